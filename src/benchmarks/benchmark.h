@@ -70,6 +70,8 @@
 #define RRAND(max, min) (rand() % ((max) - (min)) + (min))
 
 struct benchmark;
+struct benchmark_hist;
+struct benchmark_perf_counters;
 
 /*
  * benchmark_args - Arguments for benchmark.
@@ -89,6 +91,14 @@ struct benchmark_args
 	size_t dsize;			/* data size */
 	unsigned seed;			/* PRNG seed */
 	unsigned repeats;		/* number of repeats of one scenario */
+	bool latency_hist;		/* print histogram of latencies */
+	bool perf;			/* count hardware events */
+	char *output_format;		/* format of the results */
+	char *baseline;			/* file with the baseline results */
+	unsigned threshold;		/* significant change in percents */
+	char *affinity;			/* policy of pinning the workers */
+	char *cpus;			/* CPUs the workers may run on */
+	int numa_node;			/* NUMA node the workers run on */
 	bool help;			/* print help for benchmark */
 	void *opts;			/* benchmark specific arguments */
 };
@@ -201,6 +211,8 @@ struct worker_info
 	struct operation_info *opinfo;	/* operation info structure */
 	size_t nops;			/* number of operations */
 	void *priv;			/* worker's private data */
+	struct benchmark_hist *hist;	/* latencies of the operations */
+	struct benchmark_perf_counters *perf; /* hardware events, if enabled */
 };
 
 /*
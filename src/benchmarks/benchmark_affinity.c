@@ -0,0 +1,424 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * benchmark_affinity.c -- placement of the worker threads on the CPUs
+ *
+ * The CPUs the workers may run on are the ones allowed for the process,
+ * optionally narrowed down to a list of CPUs and to a single NUMA node.
+ * Without a policy each worker may run on any of them. Otherwise each
+ * worker is pinned to a single CPU, in the order given by the policy:
+ *
+ * compact -- the consecutive workers are placed as close to each other as
+ *	possible: on the hardware threads of one core, then on the other cores
+ *	of the same NUMA node,
+ * scatter -- the consecutive workers are spread as far from each other as
+ *	possible: over the NUMA nodes, then over the cores of a node and the
+ *	hardware threads of a core are used last.
+ *
+ * If there are more workers than CPUs, the CPUs are reused from the start.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark_affinity.h"
+
+#define SYSFS_CPU_DIR	"/sys/devices/system/cpu"
+
+/*
+ * affinity_policy -- the order of the CPUs assigned to the workers
+ */
+enum affinity_policy {
+	AFFINITY_NONE,
+	AFFINITY_COMPACT,
+	AFFINITY_SCATTER,
+};
+
+/*
+ * affinity_cpu -- location of a CPU in the topology of the platform
+ */
+struct affinity_cpu {
+	int cpu;
+	int node;		/* NUMA node */
+	int package;		/* physical package (socket) */
+	int core;		/* core within the package */
+	int smt_rank;		/* hardware thread within the core */
+	int core_rank;		/* core within the NUMA node */
+};
+
+struct benchmark_affinity {
+	enum affinity_policy policy;
+	cpu_set_t allowed;		/* all of the CPUs to be used */
+	int restricted;			/* fewer CPUs than for the process */
+	struct affinity_cpu *cpus;	/* the CPUs in the order of workers */
+	size_t ncpus;
+};
+
+/*
+ * affinity_read_int -- (internal) read a number from the sysfs file of
+ *	the CPU, returns -1 on error
+ */
+static int
+affinity_read_int(int cpu, const char *file)
+{
+	char path[128];
+	snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/%s", cpu, file);
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	int val;
+	if (fscanf(fp, "%d", &val) != 1)
+		val = -1;
+	fclose(fp);
+
+	return val;
+}
+
+/*
+ * affinity_node -- (internal) return the NUMA node of the CPU
+ */
+static int
+affinity_node(int cpu)
+{
+	char path[128];
+	snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d", cpu);
+
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return 0;
+
+	int node = 0;
+	struct dirent *d;
+	while ((d = readdir(dir)) != NULL) {
+		if (sscanf(d->d_name, "node%d", &node) == 1)
+			break;
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/*
+ * affinity_parse_cpus -- (internal) parse the list of CPUs, the ranges are
+ *	separated with colons because commas separate the values of arguments,
+ *	e.g. "0-3:8-11"
+ */
+static int
+affinity_parse_cpus(const char *cpus, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+
+	const char *p = cpus;
+	while (*p) {
+		char *end;
+		long first = strtol(p, &end, 10);
+		long last = first;
+		if (end == p)
+			return -1;
+
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				return -1;
+		}
+
+		if (first < 0 || last < first || last >= CPU_SETSIZE)
+			return -1;
+
+		for (long c = first; c <= last; c++)
+			CPU_SET((int)c, set);
+
+		if (*end == ':')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
+
+	return 0;
+}
+
+/*
+ * compare_compact -- (internal) order of the CPUs in compact policy
+ */
+static int
+compare_compact(const void *a, const void *b)
+{
+	const struct affinity_cpu *x = a;
+	const struct affinity_cpu *y = b;
+
+	if (x->node != y->node)
+		return x->node < y->node ? -1 : 1;
+	if (x->package != y->package)
+		return x->package < y->package ? -1 : 1;
+	if (x->core != y->core)
+		return x->core < y->core ? -1 : 1;
+	return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+/*
+ * compare_scatter -- (internal) order of the CPUs in scatter policy
+ */
+static int
+compare_scatter(const void *a, const void *b)
+{
+	const struct affinity_cpu *x = a;
+	const struct affinity_cpu *y = b;
+
+	if (x->smt_rank != y->smt_rank)
+		return x->smt_rank < y->smt_rank ? -1 : 1;
+	if (x->core_rank != y->core_rank)
+		return x->core_rank < y->core_rank ? -1 : 1;
+	if (x->node != y->node)
+		return x->node < y->node ? -1 : 1;
+	return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+/*
+ * affinity_order -- (internal) sort the CPUs in the order of the policy
+ */
+static void
+affinity_order(struct benchmark_affinity *a)
+{
+	qsort(a->cpus, a->ncpus, sizeof(*a->cpus), compare_compact);
+	if (a->policy == AFFINITY_COMPACT)
+		return;
+
+	/* rank the hardware threads of the cores and the cores of nodes */
+	for (size_t i = 0; i < a->ncpus; i++) {
+		struct affinity_cpu *c = &a->cpus[i];
+		struct affinity_cpu *prev = i ? &a->cpus[i - 1] : NULL;
+
+		if (prev == NULL || prev->node != c->node) {
+			c->core_rank = 0;
+			c->smt_rank = 0;
+		} else if (prev->package != c->package ||
+				prev->core != c->core) {
+			c->core_rank = prev->core_rank + 1;
+			c->smt_rank = 0;
+		} else {
+			c->core_rank = prev->core_rank;
+			c->smt_rank = prev->smt_rank + 1;
+		}
+	}
+
+	qsort(a->cpus, a->ncpus, sizeof(*a->cpus), compare_scatter);
+}
+
+/*
+ * benchmark_affinity_alloc -- prepare the placement of the workers
+ *
+ * policy is none, compact or scatter, cpus is a list of CPUs or "all" and
+ * node is a NUMA node or -1 for all of them.
+ */
+struct benchmark_affinity *
+benchmark_affinity_alloc(const char *policy, const char *cpus, int node)
+{
+	struct benchmark_affinity *a = calloc(1, sizeof(*a));
+	if (a == NULL) {
+		perror("calloc");
+		return NULL;
+	}
+
+	if (strcmp(policy, "none") == 0) {
+		a->policy = AFFINITY_NONE;
+	} else if (strcmp(policy, "compact") == 0) {
+		a->policy = AFFINITY_COMPACT;
+	} else if (strcmp(policy, "scatter") == 0) {
+		a->policy = AFFINITY_SCATTER;
+	} else {
+		fprintf(stderr, "invalid affinity policy -- '%s'\n", policy);
+		goto err_free;
+	}
+
+	if (sched_getaffinity(0, sizeof(a->allowed), &a->allowed)) {
+		perror("sched_getaffinity");
+		goto err_free;
+	}
+
+	if (strcmp(cpus, "all") != 0) {
+		cpu_set_t list;
+		if (affinity_parse_cpus(cpus, &list)) {
+			fprintf(stderr, "invalid list of cpus -- '%s'\n",
+					cpus);
+			goto err_free;
+		}
+		CPU_AND(&a->allowed, &a->allowed, &list);
+	}
+
+	a->cpus = calloc((size_t)CPU_COUNT(&a->allowed), sizeof(*a->cpus));
+	if (a->cpus == NULL) {
+		perror("calloc");
+		goto err_free;
+	}
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &a->allowed))
+			continue;
+
+		struct affinity_cpu *c = &a->cpus[a->ncpus];
+		c->cpu = cpu;
+		c->node = affinity_node(cpu);
+		if (node >= 0 && c->node != node) {
+			CPU_CLR(cpu, &a->allowed);
+			continue;
+		}
+
+		c->package = affinity_read_int(cpu,
+				"topology/physical_package_id");
+		c->core = affinity_read_int(cpu, "topology/core_id");
+		a->ncpus++;
+	}
+
+	if (a->ncpus == 0) {
+		fprintf(stderr, "no cpus allowed for the workers\n");
+		goto err_free_cpus;
+	}
+
+	cpu_set_t process;
+	if (sched_getaffinity(0, sizeof(process), &process) == 0)
+		a->restricted = !CPU_EQUAL(&process, &a->allowed);
+
+	affinity_order(a);
+
+	return a;
+
+err_free_cpus:
+	free(a->cpus);
+err_free:
+	free(a);
+	return NULL;
+}
+
+/*
+ * benchmark_affinity_free -- release the placement of the workers
+ */
+void
+benchmark_affinity_free(struct benchmark_affinity *a)
+{
+	free(a->cpus);
+	free(a);
+}
+
+/*
+ * affinity_get -- (internal) fill in the set of CPUs the worker may run on,
+ *	returns 1 if the worker is not restricted at all
+ */
+static int
+affinity_get(struct benchmark_affinity *a, size_t worker, cpu_set_t *set)
+{
+	if (a->policy == AFFINITY_NONE) {
+		if (a->restricted) {
+			*set = a->allowed;
+			return 0;
+		}
+
+		return 1;
+	}
+
+	CPU_ZERO(set);
+	CPU_SET(a->cpus[worker % a->ncpus].cpu, set);
+
+	return 0;
+}
+
+/*
+ * benchmark_affinity_apply -- pin the calling thread as the given worker
+ */
+int
+benchmark_affinity_apply(struct benchmark_affinity *a, size_t worker)
+{
+	cpu_set_t set;
+	if (affinity_get(a, worker, &set))
+		return 0;
+
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret) {
+		errno = ret;
+		perror("pthread_setaffinity_np");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * benchmark_affinity_str -- print the CPUs the worker runs on as a list
+ *	of ranges, or "all" if the worker is not restricted
+ */
+void
+benchmark_affinity_str(struct benchmark_affinity *a, size_t worker,
+		char *buff, size_t len)
+{
+	cpu_set_t set;
+	if (affinity_get(a, worker, &set)) {
+		snprintf(buff, len, "all");
+		return;
+	}
+
+	size_t off = 0;
+	buff[0] = '\0';
+
+	for (int cpu = 0; cpu < CPU_SETSIZE && off < len; cpu++) {
+		if (!CPU_ISSET(cpu, &set))
+			continue;
+
+		int last = cpu;
+		while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+			last++;
+
+		int ret;
+		if (last == cpu)
+			ret = snprintf(buff + off, len - off, "%s%d",
+					off ? ":" : "", cpu);
+		else
+			ret = snprintf(buff + off, len - off, "%s%d-%d",
+					off ? ":" : "", cpu, last);
+		if (ret < 0)
+			break;
+
+		off += (size_t)ret;
+		cpu = last;
+	}
+}
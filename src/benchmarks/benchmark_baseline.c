@@ -0,0 +1,217 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * benchmark_baseline.c -- comparison of the results with a baseline
+ *
+ * The baseline is a file with the results of an earlier run printed with
+ * --output-format json, one JSON object per line. The results of the same
+ * benchmark, scenario and arguments are found by the "key" member.
+ *
+ * The total times of the workers of both runs are compared with Welch's
+ * t-test at the 99% confidence level. A change is reported only if it is
+ * statistically significant and the throughput changed by more than
+ * the threshold.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark_meta.h"
+#include "benchmark_baseline.h"
+
+/* two-sided critical values of Student's t distribution for p = 0.01 */
+static const double t_crit[] = {
+	63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+	3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+	2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750,
+};
+
+/*
+ * t_critical -- (internal) return the critical value for the degrees
+ *	of freedom
+ */
+static double
+t_critical(double df)
+{
+	size_t n = sizeof(t_crit) / sizeof(t_crit[0]);
+	if (df < 1)
+		return t_crit[0];
+	if (df <= n)
+		return t_crit[(size_t)df - 1];
+	if (df <= 40)
+		return 2.704;
+	if (df <= 60)
+		return 2.660;
+	if (df <= 120)
+		return 2.617;
+	return 2.576;
+}
+
+/*
+ * baseline_get_num -- (internal) read the number of the JSON member
+ */
+static int
+baseline_get_num(const char *line, const char *name, double *val)
+{
+	char pattern[64];
+	snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+
+	const char *p = strstr(line, pattern);
+	if (p == NULL)
+		return -1;
+
+	char *end;
+	*val = strtod(p + strlen(pattern), &end);
+
+	return end == p + strlen(pattern) ? -1 : 0;
+}
+
+/*
+ * benchmark_baseline_find -- find the results with the key in the baseline,
+ *	returns 0 if found, 1 if not and -1 on error
+ */
+int
+benchmark_baseline_find(const char *path, const char *key,
+		struct benchmark_sample *s)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	/* the key is looked for as printed in the JSON object */
+	char *pattern = NULL;
+	size_t plen = 0;
+	FILE *pf = open_memstream(&pattern, &plen);
+	if (pf == NULL) {
+		perror("open_memstream");
+		fclose(fp);
+		return -1;
+	}
+	fprintf(pf, "\"key\":");
+	benchmark_meta_print_str(pf, key);
+	fclose(pf);
+
+	int ret = 1;
+	char *line = NULL;
+	size_t len = 0;
+	while (getline(&line, &len, fp) != -1) {
+		if (strstr(line, pattern) == NULL)
+			continue;
+
+		double n;
+		if (baseline_get_num(line, "total-avg", &s->avg) ||
+			baseline_get_num(line, "total-std-dev", &s->std_dev) ||
+			baseline_get_num(line, "samples", &n) ||
+			baseline_get_num(line, "ops-per-second",
+				&s->ops_per_sec)) {
+			fprintf(stderr, "%s: invalid results of %s\n",
+				path, key);
+			ret = -1;
+			break;
+		}
+
+		s->n = (uint64_t)n;
+		ret = 0;
+		break;
+	}
+
+	free(line);
+	free(pattern);
+	fclose(fp);
+
+	return ret;
+}
+
+/*
+ * benchmark_baseline_compare -- compare the results with the baseline
+ */
+void
+benchmark_baseline_compare(const struct benchmark_sample *base,
+		const struct benchmark_sample *cur, unsigned threshold,
+		struct benchmark_cmp *cmp)
+{
+	cmp->change = base->ops_per_sec > 0 ?
+		100.0 * (cur->ops_per_sec - base->ops_per_sec) /
+		base->ops_per_sec : 0;
+	cmp->t = 0;
+	cmp->df = 0;
+
+	if (base->n < 2 || cur->n < 2) {
+		cmp->status = CMP_INSUFFICIENT_SAMPLES;
+		return;
+	}
+
+	/* unbiased variances of the means */
+	double vb = base->std_dev * base->std_dev / (double)(base->n - 1);
+	double vc = cur->std_dev * cur->std_dev / (double)(cur->n - 1);
+	double se = sqrt(vb + vc);
+
+	int significant;
+	if (se > 0) {
+		cmp->t = (cur->avg - base->avg) / se;
+		cmp->df = (vb + vc) * (vb + vc) /
+			(vb * vb / (double)(base->n - 1) +
+			vc * vc / (double)(cur->n - 1));
+		significant = fabs(cmp->t) > t_critical(cmp->df);
+	} else {
+		significant = cur->avg != base->avg;
+	}
+
+	if (significant && cmp->change < -(double)threshold)
+		cmp->status = CMP_REGRESSION;
+	else if (significant && cmp->change > (double)threshold)
+		cmp->status = CMP_IMPROVEMENT;
+	else
+		cmp->status = CMP_NO_CHANGE;
+}
+
+/*
+ * benchmark_cmp_status_str -- return the name of the comparison outcome
+ */
+const char *
+benchmark_cmp_status_str(enum benchmark_cmp_status status)
+{
+	switch (status) {
+	case CMP_IMPROVEMENT:
+		return "improvement";
+	case CMP_REGRESSION:
+		return "regression";
+	case CMP_INSUFFICIENT_SAMPLES:
+		return "insufficient-samples";
+	default:
+		return "no-change";
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * benchmark_baseline.h -- declarations of benchmark_baseline module
+ */
+#include <stdint.h>
+
+/*
+ * benchmark_sample -- total times of the workers of one argument set
+ */
+struct benchmark_sample
+{
+	double avg;		/* mean total time of a worker */
+	double std_dev;		/* standard deviation of the total times */
+	uint64_t n;		/* number of the total times */
+	double ops_per_sec;	/* throughput */
+};
+
+/* outcome of the comparison with the baseline */
+enum benchmark_cmp_status {
+	CMP_NO_CHANGE,
+	CMP_IMPROVEMENT,
+	CMP_REGRESSION,
+	CMP_INSUFFICIENT_SAMPLES,
+};
+
+/*
+ * benchmark_cmp -- result of the comparison with the baseline
+ */
+struct benchmark_cmp
+{
+	double change;	/* change of the throughput in percents */
+	double t;	/* Welch's t statistic of the total times */
+	double df;	/* degrees of freedom of the t statistic */
+	enum benchmark_cmp_status status;
+};
+
+int benchmark_baseline_find(const char *path, const char *key,
+		struct benchmark_sample *s);
+void benchmark_baseline_compare(const struct benchmark_sample *base,
+		const struct benchmark_sample *cur, unsigned threshold,
+		struct benchmark_cmp *cmp);
+const char *benchmark_cmp_status_str(enum benchmark_cmp_status status);
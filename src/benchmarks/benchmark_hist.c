@@ -0,0 +1,230 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * benchmark_hist.c -- histograms of the latencies of the operations
+ *
+ * The histogram keeps the values up to 2 * HIST_SUB_COUNT nanoseconds
+ * exactly and the larger ones with a relative error below 1 / HIST_SUB_COUNT,
+ * as in the HDR histograms. Each power of two range of the values is split
+ * into HIST_SUB_COUNT buckets of equal width, so recording a value is just
+ * a few shifts and an increment.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark_hist.h"
+
+#define HIST_SUB_BITS	7
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+
+/* the magnitude of the largest value is 63 - HIST_SUB_BITS */
+#define HIST_NBUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct benchmark_hist
+{
+	uint64_t count;		/* number of the recorded values */
+	uint64_t max;		/* the largest recorded value */
+	uint64_t buckets[HIST_NBUCKETS];
+};
+
+/*
+ * hist_magnitude -- (internal) returns the number of the least significant
+ *	bits of the value which are dropped in its bucket
+ */
+static inline unsigned
+hist_magnitude(uint64_t v)
+{
+	if (v < 2 * HIST_SUB_COUNT)
+		return 0;
+
+	unsigned msb = 63 - (unsigned)__builtin_clzll(v);
+	return msb - HIST_SUB_BITS;
+}
+
+/*
+ * hist_index -- (internal) returns the index of the bucket of the value
+ */
+static inline unsigned
+hist_index(uint64_t v)
+{
+	unsigned m = hist_magnitude(v);
+	return m * HIST_SUB_COUNT + (unsigned)(v >> m);
+}
+
+/*
+ * hist_lowest -- (internal) returns the lowest value in the given bucket
+ */
+static uint64_t
+hist_lowest(unsigned idx)
+{
+	if (idx < 2 * HIST_SUB_COUNT)
+		return idx;
+
+	unsigned m = idx / HIST_SUB_COUNT - 1;
+	return (uint64_t)(idx - m * HIST_SUB_COUNT) << m;
+}
+
+/*
+ * hist_highest -- (internal) returns the highest value in the given bucket
+ */
+static uint64_t
+hist_highest(unsigned idx)
+{
+	if (idx < 2 * HIST_SUB_COUNT)
+		return idx;
+
+	unsigned m = idx / HIST_SUB_COUNT - 1;
+	return hist_lowest(idx) + ((uint64_t)1 << m) - 1;
+}
+
+/*
+ * benchmark_hist_alloc -- allocate an empty histogram
+ */
+struct benchmark_hist *
+benchmark_hist_alloc(void)
+{
+	return calloc(1, sizeof(struct benchmark_hist));
+}
+
+/*
+ * benchmark_hist_free -- release the histogram
+ */
+void
+benchmark_hist_free(struct benchmark_hist *h)
+{
+	free(h);
+}
+
+/*
+ * benchmark_hist_record -- record one latency
+ */
+void
+benchmark_hist_record(struct benchmark_hist *h, uint64_t nsecs)
+{
+	h->buckets[hist_index(nsecs)]++;
+	h->count++;
+	if (nsecs > h->max)
+		h->max = nsecs;
+}
+
+/*
+ * benchmark_hist_merge -- add all of the values recorded in the source
+ *	histogram, decreased by nsecs_sub, to the destination histogram
+ *
+ * The values are moved by the whole buckets, so the result is as precise as
+ * the histogram itself.
+ */
+void
+benchmark_hist_merge(struct benchmark_hist *dst, struct benchmark_hist *src,
+		uint64_t nsecs_sub)
+{
+	if (nsecs_sub == 0) {
+		for (unsigned i = 0; i < HIST_NBUCKETS; i++)
+			dst->buckets[i] += src->buckets[i];
+	} else {
+		for (unsigned i = 0; i < HIST_NBUCKETS; i++) {
+			if (src->buckets[i] == 0)
+				continue;
+
+			uint64_t v = hist_lowest(i);
+			v = v > nsecs_sub ? v - nsecs_sub : 0;
+			dst->buckets[hist_index(v)] += src->buckets[i];
+		}
+	}
+
+	dst->count += src->count;
+
+	uint64_t max = src->max > nsecs_sub ? src->max - nsecs_sub : 0;
+	if (max > dst->max)
+		dst->max = max;
+}
+
+/*
+ * benchmark_hist_count -- return the number of the recorded values
+ */
+uint64_t
+benchmark_hist_count(struct benchmark_hist *h)
+{
+	return h->count;
+}
+
+/*
+ * benchmark_hist_percentile -- return the value below or equal to which
+ *	the given percent of the recorded values is
+ */
+uint64_t
+benchmark_hist_percentile(struct benchmark_hist *h, double pctl)
+{
+	if (h->count == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)(pctl / 100.0 * (double)h->count + 0.5);
+	if (rank == 0)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < HIST_NBUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			uint64_t v = hist_highest(i);
+			return v < h->max ? v : h->max;
+		}
+	}
+
+	assert(0);
+	return h->max;
+}
+
+/*
+ * benchmark_hist_print -- print all of the non-empty buckets of the
+ *	histogram, along with the percent of the values up to each of them
+ */
+void
+benchmark_hist_print(struct benchmark_hist *h, FILE *out)
+{
+	fprintf(out, "latency-from;latency-to;count;percentile\n");
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < HIST_NBUCKETS; i++) {
+		if (h->buckets[i] == 0)
+			continue;
+
+		seen += h->buckets[i];
+		fprintf(out, "%ju;%ju;%ju;%f\n", hist_lowest(i),
+			hist_highest(i), h->buckets[i],
+			100.0 * (double)seen / (double)h->count);
+	}
+}
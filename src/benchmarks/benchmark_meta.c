@@ -0,0 +1,231 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * benchmark_meta.c -- description of the platform the benchmarks run on
+ *
+ * The machine-readable results carry the processor, the flush instruction
+ * and the non-temporal store threshold picked by libpmem and the environment
+ * variables which alter its behavior, so that the results taken on different
+ * systems or configurations are not compared by mistake.
+ *
+ * libpmem does not export its choices, the flush instruction is derived here
+ * from the CPUID and the environment the same way libpmem does it.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "cpu.h"
+#include "benchmark_meta.h"
+
+/* libpmem default of the non-temporal store threshold */
+#define MOVNT_THRESHOLD_DEFAULT	"256"
+
+/* environment variables altering the behavior of the libraries */
+static const char *meta_env[] = {
+	"PMEM_IS_PMEM_FORCE",
+	"PMEM_NO_CLWB",
+	"PMEM_NO_CLFLUSHOPT",
+	"PMEM_NO_FLUSH",
+	"PMEM_NO_MOVNT",
+	"PMEM_NO_AVX",
+	"PMEM_NO_AVX512F",
+	"PMEM_NO_MOVNTDQA",
+	"PMEM_MOVNT_THRESHOLD",
+	"PMEM_MOVNT_CALIBRATE",
+	"PMEMOBJ_CONF",
+};
+
+/*
+ * env_is_one -- (internal) check if the environment variable is set to 1
+ */
+static int
+env_is_one(const char *name)
+{
+	char *e = getenv(name);
+	return e && strcmp(e, "1") == 0;
+}
+
+/*
+ * meta_flush -- (internal) return the flush instruction used by libpmem
+ */
+static const char *
+meta_flush(void)
+{
+	if (env_is_one("PMEM_NO_FLUSH"))
+		return "none";
+
+	if (is_cpu_clwb_present() && !env_is_one("PMEM_NO_CLWB"))
+		return "clwb";
+
+	if (is_cpu_clflushopt_present() && !env_is_one("PMEM_NO_CLFLUSHOPT"))
+		return "clflushopt";
+
+	return "clflush";
+}
+
+/*
+ * meta_movnt -- (internal) return the non-temporal store instructions used
+ *	by libpmem
+ */
+static const char *
+meta_movnt(void)
+{
+	if (env_is_one("PMEM_NO_MOVNT"))
+		return "none";
+
+	if (is_cpu_avx512f_present() && !env_is_one("PMEM_NO_AVX512F"))
+		return "avx512f";
+
+	if (is_cpu_avx_present() && !env_is_one("PMEM_NO_AVX"))
+		return "avx";
+
+	return "sse2";
+}
+
+/*
+ * meta_movnt_threshold -- (internal) return the non-temporal store threshold
+ */
+static const char *
+meta_movnt_threshold(void)
+{
+	char *e = getenv("PMEM_MOVNT_THRESHOLD");
+	if (e)
+		return e;
+
+	if (env_is_one("PMEM_MOVNT_CALIBRATE"))
+		return "calibrated";
+
+	return MOVNT_THRESHOLD_DEFAULT;
+}
+
+/*
+ * meta_cpu_model -- (internal) read the name of the processor
+ */
+static void
+meta_cpu_model(char *buff, size_t len)
+{
+	snprintf(buff, len, "unknown");
+
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+	if (fp == NULL)
+		return;
+
+	char line[256];
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "model name", strlen("model name")) != 0)
+			continue;
+
+		char *val = strchr(line, ':');
+		if (val == NULL)
+			continue;
+
+		val += strspn(val, ": \t");
+		val[strcspn(val, "\n")] = '\0';
+		snprintf(buff, len, "%s", val);
+		break;
+	}
+
+	fclose(fp);
+}
+
+/*
+ * benchmark_meta_print_str -- print the string as a JSON string
+ */
+void
+benchmark_meta_print_str(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+/*
+ * meta_print_pair -- (internal) print a JSON member with a string value
+ */
+static void
+meta_print_pair(FILE *out, const char *name, const char *val, int first)
+{
+	if (!first)
+		fputc(',', out);
+	benchmark_meta_print_str(out, name);
+	fputc(':', out);
+	benchmark_meta_print_str(out, val);
+}
+
+/*
+ * benchmark_meta_print_json -- print the description of the platform
+ *	as a JSON object
+ */
+void
+benchmark_meta_print_json(FILE *out)
+{
+	char cpu[256];
+	meta_cpu_model(cpu, sizeof(cpu));
+
+	char ncpus[32];
+	snprintf(ncpus, sizeof(ncpus), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+
+	struct utsname u;
+	if (uname(&u))
+		memset(&u, 0, sizeof(u));
+
+	fputc('{', out);
+	meta_print_pair(out, "version", SRCVERSION, 1);
+	meta_print_pair(out, "host", u.nodename, 0);
+	meta_print_pair(out, "kernel", u.release, 0);
+	meta_print_pair(out, "cpu", cpu, 0);
+	meta_print_pair(out, "ncpus", ncpus, 0);
+	meta_print_pair(out, "flush", meta_flush(), 0);
+	meta_print_pair(out, "movnt", meta_movnt(), 0);
+	meta_print_pair(out, "movnt-threshold", meta_movnt_threshold(), 0);
+
+	fprintf(out, ",\"env\":{");
+	int first = 1;
+	for (size_t i = 0; i < sizeof(meta_env) / sizeof(meta_env[0]); i++) {
+		char *e = getenv(meta_env[i]);
+		if (e == NULL)
+			continue;
+		meta_print_pair(out, meta_env[i], e, first);
+		first = 0;
+	}
+	fprintf(out, "}}");
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * benchmark_perf.c -- hardware performance counters of the worker threads
+ *
+ * The counters are opened by each of the worker threads for itself and
+ * count only in the user space, so no special privileges are required
+ * unless perf_event_paranoid is set above 2. The events not supported by
+ * the processor (e.g. in a virtual machine) are simply not counted.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "benchmark_perf.h"
+
+/* configuration of the hardware events */
+static const uint64_t perf_event_config[MAX_PERF_EVENT] = {
+	[PERF_EVENT_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+	[PERF_EVENT_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+	[PERF_EVENT_LLC_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+struct benchmark_perf
+{
+	int leader; /* descriptor of the first counter opened */
+	unsigned mask; /* events successfully opened */
+	int fds[MAX_PERF_EVENT];
+};
+
+/*
+ * perf_event_open -- (internal) opens the counter of the given event for
+ *	the calling thread
+ */
+static int
+perf_event_open(uint64_t config, int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+ * benchmark_perf_open -- open the counters of the calling thread, returns
+ *	NULL if none of the events can be counted
+ */
+struct benchmark_perf *
+benchmark_perf_open(void)
+{
+	struct benchmark_perf *p = malloc(sizeof(*p));
+	if (p == NULL)
+		return NULL;
+
+	p->leader = -1;
+	p->mask = 0;
+
+	for (int i = 0; i < MAX_PERF_EVENT; i++) {
+		p->fds[i] = perf_event_open(perf_event_config[i], p->leader);
+		if (p->fds[i] < 0)
+			continue;
+
+		if (p->leader < 0)
+			p->leader = p->fds[i];
+		p->mask |= 1u << i;
+	}
+
+	if (p->mask == 0) {
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+/*
+ * benchmark_perf_close -- close the counters
+ */
+void
+benchmark_perf_close(struct benchmark_perf *p)
+{
+	for (int i = 0; i < MAX_PERF_EVENT; i++) {
+		if (p->mask & (1u << i))
+			close(p->fds[i]);
+	}
+
+	free(p);
+}
+
+/*
+ * benchmark_perf_start -- start counting all of the events
+ */
+void
+benchmark_perf_start(struct benchmark_perf *p)
+{
+	ioctl(p->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ * benchmark_perf_stop -- stop counting all of the events
+ */
+void
+benchmark_perf_stop(struct benchmark_perf *p)
+{
+	ioctl(p->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ * benchmark_perf_read -- read the values counted so far
+ */
+void
+benchmark_perf_read(struct benchmark_perf *p,
+		struct benchmark_perf_counters *c)
+{
+	memset(c, 0, sizeof(*c));
+
+	for (int i = 0; i < MAX_PERF_EVENT; i++) {
+		if (!(p->mask & (1u << i)))
+			continue;
+
+		uint64_t val;
+		if (read(p->fds[i], &val, sizeof(val)) != sizeof(val))
+			continue;
+
+		c->values[i] = val;
+		c->mask |= 1u << i;
+	}
+}
+
+/*
+ * benchmark_perf_init -- initialize the sum of the counters
+ */
+void
+benchmark_perf_init(struct benchmark_perf_counters *c)
+{
+	memset(c, 0, sizeof(*c));
+	c->mask = (1u << MAX_PERF_EVENT) - 1;
+}
+
+/*
+ * benchmark_perf_add -- add the values of the counters, an event is counted
+ *	in the result only if it was counted in both of them
+ */
+void
+benchmark_perf_add(struct benchmark_perf_counters *dst,
+		struct benchmark_perf_counters *src)
+{
+	dst->mask &= src->mask;
+	for (int i = 0; i < MAX_PERF_EVENT; i++)
+		dst->values[i] += src->values[i];
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * benchmark_perf.h -- declarations of benchmark_perf module
+ */
+#include <stdint.h>
+
+/* hardware events counted around the operations */
+enum benchmark_perf_event {
+	PERF_EVENT_CYCLES,
+	PERF_EVENT_INSTRUCTIONS,
+	PERF_EVENT_LLC_MISSES,
+
+	MAX_PERF_EVENT
+};
+
+/*
+ * benchmark_perf_counters -- values of the hardware counters, an event
+ * is counted only if its bit is set in the mask
+ */
+struct benchmark_perf_counters
+{
+	unsigned mask;
+	uint64_t values[MAX_PERF_EVENT];
+};
+
+struct benchmark_perf;
+
+struct benchmark_perf *benchmark_perf_open(void);
+void benchmark_perf_close(struct benchmark_perf *p);
+void benchmark_perf_start(struct benchmark_perf *p);
+void benchmark_perf_stop(struct benchmark_perf *p);
+void benchmark_perf_read(struct benchmark_perf *p,
+		struct benchmark_perf_counters *c);
+void benchmark_perf_init(struct benchmark_perf_counters *c);
+void benchmark_perf_add(struct benchmark_perf_counters *dst,
+		struct benchmark_perf_counters *src);
@@ -78,7 +78,11 @@ thread_func(void *arg)
 	worker_state_wait_for_transition(worker,
 		WORKER_STATE_IDLE, WORKER_STATE_INIT);
 
-	if (worker->init)
+	/* the worker is pinned before its init allocates anything */
+	if (worker->affinity && benchmark_affinity_apply(worker->affinity,
+			worker->info.index))
+		worker->ret_init = -1;
+	else if (worker->init)
 		worker->ret_init = worker->init(worker->bench,
 				worker->args, &worker->info);
 
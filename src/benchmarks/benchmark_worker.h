@@ -35,6 +35,7 @@
 
 #include <pthread.h>
 #include "benchmark.h"
+#include "benchmark_affinity.h"
 
 /*
  *
@@ -77,6 +78,7 @@ struct benchmark_worker
 	struct benchmark *bench;
 	struct benchmark_args *args;
 	struct worker_info info;
+	struct benchmark_affinity *affinity;
 	int ret;
 	int ret_init;
 	int (*func)(struct benchmark *bench, struct worker_info *info);
@@ -65,6 +65,8 @@ struct blk_args {
 	bool no_warmup;		/* don't do warmup */
 	unsigned seed;		/* seed for randomization */
 	bool rand;		/* random blocks */
+	unsigned queue_depth;	/* depth of the async queue, 0 for sync I/O */
+	unsigned queue_threads;	/* number of threads serving the queue */
 };
 
 /*
@@ -85,6 +87,11 @@ struct blk_worker {
 	off_t *blocks;			/* array with block numbers */
 	unsigned char *buff;		/* buffer for read/write */
 	unsigned seed;			/* worker seed */
+	PMEMblkqueue *queue;		/* async queue, NULL for sync I/O */
+	struct pmemblk_io *ios;		/* requests of the queue */
+	struct pmemblk_io **free_ios;	/* requests not in flight */
+	unsigned nfree;			/* number of free requests */
+	unsigned char *qbuff;		/* buffers of the requests */
 };
 
 static struct benchmark_clo blk_clo[] = {
@@ -139,6 +146,40 @@ static struct benchmark_clo blk_clo[] = {
 			.max	= ~0,
 		},
 	},
+	{
+		.opt_short	= 'q',
+		.opt_long	= "queue-depth",
+		.descr		= "Depth of the asynchronous I/O queue of each "
+				"thread - 0 means synchronous I/O",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct blk_args,
+						queue_depth),
+		.def		= "0",
+		.type_uint	= {
+			.size	= clo_field_size(struct blk_args,
+						queue_depth),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= UINT_MAX,
+		},
+	},
+	{
+		.opt_short	= 'Q',
+		.opt_long	= "queue-threads",
+		.descr		= "Number of threads serving each asynchronous "
+				"I/O queue",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct blk_args,
+						queue_threads),
+		.def		= "1",
+		.type_uint	= {
+			.size	= clo_field_size(struct blk_args,
+						queue_threads),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX,
+		},
+	},
 };
 
 /*
@@ -227,6 +268,80 @@ fileio_write(struct blk_bench *bb, struct benchmark_args *ba,
 	return 0;
 }
 
+/*
+ * blk_queue_reap -- wait for at least min requests of the worker's queue
+ */
+static int
+blk_queue_reap(struct blk_worker *bworker, struct benchmark_args *ba,
+		unsigned min)
+{
+	struct blk_args *bargs = ba->opts;
+	unsigned n = bargs->queue_depth - bworker->nfree;
+
+	int ret = pmemblk_queue_poll(bworker->queue,
+			&bworker->free_ios[bworker->nfree], n, min);
+	if (ret < 0) {
+		perror("pmemblk_queue_poll");
+		return -1;
+	}
+
+	for (int i = 0; i < ret; ++i) {
+		struct pmemblk_io *io = bworker->free_ios[bworker->nfree + i];
+		if (io->error) {
+			errno = io->error;
+			perror(io->opcode == PMEMBLK_IO_READ ?
+				"pmemblk_read" : "pmemblk_write");
+			return -1;
+		}
+	}
+
+	bworker->nfree += (unsigned)ret;
+
+	return 0;
+}
+
+/*
+ * blk_queue_io -- submit a request to the worker's queue
+ */
+static int
+blk_queue_io(struct blk_worker *bworker, struct benchmark_args *ba,
+		off_t off, int opcode)
+{
+	if (bworker->nfree == 0 && blk_queue_reap(bworker, ba, 1) != 0)
+		return -1;
+
+	struct pmemblk_io *io = bworker->free_ios[--bworker->nfree];
+	io->opcode = opcode;
+	io->blockno = off;
+
+	if (pmemblk_queue_submit(bworker->queue, &io, 1) != 1) {
+		perror("pmemblk_queue_submit");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * blk_queue_read -- asynchronous read function for pmemblk
+ */
+static int
+blk_queue_read(struct blk_bench *bb, struct benchmark_args *ba,
+		struct blk_worker *bworker, off_t off)
+{
+	return blk_queue_io(bworker, ba, off, PMEMBLK_IO_READ);
+}
+
+/*
+ * blk_queue_write -- asynchronous write function for pmemblk
+ */
+static int
+blk_queue_write(struct blk_bench *bb, struct benchmark_args *ba,
+		struct blk_worker *bworker, off_t off)
+{
+	return blk_queue_io(bworker, ba, off, PMEMBLK_IO_WRITE);
+}
+
 /*
  * blk_operation -- main operations for blk_read and blk_write benchmark
  */
@@ -237,7 +352,58 @@ blk_operation(struct benchmark *bench, struct operation_info *info)
 	struct blk_worker *bworker = info->worker->priv;
 
 	off_t off = bworker->blocks[info->index];
-	return bb->worker(bb, info->args, bworker, off);
+	int ret = bb->worker(bb, info->args, bworker, off);
+
+	/* the last operation waits for all of the requests in flight */
+	if (ret == 0 && bworker->queue != NULL &&
+			info->index == info->args->n_ops_per_thread - 1) {
+		struct blk_args *bargs = info->args->opts;
+		ret = blk_queue_reap(bworker, info->args,
+				bargs->queue_depth);
+	}
+
+	return ret;
+}
+
+/*
+ * blk_init_queue -- (internal) create the asynchronous queue of a worker
+ */
+static int
+blk_init_queue(struct blk_bench *bb, struct benchmark_args *args,
+		struct blk_worker *bworker)
+{
+	struct blk_args *bargs = args->opts;
+	unsigned depth = bargs->queue_depth;
+
+	bworker->ios = malloc(depth * sizeof(*bworker->ios));
+	bworker->free_ios = malloc(depth * sizeof(*bworker->free_ios));
+	bworker->qbuff = malloc(depth * args->dsize);
+	if (!bworker->ios || !bworker->free_ios || !bworker->qbuff) {
+		perror("malloc");
+		goto err;
+	}
+
+	memset(bworker->qbuff, bworker->seed, depth * args->dsize);
+
+	for (unsigned i = 0; i < depth; ++i) {
+		bworker->ios[i].buf = bworker->qbuff + i * args->dsize;
+		bworker->free_ios[i] = &bworker->ios[i];
+	}
+	bworker->nfree = depth;
+
+	bworker->queue = pmemblk_queue_new(bb->pbp, depth,
+			bargs->queue_threads);
+	if (bworker->queue == NULL) {
+		perror("pmemblk_queue_new");
+		goto err;
+	}
+
+	return 0;
+err:
+	free(bworker->qbuff);
+	free(bworker->free_ios);
+	free(bworker->ios);
+	return -1;
 }
 
 /*
@@ -285,8 +451,15 @@ blk_init_worker(struct benchmark *bench, struct benchmark_args *args,
 			bworker->blocks[i] = i % bb->blocks_per_thread;
 	}
 
+	bworker->queue = NULL;
+	if (bargs->queue_depth > 0 &&
+			blk_init_queue(bb, args, bworker) != 0)
+		goto err_queue;
+
 	worker->priv = bworker;
 	return 0;
+err_queue:
+	free(bworker->blocks);
 err_blocks:
 	free(bworker->buff);
 err_buff:
@@ -303,6 +476,12 @@ blk_free_worker(struct benchmark *bench, struct benchmark_args *args,
 		struct worker_info *worker)
 {
 	struct blk_worker *bworker = worker->priv;
+	if (bworker->queue != NULL) {
+		pmemblk_queue_delete(bworker->queue);
+		free(bworker->qbuff);
+		free(bworker->free_ios);
+		free(bworker->ios);
+	}
 	free(bworker->blocks);
 	free(bworker->buff);
 	free(bworker);
@@ -331,6 +510,11 @@ blk_init(struct blk_bench *bb, struct benchmark_args *args)
 		return -1;
 	}
 
+	if (ba->file_io && ba->queue_depth > 0) {
+		fprintf(stderr, "queue depth not supported in file-io mode\n");
+		return -1;
+	}
+
 	if (args->is_poolset) {
 		if (args->fsize < ba->fsize) {
 			fprintf(stderr, "insufficient size of poolset\n");
@@ -407,6 +591,8 @@ blk_read_init(struct benchmark *bench, struct benchmark_args *args)
 
 	if (ba->file_io)
 		bb->worker = fileio_read;
+	else if (ba->queue_depth > 0)
+		bb->worker = blk_queue_read;
 	else
 		bb->worker = blk_read;
 
@@ -438,6 +624,8 @@ blk_write_init(struct benchmark *bench, struct benchmark_args *args)
 
 	if (ba->file_io)
 		bb->worker = fileio_write;
+	else if (ba->queue_depth > 0)
+		bb->worker = blk_queue_write;
 	else
 		bb->worker = blk_write;
 
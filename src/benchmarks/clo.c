@@ -361,6 +361,16 @@ clo_check_range_params(uint64_t step, char step_type)
 	return 0;
 }
 
+/*
+ * clo_int_size -- (internal) return the size of the int or uint value
+ */
+static size_t
+clo_int_size(struct benchmark_clo *clo)
+{
+	return clo->type == CLO_TYPE_INT ? clo->type_int.size :
+		clo->type_uint.size;
+}
+
 /*
  * clo_parse_range -- (internal) parse range or value
  *
@@ -388,7 +398,7 @@ clo_parse_range(struct benchmark_clo *clo, const char *arg,
 		if (parse_single(clo, arg, &value)) {
 			ret = -1;
 		} else {
-			clo_vec_vlist_add(vlist, &value, clo->type_uint.size);
+			clo_vec_vlist_add(vlist, &value, clo_int_size(clo));
 			ret = 0;
 		}
 	} else if (ret == 4) {
@@ -474,7 +484,7 @@ clo_parse_ranges(struct benchmark_clo *clo, const char *arg,
 		goto out;
 
 	/* add list of values to CLO vector */
-	ret = clo_vec_memcpy_list(clovec, clo->off, clo->type_uint.size, vlist);
+	ret = clo_vec_memcpy_list(clovec, clo->off, clo_int_size(clo), vlist);
 out:
 	free(args);
 	clo_vec_vlist_free(vlist);
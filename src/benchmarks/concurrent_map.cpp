@@ -0,0 +1,437 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_map.cpp -- benchmarks for the libpmemobj++ concurrent_hash_map
+ */
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <libpmemobj++/concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+extern "C" {
+#include "benchmark.h"
+}
+
+#define FACTOR 2
+#define SIZE_PER_KEY 1024
+
+namespace nvobj = nvml::obj;
+
+typedef nvobj::concurrent_hash_map<uint64_t, nvobj::p<uint64_t>> map_type;
+
+struct root {
+	nvobj::persistent_ptr<map_type> map;
+};
+
+struct concurrent_map_args {
+	uint64_t max_key;
+};
+
+struct concurrent_map_worker {
+	uint64_t *keys;
+	size_t nkeys;
+};
+
+struct concurrent_map_bench {
+	nvobj::pool<root> pop;
+	map_type *map;
+	struct concurrent_map_args *margs;
+};
+
+static struct benchmark_clo concurrent_map_clos[1];
+
+/*
+ * get_key -- return 64-bit random key
+ */
+static uint64_t
+get_key(unsigned *seed, uint64_t max_key)
+{
+	unsigned key_lo = rand_r(seed);
+	unsigned key_hi = rand_r(seed);
+	uint64_t key = ((uint64_t)key_hi << 32) | key_lo;
+
+	if (max_key)
+		key = key % max_key;
+
+	return key;
+}
+
+/*
+ * concurrent_map_init -- common init function for concurrent_map_*
+ * benchmarks, creates the pool and the map, filled with the given number of
+ * keys per thread
+ */
+static int
+concurrent_map_init(struct benchmark *bench, struct benchmark_args *args,
+		    uint64_t keys_per_thread)
+{
+	assert(bench);
+	assert(args);
+	assert(args->opts);
+
+	auto *map_bench = new (std::nothrow) concurrent_map_bench;
+	if (!map_bench) {
+		perror("new");
+		return -1;
+	}
+
+	map_bench->margs = (struct concurrent_map_args *)args->opts;
+
+	size_t nkeys = args->n_threads * args->n_ops_per_thread;
+	size_t pool_size = nkeys * SIZE_PER_KEY * FACTOR;
+
+	if (args->is_poolset) {
+		if (args->fsize < pool_size) {
+			fprintf(stderr, "insufficient poolset size\n");
+			goto err_free_bench;
+		}
+
+		pool_size = 0;
+	} else {
+		if (pool_size < PMEMOBJ_MIN_POOL)
+			pool_size = PMEMOBJ_MIN_POOL;
+	}
+
+	try {
+		map_bench->pop = nvobj::pool<root>::create(
+			args->fname, "concurrent_map", pool_size, args->fmode);
+	} catch (nvml::pool_error &e) {
+		fprintf(stderr, "pool::create: %s\n", e.what());
+		goto err_free_bench;
+	}
+
+	try {
+		auto r = map_bench->pop.get_root();
+		nvobj::transaction::exec_tx(map_bench->pop, [&]() {
+			r->map = nvobj::make_persistent<map_type>();
+		});
+
+		map_bench->map = r->map.get();
+
+		for (size_t i = 0; i < args->n_threads * keys_per_thread; ++i)
+			map_bench->map->insert(map_type::value_type(i, i));
+	} catch (std::exception &e) {
+		fprintf(stderr, "map init: %s\n", e.what());
+		goto err_close;
+	}
+
+	pmembench_set_priv(bench, map_bench);
+	return 0;
+err_close:
+	map_bench->pop.close();
+err_free_bench:
+	delete map_bench;
+	return -1;
+}
+
+/*
+ * concurrent_map_insert_init -- init function for concurrent_map_insert
+ * benchmark
+ */
+static int
+concurrent_map_insert_init(struct benchmark *bench,
+			   struct benchmark_args *args)
+{
+	return concurrent_map_init(bench, args, 0);
+}
+
+/*
+ * concurrent_map_filled_init -- init function for concurrent_map_get and
+ * concurrent_map_remove benchmarks
+ */
+static int
+concurrent_map_filled_init(struct benchmark *bench,
+			   struct benchmark_args *args)
+{
+	return concurrent_map_init(bench, args, args->n_ops_per_thread);
+}
+
+/*
+ * concurrent_map_exit -- cleanup function for concurrent_map_* benchmarks
+ */
+static int
+concurrent_map_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	auto *map_bench = (concurrent_map_bench *)pmembench_get_priv(bench);
+
+	map_bench->pop.close();
+	delete map_bench;
+	return 0;
+}
+
+/*
+ * concurrent_map_init_worker -- common init worker function for
+ * concurrent_map_* benchmarks
+ */
+static concurrent_map_worker *
+concurrent_map_init_worker(struct benchmark_args *args,
+			   struct worker_info *worker)
+{
+	auto *tworker = (concurrent_map_worker *)calloc(
+		1, sizeof(concurrent_map_worker));
+	if (!tworker) {
+		perror("calloc");
+		return nullptr;
+	}
+
+	tworker->nkeys = args->n_ops_per_thread;
+	tworker->keys = (uint64_t *)malloc(tworker->nkeys *
+					   sizeof(*tworker->keys));
+	if (!tworker->keys) {
+		perror("malloc");
+		free(tworker);
+		return nullptr;
+	}
+
+	worker->priv = tworker;
+
+	return tworker;
+}
+
+/*
+ * concurrent_map_insert_init_worker -- init worker function for
+ * concurrent_map_insert benchmark, assigns random keys to the worker
+ */
+static int
+concurrent_map_insert_init_worker(struct benchmark *bench,
+				  struct benchmark_args *args,
+				  struct worker_info *worker)
+{
+	concurrent_map_worker *tworker =
+		concurrent_map_init_worker(args, worker);
+	if (!tworker)
+		return -1;
+
+	auto *margs = (struct concurrent_map_args *)args->opts;
+	unsigned seed = args->seed + worker->index;
+	for (size_t i = 0; i < tworker->nkeys; i++)
+		tworker->keys[i] = get_key(&seed, margs->max_key);
+
+	return 0;
+}
+
+/*
+ * concurrent_map_filled_init_worker -- init worker function for
+ * concurrent_map_get and concurrent_map_remove benchmarks, assigns
+ * the worker its own part of the keys in the map, in random order
+ */
+static int
+concurrent_map_filled_init_worker(struct benchmark *bench,
+				  struct benchmark_args *args,
+				  struct worker_info *worker)
+{
+	concurrent_map_worker *tworker =
+		concurrent_map_init_worker(args, worker);
+	if (!tworker)
+		return -1;
+
+	uint64_t first = worker->index * tworker->nkeys;
+	for (size_t i = 0; i < tworker->nkeys; i++)
+		tworker->keys[i] = first + i;
+
+	unsigned seed = args->seed + worker->index;
+	for (size_t i = tworker->nkeys; i > 1; i--) {
+		size_t j = get_key(&seed, i);
+		uint64_t tmp = tworker->keys[i - 1];
+		tworker->keys[i - 1] = tworker->keys[j];
+		tworker->keys[j] = tmp;
+	}
+
+	return 0;
+}
+
+/*
+ * concurrent_map_free_worker -- cleanup worker function for concurrent_map_*
+ * benchmarks
+ */
+static void
+concurrent_map_free_worker(struct benchmark *bench,
+			   struct benchmark_args *args,
+			   struct worker_info *worker)
+{
+	auto *tworker = (concurrent_map_worker *)worker->priv;
+
+	free(tworker->keys);
+	free(tworker);
+}
+
+/*
+ * concurrent_map_insert_op -- main operation for concurrent_map_insert
+ * benchmark
+ */
+static int
+concurrent_map_insert_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *map_bench = (concurrent_map_bench *)pmembench_get_priv(bench);
+	auto *tworker = (concurrent_map_worker *)info->worker->priv;
+	uint64_t key = tworker->keys[info->index];
+
+	try {
+		/* a key drawn again is already in the map */
+		map_bench->map->insert(map_type::value_type(key, key));
+	} catch (std::exception &e) {
+		fprintf(stderr, "insert: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * concurrent_map_get_op -- main operation for concurrent_map_get benchmark
+ */
+static int
+concurrent_map_get_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *map_bench = (concurrent_map_bench *)pmembench_get_priv(bench);
+	auto *tworker = (concurrent_map_worker *)info->worker->priv;
+	uint64_t key = tworker->keys[info->index];
+
+	try {
+		map_type::const_accessor acc;
+		if (!map_bench->map->find(acc, key) || acc->second != key)
+			return -1;
+	} catch (std::exception &e) {
+		fprintf(stderr, "find: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * concurrent_map_remove_op -- main operation for concurrent_map_remove
+ * benchmark
+ */
+static int
+concurrent_map_remove_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *map_bench = (concurrent_map_bench *)pmembench_get_priv(bench);
+	auto *tworker = (concurrent_map_worker *)info->worker->priv;
+	uint64_t key = tworker->keys[info->index];
+
+	try {
+		if (!map_bench->map->erase(key))
+			return -1;
+	} catch (std::exception &e) {
+		fprintf(stderr, "erase: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct benchmark_info concurrent_map_insert_info;
+static struct benchmark_info concurrent_map_get_info;
+static struct benchmark_info concurrent_map_remove_info;
+
+/*
+ * concurrent_map_info_init -- fill the common fields of the benchmark info
+ */
+static void
+concurrent_map_info_init(struct benchmark_info *info)
+{
+	info->exit = concurrent_map_exit;
+	info->free_worker = concurrent_map_free_worker;
+	info->multithread = true;
+	info->multiops = true;
+	info->measure_time = true;
+	info->clos = concurrent_map_clos;
+	info->nclos = ARRAY_SIZE(concurrent_map_clos);
+	info->opts_size = sizeof(struct concurrent_map_args);
+	info->rm_file = true;
+	info->allow_poolset = true;
+}
+
+/*
+ * concurrent_map_register -- register the concurrent_map_* benchmarks
+ *
+ * C++ has no designated initializers, so the descriptors are filled here.
+ */
+__attribute__((constructor)) static void
+concurrent_map_register(void)
+{
+	concurrent_map_clos[0].opt_short = 'M';
+	concurrent_map_clos[0].opt_long = "max-key";
+	concurrent_map_clos[0].descr = "maximum key (0 means no limit)";
+	concurrent_map_clos[0].off =
+		clo_field_offset(struct concurrent_map_args, max_key);
+	concurrent_map_clos[0].type = CLO_TYPE_UINT;
+	concurrent_map_clos[0].def = "0";
+	concurrent_map_clos[0].type_uint.size =
+		clo_field_size(struct concurrent_map_args, max_key);
+	concurrent_map_clos[0].type_uint.base = CLO_INT_BASE_DEC;
+	concurrent_map_clos[0].type_uint.min = 0;
+	concurrent_map_clos[0].type_uint.max = UINT64_MAX;
+
+	concurrent_map_info_init(&concurrent_map_insert_info);
+	concurrent_map_insert_info.name = "concurrent_map_insert";
+	concurrent_map_insert_info.brief = "Inserting to concurrent_hash_map";
+	concurrent_map_insert_info.init = concurrent_map_insert_init;
+	concurrent_map_insert_info.init_worker =
+		concurrent_map_insert_init_worker;
+	concurrent_map_insert_info.operation = concurrent_map_insert_op;
+
+	concurrent_map_info_init(&concurrent_map_get_info);
+	concurrent_map_get_info.name = "concurrent_map_get";
+	concurrent_map_get_info.brief = "concurrent_hash_map lookup";
+	concurrent_map_get_info.init = concurrent_map_filled_init;
+	concurrent_map_get_info.init_worker =
+		concurrent_map_filled_init_worker;
+	concurrent_map_get_info.operation = concurrent_map_get_op;
+
+	concurrent_map_info_init(&concurrent_map_remove_info);
+	concurrent_map_remove_info.name = "concurrent_map_remove";
+	concurrent_map_remove_info.brief = "Removing from concurrent_hash_map";
+	concurrent_map_remove_info.init = concurrent_map_filled_init;
+	concurrent_map_remove_info.init_worker =
+		concurrent_map_filled_init_worker;
+	concurrent_map_remove_info.operation = concurrent_map_remove_op;
+
+	struct benchmark_info *infos[] = {&concurrent_map_insert_info,
+					  &concurrent_map_get_info,
+					  &concurrent_map_remove_info};
+
+	for (size_t i = 0; i < ARRAY_SIZE(infos); ++i)
+		if (pmembench_register(infos[i]))
+			fprintf(stderr, "Unable to register benchmark '%s'\n",
+				infos[i]->name);
+}
@@ -50,6 +50,9 @@
 #define POOL_HDR_SIZE (3 * 4096)
 #define MIN_VEC_SIZE 1
 
+/* size of the header of a record in a framed log */
+#define FRAME_SIZE 8
+
 /*
  * prog_args - benchmark's specific command line arguments
  */
@@ -62,6 +65,8 @@ struct prog_args
 	size_t min_size;	/* minimum size for random mode */
 	bool no_warmup;		/* don't do warmup */
 	bool fileio;		/* use file io instead of pmemlog */
+	bool framed;		/* use a framed log */
+	char *mode;		/* append, reserve or batch */
 };
 
 /*
@@ -75,6 +80,7 @@ struct log_worker_info {
 	size_t buf_ptr;			/* pointer for read operations */
 	size_t *rand_sizes;
 	size_t *vec_sizes;		/* sum of sizes in vector */
+	struct pmemlog_append_op *ops;	/* appends of a batch */
 };
 
 /*
@@ -131,6 +137,13 @@ static struct benchmark_clo log_clo[] = {
 		.type		= CLO_TYPE_FLAG,
 		.off		= clo_field_offset(struct prog_args, no_warmup),
 	},
+	{
+		.opt_short	= 'F',
+		.opt_long	= "framed",
+		.descr		= "Use a framed log with checksummed records",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct prog_args, framed),
+	},
 	{
 		.opt_short	= 'm',
 		.opt_long	= "min-size",
@@ -160,6 +173,17 @@ static struct benchmark_clo log_clo[] = {
 			.max	= INT_MAX
 		}
 	},
+	/* this one is only for log_append */
+	{
+		.opt_short	= 'M',
+		.opt_long	= "mode",
+		.descr		= "Append mode: append, reserve (reserve and "
+				"commit) or batch (the vector elements are "
+				"appended as a batch of records)",
+		.off		= clo_field_offset(struct prog_args, mode),
+		.def		= "append",
+		.type		= CLO_TYPE_STR,
+	},
 };
 
 /*
@@ -254,6 +278,70 @@ log_appendv(struct benchmark *bench, struct operation_info *info)
 	return 0;
 }
 
+/*
+ * log_reserve -- performs pmemlog_reserve and pmemlog_commit operations
+ */
+static int
+log_reserve(struct benchmark *bench, struct operation_info *info)
+{
+	struct log_bench *lb = pmembench_get_priv(bench);
+	assert(lb);
+
+	struct log_worker_info *worker_info = info->worker->priv;
+	assert(worker_info);
+
+	struct iovec *iov = &worker_info->iov[info->index * lb->args->vec_size];
+	size_t size = worker_info->vec_sizes[info->index];
+
+	char *addr = pmemlog_reserve(lb->plp, size);
+	if (addr == NULL) {
+		perror("pmemlog_reserve");
+		return -1;
+	}
+
+	char *dest = addr;
+	for (int i = 0; i < lb->args->vec_size; i++) {
+		memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+		dest += iov[i].iov_len;
+	}
+
+	if (pmemlog_commit(lb->plp, addr, size) < 0) {
+		perror("pmemlog_commit");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * log_append_batch -- performs pmemlog_append_batch operation
+ */
+static int
+log_append_batch(struct benchmark *bench, struct operation_info *info)
+{
+	struct log_bench *lb = pmembench_get_priv(bench);
+	assert(lb);
+
+	struct log_worker_info *worker_info = info->worker->priv;
+	assert(worker_info);
+
+	struct iovec *iov = &worker_info->iov[info->index * lb->args->vec_size];
+
+	for (int i = 0; i < lb->args->vec_size; i++) {
+		worker_info->ops[i].plp = lb->plp;
+		worker_info->ops[i].buf = iov[i].iov_base;
+		worker_info->ops[i].count = iov[i].iov_len;
+	}
+
+	if (pmemlog_append_batch(worker_info->ops,
+			(unsigned)lb->args->vec_size) < 0) {
+		perror("pmemlog_append_batch");
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * fileio_append -- performs fileio append operation
  */
@@ -456,6 +544,14 @@ log_init_worker(struct benchmark *bench, struct benchmark_args *args,
 		goto err_free_rand_sizes;
 	}
 
+	worker_info->ops = malloc(lb->args->vec_size *
+			sizeof(*worker_info->ops));
+	if (!worker_info->ops) {
+		perror("malloc");
+		ret = -1;
+		goto err_free_vec_sizes;
+	}
+
 	/* fill up the io vectors */
 	size_t i_size = 0;
 	for (size_t n = 0; n < args->n_ops_per_thread; n++) {
@@ -480,6 +576,8 @@ log_init_worker(struct benchmark *bench, struct benchmark_args *args,
 	worker->priv = worker_info;
 
 	return 0;
+err_free_vec_sizes:
+	free(worker_info->vec_sizes);
 err_free_rand_sizes:
 	free(worker_info->rand_sizes);
 err_free_iov:
@@ -507,6 +605,7 @@ log_free_worker(struct benchmark *bench, struct benchmark_args *args,
 	free(worker_info->iov);
 	free(worker_info->rand_sizes);
 	free(worker_info->vec_sizes);
+	free(worker_info->ops);
 	free(worker_info);
 }
 
@@ -544,9 +643,12 @@ log_init(struct benchmark *bench, struct benchmark_args *args)
 			lb->args->min_size == lb->args->el_size)
 		lb->args->rand = false;
 
+	/* each vector element may be a record of a framed log */
+	size_t frame_size = lb->args->framed ? FRAME_SIZE : 0;
+
 	lb->psize = POOL_HDR_SIZE
 		+ args->n_ops_per_thread * args->n_threads
-		* lb->args->vec_size * lb->args->el_size;
+		* lb->args->vec_size * (lb->args->el_size + frame_size);
 
 	/* calculate a required pool size */
 	if (lb->psize < PMEMLOG_MIN_POOL)
@@ -565,15 +667,35 @@ log_init(struct benchmark *bench, struct benchmark_args *args)
 	struct benchmark_info *bench_info = pmembench_get_info(bench);
 
 	if (!lb->args->fileio) {
-		if ((lb->plp = pmemlog_create(args->fname,
-			lb->psize, args->fmode)) == NULL) {
-			perror("pmemlog_create");
+		/* log_read doesn't take the mode option */
+		const char *mode = lb->args->mode ? lb->args->mode : "append";
+		int (*op)(struct benchmark *, struct operation_info *);
+
+		if (strcmp(mode, "append") == 0)
+			op = (lb->args->vec_size > 1) ?
+				log_appendv : log_append;
+		else if (strcmp(mode, "reserve") == 0)
+			op = log_reserve;
+		else if (strcmp(mode, "batch") == 0)
+			op = log_append_batch;
+		else {
+			fprintf(stderr, "unknown mode: %s\n", mode);
+			errno = EINVAL;
 			ret = -1;
 			goto err_free_lb;
 		}
 
-		bench_info->operation = (lb->args->vec_size > 1) ?
-			log_appendv : log_append;
+		struct pmemlog_layout layout = { 0, 0, lb->args->framed };
+
+		if ((lb->plp = pmemlog_create_layout(args->fname,
+			lb->psize, args->fmode, &layout)) == NULL) {
+			perror("pmemlog_create_layout");
+			ret = -1;
+			goto err_free_lb;
+		}
+
+		if (bench_info->operation != log_read_op)
+			bench_info->operation = op;
 	} else {
 		int flags = O_CREAT | O_RDWR | O_SYNC;
 
@@ -668,7 +790,7 @@ static struct benchmark_info log_read_info = {
 	.operation	= log_read_op,
 	.measure_time	= true,
 	.clos		= log_clo,
-	.nclos		= ARRAY_SIZE(log_clo) - 1, /* without vector */
+	.nclos		= ARRAY_SIZE(log_clo) - 2, /* without vector and mode */
 	.opts_size	= sizeof(struct prog_args),
 	.rm_file	= true,
 	.allow_poolset	= true,
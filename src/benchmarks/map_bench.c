@@ -30,10 +30,11 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /*
- * map_bench.c -- benchmarks for: ctree, btree, rbtree, hashmap_atomic
- * and hashmap_tx from examples.
+ * map_bench.c -- benchmarks for: ctree, btree, rbtree, bptree, skiplist,
+ * cskiplist, hashmap_atomic and hashmap_tx from examples.
  */
 #include <assert.h>
+#include <math.h>
 #include <pthread.h>
 
 #include "benchmark.h"
@@ -41,6 +42,9 @@
 #include "map_ctree.h"
 #include "map_btree.h"
 #include "map_rbtree.h"
+#include "map_bptree.h"
+#include "map_skiplist.h"
+#include "map_cskiplist.h"
 #include "map_hashmap_atomic.h"
 #include "map_hashmap_tx.h"
 
@@ -66,12 +70,16 @@ struct root {
 static const struct {
 	const char *str;
 	const struct map_ops *ops;
+	bool concurrent; /* insert, remove and get are thread-safe */
 } map_types[] = {
-	{"ctree",		MAP_CTREE},
-	{"btree",		MAP_BTREE},
-	{"rbtree",		MAP_RBTREE},
-	{"hashmap_tx",		MAP_HASHMAP_TX},
-	{"hashmap_atomic",	MAP_HASHMAP_ATOMIC},
+	{"ctree",		MAP_CTREE,		false},
+	{"btree",		MAP_BTREE,		false},
+	{"rbtree",		MAP_RBTREE,		false},
+	{"bptree",		MAP_BPTREE,		false},
+	{"skiplist",		MAP_SKIPLIST,		false},
+	{"cskiplist",		MAP_CSKIPLIST,		true},
+	{"hashmap_tx",		MAP_HASHMAP_TX,		true},
+	{"hashmap_atomic",	MAP_HASHMAP_ATOMIC,	false},
 };
 
 #define MAP_TYPES_NUM	(sizeof(map_types) / sizeof(map_types[0]))
@@ -82,16 +90,61 @@ struct map_bench_args {
 	char *type;
 	bool ext_tx;
 	bool alloc;
+
+	/* arguments of the map_mixed benchmark only */
+	uint64_t records;
+	unsigned read;
+	unsigned update;
+	unsigned insert;
+	unsigned scan;
+	unsigned scan_length;
+	char *distribution;
+};
+
+/* operations of the map_mixed benchmark */
+enum map_mixed_op {
+	MAP_MIXED_READ,
+	MAP_MIXED_UPDATE,
+	MAP_MIXED_INSERT,
+	MAP_MIXED_SCAN,
+};
+
+/* distributions of the records accessed by the map_mixed benchmark */
+enum map_mixed_dist {
+	MAP_DIST_UNIFORM,
+	MAP_DIST_ZIPFIAN,
+	MAP_DIST_LATEST,
+};
+
+/* skew of the Zipfian distribution, as in YCSB */
+#define ZIPF_THETA	0.99
+
+/* number of the initial records inserted in one transaction */
+#define MAP_MIXED_LOAD_BATCH	1024
+
+/*
+ * map_zipf -- generator of the ranks of the records, from 0 (the most popular
+ * one) to n - 1, as described in "Quickly Generating Billion-Record Synthetic
+ * Databases" by J. Gray et al.
+ */
+struct map_zipf {
+	uint64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
 };
 
 struct map_bench_worker {
 	uint64_t *keys;
 	size_t nkeys;
+	enum map_mixed_op *ops; /* map_mixed only */
 };
 
 struct map_bench {
 	struct map_ctx *mapc;
 	pthread_mutex_t lock;
+	bool concurrent; /* map_insert, map_remove and map_get skip the lock */
 	PMEMobjpool *pop;
 	off_t pool_size;
 
@@ -108,6 +161,11 @@ struct map_bench {
 	int (*insert)(struct map_bench *, uint64_t);
 	int (*remove)(struct map_bench *, uint64_t);
 	int (*get)(struct map_bench *, uint64_t);
+
+	/* map_mixed only */
+	uint64_t nrecords; /* number of records in the map */
+	enum map_mixed_dist dist;
+	struct map_zipf zipf;
 };
 
 static struct benchmark_clo map_bench_clos[] = {
@@ -115,7 +173,8 @@ static struct benchmark_clo map_bench_clos[] = {
 		.opt_short	= 'T',
 		.opt_long	= "type",
 		.descr		= "Type of container "
-			"[ctree|btree|rbtree|hashmap_tx|hashmap_atomic]",
+			"[ctree|btree|rbtree|bptree|skiplist|cskiplist|"
+			"hashmap_tx|hashmap_atomic]",
 		.off		= clo_field_offset(struct map_bench_args, type),
 		.type		= CLO_TYPE_STR,
 		.def		= "ctree",
@@ -169,6 +228,102 @@ static struct benchmark_clo map_bench_clos[] = {
 	},
 };
 
+/*
+ * percent of the operations, in the map_mixed benchmark
+ */
+#define MAP_MIXED_PCT_CLO(name, field, defval, description) {\
+	.opt_short	= 0,\
+	.opt_long	= name,\
+	.descr		= description,\
+	.off		= clo_field_offset(struct map_bench_args, field),\
+	.type		= CLO_TYPE_UINT,\
+	.def		= defval,\
+	.type_uint = {\
+		.size	= clo_field_size(struct map_bench_args, field),\
+		.base	= CLO_INT_BASE_DEC,\
+		.min	= 0,\
+		.max	= 100,\
+	},\
+}
+
+static struct benchmark_clo map_mixed_clos[] = {
+	{
+		.opt_short	= 'T',
+		.opt_long	= "type",
+		.descr		= "Type of container "
+			"[ctree|btree|rbtree|bptree|skiplist|cskiplist|"
+			"hashmap_tx|hashmap_atomic]",
+		.off		= clo_field_offset(struct map_bench_args, type),
+		.type		= CLO_TYPE_STR,
+		.def		= "ctree",
+	},
+	{
+		.opt_short	= 's',
+		.opt_long	= "seed",
+		.descr		= "PRNG seed",
+		.off		= clo_field_offset(struct map_bench_args, seed),
+		.type		= CLO_TYPE_UINT,
+		.def		= "1",
+		.type_uint = {
+			.size	= clo_field_size(struct map_bench_args, seed),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX,
+		},
+	},
+	{
+		.opt_short	= 'R',
+		.opt_long	= "records",
+		.descr		= "Number of records inserted before the "
+				"operations",
+		.off		= clo_field_offset(struct map_bench_args,
+						records),
+		.type		= CLO_TYPE_UINT,
+		.def		= "100000",
+		.type_uint = {
+			.size	= clo_field_size(struct map_bench_args,
+						records),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	MAP_MIXED_PCT_CLO("read", read, "50",
+		"Percent of operations reading a record"),
+	MAP_MIXED_PCT_CLO("update", update, "50",
+		"Percent of operations updating the value of a record"),
+	MAP_MIXED_PCT_CLO("insert", insert, "0",
+		"Percent of operations inserting a new record"),
+	MAP_MIXED_PCT_CLO("scan", scan, "0",
+		"Percent of operations reading consecutive records"),
+	{
+		.opt_short	= 0,
+		.opt_long	= "scan-length",
+		.descr		= "Number of records read by a scan",
+		.off		= clo_field_offset(struct map_bench_args,
+						scan_length),
+		.type		= CLO_TYPE_UINT,
+		.def		= "10",
+		.type_uint = {
+			.size	= clo_field_size(struct map_bench_args,
+						scan_length),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX,
+		},
+	},
+	{
+		.opt_short	= 'D',
+		.opt_long	= "distribution",
+		.descr		= "Distribution of the accessed records "
+				"[uniform|zipfian|latest]",
+		.off		= clo_field_offset(struct map_bench_args,
+						distribution),
+		.type		= CLO_TYPE_STR,
+		.def		= "zipfian",
+	},
+};
+
 /*
  * mutex_lock_nofail -- locks mutex and aborts if locking failed
  */
@@ -215,16 +370,39 @@ get_key(unsigned *seed, uint64_t max_key)
  * parse_map_type -- parse type of map
  */
 static const struct map_ops *
-parse_map_type(const char *str)
+parse_map_type(const char *str, bool *concurrent)
 {
 	for (int i = 0; i < MAP_TYPES_NUM; i++) {
-		if (strcmp(str, map_types[i].str) == 0)
+		if (strcmp(str, map_types[i].str) == 0) {
+			*concurrent = map_types[i].concurrent;
 			return map_types[i].ops;
+		}
 	}
 
 	return NULL;
 }
 
+/*
+ * map_bench_lock -- serializes the operations on maps which are not
+ * thread-safe
+ */
+static void
+map_bench_lock(struct map_bench *map_bench)
+{
+	if (!map_bench->concurrent)
+		mutex_lock_nofail(&map_bench->lock);
+}
+
+/*
+ * map_bench_unlock -- counterpart of map_bench_lock
+ */
+static void
+map_bench_unlock(struct map_bench *map_bench)
+{
+	if (!map_bench->concurrent)
+		mutex_unlock_nofail(&map_bench->lock);
+}
+
 /*
  * map_remove_free_op -- remove and free object from map
  */
@@ -266,11 +444,11 @@ map_remove_op(struct benchmark *bench, struct operation_info *info)
 	struct map_bench_worker *tworker = info->worker->priv;
 	uint64_t key = tworker->keys[info->index];
 
-	mutex_lock_nofail(&map_bench->lock);
+	map_bench_lock(map_bench);
 
 	int ret = map_bench->remove(map_bench, key);
 
-	mutex_unlock_nofail(&map_bench->lock);
+	map_bench_unlock(map_bench);
 
 	return ret;
 }
@@ -314,11 +492,11 @@ map_insert_op(struct benchmark *bench, struct operation_info *info)
 	struct map_bench_worker *tworker = info->worker->priv;
 	uint64_t key = tworker->keys[info->index];
 
-	mutex_lock_nofail(&map_bench->lock);
+	map_bench_lock(map_bench);
 
 	int ret = map_bench->insert(map_bench, key);
 
-	mutex_unlock_nofail(&map_bench->lock);
+	map_bench_unlock(map_bench);
 
 	return ret;
 }
@@ -355,11 +533,11 @@ map_get_op(struct benchmark *bench, struct operation_info *info)
 	struct map_bench_worker *tworker = info->worker->priv;
 	uint64_t key = tworker->keys[info->index];
 
-	mutex_lock_nofail(&map_bench->lock);
+	map_bench_lock(map_bench);
 
 	int ret = map_bench->get(map_bench, key);
 
-	mutex_unlock_nofail(&map_bench->lock);
+	map_bench_unlock(map_bench);
 
 	return ret;
 }
@@ -532,7 +710,8 @@ map_common_init(struct benchmark *bench, struct benchmark_args *args)
 	map_bench->args = args;
 	map_bench->margs = args->opts;
 
-	const struct map_ops *ops = parse_map_type(map_bench->margs->type);
+	const struct map_ops *ops = parse_map_type(map_bench->margs->type,
+			&map_bench->concurrent);
 	if (!ops) {
 		fprintf(stderr, "invalid map type value specified -- '%s'\n",
 				map_bench->margs->type);
@@ -558,10 +737,11 @@ map_common_init(struct benchmark *bench, struct benchmark_args *args)
 	map_bench->nkeys = args->n_threads * args->n_ops_per_thread;
 	map_bench->init_nkeys = map_bench->nkeys;
 	size_t size_per_key = map_bench->margs->alloc ?
-		SIZE_PER_KEY :
-		SIZE_PER_KEY + map_bench->args->dsize + ALLOC_OVERHEAD;
+		SIZE_PER_KEY + map_bench->args->dsize + ALLOC_OVERHEAD :
+		SIZE_PER_KEY;
+	size_t nkeys = map_bench->nkeys + map_bench->margs->records;
 
-	map_bench->pool_size = map_bench->nkeys * size_per_key * FACTOR;
+	map_bench->pool_size = nkeys * size_per_key * FACTOR;
 
 	if (args->is_poolset) {
 		if (args->fsize < map_bench->pool_size) {
@@ -763,6 +943,395 @@ map_get_exit(struct benchmark *bench, struct benchmark_args *args)
 	return map_common_exit(bench, args);
 }
 
+/*
+ * map_zipf_zeta -- (internal) returns the sum of 1 / i^theta for i from 1
+ *	to n
+ */
+static double
+map_zipf_zeta(uint64_t n, double theta)
+{
+	double sum = 0;
+	for (uint64_t i = 1; i <= n; i++)
+		sum += 1.0 / pow((double)i, theta);
+
+	return sum;
+}
+
+/*
+ * map_zipf_init -- initialize the generator of Zipfian ranks of n records
+ */
+static void
+map_zipf_init(struct map_zipf *z, uint64_t n, double theta)
+{
+	z->n = n;
+	z->theta = theta;
+	z->alpha = 1.0 / (1.0 - theta);
+	z->zetan = map_zipf_zeta(n, theta);
+
+	double zeta2 = map_zipf_zeta(2, theta);
+	z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) /
+		(1.0 - zeta2 / z->zetan);
+}
+
+/*
+ * map_zipf_next -- return the rank of a record for the given uniformly
+ *	distributed number from [0, 1)
+ */
+static uint64_t
+map_zipf_next(struct map_zipf *z, double u)
+{
+	double uz = u * z->zetan;
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, z->theta))
+		return 1;
+
+	uint64_t rank = (uint64_t)((double)z->n *
+		pow(z->eta * u - z->eta + 1.0, z->alpha));
+
+	return rank < z->n ? rank : z->n - 1;
+}
+
+/*
+ * map_rand_double -- return a random number from [0, 1)
+ */
+static double
+map_rand_double(unsigned *seed)
+{
+	return (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+/*
+ * map_record_key -- return the key of the record with the given index
+ *
+ * The indexes are scattered over the whole range of the keys, so that the
+ * records inserted during the benchmark don't always go to the same end of
+ * the ordered maps. The key 0 is never used, as ctree doesn't support it.
+ */
+static uint64_t
+map_record_key(uint64_t index)
+{
+	return (index + 1) * 0x9e3779b97f4a7c15ULL;
+}
+
+/*
+ * map_record_scramble -- return the FNV-1a hash of the rank, so that the
+ *	popular records aren't next to each other
+ */
+static uint64_t
+map_record_scramble(uint64_t rank)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < 8; i++) {
+		hash ^= (rank >> (i * 8)) & 0xff;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * map_mixed_index -- return the index of the record accessed by the
+ *	operation with the given random number
+ */
+static uint64_t
+map_mixed_index(struct map_bench *map_bench, uint64_t r)
+{
+	uint64_t n = map_bench->nrecords;
+
+	switch (map_bench->dist) {
+	case MAP_DIST_ZIPFIAN:
+		return map_record_scramble(r) % n;
+	case MAP_DIST_LATEST:
+		return n - 1 - r % n;
+	default:
+		return r % n;
+	}
+}
+
+/*
+ * map_mixed_read -- read the value of the record
+ */
+static int
+map_mixed_read(struct map_bench *map_bench, uint64_t index)
+{
+	PMEMoid val = map_get(map_bench->mapc, map_bench->map,
+			map_record_key(index));
+
+	return OID_IS_NULL(val);
+}
+
+/*
+ * map_mixed_update -- overwrite the value of the record
+ */
+static int
+map_mixed_update(struct map_bench *map_bench, uint64_t index, int c)
+{
+	PMEMoid val = map_get(map_bench->mapc, map_bench->map,
+			map_record_key(index));
+	if (OID_IS_NULL(val))
+		return -1;
+
+	int ret = 0;
+	TX_BEGIN(map_bench->pop) {
+		pmemobj_tx_add_range(val, 0, map_bench->args->dsize);
+		memset(pmemobj_direct(val), c, map_bench->args->dsize);
+	} TX_ONABORT {
+		ret = -1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * map_mixed_insert -- insert the record with the next index
+ */
+static int
+map_mixed_insert(struct map_bench *map_bench)
+{
+	int ret = 0;
+	uint64_t key = map_record_key(map_bench->nrecords);
+
+	TX_BEGIN(map_bench->pop) {
+		PMEMoid oid = pmemobj_tx_zalloc(map_bench->args->dsize,
+				OBJ_TYPE_NUM);
+		ret = map_insert(map_bench->mapc, map_bench->map, key, oid);
+	} TX_ONABORT {
+		ret = -1;
+	} TX_END
+
+	if (ret == 0)
+		map_bench->nrecords++;
+
+	return ret;
+}
+
+/* state of a single scan of the map_mixed benchmark */
+struct map_mixed_scan_arg {
+	unsigned left; /* number of the records still to be read */
+	int ret;
+};
+
+/*
+ * map_mixed_scan_cb -- count down the records read by a scan
+ */
+static int
+map_mixed_scan_cb(uint64_t key, PMEMoid value, void *arg)
+{
+	struct map_mixed_scan_arg *sarg = arg;
+
+	if (OID_IS_NULL(value)) {
+		sarg->ret = -1;
+		return 1;
+	}
+
+	return --sarg->left == 0;
+}
+
+/*
+ * map_mixed_scan -- read the values of the consecutive records
+ *
+ * The ordered maps read up to scan-length records with the keys starting
+ * from the key of the record. The hashmaps can't be iterated from a given
+ * key, so the scan reads the records with the consecutive indexes instead.
+ */
+static int
+map_mixed_scan(struct map_bench *map_bench, uint64_t index)
+{
+	if (map_bench->mapc->ops->range != NULL) {
+		struct map_mixed_scan_arg sarg = {
+			.left = map_bench->margs->scan_length,
+			.ret = 0,
+		};
+		map_range(map_bench->mapc, map_bench->map,
+				map_record_key(index), UINT64_MAX,
+				map_mixed_scan_cb, &sarg);
+
+		return sarg.ret;
+	}
+
+	for (unsigned i = 0; i < map_bench->margs->scan_length; i++) {
+		if (map_mixed_read(map_bench,
+				(index + i) % map_bench->nrecords))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * map_mixed_op -- main operation for map_mixed benchmark
+ */
+static int
+map_mixed_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct map_bench *map_bench = pmembench_get_priv(bench);
+	struct map_bench_worker *tworker = info->worker->priv;
+	uint64_t r = tworker->keys[info->index];
+	int ret;
+
+	mutex_lock_nofail(&map_bench->lock);
+
+	uint64_t index = map_mixed_index(map_bench, r);
+
+	switch (tworker->ops[info->index]) {
+	case MAP_MIXED_READ:
+		ret = map_mixed_read(map_bench, index);
+		break;
+	case MAP_MIXED_UPDATE:
+		ret = map_mixed_update(map_bench, index, (int)info->index);
+		break;
+	case MAP_MIXED_INSERT:
+		ret = map_mixed_insert(map_bench);
+		break;
+	default:
+		ret = map_mixed_scan(map_bench, index);
+		break;
+	}
+
+	mutex_unlock_nofail(&map_bench->lock);
+
+	return ret;
+}
+
+/*
+ * map_mixed_init_worker -- init worker function for map_mixed benchmark,
+ *	draws the type of each of the operations and the record it accesses
+ */
+static int
+map_mixed_init_worker(struct benchmark *bench, struct benchmark_args *args,
+		struct worker_info *worker)
+{
+	int ret = map_common_init_worker(bench, args, worker);
+	if (ret)
+		return ret;
+
+	struct map_bench *map_bench = pmembench_get_priv(bench);
+	struct map_bench_args *targs = args->opts;
+	struct map_bench_worker *tworker = worker->priv;
+
+	tworker->ops = malloc(tworker->nkeys * sizeof(*tworker->ops));
+	if (!tworker->ops) {
+		perror("malloc");
+		map_common_free_worker(bench, args, worker);
+		return -1;
+	}
+
+	for (size_t i = 0; i < tworker->nkeys; i++) {
+		unsigned pct = (unsigned)rand_r(&targs->seed) % 100;
+		if (pct < targs->read)
+			tworker->ops[i] = MAP_MIXED_READ;
+		else if (pct < targs->read + targs->update)
+			tworker->ops[i] = MAP_MIXED_UPDATE;
+		else if (pct < targs->read + targs->update + targs->insert)
+			tworker->ops[i] = MAP_MIXED_INSERT;
+		else
+			tworker->ops[i] = MAP_MIXED_SCAN;
+
+		if (map_bench->dist == MAP_DIST_UNIFORM)
+			tworker->keys[i] = get_key(&targs->seed, 0);
+		else
+			tworker->keys[i] = map_zipf_next(&map_bench->zipf,
+					map_rand_double(&targs->seed));
+	}
+
+	return 0;
+}
+
+/*
+ * map_mixed_free_worker -- cleanup worker function for map_mixed benchmark
+ */
+static void
+map_mixed_free_worker(struct benchmark *bench, struct benchmark_args *args,
+		struct worker_info *worker)
+{
+	struct map_bench_worker *tworker = worker->priv;
+	free(tworker->ops);
+	map_common_free_worker(bench, args, worker);
+}
+
+/*
+ * map_mixed_load -- insert the initial records, in transactions of up to
+ *	MAP_MIXED_LOAD_BATCH records
+ */
+static int
+map_mixed_load(struct map_bench *map_bench)
+{
+	uint64_t records = map_bench->margs->records;
+
+	while (map_bench->nrecords < records) {
+		uint64_t n = records - map_bench->nrecords;
+		if (n > MAP_MIXED_LOAD_BATCH)
+			n = MAP_MIXED_LOAD_BATCH;
+
+		int ret = 0;
+		TX_BEGIN(map_bench->pop) {
+			for (uint64_t i = 0; i < n && ret == 0; i++)
+				ret = map_mixed_insert(map_bench);
+		} TX_ONABORT {
+			ret = -1;
+		} TX_END
+
+		if (ret) {
+			fprintf(stderr, "loading the records failed\n");
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * map_mixed_init -- init function for map_mixed benchmark
+ */
+static int
+map_mixed_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct map_bench_args *margs = args->opts;
+	enum map_mixed_dist dist;
+
+	if (strcmp(margs->distribution, "uniform") == 0) {
+		dist = MAP_DIST_UNIFORM;
+	} else if (strcmp(margs->distribution, "zipfian") == 0) {
+		dist = MAP_DIST_ZIPFIAN;
+	} else if (strcmp(margs->distribution, "latest") == 0) {
+		dist = MAP_DIST_LATEST;
+	} else {
+		fprintf(stderr, "invalid distribution -- '%s'\n",
+				margs->distribution);
+		return -1;
+	}
+
+	if (margs->read + margs->update + margs->insert + margs->scan != 100) {
+		fprintf(stderr, "percents of read, update, insert and scan "
+				"operations must sum up to 100\n");
+		return -1;
+	}
+
+	/* the values are always allocated, so they can be updated */
+	margs->alloc = true;
+
+	int ret = map_common_init(bench, args);
+	if (ret)
+		return ret;
+
+	struct map_bench *map_bench = pmembench_get_priv(bench);
+	map_bench->dist = dist;
+	if (dist != MAP_DIST_UNIFORM)
+		map_zipf_init(&map_bench->zipf, margs->records, ZIPF_THETA);
+
+	mutex_lock_nofail(&map_bench->lock);
+	ret = map_mixed_load(map_bench);
+	mutex_unlock_nofail(&map_bench->lock);
+
+	if (ret) {
+		map_common_exit(bench, args);
+		return ret;
+	}
+
+	return 0;
+}
+
 static struct benchmark_info map_insert_info = {
 	.name		= "map_insert",
 	.brief		= "Inserting to tree map",
@@ -819,3 +1388,22 @@ static struct benchmark_info map_get_info = {
 	.allow_poolset	= true,
 };
 REGISTER_BENCHMARK(map_get_info);
+
+static struct benchmark_info map_mixed_info = {
+	.name		= "map_mixed",
+	.brief		= "Mixed workload of reads, updates, inserts and scans",
+	.init		= map_mixed_init,
+	.exit		= map_common_exit,
+	.multithread	= true,
+	.multiops	= true,
+	.init_worker	= map_mixed_init_worker,
+	.free_worker	= map_mixed_free_worker,
+	.operation	= map_mixed_op,
+	.measure_time	= true,
+	.clos		= map_mixed_clos,
+	.nclos		= ARRAY_SIZE(map_mixed_clos),
+	.opts_size	= sizeof(struct map_bench_args),
+	.rm_file	= true,
+	.allow_poolset	= true,
+};
+REGISTER_BENCHMARK(map_mixed_info);
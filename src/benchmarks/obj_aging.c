@@ -0,0 +1,514 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_aging.c -- benchmark of the allocator on an aged heap
+ *
+ * Each of the threads keeps a working set of objects. Every operation frees
+ * one of them and allocates a new one in its place, with the size drawn from
+ * the given distribution. Which object is replaced decides the lifetimes of
+ * the objects: a random one (exponential lifetimes) or the oldest one (all
+ * of the objects live for the same number of operations).
+ *
+ * Every --report-interval operations the throughput and the fragmentation
+ * of the heap are printed to stderr, so that the results in stdout stay
+ * intact.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "libpmemobj.h"
+#include "benchmark.h"
+
+#define LAYOUT_NAME	"obj_aging"
+#define OBJ_TYPE_NUM	1
+#define MEGABYTE	((uint64_t)1 << 20)
+#define MAX_CLASSES	255
+
+/*
+ * aging_size_dist -- distributions of the sizes of the objects
+ */
+enum aging_size_dist {
+	AGING_SIZE_FIXED,	/* all of the objects are data-size bytes */
+	AGING_SIZE_UNIFORM,	/* uniform between min-size and data-size */
+	AGING_SIZE_LOG,		/* uniform logarithm of the size */
+};
+
+/*
+ * aging_lifetime -- policies of choosing the object to be replaced
+ */
+enum aging_lifetime {
+	AGING_LIFETIME_RANDOM,	/* a random object of the working set */
+	AGING_LIFETIME_FIFO,	/* the oldest object of the working set */
+};
+
+/*
+ * aging_args -- benchmark specific command line options
+ */
+struct aging_args {
+	uint64_t pool_size;	/* size of the pool in megabytes */
+	uint64_t live;		/* number of objects kept by each thread */
+	size_t min_size;	/* minimum size of the objects */
+	char *size_dist;	/* distribution of the sizes */
+	char *lifetime;		/* policy of replacing the objects */
+	uint64_t interval;	/* number of operations between reports */
+};
+
+/*
+ * aging_bench -- benchmark context
+ */
+struct aging_bench {
+	PMEMobjpool *pop;
+	struct aging_args *aa;
+	size_t max_size;
+	enum aging_size_dist size_dist;
+	enum aging_lifetime lifetime;
+
+	pthread_mutex_t report_lock;
+	uint64_t nops;		/* operations done by all of the threads */
+	uint64_t nfailed;	/* allocations which failed */
+	uint64_t live_bytes;	/* usable size of the live objects */
+	uint64_t last_nops;	/* operations at the last report */
+	benchmark_time_t last_time; /* time of the last report */
+	struct pobj_alloc_class_stats classes[MAX_CLASSES];
+};
+
+/*
+ * aging_worker -- working set of a thread
+ */
+struct aging_worker {
+	PMEMoid *objs;
+	uint64_t next;		/* the oldest object */
+	unsigned seed;
+};
+
+/*
+ * aging_rand -- (internal) returns a random 64-bit number
+ */
+static uint64_t
+aging_rand(unsigned *seed)
+{
+	uint64_t lo = (uint64_t)rand_r(seed);
+	uint64_t hi = (uint64_t)rand_r(seed);
+
+	return (hi << 32) ^ lo;
+}
+
+/*
+ * aging_size -- (internal) draws the size of a new object
+ */
+static size_t
+aging_size(struct aging_bench *ab, unsigned *seed)
+{
+	size_t min = ab->aa->min_size;
+	size_t max = ab->max_size;
+
+	switch (ab->size_dist) {
+	case AGING_SIZE_UNIFORM:
+		return min + aging_rand(seed) % (max - min + 1);
+	case AGING_SIZE_LOG: {
+		double u = (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+		double lmin = log2((double)min);
+		double lmax = log2((double)max + 1);
+		return (size_t)exp2(lmin + u * (lmax - lmin));
+	}
+	default:
+		return max;
+	}
+}
+
+/*
+ * aging_alloc -- (internal) allocates a new object in place of the given one
+ */
+static void
+aging_alloc(struct aging_bench *ab, PMEMoid *oidp, unsigned *seed)
+{
+	if (pmemobj_alloc(ab->pop, oidp, aging_size(ab, seed), OBJ_TYPE_NUM,
+			NULL, NULL)) {
+		__sync_fetch_and_add(&ab->nfailed, 1);
+		*oidp = OID_NULL;
+		return;
+	}
+
+	__sync_fetch_and_add(&ab->live_bytes,
+		pmemobj_alloc_usable_size(*oidp));
+}
+
+/*
+ * aging_free -- (internal) frees the object, if there is one
+ */
+static void
+aging_free(struct aging_bench *ab, PMEMoid *oidp)
+{
+	if (OID_IS_NULL(*oidp))
+		return;
+
+	__sync_fetch_and_sub(&ab->live_bytes,
+		pmemobj_alloc_usable_size(*oidp));
+	pmemobj_free(oidp);
+}
+
+/*
+ * aging_report -- (internal) prints the throughput since the last report
+ *	and the fragmentation of the heap
+ */
+static void
+aging_report(struct aging_bench *ab, int final)
+{
+	struct pobj_heap_stats hs;
+	if (pmemobj_heap_stats(ab->pop, &hs, ab->classes, MAX_CLASSES)) {
+		perror("pmemobj_heap_stats");
+		return;
+	}
+
+	benchmark_time_t now, diff;
+	benchmark_time_get(&now);
+	benchmark_time_diff(&diff, &ab->last_time, &now);
+	double secs = benchmark_time_get_secs(&diff);
+	uint64_t nops = ab->nops;
+
+	uint64_t used = hs.heap_size - hs.free_total;
+	uint64_t live = ab->live_bytes;
+	double frag = used ? 100.0 * (1.0 - (double)live / (double)used) : 0;
+
+	uint64_t nruns = 0;
+	unsigned nclasses = hs.nclasses < MAX_CLASSES ?
+		hs.nclasses : MAX_CLASSES;
+	for (unsigned i = 0; i < nclasses; i++)
+		nruns += ab->classes[i].nruns;
+
+	fprintf(stderr, "obj_aging: ops %ju ops-per-second %f "
+		"live %ju used %ju fragmentation %.2f%% free-huge %ju "
+		"largest-free-huge %ju free-runs %ju runs %ju failed %ju\n",
+		nops, secs > 0 ? (double)(nops - ab->last_nops) / secs : 0,
+		live, used, frag, hs.free_huge, hs.free_huge_largest,
+		hs.free_runs, nruns, ab->nfailed);
+
+	ab->last_nops = nops;
+	ab->last_time = now;
+
+	if (!final)
+		return;
+
+	fprintf(stderr, "obj_aging: class unit-size runs unloaded-runs "
+		"free-units free-bytes occupancy-0-100%%\n");
+	for (unsigned i = 0; i < nclasses; i++) {
+		struct pobj_alloc_class_stats *cs = &ab->classes[i];
+		if (cs->nruns == 0 && cs->free_units == 0)
+			continue;
+
+		fprintf(stderr, "obj_aging: %u %zu %ju %ju %ju %ju",
+			cs->class_id, cs->unit_size, cs->nruns,
+			cs->nruns_unloaded, cs->free_units,
+			cs->free_units * cs->unit_size);
+		for (unsigned b = 0; b < POBJ_RUN_OCCUPANCY_BINS; b++)
+			fprintf(stderr, "%c%ju", b ? ',' : ' ',
+				cs->run_occupancy[b]);
+		fprintf(stderr, "\n");
+	}
+}
+
+/*
+ * aging_op -- replaces one object of the working set
+ */
+static int
+aging_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct aging_bench *ab = pmembench_get_priv(bench);
+	struct aging_worker *w = info->worker->priv;
+	uint64_t live = ab->aa->live;
+
+	uint64_t i;
+	if (ab->lifetime == AGING_LIFETIME_FIFO)
+		i = w->next++ % live;
+	else
+		i = aging_rand(&w->seed) % live;
+
+	aging_free(ab, &w->objs[i]);
+	aging_alloc(ab, &w->objs[i], &w->seed);
+
+	uint64_t nops = __sync_add_and_fetch(&ab->nops, 1);
+	if (ab->aa->interval && nops % ab->aa->interval == 0) {
+		pthread_mutex_lock(&ab->report_lock);
+		aging_report(ab, 0);
+		pthread_mutex_unlock(&ab->report_lock);
+	}
+
+	return 0;
+}
+
+/*
+ * aging_init_worker -- allocates the working set of the thread
+ */
+static int
+aging_init_worker(struct benchmark *bench, struct benchmark_args *args,
+		struct worker_info *worker)
+{
+	struct aging_bench *ab = pmembench_get_priv(bench);
+
+	struct aging_worker *w = malloc(sizeof(*w));
+	if (w == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	w->objs = malloc(ab->aa->live * sizeof(*w->objs));
+	if (w->objs == NULL) {
+		perror("malloc");
+		free(w);
+		return -1;
+	}
+
+	w->next = 0;
+	w->seed = args->seed + worker->index;
+	for (uint64_t i = 0; i < ab->aa->live; i++)
+		aging_alloc(ab, &w->objs[i], &w->seed);
+
+	worker->priv = w;
+
+	return 0;
+}
+
+/*
+ * aging_free_worker -- frees the working set of the thread
+ */
+static void
+aging_free_worker(struct benchmark *bench, struct benchmark_args *args,
+		struct worker_info *worker)
+{
+	struct aging_bench *ab = pmembench_get_priv(bench);
+	struct aging_worker *w = worker->priv;
+
+	/*
+	 * The workers are freed one by one after all of the operations,
+	 * so the first one reports the state of the aged heap.
+	 */
+	if (worker->index == 0)
+		aging_report(ab, 1);
+
+	for (uint64_t i = 0; i < ab->aa->live; i++)
+		aging_free(ab, &w->objs[i]);
+
+	free(w->objs);
+	free(w);
+}
+
+/*
+ * aging_init -- benchmark initialization
+ */
+static int
+aging_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct aging_bench *ab = calloc(1, sizeof(*ab));
+	if (ab == NULL) {
+		perror("calloc");
+		return -1;
+	}
+
+	ab->aa = args->opts;
+	ab->max_size = args->dsize;
+
+	if (strcmp(ab->aa->size_dist, "fixed") == 0) {
+		ab->size_dist = AGING_SIZE_FIXED;
+	} else if (strcmp(ab->aa->size_dist, "uniform") == 0) {
+		ab->size_dist = AGING_SIZE_UNIFORM;
+	} else if (strcmp(ab->aa->size_dist, "log") == 0) {
+		ab->size_dist = AGING_SIZE_LOG;
+	} else {
+		fprintf(stderr, "invalid size distribution -- '%s'\n",
+				ab->aa->size_dist);
+		goto err_free;
+	}
+
+	if (strcmp(ab->aa->lifetime, "random") == 0) {
+		ab->lifetime = AGING_LIFETIME_RANDOM;
+	} else if (strcmp(ab->aa->lifetime, "fifo") == 0) {
+		ab->lifetime = AGING_LIFETIME_FIFO;
+	} else {
+		fprintf(stderr, "invalid lifetime -- '%s'\n",
+				ab->aa->lifetime);
+		goto err_free;
+	}
+
+	if (ab->size_dist != AGING_SIZE_FIXED &&
+			ab->aa->min_size > ab->max_size) {
+		fprintf(stderr, "min-size must not exceed data-size\n");
+		goto err_free;
+	}
+
+	size_t psize = args->is_poolset ? 0 : ab->aa->pool_size * MEGABYTE;
+	ab->pop = pmemobj_create(args->fname, LAYOUT_NAME, psize, args->fmode);
+	if (ab->pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		goto err_free;
+	}
+
+	pthread_mutex_init(&ab->report_lock, NULL);
+	benchmark_time_get(&ab->last_time);
+
+	pmembench_set_priv(bench, ab);
+
+	return 0;
+
+err_free:
+	free(ab);
+	return -1;
+}
+
+/*
+ * aging_exit -- benchmark cleanup
+ */
+static int
+aging_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct aging_bench *ab = pmembench_get_priv(bench);
+
+	pthread_mutex_destroy(&ab->report_lock);
+	pmemobj_close(ab->pop);
+	free(ab);
+
+	return 0;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo aging_clo[] = {
+	{
+		.opt_short	= 'S',
+		.opt_long	= "pool-size",
+		.descr		= "Size of the pool in megabytes",
+		.type		= CLO_TYPE_UINT,
+		.off		=
+			clo_field_offset(struct aging_args, pool_size),
+		.def		= "256",
+		.type_uint	= {
+			.size	= clo_field_size(struct aging_args, pool_size),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 8,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'l',
+		.opt_long	= "live",
+		.descr		= "Number of the objects kept by each thread",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct aging_args, live),
+		.def		= "10000",
+		.type_uint	= {
+			.size	= clo_field_size(struct aging_args, live),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'm',
+		.opt_long	= "min-size",
+		.descr		= "Minimum size of the objects",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct aging_args, min_size),
+		.def		= "64",
+		.type_uint	= {
+			.size	= clo_field_size(struct aging_args, min_size),
+			.base	= CLO_INT_BASE_DEC | CLO_INT_BASE_HEX,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'D',
+		.opt_long	= "size-dist",
+		.descr		= "Distribution of the sizes of the objects, "
+					"up to data-size: fixed, uniform or "
+					"log (uniform logarithm of the size)",
+		.type		= CLO_TYPE_STR,
+		.off		=
+			clo_field_offset(struct aging_args, size_dist),
+		.def		= "log",
+	},
+	{
+		.opt_short	= 'L',
+		.opt_long	= "lifetime",
+		.descr		= "Object replaced by each operation: random "
+					"or fifo (the oldest one)",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct aging_args, lifetime),
+		.def		= "random",
+	},
+	{
+		.opt_short	= 'I',
+		.opt_long	= "report-interval",
+		.descr		= "Number of operations between the reports "
+					"of fragmentation, 0 to report only "
+					"at the end",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct aging_args, interval),
+		.def		= "100000",
+		.ignore_in_res	= true,
+		.type_uint	= {
+			.size	= clo_field_size(struct aging_args, interval),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= UINT64_MAX,
+		},
+	},
+};
+
+/*
+ * stores information about aging benchmark
+ */
+static struct benchmark_info aging_info = {
+	.name		= "obj_aging",
+	.brief		= "Benchmark for the allocator on an aged heap",
+	.init		= aging_init,
+	.exit		= aging_exit,
+	.multithread	= true,
+	.multiops	= true,
+	.init_worker	= aging_init_worker,
+	.free_worker	= aging_free_worker,
+	.operation	= aging_op,
+	.measure_time	= true,
+	.clos		= aging_clo,
+	.nclos		= ARRAY_SIZE(aging_clo),
+	.opts_size	= sizeof(struct aging_args),
+	.rm_file	= true,
+	.allow_poolset	= true,
+};
+
+REGISTER_BENCHMARK(aging_info);
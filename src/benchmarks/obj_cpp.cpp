@@ -0,0 +1,610 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_cpp.cpp -- benchmarks of the libpmemobj++ bindings
+ *
+ * Each benchmark runs the same operation either through the C++ bindings or
+ * through the equivalent calls of the C API, so that the overhead of the
+ * bindings can be measured in isolation:
+ *
+ * obj_cpp_alloc -- transaction::exec_tx and make_persistent
+ * obj_cpp_free -- transaction::exec_tx and delete_persistent
+ * obj_cpp_add_range -- snapshotting of p<> properties in a transaction
+ * obj_cpp_deref -- persistent_ptr dereference
+ * obj_cpp_lock -- the mutex and shared_mutex wrappers
+ */
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/shared_mutex.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+extern "C" {
+#include "benchmark.h"
+}
+
+#define FACTOR 2
+#define OBJ_OVERHEAD 128
+
+namespace nvobj = nvml::obj;
+
+struct obj_cpp_obj {
+	nvobj::p<uint64_t> val;
+};
+
+struct obj_cpp_lock {
+	nvobj::mutex mtx;
+	nvobj::shared_mutex rwlock;
+};
+
+struct root {
+	nvobj::persistent_ptr<obj_cpp_lock[]> locks;
+};
+
+enum lock_type { LOCK_MUTEX, LOCK_RWLOCK_WR, LOCK_RWLOCK_RD };
+
+struct obj_cpp_args {
+	char *api;	/* cpp or c */
+	char *lock;       /* mutex, rwlock or rdlock */
+	unsigned fields;  /* number of p<> properties changed in a tx */
+	unsigned objects; /* number of objects dereferenced per operation */
+	unsigned numlocks;
+};
+
+struct obj_cpp_worker {
+	nvobj::persistent_ptr<char[]> *objs;
+	nvobj::persistent_ptr<nvobj::p<uint64_t>[]> fields;
+	nvobj::persistent_ptr<obj_cpp_obj> *ptrs;
+	uint64_t sum;
+};
+
+struct obj_cpp_bench {
+	nvobj::pool<root> pop;
+	struct obj_cpp_args *args;
+	bool cpp;
+	enum lock_type lock;
+	size_t dsize;
+	obj_cpp_lock *locks;
+};
+
+static struct benchmark_clo obj_cpp_clos[5];
+
+/*
+ * obj_cpp_init -- common init function for obj_cpp_* benchmarks, creates
+ * the pool and the locks
+ */
+static int
+obj_cpp_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench);
+	assert(args);
+	assert(args->opts);
+
+	auto *ob = new (std::nothrow) obj_cpp_bench;
+	if (!ob) {
+		perror("new");
+		return -1;
+	}
+
+	ob->args = (struct obj_cpp_args *)args->opts;
+	ob->dsize = args->dsize;
+
+	if (strcmp(ob->args->api, "cpp") == 0) {
+		ob->cpp = true;
+	} else if (strcmp(ob->args->api, "c") == 0) {
+		ob->cpp = false;
+	} else {
+		fprintf(stderr, "unknown api '%s'\n", ob->args->api);
+		goto err_free_bench;
+	}
+
+	if (strcmp(ob->args->lock, "mutex") == 0) {
+		ob->lock = LOCK_MUTEX;
+	} else if (strcmp(ob->args->lock, "rwlock") == 0) {
+		ob->lock = LOCK_RWLOCK_WR;
+	} else if (strcmp(ob->args->lock, "rdlock") == 0) {
+		ob->lock = LOCK_RWLOCK_RD;
+	} else {
+		fprintf(stderr, "unknown lock '%s'\n", ob->args->lock);
+		goto err_free_bench;
+	}
+
+	{
+		size_t per_thread = args->n_ops_per_thread *
+				(args->dsize + OBJ_OVERHEAD) +
+			ob->args->objects * OBJ_OVERHEAD +
+			ob->args->fields * sizeof(uint64_t) + OBJ_OVERHEAD;
+		size_t pool_size = (args->n_threads * per_thread +
+				    ob->args->numlocks * OBJ_OVERHEAD) *
+			FACTOR;
+
+		if (args->is_poolset) {
+			if (args->fsize < pool_size) {
+				fprintf(stderr, "insufficient poolset size\n");
+				goto err_free_bench;
+			}
+
+			pool_size = 0;
+		} else {
+			if (pool_size < PMEMOBJ_MIN_POOL)
+				pool_size = PMEMOBJ_MIN_POOL;
+		}
+
+		try {
+			ob->pop = nvobj::pool<root>::create(
+				args->fname, "obj_cpp", pool_size, args->fmode);
+		} catch (nvml::pool_error &e) {
+			fprintf(stderr, "pool::create: %s\n", e.what());
+			goto err_free_bench;
+		}
+	}
+
+	try {
+		auto r = ob->pop.get_root();
+		unsigned numlocks = ob->args->numlocks;
+		nvobj::transaction::exec_tx(ob->pop, [&]() {
+			r->locks = nvobj::make_persistent<obj_cpp_lock[]>(
+				numlocks);
+		});
+		ob->locks = r->locks.get();
+	} catch (std::exception &e) {
+		fprintf(stderr, "locks init: %s\n", e.what());
+		goto err_close;
+	}
+
+	pmembench_set_priv(bench, ob);
+	return 0;
+err_close:
+	ob->pop.close();
+err_free_bench:
+	delete ob;
+	return -1;
+}
+
+/*
+ * obj_cpp_exit -- cleanup function for obj_cpp_* benchmarks
+ */
+static int
+obj_cpp_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+
+	ob->pop.close();
+	delete ob;
+	return 0;
+}
+
+/*
+ * obj_cpp_init_worker -- init worker function for obj_cpp_* benchmarks,
+ * allocates whatever the benchmark works on, outside of the measured part
+ */
+static int
+obj_cpp_init_worker(struct benchmark *bench, struct benchmark_args *args,
+		    struct worker_info *worker)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	const char *name = pmembench_get_info(bench)->name;
+
+	auto *tworker = new (std::nothrow) obj_cpp_worker();
+	if (!tworker) {
+		perror("new");
+		return -1;
+	}
+
+	tworker->objs = new (std::nothrow)
+		nvobj::persistent_ptr<char[]>[args->n_ops_per_thread];
+	tworker->ptrs = new (std::nothrow)
+		nvobj::persistent_ptr<obj_cpp_obj>[ob->args->objects];
+	if (!tworker->objs || !tworker->ptrs) {
+		perror("new");
+		goto err;
+	}
+
+	try {
+		size_t dsize = ob->dsize;
+		if (strcmp(name, "obj_cpp_free") == 0) {
+			for (size_t i = 0; i < args->n_ops_per_thread; i++)
+				nvobj::transaction::exec_tx(ob->pop, [&]() {
+					auto &obj = tworker->objs[i];
+					obj = nvobj::make_persistent<char[]>(
+						dsize);
+				});
+		}
+
+		unsigned fields = ob->args->fields;
+		nvobj::transaction::exec_tx(ob->pop, [&]() {
+			tworker->fields = nvobj::make_persistent<
+				nvobj::p<uint64_t>[]>(fields);
+		});
+
+		for (unsigned i = 0; i < ob->args->objects; i++)
+			nvobj::transaction::exec_tx(ob->pop, [&]() {
+				tworker->ptrs[i] =
+					nvobj::make_persistent<obj_cpp_obj>();
+				tworker->ptrs[i]->val = i;
+			});
+	} catch (std::exception &e) {
+		fprintf(stderr, "worker init: %s\n", e.what());
+		goto err;
+	}
+
+	worker->priv = tworker;
+	return 0;
+err:
+	delete[] tworker->objs;
+	delete[] tworker->ptrs;
+	delete tworker;
+	return -1;
+}
+
+/*
+ * obj_cpp_free_worker -- cleanup worker function for obj_cpp_* benchmarks
+ *
+ * The objects stay in the pool, which is removed afterwards anyway.
+ */
+static void
+obj_cpp_free_worker(struct benchmark *bench, struct benchmark_args *args,
+		    struct worker_info *worker)
+{
+	auto *tworker = (obj_cpp_worker *)worker->priv;
+
+	delete[] tworker->objs;
+	delete[] tworker->ptrs;
+	delete tworker;
+}
+
+/*
+ * obj_cpp_alloc_op -- main operation for obj_cpp_alloc benchmark
+ */
+static int
+obj_cpp_alloc_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	auto *tworker = (obj_cpp_worker *)info->worker->priv;
+	auto &obj = tworker->objs[info->index];
+
+	if (!ob->cpp) {
+		if (pmemobj_tx_begin(ob->pop.get_handle(), nullptr,
+				     TX_LOCK_NONE))
+			return -1;
+		PMEMoid oid = pmemobj_tx_alloc(ob->dsize, 0);
+		if (OID_IS_NULL(oid)) {
+			pmemobj_tx_end();
+			return -1;
+		}
+		pmemobj_tx_commit();
+		pmemobj_tx_end();
+		obj = oid;
+		return 0;
+	}
+
+	try {
+		nvobj::transaction::exec_tx(ob->pop, [&]() {
+			obj = nvobj::make_persistent<char[]>(ob->dsize);
+		});
+	} catch (std::exception &e) {
+		fprintf(stderr, "make_persistent: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * obj_cpp_free_op -- main operation for obj_cpp_free benchmark
+ */
+static int
+obj_cpp_free_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	auto *tworker = (obj_cpp_worker *)info->worker->priv;
+	auto &obj = tworker->objs[info->index];
+
+	if (!ob->cpp) {
+		if (pmemobj_tx_begin(ob->pop.get_handle(), nullptr,
+				     TX_LOCK_NONE))
+			return -1;
+		if (pmemobj_tx_free(obj.raw())) {
+			pmemobj_tx_end();
+			return -1;
+		}
+		pmemobj_tx_commit();
+		pmemobj_tx_end();
+		return 0;
+	}
+
+	try {
+		nvobj::transaction::exec_tx(ob->pop, [&]() {
+			nvobj::delete_persistent<char[]>(obj, ob->dsize);
+		});
+	} catch (std::exception &e) {
+		fprintf(stderr, "delete_persistent: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * obj_cpp_add_range_op -- main operation for obj_cpp_add_range benchmark
+ *
+ * Every p<> assignment snapshots its own property, so the C variant adds
+ * each of the fields to the transaction separately as well.
+ */
+static int
+obj_cpp_add_range_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	auto *tworker = (obj_cpp_worker *)info->worker->priv;
+	unsigned fields = ob->args->fields;
+	uint64_t val = info->index;
+
+	if (!ob->cpp) {
+		auto *f = (uint64_t *)pmemobj_direct(tworker->fields.raw());
+		if (pmemobj_tx_begin(ob->pop.get_handle(), nullptr,
+				     TX_LOCK_NONE))
+			return -1;
+		for (unsigned i = 0; i < fields; i++) {
+			if (pmemobj_tx_add_range_direct(&f[i], sizeof(f[i]))) {
+				pmemobj_tx_end();
+				return -1;
+			}
+			f[i] = val;
+		}
+		pmemobj_tx_commit();
+		pmemobj_tx_end();
+		return 0;
+	}
+
+	try {
+		nvobj::transaction::exec_tx(ob->pop, [&]() {
+			for (unsigned i = 0; i < fields; i++)
+				tworker->fields[i] = val;
+		});
+	} catch (std::exception &e) {
+		fprintf(stderr, "transaction: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * obj_cpp_deref_op -- main operation for obj_cpp_deref benchmark
+ */
+static int
+obj_cpp_deref_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	auto *tworker = (obj_cpp_worker *)info->worker->priv;
+	unsigned objects = ob->args->objects;
+	uint64_t sum = 0;
+
+	if (!ob->cpp) {
+		for (unsigned i = 0; i < objects; i++)
+			sum += *(uint64_t *)pmemobj_direct(
+				tworker->ptrs[i].raw());
+	} else {
+		for (unsigned i = 0; i < objects; i++)
+			sum += tworker->ptrs[i]->val;
+	}
+
+	/* keeps the loads from being optimized out */
+	tworker->sum += sum;
+
+	return 0;
+}
+
+/*
+ * obj_cpp_lock_op -- main operation for obj_cpp_lock benchmark, takes and
+ * releases all of the locks one by one
+ */
+static int
+obj_cpp_lock_op(struct benchmark *bench, struct operation_info *info)
+{
+	auto *ob = (obj_cpp_bench *)pmembench_get_priv(bench);
+	PMEMobjpool *pop = ob->pop.get_handle();
+	unsigned numlocks = ob->args->numlocks;
+
+	if (!ob->cpp) {
+		for (unsigned i = 0; i < numlocks; i++) {
+			obj_cpp_lock &l = ob->locks[i];
+			int ret;
+			switch (ob->lock) {
+				case LOCK_MUTEX:
+					ret = pmemobj_mutex_lock(
+						pop, l.mtx.native_handle());
+					break;
+				case LOCK_RWLOCK_WR:
+					ret = pmemobj_rwlock_wrlock(
+						pop, l.rwlock.native_handle());
+					break;
+				default:
+					ret = pmemobj_rwlock_rdlock(
+						pop, l.rwlock.native_handle());
+					break;
+			}
+			if (ret)
+				return -1;
+
+			if (ob->lock == LOCK_MUTEX)
+				ret = pmemobj_mutex_unlock(
+					pop, l.mtx.native_handle());
+			else
+				ret = pmemobj_rwlock_unlock(
+					pop, l.rwlock.native_handle());
+			if (ret)
+				return -1;
+		}
+		return 0;
+	}
+
+	try {
+		for (unsigned i = 0; i < numlocks; i++) {
+			obj_cpp_lock &l = ob->locks[i];
+			switch (ob->lock) {
+				case LOCK_MUTEX:
+					l.mtx.lock();
+					l.mtx.unlock();
+					break;
+				case LOCK_RWLOCK_WR:
+					l.rwlock.lock();
+					l.rwlock.unlock();
+					break;
+				default:
+					l.rwlock.lock_shared();
+					l.rwlock.unlock_shared();
+					break;
+			}
+		}
+	} catch (std::exception &e) {
+		fprintf(stderr, "lock: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct benchmark_info obj_cpp_alloc_info;
+static struct benchmark_info obj_cpp_free_info;
+static struct benchmark_info obj_cpp_add_range_info;
+static struct benchmark_info obj_cpp_deref_info;
+static struct benchmark_info obj_cpp_lock_info;
+
+/*
+ * obj_cpp_info_init -- fill the common fields of the benchmark info
+ */
+static void
+obj_cpp_info_init(struct benchmark_info *info, const char *name,
+		  const char *brief,
+		  int (*op)(struct benchmark *, struct operation_info *))
+{
+	info->name = name;
+	info->brief = brief;
+	info->init = obj_cpp_init;
+	info->exit = obj_cpp_exit;
+	info->init_worker = obj_cpp_init_worker;
+	info->free_worker = obj_cpp_free_worker;
+	info->operation = op;
+	info->multithread = true;
+	info->multiops = true;
+	info->measure_time = true;
+	info->clos = obj_cpp_clos;
+	info->nclos = ARRAY_SIZE(obj_cpp_clos);
+	info->opts_size = sizeof(struct obj_cpp_args);
+	info->rm_file = true;
+	info->allow_poolset = true;
+}
+
+/*
+ * obj_cpp_clo_uint -- fill the descriptor of an unsigned option
+ */
+static void
+obj_cpp_clo_uint(struct benchmark_clo *clo, const char *opt_long,
+		 const char *descr, size_t off, const char *def)
+{
+	clo->opt_long = opt_long;
+	clo->descr = descr;
+	clo->off = off;
+	clo->type = CLO_TYPE_UINT;
+	clo->def = def;
+	clo->type_uint.size = sizeof(unsigned);
+	clo->type_uint.base = CLO_INT_BASE_DEC;
+	clo->type_uint.min = 1;
+	clo->type_uint.max = UINT_MAX;
+}
+
+/*
+ * obj_cpp_register -- register the obj_cpp_* benchmarks
+ *
+ * C++ has no designated initializers, so the descriptors are filled here.
+ */
+__attribute__((constructor)) static void
+obj_cpp_register(void)
+{
+	obj_cpp_clos[0].opt_long = "api";
+	obj_cpp_clos[0].descr = "API used for the operations: cpp or c";
+	obj_cpp_clos[0].off = clo_field_offset(struct obj_cpp_args, api);
+	obj_cpp_clos[0].type = CLO_TYPE_STR;
+	obj_cpp_clos[0].def = "cpp";
+
+	obj_cpp_clos[1].opt_long = "lock";
+	obj_cpp_clos[1].descr = "Lock taken by obj_cpp_lock: mutex, rwlock "
+				"or rdlock";
+	obj_cpp_clos[1].off = clo_field_offset(struct obj_cpp_args, lock);
+	obj_cpp_clos[1].type = CLO_TYPE_STR;
+	obj_cpp_clos[1].def = "mutex";
+
+	obj_cpp_clo_uint(&obj_cpp_clos[2], "fields",
+			 "Number of p<> properties changed in a transaction",
+			 clo_field_offset(struct obj_cpp_args, fields), "1");
+	obj_cpp_clo_uint(&obj_cpp_clos[3], "objects",
+			 "Number of objects dereferenced per operation",
+			 clo_field_offset(struct obj_cpp_args, objects), "1");
+	obj_cpp_clo_uint(&obj_cpp_clos[4], "numlocks",
+			 "Number of locks taken per operation",
+			 clo_field_offset(struct obj_cpp_args, numlocks), "1");
+
+	obj_cpp_info_init(&obj_cpp_alloc_info, "obj_cpp_alloc",
+			  "make_persistent in a transaction",
+			  obj_cpp_alloc_op);
+	obj_cpp_info_init(&obj_cpp_free_info, "obj_cpp_free",
+			  "delete_persistent in a transaction",
+			  obj_cpp_free_op);
+	obj_cpp_info_init(&obj_cpp_add_range_info, "obj_cpp_add_range",
+			  "Snapshotting of p<> properties",
+			  obj_cpp_add_range_op);
+	obj_cpp_info_init(&obj_cpp_deref_info, "obj_cpp_deref",
+			  "persistent_ptr dereference", obj_cpp_deref_op);
+	obj_cpp_info_init(&obj_cpp_lock_info, "obj_cpp_lock",
+			  "mutex and shared_mutex wrappers", obj_cpp_lock_op);
+
+	struct benchmark_info *infos[] = {
+		&obj_cpp_alloc_info, &obj_cpp_free_info,
+		&obj_cpp_add_range_info, &obj_cpp_deref_info,
+		&obj_cpp_lock_info};
+
+	for (size_t i = 0; i < ARRAY_SIZE(infos); ++i)
+		if (pmembench_register(infos[i]))
+			fprintf(stderr, "Unable to register benchmark '%s'\n",
+				infos[i]->name);
+}
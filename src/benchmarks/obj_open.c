@@ -0,0 +1,541 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_open.c -- benchmark of opening of a pool which was prepared with the
+ * given fill level, fragmentation of the heap and number of transactions
+ * interrupted by a crash
+ *
+ * The pool is prepared once, in a template file, and copied before each
+ * of the operations, so that every open has the same lanes to recover.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "libpmemobj.h"
+#include "benchmark.h"
+
+#define LAYOUT_NAME	"obj_open"
+#define OBJ_TYPE_NUM	1
+#define MEGABYTE	((uint64_t)1 << 20)
+#define COPY_BUFF_SIZE	(1 << 20)
+
+/* size of the range of the root object modified by each of the crashed tx */
+#define INFLIGHT_RANGE	64
+
+/*
+ * open_mode -- the part of the open measured by the operation
+ */
+enum open_mode {
+	OPEN_MODE_OPEN,		/* pmemobj_open, including the recovery */
+	OPEN_MODE_ALLOC,	/* the first allocation after the open */
+};
+
+/*
+ * open_args -- benchmark specific command line options
+ */
+struct open_args {
+	uint64_t pool_size;	/* size of the pool in megabytes */
+	unsigned fill;		/* percent of the heap filled with objects */
+	unsigned frag;		/* percent of the objects freed afterwards */
+	unsigned inflight;	/* number of interrupted transactions */
+	char *mode;		/* part of the open to be measured */
+};
+
+/*
+ * open_bench -- benchmark context
+ */
+struct open_bench {
+	struct open_args *oa;
+	enum open_mode mode;
+	char *template;		/* path of the prepared pool */
+	PMEMobjpool *pop;	/* pool opened by the current operation */
+	uint64_t nobjs;		/* number of objects left in the pool */
+};
+
+/*
+ * inflight_tx -- arguments of a thread interrupted in the middle of a tx
+ */
+struct inflight_tx {
+	PMEMobjpool *pop;
+	unsigned index;
+	size_t size;
+	pthread_barrier_t *barrier;
+	int failed;
+};
+
+/*
+ * open_copy_file -- (internal) copy the template of the pool
+ */
+static int
+open_copy_file(const char *src, const char *dst, mode_t mode)
+{
+	int ret = -1;
+	int sfd = open(src, O_RDONLY);
+	if (sfd < 0) {
+		perror(src);
+		return -1;
+	}
+
+	int dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (dfd < 0) {
+		perror(dst);
+		goto out_close_src;
+	}
+
+	char *buff = malloc(COPY_BUFF_SIZE);
+	if (buff == NULL) {
+		perror("malloc");
+		goto out_close_dst;
+	}
+
+	ssize_t n;
+	while ((n = read(sfd, buff, COPY_BUFF_SIZE)) > 0) {
+		if (write(dfd, buff, (size_t)n) != n) {
+			perror(dst);
+			goto out_free;
+		}
+	}
+
+	if (n < 0) {
+		perror(src);
+		goto out_free;
+	}
+
+	ret = 0;
+out_free:
+	free(buff);
+out_close_dst:
+	close(dfd);
+out_close_src:
+	close(sfd);
+	return ret;
+}
+
+/*
+ * open_fill -- (internal) fill the given percent of the heap with objects,
+ *	then free the given percent of them, picked at random
+ */
+static int
+open_fill(struct open_bench *ob, PMEMobjpool *pop,
+		struct benchmark_args *args)
+{
+	uint64_t size = ob->oa->pool_size * MEGABYTE * ob->oa->fill / 100;
+	uint64_t nobjs = size / args->dsize;
+
+	PMEMoid *oids = malloc(nobjs * sizeof(*oids));
+	if (oids == NULL && nobjs != 0) {
+		perror("malloc");
+		return -1;
+	}
+
+	uint64_t n;
+	for (n = 0; n < nobjs; n++) {
+		if (pmemobj_alloc(pop, &oids[n], args->dsize, OBJ_TYPE_NUM,
+				NULL, NULL))
+			break;
+	}
+
+	if (n < nobjs)
+		fprintf(stderr, "the pool was filled with %ju of %ju "
+				"objects\n", n, nobjs);
+
+	unsigned seed = args->seed;
+	uint64_t nfree = n * ob->oa->frag / 100;
+	for (uint64_t i = 0; i < nfree; i++) {
+		uint64_t j = i + (uint64_t)rand_r(&seed) % (n - i);
+		PMEMoid oid = oids[j];
+		oids[j] = oids[i];
+		pmemobj_free(&oid);
+	}
+
+	ob->nobjs = n - nfree;
+	free(oids);
+
+	return 0;
+}
+
+/*
+ * open_inflight_worker -- (internal) start a transaction and wait in it
+ *	until the process is terminated
+ */
+static void *
+open_inflight_worker(void *arg)
+{
+	struct inflight_tx *tx = arg;
+	PMEMoid root = pmemobj_root(tx->pop, 0);
+
+	TX_BEGIN(tx->pop) {
+		pmemobj_tx_alloc(tx->size, OBJ_TYPE_NUM);
+		pmemobj_tx_add_range(root, tx->index * INFLIGHT_RANGE,
+				INFLIGHT_RANGE);
+		memset((char *)pmemobj_direct(root) +
+				tx->index * INFLIGHT_RANGE, 0xff,
+				INFLIGHT_RANGE);
+
+		pthread_barrier_wait(tx->barrier);
+		for (;;)
+			pause();
+	} TX_ONABORT {
+		/* e.g. there is no memory left for the allocation */
+		tx->failed = 1;
+		pthread_barrier_wait(tx->barrier);
+	} TX_END
+
+	return NULL;
+}
+
+/*
+ * open_crash -- (internal) interrupt the given number of transactions by
+ *	terminating the process in which they were started
+ *
+ * Each of the transactions holds its own lane, so there are as many lanes
+ * to be recovered on the next open.
+ */
+static int
+open_crash(const char *path, unsigned inflight, size_t size)
+{
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		PMEMobjpool *pop = pmemobj_open(path, LAYOUT_NAME);
+		if (pop == NULL)
+			_exit(1);
+
+		pthread_barrier_t barrier;
+		pthread_barrier_init(&barrier, NULL, inflight + 1);
+
+		struct inflight_tx *txs = calloc(inflight, sizeof(*txs));
+		if (txs == NULL)
+			_exit(1);
+
+		for (unsigned i = 0; i < inflight; i++) {
+			txs[i].pop = pop;
+			txs[i].index = i;
+			txs[i].size = size;
+			txs[i].barrier = &barrier;
+
+			pthread_t thread;
+			if (pthread_create(&thread, NULL,
+					open_inflight_worker, &txs[i]))
+				_exit(1);
+		}
+
+		/* all of the transactions are in progress or failed */
+		pthread_barrier_wait(&barrier);
+		for (unsigned i = 0; i < inflight; i++) {
+			if (txs[i].failed)
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+			WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "interrupting the transactions failed, "
+			"the pool may be too small for %u of them\n",
+			inflight);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * open_prepare -- (internal) prepare the template of the pool
+ */
+static int
+open_prepare(struct open_bench *ob, struct benchmark_args *args)
+{
+	PMEMobjpool *pop = pmemobj_create(ob->template, LAYOUT_NAME,
+			ob->oa->pool_size * MEGABYTE, args->fmode);
+	if (pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		return -1;
+	}
+
+	if (ob->oa->inflight &&
+			OID_IS_NULL(pmemobj_root(pop,
+				ob->oa->inflight * INFLIGHT_RANGE))) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		pmemobj_close(pop);
+		return -1;
+	}
+
+	int ret = open_fill(ob, pop, args);
+	pmemobj_close(pop);
+	if (ret)
+		return ret;
+
+	if (ob->oa->inflight)
+		return open_crash(ob->template, ob->oa->inflight, args->dsize);
+
+	return 0;
+}
+
+/*
+ * open_init -- benchmark initialization
+ */
+static int
+open_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct open_bench *ob = calloc(1, sizeof(*ob));
+	if (ob == NULL) {
+		perror("calloc");
+		return -1;
+	}
+
+	ob->oa = args->opts;
+
+	if (strcmp(ob->oa->mode, "open") == 0) {
+		ob->mode = OPEN_MODE_OPEN;
+	} else if (strcmp(ob->oa->mode, "alloc") == 0) {
+		ob->mode = OPEN_MODE_ALLOC;
+	} else {
+		fprintf(stderr, "invalid mode -- '%s'\n", ob->oa->mode);
+		goto err_free;
+	}
+
+	if (ob->oa->pool_size * MEGABYTE < PMEMOBJ_MIN_POOL) {
+		fprintf(stderr, "the pool must be at least %zu MB\n",
+				PMEMOBJ_MIN_POOL / MEGABYTE);
+		goto err_free;
+	}
+
+	ob->template = malloc(strlen(args->fname) + sizeof(".template"));
+	if (ob->template == NULL) {
+		perror("malloc");
+		goto err_free;
+	}
+	sprintf(ob->template, "%s.template", args->fname);
+	unlink(ob->template);
+
+	if (open_prepare(ob, args))
+		goto err_unlink;
+
+	pmembench_set_priv(bench, ob);
+
+	return 0;
+
+err_unlink:
+	unlink(ob->template);
+	free(ob->template);
+err_free:
+	free(ob);
+	return -1;
+}
+
+/*
+ * open_exit -- benchmark clean up
+ */
+static int
+open_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct open_bench *ob = pmembench_get_priv(bench);
+
+	unlink(ob->template);
+	free(ob->template);
+	free(ob);
+
+	return 0;
+}
+
+/*
+ * open_op_init -- restore the prepared pool and, if the allocation is
+ *	measured, open it
+ */
+static int
+open_op_init(struct benchmark *bench, struct operation_info *info)
+{
+	struct open_bench *ob = pmembench_get_priv(bench);
+	struct benchmark_args *args = info->args;
+
+	if (open_copy_file(ob->template, args->fname, args->fmode))
+		return -1;
+
+	if (ob->mode == OPEN_MODE_OPEN)
+		return 0;
+
+	ob->pop = pmemobj_open(args->fname, LAYOUT_NAME);
+	if (ob->pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * open_op -- open the pool or allocate the first object in it
+ */
+static int
+open_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct open_bench *ob = pmembench_get_priv(bench);
+
+	if (ob->mode == OPEN_MODE_OPEN) {
+		ob->pop = pmemobj_open(info->args->fname, LAYOUT_NAME);
+		if (ob->pop == NULL) {
+			fprintf(stderr, "%s\n", pmemobj_errormsg());
+			return -1;
+		}
+
+		return 0;
+	}
+
+	PMEMoid oid;
+	return pmemobj_alloc(ob->pop, &oid, info->args->dsize, OBJ_TYPE_NUM,
+			NULL, NULL);
+}
+
+/*
+ * open_op_exit -- close the pool
+ */
+static int
+open_op_exit(struct benchmark *bench, struct operation_info *info)
+{
+	struct open_bench *ob = pmembench_get_priv(bench);
+
+	pmemobj_close(ob->pop);
+	ob->pop = NULL;
+
+	return 0;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo open_clo[] = {
+	{
+		.opt_short	= 'S',
+		.opt_long	= "pool-size",
+		.descr		= "Size of the pool in megabytes",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct open_args, pool_size),
+		.def		= "64",
+		.type_uint	= {
+			.size	= clo_field_size(struct open_args, pool_size),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'F',
+		.opt_long	= "fill",
+		.descr		= "Percent of the pool filled with objects",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct open_args, fill),
+		.def		= "50",
+		.type_uint	= {
+			.size	= clo_field_size(struct open_args, fill),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= 100,
+		},
+	},
+	{
+		.opt_short	= 'g',
+		.opt_long	= "fragmentation",
+		.descr		= "Percent of the objects freed at random "
+					"after filling the pool",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct open_args, frag),
+		.def		= "0",
+		.type_uint	= {
+			.size	= clo_field_size(struct open_args, frag),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= 100,
+		},
+	},
+	{
+		.opt_short	= 'i',
+		.opt_long	= "inflight",
+		.descr		= "Number of transactions interrupted by "
+					"a crash, each one in its own lane",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct open_args, inflight),
+		.def		= "0",
+		.type_uint	= {
+			.size	= clo_field_size(struct open_args, inflight),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= 1024,
+		},
+	},
+	{
+		.opt_short	= 'M',
+		.opt_long	= "mode",
+		.descr		= "Measured part: open (including the "
+					"recovery) or alloc (the first "
+					"allocation after the open)",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct open_args, mode),
+		.def		= "open",
+	},
+};
+
+/*
+ * stores information about open benchmark
+ */
+static struct benchmark_info open_info = {
+	.name		= "obj_open",
+	.brief		= "Benchmark for opening and recovery of a pool",
+	.init		= open_init,
+	.exit		= open_exit,
+	.multithread	= false,
+	.multiops	= true,
+	.op_init	= open_op_init,
+	.operation	= open_op,
+	.op_exit	= open_op_exit,
+	.measure_time	= true,
+	.clos		= open_clo,
+	.nclos		= ARRAY_SIZE(open_clo),
+	.opts_size	= sizeof(struct open_args),
+	.rm_file	= true,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(open_info);
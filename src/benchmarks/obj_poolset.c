@@ -0,0 +1,345 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_poolset.c -- benchmark of the creation and opening of a pool over
+ * a pool set with the given number of parts
+ *
+ * The pool set file and its parts are placed next to the file given to the
+ * benchmark, the parts are created by the library.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libpmemobj.h"
+#include "benchmark.h"
+
+#define LAYOUT_NAME	"obj_poolset"
+#define MEGABYTE	((uint64_t)1 << 20)
+
+/*
+ * poolset_mode -- the operation measured
+ */
+enum poolset_mode {
+	POOLSET_MODE_CREATE,	/* pmemobj_create of a new pool */
+	POOLSET_MODE_OPEN,	/* pmemobj_open of an existing pool */
+};
+
+/*
+ * poolset_args -- benchmark specific command line options
+ */
+struct poolset_args {
+	uint64_t pool_size;	/* size of the pool in megabytes */
+	unsigned nparts;	/* number of parts of the pool set */
+	char *mode;		/* operation to be measured */
+};
+
+/*
+ * poolset_bench -- benchmark context
+ */
+struct poolset_bench {
+	struct poolset_args *pa;
+	enum poolset_mode mode;
+	char *base;		/* absolute path of the benchmark's file */
+	char *set;		/* path of the pool set file */
+	PMEMobjpool *pop;	/* pool created or opened by the operation */
+};
+
+/*
+ * poolset_part_path -- (internal) format the path of the given part
+ */
+static void
+poolset_part_path(struct poolset_bench *pb, unsigned part, char *path)
+{
+	snprintf(path, PATH_MAX, "%s.part%u", pb->base, part);
+}
+
+/*
+ * poolset_remove_parts -- (internal) remove the parts of the pool set
+ */
+static void
+poolset_remove_parts(struct poolset_bench *pb)
+{
+	char path[PATH_MAX];
+	for (unsigned i = 0; i < pb->pa->nparts; i++) {
+		poolset_part_path(pb, i, path);
+		unlink(path);
+	}
+}
+
+/*
+ * poolset_write -- (internal) write the pool set file with parts of equal
+ *	size
+ */
+static int
+poolset_write(struct poolset_bench *pb)
+{
+	FILE *f = fopen(pb->set, "w");
+	if (f == NULL) {
+		perror(pb->set);
+		return -1;
+	}
+
+	uint64_t part_size = pb->pa->pool_size / pb->pa->nparts;
+	char path[PATH_MAX];
+
+	fprintf(f, "PMEMPOOLSET\n");
+	for (unsigned i = 0; i < pb->pa->nparts; i++) {
+		poolset_part_path(pb, i, path);
+		fprintf(f, "%juM %s\n", part_size, path);
+	}
+
+	if (fclose(f) != 0) {
+		perror(pb->set);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * poolset_init -- benchmark initialization
+ */
+static int
+poolset_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct poolset_bench *pb = calloc(1, sizeof(*pb));
+	if (pb == NULL) {
+		perror("calloc");
+		return -1;
+	}
+
+	pb->pa = args->opts;
+
+	if (strcmp(pb->pa->mode, "create") == 0) {
+		pb->mode = POOLSET_MODE_CREATE;
+	} else if (strcmp(pb->pa->mode, "open") == 0) {
+		pb->mode = POOLSET_MODE_OPEN;
+	} else {
+		fprintf(stderr, "invalid mode -- '%s'\n", pb->pa->mode);
+		goto err_free;
+	}
+
+	/* every part is subject to the minimal size of the pool */
+	if (pb->pa->pool_size * MEGABYTE / pb->pa->nparts < PMEMOBJ_MIN_POOL) {
+		fprintf(stderr, "each of the parts must be at least %zu MB\n",
+				PMEMOBJ_MIN_POOL / MEGABYTE);
+		goto err_free;
+	}
+
+	/* the paths of the parts in the pool set must be absolute */
+	pb->base = malloc(PATH_MAX);
+	if (pb->base == NULL) {
+		perror("malloc");
+		goto err_free;
+	}
+
+	char cwd[PATH_MAX] = "";
+	if (args->fname[0] != '/' && getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("getcwd");
+		goto err_free_base;
+	}
+
+	if (snprintf(pb->base, PATH_MAX, "%s%s%s", cwd, cwd[0] ? "/" : "",
+			args->fname) >= PATH_MAX) {
+		fprintf(stderr, "the path is too long\n");
+		goto err_free_base;
+	}
+
+	pb->set = malloc(strlen(pb->base) + sizeof(".set"));
+	if (pb->set == NULL) {
+		perror("malloc");
+		goto err_free_base;
+	}
+	sprintf(pb->set, "%s.set", pb->base);
+
+	poolset_remove_parts(pb);
+	if (poolset_write(pb))
+		goto err_free_set;
+
+	if (pb->mode == POOLSET_MODE_OPEN) {
+		PMEMobjpool *pop = pmemobj_create(pb->set, LAYOUT_NAME, 0,
+				args->fmode);
+		if (pop == NULL) {
+			fprintf(stderr, "%s\n", pmemobj_errormsg());
+			goto err_unlink;
+		}
+		pmemobj_close(pop);
+	}
+
+	pmembench_set_priv(bench, pb);
+
+	return 0;
+
+err_unlink:
+	poolset_remove_parts(pb);
+	unlink(pb->set);
+err_free_set:
+	free(pb->set);
+err_free_base:
+	free(pb->base);
+err_free:
+	free(pb);
+	return -1;
+}
+
+/*
+ * poolset_exit -- benchmark clean up
+ */
+static int
+poolset_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct poolset_bench *pb = pmembench_get_priv(bench);
+
+	poolset_remove_parts(pb);
+	unlink(pb->set);
+	free(pb->set);
+	free(pb->base);
+	free(pb);
+
+	return 0;
+}
+
+/*
+ * poolset_op -- create or open the pool
+ */
+static int
+poolset_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct poolset_bench *pb = pmembench_get_priv(bench);
+
+	if (pb->mode == POOLSET_MODE_CREATE)
+		pb->pop = pmemobj_create(pb->set, LAYOUT_NAME, 0,
+				info->args->fmode);
+	else
+		pb->pop = pmemobj_open(pb->set, LAYOUT_NAME);
+
+	if (pb->pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * poolset_op_exit -- close the pool and, if it was created, remove its parts
+ */
+static int
+poolset_op_exit(struct benchmark *bench, struct operation_info *info)
+{
+	struct poolset_bench *pb = pmembench_get_priv(bench);
+
+	if (pb->pop != NULL) {
+		pmemobj_close(pb->pop);
+		pb->pop = NULL;
+	}
+
+	if (pb->mode == POOLSET_MODE_CREATE)
+		poolset_remove_parts(pb);
+
+	return 0;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo poolset_clo[] = {
+	{
+		.opt_short	= 'S',
+		.opt_long	= "pool-size",
+		.descr		= "Size of the pool in megabytes",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct poolset_args,
+					pool_size),
+		.def		= "64",
+		.type_uint	= {
+			.size	= clo_field_size(struct poolset_args,
+					pool_size),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'P',
+		.opt_long	= "parts",
+		.descr		= "Number of parts of the pool set, "
+					"of equal size",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct poolset_args, nparts),
+		.def		= "1",
+		.type_uint	= {
+			.size	= clo_field_size(struct poolset_args, nparts),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= 1024,
+		},
+	},
+	{
+		.opt_short	= 'M',
+		.opt_long	= "mode",
+		.descr		= "Measured operation: create or open",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct poolset_args, mode),
+		.def		= "open",
+	},
+};
+
+/*
+ * stores information about obj_poolset benchmark
+ */
+static struct benchmark_info poolset_info = {
+	.name		= "obj_poolset",
+	.brief		= "Benchmark for creation and opening of a pool "
+				"over a pool set",
+	.init		= poolset_init,
+	.exit		= poolset_exit,
+	.multithread	= false,
+	.multiops	= true,
+	.op_exit	= poolset_op_exit,
+	.operation	= poolset_op,
+	.measure_time	= true,
+	.clos		= poolset_clo,
+	.nclos		= ARRAY_SIZE(poolset_clo),
+	.opts_size	= sizeof(struct poolset_args),
+	.rm_file	= true,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(poolset_info);
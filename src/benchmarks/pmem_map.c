@@ -0,0 +1,260 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_map.c -- benchmark of the mapping of a file with pmem_map_file,
+ * optionally followed by pmem_is_pmem and by the first touch of every page
+ * of the mapping
+ *
+ * The file is created and its blocks allocated once, so that the cost of the
+ * page faults taken by the first touch doesn't include the allocation of the
+ * blocks by the file system.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libpmem.h"
+#include "benchmark.h"
+
+#define MEGABYTE	((uint64_t)1 << 20)
+#define TOUCH_STRIDE	4096
+
+/*
+ * touch_mode -- the access made to every page of the mapping
+ */
+enum touch_mode {
+	TOUCH_NONE,
+	TOUCH_READ,
+	TOUCH_WRITE,
+};
+
+/*
+ * map_args -- benchmark specific command line options
+ */
+struct map_args {
+	uint64_t file_size;	/* size of the file in megabytes */
+	bool is_pmem;		/* call pmem_is_pmem on the mapping */
+	char *touch;		/* access to every page of the mapping */
+};
+
+/*
+ * map_bench -- benchmark context
+ */
+struct map_bench {
+	struct map_args *ma;
+	enum touch_mode touch;
+	void *addr;		/* mapping made by the current operation */
+	size_t len;
+	volatile char sink;	/* the bytes read by the first touch */
+};
+
+/*
+ * map_init -- benchmark initialization
+ */
+static int
+map_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct map_bench *mb = calloc(1, sizeof(*mb));
+	if (mb == NULL) {
+		perror("calloc");
+		return -1;
+	}
+
+	mb->ma = args->opts;
+
+	if (strcmp(mb->ma->touch, "none") == 0) {
+		mb->touch = TOUCH_NONE;
+	} else if (strcmp(mb->ma->touch, "read") == 0) {
+		mb->touch = TOUCH_READ;
+	} else if (strcmp(mb->ma->touch, "write") == 0) {
+		mb->touch = TOUCH_WRITE;
+	} else {
+		fprintf(stderr, "invalid touch mode -- '%s'\n",
+				mb->ma->touch);
+		goto err_free;
+	}
+
+	int fd = open(args->fname, O_RDWR | O_CREAT | O_TRUNC, args->fmode);
+	if (fd < 0) {
+		perror(args->fname);
+		goto err_free;
+	}
+
+	errno = posix_fallocate(fd, 0,
+			(off_t)(mb->ma->file_size * MEGABYTE));
+	close(fd);
+	if (errno != 0) {
+		perror("posix_fallocate");
+		goto err_unlink;
+	}
+
+	pmembench_set_priv(bench, mb);
+
+	return 0;
+
+err_unlink:
+	unlink(args->fname);
+err_free:
+	free(mb);
+	return -1;
+}
+
+/*
+ * map_exit -- benchmark clean up
+ */
+static int
+map_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct map_bench *mb = pmembench_get_priv(bench);
+
+	unlink(args->fname);
+	free(mb);
+
+	return 0;
+}
+
+/*
+ * map_op -- map the file and touch its pages
+ */
+static int
+map_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct map_bench *mb = pmembench_get_priv(bench);
+
+	int is_pmem;
+	mb->addr = pmem_map_file(info->args->fname, 0, 0, 0, &mb->len,
+			&is_pmem);
+	if (mb->addr == NULL) {
+		perror("pmem_map_file");
+		return -1;
+	}
+
+	if (mb->ma->is_pmem)
+		is_pmem = pmem_is_pmem(mb->addr, mb->len);
+
+	char *addr = mb->addr;
+	switch (mb->touch) {
+	case TOUCH_READ:
+		for (size_t off = 0; off < mb->len; off += TOUCH_STRIDE)
+			mb->sink = addr[off];
+		break;
+	case TOUCH_WRITE:
+		for (size_t off = 0; off < mb->len; off += TOUCH_STRIDE)
+			addr[off] = (char)is_pmem;
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * map_op_exit -- unmap the file
+ */
+static int
+map_op_exit(struct benchmark *bench, struct operation_info *info)
+{
+	struct map_bench *mb = pmembench_get_priv(bench);
+
+	if (mb->addr != NULL) {
+		pmem_unmap(mb->addr, mb->len);
+		mb->addr = NULL;
+	}
+
+	return 0;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo map_clo[] = {
+	{
+		.opt_short	= 'S',
+		.opt_long	= "file-size",
+		.descr		= "Size of the file in megabytes",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct map_args, file_size),
+		.def		= "64",
+		.type_uint	= {
+			.size	= clo_field_size(struct map_args, file_size),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT64_MAX,
+		},
+	},
+	{
+		.opt_short	= 'p',
+		.opt_long	= "is-pmem",
+		.descr		= "Call pmem_is_pmem on the mapping",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct map_args, is_pmem),
+	},
+	{
+		.opt_short	= 'T',
+		.opt_long	= "touch",
+		.descr		= "Access to every page of the mapping: none, "
+					"read or write",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct map_args, touch),
+		.def		= "none",
+	},
+};
+
+/*
+ * stores information about pmem_map benchmark
+ */
+static struct benchmark_info map_info = {
+	.name		= "pmem_map",
+	.brief		= "Benchmark for mapping of a file by pmem_map_file",
+	.init		= map_init,
+	.exit		= map_exit,
+	.multithread	= false,
+	.multiops	= true,
+	.op_exit	= map_op_exit,
+	.operation	= map_op,
+	.measure_time	= true,
+	.clos		= map_clo,
+	.nclos		= ARRAY_SIZE(map_clo),
+	.opts_size	= sizeof(struct map_args),
+	.rm_file	= true,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(map_info);
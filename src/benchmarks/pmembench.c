@@ -47,9 +47,16 @@
 #include <dirent.h>
 #include <errno.h>
 
+#include "libpmem.h"
+#include "file.h"
 #include "mmap.h"
 #include "set.h"
 #include "benchmark.h"
+#include "benchmark_affinity.h"
+#include "benchmark_baseline.h"
+#include "benchmark_hist.h"
+#include "benchmark_meta.h"
+#include "benchmark_perf.h"
 #include "benchmark_worker.h"
 #include "scenario.h"
 #include "clo_vec.h"
@@ -67,6 +74,8 @@ struct pmembench
 	struct scenario *scenario;
 	struct clo_vec *clovec;
 	bool override_clos;
+	unsigned nregressions;	/* regressions against the baseline */
+	bool pmem_stats;	/* libpmem counts flushes (PMEM_STATS=1) */
 };
 
 /*
@@ -103,6 +112,11 @@ struct latency
 	uint64_t min;
 	uint64_t avg;
 	double std_dev;
+	uint64_t pctl50_0p;
+	uint64_t pctl90_0p;
+	uint64_t pctl99_0p;
+	uint64_t pctl99_9p;
+	uint64_t pctl99_99p;
 };
 
 /*
@@ -273,6 +287,105 @@ static struct benchmark_clo pmembench_clos[] = {
 			.max	= ULONG_MAX,
 		},
 	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "latency-hist",
+		.descr		= "Print histogram of latencies of operations",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct benchmark_args,
+						latency_hist),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "perf",
+		.descr		= "Count hardware events of operations",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct benchmark_args,
+						perf),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "output-format",
+		.descr		= "Format of the results: text or json (one "
+					"object per line)",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct benchmark_args,
+						output_format),
+		.def		= "text",
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "baseline",
+		.descr		= "Compare the results with the json results "
+					"in the file",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct benchmark_args,
+						baseline),
+		/* an empty string leaves no baseline */
+		.def		= "",
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "threshold",
+		.descr		= "Smallest significant change of throughput "
+					"against the baseline in percents",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct benchmark_args,
+						threshold),
+		.def		= "5",
+		.ignore_in_res	= true,
+		.type_uint	= {
+			.size	= clo_field_size(struct benchmark_args,
+						threshold),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= 100,
+		},
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "affinity",
+		.descr		= "Pinning of the worker threads: none, "
+					"compact (close to each other) or "
+					"scatter (spread over NUMA nodes "
+					"and cores)",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct benchmark_args,
+						affinity),
+		.def		= "none",
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "cpus",
+		.descr		= "CPUs the worker threads may run on, ranges "
+					"separated with colons (e.g. 0-3:8-11) "
+					"or all",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct benchmark_args,
+						cpus),
+		.def		= "all",
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "numa-node",
+		.descr		= "NUMA node the worker threads run on, -1 for "
+					"all of them",
+		.type		= CLO_TYPE_INT,
+		.off		= clo_field_offset(struct benchmark_args,
+						numa_node),
+		.def		= "-1",
+		.type_int	= {
+			.size	= clo_field_size(struct benchmark_args,
+						numa_node),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= -1,
+			.max	= INT_MAX,
+		},
+	},
 };
 
 /*
@@ -378,25 +491,49 @@ pmembench_run_worker(struct benchmark *bench, struct worker_info *winfo)
 	uint64_t i;
 	uint64_t ops = winfo->nops;
 	benchmark_time_t start, stop;
+	struct benchmark_perf *perf = NULL;
+
+	if (winfo->perf != NULL) {
+		perf = benchmark_perf_open();
+		if (perf == NULL)
+			winfo->perf->mask = 0;
+	}
+
 	for (i = 0; i < ops; i++) {
 		if (bench->info->op_init) {
 			if (bench->info->op_init(bench, &winfo->opinfo[i]))
-				return -1;
+				goto err;
 		}
 
+		if (perf)
+			benchmark_perf_start(perf);
 		benchmark_time_get(&start);
 		if (bench->info->operation(bench, &winfo->opinfo[i]))
-			return -1;
+			goto err;
 		benchmark_time_get(&stop);
+		if (perf)
+			benchmark_perf_stop(perf);
 		benchmark_time_diff(&winfo->opinfo[i].t_diff, &start, &stop);
+		benchmark_hist_record(winfo->hist, benchmark_time_get_nsecs(
+				&winfo->opinfo[i].t_diff));
 
 		if (bench->info->op_exit) {
 			if (bench->info->op_exit(bench, &winfo->opinfo[i]))
-				return -1;
+				goto err;
 		}
 	}
 
+	if (perf) {
+		benchmark_perf_read(perf, winfo->perf);
+		benchmark_perf_close(perf);
+	}
+
 	return 0;
+
+err:
+	if (perf)
+		benchmark_perf_close(perf);
+	return -1;
 }
 
 /*
@@ -404,7 +541,7 @@ pmembench_run_worker(struct benchmark *bench, struct worker_info *winfo)
  */
 static void
 pmembench_print_header(struct pmembench *pb, struct benchmark *bench,
-		struct clo_vec *clovec)
+		struct clo_vec *clovec, struct benchmark_args *args)
 {
 	if (pb->scenario) {
 		printf("%s: %s [%ld]%s%s%s\n",
@@ -426,7 +563,22 @@ pmembench_print_header(struct pmembench *pb, struct benchmark *bench,
 		"latency-avg;"
 		"latency-min;"
 		"latency-max;"
-		"latency-std-dev");
+		"latency-std-dev;"
+		"latency-pctl-50.0%%;"
+		"latency-pctl-90.0%%;"
+		"latency-pctl-99.0%%;"
+		"latency-pctl-99.9%%;"
+		"latency-pctl-99.99%%");
+	if (args->perf)
+		printf(";cycles-per-op;"
+			"instructions-per-op;"
+			"instructions-per-cycle;"
+			"llc-misses-per-op");
+	if (pb->pmem_stats)
+		printf(";flushes-per-op;"
+			"flushed-lines-per-op;"
+			"fences-per-op;"
+			"nt-bytes-per-op");
 	size_t i;
 	for (i = 0; i < bench->nclos; i++) {
 		if (!bench->clos[i].ignore_in_res) {
@@ -436,16 +588,81 @@ pmembench_print_header(struct pmembench *pb, struct benchmark *bench,
 	printf("\n");
 }
 
+/*
+ * pmembench_print_perf_value -- print the number of events per operation,
+ *	or a dash if the event wasn't counted
+ */
+static void
+pmembench_print_perf_value(struct benchmark_perf_counters *perf,
+		enum benchmark_perf_event event, uint64_t nops)
+{
+	if (perf->mask & (1u << event))
+		printf(";%f", (double)perf->values[event] / (double)nops);
+	else
+		printf(";-");
+}
+
+/*
+ * pmembench_print_perf -- print the hardware events per operation
+ */
+static void
+pmembench_print_perf(struct benchmark_perf_counters *perf, uint64_t nops)
+{
+	pmembench_print_perf_value(perf, PERF_EVENT_CYCLES, nops);
+	pmembench_print_perf_value(perf, PERF_EVENT_INSTRUCTIONS, nops);
+
+	unsigned ipc = (1u << PERF_EVENT_CYCLES) |
+		(1u << PERF_EVENT_INSTRUCTIONS);
+	if ((perf->mask & ipc) == ipc && perf->values[PERF_EVENT_CYCLES])
+		printf(";%f",
+			(double)perf->values[PERF_EVENT_INSTRUCTIONS] /
+			(double)perf->values[PERF_EVENT_CYCLES]);
+	else
+		printf(";-");
+
+	pmembench_print_perf_value(perf, PERF_EVENT_LLC_MISSES, nops);
+}
+
+/*
+ * pmembench_pmem_stats_add -- add the libpmem counts gathered between the
+ *	start and end snapshots to the total
+ */
+static void
+pmembench_pmem_stats_add(struct pmem_stats *total,
+		const struct pmem_stats *start, const struct pmem_stats *end)
+{
+	total->flushes += end->flushes - start->flushes;
+	total->flushed_lines += end->flushed_lines - start->flushed_lines;
+	total->fences += end->fences - start->fences;
+	total->nt_bytes += end->nt_bytes - start->nt_bytes;
+}
+
+/*
+ * pmembench_print_pmem_stats -- print the libpmem counts per operation
+ */
+static void
+pmembench_print_pmem_stats(struct pmem_stats *pstats, uint64_t nops)
+{
+	printf(";%f;%f;%f;%f",
+		(double)pstats->flushes / (double)nops,
+		(double)pstats->flushed_lines / (double)nops,
+		(double)pstats->fences / (double)nops,
+		(double)pstats->nt_bytes / (double)nops);
+}
+
 /*
  * pmembench_print_results -- print benchmark's results
  */
 static void
 pmembench_print_results(struct benchmark *bench, struct benchmark_args *args,
 				size_t n_threads, size_t n_ops,
-				struct results *stats, struct latency *latency)
+				struct results *stats, struct latency *latency,
+				struct benchmark_perf_counters *perf,
+				struct pmem_stats *pstats)
 {
 	double opsps = n_threads * n_ops / stats->avg;
-	printf("%f;%f;%f;%f;%f;%f;%ld;%ld;%ld;%f", stats->avg,
+	printf("%f;%f;%f;%f;%f;%f;%ld;%ld;%ld;%f;%ld;%ld;%ld;%ld;%ld",
+			stats->avg,
 			opsps,
 			stats->max,
 			stats->min,
@@ -454,7 +671,19 @@ pmembench_print_results(struct benchmark *bench, struct benchmark_args *args,
 			latency->avg,
 			latency->min,
 			latency->max,
-			latency->std_dev);
+			latency->std_dev,
+			latency->pctl50_0p,
+			latency->pctl90_0p,
+			latency->pctl99_0p,
+			latency->pctl99_9p,
+			latency->pctl99_99p);
+
+	if (args->perf)
+		pmembench_print_perf(perf, n_threads * n_ops * args->repeats);
+
+	if (pstats)
+		pmembench_print_pmem_stats(pstats,
+				n_threads * n_ops * args->repeats);
 
 	size_t i;
 	for (i = 0; i < bench->nclos; i++) {
@@ -466,6 +695,193 @@ pmembench_print_results(struct benchmark *bench, struct benchmark_args *args,
 	printf("\n");
 }
 
+/*
+ * pmembench_is_json -- check if the results are printed in json
+ */
+static bool
+pmembench_is_json(struct benchmark_args *args)
+{
+	return strcmp(args->output_format, "json") == 0;
+}
+
+/*
+ * pmembench_get_key -- return the key identifying the results of the
+ *	argument set in the baseline, must be freed by the caller
+ */
+static char *
+pmembench_get_key(struct pmembench *pb, struct benchmark *bench,
+		struct benchmark_args *args)
+{
+	char *key = NULL;
+	size_t len = 0;
+	FILE *fp = open_memstream(&key, &len);
+	if (fp == NULL)
+		return NULL;
+
+	fprintf(fp, "%s/%s", pb->scenario ? pb->scenario->name : "-",
+			bench->info->name);
+	for (size_t i = 0; i < bench->nclos; i++) {
+		if (bench->clos[i].ignore_in_res)
+			continue;
+
+		const char *val = benchmark_clo_str(&bench->clos[i], args,
+				bench->args_size);
+		fprintf(fp, ";%s=%s", bench->clos[i].opt_long,
+				val ? val : "");
+	}
+	fclose(fp);
+
+	return key;
+}
+
+/*
+ * pmembench_json_perf_value -- print the number of events per operation
+ *	as a json member
+ */
+static void
+pmembench_json_perf_value(struct benchmark_perf_counters *perf,
+		enum benchmark_perf_event event, const char *name,
+		uint64_t nops)
+{
+	printf(",\"%s\":", name);
+	if (perf->mask & (1u << event))
+		printf("%f", (double)perf->values[event] / (double)nops);
+	else
+		printf("null");
+}
+
+/*
+ * pmembench_print_results_json -- print benchmark's results and the platform
+ *	description as a single json object
+ */
+static void
+pmembench_print_results_json(struct pmembench *pb, struct benchmark *bench,
+		struct benchmark_args *args, size_t n_threads, size_t n_ops,
+		struct results *stats, struct latency *latency,
+		struct benchmark_perf_counters *perf, struct pmem_stats *pstats,
+		const char *key, struct benchmark_cmp *cmp,
+		struct benchmark_affinity *affinity)
+{
+	printf("{\"benchmark\":");
+	benchmark_meta_print_str(stdout, bench->info->name);
+	printf(",\"scenario\":");
+	if (pb->scenario)
+		benchmark_meta_print_str(stdout, pb->scenario->name);
+	else
+		printf("null");
+	printf(",\"group\":");
+	if (pb->scenario && pb->scenario->group)
+		benchmark_meta_print_str(stdout, pb->scenario->group);
+	else
+		printf("null");
+	printf(",\"key\":");
+	benchmark_meta_print_str(stdout, key);
+	printf(",\"pool-type\":\"%s\"", args->is_poolset ? "poolset" :
+		util_file_is_device_dax(args->fname) == 1 ? "device-dax" :
+		"file");
+
+	printf(",\"metadata\":");
+	benchmark_meta_print_json(stdout);
+
+	printf(",\"args\":{");
+	for (size_t i = 0; i < bench->nclos; i++) {
+		const char *val = benchmark_clo_str(&bench->clos[i], args,
+				bench->args_size);
+		printf("%s\"%s\":", i ? "," : "", bench->clos[i].opt_long);
+		if (val)
+			benchmark_meta_print_str(stdout, val);
+		else
+			printf("null");
+	}
+	printf("}");
+
+	printf(",\"worker-cpus\":[");
+	for (size_t i = 0; i < n_threads; i++) {
+		char cpus[256];
+		benchmark_affinity_str(affinity, i, cpus, sizeof(cpus));
+		printf("%s\"%s\"", i ? "," : "", cpus);
+	}
+	printf("]");
+
+	double opsps = n_threads * n_ops / stats->avg;
+	printf(",\"results\":{\"total-avg\":%f,\"ops-per-second\":%f,"
+		"\"total-max\":%f,\"total-min\":%f,\"total-median\":%f,"
+		"\"total-std-dev\":%f,\"samples\":%zu,"
+		"\"latency-avg\":%lu,\"latency-min\":%lu,"
+		"\"latency-max\":%lu,\"latency-std-dev\":%f,"
+		"\"latency-pctl-50.0%%\":%lu,\"latency-pctl-90.0%%\":%lu,"
+		"\"latency-pctl-99.0%%\":%lu,\"latency-pctl-99.9%%\":%lu,"
+		"\"latency-pctl-99.99%%\":%lu",
+		stats->avg, opsps, stats->max, stats->min, stats->med,
+		stats->std_dev, n_threads * args->repeats,
+		latency->avg, latency->min, latency->max, latency->std_dev,
+		latency->pctl50_0p, latency->pctl90_0p, latency->pctl99_0p,
+		latency->pctl99_9p, latency->pctl99_99p);
+
+	if (args->perf) {
+		uint64_t nops = n_threads * n_ops * args->repeats;
+		pmembench_json_perf_value(perf, PERF_EVENT_CYCLES,
+				"cycles-per-op", nops);
+		pmembench_json_perf_value(perf, PERF_EVENT_INSTRUCTIONS,
+				"instructions-per-op", nops);
+		pmembench_json_perf_value(perf, PERF_EVENT_LLC_MISSES,
+				"llc-misses-per-op", nops);
+	}
+	if (pstats) {
+		double nops = (double)(n_threads * n_ops * args->repeats);
+		printf(",\"flushes-per-op\":%f,\"flushed-lines-per-op\":%f,"
+			"\"fences-per-op\":%f,\"nt-bytes-per-op\":%f",
+			(double)pstats->flushes / nops,
+			(double)pstats->flushed_lines / nops,
+			(double)pstats->fences / nops,
+			(double)pstats->nt_bytes / nops);
+	}
+	printf("}");
+
+	if (cmp)
+		printf(",\"baseline\":{\"status\":\"%s\",\"change\":%f,"
+			"\"t\":%f,\"df\":%f}",
+			benchmark_cmp_status_str(cmp->status), cmp->change,
+			cmp->t, cmp->df);
+
+	printf("}\n");
+}
+
+/*
+ * pmembench_compare -- compare the results with the baseline, returns 0
+ *	if the baseline has the results of the argument set
+ */
+static int
+pmembench_compare(struct pmembench *pb, struct benchmark_args *args,
+		const char *key, size_t n_threads, size_t n_ops,
+		struct results *stats, struct benchmark_cmp *cmp)
+{
+	struct benchmark_sample base;
+	int ret = benchmark_baseline_find(args->baseline, key, &base);
+	if (ret) {
+		if (ret > 0)
+			fprintf(stderr, "%s: not in the baseline\n", key);
+		return -1;
+	}
+
+	struct benchmark_sample cur = {
+		.avg = stats->avg,
+		.std_dev = stats->std_dev,
+		.n = n_threads * args->repeats,
+		.ops_per_sec = n_threads * n_ops / stats->avg,
+	};
+
+	benchmark_baseline_compare(&base, &cur, args->threshold, cmp);
+	if (cmp->status == CMP_REGRESSION)
+		pb->nregressions++;
+
+	fprintf(stderr, "%s: ops-per-second %f -> %f (%+.2f%%) t %f: %s\n",
+		key, base.ops_per_sec, cur.ops_per_sec, cmp->change, cmp->t,
+		benchmark_cmp_status_str(cmp->status));
+
+	return 0;
+}
+
 /*
  * pmembench_parse_clos -- parse command line arguments for benchmark
  */
@@ -503,7 +919,8 @@ pmembench_parse_clo(struct pmembench *pb, struct benchmark *bench,
  */
 static int
 pmembench_init_workers(struct benchmark_worker **workers, size_t nworkers,
-	size_t n_ops, struct benchmark *bench, struct benchmark_args *args)
+	size_t n_ops, struct benchmark *bench, struct benchmark_args *args,
+	struct benchmark_affinity *affinity)
 {
 	size_t i;
 	for (i = 0; i < nworkers; i++) {
@@ -512,6 +929,13 @@ pmembench_init_workers(struct benchmark_worker **workers, size_t nworkers,
 		workers[i]->info.nops = n_ops;
 		workers[i]->info.opinfo = calloc(n_ops,
 				sizeof(struct operation_info));
+		workers[i]->info.hist = benchmark_hist_alloc();
+		assert(workers[i]->info.hist != NULL);
+		if (args->perf) {
+			workers[i]->info.perf = calloc(1,
+				sizeof(struct benchmark_perf_counters));
+			assert(workers[i]->info.perf != NULL);
+		}
 		size_t j;
 		for (j = 0; j < n_ops; j++) {
 			workers[i]->info.opinfo[j].worker = &workers[i]->info;
@@ -523,7 +947,12 @@ pmembench_init_workers(struct benchmark_worker **workers, size_t nworkers,
 		workers[i]->func = pmembench_run_worker;
 		workers[i]->init = bench->info->init_worker;
 		workers[i]->exit = bench->info->free_worker;
-		benchmark_worker_init(workers[i]);
+		workers[i]->affinity = affinity;
+		if (benchmark_worker_init(workers[i])) {
+			fprintf(stderr, "initialization of worker %zu failed\n",
+					i);
+			return -1;
+		}
 	}
 	return 0;
 }
@@ -549,11 +978,27 @@ compare_doubles(const void *a1, const void *b1)
 }
 
 /*
- * pmembench_get_results -- return results of one repeat
+ * pmembench_get_percentiles -- fill in the latency percentiles from the
+ *	histogram of all repeats
+ */
+static void
+pmembench_get_percentiles(struct benchmark_hist *hist, struct latency *stats)
+{
+	stats->pctl50_0p = benchmark_hist_percentile(hist, 50.0);
+	stats->pctl90_0p = benchmark_hist_percentile(hist, 90.0);
+	stats->pctl99_0p = benchmark_hist_percentile(hist, 99.0);
+	stats->pctl99_9p = benchmark_hist_percentile(hist, 99.9);
+	stats->pctl99_99p = benchmark_hist_percentile(hist, 99.99);
+}
+
+/*
+ * pmembench_get_results -- return results of one repeat and add the
+ *	latencies of its operations to the histogram
  */
 static void
 pmembench_get_results(struct benchmark_worker **workers, size_t nworkers,
-		struct latency *stats, double *workers_times)
+		struct latency *stats, double *workers_times,
+		struct benchmark_hist *hist)
 {
 	memset(stats, 0, sizeof(*stats));
 	stats->min = ~0;
@@ -606,6 +1051,8 @@ pmembench_get_results(struct benchmark_worker **workers, size_t nworkers,
 	}
 	stats->std_dev = sqrt(stats->std_dev / count);
 
+	for (i = 0; i < nworkers; i++)
+		benchmark_hist_merge(hist, workers[i]->info.hist, nsecs_dummy);
 }
 
 /*
@@ -933,6 +1380,8 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 	struct benchmark_args *args = NULL;
 	struct latency *stats = NULL;
 	double *workers_times = NULL;
+	struct benchmark_hist *hist = NULL;
+	struct benchmark_affinity *affinity = NULL;
 
 	struct clo_vec *clovec = clo_vec_alloc(bench->args_size);
 	assert(clovec != NULL);
@@ -957,7 +1406,16 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 		goto out;
 	}
 
-	pmembench_print_header(pb, bench, clovec);
+	if (!pmembench_is_json(args) &&
+			strcmp(args->output_format, "text") != 0) {
+		fprintf(stderr, "invalid output format -- '%s'\n",
+				args->output_format);
+		ret = -1;
+		goto out;
+	}
+
+	if (!pmembench_is_json(args))
+		pmembench_print_header(pb, bench, clovec, args);
 
 	size_t args_i;
 	for (args_i = 0; args_i < clovec->nargs; args_i++) {
@@ -994,6 +1452,19 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 		workers_times = calloc(n_threads * args->repeats,
 							sizeof(double));
 		assert(workers_times != NULL);
+		hist = benchmark_hist_alloc();
+		assert(hist != NULL);
+		struct benchmark_perf_counters perf;
+		benchmark_perf_init(&perf);
+		struct pmem_stats pstats;
+		memset(&pstats, 0, sizeof(pstats));
+
+		affinity = benchmark_affinity_alloc(args->affinity,
+				args->cpus, args->numa_node);
+		if (affinity == NULL) {
+			ret = -1;
+			goto out;
+		}
 
 		for (unsigned i = 0; i < args->repeats; i++) {
 			if (bench->info->rm_file) {
@@ -1021,12 +1492,17 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 			assert(workers != NULL);
 
 			if ((ret = pmembench_init_workers(workers, n_threads,
-						n_ops, bench, args)) != 0) {
+					n_ops, bench, args, affinity)) != 0) {
 				if (bench->info->exit)
 					bench->info->exit(bench, args);
 				goto out;
 			}
 
+			/* only the operations are counted, not init and exit */
+			struct pmem_stats pstats_start;
+			if (pb->pmem_stats)
+				pmem_stats_get(&pstats_start);
+
 			unsigned j;
 			for (j = 0; j < args->n_threads; j++) {
 				benchmark_worker_run(workers[j]);
@@ -1040,15 +1516,29 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 					"thread number %d failed \n", j);
 				}
 			}
+
+			if (pb->pmem_stats) {
+				struct pmem_stats pstats_end;
+				pmem_stats_get(&pstats_end);
+				pmembench_pmem_stats_add(&pstats, &pstats_start,
+						&pstats_end);
+			}
 			if (ret == 0)
 				pmembench_get_results(workers, n_threads,
 						&stats[i],
-						&workers_times[i * n_threads]);
+						&workers_times[i * n_threads],
+						hist);
+
+			for (j = 0; args->perf && j < n_threads; j++)
+				benchmark_perf_add(&perf,
+						workers[j]->info.perf);
 
 			for (j = 0; j < args->n_threads; j++) {
 				benchmark_worker_exit(workers[j]);
 
 				free(workers[j]->info.opinfo);
+				benchmark_hist_free(workers[j]->info.hist);
+				free(workers[j]->info.perf);
 				benchmark_worker_free(workers[j]);
 			}
 
@@ -1061,18 +1551,45 @@ pmembench_run(struct pmembench *pb, struct benchmark *bench)
 		struct latency latency;
 		pmembench_get_total_results(stats, workers_times, &total,
 					&latency, args->repeats, n_threads);
-		pmembench_print_results(bench, args, n_threads, n_ops,
-							&total, &latency);
+		pmembench_get_percentiles(hist, &latency);
+
+		char *key = pmembench_get_key(pb, bench, args);
+		assert(key != NULL);
+		struct benchmark_cmp cmp;
+		bool compared = args->baseline && !pmembench_compare(pb, args,
+				key, n_threads, n_ops, &total, &cmp);
+
+		if (pmembench_is_json(args)) {
+			pmembench_print_results_json(pb, bench, args,
+					n_threads, n_ops, &total, &latency,
+					&perf, pb->pmem_stats ? &pstats : NULL,
+					key, compared ? &cmp : NULL, affinity);
+		} else {
+			pmembench_print_results(bench, args, n_threads, n_ops,
+					&total, &latency, &perf,
+					pb->pmem_stats ? &pstats : NULL);
+			if (args->latency_hist)
+				benchmark_hist_print(hist, stdout);
+		}
+		free(key);
 		free(stats);
 		free(workers_times);
+		benchmark_hist_free(hist);
+		benchmark_affinity_free(affinity);
 		stats = NULL;
 		workers_times = NULL;
+		hist = NULL;
+		affinity = NULL;
 	}
 out:
 	if (stats)
 		free(stats);
 	if (workers_times)
 		free(workers_times);
+	if (hist)
+		benchmark_hist_free(hist);
+	if (affinity)
+		benchmark_affinity_free(affinity);
 out_release_args:
 	clo_vec_free(clovec);
 
@@ -1227,6 +1744,9 @@ main(int argc, char *argv[])
 	pb->argc = --argc;
 	pb->argv = ++argv;
 
+	struct pmem_stats pstats;
+	pb->pmem_stats = pmem_stats_get(&pstats) == 0;
+
 	char *bench_name = pb->argv[0];
 	if (NULL == bench_name) {
 		ret = -1;
@@ -1244,6 +1764,12 @@ main(int argc, char *argv[])
 	}
 
 out:
+	if (ret == 0 && pb->nregressions) {
+		fprintf(stderr, "%u regression(s) against the baseline\n",
+				pb->nregressions);
+		ret = 1;
+	}
+
 	free(pb);
 	return ret;
 }
@@ -0,0 +1,397 @@
+/*
+ * Copyright 2015-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * rpmem.c -- benchmark implementation for rpmem_persist and rpmem_read
+ *
+ * Each thread persists its own data chunks on its own lanes, used in turns.
+ * If enabled, the librpmem persist statistics are summarized on standard
+ * error at the end of each run, so the persist latency seen by the threads
+ * can be compared with the time spent waiting for completions.
+ *
+ * The rpmem_read benchmark reads the data chunks back from the remote pool,
+ * either directly into the registered pool memory or into a private buffer.
+ * The rpmem_read() function uses the read lanes of the whole pool, so this
+ * benchmark runs a single thread.
+ *
+ * The persist method (GPSPM or APM) is chosen by rpmemd on the target node.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <librpmem.h>
+
+#include "benchmark.h"
+
+#define RPMEM_BENCH_SIG "PMEMBNCH"
+
+/*
+ * rpmem_args -- benchmark specific arguments
+ */
+struct rpmem_args {
+	char *node;		/* target node */
+	char *pool_set;		/* pool set name on the target node */
+	bool stats;		/* print persist statistics */
+	unsigned lanes;		/* number of lanes per thread */
+	bool direct;		/* read into the pool memory */
+};
+
+/*
+ * rpmem_bench -- benchmark context
+ */
+struct rpmem_bench {
+	struct rpmem_args *pargs;	/* benchmark specific arguments */
+	RPMEMpool *rpp;			/* remote pool handle */
+	void *pool;			/* local pool memory */
+	size_t pool_size;		/* size of the pool */
+	unsigned nlanes;		/* number of lanes */
+	unsigned lanes_per_thread;	/* number of lanes used by a thread */
+	size_t csize;			/* size of a chunk */
+	uint64_t nops;			/* number of operations per thread */
+	void *buff;			/* private buffer for reads */
+};
+
+/*
+ * rpmem_stats_print -- print summary of persist statistics
+ */
+static void
+rpmem_stats_print(const char *name, const struct rpmem_stats *stats)
+{
+	if (!stats->npersists)
+		return;
+
+	fprintf(stderr, "%s: persists %ju writes %ju bytes %ju max depth %ju "
+		"avg latency %ju ns max latency %ju ns avg wait %ju ns\n",
+		name, stats->npersists, stats->nwrites, stats->nbytes,
+		stats->max_depth, stats->persist_ns / stats->npersists,
+		stats->max_persist_ns, stats->wait_ns / stats->npersists);
+}
+
+/*
+ * rpmem_hist_print -- print persist latency histogram
+ */
+static void
+rpmem_hist_print(const struct rpmem_stats *stats)
+{
+	for (unsigned i = 0; i < RPMEM_STATS_NBUCKETS; i++) {
+		if (!stats->hist[i])
+			continue;
+
+		fprintf(stderr, "  [%ju, %ju) ns: %ju\n", (uintmax_t)1 << i,
+			(uintmax_t)1 << (i + 1), stats->hist[i]);
+	}
+}
+
+/*
+ * rpmem_bench_stats -- print persist statistics of the pool and all lanes
+ */
+static int
+rpmem_bench_stats(struct rpmem_bench *mb)
+{
+	struct rpmem_stats stats;
+
+	if (rpmem_stats_get(mb->rpp, RPMEM_ALL_LANES, &stats)) {
+		perror("rpmem_stats_get");
+		return -1;
+	}
+
+	rpmem_stats_print("pool", &stats);
+	rpmem_hist_print(&stats);
+
+	for (unsigned lane = 0; lane < mb->nlanes; lane++) {
+		if (rpmem_stats_get(mb->rpp, lane, &stats)) {
+			perror("rpmem_stats_get");
+			return -1;
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "lane %u", lane);
+		rpmem_stats_print(name, &stats);
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_op -- persist a single chunk
+ */
+static int
+rpmem_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct rpmem_bench *mb = pmembench_get_priv(bench);
+
+	size_t offset = mb->csize * (info->worker->index * mb->nops +
+			info->index);
+
+	memset((char *)mb->pool + offset, info->index & 0xff, mb->csize);
+
+	unsigned lane = info->worker->index * mb->lanes_per_thread +
+		(unsigned)(info->index % mb->lanes_per_thread);
+
+	return rpmem_persist(mb->rpp, offset, mb->csize, lane);
+}
+
+/*
+ * rpmem_read_op -- read a single chunk
+ */
+static int
+rpmem_read_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct rpmem_bench *mb = pmembench_get_priv(bench);
+
+	size_t offset = mb->csize * info->index;
+	void *buff = mb->pargs->direct ? (char *)mb->pool + offset : mb->buff;
+
+	return rpmem_read(mb->rpp, buff, offset, mb->csize);
+}
+
+/*
+ * rpmem_init -- initialization function
+ */
+static int
+rpmem_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct rpmem_bench *mb = malloc(sizeof(*mb));
+	if (!mb) {
+		perror("malloc");
+		return -1;
+	}
+
+	mb->pargs = args->opts;
+	mb->csize = args->dsize;
+	mb->nops = args->n_ops_per_thread;
+	/* rpmem_read does not use the persist lanes */
+	mb->lanes_per_thread = mb->pargs->lanes ? mb->pargs->lanes : 1;
+	mb->buff = NULL;
+
+	if (!mb->pargs->node || !mb->pargs->pool_set) {
+		fprintf(stderr, "node and pool set must be specified\n");
+		goto err_free_mb;
+	}
+
+	/* collecting statistics is enabled when the pool is opened */
+	if (mb->pargs->stats && setenv("RPMEM_ENABLE_STATS", "1", 1)) {
+		perror("setenv");
+		goto err_free_mb;
+	}
+
+	size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+	mb->pool_size = mb->csize * mb->nops * args->n_threads;
+	if (mb->pool_size < RPMEM_MIN_POOL)
+		mb->pool_size = RPMEM_MIN_POOL;
+	mb->pool_size = (mb->pool_size + pagesize - 1) & ~(pagesize - 1);
+
+	errno = posix_memalign(&mb->pool, pagesize, mb->pool_size);
+	if (errno) {
+		perror("posix_memalign");
+		goto err_free_mb;
+	}
+
+	memset(mb->pool, 0, mb->pool_size);
+
+	if (!mb->pargs->direct) {
+		mb->buff = malloc(mb->csize);
+		if (!mb->buff) {
+			perror("malloc");
+			goto err_free_pool;
+		}
+	}
+
+	struct rpmem_pool_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	memcpy(attr.signature, RPMEM_BENCH_SIG, RPMEM_POOL_HDR_SIG_LEN);
+
+	unsigned nlanes = args->n_threads * mb->lanes_per_thread;
+	mb->nlanes = nlanes;
+	mb->rpp = rpmem_create(mb->pargs->node, mb->pargs->pool_set,
+			mb->pool, mb->pool_size, &mb->nlanes, &attr);
+	if (!mb->rpp) {
+		/* the pool may be left by a previous run */
+		mb->nlanes = nlanes;
+		mb->rpp = rpmem_open(mb->pargs->node, mb->pargs->pool_set,
+				mb->pool, mb->pool_size, &mb->nlanes, &attr);
+	}
+
+	if (!mb->rpp) {
+		fprintf(stderr, "%s\n", rpmem_errormsg());
+		goto err_free_buff;
+	}
+
+	if (mb->nlanes < nlanes) {
+		fprintf(stderr, "too few lanes: %u < %u\n", mb->nlanes,
+			nlanes);
+		goto err_close;
+	}
+
+	pmembench_set_priv(bench, mb);
+
+	return 0;
+err_close:
+	rpmem_close(mb->rpp);
+err_free_buff:
+	free(mb->buff);
+err_free_pool:
+	free(mb->pool);
+err_free_mb:
+	free(mb);
+	return -1;
+}
+
+/*
+ * rpmem_exit -- benchmark cleanup function
+ */
+static int
+rpmem_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct rpmem_bench *mb = pmembench_get_priv(bench);
+	int ret = 0;
+
+	if (mb->pargs->stats)
+		ret = rpmem_bench_stats(mb);
+
+	rpmem_close(mb->rpp);
+	free(mb->buff);
+	free(mb->pool);
+	free(mb);
+
+	return ret;
+}
+
+static struct benchmark_clo rpmem_clo[] = {
+	{
+		.opt_short	= 0,
+		.opt_long	= "node",
+		.descr		= "Target node",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct rpmem_args, node),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "pool-set",
+		.descr		= "Pool set name on the target node",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct rpmem_args,
+						pool_set),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "stats",
+		.descr		= "Print persist statistics on standard error",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct rpmem_args, stats),
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "lanes",
+		.descr		= "Number of lanes used by each thread "
+					"in turns",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct rpmem_args, lanes),
+		.def		= "1",
+		.type_uint	= {
+			.size	= clo_field_size(struct rpmem_args, lanes),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX,
+		},
+	},
+};
+
+static struct benchmark_clo rpmem_read_clo[] = {
+	{
+		.opt_short	= 0,
+		.opt_long	= "node",
+		.descr		= "Target node",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct rpmem_args, node),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "pool-set",
+		.descr		= "Pool set name on the target node",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct rpmem_args,
+						pool_set),
+		.ignore_in_res	= true,
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "direct",
+		.descr		= "Read into the registered pool memory "
+					"instead of a private buffer",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct rpmem_args, direct),
+	},
+};
+
+/* Stores information about benchmark. */
+static struct benchmark_info rpmem_info = {
+	.name		= "rpmem_persist",
+	.brief		= "Benchmark for rpmem_persist() operation",
+	.init		= rpmem_init,
+	.exit		= rpmem_exit,
+	.multithread	= true,
+	.multiops	= true,
+	.operation	= rpmem_op,
+	.measure_time	= true,
+	.clos		= rpmem_clo,
+	.nclos		= ARRAY_SIZE(rpmem_clo),
+	.opts_size	= sizeof(struct rpmem_args),
+	.rm_file	= false,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(rpmem_info);
+
+/* Stores information about benchmark. */
+static struct benchmark_info rpmem_read_info = {
+	.name		= "rpmem_read",
+	.brief		= "Benchmark for rpmem_read() operation",
+	.init		= rpmem_init,
+	.exit		= rpmem_exit,
+	.multithread	= false,
+	.multiops	= true,
+	.operation	= rpmem_read_op,
+	.measure_time	= true,
+	.clos		= rpmem_read_clo,
+	.nclos		= ARRAY_SIZE(rpmem_read_clo),
+	.opts_size	= sizeof(struct rpmem_args),
+	.rm_file	= false,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(rpmem_read_info);
@@ -106,13 +106,15 @@ err:
 }
 
 /*
- * util_file_open -- open a memory pool file
+ * util_file_open_common -- (internal) open a memory pool file, locking it
+ *	exclusively unless nolock is set
  */
-int
-util_file_open(const char *path, size_t *size, size_t minsize, int flags)
+static int
+util_file_open_common(const char *path, size_t *size, size_t minsize,
+	int flags, int nolock)
 {
-	LOG(3, "path %s size %p minsize %zu flags %d", path, size, minsize,
-			flags);
+	LOG(3, "path %s size %p minsize %zu flags %d nolock %d", path, size,
+			minsize, flags, nolock);
 
 	int oerrno;
 	int fd;
@@ -125,7 +127,7 @@ util_file_open(const char *path, size_t *size, size_t minsize, int flags)
 		return -1;
 	}
 
-	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+	if (!nolock && flock(fd, LOCK_EX | LOCK_NB) < 0) {
 		ERR("!flock");
 		(void) close(fd);
 		return -1;
@@ -135,33 +137,47 @@ util_file_open(const char *path, size_t *size, size_t minsize, int flags)
 		if (size)
 			ASSERTeq(*size, 0);
 
-		util_stat_t stbuf;
-		if (util_fstat(fd, &stbuf) < 0) {
-			ERR("!fstat %s", path);
+		ssize_t fsize = util_fd_get_size(fd);
+		if (fsize < 0) {
+			LOG(2, "cannot determine the size of %s", path);
 			goto err;
 		}
-		if (stbuf.st_size < 0) {
-			ERR("stat %s: negative size", path);
-			errno = EINVAL;
-			goto err;
-		}
-		if ((size_t)stbuf.st_size < minsize) {
+		if ((size_t)fsize < minsize) {
 			ERR("size %zu smaller than %zu",
-					(size_t)stbuf.st_size, minsize);
+					(size_t)fsize, minsize);
 			errno = EINVAL;
 			goto err;
 		}
 
 		if (size)
-			*size = (size_t)stbuf.st_size;
+			*size = (size_t)fsize;
 	}
 
 	return fd;
 err:
 	oerrno = errno;
-	if (flock(fd, LOCK_UN))
+	if (!nolock && flock(fd, LOCK_UN))
 		ERR("!flock unlock");
 	(void) close(fd);
 	errno = oerrno;
 	return -1;
 }
+
+/*
+ * util_file_open -- open a memory pool file
+ */
+int
+util_file_open(const char *path, size_t *size, size_t minsize, int flags)
+{
+	return util_file_open_common(path, size, minsize, flags, 0);
+}
+
+/*
+ * util_file_open_shared -- open a memory pool file read-only, without
+ *	locking it, so it can be shared with the process which has it open
+ */
+int
+util_file_open_shared(const char *path, size_t *size, size_t minsize)
+{
+	return util_file_open_common(path, size, minsize, O_RDONLY, 1);
+}
@@ -46,6 +46,13 @@ int util_is_absolute_path(const char *path);
 
 int util_file_create(const char *path, size_t size, size_t minsize);
 int util_file_open(const char *path, size_t *size, size_t minsize, int flags);
+int util_file_open_shared(const char *path, size_t *size, size_t minsize);
+int util_file_get_numa_node(int fd);
+
+int util_file_is_device_dax(const char *path);
+int util_fd_is_device_dax(int fd);
+ssize_t util_fd_get_size(int fd);
+size_t util_fd_device_dax_alignment(int fd);
 
 #ifndef _WIN32
 typedef struct stat util_stat_t;
@@ -35,13 +35,21 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include "file.h"
 #include "out.h"
 
+/* the page size of a device DAX when sysfs does not tell */
+#define DEVICE_DAX_DEFAULT_ALIGN ((size_t)2 << 20)
+
 /*
  * util_tmpfile --  (internal) create the temporary file
  */
@@ -101,3 +109,228 @@ util_is_absolute_path(const char *path)
 	else
 		return 0;
 }
+
+/*
+ * read_numa_node -- (internal) read NUMA node id from a sysfs attribute
+ */
+static int
+read_numa_node(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+
+	int node;
+	if (fscanf(f, "%d", &node) != 1)
+		node = -1;
+
+	(void) fclose(f);
+
+	return node;
+}
+
+/*
+ * util_file_get_numa_node -- return NUMA node backing the file, or -1
+ *
+ * The node is taken from the sysfs entry of the block device the file
+ * resides on (or of the character device itself, for device DAX).
+ * For partitions the attribute lives in the parent device directory.
+ *
+ * This is only a hint, the attribute is usually missing for virtual devices,
+ * so errno is left as it was whether or not the node is found.
+ */
+int
+util_file_get_numa_node(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	int oerrno = errno;
+
+	util_stat_t st;
+	if (util_fstat(fd, &st) < 0) {
+		LOG(4, "!fstat %d", fd);
+		errno = oerrno;
+		return -1;
+	}
+
+	const char *type;
+	dev_t dev;
+	if (S_ISCHR(st.st_mode)) {
+		type = "char";
+		dev = st.st_rdev;
+	} else {
+		type = "block";
+		dev = st.st_dev;
+	}
+
+	char path[PATH_MAX];
+	unsigned maj = major(dev);
+	unsigned min = minor(dev);
+
+	snprintf(path, sizeof(path), "/sys/dev/%s/%u:%u/device/numa_node",
+		type, maj, min);
+	int node = read_numa_node(path);
+	if (node < 0) {
+		snprintf(path, sizeof(path),
+			"/sys/dev/%s/%u:%u/../device/numa_node",
+			type, maj, min);
+		node = read_numa_node(path);
+	}
+
+	LOG(4, "fd %d numa node %d", fd, node);
+
+	errno = oerrno;
+	return node;
+}
+
+/*
+ * device_dax_rdev -- (internal) get the device number of a device DAX
+ *
+ * Returns 1 and stores the device number in *rdev if the file described
+ * by st is a device DAX character device, 0 otherwise.
+ */
+static int
+device_dax_rdev(const util_stat_t *st, dev_t *rdev)
+{
+	if (!S_ISCHR(st->st_mode))
+		return 0;
+
+	char spath[PATH_MAX];
+	snprintf(spath, sizeof(spath), "/sys/dev/char/%u:%u/subsystem",
+		major(st->st_rdev), minor(st->st_rdev));
+
+	char npath[PATH_MAX];
+	if (realpath(spath, npath) == NULL) {
+		LOG(4, "!realpath %s", spath);
+		return 0;
+	}
+
+	/* /sys/class/dax or /sys/bus/dax, depending on the kernel */
+	const char *name = strrchr(npath, '/');
+	if (name == NULL || strcmp(name, "/dax") != 0)
+		return 0;
+
+	*rdev = st->st_rdev;
+	return 1;
+}
+
+/*
+ * device_dax_read_size -- (internal) read a size attribute of a device DAX
+ */
+static int
+device_dax_read_size(dev_t rdev, const char *attr, size_t *size)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/%s",
+		major(rdev), minor(rdev), attr);
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		LOG(4, "!fopen %s", path);
+		return -1;
+	}
+
+	unsigned long long val;
+	int ret = fscanf(f, "%llu", &val) == 1 ? 0 : -1;
+	(void) fclose(f);
+
+	if (ret == 0)
+		*size = (size_t)val;
+
+	return ret;
+}
+
+/*
+ * util_file_is_device_dax -- check if the path points to a device DAX
+ */
+int
+util_file_is_device_dax(const char *path)
+{
+	LOG(3, "path \"%s\"", path);
+
+	util_stat_t st;
+	dev_t rdev;
+	if (util_stat(path, &st) < 0)
+		return 0;
+
+	return device_dax_rdev(&st, &rdev);
+}
+
+/*
+ * util_fd_is_device_dax -- check if the file descriptor is a device DAX
+ */
+int
+util_fd_is_device_dax(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	util_stat_t st;
+	dev_t rdev;
+	if (util_fstat(fd, &st) < 0)
+		return 0;
+
+	return device_dax_rdev(&st, &rdev);
+}
+
+/*
+ * util_fd_get_size -- return the size of the file, or -1 on error
+ *
+ * A device DAX has no size of its own, it is read from sysfs.
+ */
+ssize_t
+util_fd_get_size(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	util_stat_t st;
+	if (util_fstat(fd, &st) < 0) {
+		ERR("!fstat %d", fd);
+		return -1;
+	}
+
+	dev_t rdev;
+	if (!device_dax_rdev(&st, &rdev))
+		return (ssize_t)st.st_size;
+
+	size_t size;
+	if (device_dax_read_size(rdev, "size", &size) != 0 ||
+	    (ssize_t)size < 0) {
+		ERR("cannot read the size of device DAX %u:%u",
+			major(rdev), minor(rdev));
+		errno = EINVAL;
+		return -1;
+	}
+
+	LOG(4, "device DAX size %zu", size);
+
+	return (ssize_t)size;
+}
+
+/*
+ * util_fd_device_dax_alignment -- return the mapping alignment of a device
+ *	DAX, or 0 if the file descriptor is not a device DAX
+ *
+ * Mappings of a device DAX must be aligned to the page size of the device
+ * (2MB or 1GB), both in the address space and in the device.
+ */
+size_t
+util_fd_device_dax_alignment(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	util_stat_t st;
+	dev_t rdev;
+	if (util_fstat(fd, &st) < 0 || !device_dax_rdev(&st, &rdev))
+		return 0;
+
+	size_t align;
+	if (device_dax_read_size(rdev, "device/align", &align) != 0 ||
+	    align == 0 || (align & (align - 1)) != 0) {
+		LOG(4, "unknown device DAX alignment, assuming 2MB");
+		align = DEVICE_DAX_DEFAULT_ALIGN;
+	}
+
+	LOG(4, "device DAX alignment %zu", align);
+
+	return align;
+}
@@ -113,3 +113,69 @@ util_is_absolute_path(const char *path)
 	else
 		return 1;
 }
+
+/*
+ * util_file_get_numa_node -- return NUMA node backing the file, or -1
+ *
+ * XXX - not implemented
+ */
+int
+util_file_get_numa_node(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	return -1;
+}
+
+/*
+ * util_file_is_device_dax -- check if the path points to a device DAX
+ *
+ * There is no device DAX on Windows.
+ */
+int
+util_file_is_device_dax(const char *path)
+{
+	LOG(3, "path \"%s\"", path);
+
+	return 0;
+}
+
+/*
+ * util_fd_is_device_dax -- check if the file descriptor is a device DAX
+ */
+int
+util_fd_is_device_dax(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	return 0;
+}
+
+/*
+ * util_fd_get_size -- return the size of the file, or -1 on error
+ */
+ssize_t
+util_fd_get_size(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	util_stat_t st;
+	if (util_fstat(fd, &st) < 0) {
+		ERR("!fstat %d", fd);
+		return -1;
+	}
+
+	return (ssize_t)st.st_size;
+}
+
+/*
+ * util_fd_device_dax_alignment -- return the mapping alignment of a device
+ *	DAX, or 0 if the file descriptor is not a device DAX
+ */
+size_t
+util_fd_device_dax_alignment(int fd)
+{
+	LOG(3, "fd %d", fd);
+
+	return 0;
+}
@@ -47,6 +47,8 @@
 
 int Mmap_no_random;
 void *Mmap_hint;
+int Mmap_populate;
+unsigned Mmap_open_nthreads;	/* 0 means chosen automatically */
 
 /*
  * util_mmap_init -- initialize the mmap utils
@@ -76,6 +78,32 @@ util_mmap_init(void)
 			LOG(3, "PMEM_MMAP_HINT set to %p", Mmap_hint);
 		}
 	}
+
+	/*
+	 * Allow pre-faulting the page tables of all the file mappings,
+	 * so that there are no page faults on the first access.
+	 */
+	e = getenv("PMEM_MMAP_POPULATE");
+	if (e && strcmp(e, "1") == 0) {
+		Mmap_populate = 1;
+		LOG(3, "PMEM_MMAP_POPULATE set");
+	}
+
+	/*
+	 * Allow setting the number of threads mapping and checking the part
+	 * headers of a pool set on open, 1 means no parallelism.
+	 */
+	e = getenv("PMEM_OPEN_THREADS");
+	if (e) {
+		long val = atol(e);
+		if (val < 1) {
+			LOG(2, "Invalid PMEM_OPEN_THREADS");
+		} else {
+			Mmap_open_nthreads = (unsigned)val;
+			LOG(3, "PMEM_OPEN_THREADS set to %u",
+				Mmap_open_nthreads);
+		}
+	}
 }
 
 /*
@@ -84,12 +112,14 @@ util_mmap_init(void)
  * This is just a convenience function that calls mmap() with the
  * appropriate arguments and includes our trace points.
  *
- * If cow is set, the file is mapped copy-on-write.
+ * The flags are passed to mmap(), they have to include either MAP_SHARED
+ * or MAP_PRIVATE.  MAP_POPULATE is added if PMEM_MMAP_POPULATE is set.
  */
 void *
-util_map(int fd, size_t len, int cow, size_t req_align)
+util_map(int fd, size_t len, int flags, size_t req_align)
 {
-	LOG(3, "fd %d len %zu cow %d req_align %zu", fd, len, cow, req_align);
+	LOG(3, "fd %d len %zu flags %d req_align %zu", fd, len, flags,
+			req_align);
 
 	void *base;
 	void *addr = util_map_hint(len, req_align);
@@ -98,9 +128,11 @@ util_map(int fd, size_t len, int cow, size_t req_align)
 		return NULL;
 	}
 
+	if (Mmap_populate)
+		flags |= MAP_POPULATE;
+
 	if ((base = mmap(addr, len, PROT_READ|PROT_WRITE,
-			(cow) ? MAP_PRIVATE|MAP_NORESERVE : MAP_SHARED,
-					fd, 0)) == MAP_FAILED) {
+			flags, fd, 0)) == MAP_FAILED) {
 		ERR("!mmap %zu bytes", len);
 		return NULL;
 	}
@@ -156,7 +188,7 @@ util_map_tmpfile(const char *dir, size_t size, size_t req_align)
 	}
 
 	void *base;
-	if ((base = util_map(fd, size, 0, req_align)) == NULL) {
+	if ((base = util_map(fd, size, MAP_SHARED, req_align)) == NULL) {
 		LOG(2, "cannot mmap temporary file");
 		goto err;
 	}
@@ -47,8 +47,10 @@
 
 extern int Mmap_no_random;
 extern void *Mmap_hint;
+extern int Mmap_populate;
+extern unsigned Mmap_open_nthreads;
 
-void *util_map(int fd, size_t len, int cow, size_t req_align);
+void *util_map(int fd, size_t len, int flags, size_t req_align);
 int util_unmap(void *addr, size_t len);
 
 void *util_map_tmpfile(const char *dir, size_t size, size_t req_align);
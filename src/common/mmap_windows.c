@@ -35,48 +35,41 @@
  * mmap_windows.c -- memory-mapped files for Windows
  */
 
+#include <windows.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include "mmap.h"
 #include "out.h"
 
 /*
  * util_map_hint -- determine hint address for mmap()
+ *
+ * The files on DAX volumes are mapped with large pages wherever the view is
+ * aligned to them, so the hint is aligned the same way as on Linux.
  */
 char *
 util_map_hint(size_t len, size_t req_align)
 {
 	LOG(3, "len %zu req_align %zu", len, req_align);
 
-#if 0
-	/*
-	 * XXX - for large mappings, we can end up with error
-	 * ERROR_COMMITMENT_LIMIT (0x5AF) - The paging file is too small
-	 * for this operation to complete.  So we should use VirtualAlloc(
-	 * MEM_RESERVE) to see if the virtual address is available.
-	 *
-	 * XXX - Windows doesn't support large DAX pages yet, so there is
-	 * no point in aligning for the same.
-	 */
-
 	/* choose the desired alignment based on the requested length */
 	size_t align = util_map_hint_align(len, req_align);
 
 	/*
-	 * Create dummy mapping to find an unused region of given size.
-	 * Request for increased size for later address alignment.
+	 * Reserve a region of the address space to find an unused one of
+	 * given size -- unlike a dummy mapping, a reservation isn't charged
+	 * against the commit limit, which could fail large mappings with
+	 * ERROR_COMMITMENT_LIMIT. Request for increased size for later
+	 * address alignment.
 	 */
-	char *addr = mmap(NULL, len + align, PROT_READ|PROT_WRITE,
-			MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
-	if (addr != MAP_FAILED) {
+	char *addr = VirtualAlloc(NULL, len + align, MEM_RESERVE,
+			PAGE_NOACCESS);
+	if (addr != NULL) {
 		LOG(4, "system choice %p", addr);
-		munmap(addr, len + align);
+		VirtualFree(addr, 0, MEM_RELEASE);
 		addr = (char *)roundup((uintptr_t)addr, align);
 	}
 
 	LOG(4, "hint %p", addr);
 	return addr;
-#else
-	LOG(4, "hint %p", NULL);
-	return NULL;
-#endif
 }
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mtcopy.c -- multi-threaded copy of large ranges
+ *
+ * A single thread streaming data to persistent memory cannot saturate
+ * the memory channels of a big machine, so (if enabled) very large copies
+ * are split into page aligned slices which are copied and persisted
+ * concurrently, each one by its own thread.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mtcopy.h"
+#include "out.h"
+#include "util.h"
+
+/* the number of threads used for a large copy, 0 or 1 means disabled */
+unsigned Mtcopy_nthreads;
+
+/* the minimum length of a copy to be split between threads */
+size_t Mtcopy_threshold = MTCOPY_THRESHOLD_DEFAULT;
+
+struct mtcopy_slice {
+	void *dest;
+	const void *src;
+	size_t len;
+	mtcopy_fn copy;
+};
+
+/*
+ * util_mtcopy_init -- read the multi-threaded copy configuration
+ *	from the given environment variables
+ */
+void
+util_mtcopy_init(const char *threads_var, const char *threshold_var)
+{
+	LOG(3, "threads_var %s threshold_var %s", threads_var, threshold_var);
+
+	char *e = getenv(threads_var);
+	if (e) {
+		long val = atol(e);
+		if (val < 0 || val > MTCOPY_THREADS_MAX) {
+			LOG(2, "Invalid %s", threads_var);
+		} else {
+			Mtcopy_nthreads = (unsigned)val;
+			LOG(3, "%s set to %u", threads_var, Mtcopy_nthreads);
+		}
+	}
+
+	e = getenv(threshold_var);
+	if (e) {
+		long long val = atoll(e);
+		if (val <= 0) {
+			LOG(2, "Invalid %s", threshold_var);
+		} else {
+			Mtcopy_threshold = (size_t)val;
+			LOG(3, "%s set to %zu", threshold_var,
+					Mtcopy_threshold);
+		}
+	}
+}
+
+/*
+ * mtcopy_worker -- (internal) copy a single slice
+ */
+static void *
+mtcopy_worker(void *arg)
+{
+	struct mtcopy_slice *s = arg;
+
+	s->copy(s->dest, s->src, s->len);
+
+	return NULL;
+}
+
+/*
+ * util_memcpy_mt -- copy a range using multiple threads
+ *
+ * The range is split into Mtcopy_nthreads slices, with the boundaries
+ * aligned to the page size of the destination, so that no two threads
+ * ever touch the same cache line.  The calling thread copies the first
+ * slice itself.  The copy function is expected to make its slice
+ * persistent, so the whole range is persistent once all the threads
+ * are joined.  If a thread cannot be created, its slice is copied by
+ * the calling thread.
+ */
+void
+util_memcpy_mt(void *dest, const void *src, size_t len, mtcopy_fn copy)
+{
+	LOG(3, "dest %p src %p len %zu", dest, src, len);
+
+	unsigned nthreads = Mtcopy_nthreads;
+	if (nthreads > MTCOPY_THREADS_MAX)
+		nthreads = MTCOPY_THREADS_MAX;
+
+	/* the number of threads might be 0 if they're disabled */
+	size_t slice = len;
+	if (nthreads > 1)
+		slice = (len / nthreads + Pagesize - 1) & ~(Pagesize - 1);
+
+	if (slice >= len) {
+		copy(dest, src, len);
+		return;
+	}
+
+	struct mtcopy_slice slices[MTCOPY_THREADS_MAX];
+	pthread_t threads[MTCOPY_THREADS_MAX];
+	int started[MTCOPY_THREADS_MAX];
+
+	/* the first slice ends at the page boundary of the destination */
+	uintptr_t first_end = ((uintptr_t)dest + slice) & ~(Pagesize - 1);
+	size_t off = first_end - (uintptr_t)dest;
+
+	unsigned n = 0;
+	while (off < len && n < nthreads - 1) {
+		size_t l = len - off;
+		if (l > slice && n < nthreads - 2)
+			l = slice;
+
+		slices[n].dest = (char *)dest + off;
+		slices[n].src = (const char *)src + off;
+		slices[n].len = l;
+		slices[n].copy = copy;
+
+		int ret = pthread_create(&threads[n], NULL, mtcopy_worker,
+				&slices[n]);
+		if (ret) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+			started[n] = 0;
+		} else {
+			started[n] = 1;
+		}
+
+		off += l;
+		n++;
+	}
+
+	copy(dest, src, first_end - (uintptr_t)dest);
+
+	for (unsigned i = 0; i < n; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			mtcopy_worker(&slices[i]);
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mtcopy.h -- internal definitions for the multi-threaded copy module
+ */
+
+#ifndef NVML_MTCOPY_H
+#define NVML_MTCOPY_H 1
+
+#include <stddef.h>
+
+#define MTCOPY_THREADS_MAX 64
+#define MTCOPY_THRESHOLD_DEFAULT (64 << 20) /* 64 MiB */
+
+extern unsigned Mtcopy_nthreads;
+extern size_t Mtcopy_threshold;
+
+typedef void *(*mtcopy_fn)(void *dest, const void *src, size_t len);
+
+void util_mtcopy_init(const char *threads_var, const char *threshold_var);
+
+/*
+ * util_mtcopy_enabled -- check if a copy of len bytes should be split
+ *	between multiple threads
+ */
+static inline int
+util_mtcopy_enabled(size_t len)
+{
+	return Mtcopy_nthreads > 1 && len >= Mtcopy_threshold;
+}
+
+void util_memcpy_mt(void *dest, const void *src, size_t len,
+	mtcopy_fn copy);
+
+#endif
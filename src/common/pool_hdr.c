@@ -56,6 +56,7 @@ util_convert2le_hdr(struct pool_hdr *hdrp)
 		htole64(hdrp->arch_flags.alignment_desc);
 	hdrp->arch_flags.e_machine = htole16(hdrp->arch_flags.e_machine);
 	hdrp->crtime = htole64(hdrp->crtime);
+	hdrp->stripe_size = htole64(hdrp->stripe_size);
 	hdrp->checksum = htole64(hdrp->checksum);
 }
 
@@ -70,6 +71,7 @@ util_convert2h_hdr_nocheck(struct pool_hdr *hdrp)
 	hdrp->incompat_features = le32toh(hdrp->incompat_features);
 	hdrp->ro_compat_features = le32toh(hdrp->ro_compat_features);
 	hdrp->crtime = le64toh(hdrp->crtime);
+	hdrp->stripe_size = le64toh(hdrp->stripe_size);
 	hdrp->arch_flags.e_machine =
 		le16toh(hdrp->arch_flags.e_machine);
 	hdrp->arch_flags.alignment_desc =
@@ -106,12 +106,19 @@ struct pool_hdr {
 	uuid_t next_repl_uuid; /* next replica */
 	uint64_t crtime;		/* when created (seconds since epoch) */
 	struct arch_flags arch_flags;	/* architecture identification flags */
-	unsigned char unused[3944];	/* must be zero */
+	uint64_t stripe_size;		/* 0 if the parts are concatenated */
+	unsigned char unused[3936];	/* must be zero */
 	uint64_t checksum;		/* checksum of above fields */
 };
 
 #define POOL_HDR_SIZE	(sizeof(struct pool_hdr))
 
+/*
+ * "must support" feature common to all pool types, set if the parts of
+ * the replica are striped (see stripe_size)
+ */
+#define POOL_FEAT_STRIPED	0x80000000
+
 void util_convert2le_hdr(struct pool_hdr *hdrp);
 void util_convert2h_hdr_nocheck(struct pool_hdr *hdrp);
 int util_convert_hdr(struct pool_hdr *hdrp);
@@ -52,6 +52,7 @@
 #include <stddef.h>
 #include <time.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include <linux/limits.h>
 
 #include "libpmem.h"
@@ -78,6 +79,9 @@ static int (*Rpmem_close)(RPMEMpool *rpp);
 int (*Rpmem_persist)(RPMEMpool *rpp, size_t offset, size_t length,
 			unsigned lane);
 int (*Rpmem_read)(RPMEMpool *rpp, void *buff, size_t offset, size_t length);
+int (*Rpmem_flush)(RPMEMpool *rpp, size_t offset, size_t length,
+			unsigned lane);
+int (*Rpmem_drain)(RPMEMpool *rpp, unsigned lane);
 
 static int Remote_replication_available;
 static pthread_mutex_t Remote_lock;
@@ -140,6 +144,8 @@ util_remote_unload_core()
 	Rpmem_close = NULL;
 	Rpmem_persist = NULL;
 	Rpmem_read = NULL;
+	Rpmem_flush = NULL;
+	Rpmem_drain = NULL;
 }
 
 /*
@@ -188,6 +194,8 @@ util_remote_load()
 	CHECK_FUNC_COMPATIBLE(rpmem_close, *Rpmem_close);
 	CHECK_FUNC_COMPATIBLE(rpmem_persist, *Rpmem_persist);
 	CHECK_FUNC_COMPATIBLE(rpmem_read, *Rpmem_read);
+	CHECK_FUNC_COMPATIBLE(rpmem_flush, *Rpmem_flush);
+	CHECK_FUNC_COMPATIBLE(rpmem_drain, *Rpmem_drain);
 
 	util_mutex_lock(&Remote_lock);
 
@@ -232,6 +240,18 @@ util_remote_load()
 		goto err;
 	}
 
+	Rpmem_flush = util_dlsym(Rpmem_handle_remote, "rpmem_flush");
+	if (util_dl_check_error(Rpmem_flush, "dlsym")) {
+		ERR("symbol 'rpmem_flush' not found");
+		goto err;
+	}
+
+	Rpmem_drain = util_dlsym(Rpmem_handle_remote, "rpmem_drain");
+	if (util_dl_check_error(Rpmem_drain, "dlsym")) {
+		ERR("symbol 'rpmem_drain' not found");
+		goto err;
+	}
+
 end:
 	Remote_usage_counter++;
 	util_mutex_unlock(&Remote_lock);
@@ -260,6 +280,10 @@ enum parser_codes {
 	PARSER_REP_NO_PARTS,
 	PARSER_SIZE_MISMATCH,
 	PARSER_OUT_OF_MEMORY,
+	PARSER_STRIPE_EXPECTED,
+	PARSER_WRONG_STRIPE_SIZE,
+	PARSER_STRIPE_MISPLACED,
+	PARSER_PART_SMALLER_THAN_STRIPE,
 	PARSER_FORMAT_OK,
 	PARSER_MAX_CODE
 };
@@ -277,6 +301,10 @@ static const char *parser_errstr[PARSER_MAX_CODE] = {
 	"no replica parts",
 	"sizes of pool set and replica mismatch",
 	"allocating memory failed",
+	"exactly 'STRIPE' and a size expected",
+	"incorrect stripe size (must be a multiple of the mapping alignment)",
+	"'STRIPE' must precede the parts of a local replica",
+	"part smaller than the stripe size",
 	"" /* format correct */
 };
 
@@ -291,7 +319,11 @@ util_map_hdr(struct pool_set_part *part, int flags)
 	COMPILE_ERROR_ON(POOL_HDR_SIZE == 0);
 	ASSERTeq(POOL_HDR_SIZE % Pagesize, 0);
 
-	void *hdrp = mmap(NULL, POOL_HDR_SIZE,
+	/* a device DAX can be mapped only in units of its page size */
+	size_t hdrsize = part->alignment > POOL_HDR_SIZE ?
+		part->alignment : POOL_HDR_SIZE;
+
+	void *hdrp = mmap(NULL, hdrsize,
 		PROT_READ|PROT_WRITE, flags, part->fd, 0);
 
 	if (hdrp == MAP_FAILED) {
@@ -299,7 +331,7 @@ util_map_hdr(struct pool_set_part *part, int flags)
 		return -1;
 	}
 
-	part->hdrsize = POOL_HDR_SIZE;
+	part->hdrsize = hdrsize;
 	part->hdr = hdrp;
 
 	VALGRIND_REGISTER_PMEM_MAPPING(part->hdr, part->hdrsize);
@@ -327,6 +359,119 @@ util_unmap_hdr(struct pool_set_part *part)
 	return 0;
 }
 
+/* a job run for every part of a replica by util_parts_parallel() */
+typedef int (*util_part_fn)(struct pool_replica *rep, unsigned p, void *arg);
+
+struct util_parts_job {
+	struct pool_replica *rep;
+	util_part_fn fn;
+	void *arg;
+	unsigned first;		/* first part of the thread */
+	unsigned stride;	/* the number of threads */
+	int *failed;		/* per part, set if fn failed */
+};
+
+/*
+ * util_parts_worker -- (internal) run the job on every stride-th part
+ *
+ * Consecutive parts usually reside on different devices, interleaving
+ * them spreads the I/O of each thread.
+ */
+static void *
+util_parts_worker(void *arg)
+{
+	struct util_parts_job *job = arg;
+
+	for (unsigned p = job->first; p < job->rep->nparts; p += job->stride)
+		job->failed[p] = job->fn(job->rep, p, job->arg) != 0;
+
+	return NULL;
+}
+
+/*
+ * util_parts_parallel -- (internal) run fn on all parts of a replica
+ *
+ * With many parts, the parts are split between threads.  Errors reported
+ * from other threads are not visible to the caller, so every part for
+ * which fn failed is then retried by the calling thread, in order, which
+ * also reproduces the error message and errno of a serial run.  fn must
+ * therefore be safe to retry.  Returns 0 if fn eventually succeeded for
+ * all parts, -1 otherwise.
+ */
+static int
+util_parts_parallel(struct pool_replica *rep, util_part_fn fn, void *arg)
+{
+	unsigned nthreads = Mmap_open_nthreads;
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = rep->nparts < UTIL_OPEN_PARALLEL_MIN || ncpus < 1 ?
+			1 : (unsigned)ncpus;
+	}
+	if (nthreads > UTIL_OPEN_THREADS_MAX)
+		nthreads = UTIL_OPEN_THREADS_MAX;
+	if (nthreads > rep->nparts)
+		nthreads = rep->nparts;
+
+	int *failed = NULL;
+	if (nthreads > 1 && (failed = Zalloc(rep->nparts *
+			sizeof(*failed))) == NULL)
+		nthreads = 1;
+
+	if (nthreads <= 1) {
+		for (unsigned p = 0; p < rep->nparts; p++) {
+			if (fn(rep, p, arg) != 0)
+				return -1;
+		}
+		return 0;
+	}
+
+	struct util_parts_job jobs[UTIL_OPEN_THREADS_MAX];
+	pthread_t threads[UTIL_OPEN_THREADS_MAX];
+	int started[UTIL_OPEN_THREADS_MAX];
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		jobs[t].rep = rep;
+		jobs[t].fn = fn;
+		jobs[t].arg = arg;
+		jobs[t].first = t;
+		jobs[t].stride = nthreads;
+		jobs[t].failed = failed;
+
+		started[t] = 0;
+		if (t == 0)
+			continue;
+
+		int ret = pthread_create(&threads[t], NULL,
+				util_parts_worker, &jobs[t]);
+		if (ret) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+		} else {
+			started[t] = 1;
+		}
+	}
+
+	util_parts_worker(&jobs[0]);
+
+	for (unsigned t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		else
+			util_parts_worker(&jobs[t]);
+	}
+
+	int ret = 0;
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		if (failed[p] && fn(rep, p, arg) != 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	Free(failed);
+	return ret;
+}
+
 /*
  * util_map_part -- map a part of a pool set
  */
@@ -345,6 +490,9 @@ util_map_part(struct pool_set_part *part, void *addr, size_t size,
 	if (!size)
 		size = (part->filesize & ~(Mmap_align - 1)) - offset;
 
+	if (Mmap_populate)
+		flags |= MAP_POPULATE;
+
 	void *addrp = mmap(addr, size,
 		PROT_READ|PROT_WRITE, flags, part->fd, (off_t)offset);
 
@@ -362,12 +510,63 @@ util_map_part(struct pool_set_part *part, void *addr, size_t size,
 		return -1;
 	}
 
+	part->numa_node = util_file_get_numa_node(part->fd);
+	LOG(4, "part %s numa node %d", part->path, part->numa_node);
+
 	VALGRIND_REGISTER_PMEM_MAPPING(part->addr, part->size);
 	VALGRIND_REGISTER_PMEM_FILE(part->fd, part->addr, part->size, offset);
 
 	return 0;
 }
 
+/*
+ * util_map_stripes -- (internal) map the stripes of a striped replica
+ *
+ * The first part must be already mapped over the whole replica.  Stripe k
+ * of part p is mapped over it at offset (k * nparts + p) * stripe_size of
+ * the replica, so consecutive stripes of the address space come from
+ * consecutive parts.  As with concatenated parts, only the header of the
+ * first part belongs to the pool; the other parts start past their header.
+ * The stripes of all the parts are unmapped along with the first part.
+ */
+static int
+util_map_stripes(struct pool_replica *rep, int flags)
+{
+	LOG(3, "rep %p flags %d", rep, flags);
+
+	char *base = rep->part[0].addr;
+	size_t row = rep->nparts * rep->stripe_size;
+
+	if (Mmap_populate)
+		flags |= MAP_POPULATE;
+
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		struct pool_set_part *part = &rep->part[p];
+		size_t start = p == 0 ? 0 : Mmap_align;
+
+		/* the first stripe of the first part is already in place */
+		for (size_t k = p == 0 ? 1 : 0; k < rep->nstripes; k++) {
+			void *addr = base + k * row + p * rep->stripe_size;
+			size_t offset = start + k * rep->stripe_size;
+
+			void *addrp = mmap(addr, rep->stripe_size,
+				PROT_READ|PROT_WRITE, flags | MAP_FIXED,
+				part->fd, (off_t)offset);
+			if (addrp == MAP_FAILED) {
+				ERR("!mmap: %s", part->path);
+				return -1;
+			}
+
+			VALGRIND_REGISTER_PMEM_FILE(part->fd, addr,
+				rep->stripe_size, offset);
+		}
+
+		part->numa_node = util_file_get_numa_node(part->fd);
+	}
+
+	return 0;
+}
+
 /*
  * util_unmap_part -- unmap a part of a pool set
  */
@@ -390,6 +589,42 @@ util_unmap_part(struct pool_set_part *part)
 	return 0;
 }
 
+/*
+ * util_replica_addr_numa_node -- return NUMA node backing given address
+ *
+ * Returns -1 if the address does not belong to any mapped part of the
+ * replica or if the node of the part is unknown.
+ */
+int
+util_replica_addr_numa_node(struct pool_replica *rep, const void *addr)
+{
+	if (rep->stripe_size != 0) {
+		uintptr_t base = (uintptr_t)rep->part[0].addr;
+		if (base == 0 || (uintptr_t)addr < base ||
+		    (uintptr_t)addr >= base + rep->repsize)
+			return -1;
+
+		size_t stripe = ((uintptr_t)addr - base) / rep->stripe_size;
+		return rep->part[stripe % rep->nparts].numa_node;
+	}
+
+	/*
+	 * The first part's mapping covers the whole replica (the remaining
+	 * parts are mapped over it), so search the parts backwards.
+	 */
+	for (unsigned p = rep->nparts; p > 0; p--) {
+		struct pool_set_part *part = &rep->part[p - 1];
+		if (part->addr == NULL)
+			continue;
+
+		if ((uintptr_t)addr >= (uintptr_t)part->addr &&
+		    (uintptr_t)addr < (uintptr_t)part->addr + part->size)
+			return part->numa_node;
+	}
+
+	return -1;
+}
+
 /*
  * util_unmap_parts -- unmap parts from start_index to the end_index
  */
@@ -618,6 +853,42 @@ parser_read_replica(char *line, char **node_addr, char **pool_desc)
 	return PARSER_CONTINUE;
 }
 
+/*
+ * parser_read_stripe -- (internal) read and validate the stripe size
+ *                        of a replica from a pool set file
+ */
+static enum parser_codes
+parser_read_stripe(char *line, size_t *stripe_size)
+{
+	char *size_str;
+	char *saveptr;
+
+	size_str = strtok_r(line, " \t", &saveptr);
+	if (!size_str || strtok_r(NULL, " \t", &saveptr) != NULL)
+		return PARSER_STRIPE_EXPECTED;
+
+	LOG(10, "stripe size '%s'", size_str);
+
+	if (util_parse_size(size_str, stripe_size) != 0 ||
+	    *stripe_size == 0 || *stripe_size % Mmap_align != 0)
+		return PARSER_WRONG_STRIPE_SIZE;
+
+	return PARSER_CONTINUE;
+}
+
+/*
+ * util_stripe_part_size -- (internal) size of a part usable for stripes
+ *
+ * The first part of a replica contributes its header too, as the header
+ * of the first part is the pool header.
+ */
+static size_t
+util_stripe_part_size(const struct pool_replica *rep, unsigned p)
+{
+	size_t size = rep->part[p].filesize & ~(Mmap_align - 1);
+	return p == 0 ? size : size - Mmap_align;
+}
+
 /*
  * util_parse_add_part -- (internal) add a new part file to the replica info
  */
@@ -646,8 +917,11 @@ util_parse_add_part(struct pool_set *set, const char *path, size_t filesize)
 	rep->part[p].filesize = filesize;
 	rep->part[p].fd = -1;
 	rep->part[p].created = 0;
+	rep->part[p].is_dev_dax = 0;
+	rep->part[p].alignment = Mmap_align;
 	rep->part[p].hdr = NULL;
 	rep->part[p].addr = NULL;
+	rep->part[p].numa_node = -1;
 
 	return 0;
 }
@@ -696,11 +970,23 @@ util_poolset_set_size(struct pool_set *set)
 	set->poolsize = SIZE_MAX;
 	for (unsigned r = 0; r < set->nreplicas; r++) {
 		struct pool_replica *rep = set->replica[r];
-		rep->repsize = Mmap_align;
-		for (unsigned p = 0; p < rep->nparts; p++) {
-			rep->repsize +=
-				(rep->part[p].filesize & ~(Mmap_align - 1)) -
-				Mmap_align;
+		if (rep->stripe_size != 0) {
+			/* every part holds the same number of stripes */
+			rep->nstripes = SIZE_MAX;
+			for (unsigned p = 0; p < rep->nparts; p++) {
+				size_t n = util_stripe_part_size(rep, p) /
+					rep->stripe_size;
+				if (n < rep->nstripes)
+					rep->nstripes = n;
+			}
+			rep->repsize = rep->nparts * rep->nstripes *
+				rep->stripe_size;
+		} else {
+			rep->repsize = Mmap_align;
+			for (unsigned p = 0; p < rep->nparts; p++) {
+				rep->repsize += (rep->part[p].filesize &
+					~(Mmap_align - 1)) - Mmap_align;
+			}
 		}
 
 		/*
@@ -891,6 +1177,21 @@ util_poolset_parse(struct pool_set **setp, const char *path, int fd)
 				else
 					result = PARSER_REP_NO_PARTS;
 			}
+		} else if (strncmp(line, POOLSET_STRIPE_SIG,
+					POOLSET_STRIPE_SIG_LEN) == 0) {
+			struct pool_replica *rep =
+				set->replica[set->nreplicas - 1];
+			if (!isblank((unsigned char)
+					line[POOLSET_STRIPE_SIG_LEN])) {
+				result = PARSER_STRIPE_EXPECTED;
+			} else if (nparts != 0 || rep->remote != NULL ||
+					rep->stripe_size != 0) {
+				result = PARSER_STRIPE_MISPLACED;
+			} else {
+				result = parser_read_stripe(
+					line + POOLSET_STRIPE_SIG_LEN,
+					&rep->stripe_size);
+			}
 		} else {
 			/* read size and path */
 			result = parser_read_line(line, &psize, &ppath);
@@ -901,6 +1202,14 @@ util_poolset_parse(struct pool_set **setp, const char *path, int fd)
 				if (ret != 0)
 					goto err;
 				nparts++;
+
+				struct pool_replica *rep =
+					set->replica[set->nreplicas - 1];
+				if (rep->stripe_size != 0 &&
+				    util_stripe_part_size(rep, nparts - 1) <
+						rep->stripe_size)
+					result =
+					PARSER_PART_SMALLER_THAN_STRIPE;
 			}
 		}
 	}
@@ -958,6 +1267,8 @@ util_poolset_single(const char *path, size_t filesize, int create)
 	rep->part[0].path = Strdup(path);
 	rep->part[0].fd = -1;	/* will be filled out by util_poolset_file() */
 	rep->part[0].created = create;
+	rep->part[0].is_dev_dax = 0;
+	rep->part[0].alignment = Mmap_align;
 	rep->part[0].hdr = NULL;
 	rep->part[0].addr = NULL;
 
@@ -978,12 +1289,15 @@ util_poolset_single(const char *path, size_t filesize, int create)
 }
 
 /*
- * util_poolset_file -- open or create a single part file
+ * util_poolset_part_file -- (internal) open or create a single part file,
+ *	read-only and without locking it if shared is set
  */
-int
-util_poolset_file(struct pool_set_part *part, size_t minsize, int create)
+static int
+util_poolset_part_file(struct pool_set_part *part, size_t minsize, int create,
+	int shared)
 {
-	LOG(3, "part %p minsize %zu create %d", part, minsize, create);
+	LOG(3, "part %p minsize %zu create %d shared %d", part, minsize,
+		create, shared);
 
 	/* check if file exists */
 	if (access(part->path, F_OK) == 0)
@@ -1002,14 +1316,31 @@ util_poolset_file(struct pool_set_part *part, size_t minsize, int create)
 		part->created = 1;
 	} else {
 		size = 0;
-		part->fd = util_file_open(part->path, &size, minsize, O_RDWR);
+		part->fd = shared ?
+			util_file_open_shared(part->path, &size, minsize) :
+			util_file_open(part->path, &size, minsize, O_RDWR);
 		if (part->fd == -1) {
 			LOG(2, "failed to open file: %s", part->path);
 			return -1;
 		}
 
-		/* check if filesize matches */
-		if (part->filesize != size) {
+		/*
+		 * A device DAX has a fixed size, so the part may use
+		 * only a part of it.
+		 */
+		part->is_dev_dax = util_fd_is_device_dax(part->fd);
+		if (part->is_dev_dax) {
+			part->alignment =
+				util_fd_device_dax_alignment(part->fd);
+			if (part->filesize > size) {
+				ERR("device DAX smaller than config: %s, "
+					"%zu < %zu", part->path, size,
+					part->filesize);
+				errno = EINVAL;
+				return -1;
+			}
+		} else if (part->filesize != size) {
+			/* check if filesize matches */
 			ERR("file size does not match config: %s, %zu != %zu",
 				part->path, size, part->filesize);
 			errno = EINVAL;
@@ -1020,6 +1351,15 @@ util_poolset_file(struct pool_set_part *part, size_t minsize, int create)
 	return 0;
 }
 
+/*
+ * util_poolset_file -- open or create a single part file
+ */
+int
+util_poolset_file(struct pool_set_part *part, size_t minsize, int create)
+{
+	return util_poolset_part_file(part, minsize, create, 0);
+}
+
 /*
  * util_remote_create_attr -- (internal) create attributes for remote replica
  */
@@ -1134,6 +1474,47 @@ util_poolset_remote_open(struct pool_replica *rep, unsigned repidx,
 	return 0;
 }
 
+/*
+ * util_replica_dev_dax -- (internal) adjust a replica to its device DAX
+ *
+ * The usable space of a device DAX is mapped from the device offset 0 in
+ * units of its page size, which other parts following it in the address
+ * space could not keep to, so a device DAX must be the only part of its
+ * replica.
+ */
+static int
+util_replica_dev_dax(struct pool_set *set, struct pool_replica *rep)
+{
+	struct pool_set_part *part = &rep->part[0];
+
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		if (rep->part[p].is_dev_dax && rep->nparts > 1) {
+			ERR("device DAX must be the only part of a replica: "
+				"%s", rep->part[p].path);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (!part->is_dev_dax)
+		return 0;
+
+	part->filesize &= ~(part->alignment - 1);
+	if (part->filesize == 0) {
+		ERR("device DAX part smaller than its alignment %zu: %s",
+			part->alignment, part->path);
+		errno = EINVAL;
+		return -1;
+	}
+
+	rep->stripe_size = 0;
+	rep->repsize = part->filesize;
+	if (rep->repsize < set->poolsize)
+		set->poolsize = rep->repsize;
+
+	return 0;
+}
+
 /*
  * util_poolset_files_local -- (internal) open or create all the local
  *                              part files of a pool set and replica sets
@@ -1147,10 +1528,13 @@ util_poolset_files_local(struct pool_set *set, size_t minsize, int create)
 		struct pool_replica *rep = set->replica[r];
 		if (!rep->remote) {
 			for (unsigned p = 0; p < rep->nparts; p++) {
-				if (util_poolset_file(&rep->part[p], minsize,
-							create))
+				if (util_poolset_part_file(&rep->part[p],
+						minsize, create, set->shared))
 					return -1;
 			}
+
+			if (util_replica_dev_dax(set, rep) != 0)
+				return -1;
 		}
 	}
 
@@ -1218,13 +1602,14 @@ util_poolset_read(struct pool_set **setp, const char *path)
  *
  * On success returns 0 and a pointer to a newly allocated structure
  * containing the info of all the parts of the pool set and replicas.
+ * If shared is set, the files are opened read-only and are not locked.
  */
 static int
 util_poolset_create_set(struct pool_set **setp, const char *path,
-				size_t poolsize, size_t minsize)
+				size_t poolsize, size_t minsize, int shared)
 {
-	LOG(3, "setp %p path %s poolsize %zu minsize %zu",
-		setp, path, poolsize, minsize);
+	LOG(3, "setp %p path %s poolsize %zu minsize %zu shared %d",
+		setp, path, poolsize, minsize, shared);
 
 	int oerrno;
 	int ret = 0;
@@ -1240,15 +1625,21 @@ util_poolset_create_set(struct pool_set **setp, const char *path,
 	}
 
 	/* do not check minsize */
-	if ((fd = util_file_open(path, &size, 0, O_RDONLY)) == -1)
+	fd = shared ? util_file_open_shared(path, &size, 0) :
+		util_file_open(path, &size, 0, O_RDONLY);
+	if (fd == -1)
 		return -1;
 
 	char signature[POOLSET_HDR_SIG_LEN];
 	/*
 	 * read returns ssize_t, but we know it will return value between -1
-	 * and POOLSET_HDR_SIG_LEN (11), so we can safely cast it to int
+	 * and POOLSET_HDR_SIG_LEN (11), so we can safely cast it to int.
+	 * A device DAX cannot be read(2), and it is never a pool set file.
 	 */
-	ret = (int)read(fd, signature, POOLSET_HDR_SIG_LEN);
+	if (util_fd_is_device_dax(fd))
+		ret = 0;
+	else
+		ret = (int)read(fd, signature, POOLSET_HDR_SIG_LEN);
 	if (ret < 0) {
 		ERR("!read %d", fd);
 		goto err;
@@ -1342,6 +1733,11 @@ util_header_create(struct pool_set *set, unsigned repidx, unsigned partidx,
 	hdrp->incompat_features = incompat;
 	hdrp->ro_compat_features = ro_compat;
 
+	if (rep->stripe_size != 0) {
+		hdrp->incompat_features |= POOL_FEAT_STRIPED;
+		hdrp->stripe_size = rep->stripe_size;
+	}
+
 	memcpy(hdrp->poolset_uuid, set->uuid, POOL_HDR_UUID_LEN);
 
 	memcpy(hdrp->uuid, PART(rep, partidx).uuid, POOL_HDR_UUID_LEN);
@@ -1391,6 +1787,56 @@ util_header_create(struct pool_set *set, unsigned repidx, unsigned partidx,
 	return 0;
 }
 
+/*
+ * util_feature_enable -- set incompat features in the headers of all the parts
+ *	of an open pool set
+ *
+ * The header of the first part of the first replica is updated last, all the
+ * others are already persistent by then. A version of the library which does
+ * not know the features refuses to open the pool as soon as any of the headers
+ * is written.
+ */
+int
+util_feature_enable(struct pool_set *set, uint32_t incompat)
+{
+	LOG(3, "set %p incompat %#x", set, incompat);
+
+	if (set->remote) {
+		ERR("the features of a pool set with remote replicas "
+			"cannot be changed");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	for (unsigned r = set->nreplicas; r > 0; r--) {
+		struct pool_replica *rep = set->replica[r - 1];
+		for (unsigned p = rep->nparts; p > 0; p--) {
+			struct pool_set_part *part = &rep->part[p - 1];
+
+			/* the headers are unmapped once the pool is open */
+			if (util_map_hdr(part, MAP_SHARED) != 0)
+				return -1;
+
+			struct pool_hdr *hdrp = part->hdr;
+			uint32_t features = le32toh(hdrp->incompat_features);
+			int ret = 0;
+			if ((features & incompat) != incompat) {
+				hdrp->incompat_features =
+					htole32(features | incompat);
+				util_checksum(hdrp, sizeof(*hdrp),
+					&hdrp->checksum, 1);
+				ret = pmem_msync(hdrp, sizeof(*hdrp));
+			}
+
+			util_unmap_hdr(part);
+			if (ret != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * util_header_check -- (internal) validate header of a single pool set file
  */
@@ -1465,18 +1911,33 @@ util_header_check(struct pool_set *set, unsigned repidx, unsigned partidx,
 		return -1;
 	}
 
-	/* check compatibility features */
+	/*
+	 * check compatibility features - the incompat features known to the
+	 * caller may be missing in some of the headers if the pool was closed
+	 * while they were being enabled (see util_feature_enable)
+	 */
 	if (HDR(rep, 0)->compat_features != hdrp->compat_features ||
-	    HDR(rep, 0)->incompat_features != hdrp->incompat_features ||
+	    ((HDR(rep, 0)->incompat_features ^ hdrp->incompat_features) &
+	    ~htole32(incompat)) != 0 ||
 	    HDR(rep, 0)->ro_compat_features != hdrp->ro_compat_features) {
 		ERR("incompatible feature flags");
 		errno = EINVAL;
 		return -1;
 	}
 
+	/* the layout of the parts must be the one the pool was created with */
+	if (hdr.stripe_size != rep->stripe_size) {
+		ERR("stripe size of the replica (%zu) does not match "
+			"the pool (%" PRIu64 ")", rep->stripe_size,
+			hdr.stripe_size);
+		errno = EINVAL;
+		return -1;
+	}
+
 	rep->part[partidx].rdonly = 0;
 
-	int retval = util_feature_check(&hdr, incompat, ro_compat, compat);
+	int retval = util_feature_check(&hdr, incompat | POOL_FEAT_STRIPED,
+			ro_compat, compat);
 	if (retval < 0)
 		return -1;
 
@@ -1626,7 +2087,8 @@ util_replica_create_local(struct pool_set *set, unsigned repidx, int flags,
 		mapsize = rep->part[0].filesize & ~(Mmap_align - 1);
 
 		/* determine a hint address for mmap() */
-		addr = util_map_hint(rep->repsize, 0);
+		addr = util_map_hint(rep->repsize, rep->part[0].is_dev_dax ?
+			rep->part[0].alignment : 0);
 		if (addr == MAP_FAILED) {
 			ERR("cannot find a contiguous region of given size");
 			return -1;
@@ -1670,6 +2132,20 @@ util_replica_create_local(struct pool_set *set, unsigned repidx, int flags,
 
 		set->zeroed &= rep->part[0].created;
 
+		if (rep->stripe_size != 0) {
+			if (util_map_stripes(rep, flags) != 0) {
+				LOG(2, "stripes mapping failed");
+				mapsize = rep->repsize;
+				goto err;
+			}
+
+			for (unsigned p = 1; p < rep->nparts; p++)
+				set->zeroed &= rep->part[p].created;
+
+			mapsize = rep->repsize;
+			break;
+		}
+
 		addr = (char *)rep->part[0].addr + mapsize;
 
 		/*
@@ -1715,7 +2191,9 @@ util_replica_create_local(struct pool_set *set, unsigned repidx, int flags,
 		}
 	} while (retry_for_contiguous_addr);
 
-	rep->is_pmem = pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
+	/* a device DAX is always mapped directly, without page cache */
+	rep->is_pmem = rep->part[0].is_dev_dax ||
+		pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
 
 	ASSERTeq(mapsize, rep->repsize);
 
@@ -1893,7 +2371,7 @@ util_pool_create_uuids(struct pool_set **setp, const char *path,
 		return -1;
 	}
 
-	int ret = util_poolset_create_set(setp, path, poolsize, minsize);
+	int ret = util_poolset_create_set(setp, path, poolsize, minsize, 0);
 	if (ret < 0) {
 		LOG(2, "cannot create pool set -- '%s'", path);
 		return -1;
@@ -2020,6 +2498,31 @@ util_pool_create(struct pool_set **setp, const char *path, size_t poolsize,
 					POOL_LOCAL);
 }
 
+/*
+ * util_map_hdr_job -- (internal) map and read in the header of a part
+ *
+ * Reading the header faults it in, so that the device I/O happens in
+ * parallel rather than during the serial header checks.
+ */
+static int
+util_map_hdr_job(struct pool_replica *rep, unsigned p, void *arg)
+{
+	struct pool_set_part *part = &rep->part[p];
+	if (part->hdr != NULL)
+		return 0;
+
+	if (util_map_hdr(part, *(int *)arg) != 0) {
+		LOG(2, "header mapping failed - part #%u", p);
+		return -1;
+	}
+
+	volatile char *hdr = part->hdr;
+	for (size_t off = 0; off < part->hdrsize; off += Pagesize)
+		(void) hdr[off];
+
+	return 0;
+}
+
 /*
  * util_replica_open_local -- (internal) open a memory pool local replica
  */
@@ -2037,7 +2540,8 @@ util_replica_open_local(struct pool_set *set, unsigned repidx, int flags)
 	do {
 		retry_for_contiguous_addr = 0;
 		/* determine a hint address for mmap() */
-		addr = util_map_hint(rep->repsize, 0);
+		addr = util_map_hint(rep->repsize, rep->part[0].is_dev_dax ?
+			rep->part[0].alignment : 0);
 		if (addr == MAP_FAILED) {
 			ERR("cannot find a contiguous region of given size");
 			return -1;
@@ -2059,11 +2563,18 @@ util_replica_open_local(struct pool_set *set, unsigned repidx, int flags)
 			rep->part[0].addr, rep->part[0].size, 0);
 
 		/* map all headers - don't care about the address */
-		for (unsigned p = 0; p < rep->nparts; p++) {
-			if (util_map_hdr(&rep->part[p], flags) != 0) {
-				LOG(2, "header mapping failed - part #%d", p);
+		if (util_parts_parallel(rep, util_map_hdr_job, &flags) != 0)
+			goto err;
+
+		if (rep->stripe_size != 0) {
+			if (util_map_stripes(rep, flags) != 0) {
+				LOG(2, "stripes mapping failed");
+				mapsize = rep->repsize;
 				goto err;
 			}
+
+			mapsize = rep->repsize;
+			break;
 		}
 
 		addr = (char *)rep->part[0].addr + mapsize;
@@ -2110,7 +2621,9 @@ util_replica_open_local(struct pool_set *set, unsigned repidx, int flags)
 		}
 	} while (retry_for_contiguous_addr);
 
-	rep->is_pmem = pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
+	/* a device DAX is always mapped directly, without page cache */
+	rep->is_pmem = rep->part[0].is_dev_dax ||
+		pmem_is_pmem(rep->part[0].addr, rep->part[0].size);
 
 	ASSERTeq(mapsize, rep->repsize);
 
@@ -2208,6 +2721,34 @@ util_unmap_all_hdrs(struct pool_set *set)
 	}
 }
 
+struct util_header_check_args {
+	struct pool_set *set;
+	unsigned repidx;
+	const char *sig;
+	uint32_t major;
+	uint32_t compat;
+	uint32_t incompat;
+	uint32_t ro_compat;
+};
+
+/*
+ * util_header_check_job -- (internal) validate header of a part
+ */
+static int
+util_header_check_job(struct pool_replica *rep, unsigned p, void *arg)
+{
+	struct util_header_check_args *args = arg;
+
+	if (util_header_check(args->set, args->repidx, p, args->sig,
+			args->major, args->compat, args->incompat,
+			args->ro_compat) != 0) {
+		LOG(2, "header check failed - part #%u", p);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * util_replica_check -- check headers, check UUID's, check replicas linkage
  */
@@ -2218,16 +2759,18 @@ util_replica_check(struct pool_set *set, const char *sig, uint32_t major,
 	LOG(3, "set %p sig %.8s major %u compat %#x incompat %#x ro_comapt %#x",
 		set, sig, major, compat, incompat, ro_compat);
 
+	struct util_header_check_args args = {
+		set, 0, sig, major, compat, incompat, ro_compat
+	};
+
 	for (unsigned r = 0; r < set->nreplicas; r++) {
 		struct pool_replica *rep = set->replica[r];
-		for (unsigned p = 0; p < rep->nparts; p++) {
-			if (util_header_check(set, r, p, sig, major,
-					compat, incompat, ro_compat) != 0) {
-				LOG(2, "header check failed - part #%d", p);
-				return -1;
-			}
+		args.repidx = r;
+		if (util_parts_parallel(rep, util_header_check_job, &args) != 0)
+			return -1;
+
+		for (unsigned p = 0; p < rep->nparts; p++)
 			set->rdonly |= rep->part[p].rdonly;
-		}
 
 		if (memcmp(HDR(REP(set, r - 1), 0)->uuid,
 					HDR(REP(set, r), 0)->prev_repl_uuid,
@@ -2257,7 +2800,7 @@ util_pool_open_nocheck(struct pool_set **setp, const char *path, int rdonly)
 	int flags = rdonly ? MAP_PRIVATE|MAP_NORESERVE : MAP_SHARED;
 	int oerrno;
 
-	int ret = util_poolset_create_set(setp, path, 0, 0);
+	int ret = util_poolset_create_set(setp, path, 0, 0, 0);
 	if (ret < 0) {
 		LOG(2, "cannot open pool set -- '%s'", path);
 		return -1;
@@ -2313,7 +2856,9 @@ err_poolset:
  * util_pool_open -- open a memory pool (set or a single file)
  *
  * This routine does all the work, but takes a rdonly flag so internal
- * calls can map a read-only pool if required.
+ * calls can map a read-only pool if required. With POOL_OPEN_SHARED the
+ * files are also opened read-only and are not locked, so the pool can be
+ * opened while another process has it open.
  */
 int
 util_pool_open(struct pool_set **setp, const char *path, int rdonly,
@@ -2329,7 +2874,9 @@ util_pool_open(struct pool_set **setp, const char *path, int rdonly,
 	int flags = rdonly ? MAP_PRIVATE|MAP_NORESERVE : MAP_SHARED;
 	int oerrno;
 
-	int ret = util_poolset_create_set(setp, path, 0, minsize);
+	int shared = (rdonly & POOL_OPEN_SHARED) == POOL_OPEN_SHARED;
+
+	int ret = util_poolset_create_set(setp, path, 0, minsize, shared);
 	if (ret < 0) {
 		LOG(2, "cannot open pool set -- '%s'", path);
 		return -1;
@@ -2339,6 +2886,8 @@ util_pool_open(struct pool_set **setp, const char *path, int rdonly,
 
 	ASSERT(set->nreplicas > 0);
 
+	set->shared = shared;
+
 	if (set->remote && util_remote_load()) {
 		ERR("the pool set requires a remote replica, "
 			"but the '%s' library cannot be loaded",
@@ -2410,7 +2959,7 @@ util_pool_open_remote(struct pool_set **setp, const char *path, int rdonly,
 	int flags = rdonly ? MAP_PRIVATE|MAP_NORESERVE : MAP_SHARED;
 	int oerrno;
 
-	int ret = util_poolset_create_set(setp, path, 0, minsize);
+	int ret = util_poolset_create_set(setp, path, 0, minsize, 0);
 	if (ret < 0) {
 		LOG(2, "cannot open pool set -- '%s'", path);
 		return -1;
@@ -2492,6 +3041,11 @@ util_is_poolset(const char *path)
 
 	int ret = 0;
 	char poolset[POOLSET_HDR_SIG_LEN];
+
+	/* a device DAX cannot be read(2), and it is never a pool set file */
+	if (util_fd_is_device_dax(fd))
+		goto out;
+
 	if (read(fd, poolset, sizeof(poolset)) != sizeof(poolset)) {
 		ret = -1;
 		goto out;
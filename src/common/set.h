@@ -54,6 +54,9 @@
 #define POOLSET_REPLICA_SIG "REPLICA"
 #define POOLSET_REPLICA_SIG_LEN 7	/* does NOT include '\0' */
 
+#define POOLSET_STRIPE_SIG "STRIPE"
+#define POOLSET_STRIPE_SIG_LEN 6	/* does NOT include '\0' */
+
 #define POOL_LOCAL 0
 #define POOL_REMOTE 1
 
@@ -63,6 +66,8 @@ struct pool_set_part {
 	size_t filesize;	/* aligned to page size */
 	int fd;
 	int created;		/* indicates newly created (zeroed) file */
+	int is_dev_dax;		/* true if the part is a device DAX */
+	size_t alignment;	/* required alignment of the mappings */
 
 	/* util_poolset_open/create */
 	void *hdr;		/* base address of header */
@@ -70,6 +75,7 @@ struct pool_set_part {
 	void *addr;		/* base address of the mapping */
 	size_t size;		/* size of the mapping - page aligned */
 	int rdonly;
+	int numa_node;		/* NUMA node backing the part, -1 if unknown */
 	uuid_t uuid;
 };
 
@@ -84,6 +90,8 @@ struct pool_replica {
 	unsigned nparts;
 	size_t repsize;		/* total size of all the parts (mappings) */
 	int is_pmem;		/* true if all the parts are in PMEM */
+	size_t stripe_size;	/* 0 if the parts are concatenated */
+	size_t nstripes;	/* number of stripes of each part */
 	struct remote_replica *remote;	/* not NULL if the replica */
 					/* is a remote one */
 	struct pool_set_part part[];
@@ -94,6 +102,7 @@ struct pool_set {
 	uuid_t uuid;
 	int rdonly;
 	int zeroed;		/* true if all the parts are new files */
+	int shared;		/* true if opened read-only, without locking */
 	size_t poolsize;	/* the smallest replica size */
 	int remote;		/* true if contains a remote replica */
 	struct pool_replica *replica[];
@@ -142,6 +151,7 @@ int util_map_part(struct pool_set_part *part, void *addr, size_t size,
 int util_unmap_part(struct pool_set_part *part);
 int util_unmap_parts(struct pool_replica *rep, unsigned start_index,
 	unsigned end_index);
+int util_replica_addr_numa_node(struct pool_replica *rep, const void *addr);
 int util_header_create(struct pool_set *set, unsigned repidx, unsigned partidx,
 	const char *sig, uint32_t major, uint32_t compat, uint32_t incompat,
 	uint32_t ro_compat, const unsigned char *prev_repl_uuid,
@@ -149,9 +159,15 @@ int util_header_create(struct pool_set *set, unsigned repidx, unsigned partidx,
 
 int util_map_hdr(struct pool_set_part *part, int flags);
 int util_unmap_hdr(struct pool_set_part *part);
+int util_feature_enable(struct pool_set *set, uint32_t incompat);
 
 int util_pool_open_nocheck(struct pool_set **setp, const char *path,
 	int rdonly);
+/* private copy-on-write mapping */
+#define POOL_OPEN_COW 1
+/* copy-on-write mapping of the files opened read-only, without locking */
+#define POOL_OPEN_SHARED (POOL_OPEN_COW | 2)
+
 int util_pool_open(struct pool_set **setp, const char *path, int rdonly,
 	size_t minsize, const char *sig, uint32_t major, uint32_t compat,
 	uint32_t incompat, uint32_t ro_compat, unsigned *nlanes);
@@ -162,6 +178,9 @@ int util_pool_open_remote(struct pool_set **setp, const char *path, int rdonly,
 	unsigned char *prev_repl_uuid, unsigned char *next_repl_uuid,
 	unsigned char *arch_flags);
 
+#define UTIL_OPEN_THREADS_MAX 16 /* max threads opening parts of a replica */
+#define UTIL_OPEN_PARALLEL_MIN 8 /* min parts opened in parallel by default */
+
 void util_remote_init(void);
 void util_remote_fini(void);
 
@@ -174,5 +193,8 @@ extern int (*Rpmem_persist)(RPMEMpool *rpp, size_t offset, size_t length,
 								unsigned lane);
 extern int (*Rpmem_read)(RPMEMpool *rpp, void *buff, size_t offset,
 							size_t length);
+extern int (*Rpmem_flush)(RPMEMpool *rpp, size_t offset, size_t length,
+								unsigned lane);
+extern int (*Rpmem_drain)(RPMEMpool *rpp, unsigned lane);
 
 #endif
@@ -85,6 +85,22 @@ util_mutex_lock(pthread_mutex_t *m)
 	}
 }
 
+/*
+ * util_mutex_trylock -- pthread_mutex_trylock variant that never fails from
+ * caller perspective other than with EBUSY. If pthread_mutex_trylock failed
+ * for any other reason, this function aborts the program.
+ */
+static inline int
+util_mutex_trylock(pthread_mutex_t *m)
+{
+	int tmp = pthread_mutex_trylock(m);
+	if (tmp && tmp != EBUSY) {
+		errno = tmp;
+		FATAL("!pthread_mutex_trylock");
+	}
+	return tmp;
+}
+
 /*
  * util_mutex_unlock -- pthread_mutex_unlock variant that never fails from
  * caller perspective. If pthread_mutex_unlock failed, this function aborts
@@ -100,6 +116,66 @@ util_mutex_unlock(pthread_mutex_t *m)
 	}
 }
 
+/*
+ * util_rwlock_init -- pthread_rwlock_init variant that never fails from
+ * caller perspective. If pthread_rwlock_init failed, this function aborts
+ * the program.
+ */
+static inline void
+util_rwlock_init(pthread_rwlock_t *m)
+{
+	int tmp = pthread_rwlock_init(m, NULL);
+	if (tmp) {
+		errno = tmp;
+		FATAL("!pthread_rwlock_init");
+	}
+}
+
+/*
+ * util_rwlock_rdlock -- pthread_rwlock_rdlock variant that never fails from
+ * caller perspective. If pthread_rwlock_rdlock failed, this function aborts
+ * the program.
+ */
+static inline void
+util_rwlock_rdlock(pthread_rwlock_t *m)
+{
+	int tmp = pthread_rwlock_rdlock(m);
+	if (tmp) {
+		errno = tmp;
+		FATAL("!pthread_rwlock_rdlock");
+	}
+}
+
+/*
+ * util_rwlock_wrlock -- pthread_rwlock_wrlock variant that never fails from
+ * caller perspective. If pthread_rwlock_wrlock failed, this function aborts
+ * the program.
+ */
+static inline void
+util_rwlock_wrlock(pthread_rwlock_t *m)
+{
+	int tmp = pthread_rwlock_wrlock(m);
+	if (tmp) {
+		errno = tmp;
+		FATAL("!pthread_rwlock_wrlock");
+	}
+}
+
+/*
+ * util_rwlock_destroy -- pthread_rwlock_destroy variant that never fails from
+ * caller perspective. If pthread_rwlock_destroy failed, this function aborts
+ * the program.
+ */
+static inline void
+util_rwlock_destroy(pthread_rwlock_t *m)
+{
+	int tmp = pthread_rwlock_destroy(m);
+	if (tmp) {
+		errno = tmp;
+		FATAL("!pthread_rwlock_destroy");
+	}
+}
+
 /*
  * util_rwlock_unlock -- pthread_rwlock_unlock variant that never fails from
  * caller perspective. If pthread_rwlock_unlock failed, this function aborts
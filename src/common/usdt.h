@@ -0,0 +1,87 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * usdt.h -- statically defined tracepoints
+ *
+ * When built with USE_USDT the probes are compiled in as USDT (SystemTap
+ * compatible) tracepoints, which cost a single nop each until they are
+ * attached to by a tracer, e.g.:
+ *	$ bpftrace -e 'usdt:libpmemobj.so:libpmemobj:tx_commit { ... }'
+ *
+ * Otherwise the probes compile to nothing. The arguments of a probe should
+ * be plain values at hand, as they may or may not be evaluated.
+ */
+
+#ifndef NVML_USDT_H
+#define NVML_USDT_H 1
+
+#ifdef USE_USDT
+
+#include <sys/sdt.h>
+
+#define USDT_PROBE0(provider, name)\
+	DTRACE_PROBE(provider, name)
+#define USDT_PROBE1(provider, name, a1)\
+	DTRACE_PROBE1(provider, name, a1)
+#define USDT_PROBE2(provider, name, a1, a2)\
+	DTRACE_PROBE2(provider, name, a1, a2)
+#define USDT_PROBE3(provider, name, a1, a2, a3)\
+	DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define USDT_PROBE4(provider, name, a1, a2, a3, a4)\
+	DTRACE_PROBE4(provider, name, a1, a2, a3, a4)
+
+#else
+
+#define USDT_PROBE0(provider, name) do {} while (0)
+#define USDT_PROBE1(provider, name, a1) do {\
+	(void)(a1);\
+} while (0)
+#define USDT_PROBE2(provider, name, a1, a2) do {\
+	(void)(a1);\
+	(void)(a2);\
+} while (0)
+#define USDT_PROBE3(provider, name, a1, a2, a3) do {\
+	(void)(a1);\
+	(void)(a2);\
+	(void)(a3);\
+} while (0)
+#define USDT_PROBE4(provider, name, a1, a2, a3, a4) do {\
+	(void)(a1);\
+	(void)(a2);\
+	(void)(a3);\
+	(void)(a4);\
+} while (0)
+
+#endif
+
+#endif
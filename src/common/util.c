@@ -43,6 +43,14 @@
 #include "util.h"
 #include "valgrind_internal.h"
 
+/*
+ * SSE2 is part of the x86-64 baseline, so it needs no runtime dispatch.
+ */
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTIL_CHECKSUM_SSE2
+#endif
+
 /* library-wide page size */
 unsigned long long Pagesize;
 
@@ -88,6 +96,49 @@ util_is_zeroed(const void *addr, size_t len)
 	return 1;
 }
 
+/*
+ * util_checksum_lanes -- (internal) Fletcher64 sums of nblocks 16-byte blocks
+ *
+ * The words are summed in 4 independent lanes, word j of every block going
+ * to lane j.  sum[j] is the sum of the lane, and acc[j] is the sum of lane
+ * j as it was before each block was added, so that the checksum over the
+ * whole range can be computed from them (see util_checksum()).  All the
+ * arithmetic is modulo 2^32, as in the serial algorithm.
+ */
+#ifdef UTIL_CHECKSUM_SSE2
+static void
+util_checksum_lanes(const uint32_t *p32, size_t nblocks, uint32_t sum[4],
+	uint32_t acc[4])
+{
+	__m128i vsum = _mm_setzero_si128();
+	__m128i vacc = _mm_setzero_si128();
+
+	for (size_t b = 0; b < nblocks; b++) {
+		__m128i w = _mm_loadu_si128((const __m128i *)(p32 + 4 * b));
+		vacc = _mm_add_epi32(vacc, vsum);
+		vsum = _mm_add_epi32(vsum, w);
+	}
+
+	_mm_storeu_si128((__m128i *)sum, vsum);
+	_mm_storeu_si128((__m128i *)acc, vacc);
+}
+#else
+static void
+util_checksum_lanes(const uint32_t *p32, size_t nblocks, uint32_t sum[4],
+	uint32_t acc[4])
+{
+	for (unsigned j = 0; j < 4; j++)
+		sum[j] = acc[j] = 0;
+
+	for (size_t b = 0; b < nblocks; b++) {
+		for (unsigned j = 0; j < 4; j++) {
+			acc[j] += sum[j];
+			sum[j] += le32toh(p32[4 * b + j]);
+		}
+	}
+}
+#endif
+
 /*
  * util_checksum -- compute Fletcher64 checksum
  *
@@ -98,6 +149,11 @@ util_is_zeroed(const void *addr, size_t len)
  * the range at *csump.  Otherwise the calculated checksum is
  * checked against *csump and the result returned (true means
  * the range checksummed correctly).
+ *
+ * Word i of the n words in the range adds w[i] to lo32 and (n - i) * w[i]
+ * to hi32, which lets the bulk of the range be summed in parallel lanes
+ * instead of a serial dependency chain; the words of the checksum itself
+ * are subtracted back out at the end.
  */
 int
 util_checksum(void *addr, size_t len, uint64_t *csump, int insert)
@@ -105,25 +161,36 @@ util_checksum(void *addr, size_t len, uint64_t *csump, int insert)
 	if (len % 4 != 0)
 		abort();
 
-	uint32_t *p32 = addr;
-	uint32_t *p32end = (uint32_t *)((char *)addr + len);
+	const uint32_t *p32 = addr;
+	size_t nwords = len / 4;
+	size_t nblocks = nwords / 4;
+	uint32_t sum[4];
+	uint32_t acc[4];
 	uint32_t lo32 = 0;
 	uint32_t hi32 = 0;
 	uint64_t csum;
 
-	while (p32 < p32end)
-		if (p32 == (uint32_t *)csump) {
-			/* lo32 += 0; treat first 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-			/* lo32 += 0; treat second 32-bits as zero */
-			p32++;
-			hi32 += lo32;
-		} else {
-			lo32 += le32toh(*p32);
-			++p32;
-			hi32 += lo32;
+	util_checksum_lanes(p32, nblocks, sum, acc);
+
+	for (unsigned j = 0; j < 4; j++) {
+		lo32 += sum[j];
+		hi32 += 4 * acc[j] + (4 - j) * sum[j];
+	}
+
+	for (size_t i = nblocks * 4; i < nwords; i++) {
+		lo32 += le32toh(p32[i]);
+		hi32 += lo32;
+	}
+
+	/* treat the checksum itself as zeros */
+	uintptr_t off = (uintptr_t)csump - (uintptr_t)addr;
+	if (off % 4 == 0 && off < len && len - off >= sizeof(*csump)) {
+		for (size_t i = off / 4; i < off / 4 + 2; i++) {
+			uint32_t w = le32toh(p32[i]);
+			lo32 -= w;
+			hi32 -= (uint32_t)(nwords - i) * w;
 		}
+	}
 
 	csum = (uint64_t)hi32 << 32 | lo32;
 
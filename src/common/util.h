@@ -72,6 +72,8 @@ char *util_fgets(char *buffer, int max, FILE *stream);
 
 #define UTIL_MAX_ERR_MSG 128
 void util_strerror(int errnum, char *buff, size_t bufflen);
+int util_get_numa_node(void);
+uint64_t util_time_ns(void);
 
 void util_set_alloc_funcs(
 		void *(*malloc_func)(size_t size),
@@ -139,6 +141,71 @@ __sync_bool_compare_and_swap64(volatile LONG64 *ptr,
 	__sync_bool_compare_and_swap64((LONG64 *)(p), (LONG64)(o), (LONG64)(n))
 #endif
 
+/*
+ * util_atomic_load_acquire32 -- atomically loads the value, the subsequent
+ *	memory accesses are not reordered before it
+ *
+ * util_atomic_store_release32 -- atomically stores the value, the preceding
+ *	memory accesses are not reordered after it
+ *
+ * util_atomic_load_acquire_ptr, util_atomic_store_release_ptr -- the same
+ *	for pointers
+ */
+#ifndef _MSC_VER
+#define util_atomic_load_acquire32(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define util_atomic_store_release32(p, v)\
+	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define util_atomic_load_acquire_ptr(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define util_atomic_store_release_ptr(p, v)\
+	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define util_atomic_load_acquire32(p)\
+	InterlockedCompareExchange((LONG *)(p), 0, 0)
+#define util_atomic_store_release32(p, v)\
+	((void)InterlockedExchange((LONG *)(p), (LONG)(v)))
+#define util_atomic_load_acquire_ptr(p)\
+	InterlockedCompareExchangePointer((PVOID *)(p), NULL, NULL)
+#define util_atomic_store_release_ptr(p, v)\
+	((void)InterlockedExchangePointer((PVOID *)(p), (PVOID)(v)))
+#endif
+
+/*
+ * util_lssb_index64 -- returns the index of the least significant set bit,
+ *	undefined for 0
+ *
+ * util_mssb_index64 -- returns the index of the most significant set bit,
+ *	undefined for 0
+ *
+ * util_popcount64 -- returns the number of set bits
+ */
+#ifndef _MSC_VER
+#define util_lssb_index64(v) ((unsigned)__builtin_ctzll(v))
+#define util_mssb_index64(v) ((unsigned)(63 - __builtin_clzll(v)))
+#define util_popcount64(v) ((unsigned)__builtin_popcountll(v))
+#else
+static __inline unsigned
+util_lssb_index64(uint64_t v)
+{
+	unsigned long ret;
+	_BitScanForward64(&ret, v);
+	return (unsigned)ret;
+}
+
+static __inline unsigned
+util_mssb_index64(uint64_t v)
+{
+	unsigned long ret;
+	_BitScanReverse64(&ret, v);
+	return (unsigned)ret;
+}
+
+static __inline unsigned
+util_popcount64(uint64_t v)
+{
+	return (unsigned)__popcnt64(v);
+}
+#endif
+
 /*
  * util_get_printable_ascii -- convert non-printable ascii to dot '.'
  */
@@ -158,6 +225,20 @@ util_get_printable_ascii(char c)
 #endif
 #endif
 
+/*
+ * util_prefetch -- hints the processor to bring the cacheline with the given
+ *	address into the cache
+ */
+static inline void
+util_prefetch(const void *addr)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(addr);
+#else
+	(void) addr;
+#endif
+}
+
 #ifndef _WIN32
 #define DIR_SEPARATOR '/'
 #else
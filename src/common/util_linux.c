@@ -35,6 +35,9 @@
  */
 
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <util.h>
 
 /* pass through for Linux */
@@ -43,3 +46,32 @@ util_strerror(int errnum, char *buff, size_t bufflen)
 {
 	strerror_r(errnum, buff, bufflen);
 }
+
+/*
+ * util_get_numa_node -- return NUMA node of the calling thread's CPU, or -1
+ */
+int
+util_get_numa_node(void)
+{
+	unsigned cpu;
+	unsigned node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return -1;
+
+	return (int)node;
+}
+
+/*
+ * util_time_ns -- return a monotonic timestamp in nanoseconds
+ */
+uint64_t
+util_time_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
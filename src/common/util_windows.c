@@ -34,6 +34,7 @@
  * util_windows.c -- misc utilities with OS-specific implementation
  */
 
+#include <windows.h>
 #include <string.h>
 #include "util.h"
 
@@ -69,3 +70,36 @@ util_strerror(int errnum, char *buff, size_t bufflen)
 			strcpy_s(buff, bufflen, UNMAPPED_STR);
 	}
 }
+
+/*
+ * util_get_numa_node -- return NUMA node of the calling thread's CPU, or -1
+ */
+int
+util_get_numa_node(void)
+{
+	PROCESSOR_NUMBER pn;
+	USHORT node;
+
+	GetCurrentProcessorNumberEx(&pn);
+	if (!GetNumaProcessorNodeEx(&pn, &node))
+		return -1;
+
+	return (int)node;
+}
+
+/*
+ * util_time_ns -- return a monotonic timestamp in nanoseconds
+ */
+uint64_t
+util_time_ns(void)
+{
+	LARGE_INTEGER freq, cnt;
+
+	if (!QueryPerformanceFrequency(&freq) ||
+			!QueryPerformanceCounter(&cnt))
+		return 0;
+
+	return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000 +
+		(uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000 /
+		(uint64_t)freq.QuadPart;
+}
@@ -48,12 +48,23 @@
 #define MAX_BUFFLEN 30
 #define MAX_TYPE_NUM 8
 
+/*
+ * Chunked arrays keep their elements in fixed-size chunks referenced from
+ * a directory, so element i lives in chunk (i >> CHUNK_SHIFT) at index
+ * (i & CHUNK_MASK).
+ */
+#define CHUNK_SHIFT 12
+#define CHUNK_ELMS (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_ELMS - 1)
+#define CHUNKS_FOR(size) (((size) + CHUNK_MASK) >> CHUNK_SHIFT)
+
 POBJ_LAYOUT_BEGIN(array);
 POBJ_LAYOUT_TOID(array, struct array_elm);
 POBJ_LAYOUT_TOID(array, int);
 POBJ_LAYOUT_TOID(array, PMEMoid);
 POBJ_LAYOUT_TOID(array, TOID(struct array_elm));
 POBJ_LAYOUT_TOID(array, struct array_info);
+POBJ_LAYOUT_TOID(array, struct array_chunked);
 POBJ_LAYOUT_END(array);
 
 static PMEMobjpool *pop;
@@ -61,6 +72,7 @@ enum array_types {
 	INT_ARRAY_TYPE,
 	PMEMOID_ARRAY_TYPE,
 	TOID_ARRAY_TYPE,
+	CHUNKED_ARRAY_TYPE,
 	UNKNOWN_ARRAY_TYPE
 };
 
@@ -68,6 +80,20 @@ struct array_elm {
 	int id;
 };
 
+/*
+ * array_chunked -- directory of chunks of int type
+ *
+ * Growing the array allocates only the missing chunks. The directory is
+ * reallocated when it runs out of slots, but its capacity is doubled each
+ * time and it holds just one pointer per CHUNK_ELMS elements, so the cost
+ * of copying it is amortized to O(1) per element.
+ */
+struct array_chunked {
+	size_t nchunks;		/* number of allocated chunks */
+	size_t capacity;	/* number of slots in the directory */
+	TOID(int) chunks[];
+};
+
 struct array_info {
 	char name[MAX_BUFFLEN];
 	size_t size;
@@ -83,7 +109,7 @@ print_usage()
 {
 	printf("usage: ./array <file-name> "
 		"<alloc|realloc|free|print>"
-		" <array-name> [<size> [<TOID|PMEMoid|int>]]\n");
+		" <array-name> [<size> [<TOID|PMEMoid|int|chunked>]]\n");
 }
 
 /*
@@ -92,7 +118,8 @@ print_usage()
 static enum array_types
 get_type(const char *type_name)
 {
-	const char *names[UNKNOWN_ARRAY_TYPE] = {"int", "PMEMoid", "TOID"};
+	const char *names[UNKNOWN_ARRAY_TYPE] = {"int", "PMEMoid", "TOID",
+						"chunked"};
 	enum array_types type;
 	for (type = 0; type < UNKNOWN_ARRAY_TYPE; type++) {
 		if (strcmp(names[type], type_name) == 0)
@@ -131,6 +158,78 @@ elm_constructor(PMEMobjpool *pop, void *ptr, void *arg)
 	return 0;
 }
 
+/*
+ * chunked_elm -- return pointer to i-th element of chunked array
+ */
+static int *
+chunked_elm(struct array_chunked *dir, size_t i)
+{
+	return &D_RW(dir->chunks[i >> CHUNK_SHIFT])[i & CHUNK_MASK];
+}
+
+/*
+ * chunked_resize -- (internal) resize chunked array from prev_size
+ * to size elements
+ *
+ * Only the chunks which are added or removed are allocated or freed,
+ * the existing elements are never moved.
+ */
+static TOID(struct array_chunked)
+chunked_resize(TOID(struct array_chunked) dir, size_t prev_size, size_t size)
+{
+	size_t nchunks = CHUNKS_FOR(size);
+
+	TX_BEGIN(pop) {
+		if (TOID_IS_NULL(dir)) {
+			size_t capacity = nchunks ? nchunks : 1;
+			dir = TX_ZALLOC(struct array_chunked,
+				sizeof(struct array_chunked) +
+				sizeof(TOID(int)) * capacity);
+			D_RW(dir)->capacity = capacity;
+		} else if (nchunks > D_RO(dir)->capacity) {
+			size_t capacity = D_RO(dir)->capacity;
+			while (capacity < nchunks)
+				capacity *= 2;
+			/* the new directory is not snapshotted */
+			dir = TX_REALLOC(dir, sizeof(struct array_chunked) +
+				sizeof(TOID(int)) * capacity);
+			D_RW(dir)->capacity = capacity;
+		} else {
+			size_t used = D_RO(dir)->nchunks > nchunks ?
+				D_RO(dir)->nchunks : nchunks;
+			TX_ADD_FIELD(dir, nchunks);
+			pmemobj_tx_add_range(dir.oid,
+				offsetof(struct array_chunked, chunks),
+				sizeof(TOID(int)) * used);
+		}
+
+		struct array_chunked *d = D_RW(dir);
+		while (d->nchunks > nchunks)
+			TX_FREE(d->chunks[--d->nchunks]);
+
+		/* the tail of the last chunk in use belongs to the array */
+		if (prev_size < size && (prev_size & CHUNK_MASK)) {
+			size_t end = (prev_size | CHUNK_MASK) + 1;
+			if (end > size)
+				end = size;
+			pmemobj_tx_add_range_direct(chunked_elm(d, prev_size),
+				sizeof(int) * (end - prev_size));
+		}
+
+		while (d->nchunks < nchunks)
+			d->chunks[d->nchunks++] =
+				TX_ALLOC(int, sizeof(int) * CHUNK_ELMS);
+
+		for (size_t i = prev_size; i < size; i++)
+			*chunked_elm(d, i) = i;
+	} TX_ONABORT {
+		fprintf(stderr, "chunked_resize\n");
+		dir = TOID_NULL(struct array_chunked);
+	} TX_END
+
+	return dir;
+}
+
 /*
  * print_int -- print array of int type
  */
@@ -170,8 +269,21 @@ print_toid(struct array_info *info)
 		printf("%d ", D_RO(D_RO(array)[i])->id);
 }
 
+/*
+ * print_chunked -- print chunked array of int type
+ */
+static void
+print_chunked(struct array_info *info)
+{
+	TOID(struct array_chunked) dir;
+	TOID_ASSIGN(dir, info->array);
+	for (size_t i = 0; i < info->size; i++)
+		printf("%d ", *chunked_elm(D_RW(dir), i));
+}
+
 typedef void (*fn_print)(struct array_info *info);
-fn_print print_array[] = {print_int, print_pmemoid, print_toid};
+fn_print print_array[] = {print_int, print_pmemoid, print_toid,
+						print_chunked};
 
 /*
  * free_int -- de-allocate array of int type
@@ -224,8 +336,23 @@ free_toid(struct array_info *info)
 	POBJ_FREE(&array);
 }
 
+/*
+ * free_chunked -- de-allocate chunked array of int type
+ */
+static void
+free_chunked(struct array_info *info)
+{
+	TOID(struct array_chunked) dir;
+	TOID_ASSIGN(dir, info->array);
+	TX_BEGIN(pop) {
+		for (size_t i = 0; i < D_RO(dir)->nchunks; i++)
+			TX_FREE(D_RO(dir)->chunks[i]);
+		TX_FREE(dir);
+	} TX_END
+}
+
 typedef void (*fn_free)(struct array_info *info);
-fn_free free_array[] = {free_int, free_pmemoid, free_toid};
+fn_free free_array[] = {free_int, free_pmemoid, free_toid, free_chunked};
 
 /*
  * realloc_int -- reallocate array of int type
@@ -285,8 +412,26 @@ realloc_toid(PMEMoid *info, size_t prev_size, size_t size)
 	return array.oid;
 }
 
+/*
+ * realloc_chunked -- resize chunked array of int type
+ */
+static PMEMoid
+realloc_chunked(PMEMoid *info, size_t prev_size, size_t size)
+{
+	TOID(struct array_chunked) dir;
+	TOID_ASSIGN(dir, *info);
+	TX_BEGIN(pop) {
+		/* the directory may move, so update the reference atomically */
+		pmemobj_tx_add_range_direct(info, sizeof(*info));
+		dir = chunked_resize(dir, prev_size, size);
+		*info = dir.oid;
+	} TX_END
+	return dir.oid;
+}
+
 typedef PMEMoid (*fn_realloc)(PMEMoid *info, size_t prev_size, size_t size);
-fn_realloc realloc_array[] = {realloc_int, realloc_pmemoid, realloc_toid};
+fn_realloc realloc_array[] = {realloc_int, realloc_pmemoid, realloc_toid,
+						realloc_chunked};
 
 /*
  * alloc_int -- allocate array of int type
@@ -376,8 +521,22 @@ alloc_toid(size_t size)
 	return array.oid;
 }
 
+/*
+ * alloc_chunked -- allocate chunked array of int type
+ */
+static PMEMoid
+alloc_chunked(size_t size)
+{
+	/*
+	 * Chunked array consists of directory and fixed-size chunks of
+	 * elements, which are allocated on demand as the array grows.
+	 */
+	return chunked_resize(TOID_NULL(struct array_chunked), 0, size).oid;
+}
+
 typedef PMEMoid (*fn_alloc)(size_t size);
-fn_alloc alloc_array[] = {alloc_int, alloc_pmemoid, alloc_toid};
+fn_alloc alloc_array[] = {alloc_int, alloc_pmemoid, alloc_toid,
+						alloc_chunked};
 
 /*
  * do_print -- print values stored by proper array
@@ -0,0 +1,550 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mpmc_queue.cpp -- multi-producer/multi-consumer queue implemented using
+ * pmemobj cpp bindings
+ *
+ * Unlike queue.cpp, which allocates a list node on every push, this queue is
+ * a bounded ring of preallocated cells, so neither push nor pop allocates or
+ * runs a transaction.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define LAYOUT "mpmc_queue"
+
+/* number of cells of a newly created queue */
+#define DEFAULT_CAPACITY (1 << 16)
+
+/* number of elements moved by a single push_batch/pop_batch in 'bench' */
+#define BENCH_BATCH 16
+
+namespace
+{
+
+/* available queue operations */
+enum queue_op {
+	UNKNOWN_QUEUE_OP,
+	QUEUE_PUSH,
+	QUEUE_POP,
+	QUEUE_SHOW,
+	QUEUE_BENCH,
+
+	MAX_QUEUE_OP,
+};
+
+/* queue operations strings */
+const char *ops_str[MAX_QUEUE_OP] = {"", "push", "pop", "show", "bench"};
+
+/*
+ * parse_queue_op -- parses the operation string and returns matching queue_op
+ */
+queue_op
+parse_queue_op(const char *str)
+{
+	for (int i = 0; i < MAX_QUEUE_OP; ++i)
+		if (strcmp(str, ops_str[i]) == 0)
+			return (queue_op)i;
+
+	return UNKNOWN_QUEUE_OP;
+}
+}
+
+using nvml::obj::p;
+using nvml::obj::persistent_ptr;
+using nvml::obj::pool;
+using nvml::obj::pool_base;
+using nvml::obj::make_persistent;
+using nvml::obj::transaction;
+
+namespace examples
+{
+
+/*
+ * Persistent memory bounded MPMC queue
+ *
+ * The queue is a ring of cells split into preallocated segments. Every cell
+ * carries a sequence number which tells its state to both producers and
+ * consumers: a cell at position pos is free when its sequence number is pos
+ * and holds an element when it is pos + 1. A consumer releases the cell for
+ * the next lap of the ring by setting it to pos + capacity.
+ *
+ * Producers and consumers claim runs of positions by moving the tail and the
+ * head with compare-and-swap. Those two indices are never persisted, the
+ * sequence numbers are, so recover() can rebuild the indices when the pool
+ * is opened. The value of a cell is made durable before its sequence number
+ * is published, which means that an element which is visible after a crash
+ * is always complete.
+ *
+ * An element pushed concurrently with a crash is either in the queue or not
+ * at all. An element popped concurrently with a crash might be returned
+ * again after recovery, so the consumers should be idempotent.
+ */
+class pmem_mpmc_queue {
+
+	/* element of the ring */
+	struct cell {
+		std::atomic<uint64_t> seq;
+		p<uint64_t> value;
+	};
+
+	static const uint64_t segment_cells = 4096;
+	static const uint64_t max_segments = 256;
+	static const size_t cacheline = 64;
+
+public:
+	/*
+	 * Allocates the ring, capacity is rounded up to a power of two number
+	 * of segments. Has to be called once, before any other operation.
+	 */
+	void
+	init(pool_base &pop, uint64_t capacity)
+	{
+		uint64_t n = 1;
+		while (n * segment_cells < capacity && n < max_segments)
+			n <<= 1;
+
+		transaction::exec_tx(pop, [&] {
+			for (uint64_t s = 0; s < n; ++s) {
+				segments[s] =
+					make_persistent<cell[]>(segment_cells);
+
+				cell *c = segments[s].get();
+				uint64_t pos = s * segment_cells;
+				for (uint64_t i = 0; i < segment_cells; ++i)
+					c[i].seq = pos + i;
+			}
+
+			nsegments = n;
+		});
+	}
+
+	/*
+	 * Rebuilds the runtime state of the queue from the sequence numbers.
+	 * Has to be called every time the pool is opened, before any push or
+	 * pop.
+	 *
+	 * If a crash left holes in the ring, the elements are compacted in a
+	 * single transaction.
+	 */
+	void
+	recover(pool_base &pop)
+	{
+		for (uint64_t s = 0; s < nsegments; ++s)
+			cells[s] = segments[s].get();
+		mask = nsegments * segment_cells - 1;
+
+		std::vector<std::pair<uint64_t, uint64_t>> full;
+		uint64_t free_min = UINT64_MAX;
+		for (uint64_t i = 0; i <= mask; ++i) {
+			cell &c = at(i);
+			uint64_t seq = c.seq.load(std::memory_order_relaxed);
+			if (((seq - i) & mask) == 0)
+				free_min = std::min(free_min, seq);
+			else
+				full.emplace_back(seq - 1, c.value);
+		}
+
+		std::sort(full.begin(), full.end());
+
+		uint64_t h = full.empty() ? free_min : full.front().first;
+		uint64_t t = h + full.size();
+		head.store(h, std::memory_order_relaxed);
+		tail.store(t, std::memory_order_relaxed);
+
+		bool consistent = true;
+		for (uint64_t i = 0; i <= mask && consistent; ++i) {
+			uint64_t pos = h + ((i - h) & mask);
+			uint64_t seq =
+				at(i).seq.load(std::memory_order_relaxed);
+			consistent = seq == (pos < t ? pos + 1 : pos);
+		}
+
+		if (consistent)
+			return;
+
+		transaction::exec_tx(pop, [&] {
+			for (uint64_t s = 0; s < nsegments; ++s)
+				pmemobj_tx_add_range_direct(
+					cells[s], segment_cells * sizeof(cell));
+
+			for (uint64_t pos = h; pos <= h + mask; ++pos) {
+				cell &c = at(pos);
+				if (pos < t) {
+					c.value = full[pos - h].second;
+					c.seq.store(pos + 1,
+						    std::memory_order_relaxed);
+				} else {
+					c.seq.store(pos,
+						    std::memory_order_relaxed);
+				}
+			}
+		});
+	}
+
+	/*
+	 * Appends up to n elements at the end of the queue, in order.
+	 * Returns the number of elements pushed, which is less than n only
+	 * when the queue is full.
+	 */
+	size_t
+	push_batch(pool_base &pop, const uint64_t *values, size_t n)
+	{
+		n = std::min<uint64_t>(n, mask + 1);
+
+		uint64_t pos = tail.load(std::memory_order_relaxed);
+		size_t k;
+		for (;;) {
+			for (k = 0; k < n; ++k)
+				if (at(pos + k).seq.load(
+					    std::memory_order_acquire) !=
+				    pos + k)
+					break;
+
+			if (k == 0) {
+				uint64_t seq = at(pos).seq.load(
+					std::memory_order_acquire);
+				if ((int64_t)(seq - pos) < 0)
+					return 0; /* full */
+
+				pos = tail.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (tail.compare_exchange_weak(
+				    pos, pos + k, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < k; ++i) {
+			cell &c = at(pos + i);
+			c.value = values[i];
+			pop.flush(c.value);
+		}
+		pop.drain();
+
+		for (size_t i = 0; i < k; ++i) {
+			cell &c = at(pos + i);
+			c.seq.store(pos + i + 1, std::memory_order_release);
+			pop.flush(&c.seq, sizeof(c.seq));
+		}
+		pop.drain();
+
+		return k;
+	}
+
+	/*
+	 * Removes up to n elements from the front of the queue, in order.
+	 * Returns the number of elements popped, 0 if the queue is empty.
+	 */
+	size_t
+	pop_batch(pool_base &pop, uint64_t *values, size_t n)
+	{
+		n = std::min<uint64_t>(n, mask + 1);
+
+		uint64_t pos = head.load(std::memory_order_relaxed);
+		size_t k;
+		for (;;) {
+			for (k = 0; k < n; ++k)
+				if (at(pos + k).seq.load(
+					    std::memory_order_acquire) !=
+				    pos + k + 1)
+					break;
+
+			if (k == 0) {
+				uint64_t seq = at(pos).seq.load(
+					std::memory_order_acquire);
+				if ((int64_t)(seq - (pos + 1)) < 0)
+					return 0; /* empty */
+
+				pos = head.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (head.compare_exchange_weak(
+				    pos, pos + k, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < k; ++i)
+			values[i] = at(pos + i).value;
+
+		for (size_t i = 0; i < k; ++i) {
+			cell &c = at(pos + i);
+			c.seq.store(pos + i + mask + 1,
+				    std::memory_order_release);
+			pop.flush(&c.seq, sizeof(c.seq));
+		}
+		pop.drain();
+
+		return k;
+	}
+
+	/*
+	 * Inserts a new element at the end of the queue.
+	 */
+	bool
+	push(pool_base &pop, uint64_t value)
+	{
+		return push_batch(pop, &value, 1) == 1;
+	}
+
+	/*
+	 * Removes the first element in the queue.
+	 */
+	bool
+	pop(pool_base &pop, uint64_t &value)
+	{
+		return pop_batch(pop, &value, 1) == 1;
+	}
+
+	/*
+	 * Returns the number of elements in the queue, exact only when there
+	 * are no concurrent operations.
+	 */
+	uint64_t
+	size() const
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		uint64_t t = tail.load(std::memory_order_relaxed);
+
+		return t > h ? t - h : 0;
+	}
+
+	/*
+	 * Prints the entire contents of the queue, can't be called
+	 * concurrently with push or pop.
+	 */
+	void
+	show(void)
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		for (uint64_t pos = head.load(std::memory_order_relaxed);
+		     pos < t; ++pos)
+			std::cout << at(pos).value << std::endl;
+	}
+
+	/*
+	 * Tells whether init() has been called on this queue.
+	 */
+	bool
+	initialized() const
+	{
+		return nsegments != 0;
+	}
+
+private:
+	/*
+	 * Returns the cell of the given position.
+	 */
+	cell &
+	at(uint64_t pos) const
+	{
+		uint64_t i = pos & mask;
+
+		return cells[i / segment_cells][i % segment_cells];
+	}
+
+	p<uint64_t> nsegments;
+	persistent_ptr<cell[]> segments[max_segments];
+
+	/* runtime state, rebuilt by recover() */
+	uint64_t mask;
+	cell *cells[max_segments];
+
+	char pad0[cacheline];
+	std::atomic<uint64_t> head;
+	char pad1[cacheline - sizeof(std::atomic<uint64_t>)];
+	std::atomic<uint64_t> tail;
+	char pad2[cacheline - sizeof(std::atomic<uint64_t>)];
+};
+
+/*
+ * bench -- runs producers and consumers concurrently and verifies that every
+ * element was received exactly once
+ */
+void
+bench(pool_base &pop, pmem_mpmc_queue &q, unsigned nproducers,
+      unsigned nconsumers, uint64_t count)
+{
+	if (q.size() != 0)
+		throw std::runtime_error("queue has to be empty");
+
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<uint64_t> sum(0);
+	uint64_t total = nproducers * count;
+
+	auto producer = [&]() {
+		uint64_t batch[BENCH_BATCH];
+		uint64_t next = 1;
+		while (next <= count) {
+			size_t n = 0;
+			while (n < BENCH_BATCH && next + n <= count) {
+				batch[n] = next + n;
+				n++;
+			}
+
+			size_t pushed = q.push_batch(pop, batch, n);
+			if (pushed == 0)
+				std::this_thread::yield();
+			next += pushed;
+		}
+	};
+
+	auto consumer = [&]() {
+		uint64_t batch[BENCH_BATCH];
+		uint64_t s = 0;
+		while (consumed.load(std::memory_order_relaxed) < total) {
+			size_t n = q.pop_batch(pop, batch, BENCH_BATCH);
+			if (n == 0) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			for (size_t i = 0; i < n; ++i)
+				s += batch[i];
+			consumed.fetch_add(n, std::memory_order_relaxed);
+		}
+		sum.fetch_add(s, std::memory_order_relaxed);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < nproducers; ++i)
+		threads.emplace_back(producer);
+	for (unsigned i = 0; i < nconsumers; ++i)
+		threads.emplace_back(consumer);
+	for (auto &t : threads)
+		t.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	uint64_t expected = nproducers * (count * (count + 1) / 2);
+	if (consumed != total || sum != expected)
+		throw std::runtime_error("elements lost or duplicated");
+
+	std::cout << total << " elements in " << elapsed.count() << "s ("
+		  << total / elapsed.count() << " ops/s)" << std::endl;
+}
+
+} /* namespace examples */
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [push value...|pop [n]|show|"
+			     "bench producers consumers count]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+
+	queue_op op = parse_queue_op(argv[2]);
+
+	pool<examples::pmem_mpmc_queue> pop;
+
+	if (access(path, F_OK) != 0) {
+		pop = pool<examples::pmem_mpmc_queue>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL, S_IRWXU);
+	} else {
+		pop = pool<examples::pmem_mpmc_queue>::open(path, LAYOUT);
+	}
+
+	auto q = pop.get_root();
+	if (!q->initialized())
+		q->init(pop, DEFAULT_CAPACITY);
+	q->recover(pop);
+
+	switch (op) {
+		case QUEUE_PUSH: {
+			std::vector<uint64_t> values;
+			for (int i = 3; i < argc; ++i)
+				values.push_back(atoll(argv[i]));
+
+			size_t n = q->push_batch(pop, values.data(),
+						 values.size());
+			if (n != values.size())
+				std::cerr << "queue full, pushed " << n
+					  << " elements" << std::endl;
+			break;
+		}
+		case QUEUE_POP: {
+			size_t n = argc > 3 ? atoll(argv[3]) : 1;
+			std::vector<uint64_t> values(n);
+
+			n = q->pop_batch(pop, values.data(), n);
+			for (size_t i = 0; i < n; ++i)
+				std::cout << values[i] << std::endl;
+			break;
+		}
+		case QUEUE_SHOW:
+			q->show();
+			break;
+		case QUEUE_BENCH:
+			if (argc < 6)
+				throw std::invalid_argument(
+					"bench requires 3 arguments");
+			examples::bench(pop, *q, atoi(argv[3]),
+					atoi(argv[4]), atoll(argv[5]));
+			break;
+		default:
+			throw std::invalid_argument("invalid queue operation");
+			break;
+	}
+
+	pop.close();
+
+	return 0;
+}
@@ -40,6 +40,28 @@
 #include "hashmap_tx.h"
 #include "hashmap_internal.h"
 
+/*
+ * The buckets are striped across HM_TX_STRIPES locks - bucket i belongs to
+ * stripe i % HM_TX_STRIPES. Operations on keys from different stripes run in
+ * parallel. Every lock is taken by the transaction of the operation, so it is
+ * held until the outermost transaction ends. That keeps the changes of an
+ * uncommitted transaction invisible to the other threads, but a transaction
+ * modifying more than one key may deadlock with another one doing the same -
+ * such transactions have to be serialized by the caller. A resize needs all
+ * the stripe locks, so it is skipped if another one is already in progress.
+ *
+ * The table is resized incrementally: the new bucket array replaces the old
+ * one right away and every insert or remove moves a few old buckets of its
+ * stripe to the new array, until the old one can be freed. Until then the
+ * lookups check both arrays. The number of buckets is always a multiple of
+ * HM_TX_STRIPES, so a key belongs to the same stripe in both arrays.
+ */
+
+/* number of locks protecting the buckets */
+#define HM_TX_STRIPES 64
+
+/* number of old buckets moved by every insert and remove during a resize */
+#define HM_TX_MIGRATE_STEP 2
 
 /* layout definition */
 TOID_DECLARE(struct buckets, HASHMAP_TX_TYPE_OFFSET + 1);
@@ -60,6 +82,17 @@ struct buckets {
 	TOID(struct entry) bucket[];
 };
 
+struct stripe {
+	/* protects the buckets of the stripe in both arrays */
+	PMEMmutex lock;
+
+	/* number of values inserted into the buckets of the stripe */
+	uint64_t count;
+
+	/* number of the old buckets of the stripe already moved */
+	uint64_t migrated;
+};
+
 struct hashmap_tx {
 	/* random number generator seed */
 	uint32_t seed;
@@ -69,23 +102,56 @@ struct hashmap_tx {
 	uint32_t hash_fun_b;
 	uint64_t hash_fun_p;
 
-	/* number of values inserted */
-	uint64_t count;
-
 	/* buckets */
 	TOID(struct buckets) buckets;
+
+	/* buckets being moved to the new array, NULL if not resizing */
+	TOID(struct buckets) buckets_old;
+
+	/*
+	 * serializes the resizes, the threads which may already hold one of
+	 * the stripe locks only try to take it
+	 */
+	PMEMmutex resize_lock;
+
+	struct stripe stripes[HM_TX_STRIPES];
 };
 
 /*
- * create_hashmap -- hashmap initializer
+ * buckets_len -- (internal) rounds the number of buckets up to a multiple of
+ * the number of stripes
  */
-static void
-create_hashmap(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint32_t seed)
+static size_t
+buckets_len(size_t len)
+{
+	if (len < HM_TX_STRIPES)
+		return HM_TX_STRIPES;
+
+	return (len + HM_TX_STRIPES - 1) / HM_TX_STRIPES * HM_TX_STRIPES;
+}
+
+/*
+ * buckets_new -- (internal) allocates a zeroed bucket array, must be called
+ * within a transaction
+ */
+static TOID(struct buckets)
+buckets_new(size_t len)
 {
-	size_t len = INIT_BUCKETS_NUM;
 	size_t sz = sizeof(struct buckets) +
 			len * sizeof(TOID(struct entry));
 
+	TOID(struct buckets) buckets = TX_ZALLOC(struct buckets, sz);
+	D_RW(buckets)->nbuckets = len;
+
+	return buckets;
+}
+
+/*
+ * create_hashmap -- hashmap initializer
+ */
+static void
+create_hashmap(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint32_t seed)
+{
 	TX_BEGIN(pop) {
 		TX_ADD(hashmap);
 
@@ -96,8 +162,8 @@ create_hashmap(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint32_t seed)
 				(uint32_t)(100000.0 * rand() / RAND_MAX);
 		D_RW(hashmap)->hash_fun_p = HASH_FUNC_COEFF_P;
 
-		D_RW(hashmap)->buckets = TX_ZALLOC(struct buckets, sz);
-		D_RW(D_RW(hashmap)->buckets)->nbuckets = len;
+		D_RW(hashmap)->buckets =
+				buckets_new(buckets_len(INIT_BUCKETS_NUM));
 	} TX_ONABORT {
 		fprintf(stderr, "%s: transaction aborted: %s\n", __func__,
 			pmemobj_errormsg());
@@ -108,60 +174,203 @@ create_hashmap(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint32_t seed)
 /*
  * hash -- the simplest hashing function,
  * see https://en.wikipedia.org/wiki/Universal_hashing#Hashing_integers
+ *
+ * The result modulo the number of buckets gives the bucket of the value.
  */
 static uint64_t
-hash(const TOID(struct hashmap_tx) *hashmap,
-	const TOID(struct buckets) *buckets, uint64_t value)
+hash(const TOID(struct hashmap_tx) *hashmap, uint64_t value)
 {
 	uint32_t a = D_RO(*hashmap)->hash_fun_a;
 	uint32_t b = D_RO(*hashmap)->hash_fun_b;
 	uint64_t p = D_RO(*hashmap)->hash_fun_p;
-	size_t len = D_RO(*buckets)->nbuckets;
 
-	return ((a * value + b) % p) % len;
+	return (a * value + b) % p;
+}
+
+/*
+ * hm_tx_bucket -- (internal) returns the list of given hash in the buckets
+ */
+static TOID(struct entry) *
+hm_tx_bucket(TOID(struct buckets) buckets, uint64_t h)
+{
+	return &D_RW(buckets)->bucket[h % D_RO(buckets)->nbuckets];
 }
 
 /*
- * hm_tx_rebuild -- rebuilds the hashmap with a new number of buckets
+ * hm_tx_find -- (internal) returns the link pointing to the entry with given
+ * key, NULL if there is no such entry, must be called with the stripe of the
+ * key locked
+ */
+static TOID(struct entry) *
+hm_tx_find(TOID(struct hashmap_tx) hashmap, uint64_t h, uint64_t key)
+{
+	TOID(struct entry) *link = hm_tx_bucket(D_RO(hashmap)->buckets, h);
+
+	for (; !TOID_IS_NULL(*link); link = &D_RW(*link)->next)
+		if (D_RO(*link)->key == key)
+			return link;
+
+	if (TOID_IS_NULL(D_RO(hashmap)->buckets_old))
+		return NULL;
+
+	link = hm_tx_bucket(D_RO(hashmap)->buckets_old, h);
+
+	for (; !TOID_IS_NULL(*link); link = &D_RW(*link)->next)
+		if (D_RO(*link)->key == key)
+			return link;
+
+	return NULL;
+}
+
+/*
+ * hm_tx_lock_all -- (internal) locks all the stripes until the end of the
+ * current transaction
  */
 static void
-hm_tx_rebuild(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, size_t new_len)
+hm_tx_lock_all(TOID(struct hashmap_tx) hashmap)
 {
-	TOID(struct buckets) buckets_old = D_RO(hashmap)->buckets;
+	for (size_t i = 0; i < HM_TX_STRIPES; ++i)
+		pmemobj_tx_lock(TX_LOCK_MUTEX, &D_RW(hashmap)->stripes[i].lock);
+}
+
+/*
+ * hm_tx_migrate -- (internal) moves up to nsteps old buckets of the stripe to
+ * the new array, returns 1 if all of them are moved, must be called within
+ * a transaction holding the stripe lock
+ */
+static int
+hm_tx_migrate(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
+	size_t s, size_t nsteps)
+{
+	TOID(struct buckets) buckets_old = D_RO(hashmap)->buckets_old;
+	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
+	struct stripe *stripe = &D_RW(hashmap)->stripes[s];
+
+	if (TOID_IS_NULL(buckets_old))
+		return 0;
+
+	size_t len = D_RO(buckets_old)->nbuckets / HM_TX_STRIPES;
+	if (stripe->migrated == len)
+		return 1;
+
+	pmemobj_tx_add_range_direct(&stripe->migrated,
+			sizeof(stripe->migrated));
+
+	for (; nsteps && stripe->migrated < len; nsteps--) {
+		size_t i = s + stripe->migrated * HM_TX_STRIPES;
+		TOID(struct entry) *old = &D_RW(buckets_old)->bucket[i];
+
+		if (!TOID_IS_NULL(*old))
+			pmemobj_tx_add_range_direct(old, sizeof(*old));
+
+		while (!TOID_IS_NULL(*old)) {
+			TOID(struct entry) en = *old;
+			TOID(struct entry) *head = hm_tx_bucket(buckets,
+					hash(&hashmap, D_RO(en)->key));
+
+			*old = D_RO(en)->next;
+
+			TX_ADD_FIELD(en, next);
+			pmemobj_tx_add_range_direct(head, sizeof(*head));
+			D_RW(en)->next = *head;
+			*head = en;
+		}
+
+		stripe->migrated++;
+	}
+
+	return stripe->migrated == len;
+}
+
+/*
+ * hm_tx_migrated -- (internal) checks whether all the old buckets are moved
+ */
+static int
+hm_tx_migrated(TOID(struct hashmap_tx) hashmap)
+{
+	TOID(struct buckets) buckets_old = D_RO(hashmap)->buckets_old;
+
+	if (TOID_IS_NULL(buckets_old))
+		return 0;
+
+	size_t len = D_RO(buckets_old)->nbuckets / HM_TX_STRIPES;
+	for (size_t s = 0; s < HM_TX_STRIPES; ++s)
+		if (D_RO(hashmap)->stripes[s].migrated != len)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * hm_tx_finish -- (internal) frees the old buckets once all the stripes are
+ * moved, if force is set moves the remaining ones first, must be called within
+ * a transaction holding all the stripe locks
+ */
+static void
+hm_tx_finish(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, int force)
+{
+	TOID(struct buckets) buckets_old = D_RO(hashmap)->buckets_old;
+
+	if (TOID_IS_NULL(buckets_old))
+		return;
+
+	if (force) {
+		size_t len = D_RO(buckets_old)->nbuckets / HM_TX_STRIPES;
+		for (size_t s = 0; s < HM_TX_STRIPES; ++s)
+			hm_tx_migrate(pop, hashmap, s, len);
+	} else if (!hm_tx_migrated(hashmap)) {
+		return;
+	}
+
+	TX_ADD_FIELD(hashmap, buckets_old);
+	TX_FREE(buckets_old);
+	D_RW(hashmap)->buckets_old = TOID_NULL(struct buckets);
+}
 
-	if (new_len == 0)
-		new_len = D_RO(buckets_old)->nbuckets;
+/*
+ * hm_tx_resize -- (internal) starts moving the values to a new array of
+ * new_len buckets, unless the array has already been resized from len
+ * buckets by another thread, if complete is set moves all the values
+ * before returning
+ */
+static void
+hm_tx_resize(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
+	size_t len, size_t new_len, int complete)
+{
+	PMEMmutex *lock = &D_RW(hashmap)->resize_lock;
 
-	size_t sz_old = sizeof(struct buckets) +
-			D_RO(buckets_old)->nbuckets *
-			sizeof(TOID(struct entry));
-	size_t sz_new = sizeof(struct buckets) +
-			new_len * sizeof(TOID(struct entry));
+	if (complete)
+		pmemobj_mutex_lock(pop, lock);
+	else if (pmemobj_mutex_trylock(pop, lock))
+		return;
 
 	TX_BEGIN(pop) {
-		TX_ADD_FIELD(hashmap, buckets);
-		TOID(struct buckets) buckets_new =
-				TX_ZALLOC(struct buckets, sz_new);
-		D_RW(buckets_new)->nbuckets = new_len;
-		pmemobj_tx_add_range(buckets_old.oid, 0, sz_old);
-
-		for (size_t i = 0; i < D_RO(buckets_old)->nbuckets; ++i) {
-			while (!TOID_IS_NULL(D_RO(buckets_old)->bucket[i])) {
-				TOID(struct entry) en =
-					D_RO(buckets_old)->bucket[i];
-				uint64_t h = hash(&hashmap, &buckets_new,
-						D_RO(en)->key);
-
-				D_RW(buckets_old)->bucket[i] = D_RO(en)->next;
-
-				TX_ADD_FIELD(en, next);
-				D_RW(en)->next = D_RO(buckets_new)->bucket[h];
-				D_RW(buckets_new)->bucket[h] = en;
+		hm_tx_lock_all(hashmap);
+
+		size_t cur_len = D_RO(D_RO(hashmap)->buckets)->nbuckets;
+		if (len == 0 || cur_len == len) {
+			hm_tx_finish(pop, hashmap, 1);
+
+			if (new_len == 0)
+				new_len = cur_len;
+
+			TX_ADD_FIELD(hashmap, buckets);
+			TX_ADD_FIELD(hashmap, buckets_old);
+			D_RW(hashmap)->buckets_old = D_RO(hashmap)->buckets;
+			D_RW(hashmap)->buckets =
+					buckets_new(buckets_len(new_len));
+
+			for (size_t s = 0; s < HM_TX_STRIPES; ++s) {
+				struct stripe *stripe =
+					&D_RW(hashmap)->stripes[s];
+				pmemobj_tx_add_range_direct(&stripe->migrated,
+						sizeof(stripe->migrated));
+				stripe->migrated = 0;
 			}
-		}
 
-		D_RW(hashmap)->buckets = buckets_new;
-		TX_FREE(buckets_old);
+			if (complete)
+				hm_tx_finish(pop, hashmap, 1);
+		}
 	} TX_ONABORT {
 		fprintf(stderr, "%s: transaction aborted: %s\n", __func__,
 			pmemobj_errormsg());
@@ -171,6 +380,31 @@ hm_tx_rebuild(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, size_t new_len)
 		 */
 	} TX_END
 
+	pmemobj_mutex_unlock(pop, lock);
+}
+
+/*
+ * hm_tx_finish_resize -- (internal) frees the old buckets if all the stripes
+ * are already moved
+ */
+static void
+hm_tx_finish_resize(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap)
+{
+	PMEMmutex *lock = &D_RW(hashmap)->resize_lock;
+
+	/* check without the locks first, it is repeated under them */
+	if (!hm_tx_migrated(hashmap) || pmemobj_mutex_trylock(pop, lock))
+		return;
+
+	TX_BEGIN(pop) {
+		hm_tx_lock_all(hashmap);
+		hm_tx_finish(pop, hashmap, 0);
+	} TX_ONABORT {
+		fprintf(stderr, "%s: transaction aborted: %s\n", __func__,
+			pmemobj_errormsg());
+	} TX_END
+
+	pmemobj_mutex_unlock(pop, lock);
 }
 
 /*
@@ -184,46 +418,58 @@ int
 hm_tx_insert(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
 	uint64_t key, PMEMoid value)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
-	TOID(struct entry) var;
-
-	uint64_t h = hash(&hashmap, &buckets, key);
+	uint64_t h = hash(&hashmap, key);
+	size_t s = h % HM_TX_STRIPES;
+	struct stripe *stripe = &D_RW(hashmap)->stripes[s];
+	size_t len = 0;
 	int num = 0;
-
-	for (var = D_RO(buckets)->bucket[h];
-			!TOID_IS_NULL(var);
-			var = D_RO(var)->next) {
-		if (D_RO(var)->key == key)
-			return 1;
-		num++;
-	}
+	int migrated = 0;
 
 	int ret = 0;
-	TX_BEGIN(pop) {
-		TX_ADD_FIELD(D_RO(hashmap)->buckets, bucket[h]);
-		TX_ADD_FIELD(hashmap, count);
-
-		TOID(struct entry) e = TX_NEW(struct entry);
-		D_RW(e)->key = key;
-		D_RW(e)->value = value;
-		D_RW(e)->next = D_RO(buckets)->bucket[h];
-		D_RW(buckets)->bucket[h] = e;
+	TX_BEGIN_LOCK(pop, TX_LOCK_MUTEX, &stripe->lock) {
+		if (hm_tx_find(hashmap, h, key) != NULL) {
+			ret = 1;
+		} else {
+			TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
+			TOID(struct entry) *head = hm_tx_bucket(buckets, h);
+			TOID(struct entry) var;
+
+			for (var = *head; !TOID_IS_NULL(var);
+					var = D_RO(var)->next)
+				num++;
+
+			pmemobj_tx_add_range_direct(head, sizeof(*head));
+			pmemobj_tx_add_range_direct(&stripe->count,
+					sizeof(stripe->count));
+
+			TOID(struct entry) e = TX_NEW(struct entry);
+			D_RW(e)->key = key;
+			D_RW(e)->value = value;
+			D_RW(e)->next = *head;
+			*head = e;
+
+			stripe->count++;
+			num++;
+			len = D_RO(buckets)->nbuckets;
+		}
 
-		D_RW(hashmap)->count++;
-		num++;
+		migrated = hm_tx_migrate(pop, hashmap, s, HM_TX_MIGRATE_STEP);
 	} TX_ONABORT {
 		fprintf(stderr, "transaction aborted: %s\n",
 			pmemobj_errormsg());
 		ret = -1;
 	} TX_END
 
+	if (migrated)
+		hm_tx_finish_resize(pop, hashmap);
+
 	if (ret)
 		return ret;
 
 	if (num > MAX_HASHSET_THRESHOLD ||
 			(num > MIN_HASHSET_THRESHOLD &&
-			D_RO(hashmap)->count > 2 * D_RO(buckets)->nbuckets))
-		hm_tx_rebuild(pop, hashmap, D_RO(buckets)->nbuckets * 2);
+			hm_tx_count(pop, hashmap) > 2 * len))
+		hm_tx_resize(pop, hashmap, len, len * 2, 0);
 
 	return 0;
 }
@@ -237,53 +483,59 @@ hm_tx_insert(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
 PMEMoid
 hm_tx_remove(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint64_t key)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
-	TOID(struct entry) var, prev = TOID_NULL(struct entry);
-
-	uint64_t h = hash(&hashmap, &buckets, key);
-	for (var = D_RO(buckets)->bucket[h];
-			!TOID_IS_NULL(var);
-			prev = var, var = D_RO(var)->next) {
-		if (D_RO(var)->key == key)
-			break;
-	}
-
-	if (TOID_IS_NULL(var))
-		return OID_NULL;
+	uint64_t h = hash(&hashmap, key);
+	size_t s = h % HM_TX_STRIPES;
+	struct stripe *stripe = &D_RW(hashmap)->stripes[s];
+	size_t len = 0;
+	int migrated = 0;
+
+	PMEMoid ret = OID_NULL;
+	TX_BEGIN_LOCK(pop, TX_LOCK_MUTEX, &stripe->lock) {
+		TOID(struct entry) *link = hm_tx_find(hashmap, h, key);
+		if (link != NULL) {
+			TOID(struct entry) var = *link;
+
+			pmemobj_tx_add_range_direct(link, sizeof(*link));
+			pmemobj_tx_add_range_direct(&stripe->count,
+					sizeof(stripe->count));
+
+			*link = D_RO(var)->next;
+			stripe->count--;
+			ret = D_RO(var)->value;
+			TX_FREE(var);
+
+			len = D_RO(D_RO(hashmap)->buckets)->nbuckets;
+		}
 
-	TX_BEGIN(pop) {
-		if (TOID_IS_NULL(prev))
-			TX_ADD_FIELD(D_RO(hashmap)->buckets, bucket[h]);
-		else
-			TX_ADD_FIELD(prev, next);
-		TX_ADD_FIELD(hashmap, count);
-
-		if (TOID_IS_NULL(prev))
-			D_RW(buckets)->bucket[h] = D_RO(var)->next;
-		else
-			D_RW(prev)->next = D_RO(var)->next;
-		D_RW(hashmap)->count--;
-		TX_FREE(var);
+		migrated = hm_tx_migrate(pop, hashmap, s, HM_TX_MIGRATE_STEP);
 	} TX_ONABORT {
 		fprintf(stderr, "transaction aborted: %s\n",
 			pmemobj_errormsg());
-		return OID_NULL;
+		ret = OID_NULL;
 	} TX_END
 
-	if (D_RO(hashmap)->count < D_RO(buckets)->nbuckets)
-		hm_tx_rebuild(pop, hashmap, D_RO(buckets)->nbuckets / 2);
+	if (migrated)
+		hm_tx_finish_resize(pop, hashmap);
+
+	if (OID_IS_NULL(ret))
+		return ret;
+
+	/* the count of the stripe estimates the count of the whole map */
+	if (len > HM_TX_STRIPES &&
+			stripe->count * HM_TX_STRIPES < len &&
+			hm_tx_count(pop, hashmap) < len)
+		hm_tx_resize(pop, hashmap, len, len / 2, 0);
 
-	return D_RO(var)->value;
+	return ret;
 }
 
 /*
- * hm_tx_foreach -- prints all values from the hashmap
+ * hm_tx_foreach_bucket -- (internal) calls cb for all values of the buckets
  */
-int
-hm_tx_foreach(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
+static int
+hm_tx_foreach_bucket(TOID(struct buckets) buckets,
 	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
 	TOID(struct entry) var;
 
 	int ret = 0;
@@ -295,7 +547,7 @@ hm_tx_foreach(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
 				var = D_RO(var)->next) {
 			ret = cb(D_RO(var)->key, D_RO(var)->value, arg);
 			if (ret)
-				break;
+				return ret;
 		}
 	}
 
@@ -303,19 +555,28 @@ hm_tx_foreach(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
 }
 
 /*
- * hm_tx_debug -- prints complete hashmap state
+ * hm_tx_foreach -- prints all values from the hashmap
+ */
+int
+hm_tx_foreach(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	int ret = hm_tx_foreach_bucket(D_RO(hashmap)->buckets, cb, arg);
+
+	if (ret || TOID_IS_NULL(D_RO(hashmap)->buckets_old))
+		return ret;
+
+	return hm_tx_foreach_bucket(D_RO(hashmap)->buckets_old, cb, arg);
+}
+
+/*
+ * hm_tx_debug_buckets -- (internal) prints the state of the buckets
  */
 static void
-hm_tx_debug(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, FILE *out)
+hm_tx_debug_buckets(TOID(struct buckets) buckets, FILE *out)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
 	TOID(struct entry) var;
 
-	fprintf(out, "a: %u b: %u p: %lu\n", D_RO(hashmap)->hash_fun_a,
-		D_RO(hashmap)->hash_fun_b, D_RO(hashmap)->hash_fun_p);
-	fprintf(out, "count: %lu, buckets: %lu\n", D_RO(hashmap)->count,
-		D_RO(buckets)->nbuckets);
-
 	for (size_t i = 0; i < D_RO(buckets)->nbuckets; ++i) {
 		if (TOID_IS_NULL(D_RO(buckets)->bucket[i]))
 			continue;
@@ -331,24 +592,53 @@ hm_tx_debug(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, FILE *out)
 	}
 }
 
+/*
+ * hm_tx_debug -- prints complete hashmap state
+ */
+static void
+hm_tx_debug(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, FILE *out)
+{
+	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
+	TOID(struct buckets) buckets_old = D_RO(hashmap)->buckets_old;
+
+	fprintf(out, "a: %u b: %u p: %lu\n", D_RO(hashmap)->hash_fun_a,
+		D_RO(hashmap)->hash_fun_b, D_RO(hashmap)->hash_fun_p);
+	fprintf(out, "count: %lu, buckets: %lu\n",
+		hm_tx_count(pop, hashmap), D_RO(buckets)->nbuckets);
+
+	hm_tx_debug_buckets(buckets, out);
+
+	if (TOID_IS_NULL(buckets_old))
+		return;
+
+	fprintf(out, "old buckets: %lu\n", D_RO(buckets_old)->nbuckets);
+	hm_tx_debug_buckets(buckets_old, out);
+}
+
 /*
  * hm_tx_get -- checks whether specified value is in the hashmap
  */
 PMEMoid
 hm_tx_get(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint64_t key)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
-	TOID(struct entry) var;
+	uint64_t h = hash(&hashmap, key);
+	PMEMmutex *lock = &D_RW(hashmap)->stripes[h % HM_TX_STRIPES].lock;
+	PMEMoid ret = OID_NULL;
+
+	/* within a transaction the lock is held until it ends */
+	if (pmemobj_tx_stage() == TX_STAGE_WORK)
+		pmemobj_tx_lock(TX_LOCK_MUTEX, lock);
+	else
+		pmemobj_mutex_lock(pop, lock);
 
-	uint64_t h = hash(&hashmap, &buckets, key);
+	TOID(struct entry) *link = hm_tx_find(hashmap, h, key);
+	if (link != NULL)
+		ret = D_RO(*link)->value;
 
-	for (var = D_RO(buckets)->bucket[h];
-			!TOID_IS_NULL(var);
-			var = D_RO(var)->next)
-		if (D_RO(var)->key == key)
-			return D_RO(var)->value;
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		pmemobj_mutex_unlock(pop, lock);
 
-	return OID_NULL;
+	return ret;
 }
 
 /*
@@ -357,18 +647,20 @@ hm_tx_get(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint64_t key)
 int
 hm_tx_lookup(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint64_t key)
 {
-	TOID(struct buckets) buckets = D_RO(hashmap)->buckets;
-	TOID(struct entry) var;
+	uint64_t h = hash(&hashmap, key);
+	PMEMmutex *lock = &D_RW(hashmap)->stripes[h % HM_TX_STRIPES].lock;
 
-	uint64_t h = hash(&hashmap, &buckets, key);
+	if (pmemobj_tx_stage() == TX_STAGE_WORK)
+		pmemobj_tx_lock(TX_LOCK_MUTEX, lock);
+	else
+		pmemobj_mutex_lock(pop, lock);
 
-	for (var = D_RO(buckets)->bucket[h];
-			!TOID_IS_NULL(var);
-			var = D_RO(var)->next)
-		if (D_RO(var)->key == key)
-			return 1;
+	int ret = hm_tx_find(hashmap, h, key) != NULL;
 
-	return 0;
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		pmemobj_mutex_unlock(pop, lock);
+
+	return ret;
 }
 
 /*
@@ -377,7 +669,12 @@ hm_tx_lookup(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap, uint64_t key)
 size_t
 hm_tx_count(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap)
 {
-	return D_RO(hashmap)->count;
+	size_t count = 0;
+
+	for (size_t i = 0; i < HM_TX_STRIPES; ++i)
+		count += D_RO(hashmap)->stripes[i].count;
+
+	return count;
 }
 
 /*
@@ -429,7 +726,7 @@ hm_tx_cmd(PMEMobjpool *pop, TOID(struct hashmap_tx) hashmap,
 {
 	switch (cmd) {
 		case HASHMAP_CMD_REBUILD:
-			hm_tx_rebuild(pop, hashmap, arg);
+			hm_tx_resize(pop, hashmap, 0, arg, 1);
 			return 0;
 		case HASHMAP_CMD_DEBUG:
 			if (!arg)
@@ -61,6 +61,7 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <emmintrin.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include "libpmemobj.h"
 #include "art.h"
@@ -170,6 +171,125 @@ PMEMOIDmove(PMEMoid *dest, PMEMoid *src, const int n)
 	}
 }
 
+/*
+ * Concurrency control
+ *
+ * Lookups never take locks - they use optimistic lock coupling instead.
+ * Each node (and each child reference) is covered by a version counter,
+ * which is odd while a writer modifies the node. A reader remembers the
+ * version of a node before reading it and checks that it didn't change
+ * before it follows a child reference read from the node. Before moving on
+ * to the child, it also re-validates the parent, so a node removed from
+ * the tree in the meantime is never trusted. On any mismatch the lookup
+ * restarts from the root.
+ *
+ * The versions are volatile: they live in a table indexed by the address
+ * of the node, so nothing has to be reset when the pool is reopened and
+ * the layout of the persistent nodes stays the same. Nodes which share
+ * a slot in the table only cause spurious restarts.
+ *
+ * Modifications are serialized by a single writer lock (they all update
+ * the size of the tree anyway). A writer marks every node it modifies or
+ * frees and clears the marks only after its transaction ends, so readers
+ * never use data which might still be rolled back.
+ */
+#define ART_VERSION_SLOTS	4096
+#define ART_VERSION_SHIFT	6	/* one slot per cache line */
+#define ART_WRITE_SET_MAX	32
+
+static volatile uint64_t art_versions[ART_VERSION_SLOTS];
+
+static pthread_mutex_t art_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint64_t *art_write_set[ART_WRITE_SET_MAX];
+static int art_write_set_len;
+
+/*
+ * art_version -- (internal) returns the version slot covering the address
+ */
+static inline volatile uint64_t *
+art_version(const void *addr)
+{
+	uintptr_t idx = (uintptr_t)addr >> ART_VERSION_SHIFT;
+
+	return &art_versions[idx % ART_VERSION_SLOTS];
+}
+
+/*
+ * art_read_lock -- (internal) waits until the node isn't being modified
+ *	and returns its version
+ */
+static inline uint64_t
+art_read_lock(const void *addr)
+{
+	volatile uint64_t *v = art_version(addr);
+	uint64_t ver;
+
+	while ((ver = *v) & 1)
+		_mm_pause();
+
+	__sync_synchronize();
+
+	return ver;
+}
+
+/*
+ * art_read_validate -- (internal) checks whether the node has changed since
+ *	its version was read
+ */
+static inline int
+art_read_validate(const void *addr, uint64_t ver)
+{
+	__sync_synchronize();
+
+	return *art_version(addr) == ver;
+}
+
+/*
+ * art_write_lock -- (internal) marks the node as being modified until the
+ *	end of the current write operation
+ */
+static void
+art_write_lock(const void *addr)
+{
+	volatile uint64_t *v = art_version(addr);
+
+	for (int i = 0; i < art_write_set_len; ++i)
+		if (art_write_set[i] == v)
+			return;
+
+	assert(art_write_set_len < ART_WRITE_SET_MAX);
+	art_write_set[art_write_set_len++] = v;
+
+	*v += 1;
+	__sync_synchronize();
+}
+
+/*
+ * art_write_begin -- (internal) starts a write operation
+ */
+static void
+art_write_begin(void)
+{
+	pthread_mutex_lock(&art_writer_lock);
+	art_write_set_len = 0;
+}
+
+/*
+ * art_write_end -- (internal) publishes all the modified nodes and ends
+ *	the write operation
+ */
+static void
+art_write_end(void)
+{
+	__sync_synchronize();
+
+	for (int i = 0; i < art_write_set_len; ++i)
+		*art_write_set[i] += 1;
+
+	art_write_set_len = 0;
+	pthread_mutex_unlock(&art_writer_lock);
+}
+
 TOID(art_node_u)
 alloc_node(PMEMobjpool *pop, art_node_type node_type)
 {
@@ -312,6 +432,12 @@ art_tree_destroy(TOID(struct art_tree_root) t)
 	return 0;
 }
 
+static inline int
+min(int a, int b)
+{
+	return (a < b) ? a : b;
+}
+
 static TOID(art_node_u)*
 find_child(TOID(art_node_u) n, unsigned char c)
 {
@@ -326,7 +452,7 @@ find_child(TOID(art_node_u) n, unsigned char c)
 	switch (D_RO(n)->art_node_type) {
 	case NODE4:
 		an4 = D_RO(n)->u.an4;
-		for (i = 0; i < D_RO(an4)->n.num_children; i++) {
+		for (i = 0; i < min(D_RO(an4)->n.num_children, 4); i++) {
 			if (D_RO(an4)->keys[i] == c) {
 				return &(D_RW(an4)->children[i]);
 			}
@@ -358,7 +484,7 @@ find_child(TOID(art_node_u) n, unsigned char c)
 	case NODE48:
 		an48 = D_RO(n)->u.an48;
 		i = D_RO(an48)->keys[c];
-		if (i) {
+		if (i && i <= 48) {
 			return &(D_RW(an48)->children[i - 1]);
 		}
 		break;
@@ -376,12 +502,6 @@ find_child(TOID(art_node_u) n, unsigned char c)
 	return &null_art_node_u;
 }
 
-static inline int
-min(int a, int b)
-{
-	return (a < b) ? a : b;
-}
-
 /*
  * Returns the number of prefix characters shared between
  * the key and node.
@@ -422,26 +542,59 @@ leaf_matches(TOID(art_leaf) n, const unsigned char *key, int key_len, int depth)
  * @arg key_len The length of the key
  * @return NULL if the item was not found, otherwise
  * the value pointer is returned.
+ *
+ * The search doesn't take any locks and may run concurrently with
+ * modifications of the tree. Every reference read from a node is used only
+ * after the node is validated, see "Concurrency control" above.
  */
 TOID(var_string)
 art_search(PMEMobjpool *pop, const unsigned char *key, int key_len)
 {
 	TOID(struct art_tree_root)t = POBJ_ROOT(pop, struct art_tree_root);
-	TOID(art_node_u) *child;
-	TOID(art_node_u) n = D_RO(t)->root;
+	TOID(art_node_u) *ref;
+	TOID(art_node_u) n;
+	const void *parent;
 	const art_node *n_an;
+	uint64_t parent_v;
+	uint64_t ref_v;
+	uint64_t v;
 	int prefix_len;
-	int depth = 0;
+	int depth;
+
+restart:
+	parent = NULL;
+	parent_v = 0;
+	depth = 0;
+
+	ref = &D_RW(t)->root;
+	ref_v = art_read_lock(ref);
+	n = *ref;
 
 	while (!TOID_IS_NULL(n)) {
+		// The node can be trusted only if its parent didn't change
+		v = art_read_lock(D_RO(n));
+		if (!art_read_validate(ref, ref_v) ||
+		    (parent && !art_read_validate(parent, parent_v)))
+			goto restart;
+
 		// Might be a leaf
 		if (IS_LEAF(D_RO(n))) {
-			// n = LEAF_RAW(n);
+			TOID(art_leaf) l = D_RO(n)->u.al;
+			if (!art_read_validate(D_RO(n), v))
+				goto restart;
+
+			TOID(var_string) l_key = D_RO(l)->key;
+			TOID(var_string) l_value = D_RO(l)->value;
+			if (!art_read_validate(D_RO(n), v))
+				goto restart;
+
 			// Check if the expanded path matches
-			if (!leaf_matches(D_RO(n)->u.al, key, key_len, depth)) {
-				return (D_RO(D_RO(n)->u.al))->value;
-			}
-			return null_var_string;
+			int miss = D_RO(l_key)->len != (uint32_t)key_len ||
+			    memcmp(D_RO(l_key)->s, key, key_len);
+			if (!art_read_validate(D_RO(n), v))
+				goto restart;
+
+			return miss ? null_var_string : l_value;
 		}
 
 		switch (D_RO(n)->art_node_type) {
@@ -452,25 +605,35 @@ art_search(PMEMobjpool *pop, const unsigned char *key, int key_len)
 		default:
 			return null_var_string;
 		}
+		if (!art_read_validate(D_RO(n), v))
+			goto restart;
 
 		// Bail if the prefix does not match
 		if (n_an->partial_len) {
 			prefix_len = check_prefix(n_an, key, key_len, depth);
 			if (prefix_len !=
-				    min(MAX_PREFIX_LEN, n_an->partial_len))
+				    min(MAX_PREFIX_LEN, n_an->partial_len) ||
+			    depth + n_an->partial_len >= (uint32_t)key_len) {
+				if (!art_read_validate(D_RO(n), v))
+					goto restart;
 				return null_var_string;
+			}
 			depth = depth + n_an->partial_len;
 		}
 
 		// Recursively search
-		child = find_child(n, key[depth]);
-		if (TOID_IS_NULL(*child)) {
-			n.oid = OID_NULL;
-		} else {
-			n = *child;
-		}
+		parent = D_RO(n);
+		parent_v = v;
+		ref = find_child(n, key[depth]);
+		ref_v = art_read_lock(ref);
+		n = *ref;
 		depth++;
 	}
+
+	if (!art_read_validate(ref, ref_v) ||
+	    (parent && !art_read_validate(parent, parent_v)))
+		goto restart;
+
 	return null_var_string;
 }
 
@@ -678,9 +841,12 @@ add_child16(PMEMobjpool *pop, TOID(art_node16) n, TOID(art_node_u)*ref,
 
 		TX_ADD(n);
 
-		// Compare the key to all 16 stored keys
-		cmp = _mm_cmplt_epi8(_mm_set1_epi8(c),
-			    _mm_loadu_si128((__m128i *)(D_RO(n)->keys)));
+		// Compare the key to all 16 stored keys, SSE2 has only
+		// a signed comparison, so flip the top bits of both sides
+		__m128i bias = _mm_set1_epi8((char)0x80);
+		cmp = _mm_cmplt_epi8(_mm_xor_si128(_mm_set1_epi8(c), bias),
+			    _mm_xor_si128(bias, _mm_loadu_si128(
+			    (__m128i *)(D_RO(n)->keys))));
 
 		// Use a mask to ignore children that don't exist
 		unsigned mask = (1 << n_an->num_children) - 1;
@@ -740,7 +906,7 @@ add_child4(PMEMobjpool *pop, TOID(art_node4) n, TOID(art_node_u) *ref,
 		// Shift to make room
 		memmove(D_RW(n)->keys + idx + 1, D_RO(n)->keys + idx,
 		    n_an->num_children - idx);
-		assert((idx + 1) < 4);
+		assert(idx < 4);
 		PMEMOIDmove(&(D_RW(n)->children[idx + 1].oid),
 		    &(D_RW(n)->children[idx].oid),
 		n_an->num_children - idx);
@@ -770,6 +936,9 @@ static void
 add_child(PMEMobjpool *pop, TOID(art_node_u) n, TOID(art_node_u) *ref,
 	unsigned char c, TOID(art_node_u) child)
 {
+	art_write_lock(D_RO(n));
+	art_write_lock(ref);
+
 	switch (D_RO(n)->art_node_type) {
 	case NODE4:
 		add_child4(pop, D_RO(n)->u.an4, ref, c, child);
@@ -832,6 +1001,7 @@ recursive_insert(PMEMobjpool *pop, TOID(art_node_u) n, TOID(art_node_u) *ref,
 
 	// If we are at a NULL node, inject a leaf
 	if (TOID_IS_NULL(n)) {
+		art_write_lock(ref);
 		*ref = make_leaf(pop, key, key_len, value, val_len);
 		TX_ADD(*ref);
 		SET_LEAF(D_RW(*ref));
@@ -846,6 +1016,7 @@ recursive_insert(PMEMobjpool *pop, TOID(art_node_u) n, TOID(art_node_u) *ref,
 		// Check if we are updating an existing value
 		if (!leaf_matches(l, key, key_len, depth)) {
 			*old = 1;
+			art_write_lock(D_RO(n));
 			retval = D_RO(l)->value;
 			TX_ADD(D_RW(l)->value);
 			COPY_BLOB(D_RW(l)->value, value, val_len);
@@ -853,6 +1024,7 @@ recursive_insert(PMEMobjpool *pop, TOID(art_node_u) n, TOID(art_node_u) *ref,
 		}
 
 		// New value, we must split the leaf into a node4
+		art_write_lock(ref);
 		pmemobj_tx_add_range_direct(ref,
 		    sizeof(TOID(art_node_u)));
 		TOID(art_node_u) newnode_u = alloc_node(pop, NODE4);
@@ -900,6 +1072,8 @@ recursive_insert(PMEMobjpool *pop, TOID(art_node_u) n, TOID(art_node_u) *ref,
 		}
 
 		// Create a new node
+		art_write_lock(ref);
+		art_write_lock(D_RO(n));
 		pmemobj_tx_add_range_direct(ref,
 		    sizeof(TOID(art_node_u)));
 		pmemobj_tx_add_range_direct(n_an, sizeof(art_node));
@@ -993,6 +1167,7 @@ art_insert(PMEMobjpool *pop,
 	TOID(var_string) old;
 	TOID(struct art_tree_root) root;
 
+	art_write_begin();
 	TX_BEGIN(pop) {
 		root = POBJ_ROOT(pop, struct art_tree_root);
 		TX_ADD(root);
@@ -1006,6 +1181,7 @@ art_insert(PMEMobjpool *pop,
 	} TX_ONABORT {
 		abort();
 	} TX_END
+	art_write_end();
 
 	return old;
 }
@@ -1087,8 +1263,7 @@ static void
 remove_child16(PMEMobjpool *pop,
 	TOID(art_node16) n, TOID(art_node_u) *ref, TOID(art_node_u) *l)
 {
-	/* XXX: check distance calculation */
-	int pos = (l - &(D_RO(n)->children[0])) / sizeof(TOID(art_node_u));
+	int pos = l - &(D_RO(n)->children[0]);
 	uint8_t num_children = ((D_RW(n)->n).num_children);
 
 	TX_ADD(n);
@@ -1097,7 +1272,7 @@ remove_child16(PMEMobjpool *pop,
 	    num_children - 1 - pos);
 	memmove(D_RW(n)->children + pos,
 	    D_RO(n)->children + pos + 1,
-	    (num_children - 1 - pos) * sizeof(void *));
+	    (num_children - 1 - pos) * sizeof(TOID(art_node_u)));
 	((D_RW(n)->n).num_children)--;
 
 	if (--num_children == 3) {
@@ -1119,8 +1294,7 @@ static void
 remove_child4(PMEMobjpool *pop,
 	TOID(art_node4) n, TOID(art_node_u) *ref, TOID(art_node_u) *l)
 {
-	/* XXX: check distance calculation */
-	int pos = (l - &(D_RO(n)->children[0])) / sizeof(TOID(art_node_u));
+	int pos = l - &(D_RO(n)->children[0]);
 	uint8_t *num_children = &((D_RW(n)->n).num_children);
 
 	TX_ADD(n);
@@ -1128,7 +1302,7 @@ remove_child4(PMEMobjpool *pop,
 	memmove(D_RW(n)->keys + pos, D_RO(n)->keys + pos + 1,
 	    *num_children - 1 - pos);
 	memmove(D_RW(n)->children + pos, D_RO(n)->children + pos + 1,
-	    (*num_children - 1 - pos) * sizeof(void *));
+	    (*num_children - 1 - pos) * sizeof(TOID(art_node_u)));
 	(*num_children)--;
 
 	// Remove nodes with only a single child
@@ -1136,6 +1310,7 @@ remove_child4(PMEMobjpool *pop,
 		TOID(art_node_u) child_u = D_RO(n)->children[0];
 		art_node *child = &(D_RW(D_RW(child_u)->u.an4)->n);
 
+		art_write_lock(D_RO(child_u));
 		pmemobj_tx_add_range_direct(ref, sizeof(TOID(art_node_u)));
 
 		if (!IS_LEAF(D_RO(child_u))) {
@@ -1169,6 +1344,9 @@ remove_child(PMEMobjpool *pop,
 	TOID(art_node_u) n, TOID(art_node_u) *ref,
 	unsigned char c, TOID(art_node_u) *l)
 {
+	art_write_lock(D_RO(n));
+	art_write_lock(ref);
+
 	switch (D_RO(n)->art_node_type) {
 	case NODE4:
 		return remove_child4(pop,   D_RO(n)->u.an4,   ref, l);
@@ -1198,6 +1376,8 @@ recursive_delete(PMEMobjpool *pop,
 	if (IS_LEAF(D_RO(n))) {
 		TOID(art_leaf) l = D_RO(n)->u.al;
 		if (!leaf_matches(l, key, key_len, depth)) {
+			art_write_lock(D_RO(n));
+			art_write_lock(ref);
 			*ref = null_art_node_u;
 			return l;
 		}
@@ -1231,6 +1411,7 @@ recursive_delete(PMEMobjpool *pop,
 	if (IS_LEAF(D_RO(*child))) {
 		TOID(art_leaf)l = D_RO(*child)->u.al;
 		if (!leaf_matches(l, key, key_len, depth)) {
+			art_write_lock(D_RO(*child));
 			remove_child(pop, n, ref, key[depth], child);
 			return l;
 		}
@@ -1260,6 +1441,7 @@ art_delete(PMEMobjpool *pop,
 
 	retval = null_var_string;
 
+	art_write_begin();
 	TX_BEGIN(pop) {
 		TX_ADD(root);
 		l = recursive_delete(pop, D_RO(root)->root,
@@ -1273,6 +1455,7 @@ art_delete(PMEMobjpool *pop,
 	} TX_ONABORT {
 		abort();
 	} TX_END
+	art_write_end();
 
 	return retval;
 }
@@ -1383,7 +1566,13 @@ int
 art_iter(PMEMobjpool *pop, art_callback cb, void *data)
 {
 	TOID(struct art_tree_root) t = POBJ_ROOT(pop, struct art_tree_root);
-	return recursive_iter(D_RO(t)->root, cb, data);
+
+	/* the callbacks see a stable tree */
+	art_write_begin();
+	int ret = recursive_iter(D_RO(t)->root, cb, data);
+	art_write_end();
+
+	return ret;
 }
 
 #ifdef LIBART_ITER_PREFIX /* {  */
@@ -0,0 +1,717 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * cskiplist_map.c -- lock-free concurrent skiplist
+ *
+ * All the operations except new, delete, init and clear can be called from
+ * many threads at once, without any locking. Readers never wait and
+ * the inserts and removals synchronize only by compare-and-swap.
+ *
+ * The links between the nodes and the values are stored as offsets within
+ * the pool (like PMEMoid.off), so that each of them can be replaced by
+ * a single 8-byte compare-and-swap.
+ *
+ * Only the bottom level of the list and the values must survive a crash.
+ * They are updated with the dirty bit set, flushed, and only then the bit
+ * is cleared - whoever reads a dirty word flushes it before using it, so no
+ * thread can act on a link or a value which isn't persistent yet. The higher
+ * levels are just an index, never flushed and rebuilt by cskiplist_map_init.
+ *
+ * Nodes are not unlinked while the map is in use - removing a key only
+ * clears the value of its node, a later insert of the key reuses it. Such
+ * empty nodes, as well as the nodes allocated by the inserts interrupted
+ * before linking them, are freed by cskiplist_map_init, which has to be
+ * called every time the pool is opened.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cskiplist_map.h"
+
+#define CSKIPLIST_LEVELS_MAX 16
+
+/* each level has about 1/CSKIPLIST_BRANCHING of the nodes of the one below */
+#define CSKIPLIST_BRANCHING 4
+
+/* set in a link or a value which might not be persistent yet */
+#define CSKIPLIST_DIRTY 1ULL
+
+/* set in the value of every key in the map, which may be OID_NULL */
+#define CSKIPLIST_PRESENT 2ULL
+
+struct cskiplist_map_node {
+	uint64_t key;
+	uint64_t value; /* offset of the value and CSKIPLIST_PRESENT */
+	uint64_t map; /* offset of the map the node belongs to */
+	uint64_t height;
+	uint64_t next[]; /* offsets of the next nodes on each level */
+};
+
+struct cskiplist_map {
+	uint64_t pool_uuid_lo; /* of the nodes and the values */
+	TOID(struct cskiplist_map_node) head; /* of CSKIPLIST_LEVELS_MAX */
+};
+
+struct cskiplist_map_node_args {
+	char *base;
+	uint64_t key;
+	uint64_t value;
+	uint64_t map;
+	uint64_t height;
+	const uint64_t *next;
+	uint64_t off; /* of the constructed node */
+};
+
+/* state of the generator of the heights of the nodes */
+static __thread uint64_t cskiplist_map_seed;
+
+/*
+ * cskiplist_map_base -- (internal) returns the address the offsets are
+ *	relative to
+ */
+static inline char *
+cskiplist_map_base(TOID(struct cskiplist_map) map)
+{
+	return (char *)D_RW(map) - map.oid.off;
+}
+
+/*
+ * cskiplist_map_node -- (internal) returns the node at the given offset
+ */
+static inline struct cskiplist_map_node *
+cskiplist_map_node(char *base, uint64_t off)
+{
+	return (struct cskiplist_map_node *)(base + off);
+}
+
+/*
+ * cskiplist_map_oid -- (internal) returns the object at the given offset
+ */
+static inline PMEMoid
+cskiplist_map_oid(TOID(struct cskiplist_map) map, uint64_t off)
+{
+	PMEMoid oid = {D_RO(map)->pool_uuid_lo, off};
+
+	return oid;
+}
+
+/*
+ * cskiplist_map_value -- (internal) returns the value stored in the node
+ */
+static inline PMEMoid
+cskiplist_map_value(TOID(struct cskiplist_map) map, uint64_t value)
+{
+	value &= ~CSKIPLIST_PRESENT;
+
+	return value == 0 ? OID_NULL : cskiplist_map_oid(map, value);
+}
+
+/*
+ * cskiplist_map_load -- (internal) reads a persistent word, making sure it
+ *	is flushed first
+ */
+static uint64_t
+cskiplist_map_load(PMEMobjpool *pop, uint64_t *word)
+{
+	uint64_t val = *(volatile uint64_t *)word;
+
+	if (val & CSKIPLIST_DIRTY) {
+		pmemobj_persist(pop, word, sizeof(*word));
+		__sync_bool_compare_and_swap(word, val,
+				val & ~CSKIPLIST_DIRTY);
+		val &= ~CSKIPLIST_DIRTY;
+	}
+
+	return val;
+}
+
+/*
+ * cskiplist_map_cas -- (internal) atomically replaces a persistent word,
+ *	returns 0 if the word has changed in the meantime
+ */
+static int
+cskiplist_map_cas(PMEMobjpool *pop, uint64_t *word, uint64_t old_val,
+	uint64_t new_val)
+{
+	if (!__sync_bool_compare_and_swap(word, old_val,
+			new_val | CSKIPLIST_DIRTY))
+		return 0;
+
+	pmemobj_persist(pop, word, sizeof(*word));
+	__sync_bool_compare_and_swap(word, new_val | CSKIPLIST_DIRTY, new_val);
+
+	return 1;
+}
+
+/*
+ * cskiplist_map_next -- (internal) returns the next node on the given level
+ */
+static inline uint64_t
+cskiplist_map_next(PMEMobjpool *pop, char *base, uint64_t off, int level)
+{
+	uint64_t *link = &cskiplist_map_node(base, off)->next[level];
+
+	if (level == 0)
+		return cskiplist_map_load(pop, link);
+
+	return *(volatile uint64_t *)link;
+}
+
+/*
+ * cskiplist_map_height -- (internal) draws the height of a new node
+ */
+static uint64_t
+cskiplist_map_height(void)
+{
+	uint64_t x = cskiplist_map_seed;
+	if (x == 0)
+		x = ((uint64_t)time(NULL) << 32) ^
+			(uint64_t)(uintptr_t)&cskiplist_map_seed;
+
+	/* xorshift64 */
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	cskiplist_map_seed = x;
+
+	uint64_t height = 1;
+	while (height < CSKIPLIST_LEVELS_MAX && x % CSKIPLIST_BRANCHING == 0) {
+		height++;
+		x /= CSKIPLIST_BRANCHING;
+	}
+
+	return height;
+}
+
+/*
+ * cskiplist_map_find -- (internal) returns the first node with a key not less
+ *	than the given one, or 0
+ *
+ * If preds and succs are given, they are filled with the nodes between which
+ * the key belongs on every level. Otherwise the search stops as soon as it
+ * finds the key.
+ */
+static uint64_t
+cskiplist_map_find(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key, uint64_t *preds, uint64_t *succs)
+{
+	char *base = cskiplist_map_base(map);
+	uint64_t pred = D_RO(map)->head.oid.off;
+	uint64_t succ = 0;
+
+	for (int level = CSKIPLIST_LEVELS_MAX - 1; level >= 0; --level) {
+		succ = cskiplist_map_next(pop, base, pred, level);
+		while (succ != 0 && cskiplist_map_node(base, succ)->key < key) {
+			pred = succ;
+			succ = cskiplist_map_next(pop, base, pred, level);
+		}
+
+		if (preds != NULL) {
+			preds[level] = pred;
+			succs[level] = succ;
+		} else if (succ != 0 &&
+				cskiplist_map_node(base, succ)->key == key) {
+			/* a node is indexed only once it's in the list */
+			return succ;
+		}
+	}
+
+	return succ;
+}
+
+/*
+ * cskiplist_map_node_construct -- (internal) constructor of the nodes
+ */
+static int
+cskiplist_map_node_construct(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct cskiplist_map_node *node = ptr;
+	struct cskiplist_map_node_args *args = arg;
+
+	node->key = args->key;
+	node->value = args->value;
+	node->map = args->map;
+	node->height = args->height;
+	memcpy(node->next, args->next, args->height * sizeof(node->next[0]));
+
+	pmemobj_persist(pop, node, sizeof(*node) +
+			args->height * sizeof(node->next[0]));
+
+	args->off = (uint64_t)((char *)ptr - args->base);
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_set_value -- (internal) replaces the value of the node,
+ *	returns the previous one
+ */
+static uint64_t
+cskiplist_map_set_value(PMEMobjpool *pop, struct cskiplist_map_node *node,
+	uint64_t value)
+{
+	uint64_t old;
+
+	do {
+		old = cskiplist_map_load(pop, &node->value);
+	} while (old != value &&
+			!cskiplist_map_cas(pop, &node->value, old, value));
+
+	return old;
+}
+
+/*
+ * cskiplist_map_new -- allocates a new skiplist instance
+ */
+int
+cskiplist_map_new(PMEMobjpool *pop, TOID(struct cskiplist_map) *map,
+	void *arg)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(map, sizeof(*map));
+		*map = TX_ZNEW(struct cskiplist_map);
+
+		TOID(struct cskiplist_map_node) head =
+			TX_ZALLOC(struct cskiplist_map_node,
+				sizeof(struct cskiplist_map_node) +
+				CSKIPLIST_LEVELS_MAX * sizeof(uint64_t));
+		D_RW(head)->map = map->oid.off;
+		D_RW(head)->height = CSKIPLIST_LEVELS_MAX;
+
+		D_RW(*map)->pool_uuid_lo = map->oid.pool_uuid_lo;
+		D_RW(*map)->head = head;
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * cskiplist_map_clear -- removes all elements from the map, must not be
+ *	called concurrently with any other operation
+ */
+int
+cskiplist_map_clear(PMEMobjpool *pop, TOID(struct cskiplist_map) map)
+{
+	char *base = cskiplist_map_base(map);
+	TOID(struct cskiplist_map_node) head = D_RO(map)->head;
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		uint64_t off = cskiplist_map_load(pop, &D_RW(head)->next[0]);
+		while (off != 0) {
+			struct cskiplist_map_node *node =
+				cskiplist_map_node(base, off);
+			uint64_t value = cskiplist_map_load(pop, &node->value);
+			pmemobj_tx_free(cskiplist_map_value(map, value));
+
+			pmemobj_tx_free(cskiplist_map_oid(map, off));
+			off = cskiplist_map_load(pop, &node->next[0]);
+		}
+
+		pmemobj_tx_add_range_direct(D_RW(head)->next,
+				CSKIPLIST_LEVELS_MAX * sizeof(uint64_t));
+		memset(D_RW(head)->next, 0,
+				CSKIPLIST_LEVELS_MAX * sizeof(uint64_t));
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * cskiplist_map_delete -- cleanups and frees skiplist instance
+ */
+int
+cskiplist_map_delete(PMEMobjpool *pop, TOID(struct cskiplist_map) *map)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		cskiplist_map_clear(pop, *map);
+		pmemobj_tx_add_range_direct(map, sizeof(*map));
+		TX_FREE(D_RO(*map)->head);
+		TX_FREE(*map);
+		*map = TOID_NULL(struct cskiplist_map);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * cskiplist_map_init -- recovers the skiplist after the pool is opened,
+ *	must not be called concurrently with any other operation
+ */
+int
+cskiplist_map_init(PMEMobjpool *pop, TOID(struct cskiplist_map) map)
+{
+	char *base = cskiplist_map_base(map);
+	uint64_t head = D_RO(map)->head.oid.off;
+
+	/* unlink and free the nodes of the removed keys */
+	uint64_t pred = head;
+	uint64_t off = cskiplist_map_next(pop, base, head, 0);
+	while (off != 0) {
+		struct cskiplist_map_node *node = cskiplist_map_node(base, off);
+		uint64_t next = cskiplist_map_next(pop, base, off, 0);
+
+		if (cskiplist_map_load(pop, &node->value) == 0) {
+			uint64_t *link =
+				&cskiplist_map_node(base, pred)->next[0];
+			*link = next;
+			pmemobj_persist(pop, link, sizeof(*link));
+
+			PMEMoid oid = cskiplist_map_oid(map, off);
+			pmemobj_free(&oid);
+		} else {
+			pred = off;
+		}
+
+		off = next;
+	}
+
+	/* rebuild the index from the bottom level */
+	uint64_t last[CSKIPLIST_LEVELS_MAX];
+	for (int level = 1; level < CSKIPLIST_LEVELS_MAX; ++level)
+		last[level] = head;
+
+	for (off = cskiplist_map_next(pop, base, head, 0); off != 0;
+			off = cskiplist_map_next(pop, base, off, 0)) {
+		struct cskiplist_map_node *node = cskiplist_map_node(base, off);
+		for (uint64_t level = 1; level < node->height; ++level) {
+			cskiplist_map_node(base, last[level])->next[level] =
+				off;
+			last[level] = off;
+		}
+	}
+
+	for (int level = 1; level < CSKIPLIST_LEVELS_MAX; ++level)
+		cskiplist_map_node(base, last[level])->next[level] = 0;
+
+	/* free the nodes of the inserts interrupted before linking them */
+	TOID(struct cskiplist_map_node) node;
+	TOID(struct cskiplist_map_node) nnode;
+	POBJ_FOREACH_SAFE_TYPE(pop, node, nnode) {
+		if (D_RO(node)->map != map.oid.off || node.oid.off == head)
+			continue;
+
+		if (cskiplist_map_find(pop, map, D_RO(node)->key,
+				NULL, NULL) != node.oid.off)
+			POBJ_FREE(&node);
+	}
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_insert -- inserts a new key-value pair into the map, or
+ *	replaces the value of the key
+ *
+ * The value must belong to the same pool as the map, or be OID_NULL.
+ */
+int
+cskiplist_map_insert(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key, PMEMoid value)
+{
+	if (!OID_IS_NULL(value) &&
+			value.pool_uuid_lo != D_RO(map)->pool_uuid_lo) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	char *base = cskiplist_map_base(map);
+	uint64_t preds[CSKIPLIST_LEVELS_MAX];
+	uint64_t succs[CSKIPLIST_LEVELS_MAX];
+
+	struct cskiplist_map_node_args args;
+	args.base = base;
+	args.key = key;
+	args.value = value.off | CSKIPLIST_PRESENT;
+	args.map = map.oid.off;
+	args.height = cskiplist_map_height();
+	args.next = succs;
+	args.off = 0;
+
+	struct cskiplist_map_node *node = NULL;
+	size_t size = sizeof(struct cskiplist_map_node) +
+		args.height * sizeof(uint64_t);
+
+	for (;;) {
+		uint64_t succ = cskiplist_map_find(pop, map, key, preds, succs);
+		if (succ != 0 && cskiplist_map_node(base, succ)->key == key) {
+			cskiplist_map_set_value(pop,
+				cskiplist_map_node(base, succ), args.value);
+
+			/* someone else has inserted the key first */
+			if (node != NULL) {
+				PMEMoid oid = cskiplist_map_oid(map, args.off);
+				pmemobj_free(&oid);
+			}
+
+			return 0;
+		}
+
+		if (node == NULL) {
+			if (pmemobj_alloc(pop, NULL, size,
+				TOID_TYPE_NUM(struct cskiplist_map_node),
+				cskiplist_map_node_construct, &args))
+				return -1;
+
+			node = cskiplist_map_node(base, args.off);
+		} else {
+			/* the list has changed since the last attempt */
+			memcpy(node->next, succs,
+				args.height * sizeof(node->next[0]));
+			pmemobj_persist(pop, &node->next[0],
+				sizeof(node->next[0]));
+		}
+
+		if (cskiplist_map_cas(pop,
+				&cskiplist_map_node(base, preds[0])->next[0],
+				succs[0], args.off))
+			break;
+	}
+
+	/* the key is in the map now, add the node to the index */
+	for (int level = 1; level < (int)args.height; ++level) {
+		for (;;) {
+			node->next[level] = succs[level];
+			if (__sync_bool_compare_and_swap(
+					&cskiplist_map_node(base,
+						preds[level])->next[level],
+					succs[level], args.off))
+				break;
+
+			cskiplist_map_find(pop, map, key, preds, succs);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_insert_new -- allocates a new object and inserts it into
+ *	the map
+ *
+ * The object isn't freed if the insert is interrupted.
+ */
+int
+cskiplist_map_insert_new(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key, size_t size, unsigned type_num,
+	void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
+	void *arg)
+{
+	PMEMoid n;
+	if (pmemobj_alloc(pop, &n, size, type_num, NULL, NULL))
+		return -1;
+
+	constructor(pop, pmemobj_direct(n), arg);
+
+	if (cskiplist_map_insert(pop, map, key, n)) {
+		pmemobj_free(&n);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_remove -- removes key-value pair from the map
+ */
+PMEMoid
+cskiplist_map_remove(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key)
+{
+	char *base = cskiplist_map_base(map);
+	uint64_t off = cskiplist_map_find(pop, map, key, NULL, NULL);
+
+	if (off == 0 || cskiplist_map_node(base, off)->key != key)
+		return OID_NULL;
+
+	uint64_t old = cskiplist_map_set_value(pop,
+			cskiplist_map_node(base, off), 0);
+
+	return cskiplist_map_value(map, old);
+}
+
+/*
+ * cskiplist_map_remove_free -- removes and frees an object from the list
+ *
+ * The object isn't freed if the removal is interrupted.
+ */
+int
+cskiplist_map_remove_free(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key)
+{
+	PMEMoid val = cskiplist_map_remove(pop, map, key);
+	if (!OID_IS_NULL(val))
+		pmemobj_free(&val);
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_get_value -- (internal) returns the value of the key,
+ *	0 if it isn't in the map
+ */
+static uint64_t
+cskiplist_map_get_value(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key)
+{
+	char *base = cskiplist_map_base(map);
+	uint64_t off = cskiplist_map_find(pop, map, key, NULL, NULL);
+
+	if (off == 0 || cskiplist_map_node(base, off)->key != key)
+		return 0;
+
+	return cskiplist_map_load(pop, &cskiplist_map_node(base, off)->value);
+}
+
+/*
+ * cskiplist_map_get -- searches for a value of the key
+ */
+PMEMoid
+cskiplist_map_get(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key)
+{
+	return cskiplist_map_value(map,
+			cskiplist_map_get_value(pop, map, key));
+}
+
+/*
+ * cskiplist_map_lookup -- searches if a key exists
+ */
+int
+cskiplist_map_lookup(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key)
+{
+	return cskiplist_map_get_value(pop, map, key) != 0;
+}
+
+/*
+ * cskiplist_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ *
+ * The keys inserted or removed concurrently may or may not be visited.
+ */
+int
+cskiplist_map_range(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	char *base = cskiplist_map_base(map);
+
+	if (min > max)
+		return 0;
+
+	for (uint64_t off = cskiplist_map_find(pop, map, min, NULL, NULL);
+			off != 0 && cskiplist_map_node(base, off)->key <= max;
+			off = cskiplist_map_next(pop, base, off, 0)) {
+		struct cskiplist_map_node *node = cskiplist_map_node(base, off);
+		uint64_t value = cskiplist_map_load(pop, &node->value);
+		if (value == 0)
+			continue;
+
+		int ret = cb(node->key, cskiplist_map_value(map, value), arg);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_foreach -- calls function for each node on a list
+ */
+int
+cskiplist_map_foreach(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	return cskiplist_map_range(pop, map, 0, UINT64_MAX, cb, arg);
+}
+
+/*
+ * cskiplist_map_seek -- finds the smallest key that is not less than the given
+ *	one
+ */
+int
+cskiplist_map_seek(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	char *base = cskiplist_map_base(map);
+
+	for (uint64_t off = cskiplist_map_find(pop, map, key, NULL, NULL);
+			off != 0; off = cskiplist_map_next(pop, base, off, 0)) {
+		struct cskiplist_map_node *node = cskiplist_map_node(base, off);
+		uint64_t val = cskiplist_map_load(pop, &node->value);
+		if (val == 0)
+			continue;
+
+		*found = node->key;
+		*value = cskiplist_map_value(map, val);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * cskiplist_map_is_empty -- checks whether the map is empty
+ */
+int
+cskiplist_map_is_empty(PMEMobjpool *pop, TOID(struct cskiplist_map) map)
+{
+	uint64_t key;
+	PMEMoid value;
+
+	return !cskiplist_map_seek(pop, map, 0, &key, &value);
+}
+
+/*
+ * cskiplist_map_check -- check if given persistent object is a skiplist
+ */
+int
+cskiplist_map_check(PMEMobjpool *pop, TOID(struct cskiplist_map) map)
+{
+	return TOID_IS_NULL(map) || !TOID_VALID(map);
+}
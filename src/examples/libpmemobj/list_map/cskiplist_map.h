@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * cskiplist_map.h -- lock-free concurrent skiplist
+ */
+
+#ifndef CSKIPLIST_MAP_H
+#define CSKIPLIST_MAP_H
+
+#include <libpmemobj.h>
+
+#ifndef CSKIPLIST_MAP_TYPE_OFFSET
+#define CSKIPLIST_MAP_TYPE_OFFSET 2030
+#endif
+
+struct cskiplist_map;
+struct cskiplist_map_node;
+TOID_DECLARE(struct cskiplist_map, CSKIPLIST_MAP_TYPE_OFFSET + 0);
+TOID_DECLARE(struct cskiplist_map_node, CSKIPLIST_MAP_TYPE_OFFSET + 1);
+
+int cskiplist_map_check(PMEMobjpool *pop, TOID(struct cskiplist_map) map);
+int cskiplist_map_new(PMEMobjpool *pop, TOID(struct cskiplist_map) *map,
+	void *arg);
+int cskiplist_map_delete(PMEMobjpool *pop, TOID(struct cskiplist_map) *map);
+int cskiplist_map_init(PMEMobjpool *pop, TOID(struct cskiplist_map) map);
+int cskiplist_map_insert(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+		uint64_t key, PMEMoid value);
+int cskiplist_map_insert_new(PMEMobjpool *pop,
+		TOID(struct cskiplist_map) map, uint64_t key, size_t size,
+		unsigned type_num,
+		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
+		void *arg);
+PMEMoid cskiplist_map_remove(PMEMobjpool *pop,
+		TOID(struct cskiplist_map) map, uint64_t key);
+int cskiplist_map_remove_free(PMEMobjpool *pop,
+		TOID(struct cskiplist_map) map, uint64_t key);
+int cskiplist_map_clear(PMEMobjpool *pop, TOID(struct cskiplist_map) map);
+PMEMoid cskiplist_map_get(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+		uint64_t key);
+int cskiplist_map_lookup(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+		uint64_t key);
+int cskiplist_map_foreach(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int cskiplist_map_range(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int cskiplist_map_seek(PMEMobjpool *pop, TOID(struct cskiplist_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value);
+int cskiplist_map_is_empty(PMEMobjpool *pop, TOID(struct cskiplist_map) map);
+
+#endif /* CSKIPLIST_MAP_H */
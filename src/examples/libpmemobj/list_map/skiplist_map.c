@@ -303,6 +303,55 @@ skiplist_map_foreach(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
 	return 0;
 }
 
+/*
+ * skiplist_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ */
+int
+skiplist_map_range(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	TOID(struct skiplist_map_node) path[SKIPLIST_LEVELS_NUM];
+
+	if (min > max)
+		return 0;
+
+	skiplist_map_find(min, map, path);
+	for (TOID(struct skiplist_map_node) next = D_RO(path[0])->next[0];
+			!TOID_EQUALS(next, NULL_NODE) &&
+			D_RO(next)->entry.key <= max;
+			next = D_RO(next)->next[0]) {
+		int ret = cb(D_RO(next)->entry.key,
+				D_RO(next)->entry.value, arg);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * skiplist_map_seek -- finds the smallest key that is not less than the given
+ *	one
+ */
+int
+skiplist_map_seek(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct skiplist_map_node) path[SKIPLIST_LEVELS_NUM], next;
+
+	skiplist_map_find(key, map, path);
+	next = D_RO(path[0])->next[0];
+	if (TOID_EQUALS(next, NULL_NODE))
+		return 0;
+
+	*found = D_RO(next)->entry.key;
+	*value = D_RO(next)->entry.value;
+
+	return 1;
+}
+
 /*
  * skiplist_map_is_empty -- checks whether the list map is empty
  */
@@ -68,6 +68,11 @@ int skiplist_map_lookup(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
 		uint64_t key);
 int skiplist_map_foreach(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
 	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int skiplist_map_range(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int skiplist_map_seek(PMEMobjpool *pop, TOID(struct skiplist_map_node) map,
+	uint64_t key, uint64_t *found, PMEMoid *value);
 int skiplist_map_is_empty(PMEMobjpool *pop, TOID(struct skiplist_map_node) map);
 
 #endif /* SKIPLIST_MAP_H */
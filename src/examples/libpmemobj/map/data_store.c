@@ -45,6 +45,7 @@
 #include "map_ctree.h"
 #include "map_btree.h"
 #include "map_rbtree.h"
+#include "map_bptree.h"
 #include "map_hashmap_atomic.h"
 #include "map_hashmap_tx.h"
 #include "map_skiplist.h"
@@ -112,6 +113,8 @@ parse_map_type(const char *type)
 		return MAP_BTREE;
 	else if (strcmp(type, "rbtree") == 0)
 		return MAP_RBTREE;
+	else if (strcmp(type, "bptree") == 0)
+		return MAP_BPTREE;
 	else if (strcmp(type, "hashmap_atomic") == 0)
 		return MAP_HASHMAP_ATOMIC;
 	else if (strcmp(type, "hashmap_tx") == 0)
@@ -125,7 +128,7 @@ parse_map_type(const char *type)
 int main(int argc, const char *argv[]) {
 	if (argc < 3) {
 		printf("usage: %s "
-			"<ctree|btree|rbtree|hashmap_atomic|"
+			"<ctree|btree|rbtree|bptree|hashmap_atomic|"
 			"hashmap_tx|skiplist> file-name [nops]\n", argv[0]);
 		return 1;
 	}
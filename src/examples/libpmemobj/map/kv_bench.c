@@ -0,0 +1,227 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kv_bench.c -- throughput benchmark of the kv_server
+ *
+ * Each thread opens its own connection and keeps a fixed number of requests
+ * in flight (the pipeline depth), sending a new batch of requests whenever
+ * the responses to the previous one arrive.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEY_SPACE 100000
+#define MAX_MSG_LEN 64
+#define RECV_BUF_LEN (64 * 1024)
+
+struct kv_bench_args {
+	struct sockaddr_in addr;
+	unsigned ops; /* requests per thread */
+	unsigned depth; /* pipeline depth */
+	unsigned get_ratio; /* percentage of GET requests */
+	unsigned seed;
+	int ret;
+};
+
+/*
+ * kv_bench_send -- (internal) writes the whole buffer to the socket
+ */
+static int
+kv_bench_send(int fd, const char *buf, size_t len)
+{
+	while (len != 0) {
+		ssize_t ret = send(fd, buf, len, 0);
+		if (ret <= 0)
+			return -1;
+
+		buf += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/*
+ * kv_bench_recv -- (internal) waits for the given number of responses
+ */
+static int
+kv_bench_recv(int fd, char *buf, unsigned nresp)
+{
+	while (nresp != 0) {
+		ssize_t ret = recv(fd, buf, RECV_BUF_LEN, 0);
+		if (ret <= 0)
+			return -1;
+
+		for (char *c = buf; c != buf + ret; ++c)
+			if (*c == '\n')
+				nresp--;
+	}
+
+	return 0;
+}
+
+/*
+ * kv_bench_worker -- sends the requests of a single connection
+ */
+static void *
+kv_bench_worker(void *arg)
+{
+	struct kv_bench_args *args = arg;
+	args->ret = -1;
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&args->addr,
+			sizeof(args->addr)) != 0) {
+		perror("connect");
+		return NULL;
+	}
+
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	char *msgs = malloc((size_t)args->depth * MAX_MSG_LEN);
+	char *resp = malloc(RECV_BUF_LEN);
+	if (msgs == NULL || resp == NULL) {
+		perror("malloc");
+		goto out;
+	}
+
+	unsigned seed = args->seed;
+	for (unsigned done = 0; done < args->ops; ) {
+		unsigned n = args->ops - done < args->depth ?
+			args->ops - done : args->depth;
+
+		size_t len = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			unsigned key = (unsigned)rand_r(&seed) % KEY_SPACE;
+			if ((unsigned)rand_r(&seed) % 100 < args->get_ratio)
+				len += (size_t)sprintf(msgs + len,
+					"GET key%u\n", key);
+			else
+				len += (size_t)sprintf(msgs + len,
+					"INSERT key%u value%u\n", key, done);
+		}
+
+		if (kv_bench_send(fd, msgs, len) ||
+				kv_bench_recv(fd, resp, n)) {
+			fprintf(stderr, "connection lost\n");
+			goto out;
+		}
+
+		done += n;
+	}
+
+	kv_bench_send(fd, "BYE\n", 4);
+	args->ret = 0;
+
+out:
+	free(msgs);
+	free(resp);
+	close(fd);
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 4) {
+		printf("usage: %s host port threads [ops-per-thread] "
+				"[pipeline-depth] [get-percentage]\n", argv[0]);
+		return 1;
+	}
+
+	struct kv_bench_args proto;
+	memset(&proto, 0, sizeof(proto));
+	proto.addr.sin_family = AF_INET;
+	proto.addr.sin_port = htons((uint16_t)atoi(argv[2]));
+	if (inet_pton(AF_INET, argv[1], &proto.addr.sin_addr) != 1) {
+		fprintf(stderr, "invalid address: %s\n", argv[1]);
+		return 1;
+	}
+
+	unsigned nthreads = (unsigned)atoi(argv[3]);
+	proto.ops = argc > 4 ? (unsigned)atoi(argv[4]) : 100000;
+	proto.depth = argc > 5 ? (unsigned)atoi(argv[5]) : 32;
+	proto.get_ratio = argc > 6 ? (unsigned)atoi(argv[6]) : 90;
+
+	if (nthreads == 0 || proto.depth == 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+	struct kv_bench_args *args = malloc(nthreads * sizeof(*args));
+	if (threads == NULL || args == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (unsigned i = 0; i < nthreads; ++i) {
+		args[i] = proto;
+		args[i].seed = i;
+		pthread_create(&threads[i], NULL, kv_bench_worker, &args[i]);
+	}
+
+	int ret = 0;
+	for (unsigned i = 0; i < nthreads; ++i) {
+		pthread_join(threads[i], NULL);
+		ret |= args[i].ret;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double secs = (double)(end.tv_sec - start.tv_sec) +
+		(double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	double total = (double)nthreads * proto.ops;
+
+	printf("%u threads, depth %u, %u%% gets: %.0f ops/s\n",
+		nthreads, proto.depth, proto.get_ratio, total / secs);
+
+	free(threads);
+	free(args);
+
+	return ret ? 1 : 0;
+}
@@ -32,13 +32,26 @@
 
 /*
  * kv_server.c -- persistent tcp key-value store server
+ *
+ * The server runs one event loop per thread, all of them accepting the
+ * connections from the same listening socket. The keys are spread over
+ * a number of maps (shards), each protected by its own lock.
+ *
+ * All the complete messages received by a single read from a client are
+ * handled as a batch: the shards used by the batch are locked in ascending
+ * order, the modifications are made in a single transaction and all the
+ * responses are sent by a single write, straight from the persistent values.
  */
 
 #include <uv.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <unistd.h>
 
 #include "libpmemobj.h"
@@ -47,6 +60,7 @@
 #include "map_ctree.h"
 #include "map_btree.h"
 #include "map_rbtree.h"
+#include "map_bptree.h"
 #include "map_hashmap_atomic.h"
 #include "map_hashmap_tx.h"
 #include "map_skiplist.h"
@@ -55,11 +69,18 @@
 
 #define COUNT_OF(x) (sizeof(x) / sizeof(0[x]))
 
-POBJ_LAYOUT_BEGIN(kv_server);
-POBJ_LAYOUT_ROOT(kv_server, struct root);
-POBJ_LAYOUT_TOID(kv_server, struct map_value);
-POBJ_LAYOUT_TOID(kv_server, uint64_t);
-POBJ_LAYOUT_END(kv_server);
+POBJ_LAYOUT_BEGIN(kv_server_sharded);
+POBJ_LAYOUT_ROOT(kv_server_sharded, struct root);
+POBJ_LAYOUT_TOID(kv_server_sharded, struct map_value);
+POBJ_LAYOUT_TOID(kv_server_sharded, uint64_t);
+POBJ_LAYOUT_END(kv_server_sharded);
+
+/* number of the maps the keys are spread over */
+#define KV_SHARD_BITS 4
+#define KV_SHARDS (1 << KV_SHARD_BITS)
+
+/* maximum number of the messages handled in a single transaction */
+#define KV_BATCH_MAX 64
 
 struct map_value {
 	uint64_t len;
@@ -67,29 +88,71 @@ struct map_value {
 };
 
 struct root {
-	TOID(struct map) map;
+	TOID(struct map) shards[KV_SHARDS];
 };
 
 static struct map_ctx *mapc;
 static PMEMobjpool *pop;
-static TOID(struct map) map;
+static TOID(struct map) shards[KV_SHARDS];
+static pthread_rwlock_t shard_locks[KV_SHARDS];
+
+#define MAX_READ_LEN (64 * 1024) /* 64 kilobytes */
 
-uv_tcp_t server;
-uv_loop_t *loop;
+/*
+ * kv_worker -- a thread with its own event loop
+ */
+struct kv_worker {
+	uv_loop_t loop;
+	uv_tcp_t server;
+	uv_async_t stop; /* signaled by the KILL message */
+	pthread_t thread;
+	char read_buf[MAX_READ_LEN]; /* shared by all the clients of the loop */
+};
 
-typedef int (*msg_handler)(uv_stream_t *client, const char *msg, size_t len);
+static struct kv_worker *workers;
+static unsigned nworkers;
 
 struct write_req {
 	uv_write_t req;
 	uv_buf_t buf;
+	char data[];
 };
 
 struct client_data {
-	char *buf; /* current message, always NULL terminated */
+	char *buf; /* the incomplete message from the previous read */
 	size_t buf_len; /* sizeof(buf) */
 	size_t len; /* actual length of the message (while parsing) */
 };
 
+/* shard lock modes */
+enum kv_lock {
+	KV_LOCK_NONE,
+	KV_LOCK_READ,
+	KV_LOCK_WRITE,
+};
+
+/*
+ * kv_request -- a single client message of a batch
+ */
+struct kv_request {
+	enum kv_cmsg cmsg; /* MAX_CMSG for an unknown message */
+	const char *msg; /* points into the read or the client buffer */
+	size_t len;
+	uint64_t key;
+	unsigned shard;
+};
+
+/*
+ * kv_batch -- the messages handled together and their responses
+ */
+struct kv_batch {
+	struct kv_request reqs[KV_BATCH_MAX];
+	uv_buf_t resp[KV_BATCH_MAX];
+	unsigned n;
+	int writes; /* the batch modifies the maps */
+	enum kv_lock locks[KV_SHARDS];
+};
+
 /*
  * djb2_hash -- string hashing function by Dan Bernstein
  */
@@ -114,8 +177,8 @@ write_done_cb(uv_write_t *req, int status)
 	struct write_req *wr = (struct write_req *)req;
 	free(wr);
 
-	if (status == -1) {
-		printf("response failed");
+	if (status < 0) {
+		printf("response failed\n");
 	}
 }
 
@@ -132,32 +195,19 @@ client_close_cb(uv_handle_t *handle)
 }
 
 /*
- * response_write -- response writing helper
+ * resp_msg_buf -- returns the buffer of a predefined response
  */
-static void
-response_write(uv_stream_t *client, char *resp, size_t len)
+static uv_buf_t
+resp_msg_buf(enum resp_messages msg)
 {
-	struct write_req *wr = malloc(sizeof(struct write_req));
-	assert(wr != NULL);
-
-	wr->buf = uv_buf_init(resp, len);
-	uv_write(&wr->req, client, &wr->buf, 1, write_done_cb);
-}
-
-/*
- * response_msg -- predefined message writing helper
- */
-static void
-response_msg(uv_stream_t *client, enum resp_messages msg)
-{
-	response_write(client, (char *)resp_msg[msg], strlen(resp_msg[msg]));
+	return uv_buf_init((char *)resp_msg[msg], strlen(resp_msg[msg]));
 }
 
 /*
  * cmsg_insert_handler -- handler of INSERT client message
  */
-static int
-cmsg_insert_handler(uv_stream_t *client, const char *msg, size_t len)
+static uv_buf_t
+cmsg_insert_handler(struct kv_request *req)
 {
 	int result = 0;
 	TX_BEGIN(pop) {
@@ -166,149 +216,273 @@ cmsg_insert_handler(uv_stream_t *client, const char *msg, size_t len)
 		 * a length of the message.
 		 */
 		TOID(struct map_value) val = TX_ZALLOC(struct map_value,
-			sizeof(struct map_value) + len);
+			sizeof(struct map_value) + req->len);
 
-		char key[MAX_KEY_LEN];
-		int ret = sscanf(msg, "INSERT %254s %s\n", key, D_RW(val)->buf);
-		assert(ret == 2);
+		int ret = sscanf(req->msg, "INSERT %*s %s\n", D_RW(val)->buf);
+		assert(ret == 1);
 
-		D_RW(val)->len = len;
+		D_RW(val)->len = req->len;
 
 		/* properly terminate the value */
 		D_RW(val)->buf[strlen(D_RO(val)->buf)] = '\n';
 
-		map_insert(mapc, map, djb2_hash(key), val.oid);
+		map_insert(mapc, shards[req->shard], req->key, val.oid);
 	} TX_ONABORT {
 		result = 1;
 	} TX_END
 
-	response_msg(client, result);
-
-	return 0;
+	return resp_msg_buf(result);
 }
 
 /*
  * cmsg_remove_handler -- handler of REMOVE client message
  */
-static int
-cmsg_remove_handler(uv_stream_t *client, const char *msg, size_t len)
+static uv_buf_t
+cmsg_remove_handler(struct kv_request *req)
 {
-	char key[MAX_KEY_LEN] = {0};
-	int ret = sscanf(msg, "REMOVE %s\n", key);
-	assert(ret == 1);
+	int result = map_remove_free(mapc, shards[req->shard], req->key);
 
-	int result = map_remove_free(mapc, map, djb2_hash(key));
+	return resp_msg_buf(result);
+}
 
-	response_msg(client, result);
+/*
+ * cmsg_get_handler -- handler of GET client message
+ *
+ * The response points straight to the persistent value, which is valid for
+ * as long as the shard is locked.
+ */
+static uv_buf_t
+cmsg_get_handler(struct kv_request *req)
+{
+	TOID(struct map_value) value;
+	TOID_ASSIGN(value, map_get(mapc, shards[req->shard], req->key));
 
-	return 0;
+	if (TOID_IS_NULL(value))
+		return resp_msg_buf(RESP_MSG_NULL);
+
+	return uv_buf_init(D_RW(value)->buf, D_RO(value)->len);
 }
 
+typedef uv_buf_t (*msg_handler)(struct kv_request *req);
+
+/* kv protocol implementation, BYE and KILL are handled by the connection */
+static msg_handler protocol_impl[MAX_CMSG] = {
+	cmsg_insert_handler,
+	cmsg_remove_handler,
+	cmsg_get_handler,
+	NULL,
+	NULL
+};
+
 /*
- * cmsg_get_handler -- handler of GET client message
+ * kv_batch_add -- parses the message and appends it to the batch
  */
-static int
-cmsg_get_handler(uv_stream_t *client, const char *msg, size_t len)
+static enum kv_cmsg
+kv_batch_add(struct kv_batch *b, const char *msg, size_t len)
 {
+	struct kv_request *req = &b->reqs[b->n++];
+	req->msg = msg;
+	req->len = len;
+
+	int i;
+	for (i = 0; i < MAX_CMSG; ++i)
+		if (strncmp(kv_cmsg_token[i], msg,
+			strlen(kv_cmsg_token[i])) == 0)
+			break;
+
+	req->cmsg = (enum kv_cmsg)i;
+	if (i == MAX_CMSG || protocol_impl[i] == NULL)
+		return req->cmsg;
+
 	char key[MAX_KEY_LEN];
-	int ret = sscanf(msg, "GET %s\n", key);
+	int ret = sscanf(msg, "%*s %254s", key);
 	assert(ret == 1);
 
-	TOID(struct map_value) value;
-	TOID_ASSIGN(value, map_get(mapc, map, djb2_hash(key)));
+	/*
+	 * The shard is chosen by the top bits of the hash, the maps
+	 * themselves mostly use the bottom ones.
+	 */
+	req->key = djb2_hash(key);
+	req->shard = (unsigned)(req->key >> (32 - KV_SHARD_BITS));
 
-	if (TOID_IS_NULL(value)) {
-		response_msg(client, RESP_MSG_NULL);
-	} else {
-		response_write(client, D_RW(value)->buf, D_RO(value)->len);
+	enum kv_lock lock = KV_LOCK_READ;
+	if (req->cmsg != CMSG_GET) {
+		lock = KV_LOCK_WRITE;
+		b->writes = 1;
 	}
 
-	return 0;
+	if (b->locks[req->shard] < lock)
+		b->locks[req->shard] = lock;
+
+	return req->cmsg;
 }
 
 /*
- * cmsg_bye_handler -- handler of BYE client message
+ * kv_batch_exec -- (internal) executes the request
  */
-static int
-cmsg_bye_handler(uv_stream_t *client, const char *msg, size_t len)
+static void
+kv_batch_exec(struct kv_batch *b, unsigned i)
 {
-	uv_close((uv_handle_t *)client, client_close_cb);
+	struct kv_request *req = &b->reqs[i];
 
-	return 0;
+	if (req->cmsg == MAX_CMSG || protocol_impl[req->cmsg] == NULL)
+		b->resp[i] = resp_msg_buf(RESP_MSG_UNKNOWN);
+	else
+		b->resp[i] = protocol_impl[req->cmsg](req);
 }
 
 /*
- * cmsg_bye_handler -- handler of KILL client message
+ * kv_batch_respond -- (internal) sends the responses of the batch
+ *
+ * The responses are written directly from the persistent values, while the
+ * shards are still locked. Only the part which can't be written right away
+ * is copied, to be sent once the socket is writable.
  */
-static int
-cmsg_kill_handler(uv_stream_t *client, const char *msg, size_t len)
+static void
+kv_batch_respond(uv_stream_t *client, struct kv_batch *b)
 {
-	uv_close((uv_handle_t *)client, client_close_cb);
-	uv_close((uv_handle_t *)&server, NULL);
+	size_t total = 0;
+	for (unsigned i = 0; i < b->n; ++i)
+		total += b->resp[i].len;
 
-	return 0;
-}
+	int ret = uv_try_write(client, b->resp, b->n);
+	if (ret < 0 && ret != UV_EAGAIN)
+		return;
 
-/* kv protocol implementation */
-msg_handler protocol_impl[MAX_CMSG] = {
-	cmsg_insert_handler,
-	cmsg_remove_handler,
-	cmsg_get_handler,
-	cmsg_bye_handler,
-	cmsg_kill_handler
-};
+	size_t written = ret < 0 ? 0 : (size_t)ret;
+	if (written == total)
+		return;
+
+	struct write_req *wr = malloc(sizeof(struct write_req) +
+			total - written);
+	assert(wr != NULL);
+
+	size_t len = 0;
+	for (unsigned i = 0; i < b->n; ++i) {
+		size_t skip = written < b->resp[i].len ?
+			written : b->resp[i].len;
+		written -= skip;
+
+		memcpy(wr->data + len, b->resp[i].base + skip,
+				b->resp[i].len - skip);
+		len += b->resp[i].len - skip;
+	}
+
+	wr->buf = uv_buf_init(wr->data, len);
+	uv_write(&wr->req, client, &wr->buf, 1, write_done_cb);
+}
 
 /*
- * cmsg_handle -- handles current client message
+ * kv_batch_run -- handles all the messages of the batch and resets it
+ *
+ * If the transaction of the whole batch aborts, the requests are repeated
+ * one by one, so that each gets its own result.
  */
-static int
-cmsg_handle(uv_stream_t *client, struct client_data *data)
+static void
+kv_batch_run(uv_stream_t *client, struct kv_batch *b)
 {
-	int ret = 0;
-	int i;
-	for (i = 0; i < MAX_CMSG; ++i)
-		if (strncmp(kv_cmsg_token[i], data->buf,
-			strlen(kv_cmsg_token[i])) == 0)
-			break;
+	if (b->n == 0)
+		return;
 
-	if (i == MAX_CMSG) {
-		response_msg(client, RESP_MSG_UNKNOWN);
-	} else {
-		ret = protocol_impl[i](client, data->buf, data->len);
+	for (unsigned s = 0; s < KV_SHARDS; ++s) {
+		if (b->locks[s] == KV_LOCK_READ)
+			pthread_rwlock_rdlock(&shard_locks[s]);
+		else if (b->locks[s] == KV_LOCK_WRITE)
+			pthread_rwlock_wrlock(&shard_locks[s]);
+	}
+
+	int failed = 0;
+	if (b->writes) {
+		TX_BEGIN(pop) {
+			for (unsigned i = 0; i < b->n; ++i)
+				kv_batch_exec(b, i);
+		} TX_ONABORT {
+			failed = 1;
+		} TX_END
+	}
+
+	if (!b->writes || failed) {
+		for (unsigned i = 0; i < b->n; ++i)
+			kv_batch_exec(b, i);
+	}
+
+	kv_batch_respond(client, b);
+
+	for (unsigned s = 0; s < KV_SHARDS; ++s) {
+		if (b->locks[s] != KV_LOCK_NONE)
+			pthread_rwlock_unlock(&shard_locks[s]);
 	}
 
-	data->len = 0; /* reset the message length */
+	b->n = 0;
+	b->writes = 0;
+	memset(b->locks, 0, sizeof(b->locks));
+}
+
+/*
+ * kv_stop_cb -- stops accepting new connections, once all the clients of
+ *	the loop disconnect it quits
+ */
+static void
+kv_stop_cb(uv_async_t *handle)
+{
+	struct kv_worker *w = handle->data;
 
-	return ret;
+	uv_close((uv_handle_t *)&w->server, NULL);
+	uv_close((uv_handle_t *)&w->stop, NULL);
 }
 
 /*
  * cmsg_handle_stream -- handle incoming tcp stream from clients
+ *
+ * A single read operation can contain zero or more operations, so this
+ * has to be handled appropriately. Client messages are terminated by
+ * newline character. A message which isn't complete yet is kept in the
+ * client buffer until the rest of it arrives.
  */
 static int
 cmsg_handle_stream(uv_stream_t *client, struct client_data *data,
-	const char *buf, ssize_t nread)
+	const char *buf, size_t nread)
 {
+	struct kv_batch batch = {.n = 0};
+	enum kv_cmsg cmsg = MAX_CMSG;
 	char *last;
-	int ret;
-	size_t len;
 
-	/*
-	 * A single read operation can contain zero or more operations, so this
-	 * has to be handled appropriately. Client messages are terminated by
-	 * newline character.
-	 */
 	while ((last = memchr(buf, '\n', nread)) != NULL) {
-		len = last - buf + 1;
+		const char *msg = buf;
+		size_t len = (size_t)(last - buf) + 1;
 		nread -= len;
-		assert(data->len + len <= data->buf_len);
-		memcpy(data->buf + data->len, buf, len);
-		data->len += len;
+		buf = last + 1;
 
-		if ((ret = cmsg_handle(client, data)) != 0)
-			return ret;
+		if (data->len != 0) {
+			/* the rest of the message from the previous read */
+			assert(data->len + len <= data->buf_len);
+			memcpy(data->buf + data->len, msg, len);
+			msg = data->buf;
+			len += data->len;
+			data->len = 0;
+		}
 
-		buf = last + 1;
+		cmsg = kv_batch_add(&batch, msg, len);
+		if (cmsg == CMSG_BYE || cmsg == CMSG_KILL) {
+			batch.n--;
+			break;
+		}
+
+		if (batch.n == KV_BATCH_MAX)
+			kv_batch_run(client, &batch);
+	}
+
+	kv_batch_run(client, &batch);
+
+	if (cmsg == CMSG_BYE || cmsg == CMSG_KILL) {
+		uv_close((uv_handle_t *)client, client_close_cb);
+
+		if (cmsg == CMSG_KILL) {
+			for (unsigned i = 0; i < nworkers; ++i)
+				uv_async_send(&workers[i].stop);
+		}
+
+		return 0;
 	}
 
 	if (nread != 0) {
@@ -319,16 +493,16 @@ cmsg_handle_stream(uv_stream_t *client, struct client_data *data,
 	return 0;
 }
 
-static uv_buf_t msg_buf = {0};
-
 /*
  * get_read_buf_cb -- returns buffer for incoming client message
  */
-void
+static void
 get_read_buf_cb(uv_handle_t *handle, size_t size, uv_buf_t *buf)
 {
-	buf->base = msg_buf.base;
-	buf->len = msg_buf.len;
+	struct kv_worker *w = handle->loop->data;
+
+	buf->base = w->read_buf;
+	buf->len = sizeof(w->read_buf);
 }
 
 /*
@@ -337,7 +511,10 @@ get_read_buf_cb(uv_handle_t *handle, size_t size, uv_buf_t *buf)
 static void
 read_cb(uv_stream_t *client, ssize_t nread, const uv_buf_t *buf)
 {
-	if (nread <= 0) {
+	if (nread == 0)
+		return;
+
+	if (nread < 0) {
 		printf("client connection closed\n");
 		uv_close((uv_handle_t *)client, client_close_cb);
 
@@ -346,18 +523,20 @@ read_cb(uv_stream_t *client, ssize_t nread, const uv_buf_t *buf)
 
 	struct client_data *d = client->data;
 
-	if (d->buf_len < (d->len + nread + 1)) {
-		char *cbuf = realloc(d->buf, d->buf_len + nread + 1);
+	if (d->buf_len < (d->len + (size_t)nread + 1)) {
+		char *cbuf = realloc(d->buf, d->len + (size_t)nread + 1);
 		assert(cbuf != NULL);
 
 		/* zero only the new memory */
-		memset(cbuf + d->buf_len, 0, nread + 1);
+		memset(cbuf + d->buf_len, 0, d->len + (size_t)nread + 1 -
+				d->buf_len);
 
-		d->buf_len += nread + 1;
+		d->buf_len = d->len + (size_t)nread + 1;
 		d->buf = cbuf;
 	}
 
-	if (cmsg_handle_stream(client, client->data, buf->base, nread)) {
+	if (cmsg_handle_stream(client, client->data, buf->base,
+			(size_t)nread)) {
 		printf("client disconnect\n");
 		uv_close((uv_handle_t *)client, client_close_cb);
 	}
@@ -373,22 +552,93 @@ connection_cb(uv_stream_t *server, int status)
 		printf("client connect error\n");
 		return;
 	}
-	printf("new client\n");
 
 	uv_tcp_t *client = malloc(sizeof(uv_tcp_t));
 	assert(client != NULL);
 	client->data = calloc(1, sizeof(struct client_data));
 	assert(client->data != NULL);
 
-	uv_tcp_init(loop, client);
+	uv_tcp_init(server->loop, client);
 
+	/* the other loops may have accepted the connection first */
 	if (uv_accept(server, (uv_stream_t *)client) == 0) {
+		printf("new client\n");
+		uv_tcp_nodelay(client, 1);
 		uv_read_start((uv_stream_t *)client, get_read_buf_cb, read_cb);
 	} else {
 		uv_close((uv_handle_t *)client, client_close_cb);
 	}
 }
 
+/*
+ * kv_worker_run -- runs the event loop of the worker thread
+ */
+static void *
+kv_worker_run(void *arg)
+{
+	struct kv_worker *w = arg;
+
+	int ret = uv_run(&w->loop, UV_RUN_DEFAULT);
+	assert(ret == 0);
+
+	return NULL;
+}
+
+/*
+ * kv_worker_init -- initializes the event loop of the worker, which listens
+ *	on its own duplicate of the listening socket
+ */
+static int
+kv_worker_init(struct kv_worker *w, int fd)
+{
+	if (uv_loop_init(&w->loop) != 0)
+		return -1;
+
+	w->loop.data = w;
+	w->stop.data = w;
+
+	uv_tcp_init(&w->loop, &w->server);
+	uv_async_init(&w->loop, &w->stop, kv_stop_cb);
+
+	int wfd = dup(fd);
+	if (wfd < 0 || uv_tcp_open(&w->server, wfd) != 0 ||
+			uv_listen((uv_stream_t *)&w->server, SOMAXCONN,
+				connection_cb) != 0) {
+		fprintf(stderr, "failed to listen on the socket\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * kv_listen -- creates the listening socket shared by all the workers
+ */
+static int
+kv_listen(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in bind_addr;
+	uv_ip4_addr("0.0.0.0", port, &bind_addr);
+
+	if (bind(fd, (const struct sockaddr *)&bind_addr,
+			sizeof(bind_addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 static const struct {
 	struct map_ops *ops;
 	const char *name;
@@ -398,6 +648,7 @@ static const struct {
 	{MAP_CTREE, "ctree"},
 	{MAP_BTREE, "btree"},
 	{MAP_RBTREE, "rbtree"},
+	{MAP_BPTREE, "bptree"},
 	{MAP_SKIPLIST, "skiplist"}
 };
 
@@ -416,14 +667,13 @@ get_map_ops_by_string(const char *type)
 
 #define KV_SIZE	(PMEMOBJ_MIN_POOL)
 
-#define MAX_READ_LEN (64 * 1024) /* 64 kilobytes */
-
 int
 main(int argc, char *argv[])
 {
 	if (argc < 4) {
 		printf("usage: %s hashmap_tx|hashmap_atomic|ctree|btree|"
-				"rbtree|skiplist file-name port\n", argv[0]);
+				"rbtree|bptree|skiplist file-name port "
+				"[threads]\n", argv[0]);
 		return 1;
 	}
 
@@ -431,14 +681,16 @@ main(int argc, char *argv[])
 	const char *type = argv[1];
 	int port = atoi(argv[3]);
 
-	/* use only a single buffer for all incoming data */
-	void *read_buf = malloc(MAX_READ_LEN);
-	assert(read_buf != NULL);
-
-	msg_buf = uv_buf_init(read_buf, MAX_READ_LEN);
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nworkers = argc > 4 ? (unsigned)atoi(argv[4]) :
+		(ncpus > 0 ? (unsigned)ncpus : 1);
+	if (nworkers == 0) {
+		fprintf(stderr, "invalid number of threads\n");
+		return 1;
+	}
 
 	if (access(path, F_OK) != 0) {
-		pop = pmemobj_create(path, POBJ_LAYOUT_NAME(kv_server),
+		pop = pmemobj_create(path, POBJ_LAYOUT_NAME(kv_server_sharded),
 				KV_SIZE, 0666);
 		if (pop == NULL) {
 			fprintf(stderr, "failed to create pool: %s\n",
@@ -446,7 +698,7 @@ main(int argc, char *argv[])
 			return 1;
 		}
 	} else {
-		pop = pmemobj_open(path, POBJ_LAYOUT_NAME(kv_server));
+		pop = pmemobj_open(path, POBJ_LAYOUT_NAME(kv_server_sharded));
 		if (pop == NULL) {
 			fprintf(stderr, "failed to open pool: %s\n",
 					pmemobj_errormsg());
@@ -462,36 +714,50 @@ main(int argc, char *argv[])
 		return 1;
 	}
 
-	/* initialize the actual map */
+	/* initialize the actual maps */
 	TOID(struct root) root = POBJ_ROOT(pop, struct root);
-	if (TOID_IS_NULL(D_RO(root)->map)) {
-		/* create new if it doesn't exist (a fresh pool) */
-		map_new(mapc, &D_RW(root)->map, NULL);
+	for (int i = 0; i < KV_SHARDS; ++i) {
+		if (TOID_IS_NULL(D_RO(root)->shards[i])) {
+			/* create new if it doesn't exist (a fresh pool) */
+			map_new(mapc, &D_RW(root)->shards[i], NULL);
+		}
+		shards[i] = D_RO(root)->shards[i];
+		pthread_rwlock_init(&shard_locks[i], NULL);
 	}
-	map = D_RO(root)->map;
-
-	loop = uv_default_loop();
 
 	/* tcp server initialization */
-	uv_tcp_init(loop, &server);
+	int fd = kv_listen(port);
+	assert(fd >= 0);
 
-	struct sockaddr_in bind_addr;
-	uv_ip4_addr("0.0.0.0", port, &bind_addr);
-	int ret = uv_tcp_bind(&server, (const struct sockaddr *)&bind_addr, 0);
-	assert(ret == 0);
+	workers = calloc(nworkers, sizeof(struct kv_worker));
+	assert(workers != NULL);
 
-	ret = uv_listen((uv_stream_t *)&server, SOMAXCONN, connection_cb);
-	assert(ret == 0);
+	for (unsigned i = 0; i < nworkers; ++i) {
+		int ret = kv_worker_init(&workers[i], fd);
+		assert(ret == 0);
+	}
 
-	ret = uv_run(loop, UV_RUN_DEFAULT);
-	assert(ret == 0);
+	close(fd);
+
+	for (unsigned i = 0; i < nworkers; ++i) {
+		int ret = pthread_create(&workers[i].thread, NULL,
+				kv_worker_run, &workers[i]);
+		assert(ret == 0);
+	}
+
+	/* wait until the KILL message stops all the loops */
+	for (unsigned i = 0; i < nworkers; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		uv_loop_close(&workers[i].loop);
+	}
+
+	free(workers);
+
+	for (int i = 0; i < KV_SHARDS; ++i)
+		pthread_rwlock_destroy(&shard_locks[i]);
 
-	/* no more events in the loop, release resources and quit */
-	uv_loop_delete(loop);
 	map_ctx_free(mapc);
 	pmemobj_close(pop);
 
-	free(read_buf);
-
 	return 0;
 }
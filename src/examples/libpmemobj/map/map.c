@@ -141,6 +141,19 @@ map_insert_new(struct map_ctx *mapc, TOID(struct map) map,
 			type_num, constructor, arg);
 }
 
+/*
+ * map_bulk_load -- build an empty map from key value pairs sorted by key,
+ * the next callback returns non-zero as long as it provides a pair
+ */
+int
+map_bulk_load(struct map_ctx *mapc, TOID(struct map) map,
+		int (*next)(uint64_t *key, PMEMoid *value, void *arg),
+		void *arg)
+{
+	ABORT_NOT_IMPLEMENTED(mapc, bulk_load);
+	return mapc->ops->bulk_load(mapc->pop, map, next, arg);
+}
+
 /*
  * map_remove -- remove key value pair
  */
@@ -203,6 +216,34 @@ map_foreach(struct map_ctx *mapc, TOID(struct map) map,
 	return mapc->ops->foreach(mapc->pop, map, cb, arg);
 }
 
+/*
+ * map_range -- iterate in ascending key order through all key value pairs
+ * with keys from the [min, max] range, stops when the callback returns
+ * non-zero
+ */
+int
+map_range(struct map_ctx *mapc, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	ABORT_NOT_IMPLEMENTED(mapc, range);
+	return mapc->ops->range(mapc->pop, map, min, max, cb, arg);
+}
+
+/*
+ * map_seek -- find the smallest key not less than the given one, returns 1
+ * and sets found and value if there is such a key; seeking again from
+ * found + 1 moves the cursor to the next key
+ */
+int
+map_seek(struct map_ctx *mapc, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	ABORT_NOT_IMPLEMENTED(mapc, seek);
+	return mapc->ops->seek(mapc->pop, map, key, found, value);
+}
+
 /*
  * map_is_empty -- check if map is empty
  */
@@ -60,6 +60,9 @@ struct map_ops {
 		unsigned type_num,
 		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
 		void *arg);
+	int (*bulk_load)(PMEMobjpool *pop, TOID(struct map) map,
+			int (*next)(uint64_t *key, PMEMoid *value, void *arg),
+			void *arg);
 	PMEMoid (*remove)(PMEMobjpool *pop, TOID(struct map) map,
 			uint64_t key);
 	int (*remove_free)(PMEMobjpool *pop, TOID(struct map) map,
@@ -72,6 +75,12 @@ struct map_ops {
 	int (*foreach)(PMEMobjpool *pop, TOID(struct map) map,
 			int (*cb)(uint64_t key, PMEMoid value, void *arg),
 			void *arg);
+	int (*range)(PMEMobjpool *pop, TOID(struct map) map,
+			uint64_t min, uint64_t max,
+			int (*cb)(uint64_t key, PMEMoid value, void *arg),
+			void *arg);
+	int (*seek)(PMEMobjpool *pop, TOID(struct map) map,
+			uint64_t key, uint64_t *found, PMEMoid *value);
 	int (*is_empty)(PMEMobjpool *pop, TOID(struct map) map);
 	size_t (*count)(PMEMobjpool *pop, TOID(struct map) map);
 	int (*cmd)(PMEMobjpool *pop, TOID(struct map) map,
@@ -96,6 +105,9 @@ int map_insert_new(struct map_ctx *mapc, TOID(struct map) map,
 		unsigned type_num,
 		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
 		void *arg);
+int map_bulk_load(struct map_ctx *mapc, TOID(struct map) map,
+		int (*next)(uint64_t *key, PMEMoid *value, void *arg),
+		void *arg);
 PMEMoid map_remove(struct map_ctx *mapc, TOID(struct map) map, uint64_t key);
 int map_remove_free(struct map_ctx *mapc, TOID(struct map) map, uint64_t key);
 int map_clear(struct map_ctx *mapc, TOID(struct map) map);
@@ -104,6 +116,12 @@ int map_lookup(struct map_ctx *mapc, TOID(struct map) map, uint64_t key);
 int map_foreach(struct map_ctx *mapc, TOID(struct map) map,
 		int (*cb)(uint64_t key, PMEMoid value, void *arg),
 		void *arg);
+int map_range(struct map_ctx *mapc, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg);
+int map_seek(struct map_ctx *mapc, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value);
 int map_is_empty(struct map_ctx *mapc, TOID(struct map) map);
 size_t map_count(struct map_ctx *mapc, TOID(struct map) map);
 int map_cmd(struct map_ctx *mapc, TOID(struct map) map,
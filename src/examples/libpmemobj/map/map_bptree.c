@@ -0,0 +1,238 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * map_bptree.c -- common interface for maps
+ */
+
+#include <map.h>
+#include <bptree_map.h>
+
+/*
+ * map_bptree_check -- wrapper for bptree_map_check
+ */
+static int
+map_bptree_check(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_check(pop, bptree_map);
+}
+
+/*
+ * map_bptree_new -- wrapper for bptree_map_new
+ */
+static int
+map_bptree_new(PMEMobjpool *pop, TOID(struct map) *map, void *arg)
+{
+	TOID(struct bptree_map) *bptree_map =
+		(TOID(struct bptree_map) *)map;
+
+	return bptree_map_new(pop, bptree_map, arg);
+}
+
+/*
+ * map_bptree_delete -- wrapper for bptree_map_delete
+ */
+static int
+map_bptree_delete(PMEMobjpool *pop, TOID(struct map) *map)
+{
+	TOID(struct bptree_map) *bptree_map =
+		(TOID(struct bptree_map) *)map;
+
+	return bptree_map_delete(pop, bptree_map);
+}
+
+/*
+ * map_bptree_insert -- wrapper for bptree_map_insert
+ */
+static int
+map_bptree_insert(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, PMEMoid value)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_insert(pop, bptree_map, key, value);
+}
+
+/*
+ * map_bptree_insert_new -- wrapper for bptree_map_insert_new
+ */
+static int
+map_bptree_insert_new(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, size_t size,
+		unsigned type_num,
+		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
+		void *arg)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_insert_new(pop, bptree_map, key, size,
+			type_num, constructor, arg);
+}
+
+/*
+ * map_bptree_remove -- wrapper for bptree_map_remove
+ */
+static PMEMoid
+map_bptree_remove(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_remove(pop, bptree_map, key);
+}
+
+/*
+ * map_bptree_remove_free -- wrapper for bptree_map_remove_free
+ */
+static int
+map_bptree_remove_free(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_remove_free(pop, bptree_map, key);
+}
+
+/*
+ * map_bptree_clear -- wrapper for bptree_map_clear
+ */
+static int
+map_bptree_clear(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_clear(pop, bptree_map);
+}
+
+/*
+ * map_bptree_get -- wrapper for bptree_map_get
+ */
+static PMEMoid
+map_bptree_get(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_get(pop, bptree_map, key);
+}
+
+/*
+ * map_bptree_lookup -- wrapper for bptree_map_lookup
+ */
+static int
+map_bptree_lookup(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_lookup(pop, bptree_map, key);
+}
+
+/*
+ * map_bptree_foreach -- wrapper for bptree_map_foreach
+ */
+static int
+map_bptree_foreach(PMEMobjpool *pop, TOID(struct map) map,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_foreach(pop, bptree_map, cb, arg);
+}
+
+/*
+ * map_bptree_range -- wrapper for bptree_map_range
+ */
+static int
+map_bptree_range(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_range(pop, bptree_map, min, max, cb, arg);
+}
+
+/*
+ * map_bptree_seek -- wrapper for bptree_map_seek
+ */
+static int
+map_bptree_seek(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_seek(pop, bptree_map, key, found, value);
+}
+
+/*
+ * map_bptree_is_empty -- wrapper for bptree_map_is_empty
+ */
+static int
+map_bptree_is_empty(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct bptree_map) bptree_map;
+	TOID_ASSIGN(bptree_map, map.oid);
+
+	return bptree_map_is_empty(pop, bptree_map);
+}
+
+struct map_ops bptree_map_ops = {
+	.check		= map_bptree_check,
+	.new		= map_bptree_new,
+	.delete		= map_bptree_delete,
+	.init		= NULL,
+	.insert		= map_bptree_insert,
+	.insert_new	= map_bptree_insert_new,
+	.remove		= map_bptree_remove,
+	.remove_free	= map_bptree_remove_free,
+	.clear		= map_bptree_clear,
+	.get		= map_bptree_get,
+	.lookup		= map_bptree_lookup,
+	.is_empty	= map_bptree_is_empty,
+	.foreach	= map_bptree_foreach,
+	.range		= map_bptree_range,
+	.seek		= map_bptree_seek,
+	.count		= NULL,
+	.cmd		= NULL,
+};
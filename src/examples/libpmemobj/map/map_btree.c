@@ -103,6 +103,20 @@ map_btree_insert_new(PMEMobjpool *pop, TOID(struct map) map,
 			type_num, constructor, arg);
 }
 
+/*
+ * map_btree_bulk_load -- wrapper for btree_map_bulk_load
+ */
+static int
+map_btree_bulk_load(PMEMobjpool *pop, TOID(struct map) map,
+		int (*next)(uint64_t *key, PMEMoid *value, void *arg),
+		void *arg)
+{
+	TOID(struct btree_map) btree_map;
+	TOID_ASSIGN(btree_map, map.oid);
+
+	return btree_map_bulk_load(pop, btree_map, next, arg);
+}
+
 /*
  * map_btree_remove -- wrapper for btree_map_remove
  */
@@ -177,6 +191,34 @@ map_btree_foreach(PMEMobjpool *pop, TOID(struct map) map,
 	return btree_map_foreach(pop, btree_map, cb, arg);
 }
 
+/*
+ * map_btree_range -- wrapper for btree_map_range
+ */
+static int
+map_btree_range(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct btree_map) btree_map;
+	TOID_ASSIGN(btree_map, map.oid);
+
+	return btree_map_range(pop, btree_map, min, max, cb, arg);
+}
+
+/*
+ * map_btree_seek -- wrapper for btree_map_seek
+ */
+static int
+map_btree_seek(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct btree_map) btree_map;
+	TOID_ASSIGN(btree_map, map.oid);
+
+	return btree_map_seek(pop, btree_map, key, found, value);
+}
+
 /*
  * map_btree_is_empty -- wrapper for btree_map_is_empty
  */
@@ -196,6 +238,7 @@ struct map_ops btree_map_ops = {
 	.init		= NULL,
 	.insert		= map_btree_insert,
 	.insert_new	= map_btree_insert_new,
+	.bulk_load	= map_btree_bulk_load,
 	.remove		= map_btree_remove,
 	.remove_free	= map_btree_remove_free,
 	.clear		= map_btree_clear,
@@ -203,6 +246,8 @@ struct map_ops btree_map_ops = {
 	.lookup		= map_btree_lookup,
 	.is_empty	= map_btree_is_empty,
 	.foreach	= map_btree_foreach,
+	.range		= map_btree_range,
+	.seek		= map_btree_seek,
 	.count		= NULL,
 	.cmd		= NULL,
 };
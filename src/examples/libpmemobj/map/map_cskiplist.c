@@ -0,0 +1,250 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * map_cskiplist.c -- common interface for maps
+ */
+
+#include <map.h>
+#include <cskiplist_map.h>
+
+/*
+ * map_cskiplist_check -- wrapper for cskiplist_map_check
+ */
+static int
+map_cskiplist_check(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_check(pop, cskiplist_map);
+}
+
+/*
+ * map_cskiplist_new -- wrapper for cskiplist_map_new
+ */
+static int
+map_cskiplist_new(PMEMobjpool *pop, TOID(struct map) *map, void *arg)
+{
+	TOID(struct cskiplist_map) *cskiplist_map =
+		(TOID(struct cskiplist_map) *)map;
+
+	return cskiplist_map_new(pop, cskiplist_map, arg);
+}
+
+/*
+ * map_cskiplist_delete -- wrapper for cskiplist_map_delete
+ */
+static int
+map_cskiplist_delete(PMEMobjpool *pop, TOID(struct map) *map)
+{
+	TOID(struct cskiplist_map) *cskiplist_map =
+		(TOID(struct cskiplist_map) *)map;
+
+	return cskiplist_map_delete(pop, cskiplist_map);
+}
+
+/*
+ * map_cskiplist_init -- wrapper for cskiplist_map_init
+ */
+static int
+map_cskiplist_init(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_init(pop, cskiplist_map);
+}
+
+/*
+ * map_cskiplist_insert -- wrapper for cskiplist_map_insert
+ */
+static int
+map_cskiplist_insert(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, PMEMoid value)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_insert(pop, cskiplist_map, key, value);
+}
+
+/*
+ * map_cskiplist_insert_new -- wrapper for cskiplist_map_insert_new
+ */
+static int
+map_cskiplist_insert_new(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, size_t size,
+		unsigned type_num,
+		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
+		void *arg)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_insert_new(pop, cskiplist_map, key, size,
+			type_num, constructor, arg);
+}
+
+/*
+ * map_cskiplist_remove -- wrapper for cskiplist_map_remove
+ */
+static PMEMoid
+map_cskiplist_remove(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_remove(pop, cskiplist_map, key);
+}
+
+/*
+ * map_cskiplist_remove_free -- wrapper for cskiplist_map_remove_free
+ */
+static int
+map_cskiplist_remove_free(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_remove_free(pop, cskiplist_map, key);
+}
+
+/*
+ * map_cskiplist_clear -- wrapper for cskiplist_map_clear
+ */
+static int
+map_cskiplist_clear(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_clear(pop, cskiplist_map);
+}
+
+/*
+ * map_cskiplist_get -- wrapper for cskiplist_map_get
+ */
+static PMEMoid
+map_cskiplist_get(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_get(pop, cskiplist_map, key);
+}
+
+/*
+ * map_cskiplist_lookup -- wrapper for cskiplist_map_lookup
+ */
+static int
+map_cskiplist_lookup(PMEMobjpool *pop, TOID(struct map) map, uint64_t key)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_lookup(pop, cskiplist_map, key);
+}
+
+/*
+ * map_cskiplist_foreach -- wrapper for cskiplist_map_foreach
+ */
+static int
+map_cskiplist_foreach(PMEMobjpool *pop, TOID(struct map) map,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_foreach(pop, cskiplist_map, cb, arg);
+}
+
+/*
+ * map_cskiplist_range -- wrapper for cskiplist_map_range
+ */
+static int
+map_cskiplist_range(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_range(pop, cskiplist_map, min, max, cb, arg);
+}
+
+/*
+ * map_cskiplist_seek -- wrapper for cskiplist_map_seek
+ */
+static int
+map_cskiplist_seek(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_seek(pop, cskiplist_map, key, found, value);
+}
+
+/*
+ * map_cskiplist_is_empty -- wrapper for cskiplist_map_is_empty
+ */
+static int
+map_cskiplist_is_empty(PMEMobjpool *pop, TOID(struct map) map)
+{
+	TOID(struct cskiplist_map) cskiplist_map;
+	TOID_ASSIGN(cskiplist_map, map.oid);
+
+	return cskiplist_map_is_empty(pop, cskiplist_map);
+}
+
+struct map_ops cskiplist_map_ops = {
+	.check		= map_cskiplist_check,
+	.new		= map_cskiplist_new,
+	.delete		= map_cskiplist_delete,
+	.init		= map_cskiplist_init,
+	.insert		= map_cskiplist_insert,
+	.insert_new	= map_cskiplist_insert_new,
+	.remove		= map_cskiplist_remove,
+	.remove_free	= map_cskiplist_remove_free,
+	.clear		= map_cskiplist_clear,
+	.get		= map_cskiplist_get,
+	.lookup		= map_cskiplist_lookup,
+	.is_empty	= map_cskiplist_is_empty,
+	.foreach	= map_cskiplist_foreach,
+	.range		= map_cskiplist_range,
+	.seek		= map_cskiplist_seek,
+	.count		= NULL,
+	.cmd		= NULL,
+};
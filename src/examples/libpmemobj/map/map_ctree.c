@@ -103,6 +103,20 @@ map_ctree_insert_new(PMEMobjpool *pop, TOID(struct map) map,
 			type_num, constructor, arg);
 }
 
+/*
+ * map_ctree_bulk_load -- wrapper for ctree_map_bulk_load
+ */
+static int
+map_ctree_bulk_load(PMEMobjpool *pop, TOID(struct map) map,
+		int (*next)(uint64_t *key, PMEMoid *value, void *arg),
+		void *arg)
+{
+	TOID(struct ctree_map) ctree_map;
+	TOID_ASSIGN(ctree_map, map.oid);
+
+	return ctree_map_bulk_load(pop, ctree_map, next, arg);
+}
+
 /*
  * map_ctree_remove -- wrapper for ctree_map_remove
  */
@@ -177,6 +191,34 @@ map_ctree_foreach(PMEMobjpool *pop, TOID(struct map) map,
 	return ctree_map_foreach(pop, ctree_map, cb, arg);
 }
 
+/*
+ * map_ctree_range -- wrapper for ctree_map_range
+ */
+static int
+map_ctree_range(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct ctree_map) ctree_map;
+	TOID_ASSIGN(ctree_map, map.oid);
+
+	return ctree_map_range(pop, ctree_map, min, max, cb, arg);
+}
+
+/*
+ * map_ctree_seek -- wrapper for ctree_map_seek
+ */
+static int
+map_ctree_seek(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct ctree_map) ctree_map;
+	TOID_ASSIGN(ctree_map, map.oid);
+
+	return ctree_map_seek(pop, ctree_map, key, found, value);
+}
+
 /*
  * map_ctree_is_empty -- wrapper for ctree_map_is_empty
  */
@@ -196,6 +238,7 @@ struct map_ops ctree_map_ops = {
 	.init		= NULL,
 	.insert		= map_ctree_insert,
 	.insert_new	= map_ctree_insert_new,
+	.bulk_load	= map_ctree_bulk_load,
 	.remove		= map_ctree_remove,
 	.remove_free	= map_ctree_remove_free,
 	.clear		= map_ctree_clear,
@@ -203,6 +246,8 @@ struct map_ops ctree_map_ops = {
 	.lookup		= map_ctree_lookup,
 	.is_empty	= map_ctree_is_empty,
 	.foreach	= map_ctree_foreach,
+	.range		= map_ctree_range,
+	.seek		= map_ctree_seek,
 	.count		= NULL,
 	.cmd		= NULL,
 };
@@ -177,6 +177,34 @@ map_skiplist_foreach(PMEMobjpool *pop, TOID(struct map) map,
 	return skiplist_map_foreach(pop, skiplist_map, cb, arg);
 }
 
+/*
+ * map_skiplist_range -- wrapper for skiplist_map_range
+ */
+static int
+map_skiplist_range(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t min, uint64_t max,
+		int (*cb)(uint64_t key, PMEMoid value, void *arg),
+		void *arg)
+{
+	TOID(struct skiplist_map_node) skiplist_map;
+	TOID_ASSIGN(skiplist_map, map.oid);
+
+	return skiplist_map_range(pop, skiplist_map, min, max, cb, arg);
+}
+
+/*
+ * map_skiplist_seek -- wrapper for skiplist_map_seek
+ */
+static int
+map_skiplist_seek(PMEMobjpool *pop, TOID(struct map) map,
+		uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct skiplist_map_node) skiplist_map;
+	TOID_ASSIGN(skiplist_map, map.oid);
+
+	return skiplist_map_seek(pop, skiplist_map, key, found, value);
+}
+
 /*
  * map_skiplist_is_empty -- wrapper for skiplist_map_is_empty
  */
@@ -203,6 +231,8 @@ struct map_ops skiplist_map_ops = {
 	.lookup		= map_skiplist_lookup,
 	.is_empty	= map_skiplist_is_empty,
 	.foreach	= map_skiplist_foreach,
+	.range		= map_skiplist_range,
+	.seek		= map_skiplist_seek,
 	.count		= NULL,
 	.cmd		= NULL,
 };
@@ -44,9 +44,11 @@
 #include "map_ctree.h"
 #include "map_btree.h"
 #include "map_rbtree.h"
+#include "map_bptree.h"
 #include "map_hashmap_atomic.h"
 #include "map_hashmap_tx.h"
 #include "map_skiplist.h"
+#include "map_cskiplist.h"
 #include "hashmap/hashmap.h"
 
 #define PM_HASHSET_POOL_SIZE	(160 * 1024 * 1024)
@@ -171,6 +173,7 @@ help(void)
 	printf("c $value - check $value, returns 0/1\n");
 	printf("n $value - insert $value random values\n");
 	printf("p - print all values\n");
+	printf("s $min $max - print values from the [$min, $max] range\n");
 	printf("d - print debug info\n");
 	printf("b [$value] - rebuild $value (default: 1) times\n");
 	printf("q - quit\n");
@@ -197,13 +200,30 @@ print_all(void)
 	printf("\n");
 }
 
+/*
+ * str_range -- prints values from the range specified as string
+ */
+static void
+str_range(const char *str)
+{
+	uint64_t min;
+	uint64_t max;
+	if (sscanf(str, "%lu %lu", &min, &max) == 2) {
+		map_range(mapc, map, min, max, hashmap_print, NULL);
+		printf("\n");
+	} else {
+		fprintf(stderr, "range: invalid syntax\n");
+	}
+}
+
 #define INPUT_BUF_LEN 1000
 int
 main(int argc, char *argv[])
 {
 	if (argc < 3 || argc > 4) {
 		printf("usage: %s "
-			"hashmap_tx|hashmap_atomic|ctree|btree|rbtree|skiplist"
+			"hashmap_tx|hashmap_atomic|ctree|btree|rbtree|bptree|"
+			"skiplist|cskiplist"
 				" file-name [<seed>]\n", argv[0]);
 		return 1;
 	}
@@ -221,8 +241,12 @@ main(int argc, char *argv[])
 		ops = MAP_BTREE;
 	} else if (strcmp(type, "rbtree") == 0) {
 		ops = MAP_RBTREE;
+	} else if (strcmp(type, "bptree") == 0) {
+		ops = MAP_BPTREE;
 	} else if (strcmp(type, "skiplist") == 0) {
 		ops = MAP_SKIPLIST;
+	} else if (strcmp(type, "cskiplist") == 0) {
+		ops = MAP_CSKIPLIST;
 	} else {
 		fprintf(stderr, "invalid hasmap type -- '%s'\n", type);
 		return 1;
@@ -275,6 +299,10 @@ main(int argc, char *argv[])
 		}
 		root = POBJ_ROOT(pop, struct root);
 		map = D_RO(root)->map;
+
+		/* recover the map after a crash */
+		if (ops->init)
+			map_init(mapc, map);
 	}
 
 	char buf[INPUT_BUF_LEN];
@@ -302,6 +330,9 @@ main(int argc, char *argv[])
 			case 'p':
 				print_all();
 				break;
+			case 's':
+				str_range(buf + 1);
+				break;
 			case 'd':
 				map_cmd(mapc, map, HASHMAP_CMD_DEBUG,
 						(uint64_t)stdout);
@@ -40,10 +40,12 @@
 #include <libpmem.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <err.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <linux/kdev_t.h>
 
 #include <map.h>
@@ -53,6 +55,9 @@
 #define PMEMOBJFS_TRACK_BLOCKS	1
 #endif
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
 #if DEBUG
 static FILE *log_fh;
 static uint64_t log_cnt;
@@ -80,6 +85,8 @@ if (log_fh) {\
 #define PMEMOBJFS_CTL_TX_COMMIT	_IO(PMEMOBJFS_CTL, 2)
 #define PMEMOBJFS_CTL_TX_ABORT	_IO(PMEMOBJFS_CTL, 3)
 
+#define PMEMOBJFS_POOLSET_SIG	"PMEMPOOLSET"
+
 /*
  * struct pmemobjfs -- volatile state of pmemobjfs
  */
@@ -91,6 +98,10 @@ struct pmemobjfs {
 	uint64_t ioctl_off;
 	uint64_t block_size;
 	uint64_t max_name;
+	int mt;			/* FUSE runs in multithreaded mode */
+	int pool_fd;		/* pool file for zero-copy reads or -1 */
+	PMEMrwlock *ns_lock;	/* directory tree lock */
+	PMEMmutex *ref_lock;	/* reference counters lock */
 };
 
 #define PMEMOBJFS (struct pmemobjfs *)fuse_get_context()->private_data
@@ -173,8 +184,6 @@ for (entry = ((head)).first; !TOID_IS_NULL(entry) &&\
 	}\
 } while (0)
 
-typedef uint8_t objfs_block_t;
-
 /*
  * pmemobjfs persistent layout
  */
@@ -182,11 +191,12 @@ POBJ_LAYOUT_BEGIN(pmemobjfs);
 POBJ_LAYOUT_ROOT(pmemobjfs, struct objfs_super);
 POBJ_LAYOUT_TOID(pmemobjfs, struct objfs_inode);
 POBJ_LAYOUT_TOID(pmemobjfs, struct objfs_dir_entry);
-POBJ_LAYOUT_TOID(pmemobjfs, objfs_block_t);
+POBJ_LAYOUT_TOID(pmemobjfs, struct objfs_extent);
 POBJ_LAYOUT_TOID(pmemobjfs, char);
 POBJ_LAYOUT_END(pmemobjfs);
 
 #define PMEMOBJFS_MIN_BLOCK_SIZE ((size_t)(512 - 64))
+#define PMEMOBJFS_MAX_EXTENT_SIZE ((size_t)4 << 20)
 
 /*
  * struct objfs_super -- pmemobjfs super (root) object
@@ -194,7 +204,9 @@ POBJ_LAYOUT_END(pmemobjfs);
 struct objfs_super {
 	TOID(struct objfs_inode) root_inode;	/* root dir inode */
 	TOID(struct map) opened;		/* map of opened files / dirs */
-	uint64_t block_size;			/* size of data block */
+	uint64_t block_size;			/* minimum size of extent */
+	PMEMrwlock ns_lock;			/* directory tree lock */
+	PMEMmutex ref_lock;			/* reference counters lock */
 };
 
 /*
@@ -214,15 +226,26 @@ struct objfs_dir {
 };
 
 /*
- * key == 0 for ctree_map is not allowed
+ * struct objfs_extent -- contiguous range of file data
  */
-#define GET_KEY(off) ((off) + 1)
+struct objfs_extent {
+	uint64_t off;		/* offset of extent in file */
+	uint64_t size;		/* size of extent */
+	uint8_t data[];		/* file data */
+};
+
+/*
+ * The extents are keyed by their end offsets, so seeking to off + 1 finds
+ * the extent which contains off, if any. The key is never 0, which isn't
+ * allowed by ctree_map.
+ */
+#define EXTENT_KEY(extent) (D_RO(extent)->off + D_RO(extent)->size)
 
 /*
  * struct objfs_file -- pmemobjfs file structure
  */
 struct objfs_file {
-	TOID(struct map) blocks;	/* blocks map */
+	TOID(struct map) extents;	/* extents map */
 };
 
 /*
@@ -246,11 +269,61 @@ struct objfs_inode {
 	uint32_t uid;	/* user ID */
 	uint32_t gid;	/* group ID */
 	uint32_t ref;	/* reference counter */
+	PMEMrwlock lock; /* inode data and attributes lock */
 	struct objfs_file file; /* file specific data */
 	struct objfs_dir dir;	/* directory specific data */
 	struct objfs_symlink symlink; /* symlink specific data */
 };
 
+/*
+ * The locks are taken only in the multithreaded mode of FUSE. The ns_lock is
+ * held for reading during path lookups and for writing by the operations
+ * which modify directories. The lock of an inode protects its attributes and
+ * file data, except the reference counter which, along with the map of opened
+ * inodes, is protected by ref_lock. The ref_lock is held until the end of the
+ * transaction, so an inode can be freed along with the last reference.
+ */
+
+/*
+ * pmemobjfs_rdlock -- acquire read lock
+ */
+static void
+pmemobjfs_rdlock(struct pmemobjfs *objfs, PMEMrwlock *lock)
+{
+	if (objfs->mt)
+		pmemobj_rwlock_rdlock(objfs->pop, lock);
+}
+
+/*
+ * pmemobjfs_wrlock -- acquire write lock
+ */
+static void
+pmemobjfs_wrlock(struct pmemobjfs *objfs, PMEMrwlock *lock)
+{
+	if (objfs->mt)
+		pmemobj_rwlock_wrlock(objfs->pop, lock);
+}
+
+/*
+ * pmemobjfs_unlock -- release read or write lock
+ */
+static void
+pmemobjfs_unlock(struct pmemobjfs *objfs, PMEMrwlock *lock)
+{
+	if (objfs->mt)
+		pmemobj_rwlock_unlock(objfs->pop, lock);
+}
+
+/*
+ * pmemobjfs_tx_lock_refs -- acquire reference counters lock in transaction
+ */
+static void
+pmemobjfs_tx_lock_refs(struct pmemobjfs *objfs)
+{
+	if (objfs->mt)
+		pmemobj_tx_lock(TX_LOCK_MUTEX, objfs->ref_lock);
+}
+
 /*
  * pmemobjfs_ioctl -- do the ioctl command
  */
@@ -335,7 +408,7 @@ pmemobjfs_inode_init_file(struct pmemobjfs *objfs,
 		TOID(struct objfs_inode) inode)
 {
 	TX_BEGIN(objfs->pop) {
-		map_new(objfs->mapc, &D_RW(inode)->file.blocks, NULL);
+		map_new(objfs->mapc, &D_RW(inode)->file.extents, NULL);
 	} TX_END
 }
 
@@ -347,7 +420,7 @@ pmemobjfs_inode_destroy_file(struct pmemobjfs *objfs,
 		TOID(struct objfs_inode) inode)
 {
 	TX_BEGIN(objfs->pop) {
-		map_delete(objfs->mapc, &D_RW(inode)->file.blocks);
+		map_delete(objfs->mapc, &D_RW(inode)->file.extents);
 	} TX_END
 }
 
@@ -361,6 +434,8 @@ pmemobjfs_inode_hold(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode)
 		return;
 
 	TX_BEGIN(objfs->pop) {
+		pmemobjfs_tx_lock_refs(objfs);
+
 		/* update number of references */
 		TX_ADD_FIELD(inode, ref);
 		D_RW(inode)->ref++;
@@ -497,6 +572,8 @@ pmemobjfs_inode_put(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode)
 		return;
 
 	TX_BEGIN(objfs->pop) {
+		pmemobjfs_tx_lock_refs(objfs);
+
 		/* update number of references */
 		TX_ADD_FIELD(inode, ref);
 		D_RW(inode)->ref--;
@@ -535,7 +612,8 @@ pmemobjfs_get_dir_entry(TOID(struct objfs_inode) inode, const char *name)
 	log("%s", name);
 	TOID(struct objfs_dir_entry) entry;
 	PDLL_FOREACH(entry, D_RW(inode)->dir.entries, pdll) {
-		if (strcmp(name, D_RO(entry)->name) == 0)
+		const struct objfs_dir_entry *e = D_RO(entry);
+		if (e != NULL && strcmp(name, e->name) == 0)
 			return entry;
 	}
 
@@ -625,45 +703,179 @@ pmemobjfs_inode_lookup(struct pmemobjfs *objfs, const char *path,
 }
 
 /*
- * pmemobjfs_file_get_block -- get block at given offset
+ * pmemobjfs_file_seek_extent -- get first extent which ends after given offset
  */
-static TOID(objfs_block_t)
-pmemobjfs_file_get_block(struct pmemobjfs *objfs,
-		TOID(struct objfs_inode) inode,
-		uint64_t offset)
+static TOID(struct objfs_extent)
+pmemobjfs_file_seek_extent(struct pmemobjfs *objfs,
+		TOID(struct objfs_inode) inode, uint64_t offset)
 {
-	TOID(objfs_block_t) block;
-	PMEMoid block_oid =
-		map_get(objfs->mapc, D_RO(inode)->file.blocks, GET_KEY(offset));
-	TOID_ASSIGN(block, block_oid);
-	return block;
+	TOID(struct objfs_extent) extent = TOID_NULL(struct objfs_extent);
+	uint64_t key;
+	PMEMoid extent_oid;
+	if (map_seek(objfs->mapc, D_RO(inode)->file.extents, offset + 1,
+			&key, &extent_oid) == 1)
+		TOID_ASSIGN(extent, extent_oid);
+
+	return extent;
+}
+
+/*
+ * pmemobjfs_file_alloc_extent -- allocate extent at given offset
+ *
+ * The extent holds at least size bytes, rounded up to the block size, and
+ * ends no further than at limit. An extent which directly follows another
+ * one is twice as large as the previous one, up to PMEMOBJFS_MAX_EXTENT_SIZE,
+ * so sequential writes end up in few large extents.
+ */
+static TOID(struct objfs_extent)
+pmemobjfs_file_alloc_extent(struct pmemobjfs *objfs,
+		TOID(struct objfs_inode) inode, uint64_t offset, uint64_t size,
+		uint64_t limit, int zero)
+{
+	uint64_t bsize = objfs->block_size;
+	size = (size + bsize - 1) / bsize * bsize;
+
+	if (offset > 0) {
+		TOID(struct objfs_extent) prev =
+			pmemobjfs_file_seek_extent(objfs, inode, offset - 1);
+		if (!TOID_IS_NULL(prev) && EXTENT_KEY(prev) == offset)
+			size = MAX(size, MIN(2 * D_RO(prev)->size,
+					PMEMOBJFS_MAX_EXTENT_SIZE));
+	}
+
+	size = MIN(size, limit - offset);
+
+	TOID(struct objfs_extent) extent;
+	size_t alloc_size = sizeof(struct objfs_extent) + size;
+	if (zero)
+		extent = TX_ZALLOC(struct objfs_extent, alloc_size);
+	else
+		extent = TX_ALLOC(struct objfs_extent, alloc_size);
+
+	D_RW(extent)->off = offset;
+	D_RW(extent)->size = size;
+
+	map_insert(objfs->mapc, D_RW(inode)->file.extents,
+			EXTENT_KEY(extent), extent.oid);
+
+	return extent;
 }
 
 /*
- * pmemobjfs_file_get_block_for_write -- get or allocate block at given offset
+ * pmemobjfs_file_map -- call the callback for consecutive parts of the given
+ * range of file, with the pointer to data or NULL for holes
  */
-static TOID(objfs_block_t)
-pmemobjfs_file_get_block_for_write(struct pmemobjfs *objfs,
-		TOID(struct objfs_inode) inode, uint64_t offset)
+static int
+pmemobjfs_file_map(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
+		uint64_t offset, uint64_t size,
+		int (*cb)(uint64_t off, void *ptr, uint64_t len, void *arg),
+		void *arg)
+{
+	uint64_t end = offset + size;
+	uint64_t off = offset;
+	while (off < end) {
+		TOID(struct objfs_extent) extent =
+			pmemobjfs_file_seek_extent(objfs, inode, off);
+
+		void *ptr = NULL;
+		uint64_t len;
+		if (TOID_IS_NULL(extent)) {
+			len = end - off;
+		} else if (D_RO(extent)->off > off) {
+			len = MIN(end, D_RO(extent)->off) - off;
+		} else {
+			uint64_t extent_off = off - D_RO(extent)->off;
+			len = MIN(end - off, D_RO(extent)->size - extent_off);
+			ptr = &D_RW(extent)->data[extent_off];
+		}
+
+		int ret = cb(off, ptr, len, arg);
+		if (ret)
+			return ret;
+
+		off += len;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobjfs_file_add_range -- prepare range of file data for modification,
+ * returns 1 if the range has to be persisted by the caller
+ *
+ * Outside of the transactions started by the ioctl, the data past the end of
+ * file doesn't have to be restored if a transaction aborts, because the size
+ * of file is restored as well, so the data from beyond unsafe isn't
+ * snapshotted.
+ */
+static int
+pmemobjfs_file_add_range(uint64_t off, void *ptr, uint64_t len,
+		uint64_t unsafe)
 {
-	TOID(objfs_block_t) block =
-		pmemobjfs_file_get_block(objfs, inode, offset);
-	if (TOID_IS_NULL(block)) {
-		TX_BEGIN(objfs->pop) {
-			block = TX_ALLOC(objfs_block_t,
-					objfs->block_size);
-			map_insert(objfs->mapc, D_RW(inode)->file.blocks,
-					GET_KEY(offset), block.oid);
-		} TX_ONABORT {
-			block = TOID_NULL(objfs_block_t);
-		} TX_END
-	} else {
+	if (off >= unsafe)
+		return 1;
+
 #if PMEMOBJFS_TRACK_BLOCKS
-		TX_ADD(block);
+	pmemobj_tx_add_range_direct(ptr, len);
+	return 0;
+#else
+	return 1;
 #endif
-	}
+}
+
+/*
+ * pmemobjfs_file_unsafe -- get offset from which file data is not snapshotted
+ */
+static uint64_t
+pmemobjfs_file_unsafe(TOID(struct objfs_inode) inode)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		return UINT64_MAX;
 
-	return block;
+	return D_RO(inode)->size;
+}
+
+struct pmemobjfs_zero_arg {
+	PMEMobjpool *pop;
+	uint64_t unsafe;
+};
+
+/*
+ * pmemobjfs_file_zero_cb -- zero part of file
+ */
+static int
+pmemobjfs_file_zero_cb(uint64_t off, void *ptr, uint64_t len, void *arg)
+{
+	struct pmemobjfs_zero_arg *zarg = arg;
+
+	if (!ptr)
+		return 0;
+
+	if (pmemobjfs_file_add_range(off, ptr, len, zarg->unsafe))
+		pmemobj_memset_persist(zarg->pop, ptr, 0, len);
+	else
+		memset(ptr, 0, len);
+
+	return 0;
+}
+
+/*
+ * pmemobjfs_file_zero -- zero given range of file
+ *
+ * The extents may contain stale data past the end of file, which has to be
+ * cleared when the file grows over it.
+ */
+static void
+pmemobjfs_file_zero(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
+		uint64_t offset, uint64_t size, uint64_t unsafe)
+{
+	struct pmemobjfs_zero_arg zarg = {
+		.pop = objfs->pop,
+		.unsafe = unsafe,
+	};
+
+	pmemobjfs_file_map(objfs, inode, offset, size,
+			pmemobjfs_file_zero_cb, &zarg);
 }
 
 /*
@@ -684,18 +896,28 @@ pmemobjfs_truncate(struct pmemobjfs *objfs,
 	}
 
 	int ret = 0;
+	uint64_t unsafe = pmemobjfs_file_unsafe(inode);
 
 	TX_BEGIN(objfs->pop) {
 		uint64_t old_off = D_RO(inode)->size;
 		if (old_off > off) {
-			/* release blocks */
-			uint64_t old_boff = (old_off - 1) / objfs->block_size;
-			uint64_t boff = (off + 1) / objfs->block_size;
+			/* release extents which begin past the end of file */
+			uint64_t o = off;
+			TOID(struct objfs_extent) extent;
+			while (!TOID_IS_NULL(extent =
+				pmemobjfs_file_seek_extent(objfs, inode, o))) {
+				if (D_RO(extent)->off < off) {
+					o = EXTENT_KEY(extent);
+					continue;
+				}
 
-			for (uint64_t o = boff; o <= old_boff; o++) {
 				map_remove_free(objfs->mapc,
-					D_RW(inode)->file.blocks, GET_KEY(o));
+					D_RW(inode)->file.extents,
+					EXTENT_KEY(extent));
 			}
+		} else if (old_off < off) {
+			pmemobjfs_file_zero(objfs, inode, old_off,
+					off - old_off, unsafe);
 		}
 
 		time_t t = time(NULL);
@@ -717,6 +939,24 @@ pmemobjfs_truncate(struct pmemobjfs *objfs,
 	return ret;
 }
 
+/*
+ * pmemobjfs_read_cb -- copy part of file to buffer
+ */
+static int
+pmemobjfs_read_cb(uint64_t off, void *ptr, uint64_t len, void *arg)
+{
+	char **buffp = arg;
+
+	if (ptr)
+		memcpy(*buffp, ptr, len);
+	else
+		memset(*buffp, 0, len);
+
+	*buffp += len;
+
+	return 0;
+}
+
 /*
  * pmemobjfs_read -- read from file
  */
@@ -735,45 +975,137 @@ pmemobjfs_read(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
 	}
 
 	uint64_t fsize = D_RO(inode)->size;
+	if ((uint64_t)offset >= fsize)
+		return 0;
 
-	size_t sz = size;
-	size_t off = offset;
-	while (sz > 0) {
-		if (off >= fsize)
-			break;
+	size_t sz = MIN(size, fsize - offset);
+	pmemobjfs_file_map(objfs, inode, offset, sz, pmemobjfs_read_cb, &buff);
 
-		uint64_t block_id = off / objfs->block_size;
-		uint64_t block_off = off % objfs->block_size;
-		uint64_t block_size = sz < objfs->block_size ?
-			sz : objfs->block_size;
+	return sz;
+}
 
-		TOID(objfs_block_t) block =
-			pmemobjfs_file_get_block(objfs, inode, block_id);
+struct pmemobjfs_read_buf_arg {
+	struct pmemobjfs *objfs;
+	struct fuse_bufvec *bufv;
+	size_t nbufs;
+};
 
-		if (block_off + block_size > objfs->block_size)
-			block_size = objfs->block_size - block_off;
+/*
+ * pmemobjfs_read_buf_cb -- add part of file to buffer vector
+ */
+static int
+pmemobjfs_read_buf_cb(uint64_t off, void *ptr, uint64_t len, void *arg)
+{
+	struct pmemobjfs_read_buf_arg *rarg = arg;
+	struct fuse_bufvec *bufv = rarg->bufv;
 
-		if (TOID_IS_NULL(block)) {
-			memset(buff, 0, block_size);
-		} else {
-			memcpy(buff, &D_RW(block)[block_off], block_size);
-		}
+	if (bufv->count == rarg->nbufs) {
+		size_t nbufs = 2 * rarg->nbufs;
+		bufv = realloc(bufv, sizeof(*bufv) +
+				(nbufs - 1) * sizeof(struct fuse_buf));
+		if (!bufv)
+			return -ENOMEM;
 
+		rarg->bufv = bufv;
+		rarg->nbufs = nbufs;
+	}
 
-		buff += block_size;
-		off += block_size;
-		sz -= block_size;
+	struct fuse_buf *buf = &bufv->buf[bufv->count];
+	memset(buf, 0, sizeof(*buf));
+	buf->size = len;
+	if (ptr) {
+		buf->flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+		buf->fd = rarg->objfs->pool_fd;
+		buf->pos = (uintptr_t)ptr - (uintptr_t)rarg->objfs->pop;
+	} else {
+		buf->mem = calloc(1, len);
+		if (!buf->mem)
+			return -ENOMEM;
 	}
 
-	return size - sz;
+	bufv->count++;
+
+	return 0;
+}
+
+/*
+ * pmemobjfs_read_buf -- read from file to buffer vector
+ *
+ * If the pool file is available, the buffers refer to the pool file instead
+ * of copies of the data, so FUSE can splice the data straight from pmem.
+ * The data is transferred after the inode lock is released, so a read which
+ * races with a write may return a mix of old and new data.
+ */
+static int
+pmemobjfs_read_buf(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
+		struct fuse_bufvec **bufp, size_t size, off_t offset)
+{
+	/* check inode type */
+	switch (D_RO(inode)->flags & S_IFMT) {
+	case S_IFREG:
+		break;
+	case S_IFDIR:
+		return -EISDIR;
+	default:
+		return -EINVAL;
+	}
+
+	uint64_t fsize = D_RO(inode)->size;
+	size_t sz = (uint64_t)offset < fsize ? MIN(size, fsize - offset) : 0;
+
+	struct fuse_bufvec init = FUSE_BUFVEC_INIT(sz);
+	struct pmemobjfs_read_buf_arg rarg = {
+		.objfs = objfs,
+		.bufv = malloc(sizeof(struct fuse_bufvec)),
+		.nbufs = 1,
+	};
+	if (!rarg.bufv)
+		return -ENOMEM;
+
+	*rarg.bufv = init;
+
+	int ret = 0;
+	if (objfs->pool_fd < 0) {
+		if (sz == 0)
+			goto out;
+
+		rarg.bufv->buf[0].mem = malloc(sz);
+		if (!rarg.bufv->buf[0].mem) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		pmemobjfs_read(objfs, inode, rarg.bufv->buf[0].mem,
+				sz, offset);
+	} else if (sz > 0) {
+		rarg.bufv->count = 0;
+		ret = pmemobjfs_file_map(objfs, inode, offset, sz,
+				pmemobjfs_read_buf_cb, &rarg);
+	}
+out:
+	if (ret) {
+		for (size_t i = 0; i < rarg.bufv->count; i++)
+			if (!(rarg.bufv->buf[i].flags & FUSE_BUF_IS_FD))
+				free(rarg.bufv->buf[i].mem);
+		free(rarg.bufv);
+		return ret;
+	}
+
+	*bufp = rarg.bufv;
+
+	return 0;
 }
 
 /*
  * pmemobjfs_write -- write to file
+ *
+ * The data is copied straight from the FUSE buffers to the extents. Writes
+ * into holes allocate new extents, so appending to a file doesn't snapshot
+ * any data.
  */
 static int
 pmemobjfs_write(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
-		const char *buff, size_t size, off_t offset)
+		struct fuse_bufvec *buf, off_t offset)
 {
 	/* check inode type */
 	switch (D_RO(inode)->flags & S_IFMT) {
@@ -786,31 +1118,51 @@ pmemobjfs_write(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
 	}
 
 	int ret = 0;
+	size_t size = fuse_buf_size(buf);
+	uint64_t fsize = D_RO(inode)->size;
+	uint64_t unsafe = pmemobjfs_file_unsafe(inode);
 
 	TX_BEGIN(objfs->pop) {
+		/* clear stale data between the end of file and offset */
+		if ((uint64_t)offset > fsize)
+			pmemobjfs_file_zero(objfs, inode, fsize,
+					offset - fsize, unsafe);
+
 		size_t sz = size;
-		off_t off = offset;
+		uint64_t off = offset;
 		while (sz > 0) {
-			uint64_t block_id = off / objfs->block_size;
-			uint64_t block_off = off % objfs->block_size;
-			uint64_t block_size = sz < objfs->block_size ?
-				sz : objfs->block_size;
+			TOID(struct objfs_extent) extent =
+				pmemobjfs_file_seek_extent(objfs, inode, off);
+
+			/* new extents are flushed on commit */
+			int fresh = TOID_IS_NULL(extent) ||
+				D_RO(extent)->off > off;
+			if (fresh) {
+				uint64_t limit = TOID_IS_NULL(extent) ?
+					UINT64_MAX : D_RO(extent)->off;
+				extent = pmemobjfs_file_alloc_extent(objfs,
+						inode, off, sz, limit,
+						off < fsize);
+			}
 
-			TOID(objfs_block_t) block =
-				pmemobjfs_file_get_block_for_write(objfs,
-						inode, block_id);
+			uint64_t extent_off = off - D_RO(extent)->off;
+			uint64_t len = MIN(sz, D_RO(extent)->size - extent_off);
+			void *ptr = &D_RW(extent)->data[extent_off];
 
-			if (TOID_IS_NULL(block))
-				return -ENOSPC;
+			int persist = fresh ? 0 :
+				pmemobjfs_file_add_range(off, ptr, len, unsafe);
 
-			if (block_off + block_size > objfs->block_size)
-				block_size = objfs->block_size - block_off;
+			struct fuse_bufvec dst = FUSE_BUFVEC_INIT(len);
+			dst.buf[0].mem = ptr;
+			ssize_t copied = fuse_buf_copy(&dst, buf, 0);
+			if (copied != (ssize_t)len)
+				pmemobj_tx_abort(copied < 0 ? -copied : EIO);
 
-			memcpy(&D_RW(block)[block_off], buff, block_size);
+			if (persist)
+				pmemobj_persist(objfs->pop, ptr, len);
 
-			buff += block_size;
-			off += block_size;
-			sz -= block_size;
+			off += len;
+			sz -= len;
 		}
 
 		time_t t = time(NULL);
@@ -838,7 +1190,7 @@ pmemobjfs_write(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode,
 }
 
 /*
- * pmemobjfs_fallocate -- allocate blocks for file
+ * pmemobjfs_fallocate -- allocate extents for file
  */
 static int
 pmemobjfs_fallocate(struct pmemobjfs *objfs,
@@ -855,13 +1207,33 @@ pmemobjfs_fallocate(struct pmemobjfs *objfs,
 	}
 
 	int ret = 0;
+	uint64_t fsize = D_RO(inode)->size;
+	uint64_t unsafe = pmemobjfs_file_unsafe(inode);
 
 	TX_BEGIN(objfs->pop) {
-		/* allocate blocks from requested range */
-		uint64_t b_off = offset / objfs->block_size;
-		uint64_t e_off = (offset + size) / objfs->block_size;
-		for (uint64_t off = b_off; off <= e_off; off++)
-			pmemobjfs_file_get_block_for_write(objfs, inode, off);
+		uint64_t end = offset + size;
+
+		/* clear stale data in the existing extents */
+		if (end > fsize)
+			pmemobjfs_file_zero(objfs, inode, fsize, end - fsize,
+					unsafe);
+
+		/* allocate extents for holes in requested range */
+		uint64_t off = offset;
+		while (off < end) {
+			TOID(struct objfs_extent) extent =
+				pmemobjfs_file_seek_extent(objfs, inode, off);
+
+			if (TOID_IS_NULL(extent) || D_RO(extent)->off > off) {
+				uint64_t limit = TOID_IS_NULL(extent) ?
+					UINT64_MAX : D_RO(extent)->off;
+				uint64_t len = MIN(end, limit) - off;
+				extent = pmemobjfs_file_alloc_extent(objfs,
+						inode, off, len, limit, 1);
+			}
+
+			off = EXTENT_KEY(extent);
+		}
 
 		time_t t = time(NULL);
 		/* update modification time */
@@ -873,8 +1245,10 @@ pmemobjfs_fallocate(struct pmemobjfs *objfs,
 		D_RW(inode)->ctime = t;
 
 		/* update inode size */
-		D_RW(inode)->size = offset + size;
-		TX_ADD_FIELD(inode, size);
+		if (end > fsize) {
+			TX_ADD_FIELD(inode, size);
+			D_RW(inode)->size = end;
+		}
 	} TX_ONABORT {
 		ret = -ECANCELED;
 	} TX_END
@@ -1147,6 +1521,8 @@ pmemobjfs_open(struct pmemobjfs *objfs, TOID(struct objfs_inode) inode)
 	int ret = 0;
 
 	TX_BEGIN(objfs->pop) {
+		pmemobjfs_tx_lock_refs(objfs);
+
 		/* insert inode to opened inodes map */
 		map_insert(objfs->mapc, D_RW(super)->opened,
 				inode.oid.off, inode.oid);
@@ -1172,6 +1548,8 @@ pmemobjfs_close(struct pmemobjfs *objfs,
 	int ret = 0;
 
 	TX_BEGIN(objfs->pop) {
+		pmemobjfs_tx_lock_refs(objfs);
+
 		/* remove inode from opened inodes map */
 		map_remove(objfs->mapc, D_RW(super)->opened,
 				inode.oid.off);
@@ -1484,12 +1862,19 @@ pmemobjfs_fuse_getattr(const char *path, struct stat *statbuf)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret) {
+		pmemobjfs_rdlock(objfs, &D_RW(inode)->lock);
+		ret = pmemobjfs_getattr(inode, statbuf);
+		pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+	}
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_getattr(inode, statbuf);
+	return ret;
 }
 
 /*
@@ -1501,25 +1886,31 @@ pmemobjfs_fuse_opendir(const char *path, struct fuse_file_info *fi)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
 	if (ret)
-		return ret;
+		goto out;
 
 	/* check inode type */
 	switch (D_RO(inode)->flags & S_IFMT) {
 	case S_IFDIR:
 		break;
 	case S_IFREG:
-		return -ENOTDIR;
+		ret = -ENOTDIR;
+		goto out;
 	default:
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 
 	/* add inode to opened inodes map */
 	ret = pmemobjfs_open(objfs, inode);
 	if (!ret)
 		fi->fh = inode.oid.off;
+out:
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
 	return ret;
 }
@@ -1572,16 +1963,20 @@ pmemobjfs_fuse_readdir(const char *path, void *buff, fuse_fill_dir_t fill,
 	if (!S_ISDIR(D_RO(inode)->flags))
 		return -ENOTDIR;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	/* walk through all dir entries and fill fuse buffer */
-	int ret;
+	int ret = 0;
 	TOID(struct objfs_dir_entry) entry;
 	PDLL_FOREACH(entry, D_RW(inode)->dir.entries, pdll) {
 		ret = fill(buff, D_RW(entry)->name, NULL, 0);
 		if (ret)
-			return ret;
+			break;
 	}
 
-	return 0;
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
+
+	return ret;
 }
 
 /*
@@ -1593,16 +1988,21 @@ pmemobjfs_fuse_mkdir(const char *path, mode_t mode)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	uid_t uid = fuse_get_context()->uid;
+	uid_t gid = fuse_get_context()->gid;
+
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, path, &inode, &name);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_mkdir(objfs, inode, name, mode | S_IFDIR,
+				uid, gid);
 
-	uid_t uid = fuse_get_context()->uid;
-	uid_t gid = fuse_get_context()->gid;
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_mkdir(objfs, inode, name, mode | S_IFDIR, uid, gid);
+	return ret;
 }
 
 /*
@@ -1614,13 +2014,17 @@ pmemobjfs_fuse_rmdir(const char *path)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, path, &inode, &name);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_rmdir(objfs, inode, name);
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_rmdir(objfs, inode, name);
+	return ret;
 }
 
 /*
@@ -1632,12 +2036,19 @@ pmemobjfs_fuse_chmod(const char *path, mode_t mode)
 	log("%s 0%o", path, mode);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret) {
+		pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+		ret = pmemobjfs_chmod(objfs, inode, mode);
+		pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+	}
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_chmod(objfs, inode, mode);
+	return ret;
 }
 
 /*
@@ -1649,12 +2060,19 @@ pmemobjfs_fuse_chown(const char *path, uid_t uid, gid_t gid)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret) {
+		pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+		ret = pmemobjfs_chown(objfs, inode, uid, gid);
+		pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+	}
 
-	return pmemobjfs_chown(objfs, inode, uid, gid);
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
+
+	return ret;
 }
 
 /*
@@ -1666,32 +2084,38 @@ pmemobjfs_fuse_create(const char *path, mode_t mode, struct fuse_file_info *fi)
 	log("%s mode %o", path, mode);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	uid_t uid = fuse_get_context()->uid;
+	uid_t gid = fuse_get_context()->gid;
+
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, path, &inode, &name);
 	if (ret)
-		return ret;
-
-	if (!S_ISDIR(D_RO(inode)->flags))
-		return -EINVAL;
+		goto out;
 
-	uid_t uid = fuse_get_context()->uid;
-	uid_t gid = fuse_get_context()->gid;
+	if (!S_ISDIR(D_RO(inode)->flags)) {
+		ret = -EINVAL;
+		goto out;
+	}
 
 	TOID(struct objfs_inode) new_file;
 	ret = pmemobjfs_create(objfs, inode, name, mode, uid, gid,
 			&new_file);
 	if (ret)
-		return ret;
+		goto out;
 
 	/* add new inode to opened inodes */
 	ret = pmemobjfs_open(objfs, new_file);
 	if (ret)
-		return ret;
+		goto out;
 
 	fi->fh = new_file.oid.off;
+out:
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return 0;
+	return ret;
 }
 
 /*
@@ -1703,12 +2127,19 @@ pmemobjfs_fuse_utimens(const char *path, const struct timespec tv[2])
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret) {
+		pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+		ret = pmemobjfs_utimens(objfs, inode, tv);
+		pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+	}
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_utimens(objfs, inode, tv);
+	return ret;
 }
 
 /*
@@ -1720,24 +2151,30 @@ pmemobjfs_fuse_open(const char *path, struct fuse_file_info *fi)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
 	if (ret)
-		return ret;
+		goto out;
 
 	/* check inode type */
 	switch (D_RO(inode)->flags & S_IFMT) {
 	case S_IFREG:
 		break;
 	case S_IFDIR:
-		return -EISDIR;
+		ret = -EISDIR;
+		goto out;
 	default:
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 
 	ret = pmemobjfs_open(objfs, inode);
 	if (!ret)
 		fi->fh = inode.oid.off;
+out:
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
 	return ret;
 }
@@ -1770,13 +2207,13 @@ pmemobjfs_fuse_release(const char *path, struct fuse_file_info *fi)
 }
 
 /*
- * pmemobjfs_fuse_write -- (FUSE) write to file
+ * pmemobjfs_fuse_write_buf -- (FUSE) write to file
  */
 static int
-pmemobjfs_fuse_write(const char *path, const char *buff, size_t size,
+pmemobjfs_fuse_write_buf(const char *path, struct fuse_bufvec *buf,
 		off_t offset, struct fuse_file_info *fi)
 {
-	log("%s size = %lu off = %lu", path, size, offset);
+	log("%s size = %lu off = %lu", path, fuse_buf_size(buf), offset);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
 	if (!fi->fh)
@@ -1789,15 +2226,19 @@ pmemobjfs_fuse_write(const char *path, const char *buff, size_t size,
 	if (!TOID_VALID(inode))
 		return -EINVAL;
 
-	return pmemobjfs_write(objfs, inode, buff, size, offset);
+	pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+	int ret = pmemobjfs_write(objfs, inode, buf, offset);
+	pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+
+	return ret;
 }
 
 /*
- * pmemobjfs_fuse_read -- (FUSE) read from file
+ * pmemobjfs_fuse_read_buf -- (FUSE) read from file
  */
 static int
-pmemobjfs_fuse_read(const char *path, char *buff, size_t size, off_t off,
-		struct fuse_file_info *fi)
+pmemobjfs_fuse_read_buf(const char *path, struct fuse_bufvec **bufp,
+		size_t size, off_t off, struct fuse_file_info *fi)
 {
 	log("%s size = %lu off = %lu", path, size, off);
 	struct pmemobjfs *objfs = PMEMOBJFS;
@@ -1812,7 +2253,11 @@ pmemobjfs_fuse_read(const char *path, char *buff, size_t size, off_t off,
 	if (!TOID_VALID(inode))
 		return -EINVAL;
 
-	return pmemobjfs_read(objfs, inode, buff, size, off);
+	pmemobjfs_rdlock(objfs, &D_RW(inode)->lock);
+	int ret = pmemobjfs_read_buf(objfs, inode, bufp, size, off);
+	pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+
+	return ret;
 }
 
 /*
@@ -1824,12 +2269,19 @@ pmemobjfs_fuse_truncate(const char *path, off_t off)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret) {
+		pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+		ret = pmemobjfs_truncate(objfs, inode, off);
+		pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+	}
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_truncate(objfs, inode, off);
+	return ret;
 }
 
 /*
@@ -1851,7 +2303,11 @@ pmemobjfs_fuse_ftruncate(const char *path, off_t off, struct fuse_file_info *fi)
 	if (!TOID_VALID(inode))
 		return -EINVAL;
 
-	return pmemobjfs_truncate(objfs, inode, off);
+	pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+	int ret = pmemobjfs_truncate(objfs, inode, off);
+	pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+
+	return ret;
 }
 
 /*
@@ -1863,13 +2319,17 @@ pmemobjfs_fuse_unlink(const char *path)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, path, &inode, &name);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_unlink(objfs, inode, name);
 
-	return pmemobjfs_unlink(objfs, inode, name);
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
+
+	return ret;
 }
 
 /*
@@ -1916,6 +2376,13 @@ pmemobjfs_fuse_ioctl(const char *path, int cmd, void *arg,
 
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	/*
+	 * The transaction would span operations executed by different
+	 * threads.
+	 */
+	if (objfs->mt)
+		return -ENOTSUP;
+
 	/* check transaction stage */
 	switch (cmd) {
 	case PMEMOBJFS_CTL_TX_BEGIN:
@@ -1958,13 +2425,15 @@ pmemobjfs_fuse_rename(const char *path, const char *dest)
 
 	int ret;
 
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	/* get source inode's parent and name */
 	TOID(struct objfs_inode) src_parent;
 	const char *src_name;
 	ret = pmemobjfs_inode_lookup_parent(objfs, path,
 			&src_parent, &src_name);
 	if (ret)
-		return ret;
+		goto out;
 
 	/* get destination inode's parent and name */
 	TOID(struct objfs_inode) dst_parent;
@@ -1972,11 +2441,15 @@ pmemobjfs_fuse_rename(const char *path, const char *dest)
 	ret = pmemobjfs_inode_lookup_parent(objfs, dest,
 			&dst_parent, &dst_name);
 	if (ret)
-		return ret;
+		goto out;
 
-	return pmemobjfs_rename(objfs,
+	ret = pmemobjfs_rename(objfs,
 			src_parent, src_name,
 			dst_parent, dst_name);
+out:
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
+
+	return ret;
 }
 
 /*
@@ -1989,16 +2462,20 @@ pmemobjfs_fuse_symlink(const char *path, const char *link)
 
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	uid_t uid = fuse_get_context()->uid;
+	uid_t gid = fuse_get_context()->gid;
+
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, link, &inode, &name);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_symlink(objfs, inode, name, path, uid, gid);
 
-	uid_t uid = fuse_get_context()->uid;
-	uid_t gid = fuse_get_context()->gid;
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_symlink(objfs, inode, name, path, uid, gid);
+	return ret;
 }
 
 /*
@@ -2010,12 +2487,16 @@ pmemobjfs_fuse_readlink(const char *path, char *buff, size_t size)
 	log("%s", path);
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	pmemobjfs_rdlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	int ret = pmemobjfs_inode_lookup(objfs, path, &inode);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_symlink_read(inode, buff, size);
+
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_symlink_read(inode, buff, size);
+	return ret;
 }
 
 /*
@@ -2028,20 +2509,24 @@ pmemobjfs_fuse_mknod(const char *path, mode_t mode, dev_t dev)
 			(unsigned)MAJOR(dev), (unsigned)MINOR(dev));
 	struct pmemobjfs *objfs = PMEMOBJFS;
 
+	uid_t uid = fuse_get_context()->uid;
+	uid_t gid = fuse_get_context()->gid;
+
+	pmemobjfs_wrlock(objfs, objfs->ns_lock);
+
 	TOID(struct objfs_inode) inode;
 	const char *name;
 	int ret = pmemobjfs_inode_lookup_parent(objfs, path, &inode, &name);
-	if (ret)
-		return ret;
+	if (!ret)
+		ret = pmemobjfs_mknod(objfs, inode, name, mode, uid, gid, dev);
 
-	uid_t uid = fuse_get_context()->uid;
-	uid_t gid = fuse_get_context()->gid;
+	pmemobjfs_unlock(objfs, objfs->ns_lock);
 
-	return pmemobjfs_mknod(objfs, inode, name, mode, uid, gid, dev);
+	return ret;
 }
 
 /*
- * pmemobjfs_fuse_fallocate -- (FUSE) allocate blocks for file
+ * pmemobjfs_fuse_fallocate -- (FUSE) allocate extents for file
  */
 static int
 pmemobjfs_fuse_fallocate(const char *path, int mode, off_t offset, off_t size,
@@ -2060,7 +2545,11 @@ pmemobjfs_fuse_fallocate(const char *path, int mode, off_t offset, off_t size,
 	if (!TOID_VALID(inode))
 		return -EINVAL;
 
-	return pmemobjfs_fallocate(objfs, inode, offset, size);
+	pmemobjfs_wrlock(objfs, &D_RW(inode)->lock);
+	int ret = pmemobjfs_fallocate(objfs, inode, offset, size);
+	pmemobjfs_unlock(objfs, &D_RW(inode)->lock);
+
+	return ret;
 }
 
 /*
@@ -2109,6 +2598,8 @@ pmemobjfs_fuse_init(struct fuse_conn_info *conn)
 	objfs->block_size = D_RO(super)->block_size;
 	objfs->max_name = objfs->block_size - sizeof(struct objfs_dir_entry);
 	objfs->pool_uuid_lo = super.oid.pool_uuid_lo;
+	objfs->ns_lock = &D_RW(super)->ns_lock;
+	objfs->ref_lock = &D_RW(super)->ref_lock;
 
 	TX_BEGIN(objfs->pop) {
 		/* release all opened inodes */
@@ -2153,8 +2644,8 @@ static struct fuse_operations pmemobjfs_ops = {
 	/* regular file operations */
 	.open		= pmemobjfs_fuse_open,
 	.release	= pmemobjfs_fuse_release,
-	.write		= pmemobjfs_fuse_write,
-	.read		= pmemobjfs_fuse_read,
+	.write_buf	= pmemobjfs_fuse_write_buf,
+	.read_buf	= pmemobjfs_fuse_read_buf,
 	.flush		= pmemobjfs_fuse_flush,
 	.truncate	= pmemobjfs_fuse_truncate,
 	.ftruncate	= pmemobjfs_fuse_ftruncate,
@@ -2237,7 +2728,7 @@ parse_size(const char *str, uint64_t *sizep)
 {
 	uint64_t size = 0;
 	int shift = 0;
-	char unit[3] = {0};
+	char unit[4] = {0};
 	int ret = sscanf(str, "%lu%3s", &size, unit);
 	if (ret <= 0)
 		return -1;
@@ -2400,6 +2891,31 @@ out_free:
 	return ret;
 }
 
+/*
+ * pmemobjfs_pool_fd -- open pool file for zero-copy reads
+ *
+ * The offsets in the pool file match the offsets in the pool only if the pool
+ * consists of a single regular file, otherwise -1 is returned.
+ */
+static int
+pmemobjfs_pool_fd(const char *fname)
+{
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	char sig[sizeof(PMEMOBJFS_POOLSET_SIG) - 1];
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+		pread(fd, sig, sizeof(sig), 0) != sizeof(sig) ||
+		memcmp(sig, PMEMOBJFS_POOLSET_SIG, sizeof(sig)) == 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -2460,12 +2976,22 @@ main(int argc, char *argv[])
 		goto out;
 	}
 
+	/* FUSE runs in multithreaded mode unless -s is given */
+	objfs->mt = 1;
+	for (int i = 1; i < argc - 2; i++)
+		if (strcmp(argv[i], "-s") == 0)
+			objfs->mt = 0;
+
+	objfs->pool_fd = pmemobjfs_pool_fd(fname);
+
 	argv[argc - 2] = argv[argc - 1];
 	argv[argc - 1] = NULL;
 	argc--;
 
 	ret = fuse_main(argc, argv, &pmemobjfs_ops, objfs);
 
+	if (objfs->pool_fd >= 0)
+		close(objfs->pool_fd);
 	pmemobj_close(objfs->pop);
 out:
 	free(objfs);
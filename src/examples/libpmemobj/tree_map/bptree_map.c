@@ -0,0 +1,567 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bptree_map.c -- B+-tree with cache-friendly nodes
+ *
+ * The keys of a node are packed in one contiguous array which, together with
+ * the node header, fills exactly one 256-byte block for the default order,
+ * so that a search within a node touches as few pmem cache lines as
+ * possible. The values are kept only in the leaves and the leaves are
+ * linked, which makes ordered scans a walk over the leaf level. Modifications
+ * snapshot the block with the keys and only the slots they change.
+ *
+ * The nodes are not merged on removal: an underfull or empty leaf stays in
+ * the tree and is reused by the subsequent insertions.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include "bptree_map.h"
+
+TOID_DECLARE(struct tree_map_node, BPTREE_MAP_TYPE_OFFSET + 1);
+
+/*
+ * The number of children of an inner node. It is a part of the layout of the
+ * pool, so it can't be changed for an existing tree.
+ */
+#ifndef BPTREE_MAP_ORDER
+#define BPTREE_MAP_ORDER 32
+#endif
+
+#if BPTREE_MAP_ORDER < 4
+#error "BPTREE_MAP_ORDER must be at least 4"
+#endif
+
+#define BPTREE_MAX_KEYS (BPTREE_MAP_ORDER - 1)
+
+/* the last slot of a leaf links it to the next leaf */
+#define BPTREE_NEXT_LEAF (BPTREE_MAP_ORDER - 1)
+
+struct tree_map_node {
+	uint32_t n; /* number of keys */
+	uint32_t leaf;
+	uint64_t keys[BPTREE_MAX_KEYS];
+
+	/*
+	 * The children of an inner node, the values and the next leaf of
+	 * a leaf.
+	 */
+	PMEMoid slots[BPTREE_MAP_ORDER];
+};
+
+struct bptree_map {
+	TOID(struct tree_map_node) root;
+};
+
+/*
+ * bptree_map_lower_bound -- (internal) returns the number of keys in the node
+ *	that are less than the given one
+ *
+ * The loop has no early exit, so that it can be vectorized.
+ */
+static unsigned
+bptree_map_lower_bound(const struct tree_map_node *node, uint64_t key)
+{
+	unsigned pos = 0;
+	for (unsigned i = 0; i < node->n; ++i)
+		pos += node->keys[i] < key;
+
+	return pos;
+}
+
+/*
+ * bptree_map_upper_bound -- (internal) returns the number of keys in the node
+ *	that are not greater than the given one
+ */
+static unsigned
+bptree_map_upper_bound(const struct tree_map_node *node, uint64_t key)
+{
+	unsigned pos = 0;
+	for (unsigned i = 0; i < node->n; ++i)
+		pos += node->keys[i] <= key;
+
+	return pos;
+}
+
+/*
+ * bptree_map_snapshot -- (internal) snapshots the header of the node, its keys
+ *	up to the given one and the given slots
+ *
+ * The header and the keys are snapshotted as one range, as they share the
+ * first block of the node anyway.
+ */
+static void
+bptree_map_snapshot(struct tree_map_node *node, unsigned nkeys,
+	unsigned slot, unsigned nslots)
+{
+	pmemobj_tx_add_range_direct(node,
+			offsetof(struct tree_map_node, keys) +
+			nkeys * sizeof(node->keys[0]));
+
+	if (nslots != 0)
+		pmemobj_tx_add_range_direct(&node->slots[slot],
+				nslots * sizeof(node->slots[0]));
+}
+
+/*
+ * bptree_map_find_leaf -- (internal) returns the leaf that can contain the key
+ */
+static TOID(struct tree_map_node)
+bptree_map_find_leaf(TOID(struct bptree_map) map, uint64_t key)
+{
+	TOID(struct tree_map_node) node = D_RO(map)->root;
+	if (TOID_IS_NULL(node))
+		return node;
+
+	while (!D_RO(node)->leaf) {
+		unsigned i = bptree_map_upper_bound(D_RO(node), key);
+		TOID_ASSIGN(node, D_RO(node)->slots[i]);
+	}
+
+	return node;
+}
+
+/*
+ * bptree_map_new -- allocates a new B+-tree instance
+ */
+int
+bptree_map_new(PMEMobjpool *pop, TOID(struct bptree_map) *map, void *arg)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(map, sizeof(*map));
+		*map = TX_ZNEW(struct bptree_map);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_clear_node -- (internal) removes all elements from the node
+ */
+static void
+bptree_map_clear_node(TOID(struct tree_map_node) node)
+{
+	if (!D_RO(node)->leaf) {
+		for (unsigned i = 0; i <= D_RO(node)->n; ++i) {
+			TOID(struct tree_map_node) child;
+			TOID_ASSIGN(child, D_RO(node)->slots[i]);
+			bptree_map_clear_node(child);
+		}
+	}
+
+	TX_FREE(node);
+}
+
+/*
+ * bptree_map_clear -- removes all elements from the map
+ */
+int
+bptree_map_clear(PMEMobjpool *pop, TOID(struct bptree_map) map)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		if (!TOID_IS_NULL(D_RO(map)->root)) {
+			bptree_map_clear_node(D_RO(map)->root);
+			TX_SET(map, root, TOID_NULL(struct tree_map_node));
+		}
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_delete -- cleanups and frees B+-tree instance
+ */
+int
+bptree_map_delete(PMEMobjpool *pop, TOID(struct bptree_map) *map)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		bptree_map_clear(pop, *map);
+		pmemobj_tx_add_range_direct(map, sizeof(*map));
+		TX_FREE(*map);
+		*map = TOID_NULL(struct bptree_map);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_split -- (internal) splits the full child of the node at the
+ *	given position in two
+ */
+static void
+bptree_map_split(TOID(struct tree_map_node) node, unsigned i)
+{
+	TOID(struct tree_map_node) child;
+	TOID_ASSIGN(child, D_RO(node)->slots[i]);
+
+	TOID(struct tree_map_node) right = TX_ZNEW(struct tree_map_node);
+	struct tree_map_node *c = D_RW(child);
+	struct tree_map_node *r = D_RW(right);
+	unsigned mid = BPTREE_MAX_KEYS / 2;
+	uint64_t sep;
+
+	/* the keys moved to the new node are left behind as garbage */
+	bptree_map_snapshot(c, 0, 0, 0);
+
+	if (c->leaf) {
+		/* the first key of the right leaf is copied up */
+		r->leaf = 1;
+		r->n = c->n - mid;
+		memcpy(r->keys, &c->keys[mid], r->n * sizeof(r->keys[0]));
+		memcpy(r->slots, &c->slots[mid], r->n * sizeof(r->slots[0]));
+		r->slots[BPTREE_NEXT_LEAF] = c->slots[BPTREE_NEXT_LEAF];
+		sep = r->keys[0];
+
+		pmemobj_tx_add_range_direct(&c->slots[BPTREE_NEXT_LEAF],
+				sizeof(c->slots[0]));
+		c->slots[BPTREE_NEXT_LEAF] = right.oid;
+	} else {
+		/* the middle key is moved up */
+		r->n = c->n - mid - 1;
+		memcpy(r->keys, &c->keys[mid + 1], r->n * sizeof(r->keys[0]));
+		memcpy(r->slots, &c->slots[mid + 1],
+				(r->n + 1) * sizeof(r->slots[0]));
+		sep = c->keys[mid];
+	}
+
+	c->n = mid;
+
+	struct tree_map_node *p = D_RW(node);
+	unsigned shift = p->n - i;
+
+	bptree_map_snapshot(p, p->n + 1, i + 1, shift + 1);
+
+	memmove(&p->keys[i + 1], &p->keys[i], shift * sizeof(p->keys[0]));
+	memmove(&p->slots[i + 2], &p->slots[i + 1],
+			shift * sizeof(p->slots[0]));
+	p->keys[i] = sep;
+	p->slots[i + 1] = right.oid;
+	p->n++;
+}
+
+/*
+ * bptree_map_insert_leaf -- (internal) inserts or replaces a key-value pair in
+ *	the leaf that isn't full
+ */
+static void
+bptree_map_insert_leaf(TOID(struct tree_map_node) leaf,
+	uint64_t key, PMEMoid value)
+{
+	struct tree_map_node *l = D_RW(leaf);
+	unsigned pos = bptree_map_lower_bound(l, key);
+
+	if (pos != l->n && l->keys[pos] == key) {
+		pmemobj_tx_add_range_direct(&l->slots[pos],
+				sizeof(l->slots[0]));
+		l->slots[pos] = value;
+		return;
+	}
+
+	unsigned shift = l->n - pos;
+
+	bptree_map_snapshot(l, l->n + 1, pos, shift + 1);
+
+	memmove(&l->keys[pos + 1], &l->keys[pos], shift * sizeof(l->keys[0]));
+	memmove(&l->slots[pos + 1], &l->slots[pos],
+			shift * sizeof(l->slots[0]));
+	l->keys[pos] = key;
+	l->slots[pos] = value;
+	l->n++;
+}
+
+/*
+ * bptree_map_insert -- inserts a new key-value pair into the map
+ *
+ * The full nodes on the path are split on the way down, so that there's
+ * always room for the key to be moved up.
+ */
+int
+bptree_map_insert(PMEMobjpool *pop, TOID(struct bptree_map) map,
+	uint64_t key, PMEMoid value)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		TOID(struct tree_map_node) node = D_RO(map)->root;
+
+		if (TOID_IS_NULL(node)) {
+			node = TX_ZNEW(struct tree_map_node);
+			D_RW(node)->leaf = 1;
+			TX_SET(map, root, node);
+		} else if (D_RO(node)->n == BPTREE_MAX_KEYS) {
+			TOID(struct tree_map_node) new_root =
+				TX_ZNEW(struct tree_map_node);
+			D_RW(new_root)->slots[0] = node.oid;
+			bptree_map_split(new_root, 0);
+			TX_SET(map, root, new_root);
+			node = new_root;
+		}
+
+		while (!D_RO(node)->leaf) {
+			unsigned i = bptree_map_upper_bound(D_RO(node), key);
+			TOID(struct tree_map_node) child;
+			TOID_ASSIGN(child, D_RO(node)->slots[i]);
+
+			if (D_RO(child)->n == BPTREE_MAX_KEYS) {
+				bptree_map_split(node, i);
+				if (key >= D_RO(node)->keys[i])
+					i++;
+				TOID_ASSIGN(child, D_RO(node)->slots[i]);
+			}
+
+			node = child;
+		}
+
+		bptree_map_insert_leaf(node, key, value);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_insert_new -- allocates a new object and inserts it into the tree
+ */
+int
+bptree_map_insert_new(PMEMobjpool *pop, TOID(struct bptree_map) map,
+		uint64_t key, size_t size, unsigned type_num,
+		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
+		void *arg)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		PMEMoid n = pmemobj_tx_alloc(size, type_num);
+		constructor(pop, pmemobj_direct(n), arg);
+		bptree_map_insert(pop, map, key, n);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_remove -- removes key-value pair from the map
+ */
+PMEMoid
+bptree_map_remove(PMEMobjpool *pop, TOID(struct bptree_map) map, uint64_t key)
+{
+	PMEMoid ret = OID_NULL;
+
+	TOID(struct tree_map_node) leaf = bptree_map_find_leaf(map, key);
+	if (TOID_IS_NULL(leaf))
+		return ret;
+
+	unsigned pos = bptree_map_lower_bound(D_RO(leaf), key);
+	if (pos == D_RO(leaf)->n || D_RO(leaf)->keys[pos] != key)
+		return ret;
+
+	ret = D_RO(leaf)->slots[pos];
+
+	TX_BEGIN(pop) {
+		struct tree_map_node *l = D_RW(leaf);
+		unsigned shift = l->n - pos - 1;
+
+		bptree_map_snapshot(l, l->n, pos, shift + 1);
+
+		memmove(&l->keys[pos], &l->keys[pos + 1],
+				shift * sizeof(l->keys[0]));
+		memmove(&l->slots[pos], &l->slots[pos + 1],
+				shift * sizeof(l->slots[0]));
+		l->n--;
+	} TX_ONABORT {
+		ret = OID_NULL;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_remove_free -- removes and frees an object from the tree
+ */
+int
+bptree_map_remove_free(PMEMobjpool *pop, TOID(struct bptree_map) map,
+		uint64_t key)
+{
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		PMEMoid val = bptree_map_remove(pop, map, key);
+		pmemobj_tx_free(val);
+	} TX_ONABORT {
+		ret = 1;
+	} TX_END
+
+	return ret;
+}
+
+/*
+ * bptree_map_get -- searches for a value of the key
+ */
+PMEMoid
+bptree_map_get(PMEMobjpool *pop, TOID(struct bptree_map) map, uint64_t key)
+{
+	TOID(struct tree_map_node) leaf = bptree_map_find_leaf(map, key);
+	if (TOID_IS_NULL(leaf))
+		return OID_NULL;
+
+	unsigned pos = bptree_map_lower_bound(D_RO(leaf), key);
+	if (pos == D_RO(leaf)->n || D_RO(leaf)->keys[pos] != key)
+		return OID_NULL;
+
+	return D_RO(leaf)->slots[pos];
+}
+
+/*
+ * bptree_map_lookup -- searches if a key exists
+ */
+int
+bptree_map_lookup(PMEMobjpool *pop, TOID(struct bptree_map) map,
+		uint64_t key)
+{
+	TOID(struct tree_map_node) leaf = bptree_map_find_leaf(map, key);
+	if (TOID_IS_NULL(leaf))
+		return 0;
+
+	unsigned pos = bptree_map_lower_bound(D_RO(leaf), key);
+
+	return pos != D_RO(leaf)->n && D_RO(leaf)->keys[pos] == key;
+}
+
+/*
+ * bptree_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ */
+int
+bptree_map_range(PMEMobjpool *pop, TOID(struct bptree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	if (min > max)
+		return 0;
+
+	TOID(struct tree_map_node) leaf = bptree_map_find_leaf(map, min);
+	unsigned pos = TOID_IS_NULL(leaf) ? 0 :
+		bptree_map_lower_bound(D_RO(leaf), min);
+
+	while (!TOID_IS_NULL(leaf)) {
+		const struct tree_map_node *l = D_RO(leaf);
+		for (; pos < l->n; ++pos) {
+			if (l->keys[pos] > max)
+				return 0;
+
+			int ret = cb(l->keys[pos], l->slots[pos], arg);
+			if (ret != 0)
+				return ret;
+		}
+
+		TOID_ASSIGN(leaf, l->slots[BPTREE_NEXT_LEAF]);
+		pos = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * bptree_map_foreach -- calls the callback for each key, in ascending order
+ */
+int
+bptree_map_foreach(PMEMobjpool *pop, TOID(struct bptree_map) map,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	return bptree_map_range(pop, map, 0, UINT64_MAX, cb, arg);
+}
+
+/*
+ * bptree_map_seek -- finds the smallest key that is not less than the given
+ *	one
+ */
+int
+bptree_map_seek(PMEMobjpool *pop, TOID(struct bptree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct tree_map_node) leaf = bptree_map_find_leaf(map, key);
+	unsigned pos = TOID_IS_NULL(leaf) ? 0 :
+		bptree_map_lower_bound(D_RO(leaf), key);
+
+	/* skip the leaves emptied by the removals */
+	while (!TOID_IS_NULL(leaf)) {
+		if (pos < D_RO(leaf)->n) {
+			*found = D_RO(leaf)->keys[pos];
+			*value = D_RO(leaf)->slots[pos];
+			return 1;
+		}
+
+		TOID_ASSIGN(leaf, D_RO(leaf)->slots[BPTREE_NEXT_LEAF]);
+		pos = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * bptree_map_is_empty -- checks whether the tree map is empty
+ */
+int
+bptree_map_is_empty(PMEMobjpool *pop, TOID(struct bptree_map) map)
+{
+	uint64_t key;
+	PMEMoid value;
+
+	return !bptree_map_seek(pop, map, 0, &key, &value);
+}
+
+/*
+ * bptree_map_check -- check if given persistent object is a tree map
+ */
+int
+bptree_map_check(PMEMobjpool *pop, TOID(struct bptree_map) map)
+{
+	return TOID_IS_NULL(map) || !TOID_VALID(map);
+}
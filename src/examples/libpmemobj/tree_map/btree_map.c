@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include "btree_map.h"
 
 TOID_DECLARE(struct tree_map_node, BTREE_MAP_TYPE_OFFSET + 1);
@@ -307,6 +308,149 @@ btree_map_insert(PMEMobjpool *pop, TOID(struct btree_map) map,
 	return 0;
 }
 
+/* maximum height of a tree built by bulk loading */
+#define BTREE_BULK_MAX_LEVELS 32
+
+/*
+ * btree_map_bulk -- (internal) state of the bulk loading, the rightmost node
+ *	of each level of the tree being built
+ */
+struct btree_map_bulk {
+	TOID(struct tree_map_node) nodes[BTREE_BULK_MAX_LEVELS];
+	int levels;
+};
+
+/*
+ * btree_map_bulk_add -- (internal) appends the item to the tree being built
+ *
+ * The item goes to the lowest level whose rightmost node isn't full yet,
+ * and new rightmost nodes are started on all the levels below it. The nodes
+ * are new in this transaction, so they aren't snapshotted.
+ */
+static void
+btree_map_bulk_add(struct btree_map_bulk *b, struct tree_map_node_item item)
+{
+	int level = 0;
+	while (level < b->levels &&
+			D_RO(b->nodes[level])->n == BTREE_ORDER - 1)
+		level++;
+
+	if (level == b->levels) {
+		if (b->levels == BTREE_BULK_MAX_LEVELS)
+			pmemobj_tx_abort(ENOMEM);
+
+		TOID(struct tree_map_node) root =
+			TX_ZNEW(struct tree_map_node);
+		if (b->levels != 0)
+			D_RW(root)->slots[0] = b->nodes[b->levels - 1];
+		b->nodes[b->levels++] = root;
+	}
+
+	struct tree_map_node *node = D_RW(b->nodes[level]);
+	node->items[node->n++] = item;
+
+	for (int l = level - 1; l >= 0; --l) {
+		struct tree_map_node *parent = D_RW(b->nodes[l + 1]);
+		b->nodes[l] = TX_ZNEW(struct tree_map_node);
+		parent->slots[parent->n] = b->nodes[l];
+	}
+}
+
+/*
+ * btree_map_bulk_rebalance -- (internal) evenly redistributes the items of
+ *	the two last children of the node, together with their separator
+ */
+static void
+btree_map_bulk_rebalance(TOID(struct tree_map_node) node)
+{
+	struct tree_map_node *p = D_RW(node);
+	int i = p->n - 1;
+	struct tree_map_node *l = D_RW(p->slots[i]);
+	struct tree_map_node *r = D_RW(p->slots[i + 1]);
+
+	struct tree_map_node_item items[2 * BTREE_ORDER - 1];
+	TOID(struct tree_map_node) slots[2 * BTREE_ORDER];
+	int n = 0;
+
+	for (int j = 0; j < l->n; ++j) {
+		slots[n] = l->slots[j];
+		items[n++] = l->items[j];
+	}
+	slots[n] = l->slots[l->n];
+	items[n++] = p->items[i];
+	for (int j = 0; j < r->n; ++j) {
+		slots[n] = r->slots[j];
+		items[n++] = r->items[j];
+	}
+	slots[n] = r->slots[r->n];
+
+	int k = n / 2;
+
+	memset(l->items, 0, sizeof(l->items));
+	memset(l->slots, 0, sizeof(l->slots));
+	l->n = k;
+	memcpy(l->items, items, (size_t)k * sizeof(items[0]));
+	memcpy(l->slots, slots, (size_t)(k + 1) * sizeof(slots[0]));
+
+	p->items[i] = items[k];
+
+	memset(r->items, 0, sizeof(r->items));
+	memset(r->slots, 0, sizeof(r->slots));
+	r->n = n - k - 1;
+	memcpy(r->items, &items[k + 1], (size_t)r->n * sizeof(items[0]));
+	memcpy(r->slots, &slots[k + 1], (size_t)(r->n + 1) * sizeof(slots[0]));
+}
+
+/*
+ * btree_map_bulk_load -- builds the tree from a stream of key-value pairs
+ *	sorted by the key, in one transaction
+ *
+ * The map has to be empty. The tree is built bottom-up from full nodes,
+ * so none of the nodes is split or snapshotted, and only the root of the
+ * map is published at the end.
+ */
+int
+btree_map_bulk_load(PMEMobjpool *pop, TOID(struct btree_map) map,
+	int (*next)(uint64_t *key, PMEMoid *value, void *arg), void *arg)
+{
+	if (!btree_map_is_empty(pop, map)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		struct btree_map_bulk b = {.levels = 0};
+		struct tree_map_node_item item;
+		uint64_t last = 0;
+
+		while (next(&item.key, &item.value, arg)) {
+			if (b.levels != 0 && item.key <= last)
+				pmemobj_tx_abort(EINVAL);
+
+			btree_map_bulk_add(&b, item);
+			last = item.key;
+		}
+
+		/* the rightmost nodes may be left with too few items */
+		for (int l = b.levels - 1; l > 0; --l) {
+			if (D_RO(b.nodes[l - 1])->n < BTREE_MIN)
+				btree_map_bulk_rebalance(b.nodes[l]);
+		}
+
+		if (b.levels != 0) {
+			if (!TOID_IS_NULL(D_RO(map)->root))
+				TX_FREE(D_RO(map)->root);
+			TX_SET(map, root, b.nodes[b.levels - 1]);
+		}
+	} TX_ONABORT {
+		ret = -1;
+	} TX_END
+
+	return ret;
+}
+
 /*
  * btree_map_rotate_right -- (internal) takes one element from right sibling
  */
@@ -621,6 +765,92 @@ btree_map_foreach(PMEMobjpool *pop, TOID(struct btree_map) map,
 	return btree_map_foreach_node(D_RO(map)->root, cb, arg);
 }
 
+/*
+ * btree_map_range_node -- (internal) recursively traverses the part of the
+ *	tree that can hold keys from the [min, max] range
+ */
+static int
+btree_map_range_node(const TOID(struct tree_map_node) p,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid, void *arg), void *arg)
+{
+	if (TOID_IS_NULL(p))
+		return 0;
+
+	for (int i = 0; i <= D_RO(p)->n; ++i) {
+		/* the subtree left of an item holds only smaller keys */
+		if (i == D_RO(p)->n || D_RO(p)->items[i].key > min) {
+			if (btree_map_range_node(D_RO(p)->slots[i],
+					min, max, cb, arg) != 0)
+				return 1;
+		}
+
+		if (i == D_RO(p)->n)
+			break;
+
+		uint64_t key = D_RO(p)->items[i].key;
+		if (key > max)
+			break;
+
+		if (key >= min && key != 0) {
+			if (cb(key, D_RO(p)->items[i].value, arg) != 0)
+				return 1;
+		}
+
+		if (key == max)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * btree_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ */
+int
+btree_map_range(PMEMobjpool *pop, TOID(struct btree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	if (min > max)
+		return 0;
+
+	return btree_map_range_node(D_RO(map)->root, min, max, cb, arg);
+}
+
+/*
+ * btree_map_seek -- finds the smallest key that is not less than the given one
+ */
+int
+btree_map_seek(PMEMobjpool *pop, TOID(struct btree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	int ret = 0;
+	TOID(struct tree_map_node) p = D_RO(map)->root;
+
+	/* the best candidate found so far is refined on the way down */
+	while (!TOID_IS_NULL(p)) {
+		int i;
+		for (i = 0; i < D_RO(p)->n; ++i) {
+			if (D_RO(p)->items[i].key >= key)
+				break;
+		}
+
+		if (i != D_RO(p)->n && D_RO(p)->items[i].key != 0) {
+			*found = D_RO(p)->items[i].key;
+			*value = D_RO(p)->items[i].value;
+			ret = 1;
+
+			if (*found == key)
+				break;
+		}
+
+		p = D_RO(p)->slots[i];
+	}
+
+	return ret;
+}
+
 /*
  * ctree_map_check -- check if given persistent object is a tree map
  */
@@ -55,6 +55,8 @@ int btree_map_insert_new(PMEMobjpool *pop, TOID(struct btree_map) map,
 		uint64_t key, size_t size, unsigned type_num,
 		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
 		void *arg);
+int btree_map_bulk_load(PMEMobjpool *pop, TOID(struct btree_map) map,
+	int (*next)(uint64_t *key, PMEMoid *value, void *arg), void *arg);
 PMEMoid btree_map_remove(PMEMobjpool *pop, TOID(struct btree_map) map,
 		uint64_t key);
 int btree_map_remove_free(PMEMobjpool *pop, TOID(struct btree_map) map,
@@ -66,6 +68,11 @@ int btree_map_lookup(PMEMobjpool *pop, TOID(struct btree_map) map,
 		uint64_t key);
 int btree_map_foreach(PMEMobjpool *pop, TOID(struct btree_map) map,
 	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int btree_map_range(PMEMobjpool *pop, TOID(struct btree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int btree_map_seek(PMEMobjpool *pop, TOID(struct btree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value);
 int btree_map_is_empty(PMEMobjpool *pop, TOID(struct btree_map) map);
 
 #endif /* BTREE_MAP_H */
@@ -91,6 +91,9 @@ ctree_map_new(PMEMobjpool *pop, TOID(struct ctree_map) *map, void *arg)
 static void
 ctree_map_clear_node(PMEMoid p)
 {
+	if (OID_IS_NULL(p))
+		return;
+
 	if (OID_INSTANCEOF(p, struct tree_map_node)) {
 		TOID(struct tree_map_node) node;
 		TOID_ASSIGN(node, p);
@@ -229,6 +232,77 @@ ctree_map_insert(PMEMobjpool *pop, TOID(struct ctree_map) map,
 	return ret;
 }
 
+/*
+ * ctree_map_bulk_load -- builds the tree from a stream of key-value pairs
+ *	sorted by the key, in one transaction
+ *
+ * The map has to be empty. Every key is greater than all the keys before it,
+ * so it always becomes the rightmost leaf and only the right spine of the
+ * tree has to be tracked. The nodes are new in this transaction, so they
+ * aren't snapshotted, and only the root of the map is published at the end.
+ */
+int
+ctree_map_bulk_load(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	int (*next)(uint64_t *key, PMEMoid *value, void *arg), void *arg)
+{
+	if (!OID_IS_NULL(D_RO(map)->root.slot)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+
+	TX_BEGIN(pop) {
+		struct tree_map_entry root = {0, OID_NULL};
+
+		/* the entries on the right spine, the last one is a leaf */
+		struct tree_map_entry *spine[65] = {&root};
+		int top = -1;
+
+		struct tree_map_entry e;
+		while (next(&e.key, &e.slot, arg)) {
+			if (top == -1) {
+				root = e;
+				top = 0;
+				continue;
+			}
+
+			uint64_t last = spine[top]->key;
+			if (e.key <= last)
+				pmemobj_tx_abort(EINVAL);
+
+			int diff = find_crit_bit(last, e.key);
+
+			/* the critical bits decrease along the spine */
+			TOID(struct tree_map_node) node;
+			while (top > 0) {
+				TOID_ASSIGN(node, spine[top - 1]->slot);
+				if (D_RO(node)->diff > diff)
+					break;
+				top--;
+			}
+
+			node = TX_NEW(struct tree_map_node);
+			D_RW(node)->diff = diff;
+			D_RW(node)->entries[0] = *spine[top];
+			D_RW(node)->entries[1] = e;
+
+			spine[top]->key = 0;
+			spine[top]->slot = node.oid;
+			spine[++top] = &D_RW(node)->entries[1];
+		}
+
+		if (top != -1) {
+			TX_ADD_FIELD(map, root);
+			D_RW(map)->root = root;
+		}
+	} TX_ONABORT {
+		ret = -1;
+	} TX_END
+
+	return ret;
+}
+
 /*
  * ctree_map_get_leaf -- (internal) searches for a leaf of the key
  */
@@ -354,9 +428,10 @@ ctree_map_foreach_node(struct tree_map_entry e,
 		TOID(struct tree_map_node) node;
 		TOID_ASSIGN(node, e.slot);
 
-		if (ctree_map_foreach_node(D_RO(node)->entries[0],
-					cb, arg) == 0)
-			ctree_map_foreach_node(D_RO(node)->entries[1], cb, arg);
+		if ((ret = ctree_map_foreach_node(D_RO(node)->entries[0],
+					cb, arg)) == 0)
+			ret = ctree_map_foreach_node(D_RO(node)->entries[1],
+					cb, arg);
 	} else { /* leaf */
 		ret = cb(e.key, e.slot, arg);
 	}
@@ -377,6 +452,105 @@ ctree_map_foreach(PMEMobjpool *pop, TOID(struct ctree_map) map,
 	return ctree_map_foreach_node(D_RO(map)->root, cb, arg);
 }
 
+/*
+ * ctree_map_range_node -- (internal) recursively traverses the part of the
+ *	tree that can hold keys from the [min, max] range
+ */
+static int
+ctree_map_range_node(struct tree_map_entry e, uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	if (!OID_INSTANCEOF(e.slot, struct tree_map_node)) { /* leaf */
+		if (e.key < min || e.key > max)
+			return 0;
+
+		return cb(e.key, e.slot, arg);
+	}
+
+	TOID(struct tree_map_node) node;
+	TOID_ASSIGN(node, e.slot);
+	int diff = D_RO(node)->diff;
+
+	/* all keys below this node share the bits above the critical one */
+	struct tree_map_entry leaf = D_RO(node)->entries[0];
+	while (OID_INSTANCEOF(leaf.slot, struct tree_map_node)) {
+		TOID(struct tree_map_node) n;
+		TOID_ASSIGN(n, leaf.slot);
+		leaf = D_RO(n)->entries[0];
+	}
+
+	uint64_t prefix = leaf.key & ~((2ULL << diff) - 1);
+	uint64_t low_bits = (1ULL << diff) - 1;
+
+	for (int d = 0; d < 2; ++d) {
+		uint64_t lo = prefix | ((uint64_t)d << diff);
+		uint64_t hi = lo | low_bits;
+
+		if (hi < min)
+			continue;
+		if (lo > max)
+			break;
+
+		int ret;
+		if (lo >= min && hi <= max)
+			ret = ctree_map_foreach_node(D_RO(node)->entries[d],
+					cb, arg);
+		else
+			ret = ctree_map_range_node(D_RO(node)->entries[d],
+					min, max, cb, arg);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * ctree_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ */
+int
+ctree_map_range(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	if (OID_IS_NULL(D_RO(map)->root.slot) || min > max)
+		return 0;
+
+	return ctree_map_range_node(D_RO(map)->root, min, max, cb, arg);
+}
+
+struct ctree_map_seek_arg {
+	uint64_t *found;
+	PMEMoid *value;
+};
+
+/*
+ * ctree_map_seek_cb -- (internal) stores the first visited key
+ */
+static int
+ctree_map_seek_cb(uint64_t key, PMEMoid value, void *arg)
+{
+	struct ctree_map_seek_arg *sarg = arg;
+	*sarg->found = key;
+	*sarg->value = value;
+
+	return 1;
+}
+
+/*
+ * ctree_map_seek -- finds the smallest key that is not less than the given one
+ */
+int
+ctree_map_seek(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	struct ctree_map_seek_arg sarg = {found, value};
+
+	return ctree_map_range(pop, map, key, UINT64_MAX,
+			ctree_map_seek_cb, &sarg);
+}
+
 /*
  * ctree_map_is_empty -- checks whether the tree map is empty
  */
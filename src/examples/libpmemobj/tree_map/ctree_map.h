@@ -55,6 +55,8 @@ int ctree_map_insert_new(PMEMobjpool *pop, TOID(struct ctree_map) map,
 		uint64_t key, size_t size, unsigned type_num,
 		void (*constructor)(PMEMobjpool *pop, void *ptr, void *arg),
 		void *arg);
+int ctree_map_bulk_load(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	int (*next)(uint64_t *key, PMEMoid *value, void *arg), void *arg);
 PMEMoid ctree_map_remove(PMEMobjpool *pop, TOID(struct ctree_map) map,
 		uint64_t key);
 int ctree_map_remove_free(PMEMobjpool *pop, TOID(struct ctree_map) map,
@@ -66,6 +68,11 @@ int ctree_map_lookup(PMEMobjpool *pop, TOID(struct ctree_map) map,
 		uint64_t key);
 int ctree_map_foreach(PMEMobjpool *pop, TOID(struct ctree_map) map,
 	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int ctree_map_range(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int ctree_map_seek(PMEMobjpool *pop, TOID(struct ctree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value);
 int ctree_map_is_empty(PMEMobjpool *pop, TOID(struct ctree_map) map);
 
 #endif /* CTREE_MAP_H */
@@ -478,7 +478,7 @@ rbtree_map_foreach_node(TOID(struct rbtree_map) map,
 	if ((ret = rbtree_map_foreach_node(map,
 		D_RO(p)->slots[RB_LEFT], cb, arg)) == 0) {
 		if ((ret = cb(D_RO(p)->key, D_RO(p)->value, arg)) == 0)
-			rbtree_map_foreach_node(map,
+			ret = rbtree_map_foreach_node(map,
 				D_RO(p)->slots[RB_RIGHT], cb, arg);
 	}
 
@@ -495,6 +495,84 @@ rbtree_map_foreach(PMEMobjpool *pop, TOID(struct rbtree_map) map,
 	return rbtree_map_foreach_node(map, RB_FIRST(map), cb, arg);
 }
 
+/*
+ * rbtree_map_range_node -- (internal) recursively traverses the part of the
+ *	tree that can hold keys from the [min, max] range
+ */
+static int
+rbtree_map_range_node(TOID(struct rbtree_map) map,
+	TOID(struct tree_map_node) p, uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	int ret = 0;
+
+	if (TOID_EQUALS(p, D_RO(map)->sentinel))
+		return 0;
+
+	uint64_t key = D_RO(p)->key;
+
+	if (key > min)
+		ret = rbtree_map_range_node(map, D_RO(p)->slots[RB_LEFT],
+				min, max, cb, arg);
+
+	if (ret == 0 && key >= min && key <= max)
+		ret = cb(key, D_RO(p)->value, arg);
+
+	if (ret == 0 && key < max)
+		ret = rbtree_map_range_node(map, D_RO(p)->slots[RB_RIGHT],
+				min, max, cb, arg);
+
+	return ret;
+}
+
+/*
+ * rbtree_map_range -- calls the callback for each key from the [min, max]
+ *	range, in ascending order
+ */
+int
+rbtree_map_range(PMEMobjpool *pop, TOID(struct rbtree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg)
+{
+	if (min > max)
+		return 0;
+
+	return rbtree_map_range_node(map, RB_FIRST(map), min, max, cb, arg);
+}
+
+/*
+ * rbtree_map_seek -- finds the smallest key that is not less than the given
+ *	one
+ */
+int
+rbtree_map_seek(PMEMobjpool *pop, TOID(struct rbtree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value)
+{
+	TOID(struct tree_map_node) dst = RB_FIRST(map);
+	TOID(struct tree_map_node) s = D_RO(map)->sentinel;
+	TOID(struct tree_map_node) best = s;
+
+	while (!NODE_IS_NULL(dst)) {
+		if (D_RO(dst)->key == key) {
+			best = dst;
+			break;
+		}
+
+		if (D_RO(dst)->key > key)
+			best = dst;
+
+		dst = D_RO(dst)->slots[key > D_RO(dst)->key];
+	}
+
+	if (NODE_IS_NULL(best))
+		return 0;
+
+	*found = D_RO(best)->key;
+	*value = D_RO(best)->value;
+
+	return 1;
+}
+
 /*
  * rbtree_map_is_empty -- checks whether the tree map is empty
  */
@@ -66,6 +66,11 @@ int rbtree_map_lookup(PMEMobjpool *pop, TOID(struct rbtree_map) map,
 		uint64_t key);
 int rbtree_map_foreach(PMEMobjpool *pop, TOID(struct rbtree_map) map,
 	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int rbtree_map_range(PMEMobjpool *pop, TOID(struct rbtree_map) map,
+	uint64_t min, uint64_t max,
+	int (*cb)(uint64_t key, PMEMoid value, void *arg), void *arg);
+int rbtree_map_seek(PMEMobjpool *pop, TOID(struct rbtree_map) map,
+	uint64_t key, uint64_t *found, PMEMoid *value);
 int rbtree_map_is_empty(PMEMobjpool *pop, TOID(struct rbtree_map) map);
 
 #endif /* RBTREE_MAP_H */
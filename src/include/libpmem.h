@@ -47,6 +47,7 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <sys/types.h>
 
 /*
@@ -56,6 +57,7 @@ extern "C" {
 #define PMEM_FILE_EXCL		(1 << 1)
 #define PMEM_FILE_SPARSE	(1 << 2)
 #define PMEM_FILE_TMPFILE	(1 << 3)
+#define PMEM_FILE_POPULATE	(1 << 4)
 
 void *pmem_map_file(const char *path, size_t len, int flags, mode_t mode,
 	size_t *mapped_lenp, int *is_pmemp);
@@ -66,12 +68,36 @@ int pmem_msync(const void *addr, size_t len);
 void pmem_flush(const void *addr, size_t len);
 void pmem_drain(void);
 int pmem_has_hw_drain(void);
+
+/*
+ * range descriptor for pmem_flush_vec() and pmem_persist_vec()
+ */
+struct pmem_range {
+	const void *addr;
+	size_t len;
+};
+
+void pmem_flush_vec(const struct pmem_range *ranges, size_t nranges);
+void pmem_persist_vec(const struct pmem_range *ranges, size_t nranges);
 void *pmem_memmove_persist(void *pmemdest, const void *src, size_t len);
 void *pmem_memcpy_persist(void *pmemdest, const void *src, size_t len);
 void *pmem_memset_persist(void *pmemdest, int c, size_t len);
 void *pmem_memmove_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memcpy_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memset_nodrain(void *pmemdest, int c, size_t len);
+void *pmem_memcpy_from_pmem(void *dest, const void *pmemsrc, size_t len);
+
+/*
+ * flush and fence counts of the process, see pmem_stats_get()
+ */
+struct pmem_stats {
+	uint64_t flushes;	/* flush calls */
+	uint64_t flushed_lines;	/* cache lines flushed */
+	uint64_t fences;	/* drains */
+	uint64_t nt_bytes;	/* bytes stored with non-temporal stores */
+};
+
+int pmem_stats_get(struct pmem_stats *stats);
 
 /*
  * PMEM_MAJOR_VERSION and PMEM_MINOR_VERSION provide the current version of the
@@ -81,15 +81,74 @@ const char *pmemblk_check_version(
 PMEMblkpool *pmemblk_open(const char *path, size_t bsize);
 PMEMblkpool *pmemblk_create(const char *path, size_t bsize,
 		size_t poolsize, mode_t mode);
+
+/*
+ * Layout of the block translation metadata of a new pool, passed to
+ * pmemblk_create_layout().  Zero fields select the defaults.
+ */
+struct pmemblk_layout {
+	size_t arena_size;	/* size of an arena (bytes), 16MB .. 512GB */
+	unsigned nfree;		/* spare blocks (and max lanes) per arena */
+};
+
+PMEMblkpool *pmemblk_create_layout(const char *path, size_t bsize,
+		size_t poolsize, mode_t mode,
+		const struct pmemblk_layout *layout);
 void pmemblk_close(PMEMblkpool *pbp);
 int pmemblk_check(const char *path, size_t bsize);
 size_t pmemblk_bsize(PMEMblkpool *pbp);
 size_t pmemblk_nblock(PMEMblkpool *pbp);
 int pmemblk_read(PMEMblkpool *pbp, void *buf, long long blockno);
 int pmemblk_write(PMEMblkpool *pbp, const void *buf, long long blockno);
+
+/*
+ * An element of the vectors of blocks passed to pmemblk_readv() and
+ * pmemblk_writev().
+ */
+struct pmemblk_vec {
+	void *buf;		/* block sized buffer */
+	long long blockno;	/* number of the block */
+};
+
+int pmemblk_readv(PMEMblkpool *pbp, const struct pmemblk_vec *vec,
+		size_t cnt);
+int pmemblk_writev(PMEMblkpool *pbp, const struct pmemblk_vec *vec,
+		size_t cnt);
+int pmemblk_read_map(PMEMblkpool *pbp, long long blockno,
+		const void **addrp);
+int pmemblk_read_release(PMEMblkpool *pbp, int handle);
 int pmemblk_set_zero(PMEMblkpool *pbp, long long blockno);
+int pmemblk_set_zero_range(PMEMblkpool *pbp, long long blockno,
+		size_t nblock);
 int pmemblk_set_error(PMEMblkpool *pbp, long long blockno);
 
+/*
+ * Asynchronous block I/O.  Requests are submitted to a queue and carried out
+ * by the worker threads of the queue; finished requests are returned by
+ * pmemblk_queue_poll().
+ */
+typedef struct pmemblkqueue PMEMblkqueue;
+
+#define PMEMBLK_IO_READ 0
+#define PMEMBLK_IO_WRITE 1
+#define PMEMBLK_IO_SET_ZERO 2
+
+struct pmemblk_io {
+	int opcode;		/* PMEMBLK_IO_* */
+	void *buf;		/* block sized buffer, unused by SET_ZERO */
+	long long blockno;	/* number of the block */
+	int error;		/* 0 or errno value, set on completion */
+	void *arg;		/* not used by the library */
+};
+
+PMEMblkqueue *pmemblk_queue_new(PMEMblkpool *pbp, unsigned depth,
+		unsigned nthreads);
+void pmemblk_queue_delete(PMEMblkqueue *q);
+int pmemblk_queue_submit(PMEMblkqueue *q, struct pmemblk_io *const *ios,
+		unsigned n);
+int pmemblk_queue_poll(PMEMblkqueue *q, struct pmemblk_io **ios,
+		unsigned n, unsigned min);
+
 /*
  * Passing NULL to pmemblk_set_funcs() tells libpmemblk to continue to use the
  * default for that function.  The replacement functions must not make calls
@@ -54,6 +54,7 @@ extern "C" {
  * opaque type, internal to libpmemlog
  */
 typedef struct pmemlog PMEMlogpool;
+typedef struct pmemlogcursor PMEMlogcursor;
 
 /*
  * PMEMLOG_MAJOR_VERSION and PMEMLOG_MINOR_VERSION provide the current
@@ -75,16 +76,59 @@ const char *pmemlog_check_version(
 
 PMEMlogpool *pmemlog_open(const char *path);
 PMEMlogpool *pmemlog_create(const char *path, size_t poolsize, mode_t mode);
+PMEMlogpool *pmemlog_create_ring(const char *path, size_t poolsize,
+	mode_t mode);
+
+/*
+ * Layout of a new log memory pool, passed to pmemlog_create_layout().
+ * Zero fields select the defaults.
+ */
+struct pmemlog_layout {
+	int ring;		/* reuse the space released by truncation */
+	size_t index_interval;	/* bytes between index entries, 4096 min */
+	int framed;		/* store appends as checksummed records */
+};
+
+PMEMlogpool *pmemlog_create_layout(const char *path, size_t poolsize,
+	mode_t mode, const struct pmemlog_layout *layout);
 void pmemlog_close(PMEMlogpool *plp);
 int pmemlog_check(const char *path);
 size_t pmemlog_nbyte(PMEMlogpool *plp);
 int pmemlog_append(PMEMlogpool *plp, const void *buf, size_t count);
 int pmemlog_appendv(PMEMlogpool *plp, const struct iovec *iov, int iovcnt);
+
+/*
+ * An append to one of the log memory pools of a batch, passed to
+ * pmemlog_append_batch().
+ */
+struct pmemlog_append_op {
+	PMEMlogpool *plp;
+	const void *buf;
+	size_t count;
+};
+
+int pmemlog_append_batch(const struct pmemlog_append_op *ops, unsigned nops);
+void *pmemlog_reserve(PMEMlogpool *plp, size_t count);
+int pmemlog_commit(PMEMlogpool *plp, void *addr, size_t count);
 long long pmemlog_tell(PMEMlogpool *plp);
+long long pmemlog_head(PMEMlogpool *plp);
+int pmemlog_truncate_head(PMEMlogpool *plp, long long off);
+long long pmemlog_seek(PMEMlogpool *plp, long long off);
 void pmemlog_rewind(PMEMlogpool *plp);
 void pmemlog_walk(PMEMlogpool *plp, size_t chunksize,
 	int (*process_chunk)(const void *buf, size_t len, void *arg),
 	void *arg);
+int pmemlog_walk_parallel(PMEMlogpool *plp, unsigned nthreads,
+	size_t (*record_size)(const void *buf, size_t len, void *arg),
+	int (*process_chunk)(const void *buf, size_t len, void *arg),
+	void *arg);
+int pmemlog_walk_records(PMEMlogpool *plp,
+	int (*process_record)(const void *buf, size_t len, void *arg),
+	void *arg);
+
+PMEMlogcursor *pmemlog_cursor_new(PMEMlogpool *plp, long long off);
+ssize_t pmemlog_cursor_next(PMEMlogcursor *cur, void *buf, size_t count);
+void pmemlog_cursor_delete(PMEMlogcursor *cur);
 
 /*
  * Passing NULL to pmemlog_set_funcs() tells libpmemlog to continue to use the
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Persistent memory allocator for the standard containers.
+ */
+
+#ifndef PMEMOBJ_ALLOCATOR_HPP
+#define PMEMOBJ_ALLOCATOR_HPP
+
+#include "libpmemobj++/detail/common.hpp"
+#include "libpmemobj++/detail/pexceptions.hpp"
+#include "libpmemobj++/persistent_ptr.hpp"
+#include "libpmemobj/tx_base.h"
+
+#include <cstddef>
+#include <type_traits>
+
+namespace nvml
+{
+
+namespace obj
+{
+
+/**
+ * Persistent memory allocator.
+ *
+ * A standard allocator whose pointer type is the persistent_ptr, so the
+ * containers which keep their buffers and nodes by allocator pointers can be
+ * placed in persistent memory. The memory is allocated and freed
+ * transactionally, which means that both have to be called in a transaction
+ * and are rolled back with it. The small allocations are served from the
+ * per-lane caches of reserved blocks, without taking any heap locks.
+ *
+ * The allocator doesn't make the container itself transactional - the
+ * assignments of the persistent_ptrs are added to the transaction, but the
+ * modifications of the existing elements have to be added by the caller.
+ *
+ * All the instances are equal and stateless, the memory is allocated from the
+ * pool of the active transaction.
+ */
+template <typename T>
+class allocator {
+public:
+	typedef T value_type;
+	typedef persistent_ptr<T> pointer;
+	typedef persistent_ptr<const T> const_pointer;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::true_type is_always_equal;
+
+	template <typename U>
+	struct rebind {
+		typedef allocator<U> other;
+	};
+
+	allocator() noexcept = default;
+
+	/**
+	 * Converting constructor from the allocator of another type.
+	 */
+	template <typename U>
+	allocator(const allocator<U> &) noexcept
+	{
+	}
+
+	/**
+	 * Transactionally allocates memory for n objects of type T, without
+	 * constructing them.
+	 *
+	 * @throw transaction_scope_error if called outside of an active
+	 * transaction
+	 * @throw transaction_alloc_error on transactional allocation failure.
+	 */
+	pointer
+	allocate(size_type n)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw transaction_scope_error(
+				"refusing to allocate "
+				"memory outside of transaction scope");
+
+		if (n > max_size())
+			throw transaction_alloc_error("allocation too large");
+
+		pointer p = pmemobj_tx_alloc(sizeof(value_type) * n,
+					     detail::type_num<value_type>());
+
+		if (p == nullptr)
+			throw transaction_alloc_error("failed to allocate "
+						      "persistent memory object");
+
+		return p;
+	}
+
+	/**
+	 * Transactionally frees the memory pointed to by p, without
+	 * destroying the objects.
+	 *
+	 * @throw transaction_scope_error if called outside of an active
+	 * transaction
+	 * @throw transaction_alloc_error on transactional free failure.
+	 */
+	void
+	deallocate(pointer p, size_type = 0)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw transaction_scope_error(
+				"refusing to free "
+				"memory outside of transaction scope");
+
+		if (p == nullptr)
+			return;
+
+		if (pmemobj_tx_free(p.raw()) != 0)
+			throw transaction_alloc_error("failed to delete "
+						      "persistent memory object");
+	}
+
+	/**
+	 * Returns the largest number of objects in a single allocation.
+	 */
+	size_type
+	max_size() const noexcept
+	{
+		return PMEMOBJ_MAX_ALLOC_SIZE / sizeof(value_type);
+	}
+};
+
+/**
+ * All the allocators are equal.
+ */
+template <typename T, typename U>
+inline bool
+operator==(const allocator<T> &, const allocator<U> &) noexcept
+{
+	return true;
+}
+
+template <typename T, typename U>
+inline bool
+operator!=(const allocator<T> &, const allocator<U> &) noexcept
+{
+	return false;
+}
+
+} /* namespace obj */
+
+} /* namespace nvml */
+
+#endif /* PMEMOBJ_ALLOCATOR_HPP */
@@ -0,0 +1,851 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file
+ * Persistent memory resident concurrent hash map.
+ */
+
+#ifndef PMEMOBJ_CONCURRENT_HASH_MAP_HPP
+#define PMEMOBJ_CONCURRENT_HASH_MAP_HPP
+
+#include "libpmemobj++/detail/pexceptions.hpp"
+#include "libpmemobj++/make_persistent.hpp"
+#include "libpmemobj++/make_persistent_array.hpp"
+#include "libpmemobj++/mutex.hpp"
+#include "libpmemobj++/p.hpp"
+#include "libpmemobj++/persistent_ptr.hpp"
+#include "libpmemobj++/pool.hpp"
+#include "libpmemobj++/shared_mutex.hpp"
+#include "libpmemobj++/transaction.hpp"
+#include "libpmemobj/tx_base.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace nvml
+{
+
+namespace obj
+{
+
+/**
+ * Persistent memory resident concurrent hash map.
+ *
+ * The map is an unordered associative container which can be accessed
+ * and modified by many threads at the same time. It mimics the interface
+ * of the tbb::concurrent_hash_map - the elements are accessed through
+ * accessors, which hold a lock of the element for as long as they point
+ * to it.
+ *
+ * The elements are kept in buckets, each with its own shared_mutex and
+ * a list of the elements, so only the operations on the same bucket wait
+ * for each other. The lookups take the bucket lock in shared mode, while
+ * the number of buckets and the table of buckets are read without any locks.
+ * The table grows by segments, each as big as all the previous ones
+ * together, and the elements are moved to the new buckets lazily - a new
+ * bucket takes its elements from its parent bucket when it is first accessed.
+ * Neither the growth nor the rehashing stop the operations on other
+ * buckets.
+ *
+ * Each insert and erase is a separate transaction, which makes the map
+ * consistent after a crash, with the exception of the number of elements
+ * which has to be recalculated with runtime_initialize().
+ *
+ * The map has to be allocated with make_persistent() and the elements
+ * with non-trivial members should use the p<> property and persistent_ptr<>,
+ * like any other persistent object. Since the locks of the buckets aren't a
+ * part of transactions, the operations of the map can't be called within a
+ * transaction, and a thread shouldn't call them while it holds an accessor.
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>,
+	  typename KeyEqual = std::equal_to<Key>>
+class concurrent_hash_map {
+public:
+	typedef Key key_type;
+	typedef T mapped_type;
+	typedef std::pair<const Key, T> value_type;
+	typedef std::size_t size_type;
+	typedef Hash hasher;
+	typedef KeyEqual key_equal;
+
+private:
+	struct node {
+		node(const persistent_ptr<node> &n, const Key &key)
+		    : next(n),
+		      item(std::piecewise_construct, std::forward_as_tuple(key),
+			   std::forward_as_tuple())
+		{
+		}
+
+		node(const persistent_ptr<node> &n, const value_type &value)
+		    : next(n), item(value)
+		{
+		}
+
+		persistent_ptr<node> next;
+		value_type item;
+	};
+
+	struct bucket {
+		bucket() : rehashed(0)
+		{
+		}
+
+		shared_mutex mtx;
+
+		/* zero until the elements are taken from the parent bucket */
+		p<uint64_t> rehashed;
+
+		persistent_ptr<node> head;
+	};
+
+	/* number of buckets in the first segment */
+	static constexpr size_type first_block_bits = 3;
+	static constexpr size_type first_block = size_type(1)
+		<< first_block_bits;
+
+	static constexpr size_type max_segments = 64 - first_block_bits + 1;
+
+public:
+	/**
+	 * Access to an element of the map for reading.
+	 *
+	 * Holds the lock of the element until it is released or destroyed.
+	 */
+	class const_accessor {
+		friend class concurrent_hash_map;
+
+	public:
+		/**
+		 * Default constructor, points to no element.
+		 */
+		const_accessor() noexcept
+		    : my_node(nullptr), my_mtx(nullptr), my_write(false)
+		{
+		}
+
+		const_accessor(const const_accessor &) = delete;
+		const_accessor &operator=(const const_accessor &) = delete;
+
+		/**
+		 * Releases the element.
+		 */
+		~const_accessor()
+		{
+			release();
+		}
+
+		/**
+		 * Checks whether the accessor points to no element.
+		 */
+		bool
+		empty() const noexcept
+		{
+			return my_node == nullptr;
+		}
+
+		/**
+		 * Unlocks the element and makes the accessor empty.
+		 *
+		 * @throw lock_error when unlocking the element failed.
+		 */
+		void
+		release()
+		{
+			if (my_mtx == nullptr)
+				return;
+
+			shared_mutex *mtx = my_mtx;
+			my_node = nullptr;
+			my_mtx = nullptr;
+
+			if (my_write)
+				mtx->unlock();
+			else
+				mtx->unlock_shared();
+		}
+
+		/**
+		 * Returns the element the accessor points to.
+		 */
+		const value_type &operator*() const noexcept
+		{
+			return my_node->item;
+		}
+
+		/**
+		 * Member access to the element the accessor points to.
+		 */
+		const value_type *operator->() const noexcept
+		{
+			return &my_node->item;
+		}
+
+	protected:
+		void
+		acquire(node *n, bucket *b, bool write) noexcept
+		{
+			my_node = n;
+			my_mtx = &b->mtx;
+			my_write = write;
+		}
+
+		node *my_node;
+		shared_mutex *my_mtx;
+		bool my_write;
+	};
+
+	/**
+	 * Access to an element of the map for writing.
+	 *
+	 * Holds the exclusive lock of the element until it is released or
+	 * destroyed. The element should be modified in a transaction.
+	 */
+	class accessor : public const_accessor {
+	public:
+		/**
+		 * Returns the element the accessor points to.
+		 */
+		value_type &operator*() const noexcept
+		{
+			return this->my_node->item;
+		}
+
+		/**
+		 * Member access to the element the accessor points to.
+		 */
+		value_type *operator->() const noexcept
+		{
+			return &this->my_node->item;
+		}
+	};
+
+	/**
+	 * Constructs an empty map.
+	 *
+	 * Has to be called in a transaction, by make_persistent().
+	 *
+	 * @throw transaction_alloc_error when the allocation of the buckets
+	 * failed.
+	 */
+	concurrent_hash_map() : mask(first_block - 1), nelements(0)
+	{
+		segments[0] = make_persistent<bucket[]>(first_block);
+		for (size_type i = 0; i < first_block; ++i)
+			segments[0][i].rehashed = 1;
+	}
+
+	concurrent_hash_map(const concurrent_hash_map &) = delete;
+	concurrent_hash_map &operator=(const concurrent_hash_map &) = delete;
+
+	/**
+	 * Destroys all the elements and frees the buckets.
+	 *
+	 * Has to be called in a transaction, by delete_persistent(). A failure
+	 * aborts the transaction.
+	 */
+	~concurrent_hash_map()
+	{
+		for (size_type s = 0; s < max_segments; ++s) {
+			if (segments[s] == nullptr)
+				continue;
+
+			bucket *b = segments[s].get();
+			for (size_type i = 0; i < segment_size(s); ++i) {
+				free_chain(b[i].head);
+				b[i].~bucket();
+			}
+
+			pmemobj_tx_free(segments[s].raw());
+		}
+	}
+
+	/**
+	 * Recalculates the number of elements after the pool is opened.
+	 *
+	 * It's needed only when the application wasn't shut down cleanly,
+	 * because then the number might not include the elements inserted
+	 * or erased just before the crash. Can't be called concurrently with
+	 * other operations.
+	 */
+	void
+	runtime_initialize()
+	{
+		size_type n = 0;
+		size_type m = mask.load(std::memory_order_acquire);
+		for (size_type i = 0; i <= m; ++i)
+			for (node *e = get_bucket(i).head.get(); e != nullptr;
+			     e = e->next.get())
+				++n;
+
+		nelements.store(n, std::memory_order_relaxed);
+		get_pool().persist(&nelements, sizeof(nelements));
+	}
+
+	/**
+	 * Returns the number of elements in the map.
+	 */
+	size_type
+	size() const noexcept
+	{
+		return nelements.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Checks whether the map is empty.
+	 */
+	bool
+	empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	/**
+	 * Returns the number of buckets of the map.
+	 */
+	size_type
+	bucket_count() const noexcept
+	{
+		return mask.load(std::memory_order_relaxed) + 1;
+	}
+
+	/**
+	 * Finds the element with the given key and locks it for reading.
+	 *
+	 * @return true if the element was found, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the rehashing of a bucket failed.
+	 */
+	bool
+	find(const_accessor &result, const Key &key) const
+	{
+		return lookup(result, key, false);
+	}
+
+	/**
+	 * Finds the element with the given key and locks it for writing.
+	 *
+	 * @return true if the element was found, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the rehashing of a bucket failed.
+	 */
+	bool
+	find(accessor &result, const Key &key)
+	{
+		return lookup(result, key, true);
+	}
+
+	/**
+	 * Returns the number of the elements with the given key, one or zero.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the rehashing of a bucket failed.
+	 */
+	size_type
+	count(const Key &key) const
+	{
+		const_accessor acc;
+
+		return lookup(acc, key, false) ? 1 : 0;
+	}
+
+	/**
+	 * Inserts an element with the given key and a default constructed
+	 * value, unless the key is already in the map, and locks the element
+	 * for reading.
+	 *
+	 * @return true if the element was inserted, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the insertion failed.
+	 */
+	bool
+	insert(const_accessor &result, const Key &key)
+	{
+		result.release();
+
+		return insert_node(&result, key, key);
+	}
+
+	/**
+	 * Inserts an element with the given key and a default constructed
+	 * value, unless the key is already in the map, and locks the element
+	 * for writing.
+	 *
+	 * @return true if the element was inserted, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the insertion failed.
+	 */
+	bool
+	insert(accessor &result, const Key &key)
+	{
+		result.release();
+
+		return insert_node(&result, key, key);
+	}
+
+	/**
+	 * Inserts a copy of the given element, unless its key is already in
+	 * the map, and locks the element for reading.
+	 *
+	 * @return true if the element was inserted, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the insertion failed.
+	 */
+	bool
+	insert(const_accessor &result, const value_type &value)
+	{
+		result.release();
+
+		return insert_node(&result, value.first, value);
+	}
+
+	/**
+	 * Inserts a copy of the given element, unless its key is already in
+	 * the map, and locks the element for writing.
+	 *
+	 * @return true if the element was inserted, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the insertion failed.
+	 */
+	bool
+	insert(accessor &result, const value_type &value)
+	{
+		result.release();
+
+		return insert_node(&result, value.first, value);
+	}
+
+	/**
+	 * Inserts a copy of the given element, unless its key is already in
+	 * the map.
+	 *
+	 * @return true if the element was inserted, false otherwise.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the insertion failed.
+	 */
+	bool
+	insert(const value_type &value)
+	{
+		return insert_node(nullptr, value.first, value);
+	}
+
+	/**
+	 * Erases the element with the given key.
+	 *
+	 * @return true if the element was erased, false if it wasn't found.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw lock_error when locking the element failed.
+	 * @throw transaction_error when the erasure failed.
+	 */
+	bool
+	erase(const Key &key)
+	{
+		check_tx_stage();
+
+		bucket *b;
+		bool write = true;
+		persistent_ptr<node> *prev;
+		if (acquire(key, b, write, &prev) == nullptr) {
+			unlock_bucket(b, write);
+			return false;
+		}
+
+		try {
+			pool_base pop = get_pool();
+			transaction::exec_tx(pop, [&]() {
+				persistent_ptr<node> e = *prev;
+				*prev = e->next;
+				delete_persistent<node>(e);
+			});
+		} catch (...) {
+			unlock_bucket(b, write);
+			throw;
+		}
+
+		unlock_bucket(b, write);
+
+		nelements.fetch_sub(1, std::memory_order_relaxed);
+		get_pool().persist(&nelements, sizeof(nelements));
+
+		return true;
+	}
+
+	/**
+	 * Erases all the elements of the map, in a single transaction.
+	 *
+	 * Can't be called concurrently with other operations.
+	 *
+	 * @throw transaction_scope_error if called in a transaction.
+	 * @throw transaction_error when the erasure failed.
+	 */
+	void
+	clear()
+	{
+		check_tx_stage();
+
+		pool_base pop = get_pool();
+		transaction::exec_tx(pop, [&]() {
+			size_type m = mask.load(std::memory_order_relaxed);
+			for (size_type i = 0; i <= m; ++i) {
+				bucket &b = get_bucket(i);
+				while (b.head != nullptr) {
+					persistent_ptr<node> e = b.head;
+					b.head = e->next;
+					delete_persistent<node>(e);
+				}
+			}
+		});
+
+		nelements.store(0, std::memory_order_relaxed);
+		pop.persist(&nelements, sizeof(nelements));
+	}
+
+private:
+	/*
+	 * Returns the index of the highest bit set in x.
+	 */
+	static size_type
+	log2_floor(uint64_t x) noexcept
+	{
+#ifdef _MSC_VER
+		unsigned long j;
+		_BitScanReverse64(&j, x);
+		return j;
+#else
+		return 63 - static_cast<size_type>(__builtin_clzll(x));
+#endif
+	}
+
+	static size_type
+	segment_index(size_type b) noexcept
+	{
+		return b < first_block ? 0 : log2_floor(b) - first_block_bits +
+				1;
+	}
+
+	static size_type
+	segment_base(size_type s) noexcept
+	{
+		return s == 0 ? 0 : size_type(1) << (s + first_block_bits - 1);
+	}
+
+	static size_type
+	segment_size(size_type s) noexcept
+	{
+		return s == 0 ? first_block : segment_base(s);
+	}
+
+	static void
+	check_tx_stage()
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw transaction_scope_error(
+				"concurrent_hash_map can't be used within "
+				"a transaction");
+	}
+
+	/*
+	 * Frees the list of elements, from the destructor.
+	 */
+	static void
+	free_chain(const persistent_ptr<node> &head) noexcept
+	{
+		persistent_ptr<node> e = head;
+		while (e != nullptr) {
+			persistent_ptr<node> next = e->next;
+			e->~node();
+			pmemobj_tx_free(e.raw());
+			e = next;
+		}
+	}
+
+	pool_base
+	get_pool() const noexcept
+	{
+		return pool_base(pmemobj_pool_by_ptr(this));
+	}
+
+	bucket &
+	get_bucket(size_type b) const noexcept
+	{
+		size_type s = segment_index(b);
+
+		return segments[s].get()[b - segment_base(s)];
+	}
+
+	static void
+	lock_bucket(bucket *b, bool write)
+	{
+		if (write)
+			b->mtx.lock();
+		else
+			b->mtx.lock_shared();
+	}
+
+	static void
+	unlock_bucket(bucket *b, bool write)
+	{
+		if (write)
+			b->mtx.unlock();
+		else
+			b->mtx.unlock_shared();
+	}
+
+	/*
+	 * Moves the elements which belong to the bucket from its parent bucket,
+	 * the one without the highest bit of the index. The bucket has to be
+	 * locked exclusively.
+	 */
+	void
+	rehash_bucket(bucket &b, size_type idx) const
+	{
+		size_type level = log2_floor(idx);
+		size_type parent_idx = idx - (size_type(1) << level);
+		size_type level_mask = (size_type(2) << level) - 1;
+
+		bucket &parent = get_bucket(parent_idx);
+		std::unique_lock<shared_mutex> lock(parent.mtx);
+
+		if (parent.rehashed == 0)
+			rehash_bucket(parent, parent_idx);
+
+		pool_base pop = get_pool();
+		transaction::exec_tx(pop, [&]() {
+			persistent_ptr<node> *prev = &parent.head;
+			while (*prev != nullptr) {
+				persistent_ptr<node> e = *prev;
+				if ((hasher()(e->item.first) & level_mask) ==
+				    idx) {
+					*prev = e->next;
+					e->next = b.head;
+					b.head = e;
+				} else {
+					prev = &e->next;
+				}
+			}
+
+			b.rehashed = 1;
+		});
+	}
+
+	/*
+	 * Locks the bucket of the key and returns the element with the key, or
+	 * nullptr if it isn't in the map. The bucket is locked exclusively if
+	 * 'write' is set, otherwise it's set when the bucket had to be rehashed.
+	 * If 'prev' is given, it's set to the pointer to the returned element.
+	 */
+	node *
+	acquire(const Key &key, bucket *&b, bool &write,
+		persistent_ptr<node> **prev = nullptr) const
+	{
+		size_type h = hasher()(key);
+
+		for (;;) {
+			size_type m = mask.load(std::memory_order_acquire);
+			b = &get_bucket(h & m);
+			lock_bucket(b, write);
+
+			if (b->rehashed == 0) {
+				try {
+					if (!write) {
+						b->mtx.unlock_shared();
+						write = true;
+						b->mtx.lock();
+					}
+
+					if (b->rehashed == 0)
+						rehash_bucket(*b, h & m);
+				} catch (...) {
+					unlock_bucket(b, write);
+					throw;
+				}
+			}
+
+			persistent_ptr<node> *p = &b->head;
+			for (node *e = p->get(); e != nullptr; e = p->get()) {
+				if (key_equal()(e->item.first, key)) {
+					if (prev != nullptr)
+						*prev = p;
+					return e;
+				}
+
+				p = &e->next;
+			}
+
+			/*
+			 * The element could have been moved to a new bucket
+			 * after the mask was read.
+			 */
+			if (mask.load(std::memory_order_acquire) == m)
+				return nullptr;
+
+			unlock_bucket(b, write);
+		}
+	}
+
+	bool
+	lookup(const_accessor &result, const Key &key, bool write) const
+	{
+		check_tx_stage();
+
+		result.release();
+
+		bucket *b;
+		node *e = acquire(key, b, write);
+		if (e == nullptr) {
+			unlock_bucket(b, write);
+			return false;
+		}
+
+		result.acquire(e, b, write);
+
+		return true;
+	}
+
+	template <typename Arg>
+	bool
+	insert_node(const_accessor *result, const Key &key, const Arg &arg)
+	{
+		check_tx_stage();
+
+		bucket *b;
+		bool write = true;
+		node *e = acquire(key, b, write);
+		bool inserted = e == nullptr;
+
+		if (inserted) {
+			try {
+				pool_base pop = get_pool();
+				transaction::exec_tx(pop, [&]() {
+					b->head = make_persistent<node>(
+						b->head, arg);
+				});
+			} catch (...) {
+				unlock_bucket(b, write);
+				throw;
+			}
+
+			e = b->head.get();
+		}
+
+		if (result != nullptr)
+			result->acquire(e, b, write);
+		else
+			unlock_bucket(b, write);
+
+		if (inserted) {
+			size_type n = nelements.fetch_add(
+					      1, std::memory_order_relaxed) +
+				1;
+			get_pool().persist(&nelements, sizeof(nelements));
+
+			size_type m = mask.load(std::memory_order_acquire);
+			if (n > m + 1)
+				grow(m);
+		}
+
+		return inserted;
+	}
+
+	/*
+	 * Doubles the number of buckets, unless another thread is already
+	 * doing it. The new buckets are rehashed when they're first accessed.
+	 */
+	void
+	grow(size_type m)
+	{
+		std::unique_lock<mutex> lock(grow_mtx, std::try_to_lock);
+		if (!lock.owns_lock() ||
+		    mask.load(std::memory_order_relaxed) != m)
+			return;
+
+		size_type s = segment_index(m + 1);
+		if (s >= max_segments)
+			return;
+
+		pool_base pop = get_pool();
+
+		/* the segment is left allocated if the mask wasn't updated */
+		if (segments[s] == nullptr)
+			transaction::exec_tx(pop, [&]() {
+				segments[s] =
+					make_persistent<bucket[]>(
+						segment_size(s));
+			});
+
+		mask.store((m << 1) | 1, std::memory_order_release);
+		pop.persist(&mask, sizeof(mask));
+	}
+
+	/* number of buckets minus one */
+	std::atomic<uint64_t> mask;
+
+	/* number of elements, persisted after every insert and erase */
+	std::atomic<uint64_t> nelements;
+
+	mutex grow_mtx;
+
+	persistent_ptr<bucket[]> segments[max_segments];
+};
+
+} /* namespace obj */
+
+} /* namespace nvml */
+
+#endif /* PMEMOBJ_CONCURRENT_HASH_MAP_HPP */
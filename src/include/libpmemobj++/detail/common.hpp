@@ -40,6 +40,8 @@
 
 #include "libpmemobj++/detail/pexceptions.hpp"
 #include "libpmemobj/tx_base.h"
+#include <cstddef>
+#include <cstdint>
 #include <typeinfo>
 
 namespace nvml
@@ -48,11 +50,53 @@ namespace nvml
 namespace detail
 {
 
+/*
+ * Thread-local filter of the objects recently added to a transaction.
+ *
+ * A direct-mapped cache of the ranges added in the current transaction
+ * epoch of the thread. Repeated modifications of the same object in
+ * a transaction find it here and skip the call into the library.
+ */
+struct tx_add_filter {
+	static constexpr std::size_t slots = 64;
+
+	struct slot {
+		uint64_t epoch;
+		const void *ptr;
+		std::size_t size;
+	};
+
+	slot entries[slots];
+
+	/*
+	 * Returns the slot of the given address.
+	 */
+	slot &
+	get(const void *ptr)
+	{
+		auto addr = reinterpret_cast<uintptr_t>(ptr);
+
+		return entries[((addr >> 3) ^ (addr >> 9)) & (slots - 1)];
+	}
+
+	/*
+	 * Returns the filter of the calling thread.
+	 */
+	static tx_add_filter &
+	instance()
+	{
+		static thread_local tx_add_filter filter;
+
+		return filter;
+	}
+};
+
 /*
  * Conditionally add an object to a transaction.
  *
  * Adds `*that` to the transaction if it is within a pmemobj pool and
- * there is an active transaction. Does nothing otherwise.
+ * there is an active transaction. Does nothing otherwise, or when the
+ * object was already added in this transaction.
  *
  * @param[in] that pointer to the object being added to the transaction.
  */
@@ -60,16 +104,26 @@ template <typename T>
 inline void
 conditional_add_to_tx(const T *that)
 {
-	/* 'that' is not in any open pool */
-	if (!pmemobj_pool_by_ptr(that))
+	/* not in the work stage of a transaction */
+	uint64_t epoch = pmemobj_tx_epoch();
+	if (epoch == 0)
+		return;
+
+	auto &s = tx_add_filter::instance().get(that);
+	if (s.epoch == epoch && s.ptr == that && s.size >= sizeof(*that))
 		return;
 
-	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+	/* 'that' is not in any open pool */
+	if (!pmemobj_pool_by_ptr(that))
 		return;
 
 	if (pmemobj_tx_add_range_direct(that, sizeof(*that)))
 		throw transaction_error("Could not add an object to the"
 					" transaction.");
+
+	s.epoch = epoch;
+	s.ptr = that;
+	s.size = sizeof(*that);
 }
 
 /*
@@ -45,7 +45,10 @@
 #include "libpmemobj++/detail/pexceptions.hpp"
 #include "libpmemobj/tx_base.h"
 
+#include <cstddef>
 #include <new>
+#include <utility>
+#include <vector>
 
 namespace nvml
 {
@@ -83,7 +86,7 @@ make_persistent(Args &&... args)
 		throw transaction_alloc_error("failed to allocate "
 					      "persistent memory object");
 	try {
-		new (ptr.get()) T(args...);
+		new (ptr.get()) T(std::forward<Args>(args)...);
 	} catch (...) {
 		pmemobj_tx_free(*ptr.raw_ptr());
 		throw;
@@ -92,6 +95,59 @@ make_persistent(Args &&... args)
 	return ptr;
 }
 
+/**
+ * Transactionally allocate and construct n objects of type T.
+ *
+ * This function can be used to *transactionally* allocate many independent
+ * objects at once. Unlike calling make_persistent in a loop, the
+ * allocations are recorded in the transaction in groups, which makes
+ * the bookkeeping cost of a single object much lower. Every object is
+ * constructed with the same list of parameters, so they are passed as
+ * lvalues. Cannot be used for array types.
+ *
+ * @param[in] n number of objects to allocate.
+ * @param[in] args a list of parameters passed to the constructor.
+ *
+ * @return vector of persistent_ptr<T> to the new objects
+ *
+ * @throw transaction_scope_error if called outside of an active
+ * transaction
+ * @throw transaction_alloc_error on transactional allocation failure.
+ */
+template <typename T, typename... Args>
+std::vector<typename detail::pp_if_not_array<T>::type>
+make_persistent_batch(std::size_t n, const Args &... args)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw transaction_scope_error(
+			"refusing to allocate "
+			"memory outside of transaction scope");
+
+	std::vector<PMEMoid> oids(n);
+
+	if (pmemobj_tx_alloc_bulk(sizeof(T), detail::type_num<T>(),
+				  oids.data(), n) != 0)
+		throw transaction_alloc_error("failed to allocate "
+					      "persistent memory objects");
+
+	std::vector<persistent_ptr<T>> ptrs(oids.begin(), oids.end());
+
+	std::size_t constructed = 0;
+	try {
+		for (; constructed < n; ++constructed)
+			new (ptrs[constructed].get()) T(args...);
+	} catch (...) {
+		for (std::size_t i = 0; i < n; ++i) {
+			if (i < constructed)
+				ptrs[i]->T::~T();
+			pmemobj_tx_free(oids[i]);
+		}
+		throw;
+	}
+
+	return ptrs;
+}
+
 /**
  * Transactionally free an object of type T held in a persitent_ptr.
  *
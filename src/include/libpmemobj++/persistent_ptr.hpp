@@ -39,8 +39,10 @@
 #define PMEMOBJ_PERSISTENT_PTR_HPP
 
 #include <cassert>
+#include <iterator>
 #include <memory>
 #include <ostream>
+#include <type_traits>
 
 #include "libpmemobj++/detail/common.hpp"
 #include "libpmemobj++/detail/specialization.hpp"
@@ -82,6 +84,16 @@ public:
 	 */
 	typedef typename nvml::detail::sp_element<T>::type element_type;
 
+	/*
+	 * Iterator traits, which make the persistent_ptr usable as the pointer
+	 * type of an allocator.
+	 */
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef std::ptrdiff_t difference_type;
+	typedef typename std::remove_cv<element_type>::type value_type;
+	typedef typename nvml::detail::sp_dereference<T>::type reference;
+	typedef persistent_ptr<T> pointer;
+
 	/**
 	 * Default constructor, zeroes the PMEMoid.
 	 */
@@ -202,6 +214,21 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Creates a persistent pointer to the object in persistent memory.
+	 *
+	 * Used by the containers through std::pointer_traits.
+	 *
+	 * @return persistent_ptr to the object, or a null one if the object
+	 * isn't in an open pool.
+	 */
+	template <typename U = element_type>
+	static persistent_ptr
+	pointer_to(typename std::enable_if<!std::is_void<U>::value, U>::type &ref)
+	{
+		return persistent_ptr(pmemobj_oid(&ref));
+	}
+
 	/**
 	 * Dereference operator.
 	 */
@@ -687,7 +714,7 @@ operator-(const persistent_ptr<T> &lhs, const persistent_ptr<T> &rhs)
 	assert(lhs.raw().pool_uuid_lo == rhs.raw().pool_uuid_lo);
 	ptrdiff_t d = lhs.raw().off - rhs.raw().off;
 
-	return d / sizeof(T);
+	return d / static_cast<ptrdiff_t>(sizeof(T));
 }
 
 /**
@@ -377,6 +377,9 @@ public:
 	/**
 	 * Retrieves pool's root object.
 	 *
+	 * Once the root object is allocated, this doesn't take any lock,
+	 * unless the root object has to grow to the size of T.
+	 *
 	 * @return persistent pointer to the root object.
 	 */
 	persistent_ptr<T>
@@ -0,0 +1,566 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Compact persistent smart pointer, relative to its own address.
+ */
+
+#ifndef PMEMOBJ_SELF_RELATIVE_PTR_HPP
+#define PMEMOBJ_SELF_RELATIVE_PTR_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#include "libpmemobj++/detail/common.hpp"
+#include "libpmemobj++/detail/pexceptions.hpp"
+#include "libpmemobj++/detail/specialization.hpp"
+#include "libpmemobj++/persistent_ptr.hpp"
+#include "libpmemobj++/pool.hpp"
+#include "libpmemobj/base.h"
+
+namespace nvml
+{
+
+namespace obj
+{
+
+/**
+ * Self-relative persistent pointer class.
+ *
+ * self_relative_ptr keeps only the distance between itself and the object it
+ * points to, in 8 bytes, half of the PMEMoid. The dereference is a single
+ * addition, without the pool lookup of the persistent_ptr. Since a pool can
+ * be mapped at any address, the distance stays valid only when both the
+ * pointer and the object are in the same pool - it can't point to another
+ * pool, and a copy in volatile memory is valid only until the pool is closed.
+ *
+ * Copying the pointer to another place recalculates the distance, and it can
+ * be converted to and from the persistent_ptr of the same type. Just like the
+ * persistent_ptr, the assignments add the pointer to the active transaction.
+ */
+template <typename T>
+class self_relative_ptr {
+	template <typename Y>
+	friend class self_relative_ptr;
+
+public:
+	/**
+	 * Type of an actual object with all qualifier removed,
+	 * used for easy underlying type access
+	 */
+	typedef typename nvml::detail::sp_element<T>::type element_type;
+
+	/**
+	 * Default constructor, creates a null pointer.
+	 */
+	self_relative_ptr() noexcept : off(null_offset)
+	{
+		verify_type();
+	}
+
+	/**
+	 * Null constructor.
+	 */
+	self_relative_ptr(std::nullptr_t) noexcept : off(null_offset)
+	{
+		verify_type();
+	}
+
+	/**
+	 * Direct pointer constructor.
+	 *
+	 * @param ptr pointer to an object in the same pool as the pointer.
+	 */
+	self_relative_ptr(element_type *ptr) noexcept
+	    : off(pointer_to_offset(ptr))
+	{
+		verify_type();
+	}
+
+	/**
+	 * Conversion from a persistent_ptr of the same type.
+	 */
+	self_relative_ptr(const persistent_ptr<T> &ptr) noexcept
+	    : off(pointer_to_offset(ptr.get()))
+	{
+		verify_type();
+	}
+
+	/**
+	 * Copy constructor, recalculates the distance from the new place.
+	 */
+	self_relative_ptr(const self_relative_ptr &r) noexcept
+	    : off(pointer_to_offset(r.get()))
+	{
+		verify_type();
+	}
+
+	/**
+	 * Copy constructor from a different self_relative_ptr<>.
+	 *
+	 * Available only for convertible types.
+	 */
+	template <typename Y,
+		  typename = typename std::enable_if<
+			  std::is_convertible<Y *, T *>::value>::type>
+	self_relative_ptr(const self_relative_ptr<Y> &r) noexcept
+	    : off(pointer_to_offset(r.get()))
+	{
+		verify_type();
+	}
+
+	/**
+	 * Assignment operator.
+	 *
+	 * Registers the pointer in the active transaction.
+	 *
+	 * @throw nvml::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr &
+	operator=(const self_relative_ptr &r)
+	{
+		return set(r.get());
+	}
+
+	/**
+	 * Converting assignment operator from a different
+	 * self_relative_ptr<>.
+	 *
+	 * @throw nvml::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	template <typename Y,
+		  typename = typename std::enable_if<
+			  std::is_convertible<Y *, T *>::value>::type>
+	self_relative_ptr &
+	operator=(const self_relative_ptr<Y> &r)
+	{
+		return set(r.get());
+	}
+
+	/**
+	 * Assignment from a persistent_ptr of the same type.
+	 *
+	 * @throw nvml::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr &
+	operator=(const persistent_ptr<T> &r)
+	{
+		return set(r.get());
+	}
+
+	/**
+	 * Null assignment operator.
+	 *
+	 * @throw nvml::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr &
+	operator=(std::nullptr_t)
+	{
+		return set(nullptr);
+	}
+
+	/**
+	 * Conversion to the persistent_ptr of the same type.
+	 *
+	 * Looks up the pool of the object.
+	 */
+	operator persistent_ptr<T>() const noexcept
+	{
+		return persistent_ptr<T>(pmemobj_oid(get()));
+	}
+
+	/**
+	 * Dereference operator.
+	 */
+	typename nvml::detail::sp_dereference<T>::type operator*() const
+		noexcept
+	{
+		return *get();
+	}
+
+	/**
+	 * Member access operator.
+	 */
+	typename nvml::detail::sp_member_access<T>::type operator->() const
+		noexcept
+	{
+		return get();
+	}
+
+	/**
+	 * Array access operator.
+	 *
+	 * Contains run-time bounds checking for static arrays.
+	 */
+	typename nvml::detail::sp_array_access<T>::type
+	operator[](std::ptrdiff_t i) const noexcept
+	{
+		assert(i >= 0 && (i < nvml::detail::sp_extent<T>::value ||
+				  nvml::detail::sp_extent<T>::value == 0) &&
+		       "persistent array index out of bounds");
+
+		return get()[i];
+	}
+
+	/**
+	 * Get a direct pointer.
+	 *
+	 * @return a direct pointer to the object.
+	 */
+	element_type *
+	get() const noexcept
+	{
+		if (off == null_offset)
+			return nullptr;
+
+		return reinterpret_cast<element_type *>(
+			reinterpret_cast<std::intptr_t>(this) + off + 1);
+	}
+
+	/**
+	 * Swaps the objects two pointers point to.
+	 *
+	 * @throw nvml::transaction_error when adding the pointers to the
+	 *	transaction failed.
+	 */
+	void
+	swap(self_relative_ptr &other)
+	{
+		element_type *p = get();
+		set(other.get());
+		other.set(p);
+	}
+
+	/*
+	 * Bool conversion operator.
+	 */
+	explicit operator bool() const noexcept
+	{
+		return off != null_offset;
+	}
+
+	/**
+	 * Prefix increment operator.
+	 */
+	self_relative_ptr &
+	operator++()
+	{
+		return *this += 1;
+	}
+
+	/**
+	 * Postfix increment operator.
+	 */
+	self_relative_ptr
+	operator++(int)
+	{
+		self_relative_ptr ret(*this);
+		++*this;
+
+		return ret;
+	}
+
+	/**
+	 * Prefix decrement operator.
+	 */
+	self_relative_ptr &
+	operator--()
+	{
+		return *this -= 1;
+	}
+
+	/**
+	 * Postfix decrement operator.
+	 */
+	self_relative_ptr
+	operator--(int)
+	{
+		self_relative_ptr ret(*this);
+		--*this;
+
+		return ret;
+	}
+
+	/**
+	 * Addition assignment operator.
+	 */
+	self_relative_ptr &
+	operator+=(std::ptrdiff_t s)
+	{
+		return set(get() + s);
+	}
+
+	/**
+	 * Subtraction assignment operator.
+	 */
+	self_relative_ptr &
+	operator-=(std::ptrdiff_t s)
+	{
+		return set(get() - s);
+	}
+
+	/**
+	 * Persists what the pointer points to.
+	 *
+	 * @param[in] pop Pmemobj pool
+	 */
+	void
+	persist(pool_base &pop)
+	{
+		pop.persist(get(), sizeof(T));
+	}
+
+	/**
+	 * Persists what the pointer points to.
+	 *
+	 * @throw pool_error when the object isn't in a pool.
+	 */
+	void
+	persist(void)
+	{
+		pmemobjpool *pop = pmemobj_pool_by_ptr(get());
+
+		if (pop == nullptr)
+			throw pool_error("Cannot get pool from "
+					 "self-relative pointer");
+
+		pmemobj_persist(pop, get(), sizeof(T));
+	}
+
+	/**
+	 * Flushes what the pointer points to.
+	 *
+	 * @param[in] pop Pmemobj pool
+	 */
+	void
+	flush(pool_base &pop)
+	{
+		pop.flush(get(), sizeof(T));
+	}
+
+	/**
+	 * Flushes what the pointer points to.
+	 *
+	 * @throw pool_error when the object isn't in a pool.
+	 */
+	void
+	flush(void)
+	{
+		pmemobjpool *pop = pmemobj_pool_by_ptr(get());
+
+		if (pop == nullptr)
+			throw pool_error("Cannot get pool from "
+					 "self-relative pointer");
+
+		pmemobj_flush(pop, get(), sizeof(T));
+	}
+
+private:
+	/*
+	 * The distance is stored minus one, so that the zeroed pointer is
+	 * a null one. The unrepresentable distance of one points into the
+	 * pointer itself.
+	 */
+	static constexpr std::ptrdiff_t null_offset = 0;
+
+	std::ptrdiff_t
+	pointer_to_offset(const element_type *ptr) const noexcept
+	{
+		if (ptr == nullptr)
+			return null_offset;
+
+		return reinterpret_cast<std::intptr_t>(ptr) -
+			reinterpret_cast<std::intptr_t>(this) - 1;
+	}
+
+	self_relative_ptr &
+	set(const element_type *ptr)
+	{
+		detail::conditional_add_to_tx(this);
+		off = pointer_to_offset(ptr);
+
+		return *this;
+	}
+
+	/* The distance to the object, see pointer_to_offset(). */
+	std::ptrdiff_t off;
+
+	void
+	verify_type()
+	{
+		static_assert(!std::is_polymorphic<element_type>::value,
+			      "Polymorphic types are not supported");
+	}
+};
+
+template <typename T>
+constexpr std::ptrdiff_t self_relative_ptr<T>::null_offset;
+
+/**
+ * Swaps the objects two self_relative_ptrs point to.
+ */
+template <class T>
+inline void
+swap(self_relative_ptr<T> &a, self_relative_ptr<T> &b)
+{
+	a.swap(b);
+}
+
+/**
+ * Equality operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator==(const self_relative_ptr<T> &lhs,
+	   const self_relative_ptr<Y> &rhs) noexcept
+{
+	return lhs.get() == rhs.get();
+}
+
+/**
+ * Inequality operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator!=(const self_relative_ptr<T> &lhs,
+	   const self_relative_ptr<Y> &rhs) noexcept
+{
+	return !(lhs == rhs);
+}
+
+/**
+ * Equality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator==(const self_relative_ptr<T> &lhs, std::nullptr_t) noexcept
+{
+	return !bool(lhs);
+}
+
+/**
+ * Equality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator==(std::nullptr_t, const self_relative_ptr<T> &rhs) noexcept
+{
+	return !bool(rhs);
+}
+
+/**
+ * Inequality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator!=(const self_relative_ptr<T> &lhs, std::nullptr_t) noexcept
+{
+	return bool(lhs);
+}
+
+/**
+ * Inequality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator!=(std::nullptr_t, const self_relative_ptr<T> &rhs) noexcept
+{
+	return bool(rhs);
+}
+
+/**
+ * Less than operator, compares the addresses of the objects.
+ */
+template <typename T, typename Y>
+inline bool
+operator<(const self_relative_ptr<T> &lhs,
+	  const self_relative_ptr<Y> &rhs) noexcept
+{
+	return std::less<const void *>()(lhs.get(), rhs.get());
+}
+
+/**
+ * Less or equal than operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator<=(const self_relative_ptr<T> &lhs,
+	   const self_relative_ptr<Y> &rhs) noexcept
+{
+	return !(rhs < lhs);
+}
+
+/**
+ * Greater than operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator>(const self_relative_ptr<T> &lhs,
+	  const self_relative_ptr<Y> &rhs) noexcept
+{
+	return rhs < lhs;
+}
+
+/**
+ * Greater or equal than operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator>=(const self_relative_ptr<T> &lhs,
+	   const self_relative_ptr<Y> &rhs) noexcept
+{
+	return !(lhs < rhs);
+}
+
+/**
+ * Difference operator, the number of elements between the pointers.
+ */
+template <typename T, typename Y>
+inline std::ptrdiff_t
+operator-(const self_relative_ptr<T> &lhs, const self_relative_ptr<Y> &rhs)
+{
+	return lhs.get() - rhs.get();
+}
+
+} /* namespace obj */
+
+} /* namespace nvml */
+
+#endif /* PMEMOBJ_SELF_RELATIVE_PTR_HPP */
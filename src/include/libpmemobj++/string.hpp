@@ -0,0 +1,1250 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Persistent memory resident string.
+ */
+
+#ifndef PMEMOBJ_STRING_HPP
+#define PMEMOBJ_STRING_HPP
+
+#include "libpmemobj++/detail/common.hpp"
+#include "libpmemobj++/detail/pexceptions.hpp"
+#include "libpmemobj++/p.hpp"
+#include "libpmemobj++/pool.hpp"
+#include "libpmemobj++/transaction.hpp"
+#include "libpmemobj/tx_base.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace nvml
+{
+
+namespace obj
+{
+
+/**
+ * Persistent memory resident string.
+ *
+ * A string with the interface of the std::basic_string, which keeps short
+ * strings inside the object itself - for char up to 23 characters - and the
+ * longer ones in a separate persistent memory buffer. Every modification is
+ * a transaction on its own, or a part of the enclosing one.
+ *
+ * The modifications of a short string add the whole 32 byte object to the
+ * transaction. The modifications of a long one add only the characters they
+ * overwrite, while the appended characters past the old end aren't
+ * snapshotted at all - they are only flushed on commit. The buffer grows
+ * geometrically, and moving a long string only hands over its buffer.
+ *
+ * Like the vector, the string has to reside in persistent memory and has to
+ * be destroyed in a transaction. A zero-filled string is a valid, empty one.
+ */
+template <typename CharT, typename Traits = std::char_traits<CharT>>
+class basic_string {
+public:
+	typedef Traits traits_type;
+	typedef CharT value_type;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef value_type &reference;
+	typedef const value_type &const_reference;
+	typedef value_type *pointer;
+	typedef const value_type *const_pointer;
+	typedef pointer iterator;
+	typedef const_pointer const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	static const size_type npos = static_cast<size_type>(-1);
+
+	/**
+	 * Constructs an empty string.
+	 */
+	basic_string() : sz(0)
+	{
+		sso[0] = CharT();
+	}
+
+	/**
+	 * Constructs a string with the first count characters of s.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	basic_string(const CharT *s, size_type count) : basic_string()
+	{
+		assign(s, count);
+	}
+
+	/**
+	 * Constructs a string with the null-terminated s.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	basic_string(const CharT *s) : basic_string()
+	{
+		assign(s);
+	}
+
+	/**
+	 * Constructs a string of count copies of ch.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	basic_string(size_type count, CharT ch) : basic_string()
+	{
+		assign(count, ch);
+	}
+
+	/**
+	 * Constructs a string with the contents of the std::basic_string.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	explicit basic_string(const std::basic_string<CharT, Traits> &str)
+	    : basic_string()
+	{
+		assign(str);
+	}
+
+	/**
+	 * Constructs a string with the contents of the initializer list.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	basic_string(std::initializer_list<CharT> ilist) : basic_string()
+	{
+		assign(ilist);
+	}
+
+	/**
+	 * Copy constructor.
+	 *
+	 * @throw pool_error if the string isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	basic_string(const basic_string &other) : basic_string()
+	{
+		assign(other);
+	}
+
+	/**
+	 * Move constructor. Takes over the buffer of a long string and leaves
+	 * the other string empty.
+	 *
+	 * @throw pool_error if the strings aren't in persistent memory.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string(basic_string &&other) : basic_string()
+	{
+		assign(std::move(other));
+	}
+
+	/**
+	 * Frees the buffer of a long string. Has to be called in a
+	 * transaction.
+	 */
+	~basic_string()
+	{
+		if (is_large())
+			pmemobj_tx_free(large.oid);
+	}
+
+	basic_string &
+	operator=(const basic_string &other)
+	{
+		return assign(other);
+	}
+
+	basic_string &
+	operator=(basic_string &&other)
+	{
+		return assign(std::move(other));
+	}
+
+	basic_string &
+	operator=(const std::basic_string<CharT, Traits> &str)
+	{
+		return assign(str);
+	}
+
+	basic_string &
+	operator=(const CharT *s)
+	{
+		return assign(s);
+	}
+
+	basic_string &
+	operator=(CharT ch)
+	{
+		return assign(1, ch);
+	}
+
+	basic_string &
+	operator=(std::initializer_list<CharT> ilist)
+	{
+		return assign(ilist);
+	}
+
+	/**
+	 * Replaces the contents with count copies of ch.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	assign(size_type count, CharT ch)
+	{
+		replace_impl(0, size(), nullptr, count, ch);
+
+		return *this;
+	}
+
+	/**
+	 * Replaces the contents with the first count characters of s.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	assign(const CharT *s, size_type count)
+	{
+		replace_impl(0, size(), s, count, CharT());
+
+		return *this;
+	}
+
+	basic_string &
+	assign(const CharT *s)
+	{
+		return assign(s, Traits::length(s));
+	}
+
+	basic_string &
+	assign(const basic_string &other)
+	{
+		if (this != &other)
+			assign(other.cdata(), other.size());
+
+		return *this;
+	}
+
+	/**
+	 * Replaces the contents with the other string. Takes over the buffer
+	 * of a long string, without copying the characters, and leaves the
+	 * other string empty.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	assign(basic_string &&other)
+	{
+		if (this == &other)
+			return *this;
+
+		run_tx([&] {
+			if (!other.is_large()) {
+				assign(other.cdata(), other.size());
+				other.clear();
+				return;
+			}
+
+			free_large();
+			detail::conditional_add_to_tx(this);
+			detail::conditional_add_to_tx(&other);
+
+			large = other.large;
+			sz = other.sz;
+
+			other.sz = 0;
+			other.sso[0] = CharT();
+		});
+
+		return *this;
+	}
+
+	basic_string &
+	assign(const std::basic_string<CharT, Traits> &str)
+	{
+		return assign(str.data(), str.size());
+	}
+
+	basic_string &
+	assign(std::initializer_list<CharT> ilist)
+	{
+		return assign(ilist.begin(), ilist.size());
+	}
+
+	/**
+	 * Returns the character at pos, with bounds checking. Adds the
+	 * character to the active transaction.
+	 *
+	 * @throw std::out_of_range if pos is out of range.
+	 */
+	reference
+	at(size_type pos)
+	{
+		check_range(pos);
+
+		return (*this)[pos];
+	}
+
+	/**
+	 * Returns the character at pos, with bounds checking.
+	 *
+	 * @throw std::out_of_range if pos is out of range.
+	 */
+	const_reference
+	at(size_type pos) const
+	{
+		check_range(pos);
+
+		return (*this)[pos];
+	}
+
+	/**
+	 * Returns the character at pos. Adds the character to the active
+	 * transaction.
+	 *
+	 * @throw transaction_error when the character can't be added.
+	 */
+	reference operator[](size_type pos)
+	{
+		pointer c = buffer() + pos;
+		detail::conditional_add_to_tx(c);
+
+		return *c;
+	}
+
+	const_reference operator[](size_type pos) const
+	{
+		return buffer()[pos];
+	}
+
+	reference
+	front()
+	{
+		return (*this)[0];
+	}
+
+	const_reference
+	front() const
+	{
+		return (*this)[0];
+	}
+
+	reference
+	back()
+	{
+		return (*this)[size() - 1];
+	}
+
+	const_reference
+	back() const
+	{
+		return (*this)[size() - 1];
+	}
+
+	/**
+	 * Returns the characters. Adds all of them to the active transaction.
+	 */
+	pointer
+	data()
+	{
+		if (pmemobj_tx_stage() == TX_STAGE_WORK)
+			add_chars_to_tx(0, size() + 1);
+
+		return buffer();
+	}
+
+	const_pointer
+	data() const noexcept
+	{
+		return buffer();
+	}
+
+	/**
+	 * Returns the characters, without adding them to the transaction.
+	 */
+	const_pointer
+	cdata() const noexcept
+	{
+		return buffer();
+	}
+
+	const_pointer
+	c_str() const noexcept
+	{
+		return buffer();
+	}
+
+	/**
+	 * Returns an iterator to the first character. Adds all the characters
+	 * to the active transaction - the const iterators should be used to
+	 * only read them.
+	 */
+	iterator
+	begin()
+	{
+		return data();
+	}
+
+	/**
+	 * Returns an iterator past the last character. Adds all the
+	 * characters to the active transaction.
+	 */
+	iterator
+	end()
+	{
+		return data() + size();
+	}
+
+	const_iterator
+	begin() const noexcept
+	{
+		return cbegin();
+	}
+
+	const_iterator
+	end() const noexcept
+	{
+		return cend();
+	}
+
+	const_iterator
+	cbegin() const noexcept
+	{
+		return buffer();
+	}
+
+	const_iterator
+	cend() const noexcept
+	{
+		return buffer() + size();
+	}
+
+	reverse_iterator
+	rbegin()
+	{
+		return reverse_iterator(end());
+	}
+
+	reverse_iterator
+	rend()
+	{
+		return reverse_iterator(begin());
+	}
+
+	const_reverse_iterator
+	rbegin() const noexcept
+	{
+		return crbegin();
+	}
+
+	const_reverse_iterator
+	rend() const noexcept
+	{
+		return crend();
+	}
+
+	const_reverse_iterator
+	crbegin() const noexcept
+	{
+		return const_reverse_iterator(cend());
+	}
+
+	const_reverse_iterator
+	crend() const noexcept
+	{
+		return const_reverse_iterator(cbegin());
+	}
+
+	bool
+	empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	size_type
+	size() const noexcept
+	{
+		return sz & ~large_flag;
+	}
+
+	size_type
+	length() const noexcept
+	{
+		return size();
+	}
+
+	/**
+	 * Returns the largest number of characters which fit in a single
+	 * allocation.
+	 */
+	size_type
+	max_size() const noexcept
+	{
+		return PMEMOBJ_MAX_ALLOC_SIZE / sizeof(CharT) - 1;
+	}
+
+	size_type
+	capacity() const noexcept
+	{
+		return is_large() ? large.cap - 1 : sso_capacity;
+	}
+
+	/**
+	 * Increases the capacity to at least new_cap characters.
+	 *
+	 * @throw std::length_error if new_cap is larger than max_size().
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	void
+	reserve(size_type new_cap)
+	{
+		if (new_cap <= capacity())
+			return;
+
+		if (new_cap > max_size())
+			throw std::length_error("string too long");
+
+		run_tx([&] { reallocate(new_cap); });
+	}
+
+	/**
+	 * Reduces the capacity to the size of the string, moving a short
+	 * enough string back into the object.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	void
+	shrink_to_fit()
+	{
+		if (!is_large() || capacity() == size())
+			return;
+
+		run_tx([&] {
+			size_type n = size();
+			if (n > sso_capacity) {
+				reallocate(n);
+				return;
+			}
+
+			PMEMoid oid = large.oid;
+			detail::conditional_add_to_tx(this);
+			Traits::copy(sso, static_cast<CharT *>(pmemobj_direct(oid)),
+				     n + 1);
+			sz = n;
+
+			if (pmemobj_tx_free(oid) != 0)
+				throw transaction_error(
+					"failed to free the buffer");
+		});
+	}
+
+	/**
+	 * Removes all the characters, leaving the capacity unchanged.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	clear()
+	{
+		erase(0, npos);
+	}
+
+	/**
+	 * Inserts count copies of ch at index.
+	 *
+	 * @throw std::out_of_range if index is larger than the size.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	insert(size_type index, size_type count, CharT ch)
+	{
+		replace_impl(index, 0, nullptr, count, ch);
+
+		return *this;
+	}
+
+	/**
+	 * Inserts the first count characters of s at index.
+	 *
+	 * @throw std::out_of_range if index is larger than the size.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	insert(size_type index, const CharT *s, size_type count)
+	{
+		replace_impl(index, 0, s, count, CharT());
+
+		return *this;
+	}
+
+	basic_string &
+	insert(size_type index, const CharT *s)
+	{
+		return insert(index, s, Traits::length(s));
+	}
+
+	basic_string &
+	insert(size_type index, const basic_string &str)
+	{
+		return insert(index, str.cdata(), str.size());
+	}
+
+	basic_string &
+	insert(size_type index, const std::basic_string<CharT, Traits> &str)
+	{
+		return insert(index, str.data(), str.size());
+	}
+
+	/**
+	 * Removes up to count characters starting at index.
+	 *
+	 * @throw std::out_of_range if index is larger than the size.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	erase(size_type index = 0, size_type count = npos)
+	{
+		replace_impl(index, count, nullptr, 0, CharT());
+
+		return *this;
+	}
+
+	/**
+	 * Appends ch to the end of the string.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	push_back(CharT ch)
+	{
+		append(1, ch);
+	}
+
+	/**
+	 * Removes the last character.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	pop_back()
+	{
+		if (!empty())
+			erase(size() - 1, 1);
+	}
+
+	/**
+	 * Appends count copies of ch.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	append(size_type count, CharT ch)
+	{
+		replace_impl(size(), 0, nullptr, count, ch);
+
+		return *this;
+	}
+
+	/**
+	 * Appends the first count characters of s.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	basic_string &
+	append(const CharT *s, size_type count)
+	{
+		replace_impl(size(), 0, s, count, CharT());
+
+		return *this;
+	}
+
+	basic_string &
+	append(const CharT *s)
+	{
+		return append(s, Traits::length(s));
+	}
+
+	basic_string &
+	append(const basic_string &str)
+	{
+		return append(str.cdata(), str.size());
+	}
+
+	basic_string &
+	append(const std::basic_string<CharT, Traits> &str)
+	{
+		return append(str.data(), str.size());
+	}
+
+	basic_string &
+	operator+=(const basic_string &str)
+	{
+		return append(str);
+	}
+
+	basic_string &
+	operator+=(const std::basic_string<CharT, Traits> &str)
+	{
+		return append(str);
+	}
+
+	basic_string &
+	operator+=(const CharT *s)
+	{
+		return append(s);
+	}
+
+	basic_string &
+	operator+=(CharT ch)
+	{
+		return append(1, ch);
+	}
+
+	basic_string &
+	operator+=(std::initializer_list<CharT> ilist)
+	{
+		return append(ilist.begin(), ilist.size());
+	}
+
+	/**
+	 * Resizes the string to count characters, the new ones are null.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	resize(size_type count)
+	{
+		resize(count, CharT());
+	}
+
+	/**
+	 * Resizes the string to count characters, the new ones are copies of
+	 * ch.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	resize(size_type count, CharT ch)
+	{
+		size_type n = size();
+		if (count < n)
+			erase(count, npos);
+		else if (count > n)
+			append(count - n, ch);
+	}
+
+	/**
+	 * Compares the string with the count characters of s.
+	 */
+	int
+	compare(const CharT *s, size_type count) const
+	{
+		size_type n = size();
+		int ret = Traits::compare(cdata(), s, std::min(n, count));
+		if (ret != 0)
+			return ret;
+
+		return n < count ? -1 : (n > count ? 1 : 0);
+	}
+
+	int
+	compare(const CharT *s) const
+	{
+		return compare(s, Traits::length(s));
+	}
+
+	int
+	compare(const basic_string &str) const
+	{
+		return compare(str.cdata(), str.size());
+	}
+
+	int
+	compare(const std::basic_string<CharT, Traits> &str) const
+	{
+		return compare(str.data(), str.size());
+	}
+
+	/**
+	 * Exchanges the contents with the other string, without copying the
+	 * buffers of long strings.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	swap(basic_string &other)
+	{
+		run_tx([&] {
+			detail::conditional_add_to_tx(this);
+			detail::conditional_add_to_tx(&other);
+
+			std::swap(large_bytes(), other.large_bytes());
+
+			size_type s = sz;
+			sz = other.sz;
+			other.sz = s;
+		});
+	}
+
+private:
+	struct large_buffer {
+		PMEMoid oid;
+
+		/* the number of characters, including the terminator */
+		size_type cap;
+	};
+
+	struct large_storage {
+		unsigned char bytes[sizeof(large_buffer)];
+	};
+
+	static constexpr size_type sso_capacity =
+		sizeof(large_buffer) / sizeof(CharT) - 1;
+
+	static constexpr size_type large_flag = ~(~size_type(0) >> 1);
+
+	bool
+	is_large() const noexcept
+	{
+		return (sz & large_flag) != 0;
+	}
+
+	pointer
+	buffer() const noexcept
+	{
+		if (is_large())
+			return static_cast<pointer>(pmemobj_direct(large.oid));
+
+		return const_cast<pointer>(sso);
+	}
+
+	large_storage &
+	large_bytes() noexcept
+	{
+		return *reinterpret_cast<large_storage *>(&large);
+	}
+
+	pool_base
+	get_pool() const
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		if (pop == nullptr)
+			throw pool_error("string isn't in persistent memory");
+
+		return pool_base(pop);
+	}
+
+	/*
+	 * Runs f in a transaction, nested in the active one if there is any.
+	 */
+	template <typename F>
+	void
+	run_tx(F &&f)
+	{
+		pool_base pop = get_pool();
+		transaction::exec_tx(pop, f);
+	}
+
+	void
+	check_range(size_type pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range("string index out of range");
+	}
+
+	/*
+	 * Returns the capacity for at least n characters, at least twice as
+	 * big as the current one.
+	 */
+	size_type
+	grown_capacity(size_type n) const noexcept
+	{
+		size_type c = capacity();
+		if (c > max_size() / 2)
+			return max_size();
+
+		return std::max(n, 2 * c);
+	}
+
+	/*
+	 * Adds the characters [first, first + n) of a long string to the
+	 * transaction.
+	 */
+	void
+	add_chars_to_tx(size_type first, size_type n)
+	{
+		if (pmemobj_tx_add_range_direct(buffer() + first,
+						n * sizeof(CharT)))
+			throw transaction_error("Could not add the characters"
+						" to the transaction.");
+	}
+
+	/*
+	 * Adds the unused characters [first, first + n) of a long string to
+	 * the transaction. They hold no data, so they are only flushed on
+	 * commit.
+	 */
+	void
+	add_tail_to_tx(size_type first, size_type n)
+	{
+		if (pmemobj_tx_xadd_range_direct(buffer() + first,
+						 n * sizeof(CharT),
+						 POBJ_XADD_NO_SNAPSHOT))
+			throw transaction_error("Could not add the characters"
+						" to the transaction.");
+	}
+
+	static PMEMoid
+	allocate(size_type n)
+	{
+		PMEMoid oid = pmemobj_tx_alloc(sizeof(CharT) * n,
+					       detail::type_num<CharT>());
+		if (OID_IS_NULL(oid))
+			throw transaction_alloc_error(
+				"failed to allocate persistent memory string");
+
+		return oid;
+	}
+
+	static void
+	write(pointer dst, const CharT *s, size_type n, CharT ch)
+	{
+		if (s != nullptr)
+			Traits::copy(dst, s, n);
+		else
+			Traits::assign(dst, n, ch);
+	}
+
+	void
+	free_large()
+	{
+		if (is_large() && pmemobj_tx_free(large.oid) != 0)
+			throw transaction_error("failed to free the buffer");
+	}
+
+	/*
+	 * Points the string at the new buffer.
+	 */
+	void
+	set_large(PMEMoid oid, size_type new_cap, size_type n)
+	{
+		detail::conditional_add_to_tx(this);
+
+		large.oid = oid;
+		large.cap = new_cap + 1;
+		sz = n | large_flag;
+	}
+
+	/*
+	 * Moves the characters to a new buffer of new_cap characters.
+	 */
+	void
+	reallocate(size_type new_cap)
+	{
+		size_type n = size();
+		PMEMoid oid = allocate(new_cap + 1);
+		Traits::copy(static_cast<pointer>(pmemobj_direct(oid)),
+			     buffer(), n + 1);
+
+		free_large();
+		set_large(oid, new_cap, n);
+	}
+
+	/*
+	 * Replaces up to count characters at pos with n characters of s, or
+	 * with n copies of ch when s is null.
+	 */
+	void
+	replace_impl(size_type pos, size_type count, const CharT *s,
+		     size_type n, CharT ch)
+	{
+		size_type old = size();
+		if (pos > old)
+			throw std::out_of_range("string index out of range");
+
+		count = std::min(count, old - pos);
+		if (count == 0 && n == 0)
+			return;
+
+		if (n > max_size() - (old - count))
+			throw std::length_error("string too long");
+
+		/* the source can be moved by the replacement */
+		const CharT *b = buffer();
+		if (s != nullptr && n != 0 &&
+		    std::less_equal<const CharT *>()(b, s) &&
+		    std::less<const CharT *>()(s, b + old + 1)) {
+			std::basic_string<CharT, Traits> tmp(s, n);
+			replace_impl(pos, count, tmp.data(), n, ch);
+			return;
+		}
+
+		size_type new_size = old - count + n;
+
+		run_tx([&] {
+			if (new_size > capacity())
+				replace_grow(pos, count, s, n, ch, new_size);
+			else
+				replace_in_place(pos, count, s, n, ch,
+						 new_size);
+		});
+	}
+
+	void
+	replace_in_place(size_type pos, size_type count, const CharT *s,
+			 size_type n, CharT ch, size_type new_size)
+	{
+		size_type old = size();
+
+		if (!is_large()) {
+			detail::conditional_add_to_tx(this);
+		} else if (n == count) {
+			add_chars_to_tx(pos, n);
+		} else {
+			/* everything from pos up to the old terminator moves */
+			add_chars_to_tx(pos, old + 1 - pos);
+			if (new_size > old)
+				add_tail_to_tx(old + 1, new_size - old);
+		}
+
+		pointer b = buffer();
+		if (n != count)
+			Traits::move(b + pos + n, b + pos + count,
+				     old - pos - count + 1);
+		write(b + pos, s, n, ch);
+
+		if (n != count)
+			sz = new_size | (sz & large_flag);
+	}
+
+	void
+	replace_grow(size_type pos, size_type count, const CharT *s,
+		     size_type n, CharT ch, size_type new_size)
+	{
+		size_type old = size();
+		size_type new_cap = grown_capacity(new_size);
+		PMEMoid oid = allocate(new_cap + 1);
+
+		pointer nb = static_cast<pointer>(pmemobj_direct(oid));
+		const CharT *b = buffer();
+		Traits::copy(nb, b, pos);
+		write(nb + pos, s, n, ch);
+		Traits::copy(nb + pos + n, b + pos + count,
+			     old - pos - count + 1);
+
+		free_large();
+		set_large(oid, new_cap, new_size);
+	}
+
+	/* the size, with the top bit set for a long string */
+	p<size_type> sz;
+
+	union {
+		large_buffer large;
+		CharT sso[sso_capacity + 1];
+	};
+};
+
+template <typename CharT, typename Traits>
+const typename basic_string<CharT, Traits>::size_type
+	basic_string<CharT, Traits>::npos;
+
+template <typename CharT, typename Traits>
+constexpr typename basic_string<CharT, Traits>::size_type
+	basic_string<CharT, Traits>::sso_capacity;
+
+template <typename CharT, typename Traits>
+constexpr typename basic_string<CharT, Traits>::size_type
+	basic_string<CharT, Traits>::large_flag;
+
+typedef basic_string<char> string;
+typedef basic_string<wchar_t> wstring;
+
+template <typename CharT, typename Traits>
+bool
+operator==(const basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) == 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator==(const basic_string<CharT, Traits> &lhs, const CharT *rhs)
+{
+	return lhs.compare(rhs) == 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator==(const CharT *lhs, const basic_string<CharT, Traits> &rhs)
+{
+	return rhs.compare(lhs) == 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator==(const basic_string<CharT, Traits> &lhs,
+	   const std::basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) == 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator==(const std::basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return rhs.compare(lhs) == 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator!=(const basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename CharT, typename Traits>
+bool
+operator!=(const basic_string<CharT, Traits> &lhs, const CharT *rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename CharT, typename Traits>
+bool
+operator!=(const CharT *lhs, const basic_string<CharT, Traits> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename CharT, typename Traits>
+bool
+operator!=(const basic_string<CharT, Traits> &lhs,
+	   const std::basic_string<CharT, Traits> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename CharT, typename Traits>
+bool
+operator!=(const std::basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <typename CharT, typename Traits>
+bool
+operator<(const basic_string<CharT, Traits> &lhs,
+	  const basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) < 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator>(const basic_string<CharT, Traits> &lhs,
+	  const basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) > 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator<=(const basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) <= 0;
+}
+
+template <typename CharT, typename Traits>
+bool
+operator>=(const basic_string<CharT, Traits> &lhs,
+	   const basic_string<CharT, Traits> &rhs)
+{
+	return lhs.compare(rhs) >= 0;
+}
+
+/**
+ * Exchanges the contents of the strings.
+ */
+template <typename CharT, typename Traits>
+void
+swap(basic_string<CharT, Traits> &lhs, basic_string<CharT, Traits> &rhs)
+{
+	lhs.swap(rhs);
+}
+
+/**
+ * Writes the string to the output stream.
+ */
+template <typename CharT, typename Traits>
+std::basic_ostream<CharT, Traits> &
+operator<<(std::basic_ostream<CharT, Traits> &os,
+	   const basic_string<CharT, Traits> &str)
+{
+	return os.write(str.cdata(),
+			static_cast<std::streamsize>(str.size()));
+}
+
+} /* namespace obj */
+
+} /* namespace nvml */
+
+#endif /* PMEMOBJ_STRING_HPP */
@@ -387,8 +387,12 @@ public:
 	 *
 	 * @param[in,out] pool the pool in which the transaction will take
 	 *	place.
-	 * @param[in] tx an std::function<void ()> which will perform
-	 *	operations within this transaction.
+	 * The closure is taken by reference and called directly, it is
+	 * neither copied nor wrapped in an std::function, so it can be
+	 * a lambda with any captures or a move-only function object.
+	 *
+	 * @param[in] tx a callable object taking no arguments, which will
+	 *	perform operations within this transaction.
 	 * @param[in,out] locks locks to be taken for the duration of
 	 *	the transaction.
 	 *
@@ -396,9 +400,9 @@ public:
 	 *	of the transaction.
 	 * @throw manual_tx_abort on manual transaction abort.
 	 */
-	template <typename... Locks>
+	template <typename F, typename... Locks>
 	static void
-	exec_tx(pool_base &pool, std::function<void()> tx, Locks &... locks)
+	exec_tx(pool_base &pool, F &&tx, Locks &... locks)
 	{
 		if (pmemobj_tx_begin(pool.get_handle(), NULL, TX_LOCK_NONE) !=
 		    0)
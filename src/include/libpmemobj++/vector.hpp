@@ -0,0 +1,1278 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Persistent memory resident vector.
+ */
+
+#ifndef PMEMOBJ_VECTOR_HPP
+#define PMEMOBJ_VECTOR_HPP
+
+#include "libpmemobj++/detail/common.hpp"
+#include "libpmemobj++/detail/pexceptions.hpp"
+#include "libpmemobj++/p.hpp"
+#include "libpmemobj++/persistent_ptr.hpp"
+#include "libpmemobj++/pool.hpp"
+#include "libpmemobj++/transaction.hpp"
+#include "libpmemobj/tx_base.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace nvml
+{
+
+namespace obj
+{
+
+/**
+ * Persistent memory resident vector.
+ *
+ * A sequence container with the interface of the std::vector, which keeps
+ * its elements in a single persistent memory buffer. Every modification is
+ * a transaction on its own, or a part of the enclosing one, so the vector is
+ * always consistent after a crash.
+ *
+ * The modifications add to the transaction only the parts of the buffer they
+ * overwrite. The slots past the end of the vector don't hold any data, so
+ * appending to the vector doesn't snapshot them - they are only flushed on
+ * commit. The buffer grows geometrically and a reallocation moves the
+ * elements to a new buffer, which as a fresh allocation doesn't need any
+ * snapshots either.
+ *
+ * The non-const element accessors add the accessed element to the active
+ * transaction, just like the assignment to a p<> property, so the elements
+ * can be modified in place in a transaction.
+ *
+ * The vector has to reside in persistent memory - as a member of a persistent
+ * object or allocated with make_persistent(). It has to be destroyed in a
+ * transaction, with delete_persistent() or as a part of the enclosing object.
+ * A zero-filled vector is a valid, empty one.
+ */
+template <typename T>
+class vector {
+public:
+	typedef T value_type;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef value_type &reference;
+	typedef const value_type &const_reference;
+	typedef value_type *pointer;
+	typedef const value_type *const_pointer;
+	typedef pointer iterator;
+	typedef const_pointer const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	/**
+	 * Constructs an empty vector.
+	 */
+	vector() : sz(0), cap(0)
+	{
+	}
+
+	/**
+	 * Constructs a vector of count value-initialized elements.
+	 *
+	 * @throw pool_error if the vector isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	explicit vector(size_type count) : sz(0), cap(0)
+	{
+		resize(count);
+	}
+
+	/**
+	 * Constructs a vector of count copies of value.
+	 *
+	 * @throw pool_error if the vector isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	vector(size_type count, const value_type &value) : sz(0), cap(0)
+	{
+		assign(count, value);
+	}
+
+	/**
+	 * Constructs a vector with the contents of the range [first, last).
+	 *
+	 * @throw pool_error if the vector isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	template <typename InputIt,
+		  typename = typename std::iterator_traits<
+			  InputIt>::iterator_category>
+	vector(InputIt first, InputIt last) : sz(0), cap(0)
+	{
+		assign(first, last);
+	}
+
+	/**
+	 * Constructs a vector with the contents of the initializer list.
+	 *
+	 * @throw pool_error if the vector isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	vector(std::initializer_list<value_type> init) : sz(0), cap(0)
+	{
+		assign(init.begin(), init.end());
+	}
+
+	/**
+	 * Copy constructor.
+	 *
+	 * @throw pool_error if the vector isn't in persistent memory.
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	vector(const vector &other) : sz(0), cap(0)
+	{
+		assign(other.cbegin(), other.cend());
+	}
+
+	/**
+	 * Move constructor. Takes over the buffer of the other vector, without
+	 * moving the elements, and leaves the other vector empty.
+	 *
+	 * @throw pool_error if the vectors aren't in persistent memory.
+	 * @throw transaction_error when the other vector can't be modified.
+	 */
+	vector(vector &&other) : sz(0), cap(0)
+	{
+		run_tx([&] { take(other); });
+	}
+
+	/**
+	 * Destroys the elements and frees the buffer. Has to be called in
+	 * a transaction.
+	 */
+	~vector()
+	{
+		free_data();
+	}
+
+	/**
+	 * Copy assignment operator.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	vector &
+	operator=(const vector &other)
+	{
+		if (this != &other)
+			assign(other.cbegin(), other.cend());
+
+		return *this;
+	}
+
+	/**
+	 * Move assignment operator. Frees the current contents and takes over
+	 * the buffer of the other vector.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	vector &
+	operator=(vector &&other)
+	{
+		if (this != &other)
+			run_tx([&] {
+				free_data();
+				take(other);
+			});
+
+		return *this;
+	}
+
+	/**
+	 * Replaces the contents with the initializer list.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	vector &
+	operator=(std::initializer_list<value_type> ilist)
+	{
+		assign(ilist.begin(), ilist.end());
+
+		return *this;
+	}
+
+	/**
+	 * Replaces the contents with count copies of value.
+	 *
+	 * Only the overwritten elements are added to the transaction, as one
+	 * range.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	assign(size_type count, const value_type &value)
+	{
+		run_tx([&] {
+			value_type tmp(value);
+			assign_impl(count, [&](pointer dst, size_type n) {
+				std::uninitialized_fill_n(dst, n, tmp);
+			});
+		});
+	}
+
+	/**
+	 * Replaces the contents with the range [first, last).
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	template <typename InputIt,
+		  typename = typename std::iterator_traits<
+			  InputIt>::iterator_category>
+	void
+	assign(InputIt first, InputIt last)
+	{
+		assign_range(first, last,
+			     typename std::iterator_traits<
+				     InputIt>::iterator_category());
+	}
+
+	/**
+	 * Replaces the contents with the initializer list.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	assign(std::initializer_list<value_type> ilist)
+	{
+		assign(ilist.begin(), ilist.end());
+	}
+
+	/**
+	 * Returns the element at pos, with bounds checking. Adds the element
+	 * to the active transaction.
+	 *
+	 * @throw std::out_of_range if pos is out of range.
+	 */
+	reference
+	at(size_type pos)
+	{
+		check_range(pos);
+
+		return (*this)[pos];
+	}
+
+	/**
+	 * Returns the element at pos, with bounds checking.
+	 *
+	 * @throw std::out_of_range if pos is out of range.
+	 */
+	const_reference
+	at(size_type pos) const
+	{
+		check_range(pos);
+
+		return (*this)[pos];
+	}
+
+	/**
+	 * Returns the element at pos. Adds the element to the active
+	 * transaction.
+	 *
+	 * @throw transaction_error when the element can't be added.
+	 */
+	reference
+	operator[](size_type pos)
+	{
+		pointer e = elements() + pos;
+		detail::conditional_add_to_tx(e);
+
+		return *e;
+	}
+
+	/**
+	 * Returns the element at pos.
+	 */
+	const_reference operator[](size_type pos) const
+	{
+		return elements()[pos];
+	}
+
+	/**
+	 * Returns the first element. Adds it to the active transaction.
+	 */
+	reference
+	front()
+	{
+		return (*this)[0];
+	}
+
+	/**
+	 * Returns the first element.
+	 */
+	const_reference
+	front() const
+	{
+		return (*this)[0];
+	}
+
+	/**
+	 * Returns the last element. Adds it to the active transaction.
+	 */
+	reference
+	back()
+	{
+		return (*this)[size() - 1];
+	}
+
+	/**
+	 * Returns the last element.
+	 */
+	const_reference
+	back() const
+	{
+		return (*this)[size() - 1];
+	}
+
+	/**
+	 * Returns the buffer of the elements. Adds all the elements to the
+	 * active transaction.
+	 */
+	pointer
+	data()
+	{
+		add_elements_to_tx();
+
+		return elements();
+	}
+
+	/**
+	 * Returns the buffer of the elements.
+	 */
+	const_pointer
+	data() const noexcept
+	{
+		return elements();
+	}
+
+	/**
+	 * Returns the buffer of the elements, without adding them to the
+	 * transaction.
+	 */
+	const_pointer
+	cdata() const noexcept
+	{
+		return elements();
+	}
+
+	/**
+	 * Returns an iterator to the first element. Adds all the elements to
+	 * the active transaction - the const iterators should be used to only
+	 * read them.
+	 */
+	iterator
+	begin()
+	{
+		return data();
+	}
+
+	/**
+	 * Returns an iterator past the last element. Adds all the elements to
+	 * the active transaction.
+	 */
+	iterator
+	end()
+	{
+		return data() + size();
+	}
+
+	const_iterator
+	begin() const noexcept
+	{
+		return cbegin();
+	}
+
+	const_iterator
+	end() const noexcept
+	{
+		return cend();
+	}
+
+	const_iterator
+	cbegin() const noexcept
+	{
+		return elements();
+	}
+
+	const_iterator
+	cend() const noexcept
+	{
+		return elements() + size();
+	}
+
+	reverse_iterator
+	rbegin()
+	{
+		return reverse_iterator(end());
+	}
+
+	reverse_iterator
+	rend()
+	{
+		return reverse_iterator(begin());
+	}
+
+	const_reverse_iterator
+	rbegin() const noexcept
+	{
+		return crbegin();
+	}
+
+	const_reverse_iterator
+	rend() const noexcept
+	{
+		return crend();
+	}
+
+	const_reverse_iterator
+	crbegin() const noexcept
+	{
+		return const_reverse_iterator(cend());
+	}
+
+	const_reverse_iterator
+	crend() const noexcept
+	{
+		return const_reverse_iterator(cbegin());
+	}
+
+	bool
+	empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	size_type
+	size() const noexcept
+	{
+		return sz;
+	}
+
+	/**
+	 * Returns the largest number of elements which fit in a single
+	 * allocation.
+	 */
+	size_type
+	max_size() const noexcept
+	{
+		return PMEMOBJ_MAX_ALLOC_SIZE / sizeof(value_type);
+	}
+
+	size_type
+	capacity() const noexcept
+	{
+		return cap;
+	}
+
+	/**
+	 * Increases the capacity to at least new_cap elements.
+	 *
+	 * @throw std::length_error if new_cap is larger than max_size().
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	void
+	reserve(size_type new_cap)
+	{
+		if (new_cap <= capacity())
+			return;
+
+		run_tx([&] { reallocate(new_cap); });
+	}
+
+	/**
+	 * Reduces the capacity to the size of the vector.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 */
+	void
+	shrink_to_fit()
+	{
+		if (capacity() == size())
+			return;
+
+		run_tx([&] {
+			if (empty())
+				free_data();
+			else
+				reallocate(size());
+		});
+	}
+
+	/**
+	 * Destroys all the elements, leaving the capacity unchanged.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	clear()
+	{
+		if (empty())
+			return;
+
+		run_tx([&] { shrink(0); });
+	}
+
+	/**
+	 * Inserts value before pos.
+	 *
+	 * @return iterator to the inserted element.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	insert(const_iterator pos, const value_type &value)
+	{
+		return insert(pos, 1, value);
+	}
+
+	/**
+	 * Inserts value before pos.
+	 *
+	 * @return iterator to the inserted element.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	insert(const_iterator pos, value_type &&value)
+	{
+		return emplace(pos, std::move(value));
+	}
+
+	/**
+	 * Inserts count copies of value before pos.
+	 *
+	 * @return iterator to the first inserted element, or pos when count
+	 * is zero.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	insert(const_iterator pos, size_type count, const value_type &value)
+	{
+		size_type idx = index_of(pos);
+		if (count == 0)
+			return elements() + idx;
+
+		run_tx([&] {
+			value_type tmp(value);
+			pointer gap = make_gap(idx, count);
+			std::uninitialized_fill_n(gap, count, tmp);
+			sz = size() + count;
+		});
+
+		return elements() + idx;
+	}
+
+	/**
+	 * Inserts the range [first, last) before pos. The range can't be
+	 * a part of the vector.
+	 *
+	 * @return iterator to the first inserted element, or pos when the
+	 * range is empty.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	template <typename ForwardIt,
+		  typename = typename std::iterator_traits<
+			  ForwardIt>::iterator_category>
+	iterator
+	insert(const_iterator pos, ForwardIt first, ForwardIt last)
+	{
+		size_type idx = index_of(pos);
+		size_type count =
+			static_cast<size_type>(std::distance(first, last));
+		if (count == 0)
+			return elements() + idx;
+
+		run_tx([&] {
+			pointer gap = make_gap(idx, count);
+			std::uninitialized_copy(first, last, gap);
+			sz = size() + count;
+		});
+
+		return elements() + idx;
+	}
+
+	/**
+	 * Inserts the elements of the initializer list before pos.
+	 *
+	 * @return iterator to the first inserted element, or pos when the
+	 * list is empty.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	insert(const_iterator pos, std::initializer_list<value_type> ilist)
+	{
+		return insert(pos, ilist.begin(), ilist.end());
+	}
+
+	/**
+	 * Constructs an element in place before pos.
+	 *
+	 * @return iterator to the inserted element.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	template <typename... Args>
+	iterator
+	emplace(const_iterator pos, Args &&... args)
+	{
+		size_type idx = index_of(pos);
+
+		run_tx([&] {
+			value_type tmp(std::forward<Args>(args)...);
+			pointer gap = make_gap(idx, 1);
+			new (gap) value_type(std::move(tmp));
+			sz = size() + 1;
+		});
+
+		return elements() + idx;
+	}
+
+	/**
+	 * Removes the element at pos.
+	 *
+	 * @return iterator following the removed element.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	erase(const_iterator pos)
+	{
+		return erase(pos, pos + 1);
+	}
+
+	/**
+	 * Removes the elements in the range [first, last).
+	 *
+	 * @return iterator following the last removed element.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	iterator
+	erase(const_iterator first, const_iterator last)
+	{
+		size_type idx = index_of(first);
+		size_type count = static_cast<size_type>(last - first);
+		if (count == 0)
+			return elements() + idx;
+
+		run_tx([&] {
+			size_type n = size();
+			pointer e = elements();
+
+			/* the removed elements and all the following ones */
+			add_range_to_tx(idx, n - idx);
+
+			std::move(e + idx + count, e + n, e + idx);
+			destroy(e + n - count, count);
+			sz = n - count;
+		});
+
+		return elements() + idx;
+	}
+
+	/**
+	 * Appends a copy of value to the end of the vector.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	push_back(const value_type &value)
+	{
+		emplace_back(value);
+	}
+
+	/**
+	 * Moves value to the end of the vector.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	push_back(value_type &&value)
+	{
+		emplace_back(std::move(value));
+	}
+
+	/**
+	 * Constructs an element in place at the end of the vector.
+	 *
+	 * The slot of the new element isn't snapshotted, it's only flushed on
+	 * commit.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	template <typename... Args>
+	void
+	emplace_back(Args &&... args)
+	{
+		run_tx([&] {
+			size_type n = size();
+			if (n < capacity()) {
+				add_tail_to_tx(n, 1);
+				new (elements() + n) value_type(
+					std::forward<Args>(args)...);
+			} else {
+				/*
+				 * The new element is constructed before the
+				 * old ones are moved, the arguments can refer
+				 * to them.
+				 */
+				size_type new_cap = grown_capacity(n + 1);
+				persistent_ptr<value_type[]> nbuf =
+					allocate(new_cap);
+				new (nbuf.get() + n) value_type(
+					std::forward<Args>(args)...);
+				replace_buffer(nbuf, new_cap, n, 0, 0);
+			}
+			sz = n + 1;
+		});
+	}
+
+	/**
+	 * Removes the last element.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	pop_back()
+	{
+		if (empty())
+			return;
+
+		run_tx([&] { shrink(size() - 1); });
+	}
+
+	/**
+	 * Resizes the vector to count elements, the new ones are
+	 * value-initialized.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	resize(size_type count)
+	{
+		resize_impl(count, [](pointer dst, size_type n) {
+			for (size_type i = 0; i < n; ++i)
+				new (dst + i) value_type();
+		});
+	}
+
+	/**
+	 * Resizes the vector to count elements, the new ones are copies of
+	 * value.
+	 *
+	 * @throw transaction_alloc_error when the allocation failed.
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	resize(size_type count, const value_type &value)
+	{
+		resize_impl(count, [&](pointer dst, size_type n) {
+			std::uninitialized_fill_n(dst, n, value);
+		});
+	}
+
+	/**
+	 * Exchanges the contents with the other vector, without moving any
+	 * elements.
+	 *
+	 * @throw transaction_error when the modification failed.
+	 */
+	void
+	swap(vector &other)
+	{
+		run_tx([&] {
+			persistent_ptr<value_type[]> b = buf;
+			size_type s = sz;
+			size_type c = cap;
+
+			buf = other.buf;
+			sz = other.sz;
+			cap = other.cap;
+
+			other.buf = b;
+			other.sz = s;
+			other.cap = c;
+		});
+	}
+
+private:
+	typedef std::integral_constant<bool,
+				       std::is_trivial<value_type>::value>
+		is_trivial_type;
+
+	pool_base
+	get_pool() const
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		if (pop == nullptr)
+			throw pool_error("vector isn't in persistent memory");
+
+		return pool_base(pop);
+	}
+
+	/*
+	 * Runs f in a transaction, nested in the active one if there is any.
+	 */
+	template <typename F>
+	void
+	run_tx(F &&f)
+	{
+		pool_base pop = get_pool();
+		transaction::exec_tx(pop, f);
+	}
+
+	pointer
+	elements() const noexcept
+	{
+		return buf.get();
+	}
+
+	void
+	check_range(size_type pos) const
+	{
+		if (pos >= size())
+			throw std::out_of_range("vector index out of range");
+	}
+
+	size_type
+	index_of(const_iterator pos) const noexcept
+	{
+		return static_cast<size_type>(pos - cbegin());
+	}
+
+	/*
+	 * Returns the capacity for at least n elements, at least twice as
+	 * big as the current one.
+	 */
+	size_type
+	grown_capacity(size_type n) const
+	{
+		if (n > max_size())
+			throw std::length_error("vector too long");
+
+		size_type c = capacity();
+		if (c > max_size() / 2)
+			return max_size();
+
+		return std::max(n, 2 * c);
+	}
+
+	/*
+	 * Adds the existing elements [first, first + n) to the transaction.
+	 */
+	void
+	add_range_to_tx(size_type first, size_type n)
+	{
+		if (n == 0)
+			return;
+
+		if (pmemobj_tx_add_range_direct(elements() + first,
+						n * sizeof(value_type)))
+			throw transaction_error("Could not add the elements to"
+						" the transaction.");
+	}
+
+	/*
+	 * Adds the unused slots [first, first + n) to the transaction. They
+	 * hold no data, so they are only flushed on commit.
+	 */
+	void
+	add_tail_to_tx(size_type first, size_type n)
+	{
+		if (n == 0)
+			return;
+
+		if (pmemobj_tx_xadd_range_direct(elements() + first,
+						 n * sizeof(value_type),
+						 POBJ_XADD_NO_SNAPSHOT))
+			throw transaction_error("Could not add the elements to"
+						" the transaction.");
+	}
+
+	/*
+	 * Adds all the elements to the transaction, if there is one.
+	 */
+	void
+	add_elements_to_tx()
+	{
+		if (pmemobj_tx_stage() == TX_STAGE_WORK)
+			add_range_to_tx(0, size());
+	}
+
+	static persistent_ptr<value_type[]>
+	allocate(size_type n)
+	{
+		persistent_ptr<value_type[]> p = pmemobj_tx_alloc(
+			sizeof(value_type) * n, detail::type_num<value_type>());
+		if (p == nullptr)
+			throw transaction_alloc_error(
+				"failed to allocate persistent memory vector");
+
+		return p;
+	}
+
+	static void
+	destroy(pointer first, size_type n)
+	{
+		for (size_type i = 0; i < n; ++i)
+			first[i].~value_type();
+	}
+
+	/*
+	 * Moves n elements to the uninitialized dst, destroying them in src.
+	 */
+	static void
+	relocate(pointer dst, pointer src, size_type n, std::true_type)
+	{
+		if (n != 0)
+			std::memcpy(static_cast<void *>(dst), src,
+				    n * sizeof(value_type));
+	}
+
+	static void
+	relocate(pointer dst, pointer src, size_type n, std::false_type)
+	{
+		for (size_type i = 0; i < n; ++i) {
+			new (dst + i) value_type(std::move(src[i]));
+			src[i].~value_type();
+		}
+	}
+
+	/*
+	 * Moves the elements to the new buffer, leaving a gap of count slots
+	 * at idx, and frees the old one. The slots past the moved elements can
+	 * be already occupied in the new buffer.
+	 */
+	void
+	replace_buffer(const persistent_ptr<value_type[]> &nbuf,
+		       size_type new_cap, size_type n, size_type idx,
+		       size_type count)
+	{
+		pointer src = elements();
+		pointer dst = nbuf.get();
+
+		if (n != 0) {
+			/*
+			 * Moving the elements out modifies the old buffer,
+			 * which has to be restored on abort.
+			 */
+			if (!is_trivial_type::value)
+				add_range_to_tx(0, n);
+
+			relocate(dst, src, idx, is_trivial_type());
+			relocate(dst + idx + count, src + idx, n - idx,
+				 is_trivial_type());
+		}
+
+		if (buf != nullptr && pmemobj_tx_free(buf.raw()) != 0)
+			throw transaction_error("failed to free the buffer");
+
+		buf = nbuf;
+		cap = new_cap;
+	}
+
+	/*
+	 * Moves the elements to a new buffer of new_cap elements.
+	 */
+	void
+	reallocate(size_type new_cap)
+	{
+		if (new_cap > max_size())
+			throw std::length_error("vector too long");
+
+		replace_buffer(allocate(new_cap), new_cap, size(), size(), 0);
+	}
+
+	/*
+	 * Opens a gap of count uninitialized slots at idx, moving the
+	 * following elements back, and returns it. The size is left to the
+	 * caller, to update after the construction of the new elements.
+	 */
+	pointer
+	make_gap(size_type idx, size_type count)
+	{
+		size_type n = size();
+
+		if (count > max_size() - n)
+			throw std::length_error("vector too long");
+
+		if (n + count > capacity()) {
+			size_type new_cap = grown_capacity(n + count);
+			replace_buffer(allocate(new_cap), new_cap, n, idx,
+				       count);
+
+			return elements() + idx;
+		}
+
+		pointer e = elements();
+		add_range_to_tx(idx, n - idx);
+		add_tail_to_tx(n, count);
+
+		if (is_trivial_type::value) {
+			if (n != idx)
+				std::memmove(static_cast<void *>(e + idx + count),
+					     e + idx,
+					     (n - idx) * sizeof(value_type));
+		} else {
+			for (size_type i = n; i-- > idx;) {
+				new (e + i + count)
+					value_type(std::move(e[i]));
+				e[i].~value_type();
+			}
+		}
+
+		return e + idx;
+	}
+
+	/*
+	 * Destroys the elements past new_size.
+	 */
+	void
+	shrink(size_type new_size)
+	{
+		size_type n = size();
+
+		/*
+		 * The removed slots can be overwritten later in the same
+		 * transaction, without a snapshot.
+		 */
+		add_range_to_tx(new_size, n - new_size);
+		destroy(elements() + new_size, n - new_size);
+		sz = new_size;
+	}
+
+	/*
+	 * Replaces the contents with count elements, constructed by init.
+	 */
+	template <typename Init>
+	void
+	assign_impl(size_type count, Init init)
+	{
+		if (count > max_size())
+			throw std::length_error("vector too long");
+
+		size_type n = size();
+		add_range_to_tx(0, n);
+		destroy(elements(), n);
+
+		if (count > capacity()) {
+			persistent_ptr<value_type[]> nbuf = allocate(count);
+			init(nbuf.get(), count);
+			replace_buffer(nbuf, count, 0, 0, 0);
+		} else {
+			if (count > n)
+				add_tail_to_tx(n, count - n);
+			init(elements(), count);
+		}
+
+		sz = count;
+	}
+
+	template <typename ForwardIt>
+	void
+	assign_range(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
+	{
+		size_type count =
+			static_cast<size_type>(std::distance(first, last));
+
+		run_tx([&] {
+			assign_impl(count, [&](pointer dst, size_type) {
+				std::uninitialized_copy(first, last, dst);
+			});
+		});
+	}
+
+	template <typename InputIt>
+	void
+	assign_range(InputIt first, InputIt last, std::input_iterator_tag)
+	{
+		run_tx([&] {
+			shrink(0);
+			for (; first != last; ++first)
+				emplace_back(*first);
+		});
+	}
+
+	template <typename Init>
+	void
+	resize_impl(size_type count, Init init)
+	{
+		size_type n = size();
+		if (count == n)
+			return;
+
+		run_tx([&] {
+			if (count < n) {
+				shrink(count);
+				return;
+			}
+
+			if (count > capacity())
+				reallocate(grown_capacity(count));
+			else
+				add_tail_to_tx(n, count - n);
+
+			init(elements() + n, count - n);
+			sz = count;
+		});
+	}
+
+	/*
+	 * Takes over the buffer of the other vector, leaving it empty.
+	 */
+	void
+	take(vector &other)
+	{
+		buf = other.buf;
+		sz = other.sz;
+		cap = other.cap;
+
+		other.buf = nullptr;
+		other.sz = 0;
+		other.cap = 0;
+	}
+
+	/*
+	 * Destroys the elements and frees the buffer.
+	 */
+	void
+	free_data()
+	{
+		if (buf == nullptr)
+			return;
+
+		destroy(elements(), size());
+		pmemobj_tx_free(buf.raw());
+
+		buf = nullptr;
+		sz = 0;
+		cap = 0;
+	}
+
+	persistent_ptr<value_type[]> buf;
+	p<size_type> sz;
+	p<size_type> cap;
+};
+
+/**
+ * Checks whether the vectors have the same elements.
+ */
+template <typename T>
+bool
+operator==(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return lhs.size() == rhs.size() &&
+		std::equal(lhs.cbegin(), lhs.cend(), rhs.cbegin());
+}
+
+template <typename T>
+bool
+operator!=(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+/**
+ * Compares the elements of the vectors lexicographically.
+ */
+template <typename T>
+bool
+operator<(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return std::lexicographical_compare(lhs.cbegin(), lhs.cend(),
+					    rhs.cbegin(), rhs.cend());
+}
+
+template <typename T>
+bool
+operator>(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return rhs < lhs;
+}
+
+template <typename T>
+bool
+operator<=(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return !(rhs < lhs);
+}
+
+template <typename T>
+bool
+operator>=(const vector<T> &lhs, const vector<T> &rhs)
+{
+	return !(lhs < rhs);
+}
+
+/**
+ * Exchanges the contents of the vectors.
+ */
+template <typename T>
+void
+swap(vector<T> &lhs, vector<T> &rhs)
+{
+	lhs.swap(rhs);
+}
+
+} /* namespace obj */
+
+} /* namespace nvml */
+
+#endif /* PMEMOBJ_VECTOR_HPP */
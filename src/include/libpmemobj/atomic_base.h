@@ -65,6 +65,41 @@ int pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 int pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	uint64_t type_num);
 
+/*
+ * Reserved object or deferred store, to be published or canceled.
+ * The contents are internal to the library.
+ */
+struct pobj_action {
+	uint64_t type;
+	uint64_t data[4];
+};
+
+/*
+ * Reserves a new object in volatile state of the heap only, the object
+ * becomes allocated when it is published, or is released by canceling it.
+ */
+PMEMoid pmemobj_reserve(PMEMobjpool *pop, struct pobj_action *act,
+	size_t size, uint64_t type_num);
+
+/*
+ * Creates an action which stores the value in ptr when published.
+ */
+void pmemobj_set_value(PMEMobjpool *pop, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value);
+
+/*
+ * Persistently allocates all of the reserved objects and performs all of the
+ * stores of the given actions.
+ */
+int pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv,
+	size_t actvcnt);
+
+/*
+ * Releases all of the objects reserved by the given actions.
+ */
+void pmemobj_cancel(PMEMobjpool *pop, struct pobj_action *actv,
+	size_t actvcnt);
+
 /*
  * Resizes an existing object.
  */
@@ -88,6 +123,95 @@ int pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
  */
 void pmemobj_free(PMEMoid *oidp);
 
+/*
+ * Arenas of short-lived objects
+ *
+ * An arena is a single object from which smaller ones are allocated by
+ * bumping a pointer. They're all freed at once by freeing the arena with
+ * pmemobj_free, and can't be freed on their own.
+ */
+int pmemobj_arena_create(PMEMobjpool *pop, PMEMoid *arenap, size_t size,
+	uint64_t type_num);
+
+PMEMoid pmemobj_arena_alloc(PMEMobjpool *pop, PMEMoid arena, size_t size);
+
+/*
+ * Epoch-based reclamation of the objects of lock-free structures
+ *
+ * The readers access the objects of a structure between pmemobj_epoch_enter
+ * and pmemobj_epoch_exit. An object unlinked from the structure is retired
+ * instead of being freed, and is freed once all of the readers which might
+ * have found it are gone.
+ */
+uint64_t pmemobj_epoch_enter(PMEMobjpool *pop);
+
+void pmemobj_epoch_exit(PMEMobjpool *pop, uint64_t token);
+
+int pmemobj_retire(PMEMobjpool *pop, PMEMoid oid);
+
+/*
+ * Frees the retired objects of the calling thread's lane which can no longer
+ * be reached by any reader.
+ */
+int pmemobj_epoch_reclaim(PMEMobjpool *pop);
+
+/*
+ * User-defined allocation classes
+ *
+ * A run class serves objects whose size (including the internal object
+ * header) is a multiple of unit_size, up to units_per_block units per
+ * allocation. The only huge class is the one operating on whole chunks.
+ */
+enum pobj_alloc_class_type {
+	POBJ_CLASS_RUN,
+	POBJ_CLASS_HUGE,
+};
+
+enum pobj_header_type {
+	POBJ_HEADER_LEGACY,
+	POBJ_HEADER_COMPACT, /* single-unit run blocks with a 16 byte header */
+	POBJ_HEADER_NONE, /* single-unit run blocks without any header */
+};
+
+struct pobj_alloc_class_desc {
+	size_t unit_size;
+	unsigned units_per_block;
+	enum pobj_alloc_class_type type;
+	enum pobj_header_type header_type;
+	unsigned class_id; /* filled in by pmemobj_alloc_class_register */
+};
+
+/*
+ * Registers a new allocation class, or finds an existing one with the same
+ * unit size, and stores its identifier in desc->class_id.
+ */
+int pmemobj_alloc_class_register(PMEMobjpool *pop,
+	struct pobj_alloc_class_desc *desc);
+
+#define POBJ_XALLOC_ZERO ((uint64_t)1 << 0)
+
+#define POBJ_XALLOC_ALIGN_SHIFT 40
+#define POBJ_XALLOC_ALIGN_MASK ((uint64_t)0x3F << POBJ_XALLOC_ALIGN_SHIFT)
+#define POBJ_ALIGN_SHIFT(shift)\
+(((uint64_t)(shift)) << POBJ_XALLOC_ALIGN_SHIFT)
+
+#define POBJ_XALLOC_CLASS_SHIFT 48
+#define POBJ_XALLOC_CLASS_MASK ((uint64_t)0xFFFF << POBJ_XALLOC_CLASS_SHIFT)
+#define POBJ_CLASS_ID(id) (((uint64_t)(id)) << POBJ_XALLOC_CLASS_SHIFT)
+
+#define POBJ_XALLOC_VALID_FLAGS (POBJ_XALLOC_ZERO | POBJ_XALLOC_ALIGN_MASK |\
+	POBJ_XALLOC_CLASS_MASK)
+
+/*
+ * Allocates a new object just like pmemobj_alloc, but the allocation can be
+ * zeroed (POBJ_XALLOC_ZERO), aligned to (1 << shift) bytes
+ * (POBJ_ALIGN_SHIFT(shift)) and served from a specific allocation class
+ * (POBJ_CLASS_ID(class_id)).
+ */
+int pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -75,6 +75,12 @@ static const PMEMoid OID_NULL = { 0, 0 };
 PMEMobjpool *pmemobj_pool_by_ptr(const void *addr);
 PMEMobjpool *pmemobj_pool_by_oid(PMEMoid oid);
 
+/*
+ * Returns the handle of the object at the address, or OID_NULL if the address
+ * doesn't belong to any open pool.
+ */
+PMEMoid pmemobj_oid(const void *addr);
+
 #ifndef _WIN32
 
 extern int _pobj_cache_invalidate;
@@ -108,6 +114,18 @@ pmemobj_direct(PMEMoid oid)
 	return (void *)((uintptr_t)_pobj_cached_pool.pop + oid.off);
 }
 
+/*
+ * Hints the processor to bring the first cache line of the object into the
+ * cache, so that it's already there when the object is accessed.
+ */
+static inline void
+pmemobj_prefetch(PMEMoid oid)
+{
+	void *ptr = pmemobj_direct(oid);
+	if (ptr != NULL)
+		__builtin_prefetch(ptr);
+}
+
 #else /* _WIN32 */
 
 /* XXX - this is temporary (see obj.c for details) */
@@ -117,8 +135,20 @@ pmemobj_direct(PMEMoid oid)
  */
 void *pmemobj_direct(PMEMoid oid);
 
+/*
+ * Hints the processor to bring the first cache line of the object into the
+ * cache, so that it's already there when the object is accessed.
+ */
+void pmemobj_prefetch(PMEMoid oid);
+
 #endif /* _WIN32 */
 
+/*
+ * Stores the direct pointers of the n objects in ptrs, NULL for the ones
+ * pmemobj_direct would return NULL for, and prefetches the objects.
+ */
+void pmemobj_direct_n(const PMEMoid *oids, void **ptrs, size_t n);
+
 const char *pmemobj_errormsg(void);
 
 /*
@@ -134,6 +164,33 @@ size_t pmemobj_alloc_usable_size(PMEMoid oid);
  */
 uint64_t pmemobj_type_num(PMEMoid oid);
 
+struct pobj_object_info {
+	void *ptr; /* direct pointer of the object */
+	size_t size; /* number of usable bytes in the object */
+	uint64_t type_num; /* type number of the object */
+};
+
+/*
+ * Looks up the direct pointer, the usable size and the type number of each
+ * of the objects in one go, prefetching the metadata of the objects further
+ * in the array. Null objects get a NULL pointer, zero size and type number.
+ */
+void pmemobj_object_info(const PMEMoid *oids, size_t noids,
+	struct pobj_object_info *info);
+
+struct pobj_defrag_result {
+	size_t total; /* number of processed objects */
+	size_t relocated; /* number of relocated objects */
+};
+
+/*
+ * Moves the objects out of sparsely used runs and updates the given
+ * pointers to them, all in a single transaction. Fully emptied runs are
+ * returned to the heap as free chunks.
+ */
+int pmemobj_defrag(PMEMobjpool *pop, PMEMoid **oidv, size_t oidcnt,
+	struct pobj_defrag_result *result);
+
 /*
  * Pmemobj specific low-level memory manipulation functions.
  *
@@ -61,6 +61,40 @@ PMEMoid pmemobj_first(PMEMobjpool *pop);
  */
 PMEMoid pmemobj_next(PMEMoid oid);
 
+/*
+ * Returns the first object of the specified type number.
+ */
+PMEMoid pmemobj_first_type(PMEMobjpool *pop, uint64_t type_num);
+
+/*
+ * Returns the next object of the same type number.
+ */
+PMEMoid pmemobj_next_type(PMEMoid oid);
+
+typedef int (*pmemobj_foreach_cb)(PMEMoid oid, void *arg);
+
+/*
+ * Calls the callback with every object of one of the npartitions disjoint
+ * parts of the pool, until it returns a non-zero value. The parts can be
+ * iterated through concurrently.
+ */
+int pmemobj_foreach_partition(PMEMobjpool *pop, unsigned npartitions,
+	unsigned partition, pmemobj_foreach_cb cb, void *arg);
+
+/*
+ * Frees all the objects of the type number at once. The objects are freed
+ * run by run, which is much faster than freeing each of them separately,
+ * but none of the references to them are cleared.
+ */
+int pmemobj_free_type(PMEMobjpool *pop, uint64_t type_num);
+
+/*
+ * Frees all the objects for which the select callback returns a non-zero
+ * value, just like pmemobj_free_type.
+ */
+int pmemobj_free_select(PMEMobjpool *pop, pmemobj_foreach_cb select,
+	void *arg);
+
 
 #ifdef __cplusplus
 }
@@ -61,6 +61,30 @@ int pmemobj_list_move(PMEMobjpool *pop, size_t pe_old_offset,
 	void *head_old, size_t pe_new_offset, void *head_new,
 	PMEMoid dest, int before, PMEMoid oid);
 
+enum pobj_list_op_type {
+	POBJ_LIST_OP_INSERT,
+	POBJ_LIST_OP_REMOVE,
+	POBJ_LIST_OP_MOVE,
+};
+
+struct pobj_list_op {
+	enum pobj_list_op_type type;
+	size_t pe_offset; /* offset of the list entry, the old one for a move */
+	void *head; /* list head, the old one for a move */
+	size_t pe_new_offset; /* offset of the new list entry, for a move */
+	void *head_new; /* new list head, for a move */
+	PMEMoid dest; /* destination, for an insert or a move */
+	int before;
+	PMEMoid oid;
+};
+
+/*
+ * Performs the operations in the given order, with the list locks taken
+ * once and the redo log shared by as many of them as possible.
+ */
+int pmemobj_list_batch(PMEMobjpool *pop, const struct pobj_list_op *ops,
+	size_t nops);
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,10 +52,21 @@ extern "C" {
  * Pool management.
  */
 PMEMobjpool *pmemobj_open(const char *path, const char *layout);
+PMEMobjpool *pmemobj_open_rdonly(const char *path, const char *layout);
 PMEMobjpool *pmemobj_create(const char *path, const char *layout,
 	size_t poolsize, mode_t mode);
 void pmemobj_close(PMEMobjpool *pop);
 int pmemobj_check(const char *path, const char *layout);
+int pmemobj_check_wait(PMEMobjpool *pop);
+
+/*
+ * Online scrubbing of the heap, the inconsistencies found are passed to the
+ * report function, which is also called with a NULL msg after every pass.
+ */
+int pmemobj_scrub_start(PMEMobjpool *pop, unsigned rate,
+	void (*report)(PMEMobjpool *pop, uint64_t off, const char *msg,
+	void *arg), void *arg);
+void pmemobj_scrub_stop(PMEMobjpool *pop);
 
 /*
  * If called for the first time on a newly created pool, the root object
@@ -81,6 +92,83 @@ PMEMoid pmemobj_root_construct(PMEMobjpool *pop, size_t size,
  */
 size_t pmemobj_root_size(PMEMobjpool *pop);
 
+#define POBJ_LANE_HOLD_TIME_BUCKETS 16
+
+struct pobj_lane_stats {
+	uint64_t acquisitions; /* number of lanes acquired */
+	uint64_t contended; /* acquisitions which found the lane busy */
+	uint64_t waits; /* acquisitions which waited for a lane release */
+
+	/* number of lanes held for less than 2^n us (the last one: longer) */
+	uint64_t hold_time[POBJ_LANE_HOLD_TIME_BUCKETS];
+};
+
+/*
+ * Returns the lane statistics gathered since the pool was opened, if they
+ * were enabled by the PMEMOBJ_LANE_STATS environment variable.
+ */
+int pmemobj_lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats);
+
+/*
+ * Operations the flushes and fences are attributed to, by the outermost
+ * lane the thread holds at the time.
+ */
+enum pobj_persist_op {
+	POBJ_PERSIST_ALLOC, /* atomic allocations and frees */
+	POBJ_PERSIST_LIST, /* atomic list operations */
+	POBJ_PERSIST_TX, /* transactions */
+	POBJ_PERSIST_OTHER, /* everything else, e.g. pmemobj_persist */
+
+	POBJ_PERSIST_OPS
+};
+
+struct pobj_persist_stats {
+	uint64_t flushes; /* flushes, including the ones of persists */
+	uint64_t flushed_lines; /* cache lines flushed */
+	uint64_t fences; /* drains, including the ones of persists and copies */
+	uint64_t copied_bytes; /* bytes of persistent memcpy and memset */
+};
+
+/*
+ * Returns the flush and fence counts of each of the operation types since
+ * the pool was opened, if they were enabled by the PMEMOBJ_PERSIST_STATS
+ * environment variable.
+ */
+int pmemobj_persist_stats(PMEMobjpool *pop,
+	struct pobj_persist_stats stats[POBJ_PERSIST_OPS]);
+
+#define POBJ_RUN_OCCUPANCY_BINS 10
+
+struct pobj_alloc_class_stats {
+	unsigned class_id;
+	size_t unit_size;
+	uint64_t free_units; /* free units held by the allocator */
+	uint64_t free_blocks; /* contiguous ranges of the free units */
+	uint64_t nruns; /* runs used by the allocator */
+	uint64_t nruns_unloaded; /* runs with free units, not used yet */
+
+	/* runs with n * 10% to (n + 1) * 10% of their units in use */
+	uint64_t run_occupancy[POBJ_RUN_OCCUPANCY_BINS];
+};
+
+struct pobj_heap_stats {
+	uint64_t heap_size;
+	unsigned nzones;
+	unsigned nzones_populated; /* zones the statistics are gathered from */
+	unsigned nclasses; /* number of the allocation classes */
+	uint64_t free_huge; /* bytes in free chunks */
+	uint64_t free_huge_largest; /* bytes in the largest free chunk range */
+	uint64_t free_runs; /* bytes in free units of the runs */
+	uint64_t free_total;
+};
+
+/*
+ * Returns the fragmentation statistics of the heap, computed from the
+ * volatile state of the allocator, and of up to nclasses allocation classes.
+ */
+int pmemobj_heap_stats(PMEMobjpool *pop, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses);
+
 #ifdef __cplusplus
 }
 #endif
@@ -90,6 +90,22 @@ int pmemobj_cond_timedwait(PMEMobjpool *pop, PMEMcond *__restrict condp,
 int pmemobj_cond_wait(PMEMobjpool *pop, PMEMcond *condp,
 	PMEMmutex *__restrict mutexp);
 
+/*
+ * Volatile state kept in a persistent object, initialized once per run.
+ */
+struct pmemvlt {
+	uint64_t runid;
+};
+
+#define PMEMvlt(T)\
+struct {\
+	struct pmemvlt vlt;\
+	T value;\
+}
+
+void *pmemobj_volatile(PMEMobjpool *pop, struct pmemvlt *vlt, void *ptr,
+	size_t size, int (*constr)(void *ptr, void *arg), void *arg);
+
 #ifdef __cplusplus
 }
 #endif
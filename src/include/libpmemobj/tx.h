@@ -120,6 +120,19 @@ pmemobj_tx_add_range_direct(p, sizeof(*p))
 #define TX_ADD_FIELD_DIRECT(p, field)\
 pmemobj_tx_add_range_direct(&(p)->field, sizeof((p)->field))
 
+#define TX_XADD(o, flags)\
+pmemobj_tx_xadd_range((o).oid, 0, sizeof(*(o)._type), flags)
+
+#define TX_XADD_FIELD(o, field, flags)\
+pmemobj_tx_xadd_range((o).oid, TOID_OFFSETOF(o, field),\
+		sizeof(D_RO(o)->field), flags)
+
+#define TX_XADD_DIRECT(p, flags)\
+pmemobj_tx_xadd_range_direct(p, sizeof(*p), flags)
+
+#define TX_XADD_FIELD_DIRECT(p, field, flags)\
+pmemobj_tx_xadd_range_direct(&(p)->field, sizeof((p)->field), flags)
+
 
 #define TX_NEW(t)\
 ((TOID(t))pmemobj_tx_alloc(sizeof(t), TOID_TYPE_NUM(t)))
@@ -67,6 +67,16 @@ enum pobj_tx_stage {
  */
 enum pobj_tx_stage pmemobj_tx_stage(void);
 
+/*
+ * Returns a nonzero number identifying the ranges already added to the
+ * current transaction of the thread, or zero if the current stage isn't
+ * TX_STAGE_WORK. The number is different in every transaction and changes
+ * whenever a range stops being a part of the transaction (when an object
+ * allocated in it is freed), so the ranges added while it stays the same don't
+ * need to be added again.
+ */
+uint64_t pmemobj_tx_epoch(void);
+
 enum pobj_tx_lock {
 	TX_LOCK_NONE,
 	TX_LOCK_MUTEX,	/* PMEMmutex */
@@ -161,6 +171,47 @@ int pmemobj_tx_add_range(PMEMoid oid, uint64_t off, size_t size);
  */
 int pmemobj_tx_add_range_direct(const void *ptr, size_t size);
 
+#define POBJ_XADD_NO_FLUSH ((uint64_t)1 << 0)
+#define POBJ_XADD_NO_SNAPSHOT ((uint64_t)1 << 1)
+
+#define POBJ_XADD_VALID_FLAGS (POBJ_XADD_NO_FLUSH | POBJ_XADD_NO_SNAPSHOT)
+
+/*
+ * Behaves exactly the same as pmemobj_tx_add_range when 'flags' equals 0.
+ * With POBJ_XADD_NO_FLUSH the range isn't flushed on commit - the application
+ * takes the responsibility of persisting it, e.g. because it's going to be
+ * modified again anyway. The flags apply only to the parts of the range which
+ * aren't in the transaction yet.
+ *
+ * With POBJ_XADD_NO_SNAPSHOT the range is only flushed on commit, its current
+ * contents aren't saved in the undo log and aren't restored on abort. It's
+ * meant for memory that holds no valid data yet, like the unused tail of
+ * a buffer which is being filled.
+ */
+int pmemobj_tx_xadd_range(PMEMoid oid, uint64_t off, size_t size,
+	uint64_t flags);
+
+/*
+ * Behaves exactly the same as pmemobj_tx_add_range_direct when 'flags' equals
+ * 0. 'flags' are the same as in pmemobj_tx_xadd_range.
+ */
+int pmemobj_tx_xadd_range_direct(const void *ptr, size_t size, uint64_t flags);
+
+/*
+ * Defers the write of 'size' bytes from 'src' to the given memory region until
+ * the commit of the transaction. Instead of being snapshotted in the undo log,
+ * all such writes are saved in a redo log at commit and applied after a single
+ * fence. The memory region isn't modified, and keeps its old contents, until
+ * then. If the transaction aborts, the writes are discarded. The supplied block
+ * of memory has to be within the given pool.
+ *
+ * If successful, returns zero.
+ * Otherwise, state changes to TX_STAGE_ONABORT and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ */
+int pmemobj_tx_write(void *dest, const void *src, size_t size);
+
 /*
  * Transactionally allocates a new object.
  *
@@ -171,6 +222,22 @@ int pmemobj_tx_add_range_direct(const void *ptr, size_t size);
  */
 PMEMoid pmemobj_tx_alloc(size_t size, uint64_t type_num);
 
+/*
+ * Transactionally allocates noids new objects of the same size and type
+ * number and stores their handles in the oids array.
+ *
+ * The allocations and the undo log entries of the objects are recorded
+ * in groups, each using a single redo log operation.
+ *
+ * If successful, returns zero.
+ * Otherwise, state changes to TX_STAGE_ONABORT, all oids are set
+ * to OID_NULL and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ */
+int pmemobj_tx_alloc_bulk(size_t size, uint64_t type_num, PMEMoid *oids,
+	size_t noids);
+
 /*
  * Transactionally allocates new zeroed object.
  *
@@ -181,6 +248,17 @@ PMEMoid pmemobj_tx_alloc(size_t size, uint64_t type_num);
  */
 PMEMoid pmemobj_tx_zalloc(size_t size, uint64_t type_num);
 
+/*
+ * Transactionally allocates a new object, with the same flags as
+ * pmemobj_xalloc.
+ *
+ * If successful, returns PMEMoid.
+ * Otherwise, state changes to TX_STAGE_ONABORT and an OID_NULL is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ */
+PMEMoid pmemobj_tx_xalloc(size_t size, uint64_t type_num, uint64_t flags);
+
 /*
  * Transactionally resizes an existing object.
  *
@@ -99,6 +99,7 @@ struct pmempool_check_args {
 	const char *backup_path;
 	enum pmempool_pool_type pool_type;
 	int flags;
+	const char *progress_path;
 };
 
 /*
@@ -77,10 +77,54 @@ RPMEMpool *rpmem_open(const char *target, const char *pool_set_name,
 
 int rpmem_close(RPMEMpool *rpp);
 
+/*
+ * rpmem_range -- memory range of the pool to persist
+ */
+struct rpmem_range {
+	size_t offset;	/* offset in pool */
+	size_t length;	/* length of the range */
+};
+
 int rpmem_persist(RPMEMpool *rpp, size_t offset, size_t length,
 		unsigned lane);
+int rpmem_persistv(RPMEMpool *rpp, const struct rpmem_range *ranges,
+		unsigned nranges, unsigned lane);
+int rpmem_persist_async(RPMEMpool *rpp, size_t offset, size_t length,
+		unsigned lane);
+int rpmem_flush(RPMEMpool *rpp, size_t offset, size_t length,
+		unsigned lane);
+int rpmem_drain(RPMEMpool *rpp, unsigned lane);
+int rpmem_poll(RPMEMpool *rpp, unsigned lane);
+int rpmem_wait(RPMEMpool *rpp, unsigned lane);
 int rpmem_read(RPMEMpool *rpp, void *buff, size_t offset, size_t length);
 
+/* number of buckets of the persist latency histogram */
+#define RPMEM_STATS_NBUCKETS	32
+
+/* lane number which selects the statistics summed over all lanes */
+#define RPMEM_ALL_LANES		((unsigned)-1)
+
+/*
+ * rpmem_stats -- persist statistics of a lane or a pool
+ *
+ * Collected only if the RPMEM_ENABLE_STATS environment variable is set to 1.
+ * Bucket i of the histogram counts persist latencies in range
+ * [2^i, 2^(i+1)) nanoseconds.
+ */
+struct rpmem_stats {
+	uint64_t npersists;	/* completed persist operations */
+	uint64_t nwrites;	/* WRITEs posted */
+	uint64_t nbytes;	/* bytes written */
+	uint64_t max_depth;	/* most WRITEs covered by one persist */
+	uint64_t persist_ns;	/* sum of persist latencies */
+	uint64_t max_persist_ns; /* highest persist latency */
+	uint64_t wait_ns;	/* time spent waiting for completions */
+	uint64_t hist[RPMEM_STATS_NBUCKETS]; /* persist latency histogram */
+};
+
+int rpmem_stats_get(RPMEMpool *rpp, unsigned lane, struct rpmem_stats *stats);
+int rpmem_stats_reset(RPMEMpool *rpp);
+
 /*
  * RPMEM_MAJOR_VERSION and RPMEM_MINOR_VERSION provide the current version of
  * the librpmem API as provided by this header file.  Applications can verify
@@ -55,11 +55,35 @@ typedef struct vmem VMEM;	/* opaque type internal to libvmem */
 
 #define VMEM_MIN_POOL ((size_t)(1024 * 1024 * 14)) /* min pool size: 14MB */
 
+/*
+ * per-pool allocator tuning for vmem_create_config(), a zeroed structure
+ * selects the same defaults as vmem_create()
+ */
+struct vmem_config {
+	unsigned narenas;	/* number of arenas, 0 selects the default */
+	int tcache_disable;	/* non-zero disables per-thread caches */
+	size_t tcache_max;	/* largest cached size, 0 selects the default */
+	int lg_dirty_mult;	/* dirty page purge ratio, see VMEM_DIRTY_* */
+	size_t grow_size;	/* size added when exhausted, 0 for fixed size */
+	size_t max_size;	/* limit for a growing pool, 0 for no limit */
+	size_t page_size;	/* e.g. 2MB or 1GB for huge pages, 0 default */
+};
+
+#define VMEM_DIRTY_DEFAULT 0	/* default active:dirty pages ratio */
+#define VMEM_DIRTY_NEVER (-1)	/* never purge dirty pages */
+
 VMEM *vmem_create(const char *dir, size_t size);
+VMEM *vmem_create_config(const char *dir, size_t size,
+	const struct vmem_config *config);
 VMEM *vmem_create_in_region(void *addr, size_t size);
+
+#define VMEM_NUMA_NODES_MAX 16	/* max number of nodes of a NUMA pool */
+
+VMEM *vmem_create_numa(const char *const dirs[], unsigned ndirs, size_t size);
 void vmem_delete(VMEM *vmp);
 int vmem_check(VMEM *vmp);
 void vmem_stats_print(VMEM *vmp, const char *opts);
+int vmem_stats_get(VMEM *vmp, const char *name, void *oldp, size_t *oldlenp);
 
 /*
  * support for malloc and friends...
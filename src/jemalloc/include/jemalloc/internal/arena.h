@@ -1098,7 +1098,7 @@ arena_malloc(arena_t *arena, size_t size, bool zero, bool try_tcache)
 		 * Initialize tcache after checking size in order to avoid
 		 * infinite recursion during tcache initialization.
 		 */
-		if (try_tcache && size <= tcache_maxclass && (tcache =
+		if (try_tcache && size <= pool->tcache_maxclass && (tcache =
 		    tcache_get(pool, true)) != NULL)
 			return (tcache_alloc_large(tcache, size, zero));
 		else {
@@ -1177,8 +1177,8 @@ arena_dalloc(arena_chunk_t *chunk, void *ptr, bool try_tcache)
 
 		assert(((uintptr_t)ptr & PAGE_MASK) == 0);
 
-		if (try_tcache && size <= tcache_maxclass && (tcache =
-		    tcache_get(chunk->arena->pool, false)) != NULL) {
+		if (try_tcache && size <= chunk->arena->pool->tcache_maxclass &&
+		    (tcache = tcache_get(chunk->arena->pool, false)) != NULL) {
 			tcache_dalloc_large(tcache, ptr, size);
 		} else
 			arena_dalloc_large(chunk->arena, chunk, ptr);
@@ -7,6 +7,9 @@ typedef struct ctl_indexed_node_s ctl_indexed_node_t;
 typedef struct ctl_arena_stats_s ctl_arena_stats_t;
 typedef struct ctl_stats_s ctl_stats_t;
 
+/* Maximum length of a mallctl name resolved by ctl_pool_byname(). */
+#define	CTL_POOL_NAME_MAX	128
+
 #endif /* JEMALLOC_H_TYPES */
 /******************************************************************************/
 #ifdef JEMALLOC_H_STRUCTS
@@ -68,6 +71,8 @@ int	ctl_nametomib(const char *name, size_t *mibp, size_t *miblenp);
 
 int	ctl_bymib(const size_t *mib, size_t miblen, void *oldp, size_t *oldlenp,
     void *newp, size_t newlen);
+int	ctl_pool_byname(pool_t *pool, const char *name, void *oldp,
+    size_t *oldlenp);
 bool	ctl_boot(void);
 void	ctl_prefork(void);
 void	ctl_postfork_parent(void);
@@ -58,6 +58,11 @@ struct pool_s {
 	unsigned narenas_total;
 	unsigned narenas_auto;
 
+	/* Per-pool tuning, see pool_config_t. */
+	bool		tcache_enabled;
+	size_t		tcache_maxclass;
+	ssize_t		lg_dirty_mult;
+
 	/* Tree of chunks that are stand-alone huge allocations. */
 	extent_tree_t	huge;
 	/* Protects chunk-related data structures. */
@@ -126,7 +131,7 @@ struct tsd_pool_s {
 /******************************************************************************/
 #ifdef JEMALLOC_H_EXTERNS
 
-bool pool_new(pool_t *pool, unsigned pool_id);
+bool pool_new(pool_t *pool, unsigned pool_id, const pool_config_t *config);
 void pool_destroy(pool_t *pool);
 
 extern malloc_mutex_t	pools_lock;
@@ -239,6 +239,8 @@ tcache_get(pool_t *pool, bool create)
 		return (NULL);
 	if (config_lazy_lock && isthreaded == false)
 		return (NULL);
+	if (pool->tcache_enabled == false)
+		return (NULL);
 
 	tsd = tcache_tsd_get();
 
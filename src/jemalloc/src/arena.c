@@ -869,13 +869,13 @@ arena_maybe_purge(arena_t *arena)
 	size_t npurgeable, threshold;
 
 	/* Don't purge if the option is disabled. */
-	if (opt_lg_dirty_mult < 0)
+	if (arena->pool->lg_dirty_mult < 0)
 		return;
 	/* Don't purge if all dirty pages are already being purged. */
 	if (arena->ndirty <= arena->npurgatory)
 		return;
 	npurgeable = arena->ndirty - arena->npurgatory;
-	threshold = (arena->nactive >> opt_lg_dirty_mult);
+	threshold = (arena->nactive >> arena->pool->lg_dirty_mult);
 	/*
 	 * Don't purge unless the number of purgeable pages exceeds the
 	 * threshold.
@@ -908,7 +908,8 @@ arena_compute_npurgatory(arena_t *arena, bool all)
 	npurgeable = arena->ndirty - arena->npurgatory;
 
 	if (all == false) {
-		size_t threshold = (arena->nactive >> opt_lg_dirty_mult);
+		size_t threshold = (arena->nactive >>
+		    arena->pool->lg_dirty_mult);
 
 		npurgatory = npurgeable - threshold;
 	} else
@@ -1103,8 +1104,8 @@ arena_purge(arena_t *arena, bool all)
 		assert(ndirty == arena->ndirty);
 	}
 	assert(arena->ndirty > arena->npurgatory || all);
-	assert((arena->nactive >> opt_lg_dirty_mult) < (arena->ndirty -
-	    arena->npurgatory) || all);
+	assert((arena->nactive >> arena->pool->lg_dirty_mult) <
+	    (arena->ndirty - arena->npurgatory) || all);
 
 	if (config_stats)
 		arena->stats.npurge++;
@@ -128,6 +128,7 @@ CTL_PROTO(arenas_initialized)
 CTL_PROTO(arenas_quantum)
 CTL_PROTO(arenas_page)
 CTL_PROTO(arenas_tcache_max)
+CTL_PROTO(arenas_lg_dirty_mult)
 CTL_PROTO(arenas_nbins)
 CTL_PROTO(arenas_nhbins)
 CTL_PROTO(arenas_nlruns)
@@ -318,6 +319,7 @@ static const ctl_named_node_t arenas_node[] = {
 	{NAME("quantum"),		CTL(arenas_quantum)},
 	{NAME("page"),			CTL(arenas_page)},
 	{NAME("tcache_max"),		CTL(arenas_tcache_max)},
+	{NAME("lg_dirty_mult"),		CTL(arenas_lg_dirty_mult)},
 	{NAME("nbins"),			CTL(arenas_nbins)},
 	{NAME("nhbins"),		CTL(arenas_nhbins)},
 	{NAME("bin"),			CHILD(indexed, arenas_bin)},
@@ -1197,6 +1199,45 @@ label_return:
 	return (ret);
 }
 
+static int
+pool_epoch_ctl(pool_t *pool, void *oldp, size_t *oldlenp)
+{
+	int ret;
+
+	malloc_mutex_lock(&ctl_mtx);
+	ctl_refresh_pool(pool);
+	READ(ctl_epoch, uint64_t);
+
+	ret = 0;
+label_return:
+	malloc_mutex_unlock(&ctl_mtx);
+	return (ret);
+}
+
+/*
+ * Read-only variant of ctl_byname() with the name resolved relative to
+ * "pool.<pool_id>".  Reading "epoch" refreshes the cached statistics of
+ * this pool only, so that sampling one pool does not walk every arena of
+ * every other pool.
+ */
+int
+ctl_pool_byname(pool_t *pool, const char *name, void *oldp, size_t *oldlenp)
+{
+	char pname[CTL_POOL_NAME_MAX];
+
+	if (ctl_init())
+		return (EAGAIN);
+
+	if (strcmp(name, "epoch") == 0)
+		return (pool_epoch_ctl(pool, oldp, oldlenp));
+
+	if (malloc_snprintf(pname, sizeof(pname), "pool.%u.%s",
+	    pool->pool_id, name) >= sizeof(pname))
+		return (ENOENT);
+
+	return (ctl_byname(pname, oldp, oldlenp, NULL, 0));
+}
+
 /******************************************************************************/
 
 CTL_RO_BOOL_CONFIG_GEN(config_debug)
@@ -1644,7 +1685,9 @@ label_return:
 
 CTL_RO_NL_GEN(arenas_quantum, QUANTUM, size_t)
 CTL_RO_NL_GEN(arenas_page, PAGE, size_t)
-CTL_RO_NL_CGEN(config_tcache, arenas_tcache_max, tcache_maxclass, size_t)
+CTL_RO_NL_CGEN(config_tcache, arenas_tcache_max,
+    pools[mib[1]]->tcache_maxclass, size_t)
+CTL_RO_NL_GEN(arenas_lg_dirty_mult, pools[mib[1]]->lg_dirty_mult, ssize_t)
 CTL_RO_NL_GEN(arenas_nbins, NBINS, unsigned)
 CTL_RO_NL_CGEN(config_tcache, arenas_nhbins, nhbins, unsigned)
 CTL_RO_NL_GEN(arenas_bin_i_size, arena_bin_info[mib[4]].reg_size, size_t)
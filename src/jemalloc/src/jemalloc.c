@@ -399,7 +399,7 @@ malloc_init_base_pool(void)
 		return (true);
 	}
 
-	if (pool_new(&base_pool, 0)) {
+	if (pool_new(&base_pool, 0, NULL)) {
 		malloc_mutex_unlock(&pool_base_lock);
 		return (true);
 	}
@@ -1478,7 +1478,8 @@ void pools_shared_data_destroy(void)
 }
 
 pool_t *
-je_pool_create(void *addr, size_t size, int zeroed)
+je_pool_create_config(void *addr, size_t size, int zeroed,
+	const pool_config_t *config)
 {
 	if (malloc_init())
 		return (NULL);
@@ -1542,7 +1543,7 @@ je_pool_create(void *addr, size_t size, int zeroed)
 	pool->base_past_addr = (void *)((uintptr_t)addr + size);
 
 	/* prepare pool and internal structures */
-	if (pool_new(pool, pool_id)) {
+	if (pool_new(pool, pool_id, config)) {
 		assert(pools[pool_id] == NULL);
 		malloc_mutex_unlock(&pools_lock);
 		pools_shared_data_destroy();
@@ -1592,6 +1593,13 @@ je_pool_create(void *addr, size_t size, int zeroed)
 	return (pool);
 }
 
+pool_t *
+je_pool_create(void *addr, size_t size, int zeroed)
+{
+
+	return (je_pool_create_config(addr, size, zeroed, NULL));
+}
+
 int
 je_pool_delete(pool_t *pool)
 {
@@ -2345,6 +2353,13 @@ je_pool_malloc_stats_print(pool_t *pool,
 	stats_print(pool, write_cb, cbopaque, opts);
 }
 
+int
+je_pool_mallctl(pool_t *pool, const char *name, void *oldp, size_t *oldlenp)
+{
+
+	return (ctl_pool_byname(pool, name, oldp, oldlenp));
+}
+
 void
 je_pool_set_alloc_funcs(void *(*malloc_func)(size_t),
 				void (*free_func)(void *))
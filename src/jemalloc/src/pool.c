@@ -5,7 +5,7 @@ malloc_mutex_t	pool_base_lock = MALLOC_MUTEX_INITIALIZER;
 malloc_mutex_t	pools_lock = MALLOC_MUTEX_INITIALIZER;
 
 /* Initialize pool and create its base arena. */
-bool pool_new(pool_t *pool, unsigned pool_id)
+bool pool_new(pool_t *pool, unsigned pool_id, const pool_config_t *config)
 {
 	pool->pool_id = pool_id;
 
@@ -33,6 +33,25 @@ bool pool_new(pool_t *pool, unsigned pool_id)
 	pool->ctl_stats_mapped = 0;
 
 	pool->narenas_auto = opt_narenas;
+	pool->tcache_enabled = true;
+	pool->tcache_maxclass = tcache_maxclass;
+	pool->lg_dirty_mult = opt_lg_dirty_mult;
+
+	if (config != NULL) {
+		if (config->narenas != 0)
+			pool->narenas_auto = config->narenas;
+		pool->tcache_enabled = !config->tcache_disable;
+		/* tcache bins are sized for the global tcache_maxclass */
+		if (config->tcache_max != 0 &&
+		    config->tcache_max < tcache_maxclass) {
+			pool->tcache_maxclass =
+			    (config->tcache_max < SMALL_MAXCLASS) ?
+			    SMALL_MAXCLASS : config->tcache_max;
+		}
+		if (config->lg_dirty_mult != 0)
+			pool->lg_dirty_mult = config->lg_dirty_mult;
+	}
+
 	/*
 	 * Make sure that the arenas array can be allocated.  In practice, this
 	 * limit is enough to allow the allocator to function, but the ctl
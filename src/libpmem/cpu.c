@@ -69,6 +69,23 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 			cpuinfo[ECX_IDX], cpuinfo[EDX_IDX]);
 }
 
+/*
+ * xgetbv -- (internal) read extended control register
+ *
+ * The instruction is encoded directly, so it does not depend on the
+ * -mxsave compiler flag.
+ */
+static inline unsigned long long
+xgetbv(unsigned idx)
+{
+	unsigned eax, edx;
+
+	asm volatile(".byte 0x0f, 0x01, 0xd0"
+			: "=a" (eax), "=d" (edx) : "c" (idx));
+
+	return ((unsigned long long)edx << 32) | eax;
+}
+
 #elif defined(_M_X64) || defined(_M_AMD64)
 
 #include <intrin.h>
@@ -79,11 +96,15 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 	__cpuidex(cpuinfo, func, subfunc);
 }
 
+#define xgetbv(idx) _xgetbv(idx)
+
 #else /* not x86_64 */
 
 #define cpuid(func, subfunc, cpuinfo)\
 	do { (void)(func); (void)(subfunc); (void)(cpuinfo); } while (0)
 
+#define xgetbv(idx) ((void)(idx), 0ULL)
+
 #endif
 
 #ifndef bit_SSE2
@@ -102,6 +123,30 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define bit_CLWB	(1 << 24)
 #endif
 
+#ifndef bit_SSE4_1
+#define bit_SSE4_1	(1 << 19)
+#endif
+
+#ifndef bit_OSXSAVE
+#define bit_OSXSAVE	(1 << 27)
+#endif
+
+#ifndef bit_AVX
+#define bit_AVX		(1 << 28)
+#endif
+
+#ifndef bit_AVX512F
+#define bit_AVX512F	(1 << 16)
+#endif
+
+/*
+ * Bits of the XCR0 register telling which register states are enabled
+ * by the OS - SSE (XMM), AVX (upper halves of YMM) and AVX-512 (opmask,
+ * upper halves of ZMM0-15 and ZMM16-31).
+ */
+#define XCR0_AVX_MASK		0x06ULL
+#define XCR0_AVX512_MASK	0xe6ULL
+
 /*
  * is_cpu_feature_present -- (internal) checks if CPU feature is supported
  */
@@ -119,6 +164,19 @@ is_cpu_feature_present(unsigned func, unsigned reg, unsigned bit)
 	return (cpuinfo[reg] & bit) != 0;
 }
 
+/*
+ * is_os_xstate_enabled -- (internal) checks if the OS saves/restores
+ *	the given extended register states on context switch
+ */
+static int
+is_os_xstate_enabled(unsigned long long mask)
+{
+	if (!is_cpu_feature_present(0x1, ECX_IDX, bit_OSXSAVE))
+		return 0;
+
+	return (xgetbv(0) & mask) == mask;
+}
+
 /*
  * is_cpu_genuine_intel -- checks for genuine Intel CPU
  */
@@ -186,3 +244,41 @@ is_cpu_clwb_present(void)
 
 	return ret;
 }
+
+/*
+ * is_cpu_sse41_present -- checks if SSE4.1 instructions are supported
+ */
+int
+is_cpu_sse41_present(void)
+{
+	int ret = is_cpu_feature_present(0x1, ECX_IDX, bit_SSE4_1);
+	LOG(4, "SSE4.1 %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
+
+/*
+ * is_cpu_avx_present -- checks if AVX instructions are supported
+ */
+int
+is_cpu_avx_present(void)
+{
+	int ret = is_cpu_feature_present(0x1, ECX_IDX, bit_AVX) &&
+		is_os_xstate_enabled(XCR0_AVX_MASK);
+	LOG(4, "AVX %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
+
+/*
+ * is_cpu_avx512f_present -- checks if AVX-512F instructions are supported
+ */
+int
+is_cpu_avx512f_present(void)
+{
+	int ret = is_cpu_feature_present(0x7, EBX_IDX, bit_AVX512F) &&
+		is_os_xstate_enabled(XCR0_AVX512_MASK);
+	LOG(4, "AVX512F %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
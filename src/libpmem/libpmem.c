@@ -68,6 +68,7 @@ libpmem_fini(void)
 {
 	LOG(3, NULL);
 
+	pmem_fini();
 	common_fini();
 }
 
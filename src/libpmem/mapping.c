@@ -0,0 +1,333 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mapping.c -- index of the file mappings created by libpmem
+ *
+ * Finding out whether a range is persistent memory requires parsing
+ * /proc/self/smaps, which gets expensive when the process has many
+ * mappings.  However, a mapping created by pmem_map_file() is either
+ * entirely direct access or not at all, so once the answer is known for
+ * the whole mapping, it is known for any range within it.
+ *
+ * The index is an array of non-overlapping mappings, sorted by address,
+ * so a lookup is a binary search.  Mappings are added and removed rarely,
+ * so keeping the array sorted on insertion is cheap enough.  The array is
+ * protected by a simple reader-writer spinlock - libpmem does not depend
+ * on libpthread.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mapping.h"
+#include "out.h"
+#include "util.h"
+
+#define MAPPING_INIT_CAPACITY 16
+
+#define MAPPING_WRLOCKED UINT32_MAX
+
+struct mapping {
+	uintptr_t start;
+	uintptr_t end;	/* first byte past the mapping */
+	int is_pmem;	/* 0, 1 or MAPPING_IS_PMEM_UNKNOWN */
+};
+
+static struct mapping *Mappings;
+static size_t Nmappings;
+static size_t Capacity;
+
+/* number of readers, or MAPPING_WRLOCKED */
+static volatile uint32_t Lock;
+
+/*
+ * mapping_rdlock -- (internal) grab the index lock for reading
+ */
+static void
+mapping_rdlock(void)
+{
+	for (;;) {
+		uint32_t v = Lock;
+		if (v != MAPPING_WRLOCKED &&
+				util_bool_compare_and_swap32(&Lock, v, v + 1))
+			return;
+	}
+}
+
+/*
+ * mapping_rdunlock -- (internal) release the index read lock
+ */
+static void
+mapping_rdunlock(void)
+{
+	for (;;) {
+		uint32_t v = Lock;
+		ASSERTne(v, 0);
+		ASSERTne(v, MAPPING_WRLOCKED);
+		if (util_bool_compare_and_swap32(&Lock, v, v - 1))
+			return;
+	}
+}
+
+/*
+ * mapping_wrlock -- (internal) grab the index lock for writing
+ */
+static void
+mapping_wrlock(void)
+{
+	while (!util_bool_compare_and_swap32(&Lock, 0, MAPPING_WRLOCKED))
+		;
+}
+
+/*
+ * mapping_wrunlock -- (internal) release the index write lock
+ */
+static void
+mapping_wrunlock(void)
+{
+	if (!util_bool_compare_and_swap32(&Lock, MAPPING_WRLOCKED, 0))
+		FATAL("util_bool_compare_and_swap32");
+}
+
+/*
+ * mapping_find -- (internal) return the index of the first mapping ending
+ *	above the given address
+ */
+static size_t
+mapping_find(uintptr_t addr)
+{
+	size_t lo = 0;
+	size_t hi = Nmappings;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (Mappings[mid].end <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * mapping_insert_at -- (internal) insert a new entry at the given index
+ */
+static int
+mapping_insert_at(size_t idx, uintptr_t start, uintptr_t end, int is_pmem)
+{
+	if (Nmappings == Capacity) {
+		size_t ncap = Capacity ? 2 * Capacity : MAPPING_INIT_CAPACITY;
+		struct mapping *m = Realloc(Mappings, ncap * sizeof(*m));
+		if (m == NULL) {
+			ERR("!Realloc");
+			return -1;
+		}
+		Mappings = m;
+		Capacity = ncap;
+	}
+
+	memmove(&Mappings[idx + 1], &Mappings[idx],
+		(Nmappings - idx) * sizeof(*Mappings));
+	Mappings[idx].start = start;
+	Mappings[idx].end = end;
+	Mappings[idx].is_pmem = is_pmem;
+	Nmappings++;
+
+	return 0;
+}
+
+/*
+ * mapping_remove_range -- (internal) drop the given range from the index,
+ *	trimming or splitting the entries partially overlapping with it
+ */
+static int
+mapping_remove_range(uintptr_t start, uintptr_t end)
+{
+	size_t i = mapping_find(start);
+
+	while (i < Nmappings && Mappings[i].start < end) {
+		struct mapping *m = &Mappings[i];
+
+		if (m->start < start && m->end > end) {
+			/* the range is in the middle of the entry - split it */
+			uintptr_t oend = m->end;
+			m->end = start;
+			return mapping_insert_at(i + 1, end, oend, m->is_pmem);
+		} else if (m->start < start) {
+			m->end = start;
+			i++;
+		} else if (m->end > end) {
+			m->start = end;
+			i++;
+		} else {
+			memmove(m, m + 1,
+				(Nmappings - i - 1) * sizeof(*Mappings));
+			Nmappings--;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * mapping_register -- add a mapping to the index
+ *
+ * Unless is_pmem is known by the caller (0 or 1), whether the mapping is
+ * persistent memory is found out on the first lookup of any range within
+ * it.  Any stale entries overlapping with
+ * the new mapping (i.e. those unmapped without pmem_unmap()) are dropped.
+ */
+int
+mapping_register(const void *addr, size_t len, int is_pmem)
+{
+	LOG(3, "addr %p len %zu is_pmem %d", addr, len, is_pmem);
+
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t end = start + len;
+	int ret;
+
+	if (len == 0)
+		return 0;
+
+	mapping_wrlock();
+
+	(void) mapping_remove_range(start, end);
+	ret = mapping_insert_at(mapping_find(start), start, end, is_pmem);
+
+	mapping_wrunlock();
+
+	return ret;
+}
+
+/*
+ * mapping_unregister -- remove a range from the index
+ */
+void
+mapping_unregister(const void *addr, size_t len)
+{
+	LOG(3, "addr %p len %zu", addr, len);
+
+	uintptr_t start = (uintptr_t)addr;
+
+	mapping_wrlock();
+
+	/*
+	 * If splitting an entry fails, the part above the removed range
+	 * is just forgotten - the lookups will take the slow path there.
+	 */
+	(void) mapping_remove_range(start, start + len);
+
+	mapping_wrunlock();
+}
+
+/*
+ * mapping_is_pmem -- look up a range in the index
+ *
+ * Returns 0 or 1 if the entire range lies within a single known mapping,
+ * or -1 if the index does not know this range.  The first lookup within
+ * a mapping calls is_pmem_fn for the whole mapping and caches the result.
+ *
+ * is_pmem_fn might take a while, so it's called with the lock released -
+ * the writers would spin all that time otherwise.  The result is cached
+ * only if the mapping is still there once the lock is taken again.
+ */
+int
+mapping_is_pmem(const void *addr, size_t len,
+	int (*is_pmem_fn)(const void *addr, size_t len))
+{
+	LOG(10, "addr %p len %zu", addr, len);
+
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t m_start = 0;
+	uintptr_t m_end = 0;
+	int found = 0;
+	int ret = -1;
+
+	mapping_rdlock();
+
+	size_t i = mapping_find(start);
+	if (i < Nmappings) {
+		struct mapping *m = &Mappings[i];
+
+		if (m->start <= start && len <= m->end - start) {
+			found = 1;
+			ret = m->is_pmem;
+			m_start = m->start;
+			m_end = m->end;
+		}
+	}
+
+	mapping_rdunlock();
+
+	if (!found || ret != MAPPING_IS_PMEM_UNKNOWN) {
+		LOG(10, "returning %d", ret);
+		return ret;
+	}
+
+	ret = is_pmem_fn((void *)m_start, m_end - m_start);
+
+	mapping_rdlock();
+
+	i = mapping_find(m_start);
+	if (i < Nmappings) {
+		struct mapping *m = &Mappings[i];
+
+		/*
+		 * Concurrent readers may all get here, but they would store
+		 * the same value anyway.
+		 */
+		if (m->start == m_start && m->end == m_end &&
+				m->is_pmem == MAPPING_IS_PMEM_UNKNOWN)
+			m->is_pmem = ret;
+	}
+
+	mapping_rdunlock();
+
+	LOG(10, "returning %d", ret);
+	return ret;
+}
+
+/*
+ * mapping_fini -- release the index
+ */
+void
+mapping_fini(void)
+{
+	LOG(3, NULL);
+
+	Free(Mappings);
+	Mappings = NULL;
+	Nmappings = 0;
+	Capacity = 0;
+}
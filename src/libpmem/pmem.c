@@ -114,9 +114,11 @@
  *	Checks for overlapped ranges to determine whether to copy from
  *	the beginning of the range or from the end.  If MOVNT instructions
  *	are available, uses the memory copy flow described above, otherwise
- *	calls the libc memmove() followed by pmem_flush(). Since no conditional
- *	compilation and/or architecture specific CFLAGS are in use at the
- *	moment, SSE2 ( thus movnt ) is just assumed to be available.
+ *	calls the libc memmove() followed by pmem_flush(). SSE2 ( thus movnt )
+ *	is just assumed to be available.  If the CPU supports AVX or AVX-512F,
+ *	the aligned bulk of the range is copied using 32-byte or 64-byte
+ *	non-temporal stores respectively (see pmem_avx.c and pmem_avx512f.c,
+ *	the only files built with architecture specific CFLAGS).
  *
  * pmem_memcpy_nodrain()
  *
@@ -148,14 +150,23 @@
  *		flush_clwb()
  *		flush_clflushopt()
  *		flush_clflush()
+ *		flush_empty()
  *
  *	Func_memmove_nodrain is used by memmove_nodrain() to call one of:
  *		memmove_nodrain_normal()
  *		memmove_nodrain_movnt()
+ *		memmove_nodrain_movnt_avx()
+ *		memmove_nodrain_movnt_avx512f()
  *
  *	Func_memset_nodrain is used by memset_nodrain() to call one of:
  *		memset_nodrain_normal()
  *		memset_nodrain_movnt()
+ *		memset_nodrain_movnt_avx()
+ *		memset_nodrain_movnt_avx512f()
+ *
+ *	Func_memcpy_from_pmem is used by pmem_memcpy_from_pmem() to call one of:
+ *		memcpy_from_pmem_normal()
+ *		memcpy_from_pmem_stream_load()
  *
  * DEBUG LOGGING
  *
@@ -164,11 +175,17 @@
  * impractical.  The call tracing log for those functions is set at 15.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <emmintrin.h>
 #include <errno.h>
@@ -179,10 +196,12 @@
 
 #include "pmem.h"
 #include "cpu.h"
+#include "mapping.h"
 #include "out.h"
 #include "util.h"
 #include "mmap.h"
 #include "file.h"
+#include "usdt.h"
 #include "valgrind_internal.h"
 
 #ifndef _MSC_VER
@@ -198,12 +217,16 @@
 
 #endif /* _MSC_VER */
 
+#ifdef _MSC_VER
+#define force_inline inline
+#else
+#define force_inline __attribute__((always_inline)) inline
+#endif
+
 #define FLUSH_ALIGN ((uintptr_t)64)
 
 #define ALIGN_MASK	(FLUSH_ALIGN - 1)
 
-#define CHUNK_SIZE	128 /* 16*8 */
-#define CHUNK_SHIFT	7
 #define CHUNK_MASK	(CHUNK_SIZE - 1)
 
 #define DWORD_SIZE	4
@@ -216,7 +239,125 @@
 
 #define MOVNT_THRESHOLD	256
 
-static size_t Movnt_threshold = MOVNT_THRESHOLD;
+/*
+ * Minimal lengths of memmove/memcpy and memset operations for which
+ * non-temporal stores are used.  The two may differ if the thresholds
+ * were calibrated at initialization time (see pmem_calibrate_movnt()).
+ */
+static size_t Movnt_threshold_memmove = MOVNT_THRESHOLD;
+static size_t Movnt_threshold_memset = MOVNT_THRESHOLD;
+
+/*
+ * Parameters of the movnt threshold calibration: the candidate lengths
+ * (powers of two from MIN to MAX), the size of the scratch buffer the
+ * operations are spread over (large enough not to fit in L2 cache) and
+ * the number of rounds for each candidate (the best one is taken).
+ */
+#define CALIBRATE_MIN_LEN	64
+#define CALIBRATE_MAX_LEN	(16 * 1024)
+#define CALIBRATE_SCRATCH_SIZE	(1 << 20)
+#define CALIBRATE_ROUNDS	3
+
+/*
+ * Flush and fence accounting, enabled by the PMEM_STATS environment
+ * variable.  The counts are gathered in a number of per-CPU slots, each in
+ * its own cache line, so that the threads flushing don't contend on them.
+ * Nothing is counted unless Pmem_stats points to the slots.
+ */
+#define PMEM_STATS_SLOTS 64 /* must be a power of two */
+
+struct pmem_stats_slot {
+	uint64_t flushes;
+	uint64_t flushed_lines;
+	uint64_t fences;
+	uint64_t nt_bytes;
+
+	/* padding to the cache line size */
+	char unused[64 - 4 * sizeof(uint64_t)];
+};
+
+static struct pmem_stats_slot Pmem_stats_slots[PMEM_STATS_SLOTS];
+static struct pmem_stats_slot *Pmem_stats;
+
+/*
+ * pmem_stats_slot -- (internal) returns the statistics slot of the CPU
+ *	the thread is running on
+ */
+static inline struct pmem_stats_slot *
+pmem_stats_slot(void)
+{
+	int cpu = sched_getcpu();
+
+	return &Pmem_stats[(unsigned)(cpu < 0 ? 0 : cpu) &
+		(PMEM_STATS_SLOTS - 1)];
+}
+
+/*
+ * pmem_stats_flush -- (internal) counts a flush of the given range
+ */
+static force_inline void
+pmem_stats_flush(const void *addr, size_t len)
+{
+	if (likely(Pmem_stats == NULL))
+		return;
+
+	uintptr_t start = (uintptr_t)addr & ~ALIGN_MASK;
+	uintptr_t end = ((uintptr_t)addr + len + ALIGN_MASK) & ~ALIGN_MASK;
+
+	struct pmem_stats_slot *slot = pmem_stats_slot();
+	__sync_fetch_and_add(&slot->flushes, 1);
+	__sync_fetch_and_add(&slot->flushed_lines, (end - start) / FLUSH_ALIGN);
+}
+
+/*
+ * pmem_stats_fence -- (internal) counts a fence
+ */
+static force_inline void
+pmem_stats_fence(void)
+{
+	if (likely(Pmem_stats == NULL))
+		return;
+
+	__sync_fetch_and_add(&pmem_stats_slot()->fences, 1);
+}
+
+/*
+ * pmem_stats_nt -- (internal) counts the bytes stored with non-temporal
+ *	stores
+ */
+static force_inline void
+pmem_stats_nt(size_t len)
+{
+	if (likely(Pmem_stats == NULL))
+		return;
+
+	__sync_fetch_and_add(&pmem_stats_slot()->nt_bytes, len);
+}
+
+/*
+ * pmem_stats_get -- sums up the per-CPU flush and fence counts
+ */
+int
+pmem_stats_get(struct pmem_stats *stats)
+{
+	LOG(3, "stats %p", stats);
+
+	if (Pmem_stats == NULL) {
+		ERR("statistics not enabled");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	for (unsigned i = 0; i < PMEM_STATS_SLOTS; ++i) {
+		stats->flushes += Pmem_stats[i].flushes;
+		stats->flushed_lines += Pmem_stats[i].flushed_lines;
+		stats->fences += Pmem_stats[i].fences;
+		stats->nt_bytes += Pmem_stats[i].nt_bytes;
+	}
+
+	return 0;
+}
 
 /*
  * pmem_has_hw_drain -- return whether or not HW drain was found
@@ -269,7 +410,10 @@ pmem_drain(void)
 {
 	LOG(10, NULL);
 
+	USDT_PROBE0(libpmem, drain);
+
 	Func_predrain_fence();
+	pmem_stats_fence();
 
 	VALGRIND_DO_COMMIT;
 	VALGRIND_DO_FENCE;
@@ -334,6 +478,20 @@ flush_clflushopt(const void *addr, size_t len)
 	}
 }
 
+/*
+ * flush_empty -- (internal) do not flush the CPU cache
+ *
+ * Used when the CPU caches are within the persistence domain of
+ * the platform, so flushing them is not needed for persistence.
+ */
+static void
+flush_empty(const void *addr, size_t len)
+{
+	LOG(15, "addr %p len %zu", addr, len);
+
+	VALGRIND_DO_FLUSH(addr, len);
+}
+
 /*
  * pmem_flush() calls through Func_flush to do the work.  Although
  * initialized to flush_clflush(), once the existence of the clflushopt
@@ -354,6 +512,7 @@ pmem_flush(const void *addr, size_t len)
 	VALGRIND_DO_CHECK_MEM_IS_ADDRESSABLE(addr, len);
 
 	Func_flush(addr, len);
+	pmem_stats_flush(addr, len);
 }
 
 /*
@@ -364,10 +523,125 @@ pmem_persist(const void *addr, size_t len)
 {
 	LOG(15, "addr %p len %zu", addr, len);
 
+	USDT_PROBE2(libpmem, persist, addr, len);
+
 	pmem_flush(addr, len);
 	pmem_drain();
 }
 
+/*
+ * Number of ranges pmem_flush_vec() can sort without allocating memory.
+ */
+#define FLUSH_VEC_STACK_RANGES 32
+
+/*
+ * flush_vec_cmp -- (internal) compare cache line spans by start address
+ */
+static int
+flush_vec_cmp(const void *a, const void *b)
+{
+	const struct pmem_range *ra = a;
+	const struct pmem_range *rb = b;
+
+	if ((uintptr_t)ra->addr < (uintptr_t)rb->addr)
+		return -1;
+	if ((uintptr_t)ra->addr > (uintptr_t)rb->addr)
+		return 1;
+	return 0;
+}
+
+/*
+ * pmem_flush_vec -- flush processor cache for the given set of ranges
+ *
+ * The ranges are expanded to cache line boundaries, sorted (insertion
+ * sort for the common case of a handful of ranges) and merged, so that
+ * every cache line is flushed exactly once and in address order.
+ */
+void
+pmem_flush_vec(const struct pmem_range *ranges, size_t nranges)
+{
+	LOG(10, "ranges %p nranges %zu", ranges, nranges);
+
+	struct pmem_range stack_lines[FLUSH_VEC_STACK_RANGES];
+	struct pmem_range *lines = stack_lines;
+	size_t nlines = 0;
+	size_t i;
+
+	if (nranges > FLUSH_VEC_STACK_RANGES) {
+		lines = Malloc(nranges * sizeof(*lines));
+		if (lines == NULL) {
+			/* flush the ranges as they are, just not merged */
+			LOG(3, "!Malloc");
+			for (i = 0; i < nranges; i++)
+				pmem_flush(ranges[i].addr, ranges[i].len);
+			return;
+		}
+	}
+
+	for (i = 0; i < nranges; i++) {
+		if (ranges[i].len == 0)
+			continue;
+
+		VALGRIND_DO_CHECK_MEM_IS_ADDRESSABLE(ranges[i].addr,
+				ranges[i].len);
+
+		uintptr_t start = (uintptr_t)ranges[i].addr & ~ALIGN_MASK;
+		uintptr_t end = ((uintptr_t)ranges[i].addr + ranges[i].len +
+				ALIGN_MASK) & ~ALIGN_MASK;
+
+		lines[nlines].addr = (void *)start;
+		lines[nlines].len = end - start;
+		nlines++;
+	}
+
+	if (nlines > FLUSH_VEC_STACK_RANGES) {
+		qsort(lines, nlines, sizeof(*lines), flush_vec_cmp);
+	} else {
+		for (i = 1; i < nlines; i++) {
+			struct pmem_range r = lines[i];
+			size_t j = i;
+			while (j > 0 && (uintptr_t)lines[j - 1].addr >
+					(uintptr_t)r.addr) {
+				lines[j] = lines[j - 1];
+				j--;
+			}
+			lines[j] = r;
+		}
+	}
+
+	i = 0;
+	while (i < nlines) {
+		uintptr_t start = (uintptr_t)lines[i].addr;
+		uintptr_t end = start + lines[i].len;
+
+		/* merge all the spans overlapping or adjacent to this one */
+		for (i++; i < nlines && (uintptr_t)lines[i].addr <= end; i++) {
+			uintptr_t e = (uintptr_t)lines[i].addr + lines[i].len;
+			if (e > end)
+				end = e;
+		}
+
+		Func_flush((void *)start, end - start);
+		pmem_stats_flush((void *)start, end - start);
+	}
+
+	if (lines != stack_lines)
+		Free(lines);
+}
+
+/*
+ * pmem_persist_vec -- make any cached changes to a set of ranges of pmem
+ *	persistent, with a single drain
+ */
+void
+pmem_persist_vec(const struct pmem_range *ranges, size_t nranges)
+{
+	LOG(15, "ranges %p nranges %zu", ranges, nranges);
+
+	pmem_flush_vec(ranges, nranges);
+	pmem_drain();
+}
+
 /*
  * pmem_msync -- flush to persistence via msync
  *
@@ -380,6 +654,8 @@ pmem_msync(const void *addr, size_t len)
 {
 	LOG(15, "addr %p len %zu", addr, len);
 
+	USDT_PROBE2(libpmem, msync, addr, len);
+
 	VALGRIND_DO_CHECK_MEM_IS_ADDRESSABLE(addr, len);
 
 	/*
@@ -436,11 +712,27 @@ is_pmem_never(const void *addr, size_t len)
 	return 0;
 }
 
+/*
+ * is_pmem_cached -- (internal) pmem_is_pmem() using the index of mappings
+ *	created by pmem_map_file(), falling back to is_pmem_proc()
+ */
+static int
+is_pmem_cached(const void *addr, size_t len)
+{
+	LOG(10, "addr %p len %zu", addr, len);
+
+	int ret = mapping_is_pmem(addr, len, is_pmem_proc);
+	if (ret >= 0)
+		return ret;
+
+	return is_pmem_proc(addr, len);
+}
+
 /*
  * pmem_is_pmem() calls through Func_is_pmem to do the work.  Although
  * initialized to is_pmem_never(), once the existence of the clflush
  * feature is confirmed by pmem_init() at library initialization time,
- * Func_is_pmem is set to is_pmem_proc().  That's the most common case
+ * Func_is_pmem is set to is_pmem_cached().  That's the most common case
  * on modern hardware.
  */
 static int (*Func_is_pmem)(const void *addr, size_t len) = is_pmem_never;
@@ -510,7 +802,8 @@ pmem_is_pmem(const void *addr, size_t len)
 }
 
 #define PMEM_FILE_ALL_FLAGS\
-	(PMEM_FILE_CREATE|PMEM_FILE_EXCL|PMEM_FILE_SPARSE|PMEM_FILE_TMPFILE)
+	(PMEM_FILE_CREATE|PMEM_FILE_EXCL|PMEM_FILE_SPARSE|PMEM_FILE_TMPFILE|\
+	PMEM_FILE_POPULATE)
 
 #ifndef USE_O_TMPFILE
 #ifdef O_TMPFILE
@@ -520,6 +813,83 @@ pmem_is_pmem(const void *addr, size_t len)
 #endif
 #endif
 
+/*
+ * pmem_map_device_dax -- (internal) map a whole device DAX
+ *
+ * A device DAX cannot be created, truncated nor allocated, so the flags
+ * creating a file are accepted only if len matches the size of the device,
+ * as if the file already existed.  The mapping is aligned to the page size
+ * of the device and is always persistent memory.
+ */
+static void *
+pmem_map_device_dax(const char *path, size_t len, int flags,
+	size_t *mapped_lenp, int *is_pmemp)
+{
+	LOG(3, "path \"%s\" size %zu flags %x", path, len, flags);
+
+	int oerrno;
+
+	if (flags & (PMEM_FILE_EXCL|PMEM_FILE_TMPFILE)) {
+		ERR("PMEM_FILE_EXCL and PMEM_FILE_TMPFILE not allowed for "
+			"device DAX %s", path);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		ERR("!open %s", path);
+		return NULL;
+	}
+
+	ssize_t size = util_fd_get_size(fd);
+	if (size < 0)
+		goto err;
+
+	if (len != 0 && len != (size_t)size) {
+		ERR("'len' (%zu) does not match the size of device DAX %s "
+			"(%zd)", len, path, size);
+		errno = EINVAL;
+		goto err;
+	}
+
+	len = (size_t)size;
+
+	void *addr;
+	int map_flags = MAP_SHARED;
+	if (flags & PMEM_FILE_POPULATE)
+		map_flags |= MAP_POPULATE;
+
+	size_t align = util_fd_device_dax_alignment(fd);
+	if ((addr = util_map(fd, len, map_flags, align)) == NULL)
+		goto err;    /* util_map() set errno, called LOG */
+
+	/* not fatal - pmem_is_pmem() just won't use the fast path */
+	if (mapping_register(addr, len, 1) != 0)
+		LOG(3, "cannot register mapping %p", addr);
+
+	if (mapped_lenp != NULL)
+		*mapped_lenp = len;
+
+	if (is_pmemp != NULL)
+		*is_pmemp = pmem_is_pmem(addr, len);
+
+	LOG(3, "returning %p", addr);
+
+	VALGRIND_REGISTER_PMEM_MAPPING(addr, len);
+	VALGRIND_REGISTER_PMEM_FILE(fd, addr, len, 0);
+
+	(void) close(fd);
+
+	return addr;
+
+err:
+	oerrno = errno;
+	(void) close(fd);
+	errno = oerrno;
+	return NULL;
+}
+
 /*
  * pmem_map_file -- create or open the file and map it to memory
  */
@@ -541,6 +911,10 @@ pmem_map_file(const char *path, size_t len, int flags, mode_t mode,
 		return NULL;
 	}
 
+	if (util_file_is_device_dax(path))
+		return pmem_map_device_dax(path, len, flags, mapped_lenp,
+				is_pmemp);
+
 	if (flags & PMEM_FILE_CREATE) {
 		if ((off_t)len < 0) {
 			ERR("invalid file length %zu", len);
@@ -628,9 +1002,17 @@ pmem_map_file(const char *path, size_t len, int flags, mode_t mode,
 	}
 
 	void *addr;
-	if ((addr = util_map(fd, len, 0, 0)) == NULL)
+	int map_flags = MAP_SHARED;
+	if (flags & PMEM_FILE_POPULATE)
+		map_flags |= MAP_POPULATE;
+
+	if ((addr = util_map(fd, len, map_flags, 0)) == NULL)
 		goto err;    /* util_map() set errno, called LOG */
 
+	/* not fatal - pmem_is_pmem() just won't use the fast path */
+	if (mapping_register(addr, len, MAPPING_IS_PMEM_UNKNOWN) != 0)
+		LOG(3, "cannot register mapping %p", addr);
+
 	if (mapped_lenp != NULL)
 		*mapped_lenp = len;
 
@@ -663,6 +1045,8 @@ pmem_unmap(void *addr, size_t len)
 {
 	LOG(3, "addr %p len %zu", addr, len);
 
+	mapping_unregister(addr, len);
+
 	int ret = util_unmap(addr, len);
 
 	VALGRIND_REMOVE_PMEM_MAPPING(addr, len);
@@ -684,14 +1068,91 @@ memmove_nodrain_normal(void *pmemdest, const void *src, size_t len)
 }
 
 /*
- * memmove_nodrain_movnt -- (internal) memmove to pmem without hw drain, movnt
+ * memmove_chunks_fw_sse2 -- (internal) copy cnt chunks of CHUNK_SIZE bytes
+ *	in the forward direction, using 16-byte non-temporal stores
  */
-static void *
-memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
+static void
+memmove_chunks_fw_sse2(char *dest, const char *src, size_t cnt)
 {
-	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
+	__m128i *d = (__m128i *)dest;
+	__m128i *s = (__m128i *)src;
+	size_t i;
 
+	for (i = 0; i < cnt; i++) {
+		xmm0 = _mm_loadu_si128(s);
+		xmm1 = _mm_loadu_si128(s + 1);
+		xmm2 = _mm_loadu_si128(s + 2);
+		xmm3 = _mm_loadu_si128(s + 3);
+		xmm4 = _mm_loadu_si128(s + 4);
+		xmm5 = _mm_loadu_si128(s + 5);
+		xmm6 = _mm_loadu_si128(s + 6);
+		xmm7 = _mm_loadu_si128(s + 7);
+		s += 8;
+		_mm_stream_si128(d,	xmm0);
+		_mm_stream_si128(d + 1,	xmm1);
+		_mm_stream_si128(d + 2,	xmm2);
+		_mm_stream_si128(d + 3,	xmm3);
+		_mm_stream_si128(d + 4,	xmm4);
+		_mm_stream_si128(d + 5, xmm5);
+		_mm_stream_si128(d + 6,	xmm6);
+		_mm_stream_si128(d + 7,	xmm7);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+}
+
+/*
+ * memmove_chunks_bw_sse2 -- (internal) copy cnt chunks of CHUNK_SIZE bytes
+ *	in the backward direction, using 16-byte non-temporal stores
+ *
+ * Both dest and src point to the end of the ranges.
+ */
+static void
+memmove_chunks_bw_sse2(char *dest, const char *src, size_t cnt)
+{
 	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
+	__m128i *d = (__m128i *)dest;
+	__m128i *s = (__m128i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		xmm0 = _mm_loadu_si128(s - 1);
+		xmm1 = _mm_loadu_si128(s - 2);
+		xmm2 = _mm_loadu_si128(s - 3);
+		xmm3 = _mm_loadu_si128(s - 4);
+		xmm4 = _mm_loadu_si128(s - 5);
+		xmm5 = _mm_loadu_si128(s - 6);
+		xmm6 = _mm_loadu_si128(s - 7);
+		xmm7 = _mm_loadu_si128(s - 8);
+		s -= 8;
+		_mm_stream_si128(d - 1, xmm0);
+		_mm_stream_si128(d - 2, xmm1);
+		_mm_stream_si128(d - 3, xmm2);
+		_mm_stream_si128(d - 4, xmm3);
+		_mm_stream_si128(d - 5, xmm4);
+		_mm_stream_si128(d - 6, xmm5);
+		_mm_stream_si128(d - 7, xmm6);
+		_mm_stream_si128(d - 8, xmm7);
+		d -= 8;
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+	}
+}
+
+/*
+ * memmove_nodrain_movnt_common -- (internal) memmove to pmem without hw drain,
+ *	movnt
+ *
+ * The bulk of the range is copied in chunks of CHUNK_SIZE bytes by the
+ * given chunk copy routines, which differ only in the width of the
+ * non-temporal stores they use.  Everything else (alignment of the
+ * destination, tail handling, flushing) is common for all of them.
+ */
+static force_inline void *
+memmove_nodrain_movnt_common(void *pmemdest, const void *src, size_t len,
+	movnt_chunks_fn chunks_fw, movnt_chunks_fn chunks_bw)
+{
+	__m128i xmm0;
 	size_t i;
 	__m128i *d;
 	__m128i *s;
@@ -701,12 +1162,14 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 	if (len == 0 || src == pmemdest)
 		return pmemdest;
 
-	if (len < Movnt_threshold) {
+	if (len < Movnt_threshold_memmove) {
 		memmove(pmemdest, src, len);
 		pmem_flush(pmemdest, len);
 		return pmemdest;
 	}
 
+	pmem_stats_nt(len);
+
 	if ((uintptr_t)dest1 - (uintptr_t)src >= len) {
 		/*
 		 * Copy the range in the forward direction.
@@ -737,31 +1200,11 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 			len -= cnt;
 		}
 
-		d = (__m128i *)dest1;
-		s = (__m128i *)src;
-
 		cnt = len >> CHUNK_SHIFT;
-		for (i = 0; i < cnt; i++) {
-			xmm0 = _mm_loadu_si128(s);
-			xmm1 = _mm_loadu_si128(s + 1);
-			xmm2 = _mm_loadu_si128(s + 2);
-			xmm3 = _mm_loadu_si128(s + 3);
-			xmm4 = _mm_loadu_si128(s + 4);
-			xmm5 = _mm_loadu_si128(s + 5);
-			xmm6 = _mm_loadu_si128(s + 6);
-			xmm7 = _mm_loadu_si128(s + 7);
-			s += 8;
-			_mm_stream_si128(d,	xmm0);
-			_mm_stream_si128(d + 1,	xmm1);
-			_mm_stream_si128(d + 2,	xmm2);
-			_mm_stream_si128(d + 3,	xmm3);
-			_mm_stream_si128(d + 4,	xmm4);
-			_mm_stream_si128(d + 5, xmm5);
-			_mm_stream_si128(d + 6,	xmm6);
-			_mm_stream_si128(d + 7,	xmm7);
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-			d += 8;
-		}
+		chunks_fw(dest1, src, cnt);
+
+		d = (__m128i *)((char *)dest1 + (cnt << CHUNK_SHIFT));
+		s = (__m128i *)((char *)src + (cnt << CHUNK_SHIFT));
 
 		/* copy the tail (<128 bytes) in 16 bytes chunks */
 		len &= CHUNK_MASK;
@@ -829,31 +1272,11 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 			len -= cnt;
 		}
 
-		d = (__m128i *)dest1;
-		s = (__m128i *)src;
-
 		cnt = len >> CHUNK_SHIFT;
-		for (i = 0; i < cnt; i++) {
-			xmm0 = _mm_loadu_si128(s - 1);
-			xmm1 = _mm_loadu_si128(s - 2);
-			xmm2 = _mm_loadu_si128(s - 3);
-			xmm3 = _mm_loadu_si128(s - 4);
-			xmm4 = _mm_loadu_si128(s - 5);
-			xmm5 = _mm_loadu_si128(s - 6);
-			xmm6 = _mm_loadu_si128(s - 7);
-			xmm7 = _mm_loadu_si128(s - 8);
-			s -= 8;
-			_mm_stream_si128(d - 1, xmm0);
-			_mm_stream_si128(d - 2, xmm1);
-			_mm_stream_si128(d - 3, xmm2);
-			_mm_stream_si128(d - 4, xmm3);
-			_mm_stream_si128(d - 5, xmm4);
-			_mm_stream_si128(d - 6, xmm5);
-			_mm_stream_si128(d - 7, xmm6);
-			_mm_stream_si128(d - 8, xmm7);
-			d -= 8;
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-		}
+		chunks_bw(dest1, src, cnt);
+
+		d = (__m128i *)((char *)dest1 - (cnt << CHUNK_SHIFT));
+		s = (__m128i *)((char *)src - (cnt << CHUNK_SHIFT));
 
 		/* copy the tail (<128 bytes) in 16 bytes chunks */
 		len &= CHUNK_MASK;
@@ -900,6 +1323,44 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memmove_nodrain_movnt -- (internal) memmove to pmem without hw drain, movnt
+ */
+static void *
+memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	return memmove_nodrain_movnt_common(pmemdest, src, len,
+			memmove_chunks_fw_sse2, memmove_chunks_bw_sse2);
+}
+
+/*
+ * memmove_nodrain_movnt_avx -- (internal) memmove to pmem without hw drain,
+ *	movnt, 32-byte stores
+ */
+static void *
+memmove_nodrain_movnt_avx(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	return memmove_nodrain_movnt_common(pmemdest, src, len,
+			memmove_chunks_fw_avx, memmove_chunks_bw_avx);
+}
+
+/*
+ * memmove_nodrain_movnt_avx512f -- (internal) memmove to pmem without hw
+ *	drain, movnt, 64-byte stores
+ */
+static void *
+memmove_nodrain_movnt_avx512f(void *pmemdest, const void *src, size_t len)
+{
+	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
+
+	return memmove_nodrain_movnt_common(pmemdest, src, len,
+			memmove_chunks_fw_avx512f, memmove_chunks_bw_avx512f);
+}
+
 /*
  * pmem_memmove_nodrain() calls through Func_memmove_nodrain to do the work.
  * Although initialized to memmove_nodrain_normal(), once the existence of the
@@ -956,6 +1417,82 @@ pmem_memcpy_persist(void *pmemdest, const void *src, size_t len)
 	return pmemdest;
 }
 
+/*
+ * Copies from pmem shorter than that are done with a regular memcpy(),
+ * the streaming loads only pay off for ranges much bigger than the caches
+ * they are supposed to protect.
+ */
+#define STREAM_LOAD_THRESHOLD	4096
+
+/*
+ * memcpy_from_pmem_normal -- (internal) copy from pmem, normal loads
+ */
+static void *
+memcpy_from_pmem_normal(void *dest, const void *pmemsrc, size_t len)
+{
+	LOG(15, "dest %p pmemsrc %p len %zu", dest, pmemsrc, len);
+
+	return memcpy(dest, pmemsrc, len);
+}
+
+/*
+ * memcpy_from_pmem_stream_load -- (internal) copy from pmem, non-temporal
+ *	loads
+ *
+ * The bytes up to the next 16-byte boundary of the source and the tail
+ * shorter than CHUNK_SIZE are copied using memcpy(), the bulk of the range
+ * is read with the MOVNTDQA instruction.
+ */
+static void *
+memcpy_from_pmem_stream_load(void *dest, const void *pmemsrc, size_t len)
+{
+	LOG(15, "dest %p pmemsrc %p len %zu", dest, pmemsrc, len);
+
+	if (len < STREAM_LOAD_THRESHOLD)
+		return memcpy(dest, pmemsrc, len);
+
+	char *d = dest;
+	const char *s = pmemsrc;
+
+	size_t cnt = (uintptr_t)s & MOVNT_MASK;
+	if (cnt != 0) {
+		cnt = MOVNT_SIZE - cnt;
+		memcpy(d, s, cnt);
+		d += cnt;
+		s += cnt;
+		len -= cnt;
+	}
+
+	cnt = len >> CHUNK_SHIFT;
+	memcpy_chunks_stream_load_sse41(d, s, cnt);
+
+	size_t done = cnt << CHUNK_SHIFT;
+	if (len > done)
+		memcpy(d + done, s + done, len - done);
+
+	return dest;
+}
+
+/*
+ * pmem_memcpy_from_pmem() calls through Func_memcpy_from_pmem to do the work.
+ * It is set to memcpy_from_pmem_stream_load() by pmem_init() if SSE4.1
+ * is supported.
+ */
+static void *(*Func_memcpy_from_pmem)(void *, const void *, size_t) =
+		memcpy_from_pmem_normal;
+
+/*
+ * pmem_memcpy_from_pmem -- copy from pmem to (usually) DRAM, bypassing
+ *	the processor caches for the source if possible
+ */
+void *
+pmem_memcpy_from_pmem(void *dest, const void *pmemsrc, size_t len)
+{
+	LOG(15, "dest %p pmemsrc %p len %zu", dest, pmemsrc, len);
+
+	return Func_memcpy_from_pmem(dest, pmemsrc, len);
+}
+
 /*
  * memset_nodrain_normal -- (internal) memset to pmem without hw drain, normal
  */
@@ -970,25 +1507,55 @@ memset_nodrain_normal(void *pmemdest, int c, size_t len)
 }
 
 /*
- * memset_nodrain_movnt -- (internal) memset to pmem without hw drain, movnt
+ * memset_chunks_sse2 -- (internal) fill cnt chunks of CHUNK_SIZE bytes,
+ *	using 16-byte non-temporal stores
  */
-static void *
-memset_nodrain_movnt(void *pmemdest, int c, size_t len)
+static void
+memset_chunks_sse2(char *dest, int c, size_t cnt)
 {
-	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+	__m128i xmm0 = _mm_set1_epi8((char)c);
+	__m128i *d = (__m128i *)dest;
+	size_t i;
 
+	for (i = 0; i < cnt; i++) {
+		_mm_stream_si128(d, xmm0);
+		_mm_stream_si128(d + 1, xmm0);
+		_mm_stream_si128(d + 2, xmm0);
+		_mm_stream_si128(d + 3, xmm0);
+		_mm_stream_si128(d + 4, xmm0);
+		_mm_stream_si128(d + 5, xmm0);
+		_mm_stream_si128(d + 6, xmm0);
+		_mm_stream_si128(d + 7, xmm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+}
+
+/*
+ * memset_nodrain_movnt_common -- (internal) memset to pmem without hw drain,
+ *	movnt
+ *
+ * As for memmove, only the routine filling the aligned bulk of the range
+ * depends on the width of the non-temporal stores.
+ */
+static force_inline void *
+memset_nodrain_movnt_common(void *pmemdest, int c, size_t len,
+	movnt_set_chunks_fn set_chunks)
+{
 	size_t i;
 	void *dest1 = pmemdest;
 	size_t cnt;
 	__m128i xmm0;
 	__m128i *d;
 
-	if (len < Movnt_threshold) {
+	if (len < Movnt_threshold_memset) {
 		memset(pmemdest, c, len);
 		pmem_flush(pmemdest, len);
 		return pmemdest;
 	}
 
+	pmem_stats_nt(len);
+
 	/* memset up to the next FLUSH_ALIGN boundary */
 	cnt = (uint64_t)dest1 & ALIGN_MASK;
 	if (cnt != 0) {
@@ -1005,22 +1572,12 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 
 	xmm0 = _mm_set1_epi8((char)c);
 
-	d = (__m128i *)dest1;
 	cnt = len / CHUNK_SIZE;
-	if (cnt != 0) {
-		for (i = 0; i < cnt; i++) {
-			_mm_stream_si128(d, xmm0);
-			_mm_stream_si128(d + 1, xmm0);
-			_mm_stream_si128(d + 2, xmm0);
-			_mm_stream_si128(d + 3, xmm0);
-			_mm_stream_si128(d + 4, xmm0);
-			_mm_stream_si128(d + 5, xmm0);
-			_mm_stream_si128(d + 6, xmm0);
-			_mm_stream_si128(d + 7, xmm0);
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-			d += 8;
-		}
-	}
+	if (cnt != 0)
+		set_chunks(dest1, c, cnt);
+
+	d = (__m128i *)((char *)dest1 + (cnt << CHUNK_SHIFT));
+
 	/* memset the tail (<128 bytes) in 16 bytes chunks */
 	len &= CHUNK_MASK;
 	if (len != 0) {
@@ -1060,6 +1617,44 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memset_nodrain_movnt -- (internal) memset to pmem without hw drain, movnt
+ */
+static void *
+memset_nodrain_movnt(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	return memset_nodrain_movnt_common(pmemdest, c, len,
+			memset_chunks_sse2);
+}
+
+/*
+ * memset_nodrain_movnt_avx -- (internal) memset to pmem without hw drain,
+ *	movnt, 32-byte stores
+ */
+static void *
+memset_nodrain_movnt_avx(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	return memset_nodrain_movnt_common(pmemdest, c, len,
+			memset_chunks_avx);
+}
+
+/*
+ * memset_nodrain_movnt_avx512f -- (internal) memset to pmem without hw
+ *	drain, movnt, 64-byte stores
+ */
+static void *
+memset_nodrain_movnt_avx512f(void *pmemdest, int c, size_t len)
+{
+	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
+
+	return memset_nodrain_movnt_common(pmemdest, c, len,
+			memset_chunks_avx512f);
+}
+
 /*
  * pmem_memset_nodrain() calls through Func_memset_nodrain to do the work.
  * Although initialized to memset_nodrain_normal(), once the existence of the
@@ -1105,15 +1700,32 @@ pmem_log_cpuinfo(void)
 		LOG(3, "using clflushopt");
 	else if (Func_flush == flush_clflush)
 		LOG(3, "using clflush");
+	else if (Func_flush == flush_empty)
+		LOG(3, "not flushing CPU cache");
 	else
 		FATAL("invalid flush function address");
 
-	if (Func_memmove_nodrain == memmove_nodrain_movnt)
+	if (Func_memmove_nodrain == memmove_nodrain_movnt_avx512f)
+		LOG(3, "using movnt (avx512f)");
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt_avx)
+		LOG(3, "using movnt (avx)");
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt)
 		LOG(3, "using movnt");
 	else if (Func_memmove_nodrain == memmove_nodrain_normal)
 		LOG(3, "not using movnt");
 	else
 		FATAL("invalid memove_nodrain function address");
+
+	if (Func_memmove_nodrain != memmove_nodrain_normal)
+		LOG(3, "movnt threshold: memmove %zu memset %zu",
+			Movnt_threshold_memmove, Movnt_threshold_memset);
+
+	if (Func_memcpy_from_pmem == memcpy_from_pmem_stream_load)
+		LOG(3, "using movntdqa");
+	else if (Func_memcpy_from_pmem == memcpy_from_pmem_normal)
+		LOG(3, "not using movntdqa");
+	else
+		FATAL("invalid memcpy_from_pmem function address");
 }
 
 /*
@@ -1123,7 +1735,7 @@ static void
 pmem_get_cpuinfo(void)
 {
 	if (is_cpu_clflush_present()) {
-		Func_is_pmem = is_pmem_proc;
+		Func_is_pmem = is_pmem_cached;
 		LOG(3, "clflush supported");
 	}
 
@@ -1150,6 +1762,214 @@ pmem_get_cpuinfo(void)
 			Func_predrain_fence = predrain_fence_sfence;
 		}
 	}
+
+	/*
+	 * If the CPU caches are within the persistence domain (eADR),
+	 * stores only have to be made globally visible before pmem_drain()
+	 * returns, there is no need to flush anything.  PMEM_NO_FLUSH=1
+	 * forces this behavior, PMEM_NO_FLUSH=0 disables the detection.
+	 */
+	char *e = getenv("PMEM_NO_FLUSH");
+	if (e && strcmp(e, "0") == 0) {
+		LOG(3, "PMEM_NO_FLUSH forced flushing");
+		return;
+	}
+
+	if (e && strcmp(e, "1") == 0)
+		LOG(3, "PMEM_NO_FLUSH forced no flushing");
+	else if (is_cpu_cache_persistent())
+		LOG(3, "cpu caches in persistence domain");
+	else
+		return;
+
+	Func_flush = flush_empty;
+	Func_predrain_fence = predrain_fence_sfence;
+}
+
+/*
+ * pmem_init_movnt -- (internal) pick the widest available non-temporal
+ *	memmove/memset implementation
+ */
+static void
+pmem_init_movnt(void)
+{
+	char *ptr = getenv("PMEM_NO_MOVNT");
+	if (ptr && strcmp(ptr, "1") == 0) {
+		LOG(3, "PMEM_NO_MOVNT forced no movnt");
+		return;
+	}
+
+	Func_memmove_nodrain = memmove_nodrain_movnt;
+	Func_memset_nodrain = memset_nodrain_movnt;
+
+	if (is_cpu_avx_present()) {
+		LOG(3, "avx supported");
+
+		ptr = getenv("PMEM_NO_AVX");
+		if (ptr && strcmp(ptr, "1") == 0)
+			LOG(3, "PMEM_NO_AVX forced no avx");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx;
+			Func_memset_nodrain = memset_nodrain_movnt_avx;
+		}
+	}
+
+	if (is_cpu_avx512f_present()) {
+		LOG(3, "avx512f supported");
+
+		ptr = getenv("PMEM_NO_AVX512F");
+		if (ptr && strcmp(ptr, "1") == 0)
+			LOG(3, "PMEM_NO_AVX512F forced no avx512f");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx512f;
+			Func_memset_nodrain = memset_nodrain_movnt_avx512f;
+		}
+	}
+}
+
+/*
+ * pmem_init_stream_load -- (internal) pick the pmem_memcpy_from_pmem()
+ *	implementation
+ */
+static void
+pmem_init_stream_load(void)
+{
+	if (!is_cpu_sse41_present())
+		return;
+
+	LOG(3, "sse4.1 supported");
+
+	char *ptr = getenv("PMEM_NO_MOVNTDQA");
+	if (ptr && strcmp(ptr, "1") == 0) {
+		LOG(3, "PMEM_NO_MOVNTDQA forced no movntdqa");
+		return;
+	}
+
+	Func_memcpy_from_pmem = memcpy_from_pmem_stream_load;
+}
+
+/*
+ * calibrate_memmove -- (internal) measure the time of copying the scratch
+ *	buffer in pieces of len bytes, followed by a drain after each one
+ */
+static uint64_t
+calibrate_memmove(void *(*memmove_fn)(void *, const void *, size_t),
+	char *scratch, const char *src, size_t len)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int r = 0; r < CALIBRATE_ROUNDS; r++) {
+		uint64_t start = util_time_ns();
+		for (size_t off = 0; off + len <= CALIBRATE_SCRATCH_SIZE;
+				off += len) {
+			memmove_fn(scratch + off, src, len);
+			pmem_drain();
+		}
+		uint64_t t = util_time_ns() - start;
+
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+ * calibrate_memset -- (internal) measure the time of filling the scratch
+ *	buffer in pieces of len bytes, followed by a drain after each one
+ */
+static uint64_t
+calibrate_memset(void *(*memset_fn)(void *, int, size_t),
+	char *scratch, size_t len)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int r = 0; r < CALIBRATE_ROUNDS; r++) {
+		uint64_t start = util_time_ns();
+		for (size_t off = 0; off + len <= CALIBRATE_SCRATCH_SIZE;
+				off += len) {
+			memset_fn(scratch + off, r, len);
+			pmem_drain();
+		}
+		uint64_t t = util_time_ns() - start;
+
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+ * pmem_calibrate_movnt -- (internal) pick the movnt thresholds by running
+ *	a short microbenchmark
+ *
+ * For each candidate length the regular and non-temporal variants are
+ * timed over a scratch buffer in DRAM (there is no persistent memory to
+ * experiment on at this point).  The threshold is the shortest length
+ * for which non-temporal stores are not slower.  If they never win,
+ * the threshold is set above the largest candidate.
+ */
+static void
+pmem_calibrate_movnt(void)
+{
+	LOG(3, NULL);
+
+	char *scratch = Malloc(CALIBRATE_SCRATCH_SIZE + CALIBRATE_MAX_LEN);
+	if (scratch == NULL) {
+		LOG(3, "!Malloc, movnt thresholds not calibrated");
+		return;
+	}
+	char *src = scratch + CALIBRATE_SCRATCH_SIZE;
+	memset(scratch, 0, CALIBRATE_SCRATCH_SIZE + CALIBRATE_MAX_LEN);
+
+	/* both variants are called directly, the thresholds must not apply */
+	Movnt_threshold_memmove = 0;
+	Movnt_threshold_memset = 0;
+
+	size_t memmove_thr = 2 * CALIBRATE_MAX_LEN;
+	size_t memset_thr = 2 * CALIBRATE_MAX_LEN;
+
+	for (size_t len = CALIBRATE_MIN_LEN; len <= CALIBRATE_MAX_LEN;
+			len *= 2) {
+		if (memmove_thr > CALIBRATE_MAX_LEN) {
+			uint64_t tn = calibrate_memmove(memmove_nodrain_normal,
+					scratch, src, len);
+			uint64_t tm = calibrate_memmove(Func_memmove_nodrain,
+					scratch, src, len);
+			LOG(4, "memmove len %zu normal %" PRIu64 " ns "
+				"movnt %" PRIu64 " ns", len, tn, tm);
+			if (tm <= tn)
+				memmove_thr = len;
+		}
+
+		if (memset_thr > CALIBRATE_MAX_LEN) {
+			uint64_t tn = calibrate_memset(memset_nodrain_normal,
+					scratch, len);
+			uint64_t tm = calibrate_memset(Func_memset_nodrain,
+					scratch, len);
+			LOG(4, "memset len %zu normal %" PRIu64 " ns "
+				"movnt %" PRIu64 " ns", len, tn, tm);
+			if (tm <= tn)
+				memset_thr = len;
+		}
+	}
+
+	Movnt_threshold_memmove = memmove_thr;
+	Movnt_threshold_memset = memset_thr;
+
+	Free(scratch);
+}
+
+/*
+ * pmem_fini -- libpmem cleanup routine for pmem.c
+ */
+void
+pmem_fini(void)
+{
+	LOG(3, NULL);
+
+	mapping_fini();
 }
 
 /*
@@ -1176,19 +1996,38 @@ pmem_init(void)
 			LOG(3, "Invalid PMEM_MOVNT_THRESHOLD");
 		else {
 			LOG(3, "PMEM_MOVNT_THRESHOLD set to %zu", (size_t)val);
-			Movnt_threshold = (size_t)val;
+			Movnt_threshold_memmove = (size_t)val;
+			Movnt_threshold_memset = (size_t)val;
 		}
 	}
 
-	ptr = getenv("PMEM_NO_MOVNT");
-	if (ptr && strcmp(ptr, "1") == 0)
-		LOG(3, "PMEM_NO_MOVNT forced no movnt");
-	else {
-		Func_memmove_nodrain = memmove_nodrain_movnt;
-		Func_memset_nodrain = memset_nodrain_movnt;
+	pmem_init_movnt();
+	pmem_init_stream_load();
+
+	/*
+	 * Optionally, measure where the crossover between regular stores
+	 * followed by a flush and non-temporal stores is on this platform.
+	 * An explicit PMEM_MOVNT_THRESHOLD takes precedence.
+	 */
+	char *cal = getenv("PMEM_MOVNT_CALIBRATE");
+	if (cal && strcmp(cal, "1") == 0) {
+		if (ptr)
+			LOG(3, "PMEM_MOVNT_THRESHOLD set, "
+				"PMEM_MOVNT_CALIBRATE ignored");
+		else if (Func_memmove_nodrain == memmove_nodrain_normal)
+			LOG(3, "movnt not used, PMEM_MOVNT_CALIBRATE ignored");
+		else
+			pmem_calibrate_movnt();
 	}
 
 	pmem_log_cpuinfo();
+
+	/* enabled last, not to count the calibration */
+	char *stats = getenv("PMEM_STATS");
+	if (stats && strcmp(stats, "1") == 0) {
+		LOG(3, "PMEM_STATS set to 1");
+		Pmem_stats = Pmem_stats_slots;
+	}
 }
 
 
@@ -41,5 +41,35 @@
 extern unsigned long long Pagesize;
 
 void pmem_init(void);
+void pmem_fini(void);
 
 int is_pmem_proc(const void *addr, size_t len);
+int is_cpu_cache_persistent(void);
+
+/*
+ * The non-temporal memmove/memset flow copies the aligned bulk of a range
+ * in chunks of CHUNK_SIZE bytes.  The routines doing that differ only in the
+ * width of the stores they use and live in separate compilation units, so
+ * that each of them can be built with the instruction set it requires.
+ */
+#define CHUNK_SIZE	128 /* 16*8 */
+#define CHUNK_SHIFT	7
+
+typedef void (*movnt_chunks_fn)(char *dest, const char *src, size_t cnt);
+typedef void (*movnt_set_chunks_fn)(char *dest, int c, size_t cnt);
+
+void memmove_chunks_fw_avx(char *dest, const char *src, size_t cnt);
+void memmove_chunks_bw_avx(char *dest, const char *src, size_t cnt);
+void memset_chunks_avx(char *dest, int c, size_t cnt);
+
+void memmove_chunks_fw_avx512f(char *dest, const char *src, size_t cnt);
+void memmove_chunks_bw_avx512f(char *dest, const char *src, size_t cnt);
+void memset_chunks_avx512f(char *dest, int c, size_t cnt);
+
+/*
+ * The streaming load copy (pmem_memcpy_from_pmem) reads the source in
+ * CHUNK_SIZE chunks too, prefetching STREAM_LOAD_PREFETCH bytes ahead.
+ */
+#define STREAM_LOAD_PREFETCH	512
+
+void memcpy_chunks_stream_load_sse41(char *dest, const char *src, size_t cnt);
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx.c -- non-temporal memmove/memset chunk routines using AVX
+ *
+ * This file is compiled with -mavx and its functions are called only
+ * if pmem_init() confirmed the CPU (and OS) support AVX.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "pmem.h"
+#include "valgrind_internal.h"
+
+/*
+ * memmove_chunks_fw_avx -- copy cnt chunks of CHUNK_SIZE bytes in the forward
+ *	direction, using 32-byte non-temporal stores
+ */
+void
+memmove_chunks_fw_avx(char *dest, const char *src, size_t cnt)
+{
+	__m256i ymm0, ymm1, ymm2, ymm3;
+	__m256i *d = (__m256i *)dest;
+	const __m256i *s = (const __m256i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		ymm0 = _mm256_loadu_si256(s);
+		ymm1 = _mm256_loadu_si256(s + 1);
+		ymm2 = _mm256_loadu_si256(s + 2);
+		ymm3 = _mm256_loadu_si256(s + 3);
+		s += 4;
+		_mm256_stream_si256(d, ymm0);
+		_mm256_stream_si256(d + 1, ymm1);
+		_mm256_stream_si256(d + 2, ymm2);
+		_mm256_stream_si256(d + 3, ymm3);
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+		d += 4;
+	}
+}
+
+/*
+ * memmove_chunks_bw_avx -- copy cnt chunks of CHUNK_SIZE bytes in the backward
+ *	direction, using 32-byte non-temporal stores
+ *
+ * Both dest and src point to the end of the ranges.
+ */
+void
+memmove_chunks_bw_avx(char *dest, const char *src, size_t cnt)
+{
+	__m256i ymm0, ymm1, ymm2, ymm3;
+	__m256i *d = (__m256i *)dest;
+	const __m256i *s = (const __m256i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		ymm0 = _mm256_loadu_si256(s - 1);
+		ymm1 = _mm256_loadu_si256(s - 2);
+		ymm2 = _mm256_loadu_si256(s - 3);
+		ymm3 = _mm256_loadu_si256(s - 4);
+		s -= 4;
+		_mm256_stream_si256(d - 1, ymm0);
+		_mm256_stream_si256(d - 2, ymm1);
+		_mm256_stream_si256(d - 3, ymm2);
+		_mm256_stream_si256(d - 4, ymm3);
+		d -= 4;
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+	}
+}
+
+/*
+ * memset_chunks_avx -- fill cnt chunks of CHUNK_SIZE bytes, using 32-byte
+ *	non-temporal stores
+ */
+void
+memset_chunks_avx(char *dest, int c, size_t cnt)
+{
+	__m256i ymm0 = _mm256_set1_epi8((char)c);
+	__m256i *d = (__m256i *)dest;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		_mm256_stream_si256(d, ymm0);
+		_mm256_stream_si256(d + 1, ymm0);
+		_mm256_stream_si256(d + 2, ymm0);
+		_mm256_stream_si256(d + 3, ymm0);
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+		d += 4;
+	}
+}
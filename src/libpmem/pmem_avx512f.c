@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx512f.c -- non-temporal memmove/memset chunk routines using AVX-512F
+ *
+ * This file is compiled with -mavx512f and its functions are called only
+ * if pmem_init() confirmed the CPU (and OS) support AVX-512F.
+ *
+ * A chunk is two 64-byte stores, i.e. two full cache lines.  The loops
+ * below handle two chunks per iteration, so that four cache lines are
+ * in flight, as in the SSE2 and AVX variants.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "pmem.h"
+#include "valgrind_internal.h"
+
+/*
+ * memmove_chunks_fw_avx512f -- copy cnt chunks of CHUNK_SIZE bytes in the
+ *	forward direction, using 64-byte non-temporal stores
+ */
+void
+memmove_chunks_fw_avx512f(char *dest, const char *src, size_t cnt)
+{
+	__m512i zmm0, zmm1, zmm2, zmm3;
+	__m512i *d = (__m512i *)dest;
+	const __m512i *s = (const __m512i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt / 2; i++) {
+		zmm0 = _mm512_loadu_si512(s);
+		zmm1 = _mm512_loadu_si512(s + 1);
+		zmm2 = _mm512_loadu_si512(s + 2);
+		zmm3 = _mm512_loadu_si512(s + 3);
+		s += 4;
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm1);
+		_mm512_stream_si512(d + 2, zmm2);
+		_mm512_stream_si512(d + 3, zmm3);
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+		d += 4;
+	}
+
+	if (cnt & 1) {
+		zmm0 = _mm512_loadu_si512(s);
+		zmm1 = _mm512_loadu_si512(s + 1);
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm1);
+		VALGRIND_DO_FLUSH(d, 2 * sizeof(*d));
+	}
+}
+
+/*
+ * memmove_chunks_bw_avx512f -- copy cnt chunks of CHUNK_SIZE bytes in the
+ *	backward direction, using 64-byte non-temporal stores
+ *
+ * Both dest and src point to the end of the ranges.
+ */
+void
+memmove_chunks_bw_avx512f(char *dest, const char *src, size_t cnt)
+{
+	__m512i zmm0, zmm1, zmm2, zmm3;
+	__m512i *d = (__m512i *)dest;
+	const __m512i *s = (const __m512i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt / 2; i++) {
+		zmm0 = _mm512_loadu_si512(s - 1);
+		zmm1 = _mm512_loadu_si512(s - 2);
+		zmm2 = _mm512_loadu_si512(s - 3);
+		zmm3 = _mm512_loadu_si512(s - 4);
+		s -= 4;
+		_mm512_stream_si512(d - 1, zmm0);
+		_mm512_stream_si512(d - 2, zmm1);
+		_mm512_stream_si512(d - 3, zmm2);
+		_mm512_stream_si512(d - 4, zmm3);
+		d -= 4;
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+	}
+
+	if (cnt & 1) {
+		zmm0 = _mm512_loadu_si512(s - 1);
+		zmm1 = _mm512_loadu_si512(s - 2);
+		_mm512_stream_si512(d - 1, zmm0);
+		_mm512_stream_si512(d - 2, zmm1);
+		d -= 2;
+		VALGRIND_DO_FLUSH(d, 2 * sizeof(*d));
+	}
+}
+
+/*
+ * memset_chunks_avx512f -- fill cnt chunks of CHUNK_SIZE bytes, using 64-byte
+ *	non-temporal stores
+ */
+void
+memset_chunks_avx512f(char *dest, int c, size_t cnt)
+{
+	__m512i zmm0 = _mm512_set1_epi32((int)(0x01010101u * (unsigned char)c));
+	__m512i *d = (__m512i *)dest;
+	size_t i;
+
+	for (i = 0; i < cnt / 2; i++) {
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm0);
+		_mm512_stream_si512(d + 2, zmm0);
+		_mm512_stream_si512(d + 3, zmm0);
+		VALGRIND_DO_FLUSH(d, 4 * sizeof(*d));
+		d += 4;
+	}
+
+	if (cnt & 1) {
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm0);
+		VALGRIND_DO_FLUSH(d, 2 * sizeof(*d));
+	}
+}
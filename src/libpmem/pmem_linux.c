@@ -36,12 +36,17 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
 
 #include "pmem.h"
 #include "out.h"
 
 #define PROCMAXLEN 2048 /* maximum expected line length in /proc files */
 
+#define ND_REGIONS_DIR "/sys/bus/nd/devices"
+#define ND_REGION_PREFIX "region"
+#define ND_CPU_CACHE_DOMAIN "cpu_cache"
+
 /*
  * is_pmem_proc -- use /proc to implement pmem_is_pmem()
  *
@@ -135,3 +140,63 @@ is_pmem_proc(const void *addr, size_t len)
 	LOG(3, "returning %d", retval);
 	return retval;
 }
+
+/*
+ * is_cpu_cache_persistent -- check if the CPU caches are within
+ *	the persistence domain on this platform
+ *
+ * This function returns true only if there is at least one NVDIMM region
+ * and the kernel reports (based on the ACPI NFIT platform capabilities)
+ * that the persistence domain of every region includes the CPU caches,
+ * i.e. the platform flushes them to persistent memory on power failure.
+ * Any error just results in returning false.
+ */
+int
+is_cpu_cache_persistent(void)
+{
+	DIR *dir = opendir(ND_REGIONS_DIR);
+	if (dir == NULL) {
+		LOG(4, "!%s", ND_REGIONS_DIR);
+		return 0;
+	}
+
+	int nregions = 0;
+	int retval = 1;
+	struct dirent *d;
+	while (retval && (d = readdir(dir)) != NULL) {
+		if (strncmp(d->d_name, ND_REGION_PREFIX,
+				sizeof(ND_REGION_PREFIX) - 1) != 0)
+			continue;
+
+		char path[PROCMAXLEN];
+		snprintf(path, sizeof(path), "%s/%s/persistence_domain",
+				ND_REGIONS_DIR, d->d_name);
+
+		char domain[PROCMAXLEN];
+		FILE *fp = fopen(path, "r");
+		if (fp == NULL) {
+			LOG(4, "!%s", path);
+			retval = 0;
+			break;
+		}
+
+		if (fgets(domain, sizeof(domain), fp) == NULL ||
+				strncmp(domain, ND_CPU_CACHE_DOMAIN,
+				sizeof(ND_CPU_CACHE_DOMAIN) - 1) != 0) {
+			LOG(4, "%s: cpu caches not in persistence domain",
+					d->d_name);
+			retval = 0;
+		}
+
+		fclose(fp);
+		nregions++;
+	}
+
+	closedir(dir);
+
+	if (nregions == 0)
+		retval = 0;
+
+	LOG(3, "returning %d", retval);
+	return retval;
+}
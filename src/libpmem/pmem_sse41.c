@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_sse41.c -- streaming load copy routine using SSE4.1
+ *
+ * This file is compiled with -msse4.1 and its functions are called only
+ * if pmem_init() confirmed the CPU supports SSE4.1.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <smmintrin.h>
+
+#include "pmem.h"
+
+/*
+ * memcpy_chunks_stream_load_sse41 -- copy cnt chunks of CHUNK_SIZE bytes,
+ *	using 16-byte non-temporal loads and regular stores
+ *
+ * The source must be 16-byte aligned.  The source lines are prefetched
+ * with the non-temporal hint ahead of the loads, so that they are not
+ * kept in the processor caches.
+ */
+void
+memcpy_chunks_stream_load_sse41(char *dest, const char *src, size_t cnt)
+{
+	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
+	__m128i *d = (__m128i *)dest;
+	__m128i *s = (__m128i *)src;
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		_mm_prefetch((char *)s + STREAM_LOAD_PREFETCH, _MM_HINT_NTA);
+		_mm_prefetch((char *)s + STREAM_LOAD_PREFETCH + 64,
+				_MM_HINT_NTA);
+
+		xmm0 = _mm_stream_load_si128(s);
+		xmm1 = _mm_stream_load_si128(s + 1);
+		xmm2 = _mm_stream_load_si128(s + 2);
+		xmm3 = _mm_stream_load_si128(s + 3);
+		xmm4 = _mm_stream_load_si128(s + 4);
+		xmm5 = _mm_stream_load_si128(s + 5);
+		xmm6 = _mm_stream_load_si128(s + 6);
+		xmm7 = _mm_stream_load_si128(s + 7);
+		s += 8;
+		_mm_storeu_si128(d, xmm0);
+		_mm_storeu_si128(d + 1, xmm1);
+		_mm_storeu_si128(d + 2, xmm2);
+		_mm_storeu_si128(d + 3, xmm3);
+		_mm_storeu_si128(d + 4, xmm4);
+		_mm_storeu_si128(d + 5, xmm5);
+		_mm_storeu_si128(d + 6, xmm6);
+		_mm_storeu_si128(d + 7, xmm7);
+		d += 8;
+	}
+}
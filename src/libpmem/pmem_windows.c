@@ -34,6 +34,9 @@
  * pmem_windows.c -- pmem utilities with OS-specific implementation
  */
 
+#include <windows.h>
+#include <stdint.h>
+
 #include "pmem.h"
 #include "out.h"
 
@@ -54,3 +57,16 @@ is_pmem_proc(const void *addr, size_t len)
 	LOG(3, "returning %d", 0);
 	return 0;
 }
+
+/*
+ * is_cpu_cache_persistent -- check if the CPU caches are within
+ *	the persistence domain on this platform
+ *
+ * XXX - no Windows implementation yet
+ */
+int
+is_cpu_cache_persistent(void)
+{
+	LOG(3, "returning %d", 0);
+	return 0;
+}
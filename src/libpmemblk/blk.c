@@ -35,6 +35,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/param.h>
@@ -57,25 +58,57 @@
 #include "valgrind_internal.h"
 
 /*
- * lane_enter -- (internal) acquire a unique lane number
+ * Set by the PMEMBLK_MAP_CACHE environment variable, makes the pools keep
+ * a volatile copy of the BTT map.
  */
-static void
+static int Map_cache;
+
+/*
+ * Preferred lane of the calling thread, assigned on its first lane_enter
+ * and reduced modulo the number of lanes of the pool being accessed, so
+ * that a thread keeps using the same per-lane BTT state.
+ */
+static __thread unsigned Lane_idx = UINT32_MAX;
+static unsigned Next_lane_idx;
+
+/*
+ * lane_enter -- acquire a unique lane number
+ *
+ * The preferred lane of the thread is tried first. If it is busy the other
+ * lanes are tried without blocking and only if all of them are taken the
+ * thread waits for its preferred lane.
+ */
+void
 lane_enter(PMEMblkpool *pbp, unsigned *lane)
 {
-	unsigned mylane;
+	if (Lane_idx == UINT32_MAX)
+		Lane_idx = __sync_fetch_and_add(&Next_lane_idx, 1);
+
+	unsigned mylane = Lane_idx % pbp->nlane;
 
-	mylane = __sync_fetch_and_add(&pbp->next_lane, 1) % pbp->nlane;
+	if (util_mutex_trylock(&pbp->locks[mylane]) == 0) {
+		*lane = mylane;
+		return;
+	}
+
+	for (unsigned i = 1; i < pbp->nlane; i++) {
+		unsigned l = (mylane + i) % pbp->nlane;
+		if (util_mutex_trylock(&pbp->locks[l]) == 0) {
+			*lane = l;
+			return;
+		}
+	}
 
-	/* lane selected, grab the per-lane lock */
+	/* all lanes are busy, wait for the preferred one */
 	util_mutex_lock(&pbp->locks[mylane]);
 
 	*lane = mylane;
 }
 
 /*
- * lane_exit -- (internal) drop lane lock
+ * lane_exit -- drop lane lock
  */
-static void
+void
 lane_exit(PMEMblkpool *pbp, unsigned mylane)
 {
 	util_mutex_unlock(&pbp->locks[mylane]);
@@ -262,6 +295,24 @@ static struct ns_callback ns_cb = {
 	.ns_is_zeroed = 0
 };
 
+/*
+ * blk_init -- load-time initialization for blk
+ */
+void
+blk_init(void)
+{
+	LOG(3, NULL);
+
+	char *e = getenv(PMEMBLK_MAP_CACHE_VAR);
+	if (e != NULL && atoi(e) > 0) {
+		Map_cache = 1;
+		LOG(3, "%s set", PMEMBLK_MAP_CACHE_VAR);
+	}
+
+	btt_arena_threads_init(PMEMBLK_ARENA_THREADS_VAR);
+	btt_map_locks_init(PMEMBLK_MAP_LOCKS_VAR);
+}
+
 /*
  * pmemblk_descr_create -- (internal) create block memory pool descriptor
  */
@@ -303,12 +354,16 @@ pmemblk_descr_check(PMEMblkpool *pbp, size_t *bsize)
 
 /*
  * pmemblk_runtime_init -- (internal) initialize block memory pool runtime data
+ *
+ * A non-NULL layout makes the BTT layout be written out right away, using the
+ * given parameters, instead of on the first write.
  */
 static int
-pmemblk_runtime_init(PMEMblkpool *pbp, size_t bsize, int rdonly, int is_pmem)
+pmemblk_runtime_init(PMEMblkpool *pbp, size_t bsize, int rdonly, int is_pmem,
+		const struct pmemblk_layout *layout)
 {
-	LOG(3, "pbp %p bsize %zu rdonly %d is_pmem %d",
-			pbp, bsize, rdonly, is_pmem);
+	LOG(3, "pbp %p bsize %zu rdonly %d is_pmem %d layout %p",
+			pbp, bsize, rdonly, is_pmem, layout);
 
 	/* remove volatile part of header */
 	VALGRIND_REMOVE_PMEM_MAPPING(&pbp->addr,
@@ -351,8 +406,14 @@ pmemblk_runtime_init(PMEMblkpool *pbp, size_t bsize, int rdonly, int is_pmem)
 
 	pbp->bttp = bttp;
 
+	if (layout && btt_format(bttp, 0, layout->arena_size,
+			layout->nfree) < 0)
+		goto err;	/* btt_format set errno, called LOG */
+
+	if (Map_cache && btt_map_cache(bttp) < 0)
+		goto err;	/* btt_map_cache set errno, called LOG */
+
 	pbp->nlane = btt_nlane(pbp->bttp);
-	pbp->next_lane = 0;
 	if ((locks = Malloc(pbp->nlane * sizeof(*locks))) == NULL) {
 		ERR("!Malloc for lane locks");
 		goto err;
@@ -393,14 +454,14 @@ err:
 }
 
 /*
- * pmemblk_create -- create a block memory pool
+ * pmemblk_create_layout -- create a block memory pool with the given layout
  */
 PMEMblkpool *
-pmemblk_create(const char *path, size_t bsize, size_t poolsize,
-		mode_t mode)
+pmemblk_create_layout(const char *path, size_t bsize, size_t poolsize,
+		mode_t mode, const struct pmemblk_layout *layout)
 {
-	LOG(3, "path %s bsize %zu poolsize %zu mode %o",
-			path, bsize, poolsize, mode);
+	LOG(3, "path %s bsize %zu poolsize %zu mode %o layout %p",
+			path, bsize, poolsize, mode, layout);
 
 	/* check if bsize is valid */
 	if (bsize == 0) {
@@ -451,7 +512,7 @@ pmemblk_create(const char *path, size_t bsize, size_t poolsize,
 	}
 
 	/* initialize runtime parts */
-	if (pmemblk_runtime_init(pbp, bsize, 0, rep->is_pmem) != 0) {
+	if (pmemblk_runtime_init(pbp, bsize, 0, rep->is_pmem, layout) != 0) {
 		ERR("pool initialization failed");
 		goto err;
 	}
@@ -470,6 +531,19 @@ err:
 	return NULL;
 }
 
+/*
+ * pmemblk_create -- create a block memory pool
+ */
+PMEMblkpool *
+pmemblk_create(const char *path, size_t bsize, size_t poolsize,
+		mode_t mode)
+{
+	LOG(3, "path %s bsize %zu poolsize %zu mode %o",
+			path, bsize, poolsize, mode);
+
+	return pmemblk_create_layout(path, bsize, poolsize, mode, NULL);
+}
+
 
 /*
  * pmemblk_open_common -- (internal) open a block memory pool
@@ -521,7 +595,8 @@ pmemblk_open_common(const char *path, size_t bsize, int cow)
 	}
 
 	/* initialize runtime parts */
-	if (pmemblk_runtime_init(pbp, bsize, set->rdonly, rep->is_pmem) != 0) {
+	if (pmemblk_runtime_init(pbp, bsize, set->rdonly, rep->is_pmem,
+			NULL) != 0) {
 		ERR("pool initialization failed");
 		goto err;
 	}
@@ -649,6 +724,136 @@ pmemblk_write(PMEMblkpool *pbp, const void *buf, long long blockno)
 	return err;
 }
 
+/*
+ * blk_vec_check -- (internal) validates the block numbers of a vector
+ */
+static int
+blk_vec_check(const struct pmemblk_vec *vec, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; ++i) {
+		if (vec[i].blockno < 0) {
+			ERR("negative block number");
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * pmemblk_readv -- read many blocks in a block memory pool
+ *
+ * All of the blocks are read using a single lane.
+ */
+int
+pmemblk_readv(PMEMblkpool *pbp, const struct pmemblk_vec *vec, size_t cnt)
+{
+	LOG(3, "pbp %p vec %p cnt %zu", pbp, vec, cnt);
+
+	if (blk_vec_check(vec, cnt) != 0)
+		return -1;
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = 0;
+	for (size_t i = 0; i < cnt && err == 0; ++i)
+		err = btt_read(pbp->bttp, lane, (uint64_t)vec[i].blockno,
+			vec[i].buf);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
+/*
+ * pmemblk_writev -- write many blocks (each one atomically) in a block
+ *	memory pool
+ *
+ * All of the blocks are written in order, using a single lane.
+ */
+int
+pmemblk_writev(PMEMblkpool *pbp, const struct pmemblk_vec *vec, size_t cnt)
+{
+	LOG(3, "pbp %p vec %p cnt %zu", pbp, vec, cnt);
+
+	if (pbp->rdonly) {
+		ERR("EROFS (pool is read-only)");
+		errno = EROFS;
+		return -1;
+	}
+
+	if (blk_vec_check(vec, cnt) != 0)
+		return -1;
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = 0;
+	for (size_t i = 0; i < cnt && err == 0; ++i)
+		err = btt_write(pbp->bttp, lane, (uint64_t)vec[i].blockno,
+			vec[i].buf);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
+/*
+ * pmemblk_read_map -- map a block of a block memory pool for reading
+ *
+ * The block is protected from being overwritten in place and the lane
+ * used for the lookup stays taken until pmemblk_read_release().
+ */
+int
+pmemblk_read_map(PMEMblkpool *pbp, long long blockno, const void **addrp)
+{
+	LOG(3, "pbp %p blockno %lld addrp %p", pbp, blockno, addrp);
+
+	if (blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	if (btt_read_map(pbp->bttp, lane, (uint64_t)blockno, addrp) < 0) {
+		lane_exit(pbp, lane);
+		return -1;
+	}
+
+	return (int)lane;
+}
+
+/*
+ * pmemblk_read_release -- release a block mapped by pmemblk_read_map()
+ */
+int
+pmemblk_read_release(PMEMblkpool *pbp, int handle)
+{
+	LOG(3, "pbp %p handle %d", pbp, handle);
+
+	if (handle < 0 || (unsigned)handle >= pbp->nlane) {
+		ERR("invalid read map handle %d", handle);
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane = (unsigned)handle;
+
+	btt_read_unmap(pbp->bttp, lane);
+
+	lane_exit(pbp, lane);
+
+	return 0;
+}
+
 /*
  * pmemblk_set_zero -- zero a block in a block memory pool
  */
@@ -680,6 +885,38 @@ pmemblk_set_zero(PMEMblkpool *pbp, long long blockno)
 	return err;
 }
 
+/*
+ * pmemblk_set_zero_range -- zero a range of blocks in a block memory pool
+ */
+int
+pmemblk_set_zero_range(PMEMblkpool *pbp, long long blockno, size_t nblock)
+{
+	LOG(3, "pbp %p blockno %lld nblock %zu", pbp, blockno, nblock);
+
+	if (pbp->rdonly) {
+		ERR("EROFS (pool is read-only)");
+		errno = EROFS;
+		return -1;
+	}
+
+	if (blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned lane;
+
+	lane_enter(pbp, &lane);
+
+	int err = btt_set_zero_range(pbp->bttp, lane, (uint64_t)blockno,
+			nblock);
+
+	lane_exit(pbp, lane);
+
+	return err;
+}
+
 /*
  * pmemblk_set_error -- set the error state on a block in a block memory pool
  */
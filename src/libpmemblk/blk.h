@@ -42,6 +42,9 @@
 #define PMEMBLK_LOG_PREFIX "libpmemblk"
 #define PMEMBLK_LOG_LEVEL_VAR "PMEMBLK_LOG_LEVEL"
 #define PMEMBLK_LOG_FILE_VAR "PMEMBLK_LOG_FILE"
+#define PMEMBLK_MAP_CACHE_VAR "PMEMBLK_MAP_CACHE"
+#define PMEMBLK_ARENA_THREADS_VAR "PMEMBLK_ARENA_THREADS"
+#define PMEMBLK_MAP_LOCKS_VAR "PMEMBLK_MAP_LOCKS"
 
 /* attributes of the blk memory pool format for the pool header */
 #define BLK_HDR_SIG "PMEMBLK"	/* must be 8 bytes including '\0' */
@@ -69,7 +72,6 @@ struct pmemblk {
 	size_t nlba;			/* number of LBAs in pool */
 	struct btt *bttp;		/* btt handle */
 	unsigned nlane;			/* number of lanes */
-	unsigned next_lane;		/* used to rotate through lanes */
 	pthread_mutex_t *locks;		/* one per lane */
 
 	struct pool_set *set;		/* pool set info */
@@ -82,3 +84,8 @@ struct pmemblk {
 
 /* data area starts at this alignment after the struct pmemblk above */
 #define BLK_FORMAT_DATA_ALIGN ((uintptr_t)4096)
+
+void blk_init(void);
+
+void lane_enter(struct pmemblk *pbp, unsigned *lane);
+void lane_exit(struct pmemblk *pbp, unsigned mylane);
@@ -87,6 +87,8 @@
  *				read_info
  *				read_arenas
  *				read_arena
+ *				setup_arenas
+ *				setup_arena
  *				read_flogs
  *				read_flog_pair
  *
@@ -122,6 +124,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/param.h>
 #include <unistd.h>
 #include <errno.h>
@@ -135,6 +138,7 @@
 #include "btt.h"
 #include "btt_layout.h"
 #include "sys_util.h"
+#include "usdt.h"
 
 /*
  * The opaque btt handle containing state tracked by this module
@@ -143,6 +147,7 @@
  */
 struct btt {
 	unsigned nlane; /* number of concurrent threads allowed per btt */
+	unsigned maxlane; /* upper bound on nlane, 0 if none */
 
 	/*
 	 * The laidout flag indicates whether the namespace contains valid BTT
@@ -155,6 +160,12 @@ struct btt {
 	pthread_mutex_t layout_write_mutex;
 	int laidout;
 
+	/*
+	 * Set by btt_map_cache(), makes read_arena() build a volatile copy
+	 * of the map of each arena.
+	 */
+	int map_cache;
+
 	/*
 	 * UUID of the BTT
 	 */
@@ -171,6 +182,7 @@ struct btt {
 	uint64_t rawsize;		/* size of containing namespace */
 	uint32_t lbasize;		/* external LBA size */
 	uint32_t nfree;			/* available flog entries */
+	uint64_t arena_size;		/* size of a full arena */
 	uint64_t nlba;			/* total number of external LBAs */
 	unsigned narena;		/* number of arenas */
 
@@ -208,24 +220,51 @@ struct btt {
 			struct btt_flog flog;	/* current info */
 			uint64_t entries[2];	/* offsets for flog pair */
 			int next;		/* next write (0 or 1) */
+			uint64_t free_epoch;	/* epoch old_map was freed in */
 		} *flogs;
 
 		/*
 		 * Read tracking table.  Indexed by lane.
 		 *
 		 * Before using a free block found in the flog, the write path
-		 * scans the rtt to see if there are any outstanding reads on
+		 * checks the rtt to see if there are any outstanding reads on
 		 * that block (reads that started before the block was freed by
 		 * a concurrent write).  Unused slots in the rtt are indicated
 		 * by setting the error bit, BTT_MAP_ENTRY_ERROR, so that the
-		 * entry won't match any post-map LBA when checked.
+		 * entry won't match any post-map LBA when checked.  A read
+		 * which hasn't looked up the map yet is marked as
+		 * BTT_RTT_PENDING.
+		 *
+		 * To avoid scanning the whole rtt on every write, each read
+		 * also records the arena epoch in which it started, in repoch
+		 * (0 when the lane isn't reading), and each write freeing a
+		 * block advances the epoch.  A read can only be using a block
+		 * freed in an epoch not older than its own, so once all the
+		 * reads in progress are known to have started later than the
+		 * block was freed (safe_epoch), the block is reused without
+		 * looking at the rtt at all.
 		 */
 		uint32_t volatile *rtt;
+		uint64_t volatile *repoch;
+		uint64_t volatile epoch;
+		uint64_t volatile safe_epoch;
 
 		/*
-		 * Map locking.  Indexed by pre-map LBA modulo nlane.
+		 * Map locking.  Indexed by map cache line modulo nmap_locks.
 		 */
 		pthread_mutex_t *map_locks;
+		uint32_t nmap_locks;
+
+		/*
+		 * Volatile copy of the map, in host byte order, indexed by
+		 * pre-map LBA.  NULL unless the map cache is enabled.
+		 *
+		 * The persistent map stays authoritative: map updates are
+		 * written to the namespace first and then mirrored here,
+		 * while still holding the map lock.  Lookups are served
+		 * from this copy, avoiding a media read per block.
+		 */
+		uint32_t volatile *vmap;
 
 		/*
 		 * Arena info block locking.
@@ -244,6 +283,12 @@ struct btt {
 	 */
 	void *ns;
 	const struct ns_callback *ns_cbp;
+
+	/*
+	 * Zeroed out block of lbasize bytes, handed out by btt_read_map()
+	 * for blocks that read back as zeros.
+	 */
+	void *zero_block;
 };
 
 /*
@@ -253,6 +298,27 @@ struct btt {
  */
 static const char Sig[] = BTTINFO_SIG;
 
+/*
+ * rtt value of a read that hasn't looked up its map entry yet, it has
+ * the zero bit set only, so it doesn't match any post-map LBA.
+ */
+#define BTT_RTT_PENDING BTT_MAP_ENTRY_ZERO
+
+/*
+ * Number of threads setting up the arenas of a btt when its layout is read,
+ * set by btt_arena_threads_init().
+ */
+static unsigned Arena_nthreads = 1;
+
+/*
+ * Number of map locks of each arena, set by btt_map_locks_init().  Zero
+ * means one lock per free block, that is per lane.
+ */
+static unsigned Map_nlocks;
+
+/* number of map entries in a map cache line */
+#define BTT_MAP_LINE_NENTRIES (BTT_MAP_LOCK_ALIGN / BTT_MAP_ENTRY_SIZE)
+
 /*
  * Zeroed out flog entry, used when initializing the flog.
  */
@@ -728,8 +794,20 @@ build_rtt(struct btt *bttp, struct arena *arenap)
 		ERR("!Malloc for %d rtt entries", bttp->nfree);
 		return -1;
 	}
+	if ((arenap->repoch = Zalloc(bttp->nfree * sizeof(uint64_t)))
+							== NULL) {
+		ERR("!Malloc for %d rtt epochs", bttp->nfree);
+		return -1;
+	}
 	for (uint32_t lane = 0; lane < bttp->nfree; lane++)
 		arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+
+	/*
+	 * The blocks in the flog were freed before the pool was opened,
+	 * their free_epoch is 0.
+	 */
+	arenap->epoch = 1;
+	arenap->safe_epoch = 1;
 	__sync_synchronize();
 
 	return 0;
@@ -743,20 +821,54 @@ build_rtt(struct btt *bttp, struct arena *arenap)
 static int
 build_map_locks(struct btt *bttp, struct arena *arenap)
 {
+	uint32_t nlocks = Map_nlocks ? Map_nlocks : bttp->nfree;
+
 	if ((arenap->map_locks =
-			Malloc(bttp->nfree * sizeof(*arenap->map_locks)))
+			Malloc(nlocks * sizeof(*arenap->map_locks)))
 							== NULL) {
-		ERR("!Malloc for %d map_lock entries", bttp->nfree);
+		ERR("!Malloc for %d map_lock entries", nlocks);
 		return -1;
 	}
-	for (uint32_t lane = 0; lane < bttp->nfree; lane++)
-		util_mutex_init(&arenap->map_locks[lane], NULL);
+	for (uint32_t i = 0; i < nlocks; i++)
+		util_mutex_init(&arenap->map_locks[i], NULL);
+	arenap->nmap_locks = nlocks;
+
+	return 0;
+}
+
+/*
+ * build_vmap -- (internal) construct the volatile copy of the arena map
+ *
+ * Zero is returned on success, otherwise -1/errno.
+ */
+static int
+build_vmap(struct btt *bttp, unsigned lane, struct arena *arenap)
+{
+	LOG(3, "bttp %p lane %u arenap %p", bttp, lane, arenap);
+
+	size_t size = arenap->external_nlba * sizeof(uint32_t);
+	uint32_t *vmap = Malloc(size);
+	if (vmap == NULL) {
+		ERR("!Malloc for %u map entries", arenap->external_nlba);
+		return -1;
+	}
+
+	if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, vmap, size,
+					arenap->mapoff) < 0) {
+		Free(vmap);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < arenap->external_nlba; i++)
+		vmap[i] = le32toh(vmap[i]);
+
+	arenap->vmap = vmap;
 
 	return 0;
 }
 
 /*
- * read_arena -- (internal) load up an arena and build run-time state
+ * read_arena -- (internal) load up the info block of an arena
  *
  * Zero is returned on success, otherwise -1/errno.
  */
@@ -783,6 +895,25 @@ read_arena(struct btt *bttp, unsigned lane, uint64_t arena_off,
 	arenap->flogoff = arena_off + le64toh(info.flogoff);
 	arenap->nextoff = arena_off + le64toh(info.nextoff);
 
+	/* initialize the per arena info block lock */
+	util_mutex_init(&arenap->info_lock, NULL);
+
+	return 0;
+}
+
+/*
+ * setup_arena -- (internal) recover the flog of an arena and build the rest
+ *	of its run-time state
+ *
+ * The arenas don't share any run-time state, so this can be done for
+ * multiple arenas at the same time.  Zero is returned on success, otherwise
+ * -1/errno.
+ */
+static int
+setup_arena(struct btt *bttp, unsigned lane, struct arena *arenap)
+{
+	LOG(3, "bttp %p lane %u arenap %p", bttp, lane, arenap);
+
 	if (read_flogs(bttp, lane, arenap) < 0)
 		return -1;
 
@@ -792,8 +923,93 @@ read_arena(struct btt *bttp, unsigned lane, uint64_t arena_off,
 	if (build_map_locks(bttp, arenap) < 0)
 		return -1;
 
-	/* initialize the per arena info block lock */
-	util_mutex_init(&arenap->info_lock, NULL);
+	/* flog recovery is done, so the map can be copied now */
+	if (bttp->map_cache && build_vmap(bttp, lane, arenap) < 0)
+		return -1;
+
+	return 0;
+}
+
+struct arena_setup {
+	struct btt *bttp;
+	unsigned lane;
+	unsigned narena;
+	unsigned next; /* index of the next arena to be set up */
+	int err; /* set on the first failure */
+	int oerrno; /* errno of the first failure */
+};
+
+/*
+ * setup_arenas_worker -- (internal) sets up the arenas until there are none
+ *	left
+ */
+static void *
+setup_arenas_worker(void *arg)
+{
+	struct arena_setup *a = arg;
+	unsigned i;
+
+	while (a->err == 0 &&
+			(i = __sync_fetch_and_add(&a->next, 1)) < a->narena) {
+		if (setup_arena(a->bttp, a->lane, &a->bttp->arenas[i]) < 0) {
+			int oerrno = errno;
+			if (__sync_bool_compare_and_swap(&a->err, 0, 1))
+				a->oerrno = oerrno;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * setup_arenas -- (internal) sets up all the arenas using up to
+ *	Arena_nthreads threads
+ *
+ * Zero is returned on success, otherwise -1/errno.
+ */
+static int
+setup_arenas(struct btt *bttp, unsigned lane, unsigned narena)
+{
+	LOG(3, "bttp %p lane %u narena %u", bttp, lane, narena);
+
+	struct arena_setup a = {
+		.bttp = bttp,
+		.lane = lane,
+		.narena = narena,
+		.next = 0,
+		.err = 0,
+		.oerrno = 0
+	};
+
+	pthread_t threads[BTT_ARENA_THREADS_MAX];
+	int started[BTT_ARENA_THREADS_MAX];
+
+	unsigned nthreads = Arena_nthreads;
+	if (nthreads > narena)
+		nthreads = narena;
+
+	/* the calling thread sets up the arenas as well */
+	for (unsigned n = 1; n < nthreads; ++n) {
+		int ret = pthread_create(&threads[n], NULL,
+			setup_arenas_worker, &a);
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+		}
+		started[n] = ret == 0;
+	}
+
+	setup_arenas_worker(&a);
+
+	for (unsigned n = 1; n < nthreads; ++n) {
+		if (started[n])
+			pthread_join(threads[n], NULL);
+	}
+
+	if (a.err) {
+		errno = a.oerrno;
+		return -1;
+	}
 
 	return 0;
 }
@@ -894,6 +1110,13 @@ read_arenas(struct btt *bttp, unsigned lane, unsigned narena)
 		arenap++;
 	}
 
+	/*
+	 * Only the info blocks have to be read one after the other, to find
+	 * the arenas.  The flogs of all of them are then recovered at once.
+	 */
+	if (setup_arenas(bttp, lane, narena) < 0)
+		goto err;
+
 	bttp->laidout = 1;
 
 	return 0;
@@ -907,8 +1130,12 @@ err:
 				Free(bttp->arenas[i].flogs);
 			if (bttp->arenas[i].rtt)
 				Free((void *)bttp->arenas[i].rtt);
+			if (bttp->arenas[i].repoch)
+				Free((void *)bttp->arenas[i].repoch);
 			if (bttp->arenas[i].map_locks)
 				Free((void *)bttp->arenas[i].map_locks);
+			if (bttp->arenas[i].vmap)
+				Free((void *)bttp->arenas[i].vmap);
 		}
 		Free(bttp->arenas);
 		bttp->arenas = NULL;
@@ -1094,12 +1321,12 @@ write_layout(struct btt *bttp, unsigned lane, int write)
 
 	/*
 	 * The number of arenas is the number of full arena of
-	 * size BTT_MAX_ARENA that fit into rawsize and then, if
+	 * size arena_size that fit into rawsize and then, if
 	 * the remainder is at least BTT_MIN_SIZE in size, then
 	 * that adds one more arena.
 	 */
-	bttp->narena = (unsigned)(bttp->rawsize / BTT_MAX_ARENA);
-	if (bttp->rawsize % BTT_MAX_ARENA >= BTT_MIN_SIZE)
+	bttp->narena = (unsigned)(bttp->rawsize / bttp->arena_size);
+	if (bttp->rawsize % bttp->arena_size >= BTT_MIN_SIZE)
 		bttp->narena++;
 	LOG(4, "narena %u", bttp->narena);
 
@@ -1120,8 +1347,8 @@ write_layout(struct btt *bttp, unsigned lane, int write)
 		LOG(4, "layout arena %u", arena_num);
 
 		uint64_t arena_rawsize = rawsize;
-		if (arena_rawsize > BTT_MAX_ARENA) {
-			arena_rawsize = BTT_MAX_ARENA;
+		if (arena_rawsize > bttp->arena_size) {
+			arena_rawsize = bttp->arena_size;
 		}
 		rawsize -= arena_rawsize;
 		arena_num++;
@@ -1265,6 +1492,7 @@ read_layout(struct btt *bttp, unsigned lane)
 	uint64_t arena_off = 0;
 
 	bttp->nfree = BTT_DEFAULT_NFREE;
+	bttp->arena_size = BTT_MAX_ARENA;
 
 	/*
 	 * For each arena, see if there's a valid info block
@@ -1306,12 +1534,20 @@ read_layout(struct btt *bttp, unsigned lane)
 			return -1;
 		}
 
-		if (info.nextoff && (info.nextoff != BTT_MAX_ARENA)) {
+		/* all of the arenas but the last one have the same size */
+		if (info.nextoff && (info.nextoff < BTT_MIN_SIZE ||
+				info.nextoff > BTT_MAX_ARENA ||
+				info.nextoff % BTT_ALIGNMENT ||
+				(narena > 1 &&
+				info.nextoff != bttp->arena_size))) {
 			ERR("invalid arena size");
 			errno = EINVAL;
 			return -1;
 		}
 
+		if (info.nextoff)
+			bttp->arena_size = info.nextoff;
+
 		if (info.nfree < smallest_nfree)
 			smallest_nfree = info.nfree;
 
@@ -1336,8 +1572,7 @@ read_layout(struct btt *bttp, unsigned lane)
 	 * All arenas were valid.  nfree should be the smallest value found
 	 * among different arenas.
 	 */
-	if (smallest_nfree < bttp->nfree)
-		bttp->nfree = smallest_nfree;
+	bttp->nfree = smallest_nfree;
 
 	/*
 	 * Load up arenas.
@@ -1395,6 +1630,46 @@ lba_to_arena_lba(struct btt *bttp, uint64_t lba,
 	return 0;
 }
 
+/*
+ * btt_arena_threads_init -- reads the number of threads setting up the
+ *	arenas from the given environment variable
+ */
+void
+btt_arena_threads_init(const char *threads_var)
+{
+	char *e = getenv(threads_var);
+	if (e == NULL)
+		return;
+
+	long val = atol(e);
+	if (val < 1 || val > BTT_ARENA_THREADS_MAX) {
+		LOG(2, "Invalid %s", threads_var);
+	} else {
+		Arena_nthreads = (unsigned)val;
+		LOG(3, "%s set to %u", threads_var, Arena_nthreads);
+	}
+}
+
+/*
+ * btt_map_locks_init -- reads the number of map locks of each arena from
+ *	the given environment variable
+ */
+void
+btt_map_locks_init(const char *locks_var)
+{
+	char *e = getenv(locks_var);
+	if (e == NULL)
+		return;
+
+	long val = atol(e);
+	if (val < 1 || val > BTT_MAP_LOCKS_MAX) {
+		LOG(2, "Invalid %s", locks_var);
+	} else {
+		Map_nlocks = (unsigned)val;
+		LOG(3, "%s set to %u", locks_var, Map_nlocks);
+	}
+}
+
 /*
  * btt_init -- prepare a btt namespace for use, returning an opaque handle
  *
@@ -1425,6 +1700,12 @@ btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 		return NULL;
 	}
 
+	if ((bttp->zero_block = Zalloc(lbasize)) == NULL) {
+		ERR("!Malloc %u bytes", lbasize);
+		Free(bttp);
+		return NULL;
+	}
+
 	util_mutex_init(&bttp->layout_write_mutex, NULL);
 	memcpy(bttp->parent_uuid, parent_uuid, BTTINFO_UUID_LEN);
 	bttp->rawsize = rawsize;
@@ -1447,6 +1728,7 @@ btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 		return NULL;
 	}
 
+	bttp->maxlane = maxlane;
 	bttp->nlane = bttp->nfree;
 
 	/* maxlane, if provided, is an upper bound on nlane */
@@ -1457,6 +1739,76 @@ btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 	return bttp;
 }
 
+/*
+ * btt_format -- write out the layout of a btt namespace with the given
+ *	arena size and number of free blocks per arena
+ *
+ * Zero arena_size or nfree selects the default.  Must be called before the
+ * lanes are handed out, as the number of lanes may change.  Fails with
+ * EEXIST if the namespace already has a layout.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_format(struct btt *bttp, unsigned lane, uint64_t arena_size,
+		uint32_t nfree)
+{
+	LOG(3, "bttp %p lane %u arena_size %ju nfree %u",
+			bttp, lane, arena_size, nfree);
+
+	if (arena_size == 0)
+		arena_size = BTT_MAX_ARENA;
+	if (nfree == 0)
+		nfree = BTT_DEFAULT_NFREE;
+
+	arena_size &= ~(BTT_ALIGNMENT - 1);
+	if (arena_size < BTT_MIN_SIZE || arena_size > BTT_MAX_ARENA) {
+		ERR("invalid arena size %ju", arena_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (nfree > BTT_NFREE_MAX) {
+		ERR("invalid number of free blocks %u", nfree);
+		errno = EINVAL;
+		return -1;
+	}
+
+	util_mutex_lock(&bttp->layout_write_mutex);
+
+	if (bttp->laidout) {
+		util_mutex_unlock(&bttp->layout_write_mutex);
+		ERR("btt layout already exists");
+		errno = EEXIST;
+		return -1;
+	}
+
+	bttp->arena_size = arena_size;
+	bttp->nfree = nfree;
+
+	int err = write_layout(bttp, lane, 1);
+	if (err < 0) {
+		/* fall back to the default layout written on first write */
+		int oerrno = errno;
+		bttp->arena_size = BTT_MAX_ARENA;
+		bttp->nfree = BTT_DEFAULT_NFREE;
+		write_layout(bttp, lane, 0);
+		errno = oerrno;
+	}
+
+	util_mutex_unlock(&bttp->layout_write_mutex);
+
+	if (err < 0)
+		return -1;
+
+	bttp->nlane = bttp->nfree;
+	if (bttp->maxlane && bttp->nlane > bttp->maxlane)
+		bttp->nlane = bttp->maxlane;
+
+	LOG(3, "nlane %u narena %u", bttp->nlane, bttp->narena);
+	return 0;
+}
+
 /*
  * btt_nlane -- return the number of "lanes" for this btt namespace
  *
@@ -1487,31 +1839,113 @@ btt_nlba(struct btt *bttp)
 }
 
 /*
- * btt_read -- read a block from a btt namespace
+ * btt_map_cache -- keep a volatile copy of the map of each arena
+ *
+ * Map lookups of btt_read() and btt_write() are served from DRAM
+ * afterwards, while map updates are still written to the namespace
+ * before they are mirrored.  The copies take 4 bytes per LBA.  Must be
+ * called before any I/O is done on the btt.
  *
  * Returns 0 on success, otherwise -1/errno.
  */
 int
-btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
+btt_map_cache(struct btt *bttp)
 {
-	LOG(3, "bttp %p lane %u lba %ju", bttp, lane, lba);
+	LOG(3, "bttp %p", bttp);
 
-	if (invalid_lba(bttp, lba))
-		return -1;
+	int ret = 0;
 
-	/* if there's no layout written yet, all reads come back as zeros */
-	if (!bttp->laidout)
-		return zero_block(bttp, buf);
+	util_mutex_lock(&bttp->layout_write_mutex);
 
-	/* find which arena LBA lives in, and the offset to the map entry */
-	struct arena *arenap;
-	uint32_t premap_lba;
-	uint64_t map_entry_off;
-	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+	bttp->map_cache = 1;
+
+	if (bttp->laidout) {
+		for (unsigned i = 0; i < bttp->narena; i++) {
+			if (build_vmap(bttp, 0, &bttp->arenas[i]) < 0) {
+				ret = -1;
+				break;
+			}
+		}
+	}
+
+	if (ret < 0) {
+		bttp->map_cache = 0;
+		for (unsigned i = 0; i < bttp->narena; i++) {
+			if (bttp->arenas[i].vmap) {
+				Free((void *)bttp->arenas[i].vmap);
+				bttp->arenas[i].vmap = NULL;
+			}
+		}
+	}
+
+	util_mutex_unlock(&bttp->layout_write_mutex);
+
+	return ret;
+}
+
+/*
+ * map_entry_read -- (internal) read a map entry in host byte order
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static inline int
+map_entry_read(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t premap_lba, uint32_t *entryp)
+{
+	if (arenap->vmap) {
+		*entryp = arenap->vmap[premap_lba];
+		return 0;
+	}
+
+	uint64_t map_entry_off =
+		arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
+
+	if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, entryp,
+				sizeof(uint32_t), map_entry_off) < 0)
 		return -1;
 
-	/* convert pre-map LBA into an offset into the map */
-	map_entry_off = arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
+	*entryp = le32toh(*entryp);
+	return 0;
+}
+
+/*
+ * read_done -- (internal) mark the end of a read in the read tracking table
+ */
+static inline void
+read_done(struct arena *arenap, unsigned lane)
+{
+	arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+	arenap->repoch[lane] = 0;
+}
+
+/*
+ * read_map_entry -- (internal) read a map entry and protect its block
+ *
+ * Looks up the current map entry of the given pre-map LBA.  Unless the
+ * entry is an error, zero or initial entry, the post-map LBA is recorded
+ * in the read tracking table of the lane, which prevents the block from
+ * being re-allocated by a concurrent write until read_done() is called
+ * by the caller.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static int
+read_map_entry(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t premap_lba, uint32_t *entryp)
+{
+	LOG(3, "bttp %p lane %u arenap %p premap_lba %u",
+			bttp, lane, arenap, premap_lba);
+
+	/*
+	 * Announce the read before looking up the map.  A write which
+	 * frees a block does so by updating the map before advancing the
+	 * epoch, so the map entry read below either still points to a block
+	 * freed in an epoch not older than ours, which the write reusing it
+	 * will find in the rtt, or to a block which isn't free.
+	 */
+	arenap->rtt[lane] = BTT_RTT_PENDING;
+	arenap->repoch[lane] = arenap->epoch;
+	__sync_synchronize();
 
 	/*
 	 * Read the current map entry to get the post-map LBA for the data
@@ -1519,26 +1953,21 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 	 */
 	uint32_t entry;
 
-	if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, &entry,
-				sizeof(entry), map_entry_off) < 0)
+	if (map_entry_read(bttp, lane, arenap, premap_lba, &entry) < 0) {
+		read_done(arenap, lane);
 		return -1;
+	}
 
-	entry = le32toh(entry);
-
-	/*
-	 * Retries come back to the top of this loop (for a rare case where
-	 * the map is changed by another thread doing writes to the same LBA).
-	 */
-	while (1) {
-		if (map_entry_is_error(entry)) {
-			ERR("EIO due to map entry error flag");
-			errno = EIO;
-			return -1;
-		}
-
-		if (map_entry_is_zero_or_initial(entry))
-			return zero_block(bttp, buf);
+	if (map_entry_is_error(entry)) {
+		read_done(arenap, lane);
+		ERR("EIO due to map entry error flag");
+		errno = EIO;
+		return -1;
+	}
 
+	if (map_entry_is_zero_or_initial(entry)) {
+		read_done(arenap, lane);
+	} else {
 		/*
 		 * Record the post-map LBA in the read tracking table during
 		 * the read.  The write will check entries in the read tracking
@@ -1553,30 +1982,41 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 		 * both set.
 		 */
 		arenap->rtt[lane] = entry;
-		__sync_synchronize();
+	}
 
-		/*
-		 * In case this thread was preempted between reading entry and
-		 * storing it in the rtt, check to see if the map changed.  If
-		 * it changed, the block about to be read is at least free now
-		 * (in the flog, but that's okay since the data will still be
-		 * undisturbed) and potentially allocated and being used for
-		 * another write (data disturbed, so not okay to continue).
-		 */
-		uint32_t latest_entry;
-		if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, &latest_entry,
-				sizeof(latest_entry), map_entry_off) < 0) {
-			arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
-			return -1;
-		}
+	*entryp = entry;
+	return 0;
+}
+
+/*
+ * btt_read -- read a block from a btt namespace
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
+{
+	LOG(3, "bttp %p lane %u lba %ju", bttp, lane, lba);
 
-		latest_entry = le32toh(latest_entry);
+	if (invalid_lba(bttp, lba))
+		return -1;
 
-		if (entry == latest_entry)
-			break;			/* map stayed the same */
-		else
-			entry = latest_entry;	/* try again */
-	}
+	/* if there's no layout written yet, all reads come back as zeros */
+	if (!bttp->laidout)
+		return zero_block(bttp, buf);
+
+	/* find which arena LBA lives in, and the offset to the map entry */
+	struct arena *arenap;
+	uint32_t premap_lba;
+	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+		return -1;
+
+	uint32_t entry;
+	if (read_map_entry(bttp, lane, arenap, premap_lba, &entry) < 0)
+		return -1;
+
+	if (map_entry_is_zero_or_initial(entry))
+		return zero_block(bttp, buf);
 
 	/*
 	 * It is safe to read the block now, since the rtt protects the
@@ -1589,11 +2029,104 @@ btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf)
 					bttp->lbasize, data_block_off);
 
 	/* done with read, so clear out rtt entry */
-	arenap->rtt[lane] = BTT_MAP_ENTRY_ERROR;
+	read_done(arenap, lane);
 
 	return readret;
 }
 
+/*
+ * btt_read_map -- map a block of a btt namespace for reading in place
+ *
+ * On success *addrp points to the lbasize bytes of the block.  The block
+ * stays protected from being re-allocated by concurrent writes until
+ * btt_read_unmap() is called for the same lane, so the lane must not be
+ * used for anything else in the meantime.  The mapping must not be
+ * written to.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_read_map(struct btt *bttp, unsigned lane, uint64_t lba,
+		const void **addrp)
+{
+	LOG(3, "bttp %p lane %u lba %ju", bttp, lane, lba);
+
+	if (invalid_lba(bttp, lba))
+		return -1;
+
+	/* if there's no layout written yet, all reads come back as zeros */
+	if (!bttp->laidout) {
+		*addrp = bttp->zero_block;
+		return 0;
+	}
+
+	struct arena *arenap;
+	uint32_t premap_lba;
+	if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+		return -1;
+
+	uint32_t entry;
+	if (read_map_entry(bttp, lane, arenap, premap_lba, &entry) < 0)
+		return -1;
+
+	if (map_entry_is_zero_or_initial(entry)) {
+		*addrp = bttp->zero_block;
+		return 0;
+	}
+
+	uint64_t data_block_off =
+		arenap->dataoff + (uint64_t)(entry & BTT_MAP_ENTRY_LBA_MASK) *
+		arenap->internal_lbasize;
+	void *addr;
+	ssize_t len = (*bttp->ns_cbp->nsmap)(bttp->ns, lane, &addr,
+					bttp->lbasize, data_block_off);
+	if (len < (ssize_t)bttp->lbasize) {
+		if (len >= 0) {
+			ERR("block not mapped contiguously");
+			errno = ENOTSUP;
+		}
+		read_done(arenap, lane);
+		return -1;
+	}
+
+	*addrp = addr;
+	return 0;
+}
+
+/*
+ * btt_read_unmap -- release a block mapped by btt_read_map()
+ *
+ * A lane tracks at most one read at a time, so clearing the lane's rtt
+ * slot in every arena releases the block without having to look up
+ * the arena it lives in again.
+ */
+void
+btt_read_unmap(struct btt *bttp, unsigned lane)
+{
+	LOG(3, "bttp %p lane %u", bttp, lane);
+
+	if (!bttp->laidout)
+		return;
+
+	for (unsigned i = 0; i < bttp->narena; i++)
+		read_done(&bttp->arenas[i], lane);
+}
+
+/*
+ * map_lock_get -- (internal) return the lock protecting a map entry
+ *
+ * map_locks[] contains nmap_locks locks which are used to protect the map
+ * from concurrent access to the same cache line.  The index into map_locks[]
+ * is the number of the map cache line holding the entry (BTT_MAP_LOCK_ALIGN
+ * bytes per line) modulo nmap_locks.
+ */
+static inline pthread_mutex_t *
+map_lock_get(struct arena *arenap, uint32_t premap_lba)
+{
+	return &arenap->map_locks[premap_lba / BTT_MAP_LINE_NENTRIES %
+			arenap->nmap_locks];
+}
+
 /*
  * map_lock -- (internal) grab the map_lock and read a map entry
  */
@@ -1604,28 +2137,17 @@ map_lock(struct btt *bttp, unsigned lane, struct arena *arenap,
 	LOG(3, "bttp %p lane %u arenap %p premap_lba %u",
 			bttp, lane, arenap, premap_lba);
 
-	uint64_t map_entry_off =
-			arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
-
-	/*
-	 * map_locks[] contains nfree locks which are used to protect the map
-	 * from concurrent access to the same cache line.  The index into
-	 * map_locks[] is calculated by looking at the byte offset into the map
-	 * (premap_lba * BTT_MAP_ENTRY_SIZE), figuring out how many cache lines
-	 * that is into the map that is (dividing by BTT_MAP_LOCK_ALIGN), and
-	 * then selecting one of nfree locks (the modulo at the end).
-	 */
-	uint32_t map_lock_num = premap_lba * BTT_MAP_ENTRY_SIZE /
-			BTT_MAP_LOCK_ALIGN % bttp->nfree;
-	util_mutex_lock(&arenap->map_locks[map_lock_num]);
+	pthread_mutex_t *lock = map_lock_get(arenap, premap_lba);
+	util_mutex_lock(lock);
 
 	/* read the old map entry */
-	if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, entryp,
-				sizeof(uint32_t), map_entry_off) < 0) {
-		util_mutex_unlock(&arenap->map_locks[map_lock_num]);
+	if (map_entry_read(bttp, lane, arenap, premap_lba, entryp) < 0) {
+		util_mutex_unlock(lock);
 		return -1;
 	}
 
+	*entryp = htole32(*entryp);
+
 	/* if map entry is in its initial state return premap_lba */
 	if (map_entry_is_initial(*entryp))
 		*entryp = htole32(premap_lba | BTT_MAP_ENTRY_NORMAL);
@@ -1648,9 +2170,7 @@ map_abort(struct btt *bttp, unsigned lane, struct arena *arenap,
 	LOG(3, "bttp %p lane %u arenap %p premap_lba %u",
 			bttp, lane, arenap, premap_lba);
 
-	uint32_t map_lock_num = premap_lba * BTT_MAP_ENTRY_SIZE /
-			BTT_MAP_LOCK_ALIGN % bttp->nfree;
-	util_mutex_unlock(&arenap->map_locks[map_lock_num]);
+	util_mutex_unlock(map_lock_get(arenap, premap_lba));
 }
 
 /*
@@ -1670,11 +2190,11 @@ map_unlock(struct btt *bttp, unsigned lane, struct arena *arenap,
 	int err = (*bttp->ns_cbp->nswrite)(bttp->ns, lane, &entry,
 				sizeof(uint32_t), map_entry_off);
 
-	uint32_t map_lock_num =
-			premap_lba * BTT_MAP_ENTRY_SIZE / BTT_MAP_LOCK_ALIGN
-			% bttp->nfree;
+	/* the persistent map is updated, mirror it in the volatile copy */
+	if (err == 0 && arenap->vmap)
+		arenap->vmap[premap_lba] = le32toh(entry);
 
-	util_mutex_unlock(&arenap->map_locks[map_lock_num]);
+	util_mutex_unlock(map_lock_get(arenap, premap_lba));
 
 	LOG(9, "unlocked map[%d]: %u%s%s", premap_lba,
 			entry & BTT_MAP_ENTRY_LBA_MASK,
@@ -1684,6 +2204,57 @@ map_unlock(struct btt *bttp, unsigned lane, struct arena *arenap,
 	return err;
 }
 
+/*
+ * rtt_wait -- (internal) wait for the reads of the free block of a lane
+ *
+ * If all the reads in progress are known to have started after the free
+ * block was freed, none of them can be using it and the rtt isn't looked
+ * at.  Otherwise the rtt is scanned, waiting only for the reads started
+ * early enough which are using the free block or haven't looked up the
+ * map yet, and the lower bound of the epochs of the reads in progress is
+ * advanced for the following writes.
+ */
+static void
+rtt_wait(struct btt *bttp, struct arena *arenap, unsigned lane,
+		uint32_t free_entry)
+{
+	uint64_t free_epoch = arenap->flogs[lane].free_epoch;
+
+	if (free_epoch < arenap->safe_epoch)
+		return;
+
+	/*
+	 * The reads announced after this point start in this epoch or
+	 * later, so it bounds their epochs.
+	 */
+	uint64_t bound = arenap->epoch;
+	__sync_synchronize();
+
+	for (unsigned i = 0; i < bttp->nlane; i++) {
+		uint64_t e = arenap->repoch[i];
+		if (e == 0)
+			continue;
+
+		if (e <= free_epoch) {
+			uint32_t r;
+			while (arenap->repoch[i] == e &&
+				((r = arenap->rtt[i]) == free_entry ||
+				r == BTT_RTT_PENDING))
+				;
+		}
+
+		if (e < bound)
+			bound = e;
+	}
+
+	/*
+	 * A stale bound is still a valid one, since the epochs of the reads
+	 * only grow, so concurrent updates don't need to be ordered.
+	 */
+	if (bound > arenap->safe_epoch)
+		arenap->safe_epoch = bound;
+}
+
 /*
  * btt_write -- write a block to a btt namespace
  *
@@ -1694,6 +2265,8 @@ btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
 {
 	LOG(3, "bttp %p lane %u lba %ju", bttp, lane, lba);
 
+	USDT_PROBE2(libpmemblk, btt_write, lane, lba);
+
 	if (invalid_lba(bttp, lba))
 		return -1;
 
@@ -1742,9 +2315,7 @@ btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
 				arenap->flogs[lane].flog.old_map);
 
 	/* wait for other threads to finish any reads on free block */
-	for (unsigned i = 0; i < bttp->nlane; i++)
-		while (arenap->rtt[i] == free_entry)
-			;
+	rtt_wait(bttp, arenap, lane, free_entry);
 
 	/* it is now safe to perform write to the free block */
 	uint64_t data_block_off = arenap->dataoff +
@@ -1782,6 +2353,15 @@ btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf)
 		return -1;
 	}
 
+	/*
+	 * The old block is no longer reachable through the map, only the
+	 * reads which started before now may still be using it.
+	 */
+	arenap->flogs[lane].free_epoch =
+		__sync_fetch_and_add(&arenap->epoch, 1);
+
+	USDT_PROBE2(libpmemblk, btt_write_done, lane, lba);
+
 	return 0;
 }
 
@@ -1877,6 +2457,143 @@ btt_set_zero(struct btt *bttp, unsigned lane, uint64_t lba)
 	return map_entry_setf(bttp, lane, lba, BTT_MAP_ENTRY_ZERO);
 }
 
+/*
+ * zero_range_arena -- (internal) mark a range of pre-map LBAs of an arena
+ *	as zeroed
+ *
+ * The map entries are updated one map cache line at a time, under its map
+ * lock, with a single write (and so a single persist) for all the entries
+ * of the cache line that have to change.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+static int
+zero_range_arena(struct btt *bttp, unsigned lane, struct arena *arenap,
+		uint32_t premap_lba, uint32_t count)
+{
+	LOG(3, "bttp %p lane %u arenap %p premap_lba %u count %u",
+			bttp, lane, arenap, premap_lba, count);
+
+	/* if the arena is in an error state, writing is not allowed */
+	if (arenap->flags & BTTINFO_FLAG_ERROR_MASK) {
+		ERR("EIO due to btt_info error flags 0x%x",
+			arenap->flags & BTTINFO_FLAG_ERROR_MASK);
+		errno = EIO;
+		return -1;
+	}
+
+	uint32_t entries[BTT_MAP_LINE_NENTRIES];
+
+	while (count > 0) {
+		/* entries up to the end of this map cache line */
+		uint32_t n = BTT_MAP_LINE_NENTRIES -
+			premap_lba % BTT_MAP_LINE_NENTRIES;
+		if (n > count)
+			n = count;
+
+		uint64_t map_entry_off =
+			arenap->mapoff + BTT_MAP_ENTRY_SIZE * premap_lba;
+		pthread_mutex_t *lock = map_lock_get(arenap, premap_lba);
+
+		util_mutex_lock(lock);
+
+		if ((*bttp->ns_cbp->nsread)(bttp->ns, lane, entries,
+				n * BTT_MAP_ENTRY_SIZE, map_entry_off) < 0) {
+			util_mutex_unlock(lock);
+			return -1;
+		}
+
+		/* the span of the entries which have to be updated */
+		uint32_t first = n;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t entry = le32toh(entries[i]);
+			if (map_entry_is_zero_or_initial(entry))
+				continue;
+
+			entries[i] = htole32((entry & BTT_MAP_ENTRY_LBA_MASK) |
+					BTT_MAP_ENTRY_ZERO);
+			if (first == n)
+				first = i;
+			last = i;
+		}
+
+		int err = 0;
+		if (first < n) {
+			err = (*bttp->ns_cbp->nswrite)(bttp->ns, lane,
+				&entries[first],
+				(last - first + 1) * BTT_MAP_ENTRY_SIZE,
+				map_entry_off + first * BTT_MAP_ENTRY_SIZE);
+
+			if (err == 0 && arenap->vmap) {
+				for (uint32_t i = first; i <= last; i++)
+					arenap->vmap[premap_lba + i] =
+						le32toh(entries[i]);
+			}
+		}
+
+		util_mutex_unlock(lock);
+
+		if (err < 0)
+			return -1;
+
+		premap_lba += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * btt_set_zero_range -- mark a range of blocks as zeroed in a btt namespace
+ *
+ * Equivalent to calling btt_set_zero() for each of the count blocks
+ * starting at lba, but the map is updated in bulk and persisted once per
+ * cache line.  Each block is zeroed atomically, the range as a whole
+ * isn't.
+ *
+ * Returns 0 on success, otherwise -1/errno.
+ */
+int
+btt_set_zero_range(struct btt *bttp, unsigned lane, uint64_t lba,
+		uint64_t count)
+{
+	LOG(3, "bttp %p lane %u lba %ju count %ju", bttp, lane, lba, count);
+
+	if (count == 0)
+		return 0;
+
+	if (lba >= bttp->nlba || count > bttp->nlba - lba) {
+		ERR("lba range out of range (nlba %ju)", bttp->nlba);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* no layout is written yet, all blocks read as zero */
+	if (!bttp->laidout)
+		return 0;
+
+	while (count > 0) {
+		struct arena *arenap;
+		uint32_t premap_lba;
+		if (lba_to_arena_lba(bttp, lba, &arenap, &premap_lba) < 0)
+			return -1;
+
+		uint64_t n = arenap->external_nlba - premap_lba;
+		if (n > count)
+			n = count;
+
+		if (zero_range_arena(bttp, lane, arenap, premap_lba,
+				(uint32_t)n) < 0)
+			return -1;
+
+		lba += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
 /*
  * btt_set_error -- mark a block as in an error state in a btt namespace
  *
@@ -2060,10 +2777,15 @@ btt_fini(struct btt *bttp)
 				Free(bttp->arenas[i].flogs);
 			if (bttp->arenas[i].rtt)
 				Free((void *)bttp->arenas[i].rtt);
+			if (bttp->arenas[i].repoch)
+				Free((void *)bttp->arenas[i].repoch);
 			if (bttp->arenas[i].rtt)
 				Free((void *)bttp->arenas[i].map_locks);
+			if (bttp->arenas[i].vmap)
+				Free((void *)bttp->arenas[i].vmap);
 		}
 		Free(bttp->arenas);
 	}
+	Free(bttp->zero_block);
 	Free(bttp);
 }
@@ -50,13 +50,34 @@ struct ns_callback {
 
 struct btt_info;
 
+/* upper bound on the number of threads setting up the arenas */
+#define BTT_ARENA_THREADS_MAX 64
+
+void btt_arena_threads_init(const char *threads_var);
+
+/* upper bound on the number of map locks of an arena */
+#define BTT_MAP_LOCKS_MAX (1 << 20)
+
+void btt_map_locks_init(const char *locks_var);
+
+/* upper bound on the number of free blocks of an arena */
+#define BTT_NFREE_MAX 65536
+
 struct btt *btt_init(uint64_t rawsize, uint32_t lbasize, uint8_t parent_uuid[],
 		unsigned maxlane, void *ns, const struct ns_callback *ns_cbp);
 unsigned btt_nlane(struct btt *bttp);
 size_t btt_nlba(struct btt *bttp);
+int btt_map_cache(struct btt *bttp);
+int btt_format(struct btt *bttp, unsigned lane, uint64_t arena_size,
+	uint32_t nfree);
 int btt_read(struct btt *bttp, unsigned lane, uint64_t lba, void *buf);
+int btt_read_map(struct btt *bttp, unsigned lane, uint64_t lba,
+	const void **addrp);
+void btt_read_unmap(struct btt *bttp, unsigned lane);
 int btt_write(struct btt *bttp, unsigned lane, uint64_t lba, const void *buf);
 int btt_set_zero(struct btt *bttp, unsigned lane, uint64_t lba);
+int btt_set_zero_range(struct btt *bttp, unsigned lane, uint64_t lba,
+	uint64_t count);
 int btt_set_error(struct btt *bttp, unsigned lane, uint64_t lba);
 int btt_check(struct btt *bttp);
 void btt_fini(struct btt *bttp);
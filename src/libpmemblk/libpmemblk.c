@@ -55,6 +55,7 @@ libpmemblk_init(void)
 			PMEMBLK_LOG_FILE_VAR, PMEMBLK_MAJOR_VERSION,
 			PMEMBLK_MINOR_VERSION);
 	LOG(3, NULL);
+	blk_init();
 }
 
 /*
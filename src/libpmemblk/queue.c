@@ -0,0 +1,333 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue.c -- asynchronous block I/O queues
+ *
+ * Requests submitted to a queue are put on the submission ring, from which
+ * the worker threads of the queue take them in batches.  A worker carries out
+ * a whole batch under a single lane and then moves the requests to the
+ * completion ring, where they wait to be picked up by pmemblk_queue_poll().
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "libpmemblk.h"
+
+#include "out.h"
+#include "util.h"
+#include "btt.h"
+#include "blk.h"
+#include "queue.h"
+#include "sys_util.h"
+
+/*
+ * queue_run -- (internal) carry out a single request
+ */
+static int
+queue_run(PMEMblkpool *pbp, unsigned lane, struct pmemblk_io *io)
+{
+	if (io->blockno < 0) {
+		ERR("negative block number");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (io->opcode != PMEMBLK_IO_READ && pbp->rdonly) {
+		ERR("EROFS (pool is read-only)");
+		errno = EROFS;
+		return -1;
+	}
+
+	switch (io->opcode) {
+	case PMEMBLK_IO_READ:
+		return btt_read(pbp->bttp, lane, (uint64_t)io->blockno,
+				io->buf);
+	case PMEMBLK_IO_WRITE:
+		return btt_write(pbp->bttp, lane, (uint64_t)io->blockno,
+				io->buf);
+	case PMEMBLK_IO_SET_ZERO:
+		return btt_set_zero(pbp->bttp, lane, (uint64_t)io->blockno);
+	default:
+		ERR("invalid opcode %d", io->opcode);
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+/*
+ * queue_run_batch -- (internal) carry out a batch of requests
+ */
+static void
+queue_run_batch(PMEMblkqueue *q, struct pmemblk_io **ios, unsigned n)
+{
+	unsigned lane;
+
+	lane_enter(q->pbp, &lane);
+
+	for (unsigned i = 0; i < n; ++i)
+		ios[i]->error = queue_run(q->pbp, lane, ios[i]) ? errno : 0;
+
+	lane_exit(q->pbp, lane);
+}
+
+/*
+ * queue_worker -- (internal) worker thread of a queue
+ *
+ * The pending requests are split evenly between the workers, up to
+ * QUEUE_BATCH_MAX per batch.  The worker exits once the queue is being
+ * deleted and there is nothing left to do.
+ */
+static void *
+queue_worker(void *arg)
+{
+	PMEMblkqueue *q = arg;
+	struct pmemblk_io *batch[QUEUE_BATCH_MAX];
+
+	util_mutex_lock(&q->lock);
+
+	for (;;) {
+		while (q->sq_count == 0 && !q->stop)
+			pthread_cond_wait(&q->sq_cond, &q->lock);
+
+		if (q->sq_count == 0)
+			break;
+
+		unsigned n = (q->sq_count + q->nthreads - 1) / q->nthreads;
+		if (n > QUEUE_BATCH_MAX)
+			n = QUEUE_BATCH_MAX;
+
+		for (unsigned i = 0; i < n; ++i)
+			batch[i] = q->sq[(q->sq_head + i) % q->depth];
+		q->sq_head = (q->sq_head + n) % q->depth;
+		q->sq_count -= n;
+
+		util_mutex_unlock(&q->lock);
+
+		queue_run_batch(q, batch, n);
+
+		util_mutex_lock(&q->lock);
+
+		for (unsigned i = 0; i < n; ++i) {
+			unsigned tail = (q->cq_head + q->cq_count) % q->depth;
+			q->cq[tail] = batch[i];
+			q->cq_count++;
+		}
+
+		pthread_cond_broadcast(&q->cq_cond);
+	}
+
+	util_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+/*
+ * queue_stop -- (internal) wait for the worker threads to finish
+ */
+static void
+queue_stop(PMEMblkqueue *q)
+{
+	util_mutex_lock(&q->lock);
+	q->stop = 1;
+	pthread_cond_broadcast(&q->sq_cond);
+	util_mutex_unlock(&q->lock);
+
+	for (unsigned i = 0; i < q->nthreads; ++i)
+		pthread_join(q->threads[i], NULL);
+}
+
+/*
+ * pmemblk_queue_new -- create a queue for asynchronous block I/O
+ */
+PMEMblkqueue *
+pmemblk_queue_new(PMEMblkpool *pbp, unsigned depth, unsigned nthreads)
+{
+	LOG(3, "pbp %p depth %u nthreads %u", pbp, depth, nthreads);
+
+	if (depth == 0 || nthreads == 0) {
+		ERR("invalid queue depth %u or number of threads %u",
+			depth, nthreads);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	int err;
+	PMEMblkqueue *q = Zalloc(sizeof(*q));
+	if (q == NULL) {
+		ERR("!Zalloc");
+		return NULL;
+	}
+
+	q->pbp = pbp;
+	q->depth = depth;
+
+	q->sq = Malloc(depth * sizeof(*q->sq));
+	q->cq = Malloc(depth * sizeof(*q->cq));
+	q->threads = Malloc(nthreads * sizeof(*q->threads));
+	if (q->sq == NULL || q->cq == NULL || q->threads == NULL) {
+		err = errno;
+		ERR("!Malloc");
+		goto err_malloc;
+	}
+
+	util_mutex_init(&q->lock, NULL);
+	if ((err = pthread_cond_init(&q->sq_cond, NULL))) {
+		errno = err;
+		ERR("!pthread_cond_init");
+		goto err_sq_cond;
+	}
+	if ((err = pthread_cond_init(&q->cq_cond, NULL))) {
+		errno = err;
+		ERR("!pthread_cond_init");
+		goto err_cq_cond;
+	}
+
+	for (; q->nthreads < nthreads; q->nthreads++) {
+		err = pthread_create(&q->threads[q->nthreads], NULL,
+				queue_worker, q);
+		if (err) {
+			errno = err;
+			ERR("!pthread_create");
+			goto err_thread;
+		}
+	}
+
+	return q;
+
+err_thread:
+	queue_stop(q);
+	pthread_cond_destroy(&q->cq_cond);
+err_cq_cond:
+	pthread_cond_destroy(&q->sq_cond);
+err_sq_cond:
+	util_mutex_destroy(&q->lock);
+err_malloc:
+	Free(q->threads);
+	Free(q->cq);
+	Free(q->sq);
+	Free(q);
+	errno = err;
+	return NULL;
+}
+
+/*
+ * pmemblk_queue_delete -- wait for the submitted requests and free the queue
+ */
+void
+pmemblk_queue_delete(PMEMblkqueue *q)
+{
+	LOG(3, "q %p", q);
+
+	queue_stop(q);
+
+	pthread_cond_destroy(&q->cq_cond);
+	pthread_cond_destroy(&q->sq_cond);
+	util_mutex_destroy(&q->lock);
+	Free(q->threads);
+	Free(q->cq);
+	Free(q->sq);
+	Free(q);
+}
+
+/*
+ * pmemblk_queue_submit -- submit requests for asynchronous execution
+ *
+ * Returns the number of requests accepted, which is limited by the room
+ * left in the queue.
+ */
+int
+pmemblk_queue_submit(PMEMblkqueue *q, struct pmemblk_io *const *ios,
+		unsigned n)
+{
+	LOG(3, "q %p ios %p n %u", q, ios, n);
+
+	util_mutex_lock(&q->lock);
+
+	unsigned room = q->depth - q->inflight;
+	if (n > room)
+		n = room;
+
+	for (unsigned i = 0; i < n; ++i) {
+		unsigned tail = (q->sq_head + q->sq_count) % q->depth;
+		q->sq[tail] = ios[i];
+		q->sq_count++;
+	}
+	q->inflight += n;
+
+	if (n > 0)
+		pthread_cond_broadcast(&q->sq_cond);
+
+	util_mutex_unlock(&q->lock);
+
+	return (int)n;
+}
+
+/*
+ * pmemblk_queue_poll -- reap finished requests
+ *
+ * Waits until at least min requests are finished, or all of the requests in
+ * flight if there are fewer of them, and returns up to n of them.
+ */
+int
+pmemblk_queue_poll(PMEMblkqueue *q, struct pmemblk_io **ios, unsigned n,
+		unsigned min)
+{
+	LOG(3, "q %p ios %p n %u min %u", q, ios, n, min);
+
+	if (min > n)
+		min = n;
+
+	util_mutex_lock(&q->lock);
+
+	if (min > q->inflight)
+		min = q->inflight;
+
+	while (q->cq_count < min)
+		pthread_cond_wait(&q->cq_cond, &q->lock);
+
+	if (n > q->cq_count)
+		n = q->cq_count;
+
+	for (unsigned i = 0; i < n; ++i)
+		ios[i] = q->cq[(q->cq_head + i) % q->depth];
+	q->cq_head = (q->cq_head + n) % q->depth;
+	q->cq_count -= n;
+	q->inflight -= n;
+
+	util_mutex_unlock(&q->lock);
+
+	return (int)n;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * queue.h -- internal definitions for asynchronous block I/O queues
+ */
+
+/* maximum number of requests a worker carries out under one lane */
+#define QUEUE_BATCH_MAX 16
+
+struct pmemblkqueue {
+	PMEMblkpool *pbp;		/* pool the requests are run against */
+	unsigned depth;			/* max number of requests in flight */
+
+	pthread_mutex_t lock;		/* protects all of the below */
+	pthread_cond_t sq_cond;		/* signaled on new requests */
+	pthread_cond_t cq_cond;		/* signaled on finished requests */
+
+	struct pmemblk_io **sq;		/* ring of submitted requests */
+	unsigned sq_head;
+	unsigned sq_count;
+
+	struct pmemblk_io **cq;		/* ring of finished requests */
+	unsigned cq_head;
+	unsigned cq_count;
+
+	unsigned inflight;		/* submitted and not polled yet */
+	int stop;			/* set when the queue is deleted */
+
+	unsigned nthreads;		/* number of worker threads */
+	pthread_t *threads;
+};
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * crc32c.c -- CRC32C (Castagnoli) checksums of framed log records
+ *
+ * The checksums are computed with the SSE4.2 crc32 instruction when the CPU
+ * supports it, or with a lookup table otherwise.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include "out.h"
+#include "crc32c.h"
+
+/* reversed Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+#ifndef bit_SSE4_2
+#define bit_SSE4_2	(1 << 20)
+#endif
+
+static uint32_t Crc32c_table[256];
+
+static uint32_t crc32c_table(uint32_t crc, const void *buf, size_t len);
+
+static uint32_t (*Crc32c_func)(uint32_t crc, const void *buf, size_t len) =
+	crc32c_table;
+
+/*
+ * is_cpu_sse42_present -- (internal) checks if SSE4.2 instructions are
+ *	supported
+ */
+static int
+is_cpu_sse42_present(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	unsigned cpuinfo[4] = { 0 };
+
+#ifdef _MSC_VER
+	__cpuid((int *)cpuinfo, 0x1);
+#else
+	if (!__get_cpuid(0x1, &cpuinfo[0], &cpuinfo[1], &cpuinfo[2],
+			&cpuinfo[3]))
+		return 0;
+#endif
+
+	return (cpuinfo[2] & bit_SSE4_2) != 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * crc32c_table -- (internal) compute the checksum using the lookup table
+ */
+static uint32_t
+crc32c_table(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	crc = ~crc;
+	while (len--)
+		crc = Crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+/*
+ * crc32c_init -- fill in the lookup table and pick the implementation
+ */
+void
+crc32c_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+		Crc32c_table[i] = crc;
+	}
+
+	if (is_cpu_sse42_present()) {
+		LOG(3, "crc32c: using SSE4.2");
+		Crc32c_func = crc32c_sse42;
+	}
+}
+
+/*
+ * crc32c -- extend the checksum crc of the preceding data with len bytes
+ *	at buf, the checksum of no data being 0
+ */
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return Crc32c_func(crc, buf, len);
+}
@@ -55,6 +55,7 @@ libpmemlog_init(void)
 			PMEMLOG_LOG_FILE_VAR, PMEMLOG_MAJOR_VERSION,
 			PMEMLOG_MINOR_VERSION);
 	LOG(3, NULL);
+	log_init();
 }
 
 /*
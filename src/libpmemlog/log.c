@@ -35,6 +35,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/param.h>
@@ -52,27 +53,97 @@
 #include "set.h"
 #include "out.h"
 #include "log.h"
+#include "crc32c.h"
 #include "sys_util.h"
+#include "usdt.h"
 #include "valgrind_internal.h"
 
+/*
+ * How long (in microseconds) the leader of a group commit waits for the
+ * appends which are still copying their data to join the group.
+ */
+static unsigned long Group_commit_usec;
+
+/*
+ * log_init -- load-time initialization for log
+ */
+void
+log_init(void)
+{
+	LOG(3, NULL);
+
+	crc32c_init();
+
+	char *e = getenv(PMEMLOG_GROUP_COMMIT_VAR);
+	if (e == NULL)
+		return;
+
+	long val = atol(e);
+	if (val < 0 || val > LOG_GROUP_COMMIT_MAX) {
+		LOG(2, "Invalid %s", PMEMLOG_GROUP_COMMIT_VAR);
+	} else {
+		Group_commit_usec = (unsigned long)val;
+		LOG(3, "%s set to %lu", PMEMLOG_GROUP_COMMIT_VAR,
+				Group_commit_usec);
+	}
+}
+
+/*
+ * pmemlog_index_size -- return the size of the index of a log memory pool
+ *
+ * Each index entry falls into a different interval of the log, so the
+ * data of a ring log never spans more than nbyte / interval + 2 of them.
+ */
+uint64_t
+pmemlog_index_size(uint64_t poolsize, uint64_t interval)
+{
+	uint64_t start = roundup(sizeof(struct pmemlog), LOG_FORMAT_DATA_ALIGN);
+	uint64_t nentries = (poolsize - start) / interval + 2;
+
+	return roundup(nentries * sizeof(uint64_t), LOG_FORMAT_DATA_ALIGN);
+}
+
+/*
+ * pmemlog_data_end -- (internal) return the expected end of the usable log
+ *	space, which is followed by the index of an indexed log
+ */
+static uint64_t
+pmemlog_data_end(PMEMlogpool *plp, size_t poolsize)
+{
+	if (!plp->indexed)
+		return poolsize;
+
+	return poolsize - pmemlog_index_size(poolsize,
+			le64toh(plp->index_interval));
+}
+
 /*
  * pmemlog_descr_create -- (internal) create log memory pool descriptor
  */
 static int
-pmemlog_descr_create(PMEMlogpool *plp, size_t poolsize)
+pmemlog_descr_create(PMEMlogpool *plp, size_t poolsize, uint64_t interval)
 {
-	LOG(3, "plp %p poolsize %zu", plp, poolsize);
+	LOG(3, "plp %p poolsize %zu interval %ju", plp, poolsize, interval);
 
 	ASSERTeq(poolsize % Pagesize, 0);
 
 	/* create required metadata */
+	plp->index_interval = htole64(interval);
+	plp->index_count = 0;
 	plp->start_offset = htole64(roundup(sizeof(*plp),
 					LOG_FORMAT_DATA_ALIGN));
-	plp->end_offset = htole64(poolsize);
+	plp->end_offset = htole64(pmemlog_data_end(plp, poolsize));
 	plp->write_offset = plp->start_offset;
+	plp->head_offset = plp->start_offset;
+
+	if (le64toh(plp->end_offset) <= le64toh(plp->start_offset)) {
+		ERR("pool too small for the index (interval %ju)", interval);
+		errno = EINVAL;
+		return -1;
+	}
 
 	/* store non-volatile part of pool's descriptor */
-	pmem_msync(&plp->start_offset, 3 * sizeof(uint64_t));
+	pmem_msync(&plp->start_offset, 6 * sizeof(uint64_t));
 
 	return 0;
 }
@@ -88,9 +159,15 @@ pmemlog_descr_check(PMEMlogpool *plp, size_t poolsize)
 	struct pmemlog hdr = *plp;
 	pmemlog_convert2h(&hdr);
 
+	if (plp->indexed && hdr.index_interval < LOG_INDEX_MIN_INTERVAL) {
+		ERR("wrong index interval %ju", hdr.index_interval);
+		errno = EINVAL;
+		return -1;
+	}
+
 	if ((hdr.start_offset !=
 			roundup(sizeof(*plp), LOG_FORMAT_DATA_ALIGN)) ||
-			(hdr.end_offset != poolsize) ||
+			(hdr.end_offset != pmemlog_data_end(plp, poolsize)) ||
 			(hdr.start_offset > hdr.end_offset)) {
 		ERR("wrong start/end offsets (start: %ju end: %ju), "
 			"pool size %zu",
@@ -99,7 +176,19 @@ pmemlog_descr_check(PMEMlogpool *plp, size_t poolsize)
 		return -1;
 	}
 
-	if ((hdr.write_offset > hdr.end_offset) || (hdr.write_offset <
+	if (plp->ring) {
+		if ((hdr.head_offset < hdr.start_offset) ||
+				(hdr.write_offset < hdr.head_offset) ||
+				(hdr.write_offset - hdr.head_offset >
+				hdr.end_offset - hdr.start_offset)) {
+			ERR("wrong head/write offsets (start: %ju end: %ju "
+				"head: %ju write: %ju)", hdr.start_offset,
+				hdr.end_offset, hdr.head_offset,
+				hdr.write_offset);
+			errno = EINVAL;
+			return -1;
+		}
+	} else if ((hdr.write_offset > hdr.end_offset) || (hdr.write_offset <
 			hdr.start_offset)) {
 		ERR("wrong write offset (start: %ju end: %ju write: %ju)",
 			hdr.start_offset, hdr.end_offset, hdr.write_offset);
@@ -113,6 +202,67 @@ pmemlog_descr_check(PMEMlogpool *plp, size_t poolsize)
 	return 0;
 }
 
+/*
+ * pmemlog_index -- (internal) return the index of a log memory pool and the
+ *	number of its entries
+ */
+static uint64_t *
+pmemlog_index(PMEMlogpool *plp, uint64_t *nentries)
+{
+	uint64_t end = le64toh(plp->end_offset);
+
+	*nentries = (plp->size - end) / sizeof(uint64_t);
+
+	return (uint64_t *)((char *)plp->addr + end);
+}
+
+/*
+ * pmemlog_index_next -- (internal) return the position of the next interval
+ *	after the index entry at position pos
+ */
+static uint64_t
+pmemlog_index_next(PMEMlogpool *plp, uint64_t pos)
+{
+	uint64_t interval = le64toh(plp->index_interval);
+
+	return (pos / interval + 1) * interval;
+}
+
+/*
+ * pmemlog_index_recover -- (internal) drop the index entries of the appends
+ *	which weren't committed before the pool was closed
+ *
+ * Called before the pool is write-protected (debug version only).
+ */
+static void
+pmemlog_index_recover(PMEMlogpool *plp)
+{
+	uint64_t nentries;
+	uint64_t *index = pmemlog_index(plp, &nentries);
+	uint64_t count = le64toh(plp->index_count);
+	uint64_t first = count > nentries ? count - nentries : 0;
+	uint64_t write_offset = le64toh(plp->write_offset);
+
+	while (count > first &&
+			le64toh(index[(count - 1) % nentries]) > write_offset)
+		count--;
+
+	if (count != le64toh(plp->index_count) && !plp->rdonly) {
+		LOG(3, "dropping %ju index entries",
+				le64toh(plp->index_count) - count);
+
+		plp->index_count = htole64(count);
+		if (plp->is_pmem)
+			pmem_persist(&plp->index_count, sizeof(uint64_t));
+		else
+			pmem_msync(&plp->index_count, sizeof(uint64_t));
+	}
+
+	if (count > first)
+		plp->tailp->index_next = pmemlog_index_next(plp,
+				le64toh(index[(count - 1) % nentries]));
+}
+
 /*
  * pmemlog_runtime_init -- (internal) initialize log memory pool runtime data
  */
@@ -125,7 +275,7 @@ pmemlog_runtime_init(PMEMlogpool *plp, int rdonly, int is_pmem)
 	VALGRIND_REMOVE_PMEM_MAPPING(&plp->addr,
 		sizeof(struct pmemlog) -
 		sizeof(struct pool_hdr) -
-		3 * sizeof(uint64_t));
+		6 * sizeof(uint64_t));
 
 	/*
 	 * Use some of the memory pool area for run-time info.  This
@@ -142,9 +292,39 @@ pmemlog_runtime_init(PMEMlogpool *plp, int rdonly, int is_pmem)
 
 	if ((errno = pthread_rwlock_init(plp->rwlockp, NULL))) {
 		ERR("!pthread_rwlock_init");
-		Free((void *)plp->rwlockp);
-		return -1;
+		goto err_rwlock_init;
+	}
+
+	if ((plp->tailp = Malloc(sizeof(*plp->tailp))) == NULL) {
+		ERR("!Malloc for the log tail");
+		goto err_tail_malloc;
+	}
+
+	plp->tailp->reserved = le64toh(plp->write_offset);
+	plp->tailp->head = le64toh(plp->ring ? plp->head_offset :
+			plp->start_offset);
+	plp->tailp->written = plp->tailp->reserved;
+	plp->tailp->committed = plp->tailp->reserved;
+	plp->tailp->committing = 0;
+	plp->tailp->index_next = 0;
+	if (plp->indexed)
+		pmemlog_index_recover(plp);
+	util_mutex_init(&plp->tailp->lock, NULL);
+	if ((errno = pthread_cond_init(&plp->tailp->cond, NULL))) {
+		ERR("!pthread_cond_init");
+		goto err_cond_init;
+	}
+	plp->tailp->nreaders = 0;
+	plp->tailp->pin = UINT64_MAX;
+	util_mutex_init(&plp->tailp->readers_lock, NULL);
+	if ((errno = pthread_cond_init(&plp->tailp->readers_cond, NULL))) {
+		ERR("!pthread_cond_init");
+		goto err_readers_cond_init;
 	}
+#ifdef DEBUG
+	util_mutex_init(&plp->tailp->write_lock, NULL);
+	plp->tailp->nopen = 0;
+#endif
 
 	/*
 	 * If possible, turn off all permissions on the pool header page.
@@ -159,21 +339,58 @@ pmemlog_runtime_init(PMEMlogpool *plp, int rdonly, int is_pmem)
 			plp->size - sizeof(struct pool_hdr));
 
 	return 0;
+
+err_readers_cond_init:
+	util_mutex_destroy(&plp->tailp->readers_lock);
+	pthread_cond_destroy(&plp->tailp->cond);
+err_cond_init:
+	util_mutex_destroy(&plp->tailp->lock);
+	Free(plp->tailp);
+err_tail_malloc:
+	pthread_rwlock_destroy(plp->rwlockp);
+err_rwlock_init:
+	Free((void *)plp->rwlockp);
+	return -1;
 }
 
 /*
- * pmemlog_create -- create a log memory pool
+ * pmemlog_create_layout -- create a log memory pool with the given layout
  */
 PMEMlogpool *
-pmemlog_create(const char *path, size_t poolsize, mode_t mode)
+pmemlog_create_layout(const char *path, size_t poolsize, mode_t mode,
+	const struct pmemlog_layout *layout)
 {
-	LOG(3, "path %s poolsize %zu mode %d", path, poolsize, mode);
+	LOG(3, "path %s poolsize %zu mode %d layout %p", path, poolsize,
+			mode, layout);
+
+	uint32_t incompat = LOG_FORMAT_INCOMPAT;
+	uint64_t interval = 0;
+
+	if (layout != NULL) {
+		if (layout->ring)
+			incompat |= LOG_FORMAT_INCOMPAT_RING;
+
+		if (layout->index_interval) {
+			if (layout->index_interval < LOG_INDEX_MIN_INTERVAL) {
+				ERR("invalid index interval %zu",
+						layout->index_interval);
+				errno = EINVAL;
+				return NULL;
+			}
+
+			incompat |= LOG_FORMAT_INCOMPAT_INDEX;
+			interval = layout->index_interval;
+		}
+
+		if (layout->framed)
+			incompat |= LOG_FORMAT_INCOMPAT_FRAMED;
+	}
 
 	struct pool_set *set;
 
 	if (util_pool_create(&set, path, poolsize, PMEMLOG_MIN_POOL,
 			LOG_HDR_SIG, LOG_FORMAT_MAJOR,
-			LOG_FORMAT_COMPAT, LOG_FORMAT_INCOMPAT,
+			LOG_FORMAT_COMPAT, incompat,
 			LOG_FORMAT_RO_COMPAT, NULL) != 0) {
 		LOG(2, "cannot create pool or pool set");
 		return NULL;
@@ -191,6 +408,12 @@ pmemlog_create(const char *path, size_t poolsize, mode_t mode)
 	plp->addr = plp;
 	plp->size = rep->repsize;
 	plp->set = set;
+	plp->ring = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_RING) != 0;
+	plp->indexed = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_INDEX) != 0;
+	plp->framed = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_FRAMED) != 0;
 
 	if (set->nreplicas > 1) {
 		errno = ENOTSUP;
@@ -199,7 +422,7 @@ pmemlog_create(const char *path, size_t poolsize, mode_t mode)
 	}
 
 	/* create pool descriptor */
-	if (pmemlog_descr_create(plp, rep->repsize) != 0) {
+	if (pmemlog_descr_create(plp, rep->repsize, interval) != 0) {
 		LOG(2, "descriptor creation failed");
 		goto err;
 	}
@@ -224,6 +447,27 @@ err:
 	return NULL;
 }
 
+/*
+ * pmemlog_create -- create a log memory pool
+ */
+PMEMlogpool *
+pmemlog_create(const char *path, size_t poolsize, mode_t mode)
+{
+	return pmemlog_create_layout(path, poolsize, mode, NULL);
+}
+
+/*
+ * pmemlog_create_ring -- create a log memory pool which reuses the space
+ *	released by pmemlog_truncate_head()
+ */
+PMEMlogpool *
+pmemlog_create_ring(const char *path, size_t poolsize, mode_t mode)
+{
+	struct pmemlog_layout layout = { 1, 0, 0 };
+
+	return pmemlog_create_layout(path, poolsize, mode, &layout);
+}
+
 /*
  * pmemlog_open_common -- (internal) open a log memory pool
  *
@@ -239,7 +483,7 @@ pmemlog_open_common(const char *path, int cow)
 
 	if (util_pool_open(&set, path, cow, PMEMLOG_MIN_POOL,
 			LOG_HDR_SIG, LOG_FORMAT_MAJOR,
-			LOG_FORMAT_COMPAT, LOG_FORMAT_INCOMPAT,
+			LOG_FORMAT_COMPAT, LOG_FORMAT_INCOMPAT_SUPPORTED,
 			LOG_FORMAT_RO_COMPAT, NULL) != 0) {
 		LOG(2, "cannot open pool or pool set");
 		return NULL;
@@ -257,6 +501,12 @@ pmemlog_open_common(const char *path, int cow)
 	plp->addr = plp;
 	plp->size = rep->repsize;
 	plp->set = set;
+	plp->ring = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_RING) != 0;
+	plp->indexed = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_INDEX) != 0;
+	plp->framed = (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_FRAMED) != 0;
 
 	if (set->nreplicas > 1) {
 		errno = ENOTSUP;
@@ -310,6 +560,17 @@ pmemlog_close(PMEMlogpool *plp)
 		ERR("!pthread_rwlock_destroy");
 	Free((void *)plp->rwlockp);
 
+#ifdef DEBUG
+	util_mutex_destroy(&plp->tailp->write_lock);
+#endif
+	if ((errno = pthread_cond_destroy(&plp->tailp->readers_cond)))
+		ERR("!pthread_cond_destroy");
+	util_mutex_destroy(&plp->tailp->readers_lock);
+	if ((errno = pthread_cond_destroy(&plp->tailp->cond)))
+		ERR("!pthread_cond_destroy");
+	util_mutex_destroy(&plp->tailp->lock);
+	Free(plp->tailp);
+
 	util_poolset_close(plp->set, 0);
 }
 
@@ -321,277 +582,1068 @@ pmemlog_nbyte(PMEMlogpool *plp)
 {
 	LOG(3, "plp %p", plp);
 
-	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_rdlock");
-		return (size_t)-1;
-	}
-
+	/* the offsets never change once the pool is open */
 	size_t size = le64toh(plp->end_offset) - le64toh(plp->start_offset);
 	LOG(4, "plp %p nbyte %zu", plp, size);
 
-	util_rwlock_unlock(plp->rwlockp);
-
 	return size;
 }
 
 /*
- * pmemlog_persist -- (internal) persist data, then metadata
- *
- * On entry, the write lock should be held.
+ * pmemlog_write_offset -- (internal) return the published write point of a
+ *	log memory pool, read without any locks
  */
-static void
-pmemlog_persist(PMEMlogpool *plp, uint64_t new_write_offset)
+static uint64_t
+pmemlog_write_offset(PMEMlogpool *plp)
 {
-	uint64_t old_write_offset = le64toh(plp->write_offset);
-	size_t length = new_write_offset - old_write_offset;
-
-	/* unprotect the log space range (debug version only) */
-	RANGE_RW((char *)plp->addr + old_write_offset, length);
-
-	/* persist the data */
-	if (plp->is_pmem)
-		pmem_drain(); /* data already flushed */
-	else
-		pmem_msync((char *)plp->addr + old_write_offset, length);
+	return le64toh(*(uint64_t volatile *)&plp->write_offset);
+}
 
-	/* protect the log space range (debug version only) */
-	RANGE_RO((char *)plp->addr + old_write_offset, length);
+/*
+ * pmemlog_read_begin -- register a reader of the log data
+ *
+ * Stores the positions of the first byte and of the end of the data the
+ * reader may access in *head and *end.  Their space isn't reused by the
+ * appends to a ring log until the reader calls pmemlog_read_end(), so the
+ * reader needs no lock which would delay the appends or the truncation.
+ */
+void
+pmemlog_read_begin(PMEMlogpool *plp, uint64_t *head, uint64_t *end)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
 
-	/* unprotect the pool descriptor (debug version only) */
-	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
-			LOG_FORMAT_DATA_ALIGN);
+	util_mutex_lock(&tailp->readers_lock);
 
-	/* write the metadata */
-	plp->write_offset = htole64(new_write_offset);
+	if (tailp->nreaders++ == 0)
+		tailp->pin = tailp->head;
+	*head = tailp->head;
 
-	/* persist the metadata */
-	if (plp->is_pmem)
-		pmem_persist(&plp->write_offset, sizeof(plp->write_offset));
-	else
-		pmem_msync(&plp->write_offset, sizeof(plp->write_offset));
+	util_mutex_unlock(&tailp->readers_lock);
 
-	/* set the write-protection again (debug version only) */
-	RANGE_RO((char *)plp->addr + sizeof(struct pool_hdr),
-			LOG_FORMAT_DATA_ALIGN);
+	*end = pmemlog_write_offset(plp);
 }
 
 /*
- * pmemlog_append -- add data to a log memory pool
+ * pmemlog_read_end -- unregister a reader of the log data
  */
-int
-pmemlog_append(PMEMlogpool *plp, const void *buf, size_t count)
+void
+pmemlog_read_end(PMEMlogpool *plp)
 {
-	int ret = 0;
-
-	LOG(3, "plp %p buf %p count %zu", plp, buf, count);
-
-	if (plp->rdonly) {
-		ERR("can't append to read-only log");
-		errno = EROFS;
-		return -1;
-	}
-
-	if ((errno = pthread_rwlock_wrlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_wrlock");
-		return -1;
-	}
-
-	/* get the current values */
-	uint64_t end_offset = le64toh(plp->end_offset);
-	uint64_t write_offset = le64toh(plp->write_offset);
+	struct pmemlog_tail *tailp = plp->tailp;
 
-	if (write_offset >= end_offset) {
-		/* no space left */
-		errno = ENOSPC;
-		ERR("!pmemlog_append");
-		ret = -1;
-		goto end;
-	}
+	util_mutex_lock(&tailp->readers_lock);
 
-	/* make sure we don't write past the available space */
-	if (count > (end_offset - write_offset)) {
-		errno = ENOSPC;
-		ERR("!pmemlog_append");
-		ret = -1;
-		goto end;
+	if (--tailp->nreaders == 0) {
+		tailp->pin = UINT64_MAX;
+		pthread_cond_broadcast(&tailp->readers_cond);
 	}
 
-	char *data = plp->addr;
-
-	/*
-	 * unprotect the log space range, where the new data will be stored
-	 * (debug version only)
-	 */
-	RANGE_RW(&data[write_offset], count);
-
-	if (plp->is_pmem)
-		pmem_memcpy_nodrain(&data[write_offset], buf, count);
-	else
-		memcpy(&data[write_offset], buf, count);
-
-	/* protect the log space range (debug version only) */
-	RANGE_RO(&data[write_offset], count);
-
-	write_offset += count;
-
-	/* persist the data and the metadata */
-	pmemlog_persist(plp, write_offset);
-
-end:
-	util_rwlock_unlock(plp->rwlockp);
-
-	return ret;
+	util_mutex_unlock(&tailp->readers_lock);
 }
 
 /*
- * pmemlog_appendv -- add gathered data to a log memory pool
+ * pmemlog_data -- return the address of the log data at position pos and
+ *	how many of the next len bytes are stored contiguously there
+ *
+ * Positions grow past end_offset only in ring logs, where they wrap around
+ * to start_offset.
  */
-int
-pmemlog_appendv(PMEMlogpool *plp, const struct iovec *iov, int iovcnt)
+char *
+pmemlog_data(PMEMlogpool *plp, uint64_t pos, size_t len, size_t *contig)
 {
-	LOG(3, "plp %p iovec %p iovcnt %d", plp, iov, iovcnt);
-
-	int ret = 0; // success
-	int i;
+	uint64_t start = le64toh(plp->start_offset);
+	uint64_t end = le64toh(plp->end_offset);
+	uint64_t off = start + (pos - start) % (end - start);
 
-	ASSERT(iovcnt > 0);
-
-	if (plp->rdonly) {
-		ERR("can't append to read-only log");
-		errno = EROFS;
-		return -1;
-	}
+	*contig = MIN(len, end - off);
 
-	if ((errno = pthread_rwlock_wrlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_wrlock");
-		return -1;
-	}
+	return (char *)plp->addr + off;
+}
 
-	/* get the current values */
-	uint64_t end_offset = le64toh(plp->end_offset);
-	uint64_t write_offset = le64toh(plp->write_offset);
+/*
+ * pmemlog_tail_reserve -- (internal) reserve space at the end of the log
+ *
+ * Stores the position of the reserved space in *pos and returns 0, or
+ * returns ENOSPC if there is not enough space left.  When contig is set,
+ * returns EAGAIN if the space would wrap around the end of a ring log.
+ * On entry, the RW lock should be held for reading.
+ */
+static int
+pmemlog_tail_reserve(PMEMlogpool *plp, uint64_t count, int contig,
+	uint64_t *pos)
+{
+	uint64_t nbyte = le64toh(plp->end_offset) -
+			le64toh(plp->start_offset);
+	/* the space pinned by the readers can't be reused yet */
+	uint64_t limit = MIN(plp->tailp->head, plp->tailp->pin) + nbyte;
+
+	for (;;) {
+		uint64_t offset = plp->tailp->reserved;
+
+		if (offset >= limit || count > limit - offset)
+			return ENOSPC;
+
+		if (contig && count) {
+			size_t len;
+			pmemlog_data(plp, offset, count, &len);
+			if (len < count)
+				return EAGAIN;
+		}
 
-	if (write_offset >= end_offset) {
-		/* no space left */
-		errno = ENOSPC;
-		ERR("!pmemlog_appendv");
-		ret = -1;
-		goto end;
+		if (__sync_bool_compare_and_swap(&plp->tailp->reserved,
+				offset, offset + count)) {
+			*pos = offset;
+			return 0;
+		}
 	}
+}
 
-	char *data = plp->addr;
-	uint64_t count = 0;
-	char *buf;
-
-	/* calculate required space */
-	for (i = 0; i < iovcnt; ++i)
-		count += iov[i].iov_len;
+/*
+ * pmemlog_copy -- (internal) copy data into the reserved log space
+ *
+ * If crcp is not NULL, the checksum at *crcp is extended with the data.
+ * The data is then checksummed and copied one piece at a time, so that
+ * the copy finds each piece in the cache.
+ */
+static void
+pmemlog_copy(PMEMlogpool *plp, uint64_t offset, const void *buf, size_t count,
+	uint32_t *crcp)
+{
+	const char *src = buf;
 
-	/* check if there is enough free space */
-	if (count > (end_offset - write_offset)) {
-		errno = ENOSPC;
-		ret = -1;
-		goto end;
-	}
+	while (count) {
+		size_t len;
+		char *dest = pmemlog_data(plp, offset, count, &len);
 
-	/* append the data */
-	for (i = 0; i < iovcnt; ++i) {
-		buf = iov[i].iov_base;
-		count = iov[i].iov_len;
+		if (crcp) {
+			len = MIN(len, LOG_FRAME_PIECE);
+			*crcp = crc32c(*crcp, src, len);
+		}
 
 		/*
 		 * unprotect the log space range, where the new data will be
 		 * stored (debug version only)
 		 */
-		RANGE_RW(&data[write_offset], count);
+		RANGE_RW(dest, len);
 
 		if (plp->is_pmem)
-			pmem_memcpy_nodrain(&data[write_offset], buf, count);
+			pmem_memcpy_nodrain(dest, src, len);
 		else
-			memcpy(&data[write_offset], buf, count);
+			memcpy(dest, src, len);
 
+#ifdef DEBUG
 		/*
-		 * protect the log space range (debug version only)
+		 * protect the log space range, unless a reservation may be
+		 * using it
 		 */
-		RANGE_RO(&data[write_offset], count);
+		if (plp->tailp->nopen == 0)
+			RANGE_RO(dest, len);
+#endif
 
-		write_offset += count;
+		offset += len;
+		src += len;
+		count -= len;
 	}
-
-	/* persist the data and the metadata */
-	pmemlog_persist(plp, write_offset);
-
-end:
-	util_rwlock_unlock(plp->rwlockp);
-
-	return ret;
 }
 
 /*
- * pmemlog_tell -- return current write point in a log memory pool
+ * pmemlog_reserve_record -- (internal) reserve space for the record of an
+ *	append of count bytes
+ *
+ * Stores the position and the length of the record in *pos and *len, and
+ * returns 0 or an error number like pmemlog_tail_reserve().
  */
-long long
-pmemlog_tell(PMEMlogpool *plp)
+static int
+pmemlog_reserve_record(PMEMlogpool *plp, uint64_t count, int contig,
+	uint64_t *pos, uint64_t *len)
 {
-	LOG(3, "plp %p", plp);
+	*len = count;
 
-	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_rdlock");
-		return (off_t)-1;
+	if (plp->framed) {
+		if (count > UINT32_MAX)
+			return EINVAL;
+
+		*len += sizeof(struct log_frame);
 	}
 
-	ASSERT(le64toh(plp->write_offset) >= le64toh(plp->start_offset));
-	long long wp = (long long)(le64toh(plp->write_offset) -
-			le64toh(plp->start_offset));
+	return pmemlog_tail_reserve(plp, *len, contig, pos);
+}
 
-	LOG(4, "write offset %lld", wp);
+/*
+ * pmemlog_frame -- (internal) store the header of a framed record, whose
+ *	checksum so far is crc
+ */
+static void
+pmemlog_frame(PMEMlogpool *plp, uint64_t offset, uint32_t len, uint32_t crc)
+{
+	struct log_frame frame;
 
-	util_rwlock_unlock(plp->rwlockp);
+	frame.len = htole32(len);
+	frame.crc = htole32(crc);
 
-	return wp;
+	pmemlog_copy(plp, offset, &frame, sizeof(frame), NULL);
 }
 
 /*
- * pmemlog_rewind -- discard all data, resetting a log memory pool to empty
+ * pmemlog_copy_record -- (internal) copy the gathered data of an append into
+ *	the space reserved for its record
  */
-void
-pmemlog_rewind(PMEMlogpool *plp)
+static void
+pmemlog_copy_record(PMEMlogpool *plp, uint64_t offset,
+	const struct iovec *iov, int iovcnt, uint64_t count)
 {
-	LOG(3, "plp %p", plp);
-
-	if (plp->rdonly) {
-		ERR("can't rewind read-only log");
-		errno = EROFS;
-		return;
+	uint32_t crc = 0;
+	uint32_t *crcp = NULL;
+
+	if (plp->framed) {
+		uint32_t len = htole32((uint32_t)count);
+		crc = crc32c(0, &len, sizeof(len));
+		crcp = &crc;
+		offset += sizeof(struct log_frame);
 	}
 
-	if ((errno = pthread_rwlock_wrlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_wrlock");
-		return;
+	uint64_t write_offset = offset;
+	for (int i = 0; i < iovcnt; ++i) {
+		pmemlog_copy(plp, write_offset, iov[i].iov_base,
+				iov[i].iov_len, crcp);
+		write_offset += iov[i].iov_len;
 	}
 
+	if (plp->framed)
+		pmemlog_frame(plp, offset - sizeof(struct log_frame),
+				(uint32_t)count, crc);
+}
+
+/*
+ * pmemlog_publish -- (internal) write the metadata which publishes the data
+ *	up to position target
+ *
+ * The new write_offset is flushed, but a pmem_drain() is still needed to
+ * make it persistent if the pool is in PMEM.  Called by the leader of a
+ * commit.
+ */
+static void
+pmemlog_publish(PMEMlogpool *plp, uint64_t target)
+{
 	/* unprotect the pool descriptor (debug version only) */
 	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
 			LOG_FORMAT_DATA_ALIGN);
 
-	plp->write_offset = plp->start_offset;
+	/* write the metadata */
+	plp->write_offset = htole64(target);
+
+	/* persist the metadata */
 	if (plp->is_pmem)
-		pmem_persist(&plp->write_offset, sizeof(uint64_t));
+		pmem_flush(&plp->write_offset, sizeof(plp->write_offset));
 	else
-		pmem_msync(&plp->write_offset, sizeof(uint64_t));
+		pmem_msync(&plp->write_offset, sizeof(plp->write_offset));
 
 	/* set the write-protection again (debug version only) */
 	RANGE_RO((char *)plp->addr + sizeof(struct pool_hdr),
 			LOG_FORMAT_DATA_ALIGN);
+}
+
+/*
+ * pmemlog_group_commit -- (internal) lead a group commit
+ *
+ * Publishes all of the data written so far with a single update of
+ * write_offset.  If there are appends still copying their data, waits up
+ * to Group_commit_usec for them to join the group.  Called and returns with
+ * the tail lock held.
+ */
+static void
+pmemlog_group_commit(PMEMlogpool *plp)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	tailp->committing = 1;
+
+	if (Group_commit_usec && tailp->written != tailp->reserved) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (long)(Group_commit_usec % 1000000) * 1000;
+		deadline.tv_sec += (time_t)(Group_commit_usec / 1000000) +
+				deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+
+		while (tailp->written != tailp->reserved) {
+			if (pthread_cond_timedwait(&tailp->cond, &tailp->lock,
+					&deadline) == ETIMEDOUT)
+				break;
+		}
+	}
+
+	uint64_t target = tailp->written;
+
+	util_mutex_unlock(&tailp->lock);
+
+	pmemlog_publish(plp, target);
+	if (plp->is_pmem)
+		pmem_drain();
+
+	util_mutex_lock(&tailp->lock);
+
+	tailp->committed = target;
+	tailp->committing = 0;
+}
+
+/*
+ * pmemlog_index_add -- (internal) add the position of an append to the index
+ *
+ * Called with the tail lock held, in the order of the appends.
+ */
+static void
+pmemlog_index_add(PMEMlogpool *plp, uint64_t pos)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	/* a leader may be updating the pool descriptor */
+	while (tailp->committing)
+		pthread_cond_wait(&tailp->cond, &tailp->lock);
+
+	uint64_t nentries;
+	uint64_t *index = pmemlog_index(plp, &nentries);
+	uint64_t count = le64toh(plp->index_count);
+	uint64_t *entry = &index[count % nentries];
+
+	/* unprotect the index entry (debug version only) */
+	RANGE_RW(entry, sizeof(*entry));
+
+	*entry = htole64(pos);
+	if (plp->is_pmem)
+		pmem_persist(entry, sizeof(*entry));
+	else
+		pmem_msync(entry, sizeof(*entry));
+
+	/* set the write-protection again (debug version only) */
+	RANGE_RO(entry, sizeof(*entry));
+
+	/* unprotect the pool descriptor (debug version only) */
+	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	/* the entry becomes part of the index once it is persistent */
+	plp->index_count = htole64(count + 1);
+	if (plp->is_pmem)
+		pmem_persist(&plp->index_count, sizeof(uint64_t));
+	else
+		pmem_msync(&plp->index_count, sizeof(uint64_t));
+
+	/* set the write-protection again (debug version only) */
+	RANGE_RO((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	tailp->index_next = pmemlog_index_next(plp, pos);
+}
+
+/*
+ * pmemlog_msync_data -- (internal) persist appended data in a pool which
+ *	is not in PMEM
+ */
+static void
+pmemlog_msync_data(PMEMlogpool *plp, uint64_t offset, size_t length)
+{
+	while (length) {
+		size_t len;
+		char *data = pmemlog_data(plp, offset, length, &len);
+		pmem_msync(data, len);
+		offset += len;
+		length -= len;
+	}
+}
+
+/*
+ * pmemlog_mark_written -- (internal) mark persistent appended data as
+ *	written, in the order in which its space was reserved
+ */
+static void
+pmemlog_mark_written(PMEMlogpool *plp, uint64_t offset, size_t length)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	util_mutex_lock(&tailp->lock);
+
+	while (tailp->written != offset)
+		pthread_cond_wait(&tailp->cond, &tailp->lock);
+
+	/* appends are indexed in order, before they can be committed */
+	if (plp->indexed && offset >= tailp->index_next)
+		pmemlog_index_add(plp, offset);
+
+	tailp->written = offset + length;
+	pthread_cond_broadcast(&tailp->cond);
+
+	util_mutex_unlock(&tailp->lock);
+}
+
+/*
+ * pmemlog_wait_committed -- (internal) wait until the data up to position
+ *	end is committed, leading a group commit if no one else does
+ */
+static void
+pmemlog_wait_committed(PMEMlogpool *plp, uint64_t end)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	util_mutex_lock(&tailp->lock);
+
+	while (tailp->committed < end) {
+		if (tailp->committing) {
+			pthread_cond_wait(&tailp->cond, &tailp->lock);
+		} else {
+			pmemlog_group_commit(plp);
+			pthread_cond_broadcast(&tailp->cond);
+		}
+	}
+
+	util_mutex_unlock(&tailp->lock);
+}
+
+/*
+ * pmemlog_persist -- (internal) persist data, then metadata
+ *
+ * The data of concurrent appends is persisted in parallel.  write_offset
+ * must cover the appended data in order, so each appender marks its data
+ * as written only after the appends which reserved space before it did.
+ * The first appender to find its data not yet committed becomes the leader
+ * and commits the data of every append written so far; the others wait for
+ * it.  On entry, the RW lock should be held for reading.
+ */
+static void
+pmemlog_persist(PMEMlogpool *plp, uint64_t offset, size_t length)
+{
+	/* persist the data */
+	if (plp->is_pmem)
+		pmem_drain(); /* data already flushed */
+	else
+		pmemlog_msync_data(plp, offset, length);
+
+	pmemlog_mark_written(plp, offset, length);
+	pmemlog_wait_committed(plp, offset + length);
+}
+
+/*
+ * pmemlog_append -- add data to a log memory pool
+ */
+int
+pmemlog_append(PMEMlogpool *plp, const void *buf, size_t count)
+{
+	LOG(3, "plp %p buf %p count %zu", plp, buf, count);
+
+	USDT_PROBE2(libpmemlog, append, plp, count);
+
+	if (plp->rdonly) {
+		ERR("can't append to read-only log");
+		errno = EROFS;
+		return -1;
+	}
+
+	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_rdlock");
+		return -1;
+	}
+
+	/* make sure we don't write past the available space */
+	uint64_t offset;
+	uint64_t len;
+	int err = pmemlog_reserve_record(plp, count, 0, &offset, &len);
+	if (err) {
+		util_rwlock_unlock(plp->rwlockp);
+		errno = err;
+		ERR("!pmemlog_append");
+		return -1;
+	}
+
+	struct iovec iov = { (void *)buf, count };
+
+#ifdef DEBUG
+	util_mutex_lock(&plp->tailp->write_lock);
+#endif
+
+	pmemlog_copy_record(plp, offset, &iov, 1, count);
+
+#ifdef DEBUG
+	util_mutex_unlock(&plp->tailp->write_lock);
+#endif
+
+	/* persist the data and the metadata */
+	pmemlog_persist(plp, offset, len);
+
+	util_rwlock_unlock(plp->rwlockp);
+
+	USDT_PROBE2(libpmemlog, append_done, plp, offset);
+
+	return 0;
+}
+
+/*
+ * pmemlog_appendv -- add gathered data to a log memory pool
+ */
+int
+pmemlog_appendv(PMEMlogpool *plp, const struct iovec *iov, int iovcnt)
+{
+	LOG(3, "plp %p iovec %p iovcnt %d", plp, iov, iovcnt);
+
+	int i;
+
+	ASSERT(iovcnt > 0);
+
+	if (plp->rdonly) {
+		ERR("can't append to read-only log");
+		errno = EROFS;
+		return -1;
+	}
+
+	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_rdlock");
+		return -1;
+	}
+
+	/* calculate required space */
+	uint64_t count = 0;
+	for (i = 0; i < iovcnt; ++i)
+		count += iov[i].iov_len;
+
+	/* check if there is enough free space */
+	uint64_t offset;
+	uint64_t len;
+	int err = pmemlog_reserve_record(plp, count, 0, &offset, &len);
+	if (err) {
+		util_rwlock_unlock(plp->rwlockp);
+		errno = err;
+		return -1;
+	}
+
+#ifdef DEBUG
+	util_mutex_lock(&plp->tailp->write_lock);
+#endif
+
+	/* append the data */
+	pmemlog_copy_record(plp, offset, iov, iovcnt, count);
+
+#ifdef DEBUG
+	util_mutex_unlock(&plp->tailp->write_lock);
+#endif
+
+	/* persist the data and the metadata */
+	pmemlog_persist(plp, offset, len);
+
+	util_rwlock_unlock(plp->rwlockp);
+
+	return 0;
+}
+
+/*
+ * pmemlog_commit_begin -- (internal) start a commit of the data written up
+ *	to position end, unless it's committed or being committed already
+ *
+ * Returns 1 if the calling thread leads the commit, which it then finishes
+ * with pmemlog_commit_end() once the new write_offset is persistent.
+ */
+static int
+pmemlog_commit_begin(PMEMlogpool *plp, uint64_t end, uint64_t *target)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	util_mutex_lock(&tailp->lock);
+
+	if (tailp->committed >= end || tailp->committing) {
+		util_mutex_unlock(&tailp->lock);
+		return 0;
+	}
+
+	tailp->committing = 1;
+	*target = tailp->written;
+
+	util_mutex_unlock(&tailp->lock);
+
+	pmemlog_publish(plp, *target);
+
+	return 1;
+}
+
+/*
+ * pmemlog_commit_end -- (internal) finish a commit led by the calling thread
+ */
+static void
+pmemlog_commit_end(PMEMlogpool *plp, uint64_t target)
+{
+	struct pmemlog_tail *tailp = plp->tailp;
+
+	util_mutex_lock(&tailp->lock);
+
+	tailp->committed = target;
+	tailp->committing = 0;
+	pthread_cond_broadcast(&tailp->cond);
+
+	util_mutex_unlock(&tailp->lock);
+}
+
+/*
+ * pmemlog_append_batch -- add data to several log memory pools at once
+ *
+ * The data of all of the appends is made persistent with a single
+ * pmem_drain(), and so are the write_offsets of the pools in which the
+ * calling thread leads the commit.  Space is reserved and data is marked
+ * as written in the order of the appends, like a sequence of single
+ * appends would do, so concurrent batches can't wait for each other in
+ * a circle.
+ */
+int
+pmemlog_append_batch(const struct pmemlog_append_op *ops, unsigned nops)
+{
+	LOG(3, "ops %p nops %u", ops, nops);
+
+	struct {
+		uint64_t offset;	/* position of the reserved space */
+		uint64_t len;		/* length of the record */
+		uint64_t target;	/* write_offset of a commit led */
+		int leader;		/* true if the commit is led */
+	} stack_state[LOG_BATCH_STACK], *state = stack_state;
+
+	if (nops > LOG_BATCH_STACK &&
+			(state = Malloc(nops * sizeof(*state))) == NULL) {
+		ERR("!Malloc for a log append batch");
+		return -1;
+	}
+
+	/* reserve space, up to the first append which can't be done */
+	unsigned n;
+	int err = 0;
+	for (n = 0; n < nops; n++) {
+		PMEMlogpool *plp = ops[n].plp;
+
+		if (plp->rdonly) {
+			ERR("can't append to read-only log");
+			err = EROFS;
+			break;
+		}
+
+		if ((err = pthread_rwlock_rdlock(plp->rwlockp))) {
+			errno = err;
+			ERR("!pthread_rwlock_rdlock");
+			break;
+		}
+
+		err = pmemlog_reserve_record(plp, ops[n].count, 0,
+				&state[n].offset, &state[n].len);
+		if (err) {
+			util_rwlock_unlock(plp->rwlockp);
+			break;
+		}
+	}
+
+	/* copy the data, flushing it without waiting */
+	int drain = 0;
+	for (unsigned i = 0; i < n; i++) {
+		PMEMlogpool *plp = ops[i].plp;
+
+#ifdef DEBUG
+		util_mutex_lock(&plp->tailp->write_lock);
+#endif
+
+		struct iovec iov = { (void *)ops[i].buf, ops[i].count };
+		pmemlog_copy_record(plp, state[i].offset, &iov, 1,
+				ops[i].count);
+
+#ifdef DEBUG
+		util_mutex_unlock(&plp->tailp->write_lock);
+#endif
+
+		if (plp->is_pmem)
+			drain = 1;
+		else
+			pmemlog_msync_data(plp, state[i].offset, state[i].len);
+	}
 
+	/* a single fence makes the data of all of the pools persistent */
+	if (drain)
+		pmem_drain();
+
+	for (unsigned i = 0; i < n; i++)
+		pmemlog_mark_written(ops[i].plp, state[i].offset,
+				state[i].len);
+
+	/* lead the commits no one else is doing, with a single fence again */
+	drain = 0;
+	for (unsigned i = 0; i < n; i++) {
+		PMEMlogpool *plp = ops[i].plp;
+
+		state[i].leader = pmemlog_commit_begin(plp,
+				state[i].offset + state[i].len,
+				&state[i].target);
+		if (state[i].leader && plp->is_pmem)
+			drain = 1;
+	}
+
+	if (drain)
+		pmem_drain();
+
+	for (unsigned i = 0; i < n; i++) {
+		if (state[i].leader)
+			pmemlog_commit_end(ops[i].plp, state[i].target);
+	}
+
+	for (unsigned i = 0; i < n; i++) {
+		pmemlog_wait_committed(ops[i].plp,
+				state[i].offset + state[i].len);
+		util_rwlock_unlock(ops[i].plp->rwlockp);
+	}
+
+	if (state != stack_state)
+		Free(state);
+
+	if (err) {
+		errno = err;
+		ERR("!pmemlog_append_batch");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemlog_reserve -- reserve space at the end of a log memory pool
+ *
+ * Returns a pointer to count bytes of the log, which the caller fills in
+ * and then passes to pmemlog_commit().  Until then, the RW lock is held for
+ * reading and the appends which reserve space later cannot be committed.
+ * In a framed log, the space of the record header precedes them.
+ */
+void *
+pmemlog_reserve(PMEMlogpool *plp, size_t count)
+{
+	LOG(3, "plp %p count %zu", plp, count);
+
+	if (plp->rdonly) {
+		ERR("can't append to read-only log");
+		errno = EROFS;
+		return NULL;
+	}
+
+	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_rdlock");
+		return NULL;
+	}
+
+	uint64_t offset;
+	uint64_t len;
+	int err = pmemlog_reserve_record(plp, count, 1, &offset, &len);
+	if (err) {
+		util_rwlock_unlock(plp->rwlockp);
+		errno = err;
+		ERR("!pmemlog_reserve");
+		return NULL;
+	}
+
+	size_t contig;
+	char *data = pmemlog_data(plp, offset, len, &contig);
+
+#ifdef DEBUG
+	util_mutex_lock(&plp->tailp->write_lock);
+	plp->tailp->nopen++;
+#endif
+
+	/*
+	 * unprotect the log space range, where the caller will store
+	 * the new data (debug version only)
+	 */
+	RANGE_RW(data, len);
+
+#ifdef DEBUG
+	util_mutex_unlock(&plp->tailp->write_lock);
+#endif
+
+	return data + (len - count);
+}
+
+/*
+ * pmemlog_commit -- append the data stored in space reserved by
+ *	pmemlog_reserve()
+ */
+int
+pmemlog_commit(PMEMlogpool *plp, void *addr, size_t count)
+{
+	LOG(3, "plp %p addr %p count %zu", plp, addr, count);
+
+	char *rec = addr;
+	uint64_t len = count;
+
+	/* checksum the data of a framed record, then fill in its header */
+	if (plp->framed) {
+		rec -= sizeof(struct log_frame);
+		len += sizeof(struct log_frame);
+
+		struct log_frame *frame = (struct log_frame *)rec;
+		frame->len = htole32((uint32_t)count);
+		frame->crc = htole32(crc32c(crc32c(0, &frame->len,
+				sizeof(frame->len)), addr, count));
+	}
+
+	uint64_t start = le64toh(plp->start_offset);
+	uint64_t nbyte = le64toh(plp->end_offset) - start;
+	uint64_t off = (uint64_t)(rec - (char *)plp->addr);
+
+	ASSERT(off >= start);
+	ASSERT(off + len <= start + nbyte);
+
+	if (plp->is_pmem)
+		pmem_flush(rec, len);
+
+#ifdef DEBUG
+	util_mutex_lock(&plp->tailp->write_lock);
+	if (--plp->tailp->nopen == 0)
+		RANGE_RO(rec, len);
+	util_mutex_unlock(&plp->tailp->write_lock);
+#endif
+
+	/*
+	 * All of the uncommitted space lies within nbyte bytes from the head
+	 * of the log, which gives the position of the reserved space.  A
+	 * zero-length reservation has nothing to commit, unless it's framed.
+	 */
+	if (len) {
+		uint64_t head = plp->tailp->head;
+		uint64_t offset = head + (off - start + nbyte -
+				(head - start) % nbyte) % nbyte;
+
+		/* persist the data and the metadata */
+		pmemlog_persist(plp, offset, len);
+	}
+
+	util_rwlock_unlock(plp->rwlockp);
+
+	return 0;
+}
+
+/*
+ * pmemlog_tell -- return current write point in a log memory pool
+ */
+long long
+pmemlog_tell(PMEMlogpool *plp)
+{
+	LOG(3, "plp %p", plp);
+
+	uint64_t write_offset = pmemlog_write_offset(plp);
+
+	ASSERT(write_offset >= le64toh(plp->start_offset));
+	long long wp = (long long)(write_offset - le64toh(plp->start_offset));
+
+	LOG(4, "write offset %lld", wp);
+
+	return wp;
+}
+
+/*
+ * pmemlog_rewind -- discard all data, resetting a log memory pool to empty
+ */
+void
+pmemlog_rewind(PMEMlogpool *plp)
+{
+	LOG(3, "plp %p", plp);
+
+	if (plp->rdonly) {
+		ERR("can't rewind read-only log");
+		errno = EROFS;
+		return;
+	}
+
+	if ((errno = pthread_rwlock_wrlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_wrlock");
+		return;
+	}
+
+	/* the data being read can't be overwritten */
+	util_mutex_lock(&plp->tailp->readers_lock);
+	while (plp->tailp->nreaders)
+		pthread_cond_wait(&plp->tailp->readers_cond,
+				&plp->tailp->readers_lock);
+
+	/* unprotect the pool descriptor (debug version only) */
+	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	plp->write_offset = plp->start_offset;
+	if (plp->ring)
+		plp->head_offset = plp->start_offset;
+	plp->tailp->reserved = le64toh(plp->start_offset);
+	plp->tailp->head = plp->tailp->reserved;
+	plp->tailp->written = plp->tailp->reserved;
+	plp->tailp->committed = plp->tailp->reserved;
+	if (plp->is_pmem)
+		pmem_persist(&plp->write_offset, 2 * sizeof(uint64_t));
+	else
+		pmem_msync(&plp->write_offset, 2 * sizeof(uint64_t));
+
+	if (plp->indexed) {
+		plp->index_count = 0;
+		plp->tailp->index_next = 0;
+		if (plp->is_pmem)
+			pmem_persist(&plp->index_count, sizeof(uint64_t));
+		else
+			pmem_msync(&plp->index_count, sizeof(uint64_t));
+	}
+
+	/* set the write-protection again (debug version only) */
+	RANGE_RO((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	util_mutex_unlock(&plp->tailp->readers_lock);
 	util_rwlock_unlock(plp->rwlockp);
 }
 
+/*
+ * pmemlog_head -- return the position of the first valid byte of a log
+ *	memory pool
+ */
+long long
+pmemlog_head(PMEMlogpool *plp)
+{
+	LOG(3, "plp %p", plp);
+
+	util_mutex_lock(&plp->tailp->readers_lock);
+	long long hp = (long long)(plp->tailp->head -
+			le64toh(plp->start_offset));
+	util_mutex_unlock(&plp->tailp->readers_lock);
+
+	LOG(4, "head offset %lld", hp);
+
+	return hp;
+}
+
+/*
+ * pmemlog_truncate_head -- discard the data before position off, releasing
+ *	its space for reuse in a ring log memory pool
+ */
+int
+pmemlog_truncate_head(PMEMlogpool *plp, long long off)
+{
+	LOG(3, "plp %p off %lld", plp, off);
+
+	if (plp->rdonly) {
+		ERR("can't truncate read-only log");
+		errno = EROFS;
+		return -1;
+	}
+
+	if (!plp->ring) {
+		ERR("not a ring log");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	/* no append may be in progress while the head moves */
+	if ((errno = pthread_rwlock_wrlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_wrlock");
+		return -1;
+	}
+
+	uint64_t head = le64toh(plp->start_offset) + (uint64_t)off;
+
+	if (off < 0 || head < le64toh(plp->head_offset) ||
+			head > le64toh(plp->write_offset)) {
+		util_rwlock_unlock(plp->rwlockp);
+		ERR("invalid offset %lld", off);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* unprotect the pool descriptor (debug version only) */
+	RANGE_RW((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	plp->head_offset = htole64(head);
+	if (plp->is_pmem)
+		pmem_persist(&plp->head_offset, sizeof(uint64_t));
+	else
+		pmem_msync(&plp->head_offset, sizeof(uint64_t));
+
+	/* set the write-protection again (debug version only) */
+	RANGE_RO((char *)plp->addr + sizeof(struct pool_hdr),
+			LOG_FORMAT_DATA_ALIGN);
+
+	/*
+	 * The space may be reused only once the new head is persistent, and
+	 * not before the readers in progress are done with it.
+	 */
+	util_mutex_lock(&plp->tailp->readers_lock);
+	plp->tailp->head = head;
+	util_mutex_unlock(&plp->tailp->readers_lock);
+
+	util_rwlock_unlock(plp->rwlockp);
+
+	return 0;
+}
+
+/*
+ * pmemlog_seek -- return the position of the closest record boundary at or
+ *	before position off known to the index of a log memory pool
+ *
+ * Without an index, the head of the log is the only known boundary.
+ */
+long long
+pmemlog_seek(PMEMlogpool *plp, long long off)
+{
+	LOG(3, "plp %p off %lld", plp, off);
+
+	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
+		ERR("!pthread_rwlock_rdlock");
+		return -1;
+	}
+
+	uint64_t start = le64toh(plp->start_offset);
+	uint64_t pos = start + (uint64_t)off;
+	uint64_t found = plp->tailp->head;
+
+	if (off < 0 || pos < found || pos > le64toh(plp->write_offset)) {
+		util_rwlock_unlock(plp->rwlockp);
+		ERR("invalid offset %lld", off);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (plp->indexed) {
+		uint64_t nentries;
+		uint64_t *index = pmemlog_index(plp, &nentries);
+
+		/* the index is appended to with the tail lock held */
+		util_mutex_lock(&plp->tailp->lock);
+
+		uint64_t count = le64toh(plp->index_count);
+		uint64_t first = count > nentries ? count - nentries : 0;
+		uint64_t lo = first;
+		uint64_t hi = count;
+
+		/* find the first entry past pos */
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			if (le64toh(index[mid % nentries]) <= pos)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		/* entries before the head of a ring log are stale */
+		if (lo > first)
+			found = MAX(found,
+				le64toh(index[(lo - 1) % nentries]));
+
+		util_mutex_unlock(&plp->tailp->lock);
+	}
+
+	util_rwlock_unlock(plp->rwlockp);
+
+	LOG(4, "found %ju", found - start);
+
+	return (long long)(found - start);
+}
+
 /*
  * pmemlog_walk -- walk through all data in a log memory pool
  *
  * chunksize of 0 means process_chunk gets called once for all data
- * as a single chunk.
+ * as a single chunk, or once for each of the two parts of the data
+ * which wrapped around the end of a ring log.
  */
 void
 pmemlog_walk(PMEMlogpool *plp, size_t chunksize,
@@ -601,24 +1653,27 @@ pmemlog_walk(PMEMlogpool *plp, size_t chunksize,
 
 	/*
 	 * We are assuming that the walker doesn't change the data it's reading
-	 * in place. We prevent everyone from changing the data behind our back
-	 * until we are done with processing it.
+	 * in place. The data published so far is walked, while the appends
+	 * go on; it can't be overwritten until we are done with processing it.
 	 */
-	if ((errno = pthread_rwlock_rdlock(plp->rwlockp))) {
-		ERR("!pthread_rwlock_rdlock");
-		return;
-	}
+	uint64_t data_offset;
+	uint64_t write_offset;
+	pmemlog_read_begin(plp, &data_offset, &write_offset);
 
-	char *data = plp->addr;
-	uint64_t write_offset = le64toh(plp->write_offset);
-	uint64_t data_offset = le64toh(plp->start_offset);
+	char *chunk = NULL;	/* a chunk which wrapped around, if any */
 	size_t len;
 
 	if (chunksize == 0) {
 		/* most common case: process everything at once */
 		len = write_offset - data_offset;
 		LOG(3, "length %zu", len);
-		(*process_chunk)(&data[data_offset], len, arg);
+		size_t contig;
+		char *data = pmemlog_data(plp, data_offset, len, &contig);
+		if ((*process_chunk)(data, contig, arg) && contig < len) {
+			data = pmemlog_data(plp, data_offset + contig,
+					len - contig, &len);
+			(*process_chunk)(data, len, arg);
+		}
 	} else {
 		/*
 		 * Walk through the complete record, chunk by chunk.
@@ -626,13 +1681,31 @@ pmemlog_walk(PMEMlogpool *plp, size_t chunksize,
 		 */
 		while (data_offset < write_offset) {
 			len = MIN(chunksize, write_offset - data_offset);
-			if (!(*process_chunk)(&data[data_offset], len, arg))
+			size_t contig;
+			char *data = pmemlog_data(plp, data_offset, len,
+					&contig);
+			if (contig < len) {
+				if (chunk == NULL &&
+					(chunk = Malloc(chunksize)) == NULL) {
+					ERR("!Malloc for a log chunk");
+					break;
+				}
+				size_t rest;
+				memcpy(chunk, data, contig);
+				data = pmemlog_data(plp, data_offset + contig,
+						len - contig, &rest);
+				memcpy(chunk + contig, data, rest);
+				data = chunk;
+			}
+			if (!(*process_chunk)(data, len, arg))
 				break;
 			data_offset += chunksize;
 		}
 	}
 
-	util_rwlock_unlock(plp->rwlockp);
+	Free(chunk);
+
+	pmemlog_read_end(plp);
 }
 
 /*
@@ -662,7 +1735,7 @@ pmemlog_check(const char *path)
 		consistent = 0;
 	}
 
-	if (hdr_end != plp->size) {
+	if (hdr_end != pmemlog_data_end(plp, plp->size)) {
 		ERR("wrong value of end_offset");
 		consistent = 0;
 	}
@@ -672,14 +1745,33 @@ pmemlog_check(const char *path)
 		consistent = 0;
 	}
 
-	if (hdr_start > hdr_write) {
-		ERR("start_offset greater than write_offset");
-		consistent = 0;
-	}
+	if (plp->ring) {
+		uint64_t hdr_head = le64toh(plp->head_offset);
 
-	if (hdr_write > hdr_end) {
-		ERR("write_offset greater than end_offset");
-		consistent = 0;
+		if (hdr_start > hdr_head) {
+			ERR("start_offset greater than head_offset");
+			consistent = 0;
+		}
+
+		if (hdr_head > hdr_write) {
+			ERR("head_offset greater than write_offset");
+			consistent = 0;
+		}
+
+		if (hdr_write - hdr_head > hdr_end - hdr_start) {
+			ERR("more data than log space");
+			consistent = 0;
+		}
+	} else {
+		if (hdr_start > hdr_write) {
+			ERR("start_offset greater than write_offset");
+			consistent = 0;
+		}
+
+		if (hdr_write > hdr_end) {
+			ERR("write_offset greater than end_offset");
+			consistent = 0;
+		}
 	}
 
 	pmemlog_close(plp);
@@ -699,6 +1791,9 @@ pmemlog_convert2h(struct pmemlog *plp)
 	plp->start_offset = le64toh(plp->start_offset);
 	plp->end_offset = le64toh(plp->end_offset);
 	plp->write_offset = le64toh(plp->write_offset);
+	plp->head_offset = le64toh(plp->head_offset);
+	plp->index_interval = le64toh(plp->index_interval);
+	plp->index_count = le64toh(plp->index_count);
 }
 
 /*
@@ -710,6 +1805,9 @@ pmemlog_convert2le(struct pmemlog *plp)
 	plp->start_offset = htole64(plp->start_offset);
 	plp->end_offset = htole64(plp->end_offset);
 	plp->write_offset = htole64(plp->write_offset);
+	plp->head_offset = htole64(plp->head_offset);
+	plp->index_interval = htole64(plp->index_interval);
+	plp->index_count = htole64(plp->index_count);
 }
 
 #ifdef _MSC_VER
@@ -52,6 +52,89 @@
 #define LOG_FORMAT_INCOMPAT 0x0000
 #define LOG_FORMAT_RO_COMPAT 0x0000
 
+/*
+ * The log is a ring buffer: write_offset and head_offset are positions
+ * which grow without bound, the data at position pos is stored at
+ * start_offset + (pos - start_offset) % (end_offset - start_offset).
+ */
+#define LOG_FORMAT_INCOMPAT_RING 0x0001
+
+/*
+ * The log keeps a sparse index of record boundaries: the position of the
+ * first append starting at or past each multiple of index_interval is
+ * stored in an array of 64-bit entries between end_offset and the end of
+ * the pool.  The array is used as a ring buffer, index_count is the number
+ * of entries ever added to it.
+ */
+#define LOG_FORMAT_INCOMPAT_INDEX 0x0002
+
+/*
+ * Each append is stored as a record framed by a struct log_frame, which
+ * holds the length of the appended data and its CRC32C checksum.
+ */
+#define LOG_FORMAT_INCOMPAT_FRAMED 0x0004
+
+/* all of the incompat features known to this version */
+#define LOG_FORMAT_INCOMPAT_SUPPORTED\
+	(LOG_FORMAT_INCOMPAT_RING | LOG_FORMAT_INCOMPAT_INDEX |\
+	LOG_FORMAT_INCOMPAT_FRAMED)
+
+/* the smallest interval between index entries, in bytes */
+#define LOG_INDEX_MIN_INTERVAL 4096
+
+/*
+ * The header of a record of a framed log.  The checksum covers the length
+ * field, as stored, followed by the data.  Both fields are little-endian.
+ */
+struct log_frame {
+	uint32_t len;		/* length of the data following the header */
+	uint32_t crc;		/* CRC32C of the length and the data */
+};
+
+/* the data of a record is checksummed in pieces which stay in the cache */
+#define LOG_FRAME_PIECE 8192
+
+#define PMEMLOG_GROUP_COMMIT_VAR "PMEMLOG_GROUP_COMMIT_USEC"
+
+/* appends in a batch which don't need a state allocated on the heap */
+#define LOG_BATCH_STACK 16
+
+/* upper bound of the group commit delay, in microseconds */
+#define LOG_GROUP_COMMIT_MAX 1000000
+
+/*
+ * Run-time state of concurrent appends.  Appenders reserve space by moving
+ * the volatile tail and mark their data as written in the order in which
+ * the space was reserved.  One of them at a time (the leader) commits all
+ * of the written data by updating the persistent write_offset.
+ */
+struct pmemlog_tail {
+	uint64_t volatile reserved;	/* end of the reserved space */
+	uint64_t head;			/* current value of head_offset */
+	uint64_t written;		/* end of the persistent data */
+	uint64_t committed;		/* current value of write_offset */
+	int committing;			/* true while a leader is committing */
+	uint64_t index_next;		/* next position to be indexed */
+	pthread_mutex_t lock;		/* protects the fields above */
+	pthread_cond_t cond;		/* signaled when they change */
+
+	/*
+	 * Readers of the data don't take the RW lock.  Instead, they keep
+	 * the space from the head at the time the first of them began
+	 * (the pin) from being reused by the appends to a ring log.
+	 */
+	unsigned nreaders;		/* walks and reads in progress */
+	uint64_t volatile pin;		/* UINT64_MAX without readers */
+	pthread_mutex_t readers_lock;	/* protects the head and the above */
+	pthread_cond_t readers_cond;	/* signaled when readers are gone */
+#ifdef DEBUG
+	/* held during append mprotected sections */
+	pthread_mutex_t write_lock;
+	/* reservations not committed yet, the log space stays writable */
+	unsigned nopen;
+#endif
+};
+
 struct pmemlog {
 	struct pool_hdr hdr;	/* memory pool header */
 
@@ -59,13 +142,20 @@ struct pmemlog {
 	uint64_t start_offset;	/* start offset of the usable log space */
 	uint64_t end_offset;	/* maximum offset of the usable log space */
 	uint64_t write_offset;	/* current write point for the log */
+	uint64_t head_offset;	/* first valid byte of a ring log */
+	uint64_t index_interval; /* bytes between index entries */
+	uint64_t index_count;	/* number of index entries added */
 
 	/* some run-time state, allocated out of memory pool... */
 	void *addr;			/* mapped region */
 	size_t size;			/* size of mapped region */
 	int is_pmem;			/* true if pool is PMEM */
 	int rdonly;			/* true if pool is opened read-only */
+	int ring;			/* true if the log is a ring buffer */
+	int indexed;			/* true if the log has an index */
+	int framed;			/* true if the appends are framed */
 	pthread_rwlock_t *rwlockp;	/* pointer to RW lock */
+	struct pmemlog_tail *tailp;	/* state of concurrent appends */
 
 	struct pool_set *set;		/* pool set info */
 };
@@ -73,5 +163,11 @@ struct pmemlog {
 /* data area starts at this alignment after the struct pmemlog above */
 #define LOG_FORMAT_DATA_ALIGN ((uintptr_t)4096)
 
+void log_init(void);
+uint64_t pmemlog_index_size(uint64_t poolsize, uint64_t interval);
+char *pmemlog_data(struct pmemlog *plp, uint64_t pos, size_t len,
+	size_t *contig);
+void pmemlog_read_begin(struct pmemlog *plp, uint64_t *head, uint64_t *end);
+void pmemlog_read_end(struct pmemlog *plp);
 void pmemlog_convert2h(struct pmemlog *plp);
 void pmemlog_convert2le(struct pmemlog *plp);
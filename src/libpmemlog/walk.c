@@ -0,0 +1,475 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * walk.c -- cursors and parallel walks over the data of a log memory pool
+ *
+ * A cursor copies the data out of the log one call at a time, registered
+ * as a reader only for the duration of each call.  A parallel walk splits
+ * the log into record-aligned ranges of contiguous data first, and then
+ * hands them to worker threads.  The records of a framed log are walked
+ * one at a time, each verified against its checksum.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <endian.h>
+#include <sys/param.h>
+
+#include "libpmemlog.h"
+
+#include "out.h"
+#include "util.h"
+#include "log.h"
+#include "crc32c.h"
+#include "sys_util.h"
+
+/* the beginning of a record which wraps around is passed through a copy */
+#define LOG_WALK_BOUNCE 4096
+
+struct pmemlogcursor {
+	PMEMlogpool *plp;
+	uint64_t pos;		/* position of the next byte to read */
+};
+
+struct walk_range {
+	const char *buf;	/* record-aligned, contiguous data */
+	size_t len;
+	int copied;		/* buf is a copy of a record which wraps */
+};
+
+struct walk_state {
+	struct walk_range *ranges;
+	unsigned nranges;
+	unsigned maxranges;
+	unsigned volatile next;	/* index of the next range to process */
+	int volatile stop;	/* set when a callback ends the walk */
+	int (*process_chunk)(const void *buf, size_t len, void *arg);
+	void *arg;
+};
+
+/*
+ * walk_copy_out -- (internal) copy len bytes of the log data at position pos
+ */
+static void
+walk_copy_out(PMEMlogpool *plp, uint64_t pos, void *buf, size_t len)
+{
+	char *dest = buf;
+
+	while (len) {
+		size_t contig;
+		const char *data = pmemlog_data(plp, pos, len, &contig);
+		memcpy(dest, data, contig);
+		pos += contig;
+		dest += contig;
+		len -= contig;
+	}
+}
+
+/*
+ * pmemlog_cursor_new -- create a cursor at position off of a log memory pool
+ */
+PMEMlogcursor *
+pmemlog_cursor_new(PMEMlogpool *plp, long long off)
+{
+	LOG(3, "plp %p off %lld", plp, off);
+
+	uint64_t head;
+	uint64_t end;
+	pmemlog_read_begin(plp, &head, &end);
+	pmemlog_read_end(plp);
+
+	uint64_t pos = le64toh(plp->start_offset) + (uint64_t)off;
+
+	if (off < 0 || pos < head || pos > end) {
+		ERR("invalid offset %lld", off);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	PMEMlogcursor *cur = Malloc(sizeof(*cur));
+	if (cur == NULL) {
+		ERR("!Malloc for a log cursor");
+		return NULL;
+	}
+
+	cur->plp = plp;
+	cur->pos = pos;
+
+	return cur;
+}
+
+/*
+ * pmemlog_cursor_next -- copy up to count bytes of data from the cursor
+ *	position and advance the cursor past them
+ *
+ * Returns the number of bytes copied, which is 0 at the end of the log.
+ */
+ssize_t
+pmemlog_cursor_next(PMEMlogcursor *cur, void *buf, size_t count)
+{
+	LOG(3, "cur %p buf %p count %zu", cur, buf, count);
+
+	PMEMlogpool *plp = cur->plp;
+
+	uint64_t head;
+	uint64_t write_offset;
+	pmemlog_read_begin(plp, &head, &write_offset);
+
+	/* the log could have been truncated or rewound since the last call */
+	if (cur->pos < head || cur->pos > write_offset) {
+		pmemlog_read_end(plp);
+		ERR("data at the cursor discarded");
+		errno = ENODATA;
+		return -1;
+	}
+
+	size_t len = MIN(count, write_offset - cur->pos);
+	walk_copy_out(plp, cur->pos, buf, len);
+	cur->pos += len;
+
+	pmemlog_read_end(plp);
+
+	return (ssize_t)len;
+}
+
+/*
+ * pmemlog_cursor_delete -- free a cursor
+ */
+void
+pmemlog_cursor_delete(PMEMlogcursor *cur)
+{
+	LOG(3, "cur %p", cur);
+
+	Free(cur);
+}
+
+/*
+ * walk_add -- (internal) add a range to a parallel walk
+ */
+static int
+walk_add(struct walk_state *ws, const char *buf, size_t len, int copied)
+{
+	if (len == 0)
+		return 0;
+
+	if (ws->nranges == ws->maxranges) {
+		unsigned maxranges = ws->maxranges ? 2 * ws->maxranges : 16;
+		struct walk_range *ranges = Realloc(ws->ranges,
+				maxranges * sizeof(*ranges));
+		if (ranges == NULL) {
+			ERR("!Realloc for log walk ranges");
+			return -1;
+		}
+
+		ws->ranges = ranges;
+		ws->maxranges = maxranges;
+	}
+
+	ws->ranges[ws->nranges].buf = buf;
+	ws->ranges[ws->nranges].len = len;
+	ws->ranges[ws->nranges].copied = copied;
+	ws->nranges++;
+
+	return 0;
+}
+
+/*
+ * walk_add_log -- (internal) add a range of contiguous log data to a parallel
+ *	walk
+ */
+static int
+walk_add_log(struct walk_state *ws, PMEMlogpool *plp, uint64_t pos,
+	size_t len)
+{
+	size_t contig;
+	const char *data = pmemlog_data(plp, pos, len, &contig);
+
+	ASSERTeq(contig, len);
+
+	return walk_add(ws, data, len, 0);
+}
+
+/*
+ * walk_split -- (internal) split the log into record-aligned ranges of
+ *	contiguous data, about the size of 1/nthreads of the log each
+ *
+ * A record which wraps around the end of a ring log is copied to a range of
+ * its own.  The data from pos to end should be registered for reading.
+ */
+static int
+walk_split(PMEMlogpool *plp, uint64_t pos, uint64_t end, unsigned nthreads,
+	size_t (*record_size)(const void *buf, size_t len, void *arg),
+	struct walk_state *ws)
+{
+	uint64_t target = (end - pos + nthreads - 1) / nthreads;
+	uint64_t first = pos;	/* start of the current range */
+	char bounce[LOG_WALK_BOUNCE];
+
+	while (pos < end) {
+		size_t contig;
+		const char *data = pmemlog_data(plp, pos, end - pos, &contig);
+		size_t len = contig;
+
+		if (contig < end - pos && contig < LOG_WALK_BOUNCE) {
+			len = MIN(end - pos, LOG_WALK_BOUNCE);
+			walk_copy_out(plp, pos, bounce, len);
+			data = bounce;
+		}
+
+		size_t size = record_size(data, len, ws->arg);
+		if (size == 0 || size > end - pos) {
+			ERR("invalid record size %zu at offset %ju", size,
+				pos - le64toh(plp->start_offset));
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (size > contig) {
+			/* the record wraps around the end of the log space */
+			if (walk_add_log(ws, plp, first, pos - first))
+				return -1;
+
+			char *rec = Malloc(size);
+			if (rec == NULL) {
+				ERR("!Malloc for a log record");
+				return -1;
+			}
+
+			walk_copy_out(plp, pos, rec, size);
+			if (walk_add(ws, rec, size, 1)) {
+				Free(rec);
+				return -1;
+			}
+
+			pos += size;
+			first = pos;
+			continue;
+		}
+
+		pos += size;
+
+		/* close the range when it's big enough or can't grow */
+		if (pos - first >= target || size == contig) {
+			if (walk_add_log(ws, plp, first, pos - first))
+				return -1;
+			first = pos;
+		}
+	}
+
+	return walk_add_log(ws, plp, first, pos - first);
+}
+
+/*
+ * walk_worker -- (internal) process the ranges of a parallel walk
+ */
+static void *
+walk_worker(void *arg)
+{
+	struct walk_state *ws = arg;
+
+	while (!ws->stop) {
+		unsigned i = __sync_fetch_and_add(&ws->next, 1);
+		if (i >= ws->nranges)
+			break;
+
+		if (!(*ws->process_chunk)(ws->ranges[i].buf, ws->ranges[i].len,
+				ws->arg))
+			ws->stop = 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * pmemlog_walk_parallel -- walk through all data in a log memory pool with
+ *	nthreads threads, passing record-aligned ranges of data to process_chunk
+ *
+ * record_size returns the size of the record at the beginning of buf.
+ */
+int
+pmemlog_walk_parallel(PMEMlogpool *plp, unsigned nthreads,
+	size_t (*record_size)(const void *buf, size_t len, void *arg),
+	int (*process_chunk)(const void *buf, size_t len, void *arg),
+	void *arg)
+{
+	LOG(3, "plp %p nthreads %u", plp, nthreads);
+
+	if (nthreads == 0) {
+		ERR("invalid number of threads");
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* as in pmemlog_walk(), the data must not change behind our back */
+	uint64_t head;
+	uint64_t end;
+	pmemlog_read_begin(plp, &head, &end);
+
+	struct walk_state ws;
+	memset(&ws, 0, sizeof(ws));
+	ws.process_chunk = process_chunk;
+	ws.arg = arg;
+
+	int ret = walk_split(plp, head, end, nthreads, record_size, &ws);
+	if (ret == 0) {
+		unsigned nworkers = MIN(nthreads, ws.nranges);
+		pthread_t *threads = NULL;
+		unsigned i = 0;
+
+		/* the calling thread is one of the workers */
+		if (nworkers > 1 &&
+			(threads = Malloc((nworkers - 1) * sizeof(*threads)))) {
+			for (; i < nworkers - 1; i++) {
+				if ((errno = pthread_create(&threads[i], NULL,
+						walk_worker, &ws))) {
+					LOG(2, "!pthread_create");
+					break;
+				}
+			}
+		}
+
+		walk_worker(&ws);
+
+		while (i--)
+			pthread_join(threads[i], NULL);
+
+		Free(threads);
+	}
+
+	pmemlog_read_end(plp);
+
+	for (unsigned i = 0; i < ws.nranges; i++) {
+		if (ws.ranges[i].copied)
+			Free((void *)ws.ranges[i].buf);
+	}
+
+	Free(ws.ranges);
+
+	return ret;
+}
+
+/*
+ * pmemlog_walk_records -- walk the records of a framed log memory pool
+ *
+ * Each record is verified against its checksum before it's passed to
+ * process_record, as a single buffer, even if it wraps around the end of
+ * a ring log.  Returns 0 at the end of the log or when process_record
+ * returns 0, or -1 with errno set to EBADMSG at the first corrupted record.
+ */
+int
+pmemlog_walk_records(PMEMlogpool *plp,
+	int (*process_record)(const void *buf, size_t len, void *arg),
+	void *arg)
+{
+	LOG(3, "plp %p", plp);
+
+	if (!plp->framed) {
+		ERR("not a framed log");
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint64_t pos;
+	uint64_t end;
+	pmemlog_read_begin(plp, &pos, &end);
+
+	char *bounce = NULL;	/* copy of the last record which wrapped */
+	size_t bounce_size = 0;
+	int ret = 0;
+
+	while (pos < end) {
+		struct log_frame frame;
+
+		if (end - pos < sizeof(frame)) {
+			ret = EBADMSG;
+			break;
+		}
+
+		walk_copy_out(plp, pos, &frame, sizeof(frame));
+		size_t len = le32toh(frame.len);
+
+		if (len > end - pos - sizeof(frame)) {
+			ret = EBADMSG;
+			break;
+		}
+
+		size_t contig;
+		const char *data = pmemlog_data(plp, pos + sizeof(frame), len,
+				&contig);
+
+		if (contig < len) {
+			if (len > bounce_size) {
+				char *nbounce = Realloc(bounce, len);
+				if (nbounce == NULL) {
+					ret = errno;
+					ERR("!Realloc for a log record");
+					break;
+				}
+				bounce = nbounce;
+				bounce_size = len;
+			}
+
+			walk_copy_out(plp, pos + sizeof(frame), bounce, len);
+			data = bounce;
+		}
+
+		uint32_t crc = crc32c(crc32c(0, &frame.len, sizeof(frame.len)),
+				data, len);
+		if (crc != le32toh(frame.crc)) {
+			ret = EBADMSG;
+			break;
+		}
+
+		pos += sizeof(frame) + len;
+
+		if (!(*process_record)(data, len, arg))
+			break;
+	}
+
+	pmemlog_read_end(plp);
+
+	Free(bounce);
+
+	if (ret == EBADMSG)
+		ERR("corrupted record at offset %ju",
+			pos - le64toh(plp->start_offset));
+
+	if (ret) {
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * arena.c -- arenas of short-lived persistent objects
+ *
+ * An arena is a single object, usually large enough to be taken directly
+ * from the huge chunks of the heap, which is carved into smaller objects by
+ * bumping the offset of its first free byte. Allocating from an arena takes
+ * a single atomic increment and a persist of the offset, which is the
+ * high-water mark of the arena, and all of its objects are freed at once by
+ * freeing the arena itself.
+ */
+
+#include <errno.h>
+
+#include "obj.h"
+#include "out.h"
+#include "util.h"
+
+/* alignment of the objects allocated from an arena */
+#define ARENA_ALIGN 16
+#define ARENA_ALIGN_UP(_size) (((_size) + ARENA_ALIGN - 1) &\
+	~(ARENA_ALIGN - 1ULL))
+
+struct arena_hdr {
+	uint64_t size; /* number of bytes available for the objects */
+	uint64_t used; /* offset of the first free byte of the data */
+	uint8_t unused[_POBJ_CL_ALIGNMENT - 2 * sizeof(uint64_t)];
+};
+
+/*
+ * arena_constr -- (internal) initializes the header of a new arena
+ */
+static int
+arena_constr(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct arena_hdr *hdr = ptr;
+
+	hdr->size = *(size_t *)arg;
+	hdr->used = 0;
+	pmemops_persist(&pop->p_ops, hdr, sizeof(*hdr));
+
+	return 0;
+}
+
+/*
+ * pmemobj_arena_create -- allocates an arena of the given size
+ */
+int
+pmemobj_arena_create(PMEMobjpool *pop, PMEMoid *arenap, size_t size,
+	uint64_t type_num)
+{
+	LOG(3, "pop %p arenap %p size %zu type_num %llx", pop, arenap, size,
+		(unsigned long long)type_num);
+
+	if (size == 0) {
+		ERR("arena with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE - sizeof(struct arena_hdr)) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return pmemobj_alloc(pop, arenap, sizeof(struct arena_hdr) + size,
+		type_num, arena_constr, &size);
+}
+
+/*
+ * pmemobj_arena_alloc -- allocates an object from the arena
+ *
+ * The object isn't a separate object of the heap, it can't be freed or
+ * resized on its own, and it's freed only along with the whole arena.
+ */
+PMEMoid
+pmemobj_arena_alloc(PMEMobjpool *pop, PMEMoid arena, size_t size)
+{
+	LOG(3, "pop %p arena.off 0x%016jx size %zu", pop, arena.off, size);
+
+	ASSERT(OBJ_OID_IS_VALID(pop, arena));
+
+	struct arena_hdr *hdr = OBJ_OFF_TO_PTR(pop, arena.off);
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return OID_NULL;
+	}
+
+	if (size > hdr->size) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return OID_NULL;
+	}
+
+	uint64_t asize = ARENA_ALIGN_UP(size);
+
+	/* don't overshoot the high-water mark if the arena is already full */
+	if (hdr->used + asize > hdr->size) {
+		ERR("arena exhausted");
+		errno = ENOMEM;
+		return OID_NULL;
+	}
+
+	/* a racing allocation which didn't fit leaves the arena full */
+	uint64_t off = __sync_fetch_and_add(&hdr->used, asize);
+	if (off + asize > hdr->size) {
+		ERR("arena exhausted");
+		errno = ENOMEM;
+		return OID_NULL;
+	}
+
+	/* the object can't be reused after a restart once it's linked */
+	pmemops_persist(&pop->p_ops, &hdr->used, sizeof(hdr->used));
+
+	PMEMoid oid = {
+		.pool_uuid_lo = pop->uuid_lo,
+		.off = arena.off + sizeof(struct arena_hdr) + off
+	};
+
+	return oid;
+}
@@ -42,11 +42,16 @@
  * creation.
  */
 
+#include <errno.h>
+#include <sys/queue.h>
+
 #include "bucket.h"
 #include "ctree.h"
+#include "cuckoo.h"
 #include "heap.h"
 #include "out.h"
 #include "sys_util.h"
+#include "util.h"
 #include "valgrind_internal.h"
 
 /*
@@ -89,6 +94,70 @@ bucket_vg_mark_noaccess(struct palloc_heap *heap, struct block_container *bc,
 }
 #endif
 
+/*
+ * bucket_occupancy_bin -- (internal) returns the occupancy histogram bin of
+ *	a run with the given number of free units
+ */
+static unsigned
+bucket_occupancy_bin(struct bucket_run_stats *s, unsigned nfree)
+{
+	ASSERT(nfree <= s->nallocs);
+
+	unsigned bin = (s->nallocs - nfree) * BUCKET_OCCUPANCY_BINS /
+		s->nallocs;
+
+	return bin < BUCKET_OCCUPANCY_BINS ? bin : BUCKET_OCCUPANCY_BINS - 1;
+}
+
+/*
+ * bucket_stats_update -- (internal) accounts a memory block inserted into
+ *	or removed from the container
+ *
+ * The counters are only ever modified atomically, which lets them be read
+ * at any time without taking the container or bucket locks.
+ */
+static void
+bucket_stats_update(struct block_container *bc, struct memory_block m,
+	int inserted)
+{
+	if (inserted) {
+		__sync_fetch_and_add(&bc->nblocks, 1);
+		__sync_fetch_and_add(&bc->nunits, m.size_idx);
+	} else {
+		__sync_fetch_and_sub(&bc->nblocks, 1);
+		__sync_fetch_and_sub(&bc->nunits, m.size_idx);
+	}
+
+	struct bucket_run_stats *s = bc->run_stats;
+	if (s == NULL || s->run_free[m.zone_id] == NULL)
+		return;
+
+	uint16_t *run_free = &s->run_free[m.zone_id][m.chunk_id];
+	uint16_t size_idx = (uint16_t)m.size_idx;
+	unsigned old_free;
+	unsigned new_free;
+	if (inserted) {
+		old_free = __sync_fetch_and_add(run_free, size_idx);
+		new_free = old_free + size_idx;
+	} else {
+		old_free = __sync_fetch_and_sub(run_free, size_idx);
+		new_free = old_free - size_idx;
+	}
+
+	/* runs without free units are not tracked by the histogram */
+	unsigned old_bin = old_free == 0 ? BUCKET_OCCUPANCY_BINS :
+		bucket_occupancy_bin(s, old_free);
+	unsigned new_bin = new_free == 0 ? BUCKET_OCCUPANCY_BINS :
+		bucket_occupancy_bin(s, new_free);
+	if (old_bin == new_bin)
+		return;
+
+	if (new_bin != BUCKET_OCCUPANCY_BINS)
+		__sync_fetch_and_add(&s->occupancy[new_bin], 1);
+	if (old_bin != BUCKET_OCCUPANCY_BINS)
+		__sync_fetch_and_sub(&s->occupancy[old_bin], 1);
+}
+
 /*
  * bucket_tree_insert_block -- (internal) inserts a new memory block
  *	into the container
@@ -122,7 +191,19 @@ bucket_tree_insert_block(struct block_container *bc, struct palloc_heap *heap,
 	uint64_t key = CHUNK_KEY_PACK(m.zone_id, m.chunk_id, m.block_off,
 				m.size_idx);
 
-	return ctree_insert(c->tree, key, 0);
+	/*
+	 * The block is accounted for before it's inserted, a thread which
+	 * doesn't hold the bucket lock might put it back into the tree, see
+	 * heap_return_blocks, and it must not be removed from the counters
+	 * before it's added to them.
+	 */
+	bucket_stats_update(bc, m, 1);
+
+	int ret = ctree_insert(c->tree, key, 0);
+	if (ret != 0)
+		bucket_stats_update(bc, m, 0);
+
+	return ret;
 }
 
 /*
@@ -146,6 +227,8 @@ bucket_tree_get_rm_block_bestfit(struct block_container *bc,
 	m->block_off = CHUNK_KEY_GET_BLOCK_OFF(key);
 	m->size_idx = CHUNK_KEY_GET_SIZE_IDX(key);
 
+	bucket_stats_update(bc, *m, 0);
+
 	return 0;
 }
 
@@ -164,6 +247,8 @@ bucket_tree_get_rm_block_exact(struct block_container *bc,
 	if ((key = ctree_remove(c->tree, key, 1)) == 0)
 		return ENOMEM;
 
+	bucket_stats_update(bc, m, 0);
+
 	return 0;
 }
 
@@ -191,6 +276,22 @@ bucket_tree_is_empty(struct block_container *bc)
 	return ctree_is_empty(c->tree);
 }
 
+/*
+ * bucket_tree_get_max_size_idx -- (internal) returns the size of the largest
+ *	block in the container
+ */
+static uint32_t
+bucket_tree_get_max_size_idx(struct block_container *bc)
+{
+	struct block_container_ctree *c = (struct block_container_ctree *)bc;
+
+	/* the blocks are sorted by their size first */
+	uint64_t key = UINT64_MAX;
+	ctree_find_le(c->tree, &key);
+
+	return CHUNK_KEY_GET_SIZE_IDX(key);
+}
+
 /*
  * Tree-based block container used to provide best-fit functionality to the
  * bucket. The time complexity for this particular container is O(k) where k is
@@ -204,7 +305,8 @@ static struct block_container_ops container_ctree_ops = {
 	.get_rm_exact = bucket_tree_get_rm_block_exact,
 	.get_rm_bestfit = bucket_tree_get_rm_block_bestfit,
 	.get_exact = bucket_tree_get_block_exact,
-	.is_empty = bucket_tree_is_empty
+	.is_empty = bucket_tree_is_empty,
+	.get_max_size_idx = bucket_tree_get_max_size_idx
 };
 
 /*
@@ -219,6 +321,9 @@ bucket_tree_create(size_t unit_size)
 
 	bc->super.type = CONTAINER_CTREE;
 	bc->super.unit_size = unit_size;
+	bc->super.nblocks = 0;
+	bc->super.nunits = 0;
+	bc->super.run_stats = NULL;
 
 	bc->tree = ctree_new();
 	if (bc->tree == NULL)
@@ -244,6 +349,400 @@ bucket_tree_delete(struct block_container *bc)
 	Free(bc);
 }
 
+/*
+ * The segregated lists container classifies the blocks by their size index,
+ * every power of two range is split into SEGLISTS_SL_COUNT classes (sizes
+ * smaller than SEGLISTS_SL_COUNT have a class of their own). Each class has
+ * a list of blocks and the non-empty classes are tracked by a two-level
+ * bitmap, so that the first class with blocks large enough for a request is
+ * found in constant time.
+ */
+#define SEGLISTS_SL_BITS 4
+#define SEGLISTS_SL_COUNT (1U << SEGLISTS_SL_BITS)
+#define SEGLISTS_FL_COUNT (16 - SEGLISTS_SL_BITS + 1)
+
+struct seglists_block {
+	LIST_ENTRY(seglists_block) next;
+	struct memory_block m;
+};
+
+struct block_container_seglists {
+	struct block_container super;
+	pthread_mutex_t lock;
+	uint32_t fl_bitmap; /* first levels with at least one non-empty list */
+	uint32_t sl_bitmap[SEGLISTS_FL_COUNT]; /* non-empty lists of a level */
+	LIST_HEAD(seglists_list, seglists_block)
+		lists[SEGLISTS_FL_COUNT][SEGLISTS_SL_COUNT];
+	struct cuckoo *blocks; /* position independent key -> block */
+};
+
+#define SEGLISTS_KEY(m)\
+CHUNK_KEY_PACK((m).zone_id, (m).chunk_id, (m).block_off, 0)
+
+/*
+ * seglists_class -- (internal) returns the class of the given size index
+ */
+static void
+seglists_class(uint32_t size_idx, unsigned *fl, unsigned *sl)
+{
+	if (size_idx < SEGLISTS_SL_COUNT) {
+		*fl = 0;
+		*sl = size_idx;
+		return;
+	}
+
+	unsigned msb = util_mssb_index64(size_idx);
+	*fl = msb - SEGLISTS_SL_BITS + 1;
+	*sl = (size_idx >> (msb - SEGLISTS_SL_BITS)) & (SEGLISTS_SL_COUNT - 1);
+}
+
+/*
+ * seglists_class_min -- (internal) returns the smallest size index of a class
+ */
+static uint32_t
+seglists_class_min(unsigned fl, unsigned sl)
+{
+	if (fl == 0)
+		return sl;
+
+	return (SEGLISTS_SL_COUNT + sl) << (fl - 1);
+}
+
+/*
+ * bucket_seglists_link -- (internal) puts block on the list of its class
+ */
+static void
+bucket_seglists_link(struct block_container_seglists *c,
+	struct seglists_block *b)
+{
+	unsigned fl;
+	unsigned sl;
+	seglists_class(b->m.size_idx, &fl, &sl);
+
+	LIST_INSERT_HEAD(&c->lists[fl][sl], b, next);
+	c->sl_bitmap[fl] |= 1U << sl;
+	c->fl_bitmap |= 1U << fl;
+}
+
+/*
+ * bucket_seglists_unlink -- (internal) removes block from the list of its
+ *	class
+ */
+static void
+bucket_seglists_unlink(struct block_container_seglists *c,
+	struct seglists_block *b)
+{
+	unsigned fl;
+	unsigned sl;
+	seglists_class(b->m.size_idx, &fl, &sl);
+
+	LIST_REMOVE(b, next);
+	if (LIST_EMPTY(&c->lists[fl][sl])) {
+		c->sl_bitmap[fl] &= ~(1U << sl);
+		if (c->sl_bitmap[fl] == 0)
+			c->fl_bitmap &= ~(1U << fl);
+	}
+}
+
+/*
+ * bucket_seglists_insert_block -- (internal) inserts a new memory block
+ *	into the container
+ */
+static int
+bucket_seglists_insert_block(struct block_container *bc,
+	struct palloc_heap *heap, struct memory_block m)
+{
+	ASSERT(m.chunk_id < MAX_CHUNK);
+	ASSERT(m.zone_id < UINT16_MAX);
+	ASSERTne(m.size_idx, 0);
+	ASSERT(m.size_idx <= UINT16_MAX);
+
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+#ifdef USE_VG_MEMCHECK
+	bucket_vg_mark_noaccess(heap, bc, m);
+#endif
+
+	struct seglists_block *b = Malloc(sizeof(*b));
+	if (b == NULL)
+		return ENOMEM;
+
+	b->m = m;
+
+	util_mutex_lock(&c->lock);
+
+	int ret = cuckoo_insert(c->blocks, SEGLISTS_KEY(m), b);
+	if (ret == 0) {
+		bucket_seglists_link(c, b);
+		bucket_stats_update(bc, m, 1);
+	}
+
+	util_mutex_unlock(&c->lock);
+
+	if (ret != 0)
+		Free(b);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_find_fit -- (internal) returns a block with at least
+ *	size_idx units, preferring the smallest class that can serve the request
+ *	without looking at the sizes of the individual blocks
+ */
+static struct seglists_block *
+bucket_seglists_find_fit(struct block_container_seglists *c,
+	uint32_t size_idx)
+{
+	unsigned fl;
+	unsigned sl;
+	seglists_class(size_idx, &fl, &sl);
+
+	unsigned req_fl = fl;
+	unsigned req_sl = sl;
+
+	/* not every block in the class of the request is large enough */
+	if (seglists_class_min(fl, sl) != size_idx &&
+			++sl == SEGLISTS_SL_COUNT) {
+		sl = 0;
+		fl++;
+	}
+
+	uint32_t sl_map = fl < SEGLISTS_FL_COUNT ?
+		c->sl_bitmap[fl] & (UINT32_MAX << sl) : 0;
+	if (sl_map == 0) {
+		uint32_t fl_map = fl + 1 < SEGLISTS_FL_COUNT ?
+			c->fl_bitmap & (UINT32_MAX << (fl + 1)) : 0;
+		if (fl_map != 0) {
+			fl = util_lssb_index64(fl_map);
+			sl_map = c->sl_bitmap[fl];
+		}
+	}
+
+	if (sl_map != 0)
+		return LIST_FIRST(&c->lists[fl][util_lssb_index64(sl_map)]);
+
+	/* the only candidates are the larger blocks in the class of request */
+	struct seglists_block *b;
+	LIST_FOREACH(b, &c->lists[req_fl][req_sl], next) {
+		if (b->m.size_idx >= size_idx)
+			return b;
+	}
+
+	return NULL;
+}
+
+/*
+ * bucket_seglists_get_rm_block_bestfit -- (internal) removes and returns
+ *	a memory block which fits the requested size
+ */
+static int
+bucket_seglists_get_rm_block_bestfit(struct block_container *bc,
+	struct memory_block *m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	util_mutex_lock(&c->lock);
+
+	struct seglists_block *b = bucket_seglists_find_fit(c, m->size_idx);
+	if (b != NULL) {
+		bucket_seglists_unlink(c, b);
+		cuckoo_remove(c->blocks, SEGLISTS_KEY(b->m));
+		bucket_stats_update(bc, b->m, 0);
+	}
+
+	util_mutex_unlock(&c->lock);
+
+	if (b == NULL)
+		return ENOMEM;
+
+	*m = b->m;
+	Free(b);
+
+	return 0;
+}
+
+/*
+ * bucket_seglists_get_rm_block_exact -- (internal) removes exact match memory
+ *	block
+ */
+static int
+bucket_seglists_get_rm_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	util_mutex_lock(&c->lock);
+
+	struct seglists_block *b = cuckoo_get(c->blocks, SEGLISTS_KEY(m));
+	if (b != NULL && b->m.size_idx == m.size_idx) {
+		bucket_seglists_unlink(c, b);
+		cuckoo_remove(c->blocks, SEGLISTS_KEY(m));
+		bucket_stats_update(bc, m, 0);
+	} else {
+		b = NULL;
+	}
+
+	util_mutex_unlock(&c->lock);
+
+	if (b == NULL)
+		return ENOMEM;
+
+	Free(b);
+
+	return 0;
+}
+
+/*
+ * bucket_seglists_get_block_exact -- (internal) finds exact match memory block
+ */
+static int
+bucket_seglists_get_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	util_mutex_lock(&c->lock);
+
+	struct seglists_block *b = cuckoo_get(c->blocks, SEGLISTS_KEY(m));
+	int ret = b != NULL && b->m.size_idx == m.size_idx ? 0 : ENOMEM;
+
+	util_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_is_empty -- (internal) checks whether the bucket is empty
+ */
+static int
+bucket_seglists_is_empty(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	util_mutex_lock(&c->lock);
+	int empty = c->fl_bitmap == 0;
+	util_mutex_unlock(&c->lock);
+
+	return empty;
+}
+
+/*
+ * bucket_seglists_get_max_size_idx -- (internal) returns the size of the
+ *	largest block in the container
+ */
+static uint32_t
+bucket_seglists_get_max_size_idx(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	uint32_t max = 0;
+
+	util_mutex_lock(&c->lock);
+
+	/* only the blocks of the largest non-empty class are compared */
+	if (c->fl_bitmap != 0) {
+		unsigned fl = util_mssb_index64(c->fl_bitmap);
+		unsigned sl = util_mssb_index64(c->sl_bitmap[fl]);
+
+		struct seglists_block *b;
+		LIST_FOREACH(b, &c->lists[fl][sl], next) {
+			if (b->m.size_idx > max)
+				max = b->m.size_idx;
+		}
+	}
+
+	util_mutex_unlock(&c->lock);
+
+	return max;
+}
+
+/*
+ * Segregated lists block container, which provides good-fit functionality to
+ * the bucket in constant time. Unlike the tree-based container, blocks are
+ * not ordered by their address, a block of a class large enough for the
+ * request is returned even if a better fitting one exists in the class of
+ * the request itself, and the most recently inserted block of a class is
+ * used first.
+ */
+static struct block_container_ops container_seglists_ops = {
+	.insert = bucket_seglists_insert_block,
+	.get_rm_exact = bucket_seglists_get_rm_block_exact,
+	.get_rm_bestfit = bucket_seglists_get_rm_block_bestfit,
+	.get_exact = bucket_seglists_get_block_exact,
+	.is_empty = bucket_seglists_is_empty,
+	.get_max_size_idx = bucket_seglists_get_max_size_idx
+};
+
+/*
+ * bucket_seglists_create -- (internal) creates a new segregated lists
+ *	container
+ */
+static struct block_container *
+bucket_seglists_create(size_t unit_size)
+{
+	struct block_container_seglists *bc = Malloc(sizeof(*bc));
+	if (bc == NULL)
+		goto error_container_malloc;
+
+	bc->super.type = CONTAINER_SEGLISTS;
+	bc->super.unit_size = unit_size;
+	bc->super.nblocks = 0;
+	bc->super.nunits = 0;
+	bc->super.run_stats = NULL;
+
+	bc->fl_bitmap = 0;
+	for (unsigned fl = 0; fl < SEGLISTS_FL_COUNT; ++fl) {
+		bc->sl_bitmap[fl] = 0;
+		for (unsigned sl = 0; sl < SEGLISTS_SL_COUNT; ++sl)
+			LIST_INIT(&bc->lists[fl][sl]);
+	}
+
+	bc->blocks = cuckoo_new();
+	if (bc->blocks == NULL)
+		goto error_cuckoo_new;
+
+	util_mutex_init(&bc->lock, NULL);
+
+	return &bc->super;
+
+error_cuckoo_new:
+	Free(bc);
+
+error_container_malloc:
+	return NULL;
+}
+
+/*
+ * bucket_seglists_delete -- (internal) deletes a segregated lists container
+ */
+static void
+bucket_seglists_delete(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	for (unsigned fl = 0; fl < SEGLISTS_FL_COUNT; ++fl) {
+		for (unsigned sl = 0; sl < SEGLISTS_SL_COUNT; ++sl) {
+			struct seglists_block *b;
+			while ((b = LIST_FIRST(&c->lists[fl][sl])) != NULL) {
+				LIST_REMOVE(b, next);
+				Free(b);
+			}
+		}
+	}
+
+	cuckoo_delete(c->blocks);
+	util_mutex_destroy(&c->lock);
+	Free(bc);
+}
+
 static struct {
 	struct block_container_ops *ops;
 	struct block_container *(*create)(size_t unit_size);
@@ -251,6 +750,8 @@ static struct {
 } block_containers[MAX_CONTAINER_TYPE] = {
 	{NULL, NULL, NULL},
 	{&container_ctree_ops, bucket_tree_create, bucket_tree_delete},
+	{&container_seglists_ops, bucket_seglists_create,
+		bucket_seglists_delete},
 };
 
 /*
@@ -342,6 +843,7 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	b->super.type = BUCKET_RUN;
 	b->unit_max = unit_max;
 	b->unit_max_alloc = unit_max_alloc;
+	b->header_type = HEADER_LEGACY;
 
 	/*
 	 * Here the bitmap definition is calculated based on the size of the
@@ -356,17 +858,15 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	 * The two other numbers that define our bitmap is the size of the
 	 * array that represents the bitmap and the last value of that array
 	 * with the bits that exceed number of blocks marked as set (1).
+	 * Runs of small units have more values than fit in the run metadata,
+	 * the rest of them is stored in the bitmap extension.
 	 */
-	ASSERT(b->bitmap_nallocs <= RUN_BITMAP_SIZE);
-	unsigned unused_bits = RUN_BITMAP_SIZE - b->bitmap_nallocs;
+	b->bitmap_nval = (b->bitmap_nallocs - 1) / BITS_PER_VALUE + 1;
+	ASSERT(b->bitmap_nval <= MAX_BITMAP_VALUES +
+		RUN_BITMAP_EXT_SIZE(unit_size) / sizeof(uint64_t));
 
-	unsigned unused_values = unused_bits / BITS_PER_VALUE;
-
-	ASSERT(MAX_BITMAP_VALUES >= unused_values);
-	b->bitmap_nval = MAX_BITMAP_VALUES - unused_values;
-
-	ASSERT(unused_bits >= unused_values * BITS_PER_VALUE);
-	unused_bits -= unused_values * BITS_PER_VALUE;
+	unsigned unused_bits = b->bitmap_nval * BITS_PER_VALUE -
+		b->bitmap_nallocs;
 
 	b->bitmap_lastval = unused_bits ?
 		(((1ULL << unused_bits) - 1ULL) <<
@@ -375,6 +875,19 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	return b;
 }
 
+/*
+ * bucket_set_run_stats -- attaches the statistics of the allocation class to
+ *	the bucket, must be called before any block is inserted
+ */
+void
+bucket_set_run_stats(struct bucket *b, struct bucket_run_stats *stats)
+{
+	ASSERTeq(b->type, BUCKET_RUN);
+	ASSERTeq(b->container->nblocks, 0);
+
+	b->container->run_stats = stats;
+}
+
 /*
  * bucket_delete -- cleanups and deallocates bucket instance
  */
@@ -44,7 +44,7 @@
 #include "memblock.h"
 
 #define RUN_NALLOCS(_bs)\
-((RUNSIZE / ((_bs))))
+((RUN_DATA_SIZE(_bs) / ((_bs))))
 
 #define CALC_SIZE_IDX(_unit_size, _size)\
 ((uint32_t)(((_size - 1) / _unit_size) + 1))
@@ -52,13 +52,41 @@
 enum block_container_type {
 	CONTAINER_UNKNOWN,
 	CONTAINER_CTREE,
+	CONTAINER_SEGLISTS,
 
 	MAX_CONTAINER_TYPE
 };
 
+/*
+ * Number of bins of the run occupancy histograms, each bin covers the runs
+ * with the same tenth of their units in use.
+ */
+#define BUCKET_OCCUPANCY_BINS 10
+
+/*
+ * Statistics of the runs of a single allocation class, shared by all the
+ * buckets of the class. The per-run counters are indexed by zone and chunk,
+ * the array of a zone is NULL until the zone is populated.
+ */
+struct bucket_run_stats {
+	uint16_t **run_free; /* free units of the runs held by the buckets */
+	unsigned nallocs; /* number of units in a single run */
+	uint64_t nruns; /* runs assigned to the buckets of the class */
+	uint64_t nruns_unloaded; /* runs waiting to be reused */
+
+	/* runs with at least one free unit, by their occupancy */
+	uint64_t occupancy[BUCKET_OCCUPANCY_BINS];
+};
+
 struct block_container {
 	enum block_container_type type;
 	size_t unit_size; /* required only for valgrind... */
+
+	/* free memory blocks held by the container, updated atomically */
+	uint64_t nblocks;
+	uint64_t nunits;
+
+	struct bucket_run_stats *run_stats; /* NULL for huge blocks */
 };
 
 struct block_container_ops {
@@ -69,6 +97,7 @@ struct block_container_ops {
 		struct memory_block *m);
 	int (*get_exact)(struct block_container *c, struct memory_block m);
 	int (*is_empty)(struct block_container *c);
+	uint32_t (*get_max_size_idx)(struct block_container *c);
 };
 
 #define CNT_OP(_b, _op, ...)\
@@ -137,6 +166,11 @@ struct bucket_run {
 	 * remainder is returned back to the bucket.
 	 */
 	unsigned unit_max_alloc;
+
+	/*
+	 * Type of the object headers in runs of this bucket.
+	 */
+	enum header_type header_type;
 };
 
 struct bucket_huge *bucket_huge_new(uint8_t id, enum block_container_type ctype,
@@ -145,6 +179,8 @@ struct bucket_huge *bucket_huge_new(uint8_t id, enum block_container_type ctype,
 struct bucket_run *bucket_run_new(uint8_t id, enum block_container_type ctype,
 	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc);
 
+void bucket_set_run_stats(struct bucket *b, struct bucket_run_stats *stats);
+
 void bucket_delete(struct bucket *b);
 
 #endif
@@ -40,6 +40,9 @@
  *
  * This structure is used throughout the libpmemobj for various tasks, the
  * primary one being to store and retrieve best-fit memory blocks.
+ *
+ * The locked variants of the functions serialize only the modifications of
+ * the tree, lookups hold the lock shared and run concurrently.
  */
 #include <stdint.h>
 #include <stdlib.h>
@@ -73,7 +76,7 @@ struct node_leaf {
 
 struct ctree {
 	void *root;
-	pthread_mutex_t lock;
+	pthread_rwlock_t lock; /* shared for lookups, exclusive otherwise */
 };
 
 /*
@@ -98,7 +101,7 @@ ctree_new(void)
 	if (t == NULL)
 		return NULL;
 
-	util_mutex_init(&t->lock, NULL);
+	util_rwlock_init(&t->lock);
 
 	t->root = NULL;
 
@@ -134,7 +137,7 @@ ctree_delete(struct ctree *t)
 		ctree_remove_unlocked(t, 0, 0);
 #endif
 
-	util_mutex_destroy(&t->lock);
+	util_rwlock_destroy(&t->lock);
 
 	Free(t);
 }
@@ -216,9 +219,9 @@ error_internal_malloc:
 int
 ctree_insert(struct ctree *t, uint64_t key, uint64_t value)
 {
-	util_mutex_lock(&t->lock);
+	util_rwlock_wrlock(&t->lock);
 	int ret = ctree_insert_unlocked(t, key, value);
-	util_mutex_unlock(&t->lock);
+	util_rwlock_unlock(&t->lock);
 	return ret;
 }
 
@@ -248,9 +251,9 @@ ctree_find_unlocked(struct ctree *t, uint64_t key)
 uint64_t
 ctree_find(struct ctree *t, uint64_t key)
 {
-	util_mutex_lock(&t->lock);
+	util_rwlock_rdlock(&t->lock);
 	uint64_t ret = ctree_find_unlocked(t, key);
-	util_mutex_unlock(&t->lock);
+	util_rwlock_unlock(&t->lock);
 	return ret;
 }
 
@@ -311,9 +314,9 @@ out:
 uint64_t
 ctree_find_le(struct ctree *t, uint64_t *key)
 {
-	util_mutex_lock(&t->lock);
+	util_rwlock_rdlock(&t->lock);
 	uint64_t ret = ctree_find_le_unlocked(t, key);
-	util_mutex_unlock(&t->lock);
+	util_rwlock_unlock(&t->lock);
 	return ret;
 }
 
@@ -420,9 +423,9 @@ out:
 uint64_t
 ctree_remove(struct ctree *t, uint64_t key, int eq)
 {
-	util_mutex_lock(&t->lock);
+	util_rwlock_wrlock(&t->lock);
 	uint64_t ret = ctree_remove_unlocked(t, key, eq);
-	util_mutex_unlock(&t->lock);
+	util_rwlock_unlock(&t->lock);
 	return ret;
 }
 
@@ -441,11 +444,11 @@ ctree_is_empty_unlocked(struct ctree *t)
 int
 ctree_is_empty(struct ctree *t)
 {
-	util_mutex_lock(&t->lock);
+	util_rwlock_rdlock(&t->lock);
 
 	int ret = ctree_is_empty_unlocked(t);
 
-	util_mutex_unlock(&t->lock);
+	util_rwlock_unlock(&t->lock);
 
 	return ret;
 }
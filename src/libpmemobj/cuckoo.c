@@ -32,6 +32,15 @@
 
 /*
  * cuckoo.c -- implementation of cuckoo hash table
+ *
+ * The table is bucketized - every key has two candidate buckets, each of
+ * them a single cacheline holding several slots. A lookup touches at most
+ * two cachelines and compares all the keys of a bucket at once.
+ *
+ * When the table gets full, a new one with twice the number of buckets is
+ * allocated and the entries are migrated a few buckets at a time by the
+ * following insertions, so that no single insertion rehashes the whole
+ * table. Until the migration is finished, both tables are searched.
  */
 #include <stdint.h>
 #include <errno.h>
@@ -43,166 +52,364 @@
 
 #define MAX_HASH_FUNCS 2
 
-#define GROWTH_FACTOR 1.2f
-#define INITIAL_SIZE 8
-#define MAX_INSERTS 8
+#define BUCKET_SLOTS 4
+#define BUCKET_ALIGNMENT 64
+#define INITIAL_SIZE 2 /* buckets, must be a power of two */
+#define MAX_INSERTS 32
 #define MAX_GROWS 32
+#define MIGRATE_STEP 2 /* buckets migrated by a single insertion */
 
 struct cuckoo_slot {
 	uint64_t key;
 	void *value;
 };
 
-struct cuckoo {
-	size_t size; /* number of hash table slots */
-	struct cuckoo_slot *tab;
+/* keys and values are kept apart, so that the keys are compared at once */
+struct cuckoo_bucket {
+	uint64_t keys[BUCKET_SLOTS];
+	void *values[BUCKET_SLOTS]; /* NULL for an empty slot */
 };
 
-static const struct cuckoo_slot null_slot = {0, NULL};
+struct cuckoo_table {
+	size_t mask; /* number of buckets - 1 */
+	struct cuckoo_bucket *buckets;
+	void *raw; /* unaligned allocation of the buckets */
+};
 
-/*
- * hash_mod -- (internal) first hash function
- */
-static size_t
-hash_mod(struct cuckoo *c, uint64_t key)
-{
-	return key % c->size;
-}
+struct cuckoo {
+	struct cuckoo_table tab;
+	struct cuckoo_table old; /* table being migrated, if any */
+	size_t migrated; /* number of already migrated buckets of old */
+};
 
 /*
- * hash_mixer -- (internal) second hash function
+ * hash_mixer -- (internal) hash function
  *
  * Based on Austin Appleby MurmurHash3 64-bit finalizer.
  */
-static size_t
-hash_mixer(struct cuckoo *c, uint64_t key)
+static uint64_t
+hash_mixer(uint64_t key)
 {
 	key ^= key >> 33;
 	key *= 0xff51afd7ed558ccd;
 	key ^= key >> 33;
 	key *= 0xc4ceb9fe1a85ec53;
 	key ^= key >> 33;
-	return key % c->size;
+	return key;
 }
 
-static size_t
-(*hash_funcs[MAX_HASH_FUNCS])(struct cuckoo *c, uint64_t key) = {
-	hash_mod,
-	hash_mixer
-};
+/*
+ * cuckoo_buckets -- (internal) returns both candidate buckets of the key
+ *
+ * The first bucket is picked by the lower half of the hash and the second
+ * one by the upper half.
+ */
+static void
+cuckoo_buckets(struct cuckoo_table *t, uint64_t key,
+	struct cuckoo_bucket *b[MAX_HASH_FUNCS])
+{
+	uint64_t h = hash_mixer(key);
+	b[0] = &t->buckets[h & t->mask];
+	b[1] = &t->buckets[(h >> 32) & t->mask];
+}
 
 /*
- * cuckoo_new -- allocates and initializes cuckoo hash table
+ * cuckoo_bucket_match -- (internal) returns a bitmask of the slots of the
+ *	bucket which hold the key
+ *
+ * The loop has no branches, which lets the compiler vectorize it.
  */
-struct cuckoo *
-cuckoo_new(void)
+static unsigned
+cuckoo_bucket_match(const struct cuckoo_bucket *b, uint64_t key)
 {
-	COMPILE_ERROR_ON((size_t)(INITIAL_SIZE * GROWTH_FACTOR)
-		== INITIAL_SIZE);
+	unsigned match = 0;
+	for (unsigned i = 0; i < BUCKET_SLOTS; ++i)
+		match |= (unsigned)(b->keys[i] == key) << i;
 
-	struct cuckoo *c = Malloc(sizeof(struct cuckoo));
-	if (c == NULL) {
-		ERR("!Malloc");
-		goto error_cuckoo_malloc;
-	}
+	return match;
+}
 
-	c->size = INITIAL_SIZE;
-	size_t tab_rawsize = c->size * sizeof(struct cuckoo_slot);
-	c->tab = Zalloc(tab_rawsize);
-	if (c->tab == NULL)
-		goto error_tab_malloc;
+/*
+ * cuckoo_table_new -- (internal) allocates cacheline aligned buckets
+ */
+static int
+cuckoo_table_new(struct cuckoo_table *t, size_t nbuckets)
+{
+	t->raw = Zalloc(nbuckets * sizeof(struct cuckoo_bucket) +
+		BUCKET_ALIGNMENT - 1);
+	if (t->raw == NULL)
+		return ENOMEM;
 
-	return c;
+	uintptr_t addr = ((uintptr_t)t->raw + BUCKET_ALIGNMENT - 1) &
+		~((uintptr_t)BUCKET_ALIGNMENT - 1);
+	t->buckets = (struct cuckoo_bucket *)addr;
+	t->mask = nbuckets - 1;
+
+	return 0;
+}
+
+/*
+ * cuckoo_table_delete -- (internal) frees the buckets
+ */
+static void
+cuckoo_table_delete(struct cuckoo_table *t)
+{
+	Free(t->raw);
+	t->raw = NULL;
+	t->buckets = NULL;
+	t->mask = 0;
+}
+
+/*
+ * cuckoo_table_find -- (internal) returns the value pointer of key's slot
+ */
+static void **
+cuckoo_table_find(struct cuckoo_table *t, uint64_t key)
+{
+	struct cuckoo_bucket *b[MAX_HASH_FUNCS];
+	cuckoo_buckets(t, key, b);
+
+	for (int i = 0; i < MAX_HASH_FUNCS; ++i) {
+		unsigned match = cuckoo_bucket_match(b[i], key);
+		for (unsigned s = 0; match != 0; ++s, match >>= 1) {
+			if ((match & 1) && b[i]->values[s] != NULL)
+				return &b[i]->values[s];
+		}
+	}
 
-error_tab_malloc:
-	Free(c);
-error_cuckoo_malloc:
 	return NULL;
 }
 
 /*
- * cuckoo_delete -- cleanups and deallocates cuckoo hash table
+ * cuckoo_bucket_put -- (internal) stores the entry in a free slot
  */
-void
-cuckoo_delete(struct cuckoo *c)
+static int
+cuckoo_bucket_put(struct cuckoo_bucket *b, const struct cuckoo_slot *src)
 {
-	ASSERTne(c, NULL);
-	Free(c->tab);
-	Free(c);
+	for (unsigned s = 0; s < BUCKET_SLOTS; ++s) {
+		if (b->values[s] == NULL) {
+			b->keys[s] = src->key;
+			b->values[s] = src->value;
+			return 0;
+		}
+	}
+
+	return -1;
 }
 
 /*
- * cuckoo_insert_try -- (internal) try inserting into the existing hash table
+ * cuckoo_slot_swap -- (internal) exchanges the entry with a bucket slot
+ */
+static void
+cuckoo_slot_swap(struct cuckoo_bucket *b, unsigned s, struct cuckoo_slot *src)
+{
+	struct cuckoo_slot tmp = {b->keys[s], b->values[s]};
+	b->keys[s] = src->key;
+	b->values[s] = src->value;
+	*src = tmp;
+}
+
+/*
+ * cuckoo_table_insert -- (internal) inserts the entry, which isn't in the
+ *	table yet, kicking out the existing ones if necessary
+ *
+ * If there's no room for the entry, the evictions are reverted and the table
+ * is left untouched.
  */
 static int
-cuckoo_insert_try(struct cuckoo *c, struct cuckoo_slot *src)
+cuckoo_table_insert(struct cuckoo_table *t, struct cuckoo_slot src)
 {
-	struct cuckoo_slot srct;
-	size_t h[MAX_HASH_FUNCS] = {0};
-	for (int n = 0; n < MAX_INSERTS; ++n) {
+	struct cuckoo_bucket *path[MAX_INSERTS];
+	unsigned slots[MAX_INSERTS];
+	struct cuckoo_bucket *b[MAX_HASH_FUNCS];
+	struct cuckoo_bucket *prev = NULL;
+
+	int n;
+	for (n = 0; n < MAX_INSERTS; ++n) {
+		cuckoo_buckets(t, src.key, b);
 		for (int i = 0; i < MAX_HASH_FUNCS; ++i) {
-			h[i] = hash_funcs[i](c, src->key);
-			if (c->tab[h[i]].value == NULL) {
-				c->tab[h[i]] = *src;
+			if (cuckoo_bucket_put(b[i], &src) == 0)
 				return 0;
-			} else if (c->tab[h[i]].key == src->key) {
-				return EINVAL;
-			}
 		}
 
-		srct = c->tab[h[0]];
-		c->tab[h[0]] = *src;
-		src->key = srct.key;
-		src->value = srct.value;
+		/* don't move the entry back to where it has been kicked from */
+		path[n] = b[0] == prev ? b[1] : b[0];
+		slots[n] = (unsigned)n % BUCKET_SLOTS;
+		cuckoo_slot_swap(path[n], slots[n], &src);
+		prev = path[n];
 	}
 
+	while (n-- > 0)
+		cuckoo_slot_swap(path[n], slots[n], &src);
+
 	return EAGAIN;
 }
 
 /*
- * cuckoo_grow -- (internal) rehashes the table with twice the size
+ * cuckoo_table_move -- (internal) moves all entries of the table to another
  */
 static int
-cuckoo_grow(struct cuckoo *c)
+cuckoo_table_move(struct cuckoo_table *dst, struct cuckoo_table *src,
+	size_t first)
+{
+	for (size_t i = first; i <= src->mask; ++i) {
+		struct cuckoo_bucket *b = &src->buckets[i];
+		for (unsigned s = 0; s < BUCKET_SLOTS; ++s) {
+			if (b->values[s] == NULL)
+				continue;
+
+			struct cuckoo_slot e = {b->keys[s], b->values[s]};
+			if (cuckoo_table_insert(dst, e) != 0)
+				return EAGAIN;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * cuckoo_rebuild -- (internal) rehashes all entries at once into a table
+ *	with twice the number of buckets
+ *
+ * This is the fallback for the rare case of a failed insertion into a table
+ * which is still being migrated into. On failure, the old state is kept.
+ */
+static int
+cuckoo_rebuild(struct cuckoo *c)
 {
-	size_t oldsize = c->size;
-	struct cuckoo_slot *oldtab = c->tab;
+	size_t nbuckets = c->tab.mask + 1;
 
-	int n;
-	for (n = 0; n < MAX_GROWS; ++n) {
-		size_t nsize = (size_t)((float)c->size * GROWTH_FACTOR);
+	for (int n = 0; n < MAX_GROWS; ++n) {
+		nbuckets *= 2;
 
-		size_t tab_rawsize = nsize * sizeof(struct cuckoo_slot);
-		c->tab = Zalloc(tab_rawsize);
-		if (c->tab == NULL) {
-			c->tab = oldtab;
+		struct cuckoo_table t;
+		if (cuckoo_table_new(&t, nbuckets) != 0)
 			return ENOMEM;
-		}
 
-		c->size = nsize;
-		unsigned i;
-		for (i = 0; i < oldsize; ++i) {
-			struct cuckoo_slot s = oldtab[i];
-			if (s.value != NULL && (cuckoo_insert_try(c, &s) != 0))
-				break;
+		if (cuckoo_table_move(&t, &c->tab, 0) == 0 &&
+			(c->old.buckets == NULL ||
+			cuckoo_table_move(&t, &c->old, c->migrated) == 0)) {
+			cuckoo_table_delete(&c->tab);
+			if (c->old.buckets != NULL)
+				cuckoo_table_delete(&c->old);
+			c->tab = t;
+			return 0;
 		}
 
-		if (i == oldsize)
-			break;
-		else
-			Free(c->tab);
+		cuckoo_table_delete(&t);
 	}
 
-	if (n == MAX_GROWS) {
-		c->tab = oldtab;
-		c->size = oldsize;
-		return EINVAL;
+	return EINVAL;
+}
+
+/*
+ * cuckoo_migrate -- (internal) moves the entries of up to nbuckets buckets
+ *	of the old table into the current one
+ */
+static int
+cuckoo_migrate(struct cuckoo *c, size_t nbuckets)
+{
+	if (c->old.buckets == NULL)
+		return 0;
+
+	for (; nbuckets > 0 && c->migrated <= c->old.mask; --nbuckets) {
+		struct cuckoo_bucket *b = &c->old.buckets[c->migrated];
+		for (unsigned s = 0; s < BUCKET_SLOTS; ++s) {
+			if (b->values[s] == NULL)
+				continue;
+
+			struct cuckoo_slot e = {b->keys[s], b->values[s]};
+			if (cuckoo_table_insert(&c->tab, e) != 0)
+				return cuckoo_rebuild(c);
+
+			b->values[s] = NULL;
+		}
+
+		c->migrated++;
 	}
 
-	Free(oldtab);
+	if (c->migrated > c->old.mask)
+		cuckoo_table_delete(&c->old);
+
 	return 0;
 }
 
+/*
+ * cuckoo_grow -- (internal) starts migrating the entries into a table with
+ *	twice the number of buckets
+ */
+static int
+cuckoo_grow(struct cuckoo *c)
+{
+	/* there can be only one table being migrated */
+	if (c->old.buckets != NULL)
+		return cuckoo_rebuild(c);
+
+	struct cuckoo_table t;
+	if (cuckoo_table_new(&t, 2 * (c->tab.mask + 1)) != 0)
+		return ENOMEM;
+
+	c->old = c->tab;
+	c->tab = t;
+	c->migrated = 0;
+
+	return 0;
+}
+
+/*
+ * cuckoo_new -- allocates and initializes cuckoo hash table
+ */
+struct cuckoo *
+cuckoo_new(void)
+{
+	COMPILE_ERROR_ON((INITIAL_SIZE & (INITIAL_SIZE - 1)) != 0);
+
+	struct cuckoo *c = Malloc(sizeof(struct cuckoo));
+	if (c == NULL) {
+		ERR("!Malloc");
+		goto error_cuckoo_malloc;
+	}
+
+	if (cuckoo_table_new(&c->tab, INITIAL_SIZE) != 0)
+		goto error_tab_malloc;
+
+	memset(&c->old, 0, sizeof(c->old));
+	c->migrated = 0;
+
+	return c;
+
+error_tab_malloc:
+	Free(c);
+error_cuckoo_malloc:
+	return NULL;
+}
+
+/*
+ * cuckoo_delete -- cleanups and deallocates cuckoo hash table
+ */
+void
+cuckoo_delete(struct cuckoo *c)
+{
+	ASSERTne(c, NULL);
+	cuckoo_table_delete(&c->tab);
+	if (c->old.buckets != NULL)
+		cuckoo_table_delete(&c->old);
+	Free(c);
+}
+
+/*
+ * cuckoo_find_slot -- (internal) finds the value pointer of the key's slot
+ */
+static void **
+cuckoo_find_slot(struct cuckoo *c, uint64_t key)
+{
+	void **v = cuckoo_table_find(&c->tab, key);
+	if (v == NULL && c->old.buckets != NULL)
+		v = cuckoo_table_find(&c->old, key);
+
+	return v;
+}
+
 /*
  * cuckoo_insert -- inserts key-value pair into the hash table
  */
@@ -210,10 +417,17 @@ int
 cuckoo_insert(struct cuckoo *c, uint64_t key, void *value)
 {
 	ASSERTne(c, NULL);
+
+	if (cuckoo_find_slot(c, key) != NULL)
+		return EINVAL;
+
 	int err;
+	if ((err = cuckoo_migrate(c, MIGRATE_STEP)) != 0)
+		return err;
+
 	struct cuckoo_slot src = {key, value};
 	for (int n = 0; n < MAX_GROWS; ++n) {
-		if ((err = cuckoo_insert_try(c, &src)) != EAGAIN)
+		if ((err = cuckoo_table_insert(&c->tab, src)) != EAGAIN)
 			return err;
 
 		if ((err = cuckoo_grow(c)) != 0)
@@ -223,21 +437,6 @@ cuckoo_insert(struct cuckoo *c, uint64_t key, void *value)
 	return EINVAL;
 }
 
-/*
- * cuckoo_find_slot -- (internal) finds the hash table slot of key
- */
-static struct cuckoo_slot *
-cuckoo_find_slot(struct cuckoo *c, uint64_t key)
-{
-	for (int i = 0; i < MAX_HASH_FUNCS; ++i) {
-		size_t h = hash_funcs[i](c, key);
-		if (c->tab[h].key == key)
-			return &c->tab[h];
-	}
-
-	return NULL;
-}
-
 /*
  * cuckoo_remove -- removes key-value pair from the hash table
  */
@@ -246,10 +445,10 @@ cuckoo_remove(struct cuckoo *c, uint64_t key)
 {
 	ASSERTne(c, NULL);
 	void *ret = NULL;
-	struct cuckoo_slot *s = cuckoo_find_slot(c, key);
-	if (s) {
-		ret = s->value;
-		*s = null_slot;
+	void **v = cuckoo_find_slot(c, key);
+	if (v) {
+		ret = *v;
+		*v = NULL;
 	}
 
 	return ret;
@@ -262,8 +461,8 @@ void *
 cuckoo_get(struct cuckoo *c, uint64_t key)
 {
 	ASSERTne(c, NULL);
-	struct cuckoo_slot *s = cuckoo_find_slot(c, key);
-	return s ? s->value : NULL;
+	void **v = cuckoo_find_slot(c, key);
+	return v ? *v : NULL;
 }
 
 /*
@@ -274,5 +473,5 @@ size_t
 cuckoo_get_size(struct cuckoo *c)
 {
 	ASSERTne(c, NULL);
-	return c->size;
+	return (c->tab.mask + 1) * BUCKET_SLOTS;
 }
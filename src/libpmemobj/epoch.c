@@ -0,0 +1,360 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * epoch.c -- epoch-based reclamation of retired objects
+ *
+ * The objects unlinked from a lock-free structure can't be freed right away,
+ * the threads which found them before they were unlinked might still be
+ * reading them. Instead, they are retired and freed only once all of those
+ * threads have left their critical sections.
+ *
+ * The threads announce their critical sections in pmemobj_epoch_enter and
+ * pmemobj_epoch_exit, counted in a per-CPU slot under the parity of the global
+ * epoch they've observed. The global epoch is advanced only when no thread is
+ * left in the previous one, so an object retired in epoch e can't be reached
+ * by anyone once the global epoch is e + 2.
+ *
+ * The retired objects are listed in the allocator section of the lane of the
+ * retiring thread. Each one is freed by an operation which also clears its
+ * entry, so it's never freed twice, and those still listed when the pool is
+ * closed, or after a crash, are freed on the next open.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <sched.h>
+
+#include "epoch.h"
+#include "lane.h"
+#include "memops.h"
+#include "obj.h"
+#include "out.h"
+#include "pmalloc.h"
+#include "util.h"
+
+#define EPOCH_SLOTS 64 /* must be a power of two */
+
+/* number of retired objects of a lane at which the expired ones are freed */
+#define EPOCH_RECLAIM_THRESHOLD 32
+
+struct epoch_slot {
+	uint64_t active[2]; /* threads in the epochs of either parity */
+	char padding[_POBJ_CL_ALIGNMENT - 2 * sizeof(uint64_t)];
+};
+
+struct epoch {
+	volatile uint64_t global;
+	char padding[_POBJ_CL_ALIGNMENT - sizeof(uint64_t)];
+	struct epoch_slot slots[EPOCH_SLOTS];
+};
+
+/*
+ * epoch_new -- creates the runtime state of the epochs of a pool
+ */
+struct epoch *
+epoch_new(void)
+{
+	struct epoch *ep = Zalloc(sizeof(*ep));
+	if (ep == NULL)
+		ERR("!Zalloc");
+
+	return ep;
+}
+
+/*
+ * epoch_delete -- deletes the runtime state of the epochs of a pool
+ */
+void
+epoch_delete(struct epoch *ep)
+{
+	Free(ep);
+}
+
+/*
+ * epoch_slot -- (internal) returns the slot of the CPU the thread is running on
+ */
+static inline unsigned
+epoch_slot(void)
+{
+	int cpu = sched_getcpu();
+	return (unsigned)(cpu < 0 ? 0 : cpu) & (EPOCH_SLOTS - 1);
+}
+
+/*
+ * pmemobj_epoch_enter -- starts a critical section of the calling thread, in
+ *	which it can access the objects not retired before it started
+ *
+ * The returned token must be passed to the matching pmemobj_epoch_exit.
+ */
+uint64_t
+pmemobj_epoch_enter(PMEMobjpool *pop)
+{
+	struct epoch *ep = pop->epoch;
+	unsigned slot = epoch_slot();
+	uint64_t *active = ep->slots[slot].active;
+
+	for (;;) {
+		uint64_t e = ep->global;
+		__sync_fetch_and_add(&active[e & 1], 1);
+
+		/* the epoch might have advanced before the thread counted */
+		if (likely(ep->global == e))
+			return e * EPOCH_SLOTS + slot;
+
+		__sync_fetch_and_sub(&active[e & 1], 1);
+	}
+}
+
+/*
+ * pmemobj_epoch_exit -- ends the critical section started by
+ *	pmemobj_epoch_enter
+ */
+void
+pmemobj_epoch_exit(PMEMobjpool *pop, uint64_t token)
+{
+	uint64_t e = token / EPOCH_SLOTS;
+	unsigned slot = (unsigned)(token & (EPOCH_SLOTS - 1));
+
+	__sync_fetch_and_sub(&pop->epoch->slots[slot].active[e & 1], 1);
+}
+
+/*
+ * epoch_try_advance -- (internal) advances the global epoch unless there still
+ *	are threads in the previous one, returns the global epoch
+ */
+static uint64_t
+epoch_try_advance(struct epoch *ep)
+{
+	uint64_t e = ep->global;
+
+	/* the counts must not be older than the epoch */
+	__sync_synchronize();
+
+	unsigned prev = (unsigned)((e - 1) & 1);
+	for (unsigned i = 0; i < EPOCH_SLOTS; ++i) {
+		if (((volatile uint64_t *)ep->slots[i].active)[prev] != 0)
+			return e;
+	}
+
+	if (__sync_bool_compare_and_swap(&ep->global, e, e + 1))
+		return e + 1;
+
+	return ep->global;
+}
+
+/*
+ * epoch_free -- (internal) frees the retired object and clears its entry in a
+ *	single operation of the redo log
+ */
+static void
+epoch_free(PMEMobjpool *pop, struct redo_log *redo,
+	struct alloc_retire_entry *entry)
+{
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	int ret = pmalloc_operation(&pop->heap, entry->off, &entry->off, 0,
+			NULL, NULL, &ctx, 0, 0);
+	ASSERTeq(ret, 0);
+}
+
+/*
+ * epoch_reclaim -- (internal) frees the objects of the lane whose grace
+ *	period is over, returns their number
+ *
+ * The objects retired in the current epoch are only freed two epochs later,
+ * so the epoch is advanced twice, if possible, before they're looked for.
+ */
+static unsigned
+epoch_reclaim(PMEMobjpool *pop, struct lane_alloc_layout *sec)
+{
+	struct epoch *ep = pop->epoch;
+
+	epoch_try_advance(ep);
+	uint64_t e = epoch_try_advance(ep);
+
+	unsigned nfreed = 0;
+	for (unsigned i = 0; i < ALLOC_RETIRE_LIST_SIZE; ++i) {
+		struct alloc_retire_entry *entry = &sec->retire[i];
+		if (entry->off != 0 && entry->epoch + 2 <= e) {
+			epoch_free(pop, sec->redo, entry);
+			nfreed++;
+		}
+	}
+
+	return nfreed;
+}
+
+/*
+ * epoch_modify_check -- (internal) checks whether the retired objects of the
+ *	pool can be modified by the calling thread
+ */
+static int
+epoch_modify_check(PMEMobjpool *pop)
+{
+	if (pop->rdonly) {
+		ERR("read-only pool");
+		errno = EROFS;
+		return -1;
+	}
+
+	/* the objects couldn't be brought back on abort */
+	if (pmemobj_tx_stage() != TX_STAGE_NONE) {
+		ERR("retired objects modified inside a transaction");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_retire -- frees the object once all of the critical sections which
+ *	might have found it are over
+ *
+ * The object must no longer be reachable from the persistent structures, as
+ * it's freed on the next open if the pool isn't closed cleanly in between.
+ * Whenever enough objects are waiting in the lane of the calling thread, the
+ * expired ones are freed all at once.
+ */
+int
+pmemobj_retire(PMEMobjpool *pop, PMEMoid oid)
+{
+	LOG(3, "pop %p oid.off 0x%016jx", pop, oid.off);
+
+	if (oid.off == 0)
+		return 0;
+
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+
+	if (epoch_modify_check(pop) != 0)
+		return -1;
+
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	struct lane_alloc_layout *sec = (void *)lane->layout;
+
+	unsigned nretired = 0;
+	for (unsigned i = 0; i < ALLOC_RETIRE_LIST_SIZE; ++i)
+		nretired += sec->retire[i].off != 0;
+
+	if (nretired >= EPOCH_RECLAIM_THRESHOLD)
+		nretired -= epoch_reclaim(pop, sec);
+
+	if (nretired == ALLOC_RETIRE_LIST_SIZE) {
+		lane_release(pop);
+		ERR("too many retired objects waiting to be freed");
+		errno = EAGAIN;
+		return -1;
+	}
+
+	struct alloc_retire_entry *entry = &sec->retire[0];
+	while (entry->off != 0)
+		entry++;
+
+	/* the object was unlinked before the epoch is read */
+	__sync_synchronize();
+
+	entry->epoch = pop->epoch->global;
+	entry->off = oid.off;
+	pmemops_persist(&pop->p_ops, entry, sizeof(*entry));
+
+	lane_release(pop);
+
+	return 0;
+}
+
+/*
+ * pmemobj_epoch_reclaim -- frees the retired objects of the lane of the
+ *	calling thread whose grace period is over
+ */
+int
+pmemobj_epoch_reclaim(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	if (epoch_modify_check(pop) != 0)
+		return -1;
+
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	epoch_reclaim(pop, (void *)lane->layout);
+
+	lane_release(pop);
+
+	return 0;
+}
+
+/*
+ * epoch_recover -- frees all of the objects retired, but not freed, when the
+ *	pool was last closed
+ *
+ * This is called on open, before any thread can enter an epoch. The entries
+ * of all the lanes are cleared through the redo log of the one held.
+ */
+void
+epoch_recover(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	struct lane_layout *layouts =
+		(void *)((char *)pop + pop->lanes_offset);
+
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	struct lane_alloc_layout *held = (void *)lane->layout;
+
+	size_t nfreed = 0;
+	for (uint64_t l = 0; l < pop->nlanes; ++l) {
+		struct lane_alloc_layout *sec = (void *)
+			&layouts[l].sections[LANE_SECTION_ALLOCATOR];
+
+		for (unsigned i = 0; i < ALLOC_RETIRE_LIST_SIZE; ++i) {
+			if (sec->retire[i].off != 0) {
+				epoch_free(pop, held->redo, &sec->retire[i]);
+				nfreed++;
+			}
+		}
+	}
+
+	lane_release(pop);
+
+	if (nfreed != 0)
+		LOG(3, "freed %zu retired objects", nfreed);
+}
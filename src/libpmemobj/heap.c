@@ -35,11 +35,13 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/queue.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
 #include <float.h>
+#include <sys/param.h>
 
 #include "heap.h"
 #include "out.h"
@@ -49,8 +51,17 @@
 
 #define MAX_RUN_LOCKS 1024
 
+#define HEAP_CHECK_THREADS_MAX 64
+
 #define USE_PER_THREAD_BUCKETS
 
+/*
+ * Container of the free chunks. The segregated lists give up the address
+ * ordered best-fit of the tree for constant time lookups, which do not
+ * degrade when the heap has many fragmented chunks.
+ */
+#define HUGE_BUCKET_CONTAINER CONTAINER_SEGLISTS
+
 #define EMPTY_MEMORY_BLOCK (struct memory_block)\
 {0, 0, 0, 0}
 
@@ -80,6 +91,12 @@
  */
 #define MAX_RUN_SIZE (CHUNKSIZE / 2)
 
+/*
+ * The smallest unit, and the granularity of unit sizes, of runs whose objects
+ * have no allocation header.
+ */
+#define MIN_HEADERLESS_RUN_SIZE 16
+
 /*
  * Maximum number of bytes the allocation class generation algorithm can decide
  * to waste in a single run chunk.
@@ -107,6 +124,15 @@
  */
 #define FIRST_GENERATED_CLASS_SIZE 2
 
+/*
+ * Marks of the memory which was never handed out since the pool was created
+ * from zeroed files, and so is known to be zeroed, see heap_block_fresh.
+ * Any other value is the mark of a run - the index of its first unit that
+ * was never handed out, plus one.
+ */
+#define CHUNK_FRESH_NONE 0
+#define CHUNK_FRESH_ALL UINT16_MAX
+
 static struct {
 	size_t size;
 	size_t step;
@@ -127,6 +153,12 @@ struct active_run {
 
 struct bucket_cache {
 	struct bucket *buckets[MAX_BUCKETS]; /* no default bucket */
+
+	/*
+	 * Free chunks set aside for the new runs of this cache, see
+	 * heap_get_run_chunk, protected by the lock of the default bucket.
+	 */
+	struct memory_block reserve;
 };
 
 struct heap_rt {
@@ -139,16 +171,91 @@ struct heap_rt {
 	pthread_mutex_t run_locks[MAX_RUN_LOCKS];
 	unsigned max_zone;
 	unsigned zones_exhausted;
+	uint8_t *zones_populated; /* bitmap of zones with volatile state */
+	int *zone_numa_node; /* NUMA node of each zone, NULL if not relevant */
+
+	/* enables the HEAP_FEAT_* features, NULL if there's nothing to do */
+	int (*feature_enable)(void *arg, unsigned features);
+	void *feature_arg;
 	size_t last_run_max_size;
 
 	struct bucket_cache *caches;
 	unsigned ncaches;
 	uint32_t last_drained[MAX_BUCKETS];
+
+	/* statistics of the allocation classes, see heap_stats */
+	struct bucket_run_stats run_stats[MAX_BUCKETS];
+	uint16_t **run_free; /* free units of each run, per populated zone */
+
+	/* marks of the never used chunks, per zone, NULL if not known */
+	uint16_t **chunk_fresh;
+
+	/* deferred verification of the zones, see heap_zone_checked */
+	uint8_t *zone_check; /* state of each zone, NULL if not deferred */
+	pthread_mutex_t check_lock; /* serializes verification of the zones */
+	pthread_mutex_t check_wait_lock; /* serializes joining the threads */
+	pthread_t *check_threads;
+	unsigned check_nthreads; /* number of threads not joined yet */
+	int check_stop;
+	unsigned zones_inconsistent;
+
+	/* the free space summary of the previous run, see heap_summary_load */
+	uint64_t run_id; /* id of this run of the pool */
+	uint64_t summary_gen; /* its generation, 0 if there's none */
+	uint8_t *zones_dirty; /* bitmap of the zones freed into since */
+
+	/* sampled allocation sizes, in alloc blocks, see heap_tune */
+	uint32_t *tune_hist; /* NULL if the classes aren't tuned */
+	uint32_t tune_nsamples;
+	unsigned tune_nclasses; /* number of classes created by the tuning */
+	pthread_mutex_t tune_lock;
 };
 
 static __thread unsigned Cache_idx = UINT32_MAX;
 static unsigned Next_cache_idx;
 
+/* the number of threads verifying the zones, 0 or 1 means disabled */
+static unsigned Heap_check_nthreads;
+
+/* verify the zones in the background rather than when the pool is opened */
+static int Heap_check_defer;
+
+/* write the free space summary on close and rely on it on the next open */
+static int Heap_summary;
+
+/* the number of chunks set aside for the runs of each cache, 0 if none */
+static uint32_t Heap_affinity;
+#define HEAP_AFFINITY_MAX 64
+
+/* adapt the allocation classes to the sizes allocated, see heap_tune */
+static int Heap_tune;
+
+/* one in this many allocations is sampled, must be a power of two */
+#define HEAP_TUNE_SAMPLE_RATE 16
+
+/* number of samples after which the allocation classes are tuned */
+#define HEAP_TUNE_INTERVAL 1024
+
+/* a size gets its own class if it has at least 1/n of the samples... */
+#define HEAP_TUNE_HOT_SHARE 32
+
+/* ...and the class would save at least 1/n of it, see heap_class_cost */
+#define HEAP_TUNE_MIN_WASTE 32
+
+/* the maximum number of classes created by the tuning */
+#define HEAP_TUNE_MAX_CLASSES 64
+
+static __thread unsigned Tune_sample;
+
+static int heap_zone_checked(struct palloc_heap *heap, uint32_t zone_id);
+static int heap_check_defer_start(struct palloc_heap *heap);
+static void heap_check_defer_stop(struct palloc_heap *heap);
+static int heap_summary_load(struct palloc_heap *heap);
+static void heap_summary_write(struct palloc_heap *heap);
+static int heap_get_run_chunk(struct palloc_heap *heap,
+	struct memory_block *m);
+static int heap_release_reserves(struct palloc_heap *heap);
+
 /*
  * bucket_group_init -- (internal) creates new bucket group instance
  */
@@ -187,6 +294,28 @@ heap_max_zone(size_t size)
 	return max_zone;
 }
 
+/*
+ * heap_zones_valid -- (internal) returns the number of leading zones with
+ *	valid headers
+ *
+ * The zone headers are written lazily, when the zones are populated for the
+ * first time, so that creating a pool doesn't have to touch the metadata of all
+ * of its zones. The header of zone 0 holds the persistent high-water mark --
+ * the number of the zones whose headers are valid, plus one -- regardless of
+ * whether zone 0 itself is initialized. Anything beyond the mark is undefined.
+ * In heaps created before the mark was introduced it's zero, and all of the
+ * zone headers are valid.
+ */
+static unsigned
+heap_zones_valid(struct heap_layout *layout, unsigned max_zone)
+{
+	uint64_t mark = layout->zone0.header.zones_valid;
+	if (mark == 0 || mark - 1 > max_zone)
+		return max_zone;
+
+	return (unsigned)(mark - 1);
+}
+
 /*
  * get_zone_size_idx -- (internal) calculates zone size index
  */
@@ -265,11 +394,74 @@ heap_zone_init(struct palloc_heap *heap, uint32_t zone_id)
 	struct zone_header nhdr = {
 		.size_idx = size_idx,
 		.magic = ZONE_HEADER_MAGIC,
+		/* the high-water mark must survive the initialization */
+		.zones_valid = zone_id == 0 ? z->header.zones_valid : 0,
+		/* and so must the generations, they're never reused */
+		.summary_seq = zone_id == 0 ? z->header.summary_seq : 0,
 	};
-	z->header = nhdr;  /* write the entire header (8 bytes) at once */
+	z->header = nhdr;  /* write the entire header at once */
 	pmemops_persist(&heap->p_ops, &z->header, sizeof(z->header));
 }
 
+/*
+ * heap_zones_validate -- (internal) extends the range of the zones with valid
+ *	headers up to and including the given zone
+ *
+ * The headers of the zones skipped over are cleared, the zone itself is
+ * initialized and only then the high-water mark is advanced, so that
+ * a zone past the mark never holds any allocated memory.
+ */
+static void
+heap_zones_validate(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_layout *layout = heap->layout;
+	unsigned valid = heap_zones_valid(layout, heap->rt->max_zone);
+	if (zone_id < valid)
+		return;
+
+	for (unsigned i = valid; i < zone_id; ++i) {
+		struct zone *z = ZID_TO_ZONE(layout, i);
+		z->header.magic = 0;
+		z->header.size_idx = 0;
+		pmemops_persist(&heap->p_ops, &z->header,
+				sizeof(z->header.magic) +
+				sizeof(z->header.size_idx));
+	}
+
+	struct zone_header *mark = &layout->zone0.header;
+	if (zone_id == 0) {
+		/*
+		 * The header of zone 0 was cleared when the heap was created,
+		 * so the mark can be written along with it -- if only one of
+		 * them makes it, the zone is simply initialized again.
+		 */
+		mark->zones_valid = 2;
+		heap_zone_init(heap, zone_id);
+		return;
+	}
+
+	heap_zone_init(heap, zone_id);
+
+	mark->zones_valid = zone_id + 2;
+	pmemops_persist(&heap->p_ops, &mark->zones_valid,
+			sizeof(mark->zones_valid));
+}
+
+/*
+ * heap_run_header_type -- (internal) returns the type of the object headers
+ *	in the run described by the chunk header
+ */
+static enum header_type
+heap_run_header_type(struct chunk_header *hdr)
+{
+	if (hdr->flags & CHUNK_FLAG_COMPACT_HEADER)
+		return HEADER_COMPACT;
+	if (hdr->flags & CHUNK_FLAG_HEADER_NONE)
+		return HEADER_NONE;
+
+	return HEADER_LEGACY;
+}
+
 /*
  * heap_init_run -- (internal) creates a run based on a chunk
  */
@@ -288,20 +480,33 @@ heap_init_run(struct palloc_heap *heap, struct bucket *b,
 
 	ASSERT(hdr->type == CHUNK_TYPE_FREE);
 
+	uint64_t *bitmap = RUN_BITMAP(run);
+	size_t bitmap_size = sizeof(run->bitmap) +
+		RUN_BITMAP_EXT_SIZE(b->unit_size);
+
 	/* set all the bits */
-	memset(run->bitmap, 0xFF, sizeof(run->bitmap));
+	memset(bitmap, 0xFF, bitmap_size);
 
 	unsigned nval = r->bitmap_nval;
 	ASSERT(nval > 0);
 	/* clear only the bits available for allocations from this bucket */
-	memset(run->bitmap, 0, sizeof(uint64_t) * (nval - 1));
-	run->bitmap[nval - 1] = r->bitmap_lastval;
+	memset(bitmap, 0, sizeof(uint64_t) * (nval - 1));
+	bitmap[nval - 1] = r->bitmap_lastval;
 	VALGRIND_REMOVE_FROM_TX(run, sizeof(*run));
 
-	pmemops_persist(&heap->p_ops, run->bitmap, sizeof(run->bitmap));
+	pmemops_persist(&heap->p_ops, bitmap, bitmap_size);
+
+	struct chunk_header nhdr = *hdr;
+	nhdr.type = CHUNK_TYPE_RUN;
+	nhdr.flags &= (uint16_t)~(CHUNK_FLAG_COMPACT_HEADER |
+		CHUNK_FLAG_HEADER_NONE);
+	if (r->header_type == HEADER_COMPACT)
+		nhdr.flags |= CHUNK_FLAG_COMPACT_HEADER;
+	else if (r->header_type == HEADER_NONE)
+		nhdr.flags |= CHUNK_FLAG_HEADER_NONE;
 
 	VALGRIND_ADD_TO_TX(hdr, sizeof(*hdr));
-	hdr->type = CHUNK_TYPE_RUN;
+	*hdr = nhdr; /* write the entire header (8 bytes) at once */
 	VALGRIND_REMOVE_FROM_TX(hdr, sizeof(*hdr));
 
 	pmemops_persist(&heap->p_ops, hdr, sizeof(*hdr));
@@ -358,15 +563,11 @@ heap_process_run_metadata(struct palloc_heap *heap, struct bucket *b,
 
 	ASSERT(RUN_NALLOCS(run->block_size) <= UINT16_MAX);
 
-	uint16_t run_bits = (uint16_t)(RUNSIZE / run->block_size);
-	ASSERT(run_bits < (MAX_BITMAP_VALUES * BITS_PER_VALUE));
-	uint16_t block_off = 0;
-	uint16_t block_size_idx = 0;
-
+	uint64_t *bitmap = RUN_BITMAP(run);
 	for (unsigned i = 0; i < r->bitmap_nval; ++i) {
-		uint64_t v = run->bitmap[i];
+		uint64_t v = bitmap[i];
 		ASSERT(BITS_PER_VALUE * i <= UINT16_MAX);
-		block_off = (uint16_t)(BITS_PER_VALUE * i);
+		uint16_t block_off = (uint16_t)(BITS_PER_VALUE * i);
 		if (v == 0) {
 			heap_run_insert(heap, b, chunk_id, zone_id,
 				BITS_PER_VALUE, block_off);
@@ -375,31 +576,25 @@ heap_process_run_metadata(struct palloc_heap *heap, struct bucket *b,
 			continue;
 		}
 
-		for (unsigned j = 0; j < BITS_PER_VALUE; ++j) {
-			if (BIT_IS_CLR(v, j)) {
-				block_size_idx++;
-			} else if (block_size_idx != 0) {
-				ASSERT(block_off >= block_size_idx);
+		/*
+		 * Free blocks never span multiple values, so each range of
+		 * clear bits can be found with two bit scans. The unused bits
+		 * at the end of the bitmap are always set.
+		 */
+		uint64_t free_bits = ~v;
+		while (free_bits != 0) {
+			unsigned start = util_lssb_index64(free_bits);
+			unsigned size_idx = util_lssb_index64(
+				~(free_bits >> start));
 
-				heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-				block_size_idx = 0;
-			}
+			heap_run_insert(heap, b, chunk_id, zone_id,
+				(uint16_t)size_idx,
+				(uint16_t)(block_off + start));
 
-			if ((block_off++) == run_bits) {
-				i = MAX_BITMAP_VALUES;
+			if (start + size_idx == BITS_PER_VALUE)
 				break;
-			}
-		}
-
-		if (block_size_idx != 0) {
-			ASSERT(block_off >= block_size_idx);
 
-			heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-			block_size_idx = 0;
+			free_bits &= UINT64_MAX << (start + size_idx);
 		}
 	}
 }
@@ -435,6 +630,15 @@ heap_create_run(struct palloc_heap *heap, struct bucket *b,
 	heap_set_run_bucket(run, b);
 	heap_init_run(heap, b, hdr, run);
 	heap_process_run_metadata(heap, b, run, chunk_id, zone_id);
+
+	/* the units of a run built on a fresh chunk are all fresh */
+	uint16_t *fresh = heap->rt->chunk_fresh != NULL ?
+		heap->rt->chunk_fresh[zone_id] : NULL;
+	if (fresh != NULL)
+		fresh[chunk_id] = fresh[chunk_id] == CHUNK_FRESH_ALL ?
+			1 : CHUNK_FRESH_NONE;
+
+	__sync_fetch_and_add(&heap->rt->run_stats[b->id].nruns, 1);
 }
 
 /*
@@ -467,6 +671,8 @@ heap_reuse_run(struct palloc_heap *heap, struct bucket *b,
 
 	heap_process_run_metadata(heap, b, run, chunk_id, zone_id);
 
+	__sync_fetch_and_add(&heap->rt->run_stats[b->id].nruns, 1);
+
 out:
 	util_mutex_unlock(heap_get_run_lock(heap, chunk_id));
 }
@@ -477,8 +683,13 @@ out:
 static int
 heap_run_is_empty(struct chunk_run *run)
 {
-	for (int i = 0; i < MAX_BITMAP_VALUES; ++i)
-		if (run->bitmap[i] != UINT64_MAX)
+	uint64_t *bitmap = RUN_BITMAP(run);
+	unsigned nval = (unsigned)((RUN_NALLOCS(run->block_size) - 1) /
+		BITS_PER_VALUE + 1);
+
+	/* the unused bits at the end of the bitmap are always set */
+	for (unsigned i = 0; i < nval; ++i)
+		if (bitmap[i] != UINT64_MAX)
 			return 0;
 
 	return 1;
@@ -508,25 +719,37 @@ heap_find_first_free_bucket_slot(struct heap_rt *h)
  */
 static uint8_t
 heap_create_alloc_class_buckets(struct heap_rt *h,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	enum header_type header_type)
 {
 	uint8_t slot = heap_find_first_free_bucket_slot(h);
 	if (slot == MAX_BUCKETS)
 		goto out;
 
-	h->buckets[slot] = &(bucket_run_new(slot, CONTAINER_CTREE,
-			unit_size, unit_max, unit_max_alloc)->super);
-
-	if (h->buckets[slot] == NULL)
+	struct bucket_run *b = bucket_run_new(slot, CONTAINER_CTREE,
+			unit_size, unit_max, unit_max_alloc);
+	if (b == NULL)
 		goto error_bucket_new;
 
+	struct bucket_run_stats *stats = &h->run_stats[slot];
+	memset(stats, 0, sizeof(*stats));
+	stats->run_free = h->run_free;
+	stats->nallocs = b->bitmap_nallocs;
+
+	b->header_type = header_type;
+	bucket_set_run_stats(&b->super, stats);
+	h->buckets[slot] = &b->super;
+
 	int i;
 	for (i = 0; i < (int)h->ncaches; ++i) {
-		h->caches[i].buckets[slot] =
-			&(bucket_run_new(slot, CONTAINER_CTREE,
-				unit_size, unit_max, unit_max_alloc)->super);
-		if (h->caches[i].buckets[slot] == NULL)
+		b = bucket_run_new(slot, CONTAINER_CTREE,
+				unit_size, unit_max, unit_max_alloc);
+		if (b == NULL)
 			goto error_cache_bucket_new;
+
+		b->header_type = header_type;
+		bucket_set_run_stats(&b->super, stats);
+		h->caches[i].buckets[slot] = &b->super;
 	}
 
 out:
@@ -545,14 +768,184 @@ error_bucket_new:
 	return MAX_BUCKETS;
 }
 
+/*
+ * heap_find_alloc_class_by_unit_size -- (internal) searches for an existing
+ *	allocation class with exactly the given unit size and header type
+ */
+static uint8_t
+heap_find_alloc_class_by_unit_size(struct heap_rt *h, size_t unit_size,
+	enum header_type header_type)
+{
+	for (int i = MAX_BUCKETS - 1; i >= 0; --i) {
+		struct bucket *b = h->buckets[i];
+		if (b == NULL || b == BUCKET_RESERVED)
+			continue;
+
+		if (b->unit_size == unit_size &&
+			((struct bucket_run *)b)->header_type == header_type)
+			return (uint8_t)i;
+	}
+
+	return MAX_BUCKETS;
+}
+
+/*
+ * heap_class_cost -- (internal) returns the space of a run taken by a block
+ *	of the given size, including its share of the space left at the end of
+ *	the run
+ */
+static size_t
+heap_class_cost(struct heap_rt *h, uint8_t bucket_idx, size_t size)
+{
+	struct bucket *b = h->buckets[bucket_idx];
+
+	return RUNSIZE * b->calc_units(b, size) / (RUNSIZE / b->unit_size);
+}
+
+/*
+ * heap_tune_map -- (internal) serves the sizes for which the class is cheaper
+ *	than the classes they're currently mapped to, from the size of its unit
+ *	downwards
+ */
+static void
+heap_tune_map(struct heap_rt *h, uint8_t bucket_idx)
+{
+	size_t unit_size = h->buckets[bucket_idx]->unit_size;
+	size_t cost = heap_class_cost(h, bucket_idx, unit_size);
+
+	for (size_t i = unit_size / ALLOC_BLOCK_SIZE;
+			i >= FIRST_GENERATED_CLASS_SIZE; --i) {
+		size_t size = i * ALLOC_BLOCK_SIZE;
+		if (size > h->last_run_max_size)
+			continue;
+
+		if (heap_class_cost(h, h->bucket_map[i], size) <= cost)
+			break;
+
+		h->bucket_map[i] = bucket_idx;
+	}
+}
+
+/*
+ * heap_tune -- (internal) creates the allocation classes for the sizes that
+ *	make up a large part of the sampled allocations, but are served with a
+ *	lot of internal fragmentation
+ *
+ * The tuned classes don't need to be recorded anywhere, they're created again
+ * for their runs when the pool is opened, see
+ * heap_get_create_bucket_idx_by_unit_size. Classes can't be removed while
+ * any of their runs exist, so a class which is no longer used just won't get
+ * any new runs.
+ */
+static void
+heap_tune(struct heap_rt *h)
+{
+	if (util_mutex_trylock(&h->tune_lock) != 0)
+		return; /* already being tuned by another thread */
+
+	uint32_t nsamples = h->tune_nsamples;
+	if (nsamples < HEAP_TUNE_INTERVAL)
+		goto out;
+
+	h->tune_nsamples = 0;
+
+	/* the classes are also created when populating the zones */
+	util_mutex_lock(&h->default_bucket->lock);
+
+	size_t max = h->last_run_max_size / ALLOC_BLOCK_SIZE;
+	for (size_t i = FIRST_GENERATED_CLASS_SIZE; i <= max; ++i) {
+		uint32_t n = h->tune_hist[i];
+		if (n == 0)
+			continue;
+
+		h->tune_hist[i] = 0;
+		if (n < nsamples / HEAP_TUNE_HOT_SHARE ||
+			h->tune_nclasses == HEAP_TUNE_MAX_CLASSES)
+			continue;
+
+		/*
+		 * The unit is as large as possible without fitting fewer
+		 * blocks in a run, so that it serves more of the sizes.
+		 */
+		size_t size = i * ALLOC_BLOCK_SIZE;
+		size_t nunits = RUNSIZE / size;
+		size_t unit_size = RUNSIZE / nunits / ALLOC_BLOCK_SIZE *
+			ALLOC_BLOCK_SIZE;
+		size_t cost = heap_class_cost(h, h->bucket_map[i], size);
+		if (cost < RUNSIZE / nunits + size / HEAP_TUNE_MIN_WASTE ||
+				unit_size > h->last_run_max_size)
+			continue;
+
+		uint8_t bucket_idx = heap_find_alloc_class_by_unit_size(h,
+			unit_size, HEADER_LEGACY);
+		if (bucket_idx == MAX_BUCKETS) {
+			bucket_idx = heap_create_alloc_class_buckets(h,
+				unit_size, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC,
+				HEADER_LEGACY);
+			if (bucket_idx == MAX_BUCKETS) {
+				/* no more free slots */
+				h->tune_nclasses = HEAP_TUNE_MAX_CLASSES;
+				continue;
+			}
+
+			h->tune_nclasses++;
+			LOG(3, "allocation class of %zu bytes created",
+				unit_size);
+		}
+
+		heap_tune_map(h, bucket_idx);
+	}
+
+	util_mutex_unlock(&h->default_bucket->lock);
+
+out:
+	util_mutex_unlock(&h->tune_lock);
+}
+
+/*
+ * heap_tune_sample -- (internal) samples the size of an allocation served
+ *	by a run, tunes the allocation classes once there are enough samples
+ */
+static inline void
+heap_tune_sample(struct heap_rt *h, size_t size)
+{
+	if ((++Tune_sample & (HEAP_TUNE_SAMPLE_RATE - 1)) != 0)
+		return;
+
+	__sync_fetch_and_add(&h->tune_hist[SIZE_TO_ALLOC_BLOCKS(size)], 1);
+
+	if (__sync_add_and_fetch(&h->tune_nsamples, 1) >= HEAP_TUNE_INTERVAL)
+		heap_tune(h);
+}
+
 /*
  * heap_get_create_bucket_idx_by_unit_size -- (internal) retrieves or creates
  *	the memory bucket index that points to buckets that are responsible
- *	for allocations with the given unit size.
+ *	for allocations with the given unit size and header type.
  */
 static uint8_t
-heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
+heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size,
+	enum header_type header_type)
 {
+	if (header_type != HEADER_LEGACY) {
+		/*
+		 * Classes without allocation headers are never generated by
+		 * the algorithm, the runs left behind by the previous
+		 * incarnation of the pool are served by an implicitly
+		 * registered class.
+		 */
+		uint8_t bucket_idx = heap_find_alloc_class_by_unit_size(h,
+			unit_size, header_type);
+		if (bucket_idx == MAX_BUCKETS)
+			bucket_idx = heap_create_alloc_class_buckets(h,
+				unit_size, RUN_UNIT_MAX, 1, header_type);
+
+		if (bucket_idx == MAX_BUCKETS)
+			ERR("Failed to allocate new bucket class");
+
+		return bucket_idx;
+	}
+
 	uint8_t bucket_idx = SIZE_TO_BID(h, unit_size);
 	if (h->buckets[bucket_idx]->unit_size != unit_size) {
 		/*
@@ -561,9 +954,17 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
 		 * custom allocation class in the previous incarnation of
 		 * the pool. Normally all the buckets are created at
 		 * initialization time.
+		 *
+		 * The custom class might have already been registered again
+		 * in this incarnation of the pool.
 		 */
+		bucket_idx = heap_find_alloc_class_by_unit_size(h, unit_size,
+			header_type);
+		if (bucket_idx != MAX_BUCKETS)
+			return bucket_idx;
+
 		bucket_idx = heap_create_alloc_class_buckets(h, unit_size,
-			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, header_type);
 
 		if (bucket_idx == MAX_BUCKETS) {
 			ERR("Failed to allocate new bucket class");
@@ -577,9 +978,17 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
 		 * If this is an unused bucket, then eventually it will
 		 * be rendered redundant because all backing chunks
 		 * will get freed.
+		 *
+		 * Unless the classes are tuned, in which case it was most
+		 * likely created by the tuning and serves the same sizes
+		 * again.
 		 */
-		size_t supported_block = unit_size / ALLOC_BLOCK_SIZE;
-		h->bucket_map[supported_block] = bucket_idx;
+		if (h->tune_hist != NULL) {
+			heap_tune_map(h, bucket_idx);
+		} else {
+			size_t supported_block = unit_size / ALLOC_BLOCK_SIZE;
+			h->bucket_map[supported_block] = bucket_idx;
+		}
 	}
 
 	ASSERTne(bucket_idx, MAX_BUCKETS);
@@ -590,8 +999,8 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
  * heap_register_active_run -- (internal) inserts a run for eventual reuse
  */
 static void
-heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
-	uint32_t chunk_id, uint32_t zone_id)
+heap_register_active_run(struct heap_rt *h, struct chunk_header *hdr,
+	struct chunk_run *run, uint32_t chunk_id, uint32_t zone_id)
 {
 	/* reset the volatile state of the run */
 	run->bucket_vptr = 0;
@@ -610,7 +1019,7 @@ heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
 	arun->zone_id = zone_id;
 
 	uint8_t bucket_idx = heap_get_create_bucket_idx_by_unit_size(h,
-		run->block_size);
+		run->block_size, heap_run_header_type(hdr));
 
 	if (bucket_idx == MAX_BUCKETS) {
 		ASSERT(0);
@@ -618,6 +1027,86 @@ heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
 	}
 
 	SLIST_INSERT_HEAD(&h->active_runs[bucket_idx], arun, run);
+	__sync_fetch_and_add(&h->run_stats[bucket_idx].nruns_unloaded, 1);
+}
+
+/*
+ * heap_zone_full -- (internal) checks whether the summary of the previous run
+ *	shows that the zone had no free space left
+ */
+static int
+heap_zone_full(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *h = heap->rt;
+	if (h->summary_gen == 0 || util_isset(h->zones_dirty, zone_id))
+		return 0;
+
+	if (zone_id >= heap_zones_valid(heap->layout, h->max_zone))
+		return 0;
+
+	struct zone_header *zh = &ZID_TO_ZONE(heap->layout, zone_id)->header;
+
+	return zh->magic == ZONE_HEADER_MAGIC &&
+		zh->zone_gen == h->summary_gen &&
+		zh->free_chunks == 0 && zh->free_runs == 0;
+}
+
+/*
+ * heap_next_zone -- (internal) picks the next zone to be populated
+ *
+ * Zones backed by the NUMA node of the calling thread are preferred,
+ * otherwise the zones are processed in order. The zones which were full
+ * when the pool was last closed are left for last, they would only be walked
+ * through for nothing.
+ */
+static uint32_t
+heap_next_zone(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	int node = h->zone_numa_node != NULL ? util_get_numa_node() : -1;
+	uint32_t first = UINT32_MAX;
+	uint32_t full = UINT32_MAX;
+
+	for (uint32_t i = 0; i < h->max_zone; ++i) {
+		if (util_isset(h->zones_populated, i))
+			continue;
+
+		if (heap_zone_full(heap, i)) {
+			if (full == UINT32_MAX)
+				full = i;
+			continue;
+		}
+
+		if (node < 0 || h->zone_numa_node[i] == node)
+			return i;
+
+		if (first == UINT32_MAX)
+			first = i;
+	}
+
+	if (first == UINT32_MAX)
+		first = full;
+
+	ASSERTne(first, UINT32_MAX);
+	return first;
+}
+
+/*
+ * heap_zone_fresh_init -- (internal) marks all chunks of the zone as fresh
+ */
+static void
+heap_zone_fresh_init(struct heap_rt *h, uint32_t zone_id)
+{
+	uint16_t *fresh = Malloc(sizeof(uint16_t) * MAX_CHUNK);
+	if (fresh == NULL) {
+		LOG(2, "zone %u memory not known to be zeroed", zone_id);
+		return;
+	}
+
+	memset(fresh, 0xFF, sizeof(uint16_t) * MAX_CHUNK);
+	COMPILE_ERROR_ON(CHUNK_FRESH_ALL != UINT16_MAX);
+
+	h->chunk_fresh[zone_id] = fresh;
 }
 
 /*
@@ -628,17 +1117,35 @@ heap_populate_buckets(struct palloc_heap *heap)
 {
 	struct heap_rt *h = heap->rt;
 
-	if (h->zones_exhausted == h->max_zone)
-		return ENOMEM;
+	uint32_t zone_id;
+	do {
+		if (h->zones_exhausted == h->max_zone)
+			return ENOMEM;
+
+		zone_id = heap_next_zone(heap);
+		util_setbit(h->zones_populated, zone_id);
+		h->zones_exhausted++;
+
+		/* an inconsistent zone is never used */
+	} while (heap_zone_checked(heap, zone_id) != 0);
 
-	uint32_t zone_id = h->zones_exhausted++;
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
+	/* the statistics of the zone's runs are just not gathered without it */
+	h->run_free[zone_id] = Zalloc(sizeof(uint16_t) * MAX_CHUNK);
+	if (h->run_free[zone_id] == NULL)
+		LOG(2, "zone %u excluded from the run statistics", zone_id);
+
+	if (h->chunk_fresh != NULL)
+		heap_zone_fresh_init(h, zone_id);
+
 	/* ignore zone and chunk headers */
 	VALGRIND_ADD_TO_GLOBAL_TX_IGNORE(z, sizeof(z->header) +
 		sizeof(z->chunk_headers));
 
-	if (z->header.magic != ZONE_HEADER_MAGIC)
+	if (zone_id >= heap_zones_valid(heap->layout, h->max_zone))
+		heap_zones_validate(heap, zone_id);
+	else if (z->header.magic != ZONE_HEADER_MAGIC)
 		heap_zone_init(heap, zone_id);
 
 	struct bucket *def_bucket = h->default_bucket;
@@ -653,7 +1160,8 @@ heap_populate_buckets(struct palloc_heap *heap)
 		switch (hdr->type) {
 			case CHUNK_TYPE_RUN:
 				run = (struct chunk_run *)&z->chunks[i];
-				heap_register_active_run(h, run, i, zone_id);
+				heap_register_active_run(h, hdr, run,
+					i, zone_id);
 				break;
 			case CHUNK_TYPE_FREE:
 				m.chunk_id = i;
@@ -688,6 +1196,7 @@ heap_get_active_run(struct heap_rt *h, int bucket_idx,
 		goto out;
 
 	SLIST_REMOVE_HEAD(&h->active_runs[bucket_idx], run);
+	__sync_fetch_and_sub(&h->run_stats[bucket_idx].nruns_unloaded, 1);
 
 	m->chunk_id = arun->chunk_id;
 	m->zone_id = arun->zone_id;
@@ -712,6 +1221,25 @@ heap_get_default_bucket(struct palloc_heap *heap)
 	return heap->rt->default_bucket;
 }
 
+/*
+ * heap_run_features -- (internal) returns the on-media features the runs of
+ *	the bucket depend on
+ */
+static unsigned
+heap_run_features(struct bucket_run *r)
+{
+	unsigned features = 0;
+
+	if (r->header_type == HEADER_COMPACT)
+		features |= HEAP_FEAT_COMPACT_HEADER;
+
+	if (r->header_type == HEADER_NONE ||
+		RUN_BITMAP_EXT_SIZE(r->super.unit_size) != 0)
+		features |= HEAP_FEAT_TINY_RUNS;
+
+	return features;
+}
+
 /*
  * heap_ensure_bucket_filled -- (internal) refills the bucket if needed
  */
@@ -720,17 +1248,29 @@ heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
 {
 	if (b->type == BUCKET_HUGE) {
 		/* not much to do here apart from using the next zone */
-		return heap_populate_buckets(heap);
+		int ret = heap_populate_buckets(heap);
+
+		/* the chunks set aside are the last resort */
+		if (ret == ENOMEM && heap_release_reserves(heap) != 0)
+			ret = 0;
+
+		return ret;
 	}
 
 	struct heap_rt *h = heap->rt;
 	struct memory_block m = {0, 0, 1, 0};
 
 	if (!heap_get_active_run(h, b->id, &m)) {
-		/* cannot reuse an existing run, create a new one */
-		struct bucket *def_bucket = heap_get_default_bucket(heap);
+		/* the pool must know the features before the run exists */
+		unsigned features = heap_run_features((struct bucket_run *)b);
+		if (features != 0 && h->feature_enable != NULL) {
+			int err = h->feature_enable(h->feature_arg, features);
+			if (err != 0)
+				return err;
+		}
 
-		if (heap_get_bestfit_block(heap, def_bucket, &m) != 0)
+		/* cannot reuse an existing run, create a new one */
+		if (heap_get_run_chunk(heap, &m) != 0)
 			return ENOMEM; /* OOM */
 
 		ASSERT(m.block_off == 0);
@@ -744,11 +1284,11 @@ heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
 }
 
 /*
- * heap_get_cache_bucket -- (internal) returns the bucket for given id from
- *	semi-per-thread cache
+ * heap_get_cache -- (internal) returns the semi-per-thread cache of the
+ *	calling thread
  */
-static struct bucket *
-heap_get_cache_bucket(struct heap_rt *heap, int bucket_id)
+static struct bucket_cache *
+heap_get_cache(struct heap_rt *heap)
 {
 	/*
 	 * Choose cache index only once in a threads lifetime.
@@ -758,7 +1298,17 @@ heap_get_cache_bucket(struct heap_rt *heap, int bucket_id)
 		Cache_idx = __sync_fetch_and_add(&Next_cache_idx, 1);
 	}
 
-	return heap->caches[Cache_idx % heap->ncaches].buckets[bucket_id];
+	return &heap->caches[Cache_idx % heap->ncaches];
+}
+
+/*
+ * heap_get_cache_bucket -- (internal) returns the bucket for given id from
+ *	semi-per-thread cache
+ */
+static struct bucket *
+heap_get_cache_bucket(struct heap_rt *heap, int bucket_id)
+{
+	return heap_get_cache(heap)->buckets[bucket_id];
 }
 
 /*
@@ -782,6 +1332,9 @@ heap_get_best_bucket(struct palloc_heap *heap, size_t size)
 {
 	struct heap_rt *rt = heap->rt;
 	if (size <= rt->last_run_max_size) {
+		if (rt->tune_hist != NULL)
+			heap_tune_sample(rt, size);
+
 		return heap_get_bucket_by_idx(rt, SIZE_TO_BID(rt, size));
 	} else {
 		return rt->default_bucket;
@@ -807,11 +1360,11 @@ heap_get_run_bucket(struct chunk_run *run)
  * heap_assign_run_bucket -- (internal) finds and sets bucket for a run
  */
 static struct bucket *
-heap_assign_run_bucket(struct palloc_heap *heap, struct chunk_run *run,
-	uint32_t chunk_id, uint32_t zone_id)
+heap_assign_run_bucket(struct palloc_heap *heap, struct chunk_header *hdr,
+	struct chunk_run *run, uint32_t chunk_id, uint32_t zone_id)
 {
 	uint8_t bucket_idx = heap_get_create_bucket_idx_by_unit_size(heap->rt,
-		run->block_size);
+		run->block_size, heap_run_header_type(hdr));
 
 	/*
 	 * Due to lack of resources the volatile heap state can't be tracked
@@ -841,8 +1394,14 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 	ASSERT(zone_id < rt->max_zone);
 
 	/* This zone wasn't processed yet, so no associated bucket */
-	if (zone_id >= rt->zones_exhausted)
+	if (!util_isset(rt->zones_populated, zone_id)) {
+		/* the block is likely to be freed, its summary is stale */
+		if (rt->zones_dirty != NULL &&
+				!util_isset(rt->zones_dirty, zone_id))
+			__sync_fetch_and_or(&rt->zones_dirty[zone_id / 8],
+				(uint8_t)(1 << (zone_id % 8)));
 		return NULL;
+	}
 
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
@@ -856,7 +1415,7 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 		if (run->bucket_vptr != 0)
 			return heap_get_run_bucket(run);
 		else
-			return heap_assign_run_bucket(heap, run,
+			return heap_assign_run_bucket(heap, hdr, run,
 				chunk_id, zone_id);
 	} else {
 		return rt->default_bucket;
@@ -864,19 +1423,115 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 }
 
 /*
- * heap_get_auxiliary_bucket -- returns bucket common for all threads
+ * heap_create_alloc_class -- registers a custom allocation class
+ *
+ * Run classes provide blocks of units_per_block (at most) units of unit_size
+ * bytes. If a class with the same unit size and header type already exists,
+ * its id is returned instead. The only huge class is the one backed by whole
+ * chunks. Classes without allocation headers can only provide single-unit
+ * blocks, but their units can be smaller than a cacheline.
+ *
+ * If successful function returns zero. Otherwise an error number is returned.
  */
-struct bucket *
-heap_get_auxiliary_bucket(struct palloc_heap *heap, size_t size)
+int
+heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_block, int huge, enum header_type header_type,
+	unsigned *class_id)
 {
-	ASSERT(size <= heap->rt->last_run_max_size);
+	struct heap_rt *h = heap->rt;
 
-	return heap->rt->buckets[SIZE_TO_BID(heap->rt, size)];
-}
+	if (header_type != HEADER_LEGACY && (huge || units_per_block != 1))
+		return EINVAL;
 
-/*
- * heap_drain_to_auxiliary -- migrates memory blocks from cache buckets
- */
+	if (huge) {
+		if (unit_size != CHUNKSIZE)
+			return EINVAL;
+
+		*class_id = HEAP_HUGE_CLASS_ID;
+		return 0;
+	}
+
+	if (header_type == HEADER_LEGACY) {
+		if (unit_size < MIN_RUN_SIZE ||
+			unit_size % ALLOC_BLOCK_SIZE != 0)
+			return EINVAL;
+	} else if (unit_size % MIN_HEADERLESS_RUN_SIZE != 0 ||
+		unit_size < MIN_HEADERLESS_RUN_SIZE ||
+		(header_type == HEADER_COMPACT &&
+		unit_size <= PALLOC_COMPACT_DATA_OFF)) {
+		return EINVAL;
+	}
+
+	if (unit_size > MAX_RUN_SIZE)
+		return EINVAL;
+
+	if (units_per_block == 0 || units_per_block > RUN_UNIT_MAX_ALLOC)
+		return EINVAL;
+
+	/*
+	 * Classes are also created when populating the zones, which always
+	 * happens with the default bucket locked.
+	 */
+	util_mutex_lock(&h->default_bucket->lock);
+
+	int ret = 0;
+	uint8_t slot = heap_find_alloc_class_by_unit_size(h, unit_size,
+		header_type);
+	if (slot == MAX_BUCKETS) {
+		slot = heap_create_alloc_class_buckets(h, unit_size,
+			RUN_UNIT_MAX, units_per_block, header_type);
+		if (slot == MAX_BUCKETS)
+			ret = ENOMEM;
+	}
+
+	util_mutex_unlock(&h->default_bucket->lock);
+
+	if (ret == 0)
+		*class_id = HEAP_BID_TO_CLASS_ID(slot);
+
+	return ret;
+}
+
+/*
+ * heap_get_class_bucket -- returns the bucket of a registered allocation
+ *	class, either from the semi-per-thread cache or the one common for all
+ *	threads
+ *
+ * Returns NULL if there's no such class.
+ */
+struct bucket *
+heap_get_class_bucket(struct palloc_heap *heap, unsigned class_id, int aux)
+{
+	struct heap_rt *rt = heap->rt;
+
+	if (class_id == HEAP_HUGE_CLASS_ID)
+		return rt->default_bucket;
+
+	if (class_id == 0 || class_id > MAX_BUCKETS)
+		return NULL;
+
+	uint8_t bid = (uint8_t)HEAP_CLASS_ID_TO_BID(class_id);
+	struct bucket *b = rt->buckets[bid];
+	if (b == NULL || b == BUCKET_RESERVED)
+		return NULL;
+
+	return aux ? b : heap_get_bucket_by_idx(rt, bid);
+}
+
+/*
+ * heap_get_auxiliary_bucket -- returns bucket common for all threads
+ */
+struct bucket *
+heap_get_auxiliary_bucket(struct palloc_heap *heap, size_t size)
+{
+	ASSERT(size <= heap->rt->last_run_max_size);
+
+	return heap->rt->buckets[SIZE_TO_BID(heap->rt, size)];
+}
+
+/*
+ * heap_drain_to_auxiliary -- migrates memory blocks from cache buckets
+ */
 void
 heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 	uint32_t size_idx)
@@ -994,7 +1649,7 @@ heap_find_or_create_alloc_class(struct palloc_heap *heap, size_t n)
 	}
 
 	return heap_create_alloc_class_buckets(h, n,
-		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, HEADER_LEGACY);
 }
 
 /*
@@ -1054,7 +1709,7 @@ heap_buckets_init(struct palloc_heap *heap)
 		goto error_bucket_map_malloc;
 
 	h->default_bucket = &(bucket_huge_new(MAX_BUCKETS,
-		CONTAINER_CTREE, CHUNKSIZE)->super);
+		HUGE_BUCKET_CONTAINER, CHUNKSIZE)->super);
 	if (h->default_bucket == NULL)
 		goto error_default_bucket_new;
 
@@ -1067,7 +1722,7 @@ heap_buckets_init(struct palloc_heap *heap)
 	 */
 	size_t size = 0;
 	uint8_t slot = heap_create_alloc_class_buckets(h,
-		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, HEADER_LEGACY);
 	if (slot == MAX_BUCKETS)
 		goto error_bucket_create;
 
@@ -1161,10 +1816,11 @@ error_bucket_map_malloc:
 }
 
 /*
- * heap_resize_chunk -- (internal) splits the chunk into two smaller ones
+ * heap_split_chunk -- (internal) splits the free chunk into two smaller ones,
+ *	returns the size index of the second one
  */
-static void
-heap_resize_chunk(struct palloc_heap *heap,
+static uint32_t
+heap_split_chunk(struct palloc_heap *heap,
 	uint32_t chunk_id, uint32_t zone_id, uint32_t new_size_idx)
 {
 	uint32_t new_chunk_id = chunk_id + new_size_idx;
@@ -1177,8 +1833,22 @@ heap_resize_chunk(struct palloc_heap *heap,
 	heap_chunk_init(heap, new_hdr, CHUNK_TYPE_FREE, rem_size_idx);
 	heap_chunk_init(heap, old_hdr, CHUNK_TYPE_FREE, new_size_idx);
 
+	return rem_size_idx;
+}
+
+/*
+ * heap_resize_chunk -- (internal) splits the chunk into two smaller ones
+ */
+static void
+heap_resize_chunk(struct palloc_heap *heap,
+	uint32_t chunk_id, uint32_t zone_id, uint32_t new_size_idx)
+{
+	uint32_t rem_size_idx = heap_split_chunk(heap, chunk_id, zone_id,
+		new_size_idx);
+
 	struct bucket *def_bucket = heap->rt->default_bucket;
-	struct memory_block m = {new_chunk_id, zone_id, rem_size_idx, 0};
+	struct memory_block m = {chunk_id + new_size_idx, zone_id,
+		rem_size_idx, 0};
 	CNT_OP(def_bucket, insert, heap, m);
 }
 
@@ -1232,6 +1902,207 @@ out:
 	return ret;
 }
 
+/*
+ * The new runs of a cache are carved out of a range of chunks set aside for
+ * it, so that the objects allocated by a thread end up close to each other
+ * rather than interleaved, chunk by chunk, with those of the other threads.
+ * The chunks set aside stay free on the media, they're just not in the
+ * default bucket, and are given back to it when there's no other free chunk
+ * left.
+ */
+
+/*
+ * heap_get_run_chunk -- (internal) extracts a free chunk for a new run of
+ *	the cache of the calling thread
+ */
+static int
+heap_get_run_chunk(struct palloc_heap *heap, struct memory_block *m)
+{
+	struct bucket *def_bucket = heap_get_default_bucket(heap);
+	if (Heap_affinity == 0)
+		return heap_get_bestfit_block(heap, def_bucket, m);
+
+	struct memory_block *r = &heap_get_cache(heap->rt)->reserve;
+
+	util_mutex_lock(&def_bucket->lock);
+
+	if (r->size_idx == 0) {
+		r->chunk_id = 0;
+		r->zone_id = 0;
+		r->size_idx = Heap_affinity;
+		r->block_off = 0;
+
+		/* no need to populate more zones, this is just a preference */
+		if (CNT_OP(def_bucket, get_rm_bestfit, r) != 0) {
+			r->size_idx = 0;
+			util_mutex_unlock(&def_bucket->lock);
+			return heap_get_bestfit_block(heap, def_bucket, m);
+		}
+
+		if (r->size_idx != Heap_affinity)
+			heap_recycle_block(heap, def_bucket, r, Heap_affinity);
+	}
+
+	*m = *r;
+	m->size_idx = 1;
+
+	if (r->size_idx > 1)
+		heap_split_chunk(heap, r->chunk_id, r->zone_id, 1);
+
+	r->chunk_id++;
+	r->size_idx--;
+
+	util_mutex_unlock(&def_bucket->lock);
+
+	return 0;
+}
+
+/*
+ * heap_release_reserves -- (internal) gives the chunks set aside for the
+ *	caches back to the default bucket, returns their number
+ *
+ * Must be called with the lock of the default bucket held.
+ */
+static int
+heap_release_reserves(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	struct bucket *def_bucket = heap_get_default_bucket(heap);
+
+	int nreleased = 0;
+	for (unsigned i = 0; i < h->ncaches; ++i) {
+		struct memory_block *r = &h->caches[i].reserve;
+		if (r->size_idx == 0)
+			continue;
+
+		CNT_OP(def_bucket, insert, heap, *r);
+		nreleased += (int)r->size_idx;
+		r->size_idx = 0;
+	}
+
+	return nreleased;
+}
+
+/*
+ * heap_tune_init -- enables the tuning of the allocation classes, if requested
+ *	by the given environment variable
+ */
+void
+heap_tune_init(const char *tune_var)
+{
+	char *e = getenv(tune_var);
+	if (e == NULL || atoi(e) == 0)
+		return;
+
+	Heap_tune = 1;
+	LOG(3, "allocation classes tuning enabled");
+}
+
+/*
+ * heap_affinity_init -- reads the number of chunks set aside for the runs of
+ *	each cache from the given environment variable
+ */
+void
+heap_affinity_init(const char *affinity_var)
+{
+	char *e = getenv(affinity_var);
+	if (e == NULL)
+		return;
+
+	long val = atol(e);
+	if (val < 0 || val > HEAP_AFFINITY_MAX) {
+		LOG(2, "Invalid %s", affinity_var);
+		return;
+	}
+
+	/* a single chunk would be set aside for nothing */
+	Heap_affinity = val > 1 ? (uint32_t)val : 0;
+	LOG(3, "%s set to %u", affinity_var, Heap_affinity);
+}
+
+/*
+ * heap_get_bestfit_blocks -- extracts up to n memory blocks of equal size
+ *	index from a run bucket with a single acquisition of the bucket lock
+ *
+ * Returns the number of extracted blocks, zero means out of memory.
+ */
+unsigned
+heap_get_bestfit_blocks(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n, uint32_t units)
+{
+	ASSERTeq(b->type, BUCKET_RUN);
+	ASSERT(units <= UINT16_MAX);
+
+	util_mutex_lock(&b->lock);
+
+	unsigned nblocks = 0;
+	struct memory_block m;
+
+	while (nblocks < n) {
+		/* the whole block is the search key of the container */
+		m.chunk_id = 0;
+		m.zone_id = 0;
+		m.size_idx = units;
+		m.block_off = 0;
+		if (CNT_OP(b, get_rm_bestfit, &m) != 0) {
+			/* refill only if nothing was reserved so far */
+			if (nblocks != 0 ||
+			    heap_ensure_bucket_filled(heap, b) != 0)
+				break;
+
+			continue;
+		}
+
+		ASSERT(m.size_idx >= units);
+
+		/*
+		 * A free block in a run never crosses the boundary of a single
+		 * bitmap value, so neither do the blocks cut out of it.
+		 */
+		while (nblocks < n && m.size_idx >= units) {
+			blocks[nblocks] = m;
+			blocks[nblocks].size_idx = units;
+			nblocks++;
+
+			m.block_off = (uint16_t)(m.block_off + units);
+			m.size_idx -= units;
+		}
+
+		if (m.size_idx != 0)
+			CNT_OP(b, insert, heap, m);
+	}
+
+	util_mutex_unlock(&b->lock);
+
+	return nblocks;
+}
+
+/*
+ * heap_return_blocks -- puts reserved, but unused, memory blocks back
+ *	into the bucket they were extracted from
+ *
+ * The blocks are coalesced with their free neighbours in the reverse order,
+ * so that the consecutive blocks cut out by heap_get_bestfit_blocks are merged
+ * back together. Runs which become entirely free are degraded into chunks.
+ */
+void
+heap_return_blocks(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n)
+{
+	for (unsigned i = n; i > 0; --i) {
+		struct memory_block m = blocks[i - 1];
+
+		MEMBLOCK_OPS(AUTO, &m)->lock(&m, heap);
+		struct memory_block fm = heap_free_block(heap, b, m, NULL);
+		CNT_OP(b, insert, heap, fm);
+		MEMBLOCK_OPS(AUTO, &m)->unlock(&m, heap);
+
+		if (i == 1 || blocks[i - 2].chunk_id != m.chunk_id ||
+		    blocks[i - 2].zone_id != m.zone_id)
+			heap_degrade_run_if_empty(heap, b, fm);
+	}
+}
+
 /*
  * heap_get_exact_block --
  *	extracts exactly this memory block and cuts it accordingly
@@ -1256,6 +2127,90 @@ out:
 	return 0;
 }
 
+/*
+ * heap_extend_block -- extracts the free memory block that directly follows
+ *	the given one from the transient heap, so that together they consist of
+ *	'units' units
+ *
+ * The caller must hold the lock of the memory block. Returns ENOMEM if there
+ * isn't enough free space right after the block, or if that space is
+ * currently reserved by someone else.
+ */
+int
+heap_extend_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m, uint32_t units)
+{
+	ASSERT(units > m->size_idx);
+
+	uint32_t extra = units - m->size_idx;
+	struct memory_block next = {0, 0, 0, 0};
+
+	/*
+	 * Unlike runs, huge blocks have no lock of their own - splitting of
+	 * free chunks is serialized by the lock of the default bucket.
+	 */
+	if (b->type == BUCKET_HUGE)
+		util_mutex_lock(&b->lock);
+
+	int ret = ENOMEM;
+	if (heap_get_adjacent_free_block(heap, b, &next, *m, 0) != 0 ||
+		next.size_idx < extra || CNT_OP(b, get_rm_exact, next) != 0)
+		goto out;
+
+	if (next.size_idx != extra)
+		heap_recycle_block(heap, b, &next, extra);
+
+	/* the extension is handed out just like a newly allocated block */
+	heap_block_fresh(heap, next);
+
+	m->size_idx = units;
+	ret = 0;
+
+out:
+	if (b->type == BUCKET_HUGE)
+		util_mutex_unlock(&b->lock);
+
+	return ret;
+}
+
+/*
+ * heap_trim_huge_block -- returns the leading and the trailing chunks of
+ *	a reserved huge memory block back to the default bucket, so that
+ *	the block begins 'lead' chunks later and consists of 'units' chunks
+ */
+void
+heap_trim_huge_block(struct palloc_heap *heap, struct memory_block *m,
+	uint32_t lead, uint32_t units)
+{
+	ASSERT(m->size_idx >= lead + units);
+
+	struct bucket *def_bucket = heap->rt->default_bucket;
+
+	util_mutex_lock(&def_bucket->lock);
+
+	if (lead != 0) {
+		struct zone *z = ZID_TO_ZONE(heap->layout, m->zone_id);
+		struct chunk_header *old_hdr = &z->chunk_headers[m->chunk_id];
+		struct chunk_header *new_hdr =
+			&z->chunk_headers[m->chunk_id + lead];
+
+		heap_chunk_init(heap, new_hdr, CHUNK_TYPE_FREE,
+			m->size_idx - lead);
+		heap_chunk_init(heap, old_hdr, CHUNK_TYPE_FREE, lead);
+
+		struct memory_block l = {m->chunk_id, m->zone_id, lead, 0};
+		CNT_OP(def_bucket, insert, heap, l);
+
+		m->chunk_id += lead;
+		m->size_idx -= lead;
+	}
+
+	if (units != m->size_idx)
+		heap_recycle_block(heap, def_bucket, m, units);
+
+	util_mutex_unlock(&def_bucket->lock);
+}
+
 /*
  * heap_get_block_data -- returns pointer to the data of a block
  */
@@ -1272,7 +2227,98 @@ heap_get_block_data(struct palloc_heap *heap, struct memory_block m)
 	struct chunk_run *run = data;
 	ASSERT(run->block_size != 0);
 
-	return (char *)&run->data + (run->block_size * m.block_off);
+	return (char *)RUN_DATA(run) + (run->block_size * m.block_off);
+}
+
+/*
+ * heap_get_headerless_block -- checks whether the address belongs to a run
+ *	whose objects have no allocation header and, if so, returns the memory
+ *	block which contains it
+ *
+ * All zones and chunks are of fixed size, which is what makes it possible to
+ * find the chunk of an object that has no allocation header. The address
+ * may also point to a chunk of a huge block other than the first one, but
+ * the headers of such chunks are never marked as runs.
+ *
+ * Returns the type of the object headers in the run, or HEADER_LEGACY if the
+ * block has to be found through its allocation header.
+ */
+enum header_type
+heap_get_headerless_block(struct palloc_heap *heap, const void *ptr,
+	struct memory_block *m)
+{
+	uintptr_t zone_off = (uintptr_t)ptr - (uintptr_t)&heap->layout->zone0;
+	uint32_t zone_id = (uint32_t)(zone_off / ZONE_MAX_SIZE);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+	uintptr_t chunk_off = (uintptr_t)ptr - (uintptr_t)&z->chunks[0];
+	uint32_t chunk_id = (uint32_t)(chunk_off / CHUNKSIZE);
+
+	struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+	if (hdr->type != CHUNK_TYPE_RUN)
+		return HEADER_LEGACY;
+
+	enum header_type header_type = heap_run_header_type(hdr);
+	if (header_type == HEADER_LEGACY)
+		return HEADER_LEGACY;
+
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[chunk_id];
+
+	m->chunk_id = chunk_id;
+	m->zone_id = zone_id;
+	m->block_off = (uint16_t)(((uintptr_t)ptr - (uintptr_t)RUN_DATA(run)) /
+		run->block_size);
+	m->size_idx = 1;
+
+	return header_type;
+}
+
+/*
+ * heap_prefetch_block -- prefetches the chunk header of the memory block
+ *	holding the given address, see heap_get_headerless_block
+ */
+void
+heap_prefetch_block(struct palloc_heap *heap, const void *ptr)
+{
+	uintptr_t zone_off = (uintptr_t)ptr - (uintptr_t)&heap->layout->zone0;
+	uint32_t zone_id = (uint32_t)(zone_off / ZONE_MAX_SIZE);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+	uintptr_t chunk_off = (uintptr_t)ptr - (uintptr_t)&z->chunks[0];
+	uint32_t chunk_id = (uint32_t)(chunk_off / CHUNKSIZE);
+
+	util_prefetch(&z->chunk_headers[chunk_id]);
+}
+
+/*
+ * heap_get_block_padding -- returns the number of bytes by which the data at
+ *	the given offset from the beginning of a memory block of the bucket has
+ *	to be moved forward to be aligned
+ *
+ * All chunks in the heap are equally aligned and so are the blocks of runs
+ * whose unit size is a multiple of the alignment, which means that the padding
+ * is the same for all memory blocks of the bucket. Huge blocks with alignment
+ * above the chunk size additionally have to skip over a number of leading
+ * chunks, which is not accounted for here.
+ */
+size_t
+heap_get_block_padding(struct palloc_heap *heap, struct bucket *b,
+	size_t off, size_t alignment)
+{
+	COMPILE_ERROR_ON(ZONE_MAX_SIZE % CHUNKSIZE != 0);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, 0);
+	uintptr_t data = (uintptr_t)&z->chunks[0].data + off;
+
+	if (b->type == BUCKET_RUN) {
+		ASSERTeq(b->unit_size % alignment, 0);
+		data += offsetof(struct chunk_run, data) +
+			RUN_BITMAP_EXT_SIZE(b->unit_size);
+	} else if (alignment > CHUNKSIZE) {
+		alignment = CHUNKSIZE;
+	}
+
+	return (alignment - data % alignment) % alignment;
 }
 
 #ifdef DEBUG
@@ -1296,7 +2342,7 @@ heap_block_is_allocated(struct palloc_heap *heap, struct memory_block m)
 	struct chunk_run *r = (struct chunk_run *)&z->chunks[m.chunk_id];
 
 	unsigned v = m.block_off / BITS_PER_VALUE;
-	uint64_t bitmap = r->bitmap[v];
+	uint64_t bitmap = RUN_BITMAP(r)[v];
 	unsigned b = m.block_off % BITS_PER_VALUE;
 
 	unsigned b_last = b + m.size_idx;
@@ -1320,6 +2366,7 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 {
 	unsigned v = block_off / BITS_PER_VALUE;
 	unsigned b = block_off % BITS_PER_VALUE;
+	uint64_t bitmap = RUN_BITMAP(r)[v];
 
 	ASSERTeq(rb->type, BUCKET_RUN);
 	struct bucket_run *run = (struct bucket_run *)rb;
@@ -1327,7 +2374,7 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 	if (prev) {
 		unsigned i;
 		for (i = b;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i - 1);
+			i % run->unit_max && BIT_IS_CLR(bitmap, i - 1);
 			--i)
 			;
 
@@ -1337,7 +2384,7 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 	} else { /* next */
 		unsigned i;
 		for (i = b + size_idx;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i);
+			i % run->unit_max && BIT_IS_CLR(bitmap, i);
 			++i)
 			;
 
@@ -1472,6 +2519,12 @@ heap_free_block(struct palloc_heap *heap, struct bucket *b,
 
 /*
  * traverse_bucket_run -- (internal) traverses each memory block of a run
+ *
+ * The free blocks never cross the boundaries of unit_max units, but
+ * within them the free space can be split into any number of blocks, for
+ * example when adjacent blocks couldn't be coalesced because one of them
+ * was reserved at the time. The blocks are found greedily, longest first,
+ * which for a given state of the container always yields the same set.
  */
 static int
 traverse_bucket_run(struct bucket *b, struct memory_block m,
@@ -1481,61 +2534,303 @@ traverse_bucket_run(struct bucket *b, struct memory_block m,
 	struct bucket_run *r = (struct bucket_run *)b;
 
 	m.block_off = 0;
-	m.size_idx = r->unit_max;
-	uint32_t size_idx_sum = 0;
 
-	while (size_idx_sum != r->bitmap_nallocs) {
-		if (m.block_off + r->unit_max > r->bitmap_nallocs)
-			m.size_idx = r->bitmap_nallocs - m.block_off;
-		else
-			m.size_idx = r->unit_max;
+	while (m.block_off != r->bitmap_nallocs) {
+		uint32_t end = m.block_off - m.block_off % r->unit_max +
+			r->unit_max;
+		if (end > r->bitmap_nallocs)
+			end = r->bitmap_nallocs;
 
-		if (cb(b->container, m) != 0)
-			return 1;
+		for (m.size_idx = end - m.block_off; m.size_idx != 0;
+				--m.size_idx) {
+			if (cb(b->container, m) == 0)
+				break;
+		}
 
-		size_idx_sum += m.size_idx;
+		if (m.size_idx == 0)
+			return 1;
 
-		ASSERT((uint32_t)m.block_off + r->unit_max <= UINT16_MAX);
-		m.block_off = (uint16_t)(m.block_off + r->unit_max);
+		ASSERT((uint32_t)m.block_off + m.size_idx <= UINT16_MAX);
+		m.block_off = (uint16_t)(m.block_off + m.size_idx);
 	}
 
 	return 0;
 }
 
 /*
- * heap_degrade_run_if_empty -- makes a chunk out of an empty run
+ * heap_run_occupancy -- returns the percentage of used units in the run that
+ *	contains the memory block, huge blocks are always fully used
  */
-void
-heap_degrade_run_if_empty(struct palloc_heap *heap,
-		struct bucket *b, struct memory_block m)
+unsigned
+heap_run_occupancy(struct palloc_heap *heap, struct memory_block m)
 {
 	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
 	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
-	ASSERT(hdr->type == CHUNK_TYPE_RUN);
+	if (hdr->type != CHUNK_TYPE_RUN)
+		return 100;
 
 	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
 
-	ASSERTeq(b->type, BUCKET_RUN);
-	struct bucket_run *r = (struct bucket_run *)b;
+	unsigned nallocs = (unsigned)RUN_NALLOCS(run->block_size);
+	ASSERT(nallocs != 0);
+	unsigned nval = (nallocs - 1) / BITS_PER_VALUE + 1;
 
-	/*
-	 * The redo log ptr can be NULL if we are sure that there's only one
-	 * persistent value modification in the entire operation context.
-	 */
-	struct operation_context ctx;
-	operation_init(&ctx, heap->base, NULL, NULL);
-	ctx.p_ops = &heap->p_ops;
+	/* the unused bits at the end of the bitmap are always set */
+	uint64_t *bitmap = RUN_BITMAP(run);
+	unsigned used = 0;
+	pthread_mutex_t *lock = heap_get_run_lock(heap, m.chunk_id);
+	util_mutex_lock(lock);
+	for (unsigned i = 0; i < nval; ++i)
+		used += util_popcount64(bitmap[i]);
+	util_mutex_unlock(lock);
+
+	used -= nval * BITS_PER_VALUE - nallocs;
+
+	return used * 100 / nallocs;
+}
+
+/*
+ * heap_class_stats -- (internal) sums up the statistics of the buckets of an
+ *	allocation class
+ */
+static void
+heap_class_stats(struct heap_rt *h, uint8_t bid,
+	struct pobj_alloc_class_stats *cs)
+{
+	struct bucket *b = h->buckets[bid];
+	struct bucket_run_stats *s = &h->run_stats[bid];
+
+	cs->class_id = HEAP_BID_TO_CLASS_ID(bid);
+	cs->unit_size = b->unit_size;
+	cs->free_units = b->container->nunits;
+	cs->free_blocks = b->container->nblocks;
+	for (unsigned i = 0; i < h->ncaches; ++i) {
+		/* the cache buckets of a new class might not exist yet */
+		struct bucket *cb = h->caches[i].buckets[bid];
+		if (cb == NULL)
+			continue;
+
+		cs->free_units += cb->container->nunits;
+		cs->free_blocks += cb->container->nblocks;
+	}
+
+	cs->nruns = s->nruns;
+	cs->nruns_unloaded = s->nruns_unloaded;
+
+	/*
+	 * The counters are read without any locks, a bin can be transiently
+	 * negative while a run is moved between the bins.
+	 */
+	uint64_t partial = 0;
+	for (unsigned i = 0; i < POBJ_RUN_OCCUPANCY_BINS; ++i) {
+		int64_t n = (int64_t)s->occupancy[i];
+		cs->run_occupancy[i] = n > 0 ? (uint64_t)n : 0;
+		partial += cs->run_occupancy[i];
+	}
+
+	/* the runs without any free units in the buckets are full */
+	if (cs->nruns > partial)
+		cs->run_occupancy[POBJ_RUN_OCCUPANCY_BINS - 1] +=
+			cs->nruns - partial;
+}
+
+/*
+ * heap_stats -- returns the fragmentation statistics of the heap and of up to
+ *	nclasses allocation classes
+ *
+ * Only the volatile state of the populated zones is taken into account, the
+ * counters are maintained by the buckets and no locks are held for longer
+ * than it takes to find the largest free huge block.
+ */
+void
+heap_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses)
+{
+	COMPILE_ERROR_ON(POBJ_RUN_OCCUPANCY_BINS != BUCKET_OCCUPANCY_BINS);
+
+	struct heap_rt *h = heap->rt;
+
+	stats->heap_size = heap->size;
+	stats->nzones = h->max_zone;
+	stats->nzones_populated = h->zones_exhausted;
+
+	struct bucket *defb = h->default_bucket;
+	stats->free_huge = defb->container->nunits * CHUNKSIZE;
+	stats->free_huge_largest =
+		(uint64_t)CNT_OP(defb, get_max_size_idx) * CHUNKSIZE;
+
+	/* the chunks set aside for the caches are just as free */
+	for (unsigned i = 0; i < h->ncaches; ++i)
+		stats->free_huge +=
+			(uint64_t)h->caches[i].reserve.size_idx * CHUNKSIZE;
+
+	stats->nclasses = 0;
+	stats->free_runs = 0;
+	for (int i = 0; i < MAX_BUCKETS; ++i) {
+		struct bucket *b = h->buckets[i];
+		if (b == NULL || b == BUCKET_RESERVED)
+			continue;
+
+		struct pobj_alloc_class_stats cs;
+		heap_class_stats(h, (uint8_t)i, &cs);
+		stats->free_runs += cs.free_units * cs.unit_size;
+
+		if (stats->nclasses < nclasses)
+			classes[stats->nclasses] = cs;
+		stats->nclasses++;
+	}
+
+	stats->free_total = stats->free_huge + stats->free_runs;
+}
+
+/*
+ * heap_run_detach -- removes all free blocks of the run from the bucket's
+ *	container, so that they can't be allocated, and stores them in the
+ *	'blocks' array which must fit one block per unit of the run
+ *
+ * Returns the number of removed blocks. The free units which are not in
+ * the container, e.g. because they are cached by a lane, are left alone.
+ */
+unsigned
+heap_run_detach(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m, struct memory_block *blocks)
+{
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+
+	ASSERTeq(b->type, BUCKET_RUN);
+	struct bucket_run *r = (struct bucket_run *)b;
 
 	util_mutex_lock(&b->lock);
 	MEMBLOCK_OPS(RUN, &m)->lock(&m, heap);
 
+	uint64_t *bitmap = RUN_BITMAP(run);
+	unsigned n = 0;
+	uint32_t off = 0;
+	while (off < r->bitmap_nallocs) {
+		uint64_t v = bitmap[off / BITS_PER_VALUE];
+		if (!BIT_IS_CLR(v, off % BITS_PER_VALUE)) {
+			off++;
+			continue;
+		}
+
+		/* the free range can't cross the unit_max boundary */
+		uint32_t end = off - off % r->unit_max + r->unit_max;
+		if (end > r->bitmap_nallocs)
+			end = r->bitmap_nallocs;
+
+		uint32_t last = off + 1;
+		while (last < end && BIT_IS_CLR(v, last % BITS_PER_VALUE))
+			last++;
+
+		m.block_off = (uint16_t)off;
+		for (m.size_idx = last - off; m.size_idx != 0; --m.size_idx) {
+			if (CNT_OP(b, get_rm_exact, m) == 0)
+				break;
+		}
+
+		if (m.size_idx == 0) {
+			off++;
+			continue;
+		}
+
+		blocks[n++] = m;
+		off += m.size_idx;
+	}
+
+	MEMBLOCK_OPS(RUN, &m)->unlock(&m, heap);
+	util_mutex_unlock(&b->lock);
+
+	return n;
+}
+
+/*
+ * heap_run_attach -- inserts the blocks removed by heap_run_detach back into
+ *	the bucket
+ */
+void
+heap_run_attach(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n)
+{
+	util_mutex_lock(&b->lock);
+
+	for (unsigned i = 0; i < n; ++i)
+		CNT_OP(b, insert, heap, blocks[i]);
+
+	util_mutex_unlock(&b->lock);
+
+	if (n != 0)
+		heap_degrade_run_if_empty(heap, b, blocks[0]);
+}
+
+/*
+ * run_bitmap_is_unused -- (internal) checks whether none of the blocks of the
+ *	run is allocated, the run lock has to be held
+ */
+static int
+run_bitmap_is_unused(struct bucket_run *r, struct chunk_run *run)
+{
+	uint64_t *bitmap = RUN_BITMAP(run);
 	unsigned i;
 	unsigned nval = r->bitmap_nval;
 	for (i = 0; nval > 0 && i < nval - 1; ++i)
-		if (run->bitmap[i] != 0)
-			goto out;
+		if (bitmap[i] != 0)
+			return 0;
+
+	return bitmap[i] == r->bitmap_lastval;
+}
+
+/*
+ * heap_run_is_unused -- checks whether none of the blocks of the run that
+ *	contains the memory block is allocated, the run lock has to be held
+ */
+int
+heap_run_is_unused(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m)
+{
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+
+	ASSERTeq(b->type, BUCKET_RUN);
+	ASSERTeq(z->chunk_headers[m.chunk_id].type, CHUNK_TYPE_RUN);
+
+	return run_bitmap_is_unused((struct bucket_run *)b, run);
+}
+
+/*
+ * heap_degrade_run_if_empty -- makes a chunk out of an empty run
+ */
+void
+heap_degrade_run_if_empty(struct palloc_heap *heap,
+		struct bucket *b, struct memory_block m)
+{
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+
+	ASSERTeq(b->type, BUCKET_RUN);
+	struct bucket_run *r = (struct bucket_run *)b;
+
+	/*
+	 * The redo log ptr can be NULL if we are sure that there's only one
+	 * persistent value modification in the entire operation context.
+	 */
+	struct operation_context ctx;
+	operation_init(&ctx, heap->base, NULL, NULL);
+	ctx.p_ops = &heap->p_ops;
+
+	util_mutex_lock(&b->lock);
+	MEMBLOCK_OPS(RUN, &m)->lock(&m, heap);
+
+	/*
+	 * Another thread which freed the last block of the run at the same
+	 * time might have degraded it already, and the chunk might even have
+	 * been reused since.
+	 */
+	if (hdr->type != CHUNK_TYPE_RUN || run->block_size != b->unit_size)
+		goto out;
 
-	if (run->bitmap[i] != r->bitmap_lastval)
+	if (!run_bitmap_is_unused(r, run))
 		goto out;
 
 	if (traverse_bucket_run(b, m, b->c_ops->get_exact) != 0) {
@@ -1565,6 +2860,8 @@ heap_degrade_run_if_empty(struct palloc_heap *heap,
 
 	util_mutex_unlock(&defb->lock);
 
+	__sync_fetch_and_sub(&heap->rt->run_stats[b->id].nruns, 1);
+
 out:
 	MEMBLOCK_OPS(RUN, &m)->unlock(&m, heap);
 	util_mutex_unlock(&b->lock);
@@ -1578,9 +2875,11 @@ heap_end(struct palloc_heap *h)
 {
 	ASSERT(h->rt->max_zone > 0);
 
-	struct zone *last_zone = ZID_TO_ZONE(h->layout, h->rt->max_zone - 1);
+	unsigned max_zone = h->rt->max_zone;
+	struct zone *last_zone = ZID_TO_ZONE(h->layout, max_zone - 1);
 
-	return &last_zone->chunks[last_zone->header.size_idx];
+	return &last_zone->chunks[get_zone_size_idx(max_zone - 1, max_zone,
+			h->size)];
 }
 
 /*
@@ -1612,7 +2911,7 @@ heap_get_ncaches(void)
  */
 int
 heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
-		void *base, struct pmem_ops *p_ops)
+		uint64_t run_id, void *base, struct pmem_ops *p_ops)
 {
 	struct heap_rt *h = Malloc(sizeof(*h));
 	int err;
@@ -1628,8 +2927,25 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 		goto error_heap_cache_malloc;
 	}
 
+	h->run_id = run_id;
 	h->max_zone = heap_max_zone(heap_size);
 	h->zones_exhausted = 0;
+	h->zone_numa_node = NULL;
+	h->feature_enable = NULL;
+	h->feature_arg = NULL;
+	h->zones_populated = Zalloc(howmany(h->max_zone, 8));
+	if (h->zones_populated == NULL) {
+		err = ENOMEM;
+		goto error_zones_malloc;
+	}
+
+	h->run_free = Zalloc(sizeof(uint16_t *) * h->max_zone);
+	if (h->run_free == NULL) {
+		err = ENOMEM;
+		goto error_run_free_malloc;
+	}
+
+	h->chunk_fresh = NULL;
 
 	util_mutex_init(&h->active_run_lock, NULL);
 
@@ -1655,8 +2971,39 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 
 	bucket_group_init(h->buckets);
 
-	for (unsigned i = 0; i < h->ncaches; ++i)
+	for (unsigned i = 0; i < h->ncaches; ++i) {
 		bucket_group_init(h->caches[i].buckets);
+		memset(&h->caches[i].reserve, 0, sizeof(h->caches[i].reserve));
+	}
+
+	h->zone_check = NULL;
+	h->check_threads = NULL;
+	h->check_nthreads = 0;
+	h->check_stop = 0;
+	h->zones_inconsistent = 0;
+	util_mutex_init(&h->check_lock, NULL);
+	util_mutex_init(&h->check_wait_lock, NULL);
+
+	h->tune_hist = NULL;
+	h->tune_nsamples = 0;
+	h->tune_nclasses = 0;
+	util_mutex_init(&h->tune_lock, NULL);
+	if (Heap_tune) {
+		h->tune_hist = Zalloc(sizeof(uint32_t) *
+			(MAX_RUN_SIZE / ALLOC_BLOCK_SIZE + 1));
+		if (h->tune_hist == NULL) {
+			err = ENOMEM;
+			goto error_tune_hist;
+		}
+	}
+
+	if ((err = heap_summary_load(heap)) != 0)
+		goto error_summary_load;
+
+	/* the zones covered by the summary are known to be consistent */
+	if (Heap_check_defer && h->summary_gen == 0 &&
+			(err = heap_check_defer_start(heap)) != 0)
+		goto error_check_defer;
 
 	if ((err = heap_buckets_init(heap)) != 0)
 		goto error_buckets_init;
@@ -1665,8 +3012,21 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 	return 0;
 
 error_buckets_init:
+	heap_check_defer_stop(heap);
+error_check_defer:
+	Free(h->zones_dirty);
+error_summary_load:
+	Free(h->tune_hist);
+error_tune_hist:
+	util_mutex_destroy(&h->tune_lock);
+	util_mutex_destroy(&h->check_wait_lock);
+	util_mutex_destroy(&h->check_lock);
 	pthread_mutexattr_destroy(&lock_attr);
 	/* there's really no point in destroying the locks */
+	Free(h->run_free);
+error_run_free_malloc:
+	Free(h->zones_populated);
+error_zones_malloc:
 	Free(h->caches);
 error_heap_cache_malloc:
 	Free(h);
@@ -1675,6 +3035,150 @@ error_heap_malloc:
 	return err;
 }
 
+/*
+ * heap_boot_rdonly -- attaches to the heap without building its runtime
+ *	state, for walking the objects of a pool opened read-only
+ */
+void
+heap_boot_rdonly(struct palloc_heap *heap, void *heap_start,
+		uint64_t heap_size, void *base, struct pmem_ops *p_ops)
+{
+	heap->p_ops = *p_ops;
+	heap->layout = heap_start;
+	heap->rt = NULL;
+	heap->size = heap_size;
+	heap->base = base;
+	VALGRIND_DO_CREATE_MEMPOOL(heap->layout, 0, 0);
+}
+
+/*
+ * heap_zones_numa_init -- associates the heap zones with NUMA nodes
+ *
+ * The addr_node callback returns the node backing a given address or -1.
+ * Has to be called right after heap_boot. If the heap spans only a single
+ * node (or the nodes are unknown) the zones are used in the regular order.
+ */
+void
+heap_zones_numa_init(struct palloc_heap *heap,
+	int (*addr_node)(void *arg, const void *addr), void *arg)
+{
+	struct heap_rt *h = heap->rt;
+
+	int *nodes = Malloc(sizeof(int) * h->max_zone);
+	if (nodes == NULL) {
+		LOG(2, "!Malloc");
+		return;
+	}
+
+	int multiple = 0;
+	for (unsigned i = 0; i < h->max_zone; ++i) {
+		nodes[i] = addr_node(arg, ZID_TO_ZONE(heap->layout, i));
+		LOG(4, "zone %u numa node %d", i, nodes[i]);
+
+		if (nodes[i] != nodes[0])
+			multiple = 1;
+	}
+
+	if (!multiple) {
+		Free(nodes);
+		return;
+	}
+
+	h->zone_numa_node = nodes;
+}
+
+/*
+ * heap_features_init -- sets the callback enabling the on-media features
+ *
+ * The callback gets a mask of HEAP_FEAT_* flags and returns an error number.
+ * Has to be called right after heap_boot.
+ */
+void
+heap_features_init(struct palloc_heap *heap,
+	int (*enable)(void *arg, unsigned features), void *arg)
+{
+	heap->rt->feature_enable = enable;
+	heap->rt->feature_arg = arg;
+}
+
+/*
+ * heap_assume_zeroed -- declares that all the memory of the heap not used
+ *	so far is zeroed
+ *
+ * Has to be called right after heap_boot of a pool created from new files.
+ * This state is volatile, it's only known until the pool is closed.
+ */
+void
+heap_assume_zeroed(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+
+	h->chunk_fresh = Zalloc(sizeof(uint16_t *) * h->max_zone);
+	if (h->chunk_fresh == NULL) {
+		LOG(2, "!Zalloc");
+		return;
+	}
+
+	/* the zones populated at boot don't have any allocations yet */
+	for (uint32_t i = 0; i < h->max_zone; ++i)
+		if (util_isset(h->zones_populated, i))
+			heap_zone_fresh_init(h, i);
+}
+
+/*
+ * heap_block_fresh -- marks the reserved memory block as handed out and
+ *	returns whether it's handed out for the first time since the pool was
+ *	created, that is, whether its memory is known to be zeroed
+ *
+ * Every block taken from the transient heap for an allocation, or to extend
+ * one, has to pass through this function before it's written to.
+ */
+int
+heap_block_fresh(struct palloc_heap *heap, struct memory_block m)
+{
+	struct heap_rt *h = heap->rt;
+	uint16_t *fresh = h->chunk_fresh != NULL ?
+		h->chunk_fresh[m.zone_id] : NULL;
+	if (fresh == NULL)
+		return 0;
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	if (z->chunk_headers[m.chunk_id].type != CHUNK_TYPE_RUN) {
+		/* the chunks of a huge block are reserved exclusively */
+		int ret = 1;
+		for (uint32_t i = m.chunk_id; i < m.chunk_id + m.size_idx;
+				++i) {
+			ret &= fresh[i] == CHUNK_FRESH_ALL;
+			fresh[i] = CHUNK_FRESH_NONE;
+		}
+
+		return ret;
+	}
+
+	/*
+	 * The units before the mark of a run might have been handed out, and
+	 * the ones after it never were. Other blocks of the run are handed
+	 * out concurrently, so the mark is advanced atomically, and only
+	 * ever forward - it can only be reset when it doesn't fit anymore.
+	 */
+	uint32_t end = m.block_off + m.size_idx + 1U;
+	uint16_t mark = end < CHUNK_FRESH_ALL ?
+		(uint16_t)end : CHUNK_FRESH_NONE;
+
+	uint16_t cur = fresh[m.chunk_id];
+	int ret = cur != CHUNK_FRESH_NONE && m.block_off + 1U >= cur;
+
+	while (cur != CHUNK_FRESH_NONE &&
+		(mark == CHUNK_FRESH_NONE || cur < mark)) {
+		if (__sync_bool_compare_and_swap(&fresh[m.chunk_id],
+				cur, mark))
+			break;
+		cur = fresh[m.chunk_id];
+	}
+
+	return ret;
+}
+
 /*
  * heap_write_header -- (internal) creates a clean header
  */
@@ -1709,7 +3213,10 @@ heap_vg_open(void *heap_start, uint64_t heap_size)
 
 	VALGRIND_DO_MAKE_MEM_DEFINED(&layout->header, sizeof(layout->header));
 
-	unsigned zones = heap_max_zone(heap_size);
+	VALGRIND_DO_MAKE_MEM_DEFINED(&layout->zone0.header,
+		sizeof(layout->zone0.header));
+
+	unsigned zones = heap_zones_valid(layout, heap_max_zone(heap_size));
 
 	for (unsigned i = 0; i < zones; ++i) {
 		struct zone *z = ZID_TO_ZONE(layout, i);
@@ -1769,20 +3276,20 @@ heap_init(void *heap_start, uint64_t heap_size, struct pmem_ops *p_ops)
 	heap_write_header(&layout->header, heap_size);
 	pmemops_persist(p_ops, &layout->header, sizeof(struct heap_header));
 
-	unsigned zones = heap_max_zone(heap_size);
-	for (unsigned i = 0; i < zones; ++i) {
-		pmemops_memset_persist(p_ops,
-				&ZID_TO_ZONE(layout, i)->header,
-				0, sizeof(struct zone_header));
-		pmemops_memset_persist(p_ops,
-				&ZID_TO_ZONE(layout, i)->chunk_headers,
-				0, sizeof(struct chunk_header));
+	/*
+	 * None of the zones is valid yet, their headers are written when
+	 * they're populated for the first time (see heap_zones_valid).
+	 */
+	struct zone_header nhdr = {
+		.zones_valid = 1,
+	};
+	layout->zone0.header = nhdr;
+	pmemops_persist(p_ops, &layout->zone0.header,
+			sizeof(struct zone_header));
 
-		/* only explicitly allocated chunks should be accessible */
-		VALGRIND_DO_MAKE_MEM_NOACCESS(
-			&ZID_TO_ZONE(layout, i)->chunk_headers,
-			sizeof(struct chunk_header));
-	}
+	/* only explicitly allocated chunks should be accessible */
+	VALGRIND_DO_MAKE_MEM_NOACCESS(&layout->zone0.chunk_headers,
+		sizeof(struct chunk_header));
 
 	return 0;
 }
@@ -1794,6 +3301,17 @@ void
 heap_cleanup(struct palloc_heap *heap)
 {
 	struct heap_rt *rt = heap->rt;
+	if (rt == NULL) {
+		/* attached by heap_boot_rdonly */
+		VALGRIND_DO_DESTROY_MEMPOOL(heap->layout);
+		return;
+	}
+
+	heap_summary_write(heap);
+
+	heap_check_defer_stop(heap);
+	util_mutex_destroy(&rt->check_wait_lock);
+	util_mutex_destroy(&rt->check_lock);
 
 	bucket_delete(rt->default_bucket);
 
@@ -1807,6 +3325,23 @@ heap_cleanup(struct palloc_heap *heap)
 
 	Free(rt->bucket_map);
 
+	Free(rt->tune_hist);
+	util_mutex_destroy(&rt->tune_lock);
+
+	Free(rt->zone_numa_node);
+	Free(rt->zones_populated);
+	Free(rt->zones_dirty);
+
+	for (unsigned i = 0; i < rt->max_zone; ++i)
+		Free(rt->run_free[i]);
+	Free(rt->run_free);
+
+	if (rt->chunk_fresh != NULL) {
+		for (unsigned i = 0; i < rt->max_zone; ++i)
+			Free(rt->chunk_fresh[i]);
+		Free(rt->chunk_fresh);
+	}
+
 	Free(rt->caches);
 
 	util_mutex_destroy(&rt->active_run_lock);
@@ -1881,6 +3416,15 @@ heap_verify_chunk_header(struct chunk_header *hdr)
 		return -1;
 	}
 
+	uint16_t header_flags = CHUNK_FLAG_COMPACT_HEADER |
+		CHUNK_FLAG_HEADER_NONE;
+	if ((hdr->flags & header_flags) != 0 &&
+		(hdr->type != CHUNK_TYPE_RUN ||
+		(hdr->flags & header_flags) == header_flags)) {
+		ERR("heap: invalid chunk flags");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -1917,30 +3461,604 @@ heap_verify_zone(struct zone *zone)
 	return 0;
 }
 
+struct heap_check_slice {
+	struct heap_layout *layout;
+	unsigned first;
+	unsigned last;
+	unsigned failed; /* the first inconsistent zone, or last if none */
+};
+
 /*
- * heap_check -- verifies if the heap is consistent and can be opened properly
- *
- * If successful function returns zero. Otherwise an error number is returned.
+ * heap_check_worker -- (internal) verifies a contiguous range of zones
  */
-int
-heap_check(void *heap_start, uint64_t heap_size)
+static void *
+heap_check_worker(void *arg)
 {
-	if (heap_size < HEAP_MIN_SIZE) {
-		ERR("heap: invalid heap size");
-		return -1;
+	struct heap_check_slice *s = arg;
+
+	for (s->failed = s->first; s->failed < s->last; ++s->failed) {
+		if (heap_verify_zone(ZID_TO_ZONE(s->layout, s->failed)))
+			break;
 	}
 
-	struct heap_layout *layout = heap_start;
+	return NULL;
+}
 
-	if (heap_size != layout->header.size) {
-		ERR("heap: heap size missmatch");
-		return -1;
+/*
+ * heap_verify_zones_mt -- (internal) verifies the zones using multiple
+ *	threads
+ *
+ * The chunk headers of the zones are far apart from each other, so most of
+ * the time of a sequential check on a large pool is spent waiting for the
+ * first touch of the pages with the headers. Each thread verifies its own
+ * range of zones. The error messages are thread-local, so the first
+ * inconsistent zone is verified again by the calling thread.
+ */
+static int
+heap_verify_zones_mt(struct heap_layout *layout, unsigned nzones,
+	unsigned nthreads)
+{
+	struct heap_check_slice slices[HEAP_CHECK_THREADS_MAX];
+	pthread_t threads[HEAP_CHECK_THREADS_MAX];
+	int started[HEAP_CHECK_THREADS_MAX];
+
+	unsigned per_thread = (nzones + nthreads - 1) / nthreads;
+	unsigned n = 0;
+	for (unsigned first = 0; first < nzones; first += per_thread) {
+		slices[n].layout = layout;
+		slices[n].first = first;
+		slices[n].last = first + per_thread < nzones ?
+			first + per_thread : nzones;
+
+		/* the calling thread verifies the first range itself */
+		int ret = n == 0 ? -1 : pthread_create(&threads[n], NULL,
+			heap_check_worker, &slices[n]);
+		if (ret > 0) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+		}
+		started[n] = ret == 0;
+		n++;
 	}
 
-	if (heap_verify_header(&layout->header))
+	unsigned failed = nzones;
+	for (unsigned i = 0; i < n; ++i) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			heap_check_worker(&slices[i]);
+
+		if (slices[i].failed != slices[i].last &&
+				slices[i].failed < failed)
+			failed = slices[i].failed;
+	}
+
+	if (failed == nzones)
+		return 0;
+
+	int ret = heap_verify_zone(ZID_TO_ZONE(layout, failed));
+	ASSERTne(ret, 0);
+
+	return ret;
+}
+
+/*
+ * The zones can be verified in the background, while the pool is already in
+ * use, so that opening a large pool doesn't have to wait for reading all of
+ * the chunk headers. Only the heap header is verified on open then, and the
+ * zones are verified by a number of threads, each taking its own range of
+ * zones. Before a zone is used for the first time it's verified synchronously,
+ * unless the threads got to it first, so an inconsistent zone is never
+ * modified -- it's just left out of the heap and reported.
+ */
+enum zone_check_state {
+	ZONE_UNCHECKED,
+	ZONE_CONSISTENT,
+	ZONE_INCONSISTENT,
+};
+
+struct heap_check_task {
+	struct palloc_heap *heap;
+	unsigned first;
+	unsigned last;
+};
+
+/*
+ * heap_zone_check_locked -- (internal) verifies the zone if that hasn't
+ *	been done yet, must be called with check_lock held
+ */
+static void
+heap_zone_check_locked(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *rt = heap->rt;
+	if (rt->zone_check[zone_id] != ZONE_UNCHECKED)
+		return;
+
+	if (heap_verify_zone(ZID_TO_ZONE(heap->layout, zone_id)) == 0) {
+		rt->zone_check[zone_id] = ZONE_CONSISTENT;
+		return;
+	}
+
+	LOG(1, "heap: zone %u is inconsistent: %s", zone_id,
+		out_get_errormsg());
+	rt->zone_check[zone_id] = ZONE_INCONSISTENT;
+	rt->zones_inconsistent++;
+}
+
+/*
+ * heap_zone_checked -- (internal) makes sure the zone was verified before
+ *	it's used, returns -1 if it's inconsistent
+ */
+static int
+heap_zone_checked(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *rt = heap->rt;
+	if (likely(rt == NULL || rt->zone_check == NULL ||
+			rt->zone_check[zone_id] == ZONE_CONSISTENT))
+		return 0;
+
+	util_mutex_lock(&rt->check_lock);
+	heap_zone_check_locked(heap, zone_id);
+	util_mutex_unlock(&rt->check_lock);
+
+	return rt->zone_check[zone_id] == ZONE_CONSISTENT ? 0 : -1;
+}
+
+/*
+ * heap_check_defer_worker -- (internal) verifies a range of zones in the
+ *	background
+ */
+static void *
+heap_check_defer_worker(void *arg)
+{
+	struct heap_check_task *t = arg;
+	struct heap_rt *rt = t->heap->rt;
+
+	for (unsigned i = t->first; i < t->last && !rt->check_stop; ++i) {
+		util_mutex_lock(&rt->check_lock);
+		heap_zone_check_locked(t->heap, i);
+		util_mutex_unlock(&rt->check_lock);
+	}
+
+	Free(t);
+
+	return NULL;
+}
+
+/*
+ * heap_check_defer_start -- (internal) starts verifying the zones in the
+ *	background
+ */
+static int
+heap_check_defer_start(struct palloc_heap *heap)
+{
+	struct heap_rt *rt = heap->rt;
+
+	rt->zone_check = Malloc(rt->max_zone);
+	if (rt->zone_check == NULL)
+		return ENOMEM;
+
+	/* zones past the high-water mark hold no data to verify */
+	unsigned nzones = heap_zones_valid(heap->layout, rt->max_zone);
+	memset(rt->zone_check, ZONE_UNCHECKED, nzones);
+	memset(rt->zone_check + nzones, ZONE_CONSISTENT,
+		rt->max_zone - nzones);
+
+	unsigned nthreads = Heap_check_nthreads > 1 ? Heap_check_nthreads : 1;
+	if (nthreads > nzones)
+		nthreads = nzones;
+	if (nthreads == 0)
+		return 0;
+
+	rt->check_threads = Malloc(sizeof(pthread_t) * nthreads);
+	if (rt->check_threads == NULL)
+		goto error_threads_malloc;
+
+	unsigned per_thread = (nzones + nthreads - 1) / nthreads;
+	for (unsigned first = 0; first < nzones; first += per_thread) {
+		struct heap_check_task *t = Malloc(sizeof(*t));
+		if (t == NULL)
+			break;
+
+		t->heap = heap;
+		t->first = first;
+		t->last = first + per_thread < nzones ?
+			first + per_thread : nzones;
+
+		int ret = pthread_create(&rt->check_threads[rt->check_nthreads],
+			NULL, heap_check_defer_worker, t);
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+			Free(t);
+			break;
+		}
+		rt->check_nthreads++;
+	}
+
+	/* whatever is left unverified is verified on first use */
+	LOG(3, "%u threads verifying %u zones", rt->check_nthreads, nzones);
+
+	return 0;
+
+error_threads_malloc:
+	Free(rt->zone_check);
+	rt->zone_check = NULL;
+	return ENOMEM;
+}
+
+/*
+ * heap_check_join -- (internal) waits for the background verification
+ *	threads to finish
+ */
+static void
+heap_check_join(struct heap_rt *rt)
+{
+	util_mutex_lock(&rt->check_wait_lock);
+
+	while (rt->check_nthreads > 0)
+		pthread_join(rt->check_threads[--rt->check_nthreads], NULL);
+
+	util_mutex_unlock(&rt->check_wait_lock);
+}
+
+/*
+ * heap_check_defer_stop -- (internal) stops the background verification
+ */
+static void
+heap_check_defer_stop(struct palloc_heap *heap)
+{
+	struct heap_rt *rt = heap->rt;
+
+	rt->check_stop = 1;
+	heap_check_join(rt);
+
+	Free(rt->check_threads);
+	rt->check_threads = NULL;
+	Free(rt->zone_check);
+	rt->zone_check = NULL;
+}
+
+/*
+ * heap_check_block -- makes sure the zone holding the memory block at the
+ *	given offset was verified, returns -1 if it's inconsistent
+ */
+int
+heap_check_block(struct palloc_heap *heap, uint64_t off)
+{
+	struct heap_rt *rt = heap->rt;
+	if (likely(rt->zone_check == NULL))
+		return 0;
+
+	uintptr_t zone_off = (uintptr_t)heap->base + off -
+		(uintptr_t)&heap->layout->zone0;
+	uint64_t zone_id = zone_off / ZONE_MAX_SIZE;
+	if (zone_id >= rt->max_zone)
 		return -1;
 
-	for (unsigned i = 0; i < heap_max_zone(layout->header.size); ++i) {
+	return heap_zone_checked(heap, (uint32_t)zone_id);
+}
+
+/*
+ * heap_check_wait -- waits for the deferred verification of the zones to
+ *	complete, returns the number of inconsistent zones
+ *
+ * The zones which weren't verified by the background threads are verified
+ * here, so that the result covers the whole heap.
+ */
+unsigned
+heap_check_wait(struct palloc_heap *heap)
+{
+	struct heap_rt *rt = heap->rt;
+	if (rt->zone_check == NULL)
+		return 0;
+
+	heap_check_join(rt);
+
+	for (uint32_t i = 0; i < rt->max_zone; ++i)
+		heap_zone_checked(heap, i);
+
+	util_mutex_lock(&rt->check_lock);
+	unsigned ret = rt->zones_inconsistent;
+	util_mutex_unlock(&rt->check_lock);
+
+	return ret;
+}
+
+/*
+ * heap_check_nthreads -- returns the number of threads used for verifying
+ *	the pool
+ */
+unsigned
+heap_check_nthreads(void)
+{
+	return Heap_check_nthreads > 1 ? Heap_check_nthreads : 1;
+}
+
+/*
+ * heap_check_init -- reads the number of threads used for verifying the
+ *	heap and whether the verification should be deferred from the given
+ *	environment variables
+ */
+void
+heap_check_init(const char *threads_var, const char *defer_var)
+{
+	char *e = getenv(threads_var);
+	if (e != NULL && strcmp(e, "auto") == 0) {
+		unsigned ncpus = heap_get_ncpus();
+		Heap_check_nthreads = ncpus < HEAP_CHECK_THREADS_MAX ?
+			ncpus : HEAP_CHECK_THREADS_MAX;
+		LOG(3, "%s set to %u", threads_var, Heap_check_nthreads);
+	} else if (e != NULL) {
+		long val = atol(e);
+		if (val < 0 || val > HEAP_CHECK_THREADS_MAX) {
+			LOG(2, "Invalid %s", threads_var);
+		} else {
+			Heap_check_nthreads = (unsigned)val;
+			LOG(3, "%s set to %u", threads_var,
+				Heap_check_nthreads);
+		}
+	}
+
+	e = getenv(defer_var);
+	if (e != NULL) {
+		Heap_check_defer = atoi(e) != 0;
+		LOG(3, "%s set to %d", defer_var, Heap_check_defer);
+	}
+}
+
+/*
+ * A pool closed cleanly doesn't have to be verified again on the next open.
+ * On close, the number of free chunks and of the runs with free units is
+ * written to the header of each zone, along with the generation of the
+ * summary, and only then the generation is written to the header of zone 0,
+ * which makes the summary valid. It's invalidated as soon as the heap is
+ * booted again, before it's modified, so after a crash the pool is verified
+ * the regular way. The summary is only written if the whole heap is known to
+ * be consistent -- it was either verified in this run, or covered by the
+ * summary of the previous one.
+ *
+ * Versions of the library which don't know the summary neither invalidate it
+ * nor update it, but they do increment the run id of the pool, like every
+ * open for writing. So the summary also records the run id it was written in
+ * and is only trusted by the run right after that one.
+ *
+ * Bucket population is already lazy, one zone at a time, so the summary is
+ * also used to leave the zones which were full for last, instead of walking
+ * through all of their chunks only to find no free space.
+ */
+
+/*
+ * heap_summary_init -- reads whether the free space summary is used from
+ *	the given environment variable
+ */
+void
+heap_summary_init(const char *summary_var)
+{
+	char *e = getenv(summary_var);
+	if (e != NULL) {
+		Heap_summary = atoi(e) != 0;
+		LOG(3, "%s set to %d", summary_var, Heap_summary);
+	}
+}
+
+/*
+ * heap_summary_valid -- (internal) checks whether the heap was closed with
+ *	a valid free space summary by the run with the given id
+ */
+static int
+heap_summary_valid(void *heap_start, uint64_t run_id)
+{
+	struct heap_layout *layout = heap_start;
+
+	return Heap_summary && layout->zone0.header.summary_gen != 0 &&
+		layout->zone0.header.summary_run_id == run_id;
+}
+
+/*
+ * heap_summary_load -- (internal) picks up the free space summary of the
+ *	previous run and invalidates it
+ *
+ * If successful function returns zero. Otherwise an error number is returned.
+ */
+static int
+heap_summary_load(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	struct zone_header *z0 = &heap->layout->zone0.header;
+
+	h->summary_gen = 0;
+	h->zones_dirty = NULL;
+	if (z0->summary_gen == 0)
+		return 0;
+
+	/* the id of the previous run, see pmemobj_runtime_init */
+	uint64_t prev_run_id = h->run_id - 2;
+	if (prev_run_id == 0)
+		prev_run_id -= 2;
+
+	if (heap_summary_valid(heap->layout, prev_run_id)) {
+		h->zones_dirty = Zalloc(howmany(h->max_zone, 8));
+		if (h->zones_dirty == NULL)
+			return ENOMEM;
+
+		h->summary_gen = z0->summary_gen;
+		LOG(3, "heap summary generation %ju", h->summary_gen);
+	}
+
+	/* a crash from now on might leave the summary out of date */
+	z0->summary_gen = 0;
+	pmemops_persist(&heap->p_ops, &z0->summary_gen,
+			sizeof(z0->summary_gen));
+
+	return 0;
+}
+
+/*
+ * heap_summary_zone -- (internal) counts the free chunks of the zone and
+ *	its runs with free units
+ */
+static void
+heap_summary_zone(struct zone *z)
+{
+	uint32_t free_chunks = 0;
+	uint32_t free_runs = 0;
+
+	for (uint32_t i = 0; i < z->header.size_idx; ) {
+		struct chunk_header *hdr = &z->chunk_headers[i];
+		if (hdr->type == CHUNK_TYPE_FREE)
+			free_chunks += hdr->size_idx;
+		else if (hdr->type == CHUNK_TYPE_RUN && !heap_run_is_empty(
+				(struct chunk_run *)&z->chunks[i]))
+			free_runs++;
+
+		i += hdr->size_idx;
+	}
+
+	z->header.free_chunks = free_chunks;
+	z->header.free_runs = free_runs;
+}
+
+/*
+ * heap_summary_write -- (internal) writes the free space summary of the heap
+ *	which is being closed
+ *
+ * The zones which weren't populated in this run keep the summary of the
+ * previous one, unless it's not known or they could have been freed into.
+ */
+static void
+heap_summary_write(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	if (!Heap_summary)
+		return;
+
+	int consistent = 1;
+	util_mutex_lock(&h->check_lock);
+	if (h->zones_inconsistent != 0)
+		consistent = 0;
+	for (uint32_t i = 0; h->zone_check != NULL && i < h->max_zone; ++i) {
+		if (h->zone_check[i] != ZONE_CONSISTENT)
+			consistent = 0;
+	}
+	util_mutex_unlock(&h->check_lock);
+
+	if (!consistent) {
+		LOG(3, "heap not verified, no summary written");
+		return;
+	}
+
+	struct heap_layout *layout = heap->layout;
+	struct zone_header *z0 = &layout->zone0.header;
+
+	/* a generation is never reused, even if it was never made valid */
+	uint64_t gen = z0->summary_seq + 1;
+	z0->summary_seq = gen;
+	pmemops_persist(&heap->p_ops, &z0->summary_seq,
+			sizeof(z0->summary_seq));
+
+	z0->summary_run_id = h->run_id;
+	pmemops_flush(&heap->p_ops, &z0->summary_run_id,
+			sizeof(z0->summary_run_id));
+
+	unsigned nzones = heap_zones_valid(layout, h->max_zone);
+	for (uint32_t i = 0; i < nzones; ++i) {
+		struct zone *z = ZID_TO_ZONE(layout, i);
+		if (z->header.magic != ZONE_HEADER_MAGIC)
+			continue;
+
+		if (util_isset(h->zones_populated, i))
+			heap_summary_zone(z);
+		else if (h->summary_gen == 0 ||
+				z->header.zone_gen != h->summary_gen ||
+				util_isset(h->zones_dirty, i))
+			continue;
+
+		z->header.zone_gen = gen;
+		pmemops_flush(&heap->p_ops, &z->header.zone_gen,
+			sizeof(z->header.zone_gen) +
+			sizeof(z->header.free_chunks) +
+			sizeof(z->header.free_runs));
+	}
+	pmemops_drain(&heap->p_ops);
+
+	z0->summary_gen = gen;
+	pmemops_persist(&heap->p_ops, &z0->summary_gen,
+			sizeof(z0->summary_gen));
+
+	LOG(3, "heap summary generation %ju written", gen);
+}
+
+/*
+ * heap_check_header -- verifies the heap header and the high-water mark of
+ *	the zones, but not the zones themselves
+ *
+ * If successful function returns zero. Otherwise an error number is returned.
+ */
+int
+heap_check_header(void *heap_start, uint64_t heap_size)
+{
+	if (heap_size < HEAP_MIN_SIZE) {
+		ERR("heap: invalid heap size");
+		return -1;
+	}
+
+	struct heap_layout *layout = heap_start;
+
+	if (heap_size != layout->header.size) {
+		ERR("heap: heap size missmatch");
+		return -1;
+	}
+
+	if (heap_verify_header(&layout->header))
+		return -1;
+
+	unsigned nzones = heap_max_zone(layout->header.size);
+	if (layout->zone0.header.zones_valid > (uint64_t)nzones + 1) {
+		ERR("heap: invalid number of valid zones");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * heap_check_open -- verifies the heap of a pool which is being opened
+ *
+ * With the deferred verification, or if the pool was closed with a valid free
+ * space summary in the run with the given id, only the heap header is verified
+ * here.
+ * If successful function returns zero. Otherwise an error number is returned.
+ */
+int
+heap_check_open(void *heap_start, uint64_t heap_size, uint64_t run_id)
+{
+	if (!Heap_check_defer && !heap_summary_valid(heap_start, run_id))
+		return heap_check(heap_start, heap_size);
+
+	return heap_check_header(heap_start, heap_size);
+}
+
+/*
+ * heap_check -- verifies if the heap is consistent and can be opened properly
+ *
+ * If successful function returns zero. Otherwise an error number is returned.
+ */
+int
+heap_check(void *heap_start, uint64_t heap_size)
+{
+	if (heap_check_header(heap_start, heap_size))
+		return -1;
+
+	struct heap_layout *layout = heap_start;
+	unsigned nzones = heap_zones_valid(layout,
+			heap_max_zone(layout->header.size));
+	unsigned nthreads = Heap_check_nthreads < nzones ?
+		Heap_check_nthreads : nzones;
+	if (nthreads > 1)
+		return heap_verify_zones_mt(layout, nzones, nthreads);
+
+	for (unsigned i = 0; i < nzones; ++i) {
 		if (heap_verify_zone(ZID_TO_ZONE(layout, i)))
 			return -1;
 	}
@@ -1982,7 +4100,23 @@ heap_check_remote(void *heap_start, uint64_t heap_size, struct remote_ops *ops)
 	if (heap_verify_header(&header))
 		return -1;
 
-	for (unsigned i = 0; i < heap_max_zone(header.size); ++i) {
+	struct zone_header zone0;
+	if (ops->read(ops->ctx, ops->base, &zone0, &layout->zone0.header,
+			sizeof(struct zone_header))) {
+		ERR("heap: obj_read_remote error");
+		return -1;
+	}
+
+	unsigned nzones = heap_max_zone(header.size);
+	if (zone0.zones_valid > (uint64_t)nzones + 1) {
+		ERR("heap: invalid number of valid zones");
+		return -1;
+	}
+
+	if (zone0.zones_valid != 0)
+		nzones = (unsigned)(zone0.zones_valid - 1);
+
+	for (unsigned i = 0; i < nzones; ++i) {
 		struct zone zone_buff;
 		if (ops->read(ops->ctx, ops->base, &zone_buff,
 				ZID_TO_ZONE(layout, i), sizeof(struct zone))) {
@@ -1997,29 +4131,252 @@ heap_check_remote(void *heap_start, uint64_t heap_size, struct remote_ops *ops)
 	return 0;
 }
 
+/*
+ * heap_block_alloc_header -- (internal) returns the allocation header of
+ *	the object which occupies the memory block
+ */
+static struct allocation_header *
+heap_block_alloc_header(void *block)
+{
+	struct allocation_header *alloc = block;
+	if (alloc->size & ALLOC_HDR_PADDING)
+		alloc = (struct allocation_header *)((char *)block +
+			(alloc->size & ~ALLOC_HDR_PADDING));
+
+	return alloc;
+}
+
+/*
+ * heap_scrub_object -- (internal) verifies the allocation header of the legacy
+ *	object which occupies the memory block, returns the number of units of
+ *	the object or 0 if the header is inconsistent, along with the reason
+ */
+static uint64_t
+heap_scrub_object(uint8_t *block, uint64_t unit_size, uint64_t max_units,
+	uint32_t zone_id, uint32_t chunk_id, const char **msg)
+{
+	struct allocation_header *alloc = (struct allocation_header *)block;
+	uint64_t pad = 0;
+	if (alloc->size & ALLOC_HDR_PADDING) {
+		pad = alloc->size & ~ALLOC_HDR_PADDING;
+		if (pad >= unit_size) {
+			*msg = "invalid object padding";
+			return 0;
+		}
+		alloc = (struct allocation_header *)(block + pad);
+	}
+
+	if (alloc->zone_id != zone_id || alloc->chunk_id != chunk_id) {
+		*msg = "object header location mismatch";
+		return 0;
+	}
+
+	uint64_t size = pad + alloc->size;
+	if (alloc->size == 0 || size % unit_size != 0 ||
+			size / unit_size > max_units) {
+		*msg = "invalid object size";
+		return 0;
+	}
+
+	return size / unit_size;
+}
+
+/*
+ * heap_scrub_run -- (internal) verifies the bitmap of the run and the headers
+ *	of its objects
+ *
+ * The run lock is held so that the bitmap and the headers of the objects
+ * allocated or freed in the meantime are seen consistent.
+ */
+static void
+heap_scrub_run(struct palloc_heap *heap, struct chunk_header *hdr,
+	struct chunk_run *run, uint32_t zone_id, uint32_t chunk_id,
+	palloc_scrub_cb cb, void *arg)
+{
+	pthread_mutex_t *lock = heap_get_run_lock(heap, chunk_id);
+	util_mutex_lock(lock);
+
+	/* the run might have been degraded since its header was read */
+	if (hdr->type != CHUNK_TYPE_RUN)
+		goto out;
+
+	uint64_t bs = run->block_size;
+	if (bs == 0 || bs > RUNSIZE) {
+		cb(PMALLOC_PTR_TO_OFF(heap, run), "invalid run block size",
+			arg);
+		goto out;
+	}
+
+	uint64_t nallocs = RUN_NALLOCS(bs);
+	uint64_t nval = (nallocs - 1) / BITS_PER_VALUE + 1;
+	uint64_t *bitmap = RUN_BITMAP(run);
+	uint8_t *data = RUN_DATA(run);
+
+	/* the bits past the last unit are always set */
+	uint64_t unused = nval * BITS_PER_VALUE - nallocs;
+	uint64_t lastval = unused ? (((1ULL << unused) - 1ULL) <<
+		(BITS_PER_VALUE - unused)) : 0;
+	if ((bitmap[nval - 1] & lastval) != lastval) {
+		cb(PMALLOC_PTR_TO_OFF(heap, run), "invalid run bitmap", arg);
+		goto out;
+	}
+
+	if (heap_run_header_type(hdr) != HEADER_LEGACY)
+		goto out; /* the objects don't have headers to verify */
+
+	for (uint64_t i = 0; i < nallocs; ) {
+		uint64_t v = bitmap[i / BITS_PER_VALUE];
+		if (BIT_IS_CLR(v, i % BITS_PER_VALUE)) {
+			++i;
+			continue;
+		}
+
+		const char *msg = NULL;
+		uint8_t *block = data + i * bs;
+		uint64_t units = heap_scrub_object(block, bs, nallocs - i,
+			zone_id, chunk_id, &msg);
+
+		/* all the units of the object are allocated along with it */
+		for (uint64_t j = i + 1; msg == NULL && j < i + units; ++j) {
+			if (BIT_IS_CLR(bitmap[j / BITS_PER_VALUE],
+					j % BITS_PER_VALUE))
+				msg = "object overlaps free units";
+		}
+
+		if (msg != NULL) {
+			/* the rest of the run can't be walked reliably */
+			cb(PMALLOC_PTR_TO_OFF(heap, block), msg, arg);
+			break;
+		}
+
+		i += units;
+	}
+
+out:
+	util_mutex_unlock(lock);
+}
+
+/*
+ * heap_scrub_huge -- (internal) verifies the header of the huge object
+ *
+ * Huge objects aren't protected by any lock, the inconsistency is reported
+ * only if the chunk didn't change while its object was being verified.
+ */
+static void
+heap_scrub_huge(struct palloc_heap *heap, struct chunk_header *hdr,
+	struct chunk *chunk, uint32_t zone_id, uint32_t chunk_id,
+	palloc_scrub_cb cb, void *arg)
+{
+	struct chunk_header h = *hdr;
+	if (h.type != CHUNK_TYPE_USED)
+		return;
+
+	const char *msg = NULL;
+	if (heap_scrub_object(chunk->data, CHUNKSIZE, h.size_idx,
+			zone_id, chunk_id, &msg) != 0)
+		return;
+
+	if (memcmp(&h, hdr, sizeof(h)) == 0)
+		cb(PMALLOC_PTR_TO_OFF(heap, chunk), msg, arg);
+}
+
+/*
+ * heap_scrub -- verifies the chunk at the cursor, along with the objects in
+ *	it, and advances the cursor to the next chunk
+ *
+ * Returns 1 if a chunk was verified, or 0 if the whole heap has been walked
+ * already, in which case the cursor is rewound to the beginning of the heap.
+ * The inconsistencies found are reported through the callback.
+ */
+int
+heap_scrub(struct palloc_heap *heap, uint64_t *cursor,
+	palloc_scrub_cb cb, void *arg)
+{
+	struct heap_rt *rt = heap->rt;
+	uint32_t zone_id = (uint32_t)(*cursor >> 32);
+	uint32_t chunk_id = (uint32_t)*cursor;
+
+	for (; zone_id < rt->max_zone; ++zone_id, chunk_id = 0) {
+		struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+
+		/* the zones known to be inconsistent are reported once */
+		if (chunk_id == 0 && heap_zone_checked(heap, zone_id) != 0) {
+			cb(PMALLOC_PTR_TO_OFF(heap, z), "inconsistent zone",
+				arg);
+			continue;
+		}
+
+		if (z->header.magic != ZONE_HEADER_MAGIC ||
+				chunk_id >= z->header.size_idx)
+			continue;
+
+		uint32_t zone_size_idx = z->header.size_idx;
+		struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+		struct chunk_header h = *hdr;
+		uint32_t next = chunk_id + 1;
+
+		/*
+		 * The chunks might be split or coalesced at the same time, the
+		 * header is reported only if it stays the same.
+		 */
+		if (h.type == CHUNK_TYPE_FOOTER) {
+			/* the end of a chunk coalesced in the meantime */
+		} else if (heap_verify_chunk_header(&h) != 0 ||
+				h.size_idx == 0 ||
+				h.size_idx > zone_size_idx - chunk_id) {
+			if (memcmp(&h, hdr, sizeof(h)) == 0) {
+				cb(PMALLOC_PTR_TO_OFF(heap, hdr),
+					"invalid chunk header", arg);
+				next = zone_size_idx;
+			}
+		} else if (h.type == CHUNK_TYPE_RUN) {
+			heap_scrub_run(heap, hdr,
+				(struct chunk_run *)&z->chunks[chunk_id],
+				zone_id, chunk_id, cb, arg);
+			next = chunk_id + h.size_idx;
+		} else if (h.type == CHUNK_TYPE_USED) {
+			heap_scrub_huge(heap, hdr, &z->chunks[chunk_id],
+				zone_id, chunk_id, cb, arg);
+			next = chunk_id + h.size_idx;
+		} else if (h.type == CHUNK_TYPE_FREE) {
+			next = chunk_id + h.size_idx;
+		}
+
+		*cursor = ((uint64_t)zone_id << 32) | next;
+
+		return 1;
+	}
+
+	*cursor = 0;
+
+	return 0;
+}
+
 /*
  * heap_run_foreach_object -- (internal) iterates through objects in a run
  */
 static int
 heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
-		void *arg, struct chunk_run *run)
+		void *arg, struct chunk_header *hdr, struct chunk_run *run)
 {
+	enum header_type header_type = heap_run_header_type(hdr);
+
 	uint64_t bs = run->block_size;
 	uint64_t block_off;
 
 	uint64_t bitmap_nallocs = RUN_NALLOCS(bs);
-	uint64_t unused_bits = RUN_BITMAP_SIZE - bitmap_nallocs;
-	uint64_t unused_values = unused_bits / BITS_PER_VALUE;
-	uint64_t bitmap_nval = MAX_BITMAP_VALUES - unused_values;
-	unused_bits -= unused_values * BITS_PER_VALUE;
+	uint64_t bitmap_nval = (bitmap_nallocs - 1) / BITS_PER_VALUE + 1;
+	uint64_t *bitmap = RUN_BITMAP(run);
+	uint8_t *data = RUN_DATA(run);
 
 	struct allocation_header *alloc;
+	uint8_t *block;
 
 	uint64_t i = 0;
 	uint64_t block_start = 0;
 
 	for (; i < bitmap_nval; ++i) {
-		uint64_t v = run->bitmap[i];
+		uint64_t v = bitmap[i];
 		block_off = (BITS_PER_VALUE * (uint64_t)i);
 
 		for (uint64_t j = block_start; j < BITS_PER_VALUE; ) {
@@ -2028,14 +4385,28 @@ heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
 				break;
 
 			if (!BIT_IS_CLR(v, j)) {
-				alloc = (struct allocation_header *)
-					(run->data + (block_off + j) * bs);
-				j += (alloc->size / bs);
+				block = data + (block_off + j) * bs;
+				if (header_type != HEADER_LEGACY) {
+					/* such objects occupy one unit */
+					j += 1;
+					if (cb(PMALLOC_PTR_TO_OFF(heap, block),
+							arg) != 0)
+						return 1;
+					continue;
+				}
+
+				alloc = heap_block_alloc_header(block);
+				j += ((uintptr_t)alloc - (uintptr_t)block +
+					alloc->size) / bs;
 				if (cb(PMALLOC_PTR_TO_OFF(heap, alloc), arg)
 						!= 0)
 					return 1;
 			} else {
-				++j;
+				/* skip straight to the next allocated block */
+				uint64_t rest = v >> j;
+				if (rest == 0)
+					break;
+				j += util_lssb_index64(rest);
 			}
 		}
 		block_start = 0;
@@ -2055,9 +4426,10 @@ heap_chunk_foreach_object(struct palloc_heap *heap, object_callback cb,
 		case CHUNK_TYPE_FREE:
 			return 0;
 		case CHUNK_TYPE_USED:
-			return cb(PMALLOC_PTR_TO_OFF(heap, chunk), arg);
+			return cb(PMALLOC_PTR_TO_OFF(heap,
+				heap_block_alloc_header(chunk)), arg);
 		case CHUNK_TYPE_RUN:
-			return heap_run_foreach_object(heap, cb, arg,
+			return heap_run_foreach_object(heap, cb, arg, hdr,
 				(struct chunk_run *)chunk);
 		default:
 			ASSERT(0);
@@ -2088,6 +4460,60 @@ heap_zone_foreach_object(struct palloc_heap *heap, object_callback cb,
 	return 0;
 }
 
+/*
+ * heap_foreach_object_partition -- iterates through the objects of one of
+ *	the 'npartitions' disjoint parts of the heap, each spanning about
+ *	the same number of chunks, returns non-zero if the callback terminated
+ *	it
+ *
+ * An object belongs to the part containing its first chunk, so the parts
+ * together hold all of the objects of the heap, each one exactly once, as long
+ * as the heap isn't modified in the meantime.
+ */
+int
+heap_foreach_object_partition(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned npartitions, unsigned partition)
+{
+	struct heap_layout *layout = heap->layout;
+	unsigned max_zone = heap_zones_valid(layout,
+		heap_max_zone(layout->header.size));
+
+	ASSERT(partition < npartitions);
+
+	uint64_t nchunks = 0;
+	for (unsigned i = 0; i < max_zone; ++i) {
+		struct zone *z = ZID_TO_ZONE(layout, i);
+		if (heap_zone_checked(heap, i) == 0 && z->header.magic != 0)
+			nchunks += z->header.size_idx;
+	}
+
+	uint64_t first = nchunks * partition / npartitions;
+	uint64_t last = nchunks * (partition + 1) / npartitions;
+
+	/* number of the chunks of all the preceding zones */
+	uint64_t base = 0;
+
+	for (unsigned i = 0; i < max_zone && base < last; ++i) {
+		struct zone *z = ZID_TO_ZONE(layout, i);
+		if (heap_zone_checked(heap, i) != 0 || z->header.magic == 0)
+			continue;
+
+		uint32_t c = 0;
+		while (c < z->header.size_idx && base + c < last) {
+			struct chunk_header *hdr = &z->chunk_headers[c];
+			if (base + c >= first && heap_chunk_foreach_object(heap,
+					cb, arg, hdr, &z->chunks[c]) != 0)
+				return 1;
+
+			c += hdr->size_idx;
+		}
+
+		base += z->header.size_idx;
+	}
+
+	return 0;
+}
+
 /*
  * heap_foreach_object -- (internal) iterates through objects in the heap
  */
@@ -2096,10 +4522,15 @@ heap_foreach_object(struct palloc_heap *heap, object_callback cb, void *arg,
 	struct memory_block start)
 {
 	struct heap_layout *layout = heap->layout;
+	unsigned max_zone = heap_zones_valid(layout,
+		heap_max_zone(layout->header.size));
+
+	for (unsigned i = start.zone_id; i < max_zone; ++i) {
+		if (heap_zone_checked(heap, i) != 0)
+			continue;
 
-	for (unsigned i = start.zone_id;
-		i < heap_max_zone(layout->header.size); ++i)
 		if (heap_zone_foreach_object(heap, cb, arg,
 				ZID_TO_ZONE(layout, i), start) != 0)
 			break;
+	}
 }
@@ -51,6 +51,22 @@
 #define RUN_UNIT_MAX 64U
 #define RUN_UNIT_MAX_ALLOC 8U
 
+/*
+ * Allocation class ids as seen by the users of the heap, zero means that the
+ * class is chosen automatically based on the allocation size.
+ */
+#define HEAP_BID_TO_CLASS_ID(_bid) ((unsigned)(_bid) + 1)
+#define HEAP_CLASS_ID_TO_BID(_id) ((_id) - 1)
+#define HEAP_HUGE_CLASS_ID HEAP_BID_TO_CLASS_ID(MAX_BUCKETS)
+
+/*
+ * On-media features of the heap which earlier versions can't parse, each is
+ * enabled before the first run depending on it is created, see
+ * heap_features_init.
+ */
+#define HEAP_FEAT_COMPACT_HEADER 0x0001 /* runs of objects w/ compact headers */
+#define HEAP_FEAT_TINY_RUNS 0x0002 /* headerless or w/ bitmap in the data */
+
 /*
  * Every allocation has to be a multiple of a cacheline because we need to
  * ensure proper alignment of every pmem structure.
@@ -63,11 +79,30 @@
 #define SIZE_TO_ALLOC_BLOCKS(_s) (1 + (((_s) - 1) / ALLOC_BLOCK_SIZE))
 
 int heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
-		void *base, struct pmem_ops *p_ops);
+		uint64_t run_id, void *base, struct pmem_ops *p_ops);
+void heap_boot_rdonly(struct palloc_heap *heap, void *heap_start,
+		uint64_t heap_size, void *base, struct pmem_ops *p_ops);
 int heap_init(void *heap_start, uint64_t heap_size, struct pmem_ops *p_ops);
 void heap_vg_open(void *heap_start, uint64_t heap_size);
 void heap_cleanup(struct palloc_heap *heap);
+void heap_zones_numa_init(struct palloc_heap *heap,
+	int (*addr_node)(void *arg, const void *addr), void *arg);
+void heap_features_init(struct palloc_heap *heap,
+	int (*enable)(void *arg, unsigned features), void *arg);
+void heap_assume_zeroed(struct palloc_heap *heap);
+int heap_block_fresh(struct palloc_heap *heap, struct memory_block m);
+void heap_check_init(const char *threads_var, const char *defer_var);
+void heap_summary_init(const char *summary_var);
+void heap_affinity_init(const char *affinity_var);
+void heap_tune_init(const char *tune_var);
+unsigned heap_check_nthreads(void);
 int heap_check(void *heap_start, uint64_t heap_size);
+int heap_check_header(void *heap_start, uint64_t heap_size);
+int heap_check_open(void *heap_start, uint64_t heap_size, uint64_t run_id);
+int heap_check_block(struct palloc_heap *heap, uint64_t off);
+unsigned heap_check_wait(struct palloc_heap *heap);
+int heap_scrub(struct palloc_heap *heap, uint64_t *cursor,
+	palloc_scrub_cb cb, void *arg);
 int heap_check_remote(void *heap_start, uint64_t heap_size,
 		struct remote_ops *ops);
 
@@ -76,9 +111,19 @@ struct bucket *heap_get_chunk_bucket(struct palloc_heap *heap,
 		uint32_t chunk_id, uint32_t zone_id);
 struct bucket *heap_get_auxiliary_bucket(struct palloc_heap *heap,
 		size_t size);
+int heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_block, int huge, enum header_type header_type,
+	unsigned *class_id);
+struct bucket *heap_get_class_bucket(struct palloc_heap *heap,
+	unsigned class_id, int aux);
 void heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 	uint32_t size_idx);
 void *heap_get_block_data(struct palloc_heap *heap, struct memory_block m);
+void heap_prefetch_block(struct palloc_heap *heap, const void *ptr);
+enum header_type heap_get_headerless_block(struct palloc_heap *heap,
+	const void *ptr, struct memory_block *m);
+size_t heap_get_block_padding(struct palloc_heap *heap, struct bucket *b,
+	size_t off, size_t alignment);
 struct memory_block heap_coalesce(struct palloc_heap *heap,
 	struct memory_block *blocks[], int n, enum memblock_hdr_op op,
 	struct operation_context *ctx);
@@ -89,10 +134,27 @@ void heap_chunk_write_footer(struct chunk_header *hdr, uint32_t size_idx);
 
 int heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m);
+unsigned heap_get_bestfit_blocks(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n, uint32_t units);
+void heap_return_blocks(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n);
 int heap_get_exact_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m, uint32_t new_size_idx);
+int heap_extend_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m, uint32_t units);
+void heap_trim_huge_block(struct palloc_heap *heap, struct memory_block *m,
+	uint32_t lead, uint32_t units);
 void heap_degrade_run_if_empty(struct palloc_heap *heap, struct bucket *b,
 		struct memory_block m);
+int heap_run_is_unused(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m);
+unsigned heap_run_occupancy(struct palloc_heap *heap, struct memory_block m);
+void heap_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses);
+unsigned heap_run_detach(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m, struct memory_block *blocks);
+void heap_run_attach(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *blocks, unsigned n);
 
 pthread_mutex_t *heap_get_run_lock(struct palloc_heap *heap,
 		uint32_t chunk_id);
@@ -100,11 +162,18 @@ pthread_mutex_t *heap_get_run_lock(struct palloc_heap *heap,
 struct memory_block heap_free_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block m, struct operation_context *ctx);
 
-/* foreach callback, terminates iteration if return value is non-zero */
+/*
+ * foreach callback, terminates iteration if return value is non-zero
+ *
+ * The offset is the one of the allocation header of the object, or, for
+ * objects without allocation headers, of their memory block.
+ */
 typedef int (*object_callback)(uint64_t off, void *arg);
 
 void heap_foreach_object(struct palloc_heap *heap, object_callback cb,
 	void *arg, struct memory_block start);
+int heap_foreach_object_partition(struct palloc_heap *heap, object_callback cb,
+	void *arg, unsigned npartitions, unsigned partition);
 
 #ifdef DEBUG
 int heap_block_is_allocated(struct palloc_heap *heap, struct memory_block m);
@@ -61,13 +61,45 @@
 #define RUNSIZE (CHUNKSIZE - RUN_METASIZE)
 #define MIN_RUN_SIZE 128
 
+/*
+ * Runs of units so small that the chunk holds more of them than there are
+ * bits in the run metadata continue their bitmap at the beginning of the data
+ * area. The extension is rounded up to whole cachelines, which keeps the units
+ * aligned just like in the other runs.
+ */
+#define RUN_BITMAP_EXT_ALIGN 64
+#define RUN_BITMAP_EXT_SIZE(_bs)\
+((_bs) * (RUN_BITMAP_SIZE + 1) > RUNSIZE ? 0 :\
+	((((RUNSIZE / (_bs)) - RUN_BITMAP_SIZE - 1) /\
+	(RUN_BITMAP_EXT_ALIGN * 8) + 1) * RUN_BITMAP_EXT_ALIGN))
+#define RUN_DATA_SIZE(_bs) (RUNSIZE - RUN_BITMAP_EXT_SIZE(_bs))
+
 #define ZID_TO_ZONE(layoutp, zone_id)\
 	((struct zone *)((uintptr_t)&(((struct heap_layout *)(layoutp))->zone0)\
 					+ ZONE_MAX_SIZE * (zone_id)))
 
 enum chunk_flags {
-	CHUNK_FLAG_ZEROED	=	0x0001,
-	CHUNK_RUN_ACTIVE	=	0x0002
+	CHUNK_FLAG_ZEROED		=	0x0001,
+	CHUNK_RUN_ACTIVE		=	0x0002,
+	CHUNK_FLAG_COMPACT_HEADER	=	0x0004, /* only valid in runs */
+	CHUNK_FLAG_HEADER_NONE		=	0x0008  /* only valid in runs */
+};
+
+/*
+ * Type of the headers of the objects allocated from a run.
+ *
+ * Legacy objects begin with struct allocation_header. Compact objects have
+ * no allocation header at all - they always occupy exactly one unit of the run
+ * and so their location and size are derived from their address. Objects
+ * without headers are like the compact ones, but they don't have any metadata
+ * in front of the user data either.
+ */
+enum header_type {
+	HEADER_LEGACY,
+	HEADER_COMPACT,
+	HEADER_NONE,
+
+	MAX_HEADER_TYPES
 };
 
 enum chunk_type {
@@ -91,6 +123,14 @@ struct chunk_run {
 	uint8_t data[RUNSIZE];
 };
 
+/*
+ * The bitmap and the data of the run, with the bitmap extension accounted for.
+ */
+#define RUN_BITMAP(_run)\
+((uint64_t *)((uintptr_t)(_run) + offsetof(struct chunk_run, bitmap)))
+#define RUN_DATA(_run)\
+((uint8_t *)(_run)->data + RUN_BITMAP_EXT_SIZE((_run)->block_size))
+
 struct chunk_header {
 	uint16_t type;
 	uint16_t flags;
@@ -100,7 +140,21 @@ struct chunk_header {
 struct zone_header {
 	uint32_t magic;
 	uint32_t size_idx;
-	uint8_t reserved[56];
+	uint64_t zones_valid; /* zone 0 only: high-water mark of valid zones */
+
+	/*
+	 * The free space summary written when the pool is closed, see
+	 * heap_summary_write. It's valid only if summary_gen of zone 0 is
+	 * nonzero and the pool wasn't opened since summary_run_id, and then
+	 * only for the zones with the same zone_gen.
+	 */
+	uint64_t summary_gen; /* zone 0 only: generation of the summary */
+	uint64_t summary_seq; /* zone 0 only: last generation used */
+	uint64_t zone_gen; /* generation of the summary of this zone */
+	uint32_t free_chunks; /* number of free chunks */
+	uint32_t free_runs; /* number of runs with free units */
+	uint64_t summary_run_id; /* zone 0 only: run it was written in */
+	uint8_t reserved[8];
 };
 
 struct zone {
@@ -131,4 +185,11 @@ struct allocation_header {
 	uint64_t size;
 };
 
+/*
+ * The allocation header of an aligned object might not be located at the
+ * beginning of its memory block. Such block instead begins with a padding
+ * header, which has this flag set and the length of the padding in its size.
+ */
+#define ALLOC_HDR_PADDING (1ULL << 63)
+
 #endif
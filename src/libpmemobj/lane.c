@@ -39,8 +39,12 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "libpmemobj.h"
 #include "cuckoo.h"
@@ -48,16 +52,70 @@
 #include "out.h"
 #include "util.h"
 #include "obj.h"
+#include "sys_util.h"
+#include "usdt.h"
 #include "valgrind_internal.h"
 
 static pthread_key_t Lane_info_key;
 
 static __thread struct cuckoo *Lane_info_ht;
 static __thread struct lane_info *Lane_info_records;
-static __thread struct lane_info *Lane_info_cache;
+
+/*
+ * Set-associative cache of the lane info records of the pools recently used by
+ * the thread, indexed by the least significant bits of the pool's uuid_lo, so
+ * that threads using a number of pools don't have to look them up in the hash
+ * table every time they switch between the pools.
+ */
+#define LANE_INFO_CACHE_SETS 16 /* must be a power of two */
+#define LANE_INFO_CACHE_WAYS 4
+
+struct lane_info_cache_entry {
+	uint64_t pop_uuid_lo;
+	struct lane_info *info;
+};
+
+static __thread struct lane_info_cache_entry
+	Lane_info_cache[LANE_INFO_CACHE_SETS][LANE_INFO_CACHE_WAYS];
 
 struct section_operations *Section_ops[MAX_LANE_SECTION];
 
+/* maximum number of threads recovering the lanes */
+#define LANE_RECOVERY_THREADS_MAX 64
+
+static unsigned Lane_recovery_nthreads = 1;
+
+/*
+ * Lane statistics are gathered in a number of per-CPU slots, each in its own
+ * cache lines, so that the threads holding the lanes don't contend on them.
+ */
+#define LANE_STATS_SLOTS 64 /* must be a power of two */
+
+struct lane_stats {
+	uint64_t acquisitions;
+	uint64_t contended;
+	uint64_t waits;
+	uint64_t hold_time[POBJ_LANE_HOLD_TIME_BUCKETS];
+
+	/* padding to a multiple of the cache line size */
+	char unused[64 - (3 + POBJ_LANE_HOLD_TIME_BUCKETS) * 8 % 64];
+};
+
+static int Lane_stats_enabled;
+
+/*
+ * Section type of the outermost lane held by the thread, LANE_ID if none
+ */
+static __thread enum lane_section_type Lane_held_section = LANE_ID;
+
+/*
+ * lane_wait -- threads waiting for a free lane
+ */
+struct lane_wait {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
 /*
  * lane_info_destroy -- destroy lane info hash table
  */
@@ -73,12 +131,13 @@ lane_info_destroy()
 	while (head != NULL) {
 		record = head;
 		head = head->next;
+		Free(record->dirty);
 		Free(record);
 	}
 
 	Lane_info_ht = NULL;
 	Lane_info_records = NULL;
-	Lane_info_cache = NULL;
+	memset(Lane_info_cache, 0, sizeof(Lane_info_cache));
 }
 
 /*
@@ -129,6 +188,32 @@ lane_info_ht_boot()
 	}
 }
 
+/*
+ * lane_info_cache_set -- (internal) returns the set of the lane info cache
+ *	for the pool
+ */
+static inline struct lane_info_cache_entry *
+lane_info_cache_set(uint64_t pop_uuid_lo)
+{
+	return Lane_info_cache[pop_uuid_lo & (LANE_INFO_CACHE_SETS - 1)];
+}
+
+/*
+ * lane_info_cache_insert -- (internal) inserts the record as the most recently
+ *	used one of its set, evicting the least recently inserted one
+ */
+static inline void
+lane_info_cache_insert(struct lane_info *info)
+{
+	struct lane_info_cache_entry *set =
+		lane_info_cache_set(info->pop_uuid_lo);
+
+	memmove(&set[1], &set[0],
+		sizeof(*set) * (LANE_INFO_CACHE_WAYS - 1));
+	set[0].pop_uuid_lo = info->pop_uuid_lo;
+	set[0].info = info;
+}
+
 /*
  * lane_info_cleanup -- remove lane info record regarding pool being deleted
  */
@@ -146,12 +231,19 @@ lane_info_cleanup(PMEMobjpool *pop)
 		if (info->next)
 			info->next->prev = info->prev;
 
-		if (Lane_info_cache == info)
-			Lane_info_cache = NULL;
+		struct lane_info_cache_entry *set =
+			lane_info_cache_set(info->pop_uuid_lo);
+		for (int i = 0; i < LANE_INFO_CACHE_WAYS; ++i) {
+			if (set[i].info == info) {
+				set[i].pop_uuid_lo = 0;
+				set[i].info = NULL;
+			}
+		}
 
 		if (Lane_info_records == info)
 			Lane_info_records = info->next;
 
+		Free(info->dirty);
 		Free(info);
 	}
 }
@@ -191,7 +283,7 @@ lane_init(PMEMobjpool *pop, struct lane *lane, struct lane_layout *layout)
 error_section_construct:
 	oerrno = errno;
 	for (i = i - 1; i >= 0; --i)
-		Section_ops[i]->destroy_rt(pop, &lane->sections[i].runtime);
+		Section_ops[i]->destroy_rt(pop, lane->sections[i].runtime);
 	errno = oerrno;
 	return -1;
 }
@@ -230,6 +322,33 @@ lane_boot(PMEMobjpool *pop)
 		goto error_locks_malloc;
 	}
 
+	pop->lanes_desc.lane_waiters = 0;
+	struct lane_wait *wait = Malloc(sizeof(*wait));
+	pop->lanes_desc.lane_wait = wait;
+	if (wait == NULL) {
+		err = ENOMEM;
+		ERR("!Malloc for lane wait");
+		goto error_wait_malloc;
+	}
+
+	util_mutex_init(&wait->lock, NULL);
+	if ((err = pthread_cond_init(&wait->cond, NULL))) {
+		errno = err;
+		ERR("!pthread_cond_init");
+		goto error_cond_init;
+	}
+
+	pop->lanes_desc.stats = NULL;
+	if (Lane_stats_enabled) {
+		pop->lanes_desc.stats = Zalloc(sizeof(struct lane_stats) *
+			LANE_STATS_SLOTS);
+		if (pop->lanes_desc.stats == NULL) {
+			err = ENOMEM;
+			ERR("!Zalloc for lane stats");
+			goto error_stats_malloc;
+		}
+	}
+
 	/* add lanes to pmemcheck ignored list */
 	VALGRIND_ADD_TO_GLOBAL_TX_IGNORE((char *)pop + pop->lanes_offset,
 		(sizeof(struct lane_layout) * pop->nlanes));
@@ -249,6 +368,15 @@ lane_boot(PMEMobjpool *pop)
 error_lane_init:
 	for (; i >= 1; --i)
 		lane_destroy(pop, &pop->lanes_desc.lane[i - 1]);
+	Free(pop->lanes_desc.stats);
+	pop->lanes_desc.stats = NULL;
+error_stats_malloc:
+	pthread_cond_destroy(&wait->cond);
+error_cond_init:
+	util_mutex_destroy(&wait->lock);
+	Free(wait);
+	pop->lanes_desc.lane_wait = NULL;
+error_wait_malloc:
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
 error_locks_malloc:
@@ -264,6 +392,18 @@ error_lanes_malloc:
 void
 lane_cleanup(PMEMobjpool *pop)
 {
+	struct pobj_lane_stats stats;
+	if (lane_stats_get(pop, &stats) == 0) {
+		LOG(3, "lane acquisitions %" PRIu64 " contended %" PRIu64
+			" waits %" PRIu64, stats.acquisitions,
+			stats.contended, stats.waits);
+		for (int b = 0; b < POBJ_LANE_HOLD_TIME_BUCKETS; ++b) {
+			if (stats.hold_time[b] != 0)
+				LOG(3, "lanes held < %" PRIu64 " us: %" PRIu64,
+					(uint64_t)1 << b, stats.hold_time[b]);
+		}
+	}
+
 	for (uint64_t i = 0; i < pop->nlanes; ++i)
 		lane_destroy(pop, &pop->lanes_desc.lane[i]);
 
@@ -271,33 +411,250 @@ lane_cleanup(PMEMobjpool *pop)
 	pop->lanes_desc.lane = NULL;
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
+	pthread_cond_destroy(&pop->lanes_desc.lane_wait->cond);
+	util_mutex_destroy(&pop->lanes_desc.lane_wait->lock);
+	Free(pop->lanes_desc.lane_wait);
+	pop->lanes_desc.lane_wait = NULL;
+	Free(pop->lanes_desc.stats);
+	pop->lanes_desc.stats = NULL;
 
 	lane_info_cleanup(pop);
 }
 
+/*
+ * lane_stats_init -- enables the lane statistics of the pools opened or
+ *	created from now on, if the given environment variable is set to 1
+ */
+void
+lane_stats_init(const char *stats_var)
+{
+	char *e = getenv(stats_var);
+	if (e == NULL)
+		return;
+
+	int val = atoi(e);
+	if (val != 0 && val != 1) {
+		LOG(2, "Invalid %s", stats_var);
+	} else {
+		Lane_stats_enabled = val;
+		LOG(3, "%s set to %d", stats_var, Lane_stats_enabled);
+	}
+}
+
+/*
+ * lane_stats_slot -- (internal) returns the statistics slot of the CPU
+ *	the thread is running on
+ */
+static inline struct lane_stats *
+lane_stats_slot(struct lane_stats *stats)
+{
+	int cpu = sched_getcpu();
+
+	return &stats[(unsigned)(cpu < 0 ? 0 : cpu) & (LANE_STATS_SLOTS - 1)];
+}
+
+/*
+ * lane_stats_hold_bucket -- (internal) returns the hold time histogram bucket
+ *	of the given time, the bucket n holding the times below 2^n us
+ */
+static inline unsigned
+lane_stats_hold_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	if (us == 0)
+		return 0;
+
+	unsigned b = util_mssb_index64(us) + 1;
+
+	return b < POBJ_LANE_HOLD_TIME_BUCKETS ?
+		b : POBJ_LANE_HOLD_TIME_BUCKETS - 1;
+}
+
+/*
+ * lane_stats_get -- sums up the per-CPU lane statistics of the pool
+ */
+int
+lane_stats_get(PMEMobjpool *pop, struct pobj_lane_stats *stats)
+{
+	struct lane_stats *slots = pop->lanes_desc.stats;
+	if (slots == NULL)
+		return -1;
+
+	memset(stats, 0, sizeof(*stats));
+	for (unsigned i = 0; i < LANE_STATS_SLOTS; ++i) {
+		stats->acquisitions += slots[i].acquisitions;
+		stats->contended += slots[i].contended;
+		stats->waits += slots[i].waits;
+		for (int b = 0; b < POBJ_LANE_HOLD_TIME_BUCKETS; ++b)
+			stats->hold_time[b] += slots[i].hold_time[b];
+	}
+
+	return 0;
+}
+
+/*
+ * lane_recovery_init -- reads the number of threads recovering the lanes
+ *	from the given environment variable
+ */
+void
+lane_recovery_init(const char *threads_var)
+{
+	char *e = getenv(threads_var);
+	if (e == NULL)
+		return;
+
+	long val = atol(e);
+	if (val < 1 || val > LANE_RECOVERY_THREADS_MAX) {
+		LOG(2, "Invalid %s", threads_var);
+	} else {
+		Lane_recovery_nthreads = (unsigned)val;
+		LOG(3, "%s set to %u", threads_var, Lane_recovery_nthreads);
+	}
+}
+
+struct lane_recovery {
+	PMEMobjpool *pop;
+	int section;
+	int check; /* verify the lanes instead of recovering them */
+	uint64_t next; /* index of the next lane to be processed */
+	pthread_mutex_t lock; /* protects the two fields below */
+	uint64_t failed; /* index of the first lane which failed, if any */
+	int err; /* the error of the first lane which failed */
+};
+
+/*
+ * lane_recovery_fail -- (internal) records a failure of the given lane,
+ *	keeping only the error of the lane with the lowest index
+ */
+static void
+lane_recovery_fail(struct lane_recovery *r, uint64_t lane, int err)
+{
+	util_mutex_lock(&r->lock);
+	if (lane < r->failed) {
+		r->failed = lane;
+		r->err = err;
+	}
+	util_mutex_unlock(&r->lock);
+}
+
+/*
+ * lane_recovery_worker -- (internal) recovers or verifies the given section
+ *	of the lanes until there are none left
+ *
+ * Lanes past the first one which failed are skipped, so that the reported
+ * error doesn't depend on the number of threads.
+ */
+static void *
+lane_recovery_worker(void *arg)
+{
+	struct lane_recovery *r = arg;
+	PMEMobjpool *pop = r->pop;
+	int i = r->section;
+	uint64_t j;
+
+	while ((j = __sync_fetch_and_add(&r->next, 1)) < pop->nlanes) {
+		if (j > __sync_fetch_and_add(&r->failed, 0))
+			break;
+
+		struct lane_layout *layout = lane_get_layout(pop, j);
+		int err = r->check ?
+			Section_ops[i]->check(pop, &layout->sections[i],
+				sizeof(layout->sections[i])) :
+			Section_ops[i]->recover(pop, &layout->sections[i],
+				sizeof(layout->sections[i]));
+
+		if (err != 0) {
+			LOG(2, "section_ops->%s %d %ju %d",
+				r->check ? "check" : "recover", i, j, err);
+			lane_recovery_fail(r, j, err);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * lane_process_section -- (internal) recovers or verifies the given section
+ *	of all lanes using up to the given number of threads
+ *
+ * Each of the threads picks the next lane to be processed, so that the work
+ * stays balanced even if only a few lanes need a lengthy recovery.
+ */
+static int
+lane_process_section(PMEMobjpool *pop, int section, int check,
+	unsigned nthreads)
+{
+	struct lane_recovery r = {
+		.pop = pop,
+		.section = section,
+		.check = check,
+		.next = 0,
+		.failed = UINT64_MAX,
+		.err = 0
+	};
+
+	util_mutex_init(&r.lock, NULL);
+
+	pthread_t threads[LANE_RECOVERY_THREADS_MAX];
+	int started[LANE_RECOVERY_THREADS_MAX];
+
+	if (nthreads > LANE_RECOVERY_THREADS_MAX)
+		nthreads = LANE_RECOVERY_THREADS_MAX;
+	if (nthreads > pop->nlanes)
+		nthreads = (unsigned)pop->nlanes;
+
+	/* the calling thread processes the lanes as well */
+	for (unsigned n = 1; n < nthreads; ++n) {
+		int ret = pthread_create(&threads[n], NULL,
+			lane_recovery_worker, &r);
+		if (ret != 0) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+		}
+		started[n] = ret == 0;
+	}
+
+	lane_recovery_worker(&r);
+
+	for (unsigned n = 1; n < nthreads; ++n) {
+		if (started[n])
+			pthread_join(threads[n], NULL);
+	}
+
+	util_mutex_destroy(&r.lock);
+
+	/*
+	 * The error message is kept per thread, so the first inconsistent
+	 * lane is verified again to report it to the caller.
+	 */
+	if (check && r.err != 0 && nthreads > 1) {
+		struct lane_layout *layout = lane_get_layout(pop, r.failed);
+		Section_ops[section]->check(pop, &layout->sections[section],
+			sizeof(layout->sections[section]));
+	}
+
+	return r.err;
+}
+
 /*
  * lane_recover_and_boot -- performs initialization and recovery of all lanes
+ *
+ * The allocator sections are recovered by the calling thread, before the heap
+ * is booted. The other sections, which use the heap to recover, are recovered
+ * by multiple threads if PMEMOBJ_RECOVERY_THREADS is set.
  */
 int
 lane_recover_and_section_boot(PMEMobjpool *pop)
 {
 	int err = 0;
 	int i; /* section index */
-	uint64_t j; /* lane index */
-	struct lane_layout *layout;
+	uint64_t start = util_time_ns();
 
 	for (i = 0; i < MAX_LANE_SECTION; ++i) {
-		for (j = 0; j < pop->nlanes; ++j) {
-			layout = lane_get_layout(pop, j);
-			err = Section_ops[i]->recover(pop, &layout->sections[i],
-				sizeof(layout->sections[i]));
-
-			if (err != 0) {
-				LOG(2, "section_ops->recover %d %ju %d",
-					i, j, err);
-				return err;
-			}
-		}
+		unsigned nthreads = i == LANE_SECTION_ALLOCATOR ?
+			1 : Lane_recovery_nthreads;
+		if ((err = lane_process_section(pop, i, 0, nthreads)) != 0)
+			return err;
 
 		if ((err = Section_ops[i]->boot(pop)) != 0) {
 			LOG(2, "section_ops->init %d %d", i, err);
@@ -305,56 +662,108 @@ lane_recover_and_section_boot(PMEMobjpool *pop)
 		}
 	}
 
+	LOG(3, "%ju lanes recovered in %" PRIu64 " us", pop->nlanes,
+		(util_time_ns() - start) / 1000);
+
 	return err;
 }
 
 /*
- * lane_check -- performs check of all lanes
+ * lane_check -- performs check of all lanes using up to the given number
+ *	of threads
+ *
+ * The error of the first inconsistent lane is returned, regardless of the
+ * number of threads.
  */
 int
-lane_check(PMEMobjpool *pop)
+lane_check(PMEMobjpool *pop, unsigned nthreads)
 {
 	int err = 0;
 	int i; /* section index */
-	uint64_t j; /* lane index */
-	struct lane_layout *layout;
+	uint64_t start = util_time_ns();
 
 	for (i = 0; i < MAX_LANE_SECTION; ++i) {
-		for (j = 0; j < pop->nlanes; ++j) {
-			layout = lane_get_layout(pop, j);
-			err = Section_ops[i]->check(pop, &layout->sections[i],
-					sizeof(layout->sections[i]));
+		if ((err = lane_process_section(pop, i, 1, nthreads)) != 0)
+			return err;
+	}
 
-			if (err) {
-				LOG(2, "section_ops->check %d %ju %d",
-					i, j, err);
+	LOG(3, "%ju lanes checked in %" PRIu64 " us", pop->nlanes,
+		(util_time_ns() - start) / 1000);
 
-				return err;
-			}
-		}
+	return err;
+}
+
+/*
+ * try_get_lane -- (internal) grabs the first free lane, starting from the
+ *	given index and going through all of the lanes once
+ */
+static inline int
+try_get_lane(uint64_t *locks, uint64_t *index, uint64_t nlocks)
+{
+	for (uint64_t i = 0; i < nlocks; ++i) {
+		*index %= nlocks;
+		if (likely(util_bool_compare_and_swap64(
+				&locks[*index], 0, 1)))
+			return 1;
+
+		++(*index);
 	}
 
-	return err;
+	return 0;
 }
 
 /*
  * get_lane -- (internal) get free lane index
+ *
+ * If all of the lanes stay busy for a while, the thread waits until
+ * one of them is released instead of spinning.
+ *
+ * Returns LANE_FREE if the first lane tried was free, LANE_CONTENDED if
+ * another one was found while spinning and LANE_WAITED otherwise.
  */
-static inline void
-get_lane(uint64_t *locks, uint64_t *index, uint64_t nlocks)
+static enum lane_acquisition
+get_lane(struct lane_descriptor *desc, uint64_t *index)
 {
-	while (1) {
-		do {
-			*index %= nlocks;
-			if (likely(util_bool_compare_and_swap64(
-					&locks[*index], 0, 1)))
-				return;
+	uint64_t *locks = desc->lane_locks;
+	uint64_t nlocks = desc->runtime_nlanes;
+	uint64_t first = *index % nlocks;
+
+	for (int i = 0; i < LANE_SPIN_ROUNDS; ++i) {
+		if (likely(try_get_lane(locks, index, nlocks)))
+			return i == 0 && *index == first ?
+				LANE_FREE : LANE_CONTENDED;
+	}
 
-			++(*index);
-		} while (*index < nlocks);
+	struct lane_wait *wait = desc->lane_wait;
+	util_mutex_lock(&wait->lock);
 
-		sched_yield();
-	}
+	/*
+	 * The lanes are scanned again after registering as a waiter, so that
+	 * a lane released in the meantime is either found here or its release
+	 * wakes this thread up.
+	 */
+	__sync_fetch_and_add(&desc->lane_waiters, 1);
+	while (!try_get_lane(locks, index, nlocks))
+		pthread_cond_wait(&wait->cond, &wait->lock);
+	__sync_fetch_and_sub(&desc->lane_waiters, 1);
+
+	util_mutex_unlock(&wait->lock);
+
+	return LANE_WAITED;
+}
+
+/*
+ * lane_cpu_idx -- (internal) returns the preferred lane of the given CPU
+ *
+ * The lanes of consecutive CPUs are LANE_JUMP apart, so that they don't share
+ * a cache line of the lane locks, and each wraparound shifts them by one.
+ */
+static inline uint64_t
+lane_cpu_idx(unsigned cpu, uint64_t nlanes)
+{
+	uint64_t idx = cpu * LANE_JUMP;
+
+	return (idx + idx / nlanes) % nlanes;
 }
 
 /*
@@ -364,9 +773,11 @@ get_lane(uint64_t *locks, uint64_t *index, uint64_t nlocks)
 static inline struct lane_info *
 get_lane_info_record(PMEMobjpool *pop)
 {
-	if (likely(Lane_info_cache != NULL &&
-			Lane_info_cache->pop_uuid_lo == pop->uuid_lo)) {
-		return Lane_info_cache;
+	struct lane_info_cache_entry *set = lane_info_cache_set(pop->uuid_lo);
+	for (int i = 0; i < LANE_INFO_CACHE_WAYS; ++i) {
+		if (likely(set[i].pop_uuid_lo == pop->uuid_lo &&
+				set[i].info != NULL))
+			return set[i].info;
 	}
 
 	if (unlikely(Lane_info_ht == NULL)) {
@@ -383,6 +794,7 @@ get_lane_info_record(PMEMobjpool *pop)
 		info->pop_uuid_lo = pop->uuid_lo;
 		info->lane_idx = UINT64_MAX;
 		info->nest_count = 0;
+		info->dirty = NULL;
 		info->next = Lane_info_records;
 		info->prev = NULL;
 		if (Lane_info_records) {
@@ -396,12 +808,18 @@ get_lane_info_record(PMEMobjpool *pop)
 		}
 	}
 
-	Lane_info_cache = info;
+	lane_info_cache_insert(info);
 	return info;
 }
 
 /*
- * lane_hold -- grabs a per-thread lane in a round-robin fashion
+ * lane_hold -- grabs a per-thread lane
+ *
+ * The thread starts looking for a free lane from the one assigned to the CPU
+ * it's currently running on, so that the lanes, along with their runtime
+ * state, stay with the CPUs (and NUMA nodes) using them, even when threads
+ * migrate between them. If the CPU can't be determined, the lanes are assigned
+ * to threads in a round-robin fashion.
  */
 unsigned
 lane_hold(PMEMobjpool *pop, struct lane_section **section,
@@ -415,6 +833,8 @@ lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	 * executed using RLANE_DEFAULT.
 	 */
 	if (unlikely(!pop->lanes_desc.runtime_nlanes)) {
+		if (pop->rdonly)
+			FATAL("cannot modify a read-only pool");
 		ASSERT(pop->has_remote_replicas);
 		if (section != NULL)
 			FATAL("cannot obtain section before lane's init");
@@ -428,11 +848,34 @@ lane_hold(PMEMobjpool *pop, struct lane_section **section,
 			&pop->lanes_desc.next_lane_idx, LANE_JUMP);
 	} /* handles wraparound */
 
-	uint64_t *llocks = pop->lanes_desc.lane_locks;
 	/* grab next free lane from lanes available at runtime */
-	if (!lane->nest_count++)
-		get_lane(llocks, &lane->lane_idx,
-			pop->lanes_desc.runtime_nlanes);
+	if (!lane->nest_count++) {
+		int cpu = sched_getcpu();
+		if (likely(cpu >= 0))
+			lane->lane_idx = lane_cpu_idx((unsigned)cpu,
+				pop->lanes_desc.runtime_nlanes);
+
+		USDT_PROBE2(libpmemobj, lane_hold_start, pop, type);
+
+		enum lane_acquisition acq =
+			get_lane(&pop->lanes_desc, &lane->lane_idx);
+
+		USDT_PROBE3(libpmemobj, lane_hold_done, pop,
+			lane->lane_idx, acq);
+
+		struct lane_stats *stats = pop->lanes_desc.stats;
+		if (unlikely(stats != NULL)) {
+			stats = lane_stats_slot(stats);
+			__sync_fetch_and_add(&stats->acquisitions, 1);
+			if (acq != LANE_FREE)
+				__sync_fetch_and_add(&stats->contended, 1);
+			if (acq == LANE_WAITED)
+				__sync_fetch_and_add(&stats->waits, 1);
+			lane->hold_start = util_time_ns();
+		}
+
+		Lane_held_section = type;
+	}
 
 	if (section) {
 		ASSERT(type < MAX_LANE_SECTION);
@@ -442,6 +885,16 @@ lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	return (unsigned)lane->lane_idx;
 }
 
+/*
+ * lane_held_section -- returns the section type of the outermost lane held
+ *	by the thread, or LANE_ID if it holds none
+ */
+enum lane_section_type
+lane_held_section(void)
+{
+	return Lane_held_section;
+}
+
 /*
  * lane_release -- drops the per-thread lane
  */
@@ -461,10 +914,118 @@ lane_release(PMEMobjpool *pop)
 	if (unlikely(lane->nest_count == 0)) {
 		FATAL("lane_release");
 	} else if (--(lane->nest_count) == 0) {
-		if (unlikely(!util_bool_compare_and_swap64(
-				&pop->lanes_desc.lane_locks[lane->lane_idx],
-				1, 0))) {
-			FATAL("util_bool_compare_and_swap64");
+		Lane_held_section = LANE_ID;
+
+		USDT_PROBE2(libpmemobj, lane_release, pop, lane->lane_idx);
+
+		struct lane_stats *stats = pop->lanes_desc.stats;
+		if (unlikely(stats != NULL)) {
+			unsigned b = lane_stats_hold_bucket(
+				util_time_ns() - lane->hold_start);
+			__sync_fetch_and_add(
+				&lane_stats_slot(stats)->hold_time[b], 1);
 		}
+
+		lane_unlock(pop, lane->lane_idx);
+	}
+}
+
+/*
+ * lane_try_lock -- locks the given lane, if it's free, without making the
+ *	calling thread its holder, returns 1 if successful
+ *
+ * This lets a thread access the runtime state of an idle lane while holding
+ * its own one, the lane has to be unlocked with lane_unlock.
+ */
+int
+lane_try_lock(PMEMobjpool *pop, uint64_t idx)
+{
+	ASSERT(idx < pop->lanes_desc.runtime_nlanes);
+
+	return util_bool_compare_and_swap64(
+		&pop->lanes_desc.lane_locks[idx], 0, 1);
+}
+
+/*
+ * lane_unlock -- unlocks the given lane
+ */
+void
+lane_unlock(PMEMobjpool *pop, uint64_t idx)
+{
+	if (unlikely(!util_bool_compare_and_swap64(
+			&pop->lanes_desc.lane_locks[idx], 1, 0))) {
+		FATAL("util_bool_compare_and_swap64");
+	}
+
+	/* wake up a thread waiting for a free lane, if any */
+	if (unlikely(pop->lanes_desc.lane_waiters != 0)) {
+		struct lane_wait *wait = pop->lanes_desc.lane_wait;
+		util_mutex_lock(&wait->lock);
+		pthread_cond_signal(&wait->cond);
+		util_mutex_unlock(&wait->lock);
 	}
 }
+
+/*
+ * lane_hand_off -- drops the per-thread lane without releasing it, so that
+ *	another thread can finish using it, returns -1 if the lane is nested
+ *
+ * The lane stays busy until the thread given its index in *idx takes it over
+ * with lane_take_over and releases it.
+ */
+int
+lane_hand_off(PMEMobjpool *pop, uint64_t *idx)
+{
+	ASSERTne(pop->lanes_desc.runtime_nlanes, 0);
+
+	struct lane_info *lane = get_lane_info_record(pop);
+
+	ASSERTne(lane->nest_count, 0);
+	if (lane->nest_count != 1)
+		return -1;
+
+	lane->nest_count = 0;
+	Lane_held_section = LANE_ID;
+
+	*idx = lane->lane_idx;
+
+	return 0;
+}
+
+/*
+ * lane_take_over -- makes the calling thread the holder of the lane handed
+ *	off by another one
+ */
+void
+lane_take_over(PMEMobjpool *pop, uint64_t idx, enum lane_section_type type)
+{
+	struct lane_info *lane = get_lane_info_record(pop);
+
+	if (lane->nest_count != 0)
+		FATAL("lane_take_over");
+
+	ASSERTeq(pop->lanes_desc.lane_locks[idx], 1);
+
+	lane->lane_idx = idx;
+	lane->nest_count = 1;
+	if (unlikely(pop->lanes_desc.stats != NULL))
+		lane->hold_start = util_time_ns();
+
+	Lane_held_section = type;
+}
+
+/*
+ * lane_dirty_window -- returns the window of dirty ranges of the thread
+ */
+struct lane_dirty_window *
+lane_dirty_window(PMEMobjpool *pop)
+{
+	struct lane_info *lane = get_lane_info_record(pop);
+	if (unlikely(lane->dirty == NULL)) {
+		lane->dirty = Zalloc(sizeof(*lane->dirty));
+		if (unlikely(lane->dirty == NULL))
+			FATAL("!Zalloc");
+	}
+
+	return lane->dirty;
+}
@@ -56,6 +56,9 @@
 
 #define RLANE_DEFAULT 0
 
+/* number of scans of all lanes before a thread waits for one to be released */
+#define LANE_SPIN_ROUNDS 4
+
 enum lane_section_type {
 	LANE_SECTION_ALLOCATOR,
 	LANE_SECTION_LIST,
@@ -96,6 +99,19 @@ struct lane_descriptor {
 	unsigned next_lane_idx;
 	uint64_t *lane_locks;
 	struct lane *lane;
+
+	/* number of threads waiting for a free lane */
+	unsigned lane_waiters;
+	struct lane_wait *lane_wait;
+
+	/* per-CPU lane statistics, NULL unless PMEMOBJ_LANE_STATS is set */
+	struct lane_stats *stats;
+};
+
+enum lane_acquisition {
+	LANE_FREE,	/* the preferred lane was free */
+	LANE_CONTENDED,	/* another lane was found by spinning */
+	LANE_WAITED	/* the thread waited for a lane to be released */
 };
 
 typedef int (*section_layout_op)(PMEMobjpool *pop, void *data, unsigned length);
@@ -111,26 +127,55 @@ struct section_operations {
 	section_global_op boot;
 };
 
+/* maximum number of dirty ranges buffered for the replicas by a thread */
+#define LANE_DIRTY_RANGES_MAX 64
+
+struct lane_dirty_range {
+	uintptr_t start;
+	uintptr_t end;
+};
+
+/*
+ * Ranges of the master replica flushed, but not yet written to the other
+ * replicas, by the thread since its last drain.
+ */
+struct lane_dirty_window {
+	unsigned nranges;
+	struct lane_dirty_range ranges[LANE_DIRTY_RANGES_MAX];
+};
+
 struct lane_info {
 	uint64_t pop_uuid_lo;
 	uint64_t lane_idx;
 	unsigned long nest_count;
+	uint64_t hold_start; /* time of the outermost hold, if stats enabled */
+	struct lane_dirty_window *dirty; /* allocated on first use */
 	struct lane_info *prev, *next;
 };
 
 extern struct section_operations *Section_ops[MAX_LANE_SECTION];
 
 void lane_info_boot(void);
+void lane_recovery_init(const char *threads_var);
+void lane_stats_init(const char *stats_var);
 void lane_info_destroy(void);
 
 int lane_boot(PMEMobjpool *pop);
 void lane_cleanup(PMEMobjpool *pop);
 int lane_recover_and_section_boot(PMEMobjpool *pop);
-int lane_check(PMEMobjpool *pop);
+int lane_check(PMEMobjpool *pop, unsigned nthreads);
+int lane_stats_get(PMEMobjpool *pop, struct pobj_lane_stats *stats);
 
 unsigned lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	enum lane_section_type type);
 void lane_release(PMEMobjpool *pop);
+int lane_try_lock(PMEMobjpool *pop, uint64_t idx);
+void lane_unlock(PMEMobjpool *pop, uint64_t idx);
+int lane_hand_off(PMEMobjpool *pop, uint64_t *idx);
+void lane_take_over(PMEMobjpool *pop, uint64_t idx,
+	enum lane_section_type type);
+enum lane_section_type lane_held_section(void);
+struct lane_dirty_window *lane_dirty_window(PMEMobjpool *pop);
 
 #ifndef _MSC_VER
 
@@ -42,6 +42,9 @@
 #define PREV_OFF (offsetof(struct list_entry, pe_prev) + offsetof(PMEMoid, off))
 #define NEXT_OFF (offsetof(struct list_entry, pe_next) + offsetof(PMEMoid, off))
 
+/* maximum number of redo log entries used by a single operation (a move) */
+#define LIST_OP_MAX_ENTRIES 10
+
 /*
  * list_args_common -- common arguments for operations on list
  *
@@ -153,6 +156,30 @@ list_mutexes_unlock(PMEMobjpool *pop,
 	pmemobj_mutex_unlock_nofail(pop, &head2->lock);
 }
 
+/*
+ * list_get_value -- (internal) return value of the field of a list entry or
+ * head
+ *
+ * The first nprev entries of the redo log are stored by the preceding
+ * operations of a batch and not processed yet, so the value of the field
+ * is taken from the last of them which sets it, if any.
+ */
+static inline uint64_t
+list_get_value(PMEMobjpool *pop, struct redo_log *redo, size_t nprev,
+	uint64_t *ptr)
+{
+	if (nprev == 0)
+		return *ptr;
+
+	uint64_t off = OBJ_PTR_TO_OFF(pop, ptr);
+	for (size_t i = nprev; i > 0; --i) {
+		if (redo[i - 1].offset == off)
+			return redo[i - 1].value;
+	}
+
+	return *ptr;
+}
+
 /*
  * list_get_dest -- (internal) return destination object ID
  *
@@ -161,19 +188,26 @@ list_mutexes_unlock(PMEMobjpool *pop,
  * If the input dest is OID_NULL and before is no set returns last element.
  */
 static inline PMEMoid
-list_get_dest(PMEMobjpool *pop, struct list_head *head, PMEMoid dest,
-		ssize_t pe_offset, int before)
+list_get_dest(PMEMobjpool *pop, struct redo_log *redo, size_t nprev,
+		struct list_head *head, PMEMoid dest, ssize_t pe_offset,
+		int before)
 {
 	if (dest.off)
 		return dest;
 
-	if (head->pe_first.off == 0 || !!before == POBJ_LIST_DEST_HEAD)
-		return head->pe_first;
+	uint64_t first = list_get_value(pop, redo, nprev, &head->pe_first.off);
+	if (first == 0 || !!before == POBJ_LIST_DEST_HEAD) {
+		PMEMoid ret = {pop->uuid_lo, first};
+		return first ? ret : OID_NULL;
+	}
 
 	struct list_entry *first_ptr = (struct list_entry *)OBJ_OFF_TO_PTR(pop,
-			(uintptr_t)((ssize_t)head->pe_first.off + pe_offset));
+			(uintptr_t)((ssize_t)first + pe_offset));
 
-	return first_ptr->pe_prev;
+	PMEMoid last = {pop->uuid_lo,
+		list_get_value(pop, redo, nprev, &first_ptr->pe_prev.off)};
+
+	return last;
 }
 
 /*
@@ -209,7 +243,7 @@ list_set_oid_redo_log(PMEMobjpool *pop,
  */
 static size_t
 list_update_head(PMEMobjpool *pop,
-	struct redo_log *redo, size_t redo_index,
+	struct redo_log *redo, size_t redo_index, size_t nprev,
 	struct list_head *head, uint64_t first_offset)
 {
 	LOG(15, NULL);
@@ -219,7 +253,8 @@ list_update_head(PMEMobjpool *pop,
 	redo_log_store(pop->redo, redo, redo_index + 0,
 			pe_first_off_off, first_offset);
 
-	if (head->pe_first.pool_uuid_lo == 0) {
+	if (list_get_value(pop, redo, nprev,
+			&head->pe_first.pool_uuid_lo) == 0) {
 		uint64_t pe_first_uuid_off = OBJ_PTR_TO_OFF(pop,
 				&head->pe_first.pool_uuid_lo);
 
@@ -327,23 +362,29 @@ list_fill_entry_redo_log(PMEMobjpool *pop,
  */
 static size_t
 list_remove_single(PMEMobjpool *pop,
-	struct redo_log *redo, size_t redo_index,
+	struct redo_log *redo, size_t redo_index, size_t nprev,
 	struct list_args_remove *args)
 {
 	LOG(15, NULL);
 
-	if (args->entry_ptr->pe_next.off == args->obj_doffset) {
+	uint64_t first_off = list_get_value(pop, redo, nprev,
+			&args->head->pe_first.off);
+	uint64_t next_off = list_get_value(pop, redo, nprev,
+			&args->entry_ptr->pe_next.off);
+	uint64_t prev_off = list_get_value(pop, redo, nprev,
+			&args->entry_ptr->pe_prev.off);
+
+	if (next_off == args->obj_doffset) {
 		/* only one element on list */
-		ASSERTeq(args->head->pe_first.off, args->obj_doffset);
-		ASSERTeq(args->entry_ptr->pe_prev.off, args->obj_doffset);
+		ASSERTeq(first_off, args->obj_doffset);
+		ASSERTeq(prev_off, args->obj_doffset);
 
-		return list_update_head(pop, redo, redo_index, args->head, 0);
+		return list_update_head(pop, redo, redo_index, nprev,
+				args->head, 0);
 	} else {
 		/* set next->prev = prev and prev->next = next */
-		uint64_t next_off = args->entry_ptr->pe_next.off;
 		uint64_t next_prev_off = next_off + PREV_OFF;
 		u64_add_offset(&next_prev_off, args->pe_offset);
-		uint64_t prev_off = args->entry_ptr->pe_prev.off;
 		uint64_t prev_next_off = prev_off + NEXT_OFF;
 		u64_add_offset(&prev_next_off, args->pe_offset);
 
@@ -353,9 +394,9 @@ list_remove_single(PMEMobjpool *pop,
 				prev_next_off, next_off);
 		redo_index += 2;
 
-		if (args->head->pe_first.off == args->obj_doffset) {
+		if (first_off == args->obj_doffset) {
 			/* removing element is the first one */
-			return list_update_head(pop, redo, redo_index,
+			return list_update_head(pop, redo, redo_index, nprev,
 					args->head, next_off);
 		} else {
 			return redo_index;
@@ -368,21 +409,23 @@ list_remove_single(PMEMobjpool *pop,
  */
 static size_t
 list_insert_before(PMEMobjpool *pop,
-	struct redo_log *redo, size_t redo_index,
+	struct redo_log *redo, size_t redo_index, size_t nprev,
 	struct list_args_insert *args, struct list_args_common *args_common,
 	uint64_t *next_offset, uint64_t *prev_offset)
 {
 	LOG(15, NULL);
 
+	uint64_t dest_prev = list_get_value(pop, redo, nprev,
+			&args->dest_entry_ptr->pe_prev.off);
+
 	/* current->next = dest and current->prev = dest->prev */
 	*next_offset = args->dest.off;
-	*prev_offset = args->dest_entry_ptr->pe_prev.off;
+	*prev_offset = dest_prev;
 
 	/* dest->prev = current and dest->prev->next = current */
 	uint64_t dest_prev_off = args->dest.off + PREV_OFF;
 	u64_add_offset(&dest_prev_off, args_common->pe_offset);
-	uint64_t dest_prev_next_off = args->dest_entry_ptr->pe_prev.off +
-					NEXT_OFF;
+	uint64_t dest_prev_next_off = dest_prev + NEXT_OFF;
 	u64_add_offset(&dest_prev_next_off, args_common->pe_offset);
 
 	redo_log_store(pop->redo, redo, redo_index + 0,
@@ -398,21 +441,23 @@ list_insert_before(PMEMobjpool *pop,
  */
 static size_t
 list_insert_after(PMEMobjpool *pop,
-	struct redo_log *redo, size_t redo_index,
+	struct redo_log *redo, size_t redo_index, size_t nprev,
 	struct list_args_insert *args, struct list_args_common *args_common,
 	uint64_t *next_offset, uint64_t *prev_offset)
 {
 	LOG(15, NULL);
 
+	uint64_t dest_next = list_get_value(pop, redo, nprev,
+			&args->dest_entry_ptr->pe_next.off);
+
 	/* current->next = dest->next and current->prev = dest */
-	*next_offset = args->dest_entry_ptr->pe_next.off;
+	*next_offset = dest_next;
 	*prev_offset = args->dest.off;
 
 	/* dest->next = current and dest->next->prev = current */
 	uint64_t dest_next_off = args->dest.off + NEXT_OFF;
 	u64_add_offset(&dest_next_off, args_common->pe_offset);
-	uint64_t dest_next_prev_off = args->dest_entry_ptr->pe_next.off +
-					PREV_OFF;
+	uint64_t dest_next_prev_off = dest_next + PREV_OFF;
 	u64_add_offset(&dest_next_prev_off, args_common->pe_offset);
 
 	redo_log_store(pop->redo, redo, redo_index + 0,
@@ -428,14 +473,17 @@ list_insert_after(PMEMobjpool *pop,
  */
 static size_t
 list_insert_user(PMEMobjpool *pop,
-	struct redo_log *redo, size_t redo_index,
+	struct redo_log *redo, size_t redo_index, size_t nprev,
 	struct list_args_insert *args, struct list_args_common *args_common,
 	uint64_t *next_offset, uint64_t *prev_offset)
 {
 	LOG(15, NULL);
+	uint64_t first_off = list_get_value(pop, redo, nprev,
+			&args->head->pe_first.off);
+
 	if (args->dest.off == 0) {
 		/* inserting the first element on list */
-		ASSERTeq(args->head->pe_first.off, 0);
+		ASSERTeq(first_off, 0);
 
 		/* set loop on current element */
 		*next_offset = args_common->obj_doffset;
@@ -443,25 +491,25 @@ list_insert_user(PMEMobjpool *pop,
 
 		/* update head */
 		redo_index = list_update_head(pop,
-			redo, redo_index, args->head,
+			redo, redo_index, nprev, args->head,
 			args_common->obj_doffset);
 	} else {
 		if (args->before) {
 			/* inserting before dest */
 			redo_index = list_insert_before(pop,
-				redo, redo_index, args, args_common,
+				redo, redo_index, nprev, args, args_common,
 				next_offset, prev_offset);
 
-			if (args->dest.off == args->head->pe_first.off) {
+			if (args->dest.off == first_off) {
 				/* current element at first position */
 				redo_index = list_update_head(pop,
-					redo, redo_index, args->head,
+					redo, redo_index, nprev, args->head,
 					args_common->obj_doffset);
 			}
 		} else {
 			/* inserting after dest */
 			redo_index = list_insert_after(pop,
-				redo, redo_index, args, args_common,
+				redo, redo_index, nprev, args, args_common,
 				next_offset, prev_offset);
 		}
 	}
@@ -532,7 +580,7 @@ list_insert_new(PMEMobjpool *pop,
 
 	ASSERT((ssize_t)pe_offset >= 0);
 
-	dest = list_get_dest(pop, user_head, dest,
+	dest = list_get_dest(pop, redo, 0, user_head, dest,
 		(ssize_t)pe_offset, before);
 
 	struct list_entry *entry_ptr =
@@ -561,7 +609,7 @@ list_insert_new(PMEMobjpool *pop,
 
 	/* insert element to user list */
 	redo_index = list_insert_user(pop,
-		redo, redo_index, &args, &args_common,
+		redo, redo_index, 0, &args, &args_common,
 		&next_offset, &prev_offset);
 
 	/* don't need to use redo log for filling new element */
@@ -628,6 +676,57 @@ list_insert_new_user(PMEMobjpool *pop,
 	return ret;
 }
 
+/*
+ * list_insert_redo -- (internal) fill redo log with entries inserting object
+ * to a single list
+ *
+ * The redo log entries preceding redo_index are stored by the preceding
+ * operations of a batch, if any. Returns index of the next free entry.
+ */
+static size_t
+list_insert_redo(PMEMobjpool *pop,
+	struct redo_log *redo, size_t redo_index,
+	ssize_t pe_offset, struct list_head *head,
+	PMEMoid dest, int before,
+	PMEMoid oid)
+{
+	size_t nprev = redo_index;
+
+	dest = list_get_dest(pop, redo, nprev, head, dest, pe_offset, before);
+
+	struct list_entry *entry_ptr =
+		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
+			(uintptr_t)((ssize_t)oid.off + pe_offset));
+
+	struct list_entry *dest_entry_ptr =
+		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
+			(uintptr_t)((ssize_t)dest.off + pe_offset));
+
+	struct list_args_insert args = {
+		.dest = dest,
+		.dest_entry_ptr = dest_entry_ptr,
+		.head = head,
+		.before = before,
+	};
+
+	struct list_args_common args_common = {
+		.obj_doffset = oid.off,
+		.entry_ptr = entry_ptr,
+		.pe_offset = (ssize_t)pe_offset,
+	};
+
+	uint64_t next_offset;
+	uint64_t prev_offset;
+
+	/* insert element to user list */
+	redo_index = list_insert_user(pop, redo, redo_index, nprev,
+			&args, &args_common, &next_offset, &prev_offset);
+
+	/* fill entry of existing element using redo log */
+	return list_fill_entry_redo_log(pop, redo, redo_index,
+			&args_common, next_offset, prev_offset, 1);
+}
+
 /*
  * list_insert -- insert object to a single list
  *
@@ -666,41 +765,9 @@ list_insert(PMEMobjpool *pop,
 	struct lane_list_layout *section =
 		(struct lane_list_layout *)lane_section->layout;
 	struct redo_log *redo = section->redo;
-	size_t redo_index = 0;
-
-	dest = list_get_dest(pop, head, dest, pe_offset, before);
-
-	struct list_entry *entry_ptr =
-		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
-			(uintptr_t)((ssize_t)oid.off + pe_offset));
-
-	struct list_entry *dest_entry_ptr =
-		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
-			(uintptr_t)((ssize_t)dest.off + pe_offset));
 
-	struct list_args_insert args = {
-		.dest = dest,
-		.dest_entry_ptr = dest_entry_ptr,
-		.head = head,
-		.before = before,
-	};
-
-	struct list_args_common args_common = {
-		.obj_doffset = oid.off,
-		.entry_ptr = entry_ptr,
-		.pe_offset = (ssize_t)pe_offset,
-	};
-
-	uint64_t next_offset;
-	uint64_t prev_offset;
-
-	/* insert element to user list */
-	redo_index = list_insert_user(pop, redo, redo_index,
-			&args, &args_common, &next_offset, &prev_offset);
-
-	/* fill entry of existing element using redo log */
-	redo_index = list_fill_entry_redo_log(pop, redo, redo_index,
-			&args_common, next_offset, prev_offset, 1);
+	size_t redo_index = list_insert_redo(pop, redo, 0,
+			pe_offset, head, dest, before, oid);
 
 	redo_log_set_last(pop->redo, redo, redo_index - 1);
 
@@ -764,7 +831,7 @@ list_remove_free(PMEMobjpool *pop, size_t pe_offset,
 	};
 
 	/* remove from user list */
-	redo_index = list_remove_single(pop, redo, redo_index, &args);
+	redo_index = list_remove_single(pop, redo, redo_index, 0, &args);
 
 	/* clear the oid */
 	if (OBJ_PTR_IS_VALID(pop, oidp))
@@ -816,6 +883,46 @@ list_remove_free_user(PMEMobjpool *pop, size_t pe_offset,
 	return 0;
 }
 
+/*
+ * list_remove_redo -- (internal) fill redo log with entries removing object
+ * from list
+ *
+ * The redo log entries preceding redo_index are stored by the preceding
+ * operations of a batch, if any. Returns index of the next free entry.
+ */
+static size_t
+list_remove_redo(PMEMobjpool *pop,
+	struct redo_log *redo, size_t redo_index,
+	ssize_t pe_offset, struct list_head *head,
+	PMEMoid oid)
+{
+	size_t nprev = redo_index;
+
+	struct list_entry *entry_ptr =
+		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
+				oid.off + (size_t)pe_offset);
+
+	struct list_args_remove args = {
+		.pe_offset = (ssize_t)pe_offset,
+		.head = head,
+		.entry_ptr = entry_ptr,
+		.obj_doffset = oid.off,
+	};
+
+	struct list_args_common args_common = {
+		.obj_doffset = oid.off,
+		.entry_ptr = entry_ptr,
+		.pe_offset = (ssize_t)pe_offset,
+	};
+
+	/* remove element from user list */
+	redo_index = list_remove_single(pop, redo, redo_index, nprev, &args);
+
+	/* clear next and prev offsets in removing element using redo log */
+	return list_fill_entry_redo_log(pop, redo, redo_index,
+			&args_common, 0, 0, 0);
+}
+
 /*
  * list_remove -- remove object from list
  *
@@ -851,31 +958,9 @@ list_remove(PMEMobjpool *pop,
 	struct lane_list_layout *section =
 		(struct lane_list_layout *)lane_section->layout;
 	struct redo_log *redo = section->redo;
-	size_t redo_index = 0;
-
-	struct list_entry *entry_ptr =
-		(struct list_entry *)OBJ_OFF_TO_PTR(pop,
-				oid.off + (size_t)pe_offset);
-
-	struct list_args_remove args = {
-		.pe_offset = (ssize_t)pe_offset,
-		.head = head,
-		.entry_ptr = entry_ptr,
-		.obj_doffset = oid.off,
-	};
-
-	struct list_args_common args_common = {
-		.obj_doffset = oid.off,
-		.entry_ptr = entry_ptr,
-		.pe_offset = (ssize_t)pe_offset,
-	};
-
-	/* remove element from user list */
-	redo_index = list_remove_single(pop, redo, redo_index, &args);
 
-	/* clear next and prev offsets in removing element using redo log */
-	redo_index = list_fill_entry_redo_log(pop, redo, redo_index,
-			&args_common, 0, 0, 0);
+	size_t redo_index = list_remove_redo(pop, redo, 0,
+			pe_offset, head, oid);
 
 	redo_log_set_last(pop->redo, redo, redo_index - 1);
 
@@ -890,54 +975,23 @@ err:
 }
 
 /*
- * list_move -- move object between two lists
+ * list_move_redo -- (internal) fill redo log with entries moving object
+ * between two lists
  *
- * pop           - pmemobj handle
- * pe_offset_old - offset to old list entry relative to user data
- * head_old      - old list head
- * pe_offset_new - offset to new list entry relative to user data
- * head_new      - new list head
- * dest          - destination object ID
- * before        - before/after destination
- * oid           - target object ID
+ * The redo log entries preceding redo_index are stored by the preceding
+ * operations of a batch, if any. Returns index of the next free entry, which
+ * is redo_index itself if there's nothing to be done.
  */
-int
-list_move(PMEMobjpool *pop,
+static size_t
+list_move_redo(PMEMobjpool *pop,
+	struct redo_log *redo, size_t redo_index,
 	size_t pe_offset_old, struct list_head *head_old,
 	size_t pe_offset_new, struct list_head *head_new,
 	PMEMoid dest, int before, PMEMoid oid)
 {
-	LOG(3, NULL);
-	ASSERTne(head_old, NULL);
-	ASSERTne(head_new, NULL);
+	size_t nprev = redo_index;
 
-	int ret;
-
-	struct lane_section *lane_section;
-
-	lane_hold(pop, &lane_section, LANE_SECTION_LIST);
-
-	ASSERTne(lane_section, NULL);
-	ASSERTne(lane_section->layout, NULL);
-
-	/*
-	 * Grab locks in specified order to avoid dead-locks.
-	 *
-	 * XXX performance improvement: initialize oob locks at pool opening
-	 */
-	if ((ret = list_mutexes_lock(pop, head_new, head_old))) {
-		errno = ret;
-		LOG(2, "list_mutexes_lock failed");
-		ret = -1;
-		goto err;
-	}
-
-	struct lane_list_layout *section =
-		(struct lane_list_layout *)lane_section->layout;
-	struct redo_log *redo = section->redo;
-	size_t redo_index = 0;
-
-	dest = list_get_dest(pop, head_new, dest,
+	dest = list_get_dest(pop, redo, nprev, head_new, dest,
 		(ssize_t)pe_offset_new, before);
 
 	struct list_entry *entry_ptr_old =
@@ -956,26 +1010,28 @@ list_move(PMEMobjpool *pop,
 		/* moving within the same list */
 
 		if (dest.off == oid.off)
-			goto unlock;
+			return redo_index;
 
-		if (before && dest_entry_ptr->pe_prev.off == oid.off) {
-			if (head_old->pe_first.off != dest.off)
-				goto unlock;
+		uint64_t first_off = list_get_value(pop, redo, nprev,
+				&head_old->pe_first.off);
 
-			redo_index = list_update_head(pop, redo, redo_index,
-					head_old, oid.off);
+		if (before && list_get_value(pop, redo, nprev,
+				&dest_entry_ptr->pe_prev.off) == oid.off) {
+			if (first_off != dest.off)
+				return redo_index;
 
-			goto redo_last;
+			return list_update_head(pop, redo, redo_index, nprev,
+					head_old, oid.off);
 		}
 
-		if (!before && dest_entry_ptr->pe_next.off == oid.off) {
-			if (head_old->pe_first.off != oid.off)
-				goto unlock;
-
-			redo_index = list_update_head(pop, redo, redo_index,
-					head_old, entry_ptr_old->pe_next.off);
+		if (!before && list_get_value(pop, redo, nprev,
+				&dest_entry_ptr->pe_next.off) == oid.off) {
+			if (first_off != oid.off)
+				return redo_index;
 
-			goto redo_last;
+			return list_update_head(pop, redo, redo_index, nprev,
+					head_old, list_get_value(pop, redo,
+					nprev, &entry_ptr_old->pe_next.off));
 		}
 	}
 
@@ -1005,29 +1061,230 @@ list_move(PMEMobjpool *pop,
 	uint64_t prev_offset;
 
 	/* remove element from user list */
-	redo_index = list_remove_single(pop, redo, redo_index, &args_remove);
+	redo_index = list_remove_single(pop, redo, redo_index, nprev,
+			&args_remove);
 
-	/* insert element to user list */
-	redo_index = list_insert_user(pop, redo, redo_index, &args_insert,
-			&args_common, &next_offset, &prev_offset);
+	/*
+	 * Insert element to user list. The redo log entries of the removal
+	 * are not taken into account, same as in a single move.
+	 */
+	redo_index = list_insert_user(pop, redo, redo_index, nprev,
+			&args_insert, &args_common, &next_offset, &prev_offset);
 
 	/* offsets differ, move is between different list entries - set uuid */
 	int set_uuid = pe_offset_new != pe_offset_old ? 1 : 0;
 
 	/* fill next and prev offsets of moving element using redo log */
-	redo_index = list_fill_entry_redo_log(pop, redo, redo_index,
+	return list_fill_entry_redo_log(pop, redo, redo_index,
 			&args_common, next_offset, prev_offset, set_uuid);
+}
+
+/*
+ * list_move -- move object between two lists
+ *
+ * pop           - pmemobj handle
+ * pe_offset_old - offset to old list entry relative to user data
+ * head_old      - old list head
+ * pe_offset_new - offset to new list entry relative to user data
+ * head_new      - new list head
+ * dest          - destination object ID
+ * before        - before/after destination
+ * oid           - target object ID
+ */
+int
+list_move(PMEMobjpool *pop,
+	size_t pe_offset_old, struct list_head *head_old,
+	size_t pe_offset_new, struct list_head *head_new,
+	PMEMoid dest, int before, PMEMoid oid)
+{
+	LOG(3, NULL);
+	ASSERTne(head_old, NULL);
+	ASSERTne(head_new, NULL);
+
+	int ret;
+
+	struct lane_section *lane_section;
+
+	lane_hold(pop, &lane_section, LANE_SECTION_LIST);
+
+	ASSERTne(lane_section, NULL);
+	ASSERTne(lane_section->layout, NULL);
+
+	/*
+	 * Grab locks in specified order to avoid dead-locks.
+	 *
+	 * XXX performance improvement: initialize oob locks at pool opening
+	 */
+	if ((ret = list_mutexes_lock(pop, head_new, head_old))) {
+		errno = ret;
+		LOG(2, "list_mutexes_lock failed");
+		ret = -1;
+		goto err;
+	}
+
+	struct lane_list_layout *section =
+		(struct lane_list_layout *)lane_section->layout;
+	struct redo_log *redo = section->redo;
+
+	size_t redo_index = list_move_redo(pop, redo, 0,
+			pe_offset_old, head_old, pe_offset_new, head_new,
+			dest, before, oid);
+
+	if (redo_index != 0) {
+		redo_log_set_last(pop->redo, redo, redo_index - 1);
+
+		redo_log_process(pop->redo, redo, REDO_NUM_ENTRIES);
+	}
+
+	list_mutexes_unlock(pop, head_new, head_old);
+err:
+	lane_release(pop);
+
+	ASSERT(ret == 0 || ret == -1);
+	return ret;
+}
+
+/*
+ * list_batch_heads_cmp -- (internal) compare list heads by addresses of their
+ * locks
+ */
+static int
+list_batch_heads_cmp(const void *lhs, const void *rhs)
+{
+	uintptr_t l = (uintptr_t)&(*(struct list_head **)lhs)->lock;
+	uintptr_t r = (uintptr_t)&(*(struct list_head **)rhs)->lock;
+
+	if (l < r)
+		return -1;
+
+	return l > r;
+}
+
+/*
+ * list_batch_process -- (internal) process redo log filled by operations
+ * of a batch, if any
+ */
+static void
+list_batch_process(PMEMobjpool *pop, struct redo_log *redo,
+	size_t redo_index)
+{
+	if (redo_index == 0)
+		return;
 
-redo_last:
 	redo_log_set_last(pop->redo, redo, redo_index - 1);
 
 	redo_log_process(pop->redo, redo, REDO_NUM_ENTRIES);
+}
+
+/*
+ * list_batch -- perform a batch of insert, remove and move operations
+ *
+ * pop          - pmemobj handle
+ * ops          - operations, performed in the given order
+ * nops         - number of operations
+ *
+ * The locks of all of the lists are grabbed once, in ascending address order,
+ * and the operations share the redo log of the lane, which is processed only
+ * when the next operation might not fit in it anymore.
+ */
+int
+list_batch(PMEMobjpool *pop, const struct pobj_list_op *ops, size_t nops)
+{
+	LOG(3, NULL);
+
+	if (nops == 0)
+		return 0;
+
+	/* each move can use two lists */
+	struct list_head **heads = Malloc(sizeof(*heads) * nops * 2);
+	if (heads == NULL) {
+		ERR("!Malloc");
+		return -1;
+	}
+
+	size_t nheads = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		ASSERTne(ops[i].head, NULL);
+		heads[nheads++] = ops[i].head;
+		if (ops[i].type == POBJ_LIST_OP_MOVE) {
+			ASSERTne(ops[i].head_new, NULL);
+			heads[nheads++] = ops[i].head_new;
+		}
+	}
+
+	qsort(heads, nheads, sizeof(*heads), list_batch_heads_cmp);
+
+	size_t nunique = 0;
+	for (size_t i = 0; i < nheads; ++i) {
+		if (nunique == 0 || heads[i] != heads[nunique - 1])
+			heads[nunique++] = heads[i];
+	}
+	nheads = nunique;
+
+	int ret = 0;
+
+	struct lane_section *lane_section;
+
+	lane_hold(pop, &lane_section, LANE_SECTION_LIST);
+
+	ASSERTne(lane_section, NULL);
+	ASSERTne(lane_section->layout, NULL);
+
+	size_t nlocked;
+	for (nlocked = 0; nlocked < nheads; ++nlocked) {
+		if ((ret = pmemobj_mutex_lock(pop, &heads[nlocked]->lock))) {
+			errno = ret;
+			LOG(2, "pmemobj_mutex_lock failed");
+			ret = -1;
+			goto unlock;
+		}
+	}
+
+	struct lane_list_layout *section =
+		(struct lane_list_layout *)lane_section->layout;
+	struct redo_log *redo = section->redo;
+	size_t redo_index = 0;
+
+	for (size_t i = 0; i < nops; ++i) {
+		const struct pobj_list_op *op = &ops[i];
+
+		/* an operation is never split between two redo logs */
+		if (redo_index + LIST_OP_MAX_ENTRIES > REDO_NUM_ENTRIES) {
+			list_batch_process(pop, redo, redo_index);
+			redo_index = 0;
+		}
+
+		switch (op->type) {
+		case POBJ_LIST_OP_INSERT:
+			redo_index = list_insert_redo(pop, redo, redo_index,
+				(ssize_t)op->pe_offset, op->head,
+				op->dest, op->before, op->oid);
+			break;
+		case POBJ_LIST_OP_REMOVE:
+			redo_index = list_remove_redo(pop, redo, redo_index,
+				(ssize_t)op->pe_offset, op->head, op->oid);
+			break;
+		case POBJ_LIST_OP_MOVE:
+			redo_index = list_move_redo(pop, redo, redo_index,
+				op->pe_offset, op->head,
+				op->pe_new_offset, op->head_new,
+				op->dest, op->before, op->oid);
+			break;
+		default:
+			ASSERT(0);
+		}
+	}
+
+	list_batch_process(pop, redo, redo_index);
 
 unlock:
-	list_mutexes_unlock(pop, head_new, head_old);
-err:
+	while (nlocked > 0)
+		pmemobj_mutex_unlock_nofail(pop, &heads[--nlocked]->lock);
+
 	lane_release(pop);
 
+	Free(heads);
+
 	ASSERT(ret == 0 || ret == -1);
 	return ret;
 }
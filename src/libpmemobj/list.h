@@ -88,6 +88,8 @@ int list_move(PMEMobjpool *pop,
 	size_t pe_offset_new, struct list_head *head_new,
 	PMEMoid dest, int before, PMEMoid oid);
 
+int list_batch(PMEMobjpool *pop, const struct pobj_list_op *ops, size_t nops);
+
 void list_move_oob(PMEMobjpool *pop,
 	struct list_head *head_old, struct list_head *head_new,
 	PMEMoid oid);
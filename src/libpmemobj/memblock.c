@@ -117,8 +117,8 @@ huge_block_offset(struct memory_block *m, struct palloc_heap *heap, void *ptr)
  *
  * Because the block offset is not represented in bytes but in 'unit size',
  * the number of bytes must also be divided by the chunks block size.
- * A non-zero remainder would mean that either the caller provided incorrect
- * pointer or the allocation algorithm created an invalid allocation block.
+ * A non-zero remainder is only possible for aligned objects, whose allocation
+ * header follows the padding at the beginning of the block.
  */
 static uint16_t
 run_block_offset(struct memory_block *m, struct palloc_heap *heap, void *ptr)
@@ -129,7 +129,6 @@ run_block_offset(struct memory_block *m, struct palloc_heap *heap, void *ptr)
 	uintptr_t diff = (uintptr_t)ptr - (uintptr_t)data;
 	ASSERT(diff <= RUNSIZE);
 	ASSERT((size_t)diff / block_size <= UINT16_MAX);
-	ASSERT(diff % block_size == 0);
 	uint16_t block_off = (uint16_t)((size_t)diff / block_size);
 
 	return block_off;
@@ -244,10 +243,10 @@ run_prep_operation_hdr(struct memory_block *m, struct palloc_heap *heap,
 
 	/* the bit mask is applied immediately by the add entry operations */
 	if (op == HDR_OP_ALLOC)
-		operation_add_entry(ctx, &r->bitmap[bpos],
+		operation_add_entry(ctx, &RUN_BITMAP(r)[bpos],
 			bmask, OPERATION_OR);
 	else
-		operation_add_entry(ctx, &r->bitmap[bpos],
+		operation_add_entry(ctx, &RUN_BITMAP(r)[bpos],
 			~bmask, OPERATION_AND);
 }
 
@@ -43,8 +43,11 @@
  * The modifications are not visible until the context is processed.
  */
 
+#include <string.h>
+
 #include "memops.h"
 #include "out.h"
+#include "util.h"
 #include "valgrind_internal.h"
 
 /*
@@ -62,8 +65,57 @@ operation_init(struct operation_context *ctx, const void *base,
 	else
 		ctx->p_ops = NULL;
 
-	ctx->nentries[ENTRY_PERSISTENT] = 0;
-	ctx->nentries[ENTRY_TRANSIENT] = 0;
+	ctx->overflow = 0;
+	ctx->max_entries = MAX_PERSITENT_ENTRIES;
+
+	for (int i = 0; i < MAX_OPERATION_ENTRY_TYPE; ++i) {
+		ctx->nentries[i] = 0;
+		ctx->entries[i] = ctx->embedded[i];
+	}
+}
+
+/*
+ * operation_extend -- allows the operation to have up to max_entries entries
+ *	of each type, the persistent ones which don't fit in the redo log
+ *	continue in the chain of overflow segments starting at the overflow
+ *	offset, which must be long enough to hold them
+ *
+ * The extension lasts until the operation is processed.
+ */
+int
+operation_extend(struct operation_context *ctx, uint64_t overflow,
+	size_t max_entries)
+{
+	if (max_entries <= ctx->max_entries)
+		return 0;
+
+	ASSERTne(overflow, 0);
+
+	struct operation_entry *entries[MAX_OPERATION_ENTRY_TYPE];
+	for (int i = 0; i < MAX_OPERATION_ENTRY_TYPE; ++i) {
+		entries[i] = Malloc(sizeof(struct operation_entry) *
+			max_entries);
+		if (entries[i] == NULL) {
+			ERR("!Malloc");
+			while (i-- > 0)
+				Free(entries[i]);
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < MAX_OPERATION_ENTRY_TYPE; ++i) {
+		memcpy(entries[i], ctx->entries[i],
+			sizeof(struct operation_entry) * ctx->nentries[i]);
+		if (ctx->entries[i] != ctx->embedded[i])
+			Free(ctx->entries[i]);
+
+		ctx->entries[i] = entries[i];
+	}
+
+	ctx->overflow = overflow;
+	ctx->max_entries = max_entries;
+
+	return 0;
 }
 
 /*
@@ -97,9 +149,6 @@ operation_add_typed_entry(struct operation_context *ctx,
 	void *ptr, uint64_t value,
 	enum operation_type type, enum operation_entry_type en_type)
 {
-	ASSERT(ctx->nentries[ENTRY_PERSISTENT] <= MAX_PERSITENT_ENTRIES);
-	ASSERT(ctx->nentries[ENTRY_TRANSIENT] <= MAX_TRANSIENT_ENTRIES);
-
 	/*
 	 * New entry to be added to the operations, all operations eventually
 	 * come down to a set operation regardless.
@@ -123,6 +172,7 @@ operation_add_typed_entry(struct operation_context *ctx,
 		operation_perform(&en.value, value, type);
 	}
 
+	ASSERT(ctx->nentries[en_type] < ctx->max_entries);
 	ctx->entries[en_type][ctx->nentries[en_type]] = en;
 
 	ctx->nentries[en_type]++;
@@ -161,24 +211,57 @@ operation_add_entries(struct operation_context *ctx,
 
 /*
  * operation_process_persistent_redo -- (internal) process using redo
+ *
+ * The entries are staged in DRAM and written to the redo log a segment at
+ * a time. Once a segment is full, its last entry links to the next overflow
+ * segment. The full segments are only flushed, the single drain before the
+ * finish flag is set persists them all.
  */
 static void
 operation_process_persistent_redo(struct operation_context *ctx)
 {
 	struct operation_entry *e;
 	const struct redo_ctx *redo = ctx->redo_ctx;
+	size_t nentries = ctx->nentries[ENTRY_PERSISTENT];
+
+	struct redo_log staged[REDO_OVERFLOW_NUM_ENTRIES];
+	COMPILE_ERROR_ON(MAX_PERSITENT_ENTRIES > REDO_OVERFLOW_NUM_ENTRIES);
+
+	struct redo_log *log = ctx->redo;
+	size_t log_entries = MAX_PERSITENT_ENTRIES;
+	uint64_t next = ctx->overflow;
+
+	size_t index = 0;
+	for (size_t i = 0; i < nentries; ++i) {
+		if (index == log_entries - 1 && i != nentries - 1) {
+			ASSERTne(next, 0);
+
+			redo_log_store_next(redo, staged, index, next);
+
+			memcpy(log, staged, sizeof(staged[0]) * log_entries);
+			pmemops_flush(ctx->p_ops, log,
+				sizeof(staged[0]) * log_entries);
+
+			struct redo_log_overflow *overflow =
+				(struct redo_log_overflow *)
+				((uintptr_t)ctx->base + next);
+
+			log = overflow->redo;
+			log_entries = REDO_OVERFLOW_NUM_ENTRIES;
+			next = overflow->next;
+			index = 0;
+		}
 
-	size_t i;
-	for (i = 0; i < ctx->nentries[ENTRY_PERSISTENT]; ++i) {
 		e = &ctx->entries[ENTRY_PERSISTENT][i];
 
-		redo_log_store(redo, ctx->redo, i,
+		redo_log_store(redo, staged, index++,
 				(uintptr_t)e->ptr - (uintptr_t)ctx->base,
 				e->value);
 	}
 
-	redo_log_set_last(redo, ctx->redo, i - 1);
-	redo_log_process(redo, ctx->redo, i);
+	redo_log_store_staged(redo, log, 0, staged, index);
+	redo_log_process(redo, ctx->redo, nentries < MAX_PERSITENT_ENTRIES ?
+		nentries : MAX_PERSITENT_ENTRIES);
 }
 
 /*
@@ -223,4 +306,11 @@ operation_process(struct operation_context *ctx)
 		 */
 		VALGRIND_SET_CLEAN(e->ptr, sizeof(e->value));
 	}
+
+	if (ctx->max_entries != MAX_PERSITENT_ENTRIES) {
+		for (int i = 0; i < MAX_OPERATION_ENTRY_TYPE; ++i)
+			Free(ctx->entries[i]);
+
+		operation_init(ctx, ctx->base, ctx->redo_ctx, ctx->redo);
+	}
 }
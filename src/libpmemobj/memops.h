@@ -77,13 +77,20 @@ struct operation_context {
 	struct redo_log *redo;
 	const struct pmem_ops *p_ops;
 
+	/* first segment chained after the redo log, see operation_extend */
+	uint64_t overflow;
+
+	size_t max_entries;
 	size_t nentries[MAX_OPERATION_ENTRY_TYPE];
+	struct operation_entry *entries[MAX_OPERATION_ENTRY_TYPE];
 	struct operation_entry
-		entries[MAX_OPERATION_ENTRY_TYPE][MAX_PERSITENT_ENTRIES];
+		embedded[MAX_OPERATION_ENTRY_TYPE][MAX_PERSITENT_ENTRIES];
 };
 
 void operation_init(struct operation_context *ctx, const void *base,
 	const struct redo_ctx *redo_ctx, struct redo_log *redo);
+int operation_extend(struct operation_context *ctx, uint64_t overflow,
+	size_t max_entries);
 void operation_add_entry(struct operation_context *ctx,
 	void *ptr, uint64_t value, enum operation_type type);
 void operation_add_typed_entry(struct operation_context *ctx,
@@ -33,22 +33,101 @@
 /*
  * obj.c -- transactional object store implementation
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <endian.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <sched.h>
+#include <sys/queue.h>
 
 #include "libpmem.h"
-#include "ctree.h"
 #include "cuckoo.h"
+#include "epoch.h"
 #include "list.h"
 #include "mmap.h"
+#include "mtcopy.h"
 #include "obj.h"
 
 #include "pmemops.h"
+#include "scrub.h"
 #include "set.h"
 #include "sync.h"
+#include "sys_util.h"
+#include "tx.h"
 #include "valgrind_internal.h"
 
-static struct cuckoo *pools_ht; /* hash table used for searching by UUID */
-static struct ctree *pools_tree; /* tree used for searching by address */
+/*
+ * Registry of the open pools -- an immutable array of the pools sorted by
+ * their addresses, along with an array of the same pools sorted by their
+ * uuids. Opening or closing a pool publishes a new version of the registry,
+ * so the lookups by address and by uuid never take a lock nor write to any
+ * shared cache line; an array of a few pools is also much more cache friendly
+ * than a tree or a hash table.
+ *
+ * A version replaced by a newer one is retired, and freed once no thread can
+ * still be reading it. Each publication increments the generation of the
+ * registry. The readers record the generation they've observed, each in its
+ * own reader record, for the duration of the lookup. A version retired in
+ * generation g can be freed once none of the readers is in a generation older
+ * than g. Checking that takes a scan of the reader records, one per thread,
+ * and so it's done by the writers only, when they publish a new version.
+ */
+struct obj_pool_entry {
+	uintptr_t addr;
+	size_t size;
+	uint64_t uuid_lo;
+	PMEMobjpool *pop;
+};
+
+struct obj_pools {
+	struct obj_pools *retired; /* next retired version, if retired */
+	uint64_t retired_gen; /* the generation it was retired in */
+	size_t npools;
+	struct obj_pool_entry *by_uuid;
+	struct obj_pool_entry by_addr[];
+};
+
+struct obj_pools_reader {
+	volatile uint64_t gen; /* generation being read, 0 if none */
+	int used; /* owned by a thread */
+	struct obj_pools_reader *next;
+	char padding[_POBJ_CL_ALIGNMENT - 2 * sizeof(uint64_t) -
+		sizeof(void *)];
+};
+
+static struct obj_pools *Pools; /* current version of the registry */
+static volatile uint64_t Pools_gen = 1; /* current generation */
+static struct obj_pools *Pools_retired; /* versions not freed yet */
+static pthread_mutex_t Pools_lock; /* serializes the registry updates */
+
+/* serializes the updates of the pool headers, see obj_feature_enable */
+static pthread_mutex_t Features_lock;
+
+/* the records of all the reader threads, never removed from the list */
+static struct obj_pools_reader *volatile Pools_readers;
+static pthread_key_t Pools_reader_key; /* releases the record of a thread */
+static __thread struct obj_pools_reader *Pools_reader;
+
+/*
+ * Per-thread cache of the pools recently looked up by uuid, so that threads
+ * switching between a number of pools don't have to search the registry
+ * whenever the inline one-entry cache of pmemobj_direct() misses.
+ */
+#define OBJ_POOL_CACHE_WAYS 8
+
+struct obj_pool_cache_entry {
+	uint64_t uuid_lo;
+	PMEMobjpool *pop;
+};
+
+static __thread struct {
+	int invalidate;
+	unsigned next; /* next way to be replaced */
+	struct obj_pool_cache_entry ways[OBJ_POOL_CACHE_WAYS];
+} Pool_cache;
 
 int _pobj_cache_invalidate;
 
@@ -113,1426 +192,4032 @@ pmemobj_direct(PMEMoid oid)
 	return (void *)((uintptr_t)pcache->pop + oid.off);
 }
 
+/*
+ * pmemobj_prefetch -- prefetches the object into the cache
+ */
+void
+pmemobj_prefetch(PMEMoid oid)
+{
+	void *ptr = pmemobj_direct(oid);
+	if (ptr != NULL)
+		util_prefetch(ptr);
+}
+
 #endif /* _WIN32 */
 
 /*
- * obj_pool_init -- (internal) allocate global structs holding all opened pools
- *
- * This is invoked on a first call to pmemobj_open() or pmemobj_create().
- * Memory is released in library destructor.
+ * obj_pools_reader_release -- (internal) makes the record of the exiting
+ *	thread available to the other threads
  */
 static void
-obj_pool_init(void)
+obj_pools_reader_release(void *arg)
 {
-	LOG(3, NULL);
-
-	if (pools_ht)
-		return;
+	struct obj_pools_reader *r = arg;
 
-	pools_ht = cuckoo_new();
-	if (pools_ht == NULL)
-		FATAL("!cuckoo_new");
-
-	pools_tree = ctree_new();
-	if (pools_tree == NULL)
-		FATAL("!ctree_new");
+	__sync_lock_release(&r->used);
 }
 
 /*
- * User may decide to map all pools with MAP_PRIVATE flag using
- * PMEMOBJ_COW environment variable.
- */
-static int Open_cow;
-
-/*
- * obj_init -- initialization of obj
- *
- * Called by constructor.
+ * obj_pools_reader -- (internal) returns the reader record of the calling
+ *	thread, taken over from an exited thread or allocated on first use
  */
-void
-obj_init(void)
+static struct obj_pools_reader *
+obj_pools_reader(void)
 {
-	LOG(3, NULL);
+	struct obj_pools_reader *r = Pools_reader;
+	if (likely(r != NULL))
+		return r;
 
-	COMPILE_ERROR_ON(sizeof(struct pmemobjpool) != POOL_HDR_SIZE + 4096);
+	for (r = Pools_readers; r != NULL; r = r->next) {
+		if (!r->used && __sync_bool_compare_and_swap(&r->used, 0, 1))
+			break;
+	}
 
-#ifdef USE_COW_ENV
-	char *env = getenv("PMEMOBJ_COW");
-	if (env)
-		Open_cow = atoi(env);
-#endif
+	if (r == NULL) {
+		if ((r = Zalloc(sizeof(*r))) == NULL)
+			FATAL("!Zalloc");
 
-#ifdef _WIN32
-	/* XXX - temporary implementation (see above) */
-	pthread_once(&Cached_pool_key_once, _Cached_pool_key_alloc);
-#endif
+		/* the registry lock might be held by this thread already */
+		r->used = 1;
+		do {
+			r->next = Pools_readers;
+		} while (!__sync_bool_compare_and_swap(&Pools_readers,
+				r->next, r));
+	}
 
-	lane_info_boot();
+	int ret = pthread_setspecific(Pools_reader_key, r);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_setspecific");
+	}
 
-	util_remote_init();
+	Pools_reader = r;
+
+	return r;
 }
 
 /*
- * obj_fini -- cleanup of obj
- *
- * Called by destructor.
+ * obj_pools_enter -- (internal) returns the current version of the registry,
+ *	which can't be freed until obj_pools_exit is called
  */
-void
-obj_fini(void)
+static inline struct obj_pools *
+obj_pools_enter(struct obj_pools_reader *r)
 {
-	LOG(3, NULL);
+	r->gen = Pools_gen;
 
-	if (pools_ht)
-		cuckoo_delete(pools_ht);
-	if (pools_tree)
-		ctree_delete(pools_tree);
-	lane_info_destroy();
-	util_remote_fini();
-}
+	/* the generation must be visible before the registry is read */
+	__sync_synchronize();
 
-/*
- * drain_empty -- (internal) empty function for drain on non-pmem memory
- */
-static void
-drain_empty(void)
-{
-	/* do nothing */
+	return Pools;
 }
 
 /*
- * nopmem_memcpy_persist -- (internal) memcpy followed by an msync
+ * obj_pools_exit -- (internal) ends the lookup started by obj_pools_enter
  */
-static void *
-nopmem_memcpy_persist(void *dest, const void *src, size_t len)
+static inline void
+obj_pools_exit(struct obj_pools_reader *r)
 {
-	LOG(15, "dest %p src %p len %zu", dest, src, len);
+	/* the registry is no longer read once the generation is cleared */
+	__sync_synchronize();
 
-	memcpy(dest, src, len);
-	pmem_msync(dest, len);
-	return dest;
+	r->gen = 0;
 }
 
 /*
- * nopmem_memset_persist -- (internal) memset followed by an msync
+ * obj_pools_reclaim -- (internal) frees the retired versions of the registry
+ *	which can no longer be read, must be called with Pools_lock held
  */
-static void *
-nopmem_memset_persist(void *dest, int c, size_t len)
+static void
+obj_pools_reclaim(void)
 {
-	LOG(15, "dest %p c 0x%02x len %zu", dest, c, len);
+	/* the registry must be replaced before the readers are checked */
+	__sync_synchronize();
+
+	uint64_t oldest = UINT64_MAX;
+	for (struct obj_pools_reader *r = Pools_readers; r != NULL;
+			r = r->next) {
+		uint64_t gen = r->gen;
+		if (gen != 0 && gen < oldest)
+			oldest = gen;
+	}
 
-	memset(dest, c, len);
-	pmem_msync(dest, len);
-	return dest;
+	struct obj_pools **pp = &Pools_retired;
+	while (*pp != NULL) {
+		struct obj_pools *p = *pp;
+		if (p->retired_gen <= oldest) {
+			*pp = p->retired;
+			Free(p);
+		} else {
+			pp = &p->retired;
+		}
+	}
 }
 
 /*
- * obj_remote_persist -- (internal) remote persist function
+ * obj_pools_publish -- (internal) replaces the registry of the open pools
+ *
+ * Builds a new version of the registry out of the current one, with the pool
+ * added (add != 0) or removed, and publishes it. Must be called with
+ * Pools_lock held.
  */
-static void *
-obj_remote_persist(PMEMobjpool *pop, const void *addr, size_t len,
-			unsigned lane)
+static int
+obj_pools_publish(PMEMobjpool *pop, int add)
 {
-	LOG(15, "pop %p addr %p len %zu lane %u", pop, addr, len, lane);
+	struct obj_pools *old = Pools;
+	size_t nold = old ? old->npools : 0;
+	size_t n = add ? nold + 1 : nold - 1;
+
+	struct obj_pools *p = Malloc(sizeof(*p) +
+			2 * n * sizeof(struct obj_pool_entry));
+	if (p == NULL)
+		return ENOMEM;
+
+	p->retired = NULL;
+	p->retired_gen = 0;
+	p->npools = n;
+	p->by_uuid = &p->by_addr[n];
+
+	struct obj_pool_entry e = {
+		(uintptr_t)pop, pop->size, pop->uuid_lo, pop
+	};
+
+	/* merge (or drop) the pool into both of the sorted arrays */
+	size_t ia = 0;
+	size_t iu = 0;
+	int in_addr = !add;
+	int in_uuid = !add;
+	for (size_t i = 0; i < nold; ++i) {
+		const struct obj_pool_entry *a = &old->by_addr[i];
+		const struct obj_pool_entry *u = &old->by_uuid[i];
+
+		if (!in_addr && e.addr < a->addr) {
+			p->by_addr[ia++] = e;
+			in_addr = 1;
+		}
+		if (!in_uuid && e.uuid_lo < u->uuid_lo) {
+			p->by_uuid[iu++] = e;
+			in_uuid = 1;
+		}
 
-	ASSERTne(pop->rpp, NULL);
+		if (add || a->pop != pop)
+			p->by_addr[ia++] = *a;
+		if (add || u->pop != pop)
+			p->by_uuid[iu++] = *u;
+	}
+	if (!in_addr)
+		p->by_addr[ia++] = e;
+	if (!in_uuid)
+		p->by_uuid[iu++] = e;
 
-	/*
-	 * The pool header is not visible on remote node from the local host
-	 * perspective. It means the pool descriptor is at offset 0
-	 * on remote node.
-	 */
-	uintptr_t offset = (uintptr_t)addr - pop->remote_base;
+	ASSERTeq(ia, n);
+	ASSERTeq(iu, n);
 
-	int rv = Rpmem_persist(pop->rpp, offset, len, lane);
-	if (rv) {
-		ERR("!rpmem_persist(rpp %p offset %zu length %zu lane %u)"
-			" FATAL ERROR (returned value %i)",
-			pop->rpp, offset, len, lane, rv);
-		return NULL;
+	/* make sure the contents are visible before the pointer is */
+	__sync_synchronize();
+	Pools = p;
+
+	if (old != NULL) {
+		old->retired_gen = __sync_add_and_fetch(&Pools_gen, 1);
+		old->retired = Pools_retired;
+		Pools_retired = old;
+
+		obj_pools_reclaim();
 	}
 
-	return (void *)addr;
+	return 0;
 }
 
 /*
- * XXX - Consider removing obj_norep_*() wrappers to call *_local()
- * functions directly.  Alternatively, always use obj_rep_*(), even
- * if there are no replicas.  Verify the performance penalty.
- */
-
-/*
- * obj_norep_memcpy_persist -- (internal) memcpy w/o replication
+ * obj_pools_find_uuid -- (internal) searches the registry for the pool
  */
-static void *
-obj_norep_memcpy_persist(void *ctx, void *dest, const void *src,
-	size_t len)
+static PMEMobjpool *
+obj_pools_find_uuid(uint64_t uuid_lo)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+	struct obj_pools_reader *r = obj_pools_reader();
+	struct obj_pools *p = obj_pools_enter(r);
+	PMEMobjpool *pop = NULL;
+	if (p == NULL)
+		goto out;
+
+	size_t lo = 0;
+	size_t hi = p->npools;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (p->by_uuid[mid].uuid_lo < uuid_lo)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	return pop->memcpy_persist_local(dest, src, len);
+	if (lo < p->npools && p->by_uuid[lo].uuid_lo == uuid_lo)
+		pop = p->by_uuid[lo].pop;
+
+out:
+	obj_pools_exit(r);
+
+	return pop;
 }
 
 /*
- * obj_norep_memset_persist -- (internal) memset w/o replication
+ * obj_pools_insert -- (internal) adds the pool to the registry
  */
-static void *
-obj_norep_memset_persist(void *ctx, void *dest, int c, size_t len)
+static int
+obj_pools_insert(PMEMobjpool *pop)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
+	LOG(3, "pop %p", pop);
 
-	return pop->memset_persist_local(dest, c, len);
+	int ret = 0;
+
+	util_mutex_lock(&Pools_lock);
+
+	if (obj_pools_find_uuid(pop->uuid_lo) != NULL)
+		ret = EEXIST;
+	else
+		ret = obj_pools_publish(pop, 1);
+
+	util_mutex_unlock(&Pools_lock);
+
+	return ret;
 }
 
 /*
- * obj_norep_persist -- (internal) persist w/o replication
+ * obj_pools_remove -- (internal) removes the pool from the registry
  */
-static void
-obj_norep_persist(void *ctx, const void *addr, size_t len)
+static int
+obj_pools_remove(PMEMobjpool *pop)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	LOG(3, "pop %p", pop);
 
-	pop->persist_local(addr, len);
+	int ret = 0;
+
+	util_mutex_lock(&Pools_lock);
+
+	if (pmemobj_pool_by_ptr(pop) != pop)
+		ret = EINVAL;
+	else
+		ret = obj_pools_publish(pop, 0);
+
+	util_mutex_unlock(&Pools_lock);
+
+	return ret;
 }
 
 /*
- * obj_norep_flush -- (internal) flush w/o replication
+ * obj_pools_init -- (internal) initializes the registry of the open pools
  */
 static void
-obj_norep_flush(void *ctx, const void *addr, size_t len)
+obj_pools_init(void)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	util_mutex_init(&Pools_lock, NULL);
 
-	pop->flush_local(addr, len);
+	int ret = pthread_key_create(&Pools_reader_key,
+			obj_pools_reader_release);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_key_create");
+	}
 }
 
 /*
- * obj_norep_drain -- (internal) drain w/o replication
+ * obj_pools_fini -- (internal) releases all the versions of the registry,
+ *	along with the reader records
  */
 static void
-obj_norep_drain(void *ctx)
+obj_pools_fini(void)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p", pop);
+	Free(Pools);
+	Pools = NULL;
 
-	pop->drain_local();
+	while (Pools_retired != NULL) {
+		struct obj_pools *next = Pools_retired->retired;
+		Free(Pools_retired);
+		Pools_retired = next;
+	}
+
+	pthread_key_delete(Pools_reader_key);
+
+	while (Pools_readers != NULL) {
+		struct obj_pools_reader *next = Pools_readers->next;
+		Free(Pools_readers);
+		Pools_readers = next;
+	}
+
+	util_mutex_destroy(&Pools_lock);
 }
 
-static void obj_pool_cleanup(PMEMobjpool *pop);
+/*
+ * User may decide to map all pools with MAP_PRIVATE flag using
+ * PMEMOBJ_COW environment variable.
+ */
+static int Open_cow;
 
 /*
- * obj_handle_remote_persist_error -- (internal) handle remote persist
- *                                    fatal error
+ * Number of lanes of the created pools, which can be changed using
+ * the PMEMOBJ_NLANES environment variable.
+ */
+static unsigned Create_nlanes = OBJ_NLANES;
+
+/*
+ * obj_nlanes_init -- (internal) reads the number of lanes of the created
+ *	pools from the given environment variable
  */
 static void
-obj_handle_remote_persist_error(PMEMobjpool *pop)
+obj_nlanes_init(const char *nlanes_var)
 {
-	LOG(1, "pop %p", pop);
-
-	ERR("error clean up...");
-	obj_pool_cleanup(pop);
+	char *e = getenv(nlanes_var);
+	if (e == NULL)
+		return;
 
-	FATAL("Fatal error of remote persist. Aborting...");
+	int val = atoi(e);
+	if (val < 1 || val > OBJ_NLANES_MAX) {
+		LOG(2, "Invalid %s", nlanes_var);
+	} else {
+		Create_nlanes = (unsigned)val;
+		LOG(3, "%s set to %u", nlanes_var, Create_nlanes);
+	}
 }
 
 /*
- * obj_rep_memcpy_persist -- (internal) memcpy with replication
+ * Maximum number of dirty ranges a thread accumulates for the replicas
+ * between drains, 0 if the replicas are written on every flush, set by
+ * the PMEMOBJ_REPLICA_WINDOW environment variable.
  */
-static void *
-obj_rep_memcpy_persist(void *ctx, void *dest, const void *src,
-	size_t len)
-{
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+static unsigned Rep_window;
 
-	unsigned lane = UINT_MAX;
+/* granularity of the dirty ranges */
+#define REP_WINDOW_ALIGN 64
 
-	if (pop->has_remote_replicas)
-		lane = lane_hold(pop, NULL, LANE_ID);
+/*
+ * If set by the PMEMOBJ_REPLICA_RESYNC environment variable, a remote replica
+ * which fails to persist is degraded instead of aborting the program and the
+ * chunks of the pool written since are recorded for resynchronization.
+ */
+static int Rep_resync;
 
-	void *ret = pop->memcpy_persist_local(dest, src, len);
+/* maximum length of a single write when resynchronizing a remote replica */
+#define REP_RESYNC_MAX_WRITE (1ULL << 30)
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memcpy_persist_local(rdest, src, len);
-		} else {
-			if (rep->persist_remote(rep, rdest, len, lane) == NULL)
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
+/*
+ * obj_rep_window_init -- (internal) reads the size of the replication window
+ *	from the given environment variable
+ */
+static void
+obj_rep_window_init(const char *window_var)
+{
+	char *e = getenv(window_var);
+	if (e == NULL)
+		return;
+
+	int val = atoi(e);
+	if (val < 0 || val > LANE_DIRTY_RANGES_MAX) {
+		LOG(2, "Invalid %s", window_var);
+	} else {
+		Rep_window = (unsigned)val;
+		LOG(3, "%s set to %u", window_var, Rep_window);
 	}
+}
 
-	if (pop->has_remote_replicas)
-		lane_release(pop);
+/*
+ * obj_rep_resync_init -- (internal) reads from the given environment variable
+ *	whether the failed remote replicas are degraded
+ */
+static void
+obj_rep_resync_init(const char *resync_var)
+{
+	char *e = getenv(resync_var);
+	if (e == NULL)
+		return;
 
-	return ret;
+	Rep_resync = atoi(e) != 0;
+	LOG(3, "%s set to %d", resync_var, Rep_resync);
 }
 
+static void obj_persist_stats_init(const char *stats_var);
+static void nopmem_boot(void);
+static void nopmem_fini(void);
+
 /*
- * obj_rep_memset_persist -- (internal) memset with replication
+ * obj_init -- initialization of obj
+ *
+ * Called by constructor.
  */
-static void *
-obj_rep_memset_persist(void *ctx, void *dest, int c, size_t len)
+void
+obj_init(void)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
+	LOG(3, NULL);
 
-	unsigned lane = UINT_MAX;
+	COMPILE_ERROR_ON(sizeof(struct pmemobjpool) != POOL_HDR_SIZE + 4096);
 
-	if (pop->has_remote_replicas)
-		lane = lane_hold(pop, NULL, LANE_ID);
+#ifdef USE_COW_ENV
+	char *env = getenv("PMEMOBJ_COW");
+	if (env)
+		Open_cow = atoi(env);
+#endif
 
-	void *ret = pop->memset_persist_local(dest, c, len);
+#ifdef _WIN32
+	/* XXX - temporary implementation (see above) */
+	pthread_once(&Cached_pool_key_once, _Cached_pool_key_alloc);
+#endif
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memset_persist_local(rdest, c, len);
-		} else {
-			if (rep->persist_remote(rep, rdest, len, lane) == NULL)
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	obj_pools_init();
 
-	if (pop->has_remote_replicas)
-		lane_release(pop);
+	util_mutex_init(&Features_lock, NULL);
+	nopmem_boot();
 
-	return ret;
+	lane_info_boot();
+	tx_cache_boot();
+	tx_multi_boot();
+
+	util_remote_init();
+
+	util_mtcopy_init(OBJ_COPY_THREADS_VAR, OBJ_COPY_MT_THRESHOLD_VAR);
+
+	palloc_heap_check_init(OBJ_CHECK_THREADS_VAR, OBJ_CHECK_DEFER_VAR);
+
+	palloc_heap_summary_init(OBJ_HEAP_SUMMARY_VAR);
+
+	palloc_heap_affinity_init(OBJ_ALLOC_AFFINITY_VAR);
+
+	palloc_heap_tune_init(OBJ_ALLOC_TUNE_VAR);
+
+	tx_undo_retain_init(OBJ_TX_UNDO_RETAIN_VAR);
+
+	tx_async_free_init(OBJ_TX_ASYNC_FREE_VAR);
+
+	tx_group_commit_init(OBJ_TX_GROUP_COMMIT_VAR);
+
+	sync_elision_init(OBJ_LOCK_ELISION_VAR);
+
+	sync_futex_init(OBJ_FUTEX_MUTEX_VAR);
+
+	sync_bias_init(OBJ_RWLOCK_BIAS_VAR);
+
+	obj_nlanes_init(OBJ_NLANES_VAR);
+
+	lane_recovery_init(OBJ_RECOVERY_THREADS_VAR);
+
+	lane_stats_init(OBJ_LANE_STATS_VAR);
+
+	obj_persist_stats_init(OBJ_PERSIST_STATS_VAR);
+
+	obj_rep_window_init(OBJ_REPLICA_WINDOW_VAR);
+
+	obj_rep_resync_init(OBJ_REPLICA_RESYNC_VAR);
 }
 
 /*
- * obj_rep_persist -- (internal) persist with replication
+ * obj_fini -- cleanup of obj
+ *
+ * Called by destructor.
  */
-static void
-obj_rep_persist(void *ctx, const void *addr, size_t len)
+void
+obj_fini(void)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	LOG(3, NULL);
 
-	unsigned lane = UINT_MAX;
+	obj_pools_fini();
+	util_mutex_destroy(&Features_lock);
+	nopmem_fini();
+	lane_info_destroy();
+	tx_cache_destroy();
+	tx_multi_destroy();
+	util_remote_fini();
+}
 
-	if (pop->has_remote_replicas)
-		lane = lane_hold(pop, NULL, LANE_ID);
+/*
+ * On non-pmem memory the only way to make data durable is msync, a system
+ * call which syncs whole pages.  To avoid paying for it on every flush,
+ * the flushed ranges are widened to pages and accumulated per thread until
+ * the next drain, which merges them into contiguous runs and syncs each run
+ * with a single msync.  This mirrors the pmem semantics: nothing flushed
+ * is guaranteed to be durable before the drain.
+ *
+ * The runs of a thread may belong to any of the pools, so the runs of all
+ * the threads are registered, and the ones in the mapping of a pool are
+ * synced and forgotten before it's unmapped, see nopmem_sync_range.  Both
+ * what was flushed to the pool by the threads which don't drain it again
+ * becomes durable, and the drains of the other pools don't sync the pages
+ * which are no longer mapped.
+ */
+#define NOPMEM_MAX_RUNS 64
 
-	pop->persist_local(addr, len);
+struct nopmem_run {
+	uintptr_t beg;
+	uintptr_t end;
+};
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			rep->memcpy_persist_local(raddr, addr, len);
-		} else {
-			if (rep->persist_remote(rep, raddr, len, lane) == NULL)
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+struct nopmem_dirty {
+	/* held by the thread, and by whoever syncs its runs of a pool */
+	pthread_mutex_t lock;
+	unsigned nruns;
+	struct nopmem_run runs[NOPMEM_MAX_RUNS];
 
-	if (pop->has_remote_replicas)
-		lane_release(pop);
-}
+	LIST_ENTRY(nopmem_dirty) next;
+};
+
+static __thread struct nopmem_dirty *Nopmem_dirty;
+
+/* the runs of all the threads which have flushed anything */
+static LIST_HEAD(, nopmem_dirty) Nopmem_threads;
+static pthread_mutex_t Nopmem_threads_lock;
+static pthread_key_t Nopmem_key;
 
 /*
- * obj_rep_flush -- (internal) flush with replication
+ * nopmem_sync -- (internal) msync page-aligned range
  */
 static void
-obj_rep_flush(void *ctx, const void *addr, size_t len)
+nopmem_sync(uintptr_t beg, uintptr_t end)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	/*
+	 * The flushed ranges were widened to pages, so part of the run may
+	 * have been marked as undefined/inaccessible, see pmem_msync.
+	 */
+	VALGRIND_DO_DISABLE_ERROR_REPORTING;
 
-	unsigned lane = UINT_MAX;
+	pmem_msync((void *)beg, end - beg);
 
-	if (pop->has_remote_replicas)
-		lane = lane_hold(pop, NULL, LANE_ID);
+	VALGRIND_DO_ENABLE_ERROR_REPORTING;
+}
 
-	pop->flush_local(addr, len);
+/*
+ * nopmem_run_cmp -- (internal) compares runs by their beginning
+ */
+static int
+nopmem_run_cmp(const void *lhs, const void *rhs)
+{
+	const struct nopmem_run *l = lhs;
+	const struct nopmem_run *r = rhs;
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
-		if (rep->rpp == NULL) {
-			memcpy(raddr, addr, len);
-			rep->flush_local(raddr, len);
-		} else {
-			if (rep->persist_remote(rep, raddr, len, lane) == NULL)
-				obj_handle_remote_persist_error(pop);
-		}
-		rep = rep->replica;
-	}
+	if (l->beg < r->beg)
+		return -1;
 
-	if (pop->has_remote_replicas)
-		lane_release(pop);
+	return l->beg > r->beg;
 }
 
 /*
- * obj_rep_drain -- (internal) drain with replication
+ * nopmem_merge -- (internal) sorts the dirty runs and coalesces the ones
+ *	which overlap or are adjacent
  */
 static void
-obj_rep_drain(void *ctx)
+nopmem_merge(struct nopmem_dirty *d)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(15, "pop %p", pop);
+	struct nopmem_run *runs = d->runs;
+	unsigned n = d->nruns;
 
-	pop->drain_local();
+	if (n < 2)
+		return;
 
-	PMEMobjpool *rep = pop->replica;
-	while (rep) {
-		if (rep->rpp == NULL)
-			rep->drain_local();
-		rep = rep->replica;
+	qsort(runs, n, sizeof(*runs), nopmem_run_cmp);
+
+	unsigned last = 0;
+	for (unsigned i = 1; i < n; ++i) {
+		if (runs[i].beg <= runs[last].end) {
+			if (runs[i].end > runs[last].end)
+				runs[last].end = runs[i].end;
+		} else {
+			runs[++last] = runs[i];
+		}
 	}
+
+	d->nruns = last + 1;
 }
 
-#ifdef USE_VG_MEMCHECK
 /*
- * Arbitrary value. When there's more undefined regions than MAX_UNDEFS, it's
- * not worth reporting everything - developer should fix the code.
+ * nopmem_sync_all -- (internal) msyncs all the dirty runs, called with
+ *	the lock of the runs held
  */
-#define MAX_UNDEFS 1000
+static void
+nopmem_sync_all(struct nopmem_dirty *d)
+{
+	nopmem_merge(d);
+
+	for (unsigned i = 0; i < d->nruns; ++i)
+		nopmem_sync(d->runs[i].beg, d->runs[i].end);
+
+	d->nruns = 0;
+}
 
 /*
- * pmemobj_vg_check_no_undef -- (internal) check whether there are any undefined
- *				regions
+ * nopmem_dirty_delete -- (internal) syncs the runs left by the exiting
+ *	thread and unregisters them
  */
 static void
-pmemobj_vg_check_no_undef(struct pmemobjpool *pop)
+nopmem_dirty_delete(void *arg)
 {
-	LOG(4, "pop %p", pop);
+	struct nopmem_dirty *d = arg;
 
-	struct {
-		void *start, *end;
-	} undefs[MAX_UNDEFS];
-	int num_undefs = 0;
-
-	VALGRIND_DO_DISABLE_ERROR_REPORTING;
-	char *addr_start = pop->addr;
-	char *addr_end = addr_start + pop->size;
+	util_mutex_lock(&d->lock);
+	nopmem_sync_all(d);
+	util_mutex_unlock(&d->lock);
 
-	while (addr_start < addr_end) {
-		char *noaccess = (char *)VALGRIND_CHECK_MEM_IS_ADDRESSABLE(
-					addr_start, addr_end - addr_start);
-		if (noaccess == NULL)
-			noaccess = addr_end;
+	util_mutex_lock(&Nopmem_threads_lock);
+	LIST_REMOVE(d, next);
+	util_mutex_unlock(&Nopmem_threads_lock);
 
-		while (addr_start < noaccess) {
-			char *undefined =
-				(char *)VALGRIND_CHECK_MEM_IS_DEFINED(
-					addr_start, noaccess - addr_start);
+	util_mutex_destroy(&d->lock);
+	Free(d);
 
-			if (undefined) {
-				addr_start = undefined;
+	Nopmem_dirty = NULL;
+}
 
-#ifdef VALGRIND_CHECK_MEM_IS_UNDEFINED
-				addr_start = (char *)
-					VALGRIND_CHECK_MEM_IS_UNDEFINED(
-					addr_start, noaccess - addr_start);
-				if (addr_start == NULL)
-					addr_start = noaccess;
-#else
-				while (addr_start < noaccess &&
-						VALGRIND_CHECK_MEM_IS_DEFINED(
-								addr_start, 1))
-					addr_start++;
-#endif
+/*
+ * nopmem_dirty_get -- (internal) returns the runs of the thread, registering
+ *	them on first use, or NULL if that fails
+ */
+static struct nopmem_dirty *
+nopmem_dirty_get(void)
+{
+	struct nopmem_dirty *d = Nopmem_dirty;
+	if (likely(d != NULL))
+		return d;
 
-				if (num_undefs < MAX_UNDEFS) {
-					undefs[num_undefs].start = undefined;
-					undefs[num_undefs].end = addr_start - 1;
-					num_undefs++;
-				}
-			} else
-				addr_start = noaccess;
-		}
+	d = Malloc(sizeof(*d));
+	if (d == NULL) {
+		LOG(2, "!Malloc");
+		return NULL;
+	}
 
-#ifdef VALGRIND_CHECK_MEM_IS_UNADDRESSABLE
-		addr_start = (char *)VALGRIND_CHECK_MEM_IS_UNADDRESSABLE(
-				addr_start, addr_end - addr_start);
-		if (addr_start == NULL)
-			addr_start = addr_end;
-#else
-		while (addr_start < addr_end &&
-				(char *)VALGRIND_CHECK_MEM_IS_ADDRESSABLE(
-						addr_start, 1) == addr_start)
-			addr_start++;
-#endif
+	int result = pthread_setspecific(Nopmem_key, d);
+	if (result != 0) {
+		errno = result;
+		LOG(2, "!pthread_setspecific");
+		Free(d);
+		return NULL;
 	}
-	VALGRIND_DO_ENABLE_ERROR_REPORTING;
 
-	if (num_undefs) {
-		/*
-		 * How to resolve this error:
-		 * If it's part of the free space Valgrind should be told about
-		 * it by VALGRIND_DO_MAKE_MEM_NOACCESS request. If it's
-		 * allocated - initialize it or use VALGRIND_DO_MAKE_MEM_DEFINED
-		 * request.
-		 */
+	util_mutex_init(&d->lock, NULL);
+	d->nruns = 0;
 
-		VALGRIND_PRINTF("Part of the pool is left in undefined state on"
-				" boot. This is pmemobj's bug.\nUndefined"
-				" regions:\n");
-		for (int i = 0; i < num_undefs; ++i)
-			VALGRIND_PRINTF("   [%p, %p]\n", undefs[i].start,
-					undefs[i].end);
-		if (num_undefs == MAX_UNDEFS)
-			VALGRIND_PRINTF("   ...\n");
+	util_mutex_lock(&Nopmem_threads_lock);
+	LIST_INSERT_HEAD(&Nopmem_threads, d, next);
+	util_mutex_unlock(&Nopmem_threads_lock);
 
-		/* Trigger error. */
-		VALGRIND_CHECK_MEM_IS_DEFINED(undefs[0].start, 1);
-	}
+	Nopmem_dirty = d;
+
+	return d;
 }
 
 /*
- * pmemobj_vg_boot -- (internal) notify Valgrind about pool objects
+ * nopmem_boot -- (internal) initializes the registry of the dirty runs
  */
 static void
-pmemobj_vg_boot(struct pmemobjpool *pop)
+nopmem_boot(void)
 {
-	if (!On_valgrind)
-		return;
-	LOG(4, "pop %p", pop);
-
-	PMEMoid oid;
-	size_t rs = pmemobj_root_size(pop);
-	if (rs) {
-		oid = pmemobj_root(pop, rs);
-		palloc_vg_register_object(&pop->heap, oid,
-				pmemobj_root_size(pop));
-	}
+	LIST_INIT(&Nopmem_threads);
+	util_mutex_init(&Nopmem_threads_lock, NULL);
 
-	for (oid = pmemobj_first(pop);
-			!OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
-		palloc_vg_register_object(&pop->heap, oid,
-				pmemobj_alloc_usable_size(oid));
+	int result = pthread_key_create(&Nopmem_key, nopmem_dirty_delete);
+	if (result != 0) {
+		errno = result;
+		FATAL("!pthread_key_create");
 	}
-
-	if (getenv("PMEMOBJ_VG_CHECK_UNDEF"))
-		pmemobj_vg_check_no_undef(pop);
 }
 
-#endif
-
 /*
- * pmemobj_boot -- (internal) boots the pmemobj pool
+ * nopmem_fini -- (internal) frees the dirty runs of the threads still
+ *	running, all the pools are closed by now
  */
-static int
-pmemobj_boot(PMEMobjpool *pop)
+static void
+nopmem_fini(void)
 {
-	LOG(3, "pop %p", pop);
-
-	if ((errno = lane_boot(pop)) != 0) {
-		ERR("!lane_boot");
-		return errno;
-	}
-
-	if ((errno = lane_recover_and_section_boot(pop)) != 0) {
-		ERR("!lane_recover_and_section_boot");
-		return errno;
+	while (!LIST_EMPTY(&Nopmem_threads)) {
+		struct nopmem_dirty *d = LIST_FIRST(&Nopmem_threads);
+		LIST_REMOVE(d, next);
+		util_mutex_destroy(&d->lock);
+		Free(d);
 	}
 
-	return 0;
+	Nopmem_dirty = NULL;
+	pthread_key_delete(Nopmem_key);
+	util_mutex_destroy(&Nopmem_threads_lock);
 }
 
 /*
- * pmemobj_descr_create -- (internal) create obj pool descriptor
+ * nopmem_sync_range -- (internal) msyncs the dirty runs of all the threads
+ *	which overlap the range and forgets them, before the range is unmapped
  */
-static int
-pmemobj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize)
+static void
+nopmem_sync_range(const void *addr, size_t len)
 {
-	LOG(3, "pop %p layout %s poolsize %zu", pop, layout, poolsize);
+	uintptr_t beg = (uintptr_t)addr;
+	uintptr_t end = beg + len;
 
-	ASSERTeq(poolsize % Pagesize, 0);
+	util_mutex_lock(&Nopmem_threads_lock);
 
-	/* opaque info lives at the beginning of mapped memory pool */
-	void *dscp = (void *)((uintptr_t)(&pop->hdr) +
-				sizeof(struct pool_hdr));
+	struct nopmem_dirty *d;
+	LIST_FOREACH(d, &Nopmem_threads, next) {
+		util_mutex_lock(&d->lock);
 
-	/* create the persistent part of pool's descriptor */
-	memset(dscp, 0, OBJ_DSC_P_SIZE);
-	if (layout)
-		strncpy(pop->layout, layout, PMEMOBJ_MAX_LAYOUT - 1);
-	struct pmem_ops *p_ops = &pop->p_ops;
+		for (unsigned i = 0; i < d->nruns; ) {
+			struct nopmem_run *r = &d->runs[i];
+			if (r->beg < end && r->end > beg) {
+				nopmem_sync(r->beg, r->end);
+				*r = d->runs[--d->nruns];
+			} else {
+				++i;
+			}
+		}
 
-	/* initialize run_id, it will be incremented later */
-	pop->run_id = 0;
-	pmemops_persist(p_ops, &pop->run_id, sizeof(pop->run_id));
+		util_mutex_unlock(&d->lock);
+	}
 
-	pop->lanes_offset = OBJ_LANES_OFFSET;
-	pop->nlanes = OBJ_NLANES;
-	pop->root_offset = 0;
+	util_mutex_unlock(&Nopmem_threads_lock);
+}
 
-	/* zero all lanes */
-	void *lanes_layout = (void *)((uintptr_t)pop + pop->lanes_offset);
-	pmemops_memset_persist(p_ops, lanes_layout, 0,
-				pop->nlanes * sizeof(struct lane_layout));
+/*
+ * nopmem_drain -- (internal) msyncs all the ranges flushed by this thread
+ */
+static void
+nopmem_drain(void)
+{
+	struct nopmem_dirty *d = Nopmem_dirty;
+	if (d == NULL)
+		return;
 
-	pop->heap_offset = pop->lanes_offset +
-		pop->nlanes * sizeof(struct lane_layout);
-	pop->heap_offset = (pop->heap_offset + Pagesize - 1) & ~(Pagesize - 1);
-	pop->heap_size = poolsize - pop->heap_offset;
+	util_mutex_lock(&d->lock);
+	nopmem_sync_all(d);
+	util_mutex_unlock(&d->lock);
+}
 
-	/* initialize heap prior to storing the checksum */
-	errno = palloc_init((char *)pop + pop->heap_offset, pop->heap_size,
-			p_ops);
-	if (errno != 0) {
-		ERR("!palloc_init");
-		return -1;
+/*
+ * nopmem_add -- (internal) marks the pages of the range as dirty, called with
+ *	the lock of the runs held
+ */
+static void
+nopmem_add(struct nopmem_dirty *d, uintptr_t beg, uintptr_t end)
+{
+	struct nopmem_run *runs = d->runs;
+	unsigned n = d->nruns;
+
+	/* consecutive flushes usually hit the same or the next page */
+	if (n != 0 && beg <= runs[n - 1].end && end >= runs[n - 1].beg) {
+		if (beg < runs[n - 1].beg)
+			runs[n - 1].beg = beg;
+		if (end > runs[n - 1].end)
+			runs[n - 1].end = end;
+		return;
 	}
 
-	util_checksum(dscp, OBJ_DSC_P_SIZE, &pop->checksum, 1);
-
-	/* store the persistent part of pool's descriptor (2kB) */
-	pmemops_persist(p_ops, dscp, OBJ_DSC_P_SIZE);
+	if (n == NOPMEM_MAX_RUNS) {
+		nopmem_merge(d);
+		if (d->nruns == NOPMEM_MAX_RUNS)
+			nopmem_sync_all(d);
+	}
 
-	return 0;
+	runs[d->nruns].beg = beg;
+	runs[d->nruns].end = end;
+	d->nruns++;
 }
 
 /*
- * pmemobj_descr_check -- (internal) validate obj pool descriptor
+ * nopmem_flush -- (internal) marks the pages of the range as dirty
  */
-static int
-pmemobj_descr_check(PMEMobjpool *pop, const char *layout, size_t poolsize)
+static void
+nopmem_flush(const void *addr, size_t len)
 {
-	LOG(3, "pop %p layout %s poolsize %zu", pop, layout, poolsize);
+	LOG(15, "addr %p len %zu", addr, len);
 
-	void *dscp = (void *)((uintptr_t)(&pop->hdr) + sizeof(struct pool_hdr));
+	if (len == 0)
+		return;
 
-	if (pop->rpp) {
-		/* read remote descriptor */
-		if (obj_read_remote(pop->rpp, pop->remote_base, dscp,
-				dscp, OBJ_DSC_P_SIZE)) {
-			ERR("!obj_read_remote");
-			return -1;
-		}
+	uintptr_t mask = (uintptr_t)Pagesize - 1;
+	uintptr_t beg = (uintptr_t)addr & ~mask;
+	uintptr_t end = ((uintptr_t)addr + len + mask) & ~mask;
 
-		/*
-		 * Set size of the replica to the pool size (required minimum).
-		 * This condition is checked while opening the remote pool.
-		 */
-		pop->size = poolsize;
+	struct nopmem_dirty *d = nopmem_dirty_get();
+	if (d == NULL) {
+		nopmem_sync(beg, end);
+		return;
 	}
 
-	if (!util_checksum(dscp, OBJ_DSC_P_SIZE, &pop->checksum, 0)) {
-		ERR("invalid checksum of pool descriptor");
-		errno = EINVAL;
-		return -1;
-	}
+	util_mutex_lock(&d->lock);
+	nopmem_add(d, beg, end);
+	util_mutex_unlock(&d->lock);
+}
 
-	if (layout &&
-	    strncmp(pop->layout, layout, PMEMOBJ_MAX_LAYOUT)) {
-		ERR("wrong layout (\"%s\"), "
-			"pool created with layout \"%s\"",
-			layout, pop->layout);
-		errno = EINVAL;
-		return -1;
-	}
+/*
+ * nopmem_persist -- (internal) makes the range and everything flushed
+ *	before durable
+ */
+static void
+nopmem_persist(const void *addr, size_t len)
+{
+	LOG(15, "addr %p len %zu", addr, len);
 
-	if (pop->size < poolsize) {
-		ERR("replica size smaller than pool size: %zu < %zu",
-			pop->size, poolsize);
-		errno = EINVAL;
-		return -1;
+	struct nopmem_dirty *d = Nopmem_dirty;
+	if (d == NULL) {
+		pmem_msync(addr, len);
+		return;
 	}
 
-	if (pop->heap_offset + pop->heap_size != poolsize) {
-		ERR("heap size does not match pool size: %zu != %zu",
-			pop->heap_offset + pop->heap_size, poolsize);
-		errno = EINVAL;
-		return -1;
+	util_mutex_lock(&d->lock);
+
+	if (d->nruns == 0) {
+		util_mutex_unlock(&d->lock);
+		pmem_msync(addr, len);
+		return;
 	}
 
-	if (pop->heap_offset % Pagesize ||
-	    pop->heap_size % Pagesize) {
-		ERR("unaligned heap: off %ju, size %zu",
-			pop->heap_offset, pop->heap_size);
-		errno = EINVAL;
-		return -1;
+	if (len != 0) {
+		uintptr_t mask = (uintptr_t)Pagesize - 1;
+		nopmem_add(d, (uintptr_t)addr & ~mask,
+			((uintptr_t)addr + len + mask) & ~mask);
 	}
+	nopmem_sync_all(d);
 
-	return 0;
+	util_mutex_unlock(&d->lock);
 }
 
 /*
- * pmemobj_replica_init_local -- (internal) initialize runtime part
- *                               of the local replicas
+ * obj_replicas_sync -- (internal) syncs the ranges flushed to the non-pmem
+ *	replicas of the pool set by any of the threads, before they are unmapped
  */
-static int
-pmemobj_replica_init_local(PMEMobjpool *rep, int is_pmem)
+static void
+obj_replicas_sync(struct pool_set *set)
 {
-	LOG(3, "rep %p is_pmem %d", rep, is_pmem);
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+		if (rep->remote == NULL && !rep->is_pmem)
+			nopmem_sync_range(rep->part[0].addr, rep->repsize);
+	}
+}
 
-	/*
-	 * Use some of the memory pool area for run-time info.  This
-	 * run-time state is never loaded from the file, it is always
-	 * created here, so no need to worry about byte-order.
-	 */
-	rep->is_pmem = is_pmem;
+/*
+ * nopmem_memcpy_persist -- (internal) memcpy followed by a persist
+ */
+static void *
+nopmem_memcpy_persist(void *dest, const void *src, size_t len)
+{
+	LOG(15, "dest %p src %p len %zu", dest, src, len);
 
-	/* init hooks */
-	rep->persist_remote = NULL;
+	memcpy(dest, src, len);
+	nopmem_persist(dest, len);
+	return dest;
+}
 
-	if (rep->is_pmem) {
-		rep->persist_local = pmem_persist;
-		rep->flush_local = pmem_flush;
-		rep->drain_local = pmem_drain;
-		rep->memcpy_persist_local = pmem_memcpy_persist;
-		rep->memset_persist_local = pmem_memset_persist;
-	} else {
-		rep->persist_local = (persist_local_fn)pmem_msync;
-		rep->flush_local = (flush_local_fn)pmem_msync;
-		rep->drain_local = drain_empty;
-		rep->memcpy_persist_local = nopmem_memcpy_persist;
-		rep->memset_persist_local = nopmem_memset_persist;
-	}
+/*
+ * nopmem_memset_persist -- (internal) memset followed by a persist
+ */
+static void *
+nopmem_memset_persist(void *dest, int c, size_t len)
+{
+	LOG(15, "dest %p c 0x%02x len %zu", dest, c, len);
 
-	return 0;
+	memset(dest, c, len);
+	nopmem_persist(dest, len);
+	return dest;
 }
 
 /*
- * pmemobj_replica_init_remote -- (internal) initialize runtime part
- *                                of a remote replica
+ * nopmem_memcpy_nodrain -- (internal) memcpy followed by a flush
  */
-static int
-pmemobj_replica_init_remote(PMEMobjpool *rep, struct pool_set *set,
-				unsigned repidx, int create)
+static void *
+nopmem_memcpy_nodrain(void *dest, const void *src, size_t len)
 {
-	LOG(3, "rep %p set %p repidx %u", rep, set, repidx);
+	LOG(15, "dest %p src %p len %zu", dest, src, len);
 
-	struct pool_replica *repset = set->replica[repidx];
+	memcpy(dest, src, len);
+	nopmem_flush(dest, len);
+	return dest;
+}
 
-	ASSERTne(repset->remote->rpp, NULL);
-	ASSERTne(repset->remote->node_addr, NULL);
-	ASSERTne(repset->remote->pool_desc, NULL);
+/*
+ * nopmem_memset_nodrain -- (internal) memset followed by a flush
+ */
+static void *
+nopmem_memset_nodrain(void *dest, int c, size_t len)
+{
+	LOG(15, "dest %p c 0x%02x len %zu", dest, c, len);
 
-	rep->node_addr = Strdup(repset->remote->node_addr);
-	if (rep->node_addr == NULL)
-		return -1;
-	rep->pool_desc = Strdup(repset->remote->pool_desc);
-	if (rep->pool_desc == NULL) {
-		Free(rep->node_addr);
-		return -1;
-	}
+	memset(dest, c, len);
+	nopmem_flush(dest, len);
+	return dest;
+}
 
-	rep->rpp = repset->remote->rpp;
+/*
+ * obj_remote_persist -- (internal) remote persist function
+ */
+static void *
+obj_remote_persist(PMEMobjpool *pop, const void *addr, size_t len,
+			unsigned lane)
+{
+	LOG(15, "pop %p addr %p len %zu lane %u", pop, addr, len, lane);
 
-	/* pop_desc - beginning of the pool's descriptor */
-	rep->remote_base = (uintptr_t)rep->addr + sizeof(struct pool_hdr);
+	ASSERTne(pop->rpp, NULL);
 
-	/* init hooks */
-	rep->persist_remote = obj_remote_persist;
-	rep->persist_local = NULL;
-	rep->flush_local = NULL;
-	rep->drain_local = NULL;
-	rep->memcpy_persist_local = NULL;
-	rep->memset_persist_local = NULL;
+	/*
+	 * The pool header is not visible on remote node from the local host
+	 * perspective. It means the pool descriptor is at offset 0
+	 * on remote node.
+	 */
+	uintptr_t offset = (uintptr_t)addr - pop->remote_base;
 
-	rep->p_ops.remote.read = obj_read_remote;
-	rep->p_ops.remote.ctx = rep->rpp;
-	rep->p_ops.remote.base = rep->remote_base;
+	int rv = Rpmem_persist(pop->rpp, offset, len, lane);
+	if (rv) {
+		ERR("!rpmem_persist(rpp %p offset %zu length %zu lane %u)"
+			" FATAL ERROR (returned value %i)",
+			pop->rpp, offset, len, lane, rv);
+		return NULL;
+	}
 
-	return 0;
+	return (void *)addr;
 }
 
 /*
- * redo_log_check_offset -- (internal) check if offset is valid
+ * XXX - Consider removing obj_norep_*() wrappers to call *_local()
+ * functions directly.  Alternatively, always use obj_rep_*(), even
+ * if there are no replicas.  Verify the performance penalty.
  */
-static int
-redo_log_check_offset(void *ctx, uint64_t offset)
+
+/*
+ * obj_norep_memcpy_persist -- (internal) memcpy w/o replication
+ */
+static void *
+obj_norep_memcpy_persist(void *ctx, void *dest, const void *src,
+	size_t len)
 {
 	PMEMobjpool *pop = ctx;
-	return OBJ_OFF_IS_VALID(pop, offset);
+	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+
+	return pop->memcpy_persist_local(dest, src, len);
 }
 
 /*
- * pmemobj_replica_init -- (internal) initialize runtime part of the replica
+ * obj_norep_memset_persist -- (internal) memset w/o replication
  */
-static int
-pmemobj_replica_init(PMEMobjpool *rep, struct pool_set *set, unsigned repidx,
-			int create)
+static void *
+obj_norep_memset_persist(void *ctx, void *dest, int c, size_t len)
 {
-	struct pool_replica *repset = set->replica[repidx];
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
 
-	if (repidx == 0) {
-		/* master replica */
-		rep->is_master_replica = 1;
-		rep->has_remote_replicas = set->remote;
+	return pop->memset_persist_local(dest, c, len);
+}
 
-		if (set->nreplicas > 1) {
-			rep->p_ops.persist = obj_rep_persist;
-			rep->p_ops.flush = obj_rep_flush;
-			rep->p_ops.drain = obj_rep_drain;
-			rep->p_ops.memcpy_persist = obj_rep_memcpy_persist;
-			rep->p_ops.memset_persist = obj_rep_memset_persist;
-		} else {
-			rep->p_ops.persist = obj_norep_persist;
-			rep->p_ops.flush = obj_norep_flush;
-			rep->p_ops.drain = obj_norep_drain;
-			rep->p_ops.memcpy_persist = obj_norep_memcpy_persist;
-			rep->p_ops.memset_persist = obj_norep_memset_persist;
-		}
-		rep->p_ops.base = rep;
-		rep->p_ops.pool_size = rep->size;
-	} else {
-		/* non-master replicas */
-		rep->is_master_replica = 0;
-		rep->has_remote_replicas = 0;
-
-		rep->p_ops.persist = NULL;
-		rep->p_ops.flush = NULL;
-		rep->p_ops.drain = NULL;
-		rep->p_ops.memcpy_persist = NULL;
-		rep->p_ops.memset_persist = NULL;
-
-		rep->p_ops.base = NULL;
-		rep->p_ops.pool_size = 0;
-	}
+/*
+ * obj_norep_persist -- (internal) persist w/o replication
+ */
+static void
+obj_norep_persist(void *ctx, const void *addr, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
 
-	int ret;
-	if (repset->remote)
-		ret = pmemobj_replica_init_remote(rep, set, repidx, create);
-	else
-		ret = pmemobj_replica_init_local(rep, repset->is_pmem);
-	if (ret)
-		return ret;
+	pop->persist_local(addr, len);
+}
 
-	rep->redo = redo_log_config_new(rep->addr, &rep->p_ops,
-			redo_log_check_offset, rep, REDO_NUM_ENTRIES);
-	if (!rep->redo)
-		return -1;
+/*
+ * obj_norep_flush -- (internal) flush w/o replication
+ */
+static void
+obj_norep_flush(void *ctx, const void *addr, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
 
-	return 0;
+	pop->flush_local(addr, len);
 }
 
 /*
- * pmemobj_runtime_init -- (internal) initialize runtime part of the pool header
+ * obj_norep_drain -- (internal) drain w/o replication
  */
-static int
-pmemobj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
+static void
+obj_norep_drain(void *ctx)
 {
-	LOG(3, "pop %p rdonly %d boot %d", pop, rdonly, boot);
-	struct pmem_ops *p_ops = &pop->p_ops;
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p", pop);
 
-	/* run_id is made unique by incrementing the previous value */
-	pop->run_id += 2;
-	if (pop->run_id == 0)
-		pop->run_id += 2;
-	pmemops_persist(p_ops, &pop->run_id, sizeof(pop->run_id));
+	pop->drain_local();
+}
 
-	/*
-	 * Use some of the memory pool area for run-time info.  This
-	 * run-time state is never loaded from the file, it is always
-	 * created here, so no need to worry about byte-order.
-	 */
-	pop->rdonly = rdonly;
+/*
+ * Flush and fence counts are gathered in a number of per-CPU slots, so
+ * that the threads flushing don't contend on them.  When they are enabled,
+ * the pmem_ops of the master replica count what is passed to them and call
+ * the ones they replaced.
+ */
+#define OBJ_PERSIST_STATS_SLOTS 64 /* must be a power of two */
+#define OBJ_PERSIST_STATS_LINE ((uintptr_t)64) /* granularity of flushes */
 
-	pop->uuid_lo = pmemobj_get_uuid_lo(pop);
+struct obj_persist_stats {
+	struct pmem_ops ops; /* the counted operations */
+	struct {
+		struct pobj_persist_stats op[POBJ_PERSIST_OPS];
+	} slots[OBJ_PERSIST_STATS_SLOTS];
+};
 
-	pop->lanes_desc.runtime_nlanes = nlanes;
+static int Obj_persist_stats_enabled;
 
-	if (boot) {
-		if ((errno = pmemobj_boot(pop)) != 0)
-			return -1;
+/*
+ * obj_persist_stats_init -- (internal) enables the flush and fence counts of
+ *	the pools opened or created from now on, if the given environment
+ *	variable is set to 1
+ */
+static void
+obj_persist_stats_init(const char *stats_var)
+{
+	char *e = getenv(stats_var);
+	if (e == NULL)
+		return;
 
-#ifdef USE_VG_MEMCHECK
-		if (On_valgrind) {
-			/* mark unused part of the pool as not accessible */
-			void *end = palloc_heap_end(&pop->heap);
-			VALGRIND_DO_MAKE_MEM_NOACCESS(end,
-					(void *)pop + pop->size - end);
-		}
-#endif
+	int val = atoi(e);
+	if (val != 0 && val != 1) {
+		LOG(2, "Invalid %s", stats_var);
+	} else {
+		Obj_persist_stats_enabled = val;
+		LOG(3, "%s set to %d", stats_var, Obj_persist_stats_enabled);
+	}
+}
 
-		obj_pool_init();
+/*
+ * obj_persist_stats_slot -- (internal) returns the counts of the operation
+ *	the thread is in, in the slot of the CPU it is running on
+ */
+static inline struct pobj_persist_stats *
+obj_persist_stats_slot(PMEMobjpool *pop)
+{
+	COMPILE_ERROR_ON((int)POBJ_PERSIST_ALLOC != LANE_SECTION_ALLOCATOR);
+	COMPILE_ERROR_ON((int)POBJ_PERSIST_LIST != LANE_SECTION_LIST);
+	COMPILE_ERROR_ON((int)POBJ_PERSIST_TX != LANE_SECTION_TRANSACTION);
+	COMPILE_ERROR_ON((int)POBJ_PERSIST_OTHER != LANE_ID);
 
-		if ((errno = cuckoo_insert(pools_ht, pop->uuid_lo, pop)) != 0) {
-			ERR("!cuckoo_insert");
-			return -1;
-		}
+	int cpu = sched_getcpu();
+	unsigned slot = (unsigned)(cpu < 0 ? 0 : cpu) &
+		(OBJ_PERSIST_STATS_SLOTS - 1);
 
-		if ((errno = ctree_insert(pools_tree, (uint64_t)pop, pop->size))
-				!= 0) {
-			ERR("!ctree_insert");
-			return -1;
-		}
-	}
+	return &pop->persist_stats->slots[slot].op[lane_held_section()];
+}
 
-	/*
-	 * If possible, turn off all permissions on the pool header page.
-	 *
-	 * The prototype PMFS doesn't allow this when large pages are in
-	 * use. It is not considered an error if this fails.
-	 */
-	util_range_none(pop->addr, sizeof(struct pool_hdr));
+/*
+ * obj_persist_stats_flush -- (internal) counts a flush of the given range
+ */
+static inline void
+obj_persist_stats_flush(struct pobj_persist_stats *stats, const void *addr,
+	size_t len)
+{
+	uintptr_t start = (uintptr_t)addr & ~(OBJ_PERSIST_STATS_LINE - 1);
+	uintptr_t end = ((uintptr_t)addr + len + OBJ_PERSIST_STATS_LINE - 1) &
+		~(OBJ_PERSIST_STATS_LINE - 1);
 
-	return 0;
+	__sync_fetch_and_add(&stats->flushes, 1);
+	__sync_fetch_and_add(&stats->flushed_lines,
+		(end - start) / OBJ_PERSIST_STATS_LINE);
 }
 
 /*
- * pmemobj_cleanup_remote -- (internal) clean up the remote pools data
+ * obj_stats_persist -- (internal) counted persist
  */
 static void
-pmemobj_cleanup_remote(PMEMobjpool *pop)
+obj_stats_persist(void *ctx, const void *addr, size_t len)
 {
-	LOG(3, "pop %p", pop);
+	PMEMobjpool *pop = ctx;
+	struct pobj_persist_stats *stats = obj_persist_stats_slot(pop);
 
-	for (; pop != NULL; pop = pop->replica) {
-		if (pop->rpp != NULL) {
-			Free(pop->node_addr);
-			Free(pop->pool_desc);
-			pop->rpp = NULL;
-		}
-	}
+	obj_persist_stats_flush(stats, addr, len);
+	__sync_fetch_and_add(&stats->fences, 1);
+
+	pop->persist_stats->ops.persist(ctx, addr, len);
 }
 
 /*
- * pmemobj_create -- create a transactional memory pool (set)
+ * obj_stats_flush -- (internal) counted flush
  */
-PMEMobjpool *
-pmemobj_create(const char *path, const char *layout, size_t poolsize,
-		mode_t mode)
+static void
+obj_stats_flush(void *ctx, const void *addr, size_t len)
 {
-	LOG(3, "path %s layout %s poolsize %zu mode %o",
-			path, layout, poolsize, mode);
+	PMEMobjpool *pop = ctx;
 
-	PMEMobjpool *pop;
-	struct pool_set *set;
+	obj_persist_stats_flush(obj_persist_stats_slot(pop), addr, len);
 
-	/* check length of layout */
-	if (layout && (strlen(layout) >= PMEMOBJ_MAX_LAYOUT)) {
-		ERR("Layout too long");
-		errno = EINVAL;
-		return NULL;
-	}
+	pop->persist_stats->ops.flush(ctx, addr, len);
+}
 
-	/*
-	 * A number of lanes available at runtime equals the lowest value
-	 * from all reported by remote replicas hosts. In the single host mode
-	 * the runtime number of lanes is equal to the total number of lanes
-	 * available in the pool.
-	 */
-	unsigned runtime_nlanes = OBJ_NLANES;
+/*
+ * obj_stats_drain -- (internal) counted drain
+ */
+static void
+obj_stats_drain(void *ctx)
+{
+	PMEMobjpool *pop = ctx;
 
-	if (util_pool_create(&set, path, poolsize, PMEMOBJ_MIN_POOL,
-			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
-			OBJ_FORMAT_COMPAT, OBJ_FORMAT_INCOMPAT,
-			OBJ_FORMAT_RO_COMPAT, &runtime_nlanes) != 0) {
-		LOG(2, "cannot create pool or pool set");
-		return NULL;
-	}
+	__sync_fetch_and_add(&obj_persist_stats_slot(pop)->fences, 1);
 
-	ASSERT(set->nreplicas > 0);
+	pop->persist_stats->ops.drain(ctx);
+}
 
-	/* pop is master replica from now on */
-	pop = set->replica[0]->part[0].addr;
+/*
+ * obj_stats_memcpy_persist -- (internal) counted memcpy
+ */
+static void *
+obj_stats_memcpy_persist(void *ctx, void *dest, const void *src, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	struct pobj_persist_stats *stats = obj_persist_stats_slot(pop);
 
-	for (unsigned r = 0; r < set->nreplicas; r++) {
-		struct pool_replica *repset = set->replica[r];
-		PMEMobjpool *rep = repset->part[0].addr;
+	__sync_fetch_and_add(&stats->copied_bytes, len);
+	__sync_fetch_and_add(&stats->fences, 1);
 
-		size_t rt_size = (uintptr_t)(rep + 1) - (uintptr_t)&rep->addr;
-		VALGRIND_REMOVE_PMEM_MAPPING(&rep->addr, rt_size);
+	return pop->persist_stats->ops.memcpy_persist(ctx, dest, src, len);
+}
 
-		memset(&rep->addr, 0, rt_size);
+/*
+ * obj_stats_memset_persist -- (internal) counted memset
+ */
+static void *
+obj_stats_memset_persist(void *ctx, void *dest, int c, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	struct pobj_persist_stats *stats = obj_persist_stats_slot(pop);
 
-		rep->addr = rep;
-		rep->size = repset->repsize;
-		rep->replica = NULL;
-		rep->rpp = NULL;
+	__sync_fetch_and_add(&stats->copied_bytes, len);
+	__sync_fetch_and_add(&stats->fences, 1);
 
-		/* initialize replica runtime - is_pmem, funcs, ... */
-		if (pmemobj_replica_init(rep, set, r, 1 /* create */) != 0) {
-			ERR("initialization of replica #%u failed", r);
-			goto err;
-		}
+	return pop->persist_stats->ops.memset_persist(ctx, dest, c, len);
+}
 
-		/* link replicas */
-		if (r < set->nreplicas - 1)
-			rep->replica = set->replica[r + 1]->part[0].addr;
+/*
+ * obj_persist_stats_boot -- (internal) makes the pmem_ops of the master
+ *	replica count the flushes and fences
+ */
+static int
+obj_persist_stats_boot(PMEMobjpool *rep)
+{
+	rep->persist_stats = Zalloc(sizeof(struct obj_persist_stats));
+	if (rep->persist_stats == NULL) {
+		ERR("!Zalloc for persist stats");
+		return -1;
 	}
 
-	pop->set = set;
-
-	/* create pool descriptor */
-	if (pmemobj_descr_create(pop, layout, set->poolsize) != 0) {
-		LOG(2, "creation of pool descriptor failed");
-		goto err;
-	}
+	rep->persist_stats->ops = rep->p_ops;
 
-	/* initialize runtime parts - lanes, obj stores, ... */
-	if (pmemobj_runtime_init(pop, 0, 1 /* boot */,
-					runtime_nlanes) != 0) {
-		ERR("pool initialization failed");
-		goto err;
-	}
+	rep->p_ops.persist = obj_stats_persist;
+	rep->p_ops.flush = obj_stats_flush;
+	rep->p_ops.drain = obj_stats_drain;
+	rep->p_ops.memcpy_persist = obj_stats_memcpy_persist;
+	rep->p_ops.memset_persist = obj_stats_memset_persist;
 
-	if (util_poolset_chmod(set, mode))
-		goto err;
+	return 0;
+}
 
-	LOG(3, "pop %p", pop);
+/*
+ * obj_persist_stats_get -- (internal) sums up the per-CPU flush and fence
+ *	counts of the pool
+ */
+static int
+obj_persist_stats_get(PMEMobjpool *pop,
+	struct pobj_persist_stats stats[POBJ_PERSIST_OPS])
+{
+	struct obj_persist_stats *ps = pop->persist_stats;
+	if (ps == NULL)
+		return -1;
 
-	return pop;
+	memset(stats, 0, sizeof(*stats) * POBJ_PERSIST_OPS);
+	for (unsigned i = 0; i < OBJ_PERSIST_STATS_SLOTS; ++i) {
+		for (int op = 0; op < POBJ_PERSIST_OPS; ++op) {
+			struct pobj_persist_stats *s = &ps->slots[i].op[op];
+			stats[op].flushes += s->flushes;
+			stats[op].flushed_lines += s->flushed_lines;
+			stats[op].fences += s->fences;
+			stats[op].copied_bytes += s->copied_bytes;
+		}
+	}
 
-err:
-	LOG(4, "error clean up");
-	int oerrno = errno;
-	if (set->remote)
-		pmemobj_cleanup_remote(pop);
-	util_poolset_close(set, 1);
-	errno = oerrno;
-	return NULL;
+	return 0;
 }
 
 /*
- * pmemobj_check_basic_local -- (internal) basic pool consistency check
- *                              of a local replica
+ * obj_persist_stats_fini -- (internal) logs and frees the flush and fence
+ *	counts of the pool
  */
-static int
-pmemobj_check_basic_local(PMEMobjpool *pop)
+static void
+obj_persist_stats_fini(PMEMobjpool *pop)
 {
-	LOG(3, "pop %p", pop);
+	static const char *names[POBJ_PERSIST_OPS] = {
+		"alloc", "list", "tx", "other"
+	};
 
-	ASSERTeq(pop->rpp, NULL);
+	struct pobj_persist_stats stats[POBJ_PERSIST_OPS];
+	if (obj_persist_stats_get(pop, stats) != 0)
+		return;
 
-	int consistent = 1;
+	for (int op = 0; op < POBJ_PERSIST_OPS; ++op) {
+		LOG(3, "%s: flushes %" PRIu64 " lines %" PRIu64
+			" fences %" PRIu64 " copied %" PRIu64, names[op],
+			stats[op].flushes, stats[op].flushed_lines,
+			stats[op].fences, stats[op].copied_bytes);
+	}
 
-	if (pop->run_id % 2) {
-		ERR("invalid run_id %ju", pop->run_id);
+	Free(pop->persist_stats);
+	pop->persist_stats = NULL;
+}
+
+static void obj_pool_cleanup(PMEMobjpool *pop);
+static void obj_type_index_delete(PMEMobjpool *pop);
+
+/*
+ * obj_handle_remote_persist_error -- (internal) handle remote persist
+ *                                    fatal error
+ */
+static void
+obj_handle_remote_persist_error(PMEMobjpool *pop)
+{
+	LOG(1, "pop %p", pop);
+
+	ERR("error clean up...");
+	obj_pool_cleanup(pop);
+
+	FATAL("Fatal error of remote persist. Aborting...");
+}
+
+/*
+ * obj_rep_resync_shift -- (internal) returns log2 of the chunk size which
+ *	lets the map of chunks to resynchronize cover the whole pool
+ */
+static uint64_t
+obj_rep_resync_shift(PMEMobjpool *pop)
+{
+	uint64_t shift = OBJ_RESYNC_MIN_SHIFT;
+	while ((pop->size >> shift) >= OBJ_RESYNC_MAP_WORDS * 64)
+		shift++;
+
+	return shift;
+}
+
+/*
+ * obj_rep_mark_dirty -- (internal) records the chunks of the range in the
+ *	map of chunks to resynchronize
+ *
+ * Each word of the map is persisted when a bit is set in it for the first
+ * time, before the operation writing the range returns.
+ */
+static void
+obj_rep_mark_dirty(PMEMobjpool *pop, uintptr_t off, size_t len)
+{
+	uint64_t shift = pop->resync_shift;
+	ASSERTne(shift, 0);
+
+	if (len == 0)
+		return;
+
+	uint64_t first = off >> shift;
+	uint64_t last = (off + len - 1) >> shift;
+	ASSERT(last < OBJ_RESYNC_MAP_WORDS * 64);
+
+	for (uint64_t c = first; c <= last; ++c) {
+		uint64_t *word = &pop->resync_map[c / 64];
+		uint64_t bit = 1ULL << (c % 64);
+		if (*word & bit)
+			continue;
+
+		__sync_fetch_and_or(word, bit);
+		pop->persist_local(word, sizeof(*word));
+	}
+}
+
+/*
+ * obj_rep_degrade -- (internal) stops writing to the remote replica which
+ *	failed to persist, the chunks it misses from now on are recorded
+ */
+static void
+obj_rep_degrade(PMEMobjpool *pop, PMEMobjpool *rep)
+{
+	LOG(3, "pop %p rep %p", pop, rep);
+
+	if (!Rep_resync)
+		obj_handle_remote_persist_error(pop);
+
+	ERR("remote replica %s degraded", rep->node_addr);
+
+	/* the map must be in use before anything is skipped */
+	uint64_t shift = obj_rep_resync_shift(pop);
+	if (__sync_bool_compare_and_swap(&pop->resync_shift, 0, shift))
+		pop->persist_local(&pop->resync_shift,
+				sizeof(pop->resync_shift));
+
+	rep->degraded = 1;
+	__sync_synchronize();
+}
+
+/*
+ * obj_rep_remote_persist -- (internal) persists the range on the remote
+ *	replica, or records it for resynchronization if the replica is degraded
+ */
+static void
+obj_rep_remote_persist(PMEMobjpool *pop, PMEMobjpool *rep, void *raddr,
+	size_t len, unsigned lane)
+{
+	if (likely(!rep->degraded)) {
+		if (likely(rep->persist_remote(rep, raddr, len, lane) != NULL))
+			return;
+
+		obj_rep_degrade(pop, rep);
+	}
+
+	obj_rep_mark_dirty(pop, (uintptr_t)raddr - (uintptr_t)rep, len);
+}
+
+/*
+ * obj_rep_resync -- (internal) writes the chunks recorded while a remote
+ *	replica was degraded to all the remote replicas and clears the map
+ */
+static int
+obj_rep_resync(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p shift %ju", pop, pop->resync_shift);
+
+	uint64_t shift = pop->resync_shift;
+	if (shift < OBJ_RESYNC_MIN_SHIFT || shift >= 64) {
+		ERR("invalid chunk size of the resync map: %ju", shift);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the pool header is not replicated to the remote nodes */
+	const uintptr_t hdr_size = sizeof(struct pool_hdr);
+	const uint64_t nchunks = OBJ_RESYNC_MAP_WORDS * 64;
+
+	for (PMEMobjpool *rep = pop->replica; rep; rep = rep->replica) {
+		if (rep->rpp == NULL)
+			continue;
+
+		uintptr_t start = 0;
+		uintptr_t end = 0;
+		for (uint64_t c = 0; c <= nchunks; ++c) {
+			int dirty = c < nchunks &&
+				(pop->resync_map[c / 64] & (1ULL << (c % 64)));
+			uintptr_t cstart = c << shift;
+			uintptr_t cend = (c + 1) << shift;
+
+			/* extend the pending range with the adjacent chunk */
+			if (dirty && end == cstart &&
+					cend - start <= REP_RESYNC_MAX_WRITE) {
+				end = cend;
+				continue;
+			}
+
+			if (end > pop->size)
+				end = pop->size;
+			if (start < hdr_size)
+				start = hdr_size;
+			if (start < end && Rpmem_flush(rep->rpp,
+					start - hdr_size, end - start,
+					RLANE_DEFAULT)) {
+				ERR("!rpmem_flush(rpp %p offset %zu length %zu)",
+					rep->rpp, start - hdr_size,
+					end - start);
+				return -1;
+			}
+
+			start = cstart;
+			end = dirty ? cend : cstart;
+		}
+
+		if (Rpmem_drain(rep->rpp, RLANE_DEFAULT)) {
+			ERR("!rpmem_drain(rpp %p)", rep->rpp);
+			return -1;
+		}
+	}
+
+	memset(pop->resync_map, 0, sizeof(pop->resync_map));
+	pop->persist_local(pop->resync_map, sizeof(pop->resync_map));
+
+	pop->resync_shift = 0;
+	pop->persist_local(&pop->resync_shift, sizeof(pop->resync_shift));
+
+	/* the remote replicas got a copy of the map with the chunks */
+	for (PMEMobjpool *rep = pop->replica; rep; rep = rep->replica) {
+		if (rep->rpp == NULL)
+			continue;
+
+		obj_rep_remote_persist(pop, rep, &rep->resync_shift,
+			sizeof(rep->resync_shift) + sizeof(rep->resync_map),
+			RLANE_DEFAULT);
+	}
+
+	return 0;
+}
+
+/*
+ * obj_rep_persist_remote -- (internal) persist the range on all remote
+ *                           replicas
+ */
+static void
+obj_rep_persist_remote(PMEMobjpool *pop, const void *addr, size_t len,
+	unsigned lane)
+{
+	LOG(15, "pop %p addr %p len %zu lane %u", pop, addr, len, lane);
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		if (rep->rpp != NULL) {
+			void *raddr = (char *)rep + (uintptr_t)addr -
+					(uintptr_t)pop;
+			obj_rep_remote_persist(pop, rep, raddr, len, lane);
+		}
+		rep = rep->replica;
+	}
+}
+
+static void obj_rep_drain(void *ctx);
+
+/*
+ * obj_rep_windowed -- (internal) checks if the replicas of the pool are
+ *	written through the per-thread windows of dirty ranges
+ *
+ * The windows are kept in the lane info records of the threads, so they are
+ * used only while the lanes of the pool exist.
+ */
+static inline int
+obj_rep_windowed(PMEMobjpool *pop)
+{
+	return Rep_window != 0 && pop->lanes_desc.lane != NULL;
+}
+
+/*
+ * obj_rep_window_ship -- (internal) writes the dirty ranges of the window
+ *	to all the replicas, without draining the local ones
+ */
+static void
+obj_rep_window_ship(PMEMobjpool *pop, struct lane_dirty_window *w)
+{
+	LOG(15, "pop %p nranges %u", pop, w->nranges);
+
+	if (w->nranges == 0)
+		return;
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas) {
+		/* remote replicas read the data from the master replica */
+		pop->drain_local();
+		lane = lane_hold(pop, NULL, LANE_ID);
+	}
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		for (unsigned i = 0; i < w->nranges; ++i) {
+			void *addr = (void *)w->ranges[i].start;
+			size_t len = w->ranges[i].end - w->ranges[i].start;
+			void *raddr = (char *)rep + (uintptr_t)addr -
+					(uintptr_t)pop;
+			if (rep->rpp == NULL) {
+				rep->memcpy_nodrain_local(raddr, addr, len);
+			} else {
+				obj_rep_remote_persist(pop, rep, raddr, len,
+						lane);
+			}
+		}
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas)
+		lane_release(pop);
+
+	w->nranges = 0;
+}
+
+/*
+ * obj_rep_window_add -- (internal) adds the range, extended to whole cache
+ *	lines, to the window of the thread, merging it with all the ranges
+ *	it overlaps or touches
+ *
+ * A full window is written to the replicas right away.
+ */
+static void
+obj_rep_window_add(PMEMobjpool *pop, const void *addr, size_t len)
+{
+	struct lane_dirty_window *w = lane_dirty_window(pop);
+
+	uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(REP_WINDOW_ALIGN - 1);
+	uintptr_t end = ((uintptr_t)addr + len + REP_WINDOW_ALIGN - 1) &
+			~(uintptr_t)(REP_WINDOW_ALIGN - 1);
+
+	unsigned i = 0;
+	while (i < w->nranges) {
+		struct lane_dirty_range *r = &w->ranges[i];
+		if (r->start > end || r->end < start) {
+			i++;
+			continue;
+		}
+
+		/* absorb the range, it may now touch the checked ones */
+		if (r->start < start)
+			start = r->start;
+		if (r->end > end)
+			end = r->end;
+		*r = w->ranges[--w->nranges];
+		i = 0;
+	}
+
+	ASSERT(w->nranges < Rep_window);
+	w->ranges[w->nranges].start = start;
+	w->ranges[w->nranges].end = end;
+
+	if (++w->nranges == Rep_window)
+		obj_rep_window_ship(pop, w);
+}
+
+/*
+ * The obj_rep_*_persist() functions fan the modification out to all replicas
+ * before waiting for any of them: the local replicas are written and flushed
+ * without a drain, the (synchronous) remote persists are issued while those
+ * write-backs are still in flight and a single drain at the end completes
+ * the local part.  This makes the latency of a persist close to that of
+ * the slowest replica rather than the sum over all of them.
+ *
+ * Remote replicas read the data from the master replica, so if there are
+ * any, the master replica is drained before the remote persists are issued
+ * (non-temporal stores are not guaranteed to be visible to the RNIC earlier).
+ *
+ * If the replication window is enabled, the modified range is merged with
+ * the ranges flushed by the thread since its last drain instead, and all of
+ * them are written to the replicas at once.
+ */
+
+/*
+ * obj_rep_memcpy_persist -- (internal) memcpy with replication
+ */
+static void *
+obj_rep_memcpy_persist(void *ctx, void *dest, const void *src,
+	size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+
+	if (obj_rep_windowed(pop)) {
+		void *ret = pop->memcpy_nodrain_local(dest, src, len);
+		obj_rep_window_add(pop, dest, len);
+		obj_rep_drain(pop);
+		return ret;
+	}
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	void *ret = pop->memcpy_nodrain_local(dest, src, len);
+	if (pop->has_remote_replicas)
+		pop->drain_local();
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
+		if (rep->rpp == NULL)
+			rep->memcpy_nodrain_local(rdest, src, len);
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas) {
+		obj_rep_persist_remote(pop, dest, len, lane);
+		lane_release(pop);
+	}
+
+	obj_rep_drain(pop);
+
+	return ret;
+}
+
+/*
+ * obj_rep_memset_persist -- (internal) memset with replication
+ */
+static void *
+obj_rep_memset_persist(void *ctx, void *dest, int c, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
+
+	if (obj_rep_windowed(pop)) {
+		void *ret = pop->memset_nodrain_local(dest, c, len);
+		obj_rep_window_add(pop, dest, len);
+		obj_rep_drain(pop);
+		return ret;
+	}
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	void *ret = pop->memset_nodrain_local(dest, c, len);
+	if (pop->has_remote_replicas)
+		pop->drain_local();
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
+		if (rep->rpp == NULL)
+			rep->memset_nodrain_local(rdest, c, len);
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas) {
+		obj_rep_persist_remote(pop, dest, len, lane);
+		lane_release(pop);
+	}
+
+	obj_rep_drain(pop);
+
+	return ret;
+}
+
+/*
+ * obj_rep_persist -- (internal) persist with replication
+ */
+static void
+obj_rep_persist(void *ctx, const void *addr, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+
+	if (obj_rep_windowed(pop)) {
+		pop->flush_local(addr, len);
+		obj_rep_window_add(pop, addr, len);
+		obj_rep_drain(pop);
+		return;
+	}
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	pop->flush_local(addr, len);
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
+		if (rep->rpp == NULL)
+			rep->memcpy_nodrain_local(raddr, addr, len);
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas) {
+		obj_rep_persist_remote(pop, addr, len, lane);
+		lane_release(pop);
+	}
+
+	obj_rep_drain(pop);
+}
+
+/*
+ * obj_rep_flush -- (internal) flush with replication
+ */
+static void
+obj_rep_flush(void *ctx, const void *addr, size_t len)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+
+	if (obj_rep_windowed(pop)) {
+		pop->flush_local(addr, len);
+		obj_rep_window_add(pop, addr, len);
+		return;
+	}
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	pop->flush_local(addr, len);
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *raddr = (char *)rep + (uintptr_t)addr - (uintptr_t)pop;
+		if (rep->rpp == NULL) {
+			memcpy(raddr, addr, len);
+			rep->flush_local(raddr, len);
+		} else {
+			obj_rep_remote_persist(pop, rep, raddr, len, lane);
+		}
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas)
+		lane_release(pop);
+}
+
+/*
+ * obj_rep_drain -- (internal) drain with replication
+ */
+static void
+obj_rep_drain(void *ctx)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p", pop);
+
+	pop->drain_local();
+
+	if (obj_rep_windowed(pop))
+		obj_rep_window_ship(pop, lane_dirty_window(pop));
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		if (rep->rpp == NULL)
+			rep->drain_local();
+		rep = rep->replica;
+	}
+}
+
+#ifdef USE_VG_MEMCHECK
+/*
+ * Arbitrary value. When there's more undefined regions than MAX_UNDEFS, it's
+ * not worth reporting everything - developer should fix the code.
+ */
+#define MAX_UNDEFS 1000
+
+/*
+ * pmemobj_vg_check_no_undef -- (internal) check whether there are any undefined
+ *				regions
+ */
+static void
+pmemobj_vg_check_no_undef(struct pmemobjpool *pop)
+{
+	LOG(4, "pop %p", pop);
+
+	struct {
+		void *start, *end;
+	} undefs[MAX_UNDEFS];
+	int num_undefs = 0;
+
+	VALGRIND_DO_DISABLE_ERROR_REPORTING;
+	char *addr_start = pop->addr;
+	char *addr_end = addr_start + pop->size;
+
+	while (addr_start < addr_end) {
+		char *noaccess = (char *)VALGRIND_CHECK_MEM_IS_ADDRESSABLE(
+					addr_start, addr_end - addr_start);
+		if (noaccess == NULL)
+			noaccess = addr_end;
+
+		while (addr_start < noaccess) {
+			char *undefined =
+				(char *)VALGRIND_CHECK_MEM_IS_DEFINED(
+					addr_start, noaccess - addr_start);
+
+			if (undefined) {
+				addr_start = undefined;
+
+#ifdef VALGRIND_CHECK_MEM_IS_UNDEFINED
+				addr_start = (char *)
+					VALGRIND_CHECK_MEM_IS_UNDEFINED(
+					addr_start, noaccess - addr_start);
+				if (addr_start == NULL)
+					addr_start = noaccess;
+#else
+				while (addr_start < noaccess &&
+						VALGRIND_CHECK_MEM_IS_DEFINED(
+								addr_start, 1))
+					addr_start++;
+#endif
+
+				if (num_undefs < MAX_UNDEFS) {
+					undefs[num_undefs].start = undefined;
+					undefs[num_undefs].end = addr_start - 1;
+					num_undefs++;
+				}
+			} else
+				addr_start = noaccess;
+		}
+
+#ifdef VALGRIND_CHECK_MEM_IS_UNADDRESSABLE
+		addr_start = (char *)VALGRIND_CHECK_MEM_IS_UNADDRESSABLE(
+				addr_start, addr_end - addr_start);
+		if (addr_start == NULL)
+			addr_start = addr_end;
+#else
+		while (addr_start < addr_end &&
+				(char *)VALGRIND_CHECK_MEM_IS_ADDRESSABLE(
+						addr_start, 1) == addr_start)
+			addr_start++;
+#endif
+	}
+	VALGRIND_DO_ENABLE_ERROR_REPORTING;
+
+	if (num_undefs) {
+		/*
+		 * How to resolve this error:
+		 * If it's part of the free space Valgrind should be told about
+		 * it by VALGRIND_DO_MAKE_MEM_NOACCESS request. If it's
+		 * allocated - initialize it or use VALGRIND_DO_MAKE_MEM_DEFINED
+		 * request.
+		 */
+
+		VALGRIND_PRINTF("Part of the pool is left in undefined state on"
+				" boot. This is pmemobj's bug.\nUndefined"
+				" regions:\n");
+		for (int i = 0; i < num_undefs; ++i)
+			VALGRIND_PRINTF("   [%p, %p]\n", undefs[i].start,
+					undefs[i].end);
+		if (num_undefs == MAX_UNDEFS)
+			VALGRIND_PRINTF("   ...\n");
+
+		/* Trigger error. */
+		VALGRIND_CHECK_MEM_IS_DEFINED(undefs[0].start, 1);
+	}
+}
+
+/*
+ * pmemobj_vg_boot -- (internal) notify Valgrind about pool objects
+ */
+static void
+pmemobj_vg_boot(struct pmemobjpool *pop)
+{
+	if (!On_valgrind)
+		return;
+	LOG(4, "pop %p", pop);
+
+	PMEMoid oid;
+	size_t rs = pmemobj_root_size(pop);
+	if (rs) {
+		oid = pmemobj_root(pop, rs);
+		palloc_vg_register_object(&pop->heap, oid,
+				pmemobj_root_size(pop));
+	}
+
+	for (oid = pmemobj_first(pop);
+			!OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+		palloc_vg_register_object(&pop->heap, oid,
+				pmemobj_alloc_usable_size(oid));
+	}
+
+	if (getenv("PMEMOBJ_VG_CHECK_UNDEF"))
+		pmemobj_vg_check_no_undef(pop);
+}
+
+#endif
+
+/*
+ * pmemobj_boot -- (internal) boots the pmemobj pool
+ */
+static int
+pmemobj_boot(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	if ((errno = lane_boot(pop)) != 0) {
+		ERR("!lane_boot");
+		return errno;
+	}
+
+	if ((errno = lane_recover_and_section_boot(pop)) != 0) {
+		ERR("!lane_recover_and_section_boot");
+		return errno;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_descr_create -- (internal) create obj pool descriptor
+ */
+static int
+pmemobj_descr_create(PMEMobjpool *pop, const char *layout, size_t poolsize)
+{
+	LOG(3, "pop %p layout %s poolsize %zu", pop, layout, poolsize);
+
+	ASSERTeq(poolsize % Pagesize, 0);
+
+	/* opaque info lives at the beginning of mapped memory pool */
+	void *dscp = (void *)((uintptr_t)(&pop->hdr) +
+				sizeof(struct pool_hdr));
+
+	/* create the persistent part of pool's descriptor */
+	memset(dscp, 0, OBJ_DSC_P_SIZE);
+	if (layout)
+		strncpy(pop->layout, layout, PMEMOBJ_MAX_LAYOUT - 1);
+	struct pmem_ops *p_ops = &pop->p_ops;
+
+	/* initialize run_id, it will be incremented later */
+	pop->run_id = 0;
+	pmemops_persist(p_ops, &pop->run_id, sizeof(pop->run_id));
+
+	/* no chunks to resynchronize yet */
+	pop->resync_shift = 0;
+	memset(pop->resync_map, 0, sizeof(pop->resync_map));
+	pmemops_persist(p_ops, &pop->resync_shift, sizeof(pop->resync_shift) +
+			sizeof(pop->resync_map));
+
+	pop->lanes_offset = OBJ_LANES_OFFSET;
+	pop->nlanes = Create_nlanes;
+	pop->root_offset = 0;
+
+	if (pop->lanes_offset + pop->nlanes * sizeof(struct lane_layout)
+			>= poolsize) {
+		ERR("pool too small for %ju lanes", pop->nlanes);
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* zero all lanes */
+	void *lanes_layout = (void *)((uintptr_t)pop + pop->lanes_offset);
+	pmemops_memset_persist(p_ops, lanes_layout, 0,
+				pop->nlanes * sizeof(struct lane_layout));
+
+	pop->heap_offset = pop->lanes_offset +
+		pop->nlanes * sizeof(struct lane_layout);
+	pop->heap_offset = (pop->heap_offset + Pagesize - 1) & ~(Pagesize - 1);
+	pop->heap_size = poolsize - pop->heap_offset;
+
+	/* initialize heap prior to storing the checksum */
+	errno = palloc_init((char *)pop + pop->heap_offset, pop->heap_size,
+			p_ops);
+	if (errno != 0) {
+		ERR("!palloc_init");
+		return -1;
+	}
+
+	util_checksum(dscp, OBJ_DSC_P_SIZE, &pop->checksum, 1);
+
+	/* store the persistent part of pool's descriptor (2kB) */
+	pmemops_persist(p_ops, dscp, OBJ_DSC_P_SIZE);
+
+	return 0;
+}
+
+/*
+ * pmemobj_descr_check -- (internal) validate obj pool descriptor
+ */
+static int
+pmemobj_descr_check(PMEMobjpool *pop, const char *layout, size_t poolsize)
+{
+	LOG(3, "pop %p layout %s poolsize %zu", pop, layout, poolsize);
+
+	void *dscp = (void *)((uintptr_t)(&pop->hdr) + sizeof(struct pool_hdr));
+
+	if (pop->rpp) {
+		/* read remote descriptor */
+		if (obj_read_remote(pop->rpp, pop->remote_base, dscp,
+				dscp, OBJ_DSC_P_SIZE)) {
+			ERR("!obj_read_remote");
+			return -1;
+		}
+
+		/*
+		 * Set size of the replica to the pool size (required minimum).
+		 * This condition is checked while opening the remote pool.
+		 */
+		pop->size = poolsize;
+	}
+
+	if (!util_checksum(dscp, OBJ_DSC_P_SIZE, &pop->checksum, 0)) {
+		ERR("invalid checksum of pool descriptor");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (layout &&
+	    strncmp(pop->layout, layout, PMEMOBJ_MAX_LAYOUT)) {
+		ERR("wrong layout (\"%s\"), "
+			"pool created with layout \"%s\"",
+			layout, pop->layout);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->size < poolsize) {
+		ERR("replica size smaller than pool size: %zu < %zu",
+			pop->size, poolsize);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->heap_offset + pop->heap_size != poolsize) {
+		ERR("heap size does not match pool size: %zu != %zu",
+			pop->heap_offset + pop->heap_size, poolsize);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->heap_offset % Pagesize ||
+	    pop->heap_size % Pagesize) {
+		ERR("unaligned heap: off %ju, size %zu",
+			pop->heap_offset, pop->heap_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->nlanes == 0 || pop->nlanes > OBJ_NLANES_MAX ||
+	    pop->lanes_offset + pop->nlanes * sizeof(struct lane_layout) >
+	    pop->heap_offset) {
+		ERR("invalid number of lanes: %ju", pop->nlanes);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_replica_init_local -- (internal) initialize runtime part
+ *                               of the local replicas
+ */
+static int
+pmemobj_replica_init_local(PMEMobjpool *rep, int is_pmem)
+{
+	LOG(3, "rep %p is_pmem %d", rep, is_pmem);
+
+	/*
+	 * Use some of the memory pool area for run-time info.  This
+	 * run-time state is never loaded from the file, it is always
+	 * created here, so no need to worry about byte-order.
+	 */
+	rep->is_pmem = is_pmem;
+
+	/* init hooks */
+	rep->persist_remote = NULL;
+
+	if (rep->is_pmem) {
+		rep->persist_local = pmem_persist;
+		rep->flush_local = pmem_flush;
+		rep->drain_local = pmem_drain;
+		rep->memcpy_persist_local = pmem_memcpy_persist;
+		rep->memset_persist_local = pmem_memset_persist;
+		rep->memcpy_nodrain_local = pmem_memcpy_nodrain;
+		rep->memset_nodrain_local = pmem_memset_nodrain;
+	} else {
+		rep->persist_local = nopmem_persist;
+		rep->flush_local = nopmem_flush;
+		rep->drain_local = nopmem_drain;
+		rep->memcpy_persist_local = nopmem_memcpy_persist;
+		rep->memset_persist_local = nopmem_memset_persist;
+		rep->memcpy_nodrain_local = nopmem_memcpy_nodrain;
+		rep->memset_nodrain_local = nopmem_memset_nodrain;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_replica_init_remote -- (internal) initialize runtime part
+ *                                of a remote replica
+ */
+static int
+pmemobj_replica_init_remote(PMEMobjpool *rep, struct pool_set *set,
+				unsigned repidx, int create)
+{
+	LOG(3, "rep %p set %p repidx %u", rep, set, repidx);
+
+	struct pool_replica *repset = set->replica[repidx];
+
+	ASSERTne(repset->remote->rpp, NULL);
+	ASSERTne(repset->remote->node_addr, NULL);
+	ASSERTne(repset->remote->pool_desc, NULL);
+
+	rep->node_addr = Strdup(repset->remote->node_addr);
+	if (rep->node_addr == NULL)
+		return -1;
+	rep->pool_desc = Strdup(repset->remote->pool_desc);
+	if (rep->pool_desc == NULL) {
+		Free(rep->node_addr);
+		return -1;
+	}
+
+	rep->rpp = repset->remote->rpp;
+	rep->degraded = 0;
+
+	/* pop_desc - beginning of the pool's descriptor */
+	rep->remote_base = (uintptr_t)rep->addr + sizeof(struct pool_hdr);
+
+	/* init hooks */
+	rep->persist_remote = obj_remote_persist;
+	rep->persist_local = NULL;
+	rep->flush_local = NULL;
+	rep->drain_local = NULL;
+	rep->memcpy_persist_local = NULL;
+	rep->memset_persist_local = NULL;
+	rep->memcpy_nodrain_local = NULL;
+	rep->memset_nodrain_local = NULL;
+
+	rep->p_ops.remote.read = obj_read_remote;
+	rep->p_ops.remote.ctx = rep->rpp;
+	rep->p_ops.remote.base = rep->remote_base;
+
+	return 0;
+}
+
+/*
+ * redo_log_check_offset -- (internal) check if offset is valid
+ */
+static int
+redo_log_check_offset(void *ctx, uint64_t offset)
+{
+	PMEMobjpool *pop = ctx;
+	return OBJ_OFF_IS_VALID(pop, offset);
+}
+
+/*
+ * pmemobj_replica_init -- (internal) initialize runtime part of the replica
+ */
+static int
+pmemobj_replica_init(PMEMobjpool *rep, struct pool_set *set, unsigned repidx,
+			int create)
+{
+	struct pool_replica *repset = set->replica[repidx];
+
+	if (repidx == 0) {
+		/* master replica */
+		rep->is_master_replica = 1;
+		rep->has_remote_replicas = set->remote;
+
+		if (set->nreplicas > 1) {
+			rep->p_ops.persist = obj_rep_persist;
+			rep->p_ops.flush = obj_rep_flush;
+			rep->p_ops.drain = obj_rep_drain;
+			rep->p_ops.memcpy_persist = obj_rep_memcpy_persist;
+			rep->p_ops.memset_persist = obj_rep_memset_persist;
+		} else {
+			rep->p_ops.persist = obj_norep_persist;
+			rep->p_ops.flush = obj_norep_flush;
+			rep->p_ops.drain = obj_norep_drain;
+			rep->p_ops.memcpy_persist = obj_norep_memcpy_persist;
+			rep->p_ops.memset_persist = obj_norep_memset_persist;
+		}
+		rep->p_ops.base = rep;
+		rep->p_ops.pool_size = rep->size;
+
+		rep->persist_stats = NULL;
+		if (Obj_persist_stats_enabled &&
+				obj_persist_stats_boot(rep) != 0)
+			return -1;
+	} else {
+		/* non-master replicas */
+		rep->is_master_replica = 0;
+		rep->has_remote_replicas = 0;
+
+		rep->p_ops.persist = NULL;
+		rep->p_ops.flush = NULL;
+		rep->p_ops.drain = NULL;
+		rep->p_ops.memcpy_persist = NULL;
+		rep->p_ops.memset_persist = NULL;
+
+		rep->p_ops.base = NULL;
+		rep->p_ops.pool_size = 0;
+	}
+
+	int ret;
+	if (repset->remote)
+		ret = pmemobj_replica_init_remote(rep, set, repidx, create);
+	else
+		ret = pmemobj_replica_init_local(rep, repset->is_pmem);
+	if (ret)
+		return ret;
+
+	rep->redo = redo_log_config_new(rep->addr, &rep->p_ops,
+			redo_log_check_offset, rep, REDO_NUM_ENTRIES);
+	if (!rep->redo)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * obj_feature_enable -- sets the incompat features in the headers of the pool
+ *	before the first structure which depends on them is written
+ *
+ * Versions of the library which don't know the features refuse to open the
+ * pool from then on.
+ */
+int
+obj_feature_enable(PMEMobjpool *pop, uint32_t incompat)
+{
+	if ((util_atomic_load_acquire32(&pop->incompat_features) & incompat) ==
+			incompat)
+		return 0;
+
+	LOG(3, "pop %p incompat %#x", pop, incompat);
+
+	util_mutex_lock(&Features_lock);
+
+	int ret = 0;
+	uint32_t features = pop->incompat_features | incompat;
+	if (features != pop->incompat_features) {
+		ret = util_feature_enable(pop->set, incompat);
+		if (ret == 0)
+			util_atomic_store_release32(&pop->incompat_features,
+				features);
+	}
+
+	util_mutex_unlock(&Features_lock);
+
+	return ret;
+}
+
+/*
+ * pmemobj_runtime_init -- (internal) initialize runtime part of the pool header
+ */
+static int
+pmemobj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
+{
+	LOG(3, "pop %p rdonly %d boot %d", pop, rdonly, boot);
+	struct pmem_ops *p_ops = &pop->p_ops;
+
+	/* run_id is made unique by incrementing the previous value */
+	if (!rdonly) {
+		pop->run_id += 2;
+		if (pop->run_id == 0)
+			pop->run_id += 2;
+		pmemops_persist(p_ops, &pop->run_id, sizeof(pop->run_id));
+	}
+
+	/*
+	 * Use some of the memory pool area for run-time info.  This
+	 * run-time state is never loaded from the file, it is always
+	 * created here, so no need to worry about byte-order.
+	 */
+	pop->rdonly = rdonly;
+	pop->tx_reclaim = NULL;
+	pop->tx_group = NULL;
+	pop->scrub = NULL;
+	pop->incompat_features = le32toh(pop->hdr.incompat_features);
+	pop->root_seq = 0;
+
+	pop->uuid_lo = pmemobj_get_uuid_lo(pop);
+
+	/* a read-only pool has no lanes, the heap can only be walked */
+	pop->lanes_desc.runtime_nlanes = rdonly ? 0 : nlanes;
+
+	if (boot) {
+		if (rdonly)
+			pmalloc_boot_rdonly(pop);
+		else if ((errno = pmemobj_boot(pop)) != 0)
+			return -1;
+
+#ifdef USE_VG_MEMCHECK
+		if (On_valgrind && !rdonly) {
+			/* mark unused part of the pool as not accessible */
+			void *end = palloc_heap_end(&pop->heap);
+			VALGRIND_DO_MAKE_MEM_NOACCESS(end,
+					(void *)pop + pop->size - end);
+		}
+#endif
+
+		if ((pop->epoch = epoch_new()) == NULL)
+			return -1;
+
+		if ((errno = obj_pools_insert(pop)) != 0) {
+			ERR("!obj_pools_insert");
+			epoch_delete(pop->epoch);
+			return -1;
+		}
+
+		if (!rdonly) {
+			tx_reclaim_start(pop);
+			tx_group_start(pop);
+		}
+	}
+
+	/*
+	 * If possible, turn off all permissions on the pool header page.
+	 *
+	 * The prototype PMFS doesn't allow this when large pages are in
+	 * use. It is not considered an error if this fails.
+	 */
+	util_range_none(pop->addr, sizeof(struct pool_hdr));
+
+	return 0;
+}
+
+/*
+ * pmemobj_cleanup_remote -- (internal) clean up the remote pools data
+ */
+static void
+pmemobj_cleanup_remote(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	for (; pop != NULL; pop = pop->replica) {
+		if (pop->rpp != NULL) {
+			Free(pop->node_addr);
+			Free(pop->pool_desc);
+			pop->rpp = NULL;
+		}
+	}
+}
+
+/*
+ * pmemobj_create -- create a transactional memory pool (set)
+ */
+PMEMobjpool *
+pmemobj_create(const char *path, const char *layout, size_t poolsize,
+		mode_t mode)
+{
+	LOG(3, "path %s layout %s poolsize %zu mode %o",
+			path, layout, poolsize, mode);
+
+	PMEMobjpool *pop;
+	struct pool_set *set;
+
+	/* check length of layout */
+	if (layout && (strlen(layout) >= PMEMOBJ_MAX_LAYOUT)) {
+		ERR("Layout too long");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/*
+	 * A number of lanes available at runtime equals the lowest value
+	 * from all reported by remote replicas hosts. In the single host mode
+	 * the runtime number of lanes is equal to the total number of lanes
+	 * available in the pool.
+	 */
+	unsigned runtime_nlanes = Create_nlanes;
+
+	if (util_pool_create(&set, path, poolsize, PMEMOBJ_MIN_POOL,
+			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR, OBJ_FORMAT_COMPAT,
+			OBJ_FORMAT_INCOMPAT | OBJ_FORMAT_INCOMPAT_ZONES_VALID,
+			OBJ_FORMAT_RO_COMPAT, &runtime_nlanes) != 0) {
+		LOG(2, "cannot create pool or pool set");
+		return NULL;
+	}
+
+	ASSERT(set->nreplicas > 0);
+
+	/* pop is master replica from now on */
+	pop = set->replica[0]->part[0].addr;
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *repset = set->replica[r];
+		PMEMobjpool *rep = repset->part[0].addr;
+
+		size_t rt_size = (uintptr_t)(rep + 1) - (uintptr_t)&rep->addr;
+		VALGRIND_REMOVE_PMEM_MAPPING(&rep->addr, rt_size);
+
+		memset(&rep->addr, 0, rt_size);
+
+		rep->addr = rep;
+		rep->size = repset->repsize;
+		rep->replica = NULL;
+		rep->rpp = NULL;
+
+		/* initialize replica runtime - is_pmem, funcs, ... */
+		if (pmemobj_replica_init(rep, set, r, 1 /* create */) != 0) {
+			ERR("initialization of replica #%u failed", r);
+			goto err;
+		}
+
+		/* link replicas */
+		if (r < set->nreplicas - 1)
+			rep->replica = set->replica[r + 1]->part[0].addr;
+	}
+
+	pop->set = set;
+
+	/* create pool descriptor */
+	if (pmemobj_descr_create(pop, layout, set->poolsize) != 0) {
+		LOG(2, "creation of pool descriptor failed");
+		goto err;
+	}
+
+	/* initialize runtime parts - lanes, obj stores, ... */
+	if (pmemobj_runtime_init(pop, 0, 1 /* boot */,
+					runtime_nlanes) != 0) {
+		ERR("pool initialization failed");
+		goto err;
+	}
+
+	if (util_poolset_chmod(set, mode))
+		goto err;
+
+	LOG(3, "pop %p", pop);
+
+	return pop;
+
+err:
+	LOG(4, "error clean up");
+	int oerrno = errno;
+	if (set->remote)
+		pmemobj_cleanup_remote(pop);
+	obj_replicas_sync(set);
+	util_poolset_close(set, 1);
+	errno = oerrno;
+	return NULL;
+}
+
+/*
+ * pmemobj_check_basic_local -- (internal) basic pool consistency check
+ *                              of a local replica
+ */
+static int
+pmemobj_check_basic_local(PMEMobjpool *pop, int open)
+{
+	LOG(3, "pop %p open %d", pop, open);
+
+	ASSERTeq(pop->rpp, NULL);
+
+	int consistent = 1;
+
+	if (pop->run_id % 2) {
+		ERR("invalid run_id %ju", pop->run_id);
+		consistent = 0;
+	}
+
+	if ((errno = lane_check(pop, palloc_heap_check_nthreads())) != 0) {
+		LOG(2, "!lane_check");
+		consistent = 0;
+	}
+
+	if (open)
+		errno = palloc_heap_check_open((char *)pop + pop->heap_offset,
+				pop->heap_size, pop->run_id);
+	else
+		errno = palloc_heap_check((char *)pop + pop->heap_offset,
+				pop->heap_size);
+	if (errno != 0) {
+		LOG(2, "!heap_check");
+		consistent = 0;
+	}
+
+	return consistent;
+}
+
+/*
+ * obj_read_remote -- read data from remote replica
+ *
+ * It reads data of size 'length' from the remote replica 'pop'
+ * from address 'addr' and saves it at address 'dest'.
+ */
+int
+obj_read_remote(void *ctx, uintptr_t base, void *dest, void *addr,
+		size_t length)
+{
+	LOG(3, "ctx %p base 0x%lx dest %p addr %p length %zu", ctx, base, dest,
+			addr, length);
+
+	ASSERTne(ctx, NULL);
+	ASSERT((uintptr_t)addr >= base);
+
+	uintptr_t offset = (uintptr_t)addr - base;
+	if (Rpmem_read(ctx, dest, offset, length)) {
+		ERR("!rpmem_read");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_check_basic_remote -- (internal) basic pool consistency check
+ *                               of a remote replica
+ */
+static int
+pmemobj_check_basic_remote(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	ASSERTne(pop->rpp, NULL);
+
+	int consistent = 1;
+
+	/* read pop->run_id */
+	if (obj_read_remote(pop->rpp, pop->remote_base, &pop->run_id,
+			&pop->run_id, sizeof(pop->run_id))) {
+		ERR("!obj_read_remote");
+		return -1;
+	}
+
+	if (pop->run_id % 2) {
+		ERR("invalid run_id %ju", pop->run_id);
+		consistent = 0;
+	}
+
+	/* XXX add lane_check_remote */
+
+	errno = palloc_heap_check_remote((char *)pop + pop->heap_offset,
+			pop->heap_size, &pop->p_ops.remote);
+	if (errno != 0) {
+		LOG(2, "!heap_check_remote");
+		consistent = 0;
+	}
+
+	return consistent;
+}
+
+/*
+ * pmemobj_check_basic -- (internal) basic pool consistency check
+ *
+ * Used to check if all the replicas are consistent prior to pool recovery.
+ * If 'open' is set, the verification of the heap zones of a local pool may be
+ * deferred until after the pool is opened (see heap_check_open).
+ */
+static int
+pmemobj_check_basic(PMEMobjpool *pop, int open)
+{
+	LOG(3, "pop %p open %d", pop, open);
+
+	if (pop->rpp == NULL)
+		return pmemobj_check_basic_local(pop, open);
+	else
+		return pmemobj_check_basic_remote(pop);
+}
+
+/*
+ * pmemobj_open_common -- open a transactional memory pool (set)
+ *
+ * This routine does all the work, but takes a cow flag so internal
+ * calls can map a read-only pool if required. With POOL_OPEN_SHARED the
+ * pool is opened read-only, see pmemobj_open_rdonly.
+ */
+static PMEMobjpool *
+pmemobj_open_common(const char *path, const char *layout, int cow, int boot)
+{
+	LOG(3, "path %s layout %s cow %d", path, layout, cow);
+
+	PMEMobjpool *pop = NULL;
+	struct pool_set *set;
+	int rdonly = cow == POOL_OPEN_SHARED;
+
+	/*
+	 * A number of lanes available at runtime equals the lowest value
+	 * from all reported by remote replicas hosts. In the single host mode
+	 * the runtime number of lanes is equal to the total number of lanes
+	 * available in the pool.
+	 */
+	unsigned runtime_nlanes = OBJ_NLANES;
+
+	if (util_pool_open(&set, path, cow, PMEMOBJ_MIN_POOL,
+			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
+			OBJ_FORMAT_COMPAT, OBJ_FORMAT_INCOMPAT_SUPPORTED,
+			OBJ_FORMAT_RO_COMPAT, &runtime_nlanes) != 0) {
+		LOG(2, "cannot open pool or pool set");
+		return NULL;
+	}
+
+	ASSERT(set->nreplicas > 0);
+
+	/* read-only mode is not supported in libpmemobj */
+	if (set->rdonly && !rdonly) {
+		ERR("read-only mode is not supported");
+		errno = EINVAL;
+		goto err;
+	}
+
+	if (rdonly && set->remote) {
+		ERR("remote replicas are not supported in read-only mode");
+		errno = ENOTSUP;
+		goto err;
+	}
+
+	/* pop is master replica from now on */
+	pop = set->replica[0]->part[0].addr;
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *repset = set->replica[r];
+		PMEMobjpool *rep = repset->part[0].addr;
+
+		size_t rt_size = (uintptr_t)(rep + 1) - (uintptr_t)&rep->addr;
+
+		VALGRIND_REMOVE_PMEM_MAPPING(&rep->addr, rt_size);
+
+		memset(&rep->addr, 0, rt_size);
+
+		rep->addr = rep;
+		rep->size = repset->repsize;
+		rep->replica = NULL;
+		rep->rpp = NULL;
+
+		/* initialize replica runtime - is_pmem, funcs, ... */
+		if (pmemobj_replica_init(rep, set, r, 0 /* open */) != 0) {
+			ERR("initialization of replica #%u failed", r);
+			goto err;
+		}
+
+		/* check descriptor */
+		if (pmemobj_descr_check(rep, layout, set->poolsize) != 0) {
+			LOG(2, "descriptor check of replica #%u failed", r);
+			goto err;
+		}
+
+		/* link replicas */
+		if (r < set->nreplicas - 1)
+			rep->replica = set->replica[r + 1]->part[0].addr;
+	}
+
+	pop->set = set;
+
+	/*
+	 * A read-only pool is neither checked nor recovered - the process
+	 * which has it open may be modifying it at the same time.
+	 */
+	if (boot && !rdonly) {
+		/* check consistency of 'master' replica */
+		if (pmemobj_check_basic(pop, set->nreplicas == 1) == 0) {
+			goto err;
+		}
+	}
+
+	/*
+	 * If there is more than one replica, check if all of them are
+	 * consistent (recoverable).
+	 * On success, choose any replica and copy entire lanes (redo logs)
+	 * to all the other replicas to synchronize them.
+	 */
+	if (set->nreplicas > 1 && !rdonly) {
+		PMEMobjpool *rep;
+		for (unsigned r = 0; r < set->nreplicas; r++) {
+			rep = set->replica[r]->part[0].addr;
+			if (pmemobj_check_basic(rep, 0) == 0) {
+				ERR("inconsistent replica #%u", r);
+				goto err;
+			}
+		}
+
+		/* copy lanes */
+		void *src = (void *)((uintptr_t)pop + pop->lanes_offset);
+		size_t len = pop->nlanes * sizeof(struct lane_layout);
+
+		for (unsigned r = 1; r < set->nreplicas; r++) {
+			rep = set->replica[r]->part[0].addr;
+			void *dst = (void *)((uintptr_t)rep +
+						pop->lanes_offset);
+			if (rep->rpp == NULL) {
+				rep->memcpy_persist_local(dst, src, len);
+			} else {
+				obj_rep_remote_persist(pop, rep, dst, len,
+						RLANE_DEFAULT);
+			}
+		}
+	}
+
+	/* catch up the remote replicas degraded during the last run */
+	if (set->remote && pop->resync_shift != 0 && obj_rep_resync(pop))
+		goto err;
+
+	/*
+	 * before runtime initialization lanes are unavailable, remote persists
+	 * should use RLANE_DEFAULT
+	 */
+	pop->lanes_desc.runtime_nlanes = 0;
+
+	/* the pool may have been created with fewer lanes than the default */
+	if (runtime_nlanes > pop->nlanes)
+		runtime_nlanes = (unsigned)pop->nlanes;
+
+#ifdef USE_VG_MEMCHECK
+	palloc_heap_vg_open((char *)pop + pop->heap_offset, pop->heap_size);
+#endif
+
+	/* initialize runtime parts - lanes, obj stores, ... */
+	if (pmemobj_runtime_init(pop, rdonly, boot, runtime_nlanes) != 0) {
+		ERR("pool initialization failed");
+		goto err;
+	}
+
+#ifdef USE_VG_MEMCHECK
+	if (boot)
+		pmemobj_vg_boot(pop);
+#endif
+
+	/* free the objects retired, but not freed, before the pool was closed */
+	if (boot && !rdonly)
+		epoch_recover(pop);
+
+	LOG(3, "pop %p", pop);
+
+	return pop;
+
+err:
+	LOG(4, "error clean up");
+	int oerrno = errno;
+	if (set->remote)
+		pmemobj_cleanup_remote(pop);
+	obj_replicas_sync(set);
+	util_poolset_close(set, 0);
+	errno = oerrno;
+	return NULL;
+}
+
+/*
+ * pmemobj_open -- open a transactional memory pool
+ */
+PMEMobjpool *
+pmemobj_open(const char *path, const char *layout)
+{
+	LOG(3, "path %s layout %s", path, layout);
+
+	return pmemobj_open_common(path, layout, Open_cow, 1);
+}
+
+/*
+ * pmemobj_open_rdonly -- open a transactional memory pool read-only
+ *
+ * The pool files are neither locked nor modified, so the pool can be
+ * opened while another process has it open.
+ */
+PMEMobjpool *
+pmemobj_open_rdonly(const char *path, const char *layout)
+{
+	LOG(3, "path %s layout %s", path, layout);
+
+	return pmemobj_open_common(path, layout, POOL_OPEN_SHARED, 1);
+}
+
+/*
+ * obj_replicas_cleanup -- (internal) free resources allocated for replicas
+ */
+static void
+obj_replicas_cleanup(struct pool_set *set)
+{
+	LOG(3, "set %p", set);
+
+	obj_replicas_sync(set);
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+
+		PMEMobjpool *pop = rep->part[0].addr;
+		redo_log_config_delete(pop->redo);
+		obj_persist_stats_fini(pop);
+
+		if (pop->rpp != NULL) {
+			/*
+			 * remote replica will be closed in util_poolset_close
+			 */
+			pop->rpp = NULL;
+
+			Free(pop->node_addr);
+			Free(pop->pool_desc);
+		}
+	}
+}
+
+/*
+ * obj_pool_cleanup -- (internal) cleanup the pool and unmap
+ */
+static void
+obj_pool_cleanup(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	scrub_stop(pop);
+
+	/* the objects left to the reclaimer are freed before anything else */
+	tx_reclaim_stop(pop);
+	tx_group_stop(pop);
+
+	obj_type_index_delete(pop);
+	epoch_delete(pop->epoch);
+
+	palloc_heap_cleanup(&pop->heap);
+
+	if (!pop->rdonly)
+		lane_cleanup(pop);
+
+	/* unmap all the replicas */
+	obj_replicas_cleanup(pop->set);
+	util_poolset_close(pop->set, 0);
+}
+
+/*
+ * pmemobj_close -- close a transactional memory pool
+ */
+void
+pmemobj_close(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	_pobj_cache_invalidate++;
+
+	if (obj_pools_remove(pop) != 0) {
+		ERR("obj_pools_remove");
+	}
+
+#ifndef _WIN32
+
+	if (_pobj_cached_pool.pop == pop) {
+		_pobj_cached_pool.pop = NULL;
+		_pobj_cached_pool.uuid_lo = 0;
+	}
+
+#else /* _WIN32 */
+
+	struct _pobj_pcache *pcache = pthread_getspecific(Cached_pool_key);
+	if (pcache != NULL) {
+		if (pcache->pop == pop) {
+			pcache->pop = NULL;
+			pcache->uuid_lo = 0;
+		}
+	}
+
+#endif /* _WIN32 */
+
+	obj_pool_cleanup(pop);
+}
+
+/*
+ * pmemobj_check -- transactional memory pool consistency check
+ */
+int
+pmemobj_check(const char *path, const char *layout)
+{
+	LOG(3, "path %s layout %s", path, layout);
+
+	PMEMobjpool *pop = pmemobj_open_common(path, layout, 1, 0);
+	if (pop == NULL)
+		return -1;	/* errno set by pmemobj_open_common() */
+
+	int consistent = 1;
+
+	/*
+	 * For replicated pools, basic consistency check is performed
+	 * in pmemobj_open_common().
+	 */
+	if (pop->replica == NULL)
+		consistent = pmemobj_check_basic(pop, 0);
+
+	if (consistent && (errno = pmemobj_boot(pop)) != 0) {
+		LOG(3, "!pmemobj_boot");
 		consistent = 0;
 	}
 
-	if ((errno = lane_check(pop)) != 0) {
-		LOG(2, "!lane_check");
-		consistent = 0;
+	if (consistent) {
+		obj_pool_cleanup(pop);
+	} else {
+		/* unmap all the replicas */
+		obj_replicas_cleanup(pop->set);
+		util_poolset_close(pop->set, 0);
+	}
+
+	if (consistent)
+		LOG(4, "pool consistency check OK");
+
+	return consistent;
+}
+
+/*
+ * pmemobj_check_wait -- waits for the deferred verification of the heap of
+ *	the open pool to complete
+ *
+ * Returns 1 if all of the heap zones are consistent, 0 otherwise.
+ */
+int
+pmemobj_check_wait(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	unsigned inconsistent = palloc_heap_check_wait(&pop->heap);
+	if (inconsistent != 0) {
+		ERR("%u inconsistent heap zone(s)", inconsistent);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * pmemobj_pool_by_oid -- returns the pool handle associated with the oid
+ */
+PMEMobjpool *
+pmemobj_pool_by_oid(PMEMoid oid)
+{
+	LOG(3, "oid.off 0x%016jx", oid.off);
+
+	uint64_t uuid_lo = oid.pool_uuid_lo;
+
+	if (Pool_cache.invalidate != _pobj_cache_invalidate) {
+		memset(&Pool_cache, 0, sizeof(Pool_cache));
+		Pool_cache.invalidate = _pobj_cache_invalidate;
+	}
+
+	for (int i = 0; i < OBJ_POOL_CACHE_WAYS; ++i) {
+		if (Pool_cache.ways[i].uuid_lo == uuid_lo &&
+				Pool_cache.ways[i].pop != NULL)
+			return Pool_cache.ways[i].pop;
+	}
+
+	PMEMobjpool *pop = obj_pools_find_uuid(uuid_lo);
+	if (pop == NULL)
+		return NULL;
+
+	unsigned way = Pool_cache.next++ % OBJ_POOL_CACHE_WAYS;
+	Pool_cache.ways[way].uuid_lo = uuid_lo;
+	Pool_cache.ways[way].pop = pop;
+
+	return pop;
+}
+
+/*
+ * pmemobj_pool_by_ptr -- returns the pool handle associated with the address
+ */
+PMEMobjpool *
+pmemobj_pool_by_ptr(const void *addr)
+{
+	LOG(3, "addr %p", addr);
+
+	struct obj_pools_reader *r = obj_pools_reader();
+	struct obj_pools *p = obj_pools_enter(r);
+	PMEMobjpool *pop = NULL;
+	if (p == NULL)
+		goto out;
+
+	/* find the last pool starting at or below the address */
+	uintptr_t key = (uintptr_t)addr;
+	size_t lo = 0;
+	size_t hi = p->npools;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (p->by_addr[mid].addr <= key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		goto out;
+
+	const struct obj_pool_entry *e = &p->by_addr[lo - 1];
+	if (key - e->addr < e->size)
+		pop = e->pop;
+
+out:
+	obj_pools_exit(r);
+
+	return pop;
+}
+
+/*
+ * pmemobj_oid -- returns the object handle of the address
+ */
+PMEMoid
+pmemobj_oid(const void *addr)
+{
+	LOG(3, "addr %p", addr);
+
+	PMEMobjpool *pop = pmemobj_pool_by_ptr(addr);
+	if (pop == NULL)
+		return OID_NULL;
+
+	PMEMoid oid = {pop->uuid_lo, (uintptr_t)addr - (uintptr_t)pop};
+	return oid;
+}
+
+/*
+ * pmemobj_direct_n -- translates the handles of the objects into direct
+ *	pointers and prefetches the objects
+ *
+ * The pool is looked up only when the handle is of a different one than the
+ * previous handle, so translating the handles of a single pool costs about as
+ * much as the additions. The objects are prefetched all at once, so that
+ * the misses of the accesses which follow overlap.
+ */
+void
+pmemobj_direct_n(const PMEMoid *oids, void **ptrs, size_t n)
+{
+	LOG(15, "oids %p ptrs %p n %zu", oids, ptrs, n);
+
+	uint64_t uuid_lo = 0;
+	PMEMobjpool *pop = NULL;
+
+	for (size_t i = 0; i < n; ++i) {
+		if (oids[i].off == 0 || oids[i].pool_uuid_lo == 0) {
+			ptrs[i] = NULL;
+			continue;
+		}
+
+		if (oids[i].pool_uuid_lo != uuid_lo) {
+			uuid_lo = oids[i].pool_uuid_lo;
+			pop = pmemobj_pool_by_oid(oids[i]);
+		}
+
+		if (pop == NULL) {
+			ptrs[i] = NULL;
+			continue;
+		}
+
+		ptrs[i] = (char *)pop + oids[i].off;
+		util_prefetch(ptrs[i]);
+	}
+}
+
+/* arguments for constructor_alloc_bytype */
+struct carg_bytype {
+	type_num_t user_type;
+	int zero_init;
+	pmemobj_constr constructor;
+	void *arg;
+};
+
+/*
+ * constructor_alloc_bytype -- (internal) constructor for obj_alloc_construct
+ */
+static int
+constructor_alloc_bytype(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
+	struct pmem_ops *p_ops = &pop->p_ops;
+
+	ASSERTne(ptr, NULL);
+	ASSERTne(arg, NULL);
+
+	struct carg_bytype *carg = arg;
+
+	obj_oob_init(pop, ptr, carg->user_type, 0);
+
+	if (carg->zero_init) {
+		if (palloc_block_zeroed())
+			VALGRIND_DO_MAKE_MEM_DEFINED(ptr, usable_size);
+		else
+			pmemops_memset_persist(p_ops, ptr, 0, usable_size);
+	}
+
+	int ret = 0;
+	if (carg->constructor)
+		ret = carg->constructor(pop, ptr, carg->arg);
+
+	return ret;
+}
+
+/*
+ * obj_alloc_construct -- (internal) allocates a new object with constructor
+ */
+static int
+obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	type_num_t type_num, int zero_init,
+	pmemobj_constr constructor,
+	void *arg, unsigned class_id, size_t alignment)
+{
+	if (unlikely(pop->rdonly)) {
+		ERR("cannot modify a read-only pool");
+		errno = EROFS;
+		return -1;
+	}
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	struct carg_bytype carg;
+
+	carg.user_type = type_num;
+	carg.zero_init = zero_init;
+	carg.constructor = constructor;
+	carg.arg = arg;
+
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	if (oidp)
+		operation_add_entry(&ctx, &oidp->pool_uuid_lo, pop->uuid_lo,
+				OPERATION_SET);
+
+	int ret = pmalloc_operation(&pop->heap, 0,
+			oidp != NULL ? &oidp->off : NULL, size + OBJ_OOB_SIZE,
+			constructor_alloc_bytype, &carg, &ctx, class_id,
+			alignment);
+
+	pmalloc_redo_release(pop);
+
+	return ret;
+}
+
+/*
+ * pmemobj_alloc -- allocates a new object
+ */
+int
+pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p oidp %p size %zu type_num %llx constructor %p arg %p",
+		pop, oidp, size, (unsigned long long)type_num,
+		constructor, arg);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return obj_alloc_construct(pop, oidp, size, type_num,
+			0, constructor, arg, 0, 0);
+}
+
+/*
+ * pmemobj_xalloc -- allocates with flags
+ */
+int
+pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p oidp %p size %zu type_num %llx flags %llx "
+		"constructor %p arg %p",
+		pop, oidp, size, (unsigned long long)type_num,
+		(unsigned long long)flags,
+		constructor, arg);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (flags & ~POBJ_XALLOC_VALID_FLAGS) {
+		ERR("unknown flags 0x%" PRIx64,
+			flags & ~POBJ_XALLOC_VALID_FLAGS);
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned class_id = (unsigned)((flags & POBJ_XALLOC_CLASS_MASK) >>
+		POBJ_XALLOC_CLASS_SHIFT);
+
+	int ret = obj_alloc_construct(pop, oidp, size, type_num,
+			(flags & POBJ_XALLOC_ZERO) != 0, constructor, arg,
+			class_id, obj_alloc_alignment(flags));
+	if (ret != 0 && errno == EINVAL && class_id != 0)
+		ERR("invalid allocation class %u for size %zu",
+			class_id, size);
+
+	return ret;
+}
+
+/*
+ * pmemobj_alloc_class_register -- registers a user-defined allocation class
+ */
+int
+pmemobj_alloc_class_register(PMEMobjpool *pop,
+	struct pobj_alloc_class_desc *desc)
+{
+	LOG(3, "pop %p desc %p", pop, desc);
+
+	if (desc->type != POBJ_CLASS_RUN && desc->type != POBJ_CLASS_HUGE) {
+		ERR("invalid allocation class type %d", (int)desc->type);
+		errno = EINVAL;
+		return -1;
+	}
+
+	size_t header_size;
+	switch (desc->header_type) {
+		case POBJ_HEADER_LEGACY:
+			header_size = OBJ_OOB_SIZE;
+			break;
+		case POBJ_HEADER_COMPACT:
+			header_size = PALLOC_COMPACT_DATA_OFF;
+			break;
+		case POBJ_HEADER_NONE:
+			header_size = 0;
+			break;
+		default:
+			ERR("invalid header type %d", (int)desc->header_type);
+			errno = EINVAL;
+			return -1;
+	}
+
+	/* the first run of the class changes the headers of the pool */
+	if (desc->header_type != POBJ_HEADER_LEGACY &&
+			pop->has_remote_replicas) {
+		ERR("compact or no headers are not supported in pools with "
+			"remote replicas");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	int ret = palloc_alloc_class_register(&pop->heap, desc->unit_size,
+		desc->units_per_block, desc->type == POBJ_CLASS_HUGE,
+		header_size, &desc->class_id);
+	if (ret != 0) {
+		ERR("cannot register allocation class with unit size %zu "
+			"and %u units per block", desc->unit_size,
+			desc->units_per_block);
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_reserve -- reserves a new object, which becomes allocated only
+ *	after it is published
+ */
+PMEMoid
+pmemobj_reserve(PMEMobjpool *pop, struct pobj_action *act,
+	size_t size, uint64_t type_num)
+{
+	LOG(3, "pop %p act %p size %zu type_num %llx",
+		pop, act, size, (unsigned long long)type_num);
+
+	PMEMoid oid = OID_NULL;
+
+	if (unlikely(pop->rdonly)) {
+		ERR("cannot modify a read-only pool");
+		errno = EROFS;
+		return oid;
+	}
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return oid;
+	}
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return oid;
+	}
+
+	struct carg_bytype carg;
+
+	carg.user_type = type_num;
+	carg.zero_init = 0;
+	carg.constructor = NULL;
+	carg.arg = NULL;
+
+	if (palloc_reserve(&pop->heap, size + OBJ_OOB_SIZE,
+			constructor_alloc_bytype, &carg, 0, act,
+			&oid.off) != 0)
+		return oid;
+
+	oid.pool_uuid_lo = pop->uuid_lo;
+
+	return oid;
+}
+
+/*
+ * pmemobj_set_value -- creates an action which sets the value when published
+ */
+void
+pmemobj_set_value(PMEMobjpool *pop, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value)
+{
+	LOG(3, "pop %p act %p ptr %p value %" PRIu64, pop, act, ptr, value);
+
+	palloc_set_value(&pop->heap, act, ptr, value);
+}
+
+/*
+ * pmemobj_publish -- persistently allocates the reserved objects and sets
+ *	the values
+ */
+int
+pmemobj_publish(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
+{
+	LOG(3, "pop %p actv %p actvcnt %zu", pop, actv, actvcnt);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	/* each action needs at most one entry of each type */
+	if (pmalloc_redo_extend(pop, &ctx, actvcnt) != 0)
+		LOG(2, "publishing the actions in groups");
+
+	palloc_publish(&pop->heap, actv, actvcnt, &ctx);
+
+	pmalloc_redo_release(pop);
+
+	return 0;
+}
+
+/*
+ * pmemobj_cancel -- releases the reserved objects
+ */
+void
+pmemobj_cancel(PMEMobjpool *pop, struct pobj_action *actv, size_t actvcnt)
+{
+	LOG(3, "pop %p actv %p actvcnt %zu", pop, actv, actvcnt);
+
+	palloc_cancel(&pop->heap, actv, actvcnt);
+}
+
+/* arguments for constructor_realloc and constructor_zrealloc */
+struct carg_realloc {
+	void *ptr;
+	size_t old_size;
+	size_t new_size;
+	int zero_init;
+	type_num_t user_type;
+	pmemobj_constr constructor;
+	void *arg;
+};
+
+/*
+ * pmemobj_zalloc -- allocates a new zeroed object
+ */
+int
+pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+		uint64_t type_num)
+{
+	LOG(3, "pop %p oidp %p size %zu type_num %llx",
+			pop, oidp, size, (unsigned long long)type_num);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return obj_alloc_construct(pop, oidp, size, type_num,
+					1, NULL, NULL, 0, 0);
+}
+
+/*
+ * obj_free -- (internal) free an object
+ */
+static void
+obj_free(PMEMobjpool *pop, PMEMoid *oidp)
+{
+	ASSERTne(oidp, NULL);
+
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	operation_add_entry(&ctx, &oidp->pool_uuid_lo, 0, OPERATION_SET);
+
+	pmalloc_operation(&pop->heap, oidp->off, &oidp->off, 0, NULL, NULL,
+			&ctx, 0, 0);
+
+	pmalloc_redo_release(pop);
+}
+
+/*
+ * constructor_realloc -- (internal) constructor for pmemobj_realloc
+ */
+static int
+constructor_realloc(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
+	struct pmem_ops *p_ops = &pop->p_ops;
+
+	ASSERTne(ptr, NULL);
+	ASSERTne(arg, NULL);
+
+	struct carg_realloc *carg = arg;
+
+	if (ptr != carg->ptr)
+		obj_oob_init(pop, ptr, carg->user_type, 0);
+
+	if (!carg->zero_init)
+		return 0;
+
+	if (usable_size > carg->old_size) {
+		size_t grow_len = usable_size - carg->old_size;
+		void *new_data_ptr = (void *)((uintptr_t)ptr + carg->old_size);
+
+		pmemops_memset_persist(p_ops, new_data_ptr, 0, grow_len);
+	}
+
+	return 0;
+}
+
+/*
+ * obj_realloc_common -- (internal) common routine for resizing
+ *                          existing objects
+ */
+static int
+obj_realloc_common(PMEMobjpool *pop,
+	PMEMoid *oidp, size_t size, type_num_t type_num, int zero_init)
+{
+	/* if OID is NULL just allocate memory */
+	if (OBJ_OID_IS_NULL(*oidp)) {
+		/* if size is 0 - do nothing */
+		if (size == 0)
+			return 0;
+
+		return obj_alloc_construct(pop, oidp, size, type_num,
+				zero_init, NULL, NULL, 0, 0);
+	}
+
+	if (unlikely(pop->rdonly)) {
+		ERR("cannot modify a read-only pool");
+		errno = EROFS;
+		return -1;
 	}
 
-	errno = palloc_heap_check((char *)pop + pop->heap_offset,
-			pop->heap_size);
-	if (errno != 0) {
-		LOG(2, "!heap_check");
-		consistent = 0;
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		errno = ENOMEM;
+		return -1;
 	}
 
-	return consistent;
+	/* if size is 0 just free */
+	if (size == 0) {
+		obj_free(pop, oidp);
+		return 0;
+	}
+
+	struct oob_header *pobj = OOB_HEADER_FROM_OID(pop, *oidp);
+	type_num_t user_type_old = obj_type_num(pop, oidp->off);
+
+	struct carg_realloc carg;
+	carg.ptr = OBJ_OFF_TO_PTR(pop, oidp->off);
+	carg.new_size = size;
+	carg.old_size = pmemobj_alloc_usable_size(*oidp);
+	carg.user_type = type_num;
+	carg.constructor = NULL;
+	carg.arg = NULL;
+	carg.zero_init = zero_init;
+
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	int ret;
+	if (type_num == user_type_old) {
+		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
+			size + OBJ_OOB_SIZE,
+			constructor_realloc, &carg, &ctx, 0, 0);
+	} else {
+		/* objects without headers are never resized in place */
+		if (palloc_header_size(&pop->heap, oidp->off) != 0)
+			operation_add_entry(&ctx, &pobj->type_num, type_num,
+				OPERATION_SET);
+
+		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
+			size + OBJ_OOB_SIZE, constructor_realloc, &carg,
+			&ctx, 0, 0);
+	}
+	pmalloc_redo_release(pop);
+
+	return ret;
 }
 
 /*
- * obj_read_remote -- read data from remote replica
- *
- * It reads data of size 'length' from the remote replica 'pop'
- * from address 'addr' and saves it at address 'dest'.
+ * constructor_zrealloc_root -- (internal) constructor for pmemobj_root
+ */
+static int
+constructor_zrealloc_root(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
+
+	ASSERTne(ptr, NULL);
+	ASSERTne(arg, NULL);
+
+	struct carg_realloc *carg = arg;
+
+	VALGRIND_ADD_TO_TX(OOB_HEADER_FROM_PTR(ptr),
+		usable_size + OBJ_OOB_SIZE);
+
+	struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
+
+	constructor_realloc(pop, ptr, usable_size, arg);
+	if (ptr != carg->ptr) {
+		pobj->size = carg->new_size | OBJ_INTERNAL_OBJECT_MASK;
+	}
+
+	int ret = 0;
+	if (carg->constructor)
+		ret = carg->constructor(pop, ptr, carg->arg);
+
+	VALGRIND_REMOVE_FROM_TX(OOB_HEADER_FROM_PTR(ptr),
+		carg->new_size + OBJ_OOB_SIZE);
+
+	return ret;
+}
+
+/*
+ * pmemobj_realloc -- resizes an existing object
  */
 int
-obj_read_remote(void *ctx, uintptr_t base, void *dest, void *addr,
-		size_t length)
+pmemobj_realloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+		uint64_t type_num)
 {
-	LOG(3, "ctx %p base 0x%lx dest %p addr %p length %zu", ctx, base, dest,
-			addr, length);
+	ASSERTne(oidp, NULL);
 
-	ASSERTne(ctx, NULL);
-	ASSERT((uintptr_t)addr >= base);
+	LOG(3, "pop %p oid.off 0x%016jx size %zu type_num %lu",
+		pop, oidp->off, size, type_num);
 
-	uintptr_t offset = (uintptr_t)addr - base;
-	if (Rpmem_read(ctx, dest, offset, length)) {
-		ERR("!rpmem_read");
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+
+	return obj_realloc_common(pop, oidp, size, (type_num_t)type_num, 0);
+}
+
+/*
+ * pmemobj_zrealloc -- resizes an existing object, any new space is zeroed.
+ */
+int
+pmemobj_zrealloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+		uint64_t type_num)
+{
+	ASSERTne(oidp, NULL);
+
+	LOG(3, "pop %p oid.off 0x%016jx size %zu type_num %lu",
+		pop, oidp->off, size, type_num);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+
+	return obj_realloc_common(pop, oidp, size, (type_num_t)type_num, 1);
+}
+
+/* arguments for constructor_strdup */
+struct carg_strdup {
+	size_t size;
+	const char *s;
+};
+
+/*
+ * constructor_strdup -- (internal) constructor of pmemobj_strdup
+ */
+static int
+constructor_strdup(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
+
+	ASSERTne(ptr, NULL);
+	ASSERTne(arg, NULL);
+
+	struct carg_strdup *carg = arg;
+
+	/* copy string */
+	pmemops_memcpy_persist(&pop->p_ops, ptr, carg->s, carg->size);
+
+	return 0;
+}
+
+/*
+ * pmemobj_strdup -- allocates a new object with duplicate of the string s.
+ */
+int
+pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
+		uint64_t type_num)
+{
+	LOG(3, "pop %p oidp %p string %s type_num %lu", pop, oidp, s, type_num);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (NULL == s) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	return 0;
+	struct carg_strdup carg;
+	carg.size = (strlen(s) + 1) * sizeof(char);
+	carg.s = s;
+
+	return obj_alloc_construct(pop, oidp, carg.size,
+		(type_num_t)type_num, 0, constructor_strdup, &carg, 0, 0);
 }
 
 /*
- * pmemobj_check_basic_remote -- (internal) basic pool consistency check
- *                               of a remote replica
+ * pmemobj_free -- frees an existing object
  */
-static int
-pmemobj_check_basic_remote(PMEMobjpool *pop)
+void
+pmemobj_free(PMEMoid *oidp)
+{
+	ASSERTne(oidp, NULL);
+
+	LOG(3, "oid.off 0x%016jx", oidp->off);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (oidp->off == 0)
+		return;
+
+	PMEMobjpool *pop = pmemobj_pool_by_oid(*oidp);
+
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+
+	obj_free(pop, oidp);
+}
+
+/*
+ * pmemobj_alloc_usable_size -- returns usable size of object
+ */
+size_t
+pmemobj_alloc_usable_size(PMEMoid oid)
+{
+	LOG(3, "oid.off 0x%016jx", oid.off);
+
+	if (oid.off == 0)
+		return 0;
+
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
+
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+
+	return (palloc_usable_size(&pop->heap, oid.off) - OBJ_OOB_SIZE);
+}
+
+/*
+ * obj_memcpy_persist_mt -- (internal) memcpy with replication, splitting
+ *	the copy to each local replica between multiple threads
+ */
+static void *
+obj_memcpy_persist_mt(PMEMobjpool *pop, void *dest, const void *src,
+	size_t len)
+{
+	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	util_memcpy_mt(dest, src, len, pop->memcpy_persist_local);
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		void *rdest = (char *)rep + (uintptr_t)dest - (uintptr_t)pop;
+		if (rep->rpp == NULL) {
+			util_memcpy_mt(rdest, src, len,
+					rep->memcpy_persist_local);
+		} else {
+			obj_rep_remote_persist(pop, rep, rdest, len, lane);
+		}
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas)
+		lane_release(pop);
+
+	return dest;
+}
+
+/*
+ * pmemobj_memcpy_persist -- pmemobj version of memcpy
+ */
+void *
+pmemobj_memcpy_persist(PMEMobjpool *pop, void *dest, const void *src,
+	size_t len)
 {
-	LOG(3, "pop %p", pop);
-
-	ASSERTne(pop->rpp, NULL);
+	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
 
-	int consistent = 1;
+	if (util_mtcopy_enabled(len))
+		return obj_memcpy_persist_mt(pop, dest, src, len);
 
-	/* read pop->run_id */
-	if (obj_read_remote(pop->rpp, pop->remote_base, &pop->run_id,
-			&pop->run_id, sizeof(pop->run_id))) {
-		ERR("!obj_read_remote");
-		return -1;
-	}
+	return pmemops_memcpy_persist(&pop->p_ops, dest, src, len);
+}
 
-	if (pop->run_id % 2) {
-		ERR("invalid run_id %ju", pop->run_id);
-		consistent = 0;
-	}
+/*
+ * pmemobj_memset_persist -- pmemobj version of memset
+ */
+void *
+pmemobj_memset_persist(PMEMobjpool *pop, void *dest, int c, size_t len)
+{
+	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
 
-	/* XXX add lane_check_remote */
+	return pmemops_memset_persist(&pop->p_ops, dest, c, len);
+}
 
-	errno = palloc_heap_check_remote((char *)pop + pop->heap_offset,
-			pop->heap_size, &pop->p_ops.remote);
-	if (errno != 0) {
-		LOG(2, "!heap_check_remote");
-		consistent = 0;
-	}
+/*
+ * pmemobj_persist -- pmemobj version of pmem_persist
+ */
+void
+pmemobj_persist(PMEMobjpool *pop, const void *addr, size_t len)
+{
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
 
-	return consistent;
+	pmemops_persist(&pop->p_ops, addr, len);
 }
 
 /*
- * pmemobj_check_basic -- (internal) basic pool consistency check
- *
- * Used to check if all the replicas are consistent prior to pool recovery.
+ * pmemobj_flush -- pmemobj version of pmem_flush
  */
-static int
-pmemobj_check_basic(PMEMobjpool *pop)
+void
+pmemobj_flush(PMEMobjpool *pop, const void *addr, size_t len)
 {
-	LOG(3, "pop %p", pop);
+	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
 
-	if (pop->rpp == NULL)
-		return pmemobj_check_basic_local(pop);
-	else
-		return pmemobj_check_basic_remote(pop);
+	pmemops_flush(&pop->p_ops, addr, len);
 }
 
 /*
- * pmemobj_open_common -- open a transactional memory pool (set)
- *
- * This routine does all the work, but takes a cow flag so internal
- * calls can map a read-only pool if required.
+ * pmemobj_drain -- pmemobj version of pmem_drain
  */
-static PMEMobjpool *
-pmemobj_open_common(const char *path, const char *layout, int cow, int boot)
+void
+pmemobj_drain(PMEMobjpool *pop)
 {
-	LOG(3, "path %s layout %s cow %d", path, layout, cow);
+	LOG(15, "pop %p", pop);
 
-	PMEMobjpool *pop = NULL;
-	struct pool_set *set;
+	pmemops_drain(&pop->p_ops);
+}
 
-	/*
-	 * A number of lanes available at runtime equals the lowest value
-	 * from all reported by remote replicas hosts. In the single host mode
-	 * the runtime number of lanes is equal to the total number of lanes
-	 * available in the pool.
-	 */
-	unsigned runtime_nlanes = OBJ_NLANES;
+/*
+ * pmemobj_type_num -- returns type number of object
+ */
+uint64_t
+pmemobj_type_num(PMEMoid oid)
+{
+	LOG(3, "oid.off 0x%016jx", oid.off);
 
-	if (util_pool_open(&set, path, cow, PMEMOBJ_MIN_POOL,
-			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
-			OBJ_FORMAT_COMPAT, OBJ_FORMAT_INCOMPAT,
-			OBJ_FORMAT_RO_COMPAT, &runtime_nlanes) != 0) {
-		LOG(2, "cannot open pool or pool set");
-		return NULL;
-	}
+	ASSERT(!OID_IS_NULL(oid));
 
-	ASSERT(set->nreplicas > 0);
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
 
-	/* read-only mode is not supported in libpmemobj */
-	if (set->rdonly) {
-		ERR("read-only mode is not supported");
-		errno = EINVAL;
-		goto err;
-	}
+	return obj_type_num(pop, oid.off);
+}
 
-	/* pop is master replica from now on */
-	pop = set->replica[0]->part[0].addr;
+/*
+ * Number of objects ahead of the one being looked up by pmemobj_object_info
+ * whose metadata is prefetched.
+ */
+#define OBJ_INFO_PREFETCH 8
 
-	for (unsigned r = 0; r < set->nreplicas; r++) {
-		struct pool_replica *repset = set->replica[r];
-		PMEMobjpool *rep = repset->part[0].addr;
+/*
+ * obj_info_prefetch -- (internal) finds the pool of the object and prefetches
+ *	its metadata, returns NULL for null objects
+ */
+static PMEMobjpool *
+obj_info_prefetch(PMEMoid oid, PMEMobjpool *last)
+{
+	if (oid.off == 0)
+		return NULL;
 
-		size_t rt_size = (uintptr_t)(rep + 1) - (uintptr_t)&rep->addr;
+	PMEMobjpool *pop = last != NULL && last->uuid_lo == oid.pool_uuid_lo ?
+		last : pmemobj_pool_by_oid(oid);
+	if (pop == NULL)
+		return NULL;
 
-		VALGRIND_REMOVE_PMEM_MAPPING(&rep->addr, rt_size);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
 
-		memset(&rep->addr, 0, rt_size);
+	palloc_prefetch(&pop->heap, oid.off);
 
-		rep->addr = rep;
-		rep->size = repset->repsize;
-		rep->replica = NULL;
-		rep->rpp = NULL;
+	return pop;
+}
 
-		/* initialize replica runtime - is_pmem, funcs, ... */
-		if (pmemobj_replica_init(rep, set, r, 0 /* open */) != 0) {
-			ERR("initialization of replica #%u failed", r);
-			goto err;
-		}
+/*
+ * pmemobj_object_info -- looks up the direct pointers, usable sizes and type
+ *	numbers of the objects
+ *
+ * The metadata of the objects is prefetched OBJ_INFO_PREFETCH objects ahead,
+ * so that the reads of the chunk and object headers of consecutive objects
+ * overlap instead of each one waiting for the previous one.
+ */
+void
+pmemobj_object_info(const PMEMoid *oids, size_t noids,
+	struct pobj_object_info *info)
+{
+	LOG(3, "oids %p noids %zu info %p", oids, noids, info);
 
-		/* check descriptor */
-		if (pmemobj_descr_check(rep, layout, set->poolsize) != 0) {
-			LOG(2, "descriptor check of replica #%u failed", r);
-			goto err;
-		}
+	PMEMobjpool *pops[OBJ_INFO_PREFETCH];
+	PMEMobjpool *last = NULL;
 
-		/* link replicas */
-		if (r < set->nreplicas - 1)
-			rep->replica = set->replica[r + 1]->part[0].addr;
+	for (size_t i = 0; i < noids && i < OBJ_INFO_PREFETCH; ++i) {
+		pops[i] = obj_info_prefetch(oids[i], last);
+		if (pops[i] != NULL)
+			last = pops[i];
 	}
 
-	pop->set = set;
-
-	if (boot) {
-		/* check consistency of 'master' replica */
-		if (pmemobj_check_basic(pop) == 0) {
-			goto err;
-		}
-	}
+	for (size_t i = 0; i < noids; ++i) {
+		PMEMobjpool *pop = pops[i % OBJ_INFO_PREFETCH];
 
-	/*
-	 * If there is more than one replica, check if all of them are
-	 * consistent (recoverable).
-	 * On success, choose any replica and copy entire lanes (redo logs)
-	 * to all the other replicas to synchronize them.
-	 */
-	if (set->nreplicas > 1) {
-		PMEMobjpool *rep;
-		for (unsigned r = 0; r < set->nreplicas; r++) {
-			rep = set->replica[r]->part[0].addr;
-			if (pmemobj_check_basic(rep) == 0) {
-				ERR("inconsistent replica #%u", r);
-				goto err;
-			}
+		if (i + OBJ_INFO_PREFETCH < noids) {
+			PMEMobjpool *next = obj_info_prefetch(
+				oids[i + OBJ_INFO_PREFETCH], last);
+			pops[i % OBJ_INFO_PREFETCH] = next;
+			if (next != NULL)
+				last = next;
 		}
 
-		/* copy lanes */
-		void *src = (void *)((uintptr_t)pop + pop->lanes_offset);
-		size_t len = pop->nlanes * sizeof(struct lane_layout);
-
-		for (unsigned r = 1; r < set->nreplicas; r++) {
-			rep = set->replica[r]->part[0].addr;
-			void *dst = (void *)((uintptr_t)rep +
-						pop->lanes_offset);
-			if (rep->rpp == NULL) {
-				rep->memcpy_persist_local(dst, src, len);
-			} else {
-				if (rep->persist_remote(rep, dst, len,
-						RLANE_DEFAULT) == NULL)
-					obj_handle_remote_persist_error(pop);
-			}
+		if (pop == NULL) {
+			info[i].ptr = NULL;
+			info[i].size = 0;
+			info[i].type_num = 0;
+			continue;
 		}
-	}
-
-	/*
-	 * before runtime initialization lanes are unavailable, remote persists
-	 * should use RLANE_DEFAULT
-	 */
-	pop->lanes_desc.runtime_nlanes = 0;
 
-#ifdef USE_VG_MEMCHECK
-	palloc_heap_vg_open((char *)pop + pop->heap_offset, pop->heap_size);
-#endif
+		uint64_t off = oids[i].off;
+		size_t header_size;
+		size_t usable_size = palloc_object_info(&pop->heap, off,
+			&header_size);
 
-	/* initialize runtime parts - lanes, obj stores, ... */
-	if (pmemobj_runtime_init(pop, 0, boot, runtime_nlanes) != 0) {
-		ERR("pool initialization failed");
-		goto err;
+		info[i].ptr = OBJ_OFF_TO_PTR(pop, off);
+		info[i].size = usable_size - OBJ_OOB_SIZE;
+		info[i].type_num = header_size == 0 ? 0 :
+			OOB_HEADER_FROM_OFF(pop, off)->type_num;
 	}
-
-#ifdef USE_VG_MEMCHECK
-	if (boot)
-		pmemobj_vg_boot(pop);
-#endif
-
-	LOG(3, "pop %p", pop);
-
-	return pop;
-
-err:
-	LOG(4, "error clean up");
-	int oerrno = errno;
-	if (set->remote)
-		pmemobj_cleanup_remote(pop);
-	util_poolset_close(set, 0);
-	errno = oerrno;
-	return NULL;
 }
 
 /*
- * pmemobj_open -- open a transactional memory pool
+ * Objects from runs with less than this percentage of used space are
+ * considered for relocation by pmemobj_defrag.
  */
-PMEMobjpool *
-pmemobj_open(const char *path, const char *layout)
-{
-	LOG(3, "path %s layout %s", path, layout);
+#define OBJ_DEFRAG_SPARSE_RUN 50
 
-	return pmemobj_open_common(path, layout, Open_cow, 1);
-}
+/* an object considered for relocation */
+struct obj_defrag_entry {
+	unsigned occupancy;
+	uint64_t chunk;
+	PMEMoid *oidp;
+};
 
 /*
- * obj_replicas_cleanup -- (internal) free resources allocated for replicas
+ * obj_defrag_entry_cmp -- (internal) orders the objects by the occupancy of
+ *	their runs, sparsest first, and then by the runs themselves
  */
-static void
-obj_replicas_cleanup(struct pool_set *set)
+static int
+obj_defrag_entry_cmp(const void *lhs, const void *rhs)
 {
-	LOG(3, "set %p", set);
+	const struct obj_defrag_entry *l = lhs;
+	const struct obj_defrag_entry *r = rhs;
 
-	for (unsigned r = 0; r < set->nreplicas; r++) {
-		struct pool_replica *rep = set->replica[r];
-
-		PMEMobjpool *pop = rep->part[0].addr;
-		redo_log_config_delete(pop->redo);
+	if (l->occupancy != r->occupancy)
+		return l->occupancy < r->occupancy ? -1 : 1;
 
-		if (pop->rpp != NULL) {
-			/*
-			 * remote replica will be closed in util_poolset_close
-			 */
-			pop->rpp = NULL;
+	if (l->chunk != r->chunk)
+		return l->chunk < r->chunk ? -1 : 1;
 
-			Free(pop->node_addr);
-			Free(pop->pool_desc);
-		}
-	}
+	return 0;
 }
 
 /*
- * obj_pool_cleanup -- (internal) cleanup the pool and unmap
+ * obj_defrag_relocate -- (internal) moves the object to a newly allocated
+ *	block, must be called in a transaction
+ *
+ * Objects without allocation headers stay in their allocation class.
  */
 static void
-obj_pool_cleanup(PMEMobjpool *pop)
-{
-	LOG(3, "pop %p", pop);
-
-	palloc_heap_cleanup(&pop->heap);
-
-	lane_cleanup(pop);
-
-	/* unmap all the replicas */
-	obj_replicas_cleanup(pop->set);
-	util_poolset_close(pop->set, 0);
-}
-
-/*
- * pmemobj_close -- close a transactional memory pool
- */
-void
-pmemobj_close(PMEMobjpool *pop)
+obj_defrag_relocate(PMEMobjpool *pop, PMEMoid *oidp)
 {
-	LOG(3, "pop %p", pop);
-
-	_pobj_cache_invalidate++;
+	uint64_t flags = 0;
+	if (palloc_header_size(&pop->heap, oidp->off) != OBJ_OOB_SIZE)
+		flags = POBJ_CLASS_ID(palloc_class_id(&pop->heap, oidp->off));
 
-	if (cuckoo_remove(pools_ht, pop->uuid_lo) != pop) {
-		ERR("cuckoo_remove");
-	}
+	size_t size = pmemobj_alloc_usable_size(*oidp);
+	PMEMoid new_oid = pmemobj_tx_xalloc(size, pmemobj_type_num(*oidp),
+		flags);
 
-	if (ctree_remove(pools_tree, (uint64_t)pop, 1) != (uint64_t)pop) {
-		ERR("ctree_remove");
-	}
+	pmemobj_memcpy_persist(pop, pmemobj_direct(new_oid),
+		pmemobj_direct(*oidp), size);
 
-#ifndef _WIN32
+	if (pmemobj_pool_by_ptr(oidp) == pop)
+		pmemobj_tx_add_range_direct(oidp, sizeof(*oidp));
 
-	if (_pobj_cached_pool.pop == pop) {
-		_pobj_cached_pool.pop = NULL;
-		_pobj_cached_pool.uuid_lo = 0;
-	}
+	pmemobj_tx_free(*oidp);
 
-#else /* _WIN32 */
+	*oidp = new_oid;
+}
 
-	struct _pobj_pcache *pcache = pthread_getspecific(Cached_pool_key);
-	if (pcache != NULL) {
-		if (pcache->pop == pop) {
-			pcache->pop = NULL;
-			pcache->uuid_lo = 0;
+/*
+ * obj_defrag_attach -- (internal) attaches back all the detached runs
+ */
+static void
+obj_defrag_attach(PMEMobjpool *pop, struct palloc_detached_run **runs,
+	size_t nruns)
+{
+	for (size_t i = 0; i < nruns; ++i) {
+		if (runs[i] != NULL) {
+			palloc_run_attach(&pop->heap, runs[i]);
+			runs[i] = NULL;
 		}
 	}
-
-#endif /* _WIN32 */
-
-	obj_pool_cleanup(pop);
 }
 
 /*
- * pmemobj_check -- transactional memory pool consistency check
+ * pmemobj_defrag -- relocates the objects from sparsely used runs
+ *
+ * The sparsest runs are evacuated, for as long as their objects fit in the
+ * free space of the remaining sparse runs. The free blocks of the evacuated
+ * runs are detached from their buckets for the duration of the transaction,
+ * so that the objects can only be moved to the other runs.
  */
 int
-pmemobj_check(const char *path, const char *layout)
+pmemobj_defrag(PMEMobjpool *pop, PMEMoid **oidv, size_t oidcnt,
+	struct pobj_defrag_result *result)
 {
-	LOG(3, "path %s layout %s", path, layout);
+	LOG(3, "pop %p oidv %p oidcnt %zu", pop, oidv, oidcnt);
 
-	PMEMobjpool *pop = pmemobj_open_common(path, layout, 1, 0);
-	if (pop == NULL)
-		return -1;	/* errno set by pmemobj_open_common() */
+	/* the runs must be attached back before an outer abort */
+	if (pmemobj_tx_stage() != TX_STAGE_NONE) {
+		ERR("defragmentation inside a transaction");
+		errno = EINVAL;
+		return -1;
+	}
 
-	int consistent = 1;
+	struct pobj_defrag_result r = {0, 0};
 
-	/*
-	 * For replicated pools, basic consistency check is performed
-	 * in pmemobj_open_common().
-	 */
-	if (pop->replica == NULL)
-		consistent = pmemobj_check_basic(pop);
+	struct obj_defrag_entry *entries = Malloc(sizeof(*entries) *
+		(oidcnt ? oidcnt : 1));
+	if (entries == NULL) {
+		ERR("!Malloc");
+		return -1;
+	}
 
-	if (consistent && (errno = pmemobj_boot(pop)) != 0) {
-		LOG(3, "!pmemobj_boot");
-		consistent = 0;
+	size_t nentries = 0;
+	for (size_t i = 0; i < oidcnt; ++i) {
+		if (OID_IS_NULL(*oidv[i]))
+			continue;
+
+		r.total++;
+
+		struct obj_defrag_entry *e = &entries[nentries];
+		e->occupancy = palloc_occupancy(&pop->heap, oidv[i]->off,
+			&e->chunk);
+		e->oidp = oidv[i];
+		if (e->occupancy < OBJ_DEFRAG_SPARSE_RUN)
+			nentries++;
 	}
 
-	if (consistent) {
-		obj_pool_cleanup(pop);
-	} else {
-		/* unmap all the replicas */
-		obj_replicas_cleanup(pop->set);
-		util_poolset_close(pop->set, 0);
+	qsort(entries, nentries, sizeof(*entries), obj_defrag_entry_cmp);
+
+	/* the objects from the same run are now next to each other */
+	size_t nruns = 0;
+	uint64_t free_space = 0;
+	for (size_t i = 0; i < nentries; ++i) {
+		if (i == 0 || entries[i].chunk != entries[i - 1].chunk) {
+			nruns++;
+			free_space += 100 - entries[i].occupancy;
+		}
 	}
 
-	if (consistent)
-		LOG(4, "pool consistency check OK");
+	struct palloc_detached_run **runs = Malloc(sizeof(*runs) *
+		(nruns ? nruns : 1));
+	if (runs == NULL) {
+		ERR("!Malloc");
+		Free(entries);
+		return -1;
+	}
 
-	return consistent;
-}
+	/* the lane might have cached blocks from the evacuated runs */
+	pmalloc_cache_flush(pop);
+
+	size_t nevac = 0;
+	size_t ndetached = 0;
+	uint64_t used_space = 0;
+	while (nevac < nentries) {
+		unsigned occupancy = entries[nevac].occupancy;
+		free_space -= 100 - occupancy;
+		used_space += occupancy;
+		if (used_space > free_space)
+			break;
+
+		runs[ndetached] = palloc_run_detach(&pop->heap,
+			entries[nevac].oidp->off);
+		if (runs[ndetached] == NULL)
+			break;
+
+		uint64_t chunk = entries[nevac].chunk;
+		while (nevac < nentries && entries[nevac].chunk == chunk)
+			nevac++;
+
+		ndetached++;
+	}
 
-/*
- * pmemobj_pool_by_oid -- returns the pool handle associated with the oid
- */
-PMEMobjpool *
-pmemobj_pool_by_oid(PMEMoid oid)
-{
-	LOG(3, "oid.off 0x%016jx", oid.off);
+	int ret = 0;
+	TX_BEGIN(pop) {
+		for (size_t i = 0; i < nevac; ++i) {
+			obj_defrag_relocate(pop, entries[i].oidp);
+			r.relocated++;
+		}
 
-	return cuckoo_get(pools_ht, oid.pool_uuid_lo);
-}
+		/* the old blocks are freed on commit, coalescing with these */
+		obj_defrag_attach(pop, runs, ndetached);
+	} TX_ONABORT {
+		ret = -1;
+	} TX_END
 
-/*
- * pmemobj_pool_by_ptr -- returns the pool handle associated with the address
- */
-PMEMobjpool *
-pmemobj_pool_by_ptr(const void *addr)
-{
-	LOG(3, "addr %p", addr);
+	obj_defrag_attach(pop, runs, ndetached);
 
-	uint64_t key = (uint64_t)addr;
-	size_t pool_size = ctree_find_le(pools_tree, &key);
+	Free(runs);
+	Free(entries);
 
-	if (pool_size == 0)
-		return NULL;
+	if (ret != 0)
+		return -1;
 
-	ASSERT((uint64_t)addr >= key);
-	uint64_t addr_off = (uint64_t)addr - key;
+	/* the freed blocks might keep the emptied runs from being degraded */
+	pmalloc_cache_flush(pop);
 
-	if (pool_size <= addr_off)
-		return NULL;
+	if (result != NULL)
+		*result = r;
 
-	return (PMEMobjpool *)key;
+	return 0;
 }
 
-/* arguments for constructor_alloc_bytype */
-struct carg_bytype {
-	type_num_t user_type;
-	int zero_init;
+/* arguments for constructor_alloc_root */
+struct carg_root {
+	size_t size;
 	pmemobj_constr constructor;
 	void *arg;
 };
 
 /*
- * constructor_alloc_bytype -- (internal) constructor for obj_alloc_construct
+ * constructor_alloc_root -- (internal) constructor for obj_alloc_root
  */
 static int
-constructor_alloc_bytype(void *ctx, void *ptr, size_t usable_size, void *arg)
+constructor_alloc_root(void *ctx, void *ptr, size_t usable_size, void *arg)
 {
 	PMEMobjpool *pop = ctx;
 	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
@@ -1541,44 +4226,69 @@ constructor_alloc_bytype(void *ctx, void *ptr, size_t usable_size, void *arg)
 	ASSERTne(ptr, NULL);
 	ASSERTne(arg, NULL);
 
-	struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
-	struct carg_bytype *carg = arg;
+	int ret = 0;
 
-	pobj->undo_entry_offset = 0;
-	pobj->type_num = carg->user_type;
-	pobj->size = 0;
-	memset(pobj->unused, 0, sizeof(pobj->unused));
+	struct oob_header *ro = OOB_HEADER_FROM_PTR(ptr);
+	struct carg_root *carg = arg;
 
-	if (carg->zero_init)
-		pmemops_memset_persist(p_ops, ptr, 0, usable_size);
+	/* temporarily add atomic root allocation to pmemcheck transaction */
+	VALGRIND_ADD_TO_TX(ro, OBJ_OOB_SIZE + usable_size);
 
-	int ret = 0;
 	if (carg->constructor)
 		ret = carg->constructor(pop, ptr, carg->arg);
+	else
+		pmemops_memset_persist(p_ops, ptr, 0, usable_size);
+
+	ro->undo_entry_offset = 0;
+	ro->type_num = POBJ_ROOT_TYPE_NUM;
+	ro->size = carg->size | OBJ_INTERNAL_OBJECT_MASK;
+
+	VALGRIND_REMOVE_FROM_TX(ro, OBJ_OOB_SIZE + usable_size);
+
+	pmemops_persist(p_ops, &ro->size,
+		/* there's no padding between these, so we can add sizes */
+		sizeof(ro->size) + sizeof(ro->type_num));
 
 	return ret;
 }
 
 /*
- * obj_alloc_construct -- (internal) allocates a new object with constructor
+ * obj_alloc_root -- (internal) allocate root object
  */
 static int
-obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-	type_num_t type_num, int zero_init,
-	pmemobj_constr constructor,
-	void *arg)
+obj_alloc_root(PMEMobjpool *pop, size_t size,
+	pmemobj_constr constructor, void *arg)
 {
-	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
-		ERR("requested size too large");
-		errno = ENOMEM;
-		return -1;
-	}
+	LOG(3, "pop %p size %zu", pop, size);
 
-	struct carg_bytype carg;
+	struct carg_root carg;
 
-	carg.user_type = type_num;
-	carg.zero_init = zero_init;
+	carg.size = size;
+	carg.constructor = constructor;
+	carg.arg = arg;
+
+	return pmalloc_construct(pop, &pop->root_offset,
+		size + OBJ_OOB_SIZE, constructor_alloc_root, &carg);
+}
+
+/*
+ * obj_realloc_root -- (internal) reallocate root object
+ */
+static int
+obj_realloc_root(PMEMobjpool *pop, size_t size,
+	size_t old_size,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p size %zu old_size %zu", pop, size, old_size);
+
+	struct carg_realloc carg;
+
+	carg.ptr = OBJ_OFF_TO_PTR(pop, pop->root_offset);
+	carg.old_size = old_size;
+	carg.new_size = size;
+	carg.user_type = POBJ_ROOT_TYPE_NUM;
 	carg.constructor = constructor;
+	carg.zero_init = 1;
 	carg.arg = arg;
 
 	struct redo_log *redo = pmalloc_redo_hold(pop);
@@ -1586,13 +4296,18 @@ obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	struct operation_context ctx;
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	if (oidp)
-		operation_add_entry(&ctx, &oidp->pool_uuid_lo, pop->uuid_lo,
-				OPERATION_SET);
+	/*
+	 * The constructor sets the size of a new root object, but if the
+	 * existing one is extended in-place, its size has to be updated
+	 * atomically alongside the heap metadata.
+	 */
+	struct oob_header *ro = OOB_HEADER_FROM_OFF(pop, pop->root_offset);
+	operation_add_entry(&ctx, &ro->size, size | OBJ_INTERNAL_OBJECT_MASK,
+		OPERATION_SET);
 
-	int ret = pmalloc_operation(&pop->heap, 0,
-			oidp != NULL ? &oidp->off : NULL, size + OBJ_OOB_SIZE,
-			constructor_alloc_bytype, &carg, &ctx);
+	int ret = pmalloc_operation(&pop->heap, pop->root_offset,
+			&pop->root_offset, size + OBJ_OOB_SIZE,
+			constructor_zrealloc_root, &carg, &ctx, 0, 0);
 
 	pmalloc_redo_release(pop);
 
@@ -1600,637 +4315,719 @@ obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 }
 
 /*
- * pmemobj_alloc -- allocates a new object
+ * pmemobj_root_size -- returns size of the root object
  */
-int
-pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-	uint64_t type_num, pmemobj_constr constructor, void *arg)
+size_t
+pmemobj_root_size(PMEMobjpool *pop)
 {
-	LOG(3, "pop %p oidp %p size %zu type_num %llx constructor %p arg %p",
-		pop, oidp, size, (unsigned long long)type_num,
-		constructor, arg);
-
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
-
-	if (size == 0) {
-		ERR("allocation with size 0");
-		errno = EINVAL;
-		return -1;
-	}
+	LOG(3, "pop %p", pop);
 
-	return obj_alloc_construct(pop, oidp, size, type_num,
-			0, constructor, arg);
+	if (pop->root_offset) {
+		struct oob_header *ro =
+			OOB_HEADER_FROM_OFF(pop, pop->root_offset);
+		return ro->size & ~OBJ_INTERNAL_OBJECT_MASK;
+	} else
+		return 0;
 }
 
-/* arguments for constructor_realloc and constructor_zrealloc */
-struct carg_realloc {
-	void *ptr;
-	size_t old_size;
-	size_t new_size;
-	int zero_init;
-	type_num_t user_type;
-	pmemobj_constr constructor;
-	void *arg;
-};
-
 /*
- * pmemobj_zalloc -- allocates a new zeroed object
+ * pmemobj_lane_stats -- returns the lane statistics of the pool
  */
 int
-pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-		uint64_t type_num)
+pmemobj_lane_stats(PMEMobjpool *pop, struct pobj_lane_stats *stats)
 {
-	LOG(3, "pop %p oidp %p size %zu type_num %llx",
-			pop, oidp, size, (unsigned long long)type_num);
-
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
+	LOG(3, "pop %p stats %p", pop, stats);
 
-	if (size == 0) {
-		ERR("allocation with size 0");
-		errno = EINVAL;
+	if (lane_stats_get(pop, stats) != 0) {
+		ERR("lane statistics not enabled");
+		errno = ENOTSUP;
 		return -1;
 	}
 
-	return obj_alloc_construct(pop, oidp, size, type_num,
-					1, NULL, NULL);
-}
-
-/*
- * obj_free -- (internal) free an object
- */
-static void
-obj_free(PMEMobjpool *pop, PMEMoid *oidp)
-{
-	ASSERTne(oidp, NULL);
-
-	struct redo_log *redo = pmalloc_redo_hold(pop);
-
-	struct operation_context ctx;
-	operation_init(&ctx, pop, pop->redo, redo);
-
-	operation_add_entry(&ctx, &oidp->pool_uuid_lo, 0, OPERATION_SET);
-
-	pmalloc_operation(&pop->heap, oidp->off, &oidp->off, 0, NULL, NULL,
-			&ctx);
-
-	pmalloc_redo_release(pop);
+	return 0;
 }
 
 /*
- * constructor_realloc -- (internal) constructor for pmemobj_realloc
+ * pmemobj_persist_stats -- returns the flush and fence counts of the pool
  */
-static int
-constructor_realloc(void *ctx, void *ptr, size_t usable_size, void *arg)
-{
-	PMEMobjpool *pop = ctx;
-	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
-	struct pmem_ops *p_ops = &pop->p_ops;
-
-	ASSERTne(ptr, NULL);
-	ASSERTne(arg, NULL);
-
-	struct carg_realloc *carg = arg;
-	struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
-
-	if (ptr != carg->ptr) {
-		pobj->undo_entry_offset = 0;
-		pobj->type_num = carg->user_type;
-		pobj->size = 0;
-	}
-
-	if (!carg->zero_init)
-		return 0;
-
-	if (usable_size > carg->old_size) {
-		size_t grow_len = usable_size - carg->old_size;
-		void *new_data_ptr = (void *)((uintptr_t)ptr + carg->old_size);
+int
+pmemobj_persist_stats(PMEMobjpool *pop,
+	struct pobj_persist_stats stats[POBJ_PERSIST_OPS])
+{
+	LOG(3, "pop %p stats %p", pop, stats);
 
-		pmemops_memset_persist(p_ops, new_data_ptr, 0, grow_len);
+	if (obj_persist_stats_get(pop, stats) != 0) {
+		ERR("persist statistics not enabled");
+		errno = ENOTSUP;
+		return -1;
 	}
 
 	return 0;
 }
 
 /*
- * obj_realloc_common -- (internal) common routine for resizing
- *                          existing objects
+ * pmemobj_heap_stats -- returns the fragmentation statistics of the heap
  */
-static int
-obj_realloc_common(PMEMobjpool *pop,
-	PMEMoid *oidp, size_t size, type_num_t type_num, int zero_init)
+int
+pmemobj_heap_stats(PMEMobjpool *pop, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses)
 {
-	/* if OID is NULL just allocate memory */
-	if (OBJ_OID_IS_NULL(*oidp)) {
-		/* if size is 0 - do nothing */
-		if (size == 0)
-			return 0;
+	LOG(3, "pop %p stats %p classes %p nclasses %u", pop, stats, classes,
+		nclasses);
 
-		return obj_alloc_construct(pop, oidp, size, type_num,
-				zero_init, NULL, NULL);
+	if (classes == NULL && nclasses != 0) {
+		ERR("no room for the allocation class statistics");
+		errno = EINVAL;
+		return -1;
 	}
 
+	palloc_heap_stats(&pop->heap, stats, classes, nclasses);
+
+	return 0;
+}
+
+/*
+ * pmemobj_root_construct -- returns root object
+ */
+PMEMoid
+pmemobj_root_construct(PMEMobjpool *pop, size_t size,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p size %zu constructor %p args %p", pop, size, constructor,
+		arg);
+
 	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
 		ERR("requested size too large");
 		errno = ENOMEM;
-		return -1;
+		return OID_NULL;
 	}
 
-	/* if size is 0 just free */
-	if (size == 0) {
-		obj_free(pop, oidp);
-		return 0;
+	PMEMoid root;
+
+	/*
+	 * The root object is only ever replaced by a larger one, so an
+	 * existing root which is large enough is returned without the lock.
+	 *
+	 * When the root is moved, the header of the old one gets the new size
+	 * before root_offset is updated, so the offset and the size are only
+	 * trusted if root_seq was even and didn't change while they were read.
+	 */
+	unsigned seq = util_atomic_load_acquire32(&pop->root_seq);
+	uint64_t off = *(volatile uint64_t *)&pop->root_offset;
+	if (likely(off != 0) && likely((seq & 1) == 0)) {
+		struct oob_header *ro = OOB_HEADER_FROM_OFF(pop, off);
+		uint64_t root_size = *(volatile uint64_t *)&ro->size;
+
+		__sync_synchronize();
+
+		if (size <= (root_size & ~OBJ_INTERNAL_OBJECT_MASK) &&
+				*(volatile unsigned *)&pop->root_seq == seq) {
+			root.pool_uuid_lo = pop->uuid_lo;
+			root.off = off;
+			return root;
+		}
 	}
 
-	struct oob_header *pobj = OOB_HEADER_FROM_OID(pop, *oidp);
-	type_num_t user_type_old = pobj->type_num;
+	if (pop->rdonly) {
+		if (pop->root_offset == 0 || size > pmemobj_root_size(pop)) {
+			ERR("cannot modify a read-only pool");
+			errno = EROFS;
+			return OID_NULL;
+		}
 
-	struct carg_realloc carg;
-	carg.ptr = OBJ_OFF_TO_PTR(pop, oidp->off);
-	carg.new_size = size;
-	carg.old_size = pmemobj_alloc_usable_size(*oidp);
-	carg.user_type = type_num;
-	carg.constructor = NULL;
-	carg.arg = NULL;
-	carg.zero_init = zero_init;
+		root.pool_uuid_lo = pop->uuid_lo;
+		root.off = pop->root_offset;
+		return root;
+	}
 
-	struct redo_log *redo = pmalloc_redo_hold(pop);
+	pmemobj_mutex_lock_nofail(pop, &pop->rootlock);
 
-	struct operation_context ctx;
-	operation_init(&ctx, pop, pop->redo, redo);
+	size_t old_size = pmemobj_root_size(pop);
+	if (pop->root_offset == 0 || size > old_size) {
+		/* the readers take the lock until root_seq is even again */
+		__sync_fetch_and_add(&pop->root_seq, 1);
 
-	int ret;
-	if (type_num == user_type_old) {
-		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
-			size + OBJ_OOB_SIZE,
-			constructor_realloc, &carg, &ctx);
-	} else {
-		operation_add_entry(&ctx, &pobj->type_num, type_num,
-				OPERATION_SET);
+		int ret = 0;
+		if (pop->root_offset == 0)
+			obj_alloc_root(pop, size, constructor, arg);
+		else
+			ret = obj_realloc_root(pop, size, old_size,
+				constructor, arg);
 
-		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
-			size + OBJ_OOB_SIZE, constructor_realloc, &carg, &ctx);
+		__sync_fetch_and_add(&pop->root_seq, 1);
+
+		if (ret) {
+			pmemobj_mutex_unlock_nofail(pop, &pop->rootlock);
+			LOG(2, "obj_realloc_root failed");
+			return OID_NULL;
+		}
 	}
-	pmalloc_redo_release(pop);
+	root.pool_uuid_lo = pop->uuid_lo;
+	root.off = pop->root_offset;
 
-	return ret;
+	pmemobj_mutex_unlock_nofail(pop, &pop->rootlock);
+	return root;
 }
 
 /*
- * constructor_zrealloc_root -- (internal) constructor for pmemobj_root
+ * pmemobj_root -- returns root object
  */
-static int
-constructor_zrealloc_root(void *ctx, void *ptr, size_t usable_size, void *arg)
+PMEMoid
+pmemobj_root(PMEMobjpool *pop, size_t size)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
-
-	ASSERTne(ptr, NULL);
-	ASSERTne(arg, NULL);
-
-	struct carg_realloc *carg = arg;
+	LOG(3, "pop %p size %zu", pop, size);
 
-	VALGRIND_ADD_TO_TX(OOB_HEADER_FROM_PTR(ptr),
-		usable_size + OBJ_OOB_SIZE);
+	return pmemobj_root_construct(pop, size, NULL, NULL);
+}
 
-	struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
+/*
+ * obj_is_internal -- (internal) checks whether the object is used by
+ *	the library itself, which is never the case for objects without headers
+ */
+static int
+obj_is_internal(PMEMobjpool *pop, uint64_t off)
+{
+	if (palloc_header_size(&pop->heap, off) == 0)
+		return 0;
 
-	constructor_realloc(pop, ptr, usable_size, arg);
-	if (ptr != carg->ptr) {
-		pobj->size = carg->new_size | OBJ_INTERNAL_OBJECT_MASK;
-	}
+	return (OOB_HEADER_FROM_OFF(pop, off)->size &
+		OBJ_INTERNAL_OBJECT_MASK) != 0;
+}
 
-	int ret = 0;
-	if (carg->constructor)
-		ret = carg->constructor(pop, ptr, carg->arg);
+/* initial number of the offsets in an entry of the type index */
+#define OBJ_TYPE_ENTRY_MIN 64
 
-	VALGRIND_REMOVE_FROM_TX(OOB_HEADER_FROM_PTR(ptr),
-		carg->new_size + OBJ_OOB_SIZE);
+/*
+ * Offsets of all the objects of a single type number, in the order in which
+ * pmemobj_next returns them. They are current as long as the heap is still at
+ * the generation they were collected at.
+ */
+struct obj_type_entry {
+	uint64_t generation;
+	size_t nobjs;
+	size_t capacity;
+	uint64_t *offs;
+	struct obj_type_entry *next;
+};
 
-	return ret;
-}
+/*
+ * Volatile index of the objects by type number. An entry is collected in
+ * a single pass through the heap when the objects of its type are looked for
+ * and it is dropped by any allocation or free, until the next lookup.
+ */
+struct obj_type_index {
+	pthread_mutex_t lock;
+	struct cuckoo *types;		/* type number -> obj_type_entry */
+	struct obj_type_entry *entries;	/* all the entries */
+};
 
 /*
- * pmemobj_realloc -- resizes an existing object
+ * obj_type_index_get -- (internal) returns the type index of the pool,
+ *	creating it if necessary, or NULL
  */
-int
-pmemobj_realloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-		uint64_t type_num)
+static struct obj_type_index *
+obj_type_index_get(PMEMobjpool *pop)
 {
-	ASSERTne(oidp, NULL);
+	if (likely(pop->type_index != NULL))
+		return pop->type_index;
 
-	LOG(3, "pop %p oid.off 0x%016jx size %zu type_num %lu",
-		pop, oidp->off, size, type_num);
+	struct obj_type_index *idx = Zalloc(sizeof(*idx));
+	if (idx == NULL)
+		return NULL;
 
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
-	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+	idx->types = cuckoo_new();
+	if (idx->types == NULL) {
+		Free(idx);
+		return NULL;
+	}
+	util_mutex_init(&idx->lock, NULL);
+
+	if (!util_bool_compare_and_swap64((uint64_t *)&pop->type_index,
+			0, (uint64_t)idx)) {
+		/* another thread was faster */
+		util_mutex_destroy(&idx->lock);
+		cuckoo_delete(idx->types);
+		Free(idx);
+	}
 
-	return obj_realloc_common(pop, oidp, size, (type_num_t)type_num, 0);
+	return pop->type_index;
 }
 
 /*
- * pmemobj_zrealloc -- resizes an existing object, any new space is zeroed.
+ * obj_type_index_delete -- (internal) deletes the type index of the pool
  */
-int
-pmemobj_zrealloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-		uint64_t type_num)
+static void
+obj_type_index_delete(PMEMobjpool *pop)
 {
-	ASSERTne(oidp, NULL);
-
-	LOG(3, "pop %p oid.off 0x%016jx size %zu type_num %lu",
-		pop, oidp->off, size, type_num);
+	struct obj_type_index *idx = pop->type_index;
+	if (idx == NULL)
+		return;
 
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
-	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+	while (idx->entries != NULL) {
+		struct obj_type_entry *e = idx->entries;
+		idx->entries = e->next;
+		Free(e->offs);
+		Free(e);
+	}
 
-	return obj_realloc_common(pop, oidp, size, (type_num_t)type_num, 1);
+	cuckoo_delete(idx->types);
+	util_mutex_destroy(&idx->lock);
+	Free(idx);
+	pop->type_index = NULL;
 }
 
-/* arguments for constructor_strdup */
-struct carg_strdup {
-	size_t size;
-	const char *s;
+struct obj_type_collect {
+	PMEMobjpool *pop;
+	uint64_t type_num;
+	struct obj_type_entry *e;
+	int err;
 };
 
 /*
- * constructor_strdup -- (internal) constructor of pmemobj_strdup
+ * obj_type_entry_append -- (internal) appends the offset, which must follow
+ *	all the others, to the entry
  */
 static int
-constructor_strdup(PMEMobjpool *pop, void *ptr, void *arg)
+obj_type_entry_append(struct obj_type_entry *e, uint64_t off)
 {
-	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
-
-	ASSERTne(ptr, NULL);
-	ASSERTne(arg, NULL);
-
-	struct carg_strdup *carg = arg;
+	if (e->nobjs == e->capacity) {
+		size_t capacity = e->capacity ?
+			e->capacity * 2 : OBJ_TYPE_ENTRY_MIN;
+		uint64_t *offs = Realloc(e->offs, capacity * sizeof(*offs));
+		if (offs == NULL)
+			return -1;
+		e->offs = offs;
+		e->capacity = capacity;
+	}
 
-	/* copy string */
-	pmemops_memcpy_persist(&pop->p_ops, ptr, carg->s, carg->size);
+	ASSERT(e->nobjs == 0 || e->offs[e->nobjs - 1] < off);
+	e->offs[e->nobjs++] = off;
 
 	return 0;
 }
 
 /*
- * pmemobj_strdup -- allocates a new object with duplicate of the string s.
+ * obj_type_collect_cb -- (internal) palloc_foreach callback, appends
+ *	the object to the entry if it is of its type
  */
-int
-pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
-		uint64_t type_num)
+static int
+obj_type_collect_cb(uint64_t off, void *arg)
 {
-	LOG(3, "pop %p oidp %p string %s type_num %lu", pop, oidp, s, type_num);
+	struct obj_type_collect *c = arg;
 
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
+	if (obj_is_internal(c->pop, off) ||
+			obj_type_num(c->pop, off) != c->type_num)
+		return 0;
 
-	if (NULL == s) {
-		errno = EINVAL;
-		return -1;
+	if (obj_type_entry_append(c->e, off) != 0) {
+		c->err = 1;
+		return 1;
 	}
 
-	struct carg_strdup carg;
-	carg.size = (strlen(s) + 1) * sizeof(char);
-	carg.s = s;
-
-	return obj_alloc_construct(pop, oidp, carg.size,
-		(type_num_t)type_num, 0, constructor_strdup, &carg);
+	return 0;
 }
 
 /*
- * pmemobj_free -- frees an existing object
+ * obj_type_entry_get -- (internal) returns the current entry of the type
+ *	number, collecting it anew if it's not current and 'collect' is set,
+ *	or NULL
+ *
+ * Must be called with the index locked.
  */
-void
-pmemobj_free(PMEMoid *oidp)
+static struct obj_type_entry *
+obj_type_entry_get(PMEMobjpool *pop, struct obj_type_index *idx,
+	uint64_t type_num, int collect)
 {
-	ASSERTne(oidp, NULL);
-
-	LOG(3, "oid.off 0x%016jx", oidp->off);
-
-	/* log notice message if used inside a transaction */
-	_POBJ_DEBUG_NOTICE_IN_TX();
+	/* read before the objects are collected, see palloc_heap_modified */
+	uint64_t generation = pop->heap.generation;
 
-	if (oidp->off == 0)
-		return;
-
-	PMEMobjpool *pop = pmemobj_pool_by_oid(*oidp);
+	struct obj_type_entry *e = cuckoo_get(idx->types, type_num);
+	if (e != NULL && e->generation == generation)
+		return e;
 
-	ASSERTne(pop, NULL);
-	ASSERT(OBJ_OID_IS_VALID(pop, *oidp));
+	if (!collect)
+		return NULL;
 
-	obj_free(pop, oidp);
-}
+	if (e == NULL) {
+		e = Zalloc(sizeof(*e));
+		if (e == NULL)
+			return NULL;
 
-/*
- * pmemobj_alloc_usable_size -- returns usable size of object
- */
-size_t
-pmemobj_alloc_usable_size(PMEMoid oid)
-{
-	LOG(3, "oid.off 0x%016jx", oid.off);
+		if (cuckoo_insert(idx->types, type_num, e) != 0) {
+			Free(e);
+			return NULL;
+		}
+		e->next = idx->entries;
+		idx->entries = e;
+	}
 
-	if (oid.off == 0)
-		return 0;
+	struct obj_type_collect c = {pop, type_num, e, 0};
 
-	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
+	e->nobjs = 0;
+	palloc_foreach(&pop->heap, obj_type_collect_cb, &c);
+	if (c.err) {
+		/* nothing can be current at this generation */
+		e->generation = UINT64_MAX;
+		return NULL;
+	}
 
-	ASSERTne(pop, NULL);
-	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+	e->generation = generation;
+	LOG(4, "type %" PRIu64 " objects %zu", type_num, e->nobjs);
 
-	return (palloc_usable_size(&pop->heap, oid.off) - OBJ_OOB_SIZE);
+	return e;
 }
 
 /*
- * pmemobj_memcpy_persist -- pmemobj version of memcpy
+ * obj_type_entry_next -- (internal) returns the offset of the first object
+ *	of the entry following the given offset, or 0
  */
-void *
-pmemobj_memcpy_persist(PMEMobjpool *pop, void *dest, const void *src,
-	size_t len)
+static uint64_t
+obj_type_entry_next(struct obj_type_entry *e, uint64_t off)
 {
-	LOG(15, "pop %p dest %p src %p len %zu", pop, dest, src, len);
+	size_t l = 0;
+	size_t r = e->nobjs;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (e->offs[m] <= off)
+			l = m + 1;
+		else
+			r = m;
+	}
 
-	return pmemops_memcpy_persist(&pop->p_ops, dest, src, len);
+	return l < e->nobjs ? e->offs[l] : 0;
 }
 
 /*
- * pmemobj_memset_persist -- pmemobj version of memset
+ * pmemobj_first - returns first object of specified type
  */
-void *
-pmemobj_memset_persist(PMEMobjpool *pop, void *dest, int c, size_t len)
+PMEMoid
+pmemobj_first(PMEMobjpool *pop)
 {
-	LOG(15, "pop %p dest %p c 0x%02x len %zu", pop, dest, c, len);
+	LOG(3, "pop %p", pop);
 
-	return pmemops_memset_persist(&pop->p_ops, dest, c, len);
-}
+	PMEMoid ret = {0, 0};
 
-/*
- * pmemobj_persist -- pmemobj version of pmem_persist
- */
-void
-pmemobj_persist(PMEMobjpool *pop, const void *addr, size_t len)
-{
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	uint64_t off = palloc_first(&pop->heap);
+	if (off != 0) {
+		ret.off = off;
+		ret.pool_uuid_lo = pop->uuid_lo;
+
+		if (obj_is_internal(pop, ret.off))
+			return pmemobj_next(ret);
+	}
 
-	pmemops_persist(&pop->p_ops, addr, len);
+	return ret;
 }
 
 /*
- * pmemobj_flush -- pmemobj version of pmem_flush
+ * pmemobj_next - returns next object of specified type
  */
-void
-pmemobj_flush(PMEMobjpool *pop, const void *addr, size_t len)
+PMEMoid
+pmemobj_next(PMEMoid oid)
 {
-	LOG(15, "pop %p addr %p len %zu", pop, addr, len);
+	LOG(3, "oid.off 0x%016jx", oid.off);
 
-	pmemops_flush(&pop->p_ops, addr, len);
-}
+	if (oid.off == 0)
+		return OID_NULL;
 
-/*
- * pmemobj_drain -- pmemobj version of pmem_drain
- */
-void
-pmemobj_drain(PMEMobjpool *pop)
-{
-	LOG(15, "pop %p", pop);
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
 
-	pmemops_drain(&pop->p_ops);
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+
+	PMEMoid ret = {0, 0};
+	uint64_t off = palloc_next(&pop->heap, oid.off);
+	if (off != 0) {
+		ret.off = off;
+		ret.pool_uuid_lo = pop->uuid_lo;
+
+		if (obj_is_internal(pop, ret.off))
+			return pmemobj_next(ret);
+	}
+
+	return ret;
 }
 
 /*
- * pmemobj_type_num -- returns type number of object
+ * pmemobj_first_type -- returns the first object of the specified type number
  */
-uint64_t
-pmemobj_type_num(PMEMoid oid)
+PMEMoid
+pmemobj_first_type(PMEMobjpool *pop, uint64_t type_num)
 {
-	LOG(3, "oid.off 0x%016jx", oid.off);
+	LOG(3, "pop %p type_num %" PRIu64, pop, type_num);
+
+	PMEMoid ret = OID_NULL;
+
+	/* the objects of a read-only pool may change under the index */
+	struct obj_type_index *idx = pop->rdonly ?
+		NULL : obj_type_index_get(pop);
+	if (idx != NULL) {
+		util_mutex_lock(&idx->lock);
+		struct obj_type_entry *e =
+			obj_type_entry_get(pop, idx, type_num, 1);
+		if (e != NULL && e->nobjs != 0) {
+			ret.pool_uuid_lo = pop->uuid_lo;
+			ret.off = e->offs[0];
+		}
+		util_mutex_unlock(&idx->lock);
 
-	ASSERT(!OID_IS_NULL(oid));
+		if (e != NULL)
+			return ret;
+	}
 
-	void *ptr = pmemobj_direct(oid);
+	/* the objects couldn't be collected, walk through all of them */
+	ret = pmemobj_first(pop);
+	while (!OID_IS_NULL(ret) && obj_type_num(pop, ret.off) != type_num)
+		ret = pmemobj_next(ret);
 
-	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
-	return oobh->type_num;
+	return ret;
 }
 
-/* arguments for constructor_alloc_root */
-struct carg_root {
-	size_t size;
-	pmemobj_constr constructor;
-	void *arg;
-};
-
 /*
- * constructor_alloc_root -- (internal) constructor for obj_alloc_root
+ * pmemobj_next_type -- returns the next object of the same type number
  */
-static int
-constructor_alloc_root(void *ctx, void *ptr, size_t usable_size, void *arg)
+PMEMoid
+pmemobj_next_type(PMEMoid oid)
 {
-	PMEMobjpool *pop = ctx;
-	LOG(3, "pop %p ptr %p arg %p", pop, ptr, arg);
-	struct pmem_ops *p_ops = &pop->p_ops;
-
-	ASSERTne(ptr, NULL);
-	ASSERTne(arg, NULL);
+	LOG(3, "oid.off 0x%016jx", oid.off);
 
-	int ret = 0;
+	if (oid.off == 0)
+		return OID_NULL;
 
-	struct oob_header *ro = OOB_HEADER_FROM_PTR(ptr);
-	struct carg_root *carg = arg;
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
 
-	/* temporarily add atomic root allocation to pmemcheck transaction */
-	VALGRIND_ADD_TO_TX(ro, OBJ_OOB_SIZE + usable_size);
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
 
-	if (carg->constructor)
-		ret = carg->constructor(pop, ptr, carg->arg);
-	else
-		pmemops_memset_persist(p_ops, ptr, 0, usable_size);
+	uint64_t type_num = obj_type_num(pop, oid.off);
+	PMEMoid ret = OID_NULL;
 
-	ro->undo_entry_offset = 0;
-	ro->type_num = POBJ_ROOT_TYPE_NUM;
-	ro->size = carg->size | OBJ_INTERNAL_OBJECT_MASK;
+	/*
+	 * The entry is not collected here - if it's not current, the objects
+	 * were modified during the iteration, which is likely to go on.
+	 */
+	struct obj_type_index *idx = pop->type_index;
+	if (idx != NULL) {
+		util_mutex_lock(&idx->lock);
+		struct obj_type_entry *e =
+			obj_type_entry_get(pop, idx, type_num, 0);
+		if (e != NULL) {
+			ret.off = obj_type_entry_next(e, oid.off);
+			if (ret.off != 0)
+				ret.pool_uuid_lo = pop->uuid_lo;
+		}
+		util_mutex_unlock(&idx->lock);
 
-	VALGRIND_REMOVE_FROM_TX(ro, OBJ_OOB_SIZE + usable_size);
+		if (e != NULL)
+			return ret;
+	}
 
-	pmemops_persist(p_ops, &ro->size,
-		/* there's no padding between these, so we can add sizes */
-		sizeof(ro->size) + sizeof(ro->type_num));
+	ret = pmemobj_next(oid);
+	while (!OID_IS_NULL(ret) && obj_type_num(pop, ret.off) != type_num)
+		ret = pmemobj_next(ret);
 
 	return ret;
 }
 
+struct obj_foreach_partition {
+	PMEMobjpool *pop;
+	pmemobj_foreach_cb cb;
+	void *arg;
+	int ret;
+};
+
 /*
- * obj_alloc_root -- (internal) allocate root object
+ * obj_foreach_partition_cb -- (internal) palloc_foreach_partition callback,
+ *	calls the user callback with all the objects except the internal ones
  */
 static int
-obj_alloc_root(PMEMobjpool *pop, size_t size,
-	pmemobj_constr constructor, void *arg)
+obj_foreach_partition_cb(uint64_t off, void *arg)
 {
-	LOG(3, "pop %p size %zu", pop, size);
+	struct obj_foreach_partition *p = arg;
 
-	struct carg_root carg;
+	if (obj_is_internal(p->pop, off))
+		return 0;
 
-	carg.size = size;
-	carg.constructor = constructor;
-	carg.arg = arg;
+	PMEMoid oid = {p->pop->uuid_lo, off};
+	p->ret = p->cb(oid, p->arg);
 
-	return pmalloc_construct(pop, &pop->root_offset,
-		size + OBJ_OOB_SIZE, constructor_alloc_root, &carg);
+	return p->ret;
 }
 
 /*
- * obj_realloc_root -- (internal) reallocate root object
+ * pmemobj_foreach_partition -- calls the callback with every object of one of
+ *	the 'npartitions' disjoint parts of the pool
  */
-static int
-obj_realloc_root(PMEMobjpool *pop, size_t size,
-	size_t old_size,
-	pmemobj_constr constructor, void *arg)
+int
+pmemobj_foreach_partition(PMEMobjpool *pop, unsigned npartitions,
+	unsigned partition, pmemobj_foreach_cb cb, void *arg)
 {
-	LOG(3, "pop %p size %zu old_size %zu", pop, size, old_size);
+	LOG(3, "pop %p npartitions %u partition %u cb %p arg %p", pop,
+		npartitions, partition, cb, arg);
 
-	struct carg_realloc carg;
+	if (partition >= npartitions) {
+		ERR("invalid partition %u of %u", partition, npartitions);
+		errno = EINVAL;
+		return -1;
+	}
 
-	carg.ptr = OBJ_OFF_TO_PTR(pop, pop->root_offset);
-	carg.old_size = old_size;
-	carg.new_size = size;
-	carg.user_type = POBJ_ROOT_TYPE_NUM;
-	carg.constructor = constructor;
-	carg.zero_init = 1;
-	carg.arg = arg;
+	struct obj_foreach_partition p = {pop, cb, arg, 0};
+
+	palloc_foreach_partition(&pop->heap, obj_foreach_partition_cb, &p,
+		npartitions, partition);
+
+	return p.ret;
+}
+
+/*
+ * Number of entries of the operations freeing the objects in bulk, enough for
+ * the whole bitmap of all but the runs of the smallest units.
+ */
+#define OBJ_FREE_BULK_ENTRIES 64
+
+/*
+ * obj_free_bulk -- (internal) frees the objects at the sorted offsets
+ */
+static void
+obj_free_bulk(PMEMobjpool *pop, const uint64_t *offs, size_t noffs)
+{
+	/* the lane might have cached free blocks of the emptied runs */
+	pmalloc_cache_flush(pop);
 
 	struct redo_log *redo = pmalloc_redo_hold(pop);
 
 	struct operation_context ctx;
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, pop->root_offset,
-			&pop->root_offset, size + OBJ_OOB_SIZE,
-			constructor_zrealloc_root, &carg, &ctx);
+	if (pmalloc_redo_extend(pop, &ctx, OBJ_FREE_BULK_ENTRIES) != 0)
+		LOG(2, "freeing the objects in smaller groups");
 
-	pmalloc_redo_release(pop);
+	palloc_free_bulk(&pop->heap, offs, noffs, &ctx);
 
-	return ret;
+	pmalloc_redo_release(pop);
 }
 
 /*
- * pmemobj_root_size -- returns size of the root object
+ * obj_free_bulk_check -- (internal) checks whether the objects can be freed
+ *	in bulk
  */
-size_t
-pmemobj_root_size(PMEMobjpool *pop)
+static int
+obj_free_bulk_check(void)
 {
-	LOG(3, "pop %p", pop);
+	/* the objects couldn't be brought back on abort */
+	if (pmemobj_tx_stage() != TX_STAGE_NONE) {
+		ERR("bulk free inside a transaction");
+		errno = EINVAL;
+		return -1;
+	}
 
-	if (pop->root_offset) {
-		struct oob_header *ro =
-			OOB_HEADER_FROM_OFF(pop, pop->root_offset);
-		return ro->size & ~OBJ_INTERNAL_OBJECT_MASK;
-	} else
-		return 0;
+	return 0;
 }
 
 /*
- * pmemobj_root_construct -- returns root object
+ * pmemobj_free_type -- frees all the objects of the type number
+ *
+ * The offsets of the objects are taken from the type index, if possible.
  */
-PMEMoid
-pmemobj_root_construct(PMEMobjpool *pop, size_t size,
-	pmemobj_constr constructor, void *arg)
+int
+pmemobj_free_type(PMEMobjpool *pop, uint64_t type_num)
 {
-	LOG(3, "pop %p size %zu constructor %p args %p", pop, size, constructor,
-		arg);
-
-	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
-		ERR("requested size too large");
-		errno = ENOMEM;
-		return OID_NULL;
-	}
+	LOG(3, "pop %p type_num %" PRIu64, pop, type_num);
 
-	PMEMoid root;
+	if (obj_free_bulk_check() != 0)
+		return -1;
 
-	pmemobj_mutex_lock_nofail(pop, &pop->rootlock);
+	struct obj_type_index *idx = obj_type_index_get(pop);
+	if (idx != NULL) {
+		util_mutex_lock(&idx->lock);
+		struct obj_type_entry *e =
+			obj_type_entry_get(pop, idx, type_num, 1);
+		if (e != NULL)
+			obj_free_bulk(pop, e->offs, e->nobjs);
+		util_mutex_unlock(&idx->lock);
 
-	if (pop->root_offset == 0)
-		obj_alloc_root(pop, size, constructor, arg);
-	else {
-		size_t old_size = pmemobj_root_size(pop);
-		if (size > old_size && obj_realloc_root(pop, size,
-				old_size, constructor, arg)) {
-			pmemobj_mutex_unlock_nofail(pop, &pop->rootlock);
-			LOG(2, "obj_realloc_root failed");
-			return OID_NULL;
-		}
+		if (e != NULL)
+			return 0;
 	}
-	root.pool_uuid_lo = pop->uuid_lo;
-	root.off = pop->root_offset;
 
-	pmemobj_mutex_unlock_nofail(pop, &pop->rootlock);
-	return root;
-}
+	struct obj_type_entry e = {0, 0, 0, NULL, NULL};
+	struct obj_type_collect c = {pop, type_num, &e, 0};
 
-/*
- * pmemobj_root -- returns root object
- */
-PMEMoid
-pmemobj_root(PMEMobjpool *pop, size_t size)
-{
-	LOG(3, "pop %p size %zu", pop, size);
+	palloc_foreach(&pop->heap, obj_type_collect_cb, &c);
+	if (c.err) {
+		ERR("!Realloc");
+		Free(e.offs);
+		errno = ENOMEM;
+		return -1;
+	}
 
-	return pmemobj_root_construct(pop, size, NULL, NULL);
+	obj_free_bulk(pop, e.offs, e.nobjs);
+	Free(e.offs);
+
+	return 0;
 }
 
+struct obj_free_select {
+	PMEMobjpool *pop;
+	pmemobj_foreach_cb select;
+	void *arg;
+	struct obj_type_entry e;
+	int err;
+};
+
 /*
- * pmemobj_first - returns first object of specified type
+ * obj_free_select_cb -- (internal) palloc_foreach callback, collects
+ *	the objects selected by the user callback
  */
-PMEMoid
-pmemobj_first(PMEMobjpool *pop)
+static int
+obj_free_select_cb(uint64_t off, void *arg)
 {
-	LOG(3, "pop %p", pop);
+	struct obj_free_select *s = arg;
 
-	PMEMoid ret = {0, 0};
+	if (obj_is_internal(s->pop, off))
+		return 0;
 
-	uint64_t off = palloc_first(&pop->heap);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
+	PMEMoid oid = {s->pop->uuid_lo, off};
+	if (s->select(oid, s->arg) == 0)
+		return 0;
 
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
-		}
+	if (obj_type_entry_append(&s->e, off) != 0) {
+		s->err = 1;
+		return 1;
 	}
 
-	return ret;
+	return 0;
 }
 
 /*
- * pmemobj_next - returns next object of specified type
+ * pmemobj_free_select -- frees all the objects for which the callback returns
+ *	a non-zero value
+ *
+ * All of the objects are selected before any of them is freed.
  */
-PMEMoid
-pmemobj_next(PMEMoid oid)
+int
+pmemobj_free_select(PMEMobjpool *pop, pmemobj_foreach_cb select, void *arg)
 {
-	LOG(3, "oid.off 0x%016jx", oid.off);
-
-	if (oid.off == 0)
-		return OID_NULL;
-
-	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
+	LOG(3, "pop %p select %p arg %p", pop, select, arg);
 
-	ASSERTne(pop, NULL);
-	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+	if (obj_free_bulk_check() != 0)
+		return -1;
 
-	PMEMoid ret = {0, 0};
-	uint64_t off = palloc_next(&pop->heap, oid.off);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
+	struct obj_free_select s = {pop, select, arg,
+		{0, 0, 0, NULL, NULL}, 0};
 
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
-		}
+	palloc_foreach(&pop->heap, obj_free_select_cb, &s);
+	if (s.err) {
+		ERR("!Realloc");
+		Free(s.e.offs);
+		errno = ENOMEM;
+		return -1;
 	}
 
-	return ret;
+	obj_free_bulk(pop, s.e.offs, s.e.nobjs);
+	Free(s.e.offs);
+
+	return 0;
 }
 
 /*
@@ -2365,6 +5162,52 @@ pmemobj_list_move(PMEMobjpool *pop, size_t pe_old_offset, void *head_old,
 				dest, before, oid);
 }
 
+/*
+ * pmemobj_list_batch -- performs a batch of operations on lists
+ */
+int
+pmemobj_list_batch(PMEMobjpool *pop, const struct pobj_list_op *ops,
+			size_t nops)
+{
+	LOG(3, "pop %p ops %p nops %zu", pop, ops, nops);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	for (size_t i = 0; i < nops; ++i) {
+		const struct pobj_list_op *op = &ops[i];
+
+		ASSERT(OBJ_OID_IS_VALID(pop, op->oid));
+
+		switch (op->type) {
+		case POBJ_LIST_OP_MOVE:
+			if (op->pe_new_offset >= pop->size) {
+				ERR("pe_new_offset (%lu) too big",
+					op->pe_new_offset);
+				errno = EINVAL;
+				return -1;
+			}
+			/* fallthrough */
+		case POBJ_LIST_OP_INSERT:
+			ASSERT(OBJ_OID_IS_VALID(pop, op->dest));
+			/* fallthrough */
+		case POBJ_LIST_OP_REMOVE:
+			if (op->pe_offset >= pop->size) {
+				ERR("pe_offset (%lu) too big", op->pe_offset);
+				errno = EINVAL;
+				return -1;
+			}
+			break;
+		default:
+			ERR("invalid list operation type %d", op->type);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return list_batch(pop, ops, nops);
+}
+
 /*
  * _pobj_debug_notice -- logs notice message if used inside a transaction
  */
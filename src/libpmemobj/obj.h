@@ -39,6 +39,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "lane.h"
 #include "pool_hdr.h"
@@ -48,6 +49,25 @@
 #define PMEMOBJ_LOG_PREFIX "libpmemobj"
 #define PMEMOBJ_LOG_LEVEL_VAR "PMEMOBJ_LOG_LEVEL"
 #define PMEMOBJ_LOG_FILE_VAR "PMEMOBJ_LOG_FILE"
+#define OBJ_COPY_THREADS_VAR "PMEMOBJ_COPY_THREADS"
+#define OBJ_COPY_MT_THRESHOLD_VAR "PMEMOBJ_COPY_MT_THRESHOLD"
+#define OBJ_CHECK_THREADS_VAR "PMEMOBJ_CHECK_THREADS"
+#define OBJ_CHECK_DEFER_VAR "PMEMOBJ_CHECK_DEFER"
+#define OBJ_HEAP_SUMMARY_VAR "PMEMOBJ_HEAP_SUMMARY"
+#define OBJ_ALLOC_AFFINITY_VAR "PMEMOBJ_ALLOC_AFFINITY"
+#define OBJ_ALLOC_TUNE_VAR "PMEMOBJ_ALLOC_TUNE"
+#define OBJ_TX_UNDO_RETAIN_VAR "PMEMOBJ_TX_UNDO_RETAIN"
+#define OBJ_TX_ASYNC_FREE_VAR "PMEMOBJ_TX_ASYNC_FREE"
+#define OBJ_TX_GROUP_COMMIT_VAR "PMEMOBJ_TX_GROUP_COMMIT"
+#define OBJ_LOCK_ELISION_VAR "PMEMOBJ_LOCK_ELISION"
+#define OBJ_FUTEX_MUTEX_VAR "PMEMOBJ_FUTEX_MUTEX"
+#define OBJ_RWLOCK_BIAS_VAR "PMEMOBJ_RWLOCK_BIAS"
+#define OBJ_NLANES_VAR "PMEMOBJ_NLANES"
+#define OBJ_RECOVERY_THREADS_VAR "PMEMOBJ_RECOVERY_THREADS"
+#define OBJ_LANE_STATS_VAR "PMEMOBJ_LANE_STATS"
+#define OBJ_PERSIST_STATS_VAR "PMEMOBJ_PERSIST_STATS"
+#define OBJ_REPLICA_WINDOW_VAR "PMEMOBJ_REPLICA_WINDOW"
+#define OBJ_REPLICA_RESYNC_VAR "PMEMOBJ_REPLICA_RESYNC"
 
 /* attributes of the obj memory pool format for the pool header */
 #define OBJ_HDR_SIG "PMEMOBJ"	/* must be 8 bytes including '\0' */
@@ -56,13 +76,53 @@
 #define OBJ_FORMAT_INCOMPAT 0x0000
 #define OBJ_FORMAT_RO_COMPAT 0x0000
 
+/*
+ * The zone headers are written lazily, when the zones are populated for the
+ * first time, and the header of zone 0 holds the number of the zones whose
+ * headers are valid. The headers of the zones beyond it are undefined.
+ */
+#define OBJ_FORMAT_INCOMPAT_ZONES_VALID 0x0001
+
+/*
+ * The features below are not set when the pool is created, but right before
+ * the first structure which depends on them is written, see obj_feature_enable.
+ */
+
+/* the heap contains runs of objects with compact headers */
+#define OBJ_FORMAT_INCOMPAT_COMPACT_HEADER 0x0002
+
+/*
+ * the heap contains runs of objects without headers or runs whose bitmap
+ * continues in the data area
+ */
+#define OBJ_FORMAT_INCOMPAT_TINY_RUNS 0x0004
+
+/* the redo logs of the allocator lanes may continue in overflow segments */
+#define OBJ_FORMAT_INCOMPAT_REDO_OVERFLOW 0x0008
+
+/* incompat features enabled on their first use */
+#define OBJ_FORMAT_INCOMPAT_ON_DEMAND\
+	(OBJ_FORMAT_INCOMPAT_COMPACT_HEADER |\
+	OBJ_FORMAT_INCOMPAT_TINY_RUNS |\
+	OBJ_FORMAT_INCOMPAT_REDO_OVERFLOW)
+
+/* all of the incompat features known to this version */
+#define OBJ_FORMAT_INCOMPAT_SUPPORTED\
+	(OBJ_FORMAT_INCOMPAT_ZONES_VALID | OBJ_FORMAT_INCOMPAT_ON_DEMAND)
+
 /* size of the persistent part of PMEMOBJ pool descriptor (2kB) */
 #define OBJ_DSC_P_SIZE		2048
 /* size of unused part of the persistent part of PMEMOBJ pool descriptor */
 #define OBJ_DSC_P_UNUSED	(OBJ_DSC_P_SIZE - PMEMOBJ_MAX_LAYOUT - 40)
 
 #define OBJ_LANES_OFFSET	8192	/* lanes offset (8kB) */
-#define OBJ_NLANES		1024	/* number of lanes */
+#define OBJ_NLANES		1024	/* default number of lanes */
+#define OBJ_NLANES_MAX		65536	/* maximum number of lanes */
+
+/* number of words of the map of chunks to resynchronize */
+#define OBJ_RESYNC_MAP_WORDS	128
+/* log2 of the minimal chunk size of the map (256kB, size of a heap chunk) */
+#define OBJ_RESYNC_MIN_SHIFT	18
 
 #define OBJ_OOB_SIZE		(sizeof(struct oob_header))
 #define OBJ_OFF_TO_PTR(pop, off) ((void *)((uintptr_t)(pop) + (off)))
@@ -95,9 +155,6 @@
 #define OOB_HEADER_FROM_OID(pop, oid)\
 	((struct oob_header *)((uintptr_t)(pop) + (oid).off - OBJ_OOB_SIZE))
 
-#define OBJ_OID_IS_IN_UNDO_LOG(pop, oid)\
-	(OOB_HEADER_FROM_OID(pop, oid)->undo_entry_offset != 0)
-
 #define OOB_HEADER_FROM_PTR(ptr)\
 	((struct oob_header *)((uintptr_t)(ptr) - OBJ_OOB_SIZE))
 
@@ -134,6 +191,14 @@ struct pmemobjpool {
 	/* unique runID for this program run - persistent but not checksummed */
 	uint64_t run_id;
 
+	/*
+	 * chunks of the pool modified while a remote replica was degraded,
+	 * to be written to the remote replicas on the next open - persistent
+	 * but not checksummed
+	 */
+	uint64_t resync_shift;	/* log2 of the chunk size, 0 if none */
+	uint64_t resync_map[OBJ_RESYNC_MAP_WORDS];
+
 	/* some run-time state, allocated out of memory pool... */
 	void *addr;		/* mapped region */
 	size_t size;		/* size of mapped region */
@@ -153,6 +218,8 @@ struct pmemobjpool {
 	drain_local_fn drain_local;	/* drain function */
 	memcpy_local_fn memcpy_persist_local; /* persistent memcpy function */
 	memset_local_fn memset_persist_local; /* persistent memset function */
+	memcpy_local_fn memcpy_nodrain_local; /* memcpy w/o final drain */
+	memset_local_fn memset_nodrain_local; /* memset w/o final drain */
 
 	/* for 'master' replica: with or without data replication */
 	struct pmem_ops p_ops;
@@ -168,10 +235,35 @@ struct pmemobjpool {
 	char *pool_desc;	/* descriptor of a poolset */
 
 	persist_remote_fn persist_remote; /* remote persist function */
+	int degraded;	/* remote replica is no longer written */
+
+	/* index of the objects by type number, created on first use */
+	struct obj_type_index *type_index;
+
+	/* flush and fence counts, NULL unless PMEMOBJ_PERSIST_STATS is set */
+	struct obj_persist_stats *persist_stats;
+
+	/* threads in the epochs of the retired objects, see epoch.c */
+	struct epoch *epoch;
+
+	/* frees the objects freed by transactions, NULL if disabled */
+	struct tx_reclaim *tx_reclaim;
+
+	/* commits the transactions in groups, NULL if disabled */
+	struct tx_group *tx_group;
+
+	/* verifies the heap in the background, NULL if not started */
+	struct obj_scrub *scrub;
+
+	/* incompat features set in all the headers of the pool */
+	uint32_t incompat_features;
+
+	/* odd while the root object is being replaced */
+	unsigned root_seq;
 
 	/* padding to align size of this structure to page boundary */
 	/* sizeof(unused2) == 8192 - offsetof(struct pmemobjpool, unused2) */
-	char unused2[1606];
+	char unused2[458];
 };
 
 /*
@@ -185,9 +277,15 @@ struct pmemobjpool {
  * Out-Of-Band Header - it is padded to 48B to fit one cache line (64B)
  * together with allocator's header (of size 16B) located just before it.
  */
+/*
+ * Objects with compact headers (see palloc_header_size) only have the last
+ * two fields of the header and the objects without headers have none of it,
+ * the rest of it overlaps the preceding memory.
+ */
 struct oob_header {
 	uint8_t unused[24];
 
+	/* always zero, objects allocated in a transaction are tracked in it */
 	uint64_t undo_entry_offset;
 
 	/* used only in root object, last bit used as a mask */
@@ -222,6 +320,58 @@ pmemobj_get_uuid_lo(PMEMobjpool *pop)
 	return uuid_lo;
 }
 
+/*
+ * obj_alloc_alignment -- (internal) returns the alignment requested in the
+ * allocation flags, or zero if it's provided by the allocator anyway.
+ */
+static inline size_t
+obj_alloc_alignment(uint64_t flags)
+{
+	unsigned shift = (unsigned)((flags & POBJ_XALLOC_ALIGN_MASK) >>
+		POBJ_XALLOC_ALIGN_SHIFT);
+	size_t alignment = (size_t)1 << shift;
+
+	return alignment > _POBJ_CL_ALIGNMENT ? alignment : 0;
+}
+
+/*
+ * obj_oob_init -- (internal) initializes the header of a new object, of which
+ *	only the size and type number exist in objects with compact headers,
+ *	and nothing in objects without headers
+ *
+ * The header is not flushed.
+ */
+static inline void
+obj_oob_init(PMEMobjpool *pop, void *ptr, uint64_t type_num, uint64_t size)
+{
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+
+	size_t hsize = palloc_header_size(&pop->heap, OBJ_PTR_TO_OFF(pop, ptr));
+	if (hsize == 0)
+		return;
+
+	if (hsize == OBJ_OOB_SIZE) {
+		oobh->undo_entry_offset = 0;
+		memset(oobh->unused, 0, sizeof(oobh->unused));
+	}
+
+	oobh->type_num = type_num;
+	oobh->size = size;
+}
+
+/*
+ * obj_type_num -- (internal) returns the type number of the object, objects
+ *	without headers don't have one
+ */
+static inline uint64_t
+obj_type_num(PMEMobjpool *pop, uint64_t off)
+{
+	if (palloc_header_size(&pop->heap, off) == 0)
+		return 0;
+
+	return OOB_HEADER_FROM_OFF(pop, off)->type_num;
+}
+
 /*
  * OBJ_OID_IS_VALID -- (internal) checks if 'oid' is valid
  */
@@ -238,5 +388,6 @@ void obj_init(void);
 void obj_fini(void);
 int obj_read_remote(void *ctx, uintptr_t base, void *dest, void *addr,
 		size_t length);
+int obj_feature_enable(PMEMobjpool *pop, uint32_t incompat);
 
 #endif
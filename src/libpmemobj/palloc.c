@@ -38,10 +38,14 @@
  * in a reasonable time and with an acceptable common-case fragmentation.
  */
 
+#include <sys/param.h>
+
 #include "heap_layout.h"
 #include "heap.h"
 #include "out.h"
 #include "palloc.h"
+#include "util.h"
+#include "usdt.h"
 #include "valgrind_internal.h"
 
 /*
@@ -49,12 +53,52 @@
  */
 #define ALLOC_OFF (PALLOC_DATA_OFF + sizeof(struct allocation_header))
 
+/*
+ * The same for memory blocks of objects with compact headers.
+ */
+#define ALLOC_OFF_COMPACT PALLOC_COMPACT_DATA_OFF
+
 #define USABLE_SIZE(_a)\
 ((_a)->size - sizeof(struct allocation_header))
 
 #define MEMORY_BLOCK_IS_EMPTY(_m)\
 ((_m).size_idx == 0)
 
+/*
+ * Number of memory blocks reserved at once when refilling a lane cache slot.
+ */
+#define ALLOC_CACHE_BATCH 16
+
+struct alloc_cache_slot {
+	struct bucket *bucket; /* bucket from which the blocks were reserved */
+	uint32_t units; /* size index of every block in the slot */
+	unsigned next; /* index of the next block to be handed out */
+	unsigned nblocks;
+	struct memory_block blocks[ALLOC_CACHE_BATCH];
+};
+
+/*
+ * Per-lane cache of memory blocks reserved in the transient heap, one slot per
+ * bucket, allocated on first use.
+ *
+ * The lane is held exclusively by a thread for the duration of the operation
+ * and so the cache can be accessed without any locking. The only exception is
+ * the flush flag, which is set by the threads running out of memory when the
+ * lane is busy, and makes its holder return all of the cached blocks. It's
+ * only accessed atomically, so that the request is seen by the holder of the
+ * lane no later than on its next allocation.
+ */
+struct palloc_cache {
+	int flush;
+	struct alloc_cache_slot *slots[MAX_BUCKETS];
+};
+
+/*
+ * Set while the constructor of a block which is known to be zeroed runs,
+ * see palloc_block_zeroed.
+ */
+static __thread int Alloc_block_zeroed;
+
 #define PMALLOC_OFF_TO_PTR(heap, off) ((void *)((char *)((heap)->base) + (off)))
 #define PMALLOC_PTR_TO_OFF(heap, ptr)\
 	((uintptr_t)(ptr) - (uintptr_t)(heap->base))
@@ -98,6 +142,242 @@ get_mblock_from_alloc(struct palloc_heap *heap,
 	return m;
 }
 
+/*
+ * alloc_get_block -- (internal) returns the memory block of the object along
+ *	with the type of its header
+ */
+static enum header_type
+alloc_get_block(struct palloc_heap *heap, uint64_t off, struct memory_block *m)
+{
+	enum header_type type = heap_get_headerless_block(heap,
+		PMALLOC_OFF_TO_PTR(heap, off), m);
+	if (type == HEADER_LEGACY)
+		*m = get_mblock_from_alloc(heap, ALLOC_GET_HEADER(heap, off));
+
+	return type;
+}
+
+/*
+ * alloc_header_size -- (internal) returns the number of bytes between the
+ *	beginning of the memory block and the user data
+ */
+static size_t
+alloc_header_size(enum header_type type)
+{
+	switch (type) {
+		case HEADER_LEGACY:
+			return ALLOC_OFF;
+		case HEADER_COMPACT:
+			return ALLOC_OFF_COMPACT;
+		case HEADER_NONE:
+			return 0;
+		default:
+			ASSERT(0);
+	}
+
+	return 0;
+}
+
+/*
+ * alloc_bucket_header_type -- (internal) returns the type of the headers of
+ *	the objects allocated from the bucket
+ */
+static enum header_type
+alloc_bucket_header_type(struct bucket *b)
+{
+	return b->type == BUCKET_RUN ?
+		((struct bucket_run *)b)->header_type : HEADER_LEGACY;
+}
+
+/*
+ * palloc_cache_new -- allocates an empty lane cache
+ */
+struct palloc_cache *
+palloc_cache_new(void)
+{
+	return Zalloc(sizeof(struct palloc_cache));
+}
+
+/*
+ * palloc_cache_delete -- deletes the lane cache
+ *
+ * Blocks still held in the cache are not returned to the heap, this must only
+ * be called once the transient heap is gone.
+ */
+void
+palloc_cache_delete(struct palloc_cache *cache)
+{
+	for (unsigned i = 0; i < MAX_BUCKETS; ++i)
+		Free(cache->slots[i]);
+
+	Free(cache);
+}
+
+/*
+ * alloc_cache_slot_flush -- (internal) returns unused blocks of the slot back
+ *	to their bucket
+ */
+static unsigned
+alloc_cache_slot_flush(struct palloc_heap *heap, struct alloc_cache_slot *s)
+{
+	unsigned n = s->nblocks - s->next;
+	if (n != 0)
+		heap_return_blocks(heap, s->bucket, &s->blocks[s->next], n);
+
+	s->next = 0;
+	s->nblocks = 0;
+
+	return n;
+}
+
+/*
+ * alloc_cache_flush -- (internal) returns all unused blocks of the cache back
+ *	to the heap, returns the number of blocks returned
+ */
+static unsigned
+alloc_cache_flush(struct palloc_heap *heap, struct palloc_cache *cache)
+{
+	unsigned n = 0;
+	for (unsigned i = 0; i < MAX_BUCKETS; ++i) {
+		if (cache->slots[i] != NULL)
+			n += alloc_cache_slot_flush(heap, cache->slots[i]);
+	}
+
+	return n;
+}
+
+/*
+ * palloc_cache_flush -- returns all unused blocks of the cache back to the
+ *	heap, the runs which are left empty are degraded into chunks
+ */
+void
+palloc_cache_flush(struct palloc_heap *heap, struct palloc_cache *cache)
+{
+	alloc_cache_flush(heap, cache);
+}
+
+/*
+ * palloc_cache_request_flush -- makes the holder of the lane return all of the
+ *	blocks of the cache back to the heap on its next allocation
+ */
+void
+palloc_cache_request_flush(struct palloc_cache *cache)
+{
+	util_atomic_store_release32(&cache->flush, 1);
+}
+
+/*
+ * alloc_cache_get -- (internal) takes a memory block from the lane cache,
+ *	refilling the cache from the bucket in a batch if needed
+ */
+static int
+alloc_cache_get(struct palloc_heap *heap, struct palloc_cache *cache,
+	struct bucket *b, struct memory_block *m)
+{
+	if (unlikely(util_atomic_load_acquire32(&cache->flush))) {
+		util_atomic_store_release32(&cache->flush, 0);
+		alloc_cache_flush(heap, cache);
+	}
+
+	struct alloc_cache_slot *s = cache->slots[b->id];
+	if (s == NULL) {
+		if ((s = Zalloc(sizeof(*s))) == NULL)
+			return ENOMEM;
+
+		cache->slots[b->id] = s;
+	}
+
+	if (s->next == s->nblocks || s->bucket != b ||
+			s->units != m->size_idx) {
+		alloc_cache_slot_flush(heap, s);
+
+		s->nblocks = heap_get_bestfit_blocks(heap, b, s->blocks,
+			ALLOC_CACHE_BATCH, m->size_idx);
+		if (s->nblocks == 0)
+			return ENOMEM;
+
+		s->bucket = b;
+		s->units = m->size_idx;
+	}
+
+	*m = s->blocks[s->next++];
+
+	return 0;
+}
+
+/*
+ * alloc_block_before -- (internal) checks whether block a precedes block b
+ *	in the heap address space
+ */
+static int
+alloc_block_before(const struct memory_block *a, const struct memory_block *b)
+{
+	if (a->zone_id != b->zone_id)
+		return a->zone_id < b->zone_id;
+
+	if (a->chunk_id != b->chunk_id)
+		return a->chunk_id < b->chunk_id;
+
+	return a->block_off < b->block_off;
+}
+
+/*
+ * alloc_cache_put -- (internal) puts a freed memory block into the lane cache
+ *
+ * Only possible if there's room in the slot of the block's bucket. The blocks
+ * in the slot are kept sorted by address so that, just like in the bucket,
+ * the block with the lowest address is handed out first.
+ *
+ * No locks are taken here. The caller makes sure that the last allocated block
+ * of a run isn't cached, so that the run, otherwise empty, can be degraded into
+ * a chunk usable by the other allocation classes.
+ */
+static int
+alloc_cache_put(struct palloc_cache *cache, struct bucket *b,
+	struct memory_block m)
+{
+	struct alloc_cache_slot *s = cache->slots[b->id];
+	if (s == NULL || s->next == 0 || s->bucket != b ||
+			s->units != m.size_idx ||
+			util_atomic_load_acquire32(&cache->flush))
+		return -1;
+
+	unsigned i = --s->next;
+	for (; i + 1 < s->nblocks &&
+			alloc_block_before(&s->blocks[i + 1], &m); ++i)
+		s->blocks[i] = s->blocks[i + 1];
+
+	s->blocks[i] = m;
+
+	return 0;
+}
+
+/*
+ * alloc_aligned_class -- (internal) returns the allocation class dedicated to
+ *	objects with the given alignment, which is registered on first use
+ *
+ * The unit size of that class is equal to the alignment, so that the padding
+ * in front of the objects is always shorter than a single unit. Objects which
+ * don't fit in a block of that class, or are aligned above the unit size of
+ * the largest possible run, are served from the huge class.
+ */
+static unsigned
+alloc_aligned_class(struct palloc_heap *heap, size_t alignment, size_t sizeh)
+{
+	unsigned class_id;
+	if (heap_create_alloc_class(heap, MAX(alignment, MIN_RUN_SIZE),
+			RUN_UNIT_MAX_ALLOC, 0, HEADER_LEGACY, &class_id) != 0)
+		return HEAP_HUGE_CLASS_ID;
+
+	struct bucket *b = heap_get_class_bucket(heap, class_id, 1);
+	size_t pad = heap_get_block_padding(heap, b, ALLOC_OFF, alignment);
+	if (b->calc_units(b, sizeh + pad) >
+			((struct bucket_run *)b)->unit_max_alloc)
+		return HEAP_HUGE_CLASS_ID;
+
+	return class_id;
+}
+
 /*
  * alloc_reserve_block -- (internal) reserves a memory block in volatile state
  *
@@ -121,12 +401,37 @@ get_mblock_from_alloc(struct palloc_heap *heap,
  *
  * Once this method completes no further locking is required on the transient
  * part of the heap during the allocation process.
+ *
+ * The requested size includes the PALLOC_DATA_OFF bytes in front of the user
+ * data, of which only the last ALLOC_OFF_COMPACT make it into the memory block
+ * if the object has a compact header, and none if it has no header at all.
  */
 static int
-alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
-		size_t sizeh)
+alloc_reserve_block(struct palloc_heap *heap, struct palloc_cache *cache,
+		unsigned class_id, size_t alignment, struct memory_block *m,
+		size_t size)
 {
-	struct bucket *b = heap_get_best_bucket(heap, sizeh);
+	size_t sizeh = size + sizeof(struct allocation_header);
+
+	if (class_id == 0 && alignment != 0)
+		class_id = alloc_aligned_class(heap, alignment, sizeh);
+
+	struct bucket *b;
+	if (class_id != 0) {
+		/* the allocation class was explicitly requested by the user */
+		if ((b = heap_get_class_bucket(heap, class_id, 0)) == NULL)
+			return EINVAL;
+	} else {
+		b = heap_get_best_bucket(heap, sizeh);
+	}
+
+	enum header_type header_type = alloc_bucket_header_type(b);
+	if (header_type != HEADER_LEGACY) {
+		if (alignment != 0)
+			return EINVAL; /* such objects can't be padded */
+
+		sizeh = size - PALLOC_DATA_OFF + alloc_header_size(header_type);
+	}
 
 	/*
 	 * The caller provided size in bytes, but buckets operate in
@@ -135,7 +440,40 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 	 * For example, to allocate 500 bytes from a bucket that provides 256
 	 * byte blocks two memory 'units' are required.
 	 */
-	m->size_idx = b->calc_units(b, sizeh);
+	size_t pad = 0;
+	if (alignment != 0) {
+		if (b->type == BUCKET_RUN && b->unit_size % alignment != 0)
+			return EINVAL; /* the class can't be aligned */
+
+		pad = heap_get_block_padding(heap, b, ALLOC_OFF, alignment);
+	}
+
+	m->size_idx = b->calc_units(b, sizeh + pad);
+
+	if (b->type == BUCKET_RUN &&
+		m->size_idx > ((struct bucket_run *)b)->unit_max_alloc)
+		return EINVAL; /* doesn't fit in the requested class */
+
+	/*
+	 * Huge blocks aligned above the chunk size are reserved along with
+	 * enough leading chunks to find the aligned one among them.
+	 */
+	uint32_t units = m->size_idx;
+	if (b->type == BUCKET_HUGE && alignment > CHUNKSIZE) {
+		if (alignment / CHUNKSIZE > MAX_CHUNK)
+			return ENOMEM;
+
+		m->size_idx += (uint32_t)(alignment / CHUNKSIZE - 1);
+	}
+
+	/*
+	 * Small allocations are served from the lane cache, which reserves
+	 * blocks in batches - this way the bucket lock is taken only once
+	 * every few allocations.
+	 */
+	if (cache != NULL && b->type == BUCKET_RUN &&
+			alloc_cache_get(heap, cache, b, m) == 0)
+		return 0;
 
 	int err = heap_get_bestfit_block(heap, b, m);
 
@@ -147,7 +485,8 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 		 * There's no more available memory in the common heap and in
 		 * this lane cache, fallback to the auxiliary (shared) bucket.
 		 */
-		b = heap_get_auxiliary_bucket(heap, sizeh);
+		b = class_id != 0 ? heap_get_class_bucket(heap, class_id, 1) :
+			heap_get_auxiliary_bucket(heap, sizeh);
 		err = heap_get_bestfit_block(heap, b, m);
 	}
 
@@ -160,11 +499,29 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 		err = heap_get_bestfit_block(heap, b, m);
 	}
 
+	if (err == ENOMEM && cache != NULL && alloc_cache_flush(heap, cache)) {
+		/*
+		 * The runs partially held in this lane's cache might have
+		 * been turned back into chunks, try again.
+		 */
+		return alloc_reserve_block(heap, NULL, class_id, alignment,
+			m, size);
+	}
+
 	if (err == ENOMEM) {
 		/* we are completely out of memory */
 		return ENOMEM;
 	}
 
+	if (m->size_idx != units) {
+		uintptr_t data = (uintptr_t)heap_get_block_data(heap, *m) +
+			ALLOC_OFF;
+		uint32_t lead = (uint32_t)((roundup(data, alignment) - data) /
+			CHUNKSIZE);
+
+		heap_trim_huge_block(heap, m, lead, units);
+	}
+
 	return 0;
 }
 
@@ -181,31 +538,67 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
  */
 static int
 alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
-	palloc_constr constructor, void *arg, uint64_t *offset_value)
+	size_t alignment, palloc_constr constructor, void *arg,
+	uint64_t *offset_value, int drain)
 {
 	void *block_data = heap_get_block_data(heap, m);
-	void *userdatap = (char *)block_data + ALLOC_OFF;
+
+	/* only legacy objects have an allocation header to write */
+	struct memory_block hm;
+	enum header_type header_type = heap_get_headerless_block(heap,
+		block_data, &hm);
+	size_t hsize = alloc_header_size(header_type);
+
+	void *userdatap = (char *)block_data + hsize;
 
 	uint64_t unit_size = MEMBLOCK_OPS(AUTO, &m)->
 			block_size(&m, heap->layout);
 
 	uint64_t real_size = unit_size * m.size_idx;
 
-	ASSERT((uint64_t)block_data % _POBJ_CL_ALIGNMENT == 0);
-	ASSERT((uint64_t)userdatap % _POBJ_CL_ALIGNMENT == 0);
+	/*
+	 * The user data of aligned objects, along with the headers right in
+	 * front of it, is moved forward by the padding. The reservation made
+	 * sure that the padding is shorter than a single unit, and so the size
+	 * index can still be calculated from the size in the header.
+	 */
+	uint64_t pad = 0;
+	if (alignment != 0) {
+		ASSERTeq(header_type, HEADER_LEGACY);
+		pad = roundup((uintptr_t)userdatap, alignment) -
+			(uintptr_t)userdatap;
+		ASSERT(pad < unit_size);
+		userdatap = (char *)userdatap + pad;
+	}
+
+	struct allocation_header *alloc = (struct allocation_header *)
+		((char *)block_data + pad);
+
+	/* the other objects can share their cachelines with their neighbors */
+	ASSERT(header_type != HEADER_LEGACY ||
+		((uint64_t)block_data % _POBJ_CL_ALIGNMENT == 0 &&
+		(uint64_t)userdatap % _POBJ_CL_ALIGNMENT == 0));
 
 	/* mark everything (including headers) as accessible */
 	VALGRIND_DO_MAKE_MEM_UNDEFINED(block_data, real_size);
 	/* mark space as allocated */
 	VALGRIND_DO_MEMPOOL_ALLOC(heap->layout, userdatap,
-			real_size - ALLOC_OFF);
+			real_size - pad - hsize);
+
+	if (pad != 0)
+		alloc_write_header(heap, block_data, m,
+			pad | ALLOC_HDR_PADDING);
+	if (header_type == HEADER_LEGACY)
+		alloc_write_header(heap, alloc, m, real_size - pad);
 
-	alloc_write_header(heap, block_data, m, real_size);
+	/* the headers are written outside of the user data */
+	Alloc_block_zeroed = heap_block_fresh(heap, m);
 
 	int ret;
 	if (constructor != NULL &&
 		(ret = constructor(heap->base, userdatap,
-			real_size - ALLOC_OFF, arg)) != 0) {
+			real_size - pad - hsize, arg)) != 0) {
+		Alloc_block_zeroed = 0;
 
 		/*
 		 * If canceled, revert the block back to the free state in vg
@@ -214,20 +607,31 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
 		 * in a separate call.
 		 */
 		VALGRIND_DO_MEMPOOL_FREE(heap->layout, userdatap);
-		VALGRIND_DO_MAKE_MEM_NOACCESS(block_data, ALLOC_OFF);
+		VALGRIND_DO_MAKE_MEM_NOACCESS(block_data, pad + hsize);
 
 		/*
 		 * During this method there are several stores to pmem that are
 		 * not immediately flushed and in case of a cancellation those
 		 * stores are no longer relevant anyway.
 		 */
-		VALGRIND_SET_CLEAN(block_data, ALLOC_OFF);
+		VALGRIND_SET_CLEAN(block_data, pad + hsize);
 
 		return ret;
 	}
 
-	/* flushes both the alloc and oob headers */
-	pmemops_persist(&heap->p_ops, block_data, ALLOC_OFF);
+	Alloc_block_zeroed = 0;
+
+	/*
+	 * Flushes both the alloc and oob headers, or just what's left of them
+	 * in the other objects. The drain can be deferred by the caller if
+	 * there's a fence before the block is marked as allocated anyway.
+	 */
+	if (pad != 0)
+		pmemops_flush(&heap->p_ops, block_data, sizeof(*alloc));
+	if (drain)
+		pmemops_persist(&heap->p_ops, alloc, hsize);
+	else
+		pmemops_flush(&heap->p_ops, alloc, hsize);
 
 	/*
 	 * To avoid determining the user data pointer twice this method is also
@@ -240,6 +644,125 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
 	return 0;
 }
 
+/*
+ * alloc_cancel_block -- (internal) returns a reserved, but not yet allocated,
+ *	memory block back to the transient heap
+ */
+static void
+alloc_cancel_block(struct palloc_heap *heap, struct palloc_cache *cache,
+	struct memory_block m)
+{
+	struct bucket *b = heap_get_chunk_bucket(heap, m.chunk_id, m.zone_id);
+	ASSERTne(b, NULL);
+
+	/*
+	 * The block might have come from the lane cache. It has never been
+	 * allocated, so putting it back can't keep an otherwise empty run
+	 * from being degraded.
+	 */
+	if (cache != NULL && b->type == BUCKET_RUN &&
+		alloc_cache_put(cache, b, m) == 0)
+		return;
+
+	/*
+	 * Omitting the context in this method results in coalescing of blocks
+	 * without affecting the persistent heap state.
+	 */
+	m = heap_free_block(heap, b, m, NULL);
+	CNT_OP(b, insert, heap, m);
+
+	if (b->type == BUCKET_RUN)
+		heap_degrade_run_if_empty(heap, b, m);
+}
+
+/*
+ * alloc_extend_block -- (internal) resizes the object in-place by extending its
+ *	memory block into the free space that directly follows it
+ *
+ * This is possible only for objects with a legacy header, because their size
+ * is stored in the header, and only if the bucket of the object is known in
+ * this incarnation of the heap. The allocation header and the chunk metadata
+ * are updated in the same redo log, and so the object is either entirely
+ * resized or not at all. No data has to be copied.
+ *
+ * Returns 1 if the object can't be extended and has to be reallocated, and -1
+ * if the constructor canceled the operation.
+ */
+static int
+alloc_extend_block(struct palloc_heap *heap, struct bucket *b,
+	struct allocation_header *alloc, struct memory_block m, uint64_t off,
+	size_t size, palloc_constr constructor, void *arg,
+	struct operation_context *ctx)
+{
+	size_t sizeh = size + sizeof(struct allocation_header);
+	if (b == NULL || sizeh <= alloc->size)
+		return 1;
+
+	uint64_t unit_size = MEMBLOCK_OPS(AUTO, &m)->
+			block_size(&m, heap->layout);
+
+	/* the padding of aligned objects stays in front of the header */
+	uint64_t pad = unit_size * m.size_idx - alloc->size;
+	uint32_t units = b->calc_units(b, sizeh + pad);
+	if (b->type == BUCKET_RUN &&
+		units > ((struct bucket_run *)b)->unit_max_alloc)
+		return 1;
+
+	MEMBLOCK_OPS(AUTO, &m)->lock(&m, heap);
+
+	struct memory_block grown = m;
+	if (heap_extend_block(heap, b, &grown, units) != 0) {
+		MEMBLOCK_OPS(AUTO, &m)->unlock(&m, heap);
+		return 1;
+	}
+
+	uint64_t new_size = alloc->size + unit_size * (units - m.size_idx);
+	void *userdatap = PMALLOC_OFF_TO_PTR(heap, off);
+
+	VALGRIND_DO_MAKE_MEM_UNDEFINED((char *)alloc + alloc->size,
+		new_size - alloc->size);
+	VALGRIND_DO_MEMPOOL_CHANGE(heap->layout, userdatap, userdatap,
+		new_size - ALLOC_OFF);
+
+	if (constructor != NULL &&
+		constructor(heap->base, userdatap, new_size - ALLOC_OFF,
+			arg) != 0) {
+		VALGRIND_DO_MEMPOOL_CHANGE(heap->layout, userdatap, userdatap,
+			alloc->size - ALLOC_OFF);
+
+		struct memory_block ext = grown;
+		ext.size_idx = units - m.size_idx;
+		ext.block_off = (uint16_t)(m.block_off + m.size_idx);
+		if (b->type == BUCKET_HUGE)
+			ext.chunk_id += m.size_idx;
+
+		alloc_cancel_block(heap, NULL, ext);
+		MEMBLOCK_OPS(AUTO, &m)->unlock(&m, heap);
+
+		errno = ECANCELED;
+		return -1;
+	}
+
+	MEMBLOCK_OPS(AUTO, &grown)->prep_hdr(&grown, heap, HDR_OP_ALLOC, ctx);
+	operation_add_entry(ctx, &alloc->size, new_size, OPERATION_SET);
+
+	operation_process(ctx);
+
+	MEMBLOCK_OPS(AUTO, &m)->unlock(&m, heap);
+
+	return 0;
+}
+
+/*
+ * palloc_heap_modified -- (internal) marks the set of the objects in the heap
+ *	as changed, after the change is done
+ */
+static inline void
+palloc_heap_modified(struct palloc_heap *heap)
+{
+	__sync_fetch_and_add(&heap->generation, 1);
+}
+
 /*
  * palloc_operation -- persistent memory operation. Takes a NULL pointer
  *	or an existing memory block and modifies it to occupy, at least, 'size'
@@ -271,21 +794,27 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
  *
  * Reallocation is a combination of the above, which one additional step
  * of copying the old content in the meantime.
+ *
+ * The new block is taken from the allocation class identified by class_id,
+ * or, if it's zero, from the class that best fits the requested size. Nonzero
+ * alignment, which has to be a power of two, makes the user data of the new
+ * object start at an address that is a multiple of it.
  */
 int
 palloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
 	palloc_constr constructor, void *arg,
-	struct operation_context *ctx)
+	struct operation_context *ctx, struct palloc_cache *cache,
+	unsigned class_id, size_t alignment)
 {
+	USDT_PROBE2(libpmemobj, palloc_op, off, size);
+
 	struct bucket *b = NULL;
 	struct allocation_header *alloc = NULL;
 	struct memory_block existing_block = {0, 0, 0, 0};
 	struct memory_block new_block = {0, 0, 0, 0};
 	struct memory_block reclaimed_block = {0, 0, 0, 0};
 
-	size_t sizeh = size + sizeof(struct allocation_header);
-
 	/*
 	 * The offset of an existing block can be nonzero which means this
 	 * operation is either free or a realloc - either way the offset of the
@@ -293,7 +822,16 @@ palloc_operation(struct palloc_heap *heap,
 	 * methods operate in.
 	 */
 	if (off != 0) {
-		alloc = ALLOC_GET_HEADER(heap, off);
+		/* the zone may have not been verified yet */
+		if (heap_check_block(heap, off) != 0) {
+			ERR("object in an inconsistent heap zone");
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (alloc_get_block(heap, off, &existing_block) ==
+				HEADER_LEGACY)
+			alloc = ALLOC_GET_HEADER(heap, off);
 		/*
 		 * The memory block must return back to the originating bucket,
 		 * otherwise coalescing of neighbouring blocks will be rendered
@@ -306,18 +844,32 @@ palloc_operation(struct palloc_heap *heap,
 		 * necessary volatile heap modifications won't be performed for
 		 * this memory block.
 		 */
-		b = heap_get_chunk_bucket(heap, alloc->chunk_id,
-				alloc->zone_id);
-		existing_block = get_mblock_from_alloc(heap, alloc);
+		b = heap_get_chunk_bucket(heap, existing_block.chunk_id,
+				existing_block.zone_id);
 	}
 
 	/* if allocation or reallocation, reserve new memory */
 	if (size != 0) {
 		/* reallocation to exactly the same size, which is a no-op */
-		if (alloc != NULL && alloc->size == sizeh)
+		if (alloc != NULL && alloc->size ==
+				size + sizeof(struct allocation_header)) {
+			palloc_heap_modified(heap);
 			return 0;
+		}
 
-		errno = alloc_reserve_block(heap, &new_block, sizeh);
+		/*
+		 * Growing objects are, if possible, extended in-place, which
+		 * saves the copy of the whole object.
+		 */
+		int ret;
+		if (alloc != NULL && alignment == 0 && class_id == 0 &&
+			(ret = alloc_extend_block(heap, b, alloc,
+				existing_block, off, size, constructor, arg,
+				ctx)) <= 0)
+			return ret;
+
+		errno = alloc_reserve_block(heap, cache, class_id, alignment,
+			&new_block, size);
 		if (errno != 0)
 			return -1;
 	}
@@ -370,28 +922,13 @@ palloc_operation(struct palloc_heap *heap,
 		}
 #endif /* DEBUG */
 
-		if (alloc_prep_block(heap, new_block, constructor,
-				arg, &offset_value) != 0) {
+		if (alloc_prep_block(heap, new_block, alignment, constructor,
+				arg, &offset_value, 1) != 0) {
 			/*
 			 * Constructor returned non-zero value which means
 			 * the memory block reservation has to be rolled back.
 			 */
-			struct bucket *new_bucket = heap_get_chunk_bucket(heap,
-				new_block.chunk_id, new_block.zone_id);
-			ASSERTne(new_bucket, NULL);
-
-			/*
-			 * Omitting the context in this method results in
-			 * coalescing of blocks without affecting the persistent
-			 * heap state.
-			 */
-			new_block = heap_free_block(heap, new_bucket,
-					new_block, NULL);
-			CNT_OP(new_bucket, insert, heap, new_block);
-
-			if (new_bucket->type == BUCKET_RUN)
-				heap_degrade_run_if_empty(heap,
-					new_bucket, new_block);
+			alloc_cancel_block(heap, cache, new_block);
 
 			errno = ECANCELED;
 			return -1;
@@ -419,16 +956,17 @@ palloc_operation(struct palloc_heap *heap,
 	/* not in-place realloc */
 	if (!MEMORY_BLOCK_IS_EMPTY(existing_block) &&
 		!MEMORY_BLOCK_IS_EMPTY(new_block)) {
-		size_t old_size = alloc->size;
-		size_t to_cpy = old_size > sizeh ? sizeh : old_size;
+		size_t old_size = palloc_usable_size(heap, off);
+		size_t to_cpy = (old_size > size ? size : old_size) -
+			PALLOC_DATA_OFF;
 		VALGRIND_ADD_TO_TX(PMALLOC_OFF_TO_PTR(heap, offset_value),
-			to_cpy - ALLOC_OFF);
+			to_cpy);
 		pmemops_memcpy_persist(&heap->p_ops,
 			PMALLOC_OFF_TO_PTR(heap, offset_value),
 			PMALLOC_OFF_TO_PTR(heap, off),
-			to_cpy - ALLOC_OFF);
+			to_cpy);
 		VALGRIND_REMOVE_FROM_TX(PMALLOC_OFF_TO_PTR(heap, offset_value),
-			to_cpy - ALLOC_OFF);
+			to_cpy);
 	}
 
 	/*
@@ -454,16 +992,29 @@ palloc_operation(struct palloc_heap *heap,
 	}
 
 	if (!MEMORY_BLOCK_IS_EMPTY(existing_block)) {
+		/*
+		 * The last allocated block of a run doesn't go to the lane
+		 * cache. That's checked while the run lock is still held,
+		 * so the cache itself is used without any locking.
+		 */
+		int cacheable = b != NULL && cache != NULL &&
+			b->type == BUCKET_RUN &&
+			!heap_run_is_unused(heap, b, existing_block);
+
 		/* existing (freed) run lock */
 		MEMBLOCK_OPS(AUTO, &existing_block)->
 				unlock(&existing_block, heap);
 
 		VALGRIND_DO_MEMPOOL_FREE(heap->layout,
-			(char *)heap_get_block_data(heap, existing_block)
-			+ ALLOC_OFF);
+			PMALLOC_OFF_TO_PTR(heap, off));
 
-		/* we might have been operating on inactive run */
-		if (b != NULL) {
+		/*
+		 * We might have been operating on inactive run. If possible,
+		 * the block is kept in the lane cache for subsequent
+		 * allocations instead of going back to the bucket.
+		 */
+		if (b != NULL && (!cacheable ||
+				alloc_cache_put(cache, b, reclaimed_block))) {
 			/*
 			 * Even though the initial condition is to check
 			 * whether the existing block exists it's important to
@@ -494,43 +1045,215 @@ palloc_operation(struct palloc_heap *heap,
 		}
 	}
 
+	palloc_heap_modified(heap);
+
+	USDT_PROBE2(libpmemobj, palloc_op_done, off, size);
+
 	return 0;
 }
 
+/*
+ * palloc_object_info -- returns both the usable size of the memory block, as
+ *	palloc_usable_size does, and the header size of the object, as
+ *	palloc_header_size does, with a single lookup of the chunk header
+ */
+size_t
+palloc_object_info(struct palloc_heap *heap, uint64_t off,
+	size_t *header_size)
+{
+	struct memory_block m;
+	enum header_type type = heap_get_headerless_block(heap,
+		PMALLOC_OFF_TO_PTR(heap, off), &m);
+	if (type == HEADER_LEGACY) {
+		*header_size = PALLOC_DATA_OFF;
+		return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+	}
+
+	*header_size = alloc_header_size(type);
+	return MEMBLOCK_OPS(RUN, &m)->block_size(&m, heap->layout) -
+		alloc_header_size(type) + PALLOC_DATA_OFF;
+}
+
 /*
  * palloc_usable_size -- returns the number of bytes in the memory block
+ *
+ * Just like the requested size, it includes PALLOC_DATA_OFF bytes in front of
+ * the user data, regardless of the type of the object header.
  */
 size_t
 palloc_usable_size(struct palloc_heap *heap, uint64_t off)
 {
-	return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+	size_t header_size;
+	return palloc_object_info(heap, off, &header_size);
 }
 
 /*
- * pmalloc_search_cb -- (internal) foreach callback. If the argument is equal
- *	to the current object offset then sets the argument to UINT64_MAX.
- *	If the argument is UINT64_MAX it breaks the iteration and sets the
- *	argument to the current object offset.
+ * palloc_header_size -- returns how many of the PALLOC_DATA_OFF bytes in
+ *	front of the user data are backed by the memory block of the object
+ *
+ * That's all of them for legacy objects, the last PALLOC_COMPACT_DATA_OFF
+ * bytes for objects with compact headers, and none for objects without
+ * headers.
  */
-static int
-pmalloc_search_cb(uint64_t off, void *arg)
+size_t
+palloc_header_size(struct palloc_heap *heap, uint64_t off)
 {
-	uint64_t *prev = arg;
-
-	if (*prev == UINT64_MAX) {
-		*prev = off;
-
-		return 1;
-	}
+	struct memory_block m;
+	enum header_type type = heap_get_headerless_block(heap,
+		PMALLOC_OFF_TO_PTR(heap, off), &m);
+	if (type == HEADER_LEGACY)
+		return PALLOC_DATA_OFF;
 
-	if (off == *prev)
-		*prev = UINT64_MAX;
-
-	return 0;
+	return alloc_header_size(type);
 }
 
 /*
- * palloc_first -- returns the first object from the heap.
+ * palloc_prefetch -- prefetches the metadata read by palloc_object_info for
+ *	the object at the given offset, along with the end of the object header
+ *
+ * The headers in front of the user data are prefetched even for objects which
+ * turn out not to have them, usually it's the same cacheline anyway.
+ */
+void
+palloc_prefetch(struct palloc_heap *heap, uint64_t off)
+{
+	void *ptr = PMALLOC_OFF_TO_PTR(heap, off);
+	heap_prefetch_block(heap, ptr);
+	util_prefetch(ALLOC_GET_HEADER(heap, off));
+	util_prefetch((char *)ptr - 1);
+}
+
+/*
+ * palloc_class_id -- returns the identifier of the allocation class of the
+ *	object, or zero if it's not known in this incarnation of the heap
+ */
+unsigned
+palloc_class_id(struct palloc_heap *heap, uint64_t off)
+{
+	struct memory_block m;
+	alloc_get_block(heap, off, &m);
+
+	struct bucket *b = heap_get_chunk_bucket(heap, m.chunk_id, m.zone_id);
+	if (b == NULL)
+		return 0;
+
+	return b->type == BUCKET_HUGE ?
+		HEAP_HUGE_CLASS_ID : HEAP_BID_TO_CLASS_ID(b->id);
+}
+
+/*
+ * palloc_occupancy -- returns the percentage of used space in the run which
+ *	contains the object and an identifier of the object's chunk
+ */
+unsigned
+palloc_occupancy(struct palloc_heap *heap, uint64_t off, uint64_t *chunk)
+{
+	struct memory_block m;
+	alloc_get_block(heap, off, &m);
+
+	*chunk = ((uint64_t)m.zone_id << 32) | m.chunk_id;
+
+	return heap_run_occupancy(heap, m);
+}
+
+/*
+ * palloc_heap_stats -- returns the fragmentation statistics of the heap
+ */
+void
+palloc_heap_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses)
+{
+	heap_stats(heap, stats, classes, nclasses);
+}
+
+/*
+ * Free blocks of a run taken out of its bucket.
+ */
+struct palloc_detached_run {
+	struct bucket *bucket;
+	unsigned nblocks;
+	struct memory_block blocks[];
+};
+
+/*
+ * palloc_run_detach -- prevents any further allocations from the run which
+ *	contains the object, until it's attached back
+ */
+struct palloc_detached_run *
+palloc_run_detach(struct palloc_heap *heap, uint64_t off)
+{
+	struct memory_block m;
+	alloc_get_block(heap, off, &m);
+
+	struct bucket *b = heap_get_chunk_bucket(heap, m.chunk_id, m.zone_id);
+	ASSERTne(b, NULL);
+	ASSERTeq(b->type, BUCKET_RUN);
+
+	struct bucket_run *br = (struct bucket_run *)b;
+	struct palloc_detached_run *r = Malloc(sizeof(*r) +
+		br->bitmap_nallocs * sizeof(struct memory_block));
+	if (r == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	r->bucket = b;
+	r->nblocks = heap_run_detach(heap, b, m, r->blocks);
+
+	return r;
+}
+
+/*
+ * palloc_run_attach -- returns the free blocks of a detached run back to its
+ *	bucket
+ */
+void
+palloc_run_attach(struct palloc_heap *heap, struct palloc_detached_run *r)
+{
+	heap_run_attach(heap, r->bucket, r->blocks, r->nblocks);
+
+	Free(r);
+}
+
+/*
+ * pmalloc_search_cb -- (internal) foreach callback. If the argument is equal
+ *	to the current object offset then sets the argument to UINT64_MAX.
+ *	If the argument is UINT64_MAX it breaks the iteration and sets the
+ *	argument to the current object offset.
+ */
+static int
+pmalloc_search_cb(uint64_t off, void *arg)
+{
+	uint64_t *prev = arg;
+
+	if (*prev == UINT64_MAX) {
+		*prev = off;
+
+		return 1;
+	}
+
+	if (off == *prev)
+		*prev = UINT64_MAX;
+
+	return 0;
+}
+
+/*
+ * alloc_object_off -- (internal) translates the offset of an object reported
+ *	by heap_foreach_object into the offset of its user data
+ */
+static uint64_t
+alloc_object_off(struct palloc_heap *heap, uint64_t off)
+{
+	struct memory_block m;
+
+	return off + alloc_header_size(heap_get_headerless_block(heap,
+		PMALLOC_OFF_TO_PTR(heap, off), &m));
+}
+
+/*
+ * palloc_first -- returns the offset of the user data of the first object
+ *	from the heap.
  */
 uint64_t
 palloc_first(struct palloc_heap *heap)
@@ -543,28 +1266,78 @@ palloc_first(struct palloc_heap *heap)
 	if (off_search == UINT64_MAX)
 		return 0;
 
-	return off_search + sizeof(struct allocation_header);
+	return alloc_object_off(heap, off_search);
 }
 
 /*
- * palloc_next -- returns the next object relative to 'off'.
+ * palloc_next -- returns the offset of the user data of the next object
+ *	relative to 'off'.
  */
 uint64_t
 palloc_next(struct palloc_heap *heap, uint64_t off)
 {
-	struct allocation_header *alloc = ALLOC_GET_HEADER(heap, off);
-	struct memory_block m = get_mblock_from_alloc(heap, alloc);
+	struct memory_block m;
+	uint64_t off_start = off -
+		alloc_header_size(alloc_get_block(heap, off, &m));
 
-	uint64_t off_search = off - ALLOC_OFF;
+	uint64_t off_search = off_start;
 
 	heap_foreach_object(heap, pmalloc_search_cb, &off_search, m);
 
-	if (off_search == (off - ALLOC_OFF) ||
+	if (off_search == off_start ||
 		off_search == 0 ||
 		off_search == UINT64_MAX)
 		return 0;
 
-	return off_search + sizeof(struct allocation_header);
+	return alloc_object_off(heap, off_search);
+}
+
+struct palloc_foreach_arg {
+	struct palloc_heap *heap;
+	palloc_object_cb cb;
+	void *arg;
+};
+
+/*
+ * palloc_foreach_cb -- (internal) foreach callback, passes the offset of
+ *	the user data of the object to the palloc_foreach callback
+ */
+static int
+palloc_foreach_cb(uint64_t off, void *arg)
+{
+	struct palloc_foreach_arg *a = arg;
+
+	return a->cb(alloc_object_off(a->heap, off), a->arg);
+}
+
+/*
+ * palloc_foreach -- calls the callback with the offset of the user data of
+ *	every object in the heap, in the order of palloc_next, until it returns
+ *	a non-zero value
+ */
+void
+palloc_foreach(struct palloc_heap *heap, palloc_object_cb cb, void *arg)
+{
+	struct palloc_foreach_arg a = {heap, cb, arg};
+	struct memory_block m = {0, 0, 0, 0};
+
+	heap_foreach_object(heap, palloc_foreach_cb, &a, m);
+}
+
+/*
+ * palloc_foreach_partition -- calls the callback with the offset of the user
+ *	data of every object in one of the 'npartitions' disjoint parts of
+ *	the heap, until it returns a non-zero value, and returns non-zero if it
+ *	did
+ */
+int
+palloc_foreach_partition(struct palloc_heap *heap, palloc_object_cb cb,
+	void *arg, unsigned npartitions, unsigned partition)
+{
+	struct palloc_foreach_arg a = {heap, cb, arg};
+
+	return heap_foreach_object_partition(heap, palloc_foreach_cb, &a,
+		npartitions, partition);
 }
 
 /*
@@ -572,9 +1345,478 @@ palloc_next(struct palloc_heap *heap, uint64_t off)
  */
 int
 palloc_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
-		void *base, struct pmem_ops *p_ops)
+		uint64_t run_id, void *base, struct pmem_ops *p_ops)
+{
+	return heap_boot(heap, heap_start, heap_size, run_id, base, p_ops);
+}
+
+/*
+ * palloc_boot_rdonly -- attaches to the heap of a pool opened read-only,
+ *	only the objects can be looked up and iterated over
+ */
+void
+palloc_boot_rdonly(struct palloc_heap *heap, void *heap_start,
+		uint64_t heap_size, void *base, struct pmem_ops *p_ops)
+{
+	heap_boot_rdonly(heap, heap_start, heap_size, base, p_ops);
+}
+
+enum palloc_action_type {
+	PALLOC_ACTION_RESERVE,
+	PALLOC_ACTION_SET_VALUE,
+
+	MAX_PALLOC_ACTION_TYPE
+};
+
+/*
+ * palloc_action -- internal representation of struct pobj_action
+ */
+struct palloc_action {
+	enum palloc_action_type type;
+	struct memory_block m; /* the reserved block */
+	uint64_t *ptr; /* destination of the deferred store */
+	uint64_t value; /* stored value, or the offset of the reserved object */
+};
+
+/*
+ * palloc_reserve -- reserves a memory block of at least size bytes in
+ *	the transient state of the heap and runs the constructor on it
+ *
+ * The persistent state of the heap is not modified, the block is either
+ * marked as allocated by palloc_publish or returned back to the heap by
+ * palloc_cancel. The offset of the reserved object is stored in dest_off.
+ */
+int
+palloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, unsigned class_id,
+	struct pobj_action *act, uint64_t *dest_off)
+{
+	COMPILE_ERROR_ON(sizeof(struct palloc_action) !=
+		sizeof(struct pobj_action));
+
+	struct palloc_action *a = (struct palloc_action *)act;
+	struct memory_block m = {0, 0, 0, 0};
+
+	errno = alloc_reserve_block(heap, NULL, class_id, 0, &m, size);
+	if (errno != 0)
+		return -1;
+
+	uint64_t offset_value;
+
+	/* the flushed headers are drained by palloc_publish */
+	if (alloc_prep_block(heap, m, 0, constructor, arg,
+			&offset_value, 0)) {
+		alloc_cancel_block(heap, NULL, m);
+
+		errno = ECANCELED;
+		return -1;
+	}
+
+	a->type = PALLOC_ACTION_RESERVE;
+	a->m = m;
+	a->ptr = NULL;
+	a->value = offset_value;
+
+	*dest_off = offset_value;
+
+	return 0;
+}
+
+/*
+ * palloc_set_value -- creates an action which stores the value in ptr
+ *	when published
+ */
+void
+palloc_set_value(struct palloc_heap *heap, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value)
+{
+	struct palloc_action *a = (struct palloc_action *)act;
+
+	a->type = PALLOC_ACTION_SET_VALUE;
+	a->ptr = ptr;
+	a->value = value;
+}
+
+/*
+ * palloc_cancel -- returns the reserved blocks back to the transient heap
+ */
+void
+palloc_cancel(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt)
+{
+	struct palloc_action *acts = (struct palloc_action *)actv;
+
+	for (size_t i = 0; i < actvcnt; ++i) {
+		if (acts[i].type != PALLOC_ACTION_RESERVE)
+			continue;
+
+		struct memory_block m = acts[i].m;
+		void *block_data = heap_get_block_data(heap, m);
+		void *userdatap = PMALLOC_OFF_TO_PTR(heap, acts[i].value);
+
+		VALGRIND_DO_MEMPOOL_FREE(heap->layout, userdatap);
+		VALGRIND_DO_MAKE_MEM_NOACCESS(block_data,
+			(uintptr_t)userdatap - (uintptr_t)block_data);
+
+		alloc_cancel_block(heap, NULL, m);
+	}
+}
+
+/*
+ * publish_group_process -- (internal) processes the operation with the
+ *	metadata updates of a group of reserved blocks and values
+ */
+static void
+publish_group_process(struct palloc_heap *heap, struct operation_context *ctx,
+	struct palloc_action **group, size_t ngroup)
+{
+	operation_process(ctx);
+
+	for (size_t i = 0; i < ngroup; ++i)
+		MEMBLOCK_OPS(AUTO, &group[i]->m)->unlock(&group[i]->m, heap);
+
+	operation_init(ctx, ctx->base, ctx->redo_ctx, ctx->redo);
+}
+
+/*
+ * publish_ctx_full -- (internal) checks if another entry of either type
+ *	could overflow the operation context
+ */
+static int
+publish_ctx_full(struct operation_context *ctx)
+{
+	return ctx->nentries[ENTRY_PERSISTENT] == ctx->max_entries ||
+		ctx->nentries[ENTRY_TRANSIENT] == ctx->max_entries;
+}
+
+/*
+ * palloc_publish -- marks the reserved blocks as allocated and performs
+ *	the deferred stores
+ *
+ * All of the blocks and values are processed using the redo log of the
+ * context. The blocks are persistently allocated first, in groups that fit
+ * in a single redo log, and the values are stored afterwards, so that a
+ * pointer to a new object can never be published before the object itself.
+ * Each block adds at most one persistent and one transient entry to the
+ * context, the values are stored atomically only if all of them fit in the
+ * last group. A context extended to hold an entry of each type per action
+ * processes all of them at once.
+ */
+void
+palloc_publish(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
+	struct operation_context *ctx)
+{
+	struct palloc_action *acts = (struct palloc_action *)actv;
+	struct palloc_action *embedded[MAX_PERSITENT_ENTRIES];
+	struct palloc_action **group = embedded;
+	size_t max_group = MAX_PERSITENT_ENTRIES;
+	size_t ngroup = 0;
+
+	if (ctx->max_entries > MAX_PERSITENT_ENTRIES) {
+		group = Malloc(sizeof(*group) * ctx->max_entries);
+		if (group != NULL)
+			max_group = ctx->max_entries;
+		else
+			group = embedded;
+	}
+
+	/* the headers of the reserved blocks are only flushed */
+	pmemops_drain(&heap->p_ops);
+
+	size_t i = 0;
+	while (i < actvcnt) {
+		/* gather the next group of reservations */
+		for (ngroup = 0; i < actvcnt && ngroup < max_group; ++i) {
+			if (acts[i].type != PALLOC_ACTION_RESERVE)
+				continue;
+
+			/*
+			 * Run locks are always acquired in the order of their
+			 * addresses, otherwise two threads publishing the same
+			 * runs could deadlock.
+			 */
+			size_t n = ngroup++;
+			pthread_mutex_t *lock = heap_get_run_lock(heap,
+				acts[i].m.chunk_id);
+			for (; n > 0 && heap_get_run_lock(heap,
+				group[n - 1]->m.chunk_id) > lock; --n)
+				group[n] = group[n - 1];
+			group[n] = &acts[i];
+		}
+
+		for (size_t g = 0; g < ngroup; ++g) {
+			struct memory_block *m = &group[g]->m;
+#ifdef DEBUG
+			if (heap_block_is_allocated(heap, *m)) {
+				ERR("heap corruption");
+				ASSERT(0);
+			}
+#endif /* DEBUG */
+			MEMBLOCK_OPS(AUTO, m)->lock(m, heap);
+			MEMBLOCK_OPS(AUTO, m)->prep_hdr(m, heap,
+				HDR_OP_ALLOC, ctx);
+		}
+
+		/* the last group is processed together with the values */
+		if (i < actvcnt) {
+			publish_group_process(heap, ctx, group, ngroup);
+			ngroup = 0;
+		}
+	}
+
+	for (i = 0; i < actvcnt; ++i) {
+		if (acts[i].type != PALLOC_ACTION_SET_VALUE)
+			continue;
+
+		if (publish_ctx_full(ctx)) {
+			publish_group_process(heap, ctx, group, ngroup);
+			ngroup = 0;
+		}
+
+		operation_add_entry(ctx, acts[i].ptr, acts[i].value,
+			OPERATION_SET);
+	}
+
+	publish_group_process(heap, ctx, group, ngroup);
+
+	palloc_heap_modified(heap);
+
+	if (group != embedded)
+		Free(group);
+}
+
+/*
+ * Number of blocks that palloc_free_bulk frees with a single operation
+ * at most, unless it fails to allocate the array for them.
+ */
+#define FREE_BULK_MAX_BLOCKS 4096
+#define FREE_BULK_EMBEDDED_BLOCKS 64
+
+/* a block freed by the current operation of palloc_free_bulk */
+struct free_bulk_block {
+	struct bucket *b;
+	enum memory_block_type type;
+	struct memory_block m;
+	struct memory_block reclaimed; /* the coalesced free block */
+};
+
+/*
+ * free_bulk_prep -- (internal) locks the block and creates the entries of its
+ *	free persistent state
+ */
+static void
+free_bulk_prep(struct palloc_heap *heap, struct operation_context *ctx,
+	struct free_bulk_block *f)
+{
+	/* the run locks are recursive, see palloc_operation */
+	MEMBLOCK_OPS(AUTO, &f->m)->lock(&f->m, heap);
+	f->reclaimed = heap_free_block(heap, f->b, f->m, ctx);
+}
+
+/*
+ * free_bulk_process -- (internal) processes the operation with the metadata
+ *	updates of the blocks and returns them to their buckets
+ */
+static void
+free_bulk_process(struct palloc_heap *heap, struct operation_context *ctx,
+	struct free_bulk_block *blocks, size_t nblocks)
 {
-	return heap_boot(heap, heap_start, heap_size, base, p_ops);
+	operation_process(ctx);
+	operation_init(ctx, ctx->base, ctx->redo_ctx, ctx->redo);
+
+	for (size_t i = 0; i < nblocks; ++i) {
+		struct free_bulk_block *f = &blocks[i];
+
+		MEMBLOCK_OPS(AUTO, &f->m)->unlock(&f->m, heap);
+
+		if (f->b == NULL)
+			continue;
+
+		CNT_OP(f->b, insert, heap, f->reclaimed);
+#ifdef DEBUG
+		if (heap_block_is_allocated(heap, f->reclaimed)) {
+			ERR("heap corruption");
+			ASSERT(0);
+		}
+#endif /* DEBUG */
+	}
+
+	/* all of the blocks come from the same run */
+	if (nblocks != 0 && blocks[0].type == MEMORY_BLOCK_RUN &&
+			blocks[0].b != NULL)
+		heap_degrade_run_if_empty(heap, blocks[0].b,
+			blocks[nblocks - 1].reclaimed);
+}
+
+/*
+ * palloc_free_bulk -- frees the objects at the given offsets, which must be
+ *	sorted, without clearing any references to them
+ *
+ * All of the objects of a single run are freed by one operation, in which the
+ * updates of the same bitmap value are merged, so freeing a full run costs
+ * about as much as freeing a single object. Consecutive huge blocks are freed
+ * together as well, the adjacent ones as a single free block. A run is turned
+ * back into a chunk as soon as it's empty. The operation is processed whenever
+ * it couldn't fit another entry, the extension of the context, if any, is
+ * renewed after each one.
+ *
+ * The objects must come from verified zones, e.g. found by palloc_foreach.
+ */
+void
+palloc_free_bulk(struct palloc_heap *heap, const uint64_t *offs, size_t noffs,
+	struct operation_context *ctx)
+{
+	struct free_bulk_block embedded[FREE_BULK_EMBEDDED_BLOCKS];
+	struct free_bulk_block *blocks = Malloc(sizeof(*blocks) *
+		FREE_BULK_MAX_BLOCKS);
+	size_t max_blocks = FREE_BULK_MAX_BLOCKS;
+	if (blocks == NULL) {
+		blocks = embedded;
+		max_blocks = FREE_BULK_EMBEDDED_BLOCKS;
+	}
+
+	uint64_t overflow = ctx->overflow;
+	size_t max_entries = ctx->max_entries;
+
+	size_t nblocks = 0;
+
+	/* the last huge block can still grow, it's prepared when it can't */
+	int pending = 0;
+
+	for (size_t i = 0; i < noffs; ++i) {
+		ASSERT(i == 0 || offs[i - 1] < offs[i]);
+
+		struct free_bulk_block f;
+		alloc_get_block(heap, offs[i], &f.m);
+		f.type = memblock_autodetect_type(&f.m, heap->layout);
+
+#ifdef DEBUG
+		if (!heap_block_is_allocated(heap, f.m)) {
+			ERR("Double free or heap corruption");
+			ASSERT(0);
+		}
+#endif /* DEBUG */
+
+		VALGRIND_DO_MEMPOOL_FREE(heap->layout,
+			PMALLOC_OFF_TO_PTR(heap, offs[i]));
+
+		if (pending) {
+			struct free_bulk_block *last = &blocks[nblocks - 1];
+			if (f.type == MEMORY_BLOCK_HUGE &&
+				f.m.zone_id == last->m.zone_id &&
+				f.m.chunk_id == last->m.chunk_id +
+					last->m.size_idx) {
+				last->m.size_idx += f.m.size_idx;
+				continue;
+			}
+
+			free_bulk_prep(heap, ctx, last);
+			pending = 0;
+		}
+
+		/* a run is locked only for as long as its own operation */
+		struct free_bulk_block *first = &blocks[0];
+		if (nblocks == max_blocks || publish_ctx_full(ctx) ||
+			(nblocks != 0 && (f.type != first->type ||
+			(f.type == MEMORY_BLOCK_RUN &&
+			(f.m.chunk_id != first->m.chunk_id ||
+			f.m.zone_id != first->m.zone_id))))) {
+			free_bulk_process(heap, ctx, blocks, nblocks);
+			nblocks = 0;
+
+			if (max_entries > ctx->max_entries &&
+				operation_extend(ctx, overflow,
+					max_entries) != 0)
+				max_entries = ctx->max_entries;
+		}
+
+		f.b = heap_get_chunk_bucket(heap, f.m.chunk_id, f.m.zone_id);
+		if (f.type == MEMORY_BLOCK_HUGE)
+			pending = 1;
+		else
+			free_bulk_prep(heap, ctx, &f);
+
+		blocks[nblocks++] = f;
+	}
+
+	if (pending)
+		free_bulk_prep(heap, ctx, &blocks[nblocks - 1]);
+
+	free_bulk_process(heap, ctx, blocks, nblocks);
+
+	palloc_heap_modified(heap);
+
+	if (blocks != embedded)
+		Free(blocks);
+}
+
+/*
+ * palloc_alloc_class_register -- registers a custom allocation class, whose
+ *	objects have header_size of the PALLOC_DATA_OFF bytes in front of the
+ *	user data backed by their memory blocks
+ */
+int
+palloc_alloc_class_register(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_block, int huge, size_t header_size,
+	unsigned *class_id)
+{
+	enum header_type header_type;
+	if (header_size == PALLOC_DATA_OFF)
+		header_type = HEADER_LEGACY;
+	else if (header_size == PALLOC_COMPACT_DATA_OFF)
+		header_type = HEADER_COMPACT;
+	else if (header_size == 0)
+		header_type = HEADER_NONE;
+	else
+		return EINVAL;
+
+	return heap_create_alloc_class(heap, unit_size, units_per_block, huge,
+		header_type, class_id);
+}
+
+/*
+ * palloc_numa_init -- associates the heap with NUMA nodes of its memory
+ */
+void
+palloc_numa_init(struct palloc_heap *heap,
+	int (*addr_node)(void *arg, const void *addr), void *arg)
+{
+	heap_zones_numa_init(heap, addr_node, arg);
+}
+
+/*
+ * palloc_features_init -- sets the callback enabling the on-media features
+ *	of the heap
+ */
+void
+palloc_features_init(struct palloc_heap *heap,
+	int (*enable)(void *arg, unsigned features), void *arg)
+{
+	heap_features_init(heap, enable, arg);
+}
+
+/*
+ * palloc_assume_zeroed -- declares that the unused memory of a newly created
+ *	heap is zeroed
+ */
+void
+palloc_assume_zeroed(struct palloc_heap *heap)
+{
+	heap_assume_zeroed(heap);
+}
+
+/*
+ * palloc_block_zeroed -- returns whether the memory of the object passed to
+ *	the constructor running in this thread is known to be zeroed
+ *
+ * Such memory was never handed out since the pool was created, so the
+ * constructor can skip zeroing it.
+ */
+int
+palloc_block_zeroed(void)
+{
+	return Alloc_block_zeroed;
 }
 
 /*
@@ -595,6 +1837,53 @@ palloc_heap_end(struct palloc_heap *h)
 	return heap_end(h);
 }
 
+/*
+ * palloc_heap_check_init -- configures the heap verification
+ */
+void
+palloc_heap_check_init(const char *threads_var, const char *defer_var)
+{
+	heap_check_init(threads_var, defer_var);
+}
+
+/*
+ * palloc_heap_summary_init -- configures the free space summary of the heap
+ */
+void
+palloc_heap_summary_init(const char *summary_var)
+{
+	heap_summary_init(summary_var);
+}
+
+/*
+ * palloc_heap_affinity_init -- configures the chunks set aside for the runs
+ *	of each thread cache
+ */
+void
+palloc_heap_affinity_init(const char *affinity_var)
+{
+	heap_affinity_init(affinity_var);
+}
+
+/*
+ * palloc_heap_tune_init -- configures the tuning of the allocation classes
+ */
+void
+palloc_heap_tune_init(const char *tune_var)
+{
+	heap_tune_init(tune_var);
+}
+
+/*
+ * palloc_heap_check_nthreads -- returns the number of threads verifying
+ *	the pool
+ */
+unsigned
+palloc_heap_check_nthreads(void)
+{
+	return heap_check_nthreads();
+}
+
 /*
  * palloc_heap_check -- verifies heap state
  */
@@ -604,6 +1893,37 @@ palloc_heap_check(void *heap_start, uint64_t heap_size)
 	return heap_check(heap_start, heap_size);
 }
 
+/*
+ * palloc_heap_check_open -- verifies heap state on open, possibly leaving
+ *	the zones to be verified in the background
+ */
+int
+palloc_heap_check_open(void *heap_start, uint64_t heap_size, uint64_t run_id)
+{
+	return heap_check_open(heap_start, heap_size, run_id);
+}
+
+/*
+ * palloc_heap_check_wait -- waits for the verification of the heap to
+ *	complete, returns the number of inconsistent zones
+ */
+unsigned
+palloc_heap_check_wait(struct palloc_heap *heap)
+{
+	return heap_check_wait(heap);
+}
+
+/*
+ * palloc_heap_scrub -- verifies the next chunk of the heap, returns 0 once
+ *	the whole heap has been walked
+ */
+int
+palloc_heap_scrub(struct palloc_heap *heap, uint64_t *cursor,
+	palloc_scrub_cb cb, void *arg)
+{
+	return heap_scrub(heap, cursor, cb, arg);
+}
+
 /*
  * palloc_heap_check_remote -- verifies state of remote replica
  */
@@ -631,7 +1951,9 @@ void
 palloc_vg_register_object(struct palloc_heap *heap, PMEMoid oid, size_t size)
 {
 	void *addr = pmemobj_direct(oid);
-	size_t headers = sizeof(struct allocation_header) + PALLOC_DATA_OFF;
+	struct memory_block m;
+	size_t headers = alloc_header_size(heap_get_headerless_block(heap,
+		addr, &m));
 
 	VALGRIND_DO_MEMPOOL_ALLOC(heap->layout, addr, size);
 	VALGRIND_DO_MAKE_MEM_DEFINED((char *)addr - headers, size + headers);
@@ -48,6 +48,12 @@
  */
 #define PALLOC_DATA_OFF 48
 
+/*
+ * Number of bytes in front of the user data in objects with compact headers,
+ * the part of PALLOC_DATA_OFF which is actually backed by the memory block.
+ */
+#define PALLOC_COMPACT_DATA_OFF 16
+
 struct palloc_heap {
 	struct pmem_ops p_ops;
 	struct heap_layout *layout;
@@ -55,26 +61,98 @@ struct palloc_heap {
 	uint64_t size;
 
 	void *base;
+
+	/* incremented after every allocation and free of an object */
+	uint64_t generation;
 };
 
 typedef int (*palloc_constr)(void *base, void *ptr,
 		size_t usable_size, void *arg);
 
+/* reports an inconsistency found in the heap, see palloc_heap_scrub */
+typedef void (*palloc_scrub_cb)(uint64_t off, const char *msg, void *arg);
+
+struct palloc_cache;
+
+struct palloc_cache *palloc_cache_new(void);
+void palloc_cache_delete(struct palloc_cache *cache);
+void palloc_cache_flush(struct palloc_heap *heap, struct palloc_cache *cache);
+void palloc_cache_request_flush(struct palloc_cache *cache);
+
 int palloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 	size_t size, palloc_constr constructor, void *arg,
+	struct operation_context *ctx, struct palloc_cache *cache,
+	unsigned class_id, size_t alignment);
+
+int palloc_reserve(struct palloc_heap *heap, size_t size,
+	palloc_constr constructor, void *arg, unsigned class_id,
+	struct pobj_action *act, uint64_t *dest_off);
+void palloc_set_value(struct palloc_heap *heap, struct pobj_action *act,
+	uint64_t *ptr, uint64_t value);
+void palloc_publish(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt,
 	struct operation_context *ctx);
+void palloc_cancel(struct palloc_heap *heap,
+	struct pobj_action *actv, size_t actvcnt);
+void palloc_free_bulk(struct palloc_heap *heap, const uint64_t *offs,
+	size_t noffs, struct operation_context *ctx);
+
+int palloc_alloc_class_register(struct palloc_heap *heap, size_t unit_size,
+	unsigned units_per_block, int huge, size_t header_size,
+	unsigned *class_id);
 
 uint64_t palloc_first(struct palloc_heap *heap);
 uint64_t palloc_next(struct palloc_heap *heap, uint64_t off);
 
+typedef int (*palloc_object_cb)(uint64_t off, void *arg);
+void palloc_foreach(struct palloc_heap *heap, palloc_object_cb cb, void *arg);
+int palloc_foreach_partition(struct palloc_heap *heap, palloc_object_cb cb,
+	void *arg, unsigned npartitions, unsigned partition);
+
 size_t palloc_usable_size(struct palloc_heap *heap, uint64_t off);
+size_t palloc_header_size(struct palloc_heap *heap, uint64_t off);
+size_t palloc_object_info(struct palloc_heap *heap, uint64_t off,
+	size_t *header_size);
+void palloc_prefetch(struct palloc_heap *heap, uint64_t off);
+unsigned palloc_class_id(struct palloc_heap *heap, uint64_t off);
+unsigned palloc_occupancy(struct palloc_heap *heap, uint64_t off,
+	uint64_t *chunk);
+void palloc_heap_stats(struct palloc_heap *heap, struct pobj_heap_stats *stats,
+	struct pobj_alloc_class_stats *classes, unsigned nclasses);
+
+struct palloc_detached_run;
+
+struct palloc_detached_run *palloc_run_detach(struct palloc_heap *heap,
+	uint64_t off);
+void palloc_run_attach(struct palloc_heap *heap,
+	struct palloc_detached_run *r);
 
 int palloc_boot(struct palloc_heap *heap, void *heap_start,
+		uint64_t heap_size, uint64_t run_id, void *base,
+		struct pmem_ops *p_ops);
+void palloc_boot_rdonly(struct palloc_heap *heap, void *heap_start,
 		uint64_t heap_size, void *base, struct pmem_ops *p_ops);
 
+void palloc_numa_init(struct palloc_heap *heap,
+	int (*addr_node)(void *arg, const void *addr), void *arg);
+void palloc_features_init(struct palloc_heap *heap,
+	int (*enable)(void *arg, unsigned features), void *arg);
+void palloc_assume_zeroed(struct palloc_heap *heap);
+int palloc_block_zeroed(void);
+
 int palloc_init(void *heap_start, uint64_t heap_size, struct pmem_ops *p_ops);
 void *palloc_heap_end(struct palloc_heap *h);
+void palloc_heap_check_init(const char *threads_var, const char *defer_var);
+void palloc_heap_summary_init(const char *summary_var);
+void palloc_heap_affinity_init(const char *affinity_var);
+void palloc_heap_tune_init(const char *tune_var);
+unsigned palloc_heap_check_nthreads(void);
 int palloc_heap_check(void *heap_start, uint64_t heap_size);
+int palloc_heap_check_open(void *heap_start, uint64_t heap_size,
+		uint64_t run_id);
+unsigned palloc_heap_check_wait(struct palloc_heap *heap);
+int palloc_heap_scrub(struct palloc_heap *heap, uint64_t *cursor,
+	palloc_scrub_cb cb, void *arg);
 int palloc_heap_check_remote(void *heap_start, uint64_t heap_size,
 		struct remote_ops *ops);
 void palloc_heap_cleanup(struct palloc_heap *heap);
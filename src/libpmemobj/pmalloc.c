@@ -45,6 +45,8 @@
 #include "out.h"
 #include "palloc.h"
 #include "pmalloc.h"
+#include "set.h"
+#include "tx.h"
 #include "valgrind_internal.h"
 
 /*
@@ -70,6 +72,142 @@ pmalloc_redo_release(PMEMobjpool *pop)
 	lane_release(pop);
 }
 
+/*
+ * pmalloc_redo_overflow_constr -- (internal) constructor of a new overflow
+ *	segment of the allocator redo log
+ *
+ * The segment must be zeroed, its link to the next one is followed and its
+ * entries might be reached from a stale link of an interrupted operation. It
+ * is marked as an internal object, because it's reused by all of the
+ * following operations of the lane.
+ */
+static int
+pmalloc_redo_overflow_constr(void *ctx, void *ptr, size_t usable_size,
+	void *arg)
+{
+	PMEMobjpool *pop = ctx;
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(&oobh->size, sizeof(oobh->size));
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(&pop->p_ops, &oobh->size, sizeof(oobh->size));
+	VALGRIND_REMOVE_FROM_TX(&oobh->size, sizeof(oobh->size));
+
+	VALGRIND_ADD_TO_TX(ptr, usable_size);
+	pmemops_memset_persist(&pop->p_ops, ptr, 0, usable_size);
+	VALGRIND_REMOVE_FROM_TX(ptr, usable_size);
+
+	return 0;
+}
+
+/*
+ * pmalloc_redo_extend -- extends the operation, which uses the redo log of
+ *	the allocator lane section held by the caller, to nentries entries
+ *
+ * The overflow segments of the redo log are allocated once per lane, when
+ * an operation needs them for the first time, and reused afterwards. This
+ * must be called before any entry is added to the operation.
+ */
+int
+pmalloc_redo_extend(PMEMobjpool *pop, struct operation_context *ctx,
+	size_t nentries)
+{
+	ASSERTeq(ctx->nentries[ENTRY_PERSISTENT], 0);
+	ASSERTeq(ctx->nentries[ENTRY_TRANSIENT], 0);
+
+	if (nentries <= ALLOC_REDO_LOG_SIZE)
+		return 0;
+
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	struct lane_alloc_layout *sec = (void *)lane->layout;
+	ASSERTeq(sec->redo, ctx->redo);
+
+	int ret = 0;
+
+	/* the last entry of all but the last segment links to the next one */
+	size_t capacity = ALLOC_REDO_LOG_SIZE;
+	uint64_t *next = &sec->overflow;
+	while (capacity < nentries) {
+		/* the pool must be marked before the first segment exists */
+		if (*next == 0 && (ret = obj_feature_enable(pop,
+				OBJ_FORMAT_INCOMPAT_REDO_OVERFLOW)) != 0)
+			break;
+
+		if (*next == 0 && (ret = pmalloc_construct(pop, next,
+				sizeof(struct redo_log_overflow),
+				pmalloc_redo_overflow_constr, NULL)) != 0) {
+			errno = ret;
+			ERR("!cannot allocate redo log overflow segment");
+			ret = -1;
+			break;
+		}
+
+		struct redo_log_overflow *overflow =
+			OBJ_OFF_TO_PTR(pop, *next);
+		capacity += REDO_OVERFLOW_NUM_ENTRIES - 1;
+		next = &overflow->next;
+	}
+
+	if (ret == 0)
+		ret = operation_extend(ctx, sec->overflow, nentries);
+
+	lane_release(pop);
+
+	return ret;
+}
+
+/*
+ * pmalloc_cache_flush -- returns the blocks cached by the lane of the calling
+ *	thread back to the heap
+ */
+void
+pmalloc_cache_flush(PMEMobjpool *pop)
+{
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	if (lane->runtime != NULL)
+		palloc_cache_flush(&pop->heap, lane->runtime);
+
+	lane_release(pop);
+}
+
+/*
+ * pmalloc_cache_flush_all -- (internal) returns the blocks cached by the other
+ *	lanes back to the heap, returns 1 if any of them might have been
+ *
+ * The caches of the idle lanes are flushed right away, each lane is locked for
+ * the time being. The holders of the busy lanes are asked to flush their caches
+ * themselves, this makes a difference only for the subsequent allocations.
+ */
+static int
+pmalloc_cache_flush_all(PMEMobjpool *pop, uint64_t own)
+{
+	int flushed = 0;
+	for (uint64_t i = 0; i < pop->lanes_desc.runtime_nlanes; ++i) {
+		if (i == own)
+			continue;
+
+		struct palloc_cache *cache = util_atomic_load_acquire_ptr(
+			&pop->lanes_desc.lane[i].
+			sections[LANE_SECTION_ALLOCATOR].runtime);
+		if (cache == NULL)
+			continue;
+
+		if (lane_try_lock(pop, i)) {
+			palloc_cache_flush(&pop->heap, cache);
+			lane_unlock(pop, i);
+			flushed = 1;
+		} else {
+			palloc_cache_request_flush(cache);
+		}
+	}
+
+	return flushed;
+}
+
 /*
  * pmalloc_operation -- higher level wrapper for basic allocator API
  *
@@ -78,7 +216,7 @@ pmalloc_redo_release(PMEMobjpool *pop)
 int
 pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 	size_t size, palloc_constr constructor, void *arg,
-	struct operation_context *ctx)
+	struct operation_context *ctx, unsigned class_id, size_t alignment)
 {
 #ifdef USE_VG_MEMCHECK
 	uint64_t tmp;
@@ -86,13 +224,41 @@ pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 		dest_off = &tmp;
 #endif
 
+	/*
+	 * The allocator section is already held by the caller, this only
+	 * retrieves the runtime state of the lane.
+	 */
+	PMEMobjpool *pop = heap->base;
+	struct lane_section *lane;
+	unsigned idx = lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	/* the other lanes look up the cache when running out of memory */
+	if (lane->runtime == NULL)
+		util_atomic_store_release_ptr(&lane->runtime,
+			palloc_cache_new());
+
 	int ret = palloc_operation(heap, off, dest_off, size, constructor, arg,
-			ctx);
+			ctx, lane->runtime, class_id, alignment);
+
+	/* the blocks might be held in the caches of the other lanes */
+	if (ret != 0 && errno == ENOMEM && size != 0 &&
+			pmalloc_cache_flush_all(pop, idx))
+		ret = palloc_operation(heap, off, dest_off, size, constructor,
+			arg, ctx, lane->runtime, class_id, alignment);
+
+	/* the objects freed by transactions might not have been freed yet */
+	if (ret != 0 && errno == ENOMEM && size != 0 && tx_reclaim_wait(pop))
+		ret = palloc_operation(heap, off, dest_off, size, constructor,
+			arg, ctx, lane->runtime, class_id, alignment);
+
+	lane_release(pop);
+
 	if (ret)
 		return ret;
 
 #ifdef USE_VG_MEMCHECK
-	if (size && On_valgrind) {
+	if (size && On_valgrind &&
+		palloc_header_size(heap, *dest_off) == OBJ_OOB_SIZE) {
 		struct oob_header *pobj =
 			OOB_HEADER_FROM_PTR((char *)heap->base + *dest_off);
 
@@ -124,7 +290,8 @@ pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 	struct operation_context ctx;
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL,
+		&ctx, 0, 0);
 
 	pmalloc_redo_release(pop);
 
@@ -149,7 +316,7 @@ pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, 0, off, size, constructor, arg,
-			&ctx);
+			&ctx, 0, 0);
 
 	pmalloc_redo_release(pop);
 
@@ -171,7 +338,8 @@ prealloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0,
+		&ctx, 0, 0);
 
 	pmalloc_redo_release(pop);
 
@@ -196,7 +364,7 @@ prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, *off, off, size, constructor,
-			arg, &ctx);
+			arg, &ctx, 0, 0);
 
 	pmalloc_redo_release(pop);
 
@@ -218,7 +386,8 @@ pfree(PMEMobjpool *pop, uint64_t *off)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL,
+		&ctx, 0, 0);
 	ASSERTeq(ret, 0);
 
 	pmalloc_redo_release(pop);
@@ -226,6 +395,8 @@ pfree(PMEMobjpool *pop, uint64_t *off)
 
 /*
  * pmalloc_construct_rt -- construct runtime part of allocator section
+ *
+ * The allocation cache of the lane is created on first use.
  */
 static void *
 pmalloc_construct_rt(PMEMobjpool *pop)
@@ -239,7 +410,8 @@ pmalloc_construct_rt(PMEMobjpool *pop)
 static void
 pmalloc_destroy_rt(PMEMobjpool *pop, void *rt)
 {
-	/* nop */
+	if (rt != NULL)
+		palloc_cache_delete(rt);
 }
 
 /*
@@ -267,10 +439,48 @@ pmalloc_check(PMEMobjpool *pop, void *data, unsigned length)
 	struct lane_alloc_layout *sec = data;
 
 	int ret = redo_log_check(pop->redo, sec->redo, ALLOC_REDO_LOG_SIZE);
-	if (ret != 0)
+	if (ret != 0) {
 		ERR("allocator lane: redo log check failed");
+		return ret;
+	}
 
-	return ret;
+	for (unsigned i = 0; i < ALLOC_RETIRE_LIST_SIZE; ++i) {
+		uint64_t off = sec->retire[i].off;
+		if (off != 0 && !OBJ_OFF_FROM_HEAP(pop, off)) {
+			ERR("allocator lane: invalid retired object offset "
+				"0x%016jx", off);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * pmalloc_addr_numa_node -- (internal) returns NUMA node backing the address
+ */
+static int
+pmalloc_addr_numa_node(void *arg, const void *addr)
+{
+	return util_replica_addr_numa_node(arg, addr);
+}
+
+/*
+ * pmalloc_feature_enable -- (internal) marks the pool as containing runs which
+ *	depend on the given features of the heap
+ */
+static int
+pmalloc_feature_enable(void *arg, unsigned features)
+{
+	PMEMobjpool *pop = arg;
+	uint32_t incompat = 0;
+
+	if (features & HEAP_FEAT_COMPACT_HEADER)
+		incompat |= OBJ_FORMAT_INCOMPAT_COMPACT_HEADER;
+	if (features & HEAP_FEAT_TINY_RUNS)
+		incompat |= OBJ_FORMAT_INCOMPAT_TINY_RUNS;
+
+	return obj_feature_enable(pop, incompat) != 0 ? errno : 0;
 }
 
 /*
@@ -280,9 +490,40 @@ static int
 pmalloc_boot(PMEMobjpool *pop)
 {
 	COMPILE_ERROR_ON(PALLOC_DATA_OFF != OBJ_OOB_SIZE);
+	COMPILE_ERROR_ON(PALLOC_COMPACT_DATA_OFF !=
+		OBJ_OOB_SIZE - offsetof(struct oob_header, size));
 	COMPILE_ERROR_ON(ALLOC_BLOCK_SIZE != _POBJ_CL_ALIGNMENT);
+	COMPILE_ERROR_ON(sizeof(struct lane_alloc_layout) > LANE_SECTION_LEN);
 
-	return palloc_boot(&pop->heap, (char *)pop + pop->heap_offset,
+	int ret = palloc_boot(&pop->heap, (char *)pop + pop->heap_offset,
+			pop->heap_size, pop->run_id, pop, &pop->p_ops);
+	if (ret)
+		return ret;
+
+	if (pop->set != NULL) {
+		palloc_numa_init(&pop->heap, pmalloc_addr_numa_node,
+			pop->set->replica[0]);
+		palloc_features_init(&pop->heap, pmalloc_feature_enable, pop);
+	}
+
+	/*
+	 * The memory of new files is zeroed, but remote replicas only get
+	 * the ranges which are written.
+	 */
+	if (pop->set != NULL && pop->set->zeroed && !pop->set->remote)
+		palloc_assume_zeroed(&pop->heap);
+
+	return 0;
+}
+
+/*
+ * pmalloc_boot_rdonly -- attaches to the heap of a pool opened read-only,
+ *	bypassing the allocator section
+ */
+void
+pmalloc_boot_rdonly(PMEMobjpool *pop)
+{
+	palloc_boot_rdonly(&pop->heap, (char *)pop + pop->heap_offset,
 			pop->heap_size, pop, &pop->p_ops);
 }
 
@@ -50,14 +50,28 @@
  * location and the second for applying the chunk metadata modifications.
  */
 #define ALLOC_REDO_LOG_SIZE 10
+
+/*
+ * The number of objects retired by the threads of a lane which can wait for
+ * the end of their grace period at the same time, see epoch.c.
+ */
+#define ALLOC_RETIRE_LIST_SIZE 48
+
+struct alloc_retire_entry {
+	uint64_t off; /* offset of the retired object, zero if none */
+	uint64_t epoch; /* the epoch it was retired in, valid in this run only */
+};
+
 struct lane_alloc_layout {
 	struct redo_log redo[ALLOC_REDO_LOG_SIZE];
+	uint64_t overflow; /* first overflow segment of the redo log */
+	struct alloc_retire_entry retire[ALLOC_RETIRE_LIST_SIZE];
 };
 
 int pmalloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
 	palloc_constr constructor, void *arg,
-	struct operation_context *ctx);
+	struct operation_context *ctx, unsigned class_id, size_t alignment);
 
 int pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size);
 int pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
@@ -71,5 +85,9 @@ void pfree(PMEMobjpool *pop, uint64_t *off);
 
 struct redo_log *pmalloc_redo_hold(PMEMobjpool *pop);
 void pmalloc_redo_release(PMEMobjpool *pop);
+int pmalloc_redo_extend(PMEMobjpool *pop, struct operation_context *ctx,
+	size_t nentries);
+void pmalloc_cache_flush(PMEMobjpool *pop);
+void pmalloc_boot_rdonly(PMEMobjpool *pop);
 
 #endif
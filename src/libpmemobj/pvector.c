@@ -40,12 +40,16 @@
 #include "pvector.h"
 #include "valgrind_internal.h"
 
+#define PVECTOR_CACHELINE_SIZE 64
+
 struct pvector_context {
 	PMEMobjpool *pop;
 	struct pvector *vec;
 	size_t nvalues;
 
 	size_t iter; /* a simple embedded iterator value. */
+
+	size_t nretained; /* number of arrays which are never freed */
 };
 
 /*
@@ -66,53 +70,67 @@ pvector_new(PMEMobjpool *pop, struct pvector *vec)
 	ctx->pop = pop;
 	ctx->vec = vec;
 	ctx->iter = 0;
+	ctx->nretained = 0;
 
 	/*
-	 * First the arrays are traversed to find position of the last element.
-	 * To save some time calculating the sum of the sequence at each step
-	 * the number of values from the array is added to the global nvalues
-	 * counter.
+	 * The arrays are traversed to find position of the last element.
+	 * Because the arrays which are retained by pvector_pop_back() exist
+	 * even when they are empty, the existence of the next array doesn't
+	 * mean that the current one is full - instead, an array is full only
+	 * if its last value is set. Only the array with the last element needs
+	 * to be iterated over to count the number of values present.
+	 *
+	 * Arrays which follow the last element are always zeroed, and are
+	 * simply reused once the vector grows. This also covers an
+	 * application which was interrupted in either the push_back or
+	 * pop_back methods.
 	 */
-	size_t narrays;
-	for (narrays = 0; narrays < PVECTOR_MAX_ARRAYS; ++narrays) {
-		if (vec->arrays[narrays] == 0)
+	for (size_t i = 0; i < PVECTOR_MAX_ARRAYS; ++i) {
+		if (vec->arrays[i] == 0)
 			break;
 
-		if (narrays != PVECTOR_MAX_ARRAYS - 1 &&
-			vec->arrays[narrays + 1] != 0)
-			ctx->nvalues += 1ULL << (narrays + PVECTOR_INIT_SHIFT);
-	}
-
-	if (narrays != 0) {
-		/*
-		 * But if the last array is found and non-null it needs to be
-		 * iterated over to count the number of values present.
-		 */
-		size_t last_array = narrays - 1;
+		size_t arr_size = 1ULL << (i + PVECTOR_INIT_SHIFT);
+		uint64_t *arrp = OBJ_OFF_TO_PTR(pop, vec->arrays[i]);
+		if (arrp[arr_size - 1] != 0) {
+			ctx->nvalues += arr_size;
+			continue;
+		}
 
-		size_t arr_size = 1ULL << (last_array + PVECTOR_INIT_SHIFT);
-		uint64_t *arrp = OBJ_OFF_TO_PTR(pop, vec->arrays[last_array]);
 		size_t nvalues;
 		for (nvalues = 0; nvalues < arr_size; ++nvalues) {
 			if (arrp[nvalues] == 0)
 				break;
 		}
-
-		/*
-		 * If the last array is not the embedded one and is empty
-		 * it means that the application was interrupted in either
-		 * the push_back or pop_back methods. Either way there's really
-		 * no point in keeping the array.
-		 */
-		if (nvalues == 0 && last_array != 0 /* 0 array is embedded*/)
-			pfree(pop, &vec->arrays[last_array]);
-		else
-			ctx->nvalues += nvalues;
+		ctx->nvalues += nvalues;
+		break;
 	}
 
 	return ctx;
 }
 
+/*
+ * pvector_retain -- sets the number of values for which the vector keeps its
+ *	arrays allocated once they are emptied by pvector_pop_back(), so that
+ *	they can be reused without a new allocation
+ *
+ * Only the arrays which fit entirely within the given number of values are
+ * retained.
+ */
+void
+pvector_retain(struct pvector_context *ctx, uint64_t nvalues)
+{
+	size_t n;
+	for (n = 0; n < PVECTOR_MAX_ARRAYS; ++n) {
+		/* the capacity of all the arrays up to and including n */
+		uint64_t capacity = (1ULL << (n + PVECTOR_INIT_SHIFT + 1)) -
+			PVECTOR_INIT_SIZE;
+		if (capacity > nvalues)
+			break;
+	}
+
+	ctx->nretained = n;
+}
+
 /*
  * pvector_delete -- deletes the runtime state of the vector. Has no impact
  *	on the persistent representation of the vector.
@@ -177,12 +195,21 @@ pvector_get_array_spec(uint64_t idx)
  * pvector_array_constr -- (internal) constructor of a new vector array.
  *
  * The vectors MUST be zeroed because non-zero array elements are treated as
- * vector values.
+ * vector values. The arrays are marked as internal objects, because they
+ * might be retained, and so visible to the object iteration, long after
+ * the transaction which created them has finished.
  */
 static int
 pvector_array_constr(void *ctx, void *ptr, size_t usable_size, void *arg)
 {
 	PMEMobjpool *pop = ctx;
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(&oobh->size, sizeof(oobh->size));
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(&pop->p_ops, &oobh->size, sizeof(oobh->size));
+	VALGRIND_REMOVE_FROM_TX(&oobh->size, sizeof(oobh->size));
+
 	VALGRIND_ADD_TO_TX(ptr, usable_size);
 	pmemops_memset_persist(&pop->p_ops, ptr, 0, usable_size);
 	VALGRIND_REMOVE_FROM_TX(ptr, usable_size);
@@ -191,16 +218,12 @@ pvector_array_constr(void *ctx, void *ptr, size_t usable_size, void *arg)
 }
 
 /*
- * pvector_push_back -- bumps the number of values in the vector and returns
- *	the pointer to the value position to which the caller must set the
- *	value. Calling this method without actually setting the value will
- *	result in an inconsistent vector state.
+ * pvector_array_get -- (internal) returns the array of the position,
+ *	allocating it if it doesn't exist yet
  */
-uint64_t *
-pvector_push_back(struct pvector_context *ctx)
+static uint64_t *
+pvector_array_get(struct pvector_context *ctx, struct array_spec s)
 {
-	uint64_t idx = ctx->nvalues;
-	struct array_spec s = pvector_get_array_spec(idx);
 	if (s.idx >= PVECTOR_MAX_ARRAYS) {
 		ERR("Exceeded maximum number of entries in persistent vector");
 		return NULL;
@@ -237,15 +260,64 @@ pvector_push_back(struct pvector_context *ctx)
 		}
 	}
 
+	return OBJ_OFF_TO_PTR(pop, ctx->vec->arrays[s.idx]);
+}
+
+/*
+ * pvector_push_back -- bumps the number of values in the vector and returns
+ *	the pointer to the value position to which the caller must set the
+ *	value. Calling this method without actually setting the value will
+ *	result in an inconsistent vector state.
+ */
+uint64_t *
+pvector_push_back(struct pvector_context *ctx)
+{
+	struct array_spec s = pvector_get_array_spec(ctx->nvalues);
+	uint64_t *arrp = pvector_array_get(ctx, s);
+	if (arrp == NULL)
+		return NULL;
+
 	ctx->nvalues++;
-	uint64_t *arrp = OBJ_OFF_TO_PTR(pop, ctx->vec->arrays[s.idx]);
 
 	return &arrp[s.pos];
 }
 
+/*
+ * pvector_push_back_n -- bumps the number of values in the vector by n and
+ *	stores the pointers to their positions in the entries array, the values
+ *	have to be set by the caller just like with pvector_push_back()
+ *
+ * All the arrays needed by the values are allocated up front and the array
+ * of a position is looked up only once per array. On failure, the number of
+ * values is left unchanged.
+ */
+int
+pvector_push_back_n(struct pvector_context *ctx, uint64_t **entries, size_t n)
+{
+	size_t nvalues = ctx->nvalues;
+
+	for (size_t i = 0; i < n; ) {
+		struct array_spec s = pvector_get_array_spec(nvalues);
+		uint64_t *arrp = pvector_array_get(ctx, s);
+		if (arrp == NULL)
+			return -1;
+
+		size_t arr_size = 1ULL << (s.idx + PVECTOR_INIT_SHIFT);
+		for (; i < n && s.pos < arr_size; ++i, ++nvalues)
+			entries[i] = &arrp[s.pos++];
+	}
+
+	ctx->nvalues = nvalues;
+
+	return 0;
+}
+
 /*
  * pvector_pop_back -- decreases the number of values and executes
  *	a user-defined callback in which the caller must zero the value.
+ *
+ * The callback must zero the value also if the array in which it resides
+ * is retained, otherwise the vector will be inconsistent once reopened.
  */
 uint64_t
 pvector_pop_back(struct pvector_context *ctx, entry_op_callback cb)
@@ -262,7 +334,8 @@ pvector_pop_back(struct pvector_context *ctx, entry_op_callback cb)
 	if (cb)
 		cb(ctx->pop, &arrp[s.pos]);
 
-	if (s.pos == 0 && s.idx != 0 /* the array 0 is embedded */)
+	if (s.pos == 0 && s.idx != 0 /* the array 0 is embedded */ &&
+		s.idx >= ctx->nretained)
 		pfree(ctx->pop, &ctx->vec->arrays[s.idx]);
 
 	ctx->nvalues--;
@@ -270,6 +343,52 @@ pvector_pop_back(struct pvector_context *ctx, entry_op_callback cb)
 	return ret;
 }
 
+/*
+ * pvector_truncate -- removes the values past the first nvalues ones
+ *
+ * The values are zeroed from the back, one cacheline at a time, and each
+ * cacheline is persisted before the preceding one is touched - so that the
+ * vector is consistent even if this is interrupted. The arrays which become
+ * empty are freed, unless they are retained.
+ */
+void
+pvector_truncate(struct pvector_context *ctx, uint64_t nvalues)
+{
+	PMEMobjpool *pop = ctx->pop;
+
+	while (ctx->nvalues > nvalues) {
+		struct array_spec s = pvector_get_array_spec(ctx->nvalues - 1);
+		uint64_t *arrp = OBJ_OFF_TO_PTR(pop, ctx->vec->arrays[s.idx]);
+
+		/* the values to remove from this array */
+		uint64_t n = ctx->nvalues - nvalues;
+		uint64_t *first = n > s.pos ? &arrp[0] : &arrp[s.pos + 1 - n];
+		uint64_t *end = &arrp[s.pos + 1];
+
+		while (end != first) {
+			uint64_t *begin = (uint64_t *)((uintptr_t)(end - 1) &
+				~(uintptr_t)(PVECTOR_CACHELINE_SIZE - 1));
+			if (begin < first)
+				begin = first;
+
+			size_t len = (size_t)(end - begin) * sizeof(*begin);
+			VALGRIND_ADD_TO_TX(begin, len);
+			for (uint64_t *v = end; v != begin; )
+				*--v = 0;
+			pmemops_persist(&pop->p_ops, begin, len);
+			VALGRIND_REMOVE_FROM_TX(begin, len);
+
+			end = begin;
+		}
+
+		ctx->nvalues -= (size_t)(&arrp[s.pos + 1] - first);
+
+		if (first == &arrp[0] && s.idx != 0 /* embedded */ &&
+			s.idx >= ctx->nretained)
+			pfree(pop, &ctx->vec->arrays[s.idx]);
+	}
+}
+
 /*
  * pvector_nvalues -- returns the number of values present in the vector
  */
@@ -78,11 +78,15 @@ typedef void (*entry_op_callback)(PMEMobjpool *pop, uint64_t *entry);
 
 struct pvector_context *pvector_new(PMEMobjpool *pop, struct pvector *vec);
 void pvector_delete(struct pvector_context *ctx);
+void pvector_retain(struct pvector_context *ctx, uint64_t nvalues);
 
 uint64_t *pvector_push_back(struct pvector_context *ctx);
+int pvector_push_back_n(struct pvector_context *ctx, uint64_t **entries,
+	size_t n);
 
 uint64_t pvector_pop_back(struct pvector_context *ctx,
 	entry_op_callback cb);
+void pvector_truncate(struct pvector_context *ctx, uint64_t nvalues);
 
 uint64_t pvector_nvalues(struct pvector_context *ctx);
 uint64_t pvector_first(struct pvector_context *ctx);
@@ -43,7 +43,17 @@
  * Finish flag at the least significant bit
  */
 #define REDO_FINISH_FLAG	((uint64_t)1<<0)
-#define REDO_FLAG_MASK		(~REDO_FINISH_FLAG)
+/*
+ * The entry links to the overflow segment at the offset
+ */
+#define REDO_NEXT_FLAG		((uint64_t)1<<1)
+#define REDO_FLAG_MASK		(~(REDO_FINISH_FLAG | REDO_NEXT_FLAG))
+
+/*
+ * Granularity of the cache flushes
+ */
+#define REDO_FLUSH_ALIGN	((uintptr_t)64)
+#define REDO_FLUSH_MASK		(~(REDO_FLUSH_ALIGN - 1))
 
 struct redo_ctx {
 	void *base;
@@ -151,6 +161,116 @@ redo_log_store_last(const struct redo_ctx *ctx, struct redo_log *redo,
 	pmemops_persist(p_ops, &redo[index].offset, sizeof(redo[index].offset));
 }
 
+/*
+ * redo_log_store_next -- (internal) store a link to the overflow segment at
+ *	specified index, the following entries are read from that segment
+ */
+void
+redo_log_store_next(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, uint64_t next_offset)
+{
+	LOG(15, "redo %p index %zu next %ju", redo, index, next_offset);
+
+	ASSERTeq(next_offset & ~REDO_FLAG_MASK, 0);
+	ASSERT(index < ctx->redo_num_entries);
+
+	redo[index].offset = next_offset | REDO_NEXT_FLAG;
+	redo[index].value = 0;
+}
+
+/*
+ * redo_log_next -- (internal) returns the first entry of the overflow segment
+ *	linked from the entry
+ */
+static struct redo_log *
+redo_log_next(const struct redo_ctx *ctx, const struct redo_log *redo)
+{
+	ASSERTne(redo->offset & REDO_NEXT_FLAG, 0);
+
+	struct redo_log_overflow *next = (struct redo_log_overflow *)
+		((uintptr_t)ctx->base + (redo->offset & REDO_FLAG_MASK));
+
+	return next->redo;
+}
+
+/*
+ * redo_log_last -- (internal) looks for the entry with the finish flag set,
+ *	following the links to the overflow segments
+ *
+ * Only the entries written by the last operation are guaranteed to be valid,
+ * so every link is checked before it's followed. Returns -1 if a link is
+ * invalid, otherwise the entry, or NULL if there is none, is stored in *last.
+ */
+static int
+redo_log_last(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t nentries, struct redo_log **last)
+{
+	void *cctx = ctx->check_offset_ctx;
+
+	/* the segments are never shared, so there can't be more of them */
+	size_t nsegments = ctx->p_ops.pool_size /
+		sizeof(struct redo_log_overflow);
+
+	*last = NULL;
+
+	size_t i = 0;
+	while (i < nentries) {
+		if (redo[i].offset & REDO_FINISH_FLAG) {
+			*last = &redo[i];
+			return 0;
+		}
+
+		if ((redo[i].offset & REDO_NEXT_FLAG) == 0) {
+			i++;
+			continue;
+		}
+
+		uint64_t next = redo[i].offset & REDO_FLAG_MASK;
+		if (nsegments-- == 0 || !ctx->check_offset(cctx, next) ||
+			!ctx->check_offset(cctx, next +
+				sizeof(struct redo_log_overflow) - 1)) {
+			LOG(15, "redo %p invalid link %ju", &redo[i], next);
+			return -1;
+		}
+
+		redo = redo_log_next(ctx, &redo[i]);
+		nentries = REDO_OVERFLOW_NUM_ENTRIES;
+		i = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * redo_log_store_staged -- (internal) writes the entries staged in DRAM to the
+ *	redo log, starting at specified index, and sets the finish flag of the
+ *	last one
+ *
+ * The entries are written with a single persistent copy, which stores each
+ * cache line of the redo log once, instead of flushing the entries stored
+ * one by one.
+ */
+void
+redo_log_store_staged(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, const struct redo_log *staged, size_t nentries)
+{
+	LOG(15, "redo %p index %zu nentries %zu", redo, index, nentries);
+
+	ASSERTne(nentries, 0);
+	ASSERT(index + nentries <= ctx->redo_num_entries);
+	ASSERTeq(staged[nentries - 1].offset & ~REDO_FLAG_MASK, 0);
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+
+	/* persist all redo log entries */
+	pmemops_memcpy_persist(p_ops, &redo[index], staged,
+		nentries * sizeof(struct redo_log));
+
+	/* set finish flag of last entry and persist */
+	size_t last = index + nentries - 1;
+	redo[last].offset |= REDO_FINISH_FLAG;
+	pmemops_persist(p_ops, &redo[last].offset, sizeof(redo[last].offset));
+}
+
 /*
  * redo_log_set_last -- (internal) set finish flag in specified entry
  */
@@ -185,14 +305,40 @@ redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
 #endif
 	const struct pmem_ops *p_ops = &ctx->p_ops;
 
+	/*
+	 * Consecutive stores to the same cache line are flushed together,
+	 * once the next store goes elsewhere.
+	 */
+	uintptr_t flush_start = 0;
+	uintptr_t flush_end = 0;
+
 	uint64_t *val;
 	while ((redo->offset & REDO_FINISH_FLAG) == 0) {
+		if (redo->offset & REDO_NEXT_FLAG) {
+			redo = redo_log_next(ctx, redo);
+			continue;
+		}
+
 		val = (uint64_t *)((uintptr_t)ctx->base + redo->offset);
 		VALGRIND_ADD_TO_TX(val, sizeof(*val));
 		*val = redo->value;
 		VALGRIND_REMOVE_FROM_TX(val, sizeof(*val));
 
-		pmemops_flush(p_ops, val, sizeof(uint64_t));
+		uintptr_t addr = (uintptr_t)val;
+		uintptr_t line = addr & REDO_FLUSH_MASK;
+		if (flush_end != 0 && line == (flush_start & REDO_FLUSH_MASK)) {
+			if (addr < flush_start)
+				flush_start = addr;
+			if (addr + sizeof(*val) > flush_end)
+				flush_end = addr + sizeof(*val);
+		} else {
+			if (flush_end != 0)
+				pmemops_flush(p_ops, (void *)flush_start,
+					flush_end - flush_start);
+
+			flush_start = addr;
+			flush_end = addr + sizeof(*val);
+		}
 
 		redo++;
 	}
@@ -203,6 +349,10 @@ redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
 	*val = redo->value;
 	VALGRIND_REMOVE_FROM_TX(val, sizeof(*val));
 
+	if (flush_end != 0)
+		pmemops_flush(p_ops, (void *)flush_start,
+			flush_end - flush_start);
+
 	pmemops_persist(p_ops, val, sizeof(uint64_t));
 
 	redo->offset = 0;
@@ -222,10 +372,10 @@ redo_log_recover(const struct redo_ctx *ctx, struct redo_log *redo,
 	LOG(15, "redo %p nentries %zu", redo, nentries);
 	ASSERTne(ctx, NULL);
 
-	size_t nflags = redo_log_nflags(redo, nentries);
-	ASSERT(nflags < 2);
+	ASSERT(redo_log_nflags(redo, nentries) < 2);
 
-	if (nflags == 1)
+	struct redo_log *last;
+	if (redo_log_last(ctx, redo, nentries, &last) == 0 && last != NULL)
 		redo_log_process(ctx, redo, nentries);
 }
 
@@ -246,10 +396,19 @@ redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 		return -1;
 	}
 
-	if (nflags == 1) {
+	struct redo_log *last;
+	if (redo_log_last(ctx, redo, nentries, &last) != 0)
+		return -1;
+
+	if (last != NULL) {
 		void *cctx = ctx->check_offset_ctx;
 
-		while ((redo->offset & REDO_FINISH_FLAG) == 0) {
+		while (redo != last) {
+			if (redo->offset & REDO_NEXT_FLAG) {
+				redo = redo_log_next(ctx, redo);
+				continue;
+			}
+
 			if (!ctx->check_offset(cctx, redo->offset)) {
 				LOG(15, "redo %p invalid offset %ju",
 						redo, redo->offset);
@@ -52,6 +52,19 @@ struct redo_log {
 	uint64_t value;
 };
 
+/*
+ * redo_log_overflow -- additional segment of a redo log
+ *
+ * A redo log which does not fit in its fixed-size array continues in a chain
+ * of overflow segments, each linked from the last entry of the previous one.
+ */
+#define REDO_OVERFLOW_NUM_ENTRIES 63
+struct redo_log_overflow {
+	uint64_t next;		/* offset of the next segment, 0 if none */
+	uint64_t unused;
+	struct redo_log redo[REDO_OVERFLOW_NUM_ENTRIES];
+};
+
 typedef int  (*redo_check_offset_fn)(void *ctx, uint64_t offset);
 
 struct redo_ctx *redo_log_config_new(void *base,
@@ -66,6 +79,10 @@ void redo_log_store(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t index, uint64_t offset, uint64_t value);
 void redo_log_store_last(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t index, uint64_t offset, uint64_t value);
+void redo_log_store_next(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, uint64_t next_offset);
+void redo_log_store_staged(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t index, const struct redo_log *staged, size_t nentries);
 void redo_log_set_last(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t index);
 void redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
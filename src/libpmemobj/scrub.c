@@ -0,0 +1,230 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * scrub.c -- online scrubbing of the heap
+ *
+ * The scrubber is a thread which walks the heap of an open pool one chunk at
+ * a time, over and over again, and verifies the chunk headers, the bitmaps of
+ * the runs and the headers of the objects, see heap_scrub. Each chunk is
+ * verified under the same locks the allocator takes to modify it, so the
+ * pool remains fully usable while it's being scrubbed.
+ *
+ * The rate of scrubbing is limited to the given number of chunks per second,
+ * once the chunks of the current second are verified the thread sleeps until
+ * the next one begins.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libpmemobj.h"
+#include "obj.h"
+#include "out.h"
+#include "scrub.h"
+#include "sys_util.h"
+#include "util.h"
+
+struct obj_scrub {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; /* signaled when the scrubber is to stop */
+	int stop;
+
+	PMEMobjpool *pop;
+	unsigned rate; /* chunks verified per second, 0 if not limited */
+	void (*report)(PMEMobjpool *pop, uint64_t off, const char *msg,
+		void *arg);
+	void *arg;
+};
+
+/*
+ * scrub_report -- (internal) passes the inconsistency found to the user
+ */
+static void
+scrub_report(uint64_t off, const char *msg, void *arg)
+{
+	struct obj_scrub *s = arg;
+
+	LOG(2, "heap inconsistent at 0x%016" PRIx64 ": %s", off, msg);
+
+	s->report(s->pop, off, msg, s->arg);
+}
+
+/*
+ * scrub_worker -- (internal) scrubs the heap until stopped
+ */
+static void *
+scrub_worker(void *arg)
+{
+	struct obj_scrub *s = arg;
+	PMEMobjpool *pop = s->pop;
+
+	uint64_t cursor = 0;
+	unsigned nchunks = 0; /* verified in the current second */
+	time_t second = time(NULL);
+
+	util_mutex_lock(&s->lock);
+	while (!s->stop) {
+		util_mutex_unlock(&s->lock);
+
+		if (palloc_heap_scrub(&pop->heap, &cursor, scrub_report,
+				s) == 0) {
+			LOG(4, "heap scrubbed");
+			/* the end of the pass is reported without a message */
+			s->report(pop, 0, NULL, s->arg);
+		}
+
+		util_mutex_lock(&s->lock);
+
+		if (s->rate == 0 || ++nchunks < s->rate)
+			continue;
+
+		struct timespec next = {second + 1, 0};
+		while (!s->stop && time(NULL) <= second) {
+			if (pthread_cond_timedwait(&s->cond, &s->lock,
+					&next) == ETIMEDOUT)
+				break;
+		}
+
+		nchunks = 0;
+		second = time(NULL);
+	}
+	util_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+/*
+ * pmemobj_scrub_start -- starts scrubbing the heap of the pool in the
+ *	background
+ */
+int
+pmemobj_scrub_start(PMEMobjpool *pop, unsigned rate,
+	void (*report)(PMEMobjpool *pop, uint64_t off, const char *msg,
+	void *arg), void *arg)
+{
+	LOG(3, "pop %p rate %u report %p arg %p", pop, rate, report, arg);
+
+	if (report == NULL) {
+		ERR("no report function");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pop->rdonly) {
+		ERR("scrubbing of a read-only pool is not supported");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	if (pop->scrub != NULL) {
+		ERR("the pool is being scrubbed already");
+		errno = EBUSY;
+		return -1;
+	}
+
+	struct obj_scrub *s = Malloc(sizeof(*s));
+	if (s == NULL) {
+		ERR("!Malloc");
+		return -1;
+	}
+
+	s->stop = 0;
+	s->pop = pop;
+	s->rate = rate;
+	s->report = report;
+	s->arg = arg;
+
+	util_mutex_init(&s->lock, NULL);
+	int ret = pthread_cond_init(&s->cond, NULL);
+	if (ret != 0) {
+		errno = ret;
+		ERR("!pthread_cond_init");
+		goto error_cond_init;
+	}
+
+	ret = pthread_create(&s->thread, NULL, scrub_worker, s);
+	if (ret != 0) {
+		errno = ret;
+		ERR("!pthread_create");
+		goto error_thread_create;
+	}
+
+	pop->scrub = s;
+
+	return 0;
+
+error_thread_create:
+	pthread_cond_destroy(&s->cond);
+error_cond_init:
+	util_mutex_destroy(&s->lock);
+	Free(s);
+	return -1;
+}
+
+/*
+ * scrub_stop -- stops the scrubber of the pool, if there's any
+ */
+void
+scrub_stop(PMEMobjpool *pop)
+{
+	struct obj_scrub *s = pop->scrub;
+	if (s == NULL)
+		return;
+
+	util_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_signal(&s->cond);
+	util_mutex_unlock(&s->lock);
+
+	pthread_join(s->thread, NULL);
+
+	pthread_cond_destroy(&s->cond);
+	util_mutex_destroy(&s->lock);
+	Free(s);
+
+	pop->scrub = NULL;
+}
+
+/*
+ * pmemobj_scrub_stop -- stops scrubbing the heap of the pool
+ */
+void
+pmemobj_scrub_stop(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	scrub_stop(pop);
+}
@@ -34,6 +34,12 @@
  * sync.c -- persistent memory resident synchronization primitives
  */
 
+#include <limits.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "obj.h"
 #include "out.h"
 #include "util.h"
@@ -41,34 +47,599 @@
 #include "sys_util.h"
 #include "valgrind_internal.h"
 
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32)
+#define SYNC_ELISION 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#define SYNC_FUTEX 1
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Locks can be elided using restricted transactional memory, in which case
+ * the critical section is executed speculatively, without writing anything
+ * to the lock. Threads which really acquire a lock (an exclusive one, in case
+ * of the rwlock) mark it as held in the highest bit of its runid, which the
+ * elided critical sections read, and so they are aborted if it's acquired.
+ */
+#define SYNC_LOCK_HELD (1ULL << 63)
+
+/* the rwlock is biased towards the readers, see sync_bias_rdlock */
+#define SYNC_LOCK_BIASED (1ULL << 62)
+
+/* the flags kept in the runid along with the run id itself */
+#define SYNC_LOCK_FLAGS (SYNC_LOCK_HELD | SYNC_LOCK_BIASED)
+
+/* number of attempts to elide a lock before really acquiring it */
+#define SYNC_ELISION_RETRIES 3
+
+/* explicit abort codes */
+#define SYNC_ABORT_HELD 0xfe /* the lock is held by another thread */
+#define SYNC_ABORT_UNSUPPORTED 0xff /* the operation can't be elided */
+
+#ifdef SYNC_ELISION
+static int Sync_elision;
+
+/* number of locks really held by the thread, if the elision is enabled */
+static __thread unsigned Sync_held;
+
+/*
+ * sync_elision_supported -- (internal) checks whether the CPU supports
+ *	restricted transactional memory
+ */
+static int
+sync_elision_supported(void)
+{
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return (ebx & bit_RTM) != 0;
+}
+
+/*
+ * sync_elide -- (internal) tries to start a speculative critical section of
+ *	the lock, returns 1 if successful
+ */
+__attribute__((target("rtm")))
+static int
+sync_elide(volatile uint64_t *runid)
+{
+	if (!Sync_elision || Sync_held != 0)
+		return 0;
+
+	for (int i = 0; i < SYNC_ELISION_RETRIES; ++i) {
+		unsigned status = _xbegin();
+		if (status == _XBEGIN_STARTED) {
+			if ((*runid & SYNC_LOCK_HELD) == 0)
+				return 1;
+
+			_xabort(SYNC_ABORT_HELD);
+		}
+
+		/* don't wait for a held lock, or retry what never succeeds */
+		if ((status & _XABORT_EXPLICIT) || !(status & _XABORT_RETRY))
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * sync_elided -- (internal) returns 1 if the thread is inside of a
+ *	speculative critical section
+ */
+__attribute__((target("rtm")))
+static inline int
+sync_elided(void)
+{
+	return Sync_elision && _xtest();
+}
+
+/*
+ * sync_elided_unlock -- (internal) ends a speculative critical section
+ */
+__attribute__((target("rtm")))
+static inline void
+sync_elided_unlock(void)
+{
+	_xend();
+}
+
+/*
+ * sync_elided_abort -- (internal) aborts speculative execution, so that the
+ *	outermost lock is really acquired, if the thread is inside of
+ *	a speculative critical section
+ */
+__attribute__((target("rtm")))
+static inline void
+sync_elided_abort(void)
+{
+	if (sync_elided())
+		_xabort(SYNC_ABORT_UNSUPPORTED);
+}
+
+/*
+ * sync_acquired -- (internal) takes note of a lock which has been really
+ *	acquired
+ */
+static inline void
+sync_acquired(volatile uint64_t *runid, int exclusive)
+{
+	if (!Sync_elision)
+		return;
+
+	Sync_held++;
+	if (exclusive)
+		__sync_fetch_and_or(runid, SYNC_LOCK_HELD);
+}
+
+/*
+ * sync_released -- (internal) takes note of a lock which is about to be
+ *	really released
+ */
+static inline void
+sync_released(volatile uint64_t *runid)
+{
+	if (!Sync_elision)
+		return;
+
+	ASSERTne(Sync_held, 0);
+	Sync_held--;
+
+	/* only the exclusive owner can see the lock as held */
+	if (*runid & SYNC_LOCK_HELD)
+		__sync_fetch_and_and(runid, ~SYNC_LOCK_HELD);
+}
+#else
+#define sync_elide(runid) 0
+#define sync_elided() 0
+#define sync_elided_unlock() do {} while (0)
+#define sync_elided_abort() do {} while (0)
+#define sync_acquired(runid, exclusive) do {} while (0)
+#define sync_released(runid) do {} while (0)
+#endif
+
+/*
+ * sync_elision_init -- enables the lock elision, if requested by the given
+ *	environment variable and supported by the CPU
+ */
+void
+sync_elision_init(const char *elision_var)
+{
+	char *e = getenv(elision_var);
+	if (e == NULL || atoi(e) == 0)
+		return;
+
+#ifdef SYNC_ELISION
+	if (sync_elision_supported()) {
+		Sync_elision = 1;
+		LOG(3, "lock elision enabled");
+		return;
+	}
+#endif
+	LOG(3, "lock elision not supported");
+}
+
+#ifdef SYNC_FUTEX
+/*
+ * Instead of the pthread ones, mutexes can be implemented directly on top of
+ * a futex word, which fits in the padding of the persistent lock just as well,
+ * so that locking and unlocking an uncontended mutex takes a single atomic
+ * operation each. The condition variables are then implemented the same way,
+ * as the pthread ones can't be used with such mutexes.
+ *
+ * The lock word is 0 if the mutex is unlocked, 1 if it's locked and 2 if it's
+ * locked and there may be threads sleeping on it.
+ */
+static int Sync_futex;
+
+/* number of times the lock is checked before going to sleep */
+#define SYNC_FUTEX_SPINS 100
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define sync_cpu_relax() __builtin_ia32_pause()
+#else
+#define sync_cpu_relax() do {} while (0)
+#endif
+
+/*
+ * sync_futex_wait -- (internal) sleeps until the futex is woken up, if it
+ *	still holds the given value, or until the given absolute time, if any
+ *
+ * The pools are opened by a single process at a time, so the futexes can be
+ * private to the process.
+ */
+static int
+sync_futex_wait(volatile uint32_t *futex, uint32_t val,
+	const struct timespec *abs_timeout)
+{
+	if (syscall(SYS_futex, futex, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG |
+			FUTEX_CLOCK_REALTIME, val, abs_timeout, NULL,
+			FUTEX_BITSET_MATCH_ANY) != 0)
+		return errno;
+
+	return 0;
+}
+
+/*
+ * sync_futex_wake -- (internal) wakes up to the given number of threads
+ *	sleeping on the futex
+ */
+static void
+sync_futex_wake(volatile uint32_t *futex, int nthreads)
+{
+	syscall(SYS_futex, futex, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nthreads,
+		NULL, NULL, 0);
+}
+
+/*
+ * sync_futex_zero -- (internal) initializes the lock word of a futex based
+ *	mutex or condition variable
+ */
+static int
+sync_futex_zero(void *lock, void *arg)
+{
+	*(uint32_t *)lock = 0;
+
+	return 0;
+}
+
+/*
+ * sync_futex_lock_contended -- (internal) locks the mutex marking it as
+ *	contended, sleeping until it's unlocked or until the given absolute
+ *	time, if any
+ */
+static int
+sync_futex_lock_contended(volatile uint32_t *futex,
+	const struct timespec *abs_timeout)
+{
+	while (__sync_lock_test_and_set(futex, 2) != 0) {
+		int ret = sync_futex_wait(futex, 2, abs_timeout);
+		if (ret == ETIMEDOUT || ret == EINVAL)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * sync_futex_lock -- (internal) locks the mutex, spinning for a while before
+ *	going to sleep
+ */
+static inline int
+sync_futex_lock(volatile uint32_t *futex, const struct timespec *abs_timeout)
+{
+	uint32_t c = __sync_val_compare_and_swap(futex, 0, 1);
+	if (likely(c == 0))
+		return 0;
+
+	/* spin only for as long as no other thread had to go to sleep */
+	for (int i = 0; c == 1 && i < SYNC_FUTEX_SPINS; ++i) {
+		sync_cpu_relax();
+		if ((c = *futex) == 0 &&
+				(c = __sync_val_compare_and_swap(futex, 0, 1))
+				== 0)
+			return 0;
+	}
+
+	return sync_futex_lock_contended(futex, abs_timeout);
+}
+
+/*
+ * sync_futex_trylock -- (internal) locks the mutex, if it's unlocked
+ */
+static inline int
+sync_futex_trylock(volatile uint32_t *futex)
+{
+	return __sync_bool_compare_and_swap(futex, 0, 1) ? 0 : EBUSY;
+}
+
+/*
+ * sync_futex_unlock -- (internal) unlocks the mutex, waking up one of the
+ *	threads sleeping on it, if any
+ */
+static inline int
+sync_futex_unlock(volatile uint32_t *futex)
+{
+	if (likely(__sync_fetch_and_sub(futex, 1) == 1))
+		return 0;
+
+	__sync_lock_release(futex);
+	sync_futex_wake(futex, 1);
+
+	return 0;
+}
+
+/*
+ * sync_futex_cond_wait -- (internal) waits until the condition variable is
+ *	signaled or until the given absolute time, if any
+ *
+ * A signal which comes after the sequence is read, while the mutex is still
+ * held, changes the sequence, so the thread doesn't go to sleep at all.
+ */
+static int
+sync_futex_cond_wait(volatile uint32_t *seq, volatile uint32_t *futex,
+	const struct timespec *abs_timeout)
+{
+	uint32_t val = *seq;
+
+	sync_futex_unlock(futex);
+	int ret = sync_futex_wait(seq, val, abs_timeout);
+
+	/* other threads might have been woken up along with this one */
+	sync_futex_lock_contended(futex, NULL);
+
+	return ret == ETIMEDOUT || ret == EINVAL ? ret : 0;
+}
+
+/*
+ * sync_futex_cond_signal -- (internal) wakes up to the given number of
+ *	threads waiting on the condition variable
+ */
+static inline int
+sync_futex_cond_signal(volatile uint32_t *seq, int nthreads)
+{
+	__sync_fetch_and_add(seq, 1);
+	sync_futex_wake(seq, nthreads);
+
+	return 0;
+}
+#else
+#define Sync_futex 0
+#define sync_futex_zero NULL
+#define sync_futex_lock(futex, abs_timeout) ENOTSUP
+#define sync_futex_trylock(futex) ENOTSUP
+#define sync_futex_unlock(futex) ENOTSUP
+#define sync_futex_cond_wait(seq, futex, abs_timeout) ENOTSUP
+#define sync_futex_cond_signal(seq, nthreads) ENOTSUP
+#endif
+
+/*
+ * sync_futex_init -- switches the mutexes and condition variables of the
+ *	pools to the futex based ones, if requested by the given environment
+ *	variable and supported by the system
+ */
+void
+sync_futex_init(const char *futex_var)
+{
+	char *e = getenv(futex_var);
+	if (e == NULL || atoi(e) == 0)
+		return;
+
+#ifdef SYNC_FUTEX
+	COMPILE_ERROR_ON(offsetof(PMEMmutex_internal, pmemfutex.futex) !=
+		offsetof(PMEMmutex_internal, pmemmutex.mutex));
+	COMPILE_ERROR_ON(offsetof(PMEMcond_internal, pmemfutexcond.seq) !=
+		offsetof(PMEMcond_internal, pmemcond.cond));
+
+	Sync_futex = 1;
+	LOG(3, "futex based mutexes enabled");
+#else
+	LOG(3, "futex based mutexes not supported");
+#endif
+}
+
+#ifndef _WIN32
+/*
+ * The readers of a biased rwlock don't touch the lock at all. Instead, each
+ * of them publishes the lock in a slot of a global table of visible readers,
+ * chosen by hashing the lock and the thread, so that the readers of the same
+ * lock write to different cache lines. A writer acquires the underlying
+ * rwlock, which stops the bias from being set again, revokes the bias and
+ * waits for the visible readers of the lock to go away. Since the revocation
+ * is expensive, the bias is not set again for a while after it.
+ *
+ * If the slot is taken, the reader falls back to the underlying rwlock.
+ */
+static int Sync_bias;
+
+#define SYNC_BIAS_READERS 4096 /* must be a power of two */
+
+/* how many times longer than a revocation the bias stays off after it */
+#define SYNC_BIAS_INHIBIT_MULT 9
+
+#define SYNC_BIAS_INHIBIT_SLOTS 256 /* must be a power of two */
+
+static void *volatile Sync_bias_readers[SYNC_BIAS_READERS];
+
+/* time until which the bias of the locks hashed to each slot stays off */
+static uint64_t Sync_bias_inhibit[SYNC_BIAS_INHIBIT_SLOTS];
+
+/* the slots of the visible readers table taken by the thread */
+static __thread uint64_t Sync_bias_taken[SYNC_BIAS_READERS / 64];
+
+/*
+ * sync_bias_hash -- (internal) hashes the lock address
+ */
+static inline uint64_t
+sync_bias_hash(const void *lock)
+{
+	return ((uint64_t)(uintptr_t)lock >> 6) * 0x9E3779B97F4A7C15ULL;
+}
+
+/*
+ * sync_bias_slot -- (internal) returns the slot of the visible readers table
+ *	of the lock and the calling thread
+ */
+static inline unsigned
+sync_bias_slot(const void *lock)
+{
+	/* every thread has its own copy of the table of taken slots */
+	uint64_t h = sync_bias_hash(lock) ^
+		sync_bias_hash(Sync_bias_taken) >> 16;
+
+	return (unsigned)(h >> 32) & (SYNC_BIAS_READERS - 1);
+}
+
+/*
+ * sync_bias_inhibit -- (internal) returns the inhibition time slot of the lock
+ */
+static inline uint64_t *
+sync_bias_inhibit(const void *lock)
+{
+	return &Sync_bias_inhibit[sync_bias_hash(lock) >> 56 &
+		(SYNC_BIAS_INHIBIT_SLOTS - 1)];
+}
+
+/*
+ * sync_bias_rdlock -- (internal) tries to read lock a biased rwlock without
+ *	touching the underlying one, returns 1 if successful
+ */
+static inline int
+sync_bias_rdlock(volatile uint64_t *runid, void *lock)
+{
+	if (!Sync_bias || (*runid & SYNC_LOCK_BIASED) == 0)
+		return 0;
+
+	unsigned slot = sync_bias_slot(lock);
+	if (Sync_bias_readers[slot] != NULL ||
+			!__sync_bool_compare_and_swap(&Sync_bias_readers[slot],
+			NULL, lock))
+		return 0;
+
+	/* the writer which revoked the bias might not have seen the slot */
+	if ((*runid & SYNC_LOCK_BIASED) == 0) {
+		Sync_bias_readers[slot] = NULL;
+		return 0;
+	}
+
+	Sync_bias_taken[slot / 64] |= 1ULL << (slot % 64);
+
+	return 1;
+}
+
+/*
+ * sync_bias_rdunlock -- (internal) unlocks a biased rwlock read locked by
+ *	the thread without touching the underlying one, returns 1 if successful
+ */
+static inline int
+sync_bias_rdunlock(void *lock)
+{
+	if (!Sync_bias)
+		return 0;
+
+	unsigned slot = sync_bias_slot(lock);
+	uint64_t bit = 1ULL << (slot % 64);
+	if ((Sync_bias_taken[slot / 64] & bit) == 0)
+		return 0;
+
+	ASSERTeq(Sync_bias_readers[slot], lock);
+	Sync_bias_taken[slot / 64] &= ~bit;
+	__sync_synchronize();
+	Sync_bias_readers[slot] = NULL;
+
+	return 1;
+}
+
+/*
+ * sync_bias_set -- (internal) sets the bias of the rwlock read locked through
+ *	the underlying one, unless it has been revoked recently
+ */
+static inline void
+sync_bias_set(volatile uint64_t *runid, void *lock)
+{
+	if (!Sync_bias || (*runid & SYNC_LOCK_BIASED) != 0)
+		return;
+
+	if (util_time_ns() >= *sync_bias_inhibit(lock))
+		__sync_fetch_and_or(runid, SYNC_LOCK_BIASED);
+}
+
+/*
+ * sync_bias_revoke -- (internal) revokes the bias of the rwlock write locked
+ *	through the underlying one and waits for its visible readers to go away
+ *
+ * If wait is not set and there are any visible readers, returns EBUSY
+ * instead, with the bias revoked all the same.
+ */
+static int
+sync_bias_revoke(volatile uint64_t *runid, void *lock, int wait)
+{
+	if (!Sync_bias || (*runid & SYNC_LOCK_BIASED) == 0)
+		return 0;
+
+	uint64_t start = util_time_ns();
+	__sync_fetch_and_and(runid, ~SYNC_LOCK_BIASED);
+
+	int ret = 0;
+	for (unsigned i = 0; i < SYNC_BIAS_READERS; ++i) {
+		while (Sync_bias_readers[i] == lock) {
+			if (!wait) {
+				ret = EBUSY;
+				break;
+			}
+			sched_yield();
+		}
+	}
+
+	uint64_t now = util_time_ns();
+	*sync_bias_inhibit(lock) = now + (now - start) * SYNC_BIAS_INHIBIT_MULT;
+
+	return ret;
+}
+#else
+#define Sync_bias 0
+#define sync_bias_rdlock(runid, lock) 0
+#define sync_bias_rdunlock(lock) 0
+#define sync_bias_set(runid, lock) do {} while (0)
+#define sync_bias_revoke(runid, lock, wait) 0
+#endif
+
+/*
+ * sync_bias_init -- enables the reader bias of the rwlocks, if requested by
+ *	the given environment variable
+ */
+void
+sync_bias_init(const char *bias_var)
+{
+	char *e = getenv(bias_var);
+	if (e == NULL || atoi(e) == 0)
+		return;
+
+#ifndef _WIN32
+	Sync_bias = 1;
+	LOG(3, "rwlock reader bias enabled");
+#else
+	LOG(3, "rwlock reader bias not supported");
+#endif
+}
+
 #define GET_MUTEX(pop, mutexp)\
 get_lock((pop)->run_id,\
 	&(mutexp)->pmemmutex.runid,\
 	&(mutexp)->pmemmutex.mutex,\
-	(void *)pthread_mutex_init,\
-	sizeof((mutexp)->pmemmutex.mutex))
+	Sync_futex ? (void *)sync_futex_zero : (void *)pthread_mutex_init,\
+	NULL, sizeof((mutexp)->pmemmutex.mutex))
 
 #define GET_RWLOCK(pop, rwlockp)\
 get_lock((pop)->run_id,\
 	&(rwlockp)->pmemrwlock.runid,\
 	&(rwlockp)->pmemrwlock.rwlock,\
 	(void *)pthread_rwlock_init,\
-	sizeof((rwlockp)->pmemrwlock.rwlock))
+	NULL, sizeof((rwlockp)->pmemrwlock.rwlock))
 
 
 #define GET_COND(pop, condp)\
 get_lock((pop)->run_id,\
 	&(condp)->pmemcond.runid,\
 	&(condp)->pmemcond.cond,\
-	(void *)pthread_cond_init,\
-	sizeof((condp)->pmemcond.cond))
+	Sync_futex ? (void *)sync_futex_zero : (void *)pthread_cond_init,\
+	NULL, sizeof((condp)->pmemcond.cond))
 
 /*
  * _get_lock -- (internal) atomically initialize and return a lock
  */
 static void *
 _get_lock(uint64_t pop_runid, volatile uint64_t *runid, void *lock,
-	int (*init_lock)(void *lock, void *arg), size_t size)
+	int (*init_lock)(void *lock, void *arg), void *arg, size_t size)
 {
 	LOG(15, "pop_runid %ju runid %ju lock %p init_lock %p", pop_runid,
 		*runid, lock, init_lock);
@@ -78,7 +649,7 @@ _get_lock(uint64_t pop_runid, volatile uint64_t *runid, void *lock,
 	VALGRIND_REMOVE_PMEM_MAPPING(runid, sizeof(*runid));
 	VALGRIND_REMOVE_PMEM_MAPPING(lock, size);
 
-	while ((tmp_runid = *runid) != pop_runid) {
+	while (((tmp_runid = *runid) & ~SYNC_LOCK_FLAGS) != pop_runid) {
 		if (tmp_runid == pop_runid - 1)
 			continue;
 
@@ -86,7 +657,7 @@ _get_lock(uint64_t pop_runid, volatile uint64_t *runid, void *lock,
 				pop_runid - 1))
 			continue;
 
-		if (init_lock(lock, NULL)) {
+		if (init_lock(lock, arg)) {
 			ERR("error initializing lock");
 			__sync_fetch_and_and(runid, 0);
 			return NULL;
@@ -107,12 +678,12 @@ _get_lock(uint64_t pop_runid, volatile uint64_t *runid, void *lock,
  */
 static inline void *
 get_lock(uint64_t pop_runid, volatile uint64_t *runid, void *lock,
-	int (*init_lock)(void *lock, void *arg), size_t size)
+	int (*init_lock)(void *lock, void *arg), void *arg, size_t size)
 {
-	if (likely(*runid == pop_runid))
+	if (likely((*runid & ~SYNC_LOCK_FLAGS) == pop_runid))
 		return lock;
 
-	return _get_lock(pop_runid, runid, lock, init_lock, size);
+	return _get_lock(pop_runid, runid, lock, init_lock, arg, size);
 }
 
 /*
@@ -147,7 +718,16 @@ pmemobj_mutex_lock(PMEMobjpool *pop, PMEMmutex *mutexp)
 	if (mutex == NULL)
 		return EINVAL;
 
-	return pthread_mutex_lock(mutex);
+	if (sync_elide(&mutexip->pmemmutex.runid))
+		return 0;
+
+	int ret = Sync_futex ?
+		sync_futex_lock(&mutexip->pmemfutex.futex, NULL) :
+		pthread_mutex_lock(mutex);
+	if (ret == 0)
+		sync_acquired(&mutexip->pmemmutex.runid, 1);
+
+	return ret;
 }
 
 /*
@@ -165,6 +745,12 @@ pmemobj_mutex_assert_locked(PMEMobjpool *pop, PMEMmutex *mutexp)
 	if (mutex == NULL)
 		return EINVAL;
 
+	/* an elided mutex isn't really locked */
+	sync_elided_abort();
+
+	if (Sync_futex)
+		return mutexip->pmemfutex.futex != 0 ? 0 : ENODEV;
+
 	int ret = pthread_mutex_trylock(mutex);
 	if (ret == EBUSY)
 		return 0;
@@ -196,7 +782,15 @@ pmemobj_mutex_timedlock(PMEMobjpool *pop, PMEMmutex *__restrict mutexp,
 	if (mutex == NULL)
 		return EINVAL;
 
-	return pthread_mutex_timedlock(mutex, abs_timeout);
+	sync_elided_abort();
+
+	int ret = Sync_futex ?
+		sync_futex_lock(&mutexip->pmemfutex.futex, abs_timeout) :
+		pthread_mutex_timedlock(mutex, abs_timeout);
+	if (ret == 0)
+		sync_acquired(&mutexip->pmemmutex.runid, 1);
+
+	return ret;
 }
 
 /*
@@ -215,7 +809,15 @@ pmemobj_mutex_trylock(PMEMobjpool *pop, PMEMmutex *mutexp)
 	if (mutex == NULL)
 		return EINVAL;
 
-	return pthread_mutex_trylock(mutex);
+	sync_elided_abort();
+
+	int ret = Sync_futex ?
+		sync_futex_trylock(&mutexip->pmemfutex.futex) :
+		pthread_mutex_trylock(mutex);
+	if (ret == 0)
+		sync_acquired(&mutexip->pmemmutex.runid, 1);
+
+	return ret;
 }
 
 /*
@@ -232,6 +834,20 @@ pmemobj_mutex_unlock(PMEMobjpool *pop, PMEMmutex *mutexp)
 	if (mutex == NULL)
 		return EINVAL;
 
+	/*
+	 * No lock is really acquired inside of a speculative critical section,
+	 * and none is held when it starts, so this must be an elided one.
+	 */
+	if (sync_elided()) {
+		sync_elided_unlock();
+		return 0;
+	}
+
+	sync_released(&mutexip->pmemmutex.runid);
+
+	if (Sync_futex)
+		return sync_futex_unlock(&mutexip->pmemfutex.futex);
+
 	return pthread_mutex_unlock(mutex);
 }
 
@@ -267,7 +883,21 @@ pmemobj_rwlock_rdlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_rdlock(rwlock);
+	if (sync_elide(&rwlockip->pmemrwlock.runid))
+		return 0;
+
+	if (sync_bias_rdlock(&rwlockip->pmemrwlock.runid, rwlock)) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		return 0;
+	}
+
+	int ret = pthread_rwlock_rdlock(rwlock);
+	if (ret == 0) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		sync_bias_set(&rwlockip->pmemrwlock.runid, rwlock);
+	}
+
+	return ret;
 }
 
 /*
@@ -286,7 +916,15 @@ pmemobj_rwlock_wrlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_wrlock(rwlock);
+	sync_elided_abort();
+
+	int ret = pthread_rwlock_wrlock(rwlock);
+	if (ret == 0) {
+		sync_bias_revoke(&rwlockip->pmemrwlock.runid, rwlock, 1);
+		sync_acquired(&rwlockip->pmemrwlock.runid, 1);
+	}
+
+	return ret;
 }
 
 /*
@@ -307,7 +945,20 @@ pmemobj_rwlock_timedrdlock(PMEMobjpool *pop, PMEMrwlock *__restrict rwlockp,
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_timedrdlock(rwlock, abs_timeout);
+	sync_elided_abort();
+
+	if (sync_bias_rdlock(&rwlockip->pmemrwlock.runid, rwlock)) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		return 0;
+	}
+
+	int ret = pthread_rwlock_timedrdlock(rwlock, abs_timeout);
+	if (ret == 0) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		sync_bias_set(&rwlockip->pmemrwlock.runid, rwlock);
+	}
+
+	return ret;
 }
 
 /*
@@ -328,7 +979,16 @@ pmemobj_rwlock_timedwrlock(PMEMobjpool *pop, PMEMrwlock *__restrict rwlockp,
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_timedwrlock(rwlock, abs_timeout);
+	sync_elided_abort();
+
+	int ret = pthread_rwlock_timedwrlock(rwlock, abs_timeout);
+	if (ret == 0) {
+		/* the biased readers are waited for despite the timeout */
+		sync_bias_revoke(&rwlockip->pmemrwlock.runid, rwlock, 1);
+		sync_acquired(&rwlockip->pmemrwlock.runid, 1);
+	}
+
+	return ret;
 }
 
 /*
@@ -347,7 +1007,20 @@ pmemobj_rwlock_tryrdlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_tryrdlock(rwlock);
+	sync_elided_abort();
+
+	if (sync_bias_rdlock(&rwlockip->pmemrwlock.runid, rwlock)) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		return 0;
+	}
+
+	int ret = pthread_rwlock_tryrdlock(rwlock);
+	if (ret == 0) {
+		sync_acquired(&rwlockip->pmemrwlock.runid, 0);
+		sync_bias_set(&rwlockip->pmemrwlock.runid, rwlock);
+	}
+
+	return ret;
 }
 
 /*
@@ -366,7 +1039,19 @@ pmemobj_rwlock_trywrlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	if (rwlock == NULL)
 		return EINVAL;
 
-	return pthread_rwlock_trywrlock(rwlock);
+	sync_elided_abort();
+
+	int ret = pthread_rwlock_trywrlock(rwlock);
+	if (ret == 0 && sync_bias_revoke(&rwlockip->pmemrwlock.runid,
+			rwlock, 0) != 0) {
+		pthread_rwlock_unlock(rwlock);
+		return EBUSY;
+	}
+
+	if (ret == 0)
+		sync_acquired(&rwlockip->pmemrwlock.runid, 1);
+
+	return ret;
 }
 
 /*
@@ -383,6 +1068,16 @@ pmemobj_rwlock_unlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	if (rwlock == NULL)
 		return EINVAL;
 
+	if (sync_elided()) {
+		sync_elided_unlock();
+		return 0;
+	}
+
+	sync_released(&rwlockip->pmemrwlock.runid);
+
+	if (sync_bias_rdunlock(rwlock))
+		return 0;
+
 	return pthread_rwlock_unlock(rwlock);
 }
 
@@ -418,6 +1113,12 @@ pmemobj_cond_broadcast(PMEMobjpool *pop, PMEMcond *condp)
 	if (cond == NULL)
 		return EINVAL;
 
+	sync_elided_abort();
+
+	if (Sync_futex)
+		return sync_futex_cond_signal(&condip->pmemfutexcond.seq,
+			INT_MAX);
+
 	return pthread_cond_broadcast(cond);
 }
 
@@ -437,6 +1138,11 @@ pmemobj_cond_signal(PMEMobjpool *pop, PMEMcond *condp)
 	if (cond == NULL)
 		return EINVAL;
 
+	sync_elided_abort();
+
+	if (Sync_futex)
+		return sync_futex_cond_signal(&condip->pmemfutexcond.seq, 1);
+
 	return pthread_cond_signal(cond);
 }
 
@@ -461,7 +1167,17 @@ pmemobj_cond_timedwait(PMEMobjpool *pop, PMEMcond *__restrict condp,
 	if ((cond == NULL) || (mutex == NULL))
 		return EINVAL;
 
-	return pthread_cond_timedwait(cond, mutex, abs_timeout);
+	sync_elided_abort();
+
+	/* the mutex is released by another thread while waiting */
+	sync_released(&mutexip->pmemmutex.runid);
+	int ret = Sync_futex ?
+		sync_futex_cond_wait(&condip->pmemfutexcond.seq,
+			&mutexip->pmemfutex.futex, abs_timeout) :
+		pthread_cond_timedwait(cond, mutex, abs_timeout);
+	sync_acquired(&mutexip->pmemmutex.runid, 1);
+
+	return ret;
 }
 
 /*
@@ -483,5 +1199,59 @@ pmemobj_cond_wait(PMEMobjpool *pop, PMEMcond *condp,
 	if ((cond == NULL) || (mutex == NULL))
 		return EINVAL;
 
-	return pthread_cond_wait(cond, mutex);
+	sync_elided_abort();
+
+	/* the mutex is released by another thread while waiting */
+	sync_released(&mutexip->pmemmutex.runid);
+	int ret = Sync_futex ?
+		sync_futex_cond_wait(&condip->pmemfutexcond.seq,
+			&mutexip->pmemfutex.futex, NULL) :
+		pthread_cond_wait(cond, mutex);
+	sync_acquired(&mutexip->pmemmutex.runid, 1);
+
+	return ret;
+}
+
+struct volatile_init {
+	size_t size;
+	int (*constr)(void *ptr, void *arg);
+	void *arg;
+};
+
+/*
+ * volatile_init -- (internal) zeroes the volatile state and calls the user
+ *	constructor on it
+ */
+static int
+volatile_init(void *ptr, void *arg)
+{
+	struct volatile_init *vi = arg;
+
+	memset(ptr, 0, vi->size);
+
+	return vi->constr ? vi->constr(ptr, vi->arg) : 0;
+}
+
+/*
+ * pmemobj_volatile -- returns the volatile state kept in a persistent object,
+ *	initialized once in each run of the pool
+ *
+ * The state is zeroed and passed to the constructor on the first access after
+ * the pool is opened, the same way the pmem resident locks are, and its
+ * contents from the previous runs are never looked at. It is never flushed,
+ * so it can hold pointers to the DRAM structures of the application.
+ */
+void *
+pmemobj_volatile(PMEMobjpool *pop, struct pmemvlt *vlt, void *ptr,
+	size_t size, int (*constr)(void *ptr, void *arg), void *arg)
+{
+	LOG(15, "pop %p vlt %p ptr %p size %zu", pop, vlt, ptr, size);
+
+	if (likely(vlt->runid == pop->run_id))
+		return ptr;
+
+	struct volatile_init vi = {size, constr, arg};
+
+	return _get_lock(pop->run_id, &vlt->runid, ptr, volatile_init, &vi,
+		size);
 }
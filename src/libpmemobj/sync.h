@@ -53,6 +53,10 @@ typedef union padded_pmemmutex {
 		uint64_t runid;
 		pthread_mutex_t mutex;
 	} pmemmutex;
+	struct {
+		uint64_t runid;
+		uint32_t futex; /* lock word, if PMEMOBJ_FUTEX_MUTEX is set */
+	} pmemfutex;
 } PMEMmutex_internal;
 
 typedef union padded_pmemrwlock {
@@ -69,6 +73,10 @@ typedef union padded_pmemcond {
 		uint64_t runid;
 		pthread_cond_t cond;
 	} pmemcond;
+	struct {
+		uint64_t runid;
+		uint32_t seq; /* wakeup count, if PMEMOBJ_FUTEX_MUTEX is set */
+	} pmemfutexcond;
 } PMEMcond_internal;
 
 /*
@@ -103,4 +111,8 @@ pmemobj_mutex_unlock_nofail(PMEMobjpool *pop, PMEMmutex *mutexp)
 
 int pmemobj_mutex_assert_locked(PMEMobjpool *pop, PMEMmutex *mutexp);
 
+void sync_elision_init(const char *elision_var);
+void sync_futex_init(const char *futex_var);
+void sync_bias_init(const char *bias_var);
+
 #endif
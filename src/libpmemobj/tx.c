@@ -34,13 +34,20 @@
  * tx.c -- transactions implementation
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/queue.h>
+#include <time.h>
 
 #include "ctree.h"
 #include "obj.h"
 #include "out.h"
 #include "pmalloc.h"
+#include "sys_util.h"
 #include "tx.h"
+#include "usdt.h"
 #include "valgrind_internal.h"
 
 /*
@@ -49,50 +56,298 @@
  */
 #define TX_SKIP_ENTRY_VALUE UINT64_MAX
 
-/* Safely modify a single variable during a transaction */
-#define SET_TX_VAR(_pop, _var, _nval)\
-do {\
-	VALGRIND_ADD_TO_TX(&(_var), sizeof(_var));\
-	(_var) = (_nval);\
-	VALGRIND_REMOVE_FROM_TX(&(_var), sizeof(_var));\
-} while (0)
-
 struct tx_data {
 	SLIST_ENTRY(tx_data) tx_entry;
+	PMEMobjpool *pop; /* the pool the transaction was started for */
+	int has_env; /* if not set, an abort returns to the caller */
 	jmp_buf env;
 };
 
-static __thread struct {
-	enum pobj_tx_stage stage;
-	int last_errnum;
-	struct lane_section *section;
-} tx;
-
 struct tx_lock_data {
 	union {
 		PMEMmutex *mutex;
 		PMEMrwlock *rwlock;
 	} lock;
 	enum pobj_tx_lock lock_type;
+	PMEMobjpool *pop;
 	SLIST_ENTRY(tx_lock_data) tx_lock;
 };
 
+/* a pool taking part in the transaction and its lane, if already acquired */
+struct tx_part {
+	PMEMobjpool *pop;
+	struct lane_section *section;
+};
+
+SLIST_HEAD(txd, tx_data);
+SLIST_HEAD(txl, tx_lock_data);
+
+static __thread struct {
+	enum pobj_tx_stage stage;
+	int last_errnum;
+
+	/* the pool of the innermost transaction and its lane */
+	PMEMobjpool *pop;
+
+	/*
+	 * Changes whenever a range may leave the set of the ranges which are
+	 * already in the undo log, see pmemobj_tx_epoch.
+	 */
+	uint64_t epoch;
+
+	/*
+	 * The lane is acquired only once the transaction modifies the pool
+	 * for the first time, and so it's NULL for read-only transactions.
+	 */
+	struct lane_section *section;
+
+	/*
+	 * All of the pools of the transaction, a nested transaction started
+	 * for a pool other than the one of the outer transaction adds its pool
+	 * to the set, and all of them are committed or aborted at once.
+	 */
+	struct tx_part parts[TX_MULTI_MAX_POOLS];
+	unsigned nparts;
+
+	struct txd tx_entries;
+	struct txl tx_locks;
+
+	/*
+	 * Entries of the finished transactions and released locks, reused by
+	 * the next transactions of the thread so that in steady state neither
+	 * begin nor end of a transaction touches the heap.
+	 */
+	struct txd tx_entries_cache;
+	struct txl tx_locks_cache;
+} tx;
+
+/* the key used only to free the entries cached by a thread on its exit */
+static pthread_key_t Tx_cache_key;
+
+/*
+ * tx_cache_destroy -- frees the entries cached by the current thread
+ */
+void
+tx_cache_destroy(void)
+{
+	while (!SLIST_EMPTY(&tx.tx_entries_cache)) {
+		struct tx_data *txd = SLIST_FIRST(&tx.tx_entries_cache);
+		SLIST_REMOVE_HEAD(&tx.tx_entries_cache, tx_entry);
+		Free(txd);
+	}
+
+	while (!SLIST_EMPTY(&tx.tx_locks_cache)) {
+		struct tx_lock_data *txl = SLIST_FIRST(&tx.tx_locks_cache);
+		SLIST_REMOVE_HEAD(&tx.tx_locks_cache, tx_lock);
+		Free(txl);
+	}
+}
+
+/*
+ * tx_cache_key_destroy -- (internal) destructor for thread cached entries
+ */
+static void
+tx_cache_key_destroy(void *arg)
+{
+	tx_cache_destroy();
+}
+
+/*
+ * tx_cache_boot -- initialize the key of thread cached entries
+ */
+void
+tx_cache_boot(void)
+{
+	int result = pthread_key_create(&Tx_cache_key, tx_cache_key_destroy);
+	if (result != 0) {
+		errno = result;
+		FATAL("!pthread_key_create");
+	}
+}
+
+/* serializes the updates of the commit records of multi-pool transactions */
+static pthread_mutex_t Tx_multi_lock;
+
+/* the number of multi-pool transactions committed in this process */
+static uint64_t Tx_multi_count;
+
+/*
+ * tx_multi_boot -- initializes the lock of the multi-pool commit records
+ */
+void
+tx_multi_boot(void)
+{
+	util_mutex_init(&Tx_multi_lock, NULL);
+}
+
+/*
+ * tx_multi_destroy -- destroys the lock of the multi-pool commit records
+ */
+void
+tx_multi_destroy(void)
+{
+	util_mutex_destroy(&Tx_multi_lock);
+}
+
+/*
+ * The number of entries of every undo log of a lane for which the arrays of
+ * the underlying vector are kept allocated between transactions.
+ */
+#define TX_UNDO_RETAIN_DEFAULT 256
+
+static uint64_t Tx_undo_retain = TX_UNDO_RETAIN_DEFAULT;
+
+/*
+ * tx_undo_retain_init -- reads the number of retained undo log entries from
+ *	the given environment variable
+ */
+void
+tx_undo_retain_init(const char *retain_var)
+{
+	char *e = getenv(retain_var);
+	if (e == NULL)
+		return;
+
+	long long val = atoll(e);
+	if (val < 0) {
+		LOG(2, "Invalid %s", retain_var);
+	} else {
+		Tx_undo_retain = (uint64_t)val;
+		LOG(3, "%s set to %" PRIu64, retain_var, Tx_undo_retain);
+	}
+}
+
+/*
+ * Unless set, the objects freed in a transaction are freed by its commit.
+ * Otherwise, the lane is handed off to the background reclaimer of the pool,
+ * which frees them and clears the state of the transaction, see tx_reclaim.
+ */
+static int Tx_async_free;
+
+/*
+ * tx_async_free_init -- reads whether the objects freed in transactions are
+ *	freed in the background from the given environment variable
+ */
+void
+tx_async_free_init(const char *async_var)
+{
+	char *e = getenv(async_var);
+	if (e == NULL)
+		return;
+
+	Tx_async_free = atoi(e) > 0;
+	LOG(3, "%s set to %d", async_var, Tx_async_free);
+}
+
+/* the longest the leader of a group of commits waits for it to grow */
+#define TX_GROUP_WAIT_MAX 1000000 /* microseconds */
+
+/*
+ * The time, in microseconds, for which the leader of a group of commits
+ * waits for more transactions to join it, or -1 if they are not grouped.
+ */
+static long long Tx_group_wait = -1;
+
+/*
+ * tx_group_commit_init -- reads whether the transactions are committed in
+ *	groups, and the longest wait for a group, from the given environment
+ *	variable
+ */
+void
+tx_group_commit_init(const char *group_var)
+{
+	char *e = getenv(group_var);
+	if (e == NULL)
+		return;
+
+	long long val = atoll(e);
+	if (val < 0) {
+		LOG(2, "Invalid %s", group_var);
+		return;
+	}
+
+	Tx_group_wait = val < TX_GROUP_WAIT_MAX ? val : TX_GROUP_WAIT_MAX;
+	LOG(3, "%s set to %lld", group_var, Tx_group_wait);
+}
+
+/*
+ * tx_cache_register -- (internal) makes sure that the entries cached by the
+ *	current thread are freed on its exit
+ */
+static void
+tx_cache_register(void)
+{
+	int result = pthread_setspecific(Tx_cache_key, &tx);
+	if (result != 0) {
+		errno = result;
+		FATAL("!pthread_setspecific");
+	}
+}
+
 struct tx_undo_runtime {
 	struct pvector_context *ctx[MAX_UNDO_TYPES];
 };
 
+/* initial number of entries in the set of transaction ranges */
+#define TX_RANGE_SET_INIT_CAPACITY 64
+
+struct tx_range_def {
+	uint64_t begin;
+	uint64_t end;
+};
+
+/*
+ * Set of the pool ranges which are already in the undo log of the transaction,
+ * either because they were snapshotted or allocated within it.
+ *
+ * It's a sorted array of disjoint ranges - overlapping and adjacent ranges are
+ * merged on insertion, which keeps the set small and makes repeated snapshots
+ * of the same memory cost just a binary search. The array is reused between
+ * the transactions of a lane.
+ */
+struct tx_range_set {
+	struct tx_range_def *ranges;
+	size_t nranges;
+	size_t capacity;
+};
+
+/* granularity of the commit-time flush of the snapshotted ranges */
+#define TX_FLUSH_ALIGN ((uint64_t)64)
+
+/*
+ * Minimal size of the data copied into a new object which is made durable
+ * right away, with non-temporal stores, instead of being flushed on commit.
+ * Below it the additional fence costs more than the flush.
+ */
+#define TX_COPY_PERSIST_MIN_SIZE ((size_t)4096)
+
+/* minimal capacity of the redo log of a lane */
+#define TX_REDO_LOG_MIN_CAPACITY 4096
+
+/*
+ * Writes deferred until the commit of the transaction, in the format of the
+ * persistent redo log. The buffer is reused between the transactions of a lane.
+ */
+struct tx_redo_buffer {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
 struct lane_tx_runtime {
 	PMEMobjpool *pop;
-	struct ctree *ranges;
-	unsigned cache_slot;
+	struct tx_range_set ranges;
+	struct tx_range_set flush; /* snapshotted ranges to flush on commit */
+	struct tx_range_set persisted; /* durable parts of the new objects */
+	struct tx_redo_buffer redo;
+	struct ctree *allocs; /* allocated objects and their undo log entries */
+	size_t cache_offset; /* first free byte in the last range cache */
 	struct tx_undo_runtime undo;
-	SLIST_HEAD(txd, tx_data) tx_entries;
-	SLIST_HEAD(txl, tx_lock_data) tx_locks;
+	int free_deferred; /* the objects freed are left to the reclaimer */
 };
 
 struct tx_alloc_args {
 	type_num_t type_num;
-	uint64_t entry_offset;
 };
 
 struct tx_alloc_copy_args {
@@ -100,12 +355,14 @@ struct tx_alloc_copy_args {
 	size_t size;
 	const void *ptr;
 	size_t copy_size;
+	int persisted; /* set if the copied data is already durable */
 };
 
 struct tx_add_range_args {
 	PMEMobjpool *pop;
 	uint64_t offset;
 	uint64_t size;
+	uint64_t flags;
 };
 
 /*
@@ -165,6 +422,7 @@ constructor_tx_alloc(void *ctx, void *ptr, size_t usable_size, void *arg)
 	ASSERTne(ptr, NULL);
 	ASSERTne(arg, NULL);
 
+	PMEMobjpool *pop = ctx;
 	struct tx_alloc_args *args = arg;
 
 	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
@@ -176,10 +434,7 @@ constructor_tx_alloc(void *ctx, void *ptr, size_t usable_size, void *arg)
 	 * no need to flush and persist because this
 	 * will be done in pre-commit phase
 	 */
-	oobh->type_num = args->type_num;
-	oobh->size = 0;
-	oobh->undo_entry_offset = args->entry_offset;
-	memset(oobh->unused, 0, sizeof(oobh->unused));
+	obj_oob_init(pop, ptr, args->type_num, 0);
 
 	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE);
 
@@ -200,11 +455,35 @@ constructor_tx_zalloc(void *ctx, void *ptr, size_t usable_size, void *arg)
 
 	constructor_tx_alloc(pop, ptr, usable_size, arg);
 
-	memset(ptr, 0, usable_size);
+	if (palloc_block_zeroed())
+		VALGRIND_DO_MAKE_MEM_DEFINED(ptr, usable_size);
+	else
+		memset(ptr, 0, usable_size);
 
 	return 0;
 }
 
+/*
+ * tx_alloc_copy_data -- (internal) copies the data into the new object
+ *
+ * Large copies are made durable with non-temporal stores as they go, which
+ * doesn't pollute the cache with data that's only written, and the copied
+ * range is then left out of the flush of the object on commit. The object
+ * is never snapshotted, so the copy is rolled back by freeing it.
+ */
+static void
+tx_alloc_copy_data(PMEMobjpool *pop, void *ptr,
+	struct tx_alloc_copy_args *args)
+{
+	if (args->copy_size < TX_COPY_PERSIST_MIN_SIZE) {
+		memcpy(ptr, args->ptr, args->copy_size);
+		return;
+	}
+
+	pmemops_memcpy_persist(&pop->p_ops, ptr, args->ptr, args->copy_size);
+	args->persisted = 1;
+}
+
 /*
  * constructor_tx_copy -- (internal) copy constructor
  */
@@ -220,7 +499,7 @@ constructor_tx_copy(void *ctx, void *ptr, size_t usable_size, void *arg)
 	struct tx_alloc_copy_args *args = arg;
 	constructor_tx_alloc(pop, ptr, usable_size, &args->super);
 
-	memcpy(ptr, args->ptr, args->copy_size);
+	tx_alloc_copy_data(pop, ptr, args);
 
 	return 0;
 }
@@ -241,7 +520,7 @@ constructor_tx_copy_zero(void *ctx, void *ptr, size_t usable_size, void *arg)
 	struct tx_alloc_copy_args *args = arg;
 	constructor_tx_alloc(pop, ptr, usable_size, &args->super);
 
-	memcpy(ptr, args->ptr, args->copy_size);
+	tx_alloc_copy_data(pop, ptr, args);
 	if (usable_size > args->copy_size) {
 		void *zero_ptr = (void *)((uintptr_t)ptr + args->copy_size);
 		size_t zero_size = usable_size - args->copy_size;
@@ -275,15 +554,35 @@ constructor_tx_add_range(void *ctx, void *ptr, size_t usable_size, void *arg)
 
 	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
 
-	range->offset = args->offset;
-	range->size = args->size;
+	const char *src = OBJ_OFF_TO_PTR(args->pop, args->offset);
+
+	/*
+	 * The bulk of the snapshot, from the first cache line boundary on, is
+	 * copied with the non-temporal stores of pmem_memcpy_persist, which
+	 * neither pull the lines into the cache nor need to flush them. Its
+	 * beginning shares a line with the header and is written last along
+	 * with it, so that the line is flushed only once. The snapshot becomes
+	 * a part of the undo log after that, when the allocation is published.
+	 *
+	 * The flush of the header is deliberately not drained here. The fence
+	 * that orders it is the pmemops_persist() of the allocation header in
+	 * alloc_prep_block(), called by palloc_operation() with drain set
+	 * right after this constructor returns - always, even if the object
+	 * has no header - and before the redo log that publishes the
+	 * allocation is written.
+	 */
+	size_t head = (size_t)(-(uintptr_t)range->data &
+		(_POBJ_CL_ALIGNMENT - 1));
+	if (head > args->size)
+		head = args->size;
 
-	void *src = OBJ_OFF_TO_PTR(args->pop, args->offset);
+	pmemops_memcpy_persist(p_ops, range->data + head, src + head,
+		args->size - head);
 
-	/* flush offset and size */
-	pmemops_flush(p_ops, range, sizeof(struct tx_range));
-	/* memcpy data and persist */
-	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
+	range->offset = args->offset;
+	range->size = args->size;
+	memcpy(range->data, src, head);
+	pmemops_flush(p_ops, range, sizeof(struct tx_range) + head);
 
 	VALGRIND_REMOVE_FROM_TX(oobh,
 				sizeof(struct tx_range) + args->size
@@ -342,10 +641,12 @@ tx_clear_undo_log_vg(PMEMobjpool *pop, uint64_t off, enum tx_clr_flag flags)
 	 * modifications after abort are not reported.
 	 */
 	if (flags & TX_CLR_FLAG_VG_CLEAN) {
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, off);
-		size_t size = palloc_usable_size(&pop->heap, off);
+		size_t hsize = palloc_header_size(&pop->heap, off);
+		size_t size = palloc_usable_size(&pop->heap, off) -
+			OBJ_OOB_SIZE + hsize;
 
-		VALGRIND_SET_CLEAN(oobh, size);
+		VALGRIND_SET_CLEAN((char *)OBJ_OFF_TO_PTR(pop, off) - hsize,
+			size);
 	}
 
 	if (flags & TX_CLR_FLAG_VG_TX_REMOVE) {
@@ -372,6 +673,19 @@ tx_clear_undo_log(PMEMobjpool *pop, struct pvector_context *undo,
 
 	uint64_t val;
 
+	if (!(flags & TX_CLR_FLAG_FREE)) {
+#ifdef USE_VG_PMEMCHECK
+		for (val = pvector_first(undo); val != 0;
+				val = pvector_next(undo)) {
+			if (val != TX_SKIP_ENTRY_VALUE)
+				tx_clear_undo_log_vg(pop, val, flags);
+		}
+#endif
+		/* the entries are only zeroed, all of them at once */
+		pvector_truncate(undo, 0);
+		return;
+	}
+
 	while ((val = pvector_last(undo)) != 0) {
 		if (val == TX_SKIP_ENTRY_VALUE) {
 			pvector_pop_back(undo, tx_clear_vec_entry);
@@ -380,11 +694,7 @@ tx_clear_undo_log(PMEMobjpool *pop, struct pvector_context *undo,
 
 		tx_clear_undo_log_vg(pop, val, flags);
 
-		if (flags & TX_CLR_FLAG_FREE) {
-			pvector_pop_back(undo, tx_free_vec_entry);
-		} else {
-			pvector_pop_back(undo, tx_clear_vec_entry);
-		}
+		pvector_pop_back(undo, tx_free_vec_entry);
 	}
 }
 
@@ -423,6 +733,146 @@ struct tx_range_data {
 
 SLIST_HEAD(txr, tx_range_data);
 
+/*
+ * tx_range_set_reserve -- (internal) makes sure that one more range fits in
+ *	the set
+ */
+static int
+tx_range_set_reserve(struct tx_range_set *s)
+{
+	if (s->nranges < s->capacity)
+		return 0;
+
+	size_t capacity = s->capacity == 0 ?
+		TX_RANGE_SET_INIT_CAPACITY : s->capacity * 2;
+	struct tx_range_def *ranges = Realloc(s->ranges,
+		capacity * sizeof(*ranges));
+	if (ranges == NULL)
+		return ENOMEM;
+
+	s->ranges = ranges;
+	s->capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * tx_range_set_find -- (internal) returns the index of the first range in the
+ *	set that ends at or after the given offset
+ */
+static size_t
+tx_range_set_find(struct tx_range_set *s, uint64_t off)
+{
+	size_t l = 0;
+	size_t r = s->nranges;
+
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (s->ranges[m].end < off)
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	return l;
+}
+
+/*
+ * tx_range_set_add -- (internal) adds the range to the set, merging it with
+ *	all the ranges it overlaps or touches
+ *
+ * If provided, the callback is invoked, before the set is modified, for every
+ * part of the range that isn't in the set yet. Nonzero value returned by the
+ * callback stops the insertion and is returned to the caller.
+ */
+static int
+tx_range_set_add(struct tx_range_set *s, uint64_t begin, uint64_t end,
+	int (*cb)(uint64_t begin, uint64_t end, void *arg), void *arg)
+{
+	if (begin == end)
+		return 0;
+
+	int ret;
+	if ((ret = tx_range_set_reserve(s)) != 0)
+		return ret;
+
+	size_t first = tx_range_set_find(s, begin);
+	size_t last;
+	uint64_t cur = begin; /* end of the part of the range already seen */
+
+	for (last = first; last < s->nranges &&
+			s->ranges[last].begin <= end; ++last) {
+		struct tx_range_def *r = &s->ranges[last];
+		if (cb != NULL && r->begin > cur &&
+				(ret = cb(cur, r->begin, arg)) != 0)
+			return ret;
+
+		if (r->end > cur)
+			cur = r->end;
+	}
+
+	if (cb != NULL && cur < end && (ret = cb(cur, end, arg)) != 0)
+		return ret;
+
+	if (first == last) {
+		memmove(&s->ranges[first + 1], &s->ranges[first],
+			(s->nranges - first) * sizeof(*s->ranges));
+		s->nranges++;
+
+		s->ranges[first].begin = begin;
+		s->ranges[first].end = end;
+	} else {
+		struct tx_range_def *r = &s->ranges[first];
+		if (begin < r->begin)
+			r->begin = begin;
+		r->end = cur;
+
+		memmove(&s->ranges[first + 1], &s->ranges[last],
+			(s->nranges - last) * sizeof(*s->ranges));
+		s->nranges -= last - first - 1;
+	}
+
+	return 0;
+}
+
+/*
+ * tx_range_set_remove -- (internal) removes the range from the set, splitting
+ *	the ranges it partially overlaps
+ */
+static int
+tx_range_set_remove(struct tx_range_set *s, uint64_t begin, uint64_t end)
+{
+	if (tx_range_set_reserve(s) != 0)
+		return ENOMEM;
+
+	size_t i = tx_range_set_find(s, begin + 1);
+	while (i < s->nranges && s->ranges[i].begin < end) {
+		struct tx_range_def *r = &s->ranges[i];
+		if (r->begin < begin && r->end > end) {
+			memmove(&s->ranges[i + 2], &s->ranges[i + 1],
+				(s->nranges - i - 1) * sizeof(*s->ranges));
+			s->nranges++;
+
+			s->ranges[i + 1].begin = end;
+			s->ranges[i + 1].end = r->end;
+			r->end = begin;
+			break;
+		} else if (r->begin < begin) {
+			r->end = begin;
+			i++;
+		} else if (r->end > end) {
+			r->begin = end;
+			break;
+		} else {
+			memmove(r, r + 1,
+				(s->nranges - i - 1) * sizeof(*s->ranges));
+			s->nranges--;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * tx_remove_range -- (internal) removes specified range from ranges list
  */
@@ -487,10 +937,6 @@ tx_restore_range(PMEMobjpool *pop, struct tx_range *range)
 	COMPILE_ERROR_ON(sizeof(PMEMrwlock) != _POBJ_CL_ALIGNMENT);
 	COMPILE_ERROR_ON(sizeof(PMEMcond) != _POBJ_CL_ALIGNMENT);
 
-	struct lane_tx_runtime *runtime =
-			(struct lane_tx_runtime *)tx.section->runtime;
-	ASSERTne(runtime, NULL);
-
 	struct txr tx_ranges;
 	SLIST_INIT(&tx_ranges);
 
@@ -507,7 +953,7 @@ tx_restore_range(PMEMobjpool *pop, struct tx_range *range)
 	struct tx_lock_data *txl;
 
 	/* check if there are any locks within given memory range */
-	SLIST_FOREACH(txl, &(runtime->tx_locks), tx_lock) {
+	SLIST_FOREACH(txl, &tx.tx_locks, tx_lock) {
 		void *lock_begin = txl->lock.mutex;
 		/* all PMEM locks have the same size */
 		void *lock_end = (char *)lock_begin + _POBJ_CL_ALIGNMENT;
@@ -555,12 +1001,14 @@ tx_foreach_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 	for (off = pvector_first(ctx); off != 0; off = pvector_next(ctx)) {
 		cache = OBJ_OFF_TO_PTR(pop, off);
 
-		for (int i = 0; i < MAX_CACHED_RANGES; ++i) {
-			range = (struct tx_range *)&cache->range[i];
+		uint64_t pos = 0;
+		while (pos + sizeof(struct tx_range) <= cache->capacity) {
+			range = (struct tx_range *)&cache->data[pos];
 			if (range->offset == 0 || range->size == 0)
 				break;
 
 			cb(pop, range);
+			pos += TX_RANGE_ENTRY_SIZE(range->size);
 		}
 	}
 }
@@ -608,9 +1056,13 @@ tx_abort_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt, int recovery)
 /*
  * tx_pre_commit_alloc -- (internal) do pre-commit operations for
  * allocated objects
+ *
+ * The parts of the objects which are in the 'persisted' set were made durable
+ * when the data was copied into them and aren't flushed again.
  */
 static void
-tx_pre_commit_alloc(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt)
+tx_pre_commit_alloc(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
+	struct tx_range_set *persisted)
 {
 	LOG(3, NULL);
 
@@ -624,39 +1076,68 @@ tx_pre_commit_alloc(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt)
 			continue;
 
 		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, offset);
-		SET_TX_VAR(pop, oobh->undo_entry_offset, 0);
 
 		/*
 		 * Flush the entire object with the exception of the unused part
-		 * of the OOB header. This code is very reliant on the object
-		 * header layout so be careful when modifying.
+		 * of the OOB header, or of the part which doesn't exist in
+		 * compact or no headers. This code is very reliant on the
+		 * object header layout so be careful when modifying.
 		 */
+		size_t hsize = palloc_header_size(&pop->heap, offset);
+		void *start = hsize == OBJ_OOB_SIZE ?
+			(void *)&oobh->undo_entry_offset :
+			(void *)((uintptr_t)oobh + OBJ_OOB_SIZE - hsize);
 		size_t size = palloc_usable_size(&pop->heap, offset) -
-			sizeof(oobh->unused);
-		pmemops_flush(&pop->p_ops, &oobh->undo_entry_offset, size);
-	}
-}
+			(size_t)((uintptr_t)start - (uintptr_t)oobh);
 
-/*
- * tx_pre_commit_range_persist -- (internal) flushes memory range to persistence
- */
-static void
-tx_pre_commit_range_persist(PMEMobjpool *pop, struct tx_range *range)
-{
-	void *ptr = OBJ_OFF_TO_PTR(pop, range->offset);
-	pmemops_flush(&pop->p_ops, ptr, range->size);
+		size_t i = tx_range_set_find(persisted, offset + 1);
+		if (i == persisted->nranges ||
+				persisted->ranges[i].begin > offset) {
+			pmemops_flush(&pop->p_ops, start, size);
+			continue;
+		}
+
+		/* flush only the header and whatever follows the copied data */
+		size_t hdr = (size_t)((uintptr_t)oobh + OBJ_OOB_SIZE -
+			(uintptr_t)start);
+		uint64_t end = offset + size - hdr;
+		uint64_t durable = persisted->ranges[i].end < end ?
+			persisted->ranges[i].end : end;
+
+		if (hdr != 0)
+			pmemops_flush(&pop->p_ops, start, hdr);
+		if (durable < end)
+			pmemops_flush(&pop->p_ops,
+				OBJ_OFF_TO_PTR(pop, durable), end - durable);
+	}
 }
 
 /*
  * tx_pre_commit_set -- (internal) do pre-commit operations for
  * set operations
+ *
+ * The snapshotted ranges are flushed from the sorted set of the transaction
+ * rather than one undo log entry at a time, so that the ranges which share
+ * a cacheline are flushed together and every cacheline is flushed only once.
  */
 static void
-tx_pre_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt)
+tx_pre_commit_set(PMEMobjpool *pop, struct tx_range_set *flush)
 {
 	LOG(3, NULL);
 
-	tx_foreach_set(pop, tx_rt, tx_pre_commit_range_persist);
+	size_t i = 0;
+	while (i < flush->nranges) {
+		uint64_t begin = flush->ranges[i].begin;
+		uint64_t end = flush->ranges[i].end;
+
+		for (++i; i < flush->nranges && flush->ranges[i].begin <
+				((end + TX_FLUSH_ALIGN - 1) &
+				~(TX_FLUSH_ALIGN - 1)); ++i)
+			end = flush->ranges[i].end;
+
+		pmemops_flush(&pop->p_ops, OBJ_OFF_TO_PTR(pop, begin),
+			end - begin);
+	}
 }
 
 /*
@@ -700,9 +1181,10 @@ tx_post_commit_range_vg_tx_remove(PMEMobjpool *pop, struct tx_range *range)
 
 /*
  * tx_post_commit_set -- (internal) do post commit operations for
- * add range
+ * add range, returns 1 if the range cache has been flushed and needs to be
+ * drained by the caller
  */
-static void
+static int
 tx_post_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 		int recovery)
 {
@@ -718,6 +1200,7 @@ tx_post_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 	uint64_t off;
 
 	int zero_all = recovery;
+	int flushed = 0;
 
 	while ((off = pvector_last(cache_undo)) != first_cache) {
 		pvector_pop_back(cache_undo, tx_free_vec_entry);
@@ -729,55 +1212,157 @@ tx_post_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 
 		size_t sz;
 		if (zero_all) {
-			sz = sizeof(*cache);
+			sz = cache->capacity;
 		} else {
 			struct lane_tx_runtime *r = tx.section->runtime;
-			sz = sizeof(cache->range[0]) * r->cache_slot;
+			sz = r->cache_offset;
 		}
 
-		VALGRIND_ADD_TO_TX(cache, sz);
-		pmemops_memset_persist(&pop->p_ops, cache, 0, sz);
-		VALGRIND_REMOVE_FROM_TX(cache, sz);
+		if (sz != 0) {
+			VALGRIND_ADD_TO_TX(cache->data, sz);
+			memset(cache->data, 0, sz);
+			pmemops_flush(&pop->p_ops, cache->data, sz);
+			VALGRIND_REMOVE_FROM_TX(cache->data, sz);
+			flushed = 1;
+		}
 
 #ifdef DEBUG
 		if (!zero_all) /* for recovery we know we zeroed everything */
-			ASSERTeq(util_is_zeroed(cache, sizeof(*cache)), 1);
+			ASSERTeq(util_is_zeroed(cache->data,
+				cache->capacity), 1);
 #endif
 	}
 
 	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET], TX_CLR_FLAG_FREE);
+
+	return flushed;
 }
 
 /*
- * tx_pre_commit -- (internal) do pre-commit operations
+ * tx_redo_clear -- (internal) invalidates the redo log left by an earlier
+ *	transaction of the lane, so that it won't be applied again when this
+ *	one, which has no deferred writes, is committed
+ *
+ * The redo log is not cleared right after being applied. This is instead
+ * done by the next transaction which needs it, and doesn't cost a separate
+ * fence because it's drained along with the rest of the pre-commit phase.
+ * The only exception is a transaction whose lane is handed off to the
+ * reclaimer, see tx_post_commit.
  */
 static void
-tx_pre_commit(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt)
+tx_redo_clear(PMEMobjpool *pop, struct lane_tx_layout *layout)
 {
 	LOG(3, NULL);
 
-	ASSERTne(tx.section->runtime, NULL);
+	if (layout->redo_log == 0)
+		return;
+
+	struct tx_redo_log *log = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	if (log->size == 0)
+		return;
 
-	tx_pre_commit_set(pop, tx_rt);
-	tx_pre_commit_alloc(pop, tx_rt);
+	VALGRIND_ADD_TO_TX(&log->size, sizeof(log->size));
+	log->size = 0;
+	pmemops_flush(&pop->p_ops, &log->size, sizeof(log->size));
+	VALGRIND_REMOVE_FROM_TX(&log->size, sizeof(log->size));
 }
 
 /*
- * tx_rebuild_undo_runtime -- (internal) reinitializes runtime state of vectors
+ * tx_pre_commit_redo -- (internal) saves the deferred writes in the persistent
+ *	redo log, without waiting for them to be persisted
  */
-static int
-tx_rebuild_undo_runtime(PMEMobjpool *pop, struct lane_tx_layout *layout,
-	struct tx_undo_runtime *tx_rt)
+static void
+tx_pre_commit_redo(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_redo_buffer *redo)
 {
 	LOG(3, NULL);
 
-	int i;
-	for (i = UNDO_ALLOC; i < MAX_UNDO_TYPES; ++i) {
-		if (tx_rt->ctx[i] == NULL)
-			tx_rt->ctx[i] = pvector_new(pop, &layout->undo_log[i]);
+	if (redo->size == 0) {
+		tx_redo_clear(pop, layout);
+		return;
+	}
+
+	ASSERTne(layout->redo_log, 0);
+	struct tx_redo_log *log = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+
+	VALGRIND_ADD_TO_TX(log, sizeof(*log) + redo->size);
+	memcpy(log->data, redo->data, redo->size);
+	log->size = redo->size;
+	pmemops_flush(&pop->p_ops, log, sizeof(*log) + redo->size);
+	VALGRIND_REMOVE_FROM_TX(log, sizeof(*log) + redo->size);
+}
+
+/*
+ * tx_redo_apply -- (internal) applies the writes from the redo log of
+ *	a committed transaction, without waiting for them to be persisted,
+ *	returns 1 if there were any
+ *
+ * This is idempotent, and so it's safe to repeat it during recovery.
+ */
+static int
+tx_redo_apply(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	LOG(3, NULL);
+
+	if (layout->redo_log == 0)
+		return 0;
+
+	struct tx_redo_log *log = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	if (log->size == 0)
+		return 0;
+
+	struct tx_range *e;
+	for (uint64_t pos = 0; pos < log->size;
+			pos += TX_RANGE_ENTRY_SIZE(e->size)) {
+		e = (struct tx_range *)&log->data[pos];
+		void *dest = OBJ_OFF_TO_PTR(pop, e->offset);
+
+		VALGRIND_ADD_TO_TX(dest, e->size);
+		memcpy(dest, e->data, e->size);
+		pmemops_flush(&pop->p_ops, dest, e->size);
+		VALGRIND_REMOVE_FROM_TX(dest, e->size);
+	}
+
+	return 1;
+}
+
+/*
+ * tx_pre_commit -- (internal) do pre-commit operations
+ */
+static void
+tx_pre_commit(PMEMobjpool *pop, struct lane_tx_runtime *lane)
+{
+	LOG(3, NULL);
+
+	ASSERTne(tx.section->runtime, NULL);
+
+	tx_pre_commit_set(pop, &lane->flush);
+	tx_pre_commit_alloc(pop, &lane->undo, &lane->persisted);
+}
 
+/*
+ * tx_rebuild_undo_runtime -- (internal) reinitializes runtime state of vectors
+ */
+static int
+tx_rebuild_undo_runtime(PMEMobjpool *pop, struct lane_tx_layout *layout,
+	struct tx_undo_runtime *tx_rt)
+{
+	LOG(3, NULL);
+
+	int i;
+	for (i = UNDO_ALLOC; i < MAX_UNDO_TYPES; ++i) {
+		if (tx_rt->ctx[i] != NULL)
+			continue;
+
+		tx_rt->ctx[i] = pvector_new(pop, &layout->undo_log[i]);
 		if (tx_rt->ctx[i] == NULL)
 			goto error_init;
+
+		/*
+		 * The arrays of the logs are reused by the next transactions
+		 * of the lane, instead of being freed once emptied.
+		 */
+		pvector_retain(tx_rt->ctx[i], Tx_undo_retain);
 	}
 
 	return 0;
@@ -803,8 +1388,11 @@ tx_destroy_undo_runtime(struct tx_undo_runtime *tx)
 
 /*
  * tx_post_commit -- (internal) do post commit operations
+ *
+ * Returns 1 if the objects freed in the transaction are left to the
+ * reclaimer, in which case the state of the transaction must not be cleared.
  */
-static void
+static int
 tx_post_commit(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
 {
 	LOG(3, NULL);
@@ -821,12 +1409,490 @@ tx_post_commit(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
 		tx_rt = &lane->undo;
 	}
 
-	tx_post_commit_set(pop, tx_rt, recovery);
+	/*
+	 * Neither the deferred writes nor the cleared range cache have to be
+	 * persistent until the state of the transaction is cleared, so they
+	 * share a single drain.
+	 */
+	int redo = tx_redo_apply(pop, layout);
+	int flushed = redo | tx_post_commit_set(pop, tx_rt, recovery);
+	if (flushed)
+		pmemops_drain(&pop->p_ops);
+
 	tx_post_commit_alloc(pop, tx_rt);
+
+	if (!recovery && pop->tx_reclaim != NULL &&
+			pvector_nvalues(tx_rt->ctx[UNDO_FREE]) != 0) {
+		/*
+		 * The state stays committed after the locks are released, so
+		 * the redo log, already applied, must not be applied again by
+		 * the recovery over the writes made since then.
+		 */
+		if (redo) {
+			tx_redo_clear(pop, layout);
+			pmemops_drain(&pop->p_ops);
+		}
+
+		return 1;
+	}
+
 	tx_post_commit_free(pop, tx_rt);
 
 	if (recovery)
 		tx_destroy_undo_runtime(tx_rt);
+
+	return 0;
+}
+
+/*
+ * The background reclaimer of a pool frees the objects freed by the committed
+ * transactions, so that the commit doesn't have to wait for it.
+ *
+ * The state of such a transaction is left committed, and its lane, instead of
+ * being released, is handed off to the reclaimer, which frees the objects and
+ * clears the state, just like the recovery of a transaction interrupted after
+ * it was committed does. Until then, the lane stays busy and the threads
+ * simply use the other lanes in the meantime.
+ *
+ * A crash before the objects are freed is recovered like any committed
+ * transaction, but by then the locks of the transaction are released and the
+ * memory it wrote may have been modified again. This is why the redo log of
+ * the transaction is invalidated before the lane is handed off - only the
+ * frees, which nobody else can observe until they are done, are left to be
+ * redone.
+ *
+ * To bound both the lanes taken away from the threads and the memory not yet
+ * freed, once the queue of the reclaimer is full the commits free the objects
+ * themselves.
+ */
+#define TX_RECLAIM_QUEUE_MAX 16
+
+struct tx_reclaim {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t idle; /* signaled once all the lanes are processed */
+	int stop;
+
+	/* the lanes handed off */
+	unsigned size;
+	unsigned head;
+	unsigned count;
+	uint64_t *queue;
+
+	/* the lanes taken from the queue at once */
+	unsigned nbatch;
+	uint64_t *batch;
+};
+
+/*
+ * tx_reclaim_lane -- (internal) frees the objects freed by the transaction
+ *	committed in the lane and releases it
+ */
+static void
+tx_reclaim_lane(PMEMobjpool *pop, uint64_t idx)
+{
+	lane_take_over(pop, idx, LANE_SECTION_TRANSACTION);
+
+	struct lane_section *section =
+		&pop->lanes_desc.lane[idx].sections[LANE_SECTION_TRANSACTION];
+	struct lane_tx_runtime *lane = section->runtime;
+
+	tx_post_commit_free(pop, &lane->undo);
+	tx_set_state(pop, (struct lane_tx_layout *)section->layout,
+		TX_STATE_NONE);
+
+	lane_release(pop);
+}
+
+/*
+ * tx_reclaim_worker -- (internal) processes the lanes handed off to the
+ *	reclaimer, in batches of all the lanes queued when it wakes up
+ */
+static void *
+tx_reclaim_worker(void *arg)
+{
+	PMEMobjpool *pop = arg;
+	struct tx_reclaim *r = pop->tx_reclaim;
+
+	util_mutex_lock(&r->lock);
+	for (;;) {
+		while (r->count == 0 && !r->stop)
+			pthread_cond_wait(&r->cond, &r->lock);
+
+		/* the lanes queued are processed before stopping */
+		if (r->count == 0)
+			break;
+
+		unsigned n = r->count;
+		for (unsigned i = 0; i < n; ++i)
+			r->batch[i] = r->queue[(r->head + i) % r->size];
+		r->head = (r->head + n) % r->size;
+		r->count = 0;
+		r->nbatch = n;
+
+		util_mutex_unlock(&r->lock);
+
+		for (unsigned i = 0; i < n; ++i)
+			tx_reclaim_lane(pop, r->batch[i]);
+
+		LOG(4, "freed the objects of %u transactions", n);
+
+		util_mutex_lock(&r->lock);
+		r->nbatch = 0;
+		if (r->count == 0)
+			pthread_cond_broadcast(&r->idle);
+	}
+	util_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+/*
+ * tx_reclaim_push -- (internal) hands off the lane of the ending transaction,
+ *	whose freed objects are still to be freed, to the reclaimer
+ */
+static void
+tx_reclaim_push(PMEMobjpool *pop, struct lane_section *section)
+{
+	struct tx_reclaim *r = pop->tx_reclaim;
+
+	util_mutex_lock(&r->lock);
+
+	uint64_t idx;
+	if (r->count + r->nbatch < r->size && lane_hand_off(pop, &idx) == 0) {
+		r->queue[(r->head + r->count) % r->size] = idx;
+		r->count++;
+
+		pthread_cond_signal(&r->cond);
+		util_mutex_unlock(&r->lock);
+		return;
+	}
+
+	util_mutex_unlock(&r->lock);
+
+	/* the queue is full, or the lane is still used by the caller */
+	struct lane_tx_runtime *lane = section->runtime;
+	tx_post_commit_free(pop, &lane->undo);
+	tx_set_state(pop, (struct lane_tx_layout *)section->layout,
+		TX_STATE_NONE);
+	lane_release(pop);
+}
+
+/*
+ * tx_reclaim_start -- starts the background reclaimer of the pool, if enabled
+ *
+ * If it can't be started, the objects are freed by the commits instead.
+ */
+void
+tx_reclaim_start(PMEMobjpool *pop)
+{
+	if (!Tx_async_free)
+		return;
+
+	struct tx_reclaim *r = Zalloc(sizeof(*r));
+	if (r == NULL) {
+		LOG(2, "!Zalloc");
+		return;
+	}
+
+	/* at least half of the lanes are always left to the threads */
+	r->size = pop->lanes_desc.runtime_nlanes / 2;
+	if (r->size > TX_RECLAIM_QUEUE_MAX)
+		r->size = TX_RECLAIM_QUEUE_MAX;
+	if (r->size == 0) {
+		LOG(3, "too few lanes to free objects in the background");
+		Free(r);
+		return;
+	}
+
+	r->queue = Malloc(sizeof(uint64_t) * r->size);
+	r->batch = Malloc(sizeof(uint64_t) * r->size);
+	if (r->queue == NULL || r->batch == NULL) {
+		LOG(2, "!Malloc");
+		goto error_queue_malloc;
+	}
+
+	util_mutex_init(&r->lock, NULL);
+	int ret = pthread_cond_init(&r->cond, NULL);
+	if (ret != 0) {
+		errno = ret;
+		LOG(2, "!pthread_cond_init");
+		goto error_cond_init;
+	}
+
+	ret = pthread_cond_init(&r->idle, NULL);
+	if (ret != 0) {
+		errno = ret;
+		LOG(2, "!pthread_cond_init");
+		goto error_idle_init;
+	}
+
+	pop->tx_reclaim = r;
+
+	ret = pthread_create(&r->thread, NULL, tx_reclaim_worker, pop);
+	if (ret != 0) {
+		errno = ret;
+		LOG(2, "!pthread_create");
+		pop->tx_reclaim = NULL;
+		goto error_thread_create;
+	}
+
+	return;
+
+error_thread_create:
+	pthread_cond_destroy(&r->idle);
+error_idle_init:
+	pthread_cond_destroy(&r->cond);
+error_cond_init:
+	util_mutex_destroy(&r->lock);
+error_queue_malloc:
+	Free(r->batch);
+	Free(r->queue);
+	Free(r);
+}
+
+/*
+ * tx_reclaim_wait -- waits until the objects of all the lanes handed off to
+ *	the reclaimer are freed, returns 0 if there were none
+ *
+ * This lets an allocation which ran out of memory try again before failing.
+ */
+int
+tx_reclaim_wait(PMEMobjpool *pop)
+{
+	struct tx_reclaim *r = pop->tx_reclaim;
+	if (r == NULL)
+		return 0;
+
+	util_mutex_lock(&r->lock);
+
+	int waited = r->count != 0 || r->nbatch != 0;
+	while (r->count != 0 || r->nbatch != 0)
+		pthread_cond_wait(&r->idle, &r->lock);
+
+	util_mutex_unlock(&r->lock);
+
+	return waited;
+}
+
+/*
+ * tx_reclaim_stop -- frees the objects of all the lanes handed off to the
+ *	reclaimer and stops it
+ */
+void
+tx_reclaim_stop(PMEMobjpool *pop)
+{
+	struct tx_reclaim *r = pop->tx_reclaim;
+	if (r == NULL)
+		return;
+
+	util_mutex_lock(&r->lock);
+	r->stop = 1;
+	pthread_cond_signal(&r->cond);
+	util_mutex_unlock(&r->lock);
+
+	pthread_join(r->thread, NULL);
+
+	pthread_cond_destroy(&r->idle);
+	pthread_cond_destroy(&r->cond);
+	util_mutex_destroy(&r->lock);
+	Free(r->batch);
+	Free(r->queue);
+	Free(r);
+
+	pop->tx_reclaim = NULL;
+}
+
+/*
+ * With group commit enabled, the committed state of a transaction, which is
+ * what makes it durable, is stored by its thread but flushed by the leader of
+ * a group of the transactions of the pool committing at about the same time,
+ * and all of them are made durable by a single drain of the leader.
+ *
+ * A flush writes back the cache line no matter which thread stored to it,
+ * and the stores of the members are visible to the leader once they've
+ * joined the group under its lock. The undo logs and the memory modified by
+ * each transaction, which have to be durable before its state is set, are
+ * still drained by its own thread, because a drain only waits for the
+ * flushes of the thread executing it.
+ *
+ * The first member of a group becomes its leader once no other group is
+ * being flushed. It waits up to the configured time for more transactions to
+ * join, unless all the lanes of the pool already have, then flushes the
+ * group and wakes up its members. The transactions committed meanwhile form
+ * the next group.
+ */
+struct tx_group {
+	pthread_mutex_t lock;
+	pthread_cond_t durable_cond; /* signaled once a group is durable */
+	pthread_cond_t full_cond; /* signaled once the open group is full */
+	int leader; /* a group is being formed by a leader or flushed */
+
+	uint64_t open; /* sequence number of the group being formed */
+	uint64_t durable; /* sequence number of the last durable group */
+
+	/* the states of the transactions of the group being formed */
+	unsigned size;
+	unsigned count;
+	uint64_t **states;
+
+	/* the states of the group being flushed */
+	uint64_t **batch;
+};
+
+/*
+ * tx_group_lead -- (internal) waits for the group of the leader to grow,
+ *	then flushes it and wakes up its members, called and returns with
+ *	the lock of the group held
+ */
+static void
+tx_group_lead(PMEMobjpool *pop, struct tx_group *g)
+{
+	g->leader = 1;
+
+	if (Tx_group_wait > 0 && g->count < g->size) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		long long nsec = deadline.tv_nsec + Tx_group_wait * 1000;
+		deadline.tv_sec += (time_t)(nsec / 1000000000);
+		deadline.tv_nsec = (long)(nsec % 1000000000);
+
+		while (g->count < g->size) {
+			if (pthread_cond_timedwait(&g->full_cond, &g->lock,
+					&deadline) == ETIMEDOUT)
+				break;
+		}
+	}
+
+	uint64_t seq = g->open++;
+	unsigned n = g->count;
+	uint64_t **states = g->states;
+	g->states = g->batch;
+	g->batch = states;
+	g->count = 0;
+
+	util_mutex_unlock(&g->lock);
+
+	for (unsigned i = 0; i < n; ++i)
+		pmemops_flush(&pop->p_ops, states[i], sizeof(*states[i]));
+	pmemops_drain(&pop->p_ops);
+
+	LOG(4, "committed a group of %u transactions", n);
+
+	util_mutex_lock(&g->lock);
+
+	g->durable = seq;
+	g->leader = 0;
+	pthread_cond_broadcast(&g->durable_cond);
+}
+
+/*
+ * tx_group_commit -- (internal) sets the state of the transaction as
+ *	committed and waits for the group it joins to be made durable
+ */
+static void
+tx_group_commit(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	struct tx_group *g = pop->tx_group;
+
+	layout->state = TX_STATE_COMMITTED;
+
+	util_mutex_lock(&g->lock);
+
+	/* every member holds a different lane of the pool */
+	ASSERT(g->count < g->size);
+	uint64_t seq = g->open;
+	g->states[g->count++] = &layout->state;
+	if (g->count == g->size)
+		pthread_cond_signal(&g->full_cond);
+
+	while (g->durable < seq) {
+		if (!g->leader && g->open == seq)
+			tx_group_lead(pop, g);
+		else
+			pthread_cond_wait(&g->durable_cond, &g->lock);
+	}
+
+	util_mutex_unlock(&g->lock);
+}
+
+/*
+ * tx_group_start -- prepares the transactions of the pool to be committed in
+ *	groups, if enabled
+ *
+ * If that fails, every transaction is committed on its own.
+ */
+void
+tx_group_start(PMEMobjpool *pop)
+{
+	if (Tx_group_wait < 0)
+		return;
+
+	struct tx_group *g = Zalloc(sizeof(*g));
+	if (g == NULL) {
+		LOG(2, "!Zalloc");
+		return;
+	}
+
+	/* the sequence number of the first group */
+	g->open = 1;
+
+	g->size = pop->lanes_desc.runtime_nlanes;
+	g->states = Malloc(sizeof(uint64_t *) * g->size);
+	g->batch = Malloc(sizeof(uint64_t *) * g->size);
+	if (g->states == NULL || g->batch == NULL) {
+		LOG(2, "!Malloc");
+		goto error_states_malloc;
+	}
+
+	util_mutex_init(&g->lock, NULL);
+	int ret = pthread_cond_init(&g->durable_cond, NULL);
+	if (ret != 0) {
+		errno = ret;
+		LOG(2, "!pthread_cond_init");
+		goto error_durable_init;
+	}
+
+	ret = pthread_cond_init(&g->full_cond, NULL);
+	if (ret != 0) {
+		errno = ret;
+		LOG(2, "!pthread_cond_init");
+		goto error_full_init;
+	}
+
+	pop->tx_group = g;
+
+	return;
+
+error_full_init:
+	pthread_cond_destroy(&g->durable_cond);
+error_durable_init:
+	util_mutex_destroy(&g->lock);
+error_states_malloc:
+	Free(g->batch);
+	Free(g->states);
+	Free(g);
+}
+
+/*
+ * tx_group_stop -- stops committing the transactions of the pool in groups
+ */
+void
+tx_group_stop(PMEMobjpool *pop)
+{
+	struct tx_group *g = pop->tx_group;
+	if (g == NULL)
+		return;
+
+	pthread_cond_destroy(&g->full_cond);
+	pthread_cond_destroy(&g->durable_cond);
+	util_mutex_destroy(&g->lock);
+	Free(g->batch);
+	Free(g->states);
+	Free(g);
+
+	pop->tx_group = NULL;
 }
 
 #ifdef USE_VG_MEMCHECK
@@ -887,6 +1953,11 @@ tx_abort(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
 	tx_abort_alloc(pop, tx_rt);
 	tx_abort_free(pop, tx_rt);
 
+	/*
+	 * The deferred writes are simply discarded, the redo log isn't valid
+	 * unless the transaction has been committed.
+	 */
+
 	if (recovery)
 		tx_destroy_undo_runtime(tx_rt);
 }
@@ -895,28 +1966,32 @@ tx_abort(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
  * add_to_tx_and_lock -- (internal) add lock to the transaction and acquire it
  */
 static int
-add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_lock type,
-	void *lock)
+add_to_tx_and_lock(PMEMobjpool *pop, enum pobj_tx_lock type, void *lock)
 {
 	LOG(15, NULL);
 	int retval = 0;
 	struct tx_lock_data *txl;
 	/* check if the lock is already on the list */
-	SLIST_FOREACH(txl, &(lane->tx_locks), tx_lock) {
+	SLIST_FOREACH(txl, &tx.tx_locks, tx_lock) {
 		if (memcmp(&txl->lock, &lock, sizeof(lock)) == 0)
 			return 0;
 	}
 
-	txl = Malloc(sizeof(*txl));
-	if (txl == NULL)
-		return ENOMEM;
+	txl = SLIST_FIRST(&tx.tx_locks_cache);
+	if (txl != NULL) {
+		SLIST_REMOVE_HEAD(&tx.tx_locks_cache, tx_lock);
+	} else {
+		txl = Malloc(sizeof(*txl));
+		if (txl == NULL)
+			return ENOMEM;
+	}
 
 	txl->lock_type = type;
+	txl->pop = pop;
 	switch (txl->lock_type) {
 		case TX_LOCK_MUTEX:
 			txl->lock.mutex = lock;
-			retval = pmemobj_mutex_lock(lane->pop,
-				txl->lock.mutex);
+			retval = pmemobj_mutex_lock(pop, txl->lock.mutex);
 			if (retval) {
 				errno = retval;
 				ERR("!pmemobj_mutex_lock");
@@ -924,8 +1999,7 @@ add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_lock type,
 			break;
 		case TX_LOCK_RWLOCK:
 			txl->lock.rwlock = lock;
-			retval = pmemobj_rwlock_wrlock(lane->pop,
-				txl->lock.rwlock);
+			retval = pmemobj_rwlock_wrlock(pop, txl->lock.rwlock);
 			if (retval) {
 				errno = retval;
 				ERR("!pmemobj_rwlock_wrlock");
@@ -937,7 +2011,7 @@ add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_lock type,
 			break;
 	}
 
-	SLIST_INSERT_HEAD(&lane->tx_locks, txl, tx_lock);
+	SLIST_INSERT_HEAD(&tx.tx_locks, txl, tx_lock);
 
 	return retval;
 }
@@ -947,20 +2021,20 @@ add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_lock type,
  *				transaction
  */
 static void
-release_and_free_tx_locks(struct lane_tx_runtime *lane)
+release_and_free_tx_locks(void)
 {
 	LOG(15, NULL);
 
-	while (!SLIST_EMPTY(&lane->tx_locks)) {
-		struct tx_lock_data *tx_lock = SLIST_FIRST(&lane->tx_locks);
-		SLIST_REMOVE_HEAD(&lane->tx_locks, tx_lock);
+	while (!SLIST_EMPTY(&tx.tx_locks)) {
+		struct tx_lock_data *tx_lock = SLIST_FIRST(&tx.tx_locks);
+		SLIST_REMOVE_HEAD(&tx.tx_locks, tx_lock);
 		switch (tx_lock->lock_type) {
 			case TX_LOCK_MUTEX:
-				pmemobj_mutex_unlock(lane->pop,
+				pmemobj_mutex_unlock(tx_lock->pop,
 					tx_lock->lock.mutex);
 				break;
 			case TX_LOCK_RWLOCK:
-				pmemobj_rwlock_unlock(lane->pop,
+				pmemobj_rwlock_unlock(tx_lock->pop,
 					tx_lock->lock.rwlock);
 				break;
 			default:
@@ -968,48 +2042,151 @@ release_and_free_tx_locks(struct lane_tx_runtime *lane)
 				ASSERT(0);
 				break;
 		}
-		Free(tx_lock);
+		SLIST_INSERT_HEAD(&tx.tx_locks_cache, tx_lock, tx_lock);
 	}
 }
 
 /*
- * tx_alloc_common -- (internal) common function for alloc and zalloc
+ * tx_part_find -- (internal) returns the entry of the pool in the set of the
+ *	pools of the transaction, or NULL if it doesn't take part in it
  */
-static PMEMoid
-tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor)
+static struct tx_part *
+tx_part_find(PMEMobjpool *pop)
 {
-	LOG(3, NULL);
-
-	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
-		ERR("requested size too large");
-		return obj_tx_abort_null(ENOMEM);
+	for (unsigned i = 0; i < tx.nparts; ++i) {
+		if (tx.parts[i].pop == pop)
+			return &tx.parts[i];
 	}
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
-
-	uint64_t *entry_offset = pvector_push_back(lane->undo.ctx[UNDO_ALLOC]);
-	if (entry_offset == NULL) {
-		ERR("allocation undo log too large");
-		return obj_tx_abort_null(ENOMEM);
-	}
+	return NULL;
+}
 
-	struct tx_alloc_args args = {
-		.type_num = type_num,
-		.entry_offset = (uint64_t)entry_offset,
-	};
+/*
+ * tx_part_switch -- (internal) makes the pool the current one of the
+ *	transaction, which the functions processing the lane operate on
+ */
+static void
+tx_part_switch(struct tx_part *part)
+{
+	tx.pop = part->pop;
+	tx.section = part->section;
+}
+
+/*
+ * tx_lane -- (internal) returns the lane of the current transaction, which is
+ *	acquired when the transaction modifies the pool for the first time
+ *
+ * Returns NULL if the runtime state of the lane cannot be initialized.
+ */
+static struct lane_tx_runtime *
+tx_lane(void)
+{
+	if (tx.section != NULL)
+		return tx.section->runtime;
+
+	PMEMobjpool *pop = tx.pop;
+	struct lane_section *section;
+	lane_hold(pop, &section, LANE_SECTION_TRANSACTION);
+
+	struct lane_tx_runtime *lane = section->runtime;
+	lane->ranges.nranges = 0;
+	lane->flush.nranges = 0;
+	lane->persisted.nranges = 0;
+	lane->redo.size = 0;
+	lane->cache_offset = 0;
+
+	/* the tree is emptied at the end of every transaction */
+	if (lane->allocs == NULL && (lane->allocs = ctree_new()) == NULL) {
+		ERR("!ctree_new");
+		lane_release(pop);
+		return NULL;
+	}
+
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)section->layout;
+	if (tx_rebuild_undo_runtime(pop, layout, &lane->undo) != 0) {
+		lane_release(pop);
+		return NULL;
+	}
+
+	lane->pop = pop;
+	tx.section = section;
+	tx_part_find(pop)->section = section;
+
+	return lane;
+}
+
+/*
+ * tx_alloc_entry -- (internal) returns the undo log entry of the object if it
+ *	was allocated within the current transaction, NULL otherwise
+ */
+static uint64_t *
+tx_alloc_entry(struct lane_tx_runtime *lane, uint64_t off)
+{
+	uint64_t key = off;
+	uint64_t entry = ctree_find_le_unlocked(lane->allocs, &key);
+
+	return key == off ? (uint64_t *)entry : NULL;
+}
+
+/*
+ * tx_alloc_common -- (internal) common function for alloc and zalloc
+ */
+static PMEMoid
+tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor,
+	unsigned class_id, size_t alignment)
+{
+	LOG(3, NULL);
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		return obj_tx_abort_null(ENOMEM);
+	}
+
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_null(ENOMEM);
+
+	uint64_t *entry_offset = pvector_push_back(lane->undo.ctx[UNDO_ALLOC]);
+	if (entry_offset == NULL) {
+		ERR("allocation undo log too large");
+		return obj_tx_abort_null(ENOMEM);
+	}
+
+	struct tx_alloc_args args = {
+		.type_num = type_num,
+	};
 
 	/* allocate object to undo log */
 	PMEMoid retoid = OID_NULL;
 
-	pmalloc_construct(lane->pop, entry_offset,
-		size + OBJ_OOB_SIZE, constructor, &args);
+	struct redo_log *redo = pmalloc_redo_hold(lane->pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, lane->pop, lane->pop->redo, redo);
+
+	int ret = pmalloc_operation(&lane->pop->heap, 0, entry_offset,
+		size + OBJ_OOB_SIZE, constructor, &args, &ctx,
+		class_id, alignment);
+
+	pmalloc_redo_release(lane->pop);
 
 	retoid.off = *entry_offset;
 	retoid.pool_uuid_lo = lane->pop->uuid_lo;
 
-	if (OBJ_OID_IS_NULL(retoid) ||
-		ctree_insert_unlocked(lane->ranges, retoid.off, size) != 0)
+	if (ret != 0 && errno == EINVAL) {
+		pvector_pop_back(lane->undo.ctx[UNDO_ALLOC], NULL);
+
+		ERR("invalid allocation class %u for size %zu",
+			class_id, size);
+		return obj_tx_abort_null(EINVAL);
+	}
+
+	if (ret != 0 || OBJ_OID_IS_NULL(retoid) ||
+		tx_range_set_add(&lane->ranges, retoid.off, retoid.off + size,
+			NULL, NULL) != 0 ||
+		ctree_insert_unlocked(lane->allocs, retoid.off,
+			(uint64_t)entry_offset) != 0)
 		goto err_oom;
 
 	return retoid;
@@ -1035,8 +2212,9 @@ tx_alloc_copy_common(size_t size, type_num_t type_num, const void *ptr,
 		return obj_tx_abort_null(ENOMEM);
 	}
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_null(ENOMEM);
 
 	uint64_t *entry_offset = pvector_push_back(lane->undo.ctx[UNDO_ALLOC]);
 	if (entry_offset == NULL) {
@@ -1047,11 +2225,11 @@ tx_alloc_copy_common(size_t size, type_num_t type_num, const void *ptr,
 	struct tx_alloc_copy_args args = {
 		.super = {
 			.type_num = type_num,
-			.entry_offset = (uint64_t)entry_offset,
 		},
 		.size = size,
 		.ptr = ptr,
 		.copy_size = copy_size,
+		.persisted = 0,
 	};
 
 	/* allocate object to undo log */
@@ -1063,9 +2241,17 @@ tx_alloc_copy_common(size_t size, type_num_t type_num, const void *ptr,
 	retoid.pool_uuid_lo = lane->pop->uuid_lo;
 
 	if (ret || OBJ_OID_IS_NULL(retoid) ||
-		ctree_insert_unlocked(lane->ranges, retoid.off, size) != 0)
+		tx_range_set_add(&lane->ranges, retoid.off, retoid.off + size,
+			NULL, NULL) != 0 ||
+		ctree_insert_unlocked(lane->allocs, retoid.off,
+			(uint64_t)entry_offset) != 0)
 		goto err_oom;
 
+	/* without the range the object is just flushed as a whole */
+	if (args.persisted)
+		(void) tx_range_set_add(&lane->persisted, retoid.off,
+			retoid.off + copy_size, NULL, NULL);
+
 	return retoid;
 
 err_oom:
@@ -1090,13 +2276,14 @@ tx_realloc_common(PMEMoid oid, size_t size, uint64_t type_num,
 		return obj_tx_abort_null(ENOMEM);
 	}
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_null(ENOMEM);
 
 	/* if oid is NULL just alloc */
 	if (OBJ_OID_IS_NULL(oid))
 		return tx_alloc_common(size, (type_num_t)type_num,
-				constructor_alloc);
+				constructor_alloc, 0, 0);
 
 	ASSERT(OBJ_OID_IS_VALID(lane->pop, oid));
 
@@ -1132,6 +2319,34 @@ tx_realloc_common(PMEMoid oid, size_t size, uint64_t type_num,
 	return new_obj;
 }
 
+/*
+ * tx_part_add -- (internal) returns the entry of the pool of a nested
+ *	transaction, adding it to the pools of the transaction if it's not
+ *	there yet
+ */
+static struct tx_part *
+tx_part_add(PMEMobjpool *pop)
+{
+	struct tx_part *part = tx_part_find(pop);
+	if (part == NULL) {
+		if (pop == NULL || pmemobj_pool_by_ptr(pop) != pop) {
+			ERR("nested transaction for invalid pool");
+			return NULL;
+		}
+
+		if (tx.nparts == TX_MULTI_MAX_POOLS) {
+			ERR("too many pools in a transaction");
+			return NULL;
+		}
+
+		part = &tx.parts[tx.nparts++];
+		part->pop = pop;
+		part->section = NULL;
+	}
+
+	return part;
+}
+
 /*
  * pmemobj_tx_begin -- initializes new transaction
  */
@@ -1140,66 +2355,71 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 {
 	LOG(3, NULL);
 
+	USDT_PROBE2(libpmemobj, tx_begin, pop, tx.stage == TX_STAGE_WORK);
+
 	int err = 0;
+	struct tx_part *part = NULL;
 
-	struct lane_tx_runtime *lane = NULL;
 	if (tx.stage == TX_STAGE_WORK) {
-		lane = tx.section->runtime;
-		if (lane->pop != pop) {
-			ERR("nested transaction for different pool");
+		if (tx.pop != pop && (part = tx_part_add(pop)) == NULL)
 			return obj_tx_abort_err(EINVAL);
-		}
 
 		VALGRIND_START_TX;
 	} else if (tx.stage == TX_STAGE_NONE) {
 		VALGRIND_START_TX;
 
-		lane_hold(pop, &tx.section, LANE_SECTION_TRANSACTION);
-
-		lane = tx.section->runtime;
-		SLIST_INIT(&lane->tx_entries);
-		SLIST_INIT(&lane->tx_locks);
-		lane->ranges = ctree_new();
-		lane->cache_slot = 0;
-
-		struct lane_tx_layout *layout =
-			(struct lane_tx_layout *)tx.section->layout;
-
-		if (tx_rebuild_undo_runtime(pop, layout, &lane->undo) != 0) {
-			tx.stage = TX_STAGE_ONABORT;
-			err = errno;
-			return err;
-		}
-
-		lane->pop = pop;
+		/* the lane is acquired only when the pool is first modified */
+		tx.pop = pop;
+		tx.section = NULL;
+		tx.parts[0].pop = pop;
+		tx.parts[0].section = NULL;
+		tx.nparts = 1;
+		tx.epoch++;
+		SLIST_INIT(&tx.tx_entries);
+		SLIST_INIT(&tx.tx_locks);
+
+		if (unlikely(pthread_getspecific(Tx_cache_key) == NULL))
+			tx_cache_register();
 	} else {
 		FATAL("Invalid stage %d to begin new transaction", tx.stage);
 	}
 
-	struct tx_data *txd = Malloc(sizeof(*txd));
-	if (txd == NULL) {
+	struct tx_data *txd = SLIST_FIRST(&tx.tx_entries_cache);
+	if (txd != NULL) {
+		SLIST_REMOVE_HEAD(&tx.tx_entries_cache, tx_entry);
+	} else if ((txd = Malloc(sizeof(*txd))) == NULL) {
 		err = errno;
 		ERR("!Malloc");
 		goto err_abort;
 	}
 
 	tx.last_errnum = 0;
-	if (env != NULL)
+	txd->pop = pop;
+	txd->has_env = env != NULL;
+	if (txd->has_env)
 		memcpy(txd->env, env, sizeof(jmp_buf));
-	else
-		memset(txd->env, 0, sizeof(jmp_buf));
 
-	SLIST_INSERT_HEAD(&lane->tx_entries, txd, tx_entry);
+	SLIST_INSERT_HEAD(&tx.tx_entries, txd, tx_entry);
+
+	/* the pool of the outer transaction is restored when this one ends */
+	if (part != NULL)
+		tx_part_switch(part);
 
 	tx.stage = TX_STAGE_WORK;
 
+	if (unlikely(pop->rdonly)) {
+		ERR("cannot modify a read-only pool");
+		err = EROFS;
+		goto err_abort;
+	}
+
 	/* handle locks */
 	va_list argp;
 	va_start(argp, env);
 	enum pobj_tx_lock lock_type;
 
 	while ((lock_type = va_arg(argp, enum pobj_tx_lock)) != TX_LOCK_NONE) {
-		err = add_to_tx_and_lock(lane, lock_type, va_arg(argp, void *));
+		err = add_to_tx_and_lock(pop, lock_type, va_arg(argp, void *));
 		if (err) {
 			va_end(argp);
 			goto err_abort;
@@ -1227,9 +2447,7 @@ pmemobj_tx_lock(enum pobj_tx_lock type, void *lockp)
 	ASSERT_IN_TX();
 	ASSERT_TX_STAGE_WORK();
 
-	struct lane_tx_runtime *lane = tx.section->runtime;
-
-	return add_to_tx_and_lock(lane, type, lockp);
+	return add_to_tx_and_lock(tx.pop, type, lockp);
 }
 
 /*
@@ -1243,6 +2461,18 @@ pmemobj_tx_stage()
 	return tx.stage;
 }
 
+/*
+ * pmemobj_tx_epoch -- returns the number identifying the snapshotted ranges
+ *	of the current transaction
+ */
+uint64_t
+pmemobj_tx_epoch(void)
+{
+	LOG(3, NULL);
+
+	return tx.stage == TX_STAGE_WORK ? tx.epoch : 0;
+}
+
 /*
  * obj_tx_abort -- aborts current transaction
  */
@@ -1254,23 +2484,32 @@ obj_tx_abort(int errnum, int user)
 	ASSERT_IN_TX();
 	ASSERT_TX_STAGE_WORK();
 
-	ASSERT(tx.section != NULL);
-
 	if (errnum == 0)
 		errnum = ECANCELED;
 
+	USDT_PROBE2(libpmemobj, tx_abort, tx.pop, errnum);
+
 	tx.stage = TX_STAGE_ONABORT;
-	struct lane_tx_runtime *lane = tx.section->runtime;
-	struct tx_data *txd = SLIST_FIRST(&lane->tx_entries);
+	struct tx_data *txd = SLIST_FIRST(&tx.tx_entries);
 
 	if (SLIST_NEXT(txd, tx_entry) == NULL) {
 		/* this is the outermost transaction */
 
-		struct lane_tx_layout *layout =
+		for (unsigned i = 0; i < tx.nparts; ++i) {
+			/* a read-only pool has nothing to roll back */
+			if (tx.parts[i].section == NULL)
+				continue;
+
+			tx_part_switch(&tx.parts[i]);
+
+			struct lane_tx_layout *layout =
 				(struct lane_tx_layout *)tx.section->layout;
 
-		/* process the undo log */
-		tx_abort(lane->pop, layout, 0 /* abort */);
+			/* process the undo log */
+			tx_abort(tx.pop, layout, 0 /* abort */);
+		}
+
+		tx_part_switch(tx_part_find(txd->pop));
 	}
 
 	tx.last_errnum = errnum;
@@ -1278,7 +2517,7 @@ obj_tx_abort(int errnum, int user)
 	if (user)
 		ERR("!explicit transaction abort");
 
-	if (!util_is_zeroed(txd->env, sizeof(jmp_buf)))
+	if (txd->has_env)
 		longjmp(txd->env, errnum);
 }
 
@@ -1304,6 +2543,176 @@ pmemobj_tx_errno(void)
 	return tx.last_errnum;
 }
 
+/*
+ * tx_commit_lane -- (internal) commits the transaction which modified only
+ *	the given pool
+ */
+static void
+tx_commit_lane(struct tx_part *part)
+{
+	tx_part_switch(part);
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)tx.section->layout;
+	PMEMobjpool *pop = lane->pop;
+
+	/* pre-commit phase */
+	tx_pre_commit(pop, lane);
+	tx_pre_commit_redo(pop, layout, &lane->redo);
+
+	pmemops_drain(&pop->p_ops);
+
+	USDT_PROBE1(libpmemobj, tx_commit_durable, pop);
+
+	/* set transaction state as committed */
+	if (pop->tx_group != NULL)
+		tx_group_commit(pop, layout);
+	else
+		tx_set_state(pop, layout, TX_STATE_COMMITTED);
+
+	/* post commit phase */
+	lane->free_deferred =
+		tx_post_commit(pop, layout, 0 /* not recovery */);
+
+	/* clear transaction state, unless left to the reclaimer */
+	if (!lane->free_deferred)
+		tx_set_state(pop, layout, TX_STATE_NONE);
+}
+
+/*
+ * tx_lane_idx -- (internal) returns the index of the lane of the section
+ */
+static uint64_t
+tx_lane_idx(PMEMobjpool *pop, struct lane_section *section)
+{
+	char *lanes = (char *)pop + pop->lanes_offset;
+
+	return (uint64_t)((char *)section->layout - lanes) /
+		sizeof(struct lane_layout);
+}
+
+/*
+ * tx_commit_multi -- (internal) commits the transaction which modified more
+ *	than one pool
+ *
+ * The lanes of all of the pools are flushed and enter the prepared state,
+ * referring to the commit record of the pool with the lowest uuid, and all of
+ * them are made durable with a single drain of each pool. The transaction is
+ * then committed in all of them at once by a single persist of the record.
+ *
+ * Returns EBUSY, before anything is written, if the record is still kept by
+ * the lane of the coordinating pool after a failure, see tx_multi_recover.
+ */
+static int
+tx_commit_multi(struct tx_part **parts, unsigned nparts)
+{
+	struct tx_part *coord = parts[0];
+	for (unsigned i = 1; i < nparts; ++i) {
+		if (parts[i]->pop->uuid_lo < coord->pop->uuid_lo)
+			coord = parts[i];
+	}
+
+	PMEMobjpool *cpop = coord->pop;
+	struct tx_multi_record *rec =
+		&((struct lane_tx_layout *)coord->section->layout)->multi;
+
+	util_mutex_lock(&Tx_multi_lock);
+	uint64_t id = 0;
+	if (rec->id == 0) {
+		/* unique across the runs of the coordinating pool */
+		id = cpop->run_id << 32 | (++Tx_multi_count & UINT32_MAX);
+		rec->id = id;
+	}
+	util_mutex_unlock(&Tx_multi_lock);
+
+	if (id == 0) {
+		ERR("lane of pool %p keeps an unresolved commit record", cpop);
+		return EBUSY;
+	}
+
+	/* pre-commit phase */
+	unsigned nrefs = 0;
+	for (unsigned i = 0; i < nparts; ++i) {
+		tx_part_switch(parts[i]);
+
+		struct lane_tx_runtime *lane = tx.section->runtime;
+		struct lane_tx_layout *layout =
+			(struct lane_tx_layout *)tx.section->layout;
+
+		tx_pre_commit(tx.pop, lane);
+		tx_pre_commit_redo(tx.pop, layout, &lane->redo);
+
+		if (parts[i] == coord)
+			continue;
+
+		rec->parts[nrefs++] = tx.pop->uuid_lo;
+
+		layout->coord.uuid_lo = cpop->uuid_lo;
+		layout->coord.lane = tx_lane_idx(cpop, coord->section);
+		layout->coord.id = id;
+		pmemops_flush(&tx.pop->p_ops, &layout->coord,
+			sizeof(layout->coord));
+
+		layout->state = TX_STATE_PREPARED;
+		pmemops_flush(&tx.pop->p_ops, &layout->state,
+			sizeof(layout->state));
+	}
+
+	while (nrefs < TX_MULTI_MAX_POOLS - 1)
+		rec->parts[nrefs++] = 0;
+	pmemops_flush(&cpop->p_ops, rec, sizeof(*rec));
+
+	for (unsigned i = 0; i < nparts; ++i)
+		pmemops_drain(&parts[i]->pop->p_ops);
+
+	USDT_PROBE1(libpmemobj, tx_commit_durable, cpop);
+
+	/* the transaction is now committed in all of the pools */
+	rec->committed = id;
+	pmemops_persist(&cpop->p_ops, &rec->committed, sizeof(rec->committed));
+
+	/* the record can be cleared once none of the lanes refers to it */
+	for (unsigned i = 0; i < nparts; ++i) {
+		struct lane_tx_layout *layout =
+			(struct lane_tx_layout *)parts[i]->section->layout;
+
+		layout->state = TX_STATE_COMMITTED;
+		pmemops_flush(&parts[i]->pop->p_ops, &layout->state,
+			sizeof(layout->state));
+	}
+
+	for (unsigned i = 0; i < nparts; ++i)
+		pmemops_drain(&parts[i]->pop->p_ops);
+
+	rec->id = 0;
+	pmemops_persist(&cpop->p_ops, &rec->id, sizeof(rec->id));
+
+	/* post commit phase */
+	for (unsigned i = 0; i < nparts; ++i) {
+		tx_part_switch(parts[i]);
+
+		struct lane_tx_runtime *lane = tx.section->runtime;
+		struct lane_tx_layout *layout =
+			(struct lane_tx_layout *)tx.section->layout;
+
+		if (parts[i] != coord) {
+			layout->coord.id = 0;
+			pmemops_flush(&tx.pop->p_ops, &layout->coord.id,
+				sizeof(layout->coord.id));
+		}
+
+		lane->free_deferred =
+			tx_post_commit(tx.pop, layout, 0 /* not recovery */);
+
+		if (!lane->free_deferred)
+			tx_set_state(tx.pop, layout, TX_STATE_NONE);
+	}
+
+	return 0;
+}
+
 /*
  * pmemobj_tx_commit -- commits current transaction
  */
@@ -1315,35 +2724,79 @@ pmemobj_tx_commit()
 	ASSERT_IN_TX();
 	ASSERT_TX_STAGE_WORK();
 
-	ASSERT(tx.section != NULL);
+	struct tx_data *txd = SLIST_FIRST(&tx.tx_entries);
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
-	struct tx_data *txd = SLIST_FIRST(&lane->tx_entries);
+	USDT_PROBE1(libpmemobj, tx_commit, tx.pop);
 
 	if (SLIST_NEXT(txd, tx_entry) == NULL) {
 		/* this is the outermost transaction */
 
-		struct lane_tx_layout *layout =
-			(struct lane_tx_layout *)tx.section->layout;
-		PMEMobjpool *pop = lane->pop;
+		/* only the pools which were modified have to be committed */
+		struct tx_part *parts[TX_MULTI_MAX_POOLS];
+		unsigned nparts = 0;
+		for (unsigned i = 0; i < tx.nparts; ++i) {
+			if (tx.parts[i].section != NULL)
+				parts[nparts++] = &tx.parts[i];
+		}
 
-		/* pre-commit phase */
-		tx_pre_commit(pop, &lane->undo);
+		if (nparts == 1) {
+			tx_commit_lane(parts[0]);
+		} else if (nparts > 1) {
+			int err = tx_commit_multi(parts, nparts);
+			if (err != 0) {
+				obj_tx_abort(err, 0);
+				return;
+			}
+		}
 
-		pmemops_drain(&pop->p_ops);
+		tx_part_switch(tx_part_find(txd->pop));
+	}
 
-		/* set transaction state as committed */
-		tx_set_state(pop, layout, TX_STATE_COMMITTED);
+	USDT_PROBE1(libpmemobj, tx_commit_done, tx.pop);
 
-		/* post commit phase */
-		tx_post_commit(pop, layout, 0 /* not recovery */);
+	tx.stage = TX_STAGE_ONCOMMIT;
+}
 
-		/* clear transaction state */
-		tx_set_state(pop, layout, TX_STATE_NONE);
-	}
+/*
+ * tx_end_lane -- (internal) cleans up the runtime state of the lane of the
+ *	outermost transaction and releases it
+ */
+static void
+tx_end_lane(struct lane_section *section)
+{
+	struct lane_tx_runtime *lane = section->runtime;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)section->layout;
 
-	tx.stage = TX_STAGE_ONCOMMIT;
+	/* cleanup cache */
+	lane->ranges.nranges = 0;
+	lane->flush.nranges = 0;
+	lane->persisted.nranges = 0;
+	while (!ctree_is_empty_unlocked(lane->allocs))
+		ctree_remove_unlocked(lane->allocs, 0, 0);
+	lane->cache_offset = 0;
+
+	/*
+	 * The transaction state and undo log should be clear, except
+	 * for the objects freed, if they're left to the reclaimer.
+	 */
+	uint64_t state = lane->free_deferred ?
+		TX_STATE_COMMITTED : TX_STATE_NONE;
+	ASSERTeq(layout->state, state);
+	if (layout->state != state)
+		LOG(2, "invalid transaction state");
+
+	ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_ALLOC]), 0);
+	ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_SET]), 0);
+	ASSERT(lane->free_deferred ||
+		pvector_nvalues(lane->undo.ctx[UNDO_FREE]) == 0);
+
+	if (lane->free_deferred) {
+		lane->free_deferred = 0;
+		tx_reclaim_push(lane->pop, section);
+	} else {
+		lane_release(lane->pop);
+	}
 }
 
 /*
@@ -1357,44 +2810,36 @@ pmemobj_tx_end()
 	if (tx.stage == TX_STAGE_WORK)
 		FATAL("pmemobj_tx_end called without pmemobj_tx_commit");
 
-	if (tx.section == NULL)
+	if (tx.pop == NULL)
 		FATAL("pmemobj_tx_end called without pmemobj_tx_begin");
 
-	struct lane_tx_runtime *lane = tx.section->runtime;
-	struct tx_data *txd = SLIST_FIRST(&lane->tx_entries);
-	SLIST_REMOVE_HEAD(&lane->tx_entries, tx_entry);
+	USDT_PROBE2(libpmemobj, tx_end, tx.pop, tx.last_errnum);
+
+	struct tx_data *txd = SLIST_FIRST(&tx.tx_entries);
+	SLIST_REMOVE_HEAD(&tx.tx_entries, tx_entry);
 
-	Free(txd);
+	SLIST_INSERT_HEAD(&tx.tx_entries_cache, txd, tx_entry);
 
 	VALGRIND_END_TX;
 
-	if (SLIST_EMPTY(&lane->tx_entries)) {
+	if (SLIST_EMPTY(&tx.tx_entries)) {
 		/* this is the outermost transaction */
-		struct lane_tx_layout *layout =
-			(struct lane_tx_layout *)tx.section->layout;
-
-		/* cleanup cache */
-		ctree_delete(lane->ranges);
-		lane->cache_slot = 0;
-
-		/* the transaction state and undo log should be clear */
-		ASSERTeq(layout->state, TX_STATE_NONE);
-		if (layout->state != TX_STATE_NONE)
-			LOG(2, "invalid transaction state");
+		tx.stage = TX_STAGE_NONE;
+		release_and_free_tx_locks();
 
-		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_ALLOC]), 0);
-		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_SET]), 0);
-		ASSERTeq(pvector_nvalues(lane->undo.ctx[UNDO_FREE]), 0);
-		ASSERT(pvector_nvalues(lane->undo.ctx[UNDO_FREE]) == 0 ||
-			pvector_nvalues(lane->undo.ctx[UNDO_FREE]) == 1);
+		/* the lanes of the read-only pools were never acquired */
+		for (unsigned i = 0; i < tx.nparts; ++i) {
+			if (tx.parts[i].section != NULL)
+				tx_end_lane(tx.parts[i].section);
+		}
 
-		tx.stage = TX_STAGE_NONE;
-		release_and_free_tx_locks(lane);
-		lane_release(lane->pop);
+		tx.nparts = 0;
 		tx.section = NULL;
+		tx.pop = NULL;
 	} else {
 		/* resume the next transaction */
 		tx.stage = TX_STAGE_WORK;
+		tx_part_switch(tx_part_find(SLIST_FIRST(&tx.tx_entries)->pop));
 
 		/* abort called within inner transaction, waterfall the error */
 		if (tx.last_errnum)
@@ -1413,7 +2858,7 @@ pmemobj_tx_process()
 	LOG(3, NULL);
 
 	ASSERT_IN_TX();
-	ASSERTne(tx.section, NULL);
+	ASSERTne(tx.pop, NULL);
 
 	switch (tx.stage) {
 	case TX_STAGE_NONE:
@@ -1463,7 +2908,320 @@ pmemobj_tx_add_large(struct tx_add_range_args *args)
  * constructor_tx_range_cache -- (internal) cache constructor
  */
 static int
-constructor_tx_range_cache(void *ctx, void *ptr, size_t usable_size, void *arg)
+constructor_tx_range_cache(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	LOG(3, NULL);
+	PMEMobjpool *pop = ctx;
+	const struct pmem_ops *p_ops = &pop->p_ops;
+
+	ASSERTne(ptr, NULL);
+
+	ASSERT(usable_size > sizeof(struct tx_range_cache));
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	/* temporarily add the object copy to the transaction */
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE + usable_size);
+
+	/* the cache header directly follows the object header */
+	struct tx_range_cache *cache = ptr;
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	cache->capacity = usable_size - sizeof(struct tx_range_cache);
+	cache->unused = 0;
+	pmemops_flush(p_ops, &oobh->size, OBJ_OOB_SIZE -
+		offsetof(struct oob_header, size) +
+		sizeof(struct tx_range_cache));
+
+	pmemops_memset_persist(p_ops, cache->data, 0, cache->capacity);
+
+	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE + usable_size);
+
+	return 0;
+}
+
+/*
+ * pmemobj_tx_get_range_cache -- (internal) returns a cache which has enough
+ *	free space for a snapshot of the given size
+ */
+static struct tx_range_cache *
+pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo,
+	size_t size)
+{
+	uint64_t last_cache = pvector_last(undo);
+	struct lane_tx_runtime *runtime = tx.section->runtime;
+
+	struct tx_range_cache *cache = NULL;
+	/* get the last element from the caches list */
+	if (last_cache != 0)
+		cache = OBJ_OFF_TO_PTR(pop, last_cache);
+
+	/* verify if the cache exists and has enough free space */
+	if (cache == NULL || runtime->cache_offset +
+			TX_RANGE_ENTRY_SIZE(size) > cache->capacity) {
+		/*
+		 * Allocate a new cache, twice as large as the previous one,
+		 * so that transactions which snapshot a lot of small ranges
+		 * don't need too many allocations.
+		 */
+		size_t cache_size = TX_RANGE_CACHE_SIZE;
+		if (cache != NULL) {
+			cache_size = 2 * (sizeof(struct tx_range_cache) +
+				cache->capacity);
+			if (cache_size > TX_RANGE_CACHE_MAX_SIZE)
+				cache_size = TX_RANGE_CACHE_MAX_SIZE;
+		}
+
+		uint64_t *entry = pvector_push_back(undo);
+		if (entry == NULL) {
+			ERR("cache set undo log too large");
+			return NULL;
+		}
+		int err = pmalloc_construct(pop, entry,
+			cache_size + OBJ_OOB_SIZE,
+			constructor_tx_range_cache, NULL);
+
+		if (err != 0) {
+			pvector_pop_back(undo, NULL);
+			return NULL;
+		}
+
+		cache = OBJ_OFF_TO_PTR(pop, *entry);
+
+		/* since the cache is new, we start from its beginning */
+		runtime->cache_offset = 0;
+	}
+
+	return cache;
+}
+
+/*
+ * pmemobj_tx_add_small -- (internal) adds small memory range to undo log cache
+ */
+static int
+pmemobj_tx_add_small(struct tx_add_range_args *args)
+{
+	PMEMobjpool *pop = args->pop;
+
+	struct lane_tx_runtime *runtime = tx.section->runtime;
+	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET_CACHE];
+	const struct pmem_ops *p_ops = &pop->p_ops;
+
+	struct tx_range_cache *cache = pmemobj_tx_get_range_cache(pop, undo,
+		args->size);
+	if (cache == NULL) {
+		ERR("Failed to create range cache");
+		return 1;
+	}
+
+	size_t entry_size = TX_RANGE_ENTRY_SIZE(args->size);
+	ASSERT(runtime->cache_offset + entry_size <= cache->capacity);
+
+	struct tx_range *range =
+		(struct tx_range *)&cache->data[runtime->cache_offset];
+	runtime->cache_offset += entry_size;
+
+	VALGRIND_ADD_TO_TX(range, entry_size);
+
+	/* this isn't transactional so we have to keep the order */
+	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
+	VALGRIND_ADD_TO_TX(src, args->size);
+
+	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
+
+	/* the range is only valid if both size and offset are != 0 */
+	range->size = args->size;
+	range->offset = args->offset;
+	pmemops_persist(p_ops, range,
+		sizeof(range->offset) + sizeof(range->size));
+
+	VALGRIND_REMOVE_FROM_TX(range, entry_size);
+
+	return 0;
+}
+
+/*
+ * tx_range_snapshot -- (internal) saves the range in the undo log, either in
+ *	the range cache or in a separately allocated object
+ */
+static int
+tx_range_snapshot(uint64_t begin, uint64_t end, void *arg)
+{
+	struct tx_add_range_args *range = arg;
+	struct tx_add_range_args args = {
+		.pop = range->pop,
+		.offset = begin,
+		.size = end - begin,
+		.flags = range->flags,
+	};
+
+	if (!(args.flags & POBJ_XADD_NO_FLUSH)) {
+		struct lane_tx_runtime *runtime = tx.section->runtime;
+		if (tx_range_set_add(&runtime->flush, begin, end,
+				NULL, NULL) != 0)
+			return ENOMEM;
+	}
+
+	return args.size > MAX_CACHED_RANGE_SIZE ?
+		pmemobj_tx_add_large(&args) :
+		pmemobj_tx_add_small(&args);
+}
+
+/*
+ * pmemobj_tx_add_common -- (internal) common code for adding persistent memory
+ *				into the transaction
+ */
+static int
+pmemobj_tx_add_common(struct tx_add_range_args *args)
+{
+	LOG(15, NULL);
+
+	if (args->size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("snapshot size too large");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if (args->offset < args->pop->heap_offset ||
+		(args->offset + args->size) >
+		(args->pop->heap_offset + args->pop->heap_size)) {
+		ERR("object outside of heap");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	struct lane_tx_runtime *runtime = tx.section->runtime;
+
+	/* the range holds no data to roll back, it only has to be flushed */
+	if (args->flags & POBJ_XADD_NO_SNAPSHOT) {
+		if (!(args->flags & POBJ_XADD_NO_FLUSH) &&
+			tx_range_set_add(&runtime->flush, args->offset,
+				args->offset + args->size, NULL, NULL) != 0) {
+			ERR("out of memory");
+			return obj_tx_abort_err(ENOMEM);
+		}
+
+		return 0;
+	}
+
+	/* only the parts of the range that aren't in the undo log are added */
+	int ret = tx_range_set_add(&runtime->ranges, args->offset,
+		args->offset + args->size, tx_range_snapshot, args);
+
+	if (ret != 0) {
+		ERR("out of memory");
+		return obj_tx_abort_err(ENOMEM);
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_tx_add_range_direct -- adds persistent memory range into the
+ *					transaction
+ */
+int
+pmemobj_tx_add_range_direct(const void *ptr, size_t size)
+{
+	LOG(3, NULL);
+
+	return pmemobj_tx_xadd_range_direct(ptr, size, 0);
+}
+
+/*
+ * pmemobj_tx_xadd_range_direct -- adds persistent memory range into the
+ *					transaction, with the given flags
+ */
+int
+pmemobj_tx_xadd_range_direct(const void *ptr, size_t size, uint64_t flags)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_err(ENOMEM);
+
+	if (flags & ~POBJ_XADD_VALID_FLAGS) {
+		ERR("unknown flags 0x%" PRIx64, flags & ~POBJ_XADD_VALID_FLAGS);
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if ((char *)ptr < (char *)lane->pop ||
+			(char *)ptr >= (char *)lane->pop + lane->pop->size) {
+		ERR("object outside of pool");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	struct tx_add_range_args args = {
+		.pop = lane->pop,
+		.offset = (uint64_t)((char *)ptr - (char *)lane->pop),
+		.size = size,
+		.flags = flags,
+	};
+
+	return pmemobj_tx_add_common(&args);
+}
+
+/*
+ * pmemobj_tx_add_range -- adds persistent memory range into the transaction
+ */
+int
+pmemobj_tx_add_range(PMEMoid oid, uint64_t hoff, size_t size)
+{
+	LOG(3, NULL);
+
+	return pmemobj_tx_xadd_range(oid, hoff, size, 0);
+}
+
+/*
+ * pmemobj_tx_xadd_range -- adds persistent memory range into the transaction,
+ *				with the given flags
+ */
+int
+pmemobj_tx_xadd_range(PMEMoid oid, uint64_t hoff, size_t size, uint64_t flags)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_err(ENOMEM);
+
+	if (flags & ~POBJ_XADD_VALID_FLAGS) {
+		ERR("unknown flags 0x%" PRIx64, flags & ~POBJ_XADD_VALID_FLAGS);
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if (oid.pool_uuid_lo != lane->pop->uuid_lo) {
+		ERR("invalid pool uuid");
+		return obj_tx_abort_err(EINVAL);
+	}
+	ASSERT(OBJ_OID_IS_VALID(lane->pop, oid));
+
+	struct tx_add_range_args args = {
+		.pop = lane->pop,
+		.offset = oid.off + hoff,
+		.size = size,
+		.flags = flags,
+	};
+
+	/*
+	 * If internal type is in undo log it means
+	 * the object was allocated within this transaction
+	 * and there is no need to create a snapshot.
+	 */
+	if (tx_alloc_entry(lane, oid.off) == NULL)
+		return pmemobj_tx_add_common(&args);
+
+	return 0;
+}
+
+/*
+ * constructor_tx_redo_log -- (internal) redo log constructor
+ */
+static int
+constructor_tx_redo_log(void *ctx, void *ptr, size_t usable_size, void *arg)
 {
 	LOG(3, NULL);
 	PMEMobjpool *pop = ctx;
@@ -1472,268 +3230,298 @@ constructor_tx_range_cache(void *ctx, void *ptr, size_t usable_size, void *arg)
 	ASSERTne(ptr, NULL);
 
 	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
-	/* temporarily add the object copy to the transaction */
-	VALGRIND_ADD_TO_TX(oobh,
-		OBJ_OOB_SIZE + sizeof(struct tx_range_cache));
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE + sizeof(struct tx_redo_log));
 
 	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
 	pmemops_flush(p_ops, &oobh->size, sizeof(oobh->size));
 
-	pmemops_memset_persist(p_ops, ptr, 0, sizeof(struct tx_range_cache));
+	pmemops_memset_persist(p_ops, ptr, 0, sizeof(struct tx_redo_log));
 
 	VALGRIND_REMOVE_FROM_TX(oobh,
-		OBJ_OOB_SIZE + sizeof(struct tx_range_cache));
+		OBJ_OOB_SIZE + sizeof(struct tx_redo_log));
 
 	return 0;
 }
 
 /*
- * pmemobj_tx_get_range_cache -- (internal) returns first available cache
+ * tx_redo_reserve -- (internal) makes sure that both the volatile buffer and
+ *	the persistent redo log of the lane can hold 'size' bytes of entries
+ *
+ * The persistent redo log is only written at commit, so until then it can be
+ * freely replaced by a bigger one.
  */
-static struct tx_range_cache *
-pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo)
-{
-	uint64_t last_cache = pvector_last(undo);
-
-	struct tx_range_cache *cache = NULL;
-	/* get the last element from the caches list */
-	if (last_cache != 0)
-		cache = OBJ_OFF_TO_PTR(pop, last_cache);
-
-	/* verify if the cache exists and has at least one free slot */
-	if (cache == NULL || cache->range[MAX_CACHED_RANGES - 1].offset != 0) {
-		/* no existing cache, allocate a new one */
-		uint64_t *entry = pvector_push_back(undo);
-		if (entry == NULL) {
-			ERR("cache set undo log too large");
-			return NULL;
+static int
+tx_redo_reserve(PMEMobjpool *pop, struct lane_tx_runtime *lane, size_t size)
+{
+	struct tx_redo_buffer *redo = &lane->redo;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)tx.section->layout;
+
+	if (size > redo->capacity) {
+		size_t capacity = redo->capacity == 0 ?
+			TX_REDO_LOG_MIN_CAPACITY : redo->capacity;
+		while (capacity < size)
+			capacity *= 2;
+
+		uint8_t *data = Realloc(redo->data, capacity);
+		if (data == NULL) {
+			ERR("!Realloc");
+			return ENOMEM;
 		}
-		int err = pmalloc_construct(pop, entry,
-			sizeof(struct tx_range_cache) + OBJ_OOB_SIZE,
-			constructor_tx_range_cache, NULL);
 
-		if (err != 0) {
-			pvector_pop_back(undo, NULL);
-			return NULL;
-		}
+		redo->data = data;
+		redo->capacity = capacity;
+	}
 
-		cache = OBJ_OFF_TO_PTR(pop, *entry);
+	if (layout->redo_log != 0 &&
+		palloc_usable_size(&pop->heap, layout->redo_log) -
+		OBJ_OOB_SIZE - sizeof(struct tx_redo_log) >= size)
+		return 0;
 
-		/* since the cache is new, we start the count from 0 */
-		struct lane_tx_runtime *runtime = tx.section->runtime;
-		runtime->cache_slot = 0;
+	if (layout->redo_log != 0)
+		pfree(pop, &layout->redo_log);
+
+	if (pmalloc_construct(pop, &layout->redo_log,
+		sizeof(struct tx_redo_log) + redo->capacity + OBJ_OOB_SIZE,
+		constructor_tx_redo_log, NULL) != 0) {
+		ERR("cannot allocate the redo log");
+		return ENOMEM;
 	}
 
-	return cache;
+	return 0;
 }
 
 /*
- * pmemobj_tx_add_small -- (internal) adds small memory range to undo log cache
+ * pmemobj_tx_write -- defers the write to the pool memory until the commit of
+ *	the transaction
  */
-static int
-pmemobj_tx_add_small(struct tx_add_range_args *args)
+int
+pmemobj_tx_write(void *dest, const void *src, size_t size)
 {
-	PMEMobjpool *pop = args->pop;
-
-	struct lane_tx_runtime *runtime = tx.section->runtime;
-	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET_CACHE];
-	const struct pmem_ops *p_ops = &pop->p_ops;
-
-	struct tx_range_cache *cache = pmemobj_tx_get_range_cache(pop, undo);
-	if (cache == NULL) {
-		ERR("Failed to create range cache");
-		return 1;
-	}
+	LOG(3, NULL);
 
-	unsigned n = runtime->cache_slot++; /* first free cache slot */
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
 
-	ASSERT(n != MAX_CACHED_RANGES);
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_err(ENOMEM);
+	PMEMobjpool *pop = lane->pop;
 
-	/* those structures are binary compatible */
-	struct tx_range *range = (struct tx_range *)&cache->range[n];
-	VALGRIND_ADD_TO_TX(range,
-		sizeof(struct tx_range) + MAX_CACHED_RANGE_SIZE);
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("write size too large");
+		return obj_tx_abort_err(EINVAL);
+	}
 
-	/* this isn't transactional so we have to keep the order */
-	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
-	VALGRIND_ADD_TO_TX(src, args->size);
+	if ((char *)dest < (char *)pop ||
+		(uint64_t)((char *)dest - (char *)pop) < pop->heap_offset ||
+		(uint64_t)((char *)dest - (char *)pop) + size >
+		pop->heap_offset + pop->heap_size) {
+		ERR("object outside of heap");
+		return obj_tx_abort_err(EINVAL);
+	}
 
-	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
+	if (size == 0)
+		return 0;
 
-	/* the range is only valid if both size and offset are != 0 */
-	range->size = args->size;
-	range->offset = args->offset;
-	pmemops_persist(p_ops, range,
-		sizeof(range->offset) + sizeof(range->size));
+	struct tx_redo_buffer *redo = &lane->redo;
+	size_t esize = TX_RANGE_ENTRY_SIZE(size);
+	if (tx_redo_reserve(pop, lane, redo->size + esize) != 0)
+		return obj_tx_abort_err(ENOMEM);
 
-	VALGRIND_REMOVE_FROM_TX(range,
-		sizeof(struct tx_range) + MAX_CACHED_RANGE_SIZE);
+	struct tx_range *e = (struct tx_range *)&redo->data[redo->size];
+	e->offset = (uint64_t)((char *)dest - (char *)pop);
+	e->size = size;
+	memcpy(e->data, src, size);
+	redo->size += esize;
 
 	return 0;
 }
 
 /*
- * pmemobj_tx_add_common -- (internal) common code for adding persistent memory
- *				into the transaction
+ * pmemobj_tx_alloc -- allocates a new object
  */
-static int
-pmemobj_tx_add_common(struct tx_add_range_args *args)
+PMEMoid
+pmemobj_tx_alloc(size_t size, uint64_t type_num)
 {
-	LOG(15, NULL);
+	LOG(3, NULL);
 
-	if (args->size > PMEMOBJ_MAX_ALLOC_SIZE) {
-		ERR("snapshot size too large");
-		return obj_tx_abort_err(EINVAL);
-	}
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
 
-	if (args->offset < args->pop->heap_offset ||
-		(args->offset + args->size) >
-		(args->pop->heap_offset + args->pop->heap_size)) {
-		ERR("object outside of heap");
-		return obj_tx_abort_err(EINVAL);
+	if (size == 0) {
+		ERR("allocation with size 0");
+		return obj_tx_abort_null(EINVAL);
 	}
 
-	struct lane_tx_runtime *runtime = tx.section->runtime;
-
-	/* starting from the end, search for all overlapping ranges */
-	uint64_t spoint = args->offset + args->size - 1; /* start point */
-	uint64_t apoint = 0; /* add point */
-	int ret = 0;
-
-	while (spoint >= args->offset) {
-		apoint = spoint + 1;
-		/* find range less than starting point */
-		uint64_t range = ctree_find_le_unlocked(runtime->ranges,
-				&spoint);
-		struct tx_add_range_args nargs;
-		nargs.pop = args->pop;
-
-		if (spoint < args->offset) { /* the found offset is earlier */
-			nargs.size = apoint - args->offset;
-			/* overlap on the left edge */
-			if (spoint + range > args->offset) {
-				nargs.offset = spoint + range;
-				if (nargs.size <= nargs.offset - args->offset)
-					break;
-				nargs.size -= nargs.offset - args->offset;
-			} else {
-				nargs.offset = args->offset;
-			}
-
-			if (args->size == 0)
-				break;
-
-			spoint = 0; /* this is the end of our search */
-		} else { /* found offset is equal or greater than offset */
-			nargs.offset = spoint + range;
-			spoint -= 1;
-			if (nargs.offset >= apoint)
-				continue;
+	return tx_alloc_common(size, (type_num_t)type_num,
+			constructor_tx_alloc, 0, 0);
+}
 
-			nargs.size = apoint - nargs.offset;
-		}
+/*
+ * Number of objects which pmemobj_tx_alloc_bulk allocates and records in the
+ * undo log with a single operation, if the redo log can be extended.
+ */
+#define TX_ALLOC_BULK_GROUP 64
 
-		/*
-		 * Depending on the size of the block, either allocate an
-		 * entire new object or use cache.
-		 */
-		ret = nargs.size > MAX_CACHED_RANGE_SIZE ?
-			pmemobj_tx_add_large(&nargs) :
-			pmemobj_tx_add_small(&nargs);
+/*
+ * tx_alloc_bulk_publish -- (internal) allocates a group of objects
+ *
+ * The objects are reserved in the transient heap first and then the
+ * allocations, together with the undo log entries of the objects, are
+ * published using a single redo log - either all of them are recorded in
+ * the undo log after a crash or none. The context has to fit two entries
+ * per object.
+ */
+static int
+tx_alloc_bulk_publish(PMEMobjpool *pop, struct operation_context *ctx,
+	size_t size, type_num_t type_num, PMEMoid *oids, uint64_t **entries,
+	size_t noids)
+{
+	ASSERT(noids <= TX_ALLOC_BULK_GROUP);
 
-		if (ret != 0)
-			break;
+	struct pobj_action acts[2 * TX_ALLOC_BULK_GROUP];
 
-		ret = ctree_insert_unlocked(runtime->ranges, nargs.offset,
-				nargs.size);
-		if (ret != 0) {
-			if (ret == EEXIST)
-				FATAL("invalid state of ranges tree");
+	struct tx_alloc_args args = {
+		.type_num = type_num,
+	};
 
-			break;
+	for (size_t i = 0; i < noids; ++i) {
+		if (palloc_reserve(&pop->heap, size + OBJ_OOB_SIZE,
+				constructor_tx_alloc, &args, 0, &acts[i],
+				&oids[i].off) != 0) {
+			palloc_cancel(&pop->heap, acts, i);
+			return -1;
 		}
 	}
 
-	if (ret != 0) {
-		ERR("out of memory");
-		return obj_tx_abort_err(ENOMEM);
-	}
+	for (size_t i = 0; i < noids; ++i)
+		palloc_set_value(&pop->heap, &acts[noids + i], entries[i],
+			oids[i].off);
+
+	palloc_publish(&pop->heap, acts, 2 * noids, ctx);
 
 	return 0;
 }
 
 /*
- * pmemobj_tx_add_range_direct -- adds persistent memory range into the
- *					transaction
+ * tx_alloc_bulk_group -- (internal) allocates a group of objects and
+ *	registers them in the transaction
  */
-int
-pmemobj_tx_add_range_direct(const void *ptr, size_t size)
+static int
+tx_alloc_bulk_group(struct lane_tx_runtime *lane, size_t size,
+	type_num_t type_num, PMEMoid *oids, size_t noids)
 {
-	LOG(3, NULL);
+	PMEMobjpool *pop = lane->pop;
+	struct pvector_context *undo = lane->undo.ctx[UNDO_ALLOC];
+	uint64_t *entries[TX_ALLOC_BULK_GROUP];
 
-	ASSERT_IN_TX();
-	ASSERT_TX_STAGE_WORK();
+	/* growing the undo log allocates on its own, so do it up front */
+	uint64_t nvalues = pvector_nvalues(undo);
+	if (pvector_push_back_n(undo, entries, noids) != 0)
+		return -1;
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	/* number of the objects recorded in the undo log */
+	size_t published = 0;
 
-	if ((char *)ptr < (char *)lane->pop ||
-			(char *)ptr >= (char *)lane->pop + lane->pop->size) {
-		ERR("object outside of pool");
-		return obj_tx_abort_err(EINVAL);
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+
+	size_t step = noids;
+	if (pmalloc_redo_extend(pop, &ctx, 2 * noids) != 0) {
+		LOG(2, "allocating the objects in smaller groups");
+		step = ALLOC_REDO_LOG_SIZE / 2;
 	}
 
-	struct tx_add_range_args args = {
-		.pop = lane->pop,
-		.offset = (uint64_t)((char *)ptr - (char *)lane->pop),
-		.size = size
-	};
+	while (published < noids) {
+		if (step > noids - published)
+			step = noids - published;
 
-	return pmemobj_tx_add_common(&args);
+		if (published != 0)
+			operation_init(&ctx, pop, pop->redo, redo);
+
+		if (tx_alloc_bulk_publish(pop, &ctx, size, type_num,
+				oids + published, entries + published,
+				step) != 0)
+			break;
+
+		published += step;
+	}
+
+	pmalloc_redo_release(pop);
+
+	/* the entries of the objects which weren't allocated are still zero */
+	pvector_truncate(undo, nvalues + published);
+
+	/* from now on the objects are freed on abort */
+	for (size_t i = 0; i < published; ++i) {
+		oids[i].pool_uuid_lo = pop->uuid_lo;
+
+		if (tx_range_set_add(&lane->ranges, oids[i].off,
+				oids[i].off + size, NULL, NULL) != 0 ||
+			ctree_insert_unlocked(lane->allocs, oids[i].off,
+				(uint64_t)entries[i]) != 0)
+			return -1;
+	}
+
+	return published == noids ? 0 : -1;
 }
 
 /*
- * pmemobj_tx_add_range -- adds persistent memory range into the transaction
+ * pmemobj_tx_alloc_bulk -- allocates many objects of the same size
  */
 int
-pmemobj_tx_add_range(PMEMoid oid, uint64_t hoff, size_t size)
+pmemobj_tx_alloc_bulk(size_t size, uint64_t type_num, PMEMoid *oids,
+	size_t noids)
 {
-	LOG(3, NULL);
+	LOG(3, "size %zu type_num %" PRIu64 " noids %zu", size, type_num,
+		noids);
 
 	ASSERT_IN_TX();
 	ASSERT_TX_STAGE_WORK();
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	for (size_t i = 0; i < noids; ++i)
+		oids[i] = OID_NULL;
 
-	if (oid.pool_uuid_lo != lane->pop->uuid_lo) {
-		ERR("invalid pool uuid");
+	if (size == 0) {
+		ERR("allocation with size 0");
 		return obj_tx_abort_err(EINVAL);
 	}
-	ASSERT(OBJ_OID_IS_VALID(lane->pop, oid));
 
-	struct tx_add_range_args args = {
-		.pop = lane->pop,
-		.offset = oid.off + hoff,
-		.size = size
-	};
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		return obj_tx_abort_err(ENOMEM);
+	}
 
-	/*
-	 * If internal type is in undo log it means
-	 * the object was allocated within this transaction
-	 * and there is no need to create a snapshot.
-	 */
-	if (!OBJ_OID_IS_IN_UNDO_LOG(lane->pop, oid))
-		return pmemobj_tx_add_common(&args);
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_err(ENOMEM);
+
+	for (size_t done = 0; done < noids; done += TX_ALLOC_BULK_GROUP) {
+		size_t group = noids - done;
+		if (group > TX_ALLOC_BULK_GROUP)
+			group = TX_ALLOC_BULK_GROUP;
+
+		if (tx_alloc_bulk_group(lane, size, (type_num_t)type_num,
+				oids + done, group) != 0) {
+			for (size_t i = 0; i < noids; ++i)
+				oids[i] = OID_NULL;
+
+			ERR("out of memory");
+			return obj_tx_abort_err(ENOMEM);
+		}
+	}
 
 	return 0;
 }
 
 /*
- * pmemobj_tx_alloc -- allocates a new object
+ * pmemobj_tx_zalloc -- allocates a new zeroed object
  */
 PMEMoid
-pmemobj_tx_alloc(size_t size, uint64_t type_num)
+pmemobj_tx_zalloc(size_t size, uint64_t type_num)
 {
 	LOG(3, NULL);
 
@@ -1746,14 +3534,14 @@ pmemobj_tx_alloc(size_t size, uint64_t type_num)
 	}
 
 	return tx_alloc_common(size, (type_num_t)type_num,
-			constructor_tx_alloc);
+			constructor_tx_zalloc, 0, 0);
 }
 
 /*
- * pmemobj_tx_zalloc -- allocates a new zeroed object
+ * pmemobj_tx_xalloc -- allocates a new object with flags
  */
 PMEMoid
-pmemobj_tx_zalloc(size_t size, uint64_t type_num)
+pmemobj_tx_xalloc(size_t size, uint64_t type_num, uint64_t flags)
 {
 	LOG(3, NULL);
 
@@ -1765,8 +3553,19 @@ pmemobj_tx_zalloc(size_t size, uint64_t type_num)
 		return obj_tx_abort_null(EINVAL);
 	}
 
+	if (flags & ~POBJ_XALLOC_VALID_FLAGS) {
+		ERR("unknown flags 0x%" PRIx64,
+			flags & ~POBJ_XALLOC_VALID_FLAGS);
+		return obj_tx_abort_null(EINVAL);
+	}
+
+	unsigned class_id = (unsigned)((flags & POBJ_XALLOC_CLASS_MASK) >>
+		POBJ_XALLOC_CLASS_SHIFT);
+
 	return tx_alloc_common(size, (type_num_t)type_num,
-			constructor_tx_zalloc);
+			(flags & POBJ_XALLOC_ZERO) ? constructor_tx_zalloc :
+			constructor_tx_alloc, class_id,
+			obj_alloc_alignment(flags));
 }
 
 /*
@@ -1820,7 +3619,7 @@ pmemobj_tx_strdup(const char *s, uint64_t type_num)
 
 	if (len == 0)
 		return tx_alloc_common(sizeof(char), (type_num_t)type_num,
-				constructor_tx_zalloc);
+				constructor_tx_zalloc, 0, 0);
 
 	size_t size = (len + 1) * sizeof(char);
 
@@ -1842,8 +3641,9 @@ pmemobj_tx_free(PMEMoid oid)
 	if (OBJ_OID_IS_NULL(oid))
 		return 0;
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	struct lane_tx_runtime *lane = tx_lane();
+	if (lane == NULL)
+		return obj_tx_abort_err(ENOMEM);
 	PMEMobjpool *pop = lane->pop;
 
 	if (pop->uuid_lo != oid.pool_uuid_lo) {
@@ -1852,7 +3652,8 @@ pmemobj_tx_free(PMEMoid oid)
 	}
 	ASSERT(OBJ_OID_IS_VALID(pop, oid));
 
-	if (!OBJ_OID_IS_IN_UNDO_LOG(pop, oid)) {
+	uint64_t *entry_offset = tx_alloc_entry(lane, oid.off);
+	if (entry_offset == NULL) {
 		/* the object is in object store */
 		uint64_t *entry = pvector_push_back(lane->undo.ctx[UNDO_FREE]);
 		if (entry == NULL) {
@@ -1862,17 +3663,32 @@ pmemobj_tx_free(PMEMoid oid)
 		*entry = oid.off;
 		pmemops_persist(&pop->p_ops, entry, sizeof(*entry));
 	} else {
-
-		struct oob_header *oobh = OOB_HEADER_FROM_OID(pop, oid);
 #ifdef USE_VG_PMEMCHECK
 		if (On_valgrind) {
-			size_t size = palloc_usable_size(&pop->heap, oid.off);
-			VALGRIND_SET_CLEAN(oobh, size);
-			VALGRIND_REMOVE_FROM_TX(oobh, size);
+			struct oob_header *oobh =
+				OOB_HEADER_FROM_OID(pop, oid);
+			void *start = (char *)oobh + OBJ_OOB_SIZE -
+				palloc_header_size(&pop->heap, oid.off);
+			size_t size = palloc_usable_size(&pop->heap, oid.off) -
+				(size_t)((uintptr_t)start - (uintptr_t)oobh);
+			VALGRIND_SET_CLEAN(start, size);
+			VALGRIND_REMOVE_FROM_TX(start, size);
 		}
 #endif
 
-		if (ctree_remove_unlocked(lane->ranges, oid.off, 1) != oid.off)
+		/* the ranges filtered by the epoch aren't all in the set now */
+		tx.epoch++;
+
+		size_t usable_size = pmemobj_alloc_usable_size(oid);
+		if (tx_range_set_remove(&lane->ranges, oid.off, oid.off +
+				usable_size) != 0 ||
+			tx_range_set_remove(&lane->persisted, oid.off,
+				oid.off + usable_size) != 0) {
+			ERR("out of memory");
+			return obj_tx_abort_err(ENOMEM);
+		}
+
+		if (ctree_remove_unlocked(lane->allocs, oid.off, 1) != oid.off)
 			FATAL("TX undo state mismatch");
 
 		struct redo_log *redo = pmalloc_redo_hold(pop);
@@ -1886,12 +3702,11 @@ pmemobj_tx_free(PMEMoid oid)
 		 * the removed entry with a special value which is skipped
 		 * during processing.
 		 */
-		uint64_t *entry_offset = (uint64_t *)oobh->undo_entry_offset;
 		operation_add_entry(&ctx, entry_offset, TX_SKIP_ENTRY_VALUE,
 				OPERATION_SET);
 
 		pmalloc_operation(&pop->heap, *entry_offset,
-			entry_offset, 0, NULL, NULL, &ctx);
+			entry_offset, 0, NULL, NULL, &ctx, 0, 0);
 
 		pmalloc_redo_release(pop);
 	}
@@ -1922,19 +3737,147 @@ lane_transaction_destroy_rt(PMEMobjpool *pop, void *rt)
 {
 	struct lane_tx_runtime *lane = rt;
 	tx_destroy_undo_runtime(&lane->undo);
+
+	if (lane->allocs != NULL)
+		ctree_delete(lane->allocs);
+
+	Free(lane->ranges.ranges);
+	Free(lane->flush.ranges);
+	Free(lane->persisted.ranges);
+	Free(lane->redo.data);
 	Free(lane);
 }
 
+/*
+ * tx_multi_record_release -- (internal) removes the pool from the commit
+ *	record, clearing the record once no other pool is listed
+ */
+static void
+tx_multi_record_release(PMEMobjpool *cpop, struct tx_multi_record *rec,
+	uint64_t uuid_lo)
+{
+	util_mutex_lock(&Tx_multi_lock);
+
+	int listed = 0;
+	for (unsigned i = 0; i < TX_MULTI_MAX_POOLS - 1; ++i) {
+		if (uuid_lo != 0 && rec->parts[i] == uuid_lo) {
+			rec->parts[i] = 0;
+			pmemops_persist(&cpop->p_ops, &rec->parts[i],
+				sizeof(rec->parts[i]));
+		}
+
+		listed |= rec->parts[i] != 0;
+	}
+
+	if (!listed) {
+		rec->id = 0;
+		pmemops_persist(&cpop->p_ops, &rec->id, sizeof(rec->id));
+	}
+
+	util_mutex_unlock(&Tx_multi_lock);
+}
+
+/*
+ * tx_multi_recover_coord -- (internal) recovers the commit record kept by the
+ *	lane of the coordinating pool of a multi-pool transaction
+ *
+ * The lane of a committed transaction is rolled forward, but the record is
+ * kept for the other pools, which can't know the outcome otherwise, until
+ * they're recovered as well. The record of a transaction which hasn't been
+ * committed is simply cleared, which makes all of the other pools abort it.
+ */
+static void
+tx_multi_recover_coord(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	struct tx_multi_record *rec = &layout->multi;
+
+	if (rec->committed != rec->id) {
+		rec->id = 0;
+		pmemops_persist(&pop->p_ops, &rec->id, sizeof(rec->id));
+		return;
+	}
+
+	if (layout->state != TX_STATE_COMMITTED)
+		tx_set_state(pop, layout, TX_STATE_COMMITTED);
+
+	/* there might be no pools left if the failure hit their release */
+	tx_multi_record_release(pop, rec, 0);
+}
+
+/*
+ * tx_multi_recover_part -- (internal) learns the outcome of the multi-pool
+ *	transaction the lane has taken part in from the commit record of the
+ *	coordinating pool
+ *
+ * The coordinating pool must be open for the lane to be recovered, otherwise
+ * EAGAIN is returned. The coordinating pool always has the lowest uuid of all
+ * of the pools of the transaction, so no two pools can wait for each other.
+ */
+static int
+tx_multi_recover_part(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	struct tx_multi_ref *ref = &layout->coord;
+
+	/* the transaction couldn't have been committed before it's prepared */
+	if (layout->state == TX_STATE_NONE || ref->id == 0) {
+		if (layout->state == TX_STATE_PREPARED)
+			tx_set_state(pop, layout, TX_STATE_NONE);
+	} else {
+		PMEMoid oid = { ref->uuid_lo, 0 };
+		PMEMobjpool *cpop = pmemobj_pool_by_oid(oid);
+		if (cpop == NULL || cpop == pop) {
+			ERR("pool 0x%016jx coordinating the transaction "
+				"isn't open", ref->uuid_lo);
+			return EAGAIN;
+		}
+
+		struct tx_multi_record *rec = NULL;
+		if (ref->lane < cpop->nlanes) {
+			struct lane_layout *lanes = (struct lane_layout *)
+				((char *)cpop + cpop->lanes_offset);
+			struct lane_tx_layout *clayout = (void *)
+				&lanes[ref->lane].sections[
+					LANE_SECTION_TRANSACTION];
+			rec = &clayout->multi;
+		}
+
+		if (rec != NULL && rec->id == ref->id &&
+				rec->committed == ref->id) {
+			if (layout->state != TX_STATE_COMMITTED)
+				tx_set_state(pop, layout, TX_STATE_COMMITTED);
+
+			tx_multi_record_release(cpop, rec, pop->uuid_lo);
+		} else if (layout->state == TX_STATE_PREPARED) {
+			tx_set_state(pop, layout, TX_STATE_NONE);
+		}
+	}
+
+	ref->id = 0;
+	pmemops_persist(&pop->p_ops, &ref->id, sizeof(ref->id));
+
+	return 0;
+}
+
 /*
  * lane_transaction_recovery -- recovery of transaction lane section
  */
 static int
 lane_transaction_recovery(PMEMobjpool *pop, void *data, unsigned length)
 {
+	COMPILE_ERROR_ON(sizeof(struct lane_tx_layout) > LANE_SECTION_LEN);
+
 	struct lane_tx_layout *layout = data;
 	int ret = 0;
 	ASSERT(sizeof(*layout) <= length);
 
+	if (layout->multi.id != 0)
+		tx_multi_recover_coord(pop, layout);
+
+	if (layout->state == TX_STATE_PREPARED || layout->coord.id != 0) {
+		if ((ret = tx_multi_recover_part(pop, layout)) != 0)
+			return ret;
+	}
+
 	if (layout->state == TX_STATE_COMMITTED) {
 		/*
 		 * The transaction has been committed so we have to
@@ -1962,7 +3905,8 @@ lane_transaction_check(PMEMobjpool *pop, void *data, unsigned length)
 	struct lane_tx_layout *tx_sec = data;
 
 	if (tx_sec->state != TX_STATE_NONE &&
-		tx_sec->state != TX_STATE_COMMITTED) {
+		tx_sec->state != TX_STATE_COMMITTED &&
+		tx_sec->state != TX_STATE_PREPARED) {
 		ERR("tx lane: invalid transaction state");
 		return -1;
 	}
@@ -40,17 +40,25 @@
 #include <stdint.h>
 #include "pvector.h"
 
+/* snapshots up to this size are stored in the range cache */
+#define MAX_CACHED_RANGE_SIZE 512
+
 /*
+ * Sizes of the first, and the largest, range cache object of a transaction.
+ * Every next cache object allocated within a transaction is twice as large as
+ * the previous one, up to the maximum.
+ *
  * To make sure that the range cache does not needlessly waste memory in the
  * allocator, the values set here must very closely match allocation class
  * sizes. A good value to aim for is multiples of 1024 bytes.
  */
-#define MAX_CACHED_RANGE_SIZE 32
-#define MAX_CACHED_RANGES 169
+#define TX_RANGE_CACHE_SIZE ((1 << 13) - 80)
+#define TX_RANGE_CACHE_MAX_SIZE ((1 << 16) - 80)
 
 enum tx_state {
 	TX_STATE_NONE = 0,
 	TX_STATE_COMMITTED = 1,
+	TX_STATE_PREPARED = 2, /* waits for the decision of the coordinator */
 };
 
 struct tx_range {
@@ -59,12 +67,23 @@ struct tx_range {
 	uint8_t data[];
 };
 
+/*
+ * Both the range cache and the redo log are sequences of entries, each of
+ * which is a struct tx_range with its data padded to TX_RANGE_ALIGN bytes.
+ */
+#define TX_RANGE_ALIGN 8
+#define TX_RANGE_ENTRY_SIZE(_size) (sizeof(struct tx_range) +\
+	(((_size) + TX_RANGE_ALIGN - 1) & ~(TX_RANGE_ALIGN - 1ULL)))
+
+/*
+ * The entries of the range cache are appended one after another. An entry is
+ * only valid if both its offset and size are != 0, and the first one that
+ * isn't valid ends the cache.
+ */
 struct tx_range_cache {
-	struct { /* compatible with struct tx_range */
-		uint64_t offset;
-		uint64_t size;
-		uint8_t data[MAX_CACHED_RANGE_SIZE];
-	} range[MAX_CACHED_RANGES];
+	uint64_t capacity; /* number of bytes available for the entries */
+	uint64_t unused;
+	uint8_t data[];
 };
 
 enum undo_types {
@@ -76,9 +95,62 @@ enum undo_types {
 	MAX_UNDO_TYPES
 };
 
+/*
+ * The redo log of a transaction is only valid, and applied during recovery,
+ * if the transaction is committed.
+ */
+struct tx_redo_log {
+	uint64_t size; /* number of bytes taken by the entries */
+	uint64_t unused;
+	uint8_t data[];
+};
+
+/* maximum number of pools modified by a single transaction */
+#define TX_MULTI_MAX_POOLS 8
+
+/*
+ * The commit record of a transaction which modified more than one pool, kept
+ * in the lane of the pool with the lowest uuid, which coordinates the commit.
+ * The transaction is committed once its id is written to the committed field.
+ *
+ * After a failure the record is kept until all of the other pools listed
+ * have rolled their lanes forward.
+ */
+struct tx_multi_record {
+	uint64_t id; /* id of the transaction, 0 if there's none */
+	uint64_t committed; /* equal to the id once committed */
+	uint64_t parts[TX_MULTI_MAX_POOLS - 1]; /* uuids of the other pools */
+};
+
+/*
+ * The reference to the commit record, written by each of the other pools of
+ * the transaction before its lane enters the prepared state.
+ */
+struct tx_multi_ref {
+	uint64_t uuid_lo; /* uuid of the coordinating pool */
+	uint64_t lane; /* its lane holding the record */
+	uint64_t id; /* id of the transaction, 0 if there's none */
+};
+
 struct lane_tx_layout {
 	uint64_t state;
 	struct pvector undo_log[MAX_UNDO_TYPES];
+	uint64_t redo_log; /* offset of the redo log reused by the lane */
+	struct tx_multi_record multi;
+	struct tx_multi_ref coord;
 };
 
+void tx_cache_boot(void);
+void tx_cache_destroy(void);
+void tx_multi_boot(void);
+void tx_multi_destroy(void);
+void tx_undo_retain_init(const char *retain_var);
+void tx_async_free_init(const char *async_var);
+void tx_reclaim_start(PMEMobjpool *pop);
+int tx_reclaim_wait(PMEMobjpool *pop);
+void tx_reclaim_stop(PMEMobjpool *pop);
+void tx_group_commit_init(const char *group_var);
+void tx_group_start(PMEMobjpool *pop);
+void tx_group_stop(PMEMobjpool *pop);
+
 #endif
@@ -104,9 +104,13 @@ check_init(PMEMpoolcheck *ppc)
 		goto error_data_malloc;
 	if (!(ppc->pool = pool_data_alloc(ppc)))
 		goto error_pool_malloc;
+	if (check_progress_open(ppc))
+		goto error_progress_open;
 
 	return 0;
 
+error_progress_open:
+	pool_data_free(ppc->pool);
 error_pool_malloc:
 	check_data_free(ppc->data);
 error_data_malloc:
@@ -186,6 +190,11 @@ check_step(PMEMpoolcheck *ppc)
 		return NULL;
 	}
 
+	/* persist the step in progress, unless it is already persisted */
+	if (ppc->progress.step != check_step_get(ppc->data) ||
+			ppc->progress.checksum == 0)
+		check_progress_save(ppc);
+
 	/* perform step */
 	step->func(ppc);
 
@@ -205,6 +214,7 @@ check_fini(PMEMpoolcheck *ppc)
 {
 	LOG(3, NULL);
 
+	check_progress_close(ppc);
 	pool_data_free(ppc->pool);
 	check_data_free(ppc->data);
 }
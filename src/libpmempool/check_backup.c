@@ -58,6 +58,9 @@ check_backup(PMEMpoolcheck *ppc)
 	if (ppc->backup_path == NULL)
 		return;
 
+	/* free space of the pool is not copied to the backup */
+	struct pool_extents free = {0, 0, NULL};
+
 	if (ppc->pool->params.is_poolset) {
 		if (ppc->pool->set_file->poolset->nreplicas > 1) {
 			CHECK_INFO(ppc, "only the first replica will be backed "
@@ -105,26 +108,30 @@ check_backup(PMEMpoolcheck *ppc)
 			errno = 0;
 		}
 
+		pool_free_extents(ppc->pool, &free);
 		for (unsigned p = 0; p < srep->nparts; p++) {
 			CHECK_INFO(ppc, "creating backup file: %s",
 				drep->part[p].path);
-			if (pool_set_part_copy(
-					&drep->part[p], &srep->part[p])) {
+			if (pool_set_part_copy(ppc->pool, &drep->part[p],
+					&srep->part[p], &free)) {
 				CHECK_INFO(ppc, "unable to create backup file");
 				goto err_poolset;
 			}
 		}
 	} else {
 		CHECK_INFO(ppc, "creating backup file: %s", ppc->backup_path);
-		if (pool_copy(ppc->pool, ppc->backup_path)) {
+		pool_free_extents(ppc->pool, &free);
+		if (pool_copy(ppc->pool, ppc->backup_path, &free)) {
 			CHECK_ERR(ppc, "unable to create backup file");
 			ppc->result = CHECK_RESULT_ERROR;
 		}
 	}
 
+	pool_extents_fini(&free);
 	return;
 
 err_poolset:
+	pool_extents_fini(&free);
 	CHECK_ERR(ppc, "unable to backup poolset");
 	ppc->result = CHECK_RESULT_ERROR;
 }
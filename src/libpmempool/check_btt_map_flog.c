@@ -37,6 +37,8 @@
 #include <stdint.h>
 #include <sys/param.h>
 #include <endian.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "out.h"
 #include "btt.h"
@@ -57,6 +59,7 @@ union location {
 		struct list *list_inval;
 		struct list *list_flog_inval;
 		struct list *list_unmap;
+		uint32_t nverified;	/* arenas verified by an earlier check */
 
 		unsigned step;
 	};
@@ -64,6 +67,9 @@ union location {
 	struct check_step_data step_data;
 };
 
+/* maximum number of threads reading BTT Maps and Flogs of arenas */
+#define CHECK_READ_THREADS_MAX 16
+
 enum questions {
 	Q_REPAIR_MAP,
 	Q_REPAIR_FLOG,
@@ -109,10 +115,14 @@ error_malloc:
 
 /*
  * map_read -- (internal) read and convert map from file
+ *
+ * If the pool is mapped the entries are converted straight from the
+ * mapping, otherwise they are read first and converted in place.
  */
 static int
 map_read(PMEMpoolcheck *ppc, struct arena *arenap)
 {
+	struct pool_data *pool = ppc->pool;
 	uint64_t mapoff = arenap->offset + arenap->btt_info.mapoff;
 	arenap->mapsize = btt_map_size(arenap->btt_info.external_nlba);
 
@@ -122,11 +132,22 @@ map_read(PMEMpoolcheck *ppc, struct arena *arenap)
 		goto error_malloc;
 	}
 
-	if (pool_read(ppc->pool, arenap->map, arenap->mapsize, mapoff)) {
-		goto error_read;
+	uint32_t i;
+	if (pool->params.type != POOL_TYPE_BTT) {
+		if (mapoff + arenap->mapsize > pool->set_file->size)
+			goto error_read;
+
+		const uint32_t *src = (const uint32_t *)
+			((char *)pool->set_file->addr + mapoff);
+		for (i = 0; i < arenap->btt_info.external_nlba; i++)
+			arenap->map[i] = le32toh(src[i]);
+
+		return 0;
 	}
 
-	uint32_t i;
+	if (pool_read(pool, arenap->map, arenap->mapsize, mapoff))
+		goto error_read;
+
 	for (i = 0; i < arenap->btt_info.external_nlba; i++)
 		arenap->map[i] = le32toh(arenap->map[i]);
 
@@ -139,6 +160,106 @@ error_malloc:
 	return -1;
 }
 
+/*
+ * arenas_read_arg -- arguments of a thread reading maps and flogs
+ */
+struct arenas_read_arg {
+	PMEMpoolcheck *ppc;
+	struct arena **arenas;
+	uint32_t narenas;
+	uint32_t first;		/* first arena of the thread */
+	uint32_t stride;	/* the number of threads */
+};
+
+/*
+ * arenas_read_worker -- (internal) read every stride-th arena
+ *
+ * Failures are not reported here, the map and flog of such an arena are
+ * left unread and init() reads them again and reports the error.
+ */
+static void *
+arenas_read_worker(void *arg)
+{
+	struct arenas_read_arg *a = arg;
+
+	for (uint32_t i = a->first; i < a->narenas; i += a->stride) {
+		struct arena *arenap = a->arenas[i];
+		if (flog_read(a->ppc, arenap) == 0 &&
+				map_read(a->ppc, arenap) != 0) {
+			free(arenap->flog);
+			arenap->flog = NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * arenas_read -- (internal) read maps and flogs of all arenas in parallel
+ *
+ * Only the reading and conversion of the maps and flogs is spread across
+ * threads, the arenas are then checked one by one as the messages and
+ * questions of the check are reported in order.  A BTT device is read
+ * through a single file offset, so it is always read by init().  The first
+ * skip arenas, already verified by an interrupted check, are not read.
+ */
+static void
+arenas_read(PMEMpoolcheck *ppc, uint32_t skip)
+{
+	struct pool_data *pool = ppc->pool;
+	if (pool->params.type == POOL_TYPE_BTT || pool->narenas < skip + 2)
+		return;
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 2)
+		return;
+
+	uint32_t nthreads = pool->narenas - skip;
+	if (nthreads > (unsigned long)ncpus)
+		nthreads = (uint32_t)ncpus;
+	if (nthreads > CHECK_READ_THREADS_MAX)
+		nthreads = CHECK_READ_THREADS_MAX;
+
+	struct arena **arenas = malloc(pool->narenas * sizeof(*arenas));
+	if (!arenas)
+		return;
+
+	uint32_t narenas = 0;
+	uint32_t i = 0;
+	struct arena *arenap;
+	TAILQ_FOREACH(arenap, &pool->arenas, next) {
+		if (i++ >= skip && !arenap->flog && !arenap->map &&
+				narenas < pool->narenas)
+			arenas[narenas++] = arenap;
+	}
+
+	struct arenas_read_arg args[CHECK_READ_THREADS_MAX];
+	pthread_t threads[CHECK_READ_THREADS_MAX];
+	int started[CHECK_READ_THREADS_MAX];
+
+	for (uint32_t t = 0; t < nthreads; t++) {
+		args[t].ppc = ppc;
+		args[t].arenas = arenas;
+		args[t].narenas = narenas;
+		args[t].first = t;
+		args[t].stride = nthreads;
+
+		started[t] = t != 0 && pthread_create(&threads[t], NULL,
+				arenas_read_worker, &args[t]) == 0;
+	}
+
+	arenas_read_worker(&args[0]);
+
+	for (uint32_t t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		else
+			arenas_read_worker(&args[t]);
+	}
+
+	free(arenas);
+}
+
 /*
  * list_item -- item for simple list
  */
@@ -253,13 +374,13 @@ init(PMEMpoolcheck *ppc, union location *loc)
 
 	struct arena *arenap = loc->arenap;
 
-	/* read flog and map entries */
-	if (flog_read(ppc, arenap)) {
+	/* read flog and map entries, unless already read by arenas_read() */
+	if (!arenap->flog && flog_read(ppc, arenap)) {
 		CHECK_ERR(ppc, "arena %u: cannot read BTT Flog", arenap->id);
 		goto error;
 	}
 
-	if (map_read(ppc, arenap)) {
+	if (!arenap->map && map_read(ppc, arenap)) {
 		CHECK_ERR(ppc, "arena %u: cannot read BTT Map", arenap->id);
 		goto error;
 	}
@@ -686,6 +807,54 @@ step_exe(PMEMpoolcheck *ppc, union location *loc)
 	return -1;
 }
 
+/*
+ * arenas_verified -- (internal) get the number of arenas whose map and flog
+ *	were verified by an interrupted check
+ *
+ * The persisted progress is used only if the offset of the next arena to
+ * verify matches the layout of the pool.
+ */
+static uint32_t
+arenas_verified(PMEMpoolcheck *ppc)
+{
+	struct pool_data *pool = ppc->pool;
+	uint32_t nverified = ppc->progress.narena;
+	if (nverified == 0 || nverified > pool->narenas)
+		return 0;
+
+	uint64_t offset = pool->params.size;
+	uint32_t i = 0;
+	struct arena *arenap;
+	TAILQ_FOREACH(arenap, &pool->arenas, next) {
+		if (i++ == nverified) {
+			offset = arenap->offset;
+			break;
+		}
+	}
+
+	if (offset != ppc->progress.offset) {
+		CHECK_INFO(ppc, "progress of the interrupted check does not "
+			"match the pool, checking all arenas");
+		return 0;
+	}
+
+	return nverified;
+}
+
+/*
+ * arena_verified -- (internal) persist the progress after the map and flog of
+ *	the current arena are verified
+ */
+static void
+arena_verified(PMEMpoolcheck *ppc, union location *loc)
+{
+	struct arena *nextp = TAILQ_NEXT(loc->arenap, next);
+
+	ppc->progress.narena = loc->narena + 1;
+	ppc->progress.offset = nextp ? nextp->offset : ppc->pool->params.size;
+	check_progress_save(ppc);
+}
+
 /*
  * check_btt_map_flog -- perform check and fixing of map and flog
  */
@@ -706,11 +875,21 @@ check_btt_map_flog(PMEMpoolcheck *ppc)
 	if (!loc->arenap && loc->narena == 0 &&
 			ppc->result != CHECK_RESULT_PROCESS_ANSWERS) {
 		CHECK_INFO(ppc, "checking BTT Map and Flog");
+		loc->nverified = arenas_verified(ppc);
+		arenas_read(ppc, loc->nverified);
 		loc->arenap = TAILQ_FIRST(&ppc->pool->arenas);
 		loc->narena = 0;
 	}
 
 	while (loc->arenap != NULL) {
+		if (loc->narena < loc->nverified) {
+			CHECK_INFO(ppc, "arena %u: BTT Map and Flog verified by "
+				"the interrupted check", loc->narena);
+			loc->arenap = TAILQ_NEXT(loc->arenap, next);
+			loc->narena++;
+			continue;
+		}
+
 		/* add info about checking next arena */
 		if (ppc->result != CHECK_RESULT_PROCESS_ANSWERS &&
 				loc->step == 0) {
@@ -724,6 +903,9 @@ check_btt_map_flog(PMEMpoolcheck *ppc)
 				return;
 		}
 
+		if (ppc->result == CHECK_RESULT_CONSISTENT)
+			arena_verified(ppc, loc);
+
 		/* jump to next arena */
 		loc->arenap = TAILQ_NEXT(loc->arenap, next);
 		loc->narena++;
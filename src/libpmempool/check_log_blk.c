@@ -59,6 +59,7 @@ enum question {
 	Q_LOG_START_OFFSET,
 	Q_LOG_END_OFFSET,
 	Q_LOG_WRITE_OFFSET,
+	Q_LOG_RING_OFFSETS,
 	Q_BLK_BSIZE,
 };
 
@@ -90,6 +91,22 @@ log_read(PMEMpoolcheck *ppc)
 	return 0;
 }
 
+/*
+ * log_end_offset -- (internal) return the expected end of the usable log
+ *	space, which is followed by the index of an indexed log
+ */
+static uint64_t
+log_end_offset(PMEMpoolcheck *ppc, struct pool_hdr *hdr)
+{
+	uint64_t size = ppc->pool->set_file->size;
+
+	if (!(le32toh(hdr->incompat_features) & LOG_FORMAT_INCOMPAT_INDEX))
+		return size;
+
+	return size - pmemlog_index_size(size,
+			ppc->pool->hdr.log.index_interval);
+}
+
 /*
  * log_hdr_check -- (internal) check pmemlog header
  */
@@ -119,16 +136,46 @@ log_hdr_check(PMEMpoolcheck *ppc, union location *loc)
 			goto error;
 	}
 
-	if (ppc->pool->hdr.log.end_offset != ppc->pool->set_file->size) {
+	struct pool_hdr hdr;
+	if (pool_read(ppc->pool, &hdr, sizeof(hdr), 0)) {
+		ppc->result = CHECK_RESULT_ERROR;
+		return CHECK_ERR(ppc, "cannot read pool header");
+	}
+
+	struct pmemlog *log = &ppc->pool->hdr.log;
+
+	if (le32toh(hdr.incompat_features) & LOG_FORMAT_INCOMPAT_INDEX &&
+			log->index_interval < LOG_INDEX_MIN_INTERVAL) {
+		CHECK_ERR(ppc, "invalid pmemlog.index_interval: 0x%jx",
+			log->index_interval);
+		goto error;
+	}
+
+	uint64_t d_end_offset = log_end_offset(ppc, &hdr);
+
+	if (ppc->pool->hdr.log.end_offset != d_end_offset) {
 		if (CHECK_ASK(ppc, Q_LOG_END_OFFSET,
 				"invalid pmemlog.end_offset: 0x%jx.|Do you "
 				"want to set pmemlog.end_offset to 0x%jx?",
 				ppc->pool->hdr.log.end_offset,
-				ppc->pool->set_file->size))
+				d_end_offset))
 			goto error;
 	}
 
-	if (ppc->pool->hdr.log.write_offset < d_start_offset ||
+	if (le32toh(hdr.incompat_features) & LOG_FORMAT_INCOMPAT_RING) {
+		/* head and write offsets of a ring log grow without bound */
+		if (log->head_offset < d_start_offset ||
+			log->write_offset < log->head_offset ||
+			log->write_offset - log->head_offset >
+			ppc->pool->set_file->size - d_start_offset) {
+			if (CHECK_ASK(ppc, Q_LOG_RING_OFFSETS,
+					"invalid pmemlog.head_offset: 0x%jx "
+					"or pmemlog.write_offset: 0x%jx.|Do "
+					"you want to discard the log data?",
+					log->head_offset, log->write_offset))
+				goto error;
+		}
+	} else if (ppc->pool->hdr.log.write_offset < d_start_offset ||
 		ppc->pool->hdr.log.write_offset > ppc->pool->set_file->size) {
 		if (CHECK_ASK(ppc, Q_LOG_WRITE_OFFSET,
 				"invalid pmemlog.write_offset: 0x%jx.|Do you "
@@ -160,6 +207,8 @@ log_hdr_fix(PMEMpoolcheck *ppc, struct check_step_data *location,
 	LOG(3, NULL);
 
 	uint64_t d_start_offset;
+	uint64_t d_end_offset;
+	struct pool_hdr hdr;
 
 	switch (question) {
 	case Q_LOG_START_OFFSET:
@@ -171,15 +220,29 @@ log_hdr_fix(PMEMpoolcheck *ppc, struct check_step_data *location,
 		ppc->pool->hdr.log.start_offset = d_start_offset;
 		break;
 	case Q_LOG_END_OFFSET:
+		if (pool_read(ppc->pool, &hdr, sizeof(hdr), 0)) {
+			ppc->result = CHECK_RESULT_ERROR;
+			return CHECK_ERR(ppc, "cannot read pool header");
+		}
+
+		d_end_offset = log_end_offset(ppc, &hdr);
 		CHECK_INFO(ppc, "setting pmemlog.end_offset to 0x%jx",
-			ppc->pool->set_file->size);
-		ppc->pool->hdr.log.end_offset = ppc->pool->set_file->size;
+			d_end_offset);
+		ppc->pool->hdr.log.end_offset = d_end_offset;
 			break;
 	case Q_LOG_WRITE_OFFSET:
 		CHECK_INFO(ppc, "setting pmemlog.write_offset to "
 			"pmemlog.end_offset");
 		ppc->pool->hdr.log.write_offset = ppc->pool->set_file->size;
 		break;
+	case Q_LOG_RING_OFFSETS:
+		d_start_offset = roundup(sizeof(ppc->pool->hdr.log),
+			LOG_FORMAT_DATA_ALIGN);
+		CHECK_INFO(ppc, "setting pmemlog.head_offset and "
+			"pmemlog.write_offset to 0x%jx", d_start_offset);
+		ppc->pool->hdr.log.head_offset = d_start_offset;
+		ppc->pool->hdr.log.write_offset = d_start_offset;
+		break;
 	default:
 		ERR("not implemented question id: %u", question);
 	}
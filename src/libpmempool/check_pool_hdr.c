@@ -256,7 +256,10 @@ pool_hdr_default_check(PMEMpoolcheck *ppc, union location *loc)
 			def_hdr.compat_features);
 	}
 
-	if (hdr.incompat_features != def_hdr.incompat_features) {
+	uint32_t on_demand =
+		pool_hdr_incompat_on_demand(ppc->pool->params.type);
+	if ((hdr.incompat_features & ~on_demand) !=
+			def_hdr.incompat_features) {
 		CHECK_ASK(ppc, Q_DEFAULT_INCOMPAT_FEATURES,
 			"%spool_hdr.incompat_features is not valid.|Do you "
 			"want to set it to default value 0x%x?", loc->prefix,
@@ -311,7 +314,9 @@ pool_hdr_default_fix(PMEMpoolcheck *ppc, struct check_step_data *location,
 	case Q_DEFAULT_INCOMPAT_FEATURES:
 		CHECK_INFO(ppc, "setting pool_hdr.incompat_features to 0x%x",
 			ctx->def_hdr.incompat_features);
-		ctx->hdr.incompat_features = ctx->def_hdr.incompat_features;
+		ctx->hdr.incompat_features = ctx->def_hdr.incompat_features |
+			(ctx->hdr.incompat_features &
+			pool_hdr_incompat_on_demand(ppc->pool->params.type));
 		break;
 	case Q_DEFAULT_RO_COMPAT_FEATURES:
 		CHECK_INFO(ppc, "setting pool_hdr.ro_compat_features to 0x%x",
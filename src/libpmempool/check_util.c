@@ -36,6 +36,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "out.h"
 #include "libpmempool.h"
@@ -206,6 +209,104 @@ check_is_end_util(struct check_data *data)
 	return data->step == CHECK_END;
 }
 
+/*
+ * check_progress_valid -- (internal) check if the progress read from the file
+ *	was persisted by a check of the same pool
+ */
+static int
+check_progress_valid(PMEMpoolcheck *ppc, struct check_progress *progress)
+{
+	struct pool_data *pool = ppc->pool;
+
+	return memcmp(progress->signature, CHECK_PROGRESS_SIG,
+			CHECK_PROGRESS_SIG_LEN) == 0 &&
+		util_checksum(progress, sizeof(*progress),
+			&progress->checksum, 0) &&
+		progress->pool_type == (uint32_t)pool->params.type &&
+		progress->pool_size == pool->params.size &&
+		progress->pool_mtime == (uint64_t)pool->set_file->mtime;
+}
+
+/*
+ * check_progress_open -- open the progress file and read the progress of
+ *	an interrupted check of the pool
+ */
+int
+check_progress_open(PMEMpoolcheck *ppc)
+{
+	LOG(3, NULL);
+
+	struct check_progress *progress = &ppc->progress;
+	memset(progress, 0, sizeof(*progress));
+
+	if (ppc->progress_path == NULL)
+		return 0;
+
+	int fd = open(ppc->progress_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		ERR("!open %s", ppc->progress_path);
+		return -1;
+	}
+
+	if (pread(fd, progress, sizeof(*progress), 0) !=
+			(ssize_t)sizeof(*progress) ||
+			!check_progress_valid(ppc, progress)) {
+		LOG(3, "no valid progress in %s", ppc->progress_path);
+		memset(progress, 0, sizeof(*progress));
+	}
+
+	ppc->progress_fd = fd;
+	return 0;
+}
+
+/*
+ * check_progress_save -- persist the progress of the check
+ *
+ * A failure is not fatal, the check just cannot be resumed from this point.
+ */
+void
+check_progress_save(PMEMpoolcheck *ppc)
+{
+	if (ppc->progress_fd < 0)
+		return;
+
+	struct check_progress *progress = &ppc->progress;
+	struct pool_data *pool = ppc->pool;
+
+	memcpy(progress->signature, CHECK_PROGRESS_SIG,
+		CHECK_PROGRESS_SIG_LEN);
+	progress->step = ppc->data->step;
+	progress->pool_type = (uint32_t)pool->params.type;
+	progress->pool_size = pool->params.size;
+	progress->pool_mtime = (uint64_t)pool->set_file->mtime;
+	util_checksum(progress, sizeof(*progress), &progress->checksum, 1);
+
+	if (pwrite(ppc->progress_fd, progress, sizeof(*progress), 0) !=
+			(ssize_t)sizeof(*progress) ||
+			fdatasync(ppc->progress_fd) != 0)
+		LOG(2, "!cannot persist the progress to %s",
+			ppc->progress_path);
+}
+
+/*
+ * check_progress_close -- close the progress file
+ *
+ * The file is removed once the check has ended, so the next check starts from
+ * the beginning.
+ */
+void
+check_progress_close(PMEMpoolcheck *ppc)
+{
+	if (ppc->progress_fd < 0)
+		return;
+
+	(void) close(ppc->progress_fd);
+	ppc->progress_fd = -1;
+
+	if (check_is_end_util(ppc->data) && unlink(ppc->progress_path) != 0)
+		LOG(2, "!unlink %s", ppc->progress_path);
+}
+
 /*
  * status_alloc -- (internal) allocate and initialize check_status
  */
@@ -81,6 +81,10 @@ struct check_step_data *check_get_step_data(struct check_data *data);
 void check_end(struct check_data *data);
 int check_is_end_util(struct check_data *data);
 
+int check_progress_open(PMEMpoolcheck *ppc);
+void check_progress_save(PMEMpoolcheck *ppc);
+void check_progress_close(PMEMpoolcheck *ppc);
+
 int check_status_create(PMEMpoolcheck *ppc, enum pmempool_check_msg_type type,
 	uint32_t question, const char *fmt, ...);
 void check_status_release(PMEMpoolcheck *ppc, struct check_status *status);
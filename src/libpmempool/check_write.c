@@ -173,6 +173,13 @@ btt_data_write(PMEMpoolcheck *ppc, union location *loc)
 {
 	LOG(3, NULL);
 
+	/*
+	 * nothing to write back, also the maps and flogs of the arenas
+	 * verified by an interrupted check are not read at all
+	 */
+	if (CHECK_WITHOUT_FIXING(ppc))
+		return 0;
+
 	struct arena *arenap;
 
 	TAILQ_FOREACH(arenap, &ppc->pool->arenas, next) {
@@ -35,6 +35,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <errno.h>
 #include <sys/param.h>
@@ -45,6 +46,10 @@
 #include "pool.h"
 #include "check.h"
 
+/* size of the first version of the pmempool_check_args structure */
+#define CHECK_ARGS_MIN_SIZE\
+	offsetof(struct pmempool_check_args, progress_path)
+
 /*
  * libpmempool_init -- load-time initialization for libpmempool
  *
@@ -118,8 +123,10 @@ pmempool_ppc_set_default(PMEMpoolcheck *ppc)
 			.path		= NULL,
 			.backup_path	= NULL,
 			.pool_type	= PMEMPOOL_POOL_TYPE_DETECT,
-			.flags		= 0
+			.flags		= 0,
+			.progress_path	= NULL,
 		},
+		.progress_fd	= -1,
 		.data		= NULL,
 		.pool		= NULL,
 		.result		= CHECK_RESULT_CONSISTENT,
@@ -137,11 +144,11 @@ pmempool_check_init(struct pmempool_check_args *args, size_t args_size)
 		args->backup_path, args->pool_type, args->flags);
 
 	/*
-	 * Currently one size of args structure is supported. The version of the
-	 * pmempool_check_args structure can be distinguished based on provided
-	 * args_size.
+	 * The version of the pmempool_check_args structure can be distinguished
+	 * based on provided args_size. The fields missing from the older
+	 * versions keep their default values.
 	 */
-	if (args_size < sizeof(struct pmempool_check_args)) {
+	if (args_size < CHECK_ARGS_MIN_SIZE) {
 		ERR("provided args_size is not supported");
 		errno = EINVAL;
 		return NULL;
@@ -172,6 +179,20 @@ pmempool_check_init(struct pmempool_check_args *args, size_t args_size)
 		return NULL;
 	}
 
+	/*
+	 * repairs are kept in memory until the end of the check, so only
+	 * a check without repairs can be resumed
+	 */
+	const char *progress_path =
+		args_size >= sizeof(struct pmempool_check_args) ?
+		args->progress_path : NULL;
+	if (util_flag_isset(args->flags, PMEMPOOL_CHECK_REPAIR) &&
+			progress_path != NULL) {
+		ERR("progress_path is applicable only if repair is not set");
+		errno = EINVAL;
+		return NULL;
+	}
+
 	/*
 	 * libpmempool uses str format of communication so it must be set
 	 */
@@ -188,7 +209,7 @@ pmempool_check_init(struct pmempool_check_args *args, size_t args_size)
 	}
 
 	pmempool_ppc_set_default(ppc);
-	memcpy(&ppc->args, args, sizeof(ppc->args));
+	memcpy(&ppc->args, args, MIN(args_size, sizeof(ppc->args)));
 	ppc->path = strdup(args->path);
 	if (!ppc->path) {
 		ERR("!strdup");
@@ -205,6 +226,15 @@ pmempool_check_init(struct pmempool_check_args *args, size_t args_size)
 		ppc->args.backup_path = ppc->backup_path;
 	}
 
+	if (progress_path != NULL) {
+		ppc->progress_path = strdup(progress_path);
+		if (!ppc->progress_path) {
+			ERR("!strdup");
+			goto error_progress_path_malloc;
+		}
+		ppc->args.progress_path = ppc->progress_path;
+	}
+
 	if (check_init(ppc) != 0)
 		goto error_check_init;
 
@@ -215,6 +245,8 @@ error_check_init:
 	if (errno == 0)
 		errno = EINVAL;
 
+	free(ppc->progress_path);
+error_progress_path_malloc:
 	free(ppc->backup_path);
 error_backup_path_malloc:
 	free(ppc->path);
@@ -255,6 +287,7 @@ pmempool_check_end(PMEMpoolcheck *ppc)
 	check_fini(ppc);
 	free(ppc->path);
 	free(ppc->backup_path);
+	free(ppc->progress_path);
 	free(ppc);
 
 	switch (result) {
@@ -51,6 +51,24 @@ enum check_result {
 	CHECK_RESULT_INTERNAL_ERROR
 };
 
+#define CHECK_PROGRESS_SIG "PMEMCHKP"
+#define CHECK_PROGRESS_SIG_LEN 8
+
+/*
+ * check_progress -- progress of a check persisted in the progress file
+ */
+struct check_progress {
+	char signature[CHECK_PROGRESS_SIG_LEN];
+	uint32_t step;		/* check step in progress */
+	uint32_t pool_type;
+	uint64_t pool_size;
+	uint64_t pool_mtime;
+	uint32_t narena;	/* number of arenas with verified Map and Flog */
+	uint32_t reserved;
+	uint64_t offset;	/* offset of the next arena to verify */
+	uint64_t checksum;
+};
+
 /*
  * pmempool_check -- context and arguments for check command
  */
@@ -58,6 +76,9 @@ struct pmempool_check {
 	struct pmempool_check_args args;
 	char *path;
 	char *backup_path;
+	char *progress_path;
+	int progress_fd;	/* -1 if the progress is not persisted */
+	struct check_progress progress;
 
 	struct check_data *data;
 	struct pool_data *pool;
@@ -34,6 +34,10 @@
  * pool.c -- pool processing functions
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/stat.h>
@@ -41,6 +45,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <endian.h>
+#include <sys/param.h>
 
 #include "libpmem.h"
 #include "libpmemlog.h"
@@ -52,6 +57,7 @@
 #include "pool.h"
 #include "lane.h"
 #include "obj.h"
+#include "heap_layout.h"
 #include "btt.h"
 #include "file.h"
 #include "set.h"
@@ -60,6 +66,12 @@
 /* arbitrary size of a maximum file part being read / write at once */
 #define RW_BUFFERING_SIZE (128 * 1024 * 1024)
 
+/* alignment of the free extents skipped while copying the pool */
+#define POOL_SPARSE_ALIGN ((uint64_t)4096)
+
+/* max number of the free extents skipped while copying the pool */
+#define POOL_SPARSE_MAX_EXTENTS ((size_t)1 << 20)
+
 /*
  * pool_btt_lseek -- (internal) perform lseek in BTT file mode
  */
@@ -538,7 +550,8 @@ pool_read(struct pool_data *pool, void *buff, size_t nbytes, uint64_t off)
 		return -1;
 
 	if (pool->params.type != POOL_TYPE_BTT)
-		memcpy(buff, (char *)pool->set_file->addr + off, nbytes);
+		pmem_memcpy_from_pmem(buff,
+			(char *)pool->set_file->addr + off, nbytes);
 	else {
 		if (pool_btt_lseek(pool, (off_t)off, SEEK_SET) == -1)
 			return -1;
@@ -571,11 +584,462 @@ pool_write(struct pool_data *pool, const void *buff, size_t nbytes,
 	return 0;
 }
 
+/*
+ * pool_extents_add -- (internal) append an extent to the sorted list
+ *
+ * Only the page aligned part of the extent is taken into account, so that
+ * the holes may be punched in the copy. Adjacent extents are merged and once
+ * the limit of extents is reached the remaining ones are dropped, which
+ * merely makes the copy less sparse.
+ */
+static int
+pool_extents_add(struct pool_extents *ext, uint64_t off, uint64_t len)
+{
+	uint64_t start = roundup(off, POOL_SPARSE_ALIGN);
+	uint64_t end = (off + len) & ~(POOL_SPARSE_ALIGN - 1);
+	if (end <= start)
+		return 0;
+
+	if (ext->n > 0) {
+		struct pool_extent *last = &ext->e[ext->n - 1];
+		ASSERT(start >= last->off + last->len);
+		if (start == last->off + last->len) {
+			last->len = end - last->off;
+			return 0;
+		}
+	}
+
+	if (ext->n == ext->max) {
+		if (ext->max == POOL_SPARSE_MAX_EXTENTS)
+			return 0;
+
+		size_t max = ext->max ? 2 * ext->max : 64;
+		struct pool_extent *e = realloc(ext->e, max * sizeof(*e));
+		if (!e) {
+			ERR("!realloc");
+			return -1;
+		}
+
+		ext->e = e;
+		ext->max = max;
+	}
+
+	ext->e[ext->n].off = start;
+	ext->e[ext->n].len = end - start;
+	ext->n++;
+
+	return 0;
+}
+
+/*
+ * pool_extents_fini -- release the extents
+ */
+void
+pool_extents_fini(struct pool_extents *ext)
+{
+	free(ext->e);
+	ext->e = NULL;
+	ext->n = 0;
+	ext->max = 0;
+}
+
+/*
+ * pool_obj_zone_free -- (internal) collect the free chunks of the zone
+ *
+ * The chunk headers are verified before anything is collected, the zone is
+ * copied as a whole if they do not describe it consistently.
+ */
+static int
+pool_obj_zone_free(struct pool_extents *ext, uint64_t base,
+	struct zone *z, uint64_t zone_end)
+{
+	uint32_t size_idx = z->header.size_idx;
+	if (size_idx > MAX_CHUNK || (uintptr_t)&z->chunks[size_idx] -
+			(uintptr_t)base > zone_end)
+		return 0;
+
+	uint32_t c = 0;
+	while (c < size_idx) {
+		struct chunk_header *hdr = &z->chunk_headers[c];
+		if (hdr->size_idx == 0 || hdr->size_idx > size_idx - c)
+			return 0;
+
+		if (hdr->type != CHUNK_TYPE_FREE &&
+			hdr->type != CHUNK_TYPE_USED &&
+			hdr->type != CHUNK_TYPE_RUN)
+			return 0;
+
+		c += hdr->size_idx;
+	}
+
+	for (c = 0; c < size_idx; c += z->chunk_headers[c].size_idx) {
+		if (z->chunk_headers[c].type != CHUNK_TYPE_FREE)
+			continue;
+
+		uint64_t off = (uintptr_t)&z->chunks[c] - (uintptr_t)base;
+		if (pool_extents_add(ext, off,
+				z->chunk_headers[c].size_idx * CHUNKSIZE))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * pool_obj_free_extents -- (internal) collect free extents of the obj heap
+ *
+ * The free chunks and the zones which have never been initialized are free,
+ * nothing is collected unless the pool descriptor and the heap header look
+ * sane.
+ */
+static int
+pool_obj_free_extents(struct pool_data *pool, struct pool_extents *ext)
+{
+	PMEMobjpool *pop = pool->set_file->addr;
+	uint64_t size = pool->set_file->size;
+	if (size < sizeof(*pop))
+		return 0;
+
+	void *dscp = (char *)pop + sizeof(struct pool_hdr);
+	if (!util_checksum(dscp, OBJ_DSC_P_SIZE, &pop->checksum, 0))
+		return 0;
+
+	uint64_t heap_end = pop->heap_offset + pop->heap_size;
+	if (pop->heap_size < HEAP_MIN_SIZE || heap_end < pop->heap_offset ||
+			heap_end > size)
+		return 0;
+
+	struct heap_layout *layout =
+		(struct heap_layout *)((char *)pop + pop->heap_offset);
+	if (memcmp(layout->header.signature, HEAP_SIGNATURE,
+			HEAP_SIGNATURE_LEN) != 0)
+		return 0;
+
+	unsigned max_zone = 0;
+	uint64_t heap_size = pop->heap_size - sizeof(struct heap_header);
+	while (heap_size >= ZONE_MIN_SIZE) {
+		max_zone++;
+		heap_size -= heap_size <= ZONE_MAX_SIZE ?
+			heap_size : ZONE_MAX_SIZE;
+	}
+
+	/* zones past the high-water mark have never been initialized */
+	uint64_t mark = layout->zone0.header.zones_valid;
+	unsigned valid = max_zone;
+	if (mark != 0 && mark - 1 <= max_zone)
+		valid = (unsigned)(mark - 1);
+
+	for (unsigned i = 0; i < max_zone; i++) {
+		struct zone *z = ZID_TO_ZONE(layout, i);
+		uint64_t zone_off = (uintptr_t)z - (uintptr_t)pop;
+		uint64_t zone_end = min(zone_off + ZONE_MAX_SIZE, heap_end);
+
+		if (i >= valid || (mark != 0 &&
+				z->header.magic != ZONE_HEADER_MAGIC)) {
+			/* the header of zone 0 holds the high-water mark */
+			if (i == 0)
+				zone_off += sizeof(struct zone_header);
+
+			if (pool_extents_add(ext, zone_off,
+					zone_end - zone_off))
+				return -1;
+		} else if (z->header.magic == ZONE_HEADER_MAGIC) {
+			if (pool_obj_zone_free(ext, (uintptr_t)pop, z,
+					zone_end))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * pool_btt_arena_free -- (internal) collect free blocks of the BTT arena
+ *
+ * A data block is free unless it is referenced by a map entry of a written
+ * block or by any flog entry. The blocks in the zero or initial state read
+ * as zeros regardless of their content. Returns 1 if the arena cannot be
+ * trusted.
+ */
+static int
+pool_btt_arena_free(struct pool_data *pool, struct pool_extents *ext,
+	uint64_t offset, struct btt_info *info, void *buf)
+{
+	uint64_t lbasize = info->internal_lbasize;
+	uint64_t dataend = info->dataoff + info->internal_nlba * lbasize;
+	uint64_t flogsize = btt_flog_size(info->nfree);
+	if (lbasize == 0 || info->external_nlba > info->internal_nlba ||
+		info->nfree == 0 || dataend > info->mapoff ||
+		info->mapoff + (uint64_t)info->external_nlba *
+			BTT_MAP_ENTRY_SIZE > info->flogoff ||
+		info->flogoff + flogsize > info->infooff ||
+		offset + info->infooff + sizeof(*info) >
+			pool->set_file->size ||
+		flogsize > RW_BUFFERING_SIZE)
+		return 1;
+
+	uint8_t *used = calloc(howmany(info->internal_nlba, 8), 1);
+	if (!used) {
+		ERR("!calloc");
+		return -1;
+	}
+
+	int ret = 0;
+	const uint64_t nentries = RW_BUFFERING_SIZE / BTT_MAP_ENTRY_SIZE;
+	for (uint64_t lba = 0; lba < info->external_nlba; lba += nentries) {
+		uint64_t n = min(nentries, info->external_nlba - lba);
+		if (pool_read(pool, buf, n * BTT_MAP_ENTRY_SIZE, offset +
+				info->mapoff + lba * BTT_MAP_ENTRY_SIZE)) {
+			ret = 1;
+			goto out;
+		}
+
+		uint32_t *map = buf;
+		for (uint64_t i = 0; i < n; i++) {
+			uint32_t entry = le32toh(map[i]);
+			uint32_t flags = entry & ~BTT_MAP_ENTRY_LBA_MASK;
+			if (flags == 0 || flags == BTT_MAP_ENTRY_ZERO)
+				continue;
+
+			uint32_t postmap = entry & BTT_MAP_ENTRY_LBA_MASK;
+			if (postmap >= info->internal_nlba) {
+				ret = 1;
+				goto out;
+			}
+			setbit(used, postmap);
+		}
+	}
+
+	if (pool_read(pool, buf, flogsize, offset + info->flogoff)) {
+		ret = 1;
+		goto out;
+	}
+
+	uint8_t *ptr = buf;
+	for (uint32_t i = 0; i < info->nfree; i++) {
+		struct btt_flog *flog = (struct btt_flog *)ptr;
+		for (int f = 0; f < 2; f++) {
+			uint32_t maps[2] = {
+				le32toh(flog[f].old_map) &
+					BTT_MAP_ENTRY_LBA_MASK,
+				le32toh(flog[f].new_map) &
+					BTT_MAP_ENTRY_LBA_MASK,
+			};
+
+			for (int m = 0; m < 2; m++) {
+				if (maps[m] >= info->internal_nlba) {
+					ret = 1;
+					goto out;
+				}
+				setbit(used, maps[m]);
+			}
+		}
+
+		ptr += BTT_FLOG_PAIR_ALIGN;
+	}
+
+	uint64_t data = offset + info->dataoff;
+	for (uint64_t b = 0; b < info->internal_nlba; ) {
+		if (isset(used, b)) {
+			b++;
+			continue;
+		}
+
+		uint64_t first = b;
+		while (b < info->internal_nlba && isclr(used, b))
+			b++;
+
+		if (pool_extents_add(ext, data + first * lbasize,
+				(b - first) * lbasize)) {
+			ret = -1;
+			goto out;
+		}
+	}
+
+out:
+	free(used);
+	return ret;
+}
+
+/*
+ * pool_btt_free_extents -- (internal) collect free blocks of all BTT arenas
+ */
+static int
+pool_btt_free_extents(struct pool_data *pool, struct pool_extents *ext)
+{
+	void *buf = malloc(RW_BUFFERING_SIZE);
+	if (!buf) {
+		ERR("!malloc");
+		return -1;
+	}
+
+	uint64_t offset = BTT_ALIGNMENT;
+	if (pool->params.type == POOL_TYPE_BLK)
+		offset += BTT_ALIGNMENT;
+
+	int ret = 0;
+	while (offset < pool->set_file->size) {
+		struct btt_info info;
+		if (pool_read(pool, &info, sizeof(info), offset) ||
+				!pool_btt_info_valid(&info))
+			break;
+
+		btt_info_convert2h(&info);
+		ret = pool_btt_arena_free(pool, ext, offset, &info, buf);
+		if (ret) {
+			/* the rest of the pool is copied as is */
+			ret = ret < 0 ? -1 : 0;
+			break;
+		}
+
+		if (info.nextoff == 0)
+			break;
+		offset += info.nextoff;
+	}
+
+	free(buf);
+	return ret;
+}
+
+/*
+ * pool_free_extents -- collect extents of the pool which need not be copied
+ *
+ * The obj heap chunk headers or the BTT maps are consulted to find the free
+ * space of the pool. Anything which does not look consistent is considered
+ * used, so the collected extents may be empty but are never wrong for a pool
+ * which is not being modified.
+ */
+void
+pool_free_extents(struct pool_data *pool, struct pool_extents *ext)
+{
+	ext->n = 0;
+	ext->max = 0;
+	ext->e = NULL;
+
+	int ret = 0;
+	switch (pool->params.type) {
+	case POOL_TYPE_OBJ:
+		ret = pool_obj_free_extents(pool, ext);
+		break;
+	case POOL_TYPE_BLK:
+	case POOL_TYPE_BTT:
+		ret = pool_btt_free_extents(pool, ext);
+		break;
+	default:
+		break;
+	}
+
+	if (ret)
+		pool_extents_fini(ext);
+}
+
+/*
+ * pool_extents_find -- (internal) find the first extent ending after off
+ */
+static size_t
+pool_extents_find(const struct pool_extents *ext, uint64_t off)
+{
+	size_t lo = 0;
+	size_t hi = ext->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ext->e[mid].off + ext->e[mid].len <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * pool_copy_dst -- destination of the pool copy
+ */
+struct pool_copy_dst {
+	char *addr;	/* address corresponding to the pool offset 0 */
+	int is_pmem;
+	int fd;		/* descriptor used to punch holes, -1 if none */
+	int64_t fdoff;	/* file offset corresponding to the pool offset 0 */
+};
+
+/*
+ * pool_copy_punch -- (internal) deallocate the free range of the copy
+ *
+ * The copy is zeroed already, so it is not an error if the file system
+ * does not support punching holes.
+ */
+static void
+pool_copy_punch(struct pool_copy_dst *dst, uint64_t off, uint64_t len)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+	if (dst->fd >= 0)
+		(void) fallocate(dst->fd,
+			FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			(off_t)((int64_t)off + dst->fdoff), (off_t)len);
+#endif
+}
+
+/*
+ * pool_copy_range -- (internal) copy the used part of the range of the pool
+ *
+ * The range is read from saddr, which corresponds to the pool offset off,
+ * or from the BTT device if saddr is NULL. The free extents are skipped,
+ * the destination of which reads as zeros.
+ */
+static int
+pool_copy_range(struct pool_data *pool, struct pool_copy_dst *dst,
+	const char *saddr, uint64_t off, uint64_t len,
+	const struct pool_extents *free)
+{
+	uint64_t end = off + len;
+	size_t i = pool_extents_find(free, off);
+
+	while (off < end) {
+		uint64_t used_end = end;
+		if (i < free->n && free->e[i].off < end)
+			used_end = MAX(free->e[i].off, off);
+
+		uint64_t n = used_end - off;
+		char *d = dst->addr + off;
+		if (saddr == NULL) {
+			for (uint64_t done = 0; done < n; ) {
+				size_t chunk = min(n - done, RW_BUFFERING_SIZE);
+				if (pool_read(pool, d + done, chunk,
+						off + done))
+					return -1;
+				done += chunk;
+			}
+		} else if (dst->is_pmem) {
+			pmem_memcpy_nodrain(d, saddr, n);
+		} else {
+			memcpy(d, saddr, n);
+		}
+
+		if (saddr)
+			saddr += n;
+		off = used_end;
+		if (off == end)
+			break;
+
+		uint64_t free_end = min(free->e[i].off + free->e[i].len, end);
+		pool_copy_punch(dst, off, free_end - off);
+		if (saddr)
+			saddr += free_end - off;
+		off = free_end;
+		i++;
+	}
+
+	return 0;
+}
+
 /*
  * pool_copy -- make a copy of the pool
+ *
+ * The free extents of the pool are not copied.
  */
 int
-pool_copy(struct pool_data *pool, const char *dst_path)
+pool_copy(struct pool_data *pool, const char *dst_path,
+	const struct pool_extents *free)
 {
 	struct pool_set_file *file = pool->set_file;
 	int dfd = util_file_create(dst_path, file->size, 0);
@@ -601,32 +1065,23 @@ pool_copy(struct pool_data *pool, const char *dst_path)
 		goto out_close;
 	}
 
-	if (pool->params.type != POOL_TYPE_BTT) {
-		void *saddr = pool_set_file_map(file, 0);
-		memcpy(daddr, saddr, file->size);
-		goto out_unmap;
-	}
-
-	void *buf = malloc(RW_BUFFERING_SIZE);
-	if (buf == NULL) {
-		ERR("!malloc");
-		result = -1;
-		goto out_unmap;
-	}
+	struct pool_copy_dst dst = {
+		.addr = daddr,
+		.is_pmem = pmem_is_pmem(daddr, file->size),
+		.fd = dfd,
+		.fdoff = 0,
+	};
 
-	pool_btt_lseek(pool, 0, SEEK_SET);
-	ssize_t buf_read = 0;
-	void *dst = daddr;
-	while ((buf_read = pool_btt_read(pool, buf, RW_BUFFERING_SIZE))) {
-		if (buf_read == -1)
-			break;
+	const char *saddr = NULL;
+	if (pool->params.type != POOL_TYPE_BTT)
+		saddr = pool_set_file_map(file, 0);
 
-		memcpy(dst, buf, (size_t)buf_read);
-		dst  = (void *)((ssize_t)dst + buf_read);
-	}
+	result = pool_copy_range(pool, &dst, saddr, 0, file->size, free);
+	if (dst.is_pmem)
+		pmem_drain();
+	else if (pmem_msync(daddr, file->size))
+		result = -1;
 
-	free(buf);
-out_unmap:
 	munmap(daddr, file->size);
 out_close:
 	if (dfd >= 0)
@@ -636,9 +1091,13 @@ out_close:
 
 /*
  * pool_set_part_copy -- make a copy of the poolset part
+ *
+ * Only the part of the file mapped as a fragment of the pool may contain
+ * free extents, the part header and the unaligned tail are always copied.
  */
 int
-pool_set_part_copy(struct pool_set_part *dpart, struct pool_set_part *spart)
+pool_set_part_copy(struct pool_data *pool, struct pool_set_part *dpart,
+	struct pool_set_part *spart, const struct pool_extents *free)
 {
 	LOG(3, "dpart %p spart %p", dpart, spart);
 
@@ -665,13 +1124,51 @@ pool_set_part_copy(struct pool_set_part *dpart, struct pool_set_part *spart)
 		goto out_sunmap;
 	}
 
+	/* file offset and length of the part of the pool in this file */
+	uint64_t pstart = 0;
+	uint64_t plen = spart->filesize & ~(Mmap_align - 1);
+	if (spart->addr != pool->set_file->addr) {
+		pstart = Mmap_align;
+		plen = spart->size;
+	}
+	if (pstart + plen > smapped)
+		plen = 0;
+
+	uint64_t poff = (uint64_t)((uintptr_t)spart->addr -
+		(uintptr_t)pool->set_file->addr);
+
+	struct pool_copy_dst dst = {
+		.addr = (char *)daddr + pstart - poff,
+		.is_pmem = is_pmem,
+		.fd = -1,
+		.fdoff = (int64_t)pstart - (int64_t)poff,
+	};
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+	dst.fd = open(dpart->path, O_RDWR);
+#endif
+
+	const char *s = saddr;
 	if (is_pmem) {
-		pmem_memcpy_persist(daddr, saddr, smapped);
+		pmem_memcpy_nodrain(daddr, s, pstart);
+		pmem_memcpy_nodrain((char *)daddr + pstart + plen,
+			s + pstart + plen, smapped - pstart - plen);
 	} else {
-		memcpy(daddr, saddr, smapped);
-		pmem_msync(daddr, smapped);
+		memcpy(daddr, s, pstart);
+		memcpy((char *)daddr + pstart + plen, s + pstart + plen,
+			smapped - pstart - plen);
 	}
 
+	result = pool_copy_range(pool, &dst, s + pstart, poff, plen, free);
+
+	if (dst.fd >= 0)
+		close(dst.fd);
+
+	if (is_pmem)
+		pmem_drain();
+	else if (pmem_msync(daddr, smapped))
+		result = -1;
+
 	pmem_unmap(daddr, dmapped);
 out_sunmap:
 	pmem_unmap(saddr, smapped);
@@ -820,7 +1317,8 @@ pool_hdr_default(enum pool_type type, struct pool_hdr *hdrp)
 	case POOL_TYPE_OBJ:
 		hdrp->major = OBJ_FORMAT_MAJOR;
 		hdrp->compat_features = OBJ_FORMAT_COMPAT;
-		hdrp->incompat_features = OBJ_FORMAT_INCOMPAT;
+		hdrp->incompat_features = OBJ_FORMAT_INCOMPAT |
+			OBJ_FORMAT_INCOMPAT_ZONES_VALID;
 		hdrp->ro_compat_features = OBJ_FORMAT_RO_COMPAT;
 		break;
 	default:
@@ -828,6 +1326,16 @@ pool_hdr_default(enum pool_type type, struct pool_hdr *hdrp)
 	}
 }
 
+/*
+ * pool_hdr_incompat_on_demand -- return the incompat features which are set
+ *	on their first use rather than when the pool is created
+ */
+uint32_t
+pool_hdr_incompat_on_demand(enum pool_type type)
+{
+	return type == POOL_TYPE_OBJ ? OBJ_FORMAT_INCOMPAT_ON_DEMAND : 0;
+}
+
 /*
  * pool_hdr_get_type -- return pool type based on pool header data
  */
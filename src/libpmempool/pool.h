@@ -115,6 +115,19 @@ struct pool_data {
 	uint32_t narenas;
 };
 
+/*
+ * pool_extents -- sorted, disjoint extents of the pool, described by their
+ * offsets from the beginning of the pool
+ */
+struct pool_extents {
+	size_t n;
+	size_t max;
+	struct pool_extent {
+		uint64_t off;
+		uint64_t len;
+	} *e;
+};
+
 struct pool_data *pool_data_alloc(PMEMpoolcheck *ppc);
 void pool_data_free(struct pool_data *pool);
 void pool_params_from_header(struct pool_params *params,
@@ -126,9 +139,12 @@ int pool_read(struct pool_data *pool, void *buff, size_t nbytes,
 	uint64_t off);
 int pool_write(struct pool_data *pool, const void *buff, size_t nbytes,
 	uint64_t off);
-int pool_copy(struct pool_data *pool, const char *dst_path);
-int pool_set_part_copy(struct pool_set_part *dpart,
-	struct pool_set_part *spart);
+void pool_free_extents(struct pool_data *pool, struct pool_extents *ext);
+void pool_extents_fini(struct pool_extents *ext);
+int pool_copy(struct pool_data *pool, const char *dst_path,
+	const struct pool_extents *free);
+int pool_set_part_copy(struct pool_data *pool, struct pool_set_part *dpart,
+	struct pool_set_part *spart, const struct pool_extents *free);
 int pool_memset(struct pool_data *pool, uint64_t off, int c, size_t count);
 
 unsigned pool_set_files_count(struct pool_set_file *file);
@@ -136,6 +152,7 @@ int pool_set_file_map_headers(struct pool_set_file *file, int rdonly);
 void pool_set_file_unmap_headers(struct pool_set_file *file);
 
 void pool_hdr_default(enum pool_type type, struct pool_hdr *hdrp);
+uint32_t pool_hdr_incompat_on_demand(enum pool_type type);
 enum pool_type pool_hdr_get_type(const struct pool_hdr *hdrp);
 
 int pool_btt_info_valid(struct btt_info *infop);
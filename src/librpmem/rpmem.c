@@ -49,6 +49,7 @@
 #include "rpmem_obc.h"
 #include "rpmem_fip.h"
 #include "rpmem_fip_common.h"
+#include "usdt.h"
 
 /*
  * rpmem_pool -- remote pool context
@@ -260,8 +261,13 @@ rpmem_common_fip_init(RPMEMpool *rpp, struct rpmem_req_attr *req,
 		.nlanes		= min(*nlanes, resp->nlanes),
 		.raddr		= (void *)resp->raddr,
 		.rkey		= resp->rkey,
+		.stats		= 0,
 	};
 
+	int stats;
+	if (env_get_bool(RPMEM_STATS_ENV, &stats) == 0)
+		fip_attr.stats = stats != 0;
+
 	ssize_t sret = snprintf(rpp->fip_service, sizeof(rpp->fip_service),
 			"%u", resp->port);
 	if (sret <= 0) {
@@ -508,7 +514,165 @@ rpmem_persist(RPMEMpool *rpp, size_t offset, size_t length, unsigned lane)
 		return -1;
 	}
 
+	USDT_PROBE4(librpmem, persist, rpp, offset, length, lane);
+
 	int ret = rpmem_fip_persist(rpp->fip, offset, length, lane);
+
+	USDT_PROBE2(librpmem, persist_done, rpp, ret);
+
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_persistv -- persist several ranges on target node using a single
+ * round trip
+ *
+ * rpp           -- remote pool handle
+ * ranges        -- array of ranges to persist
+ * nranges       -- number of ranges
+ * lane          -- lane number
+ */
+int
+rpmem_persistv(RPMEMpool *rpp, const struct rpmem_range *ranges,
+	unsigned nranges, unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	if (nranges == 0)
+		return 0;
+
+	int ret = rpmem_fip_persistv(rpp->fip, ranges, nranges, lane);
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_persist_async -- post persist operation on target node without
+ * waiting for its completion
+ *
+ * rpp           -- remote pool handle
+ * offset        -- offset in pool
+ * length        -- length of persist operation
+ * lane          -- lane number
+ */
+int
+rpmem_persist_async(RPMEMpool *rpp, size_t offset, size_t length,
+	unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	int ret = rpmem_fip_persist_post(rpp->fip, offset, length, lane);
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_flush -- write data to target node without making it persistent
+ *
+ * rpp           -- remote pool handle
+ * offset        -- offset in pool
+ * length        -- length of flush operation
+ * lane          -- lane number
+ */
+int
+rpmem_flush(RPMEMpool *rpp, size_t offset, size_t length, unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	int ret = rpmem_fip_flush(rpp->fip, offset, length, lane);
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_drain -- make all data flushed on lane persistent on target node
+ *
+ * rpp           -- remote pool handle
+ * lane          -- lane number
+ */
+int
+rpmem_drain(RPMEMpool *rpp, unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	int ret = rpmem_fip_drain(rpp->fip, lane);
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * rpmem_poll -- check whether persist operation posted on lane has
+ * completed, returns 1 if it has and 0 if it is still in flight
+ *
+ * rpp           -- remote pool handle
+ * lane          -- lane number
+ */
+int
+rpmem_poll(RPMEMpool *rpp, unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	int done;
+	int ret = rpmem_fip_persist_poll(rpp->fip, lane, &done);
+	if (unlikely(ret)) {
+		rpp->error = ret;
+		return -1;
+	}
+
+	return done;
+}
+
+/*
+ * rpmem_wait -- wait for persist operation posted on lane
+ *
+ * rpp           -- remote pool handle
+ * lane          -- lane number
+ */
+int
+rpmem_wait(RPMEMpool *rpp, unsigned lane)
+{
+	if (unlikely(rpp->error)) {
+		errno = rpp->error;
+		return -1;
+	}
+
+	int ret = rpmem_fip_persist_wait(rpp->fip, lane);
 	if (unlikely(ret)) {
 		rpp->error = ret;
 		return -1;
@@ -541,3 +705,28 @@ rpmem_read(RPMEMpool *rpp, void *buff, size_t offset, size_t length)
 
 	return 0;
 }
+
+/*
+ * rpmem_stats_get -- read persist statistics of a lane, or summed over all
+ * lanes if lane is RPMEM_ALL_LANES
+ *
+ * rpp           -- remote pool handle
+ * lane          -- lane number or RPMEM_ALL_LANES
+ * stats         -- output statistics
+ */
+int
+rpmem_stats_get(RPMEMpool *rpp, unsigned lane, struct rpmem_stats *stats)
+{
+	return rpmem_fip_stats_get(rpp->fip, lane, stats);
+}
+
+/*
+ * rpmem_stats_reset -- clear persist statistics of all lanes
+ *
+ * rpp           -- remote pool handle
+ */
+int
+rpmem_stats_reset(RPMEMpool *rpp)
+{
+	return rpmem_fip_stats_reset(rpp->fip);
+}
@@ -51,6 +51,7 @@
 #include <rdma/fi_errno.h>
 #include <rdma/fi_rma.h>
 
+#include "librpmem.h"
 #include "out.h"
 #include "util.h"
 #include "rpmem_common.h"
@@ -59,7 +60,9 @@
 #include "rpmem_util.h"
 #include "rpmem_fip_msg.h"
 #include "rpmem_fip_lane.h"
+#include "rpmem_stats.h"
 #include "rpmem_fip.h"
+#include "sys_util.h"
 
 #define RPMEM_FI_ERR(e, fmt, args...)\
 	RPMEM_LOG(ERR, fmt ": %s", ## args, fi_strerror((e)))
@@ -72,10 +75,13 @@
 	ret;\
 })
 
-#define RPMEM_RD_BUFF_SIZE 8192
+#define RPMEM_RD_NLANES 4 /* number of outstanding READs in read operation */
+#define RPMEM_RD_BUFF_SIZE 65536 /* bounce buffer size per read lane */
+#define RPMEM_RD_DIRECT_SIZE (1 << 20) /* max READ directly into the pool */
+#define RPMEM_FIP_INJECT_MAX 256 /* upper bound for injected WRITEs */
 
-typedef int (*rpmem_fip_persist_fn)(struct rpmem_fip *fip, size_t offset,
-		size_t len, unsigned lane);
+typedef int (*rpmem_fip_commit_fn)(struct rpmem_fip *fip, size_t start,
+		size_t end, unsigned lane);
 
 typedef int (*rpmem_fip_process_fn)(struct rpmem_fip *fip,
 		void *context, uint64_t flags);
@@ -87,7 +93,9 @@ typedef void (*rpmem_fip_fini_fn)(struct rpmem_fip *fip);
  * rpmem_fip_ops -- operations specific for persistency method
  */
 struct rpmem_fip_ops {
-	rpmem_fip_persist_fn persist;
+	rpmem_fip_commit_fn commit;	/* posts a persist of the WRITEs */
+	uint64_t event;			/* signaled when persist completes */
+	uint64_t busy;			/* pending while lane is in use */
 	rpmem_fip_process_fn process;
 	rpmem_fip_init_fn lanes_init;
 	rpmem_fip_fini_fn lanes_fini;
@@ -95,11 +103,29 @@ struct rpmem_fip_ops {
 };
 
 /*
- * rpmem_fip_plane_apm -- persist operation's lane for APM
+ * rpmem_fip_plane -- persist operation's lane, part common for all
+ * persistency methods
+ *
+ * The WRITEs posted since the last persist are tracked so a single
+ * persist can cover all of them.
  */
-struct rpmem_fip_plane_apm {
+struct rpmem_fip_plane {
 	struct rpmem_fip_lane lane;	/* base lane structure */
 	struct rpmem_fip_rma write;	/* WRITE message */
+	unsigned nwrites;	/* number of WRITEs not persisted yet */
+	size_t start;		/* lowest offset of these WRITEs */
+	size_t end;		/* highest end offset of these WRITEs */
+
+	struct rpmem_stats stats; /* statistics, updated by lane's user */
+	uint64_t post_ns;	/* when the pending persist was posted */
+	volatile uint64_t done_ns; /* when the pending persist completed */
+};
+
+/*
+ * rpmem_fip_plane_apm -- persist operation's lane for APM
+ */
+struct rpmem_fip_plane_apm {
+	struct rpmem_fip_plane base;	/* common lane structure */
 	struct rpmem_fip_rma read;	/* READ message */
 };
 
@@ -107,8 +133,7 @@ struct rpmem_fip_plane_apm {
  * rpmem_fip_plane_gpspm -- persist operation's lane for GPSPM
  */
 struct rpmem_fip_plane_gpspm {
-	struct rpmem_fip_lane lane;	/* base lane structure */
-	struct rpmem_fip_rma write;	/* WRITE message */
+	struct rpmem_fip_plane base;	/* common lane structure */
 	struct rpmem_fip_msg send;	/* SEND message */
 };
 
@@ -120,8 +145,30 @@ struct rpmem_fip_rlane {
 	struct rpmem_fip_rma read;	/* READ message */
 };
 
+/*
+ * rpmem_fip_shared -- fabric and access domain shared by all connections
+ * opened through the same provider, fabric and domain
+ *
+ * Opening an access domain allocates a device context and protection
+ * domain, so connections of many pools replicated to the same target use
+ * a single one. Each pool still registers its own memory regions.
+ */
+struct rpmem_fip_shared {
+	struct rpmem_fip_shared *next;
+	char *prov_name;	/* provider name */
+	char *fabric_name;	/* fabric name */
+	char *domain_name;	/* access domain name */
+	struct fid_fabric *fabric; /* fabric domain */
+	struct fid_domain *domain; /* fabric protection domain */
+	unsigned refcnt;	/* number of connections using it */
+};
+
+static struct rpmem_fip_shared *Shared;
+static pthread_mutex_t Shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct rpmem_fip {
 	struct fi_info *fi; /* fabric interface information */
+	struct rpmem_fip_shared *shared; /* shared fabric and domain */
 	struct fid_fabric *fabric; /* fabric domain */
 	struct fid_domain *domain; /* fabric protection domain */
 	struct fid_eq *eq; /* event queue */
@@ -138,6 +185,8 @@ struct rpmem_fip {
 	size_t size;	/* memory size */
 	struct fid_mr *mr; /* local memory region */
 	void *mr_desc;	/* local memory descriptor */
+	size_t inject_size; /* max WRITE length sent inline */
+	int stats;	/* collect persist statistics */
 
 	enum rpmem_persist_method persist_method;
 	struct rpmem_fip_ops *ops;
@@ -148,8 +197,9 @@ struct rpmem_fip {
 		struct rpmem_fip_plane_gpspm *gpspm;
 	} lanes;
 
-	struct rpmem_fip_rlane rd_lane; /* lane for read operation */
-	void *rd_buff;		/* buffer for read operation */
+	/* lanes for read operation */
+	struct rpmem_fip_rlane rd_lanes[RPMEM_RD_NLANES];
+	void *rd_buff;		/* buffers for read operation, one per lane */
 	struct fid_mr *rd_mr;	/* read buffer memory region */
 	void *rd_mr_desc;	/* read buffer memory descriptor */
 
@@ -170,6 +220,20 @@ struct rpmem_fip {
 	pthread_t process_thread;	/* processing thread */
 };
 
+/*
+ * rpmem_fip_write -- (internal) post unsignaled WRITE of the memory region,
+ * injecting it if it is small enough
+ */
+static inline int
+rpmem_fip_write(struct rpmem_fip *fip, struct rpmem_fip_rma *rma,
+	const void *laddr, size_t len, uint64_t raddr)
+{
+	if (len <= fip->inject_size)
+		return rpmem_fip_inject_write(fip->ep, rma, laddr, len, raddr);
+
+	return rpmem_fip_writemsg(fip->ep, rma, laddr, len, raddr);
+}
+
 /*
  * rpmem_fip_set_nlanes -- (internal) set maximum number of lanes supported
  */
@@ -179,6 +243,10 @@ rpmem_fip_set_nlanes(struct rpmem_fip *fip, unsigned nlanes)
 	size_t max_nlanes = rpmem_fip_max_nlanes(fip->fi,
 			fip->persist_method, RPMEM_FIP_NODE_CLIENT);
 
+	/* the read lanes beyond the first one are taken from the maximum */
+	RPMEM_ASSERT(max_nlanes > RPMEM_RD_NLANES);
+	max_nlanes -= RPMEM_RD_NLANES - 1;
+
 	/*
 	 * Get minimum of maximum supported and number of
 	 * lanes requested caller.
@@ -211,6 +279,14 @@ rpmem_fip_getinfo(struct rpmem_fip *fip, const char *node, const char *service,
 
 	rpmem_fip_print_info(fip->fi);
 
+	/*
+	 * Small WRITEs are injected, so the payload goes inline in the work
+	 * request instead of being fetched from the registered pool.
+	 */
+	fip->inject_size = fip->fi->tx_attr->inject_size;
+	if (fip->inject_size > RPMEM_FIP_INJECT_MAX)
+		fip->inject_size = RPMEM_FIP_INJECT_MAX;
+
 	/* fallback to free the hints */
 err_fi_getinfo:
 	fi_freeinfo(hints);
@@ -219,24 +295,144 @@ err_hints:
 }
 
 /*
- * rpmem_fip_init_fabric_res -- (internal) initialize common fabric resources
+ * rpmem_fip_streq -- (internal) compare names which may be NULL
  */
-static int
-rpmem_fip_init_fabric_res(struct rpmem_fip *fip)
+static inline int
+rpmem_fip_streq(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return strcmp(a, b) == 0;
+}
+
+/*
+ * rpmem_fip_strdup -- (internal) duplicate name which may be NULL
+ */
+static inline int
+rpmem_fip_strdup(char **dst, const char *src)
 {
+	*dst = NULL;
+	if (!src)
+		return 0;
+
+	*dst = strdup(src);
+	return *dst ? 0 : -1;
+}
+
+/*
+ * rpmem_fip_shared_get -- (internal) get fabric and access domain for the
+ * fabric interface, opening them if there are none yet
+ */
+static struct rpmem_fip_shared *
+rpmem_fip_shared_get(struct fi_info *fi)
+{
+	struct rpmem_fip_shared *shared;
 	int ret;
-	ret = fi_fabric(fip->fi->fabric_attr, &fip->fabric, NULL);
+
+	util_mutex_lock(&Shared_lock);
+
+	for (shared = Shared; shared; shared = shared->next) {
+		if (rpmem_fip_streq(shared->prov_name,
+				fi->fabric_attr->prov_name) &&
+			rpmem_fip_streq(shared->fabric_name,
+				fi->fabric_attr->name) &&
+			rpmem_fip_streq(shared->domain_name,
+				fi->domain_attr->name)) {
+			shared->refcnt++;
+			goto out;
+		}
+	}
+
+	shared = calloc(1, sizeof(*shared));
+	if (!shared) {
+		RPMEM_LOG(ERR, "!allocating shared fabric resources");
+		goto out;
+	}
+
+	if (rpmem_fip_strdup(&shared->prov_name, fi->fabric_attr->prov_name) ||
+		rpmem_fip_strdup(&shared->fabric_name,
+				fi->fabric_attr->name) ||
+		rpmem_fip_strdup(&shared->domain_name,
+				fi->domain_attr->name)) {
+		RPMEM_LOG(ERR, "!copying fabric interface names");
+		goto err_strdup;
+	}
+
+	ret = fi_fabric(fi->fabric_attr, &shared->fabric, NULL);
 	if (ret) {
 		RPMEM_FI_ERR(ret, "opening fabric domain");
 		goto err_fi_fabric;
 	}
 
-	ret = fi_domain(fip->fabric, fip->fi, &fip->domain, NULL);
+	ret = fi_domain(shared->fabric, fi, &shared->domain, NULL);
 	if (ret) {
 		RPMEM_FI_ERR(ret, "opening fabric access domain");
 		goto err_fi_domain;
 	}
 
+	shared->refcnt = 1;
+	shared->next = Shared;
+	Shared = shared;
+out:
+	util_mutex_unlock(&Shared_lock);
+	return shared;
+err_fi_domain:
+	RPMEM_FI_CLOSE(shared->fabric, "closing fabric domain");
+err_fi_fabric:
+err_strdup:
+	free(shared->prov_name);
+	free(shared->fabric_name);
+	free(shared->domain_name);
+	free(shared);
+	util_mutex_unlock(&Shared_lock);
+	return NULL;
+}
+
+/*
+ * rpmem_fip_shared_put -- (internal) drop reference to shared fabric and
+ * access domain, closing them with the last one
+ */
+static void
+rpmem_fip_shared_put(struct rpmem_fip_shared *shared)
+{
+	util_mutex_lock(&Shared_lock);
+
+	if (--shared->refcnt) {
+		util_mutex_unlock(&Shared_lock);
+		return;
+	}
+
+	struct rpmem_fip_shared **prev = &Shared;
+	while (*prev != shared)
+		prev = &(*prev)->next;
+	*prev = shared->next;
+
+	util_mutex_unlock(&Shared_lock);
+
+	RPMEM_FI_CLOSE(shared->domain, "closing fabric access domain");
+	RPMEM_FI_CLOSE(shared->fabric, "closing fabric domain");
+	free(shared->prov_name);
+	free(shared->fabric_name);
+	free(shared->domain_name);
+	free(shared);
+}
+
+/*
+ * rpmem_fip_init_fabric_res -- (internal) initialize common fabric resources
+ */
+static int
+rpmem_fip_init_fabric_res(struct rpmem_fip *fip)
+{
+	int ret;
+
+	fip->shared = rpmem_fip_shared_get(fip->fi);
+	if (!fip->shared)
+		return -1;
+
+	fip->fabric = fip->shared->fabric;
+	fip->domain = fip->shared->domain;
+
 	struct fi_eq_attr eq_attr = {
 		.size = 0, /* use default value */
 		.flags = 0,
@@ -253,10 +449,7 @@ rpmem_fip_init_fabric_res(struct rpmem_fip *fip)
 
 	return 0;
 err_eq_open:
-	RPMEM_FI_CLOSE(fip->domain, "closing fabric access domain");
-err_fi_domain:
-	RPMEM_FI_CLOSE(fip->fabric, "closing fabric domain");
-err_fi_fabric:
+	rpmem_fip_shared_put(fip->shared);
 	return ret;
 }
 
@@ -267,8 +460,7 @@ static void
 rpmem_fip_fini_fabric_res(struct rpmem_fip *fip)
 {
 	RPMEM_FI_CLOSE(fip->eq, "closing event queue");
-	RPMEM_FI_CLOSE(fip->domain, "closing fabric access domain");
-	RPMEM_FI_CLOSE(fip->fabric, "closing fabric domain");
+	rpmem_fip_shared_put(fip->shared);
 }
 
 /*
@@ -282,10 +474,12 @@ rpmem_fip_init_memory(struct rpmem_fip *fip)
 	/*
 	 * Register local memory space. The local memory will be used
 	 * with WRITE operation in rpmem_fip_persist function thus
-	 * the FI_WRITE access flag.
+	 * the FI_WRITE access flag. The rpmem_fip_read function READs
+	 * directly into it if the destination lies within the pool thus
+	 * the FI_READ access flag.
 	 */
 	ret = fi_mr_reg(fip->domain, fip->laddr, fip->size,
-			FI_WRITE, 0, 0, 0, &fip->mr, NULL);
+			FI_WRITE | FI_READ, 0, 0, 0, &fip->mr, NULL);
 	if (ret) {
 		RPMEM_FI_ERR(ret, "registrating memory");
 		return ret;
@@ -295,7 +489,7 @@ rpmem_fip_init_memory(struct rpmem_fip *fip)
 	fip->mr_desc = fi_mr_desc(fip->mr);
 
 	/* allocate buffer for read operation */
-	fip->rd_buff = malloc(RPMEM_RD_BUFF_SIZE);
+	fip->rd_buff = malloc(RPMEM_RD_NLANES * RPMEM_RD_BUFF_SIZE);
 	if (!fip->rd_buff) {
 		RPMEM_LOG(ERR, "!allocating read buffer");
 		ret = -1;
@@ -308,7 +502,7 @@ rpmem_fip_init_memory(struct rpmem_fip *fip)
 	 * the FI_REMOTE_WRITE flag.
 	 */
 	ret = fi_mr_reg(fip->domain, fip->rd_buff,
-			RPMEM_RD_BUFF_SIZE, FI_REMOTE_WRITE,
+			RPMEM_RD_NLANES * RPMEM_RD_BUFF_SIZE, FI_REMOTE_WRITE,
 			0, 0, 0, &fip->rd_mr, NULL);
 	if (ret) {
 		RPMEM_FI_ERR(ret, "registrating read buffer");
@@ -345,17 +539,20 @@ rpmem_fip_init_lanes_common(struct rpmem_fip *fip)
 {
 	int ret;
 
-	/* initialize lane for read operation */
-	ret = rpmem_fip_lane_init(&fip->rd_lane.lane);
-	if (ret)
-		goto err_lane_init;
+	for (unsigned i = 0; i < RPMEM_RD_NLANES; i++) {
+		/* initialize lane for read operation */
+		ret = rpmem_fip_lane_init(&fip->rd_lanes[i].lane);
+		if (ret)
+			goto err_lane_init;
 
-	/*
-	 * Initialize READ message. The completion is required in order
-	 * to signal thread that READ operation has been completed.
-	 */
-	rpmem_fip_rma_init(&fip->rd_lane.read, fip->rd_mr_desc, 0,
-			fip->rkey, &fip->rd_lane, FI_COMPLETION);
+		/*
+		 * Initialize READ message. The completion is required in
+		 * order to signal thread that READ operation has been
+		 * completed.
+		 */
+		rpmem_fip_rma_init(&fip->rd_lanes[i].read, fip->rd_mr_desc, 0,
+				fip->rkey, &fip->rd_lanes[i], FI_COMPLETION);
+	}
 
 	return 0;
 err_lane_init:
@@ -530,12 +727,12 @@ rpmem_fip_init_lanes_apm(struct rpmem_fip *fip)
 	 */
 	unsigned i;
 	for (i = 0; i < fip->nlanes; i++) {
-		ret = rpmem_fip_lane_init(&fip->lanes.apm[i].lane);
+		ret = rpmem_fip_lane_init(&fip->lanes.apm[i].base.lane);
 		if (ret)
 			goto err_lane_init;
 
 		/* WRITE */
-		rpmem_fip_rma_init(&fip->lanes.apm[i].write,
+		rpmem_fip_rma_init(&fip->lanes.apm[i].base.write,
 				fip->mr_desc, 0,
 				fip->rkey,
 				&fip->lanes.apm[i],
@@ -552,7 +749,7 @@ rpmem_fip_init_lanes_apm(struct rpmem_fip *fip)
 	return 0;
 err_lane_init:
 	for (unsigned j = 0; j < i; j++)
-		rpmem_fip_lane_fini(&fip->lanes.apm[i].lane);
+		rpmem_fip_lane_fini(&fip->lanes.apm[i].base.lane);
 err_fi_raw_mr:
 	free(fip->lanes.apm);
 err_malloc_lanes:
@@ -585,48 +782,43 @@ rpmem_fip_post_lanes_apm(struct rpmem_fip *fip)
 static int
 rpmem_fip_process_apm(struct rpmem_fip *fip, void *context, uint64_t flags)
 {
-	struct rpmem_fip_lane *lanep = context;
+	struct rpmem_fip_plane *lanep = context;
+
+	if (fip->stats)
+		lanep->done_ns = rpmem_stats_now();
 
 	/* signal READ operation completion */
-	rpmem_fip_lane_signal(lanep, flags);
+	rpmem_fip_lane_signal(&lanep->lane, flags);
 
 	return 0;
 }
 
 /*
- * rpmem_fip_persist_apm -- (internal) perform persist operation for APM
+ * rpmem_fip_commit_apm -- (internal) post persist of lane's WRITEs for APM
+ *
+ * The READ completes only after all preceding WRITEs on the endpoint are
+ * placed in the remote memory.
  */
 static int
-rpmem_fip_persist_apm(struct rpmem_fip *fip, size_t offset,
-	size_t len, unsigned lane)
+rpmem_fip_commit_apm(struct rpmem_fip *fip, size_t start, size_t end,
+	unsigned lane)
 {
 	struct rpmem_fip_plane_apm *lanep = &fip->lanes.apm[lane];
 
-	RPMEM_ASSERT(!rpmem_fip_lane_busy(&lanep->lane));
+	RPMEM_ASSERT(!rpmem_fip_lane_busy(&lanep->base.lane));
 
-	rpmem_fip_lane_begin(&lanep->lane, FI_READ);
-
-	int ret;
-	void *laddr = (void *)((uintptr_t)fip->laddr + offset);
-	uint64_t raddr = fip->raddr + offset;
-
-	/* WRITE for requested memory region */
-	ret = rpmem_fip_writemsg(fip->ep, &lanep->write, laddr, len, raddr);
-	if (unlikely(ret)) {
-		RPMEM_FI_ERR((int)ret, "RMA write");
-		return ret;
-	}
+	rpmem_fip_lane_begin(&lanep->base.lane, FI_READ);
 
 	/* READ to read-after-write buffer */
-	ret = rpmem_fip_readmsg(fip->ep, &lanep->read, &fip->raw_buff,
-			sizeof(fip->raw_buff), raddr);
+	int ret = rpmem_fip_readmsg(fip->ep, &lanep->read, &fip->raw_buff,
+			sizeof(fip->raw_buff), fip->raddr + start);
 	if (unlikely(ret)) {
-		RPMEM_FI_ERR((int)ret, "RMA read");
-		return (int)ret;
+		RPMEM_FI_ERR(ret, "RMA read");
+		rpmem_fip_lane_sigret(&lanep->base.lane, FI_READ, ret);
+		return ret;
 	}
 
-	/* wait for READ completion */
-	return rpmem_fip_lane_wait(&lanep->lane, FI_READ);
+	return 0;
 }
 
 /*
@@ -751,12 +943,12 @@ rpmem_fip_init_lanes_gpspm(struct rpmem_fip *fip)
 	 */
 	unsigned i;
 	for (i = 0; i < fip->nlanes; i++) {
-		ret = rpmem_fip_lane_init(&fip->lanes.gpspm[i].lane);
+		ret = rpmem_fip_lane_init(&fip->lanes.gpspm[i].base.lane);
 		if (ret)
 			goto err_lane_init;
 
 		/* WRITE */
-		rpmem_fip_rma_init(&fip->lanes.gpspm[i].write,
+		rpmem_fip_rma_init(&fip->lanes.gpspm[i].base.write,
 				fip->mr_desc, 0,
 				fip->rkey,
 				&fip->lanes.gpspm[i],
@@ -782,7 +974,7 @@ rpmem_fip_init_lanes_gpspm(struct rpmem_fip *fip)
 	return 0;
 err_lane_init:
 	for (unsigned j = 0; j < i; j++)
-		rpmem_fip_lane_fini(&fip->lanes.gpspm[i].lane);
+		rpmem_fip_lane_fini(&fip->lanes.gpspm[i].base.lane);
 err_malloc_recv:
 	RPMEM_FI_CLOSE(fip->pres_mr, "unregistering messages "
 			"response buffer");
@@ -829,15 +1021,18 @@ rpmem_fip_process_gpspm(struct rpmem_fip *fip, void *context, uint64_t flags)
 		if (unlikely(msg_resp->lane >= fip->nlanes))
 			return -1;
 
-		struct rpmem_fip_lane *lanep =
-			&fip->lanes.gpspm[msg_resp->lane].lane;
+		struct rpmem_fip_plane *lanep =
+			&fip->lanes.gpspm[msg_resp->lane].base;
+
+		if (fip->stats)
+			lanep->done_ns = rpmem_stats_now();
 
 		/* post RECV buffer immediately */
 		int ret = rpmem_fip_gpspm_post_resp(fip, resp);
 		if (unlikely(ret))
 			RPMEM_FI_ERR((int)ret, "MSG send");
 
-		rpmem_fip_lane_sigret(lanep, flags, ret);
+		rpmem_fip_lane_sigret(&lanep->lane, flags, ret);
 
 		return ret;
 	}
@@ -851,51 +1046,38 @@ rpmem_fip_process_gpspm(struct rpmem_fip *fip, void *context, uint64_t flags)
 }
 
 /*
- * rpmem_fip_persist_gpspm -- (internal) perform persist operation for GPSPM
+ * rpmem_fip_commit_gpspm -- (internal) post persist of lane's WRITEs for
+ * GPSPM
+ *
+ * The persist message carries one address range, so it covers the span
+ * from the lowest to the highest byte written.
  */
 static int
-rpmem_fip_persist_gpspm(struct rpmem_fip *fip, size_t offset,
-	size_t len, unsigned lane)
+rpmem_fip_commit_gpspm(struct rpmem_fip *fip, size_t start, size_t end,
+	unsigned lane)
 {
-	int ret;
 	struct rpmem_fip_plane_gpspm *lanep = &fip->lanes.gpspm[lane];
 
-	ret = rpmem_fip_lane_wait(&lanep->lane, FI_SEND);
-	if (unlikely(ret)) {
-		RPMEM_LOG(ERR, "waiting for SEND buffer");
-		return ret;
-	}
-
-	RPMEM_ASSERT(!rpmem_fip_lane_busy(&lanep->lane));
-
-	rpmem_fip_lane_begin(&lanep->lane, FI_SEND | FI_RECV);
+	RPMEM_ASSERT(!rpmem_fip_lane_busy(&lanep->base.lane));
 
-	void *laddr = (void *)((uintptr_t)fip->laddr + offset);
-	uint64_t raddr = fip->raddr + offset;
-	struct rpmem_msg_persist *msg;
-	struct rpmem_fip_plane_gpspm *gpspm = (void *)lanep;
-
-	/* WRITE for requested memory region */
-	ret = rpmem_fip_writemsg(fip->ep, &gpspm->write, laddr, len, raddr);
-	if (unlikely(ret)) {
-		RPMEM_FI_ERR((int)ret, "RMA write");
-		return ret;
-	}
+	rpmem_fip_lane_begin(&lanep->base.lane, FI_SEND | FI_RECV);
 
 	/* SEND persist message */
-	msg = rpmem_fip_msg_get_pmsg(&gpspm->send);
+	struct rpmem_msg_persist *msg = rpmem_fip_msg_get_pmsg(&lanep->send);
 	msg->lane = lane;
-	msg->addr = raddr;
-	msg->size = len;
+	msg->addr = fip->raddr + start;
+	msg->size = end - start;
 
-	ret = rpmem_fip_sendmsg(fip->ep, &gpspm->send);
+	int ret = rpmem_fip_sendmsg(fip->ep, &lanep->send);
 	if (unlikely(ret)) {
-		RPMEM_FI_ERR((int)ret, "MSG send");
-		return (int)ret;
+		RPMEM_FI_ERR(ret, "MSG send");
+		rpmem_fip_lane_sigret(&lanep->base.lane, FI_SEND | FI_RECV,
+				ret);
+		return ret;
 	}
 
-	/* wait for persist operation completion */
-	return rpmem_fip_lane_wait(&lanep->lane, FI_RECV);
+	/* the RECV completion signals the persist is done */
+	return 0;
 }
 
 /*
@@ -903,14 +1085,18 @@ rpmem_fip_persist_gpspm(struct rpmem_fip *fip, size_t offset,
  */
 static struct rpmem_fip_ops rpmem_fip_ops[MAX_RPMEM_PM] = {
 	[RPMEM_PM_GPSPM] = {
-		.persist = rpmem_fip_persist_gpspm,
+		.commit = rpmem_fip_commit_gpspm,
+		.event = FI_RECV,
+		.busy = FI_SEND | FI_RECV,
 		.process = rpmem_fip_process_gpspm,
 		.lanes_init = rpmem_fip_init_lanes_gpspm,
 		.lanes_fini = rpmem_fip_fini_lanes_gpspm,
 		.lanes_post = rpmem_fip_post_lanes_gpspm,
 	},
 	[RPMEM_PM_APM] = {
-		.persist = rpmem_fip_persist_apm,
+		.commit = rpmem_fip_commit_apm,
+		.event = FI_READ,
+		.busy = FI_READ,
 		.process = rpmem_fip_process_apm,
 		.lanes_init = rpmem_fip_init_lanes_apm,
 		.lanes_fini = rpmem_fip_fini_lanes_apm,
@@ -929,11 +1115,13 @@ rpmem_fip_set_attr(struct rpmem_fip *fip, struct rpmem_fip_attr *attr)
 	fip->laddr = attr->laddr;
 	fip->size = attr->size;
 	fip->persist_method = attr->persist_method;
+	fip->stats = attr->stats;
 
 	rpmem_fip_set_nlanes(fip, attr->nlanes);
 
 	fip->cq_size = rpmem_fip_cq_size(fip->nlanes,
-			fip->persist_method, RPMEM_FIP_NODE_CLIENT);
+			fip->persist_method, RPMEM_FIP_NODE_CLIENT) +
+			RPMEM_RD_NLANES;
 
 	fip->ops = &rpmem_fip_ops[fip->persist_method];
 }
@@ -948,17 +1136,33 @@ rpmem_fip_signal_all(struct rpmem_fip *fip, int ret)
 	switch (fip->persist_method) {
 	case RPMEM_PM_APM:
 		for (unsigned i = 0; i < fip->nlanes; i++)
-			rpmem_fip_lane_sigret(&fip->lanes.apm[i].lane,
+			rpmem_fip_lane_sigret(&fip->lanes.apm[i].base.lane,
 					FI_WRITE | FI_READ, ret);
 		break;
 	case RPMEM_PM_GPSPM:
 		for (unsigned i = 0; i < fip->nlanes; i++)
-			rpmem_fip_lane_sigret(&fip->lanes.gpspm[i].lane,
+			rpmem_fip_lane_sigret(&fip->lanes.gpspm[i].base.lane,
 					FI_WRITE | FI_SEND | FI_RECV, ret);
 		break;
 	default:
 		RPMEM_ASSERT(0);
 	}
+
+	for (unsigned i = 0; i < RPMEM_RD_NLANES; i++)
+		rpmem_fip_lane_sigret(&fip->rd_lanes[i].lane, FI_READ, ret);
+}
+
+/*
+ * rpmem_fip_is_rd_lane -- (internal) check if the context is a read lane
+ */
+static inline int
+rpmem_fip_is_rd_lane(struct rpmem_fip *fip, void *context)
+{
+	uintptr_t ctx = (uintptr_t)context;
+	uintptr_t begin = (uintptr_t)&fip->rd_lanes[0];
+	uintptr_t end = (uintptr_t)&fip->rd_lanes[RPMEM_RD_NLANES];
+
+	return ctx >= begin && ctx < end;
 }
 
 /*
@@ -1007,9 +1211,11 @@ rpmem_fip_process(struct rpmem_fip *fip)
 			RPMEM_ASSERT(comp->op_context);
 
 			/* read operation */
-			if (unlikely(comp->op_context == &fip->rd_lane)) {
-				rpmem_fip_lane_signal(&fip->rd_lane.lane,
-						FI_READ);
+			if (unlikely(rpmem_fip_is_rd_lane(fip,
+					comp->op_context))) {
+				struct rpmem_fip_rlane *rd_lane =
+					comp->op_context;
+				rpmem_fip_lane_signal(&rd_lane->lane, FI_READ);
 				continue;
 			}
 
@@ -1232,11 +1438,28 @@ rpmem_fip_process_stop(struct rpmem_fip *fip)
 }
 
 /*
- * rpmem_fip_persist -- perform remote persist operation
+ * rpmem_fip_get_plane -- (internal) return the common part of a persist
+ * operation's lane
  */
-int
-rpmem_fip_persist(struct rpmem_fip *fip, size_t offset, size_t len,
-	unsigned lane)
+static struct rpmem_fip_plane *
+rpmem_fip_get_plane(struct rpmem_fip *fip, unsigned lane)
+{
+	switch (fip->persist_method) {
+	case RPMEM_PM_APM:
+		return &fip->lanes.apm[lane].base;
+	case RPMEM_PM_GPSPM:
+		return &fip->lanes.gpspm[lane].base;
+	default:
+		RPMEM_ASSERT(0);
+		return NULL;
+	}
+}
+
+/*
+ * rpmem_fip_check_lane -- (internal) verify lane number
+ */
+static inline int
+rpmem_fip_check_lane(struct rpmem_fip *fip, unsigned lane)
 {
 	RPMEM_ASSERT(lane < fip->nlanes);
 	if (unlikely(lane >= fip->nlanes)) {
@@ -1244,38 +1467,351 @@ rpmem_fip_persist(struct rpmem_fip *fip, size_t offset, size_t len,
 		return -1;
 	}
 
-	return fip->ops->persist(fip, offset, len, lane);
+	return 0;
+}
+
+/*
+ * rpmem_fip_stats_done -- (internal) account the persist which completed on
+ * the lane
+ *
+ * The completion time is taken by the processing thread, so the latency
+ * does not include the time the lane's user takes to notice the completion.
+ */
+static inline void
+rpmem_fip_stats_done(struct rpmem_fip_plane *lanep)
+{
+	if (!lanep->post_ns || !lanep->done_ns)
+		return;
+
+	uint64_t lat = lanep->done_ns - lanep->post_ns;
+	lanep->post_ns = 0;
+	lanep->done_ns = 0;
+
+	lanep->stats.npersists++;
+	lanep->stats.persist_ns += lat;
+	if (lat > lanep->stats.max_persist_ns)
+		lanep->stats.max_persist_ns = lat;
+	lanep->stats.hist[rpmem_stats_bucket(lat, RPMEM_STATS_NBUCKETS)]++;
+}
+
+/*
+ * rpmem_fip_plane_wait -- (internal) wait for event(s) on the lane,
+ * accounting the time spent waiting
+ */
+static inline int
+rpmem_fip_plane_wait(struct rpmem_fip *fip, struct rpmem_fip_plane *lanep,
+	uint64_t sig)
+{
+	if (likely(!fip->stats))
+		return rpmem_fip_lane_wait(&lanep->lane, sig);
+
+	uint64_t start = rpmem_stats_now();
+	int ret = rpmem_fip_lane_wait(&lanep->lane, sig);
+	lanep->stats.wait_ns += rpmem_stats_now() - start;
+
+	/* both events waited for include the persist completion */
+	if (likely(!ret))
+		rpmem_fip_stats_done(lanep);
+
+	return ret;
+}
+
+/*
+ * rpmem_fip_commit -- (internal) post persist operation of all WRITEs
+ * posted on the lane since the last persist
+ */
+static int
+rpmem_fip_commit(struct rpmem_fip *fip, unsigned lane)
+{
+	struct rpmem_fip_plane *lanep = rpmem_fip_get_plane(fip, lane);
+	if (!lanep->nwrites)
+		return 0;
+
+	if (fip->stats) {
+		if (lanep->nwrites > lanep->stats.max_depth)
+			lanep->stats.max_depth = lanep->nwrites;
+		lanep->post_ns = rpmem_stats_now();
+		lanep->done_ns = 0;
+	}
+
+	lanep->nwrites = 0;
+
+	return fip->ops->commit(fip, lanep->start, lanep->end, lane);
+}
+
+/*
+ * rpmem_fip_flush_range -- (internal) post unsignaled WRITE of the range
+ *
+ * The first WRITE after a persist waits until the lane is no longer in use.
+ * At most RPMEM_FIP_MAX_WRITES WRITEs are posted before a persist, which is
+ * what the send queue has room for, so the lane is drained when full.
+ */
+static int
+rpmem_fip_flush_range(struct rpmem_fip *fip, size_t offset, size_t len,
+	unsigned lane)
+{
+	struct rpmem_fip_plane *lanep = rpmem_fip_get_plane(fip, lane);
+	int ret;
+
+	if (unlikely(lanep->nwrites == RPMEM_FIP_MAX_WRITES)) {
+		ret = rpmem_fip_commit(fip, lane);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	if (!lanep->nwrites) {
+		ret = rpmem_fip_plane_wait(fip, lanep, fip->ops->busy);
+		if (unlikely(ret)) {
+			RPMEM_LOG(ERR, "waiting for previous persist");
+			return ret;
+		}
+
+		lanep->start = SIZE_MAX;
+		lanep->end = 0;
+	}
+
+	void *laddr = (void *)((uintptr_t)fip->laddr + offset);
+	uint64_t raddr = fip->raddr + offset;
+
+	ret = rpmem_fip_write(fip, &lanep->write, laddr, len, raddr);
+	if (unlikely(ret)) {
+		RPMEM_FI_ERR(ret, "RMA write");
+		return ret;
+	}
+
+	lanep->nwrites++;
+	if (fip->stats) {
+		lanep->stats.nwrites++;
+		lanep->stats.nbytes += len;
+	}
+
+	if (offset < lanep->start)
+		lanep->start = offset;
+	if (offset + len > lanep->end)
+		lanep->end = offset + len;
+
+	return 0;
+}
+
+/*
+ * rpmem_fip_persist_post -- post remote persist operation without waiting
+ * for its completion
+ */
+int
+rpmem_fip_persist_post(struct rpmem_fip *fip, size_t offset, size_t len,
+	unsigned lane)
+{
+	struct rpmem_range range = {
+		.offset = offset,
+		.length = len,
+	};
+
+	return rpmem_fip_persistv_post(fip, &range, 1, lane);
+}
+
+/*
+ * rpmem_fip_persistv_post -- post remote persist operation of several
+ * ranges without waiting for its completion
+ */
+int
+rpmem_fip_persistv_post(struct rpmem_fip *fip,
+	const struct rpmem_range *ranges, unsigned nranges, unsigned lane)
+{
+	if (rpmem_fip_check_lane(fip, lane))
+		return -1;
+
+	RPMEM_ASSERT(nranges > 0);
+
+	for (unsigned i = 0; i < nranges; i++) {
+		int ret = rpmem_fip_flush_range(fip, ranges[i].offset,
+				ranges[i].length, lane);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	return rpmem_fip_commit(fip, lane);
+}
+
+/*
+ * rpmem_fip_persist_poll -- check whether the persist operation posted on
+ * the lane has completed
+ *
+ * Stores 1 in *done if there is no persist in flight on the lane and returns
+ * its result, or stores 0 in *done and returns 0 otherwise.
+ */
+int
+rpmem_fip_persist_poll(struct rpmem_fip *fip, unsigned lane, int *done)
+{
+	if (rpmem_fip_check_lane(fip, lane))
+		return -1;
+
+	struct rpmem_fip_plane *lanep = rpmem_fip_get_plane(fip, lane);
+
+	*done = !(lanep->lane.sync & fip->ops->event);
+	if (!*done)
+		return 0;
+
+	if (fip->stats && !lanep->lane.ret)
+		rpmem_fip_stats_done(lanep);
+
+	return lanep->lane.ret;
+}
+
+/*
+ * rpmem_fip_persist_wait -- wait for the persist operation posted on the
+ * lane
+ */
+int
+rpmem_fip_persist_wait(struct rpmem_fip *fip, unsigned lane)
+{
+	if (rpmem_fip_check_lane(fip, lane))
+		return -1;
+
+	return rpmem_fip_plane_wait(fip, rpmem_fip_get_plane(fip, lane),
+			fip->ops->event);
+}
+
+/*
+ * rpmem_fip_persist -- perform remote persist operation
+ */
+int
+rpmem_fip_persist(struct rpmem_fip *fip, size_t offset, size_t len,
+	unsigned lane)
+{
+	int ret = rpmem_fip_persist_post(fip, offset, len, lane);
+	if (unlikely(ret))
+		return ret;
+
+	return rpmem_fip_persist_wait(fip, lane);
+}
+
+/*
+ * rpmem_fip_persistv -- perform remote persist operation of several ranges
+ * using a single completion
+ */
+int
+rpmem_fip_persistv(struct rpmem_fip *fip, const struct rpmem_range *ranges,
+	unsigned nranges, unsigned lane)
+{
+	int ret = rpmem_fip_persistv_post(fip, ranges, nranges, lane);
+	if (unlikely(ret))
+		return ret;
+
+	return rpmem_fip_persist_wait(fip, lane);
+}
+
+/*
+ * rpmem_fip_flush -- post WRITE of the range without making it persistent
+ */
+int
+rpmem_fip_flush(struct rpmem_fip *fip, size_t offset, size_t len,
+	unsigned lane)
+{
+	if (rpmem_fip_check_lane(fip, lane))
+		return -1;
+
+	return rpmem_fip_flush_range(fip, offset, len, lane);
+}
+
+/*
+ * rpmem_fip_drain -- make all ranges flushed on the lane persistent
+ */
+int
+rpmem_fip_drain(struct rpmem_fip *fip, unsigned lane)
+{
+	if (rpmem_fip_check_lane(fip, lane))
+		return -1;
+
+	int ret = rpmem_fip_commit(fip, lane);
+	if (unlikely(ret))
+		return ret;
+
+	return rpmem_fip_persist_wait(fip, lane);
 }
 
 /*
  * rpmem_fip_read -- perform read operation
+ *
+ * The range is split into chunks READ over RPMEM_RD_NLANES lanes, so that
+ * several READs are outstanding at a time. If the destination buffer lies
+ * within the registered pool the data is READ directly into it, otherwise
+ * each lane bounces its chunk through its part of the read buffer.
  */
 int
 rpmem_fip_read(struct rpmem_fip *fip, void *buff, size_t len, size_t off)
 {
-	RPMEM_ASSERT(!rpmem_fip_lane_busy(&fip->rd_lane.lane));
-
-	int ret = 0;
-	size_t rd = 0;
 	uint8_t *cbuff = buff;
-	while (rd < len) {
-		rpmem_fip_lane_begin(&fip->rd_lane.lane, FI_READ);
+	uintptr_t laddr = (uintptr_t)fip->laddr;
+	int direct = (uintptr_t)buff >= laddr &&
+		(uintptr_t)buff + len <= laddr + fip->size;
+	size_t chunk = direct ? RPMEM_RD_DIRECT_SIZE : RPMEM_RD_BUFF_SIZE;
+	if (chunk > fip->fi->ep_attr->max_msg_size)
+		chunk = fip->fi->ep_attr->max_msg_size;
+
+	size_t rd_off[RPMEM_RD_NLANES];	/* destination offset of the chunk */
+	size_t rd_len[RPMEM_RD_NLANES];	/* length of the chunk */
+	size_t posted = 0;	/* number of bytes already requested */
+	unsigned head = 0;	/* lane with the oldest outstanding READ */
+	unsigned inflight = 0;	/* number of outstanding READs */
+	int ret = 0;
 
-		size_t rd_len = len - rd < RPMEM_RD_BUFF_SIZE ?
-				len - rd : RPMEM_RD_BUFF_SIZE;
-		size_t rd_off = off + rd;
-		uint64_t raddr = fip->raddr + rd_off;
+	while (posted < len || inflight) {
+		/* keep all read lanes busy */
+		while (posted < len && inflight < RPMEM_RD_NLANES) {
+			unsigned l = (head + inflight) % RPMEM_RD_NLANES;
+			struct rpmem_fip_rlane *rd_lane = &fip->rd_lanes[l];
+
+			RPMEM_ASSERT(!rpmem_fip_lane_busy(&rd_lane->lane));
+
+			size_t rlen = len - posted < chunk ?
+					len - posted : chunk;
+			void *dst;
+			if (direct) {
+				dst = &cbuff[posted];
+				rd_lane->read.desc = fip->mr_desc;
+			} else {
+				dst = (uint8_t *)fip->rd_buff +
+					l * RPMEM_RD_BUFF_SIZE;
+				rd_lane->read.desc = fip->rd_mr_desc;
+			}
 
-		ret = rpmem_fip_readmsg(fip->ep, &fip->rd_lane.read,
-				fip->rd_buff, rd_len, raddr);
+			rpmem_fip_lane_begin(&rd_lane->lane, FI_READ);
 
-		ret = rpmem_fip_lane_wait(&fip->rd_lane.lane, FI_READ);
-		if (ret)
-			return ret;
+			ret = rpmem_fip_readmsg(fip->ep, &rd_lane->read,
+					dst, rlen, fip->raddr + off + posted);
+			if (unlikely(ret)) {
+				RPMEM_FI_ERR(ret, "RMA read");
+				rpmem_fip_lane_signal(&rd_lane->lane, FI_READ);
+				goto err;
+			}
 
-		memcpy(&cbuff[rd], fip->rd_buff, rd_len);
+			rd_off[l] = posted;
+			rd_len[l] = rlen;
+			posted += rlen;
+			inflight++;
+		}
+
+		/* complete the oldest READ */
+		ret = rpmem_fip_lane_wait(&fip->rd_lanes[head].lane, FI_READ);
+		if (unlikely(ret))
+			goto err;
 
-		rd += rd_len;
+		if (!direct)
+			memcpy(&cbuff[rd_off[head]], (uint8_t *)fip->rd_buff +
+					head * RPMEM_RD_BUFF_SIZE,
+					rd_len[head]);
+
+		head = (head + 1) % RPMEM_RD_NLANES;
+		inflight--;
+	}
+
+	return 0;
+err:
+	/* the outstanding READs still target the buffers, wait for them */
+	while (inflight) {
+		rpmem_fip_lane_wait(&fip->rd_lanes[head].lane, FI_READ);
+		head = (head + 1) % RPMEM_RD_NLANES;
+		inflight--;
 	}
 
 	return ret;
@@ -1292,3 +1828,77 @@ rpmem_fip_monitor(struct rpmem_fip *fip, int nonblock)
 	return rpmem_fip_read_eq(fip->eq, &entry, FI_CONNECTED,
 			&fip->ep->fid, timeout);
 }
+
+/*
+ * rpmem_fip_stats_add -- (internal) add statistics of the lane to the sum
+ */
+static void
+rpmem_fip_stats_add(struct rpmem_stats *sum, const struct rpmem_stats *stats)
+{
+	sum->npersists += stats->npersists;
+	sum->nwrites += stats->nwrites;
+	sum->nbytes += stats->nbytes;
+	sum->persist_ns += stats->persist_ns;
+	sum->wait_ns += stats->wait_ns;
+	if (stats->max_depth > sum->max_depth)
+		sum->max_depth = stats->max_depth;
+	if (stats->max_persist_ns > sum->max_persist_ns)
+		sum->max_persist_ns = stats->max_persist_ns;
+
+	for (unsigned i = 0; i < RPMEM_STATS_NBUCKETS; i++)
+		sum->hist[i] += stats->hist[i];
+}
+
+/*
+ * rpmem_fip_stats_get -- read persist statistics of the lane, or summed over
+ * all lanes
+ *
+ * The statistics are updated by the lanes' users without synchronization,
+ * so values read while operations are in progress may be slightly off.
+ */
+int
+rpmem_fip_stats_get(struct rpmem_fip *fip, unsigned lane,
+	struct rpmem_stats *stats)
+{
+	if (!fip->stats) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (lane != RPMEM_ALL_LANES) {
+		if (lane >= fip->nlanes) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		rpmem_fip_stats_add(stats,
+				&rpmem_fip_get_plane(fip, lane)->stats);
+		return 0;
+	}
+
+	for (unsigned i = 0; i < fip->nlanes; i++)
+		rpmem_fip_stats_add(stats, &rpmem_fip_get_plane(fip, i)->stats);
+
+	return 0;
+}
+
+/*
+ * rpmem_fip_stats_reset -- clear persist statistics of all lanes
+ */
+int
+rpmem_fip_stats_reset(struct rpmem_fip *fip)
+{
+	if (!fip->stats) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	for (unsigned i = 0; i < fip->nlanes; i++) {
+		struct rpmem_fip_plane *lanep = rpmem_fip_get_plane(fip, i);
+		memset(&lanep->stats, 0, sizeof(lanep->stats));
+	}
+
+	return 0;
+}
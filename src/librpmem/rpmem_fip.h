@@ -40,6 +40,8 @@
 #include <sys/socket.h>
 
 struct rpmem_fip;
+struct rpmem_range;
+struct rpmem_stats;
 
 struct rpmem_fip_attr {
 	enum rpmem_provider provider;
@@ -49,6 +51,7 @@ struct rpmem_fip_attr {
 	unsigned nlanes;
 	void *raddr;
 	uint64_t rkey;
+	int stats;	/* collect persist statistics */
 };
 
 struct rpmem_fip *rpmem_fip_init(const char *node, const char *service,
@@ -63,6 +66,22 @@ int rpmem_fip_process_stop(struct rpmem_fip *fip);
 
 int rpmem_fip_persist(struct rpmem_fip *fip, size_t offset, size_t len,
 		unsigned lane);
+int rpmem_fip_persistv(struct rpmem_fip *fip, const struct rpmem_range *ranges,
+		unsigned nranges, unsigned lane);
+int rpmem_fip_persist_post(struct rpmem_fip *fip, size_t offset, size_t len,
+		unsigned lane);
+int rpmem_fip_persistv_post(struct rpmem_fip *fip,
+		const struct rpmem_range *ranges, unsigned nranges,
+		unsigned lane);
+int rpmem_fip_flush(struct rpmem_fip *fip, size_t offset, size_t len,
+		unsigned lane);
+int rpmem_fip_drain(struct rpmem_fip *fip, unsigned lane);
+int rpmem_fip_persist_poll(struct rpmem_fip *fip, unsigned lane, int *done);
+int rpmem_fip_persist_wait(struct rpmem_fip *fip, unsigned lane);
 
 int rpmem_fip_read(struct rpmem_fip *fip, void *buff,
 		size_t len, size_t off);
+
+int rpmem_fip_stats_get(struct rpmem_fip *fip, unsigned lane,
+		struct rpmem_stats *stats);
+int rpmem_fip_stats_reset(struct rpmem_fip *fip);
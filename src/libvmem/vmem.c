@@ -33,6 +33,11 @@
 /*
  * vmem.c -- memory pool & allocation entry points for libvmem
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +46,8 @@
 #include <errno.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "libvmem.h"
 
@@ -54,6 +61,20 @@
  */
 static size_t Header_size;
 
+/* growth state of the pools created with a non-zero grow_size */
+static struct vmem_grow *Grow_list;
+static pthread_mutex_t Grow_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * NUMA pools -- slots are reused but never freed, so that the allocation
+ * paths can look them up without taking a lock
+ */
+static struct vmem_numa Numa_pools[VMEM_NUMA_POOLS_MAX];
+static volatile unsigned Numa_npools;	/* high-water mark of used slots */
+static pthread_mutex_t Numa_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char Cpu_node[VMEM_NUMA_CPUS_MAX];
+static int Cpu_node_initialized;
+
 /*
  * print_jemalloc_messages -- custom print function, for jemalloc
  *
@@ -135,14 +156,262 @@ vmem_fini(void)
 	common_fini();
 }
 
+/*
+ * vmem_grow_find -- (internal) find, and optionally unlink, growth state
+ */
+static struct vmem_grow *
+vmem_grow_find(VMEM *vmp, int unlink)
+{
+	if (Grow_list == NULL)
+		return NULL;
+
+	util_mutex_lock(&Grow_list_lock);
+
+	struct vmem_grow **gp = &Grow_list;
+	while (*gp != NULL && (*gp)->vmp != vmp)
+		gp = &(*gp)->next;
+
+	struct vmem_grow *g = *gp;
+	if (g != NULL && unlink)
+		*gp = g->next;
+
+	util_mutex_unlock(&Grow_list_lock);
+
+	return g;
+}
+
+/*
+ * vmem_madvise_huge -- (internal) ask for transparent huge pages
+ *
+ * Mappings from hugetlbfs use huge pages anyway and DAX mappings get
+ * them from the alignment, the advice only matters for tmpfs with THP
+ * enabled; failures are not errors.
+ */
+static void
+vmem_madvise_huge(void *addr, size_t size, size_t page_size)
+{
+	if (page_size <= Pagesize)
+		return;
+
+	if (madvise(addr, size, MADV_HUGEPAGE))
+		LOG(4, "!madvise MADV_HUGEPAGE");
+}
+
+/*
+ * vmem_grow -- (internal) add a part big enough for size bytes to a pool
+ *
+ * Returns 0 if the pool grew and the allocation should be retried.
+ */
+static int
+vmem_grow(VMEM *vmp, size_t size)
+{
+	struct vmem_grow *g = vmem_grow_find(vmp, 0);
+	if (g == NULL)
+		return -1;
+
+	/* leave room for the part header and jemalloc metadata */
+	size_t part_size = size > SIZE_MAX - VMEM_MIN_POOL - g->page_size ?
+			SIZE_MAX : roundup(size + VMEM_MIN_POOL, g->page_size);
+	if (part_size < g->grow_size)
+		part_size = g->grow_size;
+
+	util_mutex_lock(&g->lock);
+
+	if (g->max_size != 0 && part_size > g->max_size - g->total_size) {
+		LOG(2, "pool %p cannot grow beyond %zu", vmp, g->max_size);
+		util_mutex_unlock(&g->lock);
+		return -1;
+	}
+
+	struct vmem_part *part = util_map_tmpfile(g->dir, part_size,
+			VMEM_MAP_ALIGN(g->page_size));
+	if (part == NULL) {
+		LOG(2, "cannot map a new part of size %zu", part_size);
+		util_mutex_unlock(&g->lock);
+		return -1;
+	}
+
+	vmem_madvise_huge(part, part_size, g->page_size);
+
+	part->size = part_size;
+	if (je_vmem_pool_extend((pool_t *)((uintptr_t)vmp + Header_size),
+			(void *)((uintptr_t)part + sizeof(*part)),
+			part_size - sizeof(*part), 1) == 0) {
+		ERR("pool extension failed");
+		util_unmap(part, part_size);
+		util_mutex_unlock(&g->lock);
+		return -1;
+	}
+
+	part->next = g->parts;
+	g->parts = part;
+	g->total_size += part_size;
+
+	util_mutex_unlock(&g->lock);
+
+	LOG(3, "pool %p grew by %zu to %zu", vmp, part_size, g->total_size);
+	return 0;
+}
+
+/*
+ * vmem_grow_destroy -- (internal) unmap all added parts of a pool
+ */
+static void
+vmem_grow_destroy(struct vmem_grow *g)
+{
+	while (g->parts != NULL) {
+		struct vmem_part *part = g->parts;
+		g->parts = part->next;
+		util_unmap(part, part->size);
+	}
+
+	util_mutex_destroy(&g->lock);
+	Free(g->dir);
+	Free(g);
+}
+
+/*
+ * vmem_numa_find -- (internal) find a NUMA pool by its handle
+ */
+static inline struct vmem_numa *
+vmem_numa_find(VMEM *vmp)
+{
+	unsigned npools = Numa_npools;
+
+	for (unsigned i = 0; i < npools; i++) {
+		if (Numa_pools[i].vmp == vmp)
+			return &Numa_pools[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * vmem_numa_local -- (internal) pick the pool local to the calling thread
+ */
+static inline VMEM *
+vmem_numa_local(VMEM *vmp)
+{
+	if (Numa_npools == 0)
+		return vmp;
+
+	struct vmem_numa *numa = vmem_numa_find(vmp);
+	if (numa == NULL)
+		return vmp;
+
+	int cpu = sched_getcpu();
+	unsigned node = (cpu < 0 || cpu >= VMEM_NUMA_CPUS_MAX) ?
+			0 : Cpu_node[cpu];
+
+	return numa->nodes[node % numa->nnodes].vmp;
+}
+
+/*
+ * vmem_numa_owner -- (internal) pick the pool containing ptr
+ */
+static inline VMEM *
+vmem_numa_owner(VMEM *vmp, void *ptr)
+{
+	if (Numa_npools == 0 || ptr == NULL)
+		return vmp;
+
+	struct vmem_numa *numa = vmem_numa_find(vmp);
+	if (numa == NULL)
+		return vmp;
+
+	for (unsigned i = 0; i < numa->nnodes; i++) {
+		if ((uintptr_t)ptr - numa->nodes[i].addr < numa->nodes[i].size)
+			return numa->nodes[i].vmp;
+	}
+
+	return vmp;
+}
+
+/*
+ * vmem_numa_cpus_init -- (internal) read the node of each CPU from sysfs
+ *
+ * CPUs without a node (e.g. on a non-NUMA system) are treated as node 0.
+ */
+static void
+vmem_numa_cpus_init(void)
+{
+	char path[64];
+	char list[1024];
+
+	for (unsigned node = 0; node < VMEM_NUMA_NODES_MAX; node++) {
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/node/node%u/cpulist", node);
+
+		FILE *f = fopen(path, "r");
+		if (f == NULL)
+			continue;
+
+		char *s = fgets(list, sizeof(list), f);
+		fclose(f);
+		if (s == NULL)
+			continue;
+
+		/* the list has a form of "0-3,8,10-11" */
+		while (*s >= '0' && *s <= '9') {
+			char *end;
+			unsigned long first = strtoul(s, &end, 10);
+			unsigned long last = first;
+			if (*end == '-')
+				last = strtoul(end + 1, &end, 10);
+
+			for (unsigned long cpu = first; cpu <= last &&
+					cpu < VMEM_NUMA_CPUS_MAX; cpu++)
+				Cpu_node[cpu] = (unsigned char)node;
+
+			s = (*end == ',') ? end + 1 : end;
+		}
+	}
+
+	Cpu_node_initialized = 1;
+}
+
+/*
+ * vmem_numa_unregister -- (internal) release the slot of a NUMA pool
+ *
+ * Returns 1 and a copy of the slot if vmp is a NUMA pool.
+ */
+static int
+vmem_numa_unregister(VMEM *vmp, struct vmem_numa *numa)
+{
+	if (Numa_npools == 0)
+		return 0;
+
+	util_mutex_lock(&Numa_lock);
+
+	struct vmem_numa *slot = vmem_numa_find(vmp);
+	if (slot != NULL) {
+		*numa = *slot;
+		slot->vmp = NULL;
+	}
+
+	util_mutex_unlock(&Numa_lock);
+
+	return slot != NULL;
+}
+
 /*
  * vmem_create -- create a memory pool in a temp file
  */
 VMEM *
 vmem_create(const char *dir, size_t size)
+{
+	return vmem_create_config(dir, size, NULL);
+}
+
+/*
+ * vmem_create_config -- create a memory pool with custom allocator tuning
+ */
+VMEM *
+vmem_create_config(const char *dir, size_t size,
+	const struct vmem_config *config)
 {
 	vmem_init();
-	LOG(3, "dir \"%s\" size %zu", dir, size);
+	LOG(3, "dir \"%s\" size %zu config %p", dir, size, config);
 
 	if (size < VMEM_MIN_POOL) {
 		ERR("size %zu smaller than %zu", size, VMEM_MIN_POOL);
@@ -150,12 +419,74 @@ vmem_create(const char *dir, size_t size)
 		return NULL;
 	}
 
+	pool_config_t pcfg;
+	struct vmem_grow *g = NULL;
+	size_t page_size = Pagesize;
+	if (config != NULL) {
+		if (config->page_size != 0) {
+			if (config->page_size < Pagesize ||
+				(config->page_size & (config->page_size - 1))) {
+				ERR("invalid page_size %zu", config->page_size);
+				errno = EINVAL;
+				return NULL;
+			}
+			page_size = config->page_size;
+		}
+
+		if (config->max_size != 0 &&
+				config->max_size < roundup(size, page_size)) {
+			ERR("max_size %zu smaller than size %zu",
+					config->max_size, size);
+			errno = EINVAL;
+			return NULL;
+		}
+
+		if (config->lg_dirty_mult < VMEM_DIRTY_NEVER ||
+				config->lg_dirty_mult >=
+				(int)(sizeof(size_t) * 8)) {
+			ERR("invalid lg_dirty_mult %d", config->lg_dirty_mult);
+			errno = EINVAL;
+			return NULL;
+		}
+
+		pcfg.narenas = config->narenas;
+		pcfg.tcache_disable = config->tcache_disable != 0;
+		pcfg.tcache_max = config->tcache_max;
+		pcfg.lg_dirty_mult = config->lg_dirty_mult;
+
+		if (config->grow_size != 0) {
+			g = Malloc(sizeof(*g));
+			if (g == NULL) {
+				ERR("!Malloc");
+				return NULL;
+			}
+
+			if ((g->dir = Strdup(dir)) == NULL) {
+				ERR("!Strdup");
+				Free(g);
+				return NULL;
+			}
+
+			util_mutex_init(&g->lock, NULL);
+			g->grow_size = roundup(config->grow_size, page_size);
+			g->max_size = config->max_size;
+			g->page_size = page_size;
+			g->parts = NULL;
+		}
+	}
+
 	/* silently enforce multiple of page size */
-	size = roundup(size, Pagesize);
+	size = roundup(size, page_size);
 
 	void *addr;
-	if ((addr = util_map_tmpfile(dir, size, 4 << 20)) == NULL)
+	if ((addr = util_map_tmpfile(dir, size,
+			VMEM_MAP_ALIGN(page_size))) == NULL) {
+		if (g != NULL)
+			vmem_grow_destroy(g);
 		return NULL;
+	}
+
+	vmem_madvise_huge(addr, size, page_size);
 
 	/* store opaque info at beginning of mapped area */
 	struct vmem *vmp = addr;
@@ -166,13 +497,27 @@ vmem_create(const char *dir, size_t size)
 	vmp->caller_mapped = 0;
 
 	/* Prepare pool for jemalloc */
-	if (je_vmem_pool_create((void *)((uintptr_t)addr + Header_size),
-			size - Header_size, 1) == NULL) {
+	if (je_vmem_pool_create_config(
+			(void *)((uintptr_t)addr + Header_size),
+			size - Header_size, 1,
+			config != NULL ? &pcfg : NULL) == NULL) {
 		ERR("pool creation failed");
 		util_unmap(vmp->addr, vmp->size);
+		if (g != NULL)
+			vmem_grow_destroy(g);
 		return NULL;
 	}
 
+	if (g != NULL) {
+		g->vmp = vmp;
+		g->total_size = size;
+
+		util_mutex_lock(&Grow_list_lock);
+		g->next = Grow_list;
+		Grow_list = g;
+		util_mutex_unlock(&Grow_list_lock);
+	}
+
 	/*
 	 * If possible, turn off all permissions on the pool header page.
 	 *
@@ -233,6 +578,72 @@ vmem_create_in_region(void *addr, size_t size)
 	return vmp;
 }
 
+/*
+ * vmem_create_numa -- create a memory pool with one region per NUMA node
+ */
+VMEM *
+vmem_create_numa(const char *const dirs[], unsigned ndirs, size_t size)
+{
+	vmem_init();
+	LOG(3, "dirs %p ndirs %u size %zu", dirs, ndirs, size);
+
+	if (dirs == NULL || ndirs == 0 || ndirs > VMEM_NUMA_NODES_MAX) {
+		ERR("invalid number of directories %u", ndirs);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct vmem_numa_node nodes[VMEM_NUMA_NODES_MAX];
+	for (unsigned i = 0; i < ndirs; i++) {
+		nodes[i].vmp = vmem_create(dirs[i], size);
+		if (nodes[i].vmp == NULL) {
+			int oerrno = errno;
+			while (i-- > 0)
+				vmem_delete(nodes[i].vmp);
+			errno = oerrno;
+			return NULL;
+		}
+
+		nodes[i].addr = (uintptr_t)nodes[i].vmp;
+		nodes[i].size = roundup(size, Pagesize);
+	}
+
+	util_mutex_lock(&Numa_lock);
+
+	if (!Cpu_node_initialized)
+		vmem_numa_cpus_init();
+
+	unsigned s;
+	for (s = 0; s < Numa_npools; s++) {
+		if (Numa_pools[s].vmp == NULL)
+			break;
+	}
+
+	if (s == VMEM_NUMA_POOLS_MAX) {
+		ERR("too many NUMA pools");
+		util_mutex_unlock(&Numa_lock);
+		for (unsigned i = 0; i < ndirs; i++)
+			vmem_delete(nodes[i].vmp);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	struct vmem_numa *numa = &Numa_pools[s];
+	memcpy(numa->nodes, nodes, ndirs * sizeof(nodes[0]));
+	numa->nnodes = ndirs;
+
+	/* publish the slot only after it is complete */
+	__sync_synchronize();
+	numa->vmp = nodes[0].vmp;
+	if (s == Numa_npools)
+		Numa_npools = s + 1;
+
+	util_mutex_unlock(&Numa_lock);
+
+	LOG(3, "vmp %p", nodes[0].vmp);
+	return nodes[0].vmp;
+}
+
 /*
  * vmem_delete -- delete a memory pool
  */
@@ -241,6 +652,13 @@ vmem_delete(VMEM *vmp)
 {
 	LOG(3, "vmp %p", vmp);
 
+	struct vmem_numa numa;
+	if (vmem_numa_unregister(vmp, &numa)) {
+		for (unsigned i = 0; i < numa.nnodes; i++)
+			vmem_delete(numa.nodes[i].vmp);
+		return;
+	}
+
 	int ret = je_vmem_pool_delete((pool_t *)((uintptr_t)vmp + Header_size));
 	if (ret != 0) {
 		ERR("invalid pool handle: %p", vmp);
@@ -248,6 +666,10 @@ vmem_delete(VMEM *vmp)
 		return;
 	}
 
+	struct vmem_grow *g = vmem_grow_find(vmp, 1);
+	if (g != NULL)
+		vmem_grow_destroy(g);
+
 	util_range_rw(vmp->addr, sizeof(struct pool_hdr));
 
 	if (vmp->caller_mapped == 0)
@@ -263,6 +685,18 @@ vmem_check(VMEM *vmp)
 	vmem_init();
 	LOG(3, "vmp %p", vmp);
 
+	struct vmem_numa *numa = Numa_npools ? vmem_numa_find(vmp) : NULL;
+	if (numa != NULL) {
+		for (unsigned i = 0; i < numa->nnodes; i++) {
+			int ret = je_vmem_pool_check((pool_t *)
+				((uintptr_t)numa->nodes[i].vmp + Header_size));
+			if (ret != 1)
+				return ret;
+		}
+
+		return 1;
+	}
+
 	return je_vmem_pool_check((pool_t *)((uintptr_t)vmp + Header_size));
 }
 
@@ -274,11 +708,45 @@ vmem_stats_print(VMEM *vmp, const char *opts)
 {
 	LOG(3, "vmp %p opts \"%s\"", vmp, opts ? opts : "");
 
+	struct vmem_numa *numa = Numa_npools ? vmem_numa_find(vmp) : NULL;
+	if (numa != NULL) {
+		for (unsigned i = 0; i < numa->nnodes; i++) {
+			LOG_NONL(0, "NUMA node %u:\n", i);
+			je_vmem_pool_malloc_stats_print((pool_t *)
+				((uintptr_t)numa->nodes[i].vmp + Header_size),
+				print_jemalloc_stats, NULL, opts);
+		}
+		return;
+	}
+
 	je_vmem_pool_malloc_stats_print(
 			(pool_t *)((uintptr_t)vmp + Header_size),
 			print_jemalloc_stats, NULL, opts);
 }
 
+/*
+ * vmem_stats_get -- read a single allocator statistic for a pool
+ */
+int
+vmem_stats_get(VMEM *vmp, const char *name, void *oldp, size_t *oldlenp)
+{
+	LOG(3, "vmp %p name \"%s\" oldp %p oldlenp %p", vmp, name, oldp,
+			oldlenp);
+
+	vmp = vmem_numa_local(vmp);
+
+	int ret = je_vmem_pool_mallctl(
+			(pool_t *)((uintptr_t)vmp + Header_size),
+			name, oldp, oldlenp);
+	if (ret) {
+		ERR("cannot read statistic \"%s\"", name);
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * vmem_malloc -- allocate memory
  */
@@ -287,8 +755,13 @@ vmem_malloc(VMEM *vmp, size_t size)
 {
 	LOG(3, "vmp %p size %zu", vmp, size);
 
-	return je_vmem_pool_malloc(
-			(pool_t *)((uintptr_t)vmp + Header_size), size);
+	vmp = vmem_numa_local(vmp);
+	pool_t *pool = (pool_t *)((uintptr_t)vmp + Header_size);
+	void *ptr = je_vmem_pool_malloc(pool, size);
+	if (ptr == NULL && vmem_grow(vmp, size) == 0)
+		ptr = je_vmem_pool_malloc(pool, size);
+
+	return ptr;
 }
 
 /*
@@ -299,6 +772,7 @@ vmem_free(VMEM *vmp, void *ptr)
 {
 	LOG(3, "vmp %p ptr %p", vmp, ptr);
 
+	vmp = vmem_numa_owner(vmp, ptr);
 	je_vmem_pool_free((pool_t *)((uintptr_t)vmp + Header_size), ptr);
 }
 
@@ -310,8 +784,14 @@ vmem_calloc(VMEM *vmp, size_t nmemb, size_t size)
 {
 	LOG(3, "vmp %p nmemb %zu size %zu", vmp, nmemb, size);
 
-	return je_vmem_pool_calloc((pool_t *)((uintptr_t)vmp + Header_size),
-			nmemb, size);
+	vmp = vmem_numa_local(vmp);
+	pool_t *pool = (pool_t *)((uintptr_t)vmp + Header_size);
+	void *ptr = je_vmem_pool_calloc(pool, nmemb, size);
+	if (ptr == NULL && size != 0 && nmemb <= SIZE_MAX / size &&
+			vmem_grow(vmp, nmemb * size) == 0)
+		ptr = je_vmem_pool_calloc(pool, nmemb, size);
+
+	return ptr;
 }
 
 /*
@@ -322,8 +802,13 @@ vmem_realloc(VMEM *vmp, void *ptr, size_t size)
 {
 	LOG(3, "vmp %p ptr %p size %zu", vmp, ptr, size);
 
-	return je_vmem_pool_ralloc((pool_t *)((uintptr_t)vmp + Header_size),
-			ptr, size);
+	vmp = ptr == NULL ? vmem_numa_local(vmp) : vmem_numa_owner(vmp, ptr);
+	pool_t *pool = (pool_t *)((uintptr_t)vmp + Header_size);
+	void *nptr = je_vmem_pool_ralloc(pool, ptr, size);
+	if (nptr == NULL && size != 0 && vmem_grow(vmp, size) == 0)
+		nptr = je_vmem_pool_ralloc(pool, ptr, size);
+
+	return nptr;
 }
 
 /*
@@ -334,9 +819,14 @@ vmem_aligned_alloc(VMEM *vmp, size_t alignment, size_t size)
 {
 	LOG(3, "vmp %p alignment %zu size %zu", vmp, alignment, size);
 
-	return je_vmem_pool_aligned_alloc(
-			(pool_t *)((uintptr_t)vmp + Header_size),
-			alignment, size);
+	vmp = vmem_numa_local(vmp);
+	pool_t *pool = (pool_t *)((uintptr_t)vmp + Header_size);
+	void *ptr = je_vmem_pool_aligned_alloc(pool, alignment, size);
+	if (ptr == NULL && size <= SIZE_MAX - alignment &&
+			vmem_grow(vmp, size + alignment) == 0)
+		ptr = je_vmem_pool_aligned_alloc(pool, alignment, size);
+
+	return ptr;
 }
 
 /*
@@ -348,8 +838,7 @@ vmem_strdup(VMEM *vmp, const char *s)
 	LOG(3, "vmp %p s %p", vmp, s);
 
 	size_t size = strlen(s) + 1;
-	void *retaddr = je_vmem_pool_malloc(
-			(pool_t *)((uintptr_t)vmp + Header_size), size);
+	void *retaddr = vmem_malloc(vmp, size);
 	if (retaddr == NULL)
 		return NULL;
 
@@ -364,6 +853,7 @@ vmem_malloc_usable_size(VMEM *vmp, void *ptr)
 {
 	LOG(3, "vmp %p ptr %p", vmp, ptr);
 
+	vmp = vmem_numa_owner(vmp, ptr);
 	return je_vmem_pool_malloc_usable_size(
 			(pool_t *)((uintptr_t)vmp + Header_size), ptr);
 }
@@ -35,6 +35,8 @@
  */
 
 #include <stddef.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "pool_hdr.h"
 
@@ -57,4 +59,54 @@ struct vmem {
 	int caller_mapped;
 };
 
+/*
+ * part added to a growing pool, the header is stored at the beginning
+ * of the mapped part
+ */
+struct vmem_part {
+	struct vmem_part *next;
+	size_t size;	/* size of mapped part */
+};
+
+/*
+ * growth state of a pool, kept outside of the pool as the header page
+ * is made inaccessible
+ */
+struct vmem_grow {
+	struct vmem_grow *next;
+	struct vmem *vmp;
+	pthread_mutex_t lock;	/* serializes adding parts */
+	char *dir;		/* directory for the added parts */
+	size_t grow_size;
+	size_t max_size;
+	size_t page_size;	/* alignment and size granularity of parts */
+	size_t total_size;	/* size of the pool and all its parts */
+	struct vmem_part *parts;
+};
+
+/* pools are mapped at least jemalloc chunk (4MB) aligned */
+#define VMEM_MAP_ALIGN(page_size) ((page_size) > (4 << 20) ?\
+	(page_size) : (4 << 20))
+
+#define VMEM_NUMA_POOLS_MAX 32	/* max number of NUMA pools at a time */
+#define VMEM_NUMA_CPUS_MAX 4096	/* CPUs above this are treated as node 0 */
+
+/*
+ * one per-node pool of a NUMA pool
+ */
+struct vmem_numa_node {
+	struct vmem *vmp;
+	uintptr_t addr;		/* mapped region of the node pool */
+	size_t size;
+};
+
+/*
+ * NUMA pool, the pool of the first node serves as the handle
+ */
+struct vmem_numa {
+	struct vmem *vmp;	/* NULL for an unused slot */
+	unsigned nnodes;
+	struct vmem_numa_node nodes[VMEM_NUMA_NODES_MAX];
+};
+
 void vmem_init(void);
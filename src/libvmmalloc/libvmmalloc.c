@@ -54,6 +54,12 @@
  *
  * 4) If the process forks, there is no separate log file open for a new
  *    process, even if the configured log file name is terminated with "-".
+ *
+ * 5) If VMMALLOC_SMALL_THRESHOLD is set, allocations smaller than the
+ *    threshold are served from the system heap (DRAM) and only the larger
+ *    ones from the vmem pool.  Whether a block belongs to the pool is
+ *    decided by its address, so free(3) and realloc(3) work for both, and
+ *    realloc(3) moves the block when the new size falls in the other tier.
  */
 
 #define _GNU_SOURCE
@@ -93,6 +99,17 @@ static int Fd;
 static int Fd_clone;
 static int Private;
 static int Forkopt = 1; /* default behavior - remap as private */
+static size_t Pool_size;	/* size of the vmem pool mapping */
+static size_t Small_threshold;	/* smaller allocations go to system heap */
+
+/*
+ * vmmalloc_in_pool -- (internal) true if ptr belongs to the vmem pool
+ */
+static inline int
+vmmalloc_in_pool(void *ptr)
+{
+	return (uintptr_t)ptr - (uintptr_t)Vmp < Pool_size;
+}
 
 
 /*
@@ -108,6 +125,9 @@ malloc(size_t size)
 		return je_vmem_malloc(size);
 	}
 	LOG(4, "size %zu", size);
+	if (size < Small_threshold)
+		return je_vmem_malloc(size);
+
 	return je_vmem_pool_malloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size), size);
 }
@@ -125,6 +145,11 @@ calloc(size_t nmemb, size_t size)
 		return je_vmem_calloc(nmemb, size);
 	}
 	LOG(4, "nmemb %zu, size %zu", nmemb, size);
+	/* on overflow let the pool fail the allocation */
+	if ((size == 0 || nmemb <= SIZE_MAX / size) &&
+			nmemb * size < Small_threshold)
+		return je_vmem_calloc(nmemb, size);
+
 	return je_vmem_pool_calloc((pool_t *)((uintptr_t)Vmp + Header_size),
 			nmemb, size);
 }
@@ -141,8 +166,31 @@ realloc(void *ptr, size_t size)
 		return je_vmem_realloc(ptr, size);
 	}
 	LOG(4, "ptr %p, size %zu", ptr, size);
-	return je_vmem_pool_ralloc((pool_t *)((uintptr_t)Vmp + Header_size),
-			ptr, size);
+	if (ptr == NULL)
+		return malloc(size);
+
+	int in_pool = vmmalloc_in_pool(ptr);
+	int to_pool = size == 0 ? in_pool : size >= Small_threshold;
+
+	if (in_pool == to_pool) {
+		if (!in_pool)
+			return je_vmem_realloc(ptr, size);
+
+		return je_vmem_pool_ralloc(
+				(pool_t *)((uintptr_t)Vmp + Header_size),
+				ptr, size);
+	}
+
+	/* the new size belongs to the other tier - move the block */
+	void *new_ptr = malloc(size);
+	if (new_ptr == NULL)
+		return NULL;
+
+	size_t old_size = malloc_usable_size(ptr);
+	memcpy(new_ptr, ptr, MIN(old_size, size));
+	free(ptr);
+
+	return new_ptr;
 }
 
 /*
@@ -156,6 +204,11 @@ free(void *ptr)
 		return;
 	}
 	LOG(4, "ptr %p", ptr);
+	if (!vmmalloc_in_pool(ptr)) {
+		je_vmem_free(ptr);
+		return;
+	}
+
 	je_vmem_pool_free((pool_t *)((uintptr_t)Vmp + Header_size), ptr);
 }
 
@@ -172,6 +225,11 @@ cfree(void *ptr)
 		return;
 	}
 	LOG(4, "ptr %p", ptr);
+	if (!vmmalloc_in_pool(ptr)) {
+		je_vmem_free(ptr);
+		return;
+	}
+
 	je_vmem_pool_free((pool_t *)((uintptr_t)Vmp + Header_size), ptr);
 }
 
@@ -191,6 +249,9 @@ memalign(size_t boundary, size_t size)
 		return je_vmem_memalign(boundary, size);
 	}
 	LOG(4, "boundary %zu  size %zu", boundary, size);
+	if (size < Small_threshold)
+		return je_vmem_memalign(boundary, size);
+
 	return je_vmem_pool_aligned_alloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size),
 			boundary, size);
@@ -217,6 +278,9 @@ aligned_alloc(size_t alignment, size_t size)
 		return je_vmem_aligned_alloc(alignment, size);
 	}
 	LOG(4, "alignment %zu  size %zu", alignment, size);
+	if (size < Small_threshold)
+		return je_vmem_aligned_alloc(alignment, size);
+
 	return je_vmem_pool_aligned_alloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size),
 			alignment, size);
@@ -238,6 +302,9 @@ posix_memalign(void **memptr, size_t alignment, size_t size)
 		return je_vmem_posix_memalign(memptr, alignment, size);
 	}
 	LOG(4, "alignment %zu  size %zu", alignment, size);
+	if (size < Small_threshold)
+		return je_vmem_posix_memalign(memptr, alignment, size);
+
 	*memptr = je_vmem_pool_aligned_alloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size),
 			alignment, size);
@@ -262,6 +329,9 @@ valloc(size_t size)
 		return je_vmem_valloc(size);
 	}
 	LOG(4, "size %zu", size);
+	if (size < Small_threshold)
+		return je_vmem_valloc(size);
+
 	return je_vmem_pool_aligned_alloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size),
 			Pagesize, size);
@@ -278,6 +348,9 @@ pvalloc(size_t size)
 		return je_vmem_valloc(roundup(size, Pagesize));
 	}
 	LOG(4, "size %zu", size);
+	if (roundup(size, Pagesize) < Small_threshold)
+		return je_vmem_valloc(roundup(size, Pagesize));
+
 	return je_vmem_pool_aligned_alloc(
 			(pool_t *)((uintptr_t)Vmp + Header_size),
 			Pagesize, roundup(size, Pagesize));
@@ -294,6 +367,9 @@ malloc_usable_size(void *ptr)
 		return je_vmem_malloc_usable_size(ptr);
 	}
 	LOG(4, "ptr %p", ptr);
+	if (!vmmalloc_in_pool(ptr))
+		return je_vmem_malloc_usable_size(ptr);
+
 	return je_vmem_pool_malloc_usable_size(
 			(pool_t *)((uintptr_t)Vmp + Header_size), ptr);
 }
@@ -368,7 +444,7 @@ libvmmalloc_create(const char *dir, size_t size)
 	}
 
 	void *addr;
-	if ((addr = util_map(Fd, size, 0, 4 << 20)) == NULL) {
+	if ((addr = util_map(Fd, size, MAP_SHARED, 4 << 20)) == NULL) {
 		(void) close(Fd);
 		return NULL;
 	}
@@ -654,6 +730,19 @@ libvmmalloc_init(void)
 		abort();
 	}
 
+	if ((env_str = getenv(VMMALLOC_SMALL_THRESHOLD_VAR)) != NULL) {
+		long long v = atoll(env_str);
+		if (v < 0) {
+			out_log(NULL, 0, NULL, 0,
+				"Error (libvmmalloc): negative %s",
+				VMMALLOC_SMALL_THRESHOLD_VAR);
+			abort();
+		}
+
+		Small_threshold = (size_t)v;
+		LOG(4, "Small allocations threshold %zu", Small_threshold);
+	}
+
 	if ((env_str = getenv(VMMALLOC_FORK_VAR)) != NULL) {
 		Forkopt = atoi(env_str);
 		if (Forkopt < 0 || Forkopt > 3) {
@@ -676,6 +765,8 @@ libvmmalloc_init(void)
 		abort();
 	}
 
+	Pool_size = Vmp->size;
+
 	LOG(2, "initialization completed");
 }
 
@@ -42,3 +42,4 @@
 #define VMMALLOC_POOL_DIR_VAR "VMMALLOC_POOL_DIR"
 #define VMMALLOC_POOL_SIZE_VAR "VMMALLOC_POOL_SIZE"
 #define VMMALLOC_FORK_VAR "VMMALLOC_FORK"
+#define VMMALLOC_SMALL_THRESHOLD_VAR "VMMALLOC_SMALL_THRESHOLD"
@@ -55,6 +55,7 @@
 #define RPMEM_DEF_SSH	"ssh"
 #define RPMEM_PROV_SOCKET_ENV	"RPMEM_ENABLE_SOCKETS"
 #define RPMEM_PROV_VERBS_ENV	"RPMEM_ENABLE_VERBS"
+#define RPMEM_STATS_ENV		"RPMEM_ENABLE_STATS"
 
 #include <sys/socket.h>
 #include <netdb.h>
@@ -224,12 +224,12 @@ struct rpmem_fip_lane_attr {
 static struct rpmem_fip_lane_attr
 rpmem_fip_lane_attrs[MAX_RPMEM_FIP_NODE][MAX_RPMEM_PM] = {
 	[RPMEM_FIP_NODE_CLIENT][RPMEM_PM_GPSPM] = {
-		.n_per_sq = 2, /* WRITE + SEND */
+		.n_per_sq = RPMEM_FIP_MAX_WRITES + 1, /* WRITEs + SEND */
 		.n_per_rq = 1, /* RECV */
 		.n_per_cq = 2, /* SEND + RECV */
 	},
 	[RPMEM_FIP_NODE_CLIENT][RPMEM_PM_APM] = {
-		.n_per_sq = 2, /* WRITE + READ */
+		.n_per_sq = RPMEM_FIP_MAX_WRITES + 1, /* WRITEs + READ */
 		.n_per_rq = 0, /* unused */
 		.n_per_cq = 1, /* READ */
 	},
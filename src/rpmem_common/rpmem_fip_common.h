@@ -43,6 +43,7 @@
 
 #define RPMEM_FIVERSION FI_VERSION(1, 1)
 #define RPMEM_FIP_CQ_WAIT_MS	100
+#define RPMEM_FIP_MAX_WRITES	8 /* max unsignaled WRITEs per persist */
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
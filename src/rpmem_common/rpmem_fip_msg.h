@@ -110,6 +110,20 @@ rpmem_fip_writemsg(struct fid_ep *ep, struct rpmem_fip_rma *rma,
 	return (int)fi_writemsg(ep, &rma->msg, rma->flags);
 }
 
+/*
+ * rpmem_fip_inject_write -- wrapper for fi_inject_write
+ *
+ * The buffer is copied by the provider before the call returns, thus no
+ * completion is generated regardless of the RMA operation flags.
+ */
+static inline int
+rpmem_fip_inject_write(struct fid_ep *ep, struct rpmem_fip_rma *rma,
+	const void *buff, size_t len, uint64_t addr)
+{
+	return (int)fi_inject_write(ep, buff, len, rma->msg.addr, addr,
+			rma->rma_iov.key);
+}
+
 /*
  * rpmem_fip_readmsg -- wrapper for fi_readmsg
  */
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * blk_queue.c -- unit test for asynchronous block I/O queues
+ *
+ * usage: blk_queue bsize file depth nthread
+ *
+ */
+
+#include "unittest.h"
+
+static size_t Bsize;
+static size_t Nblock;
+static PMEMblkqueue *Queue;
+
+/*
+ * fill -- (internal) the byte written to the given block
+ */
+static unsigned char
+fill(long long blockno)
+{
+	return (unsigned char)(blockno % 255 + 1);
+}
+
+/*
+ * run -- (internal) push all of the requests through the queue, keeping it
+ *	full, and return the number of the requests which failed
+ */
+static unsigned
+run(struct pmemblk_io *ios, unsigned n, unsigned depth)
+{
+	struct pmemblk_io **sub = MALLOC(n * sizeof(*sub));
+	struct pmemblk_io **done = MALLOC(depth * sizeof(*done));
+	unsigned submitted = 0;
+	unsigned completed = 0;
+	unsigned failed = 0;
+
+	for (unsigned i = 0; i < n; ++i)
+		sub[i] = &ios[i];
+
+	while (completed < n) {
+		int ret = pmemblk_queue_submit(Queue, &sub[submitted],
+				n - submitted);
+		UT_ASSERT(ret >= 0);
+		UT_ASSERT(submitted + (unsigned)ret - completed <= depth);
+		submitted += (unsigned)ret;
+
+		ret = pmemblk_queue_poll(Queue, done, depth, 1);
+		UT_ASSERT(ret > 0);
+		for (int i = 0; i < ret; ++i) {
+			if (done[i]->error)
+				failed++;
+		}
+		completed += (unsigned)ret;
+	}
+
+	UT_ASSERTeq(pmemblk_queue_poll(Queue, done, depth, depth), 0);
+
+	FREE(done);
+	FREE(sub);
+
+	return failed;
+}
+
+/*
+ * check_bufs -- (internal) verify the blocks read, even ones are zeroed
+ */
+static void
+check_bufs(struct pmemblk_io *ios, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		unsigned char *buf = ios[i].buf;
+		unsigned char val = ios[i].blockno % 2 ? fill(ios[i].blockno) : 0;
+
+		for (size_t b = 0; b < Bsize; ++b) {
+			if (buf[b] != val)
+				UT_FATAL("block %lld byte %zu: %u != %u",
+					ios[i].blockno, b, buf[b], val);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "blk_queue");
+
+	if (argc != 5)
+		UT_FATAL("usage: %s bsize file depth nthread", argv[0]);
+
+	Bsize = strtoul(argv[1], NULL, 0);
+	const char *path = argv[2];
+	unsigned depth = (unsigned)strtoul(argv[3], NULL, 0);
+	unsigned nthread = (unsigned)strtoul(argv[4], NULL, 0);
+
+	PMEMblkpool *handle;
+	if ((handle = pmemblk_create(path, Bsize, 0,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemblk_create", path);
+
+	Nblock = pmemblk_nblock(handle);
+	if (Nblock > 1000)
+		Nblock = 1000;
+
+	UT_OUT("%s block size %zu depth %u nthread %u", argv[1], Bsize,
+		depth, nthread);
+
+	UT_ASSERTeq(pmemblk_queue_new(handle, 0, nthread), NULL);
+	UT_OUT("!pmemblk_queue_new depth 0");
+	UT_ASSERTeq(pmemblk_queue_new(handle, depth, 0), NULL);
+	UT_OUT("!pmemblk_queue_new nthread 0");
+
+	Queue = pmemblk_queue_new(handle, depth, nthread);
+	if (Queue == NULL)
+		UT_FATAL("!pmemblk_queue_new");
+
+	unsigned n = (unsigned)Nblock;
+	struct pmemblk_io *ios = MALLOC(n * sizeof(*ios));
+	unsigned char *bufs = MALLOC(n * Bsize);
+
+	/* write all of the blocks */
+	for (unsigned i = 0; i < n; ++i) {
+		ios[i].opcode = PMEMBLK_IO_WRITE;
+		ios[i].buf = bufs + i * Bsize;
+		ios[i].blockno = i;
+		ios[i].error = -1;
+		memset(ios[i].buf, fill(i), Bsize);
+	}
+	UT_OUT("write: %u failed", run(ios, n, depth));
+
+	/* zero the even ones */
+	unsigned nzero = 0;
+	for (unsigned i = 0; i < n; i += 2) {
+		ios[nzero].opcode = PMEMBLK_IO_SET_ZERO;
+		ios[nzero].buf = NULL;
+		ios[nzero].blockno = i;
+		nzero++;
+	}
+	UT_OUT("set_zero: %u failed", run(ios, nzero, depth));
+
+	/* read everything back */
+	memset(bufs, 0xff, n * Bsize);
+	for (unsigned i = 0; i < n; ++i) {
+		ios[i].opcode = PMEMBLK_IO_READ;
+		ios[i].buf = bufs + i * Bsize;
+		ios[i].blockno = i;
+	}
+	UT_OUT("read: %u failed", run(ios, n, depth));
+	check_bufs(ios, n);
+
+	/* requests which fail */
+	ios[0].opcode = PMEMBLK_IO_READ;
+	ios[0].blockno = -1;
+	ios[1].opcode = PMEMBLK_IO_WRITE;
+	ios[1].blockno = (long long)pmemblk_nblock(handle);
+	ios[2].opcode = 100;
+	ios[2].blockno = 0;
+	UT_OUT("invalid: %u failed", run(ios, 3, depth));
+	for (unsigned i = 0; i < 3; ++i)
+		UT_OUT("io %u: %s", i, strerror(ios[i].error));
+
+	/* the queue never takes more than depth requests */
+	struct pmemblk_io **sub = MALLOC((depth + 1) * sizeof(*sub));
+	for (unsigned i = 0; i <= depth; ++i) {
+		ios[i].opcode = PMEMBLK_IO_READ;
+		ios[i].buf = bufs + i * Bsize;
+		ios[i].blockno = i;
+		sub[i] = &ios[i];
+	}
+	UT_ASSERTeq(pmemblk_queue_submit(Queue, sub, depth + 1), depth);
+	UT_ASSERTeq(pmemblk_queue_submit(Queue, &sub[depth], 1), 0);
+	UT_ASSERTeq(pmemblk_queue_poll(Queue, sub, depth + 1, depth + 1),
+		depth);
+	UT_OUT("overflow: ok");
+
+	/* requests still in flight are finished by pmemblk_queue_delete */
+	UT_ASSERTeq(pmemblk_queue_submit(Queue, sub, depth), depth);
+	pmemblk_queue_delete(Queue);
+
+	FREE(sub);
+	FREE(bufs);
+	FREE(ios);
+
+	pmemblk_close(handle);
+
+	int result = pmemblk_check(path, Bsize);
+	if (result < 0)
+		UT_OUT("!%s: pmemblk_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemblk_check: not consistent", path);
+
+	DONE(NULL);
+}
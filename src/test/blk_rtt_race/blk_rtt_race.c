@@ -0,0 +1,292 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * blk_rtt_race.c -- unit test for btt reads racing with the writes reusing
+ *	their blocks
+ *
+ * usage: blk_rtt_race
+ *
+ * A read of an LBA is stalled either right after it looked up the map entry
+ * or while it reads the data block. Meanwhile the LBA is overwritten, which
+ * frees the block the read is using, and a write of another LBA in the same
+ * lane is about to reuse that block. The second write has to wait until the
+ * read is done, and the read has to return the old data.
+ *
+ * While the read is using the data block, the writes of another lane after
+ * the one which frees the block must not let the write reusing it skip the
+ * scan of the rtt either.
+ */
+
+#include "unittest.h"
+#include "btt.h"
+#include "btt_layout.h"
+
+#define RAWSIZE BTT_MIN_SIZE
+#define LBASIZE 512
+#define NLANES 3
+
+#define WRITE_LANE 0
+#define READ_LANE 1
+#define SIDE_LANE 2
+
+#define NO_LBA UINT64_MAX
+
+/* how long the second write is expected to wait, in milliseconds */
+#define WRITE_WAIT 200
+
+enum stall {
+	STALL_NONE,
+	STALL_MAP,	/* after the map entry is looked up */
+	STALL_DATA,	/* before the data block is read */
+};
+
+static char *Ns;
+static struct btt *Bttp;
+
+/* where the reading thread stalls */
+static __thread enum stall Stall;
+
+static int Stalled;
+static int Released;
+static int Write_done;
+
+/*
+ * stall_wait -- (internal) stalls the reading thread until it's released
+ */
+static void
+stall_wait(void)
+{
+	Stall = STALL_NONE;
+	__sync_fetch_and_add(&Stalled, 1);
+	while (!__sync_fetch_and_add(&Released, 0))
+		usleep(1000);
+}
+
+/*
+ * nsread -- btt callback for reading
+ */
+static int
+nsread(void *ns, unsigned lane, void *buf, size_t count, uint64_t off)
+{
+	UT_ASSERT(off + count <= RAWSIZE);
+
+	if (Stall == STALL_DATA && count == LBASIZE)
+		stall_wait();
+
+	memcpy(buf, Ns + off, count);
+
+	if (Stall == STALL_MAP && count == sizeof(uint32_t))
+		stall_wait();
+
+	return 0;
+}
+
+/*
+ * nswrite -- btt callback for writing
+ */
+static int
+nswrite(void *ns, unsigned lane, const void *buf, size_t count, uint64_t off)
+{
+	UT_ASSERT(off + count <= RAWSIZE);
+
+	memcpy(Ns + off, buf, count);
+	return 0;
+}
+
+/*
+ * nszero -- btt callback for zeroing
+ */
+static int
+nszero(void *ns, unsigned lane, size_t count, uint64_t off)
+{
+	UT_ASSERT(off + count <= RAWSIZE);
+
+	memset(Ns + off, 0, count);
+	return 0;
+}
+
+/*
+ * nsmap -- btt callback for memory mapping
+ */
+static ssize_t
+nsmap(void *ns, unsigned lane, void **addrp, size_t len, uint64_t off)
+{
+	UT_ASSERT(off + len <= RAWSIZE);
+
+	*addrp = Ns + off;
+	return (ssize_t)len;
+}
+
+/*
+ * nssync -- btt callback for memory synchronization
+ */
+static void
+nssync(void *ns, unsigned lane, void *addr, size_t len)
+{
+}
+
+static const struct ns_callback Ns_cb = {
+	.nsread = nsread,
+	.nswrite = nswrite,
+	.nszero = nszero,
+	.nsmap = nsmap,
+	.nssync = nssync,
+	.ns_is_zeroed = 1,
+};
+
+struct read_args {
+	uint64_t lba;
+	enum stall stall;
+	char buf[LBASIZE];
+};
+
+/*
+ * reader -- (internal) reads the LBA, stalling at the given point
+ */
+static void *
+reader(void *arg)
+{
+	struct read_args *args = arg;
+
+	Stall = args->stall;
+	UT_ASSERTeq(btt_read(Bttp, READ_LANE, args->lba, args->buf), 0);
+
+	return NULL;
+}
+
+/*
+ * writer -- (internal) writes the LBA, reusing the block of the read
+ */
+static void *
+writer(void *arg)
+{
+	char buf[LBASIZE];
+	memset(buf, 'c', LBASIZE);
+
+	UT_ASSERTeq(btt_write(Bttp, WRITE_LANE, *(uint64_t *)arg, buf), 0);
+	__sync_fetch_and_add(&Write_done, 1);
+
+	return NULL;
+}
+
+/*
+ * test_race -- (internal) overwrites the LBA being read and reuses its block,
+ *	writing the side LBA in another lane meanwhile if it's given
+ */
+static void
+test_race(enum stall stall, uint64_t lba, uint64_t other_lba,
+	uint64_t side_lba)
+{
+	char buf[LBASIZE];
+
+	/*
+	 * The second write scans the rtt, which raises the lower bound of the
+	 * epochs of the reads to the epoch the read below starts in.
+	 */
+	memset(buf, 'a', LBASIZE);
+	UT_ASSERTeq(btt_write(Bttp, WRITE_LANE, lba, buf), 0);
+	UT_ASSERTeq(btt_write(Bttp, WRITE_LANE, lba, buf), 0);
+
+	Stalled = 0;
+	Released = 0;
+	Write_done = 0;
+
+	struct read_args args;
+	args.lba = lba;
+	args.stall = stall;
+
+	pthread_t read_thread;
+	PTHREAD_CREATE(&read_thread, NULL, reader, &args);
+	while (!__sync_fetch_and_add(&Stalled, 0))
+		usleep(1000);
+
+	/* frees the block of the read, which the lane is going to reuse */
+	memset(buf, 'b', LBASIZE);
+	UT_ASSERTeq(btt_write(Bttp, WRITE_LANE, lba, buf), 0);
+
+	/*
+	 * The second write of the side lane reuses a block freed after the
+	 * one of the read, so it scans the rtt and finds the read in progress.
+	 */
+	if (side_lba != NO_LBA) {
+		UT_ASSERTeq(btt_write(Bttp, SIDE_LANE, side_lba, buf), 0);
+		UT_ASSERTeq(btt_write(Bttp, SIDE_LANE, side_lba, buf), 0);
+	}
+
+	pthread_t write_thread;
+	PTHREAD_CREATE(&write_thread, NULL, writer, &other_lba);
+
+	usleep(WRITE_WAIT * 1000);
+	UT_ASSERTeq(__sync_fetch_and_add(&Write_done, 0), 0);
+
+	__sync_fetch_and_add(&Released, 1);
+
+	PTHREAD_JOIN(read_thread, NULL);
+	PTHREAD_JOIN(write_thread, NULL);
+
+	for (size_t i = 0; i < LBASIZE; ++i)
+		UT_ASSERTeq(args.buf[i], 'a');
+
+	UT_ASSERTeq(btt_read(Bttp, WRITE_LANE, lba, buf), 0);
+	for (size_t i = 0; i < LBASIZE; ++i)
+		UT_ASSERTeq(buf[i], 'b');
+
+	UT_ASSERTeq(btt_read(Bttp, WRITE_LANE, other_lba, buf), 0);
+	for (size_t i = 0; i < LBASIZE; ++i)
+		UT_ASSERTeq(buf[i], 'c');
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "blk_rtt_race");
+
+	Ns = ZALLOC(RAWSIZE);
+
+	uint8_t parent_uuid[BTTINFO_UUID_LEN];
+	memset(parent_uuid, 0, sizeof(parent_uuid));
+
+	Bttp = btt_init(RAWSIZE, LBASIZE, parent_uuid, NLANES, NULL, &Ns_cb);
+	UT_ASSERTne(Bttp, NULL);
+	UT_ASSERTeq(btt_nlane(Bttp), NLANES);
+
+	test_race(STALL_MAP, 0, 1, NO_LBA);
+	test_race(STALL_DATA, 2, 3, NO_LBA);
+	test_race(STALL_DATA, 4, 5, 6);
+
+	btt_fini(Bttp);
+	FREE(Ns);
+
+	DONE(NULL);
+}
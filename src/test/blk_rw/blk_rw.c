@@ -31,12 +31,16 @@
  */
 
 /*
- * blk_rw.c -- unit test for pmemblk_read/write/set_zero/set_error
+ * blk_rw.c -- unit test for pmemblk_read/write/readv/writev/read_map/set_zero/
+ *	set_error
  *
  * usage: blk_rw bsize file func operation:lba...
  *
- * func is 'c' or 'o' (create or open)
- * operations are 'r' or 'w' or 'z' or 'e'
+ * func is 'c' or 'o' (create or open), or 'l:arena_size,nfree' (create with
+ * the given layout)
+ * operations are 'r' or 'w' or 'z' or 'e' or 'm' (map for reading in place),
+ * or 'R' or 'W' which read or write a vector of comma separated lbas,
+ * or 'Z' which zeroes a range of blocks given as lba,count
  *
  */
 
@@ -44,6 +48,8 @@
 
 size_t Bsize;
 
+#define MAX_VEC 16
+
 /*
  * construct -- build a buffer for writing
  */
@@ -65,7 +71,7 @@ construct(unsigned char *buf)
  * ident -- identify what a buffer holds
  */
 static char *
-ident(unsigned char *buf)
+ident(const unsigned char *buf)
 {
 	static char descr[100];
 	unsigned val = *buf;
@@ -80,6 +86,27 @@ ident(unsigned char *buf)
 	return descr;
 }
 
+/*
+ * parse_vec -- parse a comma separated list of lbas into a vector
+ */
+static size_t
+parse_vec(const char *arg, struct pmemblk_vec *vec, unsigned char *bufs)
+{
+	size_t cnt = 0;
+	char *end;
+	do {
+		if (cnt == MAX_VEC)
+			UT_FATAL("too many lbas: %s", arg);
+
+		vec[cnt].blockno = strtoll(arg, &end, 0);
+		vec[cnt].buf = bufs + cnt * Bsize;
+		cnt++;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return cnt;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -105,6 +132,21 @@ main(int argc, char *argv[])
 			if (handle == NULL)
 				UT_FATAL("!%s: pmemblk_open", path);
 			break;
+		case 'l': {
+			struct pmemblk_layout layout;
+			char *end;
+			layout.arena_size = strtoul(argv[3] + 2, &end, 0);
+			if (*end != ',')
+				UT_FATAL("invalid layout %s", argv[3]);
+			layout.nfree = (unsigned)strtoul(end + 1, NULL, 0);
+			handle = pmemblk_create_layout(path, Bsize, 0,
+					S_IWUSR | S_IRUSR, &layout);
+			if (handle == NULL)
+				UT_FATAL("!%s: pmemblk_create_layout", path);
+			break;
+		}
+		default:
+			UT_FATAL("unknown func %s", argv[3]);
 	}
 
 	UT_OUT("%s block size %zu usable blocks %zu",
@@ -114,11 +156,21 @@ main(int argc, char *argv[])
 	if (buf == NULL)
 		UT_FATAL("cannot allocate buf");
 
+	unsigned char *bufs = MALLOC(Bsize * MAX_VEC);
+	struct pmemblk_vec vec[MAX_VEC];
+	size_t cnt;
+	const void *addr;
+	int mh;
+	size_t nblock;
+
 	/* map each file argument with the given map type */
 	for (int arg = 4; arg < argc; arg++) {
-		if (strchr("rwze", argv[arg][0]) == NULL || argv[arg][1] != ':')
-			UT_FATAL("op must be r: or w: or z: or e:");
-		off_t lba = strtol(&argv[arg][2], NULL, 0);
+		if (strchr("rwzemRWZ", argv[arg][0]) == NULL ||
+				argv[arg][1] != ':')
+			UT_FATAL("op must be r: or w: or z: or e: or m: or "
+					"R: or W: or Z:");
+		char *end;
+		off_t lba = strtol(&argv[arg][2], &end, 0);
 
 		switch (argv[arg][0]) {
 		case 'r':
@@ -145,15 +197,60 @@ main(int argc, char *argv[])
 				UT_OUT("set_zero  lba %jd", lba);
 			break;
 
+		case 'Z':
+			nblock = *end == ',' ? strtoul(end + 1, NULL, 0) : 1;
+			if (pmemblk_set_zero_range(handle, lba, nblock) < 0)
+				UT_OUT("!set_zero  lba %jd count %zu", lba,
+						nblock);
+			else
+				UT_OUT("set_zero  lba %jd count %zu", lba,
+						nblock);
+			break;
+
 		case 'e':
 			if (pmemblk_set_error(handle, lba) < 0)
 				UT_OUT("!set_error lba %jd", lba);
 			else
 				UT_OUT("set_error lba %jd", lba);
 			break;
+
+		case 'm':
+			mh = pmemblk_read_map(handle, lba, &addr);
+			if (mh < 0) {
+				UT_OUT("!read_map  lba %jd", lba);
+				break;
+			}
+			UT_OUT("read_map  lba %jd: %s", lba, ident(addr));
+			UT_ASSERTeq(pmemblk_read_release(handle, mh), 0);
+			break;
+
+		case 'R':
+			cnt = parse_vec(&argv[arg][2], vec, bufs);
+			if (pmemblk_readv(handle, vec, cnt) < 0) {
+				UT_OUT("!readv     %s", &argv[arg][2]);
+				break;
+			}
+			for (size_t i = 0; i < cnt; ++i)
+				UT_OUT("readv     lba %lld: %s", vec[i].blockno,
+						ident(vec[i].buf));
+			break;
+
+		case 'W':
+			cnt = parse_vec(&argv[arg][2], vec, bufs);
+			for (size_t i = 0; i < cnt; ++i)
+				construct(vec[i].buf);
+			if (pmemblk_writev(handle, vec, cnt) < 0) {
+				UT_OUT("!writev    %s", &argv[arg][2]);
+				break;
+			}
+			for (size_t i = 0; i < cnt; ++i)
+				UT_OUT("writev    lba %lld: %s", vec[i].blockno,
+						ident(vec[i].buf));
+			break;
 		}
 	}
 
+	FREE(bufs);
 	FREE(buf);
 	pmemblk_close(handle);
 
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_append_batch.c -- unit test for pmemlog_append_batch
+ *
+ * usage: log_append_batch file1 file2 file3
+ *
+ * Appends batches of records spanning the logs created in the three files
+ * from several threads at once and verifies the records of each thread
+ * appear in each log in the order they were batched.
+ */
+
+#include "unittest.h"
+
+#define NPOOLS 3
+#define NTHREADS 4
+#define NBATCHES 500
+#define MAX_OPS 20	/* more than the library keeps on the stack */
+
+struct rec {
+	uint32_t thread;
+	uint32_t seq;		/* per thread and pool */
+	uint32_t pool;
+	uint32_t check;
+};
+
+static PMEMlogpool *Pools[NPOOLS];
+
+/*
+ * batch_pool -- (internal) the pool of the i-th append of a batch
+ */
+static unsigned
+batch_pool(unsigned thread, unsigned batch, unsigned i)
+{
+	return (thread + i * i + batch) % NPOOLS;
+}
+
+/*
+ * batch_nops -- (internal) the number of appends in a batch
+ */
+static unsigned
+batch_nops(unsigned thread, unsigned batch)
+{
+	return 1 + (batch * 7 + thread) % MAX_OPS;
+}
+
+/*
+ * rec_check -- (internal) the check value of a record
+ */
+static uint32_t
+rec_check(const struct rec *r)
+{
+	return r->thread * 0x9e3779b9u ^ r->seq * 0x85ebca6bu ^ r->pool;
+}
+
+/*
+ * worker -- (internal) append the batches of a thread
+ */
+static void *
+worker(void *arg)
+{
+	unsigned thread = (unsigned)(uintptr_t)arg;
+	uint32_t seq[NPOOLS] = { 0 };
+	struct rec recs[MAX_OPS];
+	struct pmemlog_append_op ops[MAX_OPS];
+
+	for (unsigned b = 0; b < NBATCHES; b++) {
+		unsigned nops = batch_nops(thread, b);
+
+		for (unsigned i = 0; i < nops; i++) {
+			unsigned pool = batch_pool(thread, b, i);
+
+			recs[i].thread = thread;
+			recs[i].seq = seq[pool]++;
+			recs[i].pool = pool;
+			recs[i].check = rec_check(&recs[i]);
+
+			ops[i].plp = Pools[pool];
+			ops[i].buf = &recs[i];
+			ops[i].count = sizeof(recs[i]);
+		}
+
+		UT_ASSERTeq(pmemlog_append_batch(ops, nops), 0);
+	}
+
+	return NULL;
+}
+
+struct verify {
+	uint32_t pool;
+	uint32_t next[NTHREADS];	/* next expected sequence numbers */
+	unsigned nrecs;
+};
+
+/*
+ * verify_chunk -- (internal) check the records of a log are in order,
+ *	called by pmemlog_walk()
+ */
+static int
+verify_chunk(const void *buf, size_t len, void *arg)
+{
+	struct verify *v = arg;
+	const struct rec *r = buf;
+
+	UT_ASSERTeq(len % sizeof(*r), 0);
+
+	for (size_t i = 0; i < len / sizeof(*r); i++) {
+		UT_ASSERT(r[i].thread < NTHREADS);
+		UT_ASSERTeq(r[i].pool, v->pool);
+		UT_ASSERTeq(r[i].check, rec_check(&r[i]));
+		if (r[i].seq != v->next[r[i].thread])
+			UT_FATAL("pool %u thread %u: record %u, expected %u",
+					v->pool, r[i].thread, r[i].seq,
+					v->next[r[i].thread]);
+		v->next[r[i].thread]++;
+		v->nrecs++;
+	}
+
+	return 1;
+}
+
+/*
+ * verify -- (internal) check the records of all logs
+ */
+static void
+verify(const char *when)
+{
+	unsigned expected[NPOOLS] = { 0 };
+
+	for (unsigned t = 0; t < NTHREADS; t++)
+		for (unsigned b = 0; b < NBATCHES; b++)
+			for (unsigned i = 0; i < batch_nops(t, b); i++)
+				expected[batch_pool(t, b, i)]++;
+
+	for (uint32_t p = 0; p < NPOOLS; p++) {
+		struct verify v = { .pool = p, .nrecs = 0 };
+		memset(v.next, 0, sizeof(v.next));
+
+		pmemlog_walk(Pools[p], 0, verify_chunk, &v);
+
+		UT_ASSERTeq(v.nrecs, expected[p]);
+		UT_ASSERTeq(pmemlog_tell(Pools[p]),
+				(long long)(v.nrecs * sizeof(struct rec)));
+
+		UT_OUT("%s: log %u: %u records", when, p, v.nrecs);
+	}
+}
+
+/*
+ * check_partial -- (internal) run a batch with an append which doesn't fit
+ */
+static void
+check_partial(void)
+{
+	static char big[PMEMLOG_MIN_POOL];
+	struct rec r = { .thread = 0, .seq = 0, .pool = 0 };
+
+	long long tell[NPOOLS];
+	for (unsigned p = 0; p < NPOOLS; p++)
+		tell[p] = pmemlog_tell(Pools[p]);
+
+	struct pmemlog_append_op ops[] = {
+		{ Pools[1], &r, sizeof(r) },
+		{ Pools[0], &r, sizeof(r) },
+		{ Pools[2], big, sizeof(big) },
+		{ Pools[0], &r, sizeof(r) },
+	};
+
+	UT_ASSERTeq(pmemlog_append_batch(ops, 4), -1);
+	UT_ASSERTeq(errno, ENOSPC);
+
+	/* the appends before the failed one are done */
+	UT_ASSERTeq(pmemlog_tell(Pools[0]), tell[0] + (long long)sizeof(r));
+	UT_ASSERTeq(pmemlog_tell(Pools[1]), tell[1] + (long long)sizeof(r));
+	UT_ASSERTeq(pmemlog_tell(Pools[2]), tell[2]);
+
+	/* an empty batch does nothing */
+	UT_ASSERTeq(pmemlog_append_batch(ops, 0), 0);
+	UT_ASSERTeq(pmemlog_tell(Pools[0]), tell[0] + (long long)sizeof(r));
+
+	UT_OUT("partial batch done");
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_append_batch");
+
+	if (argc != NPOOLS + 1)
+		UT_FATAL("usage: %s file1 file2 file3", argv[0]);
+
+	for (unsigned p = 0; p < NPOOLS; p++) {
+		if ((Pools[p] = pmemlog_create(argv[p + 1], PMEMLOG_MIN_POOL,
+				S_IWUSR | S_IRUSR)) == NULL)
+			UT_FATAL("!%s: pmemlog_create", argv[p + 1]);
+	}
+
+	pthread_t threads[NTHREADS];
+	for (unsigned t = 0; t < NTHREADS; t++)
+		PTHREAD_CREATE(&threads[t], NULL, worker,
+				(void *)(uintptr_t)t);
+	for (unsigned t = 0; t < NTHREADS; t++)
+		PTHREAD_JOIN(threads[t], NULL);
+
+	verify("appended");
+
+	for (unsigned p = 0; p < NPOOLS; p++) {
+		pmemlog_close(Pools[p]);
+		if ((Pools[p] = pmemlog_open(argv[p + 1])) == NULL)
+			UT_FATAL("!%s: pmemlog_open", argv[p + 1]);
+	}
+
+	verify("reopened");
+
+	check_partial();
+
+	for (unsigned p = 0; p < NPOOLS; p++)
+		pmemlog_close(Pools[p]);
+
+	DONE(NULL);
+}
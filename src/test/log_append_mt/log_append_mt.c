@@ -0,0 +1,238 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_append_mt.c -- unit test for multi-threaded appends
+ *
+ * usage: log_append_mt file nthread nops
+ *
+ * Each thread appends nops records, using pmemlog_append(),
+ * pmemlog_appendv() and pmemlog_reserve()/pmemlog_commit() in turn, and
+ * then keeps appending until the log is full.  Every record carries the
+ * number of the thread and a per-thread sequence number, so the walk at
+ * the end can tell torn, lost or reordered appends.
+ */
+
+#include "unittest.h"
+
+#define REC_PAD 48
+
+struct rec {
+	uint32_t tid;
+	uint32_t seq;
+	uint8_t pad[REC_PAD];
+	uint32_t check;
+	uint32_t unused;
+};
+
+static PMEMlogpool *Handle;
+static unsigned Nthread;
+static unsigned Nops;
+
+/*
+ * rec_fill -- (internal) build a record
+ */
+static void
+rec_fill(struct rec *r, uint32_t tid, uint32_t seq)
+{
+	r->tid = tid;
+	r->seq = seq;
+	memset(r->pad, (int)((tid + seq) & 0xff), REC_PAD);
+	r->check = ~(tid ^ seq);
+	r->unused = 0;
+}
+
+/*
+ * rec_append -- (internal) append a record, in one of the three ways
+ */
+static int
+rec_append(struct rec *r)
+{
+	switch (r->seq % 3) {
+	case 0:
+		return pmemlog_append(Handle, r, sizeof(*r));
+	case 1: {
+		struct iovec iov[2] = {
+			{ .iov_base = r, .iov_len = sizeof(*r) / 2 },
+			{ .iov_base = (char *)r + sizeof(*r) / 2,
+				.iov_len = sizeof(*r) - sizeof(*r) / 2 },
+		};
+
+		return pmemlog_appendv(Handle, iov, 2);
+	}
+	default: {
+		void *addr = pmemlog_reserve(Handle, sizeof(*r));
+		if (addr == NULL)
+			return -1;
+
+		memcpy(addr, r, sizeof(*r));
+
+		return pmemlog_commit(Handle, addr, sizeof(*r));
+	}
+	}
+}
+
+/*
+ * worker -- (internal) the work each thread performs
+ */
+static void *
+worker(void *arg)
+{
+	uint32_t tid = (uint32_t)(uintptr_t)arg;
+	struct rec r;
+	uint32_t seq = 0;
+
+	for (; seq < Nops; seq++) {
+		rec_fill(&r, tid, seq);
+		if (rec_append(&r) < 0)
+			UT_FATAL("!append tid %u seq %u", tid, seq);
+	}
+
+	/* fill up the log */
+	for (;; seq++) {
+		rec_fill(&r, tid, seq);
+		if (rec_append(&r) < 0) {
+			UT_ASSERTeq(errno, ENOSPC);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+struct walk_state {
+	uint32_t *next_seq;	/* expected sequence number of each thread */
+	size_t nrec;		/* number of records seen */
+};
+
+/*
+ * check_rec -- (internal) verify a record, called by pmemlog_walk()
+ */
+static int
+check_rec(const void *buf, size_t len, void *arg)
+{
+	struct walk_state *ws = arg;
+	struct rec r;
+
+	UT_ASSERTeq(len, sizeof(r));
+	memcpy(&r, buf, sizeof(r));
+
+	if (r.tid >= Nthread || r.check != ~(r.tid ^ r.seq))
+		UT_FATAL("record %zu: torn", ws->nrec);
+
+	for (int i = 0; i < REC_PAD; i++) {
+		if (r.pad[i] != ((r.tid + r.seq) & 0xff))
+			UT_FATAL("record %zu: torn at byte %d", ws->nrec, i);
+	}
+
+	if (r.seq != ws->next_seq[r.tid])
+		UT_FATAL("record %zu: tid %u seq %u, expected %u", ws->nrec,
+			r.tid, r.seq, ws->next_seq[r.tid]);
+
+	ws->next_seq[r.tid]++;
+	ws->nrec++;
+
+	return 1;
+}
+
+/*
+ * check_log -- (internal) walk the log and verify all of the records
+ */
+static void
+check_log(void)
+{
+	struct walk_state ws;
+	ws.next_seq = ZALLOC(Nthread * sizeof(*ws.next_seq));
+	ws.nrec = 0;
+
+	pmemlog_walk(Handle, sizeof(struct rec), check_rec, &ws);
+
+	long long tell = pmemlog_tell(Handle);
+	UT_ASSERTeq((size_t)tell, ws.nrec * sizeof(struct rec));
+	UT_ASSERT(tell + sizeof(struct rec) > pmemlog_nbyte(Handle));
+
+	for (unsigned i = 0; i < Nthread; i++)
+		UT_ASSERT(ws.next_seq[i] >= Nops);
+
+	UT_OUT("log full, all records intact");
+
+	FREE(ws.next_seq);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_append_mt");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file nthread nops", argv[0]);
+
+	const char *path = argv[1];
+	Nthread = (unsigned)strtoul(argv[2], NULL, 0);
+	Nops = (unsigned)strtoul(argv[3], NULL, 0);
+
+	if ((Handle = pmemlog_create(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create", path);
+
+	UT_OUT("%u threads %u appends", Nthread, Nops);
+
+	pthread_t *threads = MALLOC(Nthread * sizeof(pthread_t));
+
+	for (unsigned i = 0; i < Nthread; i++)
+		PTHREAD_CREATE(&threads[i], NULL, worker, (void *)(uintptr_t)i);
+
+	for (unsigned i = 0; i < Nthread; i++)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	FREE(threads);
+
+	check_log();
+
+	pmemlog_close(Handle);
+
+	/* the committed write offset covers all of the records */
+	if ((Handle = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	check_log();
+
+	pmemlog_close(Handle);
+
+	int result = pmemlog_check(path);
+	if (result < 0)
+		UT_OUT("!%s: pmemlog_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemlog_check: not consistent", path);
+
+	DONE(NULL);
+}
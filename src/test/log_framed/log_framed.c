@@ -0,0 +1,286 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_framed.c -- unit test for framed logs
+ *
+ * usage: log_framed file1 file2
+ *
+ * Appends records of various lengths to a framed ring log created in file1
+ * with each of the append functions, walks them with pmemlog_walk_records()
+ * and checks a corrupted record ends the walk.  file2 is used for a regular
+ * log.
+ */
+
+#include "unittest.h"
+
+#define MAX_RECS 100000
+#define MAX_LEN 300
+
+static long long Ends[MAX_RECS];	/* log position after each record */
+
+/*
+ * rec_len -- (internal) length of the record with sequence number seq
+ */
+static size_t
+rec_len(uint32_t seq)
+{
+	return (seq * 53) % MAX_LEN;
+}
+
+/*
+ * rec_fill -- (internal) fill in the data of the record seq
+ */
+static void
+rec_fill(char *buf, uint32_t seq)
+{
+	for (size_t i = 0; i < rec_len(seq); i++)
+		buf[i] = (char)(seq + i);
+}
+
+/*
+ * append_rec -- (internal) append the record seq, with an append function
+ *	depending on seq, returns the address of its data if it was reserved
+ */
+static int
+append_rec(PMEMlogpool *plp, uint32_t seq, char **addrp)
+{
+	char buf[MAX_LEN];
+	size_t len = rec_len(seq);
+	rec_fill(buf, seq);
+
+	*addrp = NULL;
+
+	switch (seq % 4) {
+	case 0:
+		return pmemlog_append(plp, buf, len);
+	case 1: {
+		struct iovec iov[3] = {
+			{ buf, len / 3 },
+			{ buf + len / 3, len / 3 },
+			{ buf + 2 * (len / 3), len - 2 * (len / 3) },
+		};
+		return pmemlog_appendv(plp, iov, 3);
+	}
+	case 2: {
+		struct pmemlog_append_op op = { plp, buf, len };
+		return pmemlog_append_batch(&op, 1);
+	}
+	default: {
+		char *addr = pmemlog_reserve(plp, len);
+		if (addr == NULL) {
+			/* the space would wrap around */
+			if (errno == EAGAIN)
+				return pmemlog_append(plp, buf, len);
+			return -1;
+		}
+		memcpy(addr, buf, len);
+		*addrp = addr;
+		return pmemlog_commit(plp, addr, len);
+	}
+	}
+}
+
+/*
+ * append -- (internal) append records until the log is full, returns the
+ *	next sequence number
+ */
+static uint32_t
+append(PMEMlogpool *plp, uint32_t seq)
+{
+	char *addr;
+
+	for (; seq < MAX_RECS; seq++) {
+		if (append_rec(plp, seq, &addr) < 0) {
+			UT_ASSERTeq(errno, ENOSPC);
+			break;
+		}
+		Ends[seq] = pmemlog_tell(plp);
+	}
+
+	UT_ASSERT(seq < MAX_RECS);
+
+	return seq;
+}
+
+struct walk_arg {
+	uint32_t seq;		/* next expected record */
+	uint32_t stop;		/* record at which the walk stops */
+};
+
+/*
+ * check_record -- (internal) verify a record, called by
+ *	pmemlog_walk_records()
+ */
+static int
+check_record(const void *buf, size_t len, void *arg)
+{
+	struct walk_arg *wa = arg;
+	char expected[MAX_LEN];
+
+	if (len != rec_len(wa->seq))
+		UT_FATAL("record %u: length %zu, expected %zu", wa->seq, len,
+				rec_len(wa->seq));
+
+	rec_fill(expected, wa->seq);
+	UT_ASSERTeq(memcmp(buf, expected, len), 0);
+
+	return ++wa->seq != wa->stop;
+}
+
+/*
+ * check_walk -- (internal) walk the records from first to end
+ */
+static void
+check_walk(PMEMlogpool *plp, const char *when, uint32_t first, uint32_t end)
+{
+	struct walk_arg wa = { first, MAX_RECS };
+
+	UT_ASSERTeq(pmemlog_walk_records(plp, check_record, &wa), 0);
+	UT_ASSERTeq(wa.seq, end);
+
+	UT_OUT("%s: records %u-%u", when, first, end);
+}
+
+/*
+ * corrupt -- (internal) flip a byte at offset off of the file
+ */
+static void
+corrupt(const char *path, off_t off)
+{
+	char c;
+	int fd = OPEN(path, O_RDWR);
+
+	LSEEK(fd, off, SEEK_SET);
+	UT_ASSERTeq(read(fd, &c, 1), 1);
+	c = (char)~c;
+	LSEEK(fd, off, SEEK_SET);
+	WRITE(fd, &c, 1);
+
+	CLOSE(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_framed");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	const char *path = argv[1];
+	struct pmemlog_layout layout = { 1, 0, 1 };
+	PMEMlogpool *plp;
+
+	if ((plp = pmemlog_create_layout(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR, &layout)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_layout", path);
+
+	check_walk(plp, "empty", 0, 0);
+
+	uint32_t end = append(plp, 0);
+	check_walk(plp, "appended", 0, end);
+
+	/* the frames take 8 bytes each */
+	UT_ASSERTeq(Ends[0], 8);
+	UT_ASSERTeq(Ends[1], 8 + 8 + (long long)rec_len(1));
+
+	/* a walk stopped by the callback */
+	struct walk_arg wa = { 0, 10 };
+	UT_ASSERTeq(pmemlog_walk_records(plp, check_record, &wa), 0);
+	UT_ASSERTeq(wa.seq, 10);
+
+	/* make the records wrap around the end of the log space */
+	uint32_t first = end / 2;
+	UT_ASSERTeq(pmemlog_truncate_head(plp, Ends[first - 1]), 0);
+	uint32_t wrapped = append(plp, end);
+	UT_ASSERT(wrapped > end);
+
+	/* the data of one of the records must be split by the wrap-around */
+	long long nbyte = (long long)pmemlog_nbyte(plp);
+	uint32_t split = end;
+	while (split < wrapped &&
+			(Ends[split - 1] + 8) / nbyte == Ends[split] / nbyte)
+		split++;
+	UT_ASSERT(split < wrapped);
+
+	check_walk(plp, "wrapped", first, wrapped);
+
+	pmemlog_close(plp);
+
+	if ((plp = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	check_walk(plp, "reopened", first, wrapped);
+
+	/* corrupt the data of a record appended with pmemlog_reserve() */
+	uint32_t bad = wrapped - 1;
+	while (bad % 4 != 3 || rec_len(bad) == 0)
+		bad--;
+
+	UT_ASSERTeq(pmemlog_truncate_head(plp, Ends[bad - 1]), 0);
+
+	char *addr;
+	UT_ASSERTeq(append_rec(plp, bad, &addr), 0);
+	UT_ASSERTne(addr, NULL);
+	off_t off = addr - (char *)plp;
+
+	pmemlog_close(plp);
+
+	corrupt(path, off);
+
+	if ((plp = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	wa.seq = bad;
+	wa.stop = MAX_RECS;
+	UT_ASSERTeq(pmemlog_walk_records(plp, check_record, &wa), -1);
+	UT_ASSERTeq(errno, EBADMSG);
+	UT_ASSERTeq(wa.seq, wrapped);
+
+	UT_OUT("corrupted: records %u-%u", bad, wa.seq);
+
+	pmemlog_close(plp);
+
+	/* a regular log can't be walked by records */
+	path = argv[2];
+	if ((plp = pmemlog_create(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create", path);
+
+	UT_ASSERTeq(pmemlog_walk_records(plp, check_record, &wa), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	pmemlog_close(plp);
+
+	DONE(NULL);
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_index.c -- unit test for indexed logs
+ *
+ * usage: log_index file1 file2 file3
+ *
+ * Appends variable-length records to an indexed log created in file1 and
+ * checks that pmemlog_seek() finds a record boundary close enough before
+ * each position, before and after reopening the pool and rewinding it.
+ * file2 is used for an indexed ring log whose data wraps around the end
+ * of the log space, file3 for a regular log without an index.
+ */
+
+#include <sys/param.h>
+
+#include "unittest.h"
+
+#define INTERVAL 4096
+#define MAX_RECS 100000
+#define MAX_REC_LEN 1000
+#define SEEK_STEP 13	/* distance between the positions to seek to */
+
+static long long Starts[MAX_RECS];	/* positions of the records */
+
+/*
+ * rec_len -- (internal) length of the record with sequence number seq
+ */
+static size_t
+rec_len(uint64_t seq)
+{
+	return 1 + (seq * 7919) % MAX_REC_LEN;
+}
+
+/*
+ * append -- (internal) append records until the log is full, returns the
+ *	next sequence number
+ */
+static uint64_t
+append(PMEMlogpool *plp, uint64_t seq)
+{
+	char buf[MAX_REC_LEN];
+
+	for (; seq < MAX_RECS; seq++) {
+		Starts[seq] = pmemlog_tell(plp);
+		memset(buf, (int)(seq & 0xff), rec_len(seq));
+		if (pmemlog_append(plp, buf, rec_len(seq)) < 0) {
+			UT_ASSERTeq(errno, ENOSPC);
+			break;
+		}
+	}
+
+	UT_ASSERT(seq < MAX_RECS);
+
+	return seq;
+}
+
+/*
+ * find_rec -- (internal) return the sequence number of the record which
+ *	starts at position off
+ */
+static uint64_t
+find_rec(long long off, uint64_t first, uint64_t end)
+{
+	while (first < end) {
+		uint64_t mid = first + (end - first) / 2;
+		if (Starts[mid] < off)
+			first = mid + 1;
+		else
+			end = mid;
+	}
+
+	return first;
+}
+
+/*
+ * check_seek -- (internal) seek to positions all over the log, which holds
+ *	the records from first to end
+ */
+static void
+check_seek(PMEMlogpool *plp, uint64_t first, uint64_t end)
+{
+	long long head = pmemlog_head(plp);
+	long long tell = pmemlog_tell(plp);
+
+	for (long long off = head; ; off = MIN(off + SEEK_STEP, tell)) {
+		long long found = pmemlog_seek(plp, off);
+		UT_ASSERT(found >= head && found <= off);
+
+		/* the index covers the whole log */
+		UT_ASSERT(off - found < INTERVAL + MAX_REC_LEN);
+
+		/* the position found is a record boundary */
+		uint64_t seq = find_rec(found, first, end);
+		UT_ASSERT(found == tell || (seq < end && Starts[seq] == found));
+
+		if (off == tell)
+			break;
+	}
+
+	UT_ASSERTeq(pmemlog_seek(plp, head - 1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemlog_seek(plp, tell + 1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_OUT("records %ju-%ju: seek ok", first, end);
+}
+
+/*
+ * read_at -- (internal) read the record containing position off, using
+ *	the index to find where to start
+ */
+static void
+read_at(PMEMlogpool *plp, long long off, uint64_t first, uint64_t end)
+{
+	long long pos = pmemlog_seek(plp, off);
+	uint64_t seq = find_rec(pos, first, end);
+	char buf[MAX_REC_LEN];
+
+	PMEMlogcursor *cur = pmemlog_cursor_new(plp, pos);
+	UT_ASSERTne(cur, NULL);
+
+	/* skip the records before off */
+	for (;; seq++) {
+		UT_ASSERT(seq < end);
+		size_t len = rec_len(seq);
+		UT_ASSERTeq(pmemlog_cursor_next(cur, buf, len), (ssize_t)len);
+		if (pos + (long long)len > off)
+			break;
+		pos += (long long)len;
+	}
+
+	for (size_t i = 0; i < rec_len(seq); i++)
+		UT_ASSERTeq(buf[i], (char)(seq & 0xff));
+
+	pmemlog_cursor_delete(cur);
+
+	UT_OUT("record at %lld: %ju", off, seq);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_index");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file1 file2 file3", argv[0]);
+
+	const char *path = argv[1];
+	PMEMlogpool *plp;
+	struct pmemlog_layout layout = { 0, INTERVAL / 2 };
+
+	UT_ASSERTeq(pmemlog_create_layout(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR, &layout), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	layout.index_interval = INTERVAL;
+	if ((plp = pmemlog_create_layout(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR, &layout)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_layout", path);
+
+	UT_OUT("nbyte %zu", pmemlog_nbyte(plp));
+
+	check_seek(plp, 0, 0);
+
+	uint64_t end = append(plp, 0);
+	check_seek(plp, 0, end);
+	read_at(plp, 1000000, 0, end);
+
+	pmemlog_close(plp);
+
+	if ((plp = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	check_seek(plp, 0, end);
+	read_at(plp, pmemlog_tell(plp) - 1, 0, end);
+
+	/* a rewound log is indexed from scratch */
+	pmemlog_rewind(plp);
+	check_seek(plp, 0, 0);
+	end = append(plp, 0);
+	check_seek(plp, 0, end);
+
+	pmemlog_close(plp);
+
+	int result = pmemlog_check(path);
+	if (result < 0)
+		UT_OUT("!%s: pmemlog_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemlog_check: not consistent", path);
+
+	/* an indexed ring log */
+	path = argv[2];
+	layout.ring = 1;
+	if ((plp = pmemlog_create_layout(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR, &layout)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_layout", path);
+
+	end = append(plp, 0);
+	uint64_t first = end / 2;
+	UT_ASSERTeq(pmemlog_truncate_head(plp, Starts[first]), 0);
+	end = append(plp, end);
+	check_seek(plp, first, end);
+
+	pmemlog_close(plp);
+
+	if ((plp = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	check_seek(plp, first, end);
+	read_at(plp, pmemlog_tell(plp) - 1, first, end);
+
+	pmemlog_close(plp);
+
+	/* without an index, the head of the log is the only boundary known */
+	path = argv[3];
+	if ((plp = pmemlog_create(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create", path);
+
+	end = append(plp, 0);
+	UT_ASSERTeq(pmemlog_seek(plp, pmemlog_tell(plp)), 0);
+
+	pmemlog_close(plp);
+
+	DONE(NULL);
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_ring.c -- unit test for ring logs
+ *
+ * usage: log_ring file1 file2
+ *
+ * Fills a ring log created in file1, releases a part of it with
+ * pmemlog_truncate_head() and appends past the end of the log space,
+ * then walks the log before and after reopening the pool.  file2 is used
+ * for a regular log, which can't be truncated.
+ */
+
+#include "unittest.h"
+
+#define REC_SIZE 104	/* doesn't divide the log space, records wrap */
+#define NRELEASE 10000	/* number of records released by truncation */
+
+struct rec {
+	uint64_t seq;
+	char data[REC_SIZE - sizeof(uint64_t)];
+};
+
+/*
+ * rec_fill -- (internal) build a record
+ */
+static void
+rec_fill(struct rec *r, uint64_t seq)
+{
+	r->seq = seq;
+	memset(r->data, (int)(seq & 0xff), sizeof(r->data));
+}
+
+/*
+ * fill -- (internal) append records until the log is full
+ *
+ * Builds the records in the log space with pmemlog_reserve() whenever
+ * possible.  Returns the next sequence number.
+ */
+static uint64_t
+fill(PMEMlogpool *plp, uint64_t seq)
+{
+	struct rec r;
+	unsigned nwrapped = 0;
+	uint64_t first = seq;
+
+	for (;; seq++) {
+		void *addr = pmemlog_reserve(plp, sizeof(r));
+		if (addr != NULL) {
+			rec_fill(addr, seq);
+			UT_ASSERTeq(pmemlog_commit(plp, addr, sizeof(r)), 0);
+			continue;
+		}
+
+		if (errno == ENOSPC)
+			break;
+
+		/* the record would wrap around, so it has to be copied */
+		UT_ASSERTeq(errno, EAGAIN);
+		nwrapped++;
+
+		rec_fill(&r, seq);
+		UT_ASSERTeq(pmemlog_append(plp, &r, sizeof(r)), 0);
+	}
+
+	UT_OUT("appended %ju records, %u wrapped", seq - first, nwrapped);
+
+	return seq;
+}
+
+struct walk_state {
+	uint64_t seq;		/* expected sequence number */
+	size_t nchunks;		/* number of callback calls */
+	size_t len;		/* total length of the chunks */
+};
+
+/*
+ * check_rec -- (internal) verify a record, called by pmemlog_walk()
+ */
+static int
+check_rec(const void *buf, size_t len, void *arg)
+{
+	struct walk_state *ws = arg;
+	struct rec r;
+
+	UT_ASSERTeq(len, sizeof(r));
+	memcpy(&r, buf, sizeof(r));
+
+	if (r.seq != ws->seq)
+		UT_FATAL("seq %ju, expected %ju", r.seq, ws->seq);
+
+	for (size_t i = 0; i < sizeof(r.data); i++) {
+		if (r.data[i] != (char)(r.seq & 0xff))
+			UT_FATAL("record %ju: torn at byte %zu", r.seq, i);
+	}
+
+	ws->seq++;
+
+	return 1;
+}
+
+/*
+ * count_chunk -- (internal) count the chunks passed by pmemlog_walk()
+ */
+static int
+count_chunk(const void *buf, size_t len, void *arg)
+{
+	struct walk_state *ws = arg;
+
+	ws->nchunks++;
+	ws->len += len;
+
+	return 1;
+}
+
+/*
+ * check_log -- (internal) walk the log and verify the records
+ */
+static void
+check_log(PMEMlogpool *plp, uint64_t first, uint64_t end)
+{
+	long long head = pmemlog_head(plp);
+	long long tell = pmemlog_tell(plp);
+
+	UT_ASSERTeq((uint64_t)head, first * sizeof(struct rec));
+	UT_ASSERTeq((uint64_t)tell, end * sizeof(struct rec));
+
+	struct walk_state ws = { first, 0, 0 };
+	pmemlog_walk(plp, sizeof(struct rec), check_rec, &ws);
+	UT_ASSERTeq(ws.seq, end);
+
+	pmemlog_walk(plp, 0, count_chunk, &ws);
+	UT_ASSERTeq(ws.len, (size_t)(tell - head));
+
+	UT_OUT("head %lld tell %lld records %ju-%ju in %zu chunks", head,
+			tell, first, end, ws.nchunks);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_ring");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	const char *path = argv[1];
+	PMEMlogpool *plp;
+
+	if ((plp = pmemlog_create_ring(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_ring", path);
+
+	UT_OUT("nbyte %zu", pmemlog_nbyte(plp));
+
+	uint64_t end = fill(plp, 0);
+	check_log(plp, 0, end);
+
+	/* release the first records and reuse their space */
+	UT_ASSERTeq(pmemlog_truncate_head(plp,
+			NRELEASE * sizeof(struct rec)), 0);
+	end = fill(plp, end);
+	check_log(plp, NRELEASE, end);
+
+	pmemlog_close(plp);
+
+	if ((plp = pmemlog_open(path)) == NULL)
+		UT_FATAL("!%s: pmemlog_open", path);
+
+	check_log(plp, NRELEASE, end);
+
+	/* the head can't move backwards or past the data */
+	long long tell = pmemlog_tell(plp);
+	UT_ASSERTeq(pmemlog_truncate_head(plp, tell + 1), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemlog_truncate_head(plp, 0), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* release everything, then add a single record */
+	UT_ASSERTeq(pmemlog_truncate_head(plp, tell), 0);
+	check_log(plp, end, end);
+
+	struct rec r;
+	rec_fill(&r, end);
+	UT_ASSERTeq(pmemlog_append(plp, &r, sizeof(r)), 0);
+	check_log(plp, end, end + 1);
+
+	pmemlog_rewind(plp);
+	check_log(plp, 0, 0);
+
+	pmemlog_close(plp);
+
+	int result = pmemlog_check(path);
+	if (result < 0)
+		UT_OUT("!%s: pmemlog_check", path);
+	else if (result == 0)
+		UT_OUT("%s: pmemlog_check: not consistent", path);
+
+	/* regular logs don't reuse their space */
+	path = argv[2];
+	if ((plp = pmemlog_create(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create", path);
+
+	UT_ASSERTeq(pmemlog_truncate_head(plp, 0), -1);
+	UT_ASSERTeq(errno, ENOTSUP);
+	UT_ASSERTeq(pmemlog_head(plp), 0);
+
+	pmemlog_close(plp);
+
+	DONE(NULL);
+}
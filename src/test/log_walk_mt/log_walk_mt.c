@@ -0,0 +1,452 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_walk_mt.c -- unit test for log cursors and parallel walks
+ *
+ * usage: log_walk_mt file1 file2 file3
+ *
+ * Reads variable-length records appended to a regular log created in file1
+ * with a cursor, also while more records are appended, and walks them with
+ * pmemlog_walk_parallel() using various numbers of threads.  file2 is used
+ * for a ring log whose data wraps around the end of the log space, file3
+ * for a ring log which is appended to and truncated during a walk.
+ */
+
+#include "unittest.h"
+
+#define MAX_RECS 100000
+#define CURSOR_BUF 1000	/* doesn't match the record boundaries */
+
+struct rec_hdr {
+	uint32_t len;	/* total length of the record */
+	uint32_t seq;
+};
+
+static unsigned Visited[MAX_RECS];
+static PMEMlogpool *Walked;	/* the pool walked by blocked_walker() */
+
+/*
+ * rec_len -- (internal) length of the record with sequence number seq
+ */
+static size_t
+rec_len(uint32_t seq)
+{
+	return sizeof(struct rec_hdr) + (seq * 37) % 200;
+}
+
+/*
+ * append -- (internal) append records until the log is full or the end
+ *	sequence number is reached, returns the next sequence number
+ */
+static uint32_t
+append(PMEMlogpool *plp, uint32_t seq, uint32_t end)
+{
+	char buf[sizeof(struct rec_hdr) + 200];
+
+	for (; seq < end; seq++) {
+		struct rec_hdr hdr = { (uint32_t)rec_len(seq), seq };
+		memcpy(buf, &hdr, sizeof(hdr));
+		memset(buf + sizeof(hdr), (int)(seq & 0xff),
+				hdr.len - sizeof(hdr));
+
+		if (pmemlog_append(plp, buf, hdr.len) < 0) {
+			UT_ASSERTeq(errno, ENOSPC);
+			break;
+		}
+	}
+
+	UT_ASSERT(seq < MAX_RECS);
+
+	return seq;
+}
+
+/*
+ * check_rec -- (internal) verify the record at the beginning of buf and
+ *	return its sequence number
+ */
+static uint32_t
+check_rec(const char *buf, size_t len)
+{
+	struct rec_hdr hdr;
+
+	UT_ASSERT(len >= sizeof(hdr));
+	memcpy(&hdr, buf, sizeof(hdr));
+	UT_ASSERT(hdr.seq < MAX_RECS);
+	UT_ASSERTeq(hdr.len, rec_len(hdr.seq));
+	UT_ASSERT(hdr.len <= len);
+
+	for (size_t i = sizeof(hdr); i < hdr.len; i++) {
+		if (buf[i] != (char)(hdr.seq & 0xff))
+			UT_FATAL("record %u: torn at byte %zu", hdr.seq, i);
+	}
+
+	return hdr.seq;
+}
+
+/*
+ * read_cursor -- (internal) read the records at the cursor up to the end of
+ *	the log, starting with the sequence number seq
+ */
+static uint32_t
+read_cursor(PMEMlogcursor *cur, uint32_t seq)
+{
+	char buf[CURSOR_BUF + sizeof(struct rec_hdr) + 200];
+	size_t len = 0;
+	ssize_t ret;
+
+	while ((ret = pmemlog_cursor_next(cur, buf + len, CURSOR_BUF)) > 0) {
+		len += (size_t)ret;
+
+		size_t off = 0;
+		while (len - off >= sizeof(struct rec_hdr)) {
+			struct rec_hdr hdr;
+			memcpy(&hdr, buf + off, sizeof(hdr));
+			if (hdr.len > len - off)
+				break;
+
+			if (check_rec(buf + off, len - off) != seq)
+				UT_FATAL("seq %u, expected %u", hdr.seq, seq);
+
+			seq++;
+			off += hdr.len;
+		}
+
+		/* keep the beginning of the partial record */
+		memmove(buf, buf + off, len - off);
+		len -= off;
+	}
+
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(len, 0);
+
+	return seq;
+}
+
+/*
+ * record_size -- (internal) return the size of a record, called by
+ *	pmemlog_walk_parallel()
+ */
+static size_t
+record_size(const void *buf, size_t len, void *arg)
+{
+	struct rec_hdr hdr;
+
+	UT_ASSERT(len >= sizeof(hdr));
+	memcpy(&hdr, buf, sizeof(hdr));
+
+	return hdr.len;
+}
+
+/*
+ * bad_record_size -- (internal) return an invalid record size
+ */
+static size_t
+bad_record_size(const void *buf, size_t len, void *arg)
+{
+	return 0;
+}
+
+/*
+ * visit_chunk -- (internal) mark the records of a chunk as visited, called
+ *	by pmemlog_walk_parallel()
+ */
+static int
+visit_chunk(const void *buf, size_t len, void *arg)
+{
+	const char *data = buf;
+	size_t off = 0;
+
+	while (off < len) {
+		uint32_t seq = check_rec(data + off, len - off);
+		__sync_fetch_and_add(&Visited[seq], 1);
+		off += rec_len(seq);
+	}
+
+	UT_ASSERTeq(off, len);
+
+	return 1;
+}
+
+/*
+ * stop_chunk -- (internal) count the chunks and end the walk at the first one
+ */
+static int
+stop_chunk(const void *buf, size_t len, void *arg)
+{
+	__sync_fetch_and_add((unsigned *)arg, 1);
+
+	return 0;
+}
+
+struct walk_sync {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int walking;		/* the walk has started */
+	int go;			/* the walk may go on */
+	uint32_t nrecs;		/* number of records walked */
+};
+
+/*
+ * blocked_chunk -- (internal) wait until the walk may go on, then verify
+ *	the records, called by pmemlog_walk()
+ */
+static int
+blocked_chunk(const void *buf, size_t len, void *arg)
+{
+	struct walk_sync *ws = arg;
+
+	pthread_mutex_lock(&ws->lock);
+	ws->walking = 1;
+	pthread_cond_signal(&ws->cond);
+	while (!ws->go)
+		pthread_cond_wait(&ws->cond, &ws->lock);
+	pthread_mutex_unlock(&ws->lock);
+
+	const char *data = buf;
+	size_t off = 0;
+
+	while (off < len) {
+		uint32_t seq = check_rec(data + off, len - off);
+		UT_ASSERTeq(seq, ws->nrecs);
+		ws->nrecs++;
+		off += rec_len(seq);
+	}
+
+	return 1;
+}
+
+/*
+ * blocked_walker -- (internal) walk a log, blocked in the callback
+ */
+static void *
+blocked_walker(void *arg)
+{
+	struct walk_sync *ws = arg;
+
+	pmemlog_walk(Walked, 0, blocked_chunk, ws);
+
+	return NULL;
+}
+
+/*
+ * check_blocked_walk -- (internal) append to and truncate a full ring log
+ *	while a walk of its records is in progress
+ */
+static void
+check_blocked_walk(PMEMlogpool *plp)
+{
+	struct walk_sync ws = { .walking = 0, .go = 0, .nrecs = 0 };
+	pthread_mutex_init(&ws.lock, NULL);
+	pthread_cond_init(&ws.cond, NULL);
+
+	uint32_t end = append(plp, 0, MAX_RECS);
+
+	Walked = plp;
+	pthread_t walker;
+	PTHREAD_CREATE(&walker, NULL, blocked_walker, &ws);
+
+	pthread_mutex_lock(&ws.lock);
+	while (!ws.walking)
+		pthread_cond_wait(&ws.cond, &ws.lock);
+	pthread_mutex_unlock(&ws.lock);
+
+	/* the walker doesn't block the truncation */
+	long long tell = pmemlog_tell(plp);
+	UT_ASSERTeq(pmemlog_truncate_head(plp, tell), 0);
+	UT_ASSERTeq(pmemlog_head(plp), tell);
+
+	/* ...nor the appends, but the space it reads can't be reused yet */
+	UT_ASSERTeq(append(plp, end, MAX_RECS), end);
+
+	pthread_mutex_lock(&ws.lock);
+	ws.go = 1;
+	pthread_cond_signal(&ws.cond);
+	pthread_mutex_unlock(&ws.lock);
+
+	PTHREAD_JOIN(walker, NULL);
+	UT_ASSERTeq(ws.nrecs, end);
+
+	/* once the walk is done, it can */
+	UT_ASSERT(append(plp, end, MAX_RECS) > end);
+
+	pthread_cond_destroy(&ws.cond);
+	pthread_mutex_destroy(&ws.lock);
+
+	UT_OUT("blocked walk: %u records", ws.nrecs);
+}
+
+/*
+ * check_walk -- (internal) walk the log with nthreads threads and verify each
+ *	record from first to end is visited exactly once
+ */
+static void
+check_walk(PMEMlogpool *plp, unsigned nthreads, uint32_t first, uint32_t end)
+{
+	memset(Visited, 0, sizeof(Visited));
+
+	UT_ASSERTeq(pmemlog_walk_parallel(plp, nthreads, record_size,
+			visit_chunk, NULL), 0);
+
+	for (uint32_t seq = 0; seq < MAX_RECS; seq++) {
+		unsigned expected = seq >= first && seq < end;
+		if (Visited[seq] != expected)
+			UT_FATAL("record %u visited %u times", seq,
+					Visited[seq]);
+	}
+
+	UT_OUT("%u threads: records %u-%u", nthreads, first, end);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "log_walk_mt");
+
+	if (argc != 4)
+		UT_FATAL("usage: %s file1 file2 file3", argv[0]);
+
+	const char *path = argv[1];
+	PMEMlogpool *plp;
+
+	if ((plp = pmemlog_create(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create", path);
+
+	/* an empty log */
+	PMEMlogcursor *cur = pmemlog_cursor_new(plp, 0);
+	UT_ASSERTne(cur, NULL);
+	UT_ASSERTeq(read_cursor(cur, 0), 0);
+	check_walk(plp, 4, 0, 0);
+
+	/* the cursor follows the appends */
+	uint32_t end = append(plp, 0, 5000);
+	UT_ASSERTeq(read_cursor(cur, 0), end);
+	end = append(plp, end, 8000);
+	UT_ASSERTeq(read_cursor(cur, 5000), end);
+	pmemlog_cursor_delete(cur);
+
+	/* a cursor in the middle of the log, at a record boundary */
+	long long off = 0;
+	for (uint32_t seq = 0; seq < 3000; seq++)
+		off += (long long)rec_len(seq);
+	cur = pmemlog_cursor_new(plp, off);
+	UT_ASSERTne(cur, NULL);
+	UT_ASSERTeq(read_cursor(cur, 3000), end);
+	pmemlog_cursor_delete(cur);
+
+	UT_ASSERTeq(pmemlog_cursor_new(plp, -1), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemlog_cursor_new(plp, pmemlog_tell(plp) + 1), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	end = append(plp, end, MAX_RECS);
+	UT_OUT("appended %u records", end);
+
+	check_walk(plp, 1, 0, end);
+	check_walk(plp, 4, 0, end);
+	check_walk(plp, 16, 0, end);
+
+	/* a single-threaded walk stops at the first chunk */
+	unsigned nchunks = 0;
+	UT_ASSERTeq(pmemlog_walk_parallel(plp, 1, record_size, stop_chunk,
+			&nchunks), 0);
+	UT_ASSERTeq(nchunks, 1);
+
+	/* a multi-threaded one stops each thread at its first chunk */
+	nchunks = 0;
+	UT_ASSERTeq(pmemlog_walk_parallel(plp, 4, record_size, stop_chunk,
+			&nchunks), 0);
+	UT_ASSERT(nchunks >= 1 && nchunks <= 4);
+
+	UT_ASSERTeq(pmemlog_walk_parallel(plp, 0, record_size, visit_chunk,
+			NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemlog_walk_parallel(plp, 4, bad_record_size,
+			visit_chunk, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	pmemlog_close(plp);
+
+	/* a ring log wrapping around the end of the log space */
+	path = argv[2];
+	if ((plp = pmemlog_create_ring(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_ring", path);
+
+	end = append(plp, 0, MAX_RECS);
+
+	cur = pmemlog_cursor_new(plp, 0);
+	UT_ASSERTne(cur, NULL);
+
+	/* release the first half of the records */
+	uint32_t first = end / 2;
+	off = 0;
+	for (uint32_t seq = 0; seq < first; seq++)
+		off += (long long)rec_len(seq);
+	UT_ASSERTeq(pmemlog_truncate_head(plp, off), 0);
+
+	/* the cursor points to the discarded data */
+	char buf[CURSOR_BUF];
+	UT_ASSERTeq(pmemlog_cursor_next(cur, buf, sizeof(buf)), -1);
+	UT_ASSERTeq(errno, ENODATA);
+	pmemlog_cursor_delete(cur);
+
+	UT_ASSERTeq(pmemlog_cursor_new(plp, 0), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	end = append(plp, end, MAX_RECS);
+	UT_OUT("ring: records %u-%u", first, end);
+
+	cur = pmemlog_cursor_new(plp, off);
+	UT_ASSERTne(cur, NULL);
+	UT_ASSERTeq(read_cursor(cur, first), end);
+	pmemlog_cursor_delete(cur);
+
+	check_walk(plp, 1, first, end);
+	check_walk(plp, 4, first, end);
+	check_walk(plp, 16, first, end);
+
+	pmemlog_close(plp);
+
+	/* readers don't take the locks of the appends */
+	path = argv[3];
+	if ((plp = pmemlog_create_ring(path, PMEMLOG_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!%s: pmemlog_create_ring", path);
+
+	check_blocked_walk(plp);
+
+	pmemlog_close(plp);
+
+	DONE(NULL);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_affinity.c -- unit test for allocation affinity
+ *
+ * usage: obj_alloc_affinity file nchunks
+ *
+ * Two threads take turns allocating enough objects to fill a few runs each.
+ * With the affinity, the runs of each thread are carved out of the nchunks
+ * chunks set aside for it, so its objects can't span more than that.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "affinity"
+#define NTHREADS 2
+#define NOBJS 600 /* enough for a few runs */
+#define BATCH 50
+#define OBJ_SIZE 1000
+#define CHUNKSIZE (1 << 18) /* see heap_layout.h */
+
+static PMEMobjpool *Pop;
+static uint64_t Min_off[NTHREADS];
+static uint64_t Max_off[NTHREADS];
+
+static pthread_mutex_t Turn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Turn_cond = PTHREAD_COND_INITIALIZER;
+static unsigned Turn;
+
+/*
+ * worker -- (internal) allocates the objects of a thread in batches, taking
+ *	turns with the other threads
+ */
+static void *
+worker(void *arg)
+{
+	unsigned idx = (unsigned)(uintptr_t)arg;
+
+	Min_off[idx] = UINT64_MAX;
+	Max_off[idx] = 0;
+
+	for (unsigned i = 0; i < NOBJS; i += BATCH) {
+		pthread_mutex_lock(&Turn_lock);
+		while (Turn % NTHREADS != idx)
+			pthread_cond_wait(&Turn_cond, &Turn_lock);
+
+		for (unsigned j = 0; j < BATCH; ++j) {
+			PMEMoid oid;
+			int ret = pmemobj_alloc(Pop, &oid, OBJ_SIZE, 0,
+					NULL, NULL);
+			UT_ASSERTeq(ret, 0);
+
+			if (oid.off < Min_off[idx])
+				Min_off[idx] = oid.off;
+			if (oid.off > Max_off[idx])
+				Max_off[idx] = oid.off;
+		}
+
+		Turn++;
+		pthread_cond_broadcast(&Turn_cond);
+		pthread_mutex_unlock(&Turn_lock);
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_affinity");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file nchunks", argv[0]);
+
+	const char *path = argv[1];
+	uint64_t nchunks = (uint64_t)atoi(argv[2]);
+
+	Pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker,
+			(void *)(uintptr_t)i);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		UT_ASSERT(Max_off[i] - Min_off[i] < nchunks * CHUNKSIZE);
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
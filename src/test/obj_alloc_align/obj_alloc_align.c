@@ -0,0 +1,282 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_align.c -- unit test for aligned pmemobj_xalloc and
+ *	pmemobj_tx_xalloc
+ *
+ * usage: obj_alloc_align file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_alloc_align"
+
+#define POOL_SIZE (64 * 1024 * 1024)
+#define CHUNKSIZE (256 * 1024)
+
+#define NOBJS 3
+#define TYPE_ATOMIC 1
+#define TYPE_TX 2
+
+static const unsigned shifts[] = {8, 12, 21};
+static const size_t sizes[] = {100, 5000, 300000};
+
+#define NSHIFTS (sizeof(shifts) / sizeof(shifts[0]))
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define NCASES (NSHIFTS * NSIZES)
+
+struct root {
+	PMEMoid objs[NCASES][2][NOBJS];
+};
+
+/*
+ * check_object -- verifies that the object is aligned and that it wasn't
+ *	over-allocated
+ */
+static void
+check_object(PMEMoid oid, unsigned shift, size_t size)
+{
+	UT_ASSERT(!OID_IS_NULL(oid));
+
+	char *data = pmemobj_direct(oid);
+	UT_ASSERTeq((uintptr_t)data % ((size_t)1 << shift), 0);
+
+	size_t usable = pmemobj_alloc_usable_size(oid);
+	UT_ASSERT(usable >= size);
+	UT_ASSERT(usable - size < CHUNKSIZE);
+}
+
+/*
+ * check_data -- verifies the marks left by fill_object
+ */
+static void
+check_data(PMEMoid oid, unsigned shift, size_t size)
+{
+	char *data = pmemobj_direct(oid);
+	size_t usable = pmemobj_alloc_usable_size(oid);
+
+	/* the whole usable space belongs to the object */
+	UT_ASSERTeq(data[0], (char)shift);
+	UT_ASSERTeq(data[usable - 1], (char)size);
+}
+
+/*
+ * fill_object -- checks that the object is zeroed and marks its first and
+ *	last byte
+ */
+static void
+fill_object(PMEMobjpool *pop, PMEMoid oid, unsigned shift, size_t size)
+{
+	char *data = pmemobj_direct(oid);
+	size_t usable = pmemobj_alloc_usable_size(oid);
+
+	for (size_t i = 0; i < usable; ++i)
+		UT_ASSERTeq(data[i], 0);
+
+	data[0] = (char)shift;
+	data[usable - 1] = (char)size;
+	pmemobj_persist(pop, data, usable);
+}
+
+/*
+ * count_objects -- returns the number of allocated objects of the given type
+ */
+static unsigned
+count_objects(PMEMobjpool *pop, uint64_t type_num)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type_num)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * test_alloc -- allocates aligned objects, both atomically and in
+ *	a transaction
+ */
+static void
+test_alloc(PMEMobjpool *pop, struct root *r)
+{
+	for (unsigned c = 0; c < NCASES; ++c) {
+		unsigned shift = shifts[c / NSIZES];
+		size_t size = sizes[c % NSIZES];
+		uint64_t flags = POBJ_XALLOC_ZERO | POBJ_ALIGN_SHIFT(shift);
+
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			PMEMoid *oidp = &r->objs[c][0][i];
+			int ret = pmemobj_xalloc(pop, oidp, size, TYPE_ATOMIC,
+				flags, NULL, NULL);
+			UT_ASSERTeq(ret, 0);
+			fill_object(pop, *oidp, shift, size);
+			check_object(*oidp, shift, size);
+		}
+
+		TX_BEGIN(pop) {
+			for (unsigned i = 0; i < NOBJS; ++i) {
+				PMEMoid *oidp = &r->objs[c][1][i];
+				pmemobj_tx_add_range_direct(oidp,
+					sizeof(*oidp));
+				*oidp = pmemobj_tx_xalloc(size, TYPE_TX,
+					flags);
+				fill_object(pop, *oidp, shift, size);
+				check_object(*oidp, shift, size);
+			}
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), NCASES * NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NCASES * NOBJS);
+}
+
+/*
+ * test_abort -- aborts a transaction with an aligned allocation
+ */
+static void
+test_abort(PMEMobjpool *pop)
+{
+	TX_BEGIN(pop) {
+		PMEMoid oid = pmemobj_tx_xalloc(CHUNKSIZE, TYPE_TX,
+			POBJ_ALIGN_SHIFT(21));
+		check_object(oid, 21, CHUNKSIZE);
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NCASES * NOBJS);
+}
+
+/*
+ * test_invalid -- requests alignment which the allocation class can't provide
+ */
+static void
+test_invalid(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = 192;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = POBJ_HEADER_LEGACY;
+
+	int ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+
+	uint64_t flags = POBJ_CLASS_ID(desc.class_id) | POBJ_ALIGN_SHIFT(8);
+
+	PMEMoid oid;
+	ret = pmemobj_xalloc(pop, &oid, 100, TYPE_ATOMIC, flags, NULL, NULL);
+	UT_ASSERTne(ret, 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_xalloc(100, TYPE_TX, flags);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+}
+
+/*
+ * test_verify -- checks the objects after the pool is reopened and frees them
+ */
+static void
+test_verify(PMEMobjpool *pop, struct root *r)
+{
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), NCASES * NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NCASES * NOBJS);
+
+	for (unsigned c = 0; c < NCASES; ++c) {
+		unsigned shift = shifts[c / NSIZES];
+		size_t size = sizes[c % NSIZES];
+
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			check_object(r->objs[c][0][i], shift, size);
+			check_data(r->objs[c][0][i], shift, size);
+			pmemobj_free(&r->objs[c][0][i]);
+		}
+
+		TX_BEGIN(pop) {
+			for (unsigned i = 0; i < NOBJS; ++i) {
+				check_object(r->objs[c][1][i], shift, size);
+				check_data(r->objs[c][1][i], shift, size);
+				pmemobj_tx_free(r->objs[c][1][i]);
+			}
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_align");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	UT_ASSERT(!OID_IS_NULL(root));
+
+	test_alloc(pop, pmemobj_direct(root));
+	test_abort(pop);
+	test_invalid(pop);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = pmemobj_root(pop, sizeof(struct root));
+	test_verify(pop, pmemobj_direct(root));
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,404 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_cache.c -- unit test for the per-lane cache of reserved blocks
+ *
+ * usage: obj_alloc_cache file h|r|b|c|o
+ *
+ * h - the blocks are handed out from the cache until it's empty, the freed
+ *     ones go back to it
+ * r - the blocks cached by an idle lane are reclaimed when the heap runs out
+ *     of memory
+ * b - the holder of a busy lane returns the cached blocks on its next
+ *     allocation
+ * c - allocates and frees some objects, and exits without closing the pool
+ *     while some blocks are still in the cache
+ * o - checks the objects allocated by c, and that none of the blocks cached at
+ *     the time of the crash is lost
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "obj_alloc_cache"
+#define OBJ_SIZE 1024
+#define CACHE_BATCH 16 /* blocks reserved at once by the cache */
+
+/* not a multiple of the batch, so that some blocks are left in the cache */
+#define NOBJS (4 * CACHE_BATCH + 6)
+#define TYPE_OBJ 1
+
+struct palloc_heap;
+struct bucket;
+struct memory_block;
+
+static unsigned Refills; /* number of times a cache slot was refilled */
+
+FUNC_MOCK(heap_get_bestfit_blocks, unsigned, struct palloc_heap *heap,
+	struct bucket *b, struct memory_block *blocks, unsigned n,
+	uint32_t units)
+	FUNC_MOCK_RUN_DEFAULT {
+		__sync_fetch_and_add(&Refills, 1);
+		return _FUNC_REAL(heap_get_bestfit_blocks)(heap, b, blocks,
+			n, units);
+	}
+FUNC_MOCK_END
+
+static PMEMobjpool *Pop;
+static volatile int Phase;
+
+/*
+ * wait_phase -- (internal) waits until the test reaches the phase
+ */
+static void
+wait_phase(int phase)
+{
+	while (Phase != phase)
+		sched_yield();
+}
+
+/*
+ * pool_create -- (internal) creates the pool with a root object
+ */
+static PMEMobjpool *
+pool_create(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	UT_ASSERT(!OID_IS_NULL(pmemobj_root(pop, sizeof(uint64_t))));
+
+	return pop;
+}
+
+/*
+ * hold_lane -- (internal) makes the current transaction acquire its lane,
+ *	which is held until the transaction ends
+ */
+static void
+hold_lane(PMEMobjpool *pop)
+{
+	UT_ASSERTeq(pmemobj_tx_add_range(pmemobj_root(pop, sizeof(uint64_t)),
+		0, sizeof(uint64_t)), 0);
+}
+
+/*
+ * fill -- (internal) allocates the objects until the heap is full, returns
+ *	their number
+ *
+ * The calling thread has to hold its lane, so that the other threads never
+ * use it.
+ */
+static unsigned
+fill(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	unsigned n = 0;
+
+	while (pmemobj_alloc(pop, &oid, OBJ_SIZE, 0, NULL, NULL) == 0)
+		n++;
+
+	UT_ASSERTeq(errno, ENOMEM);
+
+	return n;
+}
+
+/*
+ * capacity -- (internal) returns the number of objects which fit in an empty
+ *	pool
+ */
+static unsigned
+capacity(const char *path)
+{
+	char cap_path[PATH_MAX];
+	snprintf(cap_path, sizeof(cap_path), "%s.cap", path);
+
+	PMEMobjpool *pop = pool_create(cap_path);
+
+	unsigned n = 0;
+	TX_BEGIN(pop) {
+		hold_lane(pop);
+		n = fill(pop);
+	} TX_END
+
+	pmemobj_close(pop);
+	UNLINK(cap_path);
+
+	return n;
+}
+
+/*
+ * test_hit_miss -- checks that the cache is refilled only once it's empty
+ */
+static void
+test_hit_miss(const char *path)
+{
+	PMEMobjpool *pop = pool_create(path);
+	PMEMoid oids[CACHE_BATCH + 1];
+
+	unsigned refills = Refills;
+	for (unsigned i = 0; i < 2; ++i)
+		UT_ASSERTeq(pmemobj_alloc(pop, &oids[i], OBJ_SIZE, 0,
+			NULL, NULL), 0);
+	UT_ASSERTeq(Refills, refills + 1);
+
+	/*
+	 * The freed block is handed out again. It isn't the last allocated
+	 * block of its run, which would go back to the bucket instead.
+	 */
+	uint64_t off = oids[1].off;
+	pmemobj_free(&oids[1]);
+	UT_ASSERTeq(pmemobj_alloc(pop, &oids[1], OBJ_SIZE, 0, NULL, NULL), 0);
+	UT_ASSERTeq(oids[1].off, off);
+
+	/* the rest of the batch comes from the cache */
+	for (unsigned i = 2; i < CACHE_BATCH; ++i)
+		UT_ASSERTeq(pmemobj_alloc(pop, &oids[i], OBJ_SIZE, 0,
+			NULL, NULL), 0);
+	UT_ASSERTeq(Refills, refills + 1);
+
+	UT_ASSERTeq(pmemobj_alloc(pop, &oids[CACHE_BATCH], OBJ_SIZE, 0,
+		NULL, NULL), 0);
+	UT_ASSERTeq(Refills, refills + 2);
+
+	off = oids[CACHE_BATCH].off;
+	pmemobj_free(&oids[CACHE_BATCH]);
+	UT_ASSERTeq(pmemobj_alloc(pop, &oids[CACHE_BATCH], OBJ_SIZE, 0,
+		NULL, NULL), 0);
+	UT_ASSERTeq(oids[CACHE_BATCH].off, off);
+	UT_ASSERTeq(Refills, refills + 2);
+
+	pmemobj_close(pop);
+}
+
+/*
+ * alloc_free_worker -- (internal) leaves the blocks in the cache of its lane
+ */
+static void *
+alloc_free_worker(void *arg)
+{
+	PMEMoid oid;
+	UT_ASSERTeq(pmemobj_alloc(Pop, &oid, OBJ_SIZE, 0, NULL, NULL), 0);
+	pmemobj_free(&oid);
+
+	return NULL;
+}
+
+/*
+ * test_reclaim_idle -- checks that the blocks cached by the lane of a thread
+ *	which is gone are reclaimed
+ */
+static void
+test_reclaim_idle(const char *path)
+{
+	unsigned cap = capacity(path);
+	Pop = pool_create(path);
+
+	/* the lane held by the transaction can't be used by the worker */
+	TX_BEGIN(Pop) {
+		hold_lane(Pop);
+
+		pthread_t t;
+		PTHREAD_CREATE(&t, NULL, alloc_free_worker, NULL);
+		PTHREAD_JOIN(t, NULL);
+
+		unsigned n = fill(Pop);
+		UT_ASSERTeq(n, cap);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	pmemobj_close(Pop);
+}
+
+/*
+ * busy_worker -- (internal) keeps its lane busy with blocks in its cache
+ *	until the other thread runs out of memory
+ */
+static void *
+busy_worker(void *arg)
+{
+	TX_BEGIN(Pop) {
+		UT_ASSERT(!OID_IS_NULL(pmemobj_tx_alloc(OBJ_SIZE, 0)));
+		Phase = 1;
+		wait_phase(2);
+
+		/* the cached blocks are returned before it's served */
+		UT_ASSERT(!OID_IS_NULL(pmemobj_tx_alloc(OBJ_SIZE, 0)));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	Phase = 3;
+
+	return NULL;
+}
+
+/*
+ * test_reclaim_busy -- checks that the holder of a busy lane is asked to
+ *	return the blocks of its cache
+ */
+static void
+test_reclaim_busy(const char *path)
+{
+	unsigned cap = capacity(path);
+	Pop = pool_create(path);
+
+	TX_BEGIN(Pop) {
+		hold_lane(Pop);
+
+		pthread_t t;
+		PTHREAD_CREATE(&t, NULL, busy_worker, NULL);
+		wait_phase(1);
+
+		unsigned n = fill(Pop);
+		UT_ASSERTeq(n, cap - CACHE_BATCH);
+
+		Phase = 2;
+		wait_phase(3);
+		PTHREAD_JOIN(t, NULL);
+
+		/* the worker has allocated two of all the objects */
+		n += fill(Pop);
+		UT_ASSERTeq(n + 2, cap);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	pmemobj_close(Pop);
+}
+
+/*
+ * obj_constr -- (internal) stores the id of the object
+ */
+static int
+obj_constr(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	uint64_t *id = ptr;
+	*id = (uint64_t)(uintptr_t)arg;
+	pmemobj_persist(pop, id, sizeof(*id));
+
+	return 0;
+}
+
+/*
+ * test_crash -- frees every other object and exits while the freed blocks and
+ *	the ones never handed out are in the cache
+ */
+static void
+test_crash(const char *path)
+{
+	PMEMobjpool *pop = pool_create(path);
+	PMEMoid oids[NOBJS];
+
+	for (unsigned i = 0; i < NOBJS; ++i)
+		UT_ASSERTeq(pmemobj_alloc(pop, &oids[i], OBJ_SIZE, TYPE_OBJ,
+			obj_constr, (void *)(uintptr_t)i), 0);
+
+	for (unsigned i = 0; i < NOBJS; i += 2)
+		pmemobj_free(&oids[i]);
+
+	/* the pool is not closed, the process is gone with the cache */
+	_exit(0);
+}
+
+/*
+ * test_recover -- checks the pool left by test_crash
+ */
+static void
+test_recover(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	unsigned n = 0;
+	PMEMoid oid;
+	PMEMoid next;
+	POBJ_FOREACH_SAFE(pop, oid, next) {
+		UT_ASSERTeq(pmemobj_type_num(oid), TYPE_OBJ);
+
+		uint64_t id = *(uint64_t *)pmemobj_direct(oid);
+		UT_ASSERT(id < NOBJS);
+		UT_ASSERTeq(id % 2, 1);
+
+		pmemobj_free(&oid);
+		n++;
+	}
+	UT_ASSERTeq(n, NOBJS / 2);
+
+	unsigned nfree = 0;
+	TX_BEGIN(pop) {
+		hold_lane(pop);
+		nfree = fill(pop);
+	} TX_END
+
+	pmemobj_close(pop);
+
+	/* the heap is as good as new */
+	UT_ASSERTeq(nfree, capacity(path));
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_cache");
+
+	if (argc != 3 || strlen(argv[2]) != 1)
+		UT_FATAL("usage: %s file h|r|b|c|o", argv[0]);
+
+	const char *path = argv[1];
+
+	switch (argv[2][0]) {
+	case 'h':
+		test_hit_miss(path);
+		break;
+	case 'r':
+		test_reclaim_idle(path);
+		break;
+	case 'b':
+		test_reclaim_busy(path);
+		break;
+	case 'c':
+		test_crash(path);
+		break;
+	case 'o':
+		test_recover(path);
+		break;
+	default:
+		UT_FATAL("unknown operation %s", argv[2]);
+	}
+
+	DONE(NULL);
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_class.c -- unit test for user-defined allocation classes
+ *
+ * usage: obj_alloc_class file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_alloc_class"
+#define CHUNK_SIZE (256 * 1024)
+
+/*
+ * test_register -- registers valid and invalid allocation classes
+ */
+static unsigned
+test_register(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc;
+
+	desc.unit_size = 128;
+	desc.units_per_block = 8;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = POBJ_HEADER_LEGACY;
+	int ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(desc.class_id, 0);
+
+	/* the same unit size maps to the same class */
+	unsigned class_id = desc.class_id;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(desc.class_id, class_id);
+
+	desc.unit_size = 100;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	desc.unit_size = 192;
+	desc.units_per_block = 0;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	desc.unit_size = 1024;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_HUGE;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* compact objects occupy exactly one unit of a run */
+	desc.unit_size = 128;
+	desc.units_per_block = 2;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = POBJ_HEADER_COMPACT;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	desc.unit_size = CHUNK_SIZE;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_HUGE;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* a compact class is distinct from the one with the same unit size */
+	desc.unit_size = 128;
+	desc.type = POBJ_CLASS_RUN;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(desc.class_id, class_id);
+
+	desc.header_type = (enum pobj_header_type)5;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_OUT("class registered");
+
+	return class_id;
+}
+
+/*
+ * test_xalloc -- allocates objects from the registered classes
+ */
+static void
+test_xalloc(PMEMobjpool *pop, unsigned class_id)
+{
+	PMEMoid oid;
+
+	/* 100 bytes plus the object header take two 128 byte units */
+	int ret = pmemobj_xalloc(pop, &oid, 100, 0,
+		POBJ_CLASS_ID(class_id) | POBJ_XALLOC_ZERO, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	UT_OUT("run usable size %zu", pmemobj_alloc_usable_size(oid));
+
+	char *buf = pmemobj_direct(oid);
+	for (size_t i = 0; i < 100; ++i)
+		UT_ASSERTeq(buf[i], 0);
+	pmemobj_free(&oid);
+
+	/* larger than the maximum of eight units per allocation */
+	ret = pmemobj_xalloc(pop, &oid, 1024, 0, POBJ_CLASS_ID(class_id),
+		NULL, NULL);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* not a registered class */
+	ret = pmemobj_xalloc(pop, &oid, 100, 0, POBJ_CLASS_ID(200),
+		NULL, NULL);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* unknown flags */
+	ret = pmemobj_xalloc(pop, &oid, 100, 0, (uint64_t)1 << 10,
+		NULL, NULL);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = CHUNK_SIZE;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_HUGE;
+	desc.header_type = POBJ_HEADER_LEGACY;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+
+	/* huge class serves even small objects with whole chunks */
+	ret = pmemobj_xalloc(pop, &oid, 100, 0, POBJ_CLASS_ID(desc.class_id),
+		NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	UT_OUT("huge usable size %zu", pmemobj_alloc_usable_size(oid));
+	pmemobj_free(&oid);
+
+	/* default class */
+	ret = pmemobj_xalloc(pop, &oid, 100, 0, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	pmemobj_free(&oid);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_class");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	unsigned class_id = test_register(pop);
+	test_xalloc(pop, class_id);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_compact.c -- unit test for allocation classes with compact
+ *	object headers
+ *
+ * usage: obj_alloc_compact file [part ...]
+ *
+ * The pool headers of the parts, or of the file itself if none are given, are
+ * checked for the compact header feature.
+ */
+
+#include <endian.h>
+
+#include "obj.h"
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_alloc_compact"
+
+#define POOL_SIZE (16 * 1024 * 1024)
+#define UNIT_SIZE 128
+#define HEADER_SIZE 16
+#define USABLE_SIZE (UNIT_SIZE - HEADER_SIZE)
+
+#define NOBJS 64
+#define TYPE_ATOMIC 1
+#define TYPE_TX 2
+#define TYPE_REALLOC 3
+
+struct root {
+	PMEMoid atomic[NOBJS];
+	PMEMoid tx[NOBJS];
+	PMEMoid resized;
+};
+
+/*
+ * count_objects -- returns the number of allocated objects of the given type
+ */
+static unsigned
+count_objects(PMEMobjpool *pop, uint64_t type_num)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type_num)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * check_object -- verifies the object's metadata and the marks left in it
+ */
+static void
+check_object(PMEMoid oid, uint64_t type_num, unsigned i)
+{
+	UT_ASSERT(!OID_IS_NULL(oid));
+	UT_ASSERTeq(pmemobj_alloc_usable_size(oid), USABLE_SIZE);
+	UT_ASSERTeq(pmemobj_type_num(oid), type_num);
+
+	unsigned char *data = pmemobj_direct(oid);
+	for (size_t n = 0; n < USABLE_SIZE; ++n)
+		UT_ASSERTeq(data[n], (unsigned char)(i + n));
+}
+
+/*
+ * fill_object -- checks that the object is zeroed and marks all of its bytes
+ */
+static void
+fill_object(PMEMobjpool *pop, PMEMoid oid, unsigned i)
+{
+	unsigned char *data = pmemobj_direct(oid);
+	for (size_t n = 0; n < USABLE_SIZE; ++n) {
+		UT_ASSERTeq(data[n], 0);
+		data[n] = (unsigned char)(i + n);
+	}
+	pmemobj_persist(pop, data, USABLE_SIZE);
+}
+
+/*
+ * check_incompat -- checks if the headers of the files have the compact header
+ *	feature set
+ */
+static void
+check_incompat(char *files[], int nfiles, int set)
+{
+	for (int i = 0; i < nfiles; ++i) {
+		struct pool_hdr hdr;
+		int fd = OPEN(files[i], O_RDONLY);
+		ssize_t ret = READ(fd, &hdr, sizeof(hdr));
+		UT_ASSERTeq(ret, sizeof(hdr));
+		CLOSE(fd);
+
+		uint32_t incompat = le32toh(hdr.incompat_features);
+		UT_ASSERTeq((incompat & OBJ_FORMAT_INCOMPAT_ZONES_VALID),
+			OBJ_FORMAT_INCOMPAT_ZONES_VALID);
+		UT_ASSERTeq(!!(incompat & OBJ_FORMAT_INCOMPAT_COMPACT_HEADER),
+			set);
+
+		/* the bitmap of 128 byte units fits in the run metadata */
+		UT_ASSERTeq(incompat & OBJ_FORMAT_INCOMPAT_TINY_RUNS, 0);
+	}
+}
+
+/*
+ * test_register -- registers the compact allocation class
+ */
+static unsigned
+test_register(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = UNIT_SIZE;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = POBJ_HEADER_COMPACT;
+
+	int ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(desc.class_id, 0);
+
+	return desc.class_id;
+}
+
+/*
+ * test_alloc -- allocates compact objects, both atomically and in
+ *	a transaction
+ */
+static void
+test_alloc(PMEMobjpool *pop, struct root *r, unsigned class_id)
+{
+	uint64_t flags = POBJ_CLASS_ID(class_id) | POBJ_XALLOC_ZERO;
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_xalloc(pop, &r->atomic[i], USABLE_SIZE,
+			TYPE_ATOMIC, flags, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		fill_object(pop, r->atomic[i], i);
+		check_object(r->atomic[i], TYPE_ATOMIC, i);
+	}
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(r->tx, sizeof(r->tx));
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			r->tx[i] = pmemobj_tx_xalloc(USABLE_SIZE, TYPE_TX,
+				flags);
+			/* a range of a new object doesn't need a snapshot */
+			pmemobj_tx_add_range(r->tx[i], 0, USABLE_SIZE);
+			fill_object(pop, r->tx[i], i);
+		}
+
+		/* freed in the same transaction */
+		PMEMoid oid = pmemobj_tx_xalloc(USABLE_SIZE, TYPE_TX, flags);
+		pmemobj_tx_free(oid);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	for (unsigned i = 0; i < NOBJS; ++i)
+		check_object(r->tx[i], TYPE_TX, i);
+
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NOBJS);
+}
+
+/*
+ * test_abort -- aborts a transaction with compact allocations
+ */
+static void
+test_abort(PMEMobjpool *pop, unsigned class_id)
+{
+	TX_BEGIN(pop) {
+		for (unsigned i = 0; i < NOBJS; ++i)
+			pmemobj_tx_xalloc(USABLE_SIZE, TYPE_TX,
+				POBJ_CLASS_ID(class_id));
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NOBJS);
+}
+
+/*
+ * test_invalid -- requests which don't fit in a single compact unit
+ */
+static void
+test_invalid(PMEMobjpool *pop, unsigned class_id)
+{
+	PMEMoid oid;
+	int ret = pmemobj_xalloc(pop, &oid, USABLE_SIZE + 1, TYPE_ATOMIC,
+		POBJ_CLASS_ID(class_id), NULL, NULL);
+	UT_ASSERTne(ret, 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* alignment needs room for padding in front of the object */
+	ret = pmemobj_xalloc(pop, &oid, 64, TYPE_ATOMIC,
+		POBJ_CLASS_ID(class_id) | POBJ_ALIGN_SHIFT(7), NULL, NULL);
+	UT_ASSERTne(ret, 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_xalloc(USABLE_SIZE + 1, TYPE_TX,
+			POBJ_CLASS_ID(class_id));
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+}
+
+/*
+ * test_realloc -- resizes a compact object into a default class
+ */
+static void
+test_realloc(PMEMobjpool *pop, struct root *r, unsigned class_id)
+{
+	int ret = pmemobj_xalloc(pop, &r->resized, USABLE_SIZE, TYPE_REALLOC,
+		POBJ_CLASS_ID(class_id) | POBJ_XALLOC_ZERO, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	fill_object(pop, r->resized, NOBJS);
+
+	ret = pmemobj_realloc(pop, &r->resized, 4 * UNIT_SIZE, TYPE_REALLOC);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERT(pmemobj_alloc_usable_size(r->resized) >= 4 * UNIT_SIZE);
+	UT_ASSERTeq(pmemobj_type_num(r->resized), TYPE_REALLOC);
+
+	unsigned char *data = pmemobj_direct(r->resized);
+	for (size_t n = 0; n < USABLE_SIZE; ++n)
+		UT_ASSERTeq(data[n], (unsigned char)(NOBJS + n));
+}
+
+/*
+ * test_verify -- checks the objects after the pool is reopened and frees them
+ */
+static void
+test_verify(PMEMobjpool *pop, struct root *r)
+{
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_REALLOC), 1);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		check_object(r->atomic[i], TYPE_ATOMIC, i);
+		pmemobj_free(&r->atomic[i]);
+	}
+
+	TX_BEGIN(pop) {
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			check_object(r->tx[i], TYPE_TX, i);
+			pmemobj_tx_free(r->tx[i]);
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	pmemobj_free(&r->resized);
+
+	UT_ASSERTeq(count_objects(pop, TYPE_ATOMIC), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_TX), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_REALLOC), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_compact");
+
+	if (argc < 2)
+		UT_FATAL("usage: %s file [part ...]", argv[0]);
+
+	char **files = argc > 2 ? &argv[2] : &argv[1];
+	int nfiles = argc > 2 ? argc - 2 : 1;
+
+	/* a pool set has the size of its parts */
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			argc > 2 ? 0 : POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	UT_ASSERT(!OID_IS_NULL(root));
+
+	/* the pool is marked only once the first compact run is created */
+	unsigned class_id = test_register(pop);
+	check_incompat(files, nfiles, 0);
+	test_alloc(pop, pmemobj_direct(root), class_id);
+	check_incompat(files, nfiles, 1);
+	test_abort(pop, class_id);
+	test_invalid(pop, class_id);
+	test_realloc(pop, pmemobj_direct(root), class_id);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = pmemobj_root(pop, sizeof(struct root));
+	test_verify(pop, pmemobj_direct(root));
+
+	pmemobj_close(pop);
+
+	/* the feature is never cleared */
+	check_incompat(files, nfiles, 1);
+
+	DONE(NULL);
+}
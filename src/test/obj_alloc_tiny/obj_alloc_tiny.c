@@ -0,0 +1,371 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_tiny.c -- unit test for allocation classes with units smaller
+ *	than a cacheline
+ *
+ * usage: obj_alloc_tiny file
+ */
+
+#include <endian.h>
+
+#include "obj.h"
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_alloc_tiny"
+
+#define POOL_SIZE (64 * 1024 * 1024)
+
+/* more than the 2432 units tracked by the bitmap in the run metadata */
+#define NOBJS 20000
+#define OBJ_SIZE 16
+#define TYPE_COMPACT 1
+
+struct object {
+	uint64_t id;
+	uint64_t check;
+};
+
+struct root {
+	PMEMoid none[NOBJS];
+	PMEMoid compact[NOBJS];
+};
+
+/*
+ * count_objects -- returns the number of allocated objects of the given type
+ */
+static unsigned
+count_objects(PMEMobjpool *pop, uint64_t type_num)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == type_num)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * fill_object -- checks that the object is zeroed and marks it
+ */
+static void
+fill_object(PMEMobjpool *pop, PMEMoid oid, uint64_t id)
+{
+	UT_ASSERTeq(pmemobj_alloc_usable_size(oid), OBJ_SIZE);
+
+	struct object *obj = pmemobj_direct(oid);
+	UT_ASSERTeq(obj->id, 0);
+	UT_ASSERTeq(obj->check, 0);
+
+	obj->id = id;
+	obj->check = ~id;
+	pmemobj_persist(pop, obj, sizeof(*obj));
+}
+
+/*
+ * check_object -- verifies the marks left by fill_object
+ */
+static void
+check_object(PMEMoid oid, uint64_t type_num, uint64_t id)
+{
+	UT_ASSERT(!OID_IS_NULL(oid));
+	UT_ASSERTeq(pmemobj_alloc_usable_size(oid), OBJ_SIZE);
+	UT_ASSERTeq(pmemobj_type_num(oid), type_num);
+
+	struct object *obj = pmemobj_direct(oid);
+	UT_ASSERTeq(obj->id, id);
+	UT_ASSERTeq(obj->check, ~id);
+}
+
+/*
+ * check_object_info -- compares the batch lookup of objects of both classes,
+ *	interleaved with null objects, with the lookups of single objects
+ */
+static void
+check_object_info(struct root *r)
+{
+	static PMEMoid oids[NOBJS];
+	static struct pobj_object_info info[NOBJS];
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		if (i % 7 == 0)
+			oids[i] = OID_NULL;
+		else
+			oids[i] = i % 2 ? r->none[i] : r->compact[i];
+	}
+
+	pmemobj_object_info(oids, NOBJS, info);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		UT_ASSERTeq(info[i].ptr, pmemobj_direct(oids[i]));
+		if (OID_IS_NULL(oids[i])) {
+			UT_ASSERTeq(info[i].size, 0);
+			UT_ASSERTeq(info[i].type_num, 0);
+			continue;
+		}
+		UT_ASSERTeq(info[i].size, pmemobj_alloc_usable_size(oids[i]));
+		UT_ASSERTeq(info[i].type_num, pmemobj_type_num(oids[i]));
+		UT_ASSERTeq(info[i].type_num, i % 2 ? 0 : TYPE_COMPACT);
+	}
+
+	/* fewer objects than the prefetch distance */
+	pmemobj_object_info(&oids[1], 2, info);
+	UT_ASSERTeq(info[0].ptr, pmemobj_direct(oids[1]));
+	UT_ASSERTeq(info[1].ptr, pmemobj_direct(oids[2]));
+	UT_ASSERTeq(info[1].type_num, TYPE_COMPACT);
+}
+
+/*
+ * count_dense -- returns the number of objects which directly follow
+ *	the previous one in memory
+ */
+static unsigned
+count_dense(PMEMoid *oids, size_t unit_size)
+{
+	unsigned n = 0;
+	for (unsigned i = 1; i < NOBJS; ++i) {
+		if (oids[i].off == oids[i - 1].off + unit_size)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * register_class -- registers a single-unit run class
+ */
+static int
+register_class(PMEMobjpool *pop, size_t unit_size, unsigned units_per_block,
+	enum pobj_header_type header_type, unsigned *class_id)
+{
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = unit_size;
+	desc.units_per_block = units_per_block;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = header_type;
+
+	int ret = pmemobj_alloc_class_register(pop, &desc);
+	if (ret == 0)
+		*class_id = desc.class_id;
+
+	return ret;
+}
+
+/*
+ * test_register -- registers valid and invalid sub-cacheline classes
+ */
+static void
+test_register(PMEMobjpool *pop, unsigned *none_id, unsigned *compact_id)
+{
+	unsigned class_id;
+
+	/* legacy objects need cacheline aligned units */
+	UT_ASSERTne(register_class(pop, 64, 1, POBJ_HEADER_LEGACY,
+		&class_id), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* not a multiple of 16 bytes */
+	UT_ASSERTne(register_class(pop, 24, 1, POBJ_HEADER_NONE,
+		&class_id), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* no room for any data after the compact header */
+	UT_ASSERTne(register_class(pop, 16, 1, POBJ_HEADER_COMPACT,
+		&class_id), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* the size of an object without header is the size of the unit */
+	UT_ASSERTne(register_class(pop, 16, 2, POBJ_HEADER_NONE,
+		&class_id), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(register_class(pop, OBJ_SIZE, 1, POBJ_HEADER_NONE,
+		none_id), 0);
+	UT_ASSERTeq(register_class(pop, OBJ_SIZE + 16, 1,
+		POBJ_HEADER_COMPACT, compact_id), 0);
+	UT_ASSERTne(*none_id, *compact_id);
+}
+
+/*
+ * check_incompat -- checks which of the incompat features enabled on demand
+ *	are set in the pool header
+ */
+static void
+check_incompat(const char *path, uint32_t expected)
+{
+	struct pool_hdr hdr;
+	int fd = OPEN(path, O_RDONLY);
+	ssize_t ret = READ(fd, &hdr, sizeof(hdr));
+	UT_ASSERTeq(ret, sizeof(hdr));
+	CLOSE(fd);
+
+	uint32_t incompat = le32toh(hdr.incompat_features);
+	UT_ASSERTeq(incompat & OBJ_FORMAT_INCOMPAT_ON_DEMAND, expected);
+}
+
+/*
+ * test_alloc -- allocates tiny objects, both atomically and in a transaction
+ */
+static void
+test_alloc(PMEMobjpool *pop, const char *path, struct root *r,
+	unsigned none_id, unsigned compact_id)
+{
+	check_incompat(path, 0);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_xalloc(pop, &r->none[i], OBJ_SIZE, 0,
+			POBJ_CLASS_ID(none_id) | POBJ_XALLOC_ZERO, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		fill_object(pop, r->none[i], i);
+	}
+
+	check_incompat(path, OBJ_FORMAT_INCOMPAT_TINY_RUNS);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range_direct(r->compact, sizeof(r->compact));
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			r->compact[i] = pmemobj_tx_xalloc(OBJ_SIZE,
+				TYPE_COMPACT, POBJ_CLASS_ID(compact_id) |
+				POBJ_XALLOC_ZERO);
+			fill_object(pop, r->compact[i], i);
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_incompat(path, OBJ_FORMAT_INCOMPAT_TINY_RUNS |
+		OBJ_FORMAT_INCOMPAT_COMPACT_HEADER);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		check_object(r->none[i], 0, i);
+		check_object(r->compact[i], TYPE_COMPACT, i);
+	}
+
+	check_object_info(r);
+
+	/* most of the objects are right next to each other */
+	UT_ASSERT(count_dense(r->none, OBJ_SIZE) > NOBJS / 2);
+	UT_ASSERT(count_dense(r->compact, OBJ_SIZE + 16) > NOBJS / 2);
+
+	UT_ASSERTeq(count_objects(pop, 0), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_COMPACT), NOBJS);
+}
+
+/*
+ * test_invalid -- requests which don't fit in a single tiny unit
+ */
+static void
+test_invalid(PMEMobjpool *pop, unsigned none_id)
+{
+	PMEMoid oid;
+	int ret = pmemobj_xalloc(pop, &oid, OBJ_SIZE + 1, 0,
+		POBJ_CLASS_ID(none_id), NULL, NULL);
+	UT_ASSERTne(ret, 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	TX_BEGIN(pop) {
+		for (unsigned i = 0; i < NOBJS / 10; ++i)
+			pmemobj_tx_xalloc(OBJ_SIZE, 0,
+				POBJ_CLASS_ID(none_id));
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(count_objects(pop, 0), NOBJS);
+}
+
+/*
+ * test_verify -- checks the objects after the pool is reopened and frees them
+ */
+static void
+test_verify(PMEMobjpool *pop, struct root *r)
+{
+	UT_ASSERTeq(count_objects(pop, 0), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_COMPACT), NOBJS);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		check_object(r->none[i], 0, i);
+		pmemobj_free(&r->none[i]);
+	}
+
+	TX_BEGIN(pop) {
+		for (unsigned i = 0; i < NOBJS; ++i) {
+			check_object(r->compact[i], TYPE_COMPACT, i);
+			pmemobj_tx_free(r->compact[i]);
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(count_objects(pop, 0), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_COMPACT), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_tiny");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	UT_ASSERT(!OID_IS_NULL(root));
+
+	unsigned none_id;
+	unsigned compact_id;
+	test_register(pop, &none_id, &compact_id);
+	test_alloc(pop, argv[1], pmemobj_direct(root), none_id, compact_id);
+	test_invalid(pop, none_id);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = pmemobj_root(pop, sizeof(struct root));
+	test_verify(pop, pmemobj_direct(root));
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
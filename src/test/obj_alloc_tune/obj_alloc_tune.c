@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_tune.c -- unit test for the tuning of the allocation classes
+ *
+ * usage: obj_alloc_tune file
+ *
+ * Objects of a single size, poorly served by the generated allocation
+ * classes, are allocated and freed until a class is created for them. That
+ * class must serve them right away once the pool is opened again, as long as
+ * any of its objects is left in the pool.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "tune"
+#define OBJ_SIZE 7680
+#define NROUNDS (1 << 16) /* enough samples for a few tunings */
+
+struct root {
+	PMEMoid obj;
+};
+
+/*
+ * usable_size -- (internal) allocates an object, returns its usable size and
+ *	frees it
+ */
+static size_t
+usable_size(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, OBJ_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	size_t size = pmemobj_alloc_usable_size(oid);
+	pmemobj_free(&oid);
+
+	return size;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_tune");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	size_t generated = usable_size(pop);
+	size_t tuned = generated;
+	for (unsigned i = 0; i < NROUNDS && tuned == generated; ++i)
+		tuned = usable_size(pop);
+
+	UT_ASSERT(tuned >= OBJ_SIZE);
+	UT_ASSERT(tuned < generated);
+
+	struct root *root = pmemobj_direct(pmemobj_root(pop, sizeof(*root)));
+	int ret = pmemobj_alloc(pop, &root->obj, OBJ_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(pmemobj_alloc_usable_size(root->obj), tuned);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_ASSERTeq(usable_size(pop), tuned);
+
+	root = pmemobj_direct(pmemobj_root(pop, sizeof(*root)));
+	pmemobj_free(&root->obj);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
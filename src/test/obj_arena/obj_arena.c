@@ -0,0 +1,193 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_arena.c -- unit test for arenas of short-lived objects
+ *
+ * usage: obj_arena file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "arena"
+#define NTHREADS 4
+#define OBJ_SIZE 24 /* rounded up to the alignment of the objects */
+#define OBJ_ALIGN 16
+#define ARENA_SIZE (1 << 20)
+#define NOBJS_MAX (ARENA_SIZE / 32)
+
+struct root {
+	PMEMoid arena;
+};
+
+static PMEMobjpool *Pop;
+static PMEMoid Arena;
+
+/* offsets of the objects allocated by each of the threads */
+static uint64_t Offs[NTHREADS][NOBJS_MAX];
+static unsigned Nallocs[NTHREADS];
+
+/*
+ * worker -- (internal) allocates objects from the arena until it's full,
+ *	marking each of them with the index of the thread
+ */
+static void *
+worker(void *arg)
+{
+	unsigned idx = (unsigned)(uintptr_t)arg;
+
+	for (;;) {
+		PMEMoid oid = pmemobj_arena_alloc(Pop, Arena, OBJ_SIZE);
+		if (OID_IS_NULL(oid)) {
+			UT_ASSERTeq(errno, ENOMEM);
+			break;
+		}
+
+		UT_ASSERTeq(oid.off % OBJ_ALIGN, 0);
+
+		unsigned *obj = pmemobj_direct(oid);
+		for (unsigned i = 0; i < OBJ_SIZE / sizeof(*obj); ++i)
+			obj[i] = idx + 1;
+		pmemobj_persist(Pop, obj, OBJ_SIZE);
+
+		Offs[idx][Nallocs[idx]++] = oid.off;
+	}
+
+	return NULL;
+}
+
+/*
+ * cmp_off -- (internal) compares two offsets
+ */
+static int
+cmp_off(const void *a, const void *b)
+{
+	uint64_t l = *(const uint64_t *)a;
+	uint64_t r = *(const uint64_t *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/*
+ * check_objs -- (internal) verifies the contents of the objects and that no
+ *	two of them overlap
+ */
+static void
+check_objs(void)
+{
+	static uint64_t offs[NTHREADS * NOBJS_MAX];
+	unsigned total = 0;
+
+	for (unsigned i = 0; i < NTHREADS; ++i) {
+		for (unsigned n = 0; n < Nallocs[i]; ++n) {
+			PMEMoid oid = { Arena.pool_uuid_lo, Offs[i][n] };
+			unsigned *obj = pmemobj_direct(oid);
+			for (unsigned j = 0; j < OBJ_SIZE / sizeof(*obj); ++j)
+				UT_ASSERTeq(obj[j], i + 1);
+
+			offs[total++] = Offs[i][n];
+		}
+	}
+
+	/* only the alignment padding at the end might be left */
+	UT_ASSERTeq(total, NOBJS_MAX);
+
+	qsort(offs, total, sizeof(offs[0]), cmp_off);
+	for (unsigned i = 1; i < total; ++i)
+		UT_ASSERT(offs[i] - offs[i - 1] >= OBJ_SIZE);
+
+	UT_ASSERT(offs[0] > Arena.off);
+	UT_ASSERT(offs[total - 1] + OBJ_SIZE <=
+		Arena.off + pmemobj_alloc_usable_size(Arena));
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_arena");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	struct root *root = pmemobj_direct(pmemobj_root(Pop, sizeof(*root)));
+
+	UT_ASSERTne(pmemobj_arena_create(Pop, &root->arena, 0, 0), 0);
+	UT_ASSERTeq(errno, EINVAL);
+
+	int ret = pmemobj_arena_create(Pop, &root->arena, ARENA_SIZE, 0);
+	UT_ASSERTeq(ret, 0);
+	Arena = root->arena;
+
+	UT_ASSERT(OID_IS_NULL(pmemobj_arena_alloc(Pop, Arena, 0)));
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERT(OID_IS_NULL(pmemobj_arena_alloc(Pop, Arena,
+		ARENA_SIZE + 1)));
+	UT_ASSERTeq(errno, ENOMEM);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker,
+			(void *)(uintptr_t)i);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	check_objs();
+
+	pmemobj_close(Pop);
+
+	Pop = pmemobj_open(path, LAYOUT);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	root = pmemobj_direct(pmemobj_root(Pop, sizeof(*root)));
+	Arena = root->arena;
+
+	/* the objects are kept and the arena stays full */
+	check_objs();
+	UT_ASSERT(OID_IS_NULL(pmemobj_arena_alloc(Pop, Arena, OBJ_SIZE)));
+	UT_ASSERTeq(errno, ENOMEM);
+
+	pmemobj_free(&root->arena);
+	UT_ASSERT(OID_IS_NULL(pmemobj_first(Pop)));
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
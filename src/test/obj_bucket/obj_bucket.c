@@ -176,6 +176,81 @@ test_bucket_remove()
 	bucket_delete(b);
 }
 
+/*
+ * seglists_insert -- inserts a huge block of the given size
+ */
+static void
+seglists_insert(struct bucket *b, uint32_t chunk_id, uint32_t size_idx)
+{
+	struct memory_block m = {chunk_id, TEST_ZONE_ID, size_idx, 0};
+	UT_ASSERTeq(CNT_OP(b, insert, NULL, m), 0);
+}
+
+/*
+ * seglists_get -- removes a block that fits size_idx and returns its chunk
+ */
+static uint32_t
+seglists_get(struct bucket *b, uint32_t size_idx)
+{
+	struct memory_block m = {0, 0, size_idx, 0};
+	if (CNT_OP(b, get_rm_bestfit, &m) != 0)
+		return UINT32_MAX;
+
+	UT_ASSERT(m.size_idx >= size_idx);
+	UT_ASSERTeq(m.zone_id, TEST_ZONE_ID);
+
+	return m.chunk_id;
+}
+
+static void
+test_bucket_seglists()
+{
+	struct bucket *b = &(bucket_huge_new(1, CONTAINER_SEGLISTS,
+		TEST_UNIT_SIZE))->super;
+	UT_ASSERT(b != NULL);
+
+	UT_ASSERT(CNT_OP(b, is_empty));
+	UT_ASSERTeq(seglists_get(b, 1), UINT32_MAX);
+
+	seglists_insert(b, 0, 1);
+	seglists_insert(b, 10, 17);
+	seglists_insert(b, 100, 40);
+	seglists_insert(b, 1000, 1000);
+	UT_ASSERT(!CNT_OP(b, is_empty));
+
+	/* the same block cannot be inserted twice */
+	struct memory_block m = {10, TEST_ZONE_ID, 17, 0};
+	UT_ASSERTne(CNT_OP(b, insert, NULL, m), 0);
+
+	UT_ASSERTeq(CNT_OP(b, get_exact, m), 0);
+	m.size_idx = 16;
+	UT_ASSERTne(CNT_OP(b, get_exact, m), 0);
+	UT_ASSERTne(CNT_OP(b, get_rm_exact, m), 0);
+	m.size_idx = 17;
+	UT_ASSERTeq(CNT_OP(b, get_rm_exact, m), 0);
+	UT_ASSERTne(CNT_OP(b, get_exact, m), 0);
+
+	UT_ASSERTeq(seglists_get(b, 1), 0);
+	UT_ASSERTeq(seglists_get(b, 18), 100);
+	UT_ASSERTeq(seglists_get(b, 200), 1000);
+	UT_ASSERTeq(seglists_get(b, 1), UINT32_MAX);
+	UT_ASSERT(CNT_OP(b, is_empty));
+
+	/* only a larger block from the class of the request itself fits */
+	seglists_insert(b, 5, 40);
+	seglists_insert(b, 6, 41);
+	UT_ASSERTeq(seglists_get(b, 41), 6);
+	UT_ASSERTeq(seglists_get(b, 41), UINT32_MAX);
+	UT_ASSERTeq(seglists_get(b, 40), 5);
+
+	/* the largest possible block */
+	seglists_insert(b, 7, UINT16_MAX);
+	UT_ASSERTeq(seglists_get(b, UINT16_MAX), 7);
+
+	seglists_insert(b, 8, 2);
+	bucket_delete(b);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -186,6 +261,7 @@ main(int argc, char *argv[])
 	test_bucket_insert_get();
 	test_bucket_remove();
 	test_bucket_bitmap_correctness();
+	test_bucket_seglists();
 
 	DONE(NULL);
 }
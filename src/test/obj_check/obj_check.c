@@ -39,16 +39,42 @@
 #include "unittest.h"
 #include "libpmemobj.h"
 
+/*
+ * check_open -- opens the pool and waits for the deferred verification
+ *	of its heap
+ */
+static void
+check_open(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_open(path, NULL);
+	if (pop == NULL) {
+		UT_OUT("error: %s", pmemobj_errormsg());
+		return;
+	}
+
+	if (pmemobj_check_wait(pop))
+		UT_OUT("consistent");
+	else
+		UT_OUT("not consistent: %s", pmemobj_errormsg());
+
+	pmemobj_close(pop);
+}
+
 int
 main(int argc, char *argv[])
 {
 	START(argc, argv, "obj_check");
 	if (argc < 2) {
-		UT_FATAL("usage: obj_check file");
+		UT_FATAL("usage: obj_check file [o]");
 	}
 
 	const char *path = argv[1];
 
+	if (argc > 2 && argv[2][0] == 'o') {
+		check_open(path);
+		DONE(NULL);
+	}
+
 	int ret = pmemobj_check(path, NULL);
 
 	switch (ret) {
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_cpp_allocator.cpp -- cpp allocator test
+ */
+
+#include "unittest.h"
+
+#include <libpmemobj++/allocator.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = nvml::obj;
+
+namespace
+{
+
+struct foo {
+	foo() : bar(1)
+	{
+	}
+
+	int bar;
+};
+
+typedef std::vector<int, nvobj::allocator<int>> vector_type;
+
+/* pool root structure */
+struct root {
+	nvobj::persistent_ptr<vector_type> vec;
+};
+
+const int num_elements = 100;
+
+/*
+ * test_alloc -- (internal) test the allocator interface
+ */
+void
+test_alloc(nvobj::pool<root> &pop)
+{
+	typedef std::allocator_traits<nvobj::allocator<foo>> traits;
+
+	static_assert(std::is_same<traits::pointer,
+				   nvobj::persistent_ptr<foo>>::value,
+		      "wrong pointer type");
+	static_assert(
+		std::is_same<traits::rebind_alloc<int>,
+			     nvobj::allocator<int>>::value,
+		"wrong rebind type");
+
+	nvobj::allocator<foo> a;
+	UT_ASSERT(a == nvobj::allocator<int>());
+
+	bool thrown = false;
+	try {
+		a.allocate(1);
+	} catch (nvml::transaction_scope_error &) {
+		thrown = true;
+	}
+	UT_ASSERT(thrown);
+
+	nvobj::persistent_ptr<foo> p;
+	nvobj::transaction::exec_tx(pop, [&]() {
+		p = traits::allocate(a, 10);
+		for (int i = 0; i < 10; ++i)
+			traits::construct(a, (p + i).get());
+	});
+
+	UT_ASSERTne(pmemobj_pool_by_ptr(p.get()), nullptr);
+	for (int i = 0; i < 10; ++i)
+		UT_ASSERTeq(p[i].bar, 1);
+
+	/* a pointer to any object of the pool can be recreated */
+	UT_ASSERT(std::pointer_traits<nvobj::persistent_ptr<foo>>::pointer_to(
+			  p[5]) == p + 5);
+	UT_ASSERTeq(p + 5 - p, 5);
+	UT_ASSERTeq(p - (p + 5), -5);
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		for (int i = 0; i < 10; ++i)
+			traits::destroy(a, (p + i).get());
+		traits::deallocate(a, p, 10);
+	});
+}
+
+/*
+ * check_vector -- (internal) verify the contents of the vector
+ */
+void
+check_vector(const vector_type &v, int size)
+{
+	UT_ASSERTeq(v.size(), (size_t)size);
+	for (int i = 0; i < size; ++i)
+		UT_ASSERTeq(v[(size_t)i], i);
+}
+
+/*
+ * test_vector -- (internal) test the std::vector with the allocator
+ */
+void
+test_vector(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->vec = nvobj::make_persistent<vector_type>();
+		for (int i = 0; i < num_elements; ++i)
+			r->vec->push_back(i);
+	});
+	check_vector(*r->vec, num_elements);
+
+	/* the reallocations and the size are rolled back */
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			for (int i = 0; i < num_elements * 10; ++i)
+				r->vec->push_back(-1);
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (nvml::manual_tx_abort &) {
+	}
+	check_vector(*r->vec, num_elements);
+}
+
+/*
+ * test_reopen -- (internal) test the vector after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop, const char *path)
+{
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	auto r = pop.get_root();
+	check_vector(*r->vec, num_elements);
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		nvobj::delete_persistent<vector_type>(r->vec);
+		r->vec = nullptr;
+	});
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cpp_allocator");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (nvml::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_alloc(pop);
+	test_vector(pop);
+	test_reopen(pop, path);
+
+	pop.close();
+
+	DONE(NULL);
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_cpp_concurrent_hash_map.cpp -- cpp concurrent_hash_map test
+ */
+
+#include "unittest.h"
+
+#include <libpmemobj++/concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <thread>
+#include <vector>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = nvml::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<int, nvobj::p<int>> map_type;
+
+/* pool root structure */
+struct root {
+	nvobj::persistent_ptr<map_type> map;
+};
+
+/* number of elements inserted by a single thread */
+const int num_elements = 1000;
+
+/* the number of threads */
+const int num_threads = 8;
+
+/*
+ * check_elements -- (internal) verify that the map contains exactly the
+ *	elements with the keys from the range with the given step
+ */
+void
+check_elements(map_type &map, int begin, int end, int step)
+{
+	UT_ASSERTeq(map.size(), (size_t)((end - begin + step - 1) / step));
+
+	for (int i = begin - 1; i <= end; ++i) {
+		map_type::const_accessor acc;
+		bool found = map.find(acc, i);
+
+		if (i >= begin && i < end && (i - begin) % step == 0) {
+			UT_ASSERT(found);
+			UT_ASSERTeq(acc->first, i);
+			UT_ASSERTeq(acc->second, i * 2);
+		} else {
+			UT_ASSERT(!found);
+			UT_ASSERT(acc.empty());
+		}
+	}
+}
+
+/*
+ * test_basic -- (internal) test single-threaded operations on the map
+ */
+void
+test_basic(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+	map_type &map = *r->map;
+
+	UT_ASSERT(map.empty());
+	size_t nbuckets = map.bucket_count();
+
+	for (int i = 0; i < num_elements; ++i)
+		UT_ASSERT(map.insert(map_type::value_type(i, i * 2)));
+
+	check_elements(map, 0, num_elements, 1);
+	UT_ASSERT(map.bucket_count() > nbuckets);
+
+	/* the existing element isn't replaced */
+	UT_ASSERT(!map.insert(map_type::value_type(1, 0)));
+	UT_ASSERTeq(map.count(1), 1);
+
+	{
+		map_type::accessor acc;
+		UT_ASSERT(!map.insert(acc, 2));
+		UT_ASSERTeq(acc->second, 4);
+
+		nvobj::transaction::exec_tx(pop,
+					    [&]() { acc->second = 5; });
+	}
+
+	{
+		map_type::const_accessor acc;
+		UT_ASSERT(map.find(acc, 2));
+		UT_ASSERTeq(acc->second, 5);
+		acc.release();
+		UT_ASSERT(acc.empty());
+
+		map_type::accessor wacc;
+		UT_ASSERT(map.find(wacc, 2));
+		nvobj::transaction::exec_tx(pop,
+					    [&]() { wacc->second = 4; });
+	}
+
+	/* a new key gets a default constructed value */
+	{
+		map_type::accessor acc;
+		UT_ASSERT(map.insert(acc, -1));
+		UT_ASSERTeq(acc->first, -1);
+
+		nvobj::transaction::exec_tx(pop,
+					    [&]() { acc->second = -2; });
+	}
+
+	UT_ASSERT(map.erase(-1));
+	UT_ASSERT(!map.erase(-1));
+	UT_ASSERTeq(map.count(-1), 0);
+
+	for (int i = 1; i < num_elements; i += 2)
+		UT_ASSERT(map.erase(i));
+
+	check_elements(map, 0, num_elements, 2);
+}
+
+/*
+ * test_tx_scope -- (internal) test that the map refuses to be a part of
+ *	a transaction
+ */
+void
+test_tx_scope(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+	map_type &map = *r->map;
+
+	bool exception_thrown = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			map.insert(map_type::value_type(1, 2));
+		});
+	} catch (nvml::transaction_scope_error &) {
+		exception_thrown = true;
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERTeq(map.count(1), 0);
+}
+
+/*
+ * inserter -- (internal) insert the elements with the keys which are equal to
+ *	the number of the thread modulo the number of threads
+ */
+void
+inserter(map_type *map, int thread)
+{
+	for (int i = thread; i < num_elements * num_threads;
+	     i += num_threads)
+		UT_ASSERT(map->insert(map_type::value_type(i, i * 2)));
+}
+
+/*
+ * reader -- (internal) look up the elements while they're inserted
+ */
+void
+reader(map_type *map, int thread)
+{
+	for (int i = thread; i < num_elements * num_threads;
+	     i += num_threads) {
+		map_type::const_accessor acc;
+		if (map->find(acc, i))
+			UT_ASSERTeq(acc->second, i * 2);
+	}
+}
+
+/*
+ * eraser -- (internal) erase the elements inserted by the inserter with
+ *	an odd number
+ */
+void
+eraser(map_type *map, int thread)
+{
+	for (int i = thread; i < num_elements * num_threads;
+	     i += num_threads)
+		UT_ASSERT(map->erase(i));
+}
+
+/*
+ * test_mt -- (internal) test concurrent inserts, lookups and erasures
+ */
+void
+test_mt(nvobj::pool<root> &pop)
+{
+	map_type *map = pop.get_root()->map.get();
+
+	map->clear();
+	UT_ASSERT(map->empty());
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; ++i) {
+		threads.emplace_back(inserter, map, i);
+		threads.emplace_back(reader, map, i);
+	}
+
+	for (auto &t : threads)
+		t.join();
+	threads.clear();
+
+	check_elements(*map, 0, num_elements * num_threads, 1);
+
+	for (int i = 1; i < num_threads; i += 2) {
+		threads.emplace_back(eraser, map, i);
+		threads.emplace_back(reader, map, i - 1);
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	check_elements(*map, 0, num_elements * num_threads, 2);
+}
+
+/*
+ * test_reopen -- (internal) test the map after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop, const char *path)
+{
+	size_t nbuckets = pop.get_root()->map->bucket_count();
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	map_type &map = *pop.get_root()->map;
+	UT_ASSERTeq(map.bucket_count(), nbuckets);
+	check_elements(map, 0, num_elements * num_threads, 2);
+
+	map.runtime_initialize();
+	check_elements(map, 0, num_elements * num_threads, 2);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cpp_concurrent_hash_map");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 4,
+						S_IWUSR | S_IRUSR);
+	} catch (nvml::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	auto r = pop.get_root();
+	nvobj::transaction::exec_tx(
+		pop, [&]() { r->map = nvobj::make_persistent<map_type>(); });
+
+	test_basic(pop);
+	test_tx_scope(pop);
+	test_mt(pop);
+	test_reopen(pop, path);
+
+	r = pop.get_root();
+	nvobj::transaction::exec_tx(pop, [&]() {
+		nvobj::delete_persistent<map_type>(r->map);
+		r->map = nullptr;
+	});
+
+	pop.close();
+
+	DONE(NULL);
+}
@@ -42,6 +42,9 @@
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj++/transaction.hpp>
 
+#include <stdexcept>
+#include <vector>
+
 #define LAYOUT "cpp"
 
 namespace nvobj = nvml::obj;
@@ -90,6 +93,38 @@ struct root {
 	nvobj::persistent_ptr<foo> pfoo;
 };
 
+const int BATCH_SIZE = 100;
+
+struct thrower {
+	thrower()
+	{
+		if (++count == BATCH_SIZE / 2)
+			throw std::runtime_error("construction failed");
+	}
+
+	static int count;
+
+	nvobj::p<int> val;
+};
+
+int thrower::count = 0;
+
+/*
+ * count_objects -- (internal) count all objects in the pool but the root
+ */
+int
+count_objects(nvobj::pool<struct root> &pop)
+{
+	int n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop.get_handle(), oid)
+	{
+		++n;
+	}
+
+	return n;
+}
+
 /*
  * test_make_no_args -- (internal) test make_persitent without arguments
  */
@@ -197,6 +232,77 @@ test_additional_delete(nvobj::pool<struct root> &pop)
 
 	UT_ASSERT(r->pfoo == nullptr);
 }
+
+/*
+ * test_make_batch -- (internal) test make_persistent_batch
+ */
+void
+test_make_batch(nvobj::pool<struct root> &pop)
+{
+	std::vector<nvobj::persistent_ptr<foo>> foos;
+
+	bool exception_thrown = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&] {
+			foos = nvobj::make_persistent_batch<foo>(BATCH_SIZE, 5,
+								 6);
+			UT_ASSERTeq(foos.size(), BATCH_SIZE);
+			for (auto &f : foos)
+				f->check_foo(5, 6);
+
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (nvml::manual_tx_abort &) {
+		exception_thrown = true;
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERTeq(count_objects(pop), 0);
+
+	exception_thrown = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&] {
+			nvobj::make_persistent_batch<thrower>(BATCH_SIZE);
+		});
+	} catch (std::runtime_error &) {
+		exception_thrown = true;
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERTeq(count_objects(pop), 0);
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&] {
+			foos = nvobj::make_persistent_batch<foo>(BATCH_SIZE);
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(count_objects(pop), BATCH_SIZE);
+	for (int i = 0; i < BATCH_SIZE; ++i) {
+		foos[i]->check_foo(1, 1);
+		for (int j = 0; j < i; ++j)
+			UT_ASSERT(foos[i] != foos[j]);
+	}
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&] {
+			UT_ASSERT(nvobj::make_persistent_batch<foo>(0).empty());
+
+			for (auto &f : foos)
+				nvobj::delete_persistent<foo>(f);
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(count_objects(pop), 0);
+}
 }
 
 int
@@ -221,6 +327,7 @@ main(int argc, char *argv[])
 	test_make_no_args(pop);
 	test_make_args(pop);
 	test_additional_delete(pop);
+	test_make_batch(pop);
 
 	pop.close();
 
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_cpp_self_relative_ptr.cpp -- cpp self_relative_ptr test
+ */
+
+#include "unittest.h"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/self_relative_ptr.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = nvml::obj;
+
+namespace
+{
+
+struct node {
+	node(int v) : val(v)
+	{
+	}
+
+	nvobj::self_relative_ptr<node> next;
+	nvobj::p<int> val;
+};
+
+/* pool root structure */
+struct root {
+	nvobj::self_relative_ptr<node> head;
+	nvobj::persistent_ptr<node> first;
+	nvobj::persistent_ptr<int[]> arr;
+};
+
+const int num_nodes = 100;
+const int arr_size = 10;
+
+/*
+ * check_list -- (internal) verify the values of the list
+ */
+void
+check_list(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	int i = num_nodes;
+	for (auto n = r->head; n != nullptr; n = n->next)
+		UT_ASSERTeq(n->val, --i);
+	UT_ASSERTeq(i, 0);
+
+	/* both pointers lead to the same object */
+	UT_ASSERTeq(r->head.get(), r->first.get());
+	nvobj::persistent_ptr<node> first = r->head;
+	UT_ASSERT(first == r->first);
+}
+
+/*
+ * test_list -- (internal) build a list linked with self-relative pointers
+ */
+void
+test_list(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	UT_COMPILE_ERROR_ON(sizeof(nvobj::self_relative_ptr<node>) != 8);
+	UT_ASSERT(r->head == nullptr);
+	UT_ASSERT(!r->head);
+	UT_ASSERTeq(r->head.get(), nullptr);
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		for (int i = 0; i < num_nodes; ++i) {
+			auto n = nvobj::make_persistent<node>(i);
+			n->next = r->head;
+			r->head = n;
+		}
+		r->first = r->head;
+	});
+
+	check_list(pop);
+
+	/* the assignments are rolled back */
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			r->head = r->head->next;
+			r->head->next = nullptr;
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (nvml::manual_tx_abort &) {
+	}
+
+	check_list(pop);
+}
+
+/*
+ * test_arith -- (internal) test the arithmetic of self-relative pointers
+ */
+void
+test_arith(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->arr = nvobj::make_persistent<int[]>(arr_size);
+		for (int i = 0; i < arr_size; ++i)
+			r->arr[i] = i;
+	});
+
+	nvobj::self_relative_ptr<int[]> begin = r->arr;
+	nvobj::self_relative_ptr<int[]> it = begin;
+	UT_ASSERT(it == begin);
+
+	for (int i = 0; i < arr_size; ++i) {
+		UT_ASSERTeq(begin[i], i);
+		UT_ASSERTeq((it++)[0], i);
+	}
+
+	UT_ASSERTeq(it - begin, arr_size);
+	UT_ASSERT(begin < it);
+	UT_ASSERT(it >= begin);
+
+	it -= arr_size / 2;
+	UT_ASSERTeq(it[0], arr_size / 2);
+	UT_ASSERTeq((--it)[0], arr_size / 2 - 1);
+
+	nvobj::self_relative_ptr<int[]> other;
+	other.swap(it);
+	UT_ASSERT(it == nullptr);
+	UT_ASSERTeq(other[0], arr_size / 2 - 1);
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		nvobj::delete_persistent<int[]>(r->arr, arr_size);
+		r->arr = nullptr;
+	});
+}
+
+/*
+ * test_reopen -- (internal) test the pointers in another mapping of the pool
+ */
+void
+test_reopen(nvobj::pool<root> &pop, const char *path)
+{
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	check_list(pop);
+
+	auto r = pop.get_root();
+	nvobj::transaction::exec_tx(pop, [&]() {
+		while (r->head != nullptr) {
+			nvobj::persistent_ptr<node> n = r->head;
+			r->head = n->next;
+			nvobj::delete_persistent<node>(n);
+		}
+		r->first = nullptr;
+	});
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cpp_self_relative_ptr");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (nvml::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_list(pop);
+	test_arith(pop);
+	test_reopen(pop, path);
+
+	pop.close();
+
+	DONE(NULL);
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_cpp_string.cpp -- cpp string test
+ */
+
+#include "unittest.h"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/string.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <sstream>
+#include <string>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = nvml::obj;
+
+namespace
+{
+
+/* pool root structure */
+struct root {
+	nvobj::string s1;
+	nvobj::string s2;
+	nvobj::persistent_ptr<nvobj::string> ps;
+};
+
+const std::string short_str = "short string";
+const std::string long_str =
+	"a string too long to fit inside the persistent string object";
+
+/*
+ * check -- (internal) verify the contents of the string
+ */
+void
+check(const nvobj::string &s, const std::string &expected)
+{
+	UT_ASSERTeq(s.size(), expected.size());
+	UT_ASSERT(s.capacity() >= s.size());
+	UT_ASSERT(s == expected);
+	UT_ASSERTeq(s.c_str()[s.size()], '\0');
+	UT_ASSERT(std::string(s.c_str()) == expected);
+}
+
+/*
+ * abort_tx -- (internal) run f in a transaction and abort it
+ */
+template <typename F>
+void
+abort_tx(nvobj::pool<root> &pop, F f)
+{
+	bool aborted = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			f();
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (nvml::manual_tx_abort &) {
+		aborted = true;
+	}
+
+	UT_ASSERT(aborted);
+}
+
+/*
+ * test_sso -- (internal) test the short strings kept in the object
+ */
+void
+test_sso(nvobj::pool<root> &pop)
+{
+	nvobj::string &s = pop.get_root()->s1;
+
+	UT_COMPILE_ERROR_ON(sizeof(nvobj::string) != 32);
+	check(s, "");
+	UT_ASSERTeq(s.capacity(), 23);
+
+	s = short_str.c_str();
+	check(s, short_str);
+
+	s.push_back('!');
+	check(s, short_str + "!");
+
+	s.pop_back();
+	s[0] = 'S';
+	check(s, "S" + short_str.substr(1));
+
+	abort_tx(pop, [&]() {
+		s.append("x");
+		s.insert(0, "y");
+		s.erase(3, 2);
+		s.front() = 'z';
+	});
+	check(s, "S" + short_str.substr(1));
+
+	s.assign(23, 'a');
+	check(s, std::string(23, 'a'));
+	UT_ASSERTeq(s.capacity(), 23);
+}
+
+/*
+ * test_large -- (internal) test the strings in a separate buffer
+ */
+void
+test_large(nvobj::pool<root> &pop)
+{
+	nvobj::string &s = pop.get_root()->s1;
+	std::string expected = s.c_str();
+
+	s.push_back('b');
+	expected.push_back('b');
+	check(s, expected);
+	UT_ASSERT(s.capacity() >= 46);
+
+	for (int i = 0; i < 1000; ++i) {
+		size_t cap = s.capacity();
+		s += static_cast<char>('a' + i % 26);
+		expected += static_cast<char>('a' + i % 26);
+		UT_ASSERT(s.capacity() == cap || s.capacity() >= 2 * cap);
+	}
+	check(s, expected);
+
+	s.insert(10, long_str);
+	expected.insert(10, long_str);
+	check(s, expected);
+
+	s.erase(5, 100);
+	expected.erase(5, 100);
+	check(s, expected);
+
+	/* the source is a part of the string */
+	s.append(s.c_str(), 50);
+	expected.append(expected.c_str(), 50);
+	check(s, expected);
+
+	s.insert(0, s.c_str() + 10);
+	expected.insert(0, expected.c_str() + 10);
+	check(s, expected);
+
+	size_t cap = s.capacity();
+	abort_tx(pop, [&]() {
+		s.append(long_str);
+		s.append(cap, 'c');
+		s[0] = 'x';
+	});
+	check(s, expected);
+	UT_ASSERTeq(s.capacity(), cap);
+
+	abort_tx(pop, [&]() {
+		s.clear();
+		s.append(cap, 'c');
+	});
+	check(s, expected);
+
+	abort_tx(pop, [&]() {
+		s.resize(10);
+		s.shrink_to_fit();
+		s.resize(100, 'r');
+	});
+	check(s, expected);
+
+	s.resize(10);
+	expected.resize(10);
+	s.shrink_to_fit();
+	check(s, expected);
+	UT_ASSERTeq(s.capacity(), 23);
+
+	std::ostringstream os;
+	os << s;
+	UT_ASSERT(os.str() == expected);
+}
+
+/*
+ * test_move -- (internal) test the moves and swaps of the strings
+ */
+void
+test_move(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	r->s1 = long_str;
+	r->s2 = short_str;
+
+	const char *buf = r->s1.c_str();
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->ps = nvobj::make_persistent<nvobj::string>(
+			std::move(r->s1));
+	});
+	UT_ASSERTeq(r->ps->c_str(), buf);
+	check(*r->ps, long_str);
+	check(r->s1, "");
+
+	nvobj::transaction::exec_tx(pop, [&]() { r->s2.swap(*r->ps); });
+	UT_ASSERTeq(r->s2.c_str(), buf);
+	check(r->s2, long_str);
+	check(*r->ps, short_str);
+
+	abort_tx(pop, [&]() { r->s1 = std::move(r->s2); });
+	check(r->s2, long_str);
+	check(r->s1, "");
+
+	r->s1 = std::move(r->s2);
+	UT_ASSERTeq(r->s1.c_str(), buf);
+	check(r->s1, long_str);
+
+	UT_ASSERT(r->s1 != r->s2);
+	UT_ASSERT(*r->ps > r->s1);
+	UT_ASSERT(r->s1.compare(long_str) == 0);
+	UT_ASSERT(r->s1.compare("b") < 0);
+}
+
+/*
+ * test_reopen -- (internal) test the strings after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop, const char *path)
+{
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	auto r = pop.get_root();
+	check(r->s1, long_str);
+	check(r->s2, "");
+	check(*r->ps, short_str);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cpp_string");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (nvml::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_sso(pop);
+	test_large(pop);
+	test_move(pop);
+	test_reopen(pop, path);
+
+	auto r = pop.get_root();
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->s1.clear();
+		r->s1.shrink_to_fit();
+		nvobj::delete_persistent<nvobj::string>(r->ps);
+		r->ps = nullptr;
+	});
+	UT_ASSERTeq(r->s1.capacity(), 23);
+
+	pop.close();
+
+	DONE(NULL);
+}
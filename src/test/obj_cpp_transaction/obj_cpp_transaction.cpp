@@ -36,6 +36,8 @@
 
 #include "unittest.h"
 
+#include <memory>
+
 #include "libpmemobj++/make_persistent.hpp"
 #include "libpmemobj++/mutex.hpp"
 #include "libpmemobj++/p.hpp"
@@ -129,6 +131,38 @@ private:
 	nvobj::pool<root> &pop;
 };
 
+/*
+ * Move-only callable object class.
+ */
+class transaction_move_only {
+public:
+	/*
+	 * Constructor.
+	 */
+	transaction_move_only(nvobj::pool<root> &pop_, int val)
+	    : pop(pop_), value(new int(val))
+	{
+	}
+
+	transaction_move_only(transaction_move_only &&) = default;
+	transaction_move_only(const transaction_move_only &) = delete;
+
+	/*
+	 * The transaction worker.
+	 */
+	void
+	operator()()
+	{
+		auto rootp = this->pop.get_root();
+
+		rootp->pfoo->bar = *value;
+	}
+
+private:
+	nvobj::pool<root> &pop;
+	std::unique_ptr<int> value;
+};
+
 /*
  * do_transaction -- internal C-style function transaction.
  */
@@ -207,6 +241,50 @@ test_tx_no_throw_no_abort(nvobj::pool<root> &pop)
 	UT_ASSERT(rootp->parr == nullptr);
 }
 
+/*
+ * test_tx_callable -- test transactions with callables which can't be stored
+ * in an std::function
+ */
+void
+test_tx_callable(nvobj::pool<root> &pop)
+{
+	auto rootp = pop.get_root();
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			rootp->pfoo = nvobj::make_persistent<foo>();
+		});
+
+		nvobj::transaction::exec_tx(
+			pop, transaction_move_only(pop, 7), rootp->mtx);
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(rootp->pfoo->bar, 7);
+
+	/* an lvalue is called in place, without a copy */
+	transaction_move_only tx(pop, 9);
+	try {
+		nvobj::transaction::exec_tx(pop, tx);
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(rootp->pfoo->bar, 9);
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			nvobj::delete_persistent<foo>(rootp->pfoo);
+			rootp->pfoo = nullptr;
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(rootp->pfoo == nullptr);
+}
+
 /*
  * test_tx_throw_no_abort -- test transaction with exceptions and no aborts
  */
@@ -348,6 +426,83 @@ test_tx_no_throw_abort(nvobj::pool<root> &pop)
 	UT_ASSERT(rootp->parr == nullptr);
 }
 
+/*
+ * test_tx_repeated_add -- test transactions which modify the same objects
+ *	many times
+ */
+void
+test_tx_repeated_add(nvobj::pool<root> &pop)
+{
+	auto rootp = pop.get_root();
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			rootp->pfoo = nvobj::make_persistent<foo>();
+			rootp->pfoo->bar = 1;
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	/* every transaction has to snapshot the objects again */
+	for (int i = 0; i < 3; ++i) {
+		bool exception_thrown = false;
+		try {
+			nvobj::transaction::exec_tx(pop, [&]() {
+				for (int j = 0; j < 10; ++j) {
+					rootp->pfoo->bar = j;
+					nvobj::transaction::exec_tx(pop, [&]() {
+						rootp->pfoo->bar = j + 1;
+					});
+				}
+
+				UT_ASSERTeq(rootp->pfoo->bar, 10);
+				nvobj::transaction::abort(-1);
+			});
+		} catch (nvml::manual_tx_abort &) {
+			exception_thrown = true;
+		} catch (...) {
+			UT_ASSERT(0);
+		}
+
+		UT_ASSERT(exception_thrown);
+		UT_ASSERTeq(rootp->pfoo->bar, 1);
+	}
+
+	/* an object freed in the transaction takes its snapshots with it */
+	bool exception_thrown = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			auto pfoo = rootp->pfoo;
+			rootp->pfoo = nvobj::make_persistent<foo>();
+			rootp->pfoo->bar = 2;
+			nvobj::delete_persistent<foo>(rootp->pfoo);
+
+			rootp->pfoo = pfoo;
+			rootp->pfoo->bar = 3;
+			nvobj::transaction::abort(-1);
+		});
+	} catch (nvml::manual_tx_abort &) {
+		exception_thrown = true;
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERTeq(rootp->pfoo->bar, 1);
+
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			nvobj::delete_persistent<foo>(rootp->pfoo);
+			rootp->pfoo = nullptr;
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(rootp->pfoo == nullptr);
+}
+
 /*
  * Scoped tests.
  */
@@ -599,8 +754,10 @@ main(int argc, char *argv[])
 	}
 
 	test_tx_no_throw_no_abort(pop);
+	test_tx_callable(pop);
 	test_tx_throw_no_abort(pop);
 	test_tx_no_throw_abort(pop);
+	test_tx_repeated_add(pop);
 
 	test_tx_no_throw_no_abort_scope<nvobj::transaction::manual>(
 		pop, real_commit);
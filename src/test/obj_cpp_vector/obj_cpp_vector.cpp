@@ -0,0 +1,419 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_cpp_vector.cpp -- cpp vector test
+ */
+
+#include "unittest.h"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/vector.hpp>
+
+#include <vector>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = nvml::obj;
+
+namespace
+{
+
+/* element with a non-trivial move */
+struct element {
+	element() : val(0)
+	{
+	}
+
+	element(int v) : val(v)
+	{
+	}
+
+	element(const element &e) : val(e.val)
+	{
+	}
+
+	element(element &&e) : val(e.val)
+	{
+		e.val = -1;
+	}
+
+	element &
+	operator=(const element &e)
+	{
+		val = e.val;
+		return *this;
+	}
+
+	element &
+	operator=(element &&e)
+	{
+		val = e.val;
+		e.val = -1;
+		return *this;
+	}
+
+	operator int() const
+	{
+		return val;
+	}
+
+	nvobj::p<int> val;
+};
+
+typedef nvobj::vector<int> int_vector;
+typedef nvobj::vector<element> elem_vector;
+
+/* pool root structure */
+struct root {
+	int_vector iv;
+	nvobj::persistent_ptr<elem_vector> ev;
+	nvobj::persistent_ptr<int_vector> other;
+};
+
+const int num_elements = 1000;
+
+/*
+ * check_range -- (internal) verify that the vector holds exactly the values
+ *	from the given range
+ */
+template <typename V>
+void
+check_range(const V &v, int begin, int end)
+{
+	UT_ASSERTeq(v.size(), (size_t)(end - begin));
+	UT_ASSERT(v.capacity() >= v.size());
+
+	for (int i = begin; i < end; ++i)
+		UT_ASSERTeq(static_cast<int>(v[(size_t)(i - begin)]), i);
+}
+
+/*
+ * abort_tx -- (internal) run f in a transaction and abort it
+ */
+template <typename F>
+void
+abort_tx(nvobj::pool<root> &pop, F f)
+{
+	bool aborted = false;
+	try {
+		nvobj::transaction::exec_tx(pop, [&]() {
+			f();
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (nvml::manual_tx_abort &) {
+		aborted = true;
+	}
+
+	UT_ASSERT(aborted);
+}
+
+/*
+ * test_push_back -- (internal) test appending to a zeroed vector
+ */
+void
+test_push_back(nvobj::pool<root> &pop)
+{
+	int_vector &v = pop.get_root()->iv;
+
+	UT_ASSERT(v.empty());
+	UT_ASSERTeq(v.capacity(), 0);
+
+	size_t reallocs = 0;
+	for (int i = 0; i < num_elements; ++i) {
+		size_t cap = v.capacity();
+		v.push_back(i);
+		if (v.capacity() != cap) {
+			UT_ASSERT(v.capacity() >= 2 * cap);
+			reallocs++;
+		}
+	}
+
+	check_range(v, 0, num_elements);
+	UT_ASSERT(reallocs <= 11);
+
+	UT_ASSERTeq(v.front(), 0);
+	UT_ASSERTeq(v.back(), num_elements - 1);
+	UT_ASSERTeq(v.at(10), 10);
+
+	bool thrown = false;
+	try {
+		v.at(num_elements);
+	} catch (std::out_of_range &) {
+		thrown = true;
+	}
+	UT_ASSERT(thrown);
+
+	/* appends in a single transaction */
+	nvobj::transaction::exec_tx(pop, [&]() {
+		for (int i = num_elements; i < 2 * num_elements; ++i)
+			v.emplace_back(i);
+	});
+	check_range(v, 0, 2 * num_elements);
+
+	v.resize(num_elements);
+	check_range(v, 0, num_elements);
+}
+
+/*
+ * test_abort -- (internal) test the rollback of the modifications
+ */
+void
+test_abort(nvobj::pool<root> &pop)
+{
+	int_vector &v = pop.get_root()->iv;
+	size_t cap = v.capacity();
+
+	/* appends into the existing capacity */
+	abort_tx(pop, [&]() {
+		while (v.size() < v.capacity())
+			v.push_back(0);
+	});
+	check_range(v, 0, num_elements);
+
+	/* appends past the capacity */
+	abort_tx(pop, [&]() {
+		for (int i = 0; i < num_elements; ++i)
+			v.push_back(0);
+		v[0] = 5;
+	});
+	check_range(v, 0, num_elements);
+	UT_ASSERTeq(v.capacity(), cap);
+
+	/* removal and an overwrite of the removed slots */
+	abort_tx(pop, [&]() {
+		v.pop_back();
+		v.erase(v.cbegin() + 10, v.cbegin() + 20);
+		v.clear();
+		for (int i = 0; i < num_elements; ++i)
+			v.push_back(-i);
+	});
+	check_range(v, 0, num_elements);
+
+	abort_tx(pop, [&]() {
+		v.assign(10, 7);
+		v.insert(v.cbegin(), 3, 1);
+		v.shrink_to_fit();
+	});
+	check_range(v, 0, num_elements);
+	UT_ASSERTeq(v.capacity(), cap);
+
+	abort_tx(pop, [&]() {
+		for (auto &e : v)
+			e = 0;
+	});
+	check_range(v, 0, num_elements);
+}
+
+/*
+ * test_modifiers -- (internal) test the modifiers against std::vector
+ */
+void
+test_modifiers(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->other = nvobj::make_persistent<int_vector>(
+			std::initializer_list<int>{1, 2, 3});
+	});
+
+	int_vector &v = *r->other;
+	std::vector<int> expected = {1, 2, 3};
+
+	auto check = [&]() {
+		UT_ASSERTeq(v.size(), expected.size());
+		for (size_t i = 0; i < expected.size(); ++i)
+			UT_ASSERTeq(v.cdata()[i], expected[i]);
+	};
+
+	check();
+
+	v.insert(v.cbegin() + 1, 10, 4);
+	expected.insert(expected.begin() + 1, 10, 4);
+	check();
+
+	v.insert(v.cend(), {5, 6, 7});
+	expected.insert(expected.end(), {5, 6, 7});
+	check();
+
+	v.emplace(v.cbegin(), 8);
+	expected.emplace(expected.begin(), 8);
+	check();
+
+	v.insert(v.cbegin() + 2, v[0]);
+	expected.insert(expected.begin() + 2, expected[0]);
+	check();
+
+	v.erase(v.cbegin() + 3, v.cbegin() + 8);
+	expected.erase(expected.begin() + 3, expected.begin() + 8);
+	check();
+
+	v.erase(v.cbegin());
+	expected.erase(expected.begin());
+	check();
+
+	v.resize(30, 9);
+	expected.resize(30, 9);
+	check();
+
+	v.shrink_to_fit();
+	UT_ASSERTeq(v.capacity(), v.size());
+
+	v.assign(expected.begin(), expected.begin() + 5);
+	expected.resize(5);
+	check();
+
+	v.assign(100, 1);
+	expected.assign(100, 1);
+	check();
+
+	v = {3, 2, 1};
+	expected = {3, 2, 1};
+	check();
+
+	int_vector &iv = r->iv;
+	UT_ASSERT(v != iv);
+	UT_ASSERT(iv < v);
+
+	/* swap and move hand over the buffers */
+	const int *data = v.cdata();
+	const int *idata = iv.cdata();
+	nvobj::transaction::exec_tx(pop, [&]() { v.swap(iv); });
+	UT_ASSERTeq(v.cdata(), idata);
+	UT_ASSERTeq(iv.cdata(), data);
+	check_range(v, 0, num_elements);
+
+	nvobj::transaction::exec_tx(pop, [&]() { iv = std::move(v); });
+	UT_ASSERTeq(iv.cdata(), idata);
+	UT_ASSERT(v.empty());
+	UT_ASSERT(v.cdata() == nullptr);
+	check_range(iv, 0, num_elements);
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		nvobj::delete_persistent<int_vector>(r->other);
+		r->other = nullptr;
+	});
+}
+
+/*
+ * test_non_trivial -- (internal) test a vector of elements with
+ *	a non-trivial move
+ */
+void
+test_non_trivial(nvobj::pool<root> &pop)
+{
+	auto r = pop.get_root();
+
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->ev = nvobj::make_persistent<elem_vector>();
+	});
+
+	elem_vector &v = *r->ev;
+	for (int i = 0; i < num_elements; ++i)
+		v.emplace_back(i);
+	check_range(v, 0, num_elements);
+
+	v.erase(v.cbegin());
+	check_range(v, 1, num_elements);
+
+	v.insert(v.cbegin(), element(0));
+	check_range(v, 0, num_elements);
+
+	/* the moved-from elements of the old buffers are restored */
+	abort_tx(pop, [&]() {
+		v.reserve(v.capacity() * 2);
+		v.insert(v.cbegin(), 5, element(-1));
+		v.erase(v.cbegin(), v.cbegin() + 10);
+	});
+	check_range(v, 0, num_elements);
+}
+
+/*
+ * test_reopen -- (internal) test the vectors after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop, const char *path)
+{
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	auto r = pop.get_root();
+	check_range(r->iv, 0, num_elements);
+	check_range(*r->ev, 0, num_elements);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cpp_vector");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 2,
+						S_IWUSR | S_IRUSR);
+	} catch (nvml::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_push_back(pop);
+	test_abort(pop);
+	test_modifiers(pop);
+	test_non_trivial(pop);
+	test_reopen(pop, path);
+
+	auto r = pop.get_root();
+	nvobj::transaction::exec_tx(pop, [&]() {
+		r->iv.clear();
+		r->iv.shrink_to_fit();
+		nvobj::delete_persistent<elem_vector>(r->ev);
+		r->ev = nullptr;
+	});
+	UT_ASSERTeq(r->iv.capacity(), 0);
+
+	pop.close();
+
+	DONE(NULL);
+}
@@ -165,6 +165,67 @@ test_ctree_remove()
 	ctree_delete(t);
 }
 
+#define TEST_MT_KEYS 1024
+#define TEST_MT_READERS 4
+#define TEST_MT_OPS 10000
+
+static int Writer_done;
+
+/*
+ * ctree_reader -- (internal) looks up the stable even keys and the odd ones,
+ *	which are being inserted and removed by the writer
+ */
+static void *
+ctree_reader(void *arg)
+{
+	struct ctree *t = arg;
+
+	unsigned i = 0;
+	while (!__sync_fetch_and_add(&Writer_done, 0)) {
+		uint64_t even = 2 * (i % TEST_MT_KEYS + 1);
+		UT_ASSERTeq(ctree_find(t, even), even);
+
+		uint64_t k = even + 1;
+		uint64_t v = ctree_find_le(t, &k);
+		UT_ASSERT(k == even || k == even + 1);
+		UT_ASSERTeq(v, k);
+
+		UT_ASSERT(!ctree_is_empty(t));
+		i++;
+	}
+
+	return NULL;
+}
+
+static void
+test_ctree_concurrent_find()
+{
+	struct ctree *t = ctree_new();
+	UT_ASSERT(t != NULL);
+
+	for (uint64_t k = 2; k <= 2 * TEST_MT_KEYS; k += 2)
+		UT_ASSERT(ctree_insert(t, k, k) == 0);
+
+	Writer_done = 0;
+
+	pthread_t readers[TEST_MT_READERS];
+	for (int i = 0; i < TEST_MT_READERS; ++i)
+		PTHREAD_CREATE(&readers[i], NULL, ctree_reader, t);
+
+	for (unsigned i = 0; i < TEST_MT_OPS; ++i) {
+		uint64_t odd = 2 * (i % TEST_MT_KEYS + 1) + 1;
+		UT_ASSERT(ctree_insert(t, odd, odd) == 0);
+		UT_ASSERT(ctree_remove(t, odd, 1) == odd);
+	}
+
+	__sync_fetch_and_add(&Writer_done, 1);
+
+	for (int i = 0; i < TEST_MT_READERS; ++i)
+		PTHREAD_JOIN(readers[i], NULL);
+
+	ctree_delete(t);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -176,6 +237,7 @@ main(int argc, char *argv[])
 	test_ctree_insert();
 	test_ctree_find();
 	test_ctree_remove();
+	test_ctree_concurrent_find();
 
 	DONE(NULL);
 }
@@ -103,6 +103,43 @@ test_insert_get_remove()
 	cuckoo_delete(c);
 }
 
+#define TEST_GROW_INSERTS 10000
+
+/*
+ * test_grow -- inserts and removes entries while the table grows, every
+ *	entry has to be reachable regardless of which table it lives in
+ */
+static void
+test_grow()
+{
+	struct cuckoo *c = cuckoo_new();
+	UT_ASSERT(c != NULL);
+
+	for (uint64_t i = 1; i <= TEST_GROW_INSERTS; ++i) {
+		UT_ASSERT(cuckoo_insert(c, i, TEST_VAL(i)) == 0);
+		UT_ASSERT(cuckoo_insert(c, i, TEST_VAL(i)) == EINVAL);
+
+		/* the previous entries might be in the middle of migration */
+		uint64_t k = i / 2 + 1;
+		void *val = k % 3 == 2 && k + 1 < i ? NULL : TEST_VAL(k);
+		UT_ASSERT(cuckoo_get(c, k) == val);
+
+		if (i % 3 == 0)
+			UT_ASSERT(cuckoo_remove(c, i - 1) == TEST_VAL(i - 1));
+	}
+
+	for (uint64_t i = 1; i <= TEST_GROW_INSERTS; ++i) {
+		void *val = i % 3 == 2 ? NULL : TEST_VAL(i);
+		UT_ASSERT(cuckoo_get(c, i) == val);
+		UT_ASSERT(cuckoo_remove(c, i) == val);
+	}
+
+	for (uint64_t i = 1; i <= TEST_GROW_INSERTS; ++i)
+		UT_ASSERT(cuckoo_get(c, i) == NULL);
+
+	cuckoo_delete(c);
+}
+
 /*
  * rand64 -- (internal) 64-bit random function of doubtful quality, but good
  *	enough for the test.
@@ -163,6 +200,7 @@ main(int argc, char *argv[])
 
 	test_cuckoo_new_delete();
 	test_insert_get_remove();
+	test_grow();
 	test_load_factor();
 
 	DONE(NULL);
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_defrag.c -- unit test for pmemobj_defrag
+ *
+ * usage: obj_defrag file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_defrag"
+
+#define NOBJS 4000
+#define OBJ_SIZE 256
+#define KEEP_EVERY 8
+#define TYPE_NUM 1
+#define TYPE_CHUNK 2
+#define CHUNK_OBJ_SIZE (200 * 1024)
+#define MAX_CHUNK_OBJS 100
+
+struct root {
+	PMEMoid objs[NOBJS];
+};
+
+/*
+ * fill_object -- writes the pattern of the given object
+ */
+static void
+fill_object(PMEMobjpool *pop, PMEMoid oid, unsigned i)
+{
+	unsigned *data = pmemobj_direct(oid);
+	for (size_t n = 0; n < OBJ_SIZE / sizeof(*data); ++n)
+		data[n] = i;
+
+	pmemobj_persist(pop, data, OBJ_SIZE);
+}
+
+/*
+ * count_chunk_objects -- returns the number of objects, each spanning almost
+ *	a whole chunk, that can be allocated in the pool
+ */
+static unsigned
+count_chunk_objects(PMEMobjpool *pop)
+{
+	static PMEMoid objs[MAX_CHUNK_OBJS];
+	unsigned n = 0;
+	while (n < MAX_CHUNK_OBJS && pmemobj_alloc(pop, &objs[n],
+			CHUNK_OBJ_SIZE, TYPE_CHUNK, NULL, NULL) == 0)
+		n++;
+
+	for (unsigned i = 0; i < n; ++i)
+		pmemobj_free(&objs[i]);
+
+	return n;
+}
+
+/*
+ * check_objects -- verifies the contents of all the remaining objects
+ */
+static void
+check_objects(struct root *r)
+{
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		if (i % KEEP_EVERY != 0) {
+			UT_ASSERT(OID_IS_NULL(r->objs[i]));
+			continue;
+		}
+
+		UT_ASSERT(!OID_IS_NULL(r->objs[i]));
+		UT_ASSERTeq(pmemobj_type_num(r->objs[i]), TYPE_NUM);
+
+		unsigned *data = pmemobj_direct(r->objs[i]);
+		for (size_t n = 0; n < OBJ_SIZE / sizeof(*data); ++n)
+			UT_ASSERTeq(data[n], i);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_defrag");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *r = pmemobj_direct(root);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_alloc(pop, &r->objs[i], OBJ_SIZE, TYPE_NUM,
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		fill_object(pop, r->objs[i], i);
+	}
+
+	/* leave the runs sparsely used */
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		if (i % KEEP_EVERY != 0)
+			pmemobj_free(&r->objs[i]);
+	}
+
+	static PMEMoid *oidv[NOBJS];
+	for (unsigned i = 0; i < NOBJS; ++i)
+		oidv[i] = &r->objs[i];
+
+	unsigned nchunks = count_chunk_objects(pop);
+
+	struct pobj_defrag_result result;
+	int ret = pmemobj_defrag(pop, oidv, NOBJS, &result);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(result.total, NOBJS / KEEP_EVERY);
+	UT_ASSERT(result.relocated > 0);
+	UT_ASSERT(result.relocated <= result.total);
+
+	/* the emptied runs are returned to the heap as whole chunks */
+	UT_ASSERT(count_chunk_objects(pop) > nchunks);
+
+	check_objects(r);
+
+	/* another pass over the compacted heap */
+	ret = pmemobj_defrag(pop, oidv, NOBJS, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	check_objects(r);
+
+	TX_BEGIN(pop) {
+		UT_ASSERTne(pmemobj_defrag(pop, oidv, NOBJS, NULL), 0);
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = pmemobj_root(pop, sizeof(struct root));
+	check_objects(pmemobj_direct(root));
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -118,6 +118,23 @@ main(int argc, char *argv[])
 		UT_ASSERTeq(r, 0);
 	}
 
+	/* the handles of different pools, mixed with the null ones */
+	size_t nbatch = 3 * (size_t)npools;
+	PMEMoid *batch = MALLOC(nbatch * sizeof(PMEMoid));
+	void **ptrs = MALLOC(nbatch * sizeof(void *));
+	for (int i = 0; i < npools; ++i) {
+		batch[3 * i] = tmpoids[i];
+		batch[3 * i + 1] = oids[i];
+		batch[3 * i + 2] = i % 2 ? OID_NULL :
+			(PMEMoid) {pops[i]->uuid_lo, 0};
+	}
+
+	pmemobj_direct_n(batch, ptrs, nbatch);
+	for (size_t i = 0; i < nbatch; ++i) {
+		UT_ASSERTeq(ptrs[i], pmemobj_direct(batch[i]));
+		pmemobj_prefetch(batch[i]);
+	}
+
 	r = pmemobj_alloc(pops[0], &thread_oid, 100, 2, NULL, NULL);
 	UT_ASSERTeq(r, 0);
 	UT_ASSERTne(pmemobj_direct(thread_oid), NULL);
@@ -141,6 +158,10 @@ main(int argc, char *argv[])
 		UT_ASSERTeq(pmemobj_direct(oids[i]), NULL);
 	}
 
+	pmemobj_direct_n(batch, ptrs, nbatch);
+	for (size_t i = 0; i < nbatch; ++i)
+		UT_ASSERTeq(ptrs[i], NULL);
+
 	/* signal the worker that we're free and closed */
 	pthread_mutex_lock(&lock2);
 	cond2 = 1;
@@ -152,6 +173,8 @@ main(int argc, char *argv[])
 	pthread_cond_destroy(&sync_cond2);
 	pthread_mutex_destroy(&lock1);
 	pthread_mutex_destroy(&lock2);
+	FREE(ptrs);
+	FREE(batch);
 	FREE(pops);
 	FREE(tmpoids);
 	FREE(oids);
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_epoch.c -- unit test for epoch-based reclamation
+ *
+ * usage: obj_epoch file
+ *
+ * The retired objects are freed only after the critical sections which
+ * might have found them are over, the ones still waiting when the pool
+ * is closed are freed on the next open.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "epoch"
+#define TYPE_ITEM 1
+
+/* the number of retired objects a lane can hold, see pmalloc.h */
+#define RETIRE_LIST_SIZE 48
+
+/*
+ * count_objs -- (internal) returns the number of allocated objects
+ */
+static unsigned
+count_objs(PMEMobjpool *pop)
+{
+	unsigned nobjs = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		nobjs++;
+
+	return nobjs;
+}
+
+/*
+ * alloc_objs -- (internal) allocates the given number of objects
+ */
+static void
+alloc_objs(PMEMobjpool *pop, PMEMoid *oids, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		int ret = pmemobj_zalloc(pop, &oids[i], sizeof(uint64_t),
+				TYPE_ITEM);
+		UT_ASSERTeq(ret, 0);
+	}
+}
+
+/*
+ * test_deferred -- (internal) retires objects while a thread is in its
+ *	critical section
+ */
+static void
+test_deferred(PMEMobjpool *pop)
+{
+	PMEMoid oids[10];
+	alloc_objs(pop, oids, 10);
+
+	uint64_t token = pmemobj_epoch_enter(pop);
+	for (unsigned i = 0; i < 10; ++i)
+		UT_ASSERTeq(pmemobj_retire(pop, oids[i]), 0);
+	UT_ASSERTeq(pmemobj_retire(pop, OID_NULL), 0);
+
+	UT_ASSERTeq(pmemobj_epoch_reclaim(pop), 0);
+	UT_OUT("in epoch: objects %u", count_objs(pop));
+
+	pmemobj_epoch_exit(pop, token);
+
+	UT_ASSERTeq(pmemobj_epoch_reclaim(pop), 0);
+	UT_OUT("after epoch: objects %u", count_objs(pop));
+}
+
+/*
+ * test_tx -- (internal) retires an object inside a transaction
+ */
+static void
+test_tx(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	alloc_objs(pop, &oid, 1);
+
+	TX_BEGIN(pop) {
+		errno = 0;
+		UT_ASSERTne(pmemobj_retire(pop, oid), 0);
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+
+	pmemobj_free(&oid);
+}
+
+/*
+ * test_full -- (internal) fills up the retired objects of the lane
+ */
+static void
+test_full(PMEMobjpool *pop)
+{
+	PMEMoid oids[RETIRE_LIST_SIZE + 1];
+	alloc_objs(pop, oids, RETIRE_LIST_SIZE + 1);
+
+	uint64_t token = pmemobj_epoch_enter(pop);
+	for (unsigned i = 0; i < RETIRE_LIST_SIZE; ++i)
+		UT_ASSERTeq(pmemobj_retire(pop, oids[i]), 0);
+
+	errno = 0;
+	UT_ASSERTne(pmemobj_retire(pop, oids[RETIRE_LIST_SIZE]), 0);
+	UT_ASSERTeq(errno, EAGAIN);
+
+	pmemobj_epoch_exit(pop, token);
+
+	/* makes room for itself by freeing the expired ones */
+	UT_ASSERTeq(pmemobj_retire(pop, oids[RETIRE_LIST_SIZE]), 0);
+	UT_OUT("full: objects %u", count_objs(pop));
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_epoch");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create");
+
+	test_deferred(pop);
+	test_tx(pop);
+	test_full(pop);
+
+	pmemobj_close(pop);
+
+	/* the object still waiting is freed on open */
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open");
+
+	UT_OUT("reopen: objects %u", count_objs(pop));
+
+	PMEMoid oid;
+	alloc_objs(pop, &oid, 1);
+	pmemobj_close(pop);
+
+	pop = pmemobj_open_rdonly(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open_rdonly");
+
+	errno = 0;
+	UT_ASSERTne(pmemobj_retire(pop, oid), 0);
+	UT_ASSERTeq(errno, EROFS);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -202,6 +202,35 @@ do_free_type_sec(int n)
 
 fn_op do_free[] = {do_free_type, do_free_type_sec};
 
+/*
+ * do_free_all_type -- remove and free all elements from type collection
+ */
+static void
+do_free_all_type()
+{
+	TOID(struct type) item, next;
+	POBJ_FOREACH_SAFE_TYPE(pop, item, next) {
+		UT_OUT("free id = %d", D_RO(item)->id);
+		POBJ_FREE(&item);
+	}
+}
+
+/*
+ * do_free_all_type_sec -- remove and free all elements from type_sec
+ * collection
+ */
+static void
+do_free_all_type_sec()
+{
+	TOID(struct type_sec) item, next;
+	POBJ_FOREACH_SAFE_TYPE(pop, item, next) {
+		UT_OUT("free id = %d", D_RO(item)->id);
+		POBJ_FREE(&item);
+	}
+}
+
+fn_void do_free_all[] = {do_free_all_type, do_free_all_type_sec};
+
 /*
  * do_first_type -- prints id of first object in type collection
  */
@@ -316,6 +345,9 @@ main(int argc, char *argv[])
 		case 'r':
 			do_free[list_num](id);
 			break;
+		case 'R':
+			do_free_all[list_num]();
+			break;
 		case 'f':
 			do_first[list_num]();
 			break;
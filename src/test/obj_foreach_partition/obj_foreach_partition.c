@@ -0,0 +1,207 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_foreach_partition.c -- unit test for pmemobj_foreach_partition
+ */
+
+#include "libpmemobj.h"
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_foreach_partition"
+
+#define NOBJS 300
+#define MAX_PARTITIONS 64
+
+/* sizes of the allocated objects, the last one is allocated from chunks */
+static const size_t Sizes[] = {64, 1000, 300 * 1024};
+
+struct object {
+	unsigned id;
+};
+
+struct partition {
+	PMEMobjpool *pop;
+	unsigned npartitions;
+	unsigned partition;
+	unsigned *seen;
+	uint64_t last_off;
+	int ret;
+};
+
+/*
+ * object_constr -- sets the id of the new object
+ */
+static int
+object_constr(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct object *obj = ptr;
+	obj->id = *(unsigned *)arg;
+	pmemobj_persist(pop, obj, sizeof(*obj));
+
+	return 0;
+}
+
+/*
+ * visit_cb -- marks the object as seen, checks that the objects of
+ * the partition come in the order of their offsets
+ */
+static int
+visit_cb(PMEMoid oid, void *arg)
+{
+	struct partition *p = arg;
+	struct object *obj = pmemobj_direct(oid);
+
+	UT_ASSERT(obj->id < NOBJS);
+	UT_ASSERT(oid.off > p->last_off);
+	p->last_off = oid.off;
+
+	__sync_fetch_and_add(&p->seen[obj->id], 1);
+
+	return 0;
+}
+
+/*
+ * stop_cb -- terminates the iteration at the first object
+ */
+static int
+stop_cb(PMEMoid oid, void *arg)
+{
+	(*(unsigned *)arg)++;
+
+	return 7;
+}
+
+/*
+ * worker -- iterates through one partition of the pool
+ */
+static void *
+worker(void *arg)
+{
+	struct partition *p = arg;
+
+	p->ret = pmemobj_foreach_partition(p->pop, p->npartitions,
+		p->partition, visit_cb, p);
+
+	return NULL;
+}
+
+/*
+ * test_partitions -- iterates through all the partitions concurrently and
+ * verifies that each object was visited exactly once
+ */
+static void
+test_partitions(PMEMobjpool *pop, unsigned npartitions, unsigned nobjs)
+{
+	static unsigned seen[NOBJS];
+	memset(seen, 0, sizeof(seen));
+
+	struct partition p[MAX_PARTITIONS];
+	pthread_t threads[MAX_PARTITIONS];
+
+	for (unsigned i = 0; i < npartitions; ++i) {
+		p[i].pop = pop;
+		p[i].npartitions = npartitions;
+		p[i].partition = i;
+		p[i].seen = seen;
+		p[i].last_off = 0;
+		PTHREAD_CREATE(&threads[i], NULL, worker, &p[i]);
+	}
+
+	for (unsigned i = 0; i < npartitions; ++i) {
+		PTHREAD_JOIN(threads[i], NULL);
+		UT_ASSERTeq(p[i].ret, 0);
+	}
+
+	unsigned nseen = 0;
+	for (unsigned id = 0; id < NOBJS; ++id) {
+		UT_ASSERT(seen[id] <= 1);
+		nseen += seen[id];
+	}
+	UT_ASSERTeq(nseen, nobjs);
+
+	UT_OUT("partitions %u objects %u", npartitions, nseen);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_foreach_partition");
+
+	if (argc < 3)
+		UT_FATAL("usage: %s file-name npartitions...", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+		PMEMOBJ_MIN_POOL * 16, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	/* the root object is internal, it's never visited */
+	UT_ASSERT(!OID_IS_NULL(pmemobj_root(pop, sizeof(struct object))));
+
+	PMEMoid oids[NOBJS];
+	for (unsigned id = 0; id < NOBJS; ++id) {
+		size_t size = Sizes[id % (sizeof(Sizes) / sizeof(Sizes[0]))];
+		int ret = pmemobj_alloc(pop, &oids[id], size, 0,
+			object_constr, &id);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	unsigned nobjs = NOBJS;
+
+	/* free every fourth object, to leave holes in the runs and chunks */
+	for (unsigned id = 0; id < NOBJS; id += 4) {
+		pmemobj_free(&oids[id]);
+		nobjs--;
+	}
+
+	for (int i = 2; i < argc; ++i) {
+		int npartitions = atoi(argv[i]);
+		UT_ASSERT(npartitions > 0 && npartitions <= MAX_PARTITIONS);
+		test_partitions(pop, (unsigned)npartitions, nobjs);
+	}
+
+	/* a non-zero value of the callback stops the iteration */
+	unsigned calls = 0;
+	UT_ASSERTeq(pmemobj_foreach_partition(pop, 1, 0, stop_cb, &calls), 7);
+	UT_ASSERTeq(calls, 1);
+
+	UT_ASSERTeq(pmemobj_foreach_partition(pop, 2, 2, stop_cb, &calls), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemobj_foreach_partition(pop, 0, 0, stop_cb, &calls), -1);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(calls, 1);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
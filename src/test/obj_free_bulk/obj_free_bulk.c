@@ -0,0 +1,272 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_free_bulk.c -- unit test for pmemobj_free_type and pmemobj_free_select
+ */
+
+#include "libpmemobj.h"
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_free_bulk"
+
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 16)
+
+/* objects of these types are interleaved in the same runs */
+#define TYPE_SMALL 1
+#define TYPE_MEDIUM 2
+#define TYPE_KEEP 3
+#define TYPE_HUGE 4
+#define TYPE_CHUNK 5
+
+#define NSMALL 6000
+#define NHUGE 8
+
+#define SMALL_SIZE 64
+#define MEDIUM_SIZE 1000
+#define HUGE_SIZE (300 * 1024)
+#define CHUNK_SIZE (200 * 1024)
+
+struct object {
+	unsigned id;
+	unsigned check;
+};
+
+/*
+ * object_constr -- sets the id of the new object
+ */
+static int
+object_constr(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct object *obj = ptr;
+	obj->id = *(unsigned *)arg;
+	obj->check = ~obj->id;
+	pmemobj_persist(pop, obj, sizeof(*obj));
+
+	return 0;
+}
+
+/*
+ * alloc_object -- allocates an object of the type with the given id
+ */
+static void
+alloc_object(PMEMobjpool *pop, size_t size, uint64_t type_num, unsigned id)
+{
+	int ret = pmemobj_alloc(pop, NULL, size, type_num, object_constr, &id);
+	UT_ASSERTeq(ret, 0);
+}
+
+/*
+ * count_objects -- returns the number of objects of the type and verifies
+ *	their contents
+ */
+static unsigned
+count_objects(PMEMobjpool *pop, uint64_t type_num)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) != type_num)
+			continue;
+
+		struct object *obj = pmemobj_direct(oid);
+		UT_ASSERTeq(obj->check, ~obj->id);
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * count_chunks -- returns the number of chunk-sized objects that can be
+ *	allocated, and frees them all at once
+ */
+static unsigned
+count_chunks(PMEMobjpool *pop)
+{
+	unsigned n = 0;
+	while (pmemobj_alloc(pop, NULL, CHUNK_SIZE, TYPE_CHUNK,
+			object_constr, &n) == 0)
+		n++;
+
+	UT_ASSERTeq(pmemobj_free_type(pop, TYPE_CHUNK), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_CHUNK), 0);
+
+	return n;
+}
+
+/*
+ * select_odd_cb -- selects the medium objects with odd ids and all of
+ *	the huge ones
+ */
+static int
+select_odd_cb(PMEMoid oid, void *arg)
+{
+	(*(unsigned *)arg)++;
+
+	struct object *obj = pmemobj_direct(oid);
+	uint64_t type_num = pmemobj_type_num(oid);
+
+	return type_num == TYPE_HUGE ||
+		(type_num == TYPE_MEDIUM && obj->id % 2 == 1);
+}
+
+/*
+ * select_all_cb -- selects every object
+ */
+static int
+select_all_cb(PMEMoid oid, void *arg)
+{
+	return 1;
+}
+
+/*
+ * test_free_type -- frees the small objects, which share the runs with
+ *	the objects that are kept
+ */
+static void
+test_free_type(PMEMobjpool *pop)
+{
+	UT_ASSERTeq(pmemobj_free_type(pop, TYPE_SMALL), 0);
+
+	UT_ASSERTeq(count_objects(pop, TYPE_SMALL), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_MEDIUM), NSMALL / 4);
+	UT_ASSERTeq(count_objects(pop, TYPE_KEEP), NSMALL / 4);
+	UT_ASSERTeq(count_objects(pop, TYPE_HUGE), NHUGE);
+
+	/* there's nothing left to free */
+	UT_ASSERTeq(pmemobj_free_type(pop, TYPE_SMALL), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_KEEP), NSMALL / 4);
+}
+
+/*
+ * test_free_select -- frees the objects chosen by the callback
+ */
+static void
+test_free_select(PMEMobjpool *pop)
+{
+	unsigned calls = 0;
+	UT_ASSERTeq(pmemobj_free_select(pop, select_odd_cb, &calls), 0);
+
+	/* the root object is internal, it's never selected */
+	UT_ASSERTeq(calls, NSMALL / 4 * 2 + NHUGE);
+
+	UT_ASSERTeq(count_objects(pop, TYPE_MEDIUM), NSMALL / 8);
+	UT_ASSERTeq(count_objects(pop, TYPE_KEEP), NSMALL / 4);
+	UT_ASSERTeq(count_objects(pop, TYPE_HUGE), 0);
+
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) == TYPE_MEDIUM) {
+			struct object *obj = pmemobj_direct(oid);
+			UT_ASSERTeq(obj->id % 2, 0);
+		}
+	}
+}
+
+/*
+ * test_tx -- bulk free is not allowed inside of a transaction
+ */
+static void
+test_tx(PMEMobjpool *pop)
+{
+	TX_BEGIN(pop) {
+		UT_ASSERTeq(pmemobj_free_type(pop, TYPE_KEEP), -1);
+		UT_ASSERTeq(errno, EINVAL);
+		UT_ASSERTeq(pmemobj_free_select(pop, select_all_cb, NULL), -1);
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+
+	UT_ASSERTeq(count_objects(pop, TYPE_KEEP), NSMALL / 4);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_free_bulk");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+		POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	UT_ASSERT(!OID_IS_NULL(pmemobj_root(pop, sizeof(struct object))));
+
+	/* allocates the redo log extension of the lane, which is kept */
+	UT_ASSERTeq(pmemobj_free_type(pop, TYPE_CHUNK), 0);
+
+	/* frees the chunks by the type, leaving the heap as it was */
+	unsigned nchunks = count_chunks(pop);
+	UT_ASSERT(nchunks > NHUGE);
+	UT_ASSERTeq(count_chunks(pop), nchunks);
+
+	for (unsigned id = 0; id < NSMALL; ++id) {
+		alloc_object(pop, SMALL_SIZE, TYPE_SMALL, id);
+
+		if (id % 4 == 0)
+			alloc_object(pop, MEDIUM_SIZE, TYPE_MEDIUM, id / 4);
+		else if (id % 4 == 2)
+			alloc_object(pop, SMALL_SIZE, TYPE_KEEP, id);
+	}
+	for (unsigned id = 0; id < NHUGE; ++id)
+		alloc_object(pop, HUGE_SIZE, TYPE_HUGE, id);
+
+	test_tx(pop);
+	test_free_type(pop);
+	test_free_select(pop);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(argv[1], LAYOUT_NAME), 1);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	UT_ASSERTeq(count_objects(pop, TYPE_SMALL), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_MEDIUM), NSMALL / 8);
+	UT_ASSERTeq(count_objects(pop, TYPE_KEEP), NSMALL / 4);
+	UT_ASSERTeq(count_objects(pop, TYPE_HUGE), 0);
+
+	/* the emptied runs are turned back into chunks */
+	UT_ASSERTeq(pmemobj_free_select(pop, select_all_cb, NULL), 0);
+	UT_ASSERTeq(count_chunks(pop), nchunks);
+
+	pmemobj_close(pop);
+
+	UT_ASSERTeq(pmemobj_check(argv[1], LAYOUT_NAME), 1);
+
+	DONE(NULL);
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_hashmap_tx_mt.c -- unit test for the hashmap_tx example modified by
+ *	many threads while it is being resized
+ *
+ * usage: obj_hashmap_tx_mt file-name
+ *
+ * The threads insert and then remove their own ranges of keys. The map grows
+ * and shrinks on the way, so the operations keep running while the buckets
+ * are being moved between the arrays, and another thread rebuilds the map on
+ * top of that. Every key must be found exactly once until it's removed.
+ */
+
+#include "unittest.h"
+#include "hashmap_tx.h"
+
+#define LAYOUT "hashmap_tx_mt"
+#define NTHREADS 4
+#define NKEYS 1024 /* number of keys of every thread */
+
+/* sizes the map is alternately rebuilt to */
+#define REBUILD_SMALL 128
+#define REBUILD_LARGE 4096
+
+TOID_DECLARE_ROOT(struct root);
+
+struct root {
+	TOID(struct hashmap_tx) map;
+};
+
+static PMEMobjpool *Pop;
+static TOID(struct hashmap_tx) Map;
+static int Stop;
+
+/*
+ * key_of -- (internal) returns the i-th key of the thread
+ */
+static uint64_t
+key_of(unsigned t, unsigned i)
+{
+	return (uint64_t)t * NKEYS + i + 1;
+}
+
+/*
+ * value_of -- (internal) returns the value stored under the key
+ */
+static PMEMoid
+value_of(uint64_t key)
+{
+	PMEMoid value = {0, key};
+	return value;
+}
+
+/*
+ * inserter -- (internal) inserts the keys of the thread
+ */
+static void *
+inserter(void *arg)
+{
+	unsigned t = (unsigned)(uintptr_t)arg;
+
+	for (unsigned i = 0; i < NKEYS; ++i) {
+		uint64_t key = key_of(t, i);
+		UT_ASSERTeq(hm_tx_insert(Pop, Map, key, value_of(key)), 0);
+		UT_ASSERTeq(hm_tx_insert(Pop, Map, key, value_of(key)), 1);
+		UT_ASSERT(hm_tx_lookup(Pop, Map, key));
+
+		/* the keys inserted before must survive the resizes */
+		uint64_t old = key_of(t, i / 2);
+		UT_ASSERTeq(hm_tx_get(Pop, Map, old).off, old);
+	}
+
+	return NULL;
+}
+
+/*
+ * remover -- (internal) removes the keys of the thread
+ */
+static void *
+remover(void *arg)
+{
+	unsigned t = (unsigned)(uintptr_t)arg;
+	uint64_t last = key_of(t, NKEYS - 1);
+
+	for (unsigned i = 0; i < NKEYS; ++i) {
+		uint64_t key = key_of(t, i);
+		UT_ASSERTeq(hm_tx_remove(Pop, Map, key).off, key);
+		UT_ASSERT(OID_IS_NULL(hm_tx_remove(Pop, Map, key)));
+		UT_ASSERT(!hm_tx_lookup(Pop, Map, key));
+
+		/* the keys not removed yet must survive the resizes */
+		if (key != last)
+			UT_ASSERTeq(hm_tx_get(Pop, Map, last).off, last);
+	}
+
+	return NULL;
+}
+
+/*
+ * run_threads -- (internal) runs the function in all the threads
+ */
+static void
+run_threads(void *(*func)(void *))
+{
+	pthread_t threads[NTHREADS];
+	for (unsigned t = 0; t < NTHREADS; ++t)
+		PTHREAD_CREATE(&threads[t], NULL, func,
+				(void *)(uintptr_t)t);
+
+	for (unsigned t = 0; t < NTHREADS; ++t)
+		PTHREAD_JOIN(threads[t], NULL);
+}
+
+/*
+ * rebuilder -- (internal) rebuilds the map until stopped
+ */
+static void *
+rebuilder(void *arg)
+{
+	uint64_t len = REBUILD_SMALL;
+
+	while (!Stop) {
+		UT_ASSERTeq(hm_tx_cmd(Pop, Map, HASHMAP_CMD_REBUILD, len), 0);
+		len = len == REBUILD_SMALL ? REBUILD_LARGE : REBUILD_SMALL;
+		sched_yield();
+	}
+
+	return NULL;
+}
+
+/*
+ * count_cb -- (internal) counts the keys of every thread
+ */
+static int
+count_cb(uint64_t key, PMEMoid value, void *arg)
+{
+	unsigned *counts = arg;
+
+	UT_ASSERTeq(value.off, key);
+	UT_ASSERT(key > 0 && key <= (uint64_t)NTHREADS * NKEYS);
+	counts[key - 1]++;
+
+	return 0;
+}
+
+/*
+ * check_map -- (internal) checks that every key of the threads is in the map
+ *	exactly once if present is set, and that there are none otherwise
+ */
+static void
+check_map(int present)
+{
+	static unsigned counts[NTHREADS * NKEYS];
+
+	memset(counts, 0, sizeof(counts));
+	UT_ASSERTeq(hm_tx_foreach(Pop, Map, count_cb, counts), 0);
+
+	for (unsigned i = 0; i < NTHREADS * NKEYS; ++i)
+		UT_ASSERTeq(counts[i], (unsigned)present);
+
+	UT_ASSERTeq(hm_tx_count(Pop, Map),
+			present ? (size_t)NTHREADS * NKEYS : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_hashmap_tx_mt");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, 4 * PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	TOID(struct root) root = POBJ_ROOT(Pop, struct root);
+	struct hashmap_args args = {0};
+	UT_ASSERTeq(hm_tx_new(Pop, &D_RW(root)->map, &args), 0);
+	pmemobj_persist(Pop, &D_RW(root)->map, sizeof(D_RW(root)->map));
+
+	Map = D_RO(root)->map;
+	UT_ASSERTeq(hm_tx_init(Pop, Map), 0);
+
+	pthread_t rebuild;
+	PTHREAD_CREATE(&rebuild, NULL, rebuilder, NULL);
+
+	run_threads(inserter);
+	check_map(1);
+
+	run_threads(remover);
+
+	Stop = 1;
+	PTHREAD_JOIN(rebuild, NULL);
+
+	check_map(0);
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
@@ -82,7 +82,8 @@ test_heap()
 
 	UT_ASSERT(heap_check(heap_start, heap_size) != 0);
 	UT_ASSERT(heap_init(heap_start, heap_size, p_ops) == 0);
-	UT_ASSERT(heap_boot(heap, heap_start, heap_size, pop, p_ops) == 0);
+	UT_ASSERT(heap_boot(heap, heap_start, heap_size, pop->run_id, pop,
+		p_ops) == 0);
 	UT_ASSERT(pop->heap.rt != NULL);
 
 	struct bucket *b_small = heap_get_best_bucket(heap, 1);
@@ -142,12 +143,60 @@ test_heap()
 	Free(mpop);
 }
 
+/*
+ * test_heap_lazy_zones -- verifies that the zone headers left over in the
+ *	memory are ignored until the zones are initialized
+ */
+static void
+test_heap_lazy_zones()
+{
+	struct mock_pop *mpop = Malloc(MOCK_POOL_SIZE);
+	PMEMobjpool *pop = &mpop->p;
+	memset(pop, 0, MOCK_POOL_SIZE);
+	pop->size = MOCK_POOL_SIZE;
+	pop->heap_size = MOCK_POOL_SIZE - sizeof(PMEMobjpool);
+	pop->heap_offset = (uint64_t)((uint64_t)&mpop->heap - (uint64_t)mpop);
+	pop->p_ops.persist = obj_heap_persist;
+	pop->p_ops.memset_persist = obj_heap_memset_persist;
+	pop->p_ops.base = pop;
+	pop->p_ops.pool_size = pop->size;
+
+	void *heap_start = (char *)pop + pop->heap_offset;
+	uint64_t heap_size = pop->heap_size;
+	struct palloc_heap *heap = &pop->heap;
+	struct heap_layout *layout = heap_start;
+
+	/* garbage which looks like an initialized zone */
+	memset(&layout->zone0, 0xc5, sizeof(struct zone));
+	layout->zone0.header.magic = ZONE_HEADER_MAGIC;
+
+	UT_ASSERT(heap_init(heap_start, heap_size, &pop->p_ops) == 0);
+	UT_ASSERTeq(layout->zone0.header.zones_valid, 1);
+	UT_ASSERT(heap_check(heap_start, heap_size) == 0);
+
+	UT_ASSERT(heap_boot(heap, heap_start, heap_size, pop->run_id, pop,
+		&pop->p_ops) == 0);
+	UT_ASSERTeq(layout->zone0.header.zones_valid, 2);
+	UT_ASSERTeq(layout->zone0.header.magic, ZONE_HEADER_MAGIC);
+	UT_ASSERTne(layout->zone0.chunk_headers[0].type, 0xc5c5);
+	UT_ASSERT(heap_check(heap_start, heap_size) == 0);
+
+	heap_cleanup(heap);
+
+	/* a high-water mark past the last zone is invalid */
+	layout->zone0.header.zones_valid = 3;
+	UT_ASSERT(heap_check(heap_start, heap_size) != 0);
+
+	Free(mpop);
+}
+
 int
 main(int argc, char *argv[])
 {
 	START(argc, argv, "obj_heap");
 
 	test_heap();
+	test_heap_lazy_zones();
 
 	DONE(NULL);
 }
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_heap_stats.c -- unit test for pmemobj_heap_stats
+ *
+ * usage: obj_heap_stats file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_heap_stats"
+#define CHUNK_SIZE (256 * 1024)
+#define UNIT_SIZE 128
+#define MAX_CLASSES 255
+
+static struct pobj_alloc_class_stats Classes[MAX_CLASSES];
+
+/*
+ * get_stats -- returns the statistics of the heap and of the given class
+ */
+static void
+get_stats(PMEMobjpool *pop, unsigned class_id, struct pobj_heap_stats *hs,
+	struct pobj_alloc_class_stats *cs)
+{
+	int ret = pmemobj_heap_stats(pop, hs, Classes, MAX_CLASSES);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERT(hs->nclasses <= MAX_CLASSES);
+	UT_ASSERTeq(hs->free_total, hs->free_huge + hs->free_runs);
+	UT_ASSERT(hs->free_huge_largest <= hs->free_huge);
+	UT_ASSERTeq(hs->free_huge % CHUNK_SIZE, 0);
+	UT_ASSERT(hs->nzones_populated <= hs->nzones);
+
+	uint64_t free_runs = 0;
+	for (unsigned i = 0; i < hs->nclasses; ++i) {
+		free_runs += Classes[i].free_units * Classes[i].unit_size;
+		if (Classes[i].class_id == class_id)
+			*cs = Classes[i];
+	}
+	UT_ASSERTeq(free_runs, hs->free_runs);
+	UT_ASSERTeq(cs->class_id, class_id);
+}
+
+/*
+ * occupied_runs -- returns the number of runs in the occupancy histogram
+ */
+static uint64_t
+occupied_runs(struct pobj_alloc_class_stats *cs)
+{
+	uint64_t n = 0;
+	for (unsigned i = 0; i < POBJ_RUN_OCCUPANCY_BINS; ++i)
+		n += cs->run_occupancy[i];
+
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_heap_stats");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	struct pobj_heap_stats hs;
+	int ret = pmemobj_heap_stats(pop, &hs, NULL, 1);
+	UT_ASSERTeq(ret, -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	ret = pmemobj_heap_stats(pop, &hs, NULL, 0);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTne(hs.nclasses, 0);
+	UT_ASSERTeq(hs.nzones, 1);
+	UT_ASSERTne(hs.heap_size, 0);
+
+	/* every object of a compact class occupies exactly one unit */
+	struct pobj_alloc_class_desc desc;
+	desc.unit_size = UNIT_SIZE;
+	desc.units_per_block = 1;
+	desc.type = POBJ_CLASS_RUN;
+	desc.header_type = POBJ_HEADER_COMPACT;
+	ret = pmemobj_alloc_class_register(pop, &desc);
+	UT_ASSERTeq(ret, 0);
+
+	struct pobj_alloc_class_stats cs;
+	get_stats(pop, desc.class_id, &hs, &cs);
+	UT_ASSERTeq(cs.unit_size, UNIT_SIZE);
+	UT_ASSERTeq(cs.nruns, 0);
+	UT_ASSERTeq(cs.free_units, 0);
+	UT_ASSERTeq(occupied_runs(&cs), 0);
+	uint64_t free_huge = hs.free_huge;
+
+	PMEMoid oid;
+	ret = pmemobj_xalloc(pop, &oid, 64, 0, POBJ_CLASS_ID(desc.class_id),
+		NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	/* a new run is created out of a free chunk */
+	get_stats(pop, desc.class_id, &hs, &cs);
+	UT_ASSERTeq(cs.nruns, 1);
+	UT_ASSERTeq(cs.nruns_unloaded, 0);
+	UT_ASSERTne(cs.free_units, 0);
+	UT_ASSERTeq(cs.free_blocks, (cs.free_units + 1 + 63) / 64);
+	UT_ASSERTeq(cs.run_occupancy[0], 1);
+	UT_ASSERTeq(occupied_runs(&cs), 1);
+	UT_ASSERTeq(hs.free_huge, free_huge - CHUNK_SIZE);
+
+	/*
+	 * Fill up the run, the units cached by the lane are taken out of the
+	 * bucket so the number of the objects is not known upfront.
+	 */
+	size_t nobjs = cs.free_units * 2;
+	PMEMoid *oids = MALLOC(sizeof(*oids) * nobjs);
+	oids[0] = oid;
+	size_t n = 1;
+	while (cs.free_units != 0) {
+		UT_ASSERT(n < nobjs);
+		ret = pmemobj_xalloc(pop, &oids[n++], 64, 0,
+			POBJ_CLASS_ID(desc.class_id), NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+
+		uint64_t free_units = cs.free_units;
+		get_stats(pop, desc.class_id, &hs, &cs);
+		UT_ASSERTeq(cs.nruns, 1);
+		UT_ASSERT(cs.free_units <= free_units);
+		UT_ASSERTeq(occupied_runs(&cs), 1);
+	}
+
+	UT_ASSERTeq(cs.free_blocks, 0);
+	UT_ASSERTeq(cs.run_occupancy[POBJ_RUN_OCCUPANCY_BINS - 1], 1);
+
+	/* the freed units go back to the bucket */
+	for (size_t i = 0; i < n; ++i)
+		pmemobj_free(&oids[i]);
+
+	/*
+	 * The run is not turned back into a chunk while some of its units are
+	 * still cached by the lane.
+	 */
+	get_stats(pop, desc.class_id, &hs, &cs);
+	UT_ASSERTeq(cs.nruns, 1);
+	UT_ASSERTne(cs.free_units, 0);
+	UT_ASSERTeq(cs.run_occupancy[0], 1);
+	UT_ASSERTeq(occupied_runs(&cs), 1);
+
+	FREE(oids);
+
+	/* a huge object takes chunks away from the largest free range */
+	free_huge = hs.free_huge;
+	uint64_t largest = hs.free_huge_largest;
+	ret = pmemobj_xalloc(pop, &oid, 2 * CHUNK_SIZE, 0, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	get_stats(pop, desc.class_id, &hs, &cs);
+	UT_ASSERTeq(hs.free_huge_largest, largest - 3 * CHUNK_SIZE);
+	UT_ASSERTeq(hs.free_huge, free_huge - 3 * CHUNK_SIZE);
+
+	pmemobj_free(&oid);
+
+	get_stats(pop, desc.class_id, &hs, &cs);
+	UT_ASSERTeq(hs.free_huge_largest, largest);
+	UT_OUT("free huge %s", hs.free_huge == hs.free_huge_largest ?
+		"contiguous" : "fragmented");
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_heap_summary.c -- unit test for the free space summary of the heap
+ *
+ * usage: obj_heap_summary file
+ *
+ * The summary is written when the pool is closed, kept by a read-only open
+ * and invalidated as soon as the pool is opened for writing. It's also not
+ * trusted after the pool was opened by a version of the library which doesn't
+ * know the summary.
+ */
+
+#include "heap_layout.h"
+#include "obj.h"
+#include "unittest.h"
+
+#define LAYOUT "summary"
+#define NOBJS 100
+#define SMALL_SIZE 128
+#define HUGE_SIZE (1 << 20)
+
+/*
+ * zone0_header -- (internal) returns the header of the first zone of the pool
+ */
+static struct zone_header *
+zone0_header(PMEMobjpool *pop)
+{
+	struct heap_layout *layout =
+		(void *)((char *)pop + pop->heap_offset);
+
+	return &layout->zone0.header;
+}
+
+/*
+ * old_writer_open -- (internal) does what an open for writing by a version of
+ *	the library without the summary support does to the pool, and corrupts
+ *	a chunk header, as if it was left that way by that version
+ */
+static void
+old_writer_open(const char *path)
+{
+	size_t mapped_len;
+	int is_pmem;
+	PMEMobjpool *pop = pmem_map_file(path, 0, 0, 0, &mapped_len,
+			&is_pmem);
+	if (pop == NULL)
+		UT_FATAL("!pmem_map_file: %s", path);
+
+	pop->run_id += 2;
+	pmem_msync(&pop->run_id, sizeof(pop->run_id));
+
+	struct heap_layout *layout =
+		(void *)((char *)pop + pop->heap_offset);
+	layout->zone0.chunk_headers[0].type = MAX_CHUNK_TYPE;
+	pmem_msync(&layout->zone0.chunk_headers[0],
+			sizeof(layout->zone0.chunk_headers[0]));
+
+	pmem_unmap(pop, mapped_len);
+}
+
+/*
+ * check_summary -- (internal) checks that the pool has a valid summary
+ *	newer than the given generation and returns its generation
+ */
+static uint64_t
+check_summary(const char *path, uint64_t prev_gen)
+{
+	PMEMobjpool *pop = pmemobj_open_rdonly(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open_rdonly: %s", path);
+
+	struct zone_header *zh = zone0_header(pop);
+	UT_ASSERTne(zh->summary_gen, 0);
+	UT_ASSERT(zh->summary_gen > prev_gen);
+	UT_ASSERTeq(zh->summary_gen, zh->summary_seq);
+	UT_ASSERTeq(zh->zone_gen, zh->summary_gen);
+	UT_ASSERTne(zh->free_chunks, 0);
+	UT_ASSERTne(zh->free_runs, 0);
+
+	uint64_t gen = zh->summary_gen;
+
+	pmemobj_close(pop);
+
+	return gen;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_heap_summary");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	PMEMoid oids[NOBJS];
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_alloc(pop, &oids[i], SMALL_SIZE, 0,
+				NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	PMEMoid huge;
+	int ret = pmemobj_alloc(pop, &huge, HUGE_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	pmemobj_close(pop);
+
+	uint64_t gen = check_summary(path, 0);
+
+	/* the read-only open doesn't invalidate the summary */
+	uint64_t gen_rdonly = check_summary(path, gen - 1);
+	UT_ASSERTeq(gen_rdonly, gen);
+
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	/* a crash while the pool is open would leave it without a summary */
+	UT_ASSERTeq(zone0_header(pop)->summary_gen, 0);
+	UT_ASSERTeq(zone0_header(pop)->summary_seq, gen);
+
+	for (unsigned i = 0; i < NOBJS; i += 2)
+		pmemobj_free(&oids[i]);
+	pmemobj_free(&huge);
+
+	pmemobj_close(pop);
+
+	gen = check_summary(path, gen);
+	UT_OUT("summary generation %ju", gen);
+
+	/* the stale summary is ignored and the heap is verified */
+	old_writer_open(path);
+	pop = pmemobj_open(path, LAYOUT);
+	UT_ASSERTeq(pop, NULL);
+
+	DONE(NULL);
+}
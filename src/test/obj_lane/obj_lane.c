@@ -183,7 +183,7 @@ test_lane_recovery_check_ok()
 	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
 
 	UT_ASSERTeq(lane_recover_and_section_boot(&pop.p), 0);
-	UT_ASSERTeq(lane_check(&pop.p), 0);
+	UT_ASSERTeq(lane_check(&pop.p, 1), 0);
 }
 
 static void
@@ -201,7 +201,7 @@ test_lane_recovery_check_fail()
 
 	UT_ASSERTne(lane_recover_and_section_boot(&pop.p), 0);
 
-	UT_ASSERTne(lane_check(&pop.p), 0);
+	UT_ASSERTne(lane_check(&pop.p, 1), 0);
 }
 
 ut_jmp_buf_t Jmp;
@@ -265,6 +265,59 @@ test_lane_hold_release()
 	FREE(pop.p.lanes_desc.lane_locks);
 }
 
+#define MOCK_NPOOLS 40
+
+/*
+ * test_lane_hold_many_pools -- holds the lanes of more pools than fit in
+ *	a set of the lane info cache, in an interleaved fashion
+ */
+static void
+test_lane_hold_many_pools(void)
+{
+	struct lane mock_lane = {
+		.sections = {
+			[LANE_SECTION_ALLOCATOR] = {
+				.runtime = MOCK_RUNTIME
+			}
+		}
+	};
+
+	struct mock_pop *pops = MALLOC(sizeof(*pops) * MOCK_NPOOLS);
+	for (int i = 0; i < MOCK_NPOOLS; ++i) {
+		memset(&pops[i], 0, sizeof(pops[i]));
+		pops[i].p.nlanes = 1;
+		/* five pools map to each of the first eight cache sets */
+		pops[i].p.uuid_lo = (uint64_t)(i % 8) | ((uint64_t)i << 32);
+		pops[i].p.lanes_desc.runtime_nlanes = 1;
+		pops[i].p.lanes_desc.lane = &mock_lane;
+		pops[i].p.lanes_desc.lane_locks = CALLOC(1, sizeof(uint64_t));
+	}
+
+	for (int round = 0; round < 2; ++round) {
+		struct lane_section *sec;
+		for (int i = 0; i < MOCK_NPOOLS; ++i) {
+			lane_hold(&pops[i].p, &sec, LANE_SECTION_ALLOCATOR);
+			UT_ASSERTeq(sec->runtime, MOCK_RUNTIME);
+			UT_ASSERTeq(*pops[i].p.lanes_desc.lane_locks, 1);
+		}
+
+		/* nested holds of each pool */
+		for (int i = MOCK_NPOOLS - 1; i >= 0; --i) {
+			lane_hold(&pops[i].p, &sec, LANE_SECTION_ALLOCATOR);
+			lane_release(&pops[i].p);
+		}
+
+		for (int i = 0; i < MOCK_NPOOLS; ++i) {
+			lane_release(&pops[i].p);
+			UT_ASSERTeq(*pops[i].p.lanes_desc.lane_locks, 0);
+		}
+	}
+
+	for (int i = 0; i < MOCK_NPOOLS; ++i)
+		FREE(pops[i].p.lanes_desc.lane_locks);
+	FREE(pops);
+}
+
 static void
 test_lane_sizes(void)
 {
@@ -368,6 +421,86 @@ test_lane_cleanup_in_separate_thread(void)
 	UT_ASSERTeq(pop.p.lanes_desc.lane_locks, NULL);
 }
 
+#define CONTENDED_NLANES 2
+#define CONTENDED_NTHREADS 8
+#define CONTENDED_OPS 10000
+
+static unsigned Lane_holders[CONTENDED_NLANES];
+
+/*
+ * test_lane_hold_thread -- (internal) holds the lanes of the pool over and
+ *	over, checking that no other thread holds the same lane at the same time
+ */
+static void *
+test_lane_hold_thread(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (int i = 0; i < CONTENDED_OPS; ++i) {
+		unsigned idx = lane_hold(pop, NULL, LANE_ID);
+		UT_ASSERT(idx < CONTENDED_NLANES);
+		UT_ASSERTeq(__sync_fetch_and_add(&Lane_holders[idx], 1), 0);
+
+		if (i % 100 == 0)
+			sched_yield();
+
+		UT_ASSERTeq(__sync_fetch_and_sub(&Lane_holders[idx], 1), 1);
+		lane_release(pop);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_lane_hold_contended -- more threads than lanes holding them at once
+ */
+static void
+test_lane_hold_contended(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = MAX_MOCK_LANES,
+			.uuid_lo = 1
+		}
+	};
+	base_ptr = &pop.p;
+
+	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
+
+	lane_info_boot();
+	UT_ASSERTeq(lane_boot(&pop.p), 0);
+	pop.p.lanes_desc.runtime_nlanes = CONTENDED_NLANES;
+
+	pthread_t threads[CONTENDED_NTHREADS];
+	for (int i = 0; i < CONTENDED_NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, test_lane_hold_thread,
+			&pop.p);
+
+	for (int i = 0; i < CONTENDED_NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	UT_ASSERTeq(pop.p.lanes_desc.lane_waiters, 0);
+
+	struct pobj_lane_stats stats;
+	if (getenv(OBJ_LANE_STATS_VAR) != NULL) {
+		UT_ASSERTeq(lane_stats_get(&pop.p, &stats), 0);
+		UT_ASSERTeq(stats.acquisitions,
+			CONTENDED_NTHREADS * CONTENDED_OPS);
+		UT_ASSERT(stats.contended <= stats.acquisitions);
+		UT_ASSERT(stats.waits <= stats.contended);
+
+		uint64_t held = 0;
+		for (int b = 0; b < POBJ_LANE_HOLD_TIME_BUCKETS; ++b)
+			held += stats.hold_time[b];
+		UT_ASSERTeq(held, stats.acquisitions);
+	} else {
+		UT_ASSERTne(lane_stats_get(&pop.p, &stats), 0);
+	}
+
+	lane_cleanup(&pop.p);
+	lane_info_destroy();
+}
+
 static void
 usage(const char *app)
 {
@@ -390,12 +523,15 @@ main(int argc, char *argv[])
 		test_lane_recovery_check_ok();
 		test_lane_recovery_check_fail();
 		test_lane_hold_release();
+		test_lane_hold_many_pools();
 		test_lane_sizes();
 		break;
 	case 'm':
 		/* multithreaded scenarios */
+		lane_stats_init(OBJ_LANE_STATS_VAR);
 		test_lane_info_destroy_in_separate_thread();
 		test_lane_cleanup_in_separate_thread();
+		test_lane_hold_contended();
 		break;
 	default:
 		usage(argv[0]);
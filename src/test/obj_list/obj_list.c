@@ -121,6 +121,8 @@ TOID(struct oob_item) *Item;
 	UT_FATAL("usage: obj_list <file> r:<num>")
 #define FATAL_USAGE_MOVE()\
 	UT_FATAL("usage: obj_list <file> m:<num>:<where>:<num>")
+#define FATAL_USAGE_BATCH()\
+	UT_FATAL("usage: obj_list <file> b:<num>")
 #define FATAL_USAGE_FAIL()\
 	UT_FATAL("usage: obj_list <file> "\
 	"F:<after_finish|before_finish|after_process>")
@@ -854,6 +856,51 @@ do_move_one_list(PMEMobjpool *pop, const char *arg)
 	}
 }
 
+/*
+ * do_batch -- insert new elements to the tail of "in band" list and move
+ * the same number of its first elements to the tail of second "in band" list
+ * in a single batch
+ */
+static void
+do_batch(PMEMobjpool *pop, const char *arg)
+{
+	int n;
+	if (sscanf(arg, "b:%d", &n) != 1 || n <= 0)
+		FATAL_USAGE_BATCH();
+
+	struct pobj_list_op *ops = MALLOC(sizeof(*ops) * 2 * (size_t)n);
+
+	for (int i = 0; i < n; ++i) {
+		PMEMoid it;
+		pmemobj_alloc(pop, &it,
+				sizeof(struct oob_item), 0, NULL, NULL);
+
+		struct pobj_list_op *ins = &ops[2 * i];
+		ins->type = POBJ_LIST_OP_INSERT;
+		ins->pe_offset = offsetof(struct item, next);
+		ins->head = &D_RW(List)->head;
+		ins->dest = OID_NULL;
+		ins->before = POBJ_LIST_DEST_TAIL;
+		ins->oid = it;
+
+		struct pobj_list_op *mov = &ops[2 * i + 1];
+		mov->type = POBJ_LIST_OP_MOVE;
+		mov->pe_offset = offsetof(struct item, next);
+		mov->head = &D_RW(List)->head;
+		mov->pe_new_offset = offsetof(struct item, next);
+		mov->head_new = &D_RW(List_sec)->head;
+		mov->dest = OID_NULL;
+		mov->before = POBJ_LIST_DEST_TAIL;
+		mov->oid = get_item_list(List.oid, i);
+		UT_ASSERT(!OID_IS_NULL(mov->oid));
+	}
+
+	if (list_batch(pop, ops, 2 * (size_t)n))
+		UT_FATAL("list_batch(List, List_sec) failed");
+
+	FREE(ops);
+}
+
 /*
  * do_fail -- fail after specified event
  */
@@ -916,6 +963,9 @@ main(int argc, char *argv[])
 		case 'M':
 			do_move_one_list(pop, argv[i]);
 			break;
+		case 'b':
+			do_batch(pop, argv[i]);
+			break;
 		case 'V':
 			lane_recover_and_section_boot(pop);
 			break;
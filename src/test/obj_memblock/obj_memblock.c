@@ -140,7 +140,9 @@ test_block_offset()
 	UT_ASSERTeq(MEMBLOCK_OPS(, &mhuge)->block_offset(&mhuge, heap, NULL),
 			0);
 
-	void *ptr = (char *)run->data + 300;
+	/* units this small need the bitmap extension in front of the data */
+	UT_ASSERTne(RUN_BITMAP_EXT_SIZE(run->block_size), 0);
+	void *ptr = (char *)RUN_DATA(run) + 300;
 
 	UT_ASSERTeq(MEMBLOCK_OPS(, &mrun)->block_offset(&mrun, heap, ptr), 3);
 }
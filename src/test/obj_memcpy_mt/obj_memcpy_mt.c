@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_memcpy_mt.c -- unit test for multi-threaded pmemobj_memcpy_persist()
+ *
+ * usage: obj_memcpy_mt file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_memcpy_mt"
+#define COPY_AREA_SIZE (8 << 20)
+
+/*
+ * do_memcpy -- copy len bytes at the given offset and verify the data
+ */
+static void
+do_memcpy(PMEMobjpool *pop, char *dest, const char *src, size_t off,
+	size_t len)
+{
+	memset(dest, 0, COPY_AREA_SIZE);
+	pmemobj_persist(pop, dest, COPY_AREA_SIZE);
+
+	void *ret = pmemobj_memcpy_persist(pop, dest + off, src, len);
+	UT_ASSERTeq(ret, dest + off);
+
+	UT_ASSERTeq(memcmp(dest + off, src, len), 0);
+	for (size_t i = 0; i < off; i++)
+		UT_ASSERTeq(dest[i], 0);
+	for (size_t i = off + len; i < COPY_AREA_SIZE; i++)
+		UT_ASSERTeq(dest[i], 0);
+
+	UT_OUT("off %zu len %zu", off, len);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_memcpy_mt");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			4 * COPY_AREA_SIZE, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, COPY_AREA_SIZE);
+	UT_ASSERT(!OID_IS_NULL(root));
+	char *dest = pmemobj_direct(root);
+
+	char *src = MALLOC(COPY_AREA_SIZE);
+	for (size_t i = 0; i < COPY_AREA_SIZE; i++)
+		src[i] = (char)(i % 251 + 1);
+
+	do_memcpy(pop, dest, src, 0, COPY_AREA_SIZE);
+	do_memcpy(pop, dest, src, 100, (3 << 20) + 123);
+	do_memcpy(pop, dest, src, 4096, 4096);
+
+	FREE(src);
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_nopmem_sync.c -- unit test for syncing the ranges flushed to non-pmem
+ *	pools
+ *
+ * usage: obj_nopmem_sync file1 file2
+ *
+ * A thread flushes a range of the first pool without draining it, which is
+ * then closed by another thread. The range has to be synced before the pool
+ * is unmapped, and must not be synced again by the next drain of the thread,
+ * made for the second pool.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "nopmem_sync"
+
+static PMEMobjpool *Pop1;
+static PMEMobjpool *Pop2;
+static pthread_barrier_t Step;
+
+/* the address which is expected to be synced */
+static uintptr_t Target;
+static int Target_synced;
+
+/* the range which must not be synced, and the number of its syncs */
+static uintptr_t Watch_beg;
+static uintptr_t Watch_end;
+static int Watch_syncs;
+
+FUNC_MOCK(pmem_msync, int, void *addr, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		uintptr_t beg = (uintptr_t)addr;
+		uintptr_t end = beg + len;
+
+		if (Target >= beg && Target < end)
+			__sync_fetch_and_add(&Target_synced, 1);
+
+		if (beg < Watch_end && end > Watch_beg)
+			__sync_fetch_and_add(&Watch_syncs, 1);
+
+		return _FUNC_REAL(pmem_msync)(addr, len);
+	}
+FUNC_MOCK_END
+
+/*
+ * step_wait -- (internal) waits for the other thread to finish its step
+ */
+static void
+step_wait(void)
+{
+	int ret = pthread_barrier_wait(&Step);
+	UT_ASSERT(ret == 0 || ret == PTHREAD_BARRIER_SERIAL_THREAD);
+}
+
+/*
+ * worker -- (internal) flushes a range of the first pool, then drains the
+ *	second pool once the first one is closed
+ */
+static void *
+worker(void *arg)
+{
+	uint64_t *val1 = pmemobj_direct(pmemobj_root(Pop1, sizeof(uint64_t)));
+	*val1 = 1;
+	pmemobj_flush(Pop1, val1, sizeof(*val1));
+
+	step_wait();
+	step_wait();
+
+	uint64_t *val2 = pmemobj_direct(pmemobj_root(Pop2, sizeof(uint64_t)));
+	*val2 = 2;
+	pmemobj_flush(Pop2, val2, sizeof(*val2));
+	pmemobj_drain(Pop2);
+
+	step_wait();
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_nopmem_sync");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	Pop1 = pmemobj_create(argv[1], LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop1 == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	Pop2 = pmemobj_create(argv[2], LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop2 == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[2]);
+
+	int ret = pthread_barrier_init(&Step, NULL, 2);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_t thread;
+	PTHREAD_CREATE(&thread, NULL, worker, NULL);
+
+	step_wait();
+
+	/* the range flushed by the worker is synced by the close */
+	Target = (uintptr_t)pmemobj_direct(pmemobj_root(Pop1,
+			sizeof(uint64_t)));
+	Watch_beg = (uintptr_t)Pop1;
+	Watch_end = Watch_beg + PMEMOBJ_MIN_POOL;
+
+	pmemobj_close(Pop1);
+	UT_ASSERTne(Target_synced, 0);
+
+	/* the pool is unmapped, the drain of the worker doesn't touch it */
+	Watch_syncs = 0;
+
+	step_wait();
+	step_wait();
+
+	UT_ASSERTeq(Watch_syncs, 0);
+
+	PTHREAD_JOIN(thread, NULL);
+
+	pthread_barrier_destroy(&Step);
+
+	pmemobj_close(Pop2);
+
+	Pop1 = pmemobj_open(argv[1], LAYOUT);
+	if (Pop1 == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	uint64_t *val1 = pmemobj_direct(pmemobj_root(Pop1, sizeof(uint64_t)));
+	UT_ASSERTeq(*val1, 1);
+
+	pmemobj_close(Pop1);
+
+	DONE(NULL);
+}
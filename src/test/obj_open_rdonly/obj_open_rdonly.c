@@ -0,0 +1,252 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_open_rdonly.c -- unit test for pmemobj_open_rdonly
+ *
+ * usage: obj_open_rdonly file
+ *
+ * The pool is opened read-only while a child process has it open for
+ * writing, the changes the child makes are visible through the read-only
+ * handle and all the modifications through it fail with EROFS.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "rdonly"
+#define NOBJS 10
+#define TYPE_ITEM 1
+
+struct root {
+	uint64_t value;
+};
+
+/*
+ * sync_send -- (internal) sends a byte over the pipe
+ */
+static void
+sync_send(int fd, char c)
+{
+	if (write(fd, &c, 1) != 1)
+		UT_FATAL("!write");
+}
+
+/*
+ * sync_wait -- (internal) waits for the byte from the pipe
+ */
+static void
+sync_wait(int fd, char c)
+{
+	char r;
+	if (read(fd, &r, 1) != 1)
+		UT_FATAL("!read");
+	UT_ASSERTeq(r, c);
+}
+
+/*
+ * pool_create -- (internal) creates the pool with the root and a few objects
+ */
+static void
+pool_create(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create");
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *rootp = pmemobj_direct(root);
+	rootp->value = 1;
+	pmemobj_persist(pop, &rootp->value, sizeof(rootp->value));
+
+	for (uint64_t i = 0; i < NOBJS; ++i) {
+		PMEMoid oid;
+		int ret = pmemobj_alloc(pop, &oid, sizeof(uint64_t),
+				TYPE_ITEM, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+
+		uint64_t *val = pmemobj_direct(oid);
+		*val = i;
+		pmemobj_persist(pop, val, sizeof(*val));
+	}
+
+	pmemobj_close(pop);
+}
+
+/*
+ * writer -- (internal) the child process, keeps the pool open and modifies
+ *	the root object when asked to
+ */
+static void
+writer(const char *path, int in, int out)
+{
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open");
+
+	sync_send(out, 'o');
+
+	sync_wait(in, 'u');
+	struct root *rootp = pmemobj_direct(pmemobj_root(pop,
+			sizeof(struct root)));
+	rootp->value = 2;
+	pmemobj_persist(pop, &rootp->value, sizeof(rootp->value));
+	sync_send(out, 'd');
+
+	sync_wait(in, 'q');
+	pmemobj_close(pop);
+}
+
+/*
+ * reader -- (internal) opens the pool read-only while the writer has it open
+ */
+static void
+reader(const char *path, int in, int out)
+{
+	sync_wait(in, 'o');
+
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	UT_ASSERTeq(pop, NULL);
+	UT_ASSERTeq(errno, EWOULDBLOCK);
+
+	pop = pmemobj_open_rdonly(path, "wrong");
+	UT_ASSERTeq(pop, NULL);
+
+	pop = pmemobj_open_rdonly(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open_rdonly");
+
+	UT_ASSERTeq(pmemobj_root_size(pop), sizeof(struct root));
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *rootp = pmemobj_direct(root);
+	UT_ASSERTne(rootp, NULL);
+	UT_OUT("root value %ju", rootp->value);
+
+	uint64_t nobjs = 0;
+	uint64_t sum = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		UT_ASSERTeq(pmemobj_type_num(oid), TYPE_ITEM);
+		sum += *(uint64_t *)pmemobj_direct(oid);
+		nobjs++;
+	}
+	UT_OUT("objects %ju sum %ju", nobjs, sum);
+
+	nobjs = 0;
+	for (oid = pmemobj_first_type(pop, TYPE_ITEM); !OID_IS_NULL(oid);
+			oid = pmemobj_next_type(oid))
+		nobjs++;
+	UT_ASSERTeq(nobjs, NOBJS);
+
+	/* none of the modifications are allowed */
+	errno = 0;
+	UT_ASSERT(OID_IS_NULL(pmemobj_root(pop, 2 * sizeof(struct root))));
+	UT_ASSERTeq(errno, EROFS);
+
+	errno = 0;
+	UT_ASSERTne(pmemobj_alloc(pop, &oid, 64, TYPE_ITEM, NULL, NULL), 0);
+	UT_ASSERTeq(errno, EROFS);
+
+	errno = 0;
+	UT_ASSERTne(pmemobj_realloc(pop, &root, 64, 0), 0);
+	UT_ASSERTeq(errno, EROFS);
+
+	struct pobj_action act;
+	errno = 0;
+	UT_ASSERT(OID_IS_NULL(pmemobj_reserve(pop, &act, 64, TYPE_ITEM)));
+	UT_ASSERTeq(errno, EROFS);
+
+	int aborted = 0;
+	TX_BEGIN(pop) {
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		aborted = 1;
+	} TX_END
+	UT_ASSERTeq(aborted, 1);
+	UT_ASSERTeq(errno, EROFS);
+
+	/* the changes of the writer are visible */
+	sync_send(out, 'u');
+	sync_wait(in, 'd');
+	UT_OUT("root value %ju", rootp->value);
+
+	pmemobj_close(pop);
+
+	sync_send(out, 'q');
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_open_rdonly");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	pool_create(path);
+
+	int to_writer[2];
+	int to_reader[2];
+	if (pipe(to_writer) || pipe(to_reader))
+		UT_FATAL("!pipe");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		UT_FATAL("!fork");
+
+	if (pid == 0) {
+		writer(path, to_writer[0], to_reader[1]);
+		exit(0);
+	}
+
+	reader(path, to_reader[0], to_writer[1]);
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		UT_FATAL("!waitpid");
+	UT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	for (int i = 0; i < 2; ++i) {
+		CLOSE(to_writer[i]);
+		CLOSE(to_reader[i]);
+	}
+
+	/* with the writer gone, the pool is opened for writing again */
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open");
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
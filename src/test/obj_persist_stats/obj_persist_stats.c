@@ -0,0 +1,207 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_persist_stats.c -- unit test for pmemobj_persist_stats and
+ * pmem_stats_get
+ *
+ * usage: obj_persist_stats file 0|1
+ *
+ * The second argument says whether the statistics are expected to be
+ * enabled by the environment.
+ */
+
+#include "unittest.h"
+
+POBJ_LAYOUT_BEGIN(persist_stats);
+POBJ_LAYOUT_ROOT(persist_stats, struct root);
+POBJ_LAYOUT_TOID(persist_stats, struct item);
+POBJ_LAYOUT_END(persist_stats);
+
+struct item {
+	POBJ_LIST_ENTRY(struct item) next;
+	char data[1024];
+};
+
+struct root {
+	POBJ_LIST_HEAD(items, struct item) head;
+	PMEMoid obj;
+};
+
+static const char *Op_names[POBJ_PERSIST_OPS] = {
+	"alloc", "list", "tx", "other"
+};
+
+static struct pobj_persist_stats Prev[POBJ_PERSIST_OPS];
+
+/*
+ * nlines -- returns the number of cache lines the range spans
+ */
+static uint64_t
+nlines(const void *addr, size_t len)
+{
+	uintptr_t start = (uintptr_t)addr & ~(uintptr_t)63;
+	uintptr_t end = ((uintptr_t)addr + len + 63) & ~(uintptr_t)63;
+
+	return (end - start) / 64;
+}
+
+/*
+ * print_delta -- prints the operation types whose counts changed since
+ *	the previous call
+ */
+static void
+print_delta(PMEMobjpool *pop, const char *step)
+{
+	struct pobj_persist_stats cur[POBJ_PERSIST_OPS];
+	int ret = pmemobj_persist_stats(pop, cur);
+	UT_ASSERTeq(ret, 0);
+
+	char buff[64] = "";
+	for (int op = 0; op < POBJ_PERSIST_OPS; ++op) {
+		UT_ASSERT(cur[op].flushes >= Prev[op].flushes);
+		UT_ASSERT(cur[op].flushed_lines >= cur[op].flushes);
+		UT_ASSERT(cur[op].fences >= Prev[op].fences);
+
+		if (memcmp(&cur[op], &Prev[op], sizeof(cur[op])) != 0) {
+			strcat(buff, " ");
+			strcat(buff, Op_names[op]);
+		}
+	}
+
+	UT_OUT("%s:%s", step, buff);
+	memcpy(Prev, cur, sizeof(cur));
+}
+
+/*
+ * test_obj -- checks the flushes and fences are attributed to the
+ *	operations issuing them
+ */
+static void
+test_obj(PMEMobjpool *pop)
+{
+	print_delta(pop, "create");
+
+	TOID(struct root) root = POBJ_ROOT(pop, struct root);
+	print_delta(pop, "root");
+
+	int ret = pmemobj_alloc(pop, &D_RW(root)->obj, 128, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	print_delta(pop, "alloc");
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range(D_RO(root)->obj, 0, 128);
+		memset(pmemobj_direct(D_RO(root)->obj), 1, 128);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+	print_delta(pop, "tx");
+
+	POBJ_LIST_INSERT_NEW_HEAD(pop, &D_RW(root)->head, next,
+		sizeof(struct item), NULL, NULL);
+	print_delta(pop, "list");
+
+	/* the calls of the application are counted exactly */
+	struct item *item = D_RW(POBJ_LIST_FIRST(&D_RW(root)->head));
+	pmemobj_persist(pop, item->data + 32, 100);
+	pmemobj_memset_persist(pop, item->data, 0, 1000);
+	pmemobj_flush(pop, item->data, 64);
+	pmemobj_drain(pop);
+
+	struct pobj_persist_stats prev = Prev[POBJ_PERSIST_OTHER];
+	print_delta(pop, "user");
+	struct pobj_persist_stats *cur = &Prev[POBJ_PERSIST_OTHER];
+	UT_ASSERTeq(cur->flushes - prev.flushes, 2);
+	UT_ASSERTeq(cur->flushed_lines - prev.flushed_lines,
+		nlines(item->data + 32, 100) + nlines(item->data, 64));
+	UT_ASSERTeq(cur->fences - prev.fences, 3);
+	UT_ASSERTeq(cur->copied_bytes - prev.copied_bytes, 1000);
+}
+
+/*
+ * test_pmem -- checks the libpmem counts
+ */
+static void
+test_pmem(char *addr)
+{
+	struct pmem_stats prev;
+	struct pmem_stats cur;
+
+	int ret = pmem_stats_get(&prev);
+	UT_ASSERTeq(ret, 0);
+
+	/* the range spans three cache lines */
+	char *line = (char *)(((uintptr_t)addr + 63) & ~(uintptr_t)63);
+	pmem_persist(line + 32, 100);
+	pmem_drain();
+
+	ret = pmem_stats_get(&cur);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(cur.flushes - prev.flushes, 1);
+	UT_ASSERTeq(cur.flushed_lines - prev.flushed_lines, 3);
+	UT_ASSERTeq(cur.fences - prev.fences, 2);
+	UT_ASSERTeq(cur.nt_bytes, prev.nt_bytes);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_persist_stats");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file 0|1", argv[0]);
+
+	int enabled = atoi(argv[2]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1],
+		POBJ_LAYOUT_NAME(persist_stats), PMEMOBJ_MIN_POOL, S_IWUSR |
+		S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	if (enabled) {
+		test_obj(pop);
+		test_pmem(pmemobj_direct(POBJ_ROOT(pop, struct root).oid));
+	} else {
+		struct pobj_persist_stats stats[POBJ_PERSIST_OPS];
+		UT_ASSERTeq(pmemobj_persist_stats(pop, stats), -1);
+		UT_ASSERTeq(errno, ENOTSUP);
+
+		struct pmem_stats ps;
+		UT_ASSERTeq(pmem_stats_get(&ps), -1);
+		UT_ASSERTeq(errno, ENOTSUP);
+	}
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -214,8 +214,8 @@ test_mock_pool_allocs()
 	uint64_t heap_size = mock_pop->heap_size;
 
 	heap_init(heap_start, heap_size, &mock_pop->p_ops);
-	heap_boot(&mock_pop->heap, heap_start, heap_size, mock_pop,
-			&mock_pop->p_ops);
+	heap_boot(&mock_pop->heap, heap_start, heap_size, mock_pop->run_id,
+			mock_pop, &mock_pop->p_ops);
 
 	/* initialize runtime lanes structure */
 	mock_pop->lanes_desc.runtime_nlanes = (unsigned)mock_pop->nlanes;
@@ -94,6 +94,7 @@ main(int argc, char *argv[])
 
 	UT_ASSERTeq(pmemobj_pool_by_ptr(NULL), NULL);
 	UT_ASSERTeq(pmemobj_pool_by_ptr((void *)0xCBA), NULL);
+	UT_ASSERT(OID_IS_NULL(pmemobj_oid(NULL)));
 
 	for (int i = 0; i < npools; ++i) {
 		void *before_pool = (char *)pops[i] - 1;
@@ -107,9 +108,18 @@ main(int argc, char *argv[])
 		UT_ASSERTeq(pmemobj_pool_by_ptr(edge), NULL);
 		UT_ASSERTeq(pmemobj_pool_by_ptr(middle), pops[i]);
 		UT_ASSERTeq(pmemobj_pool_by_ptr(in_oid), pops[i]);
+
+		PMEMoid oid = pmemobj_oid(pmemobj_direct(oids[i]));
+		UT_ASSERT(OID_EQUALS(oid, oids[i]));
+		oid = pmemobj_oid(in_oid);
+		UT_ASSERTeq(oid.pool_uuid_lo, oids[i].pool_uuid_lo);
+		UT_ASSERTeq(pmemobj_direct(oid), in_oid);
+		UT_ASSERT(OID_IS_NULL(pmemobj_oid(edge)));
+
 		pmemobj_close(pops[i]);
 		UT_ASSERTeq(pmemobj_pool_by_ptr(middle), NULL);
 		UT_ASSERTeq(pmemobj_pool_by_ptr(in_oid), NULL);
+		UT_ASSERT(OID_IS_NULL(pmemobj_oid(in_oid)));
 
 		MUNMAP(guard_after[i], Ut_pagesize);
 	}
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_pool_lookup_mt.c -- unit test for the lookups of the pools by address
+ *	and uuid racing with the pools being opened and closed
+ *
+ * usage: obj_pool_lookup_mt directory
+ *
+ * The threads keep looking up the pools which stay open, and the pool which
+ * is repeatedly opened and closed, while the registry of the open pools is
+ * replaced on every open and close. Once they're done, the memory held by the
+ * library must not have grown with the number of the versions of the registry
+ * retired in the meantime.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "pool_lookup_mt"
+#define NPOOLS 2
+#define NTHREADS 4
+#define NCYCLES 200
+
+static PMEMobjpool *Pops[NPOOLS];
+static PMEMoid Roots[NPOOLS];
+static PMEMoid Churn_root; /* root of the pool opened and closed */
+static int Stop;
+static unsigned Started;
+
+static int Nallocs; /* blocks allocated by the library, not freed yet */
+
+/*
+ * test_malloc -- (internal) malloc counting the allocated blocks
+ */
+static void *
+test_malloc(size_t size)
+{
+	void *ptr = malloc(size);
+	if (ptr != NULL)
+		__sync_fetch_and_add(&Nallocs, 1);
+
+	return ptr;
+}
+
+/*
+ * test_free -- (internal) free counting the allocated blocks
+ */
+static void
+test_free(void *ptr)
+{
+	if (ptr != NULL)
+		__sync_fetch_and_sub(&Nallocs, 1);
+
+	free(ptr);
+}
+
+/*
+ * test_realloc -- (internal) realloc counting the allocated blocks
+ */
+static void *
+test_realloc(void *ptr, size_t size)
+{
+	void *nptr = realloc(ptr, size);
+	if (ptr == NULL && nptr != NULL)
+		__sync_fetch_and_add(&Nallocs, 1);
+	else if (ptr != NULL && nptr == NULL && size == 0)
+		__sync_fetch_and_sub(&Nallocs, 1);
+
+	return nptr;
+}
+
+/*
+ * test_strdup -- (internal) strdup counting the allocated blocks
+ */
+static char *
+test_strdup(const char *s)
+{
+	char *str = strdup(s);
+	if (str != NULL)
+		__sync_fetch_and_add(&Nallocs, 1);
+
+	return str;
+}
+
+/*
+ * reader -- (internal) looks up the pools until stopped
+ */
+static void *
+reader(void *arg)
+{
+	int local;
+
+	__sync_fetch_and_add(&Started, 1);
+
+	while (!Stop) {
+		for (int i = 0; i < NPOOLS; ++i) {
+			char *addr = pmemobj_direct(Roots[i]);
+			UT_ASSERTeq(pmemobj_pool_by_ptr(addr), Pops[i]);
+			UT_ASSERTeq(pmemobj_pool_by_ptr(Pops[i]), Pops[i]);
+			UT_ASSERTeq(pmemobj_pool_by_oid(Roots[i]), Pops[i]);
+		}
+
+		UT_ASSERTeq(pmemobj_pool_by_ptr(&local), NULL);
+
+		/* it might be either open or closed */
+		(void) pmemobj_pool_by_oid(Churn_root);
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_pool_lookup_mt");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s directory", argv[0]);
+
+	const char *dir = argv[1];
+
+	pmemobj_set_funcs(test_malloc, test_free, test_realloc, test_strdup);
+
+	char path[PATH_MAX];
+	for (int i = 0; i < NPOOLS; ++i) {
+		snprintf(path, sizeof(path), "%s/testfile%d", dir, i);
+		Pops[i] = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+				S_IWUSR | S_IRUSR);
+		if (Pops[i] == NULL)
+			UT_FATAL("!pmemobj_create: %s", path);
+
+		Roots[i] = pmemobj_root(Pops[i], sizeof(uint64_t));
+		UT_ASSERT(!OID_IS_NULL(Roots[i]));
+	}
+
+	char churn[PATH_MAX];
+	snprintf(churn, sizeof(churn), "%s/testfile_churn", dir);
+	PMEMobjpool *pop = pmemobj_create(churn, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", churn);
+
+	Churn_root = pmemobj_root(pop, sizeof(uint64_t));
+	pmemobj_close(pop);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, reader, NULL);
+
+	while (Started != NTHREADS)
+		sched_yield();
+
+	int nallocs = 0;
+	for (int i = 0; i < NCYCLES; ++i) {
+		pop = pmemobj_open(churn, LAYOUT);
+		if (pop == NULL)
+			UT_FATAL("!pmemobj_open: %s", churn);
+
+		pmemobj_close(pop);
+
+		/* the records of all the readers exist by now */
+		if (i == 0)
+			nallocs = Nallocs;
+	}
+
+	Stop = 1;
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	/* with no readers left, all of the retired versions can be freed */
+	pop = pmemobj_open(churn, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", churn);
+	pmemobj_close(pop);
+
+	UT_ASSERT(Nallocs <= nallocs);
+
+	for (int i = 0; i < NPOOLS; ++i)
+		pmemobj_close(Pops[i]);
+
+	DONE(NULL);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_pool_stripe.c -- unit test for pool sets with striped parts
+ *
+ * usage: obj_pool_stripe c path stripe part...
+ *        obj_pool_stripe o path...
+ *
+ * op can be:
+ *   c - create a pool, fill the root object, verify that every stripe
+ *       of it landed in the expected part file and reopen the pool
+ *   o - open each of the pool set files and verify the root object
+ */
+#include "unittest.h"
+
+#define LAYOUT "stripe"
+#define ROOT_SIZE ((size_t)24 << 20)
+#define PART_HDR_SIZE 4096
+
+/*
+ * fill_value -- value stored at given offset of the root object
+ */
+static char
+fill_value(size_t off)
+{
+	return (char)(off / Ut_pagesize + 1);
+}
+
+/*
+ * verify_parts -- check that the root object is striped over the parts
+ */
+static void
+verify_parts(size_t root_off, size_t stripe, int nparts, char *parts[])
+{
+	int fds[nparts];
+	for (int p = 0; p < nparts; p++)
+		fds[p] = OPEN(parts[p], O_RDONLY);
+
+	for (size_t off = 0; off < ROOT_SIZE; off += Ut_pagesize) {
+		size_t pool_off = root_off + off;
+		size_t s = pool_off / stripe;
+		int p = (int)(s % (size_t)nparts);
+		size_t file_off = (p == 0 ? 0 : PART_HDR_SIZE) +
+			s / (size_t)nparts * stripe + pool_off % stripe;
+
+		char c;
+		UT_ASSERTeq(pread(fds[p], &c, 1, (off_t)file_off), 1);
+		UT_ASSERTeq(c, fill_value(off));
+	}
+
+	for (int p = 0; p < nparts; p++)
+		CLOSE(fds[p]);
+}
+
+/*
+ * pool_create -- create a striped pool and fill the root object
+ */
+static void
+pool_create(const char *path, size_t stripe, int nparts, char *parts[])
+{
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, 0, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!%s: pmemobj_create", path);
+
+	PMEMoid root = pmemobj_root(pop, ROOT_SIZE);
+	char *data = pmemobj_direct(root);
+	for (size_t off = 0; off < ROOT_SIZE; off += Ut_pagesize)
+		data[off] = fill_value(off);
+	pmemobj_persist(pop, data, ROOT_SIZE);
+
+	pmemobj_close(pop);
+
+	verify_parts(root.off, stripe, nparts, parts);
+
+	UT_OUT("%s: created", path);
+}
+
+/*
+ * pool_open -- open a pool and verify the root object
+ */
+static void
+pool_open(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL) {
+		UT_OUT("!%s: pmemobj_open", path);
+		return;
+	}
+
+	UT_ASSERTeq(pmemobj_root_size(pop), ROOT_SIZE);
+	char *data = pmemobj_direct(pmemobj_root(pop, ROOT_SIZE));
+	for (size_t off = 0; off < ROOT_SIZE; off += Ut_pagesize)
+		UT_ASSERTeq(data[off], fill_value(off));
+
+	UT_OUT("%s: pmemobj_open: Success", path);
+
+	pmemobj_close(pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_pool_stripe");
+
+	if (argc < 3)
+		UT_FATAL("usage: %s c path stripe part... | o path...",
+			argv[0]);
+
+	switch (argv[1][0]) {
+	case 'c':
+		if (argc < 5)
+			UT_FATAL("usage: %s c path stripe part...", argv[0]);
+		pool_create(argv[2], strtoul(argv[3], NULL, 0) << 20,
+			argc - 4, argv + 4);
+		pool_open(argv[2]);
+		break;
+
+	case 'o':
+		for (int i = 2; i < argc; i++)
+			pool_open(argv[i]);
+		break;
+
+	default:
+		UT_FATAL("unknown operation");
+	}
+
+	DONE(NULL);
+}
@@ -41,6 +41,9 @@
 #include "unittest.h"
 
 #define PVECTOR_INSERT_VALUES 100000
+#define PVECTOR_RETAIN_VALUES 1000
+#define PVECTOR_BULK_VALUES 37
+#define PVECTOR_TRUNCATE_VALUES 5003
 
 struct test_root {
 	struct pvector vec;
@@ -131,7 +134,7 @@ main(int argc, char *argv[])
 
 	n = 0;
 	for (int i = PVECTOR_INSERT_VALUES - 1; i >= 0; --i) {
-		v = pvector_pop_back(ctx, NULL);
+		v = pvector_pop_back(ctx, vec_zero_entry);
 		UT_ASSERTeq(v, i);
 	}
 
@@ -139,6 +142,74 @@ main(int argc, char *argv[])
 
 	pvector_delete(ctx);
 
+	/* emptied arrays are retained and reused, and the vector stays valid */
+	ctx = pvector_new(pop, &r->vec);
+	pvector_retain(ctx, PVECTOR_RETAIN_VALUES);
+	for (int round = 0; round < 2; ++round) {
+		for (int i = (int)pvector_nvalues(ctx) + 1;
+				i <= PVECTOR_INSERT_VALUES; ++i) {
+			val = pvector_push_back(ctx);
+			UT_ASSERTne(val, NULL);
+			*val = (uint64_t)i;
+		}
+		for (int i = PVECTOR_INSERT_VALUES;
+				i > PVECTOR_RETAIN_VALUES / 2; --i) {
+			v = pvector_pop_back(ctx, vec_zero_entry);
+			UT_ASSERTeq(v, i);
+		}
+	}
+	UT_ASSERTeq(pvector_nvalues(ctx), PVECTOR_RETAIN_VALUES / 2);
+	pvector_delete(ctx);
+
+	ctx = pvector_new(pop, &r->vec);
+	UT_ASSERTeq(pvector_nvalues(ctx), PVECTOR_RETAIN_VALUES / 2);
+	n = 1;
+	for (v = pvector_first(ctx); v != 0; v = pvector_next(ctx)) {
+		UT_ASSERTeq(v, n);
+		n++;
+	}
+	while (pvector_pop_back(ctx, vec_zero_entry) != 0)
+		;
+	pvector_delete(ctx);
+
+	ctx = pvector_new(pop, &r->vec);
+	UT_ASSERTeq(pvector_nvalues(ctx), 0);
+	pvector_delete(ctx);
+
+	/* values pushed in bulk span the arrays and are truncated in bulk */
+	ctx = pvector_new(pop, &r->vec);
+	uint64_t *entries[PVECTOR_BULK_VALUES];
+	for (int i = 1; i <= PVECTOR_INSERT_VALUES; ) {
+		size_t nentries = PVECTOR_BULK_VALUES;
+		if (nentries > (size_t)(PVECTOR_INSERT_VALUES - i + 1))
+			nentries = (size_t)(PVECTOR_INSERT_VALUES - i + 1);
+
+		UT_ASSERTeq(pvector_push_back_n(ctx, entries, nentries), 0);
+		for (size_t e = 0; e < nentries; ++e)
+			*entries[e] = (uint64_t)i++;
+	}
+	UT_ASSERTeq(pvector_nvalues(ctx), PVECTOR_INSERT_VALUES);
+
+	pvector_truncate(ctx, PVECTOR_TRUNCATE_VALUES);
+	UT_ASSERTeq(pvector_nvalues(ctx), PVECTOR_TRUNCATE_VALUES);
+	UT_ASSERTeq(pvector_last(ctx), PVECTOR_TRUNCATE_VALUES);
+	pvector_delete(ctx);
+
+	ctx = pvector_new(pop, &r->vec);
+	UT_ASSERTeq(pvector_nvalues(ctx), PVECTOR_TRUNCATE_VALUES);
+	n = 1;
+	for (v = pvector_first(ctx); v != 0; v = pvector_next(ctx)) {
+		UT_ASSERTeq(v, n);
+		n++;
+	}
+	pvector_truncate(ctx, 0);
+	UT_ASSERTeq(pvector_first(ctx), 0);
+	pvector_delete(ctx);
+
+	ctx = pvector_new(pop, &r->vec);
+	UT_ASSERTeq(pvector_nvalues(ctx), 0);
+	pvector_delete(ctx);
+
 	pmemobj_close(pop);
 
 	DONE(NULL);
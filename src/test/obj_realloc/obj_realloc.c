@@ -174,6 +174,51 @@ test_realloc(PMEMobjpool *pop, size_t size_from, size_t size_to,
 	UT_ASSERT(TOID_IS_NULL(D_RO(root)->obj));
 }
 
+/*
+ * test_realloc_inplace -- test growing of a huge object into the free chunks
+ *	that follow it
+ */
+static void
+test_realloc_inplace(PMEMobjpool *pop)
+{
+	TOID(struct root) root = POBJ_ROOT(pop, struct root);
+	UT_ASSERT(TOID_IS_NULL(D_RO(root)->obj));
+
+	PMEMoid *oidp = &D_RW(root)->obj.oid;
+	int ret = pmemobj_alloc(pop, oidp, MAX_ALLOC_SIZE,
+		TOID_TYPE_NUM(struct object), NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	uint64_t off = oidp->off;
+	size_t usable_size = pmemobj_alloc_usable_size(*oidp);
+	uint16_t checksum = fill_buffer(pmemobj_direct(*oidp), usable_size);
+
+	/* the rest of the heap is free, so the object doesn't have to move */
+	ret = pmemobj_realloc(pop, oidp, 4 * MAX_ALLOC_SIZE,
+		TOID_TYPE_NUM(struct object));
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(oidp->off, off);
+	UT_ASSERT(pmemobj_alloc_usable_size(*oidp) >= 4 * MAX_ALLOC_SIZE);
+	UT_ASSERTeq(ut_checksum(pmemobj_direct(*oidp), usable_size), checksum);
+
+	usable_size = pmemobj_alloc_usable_size(*oidp);
+	ret = pmemobj_zrealloc(pop, oidp, 8 * MAX_ALLOC_SIZE,
+		TOID_TYPE_NUM(struct object));
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(oidp->off, off);
+	UT_ASSERT(util_is_zeroed((char *)pmemobj_direct(*oidp) + usable_size,
+		8 * MAX_ALLOC_SIZE - usable_size));
+
+	/* the type number can be changed alongside */
+	ret = pmemobj_realloc(pop, oidp, 9 * MAX_ALLOC_SIZE, 1);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(oidp->off, off);
+	UT_ASSERTeq(pmemobj_type_num(*oidp), 1);
+
+	pmemobj_free(oidp);
+	UT_ASSERT(TOID_IS_NULL(D_RO(root)->obj));
+}
+
 /*
  * test_realloc_sizes -- test reallocations from/to specified sizes
  */
@@ -237,6 +282,9 @@ main(int argc, char *argv[])
 	test_alloc(pop, 16);
 	test_free(pop);
 
+	/* test in-place growth of huge objects */
+	test_realloc_inplace(pop);
+
 	/* test realloc without changing type number */
 	test_realloc_sizes(pop, 0, 0, 0, 0);
 	/* test realloc with changing type number */
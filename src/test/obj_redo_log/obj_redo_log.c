@@ -38,6 +38,12 @@
  * s:<index>:<offset>:<value> - store <value> at <offset>
  * f:<index>:<offset>:<value> - store last <value> at <offset>
  * F:<index>                  - set <index> entry as the last one
+ * l:<index>:<offset>         - link to the overflow segment at <offset>
+ * L:<offset>                 - use the overflow segment at <offset>, or the
+ *                              redo log if zero, for the s, f, F, l and e
+ *                              operations
+ * H:<offset>:<size>          - treat offsets in the range as valid heap
+ *                              offsets
  * r:<offset>                 - read at <offset>
  * e:<index>                  - read redo log entry at <index>
  * P                          - process redo log
@@ -63,7 +69,7 @@
 #include "unittest.h"
 
 #define FATAL_USAGE()	UT_FATAL("usage: obj_redo_log <fname> <redo_log_size> "\
-		"[sfFrePRC][<index>:<offset>:<value>]\n")
+		"[sfFlLHrePRC][<index>:<offset>:<value>]\n")
 
 #define PMEMOBJ_POOL_HDR_SIZE	8192
 
@@ -144,6 +150,7 @@ pmemobj_open_mock(const char *fname)
 	pop->p_ops.flush = obj_flush;
 	pop->p_ops.drain = obj_drain;
 	pop->p_ops.base = pop;
+	pop->p_ops.pool_size = size;
 
 	pop->redo = redo_log_config_new(pop->addr, &pop->p_ops,
 			redo_log_check_offset, pop, REDO_NUM_ENTRIES);
@@ -183,6 +190,8 @@ main(int argc, char *argv[])
 	UT_ASSERT(pop->size >= redo_size * sizeof(struct redo_log));
 
 	struct redo_log *redo = (struct redo_log *)pop->addr;
+	/* log used by the operations on entries */
+	struct redo_log *log = redo;
 
 	uint64_t offset;
 	uint64_t value;
@@ -199,7 +208,7 @@ main(int argc, char *argv[])
 					&index, &offset, &value) != 3)
 				FATAL_USAGE();
 			UT_OUT("s:%ld:0x%08lx:0x%08lx", index, offset, value);
-			redo_log_store(pop->redo, redo, index, offset,
+			redo_log_store(pop->redo, log, index, offset,
 					value);
 			break;
 		case 'f':
@@ -207,14 +216,40 @@ main(int argc, char *argv[])
 					&index, &offset, &value) != 3)
 				FATAL_USAGE();
 			UT_OUT("f:%ld:0x%08lx:0x%08lx", index, offset, value);
-			redo_log_store_last(pop->redo, redo, index, offset,
+			redo_log_store_last(pop->redo, log, index, offset,
 					value);
 			break;
 		case 'F':
 			if (sscanf(arg, "F:%ld", &index) != 1)
 				FATAL_USAGE();
 			UT_OUT("F:%ld", index);
-			redo_log_set_last(pop->redo, redo, index);
+			redo_log_set_last(pop->redo, log, index);
+			break;
+		case 'l':
+			if (sscanf(arg, "l:%ld:0x%lx", &index, &offset) != 2)
+				FATAL_USAGE();
+			UT_OUT("l:%ld:0x%08lx", index, offset);
+			redo_log_store_next(pop->redo, log, index, offset);
+			break;
+		case 'L':
+			if (sscanf(arg, "L:0x%lx", &offset) != 1)
+				FATAL_USAGE();
+			UT_OUT("L:0x%08lx", offset);
+			if (offset == 0) {
+				log = redo;
+			} else {
+				struct redo_log_overflow *overflow =
+					(struct redo_log_overflow *)
+					((uintptr_t)pop->addr + offset);
+				log = overflow->redo;
+			}
+			break;
+		case 'H':
+			if (sscanf(arg, "H:0x%lx:0x%lx", &offset, &value) != 2)
+				FATAL_USAGE();
+			UT_OUT("H:0x%08lx:0x%08lx", offset, value);
+			pop->heap_offset = offset;
+			pop->heap_size = value;
 			break;
 		case 'r':
 			if (sscanf(arg, "r:0x%lx", &offset) != 1)
@@ -228,7 +263,7 @@ main(int argc, char *argv[])
 			if (sscanf(arg, "e:%ld", &index) != 1)
 				FATAL_USAGE();
 
-			struct redo_log *entry = redo + index;
+			struct redo_log *entry = log + index;
 
 			int flag = redo_log_is_last(entry);
 			offset = redo_log_offset(entry);
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_reserve.c -- unit test for pmemobj_reserve, pmemobj_publish and
+ *	pmemobj_cancel
+ *
+ * usage: obj_reserve file
+ */
+
+#include <endian.h>
+
+#include "obj.h"
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_reserve"
+
+#define NOBJS 100
+#define OBJ_SIZE 64
+#define TYPE_PUBLISHED 1
+#define TYPE_CANCELED 2
+
+struct root {
+	uint64_t nobjs;
+	PMEMoid objs[NOBJS];
+	uint64_t values[NOBJS];
+};
+
+/*
+ * count_objects -- returns the number of allocated objects of the given type
+ */
+static unsigned
+count_objects(PMEMobjpool *pop, uint64_t type_num)
+{
+	unsigned n = 0;
+	PMEMoid oid;
+	for (oid = pmemobj_first(pop); !OID_IS_NULL(oid);
+			oid = pmemobj_next(oid)) {
+		if (pmemobj_type_num(oid) == type_num)
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * check_overflow_feature -- checks if the redo log overflow feature is set in
+ *	the pool header
+ */
+static void
+check_overflow_feature(const char *path, int set)
+{
+	struct pool_hdr hdr;
+	int fd = OPEN(path, O_RDONLY);
+	ssize_t ret = READ(fd, &hdr, sizeof(hdr));
+	UT_ASSERTeq(ret, sizeof(hdr));
+	CLOSE(fd);
+
+	uint32_t incompat = le32toh(hdr.incompat_features);
+	UT_ASSERTeq(!!(incompat & OBJ_FORMAT_INCOMPAT_REDO_OVERFLOW), set);
+}
+
+/*
+ * test_publish -- reserves objects, fills them and publishes them all at once
+ *	together with the pointers in the root object
+ */
+static void
+test_publish(PMEMobjpool *pop, struct root *r)
+{
+	static struct pobj_action act[3 * NOBJS + 1];
+	int nact = 0;
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		PMEMoid oid = pmemobj_reserve(pop, &act[nact++], OBJ_SIZE,
+			TYPE_PUBLISHED);
+		UT_ASSERT(!OID_IS_NULL(oid));
+		UT_ASSERT(pmemobj_alloc_usable_size(oid) >= OBJ_SIZE);
+
+		uint64_t *data = pmemobj_direct(oid);
+		*data = i;
+		pmemobj_persist(pop, data, sizeof(*data));
+
+		pmemobj_set_value(pop, &act[nact++], &r->objs[i].pool_uuid_lo,
+			oid.pool_uuid_lo);
+		pmemobj_set_value(pop, &act[nact++], &r->objs[i].off,
+			oid.off);
+	}
+
+	pmemobj_set_value(pop, &act[nact++], &r->nobjs, NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_PUBLISHED), 0);
+
+	UT_ASSERTeq(pmemobj_publish(pop, act, (size_t)nact), 0);
+	UT_ASSERTeq(count_objects(pop, TYPE_PUBLISHED), NOBJS);
+
+	UT_OUT("published %u objects", count_objects(pop, TYPE_PUBLISHED));
+}
+
+/*
+ * test_values -- publishes many values at once a few times, reusing the
+ *	overflow segments of the redo log of the lane
+ */
+static void
+test_values(PMEMobjpool *pop, struct root *r)
+{
+	struct pobj_action act[NOBJS];
+
+	for (uint64_t n = 1; n <= 3; ++n) {
+		for (unsigned i = 0; i < NOBJS; ++i)
+			pmemobj_set_value(pop, &act[i], &r->values[i], i * n);
+
+		UT_ASSERTeq(pmemobj_publish(pop, act, NOBJS), 0);
+
+		for (unsigned i = 0; i < NOBJS; ++i)
+			UT_ASSERTeq(r->values[i], i * n);
+	}
+
+	UT_OUT("published %u values", NOBJS);
+}
+
+/*
+ * test_cancel -- reserves objects and releases them
+ */
+static void
+test_cancel(PMEMobjpool *pop)
+{
+	struct pobj_action act[NOBJS];
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		size_t size = OBJ_SIZE * (i % 8 + 1);
+		PMEMoid oid = pmemobj_reserve(pop, &act[i], size,
+			TYPE_CANCELED);
+		UT_ASSERT(!OID_IS_NULL(oid));
+	}
+
+	pmemobj_cancel(pop, act, NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_CANCELED), 0);
+
+	/* the canceled memory can be allocated again */
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, OBJ_SIZE, TYPE_CANCELED,
+		NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	pmemobj_free(&oid);
+
+	oid = pmemobj_reserve(pop, &act[0], 0, TYPE_CANCELED);
+	UT_ASSERT(OID_IS_NULL(oid));
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_OUT("canceled %u objects", NOBJS);
+}
+
+/*
+ * test_verify -- checks the published objects after the pool is reopened
+ */
+static void
+test_verify(PMEMobjpool *pop, struct root *r)
+{
+	UT_ASSERTeq(r->nobjs, NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_PUBLISHED), NOBJS);
+	UT_ASSERTeq(count_objects(pop, TYPE_CANCELED), 0);
+
+	for (unsigned i = 0; i < NOBJS; ++i) {
+		uint64_t *data = pmemobj_direct(r->objs[i]);
+		UT_ASSERTne(data, NULL);
+		UT_ASSERTeq(*data, i);
+		UT_ASSERTeq(pmemobj_type_num(r->objs[i]), TYPE_PUBLISHED);
+		UT_ASSERTeq(r->values[i], i * 3);
+	}
+
+	UT_OUT("verified %u objects", NOBJS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_reserve");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+			PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	UT_ASSERT(!OID_IS_NULL(root));
+
+	/* the pool is marked once the first overflow segment is allocated */
+	check_overflow_feature(argv[1], 0);
+	test_publish(pop, pmemobj_direct(root));
+	check_overflow_feature(argv[1], 1);
+	test_values(pop, pmemobj_direct(root));
+	test_cancel(pop);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = pmemobj_root(pop, sizeof(struct root));
+	test_verify(pop, pmemobj_direct(root));
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_root_race.c -- unit test for pmemobj_root racing with a move of the
+ *	root object
+ *
+ * usage: obj_root_race file
+ *
+ * When the root object is moved, the header of the old one gets the new size
+ * before the offset of the root object is updated. Right then, from the flush
+ * of that header, another thread asks for the root object of the new size. It
+ * must not get the old root object, but wait for the new one.
+ */
+
+#include "unittest.h"
+#include "obj.h"
+
+#define LAYOUT "root_race"
+
+#define OLD_SIZE 64
+/* a huge object, so that the root object can't be extended in place */
+#define NEW_SIZE (1 << 20)
+
+/* how long the reader has to return the old root object, in milliseconds */
+#define READER_WAIT 200
+
+static PMEMobjpool *Pop;
+
+/* the size in the header of the old root object */
+static const void *Watch;
+
+static pthread_t Reader;
+static PMEMoid Reader_root;
+static int Reader_done;
+
+/*
+ * reader -- (internal) asks for the root object of the new size
+ */
+static void *
+reader(void *arg)
+{
+	Reader_root = pmemobj_root(Pop, NEW_SIZE);
+	__sync_fetch_and_add(&Reader_done, 1);
+
+	return NULL;
+}
+
+FUNC_MOCK(pmem_flush, void, const void *addr, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		_FUNC_REAL(pmem_flush)(addr, len);
+
+		uintptr_t w = (uintptr_t)Watch;
+		if (w == 0 || w < (uintptr_t)addr ||
+				w >= (uintptr_t)addr + len)
+			return;
+
+		Watch = NULL;
+		PTHREAD_CREATE(&Reader, NULL, reader, NULL);
+
+		for (int i = 0; i < READER_WAIT &&
+				!__sync_fetch_and_add(&Reader_done, 0); ++i)
+			usleep(1000);
+	}
+FUNC_MOCK_END
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_root_race");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	Pop = pmemobj_create(argv[1], LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	PMEMoid old_root = pmemobj_root(Pop, OLD_SIZE);
+	UT_ASSERT(!OID_IS_NULL(old_root));
+
+	Watch = &OOB_HEADER_FROM_OFF(Pop, old_root.off)->size;
+
+	PMEMoid new_root = pmemobj_root(Pop, NEW_SIZE);
+	UT_ASSERT(!OID_IS_NULL(new_root));
+	UT_ASSERTne(new_root.off, old_root.off);
+
+	/* the header of the old root object was flushed */
+	UT_ASSERTeq(Watch, NULL);
+
+	PTHREAD_JOIN(Reader, NULL);
+	UT_ASSERTeq(Reader_root.off, new_root.off);
+	UT_ASSERT(pmemobj_root_size(Pop) >= NEW_SIZE);
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_rpmem_resync.c -- unit test for the resynchronization of a remote
+ *	replica which missed writes
+ *
+ * usage: obj_rpmem_resync file
+ *
+ * The librpmem library is replaced by a fake one which keeps the remote
+ * replica in memory and can be told to fail. The pool is written while the
+ * remote replica persists fine, then it starts failing, which degrades it,
+ * and some objects are modified and allocated behind its back. On the next
+ * open the remote replica has to catch up with the master replica.
+ */
+
+#include "unittest.h"
+#include "librpmem.h"
+#include "obj.h"
+#include "util.h"
+
+#define LAYOUT "rpmem_resync"
+
+#define LIBRPMEM "librpmem.so.1"
+
+/* larger than a chunk of the heap, so each object gets its own chunks */
+#define OBJ_SIZE (512 * 1024)
+#define NOBJS 8
+
+#define OLD_VAL 'a'
+#define NEW_VAL 'b'
+#define ALLOC_VAL 'c'
+
+/* the remote replica, all the offsets are relative to the pool header end */
+static struct {
+	void *pool_addr;	/* data of the master replica */
+	size_t size;
+	char *data;		/* the content of the remote replica */
+	struct rpmem_pool_attr attr;
+	int fail;		/* persists fail if set */
+	unsigned nwrites;	/* number of successful persists and flushes */
+} Remote;
+
+/* the address of Remote_handle is the handle of the fake library */
+static int Remote_handle;
+
+/*
+ * fake_create -- create the remote replica
+ */
+static RPMEMpool *
+fake_create(const char *target, const char *pool_set_name,
+	void *pool_addr, size_t pool_size, unsigned *nlanes,
+	const struct rpmem_pool_attr *create_attr)
+{
+	UT_ASSERTeq(Remote.data, NULL);
+
+	Remote.data = ZALLOC(pool_size);
+	Remote.size = pool_size;
+	Remote.pool_addr = pool_addr;
+	Remote.attr = *create_attr;
+
+	return (RPMEMpool *)&Remote;
+}
+
+/*
+ * fake_open -- open the remote replica
+ */
+static RPMEMpool *
+fake_open(const char *target, const char *pool_set_name,
+	void *pool_addr, size_t pool_size, unsigned *nlanes,
+	struct rpmem_pool_attr *open_attr)
+{
+	UT_ASSERTne(Remote.data, NULL);
+	UT_ASSERTeq(Remote.size, pool_size);
+
+	Remote.pool_addr = pool_addr;
+	*open_attr = Remote.attr;
+
+	return (RPMEMpool *)&Remote;
+}
+
+/*
+ * fake_close -- close the remote replica, its content is kept
+ */
+static int
+fake_close(RPMEMpool *rpp)
+{
+	UT_ASSERTeq(rpp, (RPMEMpool *)&Remote);
+
+	return 0;
+}
+
+/*
+ * fake_flush -- copy the range of the master replica to the remote one
+ */
+static int
+fake_flush(RPMEMpool *rpp, size_t offset, size_t length, unsigned lane)
+{
+	UT_ASSERTeq(rpp, (RPMEMpool *)&Remote);
+	UT_ASSERT(offset + length <= Remote.size);
+
+	if (Remote.fail) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	memcpy(Remote.data + offset, (char *)Remote.pool_addr + offset,
+		length);
+	Remote.nwrites++;
+
+	return 0;
+}
+
+/*
+ * fake_persist -- copy the range of the master replica to the remote one
+ */
+static int
+fake_persist(RPMEMpool *rpp, size_t offset, size_t length, unsigned lane)
+{
+	return fake_flush(rpp, offset, length, lane);
+}
+
+/*
+ * fake_drain -- nothing to wait for, the flushes are synchronous
+ */
+static int
+fake_drain(RPMEMpool *rpp, unsigned lane)
+{
+	UT_ASSERTeq(rpp, (RPMEMpool *)&Remote);
+
+	if (Remote.fail) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * fake_read -- read the range of the remote replica
+ */
+static int
+fake_read(RPMEMpool *rpp, void *buff, size_t offset, size_t length)
+{
+	UT_ASSERTeq(rpp, (RPMEMpool *)&Remote);
+	UT_ASSERT(offset + length <= Remote.size);
+
+	memcpy(buff, Remote.data + offset, length);
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	void *func;
+} Fake_funcs[] = {
+	{"rpmem_create", fake_create},
+	{"rpmem_open", fake_open},
+	{"rpmem_close", fake_close},
+	{"rpmem_persist", fake_persist},
+	{"rpmem_read", fake_read},
+	{"rpmem_flush", fake_flush},
+	{"rpmem_drain", fake_drain},
+};
+
+/*
+ * dlopen -- dlopen mock, loads the fake librpmem
+ */
+FUNC_MOCK(dlopen, void *, const char *filename, int flags)
+FUNC_MOCK_RUN_DEFAULT {
+	if (filename != NULL && strcmp(filename, LIBRPMEM) == 0)
+		return &Remote_handle;
+
+	return _FUNC_REAL(dlopen)(filename, flags);
+}
+FUNC_MOCK_END
+
+/*
+ * dlsym -- dlsym mock, finds the functions of the fake librpmem
+ */
+FUNC_MOCK(dlsym, void *, void *handle, const char *symbol)
+FUNC_MOCK_RUN_DEFAULT {
+	if (handle != &Remote_handle)
+		return _FUNC_REAL(dlsym)(handle, symbol);
+
+	for (size_t i = 0; i < ARRAY_SIZE(Fake_funcs); ++i) {
+		if (strcmp(Fake_funcs[i].name, symbol) == 0)
+			return Fake_funcs[i].func;
+	}
+
+	UT_FATAL("unexpected symbol %s", symbol);
+}
+FUNC_MOCK_END
+
+/*
+ * dlclose -- dlclose mock, unloads the fake librpmem
+ */
+FUNC_MOCK(dlclose, int, void *handle)
+FUNC_MOCK_RUN_DEFAULT {
+	if (handle == &Remote_handle)
+		return 0;
+
+	return _FUNC_REAL(dlclose)(handle);
+}
+FUNC_MOCK_END
+
+/*
+ * remote_ptr -- returns the address of the copy of the object in the remote
+ *	replica
+ */
+static char *
+remote_ptr(PMEMoid oid)
+{
+	return Remote.data + oid.off - sizeof(struct pool_hdr);
+}
+
+/*
+ * is_marked -- checks if the chunk with the object is marked in the map of
+ *	chunks to resynchronize
+ */
+static int
+is_marked(PMEMobjpool *pop, PMEMoid oid)
+{
+	uint64_t c = oid.off >> pop->resync_shift;
+
+	return (pop->resync_map[c / 64] & (1ULL << (c % 64))) != 0;
+}
+
+/*
+ * fill -- fills the object with the value
+ */
+static void
+fill(PMEMobjpool *pop, PMEMoid oid, int val)
+{
+	pmemobj_memset_persist(pop, pmemobj_direct(oid), val, OBJ_SIZE);
+}
+
+/*
+ * check_remote -- checks the content of the object in the remote replica
+ */
+static void
+check_remote(PMEMoid oid, int val)
+{
+	char *r = remote_ptr(oid);
+	for (size_t i = 0; i < OBJ_SIZE; ++i)
+		UT_ASSERTeq(r[i], val);
+}
+
+/*
+ * check_remote_range -- checks the range of the pool is the same in both
+ *	replicas
+ */
+static void
+check_remote_range(PMEMobjpool *pop, size_t beg, size_t end)
+{
+	size_t hdr_size = sizeof(struct pool_hdr);
+	UT_ASSERT(end - hdr_size <= Remote.size);
+
+	UT_ASSERTeq(memcmp(Remote.data + beg - hdr_size, (char *)pop + beg,
+		end - beg), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_rpmem_resync");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, 0, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	PMEMoid oids[NOBJS];
+	for (int i = 0; i < NOBJS; ++i) {
+		int ret = pmemobj_alloc(pop, &oids[i], OBJ_SIZE, 0, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+		fill(pop, oids[i], OLD_VAL);
+		check_remote(oids[i], OLD_VAL);
+	}
+	UT_ASSERTeq(pop->resync_shift, 0);
+
+	/* the first persist which fails degrades the remote replica */
+	Remote.fail = 1;
+	for (int i = 1; i < NOBJS; i += 2)
+		fill(pop, oids[i], NEW_VAL);
+
+	PMEMoid new_oid;
+	int ret = pmemobj_alloc(pop, &new_oid, OBJ_SIZE, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+	fill(pop, new_oid, ALLOC_VAL);
+
+	/* the remote replica is no longer written to */
+	Remote.fail = 0;
+	unsigned nwrites = Remote.nwrites;
+	fill(pop, oids[0], OLD_VAL);
+	UT_ASSERTeq(Remote.nwrites, nwrites);
+
+	UT_ASSERTne(pop->resync_shift, 0);
+	for (int i = 0; i < NOBJS; ++i) {
+		check_remote(oids[i], OLD_VAL);
+		if (i % 2)
+			UT_ASSERT(is_marked(pop, oids[i]));
+	}
+	UT_ASSERT(is_marked(pop, new_oid));
+
+	pmemobj_close(pop);
+
+	/* the remote replica is back, the chunks it missed are written to it */
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_ASSERTeq(pop->resync_shift, 0);
+	UT_ASSERT(util_is_zeroed(pop->resync_map, sizeof(pop->resync_map)));
+	UT_ASSERT(Remote.nwrites > nwrites);
+
+	for (int i = 0; i < NOBJS; ++i)
+		check_remote(oids[i], i % 2 ? NEW_VAL : OLD_VAL);
+	check_remote(new_oid, ALLOC_VAL);
+
+	/* nothing else was missed either, except for the run-time state */
+	check_remote_range(pop, sizeof(struct pool_hdr),
+		offsetof(struct pmemobjpool, addr));
+	check_remote_range(pop, sizeof(struct pmemobjpool), pop->size);
+
+	pmemobj_close(pop);
+
+	FREE(Remote.data);
+
+	DONE(NULL);
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_scrub.c -- unit test for the online scrubbing of the heap
+ *
+ * usage: obj_scrub file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "scrub"
+#define NTHREADS 4
+#define SMALL_SIZE 128
+#define HUGE_SIZE (1 << 20)
+
+/* the legacy allocation header, right in front of the object's padding */
+struct alloc_hdr {
+	uint32_t zone_id;
+	uint32_t chunk_id;
+	uint64_t size;
+};
+#define ALLOC_HDR_OFF 64
+
+static PMEMobjpool *Pop;
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Cond = PTHREAD_COND_INITIALIZER;
+static unsigned Npasses;
+static unsigned Nreports;
+static uint64_t Reported[2];
+
+static int Stop;
+
+/*
+ * report -- (internal) counts the passes and records the inconsistencies
+ */
+static void
+report(PMEMobjpool *pop, uint64_t off, const char *msg, void *arg)
+{
+	UT_ASSERTeq(pop, Pop);
+	UT_ASSERTeq(arg, &Lock);
+
+	pthread_mutex_lock(&Lock);
+	if (msg == NULL) {
+		Npasses++;
+		pthread_cond_broadcast(&Cond);
+	} else {
+		if (Nreports < 2)
+			Reported[Nreports] = off;
+		Nreports++;
+	}
+	pthread_mutex_unlock(&Lock);
+}
+
+/*
+ * wait_passes -- (internal) waits until the heap is scrubbed whole n times
+ *	more, returns the number of inconsistencies reported so far
+ */
+static unsigned
+wait_passes(unsigned n)
+{
+	pthread_mutex_lock(&Lock);
+	unsigned last = Npasses + n;
+	while (Npasses < last)
+		pthread_cond_wait(&Cond, &Lock);
+	unsigned ret = Nreports;
+	pthread_mutex_unlock(&Lock);
+
+	return ret;
+}
+
+/*
+ * worker -- (internal) allocates and frees objects until stopped
+ */
+static void *
+worker(void *arg)
+{
+	PMEMoid oids[16];
+
+	while (!__sync_fetch_and_add(&Stop, 0)) {
+		for (unsigned i = 0; i < 16; ++i) {
+			size_t size = i % 4 == 0 ? HUGE_SIZE : SMALL_SIZE * i;
+			int ret = pmemobj_alloc(Pop, &oids[i], size, 0,
+				NULL, NULL);
+			UT_ASSERTeq(ret, 0);
+		}
+
+		for (unsigned i = 0; i < 16; ++i)
+			pmemobj_free(&oids[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * corrupt -- (internal) moves the header of the object to another chunk,
+ *	returns the offset at which the inconsistency is expected
+ */
+static uint64_t
+corrupt(PMEMoid oid)
+{
+	struct alloc_hdr *hdr = (struct alloc_hdr *)
+		((char *)pmemobj_direct(oid) - ALLOC_HDR_OFF);
+	hdr->chunk_id += 1;
+	pmemobj_persist(Pop, hdr, sizeof(*hdr));
+
+	return oid.off - ALLOC_HDR_OFF;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_scrub");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL * 8,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 0, NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* the heap is scrubbed while the objects are allocated and freed */
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 0, report, &Lock), 0);
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 0, report, &Lock), -1);
+	UT_ASSERTeq(errno, EBUSY);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, NULL);
+
+	UT_ASSERTeq(wait_passes(100), 0);
+
+	__sync_fetch_and_add(&Stop, 1);
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	pmemobj_scrub_stop(Pop);
+
+	PMEMoid small;
+	PMEMoid huge;
+	UT_ASSERTeq(pmemobj_alloc(Pop, &small, SMALL_SIZE, 0, NULL, NULL), 0);
+	UT_ASSERTeq(pmemobj_alloc(Pop, &huge, HUGE_SIZE, 0, NULL, NULL), 0);
+
+	/* a limited scrubber stops right away */
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 1, report, &Lock), 0);
+	pmemobj_scrub_stop(Pop);
+
+	uint64_t small_off = corrupt(small);
+	uint64_t huge_off = corrupt(huge);
+
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 0, report, &Lock), 0);
+	UT_ASSERTne(wait_passes(1), 0);
+	pmemobj_scrub_stop(Pop);
+
+	UT_ASSERT(Nreports >= 2);
+	UT_ASSERT((Reported[0] == small_off && Reported[1] == huge_off) ||
+		(Reported[0] == huge_off && Reported[1] == small_off));
+
+	/* the scrubber is stopped along with the pool */
+	UT_ASSERTeq(pmemobj_scrub_start(Pop, 1, report, &Lock), 0);
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
@@ -66,6 +66,9 @@ static struct mock_obj {
 	uint8_t data[DATA_SIZE];
 } *Test_obj;
 
+/* set if the futex based locks are used instead of the pthread ones */
+static int Futex;
+
 FUNC_MOCK(pthread_mutex_init, int,
 		pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
 
@@ -286,6 +289,10 @@ timed_check_worker(void *arg)
 static void
 cleanup(char test_type)
 {
+	/* the futex based locks don't have to be destroyed */
+	if (Futex)
+		return;
+
 	switch (test_type) {
 		case 'm':
 			pthread_mutex_destroy(&((PMEMmutex_internal *)
@@ -324,6 +331,10 @@ main(int argc, char *argv[])
 {
 	START(argc, argv, "obj_sync");
 	util_init();
+	sync_elision_init(OBJ_LOCK_ELISION_VAR);
+	sync_futex_init(OBJ_FUTEX_MUTEX_VAR);
+	sync_bias_init(OBJ_RWLOCK_BIAS_VAR);
+	Futex = getenv(OBJ_FUTEX_MUTEX_VAR) != NULL;
 
 	if (argc < 4)
 		FATAL_USAGE();
@@ -402,6 +413,11 @@ main(int argc, char *argv[])
 		cleanup(test_type);
 	}
 
+	if (Futex) {
+		UT_ASSERTeq(RCOUNTER(pthread_mutex_init), 0);
+		UT_ASSERTeq(RCOUNTER(pthread_cond_init), 0);
+	}
+
 	FREE(check_threads);
 	FREE(write_threads);
 	FREE(Test_obj);
@@ -45,8 +45,7 @@
 
 #define OBJ_SIZE	1024
 #define OVERLAP_SIZE	100
-#define ROOT_TAB_SIZE\
-	(((MAX_CACHED_RANGE_SIZE + 16) * MAX_CACHED_RANGES) / sizeof(int))
+#define ROOT_TAB_SIZE	(TX_RANGE_CACHE_SIZE / sizeof(int))
 
 #define REOPEN_COUNT	10
 
@@ -523,6 +522,61 @@ do_tx_add_range_overlapping(PMEMobjpool *pop)
 	UT_ASSERT(util_is_zeroed(D_RO(obj)->data, OVERLAP_SIZE));
 }
 
+/*
+ * do_tx_add_range_scattered -- call pmemobj_tx_add_range on many small ranges
+ * added in reverse order, which later get merged by the overlapping ones
+ */
+static void
+do_tx_add_range_scattered(PMEMobjpool *pop)
+{
+	TOID(struct overlap_object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, 1));
+
+	/*
+	 * -+-+-+-+- ... added from the end
+	 * +-+-+-+-+ ... added from the end
+	 */
+	TX_BEGIN(pop) {
+		for (int i = OVERLAP_SIZE - 1; i >= 0; i -= 2) {
+			pmemobj_tx_add_range(obj.oid, (uint64_t)i, 1);
+			D_RW(obj)->data[i] = 1;
+		}
+
+		for (int i = OVERLAP_SIZE - 2; i >= 0; i -= 2) {
+			pmemobj_tx_add_range(obj.oid, (uint64_t)i, 1);
+			D_RW(obj)->data[i] = 2;
+		}
+
+		TX_ADD(obj);
+		memset(D_RW(obj)->data, 0xFF, OVERLAP_SIZE);
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERT(util_is_zeroed(D_RO(obj)->data, OVERLAP_SIZE));
+
+	/* objects allocated and freed in between the snapshots */
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range(obj.oid, 0, 4);
+		memset(D_RW(obj)->data, 1, 4);
+
+		PMEMoid tmp = pmemobj_tx_zalloc(OVERLAP_SIZE, 1);
+		pmemobj_tx_add_range(tmp, 0, OVERLAP_SIZE);
+		pmemobj_tx_free(tmp);
+
+		pmemobj_tx_add_range(obj.oid, 0, OVERLAP_SIZE);
+		memset(D_RW(obj)->data, 2, OVERLAP_SIZE);
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERT(util_is_zeroed(D_RO(obj)->data, OVERLAP_SIZE));
+}
+
 /*
  * do_tx_add_range_reopen -- check for persistent memory leak in undo log set
  */
@@ -553,6 +607,86 @@ do_tx_add_range_reopen(char *path)
 	}
 }
 
+/*
+ * do_tx_xadd_range_no_flush_commit -- call pmemobj_tx_xadd_range with
+ * POBJ_XADD_NO_FLUSH, persist the range manually and commit the transaction
+ */
+static void
+do_tx_xadd_range_no_flush_commit(PMEMobjpool *pop)
+{
+	int ret;
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
+
+	TX_BEGIN(pop) {
+		ret = pmemobj_tx_xadd_range(obj.oid, VALUE_OFF, VALUE_SIZE,
+			POBJ_XADD_NO_FLUSH);
+		UT_ASSERTeq(ret, 0);
+
+		D_RW(obj)->value = TEST_VALUE_1;
+		pmemobj_persist(pop, &D_RW(obj)->value, VALUE_SIZE);
+
+		ret = TX_XADD_FIELD(obj, data, 0);
+		UT_ASSERTeq(ret, 0);
+
+		pmemobj_memset_persist(pop, D_RW(obj)->data, TEST_VALUE_2,
+			DATA_SIZE);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, TEST_VALUE_1);
+
+	size_t i;
+	for (i = 0; i < DATA_SIZE; i++)
+		UT_ASSERTeq(D_RO(obj)->data[i], TEST_VALUE_2);
+}
+
+/*
+ * do_tx_xadd_range_no_flush_abort -- call pmemobj_tx_xadd_range with
+ * POBJ_XADD_NO_FLUSH and abort the transaction
+ */
+static void
+do_tx_xadd_range_no_flush_abort(PMEMobjpool *pop)
+{
+	int ret;
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
+
+	TX_BEGIN(pop) {
+		ret = TX_XADD(obj, POBJ_XADD_NO_FLUSH);
+		UT_ASSERTeq(ret, 0);
+
+		D_RW(obj)->value = TEST_VALUE_1;
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 0);
+}
+
+/*
+ * do_tx_xadd_range_invalid_flags -- call pmemobj_tx_xadd_range with unknown
+ * flags, which has to abort the transaction
+ */
+static void
+do_tx_xadd_range_invalid_flags(PMEMobjpool *pop)
+{
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_xadd_range(obj.oid, VALUE_OFF, VALUE_SIZE,
+			~POBJ_XADD_VALID_FLAGS);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(errno, EINVAL);
+}
+
 static void
 do_tx_add_range_too_large(PMEMobjpool *pop)
 {
@@ -609,8 +743,16 @@ main(int argc, char *argv[])
 		VALGRIND_WRITE_STATS;
 		do_tx_add_range_overlapping(pop);
 		VALGRIND_WRITE_STATS;
+		do_tx_add_range_scattered(pop);
+		VALGRIND_WRITE_STATS;
 		do_tx_add_range_too_large(pop);
 		VALGRIND_WRITE_STATS;
+		do_tx_xadd_range_no_flush_commit(pop);
+		VALGRIND_WRITE_STATS;
+		do_tx_xadd_range_no_flush_abort(pop);
+		VALGRIND_WRITE_STATS;
+		do_tx_xadd_range_invalid_flags(pop);
+		VALGRIND_WRITE_STATS;
 		pmemobj_close(pop);
 	}
 
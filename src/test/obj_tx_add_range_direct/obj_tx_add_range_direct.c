@@ -63,6 +63,9 @@ struct object {
 #define DATA_SIZE	(OBJ_SIZE - sizeof(size_t))
 #define TEST_VALUE_1	1
 #define TEST_VALUE_2	2
+/* number of 1-byte snapshots which fit in the first range cache */
+#define CACHED_RANGES	(TX_RANGE_CACHE_SIZE / TX_RANGE_ENTRY_SIZE(1))
+#define CACHED_OBJS	64
 
 /*
  * do_tx_alloc -- do tx allocation with specified type number
@@ -402,6 +405,72 @@ do_tx_add_range_commit(PMEMobjpool *pop)
 	UT_ASSERTeq(D_RO(obj)->value, TEST_VALUE_1);
 }
 
+/*
+ * do_tx_xadd_range_no_flush_commit -- call xadd_range_direct with
+ *	POBJ_XADD_NO_FLUSH, persist the range manually and commit tx
+ */
+static void
+do_tx_xadd_range_no_flush_commit(PMEMobjpool *pop)
+{
+	int ret;
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
+
+	TX_BEGIN(pop) {
+		char *ptr = pmemobj_direct(obj.oid);
+		ret = pmemobj_tx_xadd_range_direct(ptr + VALUE_OFF,
+				VALUE_SIZE, POBJ_XADD_NO_FLUSH);
+		UT_ASSERTeq(ret, 0);
+
+		D_RW(obj)->value = TEST_VALUE_1;
+		pmemobj_persist(pop, &D_RW(obj)->value, VALUE_SIZE);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, TEST_VALUE_1);
+}
+
+/*
+ * do_tx_xadd_range_no_snapshot -- call xadd_range_direct with
+ *	POBJ_XADD_NO_SNAPSHOT and make sure the range is persisted on commit, but
+ *	not restored on abort
+ */
+static void
+do_tx_xadd_range_no_snapshot(PMEMobjpool *pop)
+{
+	int ret;
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
+
+	TX_BEGIN(pop) {
+		char *ptr = pmemobj_direct(obj.oid);
+		ret = pmemobj_tx_xadd_range_direct(ptr + VALUE_OFF,
+				VALUE_SIZE, POBJ_XADD_NO_SNAPSHOT);
+		UT_ASSERTeq(ret, 0);
+
+		D_RW(obj)->value = TEST_VALUE_1;
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, TEST_VALUE_1);
+
+	TX_BEGIN(pop) {
+		char *ptr = pmemobj_direct(obj.oid);
+		ret = pmemobj_tx_xadd_range_direct(ptr + VALUE_OFF,
+				VALUE_SIZE, POBJ_XADD_NO_SNAPSHOT);
+		UT_ASSERTeq(ret, 0);
+
+		D_RW(obj)->value = TEST_VALUE_2;
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, TEST_VALUE_2);
+}
+
 /*
  * do_tx_commit_and_abort -- use range cache, commit and then abort to make
  *	sure that it won't affect previously modified data.
@@ -477,37 +546,95 @@ test_tx_corruption_bug(PMEMobjpool *pop)
 	TOID(struct object) obj;
 	TOID_ASSIGN(obj, do_tx_zalloc(pop, TYPE_OBJ));
 	struct object *o = D_RW(obj);
-	unsigned char i;
-	UT_COMPILE_ERROR_ON(1.5 * MAX_CACHED_RANGES > 255);
+	size_t i;
+	UT_COMPILE_ERROR_ON(1.5 * CACHED_RANGES > DATA_SIZE);
 
 	TX_BEGIN(pop) {
-		for (i = 0; i < 1.5 * MAX_CACHED_RANGES; ++i) {
+		for (i = 0; i < 1.5 * CACHED_RANGES; ++i) {
 			TX_ADD_DIRECT(&o->data[i]);
-			o->data[i] = i;
+			o->data[i] = (char)i;
 		}
 	} TX_ONABORT {
 		UT_ASSERT(0);
 	} TX_END
 
-	for (i = 0; i < 1.5 * MAX_CACHED_RANGES; ++i)
-		UT_ASSERTeq((unsigned char)o->data[i], i);
+	for (i = 0; i < 1.5 * CACHED_RANGES; ++i)
+		UT_ASSERTeq((unsigned char)o->data[i], (unsigned char)i);
 
 	TX_BEGIN(pop) {
-		for (i = 0; i < 0.1 * MAX_CACHED_RANGES; ++i) {
+		for (i = 0; i < 0.1 * CACHED_RANGES; ++i) {
 			TX_ADD_DIRECT(&o->data[i]);
-			o->data[i] = i + 10;
+			o->data[i] = (char)(i + 10);
 		}
 		pmemobj_tx_abort(EINVAL);
 	} TX_ONCOMMIT {
 		UT_ASSERT(0);
 	} TX_END
 
-	for (i = 0; i < 1.5 * MAX_CACHED_RANGES; ++i)
-		UT_ASSERTeq((unsigned char)o->data[i], i);
+	for (i = 0; i < 1.5 * CACHED_RANGES; ++i)
+		UT_ASSERTeq((unsigned char)o->data[i], (unsigned char)i);
 
 	pmemobj_free(&obj.oid);
 }
 
+/*
+ * do_tx_add_range_cached -- snapshot enough ranges of up to
+ * MAX_CACHED_RANGE_SIZE bytes to fill more than one range cache
+ */
+static void
+do_tx_add_range_cached(PMEMobjpool *pop)
+{
+	TOID(struct object) objs[CACHED_OBJS];
+	for (int i = 0; i < CACHED_OBJS; ++i)
+		TOID_ASSIGN(objs[i], do_tx_zalloc(pop, TYPE_OBJ));
+
+	UT_COMPILE_ERROR_ON(MAX_CACHED_RANGE_SIZE + 64 > DATA_SIZE);
+	UT_COMPILE_ERROR_ON(CACHED_OBJS * MAX_CACHED_RANGE_SIZE <
+		2 * TX_RANGE_CACHE_SIZE);
+
+	TX_BEGIN(pop) {
+		for (int i = 0; i < CACHED_OBJS; ++i) {
+			struct object *o = D_RW(objs[i]);
+			TX_ADD_DIRECT(&o->value);
+			o->value = TEST_VALUE_1;
+
+			/* between 64 and MAX_CACHED_RANGE_SIZE bytes */
+			size_t size = 64 + (size_t)i *
+				(MAX_CACHED_RANGE_SIZE - 64) /
+				(CACHED_OBJS - 1);
+			pmemobj_tx_add_range_direct(o->data, size);
+			memset(o->data, TEST_VALUE_1, size);
+		}
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	for (int i = 0; i < CACHED_OBJS; ++i) {
+		UT_ASSERTeq(D_RO(objs[i])->value, 0);
+		UT_ASSERT(util_is_zeroed(D_RO(objs[i])->data,
+			MAX_CACHED_RANGE_SIZE));
+	}
+
+	TX_BEGIN(pop) {
+		for (int i = 0; i < CACHED_OBJS; ++i) {
+			struct object *o = D_RW(objs[i]);
+			pmemobj_tx_add_range_direct(o->data,
+				MAX_CACHED_RANGE_SIZE);
+			memset(o->data, TEST_VALUE_2, MAX_CACHED_RANGE_SIZE);
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	for (int i = 0; i < CACHED_OBJS; ++i) {
+		const struct object *o = D_RO(objs[i]);
+		for (size_t j = 0; j < MAX_CACHED_RANGE_SIZE; ++j)
+			UT_ASSERTeq(o->data[j], TEST_VALUE_2);
+		pmemobj_free(&objs[i].oid);
+	}
+}
+
 static void
 do_tx_add_range_too_large(PMEMobjpool *pop)
 {
@@ -540,6 +667,10 @@ main(int argc, char *argv[])
 
 	do_tx_add_range_commit(pop);
 	VALGRIND_WRITE_STATS;
+	do_tx_xadd_range_no_flush_commit(pop);
+	VALGRIND_WRITE_STATS;
+	do_tx_xadd_range_no_snapshot(pop);
+	VALGRIND_WRITE_STATS;
 	do_tx_add_range_abort(pop);
 	VALGRIND_WRITE_STATS;
 	do_tx_add_range_commit_nested(pop);
@@ -562,6 +693,8 @@ main(int argc, char *argv[])
 	VALGRIND_WRITE_STATS;
 	test_tx_corruption_bug(pop);
 	VALGRIND_WRITE_STATS;
+	do_tx_add_range_cached(pop);
+	VALGRIND_WRITE_STATS;
 	do_tx_add_range_too_large(pop);
 	VALGRIND_WRITE_STATS;
 
@@ -31,7 +31,8 @@
  */
 
 /*
- * obj_tx_alloc.c -- unit test for pmemobj_tx_alloc and pmemobj_tx_zalloc
+ * obj_tx_alloc.c -- unit test for pmemobj_tx_alloc, pmemobj_tx_alloc_bulk
+ * and pmemobj_tx_zalloc
  */
 #include <assert.h>
 #include <sys/param.h>
@@ -47,6 +48,8 @@
 #define TEST_VALUE_1	1
 #define TEST_VALUE_2	2
 #define OBJ_SIZE	(200 * 1024)
+#define BULK_OBJ_SIZE	64
+#define BULK_NOBJS	100
 
 enum type_number {
 	TYPE_NO_TX,
@@ -61,6 +64,8 @@ enum type_number {
 	TYPE_ABORT_AFTER_NESTED1,
 	TYPE_ABORT_AFTER_NESTED2,
 	TYPE_OOM,
+	TYPE_BULK_COMMIT,
+	TYPE_BULK_ABORT,
 };
 
 TOID_DECLARE(struct object, TYPE_OOM);
@@ -380,6 +385,102 @@ do_tx_alloc_commit(PMEMobjpool *pop)
 	UT_ASSERT(TOID_IS_NULL(next));
 }
 
+/*
+ * do_tx_alloc_bulk_abort -- allocates many objects and aborts the transaction
+ */
+static void
+do_tx_alloc_bulk_abort(PMEMobjpool *pop)
+{
+	PMEMoid oids[BULK_NOBJS];
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_alloc_bulk(BULK_OBJ_SIZE, TYPE_BULK_ABORT,
+			oids, BULK_NOBJS);
+		UT_ASSERTeq(ret, 0);
+
+		for (int i = 0; i < BULK_NOBJS; ++i) {
+			UT_ASSERT(!OID_IS_NULL(oids[i]));
+			memset(pmemobj_direct(oids[i]), TEST_VALUE_1,
+				BULK_OBJ_SIZE);
+		}
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERT(OID_IS_NULL(POBJ_FIRST_TYPE_NUM(pop, TYPE_BULK_ABORT)));
+}
+
+/*
+ * do_tx_alloc_bulk_zerolen -- allocates many objects of zero size to trigger
+ * tx abort
+ */
+static void
+do_tx_alloc_bulk_zerolen(PMEMobjpool *pop)
+{
+	PMEMoid oids[BULK_NOBJS];
+	TX_BEGIN(pop) {
+		pmemobj_tx_alloc_bulk(0, TYPE_BULK_ABORT, oids, BULK_NOBJS);
+		UT_ASSERT(0); /* should not get to this point */
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_ONABORT {
+		UT_ASSERTeq(errno, EINVAL);
+	} TX_END
+
+	for (int i = 0; i < BULK_NOBJS; ++i)
+		UT_ASSERT(OID_IS_NULL(oids[i]));
+
+	UT_ASSERT(OID_IS_NULL(POBJ_FIRST_TYPE_NUM(pop, TYPE_BULK_ABORT)));
+}
+
+/*
+ * do_tx_alloc_bulk_commit -- allocates many objects
+ */
+static void
+do_tx_alloc_bulk_commit(PMEMobjpool *pop)
+{
+	PMEMoid oids[BULK_NOBJS];
+	TX_BEGIN(pop) {
+		int ret = pmemobj_tx_alloc_bulk(BULK_OBJ_SIZE,
+			TYPE_BULK_COMMIT, oids, BULK_NOBJS);
+		UT_ASSERTeq(ret, 0);
+
+		for (int i = 0; i < BULK_NOBJS; ++i) {
+			UT_ASSERT(!OID_IS_NULL(oids[i]));
+			UT_ASSERT(pmemobj_alloc_usable_size(oids[i]) >=
+				BULK_OBJ_SIZE);
+			memset(pmemobj_direct(oids[i]), TEST_VALUE_2,
+				BULK_OBJ_SIZE);
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	int nobjs = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (pmemobj_type_num(oid) != TYPE_BULK_COMMIT)
+			continue;
+
+		int found = 0;
+		for (int i = 0; i < BULK_NOBJS; ++i)
+			found += OID_EQUALS(oid, oids[i]);
+		UT_ASSERTeq(found, 1);
+
+		char *data = pmemobj_direct(oid);
+		for (int i = 0; i < BULK_OBJ_SIZE; ++i)
+			UT_ASSERTeq(data[i], TEST_VALUE_2);
+
+		nobjs++;
+	}
+
+	UT_ASSERTeq(nobjs, BULK_NOBJS);
+
+	for (int i = 0; i < BULK_NOBJS; ++i)
+		pmemobj_free(&oids[i]);
+}
+
 /*
  * do_tx_zalloc_abort -- allocates a zeroed object and aborts the transaction
  */
@@ -527,6 +628,12 @@ main(int argc, char *argv[])
 	VALGRIND_WRITE_STATS;
 	do_tx_alloc_huge(pop);
 	VALGRIND_WRITE_STATS;
+	do_tx_alloc_bulk_commit(pop);
+	VALGRIND_WRITE_STATS;
+	do_tx_alloc_bulk_abort(pop);
+	VALGRIND_WRITE_STATS;
+	do_tx_alloc_bulk_zerolen(pop);
+	VALGRIND_WRITE_STATS;
 	do_tx_zalloc_commit(pop);
 	VALGRIND_WRITE_STATS;
 	do_tx_zalloc_abort(pop);
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_async_free.c -- unit test for freeing objects in the background
+ *
+ * usage: obj_tx_async_free file
+ *
+ * The threads repeatedly allocate a few objects and free them all in a
+ * transaction, many times more memory than the pool has in total, so that
+ * the objects freed in the background must be reused. All of them have to be
+ * freed once the pool is closed.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "async_free"
+#define POOL_SIZE (PMEMOBJ_MIN_POOL * 4)
+#define NTHREADS 4
+#define NLOOPS 100
+#define NOBJS 8
+#define OBJ_SIZE (1 << 15)
+
+static PMEMobjpool *Pop;
+
+/*
+ * worker -- (internal) allocates the objects and frees them in a transaction
+ */
+static void *
+worker(void *arg)
+{
+	PMEMoid oids[NOBJS];
+
+	for (unsigned i = 0; i < NLOOPS; ++i) {
+		for (unsigned j = 0; j < NOBJS; ++j) {
+			int ret = pmemobj_alloc(Pop, &oids[j], OBJ_SIZE, 0,
+					NULL, NULL);
+			UT_ASSERTeq(ret, 0);
+		}
+
+		TX_BEGIN(Pop) {
+			for (unsigned j = 0; j < NOBJS; ++j)
+				pmemobj_tx_free(oids[j]);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_async_free");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, POOL_SIZE, S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, NULL);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	pmemobj_close(Pop);
+
+	Pop = pmemobj_open(path, LAYOUT);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	UT_ASSERT(OID_IS_NULL(pmemobj_first(Pop)));
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
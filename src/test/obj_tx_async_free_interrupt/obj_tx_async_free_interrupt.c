@@ -0,0 +1,158 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_async_free_interrupt.c -- unit test for a crash after the commit of
+ *	a transaction whose frees are left to the background reclaimer
+ *
+ * usage: obj_tx_async_free_interrupt file c|o
+ *
+ * The transaction defers a write to the root object and frees another object.
+ * Once it's committed, and before the reclaimer frees the object, the root
+ * object is modified again and the process exits. The open must recover the
+ * transaction without undoing that modification.
+ */
+
+#include "lane.h"
+#include "unittest.h"
+
+#define LAYOUT "async_free_interrupt"
+
+struct root {
+	uint64_t value;
+};
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Cond = PTHREAD_COND_INITIALIZER;
+static int Exit_on_reclaim;
+
+/*
+ * lane_take_over -- called by the reclaimer before it frees the objects,
+ *	exits once the main thread is done with its writes
+ */
+FUNC_MOCK(lane_take_over, void, PMEMobjpool *pop, uint64_t idx,
+	enum lane_section_type type)
+	FUNC_MOCK_RUN_DEFAULT {
+		pthread_mutex_lock(&Lock);
+		while (Exit_on_reclaim == 1)
+			pthread_cond_wait(&Cond, &Lock);
+		int exit_now = Exit_on_reclaim != 0;
+		pthread_mutex_unlock(&Lock);
+
+		if (exit_now)
+			_exit(0);
+
+		_FUNC_REAL(lane_take_over)(pop, idx, type);
+	}
+FUNC_MOCK_END
+
+/*
+ * do_create -- (internal) commits the transaction and exits before the
+ *	reclaimer frees the object
+ */
+static void
+do_create(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *rootp = pmemobj_direct(root);
+
+	PMEMoid oid;
+	int ret = pmemobj_alloc(pop, &oid, 64, 0, NULL, NULL);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_mutex_lock(&Lock);
+	Exit_on_reclaim = 1;
+	pthread_mutex_unlock(&Lock);
+
+	TX_BEGIN(pop) {
+		uint64_t value = 1;
+		pmemobj_tx_write(&rootp->value, &value, sizeof(value));
+		pmemobj_tx_free(oid);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(rootp->value, 1);
+
+	rootp->value = 2;
+	pmemobj_persist(pop, &rootp->value, sizeof(rootp->value));
+
+	pthread_mutex_lock(&Lock);
+	Exit_on_reclaim = 2;
+	pthread_cond_signal(&Cond);
+	pthread_mutex_unlock(&Lock);
+
+	/* waits for the reclaimer, which exits */
+	pmemobj_close(pop);
+
+	UT_FATAL("the object was not left to the reclaimer");
+}
+
+/*
+ * do_open -- (internal) verifies the recovered pool
+ */
+static void
+do_open(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	PMEMoid root = pmemobj_root(pop, sizeof(struct root));
+	struct root *rootp = pmemobj_direct(root);
+
+	UT_ASSERTeq(rootp->value, 2);
+	UT_ASSERT(OID_IS_NULL(pmemobj_first(pop)));
+
+	pmemobj_close(pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_async_free_interrupt");
+
+	if (argc != 3 || (argv[2][0] != 'c' && argv[2][0] != 'o'))
+		UT_FATAL("usage: %s file c|o", argv[0]);
+
+	if (argv[2][0] == 'c')
+		do_create(argv[1]);
+	else
+		do_open(argv[1]);
+
+	DONE(NULL);
+}
@@ -256,6 +256,62 @@ do_tx_process_nested(PMEMobjpool *pop)
 	UT_ASSERT(pmemobj_tx_stage() == TX_STAGE_NONE);
 }
 
+static void
+do_tx_read_only(PMEMobjpool *pop, TOID(struct test_obj) *obj)
+{
+	D_RW(*obj)->a = TEST_VALUE_A;
+	pmemobj_persist(pop, &D_RW(*obj)->a, sizeof(D_RW(*obj)->a));
+
+	/* transactions which don't modify the pool commit and abort as usual */
+	TX_BEGIN(pop) {
+		UT_ASSERT(D_RO(*obj)->a == TEST_VALUE_A);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERT(errno == EINVAL);
+
+	/* the first modification, in a nested transaction, is rolled back */
+	TX_BEGIN(pop) {
+		TX_BEGIN(pop) {
+			TX_SET(*obj, a, TEST_VALUE_B);
+		} TX_END
+		UT_ASSERT(D_RO(*obj)->a == TEST_VALUE_B);
+		pmemobj_tx_abort(EINVAL);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERT(D_RO(*obj)->a == TEST_VALUE_A);
+}
+
+static void
+do_tx_error_code(PMEMobjpool *pop, TOID(struct test_obj) *obj)
+{
+	D_RW(*obj)->a = TEST_VALUE_A;
+	pmemobj_persist(pop, &D_RW(*obj)->a, sizeof(D_RW(*obj)->a));
+
+	/* without an environment a failed operation returns to the caller */
+	UT_ASSERTeq(pmemobj_tx_begin(pop, NULL, TX_LOCK_NONE), 0);
+	UT_ASSERTeq(pmemobj_tx_add_range(obj->oid, 0,
+		sizeof(struct test_obj)), 0);
+	D_RW(*obj)->a = TEST_VALUE_B;
+
+	PMEMoid oid = pmemobj_tx_alloc(0, 0);
+	UT_ASSERT(OID_IS_NULL(oid));
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_ONABORT);
+	UT_ASSERTeq(pmemobj_tx_errno(), EINVAL);
+	UT_ASSERTeq(pmemobj_tx_end(), EINVAL);
+
+	UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_NONE);
+	UT_ASSERT(D_RO(*obj)->a == TEST_VALUE_A);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -284,6 +340,8 @@ main(int argc, char *argv[])
 	}
 	do_tx_process(pop);
 	do_tx_process_nested(pop);
+	do_tx_read_only(pop, &obj);
+	do_tx_error_code(pop, &obj);
 	pmemobj_close(pop);
 
 	DONE(NULL);
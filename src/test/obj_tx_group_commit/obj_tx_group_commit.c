@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_tx_group_commit.c -- unit test for committing transactions in groups
+ *
+ * usage: obj_tx_group_commit file
+ *
+ * The threads run their transactions in rounds, all of them committing at
+ * about the same time, so that with group commit enabled every round is
+ * committed as a single group. The number of fences of the transactions,
+ * after the first round which sets up the lanes, is printed to be compared
+ * with and without group commit, and the counters incremented by the
+ * transactions are checked after the pool is reopened.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "group_commit"
+#define NTHREADS 4
+#define NROUNDS 20
+
+struct root {
+	uint64_t counters[NTHREADS];
+};
+
+static PMEMobjpool *Pop;
+static struct root *Root;
+static pthread_barrier_t Round;
+
+/*
+ * tx_fences -- (internal) returns the number of fences of the transactions
+ */
+static uint64_t
+tx_fences(void)
+{
+	struct pobj_persist_stats stats[POBJ_PERSIST_OPS];
+	int ret = pmemobj_persist_stats(Pop, stats);
+	UT_ASSERTeq(ret, 0);
+
+	return stats[POBJ_PERSIST_TX].fences;
+}
+
+/*
+ * round_wait -- (internal) waits for all the threads to start the next round
+ */
+static void
+round_wait(void)
+{
+	int ret = pthread_barrier_wait(&Round);
+	UT_ASSERT(ret == 0 || ret == PTHREAD_BARRIER_SERIAL_THREAD);
+}
+
+/*
+ * worker -- (internal) increments the counter of the thread in a transaction
+ *	in every round
+ */
+static void *
+worker(void *arg)
+{
+	uint64_t *counter = &Root->counters[(uintptr_t)arg];
+
+	for (unsigned i = 0; i < NROUNDS; ++i) {
+		round_wait();
+
+		TX_BEGIN(Pop) {
+			pmemobj_tx_add_range_direct(counter, sizeof(*counter));
+			*counter += 1;
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		round_wait();
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_group_commit");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	Root = pmemobj_direct(pmemobj_root(Pop, sizeof(struct root)));
+	UT_ASSERTne(Root, NULL);
+
+	int ret = pthread_barrier_init(&Round, NULL, NTHREADS + 1);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_t threads[NTHREADS];
+	for (uintptr_t i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, (void *)i);
+
+	uint64_t fences = 0;
+	for (unsigned i = 0; i < NROUNDS; ++i) {
+		uint64_t before = tx_fences();
+		round_wait();
+		round_wait();
+
+		/* the first round is when the lanes are set up */
+		if (i != 0)
+			fences += tx_fences() - before;
+	}
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	pthread_barrier_destroy(&Round);
+
+	UT_OUT("fences %ju", fences);
+
+	pmemobj_close(Pop);
+
+	Pop = pmemobj_open(path, LAYOUT);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	Root = pmemobj_direct(pmemobj_root(Pop, sizeof(struct root)));
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		UT_ASSERTeq(Root->counters[i], NROUNDS);
+
+	pmemobj_close(Pop);
+
+	DONE(NULL);
+}
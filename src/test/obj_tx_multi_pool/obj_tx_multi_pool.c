@@ -0,0 +1,228 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_multi_pool.c -- unit test for transactions spanning multiple pools
+ *
+ * usage: obj_tx_multi_pool file1 file2
+ *
+ * A nested transaction started for the second pool makes the outer one span
+ * both of them, the changes of which must be committed or rolled back
+ * together.
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "multi_pool"
+#define NPOOLS 2
+
+struct root {
+	uint64_t value;
+	PMEMoid obj;
+};
+
+static PMEMobjpool *Pops[NPOOLS];
+
+/*
+ * root_get -- (internal) returns the root object of the pool
+ */
+static struct root *
+root_get(PMEMobjpool *pop)
+{
+	return pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+}
+
+/*
+ * root_set -- (internal) sets the value of the root object in a transaction
+ */
+static void
+root_set(PMEMobjpool *pop, uint64_t value)
+{
+	struct root *root = root_get(pop);
+
+	pmemobj_tx_add_range_direct(&root->value, sizeof(root->value));
+	root->value = value;
+}
+
+/*
+ * root_alloc -- (internal) allocates the object of the root object in
+ *	a transaction
+ */
+static void
+root_alloc(PMEMobjpool *pop)
+{
+	struct root *root = root_get(pop);
+
+	pmemobj_tx_add_range_direct(&root->obj, sizeof(root->obj));
+	root->obj = pmemobj_tx_zalloc(sizeof(uint64_t), 0);
+}
+
+/*
+ * check_values -- (internal) verifies the values of the roots of the pools
+ */
+static void
+check_values(uint64_t v0, uint64_t v1)
+{
+	UT_ASSERTeq(root_get(Pops[0])->value, v0);
+	UT_ASSERTeq(root_get(Pops[1])->value, v1);
+}
+
+/*
+ * test_commit -- (internal) commits the changes made to both pools
+ */
+static void
+test_commit(void)
+{
+	TX_BEGIN(Pops[0]) {
+		root_set(Pops[0], 1);
+
+		TX_BEGIN(Pops[1]) {
+			root_set(Pops[1], 1);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		/* the pool of the outer transaction is current again */
+		root_alloc(Pops[0]);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(1, 1);
+
+	PMEMoid obj = root_get(Pops[0])->obj;
+	UT_ASSERTeq(pmemobj_pool_by_oid(obj), Pops[0]);
+}
+
+/*
+ * test_abort -- (internal) aborts the transaction in the nested one, which
+ *	rolls back the changes made to both pools
+ */
+static void
+test_abort(void)
+{
+	int aborted = 0;
+
+	TX_BEGIN(Pops[0]) {
+		root_set(Pops[0], 2);
+
+		TX_BEGIN(Pops[1]) {
+			root_set(Pops[1], 2);
+			root_alloc(Pops[1]);
+			pmemobj_tx_abort(ECANCELED);
+		} TX_END
+	} TX_ONABORT {
+		aborted = 1;
+	} TX_END
+
+	UT_ASSERT(aborted);
+	check_values(1, 1);
+	UT_ASSERT(OID_IS_NULL(root_get(Pops[1])->obj));
+}
+
+/*
+ * test_nested_only -- (internal) commits the changes made only to the pool of
+ *	the nested transaction
+ */
+static void
+test_nested_only(void)
+{
+	TX_BEGIN(Pops[0]) {
+		TX_BEGIN(Pops[1]) {
+			root_set(Pops[1], 3);
+		} TX_END
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(1, 3);
+}
+
+/*
+ * test_reenter -- (internal) modifies both pools again after the pool of the
+ *	outer transaction is current again
+ */
+static void
+test_reenter(void)
+{
+	TX_BEGIN(Pops[1]) {
+		TX_BEGIN(Pops[0]) {
+			root_set(Pops[0], 4);
+		} TX_END
+
+		root_set(Pops[1], 4);
+
+		TX_BEGIN(Pops[0]) {
+			root_set(Pops[0], 5);
+		} TX_END
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(5, 4);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_multi_pool");
+
+	if (argc != NPOOLS + 1)
+		UT_FATAL("usage: %s file1 file2", argv[0]);
+
+	for (int i = 0; i < NPOOLS; ++i) {
+		Pops[i] = pmemobj_create(argv[i + 1], LAYOUT,
+				PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+		if (Pops[i] == NULL)
+			UT_FATAL("!pmemobj_create: %s", argv[i + 1]);
+	}
+
+	test_commit();
+	test_abort();
+	test_nested_only();
+	test_reenter();
+
+	for (int i = 0; i < NPOOLS; ++i) {
+		pmemobj_close(Pops[i]);
+
+		Pops[i] = pmemobj_open(argv[i + 1], LAYOUT);
+		if (Pops[i] == NULL)
+			UT_FATAL("!pmemobj_open: %s", argv[i + 1]);
+	}
+
+	check_values(5, 4);
+
+	for (int i = 0; i < NPOOLS; ++i)
+		pmemobj_close(Pops[i]);
+
+	DONE(NULL);
+}
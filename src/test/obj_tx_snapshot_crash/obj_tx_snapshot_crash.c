@@ -0,0 +1,356 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * obj_tx_snapshot_crash.c -- unit test for a crash while a large range is
+ *	added to a transaction
+ *
+ * usage: obj_tx_snapshot_crash file crash-file
+ *
+ * The flushes and fences of the pool are tracked and only the data flushed
+ * before a fence is copied to an image of the pool, which is what survives
+ * a crash. A child process runs a transaction which snapshots and modifies
+ * an object, and dumps the image at one of its fences - each run crashes at
+ * the next one. The dumped pool has to recover to either the old or, once
+ * the transaction was committed, the new content of the object.
+ *
+ * All runs use the same pool, so the old content and the range differ between
+ * them - otherwise a lost write could be masked by the identical data left in
+ * the same place by the previous run.
+ */
+
+#include <sys/wait.h>
+
+#include "unittest.h"
+
+#define LAYOUT "tx_snapshot_crash"
+
+/* larger than MAX_CACHED_RANGE_SIZE, so it doesn't go to the range cache */
+#define OBJ_SIZE (64 * 1024)
+
+#define NEW_VAL 0x22
+
+#define CACHELINE 64
+#define MAX_PENDING 4096
+
+/* exit statuses of the child */
+#define CRASHED_IN_WORK 0
+#define CRASHED_IN_COMMIT 1
+#define COMPLETED 2
+
+/* the durable image of the pool, tracking is enabled if it's not NULL */
+static char *Image;
+static uintptr_t Pool_beg;
+static size_t Pool_size;
+
+/* the ranges flushed since the last fence */
+static struct {
+	uintptr_t beg;
+	uintptr_t end;
+} Pending[MAX_PENDING];
+static unsigned Npending;
+
+static unsigned Fences;
+static unsigned Crash_at;
+static int In_work;
+static const char *Crash_file;
+
+/*
+ * image_dump -- (internal) writes the durable image to the crash file and
+ *	terminates the process
+ */
+static void
+image_dump(void)
+{
+	int fd = OPEN(Crash_file, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	WRITE(fd, Image, Pool_size);
+	CLOSE(fd);
+
+	_exit(In_work ? CRASHED_IN_WORK : CRASHED_IN_COMMIT);
+}
+
+/*
+ * model_flush -- (internal) marks the cache lines of the range as pending
+ */
+static void
+model_flush(const void *addr, size_t len)
+{
+	if (Image == NULL || len == 0)
+		return;
+
+	uintptr_t beg = (uintptr_t)addr & ~(uintptr_t)(CACHELINE - 1);
+	uintptr_t end = ((uintptr_t)addr + len + CACHELINE - 1) &
+		~(uintptr_t)(CACHELINE - 1);
+
+	if (end <= Pool_beg || beg >= Pool_beg + Pool_size)
+		return;
+
+	UT_ASSERT(Npending < MAX_PENDING);
+	Pending[Npending].beg = beg;
+	Pending[Npending].end = end;
+	Npending++;
+}
+
+/*
+ * model_drain -- (internal) makes the pending ranges durable, unless the
+ *	crash happens at this fence
+ */
+static void
+model_drain(void)
+{
+	if (Image == NULL)
+		return;
+
+	if (++Fences == Crash_at)
+		image_dump();
+
+	for (unsigned i = 0; i < Npending; ++i) {
+		uintptr_t beg = Pending[i].beg;
+		uintptr_t end = Pending[i].end;
+		if (beg < Pool_beg)
+			beg = Pool_beg;
+		if (end > Pool_beg + Pool_size)
+			end = Pool_beg + Pool_size;
+
+		memcpy(Image + (beg - Pool_beg), (void *)beg, end - beg);
+	}
+
+	Npending = 0;
+}
+
+FUNC_MOCK(pmem_flush, void, const void *addr, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		_FUNC_REAL(pmem_flush)(addr, len);
+		model_flush(addr, len);
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_drain, void, void)
+	FUNC_MOCK_RUN_DEFAULT {
+		_FUNC_REAL(pmem_drain)();
+		model_drain();
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_persist, void, const void *addr, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		_FUNC_REAL(pmem_persist)(addr, len);
+		model_flush(addr, len);
+		model_drain();
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_memcpy_nodrain, void *, void *dest, const void *src,
+		size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		void *ret = _FUNC_REAL(pmem_memcpy_nodrain)(dest, src, len);
+		model_flush(dest, len);
+		return ret;
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_memset_nodrain, void *, void *dest, int c, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		void *ret = _FUNC_REAL(pmem_memset_nodrain)(dest, c, len);
+		model_flush(dest, len);
+		return ret;
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_memcpy_persist, void *, void *dest, const void *src,
+		size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		void *ret = _FUNC_REAL(pmem_memcpy_persist)(dest, src, len);
+		model_flush(dest, len);
+		model_drain();
+		return ret;
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(pmem_memset_persist, void *, void *dest, int c, size_t len)
+	FUNC_MOCK_RUN_DEFAULT {
+		void *ret = _FUNC_REAL(pmem_memset_persist)(dest, c, len);
+		model_flush(dest, len);
+		model_drain();
+		return ret;
+	}
+FUNC_MOCK_END
+
+/*
+ * old_val -- (internal) returns the content of the object before the run
+ */
+static char
+old_val(unsigned run)
+{
+	return (char)(0x40 + run % 0x40);
+}
+
+/*
+ * range_off -- (internal) returns the offset of the range added in the run
+ */
+static size_t
+range_off(unsigned run)
+{
+	return (run % 2) * CACHELINE;
+}
+
+/*
+ * run_tx -- (internal) modifies the object in a transaction, crashing at the
+ *	given fence; the pool left by the previous run is recovered on open
+ */
+static void
+run_tx(const char *path)
+{
+	PMEMobjpool *pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	PMEMoid root = pmemobj_root(pop, OBJ_SIZE);
+	char *obj = pmemobj_direct(root);
+	pmemobj_memset_persist(pop, obj, old_val(Crash_at), OBJ_SIZE);
+
+	/*
+	 * Everything written until now is durable. The file is read instead of
+	 * the mapping, parts of which may be inaccessible.
+	 */
+	char *image = MALLOC(Pool_size);
+	int fd = OPEN(path, O_RDONLY);
+	UT_ASSERTeq(READ(fd, image, Pool_size), Pool_size);
+	CLOSE(fd);
+
+	Pool_beg = (uintptr_t)pop;
+	Image = image;
+
+	size_t off = range_off(Crash_at);
+
+	TX_BEGIN(pop) {
+		In_work = 1;
+		pmemobj_tx_add_range(root, off, OBJ_SIZE - off);
+		pmemobj_memset_persist(pop, obj + off, NEW_VAL, OBJ_SIZE - off);
+		In_work = 0;
+	} TX_END
+
+	_exit(COMPLETED);
+}
+
+/*
+ * check_obj -- (internal) checks that the object holds the old content before
+ *	the range and the given value in it
+ */
+static void
+check_obj(PMEMobjpool *pop, char val)
+{
+	char *obj = pmemobj_direct(pmemobj_root(pop, OBJ_SIZE));
+	char old = old_val(Crash_at);
+	size_t off = range_off(Crash_at);
+
+	for (size_t i = 0; i < OBJ_SIZE; ++i) {
+		char exp = i < off ? old : val;
+		if (obj[i] != exp)
+			UT_FATAL("fence %u: offset %zu not recovered",
+				Crash_at, i);
+	}
+}
+
+/*
+ * check_crash -- (internal) checks the object recovered from the dumped pool,
+ *	the range is either rolled back or, if the crash happened during the
+ *	commit, possibly committed
+ */
+static void
+check_crash(const char *crash_file, int committed)
+{
+	PMEMobjpool *pop = pmemobj_open(crash_file, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", crash_file);
+
+	char *obj = pmemobj_direct(pmemobj_root(pop, OBJ_SIZE));
+	char val = obj[range_off(Crash_at)];
+	if (val != old_val(Crash_at) && (!committed || val != NEW_VAL))
+		UT_FATAL("fence %u: unexpected value 0x%x", Crash_at,
+			(unsigned char)val);
+
+	check_obj(pop, val);
+
+	pmemobj_close(pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_snapshot_crash");
+
+	if (argc != 3)
+		UT_FATAL("usage: %s file crash-file", argv[0]);
+
+	const char *path = argv[1];
+	Crash_file = argv[2];
+
+	PMEMobjpool *pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	pmemobj_close(pop);
+
+	Pool_size = PMEMOBJ_MIN_POOL;
+
+	for (Crash_at = 1; ; ++Crash_at) {
+		pid_t pid = fork();
+		UT_ASSERT(pid >= 0);
+
+		if (pid == 0)
+			run_tx(path);
+
+		int status;
+		UT_ASSERTeq(waitpid(pid, &status, 0), pid);
+		UT_ASSERT(WIFEXITED(status));
+
+		if (WEXITSTATUS(status) == COMPLETED)
+			break;
+
+		check_crash(Crash_file,
+			WEXITSTATUS(status) == CRASHED_IN_COMMIT);
+	}
+
+	/* the last run wasn't interrupted */
+	pop = pmemobj_open(path, LAYOUT);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	check_obj(pop, NEW_VAL);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -54,11 +54,14 @@ enum type_number {
 	TYPE_ABORT_NESTED2,
 	TYPE_ABORT_AFTER_NESTED1,
 	TYPE_ABORT_AFTER_NESTED2,
+	TYPE_LARGE_COMMIT,
+	TYPE_LARGE_ABORT,
 };
 
 #define TEST_STR_1	"Test string 1"
 #define TEST_STR_2	"Test string 2"
 #define MAX_FUNC	2
+#define LARGE_STR_LEN	(64 * 1024)
 
 typedef void (*fn_tx_strdup)(TOID(char) *str, const char *s,
 						unsigned type_num);
@@ -282,6 +285,44 @@ do_tx_strdup_abort_after_nested(PMEMobjpool *pop)
 	UT_ASSERT(TOID_IS_NULL(str2));
 }
 
+/*
+ * do_tx_strdup_large -- duplicate a string large enough to be copied with
+ * non-temporal stores, commit one transaction and abort another
+ */
+static void
+do_tx_strdup_large(PMEMobjpool *pop)
+{
+	char *s = MALLOC(LARGE_STR_LEN + 1);
+	for (size_t i = 0; i < LARGE_STR_LEN; ++i)
+		s[i] = (char)('a' + i % 26);
+	s[LARGE_STR_LEN] = '\0';
+
+	TOID(char) str;
+	TX_BEGIN(pop) {
+		do_tx_strdup[counter](&str, s, TYPE_LARGE_COMMIT);
+		UT_ASSERT(!TOID_IS_NULL(str));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	TOID_ASSIGN(str, POBJ_FIRST_TYPE_NUM(pop, TYPE_LARGE_COMMIT));
+	UT_ASSERT(!TOID_IS_NULL(str));
+	UT_ASSERTeq(strcmp(s, D_RO(str)), 0);
+
+	TX_BEGIN(pop) {
+		do_tx_strdup[counter](&str, s, TYPE_LARGE_ABORT);
+		UT_ASSERT(!TOID_IS_NULL(str));
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	TOID_ASSIGN(str, POBJ_FIRST_TYPE_NUM(pop, TYPE_LARGE_ABORT));
+	UT_ASSERT(TOID_IS_NULL(str));
+
+	FREE(s);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -304,6 +345,7 @@ main(int argc, char *argv[])
 		do_tx_strdup_commit_nested(pop);
 		do_tx_strdup_abort_nested(pop);
 		do_tx_strdup_abort_after_nested(pop);
+		do_tx_strdup_large(pop);
 	}
 	pmemobj_close(pop);
 
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_write.c -- unit test for pmemobj_tx_write
+ */
+#include <string.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "tx_write"
+
+#define NVALUES 1024
+#define LARGE_SIZE (1 << 20) /* more than the initial size of the redo log */
+
+TOID_DECLARE_ROOT(struct root);
+TOID_DECLARE(struct large, 1);
+
+struct large {
+	uint8_t data[LARGE_SIZE];
+};
+
+struct root {
+	uint64_t values[NVALUES];
+	uint64_t snapshotted;
+	TOID(struct large) large;
+};
+
+/*
+ * tx_write_value -- (internal) defers the write of a single value
+ */
+static void
+tx_write_value(uint64_t *dest, uint64_t value)
+{
+	int ret = pmemobj_tx_write(dest, &value, sizeof(value));
+	UT_ASSERTeq(ret, 0);
+}
+
+/*
+ * check_values -- (internal) verifies that all values are set to the given
+ *	one, increased by their index
+ */
+static void
+check_values(TOID(struct root) root, uint64_t value)
+{
+	for (uint64_t i = 0; i < NVALUES; ++i)
+		UT_ASSERTeq(D_RO(root)->values[i], value + i);
+}
+
+/*
+ * test_commit -- the writes are applied only once the transaction commits
+ */
+static void
+test_commit(PMEMobjpool *pop, TOID(struct root) root)
+{
+	TX_BEGIN(pop) {
+		for (uint64_t i = 0; i < NVALUES; ++i)
+			tx_write_value(&D_RW(root)->values[i], 1 + i);
+
+		for (uint64_t i = 0; i < NVALUES; ++i)
+			UT_ASSERTeq(D_RO(root)->values[i], 0);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(root, 1);
+}
+
+/*
+ * test_abort -- the writes of an aborted transaction are discarded
+ */
+static void
+test_abort(PMEMobjpool *pop, TOID(struct root) root)
+{
+	TX_BEGIN(pop) {
+		for (uint64_t i = 0; i < NVALUES; ++i)
+			tx_write_value(&D_RW(root)->values[i], 100 + i);
+
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(root, 1);
+
+	/* the next transaction without any writes must not replay them */
+	TX_BEGIN(pop) {
+		TX_SET(root, snapshotted, 1);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(root, 1);
+}
+
+/*
+ * test_overlapping -- overlapping writes are applied in order, and after the
+ *	direct modifications of snapshotted ranges
+ */
+static void
+test_overlapping(PMEMobjpool *pop, TOID(struct root) root)
+{
+	TX_BEGIN(pop) {
+		uint64_t v[3] = {5, 6, 7};
+		pmemobj_tx_write(&D_RW(root)->values[0], v, sizeof(v));
+		tx_write_value(&D_RW(root)->values[1], 8);
+
+		TX_SET(root, snapshotted, 2);
+		tx_write_value(&D_RW(root)->snapshotted, 3);
+		UT_ASSERTeq(D_RO(root)->snapshotted, 2);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(root)->values[0], 5);
+	UT_ASSERTeq(D_RO(root)->values[1], 8);
+	UT_ASSERTeq(D_RO(root)->values[2], 7);
+	UT_ASSERTeq(D_RO(root)->snapshotted, 3);
+
+	TX_BEGIN(pop) {
+		uint64_t v[3] = {1, 2, 3};
+		pmemobj_tx_write(&D_RW(root)->values[0], v, sizeof(v));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(root, 1);
+}
+
+/*
+ * test_nested -- the writes of a nested transaction are applied with the
+ *	outermost one
+ */
+static void
+test_nested(PMEMobjpool *pop, TOID(struct root) root)
+{
+	TX_BEGIN(pop) {
+		tx_write_value(&D_RW(root)->values[0], 10);
+		TX_BEGIN(pop) {
+			tx_write_value(&D_RW(root)->values[1], 11);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		UT_ASSERTeq(D_RO(root)->values[1], 2);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(root)->values[0], 10);
+	UT_ASSERTeq(D_RO(root)->values[1], 11);
+
+	TX_BEGIN(pop) {
+		tx_write_value(&D_RW(root)->values[0], 1);
+		TX_BEGIN(pop) {
+			tx_write_value(&D_RW(root)->values[1], 20);
+			pmemobj_tx_abort(ECANCELED);
+		} TX_END
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(root)->values[0], 10);
+	UT_ASSERTeq(D_RO(root)->values[1], 11);
+
+	TX_BEGIN(pop) {
+		tx_write_value(&D_RW(root)->values[0], 1);
+		tx_write_value(&D_RW(root)->values[1], 2);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	check_values(root, 1);
+}
+
+/*
+ * test_large -- writes larger than the redo log grow it
+ */
+static void
+test_large(PMEMobjpool *pop, TOID(struct root) root)
+{
+	static uint8_t buf[LARGE_SIZE];
+	memset(buf, 0xc5, sizeof(buf));
+
+	TX_BEGIN(pop) {
+		TX_SET(root, large, TX_ZNEW(struct large));
+		pmemobj_tx_write(D_RW(D_RW(root)->large)->data, buf,
+			LARGE_SIZE);
+		for (uint64_t i = 0; i < NVALUES; ++i)
+			tx_write_value(&D_RW(root)->values[i], 2 + i);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(memcmp(D_RO(D_RO(root)->large)->data, buf, LARGE_SIZE), 0);
+	check_values(root, 2);
+}
+
+/*
+ * test_invalid -- writes outside of the heap abort the transaction
+ */
+static void
+test_invalid(PMEMobjpool *pop)
+{
+	uint64_t value = 0;
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(&value, &value, sizeof(value));
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(errno, EINVAL);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_write");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	PMEMobjpool *pop = pmemobj_create(argv[1], LAYOUT_NAME,
+		PMEMOBJ_MIN_POOL * 4, S_IWUSR | S_IRUSR);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", argv[1]);
+
+	TOID(struct root) root = POBJ_ROOT(pop, struct root);
+
+	test_commit(pop, root);
+	test_abort(pop, root);
+	test_overlapping(pop, root);
+	test_nested(pop, root);
+	test_large(pop, root);
+	test_invalid(pop);
+
+	pmemobj_close(pop);
+
+	pop = pmemobj_open(argv[1], LAYOUT_NAME);
+	if (pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", argv[1]);
+
+	root = POBJ_ROOT(pop, struct root);
+	check_values(root, 2);
+	UT_ASSERTeq(D_RO(root)->snapshotted, 3);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
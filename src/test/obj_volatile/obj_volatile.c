@@ -0,0 +1,162 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_volatile.c -- unit test for the volatile state of persistent objects
+ *
+ * usage: obj_volatile file
+ */
+
+#include "unittest.h"
+
+#define LAYOUT "volatile"
+#define NTHREADS 8
+
+struct vstate {
+	PMEMmutex *lock; /* a pointer to a DRAM structure */
+	unsigned run;
+};
+
+struct root {
+	uint64_t value;
+	PMEMvlt(struct vstate) state;
+};
+
+static PMEMobjpool *Pop;
+static struct root *Root;
+static unsigned Nconstr;
+static unsigned Run;
+
+/*
+ * vstate_constr -- (internal) initializes the volatile state, fails when the
+ *	argument is non-zero
+ */
+static int
+vstate_constr(void *ptr, void *arg)
+{
+	struct vstate *vs = ptr;
+
+	UT_ASSERTeq(vs->lock, NULL);
+	UT_ASSERTeq(vs->run, 0);
+
+	if (arg != NULL)
+		return 1;
+
+	__sync_fetch_and_add(&Nconstr, 1);
+
+	vs->lock = MALLOC(sizeof(*vs->lock));
+	vs->run = Run;
+
+	return 0;
+}
+
+/*
+ * vstate_get -- (internal) returns the volatile state of the root object
+ */
+static struct vstate *
+vstate_get(void *arg)
+{
+	return pmemobj_volatile(Pop, &Root->state.vlt, &Root->state.value,
+		sizeof(Root->state.value), vstate_constr, arg);
+}
+
+/*
+ * worker -- (internal) accesses the volatile state of the root object
+ */
+static void *
+worker(void *arg)
+{
+	for (unsigned i = 0; i < 1000; ++i) {
+		struct vstate *vs = vstate_get(NULL);
+		UT_ASSERTne(vs, NULL);
+		UT_ASSERTne(vs->lock, NULL);
+		UT_ASSERTeq(vs->run, Run);
+	}
+
+	return NULL;
+}
+
+/*
+ * run -- (internal) opens the pool and accesses the volatile state of its
+ *	root object from a few threads
+ */
+static void
+run(const char *path)
+{
+	Pop = pmemobj_open(path, LAYOUT);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	Root = pmemobj_direct(pmemobj_root(Pop, sizeof(*Root)));
+	Run++;
+	Nconstr = 0;
+
+	/* a failed constructor leaves the state uninitialized */
+	UT_ASSERTeq(vstate_get((void *)1), NULL);
+
+	pthread_t threads[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, worker, NULL);
+
+	for (unsigned i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	UT_ASSERTeq(Nconstr, 1);
+
+	struct vstate *vs = vstate_get(NULL);
+	FREE(vs->lock);
+
+	/* the volatile state is left as is in the pool */
+	pmemobj_close(Pop);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_volatile");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	const char *path = argv[1];
+
+	Pop = pmemobj_create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	if (Pop == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+	pmemobj_close(Pop);
+
+	run(path);
+	run(path);
+
+	DONE(NULL);
+}
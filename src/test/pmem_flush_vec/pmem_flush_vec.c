@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pmem_flush_vec.c -- unit test for pmem_flush_vec() and pmem_persist_vec()
+ *
+ * usage: pmem_flush_vec file
+ *
+ * The cache line spans actually flushed are verified by the test scripts
+ * from the libpmem debug log.
+ */
+
+#include "unittest.h"
+
+#define NRANGES_MAX 41
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_flush_vec");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	size_t mapped_len;
+	char *base = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (base == NULL)
+		UT_FATAL("!Could not mmap %s", argv[1]);
+
+	struct pmem_range ranges[NRANGES_MAX];
+
+	/* unsorted, adjacent and empty ranges -- a single span of 192 */
+	ranges[0].addr = base + 128;
+	ranges[0].len = 10;
+	ranges[1].addr = base;
+	ranges[1].len = 64;
+	ranges[2].addr = base + 64;
+	ranges[2].len = 1;
+	ranges[3].addr = base + 4096;
+	ranges[3].len = 0;
+	pmem_persist_vec(ranges, 4);
+
+	/* overlapping unaligned ranges and a separate one -- 320 and 64 */
+	ranges[0].addr = base + 8192;
+	ranges[0].len = 64;
+	ranges[1].addr = base + 1000;
+	ranges[1].len = 100;
+	ranges[2].addr = base + 1050;
+	ranges[2].len = 200;
+	pmem_persist_vec(ranges, 3);
+
+	/* more ranges than fit on the stack -- a single span of 5120 */
+	for (int i = 0; i < NRANGES_MAX - 1; i++) {
+		ranges[i].addr = base + (NRANGES_MAX - 2 - i) * 128;
+		ranges[i].len = 64;
+	}
+	ranges[NRANGES_MAX - 1].addr = base;
+	ranges[NRANGES_MAX - 1].len = (NRANGES_MAX - 1) * 128;
+	pmem_persist_vec(ranges, NRANGES_MAX);
+
+	/* no drain for pmem_flush_vec() */
+	ranges[0].addr = base + 64;
+	ranges[0].len = 128;
+	pmem_flush_vec(ranges, 1);
+
+	/* nothing to flush */
+	pmem_persist_vec(ranges, 0);
+
+	pmem_unmap(base, mapped_len);
+
+	DONE(NULL);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_is_pmem_cache.c -- unit test for the pmem_is_pmem() range index
+ *
+ * usage: pmem_is_pmem_cache file
+ *
+ * Verifies that looking up ranges within a mapping created by
+ * pmem_map_file() does not parse /proc/self/smaps again, and that
+ * unmapped ranges are dropped from the index.
+ */
+
+#define _GNU_SOURCE
+#include "unittest.h"
+
+#include <dlfcn.h>
+
+static int Smaps_opens;
+
+/*
+ * fopen -- interpose on libc fopen()
+ *
+ * This counts the opens of /proc/self/smaps.
+ */
+FILE *
+fopen(const char *path, const char *mode)
+{
+	static FILE *(*fopen_ptr)(const char *path, const char *mode);
+
+	if (strcmp(path, "/proc/self/smaps") == 0)
+		Smaps_opens++;
+
+	if (fopen_ptr == NULL)
+		fopen_ptr = dlsym(RTLD_NEXT, "fopen");
+
+	return (*fopen_ptr)(path, mode);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_is_pmem_cache");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	size_t mapped_len;
+	int is_pmem;
+	char *addr = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, &is_pmem);
+	if (addr == NULL)
+		UT_FATAL("!pmem_map_file");
+
+	UT_OUT("after map: %d", Smaps_opens);
+
+	/* any range within the mapping */
+	UT_ASSERTeq(pmem_is_pmem(addr, mapped_len), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr + 1, 4096), is_pmem);
+	UT_ASSERTeq(pmem_is_pmem(addr + mapped_len - 1, 1), is_pmem);
+	UT_OUT("within mapping: %d", Smaps_opens);
+
+	/* range extending past the mapping */
+	UT_ASSERTeq(pmem_is_pmem(addr, mapped_len + 1), 0);
+	UT_OUT("past mapping: %d", Smaps_opens);
+
+	/* unmap the upper half */
+	size_t half = mapped_len / 2;
+	UT_ASSERTeq(pmem_unmap(addr + half, mapped_len - half), 0);
+
+	UT_ASSERTeq(pmem_is_pmem(addr, half), is_pmem);
+	UT_OUT("lower half: %d", Smaps_opens);
+
+	UT_ASSERTeq(pmem_is_pmem(addr + half, 4096), 0);
+	UT_OUT("upper half: %d", Smaps_opens);
+
+	UT_ASSERTeq(pmem_unmap(addr, half), 0);
+
+	DONE(NULL);
+}
@@ -87,7 +87,8 @@ signal_handler(int sig)
 }
 
 #define PMEM_FILE_ALL_FLAGS\
-	(PMEM_FILE_CREATE|PMEM_FILE_EXCL|PMEM_FILE_SPARSE|PMEM_FILE_TMPFILE)
+	(PMEM_FILE_CREATE|PMEM_FILE_EXCL|PMEM_FILE_SPARSE|PMEM_FILE_TMPFILE|\
+	PMEM_FILE_POPULATE)
 
 /*
  * parse_flags -- parse 'flags' string
@@ -114,6 +115,9 @@ parse_flags(const char *flags_str)
 		case 'E':
 			ret |= PMEM_FILE_EXCL;
 			break;
+		case 'P':
+			ret |= PMEM_FILE_POPULATE;
+			break;
 		case 'X':
 			/* not supported flag */
 			ret |= (PMEM_FILE_ALL_FLAGS + 1);
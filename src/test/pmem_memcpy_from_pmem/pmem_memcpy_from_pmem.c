@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * pmem_memcpy_from_pmem.c -- unit test for pmem_memcpy_from_pmem()
+ *
+ * usage: pmem_memcpy_from_pmem file
+ */
+
+#include "unittest.h"
+
+#define COPY_SIZE (1 << 20)
+
+/*
+ * do_memcpy -- copy len bytes at the given source offset and verify them
+ */
+static void
+do_memcpy(char *dest, const char *src, size_t off, size_t len)
+{
+	memset(dest, 0, COPY_SIZE + 1);
+
+	void *ret = pmem_memcpy_from_pmem(dest + 1, src + off, len);
+	UT_ASSERTeq(ret, dest + 1);
+
+	UT_ASSERTeq(dest[0], 0);
+	UT_ASSERTeq(memcmp(dest + 1, src + off, len), 0);
+	UT_ASSERTeq(dest[len + 1], 0);
+
+	UT_OUT("off %zu len %zu", off, len);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_memcpy_from_pmem");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	size_t mapped_len;
+	char *src = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, NULL);
+	if (src == NULL)
+		UT_FATAL("!Could not mmap %s", argv[1]);
+	UT_ASSERT(mapped_len >= COPY_SIZE + 4096);
+
+	for (size_t i = 0; i < mapped_len; i++)
+		src[i] = (char)(i % 251 + 1);
+	pmem_persist(src, mapped_len);
+
+	/* one more byte, so that the copy is at an odd address */
+	char *dest = MALLOC(COPY_SIZE + 2);
+
+	do_memcpy(dest, src, 0, 100);
+	do_memcpy(dest, src, 0, COPY_SIZE);
+	do_memcpy(dest, src, 7, COPY_SIZE);
+	do_memcpy(dest, src, 64, 4096 + 127);
+	do_memcpy(dest, src, 4095, 5000);
+
+	FREE(dest);
+	pmem_unmap(src, mapped_len);
+
+	DONE(NULL);
+}
@@ -57,6 +57,7 @@
 #define NLANES		1024
 #define SOCK_NLANES	32
 #define NTHREADS	32
+#define NRANGES		4
 #define TOTAL_PER_LANE	(SIZE_PER_LANE * COUNT_PER_LANE)
 #define POOL_SIZE	(NLANES * TOTAL_PER_LANE)
 
@@ -70,6 +71,10 @@ TEST_CASE_DECLARE(server_connect);
 TEST_CASE_DECLARE(server_process);
 TEST_CASE_DECLARE(client_persist);
 TEST_CASE_DECLARE(client_persist_mt);
+TEST_CASE_DECLARE(client_persist_async);
+TEST_CASE_DECLARE(client_persistv);
+TEST_CASE_DECLARE(client_flush);
+TEST_CASE_DECLARE(client_stats);
 TEST_CASE_DECLARE(client_read);
 
 /*
@@ -178,6 +183,71 @@ client_persist_thread(void *arg)
 	return NULL;
 }
 
+/*
+ * client_persistv_thread -- thread callback for vectored persist operation
+ *
+ * Each call persists NRANGES disjoint chunks of the lane's area.
+ */
+static void *
+client_persistv_thread(void *arg)
+{
+	struct persist_arg *args = arg;
+	struct rpmem_range ranges[NRANGES];
+	unsigned stride = COUNT_PER_LANE / NRANGES;
+	int ret;
+
+	for (unsigned i = 0; i < stride; i++) {
+		for (unsigned j = 0; j < NRANGES; j++) {
+			unsigned chunk = j * stride + i;
+			size_t offset = args->lane * TOTAL_PER_LANE +
+				chunk * SIZE_PER_LANE;
+			unsigned val = args->lane + chunk;
+			memset(&lpool[offset], val, SIZE_PER_LANE);
+
+			ranges[j].offset = offset;
+			ranges[j].length = SIZE_PER_LANE;
+		}
+
+		ret = rpmem_fip_persistv(args->fip, ranges, NRANGES,
+				args->lane);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	return NULL;
+}
+
+/*
+ * client_flush_thread -- thread callback for flush and drain operations
+ *
+ * All chunks of the lane's area are flushed and then drained at once,
+ * which also covers the implicit drain of a lane with too many flushes.
+ */
+static void *
+client_flush_thread(void *arg)
+{
+	struct persist_arg *args = arg;
+	int ret;
+
+	for (unsigned i = 0; i < COUNT_PER_LANE; i++) {
+		size_t offset = args->lane * TOTAL_PER_LANE + i * SIZE_PER_LANE;
+		unsigned val = args->lane + i;
+		memset(&lpool[offset], val, SIZE_PER_LANE);
+
+		ret = rpmem_fip_flush(args->fip, offset,
+				SIZE_PER_LANE, args->lane);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	ret = rpmem_fip_drain(args->fip, args->lane);
+	UT_ASSERTeq(ret, 0);
+
+	/* nothing flushed since the last drain */
+	ret = rpmem_fip_drain(args->fip, args->lane);
+	UT_ASSERTeq(ret, 0);
+
+	return NULL;
+}
+
 /*
  * client_init -- test case for client initialization
  */
@@ -641,6 +711,437 @@ client_persist_mt(const struct test_case *tc, int argc, char *argv[])
 	return 3;
 }
 
+/*
+ * client_persistv -- test case for multi-threaded vectored persist operation
+ */
+int
+client_persistv(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 3)
+		UT_FATAL("usage: %s <target> <provider> <persist method>",
+				tc->name);
+
+	char *target = argv[0];
+	char *prov_name = argv[1];
+	char *persist_method = argv[2];
+
+	set_rpmem_cmd("server_process %s", persist_method);
+
+	char fip_service[NI_MAXSERV];
+	struct rpmem_target_info *info;
+	int ret;
+
+	info = rpmem_target_parse(target);
+	UT_ASSERTne(info, NULL);
+
+	set_pool_data(lpool, 1);
+	set_pool_data(rpool, 1);
+
+	unsigned nlanes;
+	enum rpmem_provider provider = get_provider(info->node,
+			prov_name, &nlanes);
+
+	client_t *client;
+	struct rpmem_resp_attr resp;
+	client = client_exchange(info, NLANES, provider, &resp);
+
+	struct rpmem_fip_attr attr = {
+		.provider = provider,
+		.persist_method = resp.persist_method,
+		.laddr = lpool,
+		.size = POOL_SIZE,
+		.nlanes = resp.nlanes,
+		.raddr = (void *)resp.raddr,
+		.rkey = resp.rkey,
+	};
+
+	ssize_t sret = snprintf(fip_service, NI_MAXSERV, "%u", resp.port);
+	UT_ASSERT(sret > 0);
+
+	struct rpmem_fip *fip;
+	fip = rpmem_fip_init(info->node, fip_service, &attr, &nlanes);
+	UT_ASSERTne(fip, NULL);
+
+	ret = rpmem_fip_connect(fip);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_start(fip);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_t *persist_thread = MALLOC(resp.nlanes * sizeof(pthread_t));
+	struct persist_arg *args = MALLOC(resp.nlanes *
+			sizeof(struct persist_arg));
+
+	for (unsigned i = 0; i < nlanes; i++) {
+		args[i].fip = fip;
+		args[i].lane = i;
+		PTHREAD_CREATE(&persist_thread[i], NULL,
+				client_persistv_thread, &args[i]);
+	}
+
+	for (unsigned i = 0; i < nlanes; i++)
+		PTHREAD_JOIN(persist_thread[i], NULL);
+
+	ret = rpmem_fip_read(fip, rpool, POOL_SIZE, 0);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_stop(fip);
+	UT_ASSERTeq(ret, 0);
+
+	client_close(client);
+
+	ret = rpmem_fip_close(fip);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_fip_fini(fip);
+
+	FREE(persist_thread);
+	FREE(args);
+
+	ret = memcmp(rpool, lpool, POOL_SIZE);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_target_free(info);
+
+	return 3;
+}
+
+/*
+ * client_flush -- test case for multi-threaded flush and drain operations
+ */
+int
+client_flush(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 3)
+		UT_FATAL("usage: %s <target> <provider> <persist method>",
+				tc->name);
+
+	char *target = argv[0];
+	char *prov_name = argv[1];
+	char *persist_method = argv[2];
+
+	set_rpmem_cmd("server_process %s", persist_method);
+
+	char fip_service[NI_MAXSERV];
+	struct rpmem_target_info *info;
+	int ret;
+
+	info = rpmem_target_parse(target);
+	UT_ASSERTne(info, NULL);
+
+	set_pool_data(lpool, 1);
+	set_pool_data(rpool, 1);
+
+	unsigned nlanes;
+	enum rpmem_provider provider = get_provider(info->node,
+			prov_name, &nlanes);
+
+	client_t *client;
+	struct rpmem_resp_attr resp;
+	client = client_exchange(info, NLANES, provider, &resp);
+
+	struct rpmem_fip_attr attr = {
+		.provider = provider,
+		.persist_method = resp.persist_method,
+		.laddr = lpool,
+		.size = POOL_SIZE,
+		.nlanes = resp.nlanes,
+		.raddr = (void *)resp.raddr,
+		.rkey = resp.rkey,
+	};
+
+	ssize_t sret = snprintf(fip_service, NI_MAXSERV, "%u", resp.port);
+	UT_ASSERT(sret > 0);
+
+	struct rpmem_fip *fip;
+	fip = rpmem_fip_init(info->node, fip_service, &attr, &nlanes);
+	UT_ASSERTne(fip, NULL);
+
+	ret = rpmem_fip_connect(fip);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_start(fip);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_t *persist_thread = MALLOC(resp.nlanes * sizeof(pthread_t));
+	struct persist_arg *args = MALLOC(resp.nlanes *
+			sizeof(struct persist_arg));
+
+	for (unsigned i = 0; i < nlanes; i++) {
+		args[i].fip = fip;
+		args[i].lane = i;
+		PTHREAD_CREATE(&persist_thread[i], NULL,
+				client_flush_thread, &args[i]);
+	}
+
+	for (unsigned i = 0; i < nlanes; i++)
+		PTHREAD_JOIN(persist_thread[i], NULL);
+
+	ret = rpmem_fip_read(fip, rpool, POOL_SIZE, 0);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_stop(fip);
+	UT_ASSERTeq(ret, 0);
+
+	client_close(client);
+
+	ret = rpmem_fip_close(fip);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_fip_fini(fip);
+
+	FREE(persist_thread);
+	FREE(args);
+
+	ret = memcmp(rpool, lpool, POOL_SIZE);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_target_free(info);
+
+	return 3;
+}
+
+/*
+ * client_stats -- test case for persist statistics
+ */
+int
+client_stats(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 3)
+		UT_FATAL("usage: %s <target> <provider> <persist method>",
+				tc->name);
+
+	char *target = argv[0];
+	char *prov_name = argv[1];
+	char *persist_method = argv[2];
+
+	set_rpmem_cmd("server_process %s", persist_method);
+
+	char fip_service[NI_MAXSERV];
+	struct rpmem_target_info *info;
+	int ret;
+
+	info = rpmem_target_parse(target);
+	UT_ASSERTne(info, NULL);
+
+	set_pool_data(lpool, 1);
+	set_pool_data(rpool, 1);
+
+	unsigned nlanes;
+	enum rpmem_provider provider = get_provider(info->node,
+			prov_name, &nlanes);
+
+	client_t *client;
+	struct rpmem_resp_attr resp;
+	client = client_exchange(info, NLANES, provider, &resp);
+
+	struct rpmem_fip_attr attr = {
+		.provider = provider,
+		.persist_method = resp.persist_method,
+		.laddr = lpool,
+		.size = POOL_SIZE,
+		.nlanes = resp.nlanes,
+		.raddr = (void *)resp.raddr,
+		.rkey = resp.rkey,
+		.stats = 1,
+	};
+
+	ssize_t sret = snprintf(fip_service, NI_MAXSERV, "%u", resp.port);
+	UT_ASSERT(sret > 0);
+
+	struct rpmem_fip *fip;
+	fip = rpmem_fip_init(info->node, fip_service, &attr, &nlanes);
+	UT_ASSERTne(fip, NULL);
+
+	ret = rpmem_fip_connect(fip);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_start(fip);
+	UT_ASSERTeq(ret, 0);
+
+	pthread_t *persist_thread = MALLOC(resp.nlanes * sizeof(pthread_t));
+	struct persist_arg *args = MALLOC(resp.nlanes *
+			sizeof(struct persist_arg));
+
+	for (unsigned i = 0; i < nlanes; i++) {
+		args[i].fip = fip;
+		args[i].lane = i;
+		PTHREAD_CREATE(&persist_thread[i], NULL,
+				client_persist_thread, &args[i]);
+	}
+
+	for (unsigned i = 0; i < nlanes; i++)
+		PTHREAD_JOIN(persist_thread[i], NULL);
+
+	struct rpmem_stats stats;
+	ret = rpmem_fip_stats_get(fip, RPMEM_ALL_LANES, &stats);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(stats.npersists, nlanes * COUNT_PER_LANE);
+	UT_ASSERTeq(stats.nwrites, nlanes * COUNT_PER_LANE);
+	UT_ASSERTeq(stats.nbytes, nlanes * COUNT_PER_LANE * SIZE_PER_LANE);
+	UT_ASSERTeq(stats.max_depth, 1);
+	UT_ASSERT(stats.max_persist_ns <= stats.persist_ns);
+
+	uint64_t nhist = 0;
+	for (unsigned i = 0; i < RPMEM_STATS_NBUCKETS; i++)
+		nhist += stats.hist[i];
+	UT_ASSERTeq(nhist, stats.npersists);
+
+	for (unsigned i = 0; i < nlanes; i++) {
+		ret = rpmem_fip_stats_get(fip, i, &stats);
+		UT_ASSERTeq(ret, 0);
+		UT_ASSERTeq(stats.npersists, COUNT_PER_LANE);
+	}
+
+	ret = rpmem_fip_stats_get(fip, nlanes, &stats);
+	UT_ASSERTne(ret, 0);
+
+	ret = rpmem_fip_stats_reset(fip);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_stats_get(fip, RPMEM_ALL_LANES, &stats);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(stats.npersists, 0);
+	UT_ASSERTeq(stats.wait_ns, 0);
+
+	ret = rpmem_fip_read(fip, rpool, POOL_SIZE, 0);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_stop(fip);
+	UT_ASSERTeq(ret, 0);
+
+	client_close(client);
+
+	ret = rpmem_fip_close(fip);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_fip_fini(fip);
+
+	FREE(persist_thread);
+	FREE(args);
+
+	ret = memcmp(rpool, lpool, POOL_SIZE);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_target_free(info);
+
+	return 3;
+}
+
+/*
+ * client_persist_async -- test case for persist operations posted on all
+ * lanes from a single thread and completed by polling
+ */
+int
+client_persist_async(const struct test_case *tc, int argc, char *argv[])
+{
+	if (argc < 3)
+		UT_FATAL("usage: %s <target> <provider> <persist method>",
+				tc->name);
+
+	char *target = argv[0];
+	char *prov_name = argv[1];
+	char *persist_method = argv[2];
+
+	set_rpmem_cmd("server_process %s", persist_method);
+
+	char fip_service[NI_MAXSERV];
+	struct rpmem_target_info *info;
+	int ret;
+
+	info = rpmem_target_parse(target);
+	UT_ASSERTne(info, NULL);
+
+	set_pool_data(lpool, 1);
+	set_pool_data(rpool, 1);
+
+	unsigned nlanes;
+	enum rpmem_provider provider = get_provider(info->node,
+			prov_name, &nlanes);
+
+	client_t *client;
+	struct rpmem_resp_attr resp;
+	client = client_exchange(info, NLANES, provider, &resp);
+
+	struct rpmem_fip_attr attr = {
+		.provider = provider,
+		.persist_method = resp.persist_method,
+		.laddr = lpool,
+		.size = POOL_SIZE,
+		.nlanes = resp.nlanes,
+		.raddr = (void *)resp.raddr,
+		.rkey = resp.rkey,
+	};
+
+	ssize_t sret = snprintf(fip_service, NI_MAXSERV, "%u", resp.port);
+	UT_ASSERT(sret > 0);
+
+	struct rpmem_fip *fip;
+	fip = rpmem_fip_init(info->node, fip_service, &attr, &nlanes);
+	UT_ASSERTne(fip, NULL);
+
+	ret = rpmem_fip_connect(fip);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_start(fip);
+	UT_ASSERTeq(ret, 0);
+
+	for (unsigned i = 0; i < COUNT_PER_LANE; i++) {
+		/* post one persist on every lane */
+		for (unsigned lane = 0; lane < nlanes; lane++) {
+			size_t offset = lane * TOTAL_PER_LANE +
+				i * SIZE_PER_LANE;
+			unsigned val = lane + i;
+			memset(&lpool[offset], val, SIZE_PER_LANE);
+
+			ret = rpmem_fip_persist_post(fip, offset,
+					SIZE_PER_LANE, lane);
+			UT_ASSERTeq(ret, 0);
+		}
+
+		/* reap completions by polling, odd rounds wait instead */
+		for (unsigned lane = 0; lane < nlanes; lane++) {
+			if (i % 2) {
+				ret = rpmem_fip_persist_wait(fip, lane);
+				UT_ASSERTeq(ret, 0);
+				continue;
+			}
+
+			int done = 0;
+			while (!done) {
+				ret = rpmem_fip_persist_poll(fip, lane, &done);
+				UT_ASSERTeq(ret, 0);
+			}
+		}
+	}
+
+	/* polling an idle lane reports completion */
+	int done = 0;
+	ret = rpmem_fip_persist_poll(fip, 0, &done);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(done, 1);
+
+	ret = rpmem_fip_read(fip, rpool, POOL_SIZE, 0);
+	UT_ASSERTeq(ret, 0);
+
+	ret = rpmem_fip_process_stop(fip);
+	UT_ASSERTeq(ret, 0);
+
+	client_close(client);
+
+	ret = rpmem_fip_close(fip);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_fip_fini(fip);
+
+	ret = memcmp(rpool, lpool, POOL_SIZE);
+	UT_ASSERTeq(ret, 0);
+
+	rpmem_target_free(info);
+
+	return 3;
+}
+
 /*
  * client_read -- test case for read operation
  */
@@ -729,6 +1230,10 @@ static struct test_case test_cases[] = {
 	TEST_CASE(server_connect),
 	TEST_CASE(client_persist),
 	TEST_CASE(client_persist_mt),
+	TEST_CASE(client_persist_async),
+	TEST_CASE(client_persistv),
+	TEST_CASE(client_flush),
+	TEST_CASE(client_stats),
 	TEST_CASE(server_process),
 	TEST_CASE(client_read),
 };
@@ -48,6 +48,7 @@ static const char *config_print_fmt =
 "poolset_dir:\t\t%s\n"
 "persist_apm:\t\t%s\n"
 "persist_general:\t%s\n"
+"persist_nonalloc:\t%s\n"
 "use_syslog:\t\t%s\n"
 "max_lanes:\t\t%" PRIu64 "\n"
 "log_level:\t\t%s";
@@ -75,6 +76,7 @@ config_print(struct rpmemd_config *config)
 		config->poolset_dir,
 		bool_to_str(config->persist_apm),
 		bool_to_str(config->persist_general),
+		bool_to_str(config->persist_nonalloc),
 		bool_to_str(config->use_syslog),
 		config->max_lanes,
 		rpmemd_log_level_to_str(config->log_level));
@@ -227,13 +227,14 @@ _vmem_strdup(const char *s)
  * pmemobj_close(), but in the library destructor.  So, we need to take them
  * into account when detecting memory leaks.
  *
- * obj_init/obj_pool_init:
- *   cuckoo_new  - Malloc + Zalloc
- *   ctree_new   - Malloc
+ * obj_pools_publish:
+ *   the current (empty) version of the registry - Malloc
+ * obj_pools_reader:
+ *   the reader record of the thread - Zalloc
  * lane_info_ht_boot/lane_info_create:
  *   cuckoo_new  - Malloc + Zalloc
  */
-#define OBJ_EXTRA_NALLOC 5
+#define OBJ_EXTRA_NALLOC 4
 
 static void
 test_obj(const char *path)
@@ -1075,6 +1075,7 @@ pmemspoil_process_zone(struct pmemspoil *psp, struct pmemspoil_list *pfp,
 
 		PROCESS_FIELD(zhdr, magic, uint32_t);
 		PROCESS_FIELD(zhdr, size_idx, uint32_t);
+		PROCESS_FIELD(zhdr, zones_valid, uint64_t);
 		PROCESS_FIELD(zhdr, reserved, char);
 
 		PROCESS(chunk, cpair, zhdr->size_idx, struct chunk_pair);
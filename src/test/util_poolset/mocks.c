@@ -39,6 +39,25 @@
 extern const char *Open_path;
 extern off_t Fallocate_len;
 extern size_t Is_pmem_len;
+extern const char *Dax_path;
+
+/* alignment of the mocked device DAX */
+#define DAX_ALIGN (2 * 1024 * 1024)
+
+/*
+ * is_dax -- (internal) check if the file descriptor refers to Dax_path
+ */
+static int
+is_dax(int fd)
+{
+	struct stat pst;
+	struct stat fst;
+
+	if (stat(Dax_path, &pst) != 0 || fstat(fd, &fst) != 0)
+		return 0;
+
+	return pst.st_dev == fst.st_dev && pst.st_ino == fst.st_ino;
+}
 
 /*
  * open -- open mock
@@ -81,3 +100,27 @@ FUNC_MOCK_RUN_DEFAULT {
 	return _FUNC_REAL(pmem_is_pmem)(addr, len);
 }
 FUNC_MOCK_END
+
+
+/*
+ * util_fd_is_device_dax -- util_fd_is_device_dax mock
+ */
+FUNC_MOCK(util_fd_is_device_dax, int, int fd)
+FUNC_MOCK_RUN_DEFAULT {
+	if (is_dax(fd))
+		return 1;
+	return _FUNC_REAL(util_fd_is_device_dax)(fd);
+}
+FUNC_MOCK_END
+
+
+/*
+ * util_fd_device_dax_alignment -- util_fd_device_dax_alignment mock
+ */
+FUNC_MOCK(util_fd_device_dax_alignment, size_t, int fd)
+FUNC_MOCK_RUN_DEFAULT {
+	if (is_dax(fd))
+		return DAX_ALIGN;
+	return _FUNC_REAL(util_fd_device_dax_alignment)(fd);
+}
+FUNC_MOCK_END
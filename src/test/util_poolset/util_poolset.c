@@ -51,6 +51,7 @@
 const char *Open_path = "";
 off_t Fallocate_len = -1;
 size_t Is_pmem_len = 0;
+const char *Dax_path = "";
 
 /*
  * poolset_info -- (internal) dumps poolset info and checks its integrity
@@ -112,6 +113,7 @@ mock_options(const char *arg)
 	Open_path = "";
 	Fallocate_len = -1;
 	Is_pmem_len = 0;
+	Dax_path = "";
 
 	if (arg[0] != '-' || arg[1] != 'm')
 		return 0;
@@ -132,6 +134,10 @@ mock_options(const char *arg)
 		/* is_pmem */
 		Is_pmem_len = atoll(&arg[4]);
 		break;
+	case 'd':
+		/* device DAX */
+		Dax_path = &arg[4];
+		break;
 	default:
 		UT_FATAL("unknown mock option: %c", arg[2]);
 	}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2014-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vmem_create_config.c -- unit test for vmem_create_config
+ *
+ * usage: vmem_create_config directory
+ */
+
+#include "unittest.h"
+
+/*
+ * stat_get -- (internal) read a statistic of the pool
+ */
+static void
+stat_get(VMEM *vmp, const char *name, void *val, size_t len)
+{
+	UT_ASSERTeq(vmem_stats_get(vmp, name, val, &len), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "vmem_create_config");
+
+	if (argc < 2)
+		UT_FATAL("usage: %s directory", argv[0]);
+
+	const char *dir = argv[1];
+
+	/* a NULL config is the same as vmem_create() */
+	VMEM *vmp = vmem_create(dir, VMEM_MIN_POOL);
+	UT_ASSERTne(vmp, NULL);
+	VMEM *vmp_def = vmem_create_config(dir, VMEM_MIN_POOL, NULL);
+	UT_ASSERTne(vmp_def, NULL);
+
+	unsigned narenas_def;
+	size_t tcache_max_def;
+	ssize_t lg_dirty_mult_def;
+	stat_get(vmp, "arenas.narenas", &narenas_def, sizeof(narenas_def));
+	stat_get(vmp, "arenas.tcache_max", &tcache_max_def,
+			sizeof(tcache_max_def));
+	stat_get(vmp, "arenas.lg_dirty_mult", &lg_dirty_mult_def,
+			sizeof(lg_dirty_mult_def));
+
+	unsigned narenas;
+	size_t tcache_max;
+	ssize_t lg_dirty_mult;
+	stat_get(vmp_def, "arenas.narenas", &narenas, sizeof(narenas));
+	stat_get(vmp_def, "arenas.tcache_max", &tcache_max,
+			sizeof(tcache_max));
+	stat_get(vmp_def, "arenas.lg_dirty_mult", &lg_dirty_mult,
+			sizeof(lg_dirty_mult));
+	UT_ASSERTeq(narenas, narenas_def);
+	UT_ASSERTeq(tcache_max, tcache_max_def);
+	UT_ASSERTeq(lg_dirty_mult, lg_dirty_mult_def);
+
+	vmem_delete(vmp_def);
+
+	/* a tuned pool */
+	struct vmem_config cfg = {
+		.narenas = 1,
+		.tcache_disable = 1,
+		.tcache_max = 1,
+		.lg_dirty_mult = VMEM_DIRTY_NEVER,
+	};
+	VMEM *vmp_cfg = vmem_create_config(dir, VMEM_MIN_POOL, &cfg);
+	UT_ASSERTne(vmp_cfg, NULL);
+
+	stat_get(vmp_cfg, "arenas.narenas", &narenas, sizeof(narenas));
+	stat_get(vmp_cfg, "arenas.tcache_max", &tcache_max,
+			sizeof(tcache_max));
+	stat_get(vmp_cfg, "arenas.lg_dirty_mult", &lg_dirty_mult,
+			sizeof(lg_dirty_mult));
+	UT_ASSERTeq(narenas, 1);
+	UT_ASSERT(tcache_max > 0 && tcache_max < tcache_max_def);
+	UT_ASSERTeq(lg_dirty_mult, VMEM_DIRTY_NEVER);
+
+	/* without a thread cache small allocations show up immediately */
+	uint64_t epoch;
+	size_t allocated;
+	size_t allocated_new;
+	stat_get(vmp_cfg, "epoch", &epoch, sizeof(epoch));
+	stat_get(vmp_cfg, "stats.allocated", &allocated, sizeof(allocated));
+
+	void *ptr = vmem_malloc(vmp_cfg, 64);
+	UT_ASSERTne(ptr, NULL);
+
+	stat_get(vmp_cfg, "epoch", &epoch, sizeof(epoch));
+	stat_get(vmp_cfg, "stats.allocated", &allocated_new,
+			sizeof(allocated_new));
+	UT_ASSERTeq(allocated_new, allocated + 64);
+
+	vmem_free(vmp_cfg, ptr);
+
+	stat_get(vmp_cfg, "epoch", &epoch, sizeof(epoch));
+	stat_get(vmp_cfg, "stats.allocated", &allocated_new,
+			sizeof(allocated_new));
+	UT_ASSERTeq(allocated_new, allocated);
+
+	vmem_delete(vmp_cfg);
+	vmem_delete(vmp);
+
+	/* invalid purge ratio */
+	cfg.lg_dirty_mult = -2;
+	UT_ASSERTeq(vmem_create_config(dir, VMEM_MIN_POOL, &cfg), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* huge page backed pool is aligned to the page size */
+	struct vmem_config hcfg = {
+		.page_size = 8 << 20,
+	};
+	vmp = vmem_create_config(dir, VMEM_MIN_POOL + 1, &hcfg);
+	UT_ASSERTne(vmp, NULL);
+	UT_ASSERTeq((uintptr_t)vmp & (hcfg.page_size - 1), 0);
+
+	void *big = vmem_malloc(vmp, 4 << 20);
+	UT_ASSERTne(big, NULL);
+	vmem_free(vmp, big);
+	vmem_delete(vmp);
+
+	/* invalid page size */
+	hcfg.page_size = 3 << 20;
+	UT_ASSERTeq(vmem_create_config(dir, VMEM_MIN_POOL, &hcfg), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	DONE(NULL);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2014-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vmem_grow.c -- unit test for growing pools
+ *
+ * usage: vmem_grow directory
+ */
+
+#include "unittest.h"
+
+#define ALLOC_SIZE (1 << 20)
+#define MAX_ALLOCS 1024
+
+static void *Allocs[MAX_ALLOCS];
+
+/*
+ * fill -- (internal) allocate until the pool is exhausted
+ */
+static unsigned
+fill(VMEM *vmp)
+{
+	unsigned n = 0;
+
+	while (n < MAX_ALLOCS &&
+			(Allocs[n] = vmem_malloc(vmp, ALLOC_SIZE)) != NULL) {
+		memset(Allocs[n], 0xc5, ALLOC_SIZE);
+		n++;
+	}
+
+	UT_ASSERT(n < MAX_ALLOCS);
+	return n;
+}
+
+/*
+ * release -- (internal) free n allocations
+ */
+static void
+release(VMEM *vmp, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+		vmem_free(vmp, Allocs[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "vmem_grow");
+
+	if (argc < 2)
+		UT_FATAL("usage: %s directory", argv[0]);
+
+	const char *dir = argv[1];
+
+	/* fixed size pool */
+	VMEM *vmp = vmem_create(dir, VMEM_MIN_POOL);
+	UT_ASSERTne(vmp, NULL);
+	unsigned nfixed = fill(vmp);
+	UT_ASSERT(nfixed * (size_t)ALLOC_SIZE < VMEM_MIN_POOL);
+	release(vmp, nfixed);
+	vmem_delete(vmp);
+
+	/* growing pool with a limit */
+	struct vmem_config cfg = {
+		.grow_size = VMEM_MIN_POOL,
+		.max_size = 4 * VMEM_MIN_POOL,
+	};
+	vmp = vmem_create_config(dir, VMEM_MIN_POOL, &cfg);
+	UT_ASSERTne(vmp, NULL);
+
+	unsigned n = fill(vmp);
+	UT_ASSERT(n * (size_t)ALLOC_SIZE > VMEM_MIN_POOL);
+	UT_ASSERT(n * (size_t)ALLOC_SIZE < cfg.max_size);
+	UT_ASSERTeq(vmem_check(vmp), 1);
+
+	release(vmp, n);
+
+	/* freed space is reused, the pool does not grow any further */
+	UT_ASSERTeq(fill(vmp), n);
+	release(vmp, n);
+	vmem_delete(vmp);
+
+	/* allocation bigger than the growth step */
+	cfg.grow_size = ALLOC_SIZE;
+	cfg.max_size = 0;
+	vmp = vmem_create_config(dir, VMEM_MIN_POOL, &cfg);
+	UT_ASSERTne(vmp, NULL);
+
+	void *ptr = vmem_malloc(vmp, 2 * VMEM_MIN_POOL);
+	UT_ASSERTne(ptr, NULL);
+	memset(ptr, 0xc5, 2 * VMEM_MIN_POOL);
+
+	char *str = vmem_strdup(vmp, "vmem_grow");
+	UT_ASSERTne(str, NULL);
+
+	UT_ASSERTeq(vmem_check(vmp), 1);
+
+	vmem_free(vmp, str);
+	vmem_free(vmp, ptr);
+	vmem_delete(vmp);
+
+	/* limit below the initial size */
+	cfg.max_size = VMEM_MIN_POOL / 2;
+	UT_ASSERTeq(vmem_create_config(dir, VMEM_MIN_POOL, &cfg), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	DONE(NULL);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2014-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vmem_numa.c -- unit test for vmem_create_numa
+ *
+ * usage: vmem_numa directory
+ */
+
+#include "unittest.h"
+
+#define NODES 2
+#define ALLOC_SIZE 4096
+#define MAX_ALLOCS (VMEM_MIN_POOL / ALLOC_SIZE)
+
+static void *Allocs[MAX_ALLOCS];
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "vmem_numa");
+
+	if (argc < 2)
+		UT_FATAL("usage: %s directory", argv[0]);
+
+	const char *dirs[VMEM_NUMA_NODES_MAX + 1];
+	for (unsigned i = 0; i <= VMEM_NUMA_NODES_MAX; i++)
+		dirs[i] = argv[1];
+
+	/* invalid arguments */
+	UT_ASSERTeq(vmem_create_numa(dirs, 0, VMEM_MIN_POOL), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(vmem_create_numa(dirs, VMEM_NUMA_NODES_MAX + 1,
+			VMEM_MIN_POOL), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(vmem_create_numa(dirs, NODES, VMEM_MIN_POOL - 1), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	VMEM *vmp = vmem_create_numa(dirs, NODES, VMEM_MIN_POOL);
+	UT_ASSERTne(vmp, NULL);
+
+	unsigned n = 0;
+	while (n < MAX_ALLOCS &&
+			(Allocs[n] = vmem_malloc(vmp, ALLOC_SIZE)) != NULL) {
+		UT_ASSERT(vmem_malloc_usable_size(vmp, Allocs[n]) >=
+				ALLOC_SIZE);
+		memset(Allocs[n], 0xc5, ALLOC_SIZE);
+		n++;
+	}
+	UT_ASSERT(n > 0);
+
+	void *ptr = vmem_realloc(vmp, Allocs[0], ALLOC_SIZE / 2);
+	UT_ASSERTne(ptr, NULL);
+	Allocs[0] = ptr;
+
+	UT_ASSERTeq(vmem_check(vmp), 1);
+
+	for (unsigned i = 0; i < n; i++)
+		vmem_free(vmp, Allocs[i]);
+
+	char *str = vmem_strdup(vmp, "vmem_numa");
+	UT_ASSERTne(str, NULL);
+	vmem_free(vmp, str);
+
+	vmem_delete(vmp);
+
+	/* slots of deleted pools are reused */
+	for (unsigned i = 0; i < 64; i++) {
+		vmp = vmem_create_numa(dirs, NODES, VMEM_MIN_POOL);
+		UT_ASSERTne(vmp, NULL);
+		vmem_delete(vmp);
+	}
+
+	DONE(NULL);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2014-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vmem_stats_get.c -- unit test for vmem_stats_get
+ *
+ * usage: vmem_stats_get
+ */
+
+#include "unittest.h"
+
+#define LARGE_ALLOC (1 << 20)
+
+/*
+ * stat_size -- (internal) read a size_t statistic of the pool
+ */
+static size_t
+stat_size(VMEM *vmp, const char *name)
+{
+	size_t val;
+	size_t len = sizeof(val);
+
+	int ret = vmem_stats_get(vmp, name, &val, &len);
+	UT_ASSERTeq(ret, 0);
+	UT_ASSERTeq(len, sizeof(val));
+
+	return val;
+}
+
+/*
+ * refresh -- (internal) take a new snapshot of the pool statistics
+ */
+static uint64_t
+refresh(VMEM *vmp)
+{
+	uint64_t epoch;
+	size_t len = sizeof(epoch);
+
+	int ret = vmem_stats_get(vmp, "epoch", &epoch, &len);
+	UT_ASSERTeq(ret, 0);
+
+	return epoch;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "vmem_stats_get");
+
+	void *mem_pool = MMAP_ANON_ALIGNED(VMEM_MIN_POOL, 4 << 20);
+	VMEM *vmp = vmem_create_in_region(mem_pool, VMEM_MIN_POOL);
+	if (vmp == NULL)
+		UT_FATAL("!vmem_create_in_region");
+
+	void *mem_pool2 = MMAP_ANON_ALIGNED(VMEM_MIN_POOL, 4 << 20);
+	VMEM *vmp2 = vmem_create_in_region(mem_pool2, VMEM_MIN_POOL);
+	if (vmp2 == NULL)
+		UT_FATAL("!vmem_create_in_region");
+
+	uint64_t epoch = refresh(vmp);
+	size_t allocated = stat_size(vmp, "stats.allocated");
+	size_t allocated2 = stat_size(vmp2, "stats.allocated");
+
+	void *ptr = vmem_malloc(vmp, LARGE_ALLOC);
+	UT_ASSERTne(ptr, NULL);
+
+	/* values are a snapshot until the next refresh */
+	UT_ASSERTeq(stat_size(vmp, "stats.allocated"), allocated);
+
+	UT_ASSERT(refresh(vmp) > epoch);
+	refresh(vmp2);
+
+	size_t now = stat_size(vmp, "stats.allocated");
+	UT_ASSERT(now >= allocated + LARGE_ALLOC);
+	UT_ASSERT(stat_size(vmp, "stats.active") >= now);
+	UT_ASSERT(stat_size(vmp, "stats.mapped") >=
+			stat_size(vmp, "stats.active"));
+	UT_ASSERTeq(stat_size(vmp2, "stats.allocated"), allocated2);
+
+	/* per-arena and per-size-class values */
+	UT_ASSERT(stat_size(vmp, "stats.arenas.0.pactive") > 0);
+	UT_ASSERT(stat_size(vmp, "arenas.bin.0.size") > 0);
+
+	unsigned narenas;
+	size_t len = sizeof(narenas);
+	UT_ASSERTeq(vmem_stats_get(vmp, "arenas.narenas", &narenas, &len), 0);
+	UT_ASSERT(narenas > 0);
+
+	/* unknown name */
+	len = sizeof(narenas);
+	UT_ASSERTeq(vmem_stats_get(vmp, "stats.nonexistent", &narenas, &len),
+			-1);
+	UT_ASSERTeq(errno, ENOENT);
+
+	/* size mismatch */
+	len = sizeof(narenas);
+	UT_ASSERTeq(vmem_stats_get(vmp, "stats.allocated", &narenas, &len),
+			-1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	vmem_free(vmp, ptr);
+
+	refresh(vmp);
+	UT_ASSERT(stat_size(vmp, "stats.allocated") < now);
+
+	vmem_delete(vmp);
+	vmem_delete(vmp2);
+
+	DONE(NULL);
+}
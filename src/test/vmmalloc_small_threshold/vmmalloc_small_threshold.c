@@ -0,0 +1,138 @@
+/*
+ * Copyright 2014-2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vmmalloc_small_threshold.c -- unit test for libvmmalloc small allocations
+ * threshold
+ *
+ * usage: vmmalloc_small_threshold threshold
+ *
+ * Verifies that allocations smaller than the threshold are placed outside of
+ * the vmem pool, the larger ones inside it and that realloc moves the block
+ * between them preserving its contents.
+ */
+
+#include <malloc.h>
+#include "unittest.h"
+
+static uintptr_t Pool_start;
+static uintptr_t Pool_end;
+
+/*
+ * find_pool -- find the vmem pool mapping in /proc/self/maps
+ */
+static void
+find_pool(void)
+{
+	const char *dir = getenv("VMMALLOC_POOL_DIR");
+	UT_ASSERTne(dir, NULL);
+
+	FILE *maps = fopen("/proc/self/maps", "r");
+	UT_ASSERTne(maps, NULL);
+	char line[4096];
+	while (fgets(line, sizeof(line), maps)) {
+		if (strstr(line, dir) == NULL)
+			continue;
+
+		unsigned long start, end;
+		UT_ASSERTeq(sscanf(line, "%lx-%lx", &start, &end), 2);
+		if (Pool_start == 0)
+			Pool_start = start;
+		Pool_end = end;
+	}
+	fclose(maps);
+
+	UT_ASSERTne(Pool_start, 0);
+}
+
+/*
+ * check_tier -- verify the block of given size is in the proper tier
+ */
+static void
+check_tier(void *ptr, size_t size, size_t threshold)
+{
+	UT_ASSERTne(ptr, NULL);
+
+	int in_pool = (uintptr_t)ptr >= Pool_start &&
+			(uintptr_t)ptr < Pool_end;
+	UT_ASSERTeq(in_pool, size >= threshold);
+	UT_ASSERT(malloc_usable_size(ptr) >= size);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "vmmalloc_small_threshold");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s threshold", argv[0]);
+
+	size_t threshold = strtoul(argv[1], NULL, 0);
+	size_t small = threshold > 1 ? threshold - 1 : 1;
+	size_t large = threshold > 1 ? threshold : 1;
+	size_t huge = 4 * 1024 * 1024;
+
+	find_pool();
+
+	char *ptr = malloc(small);
+	check_tier(ptr, small, threshold);
+	memset(ptr, 0xAB, small);
+
+	/* move to the pool and back */
+	ptr = realloc(ptr, huge);
+	check_tier(ptr, huge, threshold);
+	for (size_t i = 0; i < small; i++)
+		UT_ASSERTeq((unsigned char)ptr[i], 0xAB);
+
+	ptr = realloc(ptr, small);
+	check_tier(ptr, small, threshold);
+	for (size_t i = 0; i < small; i++)
+		UT_ASSERTeq((unsigned char)ptr[i], 0xAB);
+	free(ptr);
+
+	ptr = malloc(large);
+	check_tier(ptr, large, threshold);
+	free(ptr);
+
+	ptr = calloc(1, small);
+	check_tier(ptr, small, threshold);
+	UT_ASSERTeq(ptr[0], 0);
+	free(ptr);
+
+	void *aligned;
+	UT_ASSERTeq(posix_memalign(&aligned, 64, small), 0);
+	check_tier(aligned, small, threshold);
+	UT_ASSERTeq((uintptr_t)aligned % 64, 0);
+	free(aligned);
+
+	DONE(NULL);
+}
@@ -64,6 +64,7 @@ struct pmempool_check_context {
 	bool backup;		/* do backup */
 	bool advanced;		/* do advanced repairs */
 	char *backup_fname;	/* backup file name */
+	char *progress_fname;	/* progress file name */
 	bool exec;		/* do execute */
 	char ans;		/* default answer on all questions or '?' */
 };
@@ -77,6 +78,7 @@ static const struct pmempool_check_context pmempool_check_default = {
 	.repair		= false,
 	.backup		= false,
 	.backup_fname	= NULL,
+	.progress_fname	= NULL,
 	.advanced	= false,
 	.exec		= true,
 	.ans		= '?',
@@ -94,6 +96,7 @@ static const char *help_str =
 "  -N, --no-exec        don't execute, just show what would be done\n"
 "  -b, --backup <file>  create backup of a pool file before executing\n"
 "  -a, --advanced       perform advanced repairs\n"
+"  -p, --progress <file> save progress to file and resume interrupted check\n"
 "  -q, --quiet          be quiet and don't print any messages\n"
 "  -v, --verbose        increase verbosity level\n"
 "  -h, --help           display this help and exit\n"
@@ -110,6 +113,7 @@ static const struct option long_options[] = {
 	{"no-exec",	no_argument,		0,	'N'},
 	{"backup",	required_argument,	0,	'b'},
 	{"advanced",	no_argument,		0,	'a'},
+	{"progress",	required_argument,	0,	'p'},
 	{"quiet",	no_argument,		0,	'q'},
 	{"verbose",	no_argument,		0,	'v'},
 	{"help",	no_argument,		0,	'h'},
@@ -153,7 +157,7 @@ pmempool_check_parse_args(struct pmempool_check_context *pcp, char *appname,
 		int argc, char *argv[])
 {
 	int opt;
-	while ((opt = getopt_long(argc, argv, "ahvrNb:qy",
+	while ((opt = getopt_long(argc, argv, "ahvrNb:p:qy",
 			long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'r':
@@ -172,6 +176,9 @@ pmempool_check_parse_args(struct pmempool_check_context *pcp, char *appname,
 		case 'a':
 			pcp->advanced = true;
 			break;
+		case 'p':
+			pcp->progress_fname = optarg;
+			break;
 		case 'q':
 			pcp->verbose = 0;
 			break;
@@ -204,6 +211,11 @@ pmempool_check_parse_args(struct pmempool_check_context *pcp, char *appname,
 		exit(EXIT_FAILURE);
 	}
 
+	if (pcp->repair && pcp->progress_fname) {
+		outv_err("'-p' option cannot be used with '-r'\n");
+		exit(EXIT_FAILURE);
+	}
+
 	return 0;
 }
 
@@ -238,7 +250,8 @@ pmempool_check_perform(struct pmempool_check_context *pc)
 		.path	= pc->fname,
 		.backup_path	= pc->backup_fname,
 		.pool_type	= PMEMPOOL_POOL_TYPE_DETECT,
-		.flags		= PMEMPOOL_CHECK_FORMAT_STR
+		.flags		= PMEMPOOL_CHECK_FORMAT_STR,
+		.progress_path	= pc->progress_fname,
 	};
 
 	if (pc->repair)
@@ -53,6 +53,7 @@
 
 #include "common.h"
 #include "output.h"
+#include "libpmem.h"
 #include "libpmemblk.h"
 #include "libpmemlog.h"
 #include "libpmemobj.h"
@@ -1144,26 +1145,22 @@ int
 util_heap_get_bitmap_params(uint64_t block_size, uint64_t *nallocsp,
 		uint64_t *nvalsp, uint64_t *last_valp)
 {
-	assert(RUNSIZE / block_size <= UINT32_MAX);
-	uint32_t nallocs = (uint32_t)(RUNSIZE / block_size);
-
-	assert(nallocs <= RUN_BITMAP_SIZE);
-	unsigned unused_bits = RUN_BITMAP_SIZE - nallocs;
-
-	unsigned unused_values = unused_bits / BITS_PER_VALUE;
+	assert(RUN_DATA_SIZE(block_size) / block_size <= UINT32_MAX);
+	uint32_t nallocs = (uint32_t)(RUN_DATA_SIZE(block_size) / block_size);
+	if (nallocs == 0)
+		return -1;
 
-	assert(MAX_BITMAP_VALUES >= unused_values);
-	uint64_t nvals = MAX_BITMAP_VALUES - unused_values;
+	/* runs of small units continue their bitmap in the data area */
+	uint64_t nvals = (nallocs - 1) / BITS_PER_VALUE + 1;
+	if (nvals > MAX_BITMAP_VALUES +
+			RUN_BITMAP_EXT_SIZE(block_size) / sizeof(uint64_t))
+		return -1;
 
-	assert(unused_bits >= unused_values * BITS_PER_VALUE);
-	unused_bits -= unused_values * BITS_PER_VALUE;
+	unsigned unused_bits = (unsigned)(nvals * BITS_PER_VALUE - nallocs);
 
 	uint64_t last_val = unused_bits ? (((1ULL << unused_bits) - 1ULL) <<
 				(BITS_PER_VALUE - unused_bits)) : 0;
 
-	if (nvals >= MAX_BITMAP_VALUES || nvals == 0)
-		return -1;
-
 	if (nallocsp)
 		*nallocsp = nallocs;
 	if (nvalsp)
@@ -1204,6 +1201,32 @@ util_plist_get_entry(struct pmemobjpool *pop,
 	return NULL;
 }
 
+/*
+ * pool_set_file_advise -- (internal) tells the kernel how the range of the
+ *	mapped pool is going to be accessed
+ *
+ * It's only a hint, so the errors are ignored, e.g. the Device DAX mappings
+ * don't support all of the advices.
+ */
+static void
+pool_set_file_advise(struct pool_set_file *file, uint64_t off, size_t len,
+		int advice)
+{
+#ifndef _WIN32
+	if (file->fileio || file->addr == NULL || off >= file->size)
+		return;
+
+	if (len > file->size - off)
+		len = file->size - off;
+
+	uintptr_t start = (uintptr_t)file->addr + off;
+	uintptr_t end = start + len;
+	start &= ~(uintptr_t)(Pagesize - 1);
+
+	(void) madvise((void *)start, end - start, advice);
+#endif
+}
+
 /*
  * pool_set_file_open -- opens pool set file or regular file
  */
@@ -1271,6 +1294,13 @@ pool_set_file_open(const char *fname,
 		}
 		file->size = file->poolset->poolsize;
 		file->addr = file->poolset->replica[0]->part[0].addr;
+
+		/*
+		 * The mapping is populated on demand, but the readahead would
+		 * load the neighbourhood of every header looked at. The regions
+		 * which are read as a whole are prefetched by the readers.
+		 */
+		pool_set_file_advise(file, 0, file->size, MADV_RANDOM);
 	}
 	return file;
 
@@ -1316,7 +1346,9 @@ pool_set_file_read(struct pool_set_file *file, void *buff,
 		if (num < (ssize_t)nbytes)
 			return -1;
 	} else {
-		memcpy(buff, (char *)file->addr + off, nbytes);
+		if (nbytes > Pagesize)
+			pool_set_file_prefetch(file, off, nbytes);
+		pmem_memcpy_from_pmem(buff, (char *)file->addr + off, nbytes);
 	}
 	return 0;
 }
@@ -1358,6 +1390,7 @@ pool_set_file_set_replica(struct pool_set_file *file, size_t replica)
 
 	file->replica = replica;
 	file->addr = file->poolset->replica[replica]->part[0].addr;
+	pool_set_file_advise(file, 0, file->size, MADV_RANDOM);
 
 	return 0;
 }
@@ -1381,3 +1414,24 @@ pool_set_file_map(struct pool_set_file *file, uint64_t offset)
 		return NULL;
 	return (char *)file->addr + offset;
 }
+
+/*
+ * pool_set_file_prefetch -- starts loading the range of the mapped pool which
+ *	is going to be read as a whole
+ */
+void
+pool_set_file_prefetch(struct pool_set_file *file, uint64_t off, size_t len)
+{
+	pool_set_file_advise(file, off, len, MADV_NORMAL);
+	pool_set_file_advise(file, off, len, MADV_WILLNEED);
+}
+
+/*
+ * pool_set_file_readahead -- enables readahead for the range of the mapped
+ *	pool which is going to be walked through, without loading it upfront
+ */
+void
+pool_set_file_readahead(struct pool_set_file *file, uint64_t off, size_t len)
+{
+	pool_set_file_advise(file, off, len, MADV_NORMAL);
+}
@@ -43,8 +43,17 @@
 #include <stdbool.h>
 #include <sys/mman.h>
 #include <endian.h>
+#include <pthread.h>
 #include "common.h"
 #include "convert.h"
+#include "set.h"
+#include "libpmem.h"
+
+/* max number of threads converting the zones */
+#define CONVERT_THREADS_MAX 16
+
+/* set if the converted pool resides on persistent memory */
+static int Convert_is_pmem;
 
 static const char *help_str = "";
 
@@ -77,6 +86,215 @@ pmempool_convert_help(char *appname)
 	printf(help_str, appname);
 }
 
+/*
+ * convert_ranges_flush -- (internal) flush all collected ranges
+ */
+static void
+convert_ranges_flush(struct convert_ranges *ranges)
+{
+	for (unsigned i = 0; i < ranges->n; i++) {
+		void *addr = (void *)ranges->r[i].addr;
+		if (Convert_is_pmem)
+			pmem_flush(addr, ranges->r[i].len);
+		else
+			pmem_msync(addr, ranges->r[i].len);
+	}
+
+	ranges->n = 0;
+}
+
+/*
+ * convert_ranges_add -- add a modified range to be persisted
+ */
+void
+convert_ranges_add(struct convert_ranges *ranges, const void *addr,
+	size_t len)
+{
+	if (len == 0)
+		return;
+
+	uintptr_t start = (uintptr_t)addr;
+	if (ranges->n > 0) {
+		uintptr_t last = ranges->r[ranges->n - 1].addr;
+		size_t *lastlen = &ranges->r[ranges->n - 1].len;
+
+		if (start >= last && start <= last + *lastlen) {
+			if (start + len > last + *lastlen)
+				*lastlen = start + len - last;
+			return;
+		}
+	}
+
+	if (ranges->n == CONVERT_RANGES_MAX)
+		convert_ranges_flush(ranges);
+
+	ranges->r[ranges->n].addr = start;
+	ranges->r[ranges->n].len = len;
+	ranges->n++;
+}
+
+/*
+ * convert_ranges_persist -- persist all collected ranges
+ */
+void
+convert_ranges_persist(struct convert_ranges *ranges)
+{
+	convert_ranges_flush(ranges);
+	if (Convert_is_pmem)
+		pmem_drain();
+}
+
+/*
+ * convert_persist -- persist a single range
+ */
+void
+convert_persist(const void *addr, size_t len)
+{
+	if (Convert_is_pmem)
+		pmem_persist(addr, len);
+	else
+		pmem_msync(addr, len);
+}
+
+/*
+ * convert_zones -- state shared by the threads converting the zones
+ */
+struct convert_zones {
+	unsigned nzones;
+	convert_zone_fn fn;
+	void *arg;
+	uint64_t *done;		/* persistent mark of converted zones */
+	uint8_t *converted;	/* zones converted in this run */
+	unsigned next;		/* next zone to be converted */
+	int ret;
+	pthread_mutex_t lock;
+};
+
+/*
+ * convert_zone_done -- (internal) mark the zone as converted
+ *
+ * The persistent mark is advanced only over the contiguous prefix of
+ * converted zones, so an interrupted conversion resumes from the first
+ * zone which might not have been converted.
+ */
+static void
+convert_zone_done(struct convert_zones *cz, unsigned zone_id)
+{
+	cz->converted[zone_id] = 1;
+	if (!cz->done)
+		return;
+
+	uint64_t mark = le64toh(*cz->done);
+	if (mark != zone_id)
+		return;
+
+	while (mark < cz->nzones && cz->converted[mark])
+		mark++;
+
+	*cz->done = htole64(mark);
+	convert_persist(cz->done, sizeof(*cz->done));
+}
+
+/*
+ * convert_zones_worker -- (internal) convert zones until none is left
+ *
+ * The zones are handed out one by one because the amount of work differs
+ * a lot between them.
+ */
+static void *
+convert_zones_worker(void *arg)
+{
+	struct convert_zones *cz = arg;
+	struct convert_ranges ranges;
+	ranges.n = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&cz->lock);
+		unsigned zone_id = cz->next;
+		if (cz->ret == 0 && zone_id < cz->nzones)
+			cz->next++;
+		else
+			zone_id = cz->nzones;
+		pthread_mutex_unlock(&cz->lock);
+
+		if (zone_id == cz->nzones)
+			break;
+
+		int ret = cz->fn(zone_id, &ranges, cz->arg);
+		convert_ranges_persist(&ranges);
+
+		pthread_mutex_lock(&cz->lock);
+		if (ret)
+			cz->ret = ret;
+		else
+			convert_zone_done(cz, zone_id);
+		pthread_mutex_unlock(&cz->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * convert_foreach_zone -- convert all zones of the heap by multiple threads
+ *
+ * If done is not NULL it points to a little-endian counter in the pool,
+ * zones below which are already converted. It is persisted as the zones
+ * get converted, so the conversion can be restarted after an interruption.
+ * Returns the first nonzero value returned by the callback.
+ */
+int
+convert_foreach_zone(unsigned nzones, convert_zone_fn fn, void *arg,
+	uint64_t *done)
+{
+	struct convert_zones cz;
+	cz.nzones = nzones;
+	cz.fn = fn;
+	cz.arg = arg;
+	cz.done = done;
+	cz.next = 0;
+	cz.ret = 0;
+
+	if (done) {
+		uint64_t mark = le64toh(*done);
+		cz.next = mark < nzones ? (unsigned)mark : nzones;
+	}
+
+	if (cz.next == nzones)
+		return 0;
+
+	cz.converted = calloc(nzones, sizeof(*cz.converted));
+	if (!cz.converted)
+		return -1;
+
+	pthread_mutex_init(&cz.lock, NULL);
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned nthreads = ncpus > 1 ? (unsigned)ncpus : 1;
+	if (nthreads > CONVERT_THREADS_MAX)
+		nthreads = CONVERT_THREADS_MAX;
+	if (nthreads > nzones - cz.next)
+		nthreads = nzones - cz.next;
+
+	pthread_t threads[CONVERT_THREADS_MAX];
+	int started[CONVERT_THREADS_MAX];
+
+	for (unsigned t = 1; t < nthreads; t++)
+		started[t] = pthread_create(&threads[t], NULL,
+				convert_zones_worker, &cz) == 0;
+
+	convert_zones_worker(&cz);
+
+	for (unsigned t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+	}
+
+	pthread_mutex_destroy(&cz.lock);
+	free(cz.converted);
+
+	return cz.ret;
+}
+
 typedef int (*convert_func)(void *addr);
 
 /*
@@ -144,10 +362,12 @@ pmempool_convert_func(char *appname, int argc, char *argv[])
 
 	PMEMobjpool *pop = addr;
 
-	if (version_convert[m](pop) != 0)
-		fprintf(stderr, "Failed to convert the pool\n");
+	Convert_is_pmem = psf->poolset->replica[0]->is_pmem;
 
-	msync(pop, psf->size, 0);
+	if (version_convert[m](pop) != 0) {
+		fprintf(stderr, "Failed to convert the pool\n");
+		ret = -1;
+	}
 
 out:
 	pool_set_file_close(psf);
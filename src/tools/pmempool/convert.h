@@ -37,3 +37,43 @@
 int pmempool_convert_func(char *appname, int argc, char *argv[]);
 void pmempool_convert_help(char *appname);
 int convert_v1_v2(void *addr);
+
+/*
+ * Helpers available to the conversion functions. The pool is mapped
+ * by the convert command which also knows whether it resides on pmem.
+ */
+#define CONVERT_RANGES_MAX 64
+
+/*
+ * convert_ranges -- modified ranges of the pool waiting to be persisted
+ *
+ * Adjacent ranges are coalesced and all of them are flushed at once with
+ * a single drain at the end, instead of persisting every store separately.
+ */
+struct convert_ranges {
+	unsigned n;
+	struct {
+		uintptr_t addr;
+		size_t len;
+	} r[CONVERT_RANGES_MAX];
+};
+
+void convert_ranges_add(struct convert_ranges *ranges,
+	const void *addr, size_t len);
+void convert_ranges_persist(struct convert_ranges *ranges);
+void convert_persist(const void *addr, size_t len);
+
+/*
+ * convert_zone_fn -- converts a single zone of the heap
+ *
+ * Called concurrently for different zones, so it must not modify anything
+ * outside of the zone. Every modified range has to be added to the ranges,
+ * which are persisted by the driver once the callback returns. A zone may
+ * be converted again if the conversion was interrupted, hence the callback
+ * must be idempotent.
+ */
+typedef int (*convert_zone_fn)(unsigned zone_id,
+	struct convert_ranges *ranges, void *arg);
+
+int convert_foreach_zone(unsigned nzones, convert_zone_fn fn, void *arg,
+	uint64_t *done);
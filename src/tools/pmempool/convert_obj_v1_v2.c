@@ -204,6 +204,9 @@ struct tx_range_cache {
 static struct pmemobjpool *pop;
 static struct heap_layout *heap;
 
+/* ranges modified outside of the lanes during recovery */
+static struct convert_ranges ranges;
+
 #define D_RW pmemobj_direct
 
 #define D_RW_OBJ(_oid)\
@@ -321,6 +324,7 @@ redo_recover(struct redo_log *redo, size_t nentries)
 	while ((redo->offset & REDO_FINISH_FLAG) == 0) {
 		val = (uint64_t *)((uintptr_t)pop + redo->offset);
 		*val = redo->value;
+		convert_ranges_add(&ranges, val, sizeof(*val));
 
 		redo++;
 	}
@@ -328,6 +332,7 @@ redo_recover(struct redo_log *redo, size_t nentries)
 	uint64_t offset = redo->offset & REDO_FLAG_MASK;
 	val = (uint64_t *)((uintptr_t)pop + offset);
 	*val = redo->value;
+	convert_ranges_add(&ranges, val, sizeof(*val));
 }
 
 static int
@@ -346,6 +351,7 @@ pfree(uint64_t *off)
 	struct chunk_header *chdr = &z->chunk_headers[hdr->chunk_id];
 	if (chdr->type == CHUNK_TYPE_USED) {
 		chdr->type = CHUNK_TYPE_FREE;
+		convert_ranges_add(&ranges, chdr, sizeof(*chdr));
 		return 0;
 	} else if (chdr->type != CHUNK_TYPE_RUN) {
 		assert(0);
@@ -363,6 +369,8 @@ pfree(uint64_t *off)
 	uint64_t bpos = block_off / BITS_PER_VALUE;
 
 	run->bitmap[bpos] &= ~bmask;
+	convert_ranges_add(&ranges, &run->bitmap[bpos],
+		sizeof(run->bitmap[bpos]));
 	*off = 0;
 
 	return 0;
@@ -404,9 +412,12 @@ foreach_clear_undo_list(struct list_head *head,
 
 		if (free)
 			pfree(&iter.off);
-		else
+		else {
 			memset(&D_RW_OBJ(iter)->oobh.oob, 0,
 				sizeof(struct list_entry));
+			convert_ranges_add(&ranges, &D_RW_OBJ(iter)->oobh.oob,
+				sizeof(struct list_entry));
+		}
 
 		iter = next;
 	};
@@ -419,6 +430,7 @@ restore_range(struct tx_range *r)
 {
 	void *dest = (char *)pop + r->offset;
 	memcpy(dest, r->data, r->size);
+	convert_ranges_add(&ranges, dest, r->size);
 }
 
 static void
@@ -525,8 +537,7 @@ convert_v1_v2(void *addr)
 	if (le32toh(pop->hdr.major) != SOURCE_MAJOR_VERSION)
 		return -1;
 
-	pop->hdr.major = htole32(TARGET_MAJOR_VERSION);
-	util_checksum(&pop->hdr, sizeof(pop->hdr), &pop->hdr.checksum, 1);
+	ranges.n = 0;
 
 	struct lane_layout *lanes =
 		(struct lane_layout *)((char *)addr + pop->lanes_offset);
@@ -539,6 +550,17 @@ convert_v1_v2(void *addr)
 			&lanes[i].sections[LANE_SECTION_TRANSACTION]);
 	}
 	memset(lanes, 0, pop->nlanes * sizeof(struct lane_layout));
+	convert_ranges_add(&ranges, lanes,
+		pop->nlanes * sizeof(struct lane_layout));
+	convert_ranges_persist(&ranges);
+
+	/*
+	 * The version is bumped only after the recovered pool is persistent,
+	 * so an interrupted conversion can be simply started over.
+	 */
+	pop->hdr.major = htole32(TARGET_MAJOR_VERSION);
+	util_checksum(&pop->hdr, sizeof(pop->hdr), &pop->hdr.checksum, 1);
+	convert_persist(&pop->hdr, sizeof(pop->hdr));
 
 	return 0;
 }
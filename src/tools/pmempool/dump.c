@@ -42,6 +42,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <err.h>
+#include <pthread.h>
 #include "common.h"
 #include "dump.h"
 #include "output.h"
@@ -50,6 +51,15 @@
 
 #define VERBOSE_DEFAULT	1
 
+/* size of the buffer for blocks read at once and of the output buffer */
+#define DUMP_BUFF_SIZE	((size_t)8 << 20)
+
+/* maximum number of threads reading blocks of a single buffer */
+#define DUMP_THREADS_MAX 8
+
+/* minimum number of blocks read by a single thread */
+#define DUMP_THREAD_MIN_BLOCKS 256
+
 /*
  * pmempool_dump -- context and arguments for dump command
  */
@@ -225,8 +235,89 @@ end:
 	return 0;
 }
 
+/*
+ * dump_blk_job -- consecutive blocks read by a single thread
+ */
+struct dump_blk_job {
+	PMEMblkpool *pbp;
+	struct pmemblk_vec *vec;
+	size_t count;
+	int failed;
+};
+
+/*
+ * pmempool_dump_blk_worker -- read blocks of a single job
+ */
+static void *
+pmempool_dump_blk_worker(void *arg)
+{
+	struct dump_blk_job *job = arg;
+
+	job->failed = pmemblk_readv(job->pbp, job->vec, job->count) != 0;
+
+	return NULL;
+}
+
+/*
+ * pmempool_dump_blk_read -- read consecutive blocks into the buffer
+ *
+ * The blocks are split between up to nthreads threads, each of them reads
+ * its part with a single pmemblk_readv() call.  Returns the number of
+ * blocks read before the first failing one.
+ */
+static uint64_t
+pmempool_dump_blk_read(PMEMblkpool *pbp, struct pmemblk_vec *vec,
+	uint64_t count, unsigned nthreads)
+{
+	uint64_t per_thread = (count + nthreads - 1) / nthreads;
+	if (per_thread < DUMP_THREAD_MIN_BLOCKS)
+		per_thread = DUMP_THREAD_MIN_BLOCKS;
+
+	struct dump_blk_job jobs[DUMP_THREADS_MAX];
+	pthread_t threads[DUMP_THREADS_MAX];
+	int started[DUMP_THREADS_MAX];
+	unsigned njobs = 0;
+
+	for (uint64_t b = 0; b < count; b += per_thread, njobs++) {
+		jobs[njobs].pbp = pbp;
+		jobs[njobs].vec = &vec[b];
+		jobs[njobs].count = count - b < per_thread ?
+			count - b : per_thread;
+
+		started[njobs] = njobs != 0 && pthread_create(&threads[njobs],
+				NULL, pmempool_dump_blk_worker,
+				&jobs[njobs]) == 0;
+	}
+
+	pmempool_dump_blk_worker(&jobs[0]);
+
+	for (unsigned j = 1; j < njobs; j++) {
+		if (started[j])
+			pthread_join(threads[j], NULL);
+		else
+			pmempool_dump_blk_worker(&jobs[j]);
+	}
+
+	for (unsigned j = 0; j < njobs; j++) {
+		if (!jobs[j].failed)
+			continue;
+
+		/* find the failing block of the job */
+		uint64_t b = (uint64_t)(jobs[j].vec - vec);
+		while (b < count && pmemblk_read(pbp, vec[b].buf,
+				vec[b].blockno) == 0)
+			b++;
+		return b;
+	}
+
+	return count;
+}
+
 /*
  * pmempool_dump_blk -- dump data from pmem blk pool
+ *
+ * The blocks are read in batches filling up a large buffer, which in
+ * binary mode is then written with a single call.
  */
 static int
 pmempool_dump_blk(struct pmempool_dump *pdp)
@@ -245,10 +336,23 @@ pmempool_dump_blk(struct pmempool_dump *pdp)
 		util_ranges_add(&pdp->ranges, entire);
 	}
 
-	uint8_t *buff = malloc(pdp->bsize);
+	uint64_t nbatch = DUMP_BUFF_SIZE / pdp->bsize;
+	if (nbatch == 0)
+		nbatch = 1;
+
+	uint8_t *buff = malloc(nbatch * pdp->bsize);
 	if (!buff)
 		err(1, "Cannot allocate memory for pmemblk block buffer");
 
+	struct pmemblk_vec *vec = malloc(nbatch * sizeof(*vec));
+	if (!vec)
+		err(1, "Cannot allocate memory for pmemblk block vector");
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned nthreads = ncpus > 1 ? (unsigned)ncpus : 1;
+	if (nthreads > DUMP_THREADS_MAX)
+		nthreads = DUMP_THREADS_MAX;
+
 	int ret = 0;
 
 	uint64_t i;
@@ -256,30 +360,43 @@ pmempool_dump_blk(struct pmempool_dump *pdp)
 	assert((off_t)entire.last >= 0);
 	LIST_FOREACH(curp, &pdp->ranges.head, next) {
 		assert((off_t)curp->last >= 0);
-		for (i = curp->first;
-				i <= curp->last && i <= entire.last; i++) {
-			if (pmemblk_read(pbp, buff, (off_t)i)) {
-				ret = -1;
-				outv_err("reading block number %lu "
-					"failed\n", i);
-				break;
+		uint64_t last = curp->last < entire.last ?
+			curp->last : entire.last;
+		for (i = curp->first; i <= last; i += nbatch) {
+			uint64_t count = last - i + 1 < nbatch ?
+				last - i + 1 : nbatch;
+			for (uint64_t b = 0; b < count; b++) {
+				vec[b].buf = buff + b * pdp->bsize;
+				vec[b].blockno = (long long)(i + b);
 			}
 
+			uint64_t nread = pmempool_dump_blk_read(pbp, vec,
+					count, nthreads);
+
 			if (pdp->hex) {
-				uint64_t offset = i * pdp->bsize;
-				outv_hexdump(VERBOSE_DEFAULT, buff,
-						pdp->bsize, offset, 0);
-			} else {
-				if (fwrite(buff, pdp->bsize, 1,
-							pdp->ofh) != 1) {
-					warn("write");
-					ret = -1;
-					break;
+				for (uint64_t b = 0; b < nread; b++) {
+					uint64_t offset = (i + b) * pdp->bsize;
+					outv_hexdump(VERBOSE_DEFAULT,
+						vec[b].buf, pdp->bsize,
+						offset, 0);
 				}
+			} else if (nread && fwrite(buff, pdp->bsize, nread,
+					pdp->ofh) != nread) {
+				warn("write");
+				ret = -1;
+				break;
+			}
+
+			if (nread < count) {
+				ret = -1;
+				outv_err("reading block number %lu "
+					"failed\n", i + nread);
+				break;
 			}
 		}
 	}
 
+	free(vec);
 	free(buff);
 	pmemblk_close(pbp);
 
@@ -352,6 +469,10 @@ pmempool_dump_func(char *appname, int argc, char *argv[])
 		}
 	}
 
+	/* binary data is written in large chunks, so buffer it accordingly */
+	if (!pd.hex)
+		setvbuf(pd.ofh, NULL, _IOFBF, DUMP_BUFF_SIZE);
+
 	/* set output stream - stdout or file passed by -o option */
 	out_set_stream(pd.ofh);
 
@@ -146,6 +146,7 @@ static const struct option long_options[] = {
 	{"chunk-type",	required_argument,	0, 'T' | OPT_OBJ},
 	{"bitmap",	no_argument,		0, 'b' | OPT_OBJ},
 	{"replica",	required_argument,	0, 'p' | OPT_OBJ},
+	{"json",	no_argument,		0, 'j' | OPT_OBJ},
 	{NULL,		0,			0,  0 },
 };
 
@@ -241,6 +242,11 @@ static const struct option_requirement option_requirements[] = {
 		.type	= PMEM_POOL_TYPE_OBJ,
 		.req	= OPT_REQ0('O') | OPT_REQ1('o'),
 	},
+	{
+		.opt	= 'j',
+		.type	= PMEM_POOL_TYPE_OBJ,
+		.req	= OPT_REQ0('s'),
+	},
 	{ 0,  0, 0}
 };
 
@@ -296,6 +302,8 @@ static const char *help_str =
 "  -b, --bitmap                    Print chunk run's bitmap in graphical\n"
 "                                  format. [requires --chunks|-C]\n"
 "  -p, --replica <num>             Print info from specified replica\n"
+"  -j, --json                      Print only statistics, in JSON format.\n"
+"                                  [requires --stats|-s]\n"
 "For complete documentation see %s-info(1) manual page.\n"
 ;
 
@@ -350,7 +358,7 @@ parse_args(char *appname, int argc, char *argv[],
 
 	struct ranges *rangesp = &argsp->ranges;
 	while ((opt = util_options_getopt(argc, argv,
-			"vhnf:ezuF:L:c:dmxVw:gBsr:lRS:OECZHT:bot:aAp:",
+			"vhnf:ezuF:L:c:dmxVw:gBsr:lRS:OECZHT:bot:aAp:j",
 			opts)) != -1) {
 
 		switch (opt) {
@@ -498,6 +506,9 @@ parse_args(char *appname, int argc, char *argv[],
 			argsp->obj.replica = (size_t)ll;
 			break;
 		}
+		case 'j':
+			argsp->obj.json = true;
+			break;
 		default:
 			print_usage(appname);
 			return -1;
@@ -820,7 +831,8 @@ pmempool_info_func(char *appname, int argc, char *argv[])
 	if ((ret = parse_args(appname, argc, argv, &pip->args,
 					pip->opts)) == 0) {
 		/* set some output format values */
-		out_set_vlevel(pip->args.vlevel);
+		out_set_vlevel(pip->args.obj.json ? VERBOSE_SILENT :
+				pip->args.vlevel);
 		out_set_col_width(pip->args.col_width);
 
 		ret = pmempool_info_file(pip, pip->args.file);
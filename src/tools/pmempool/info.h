@@ -101,6 +101,7 @@ struct pmempool_info_args {
 		uint64_t lane_sections;
 		bool lanes_recovery;
 		bool ignore_empty_obj;
+		bool json;		/* print statistics in JSON format */
 		uint64_t chunk_types;
 		size_t replica;
 		struct ranges lane_ranges;
@@ -35,13 +35,34 @@
  */
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <err.h>
 #include <sys/mman.h>
+#include <endian.h>
 
 #include "common.h"
 #include "output.h"
 #include "info.h"
 
+/*
+ * info_log_ring -- return true if the log is a ring buffer
+ */
+static int
+info_log_ring(struct pmemlog *plp)
+{
+	return (le32toh(plp->hdr.incompat_features) &
+			LOG_FORMAT_INCOMPAT_RING) != 0;
+}
+
+/*
+ * info_log_head -- return the position of the first valid byte of the log
+ */
+static uint64_t
+info_log_head(struct pmemlog *plp)
+{
+	return info_log_ring(plp) ? plp->head_offset : plp->start_offset;
+}
+
 /*
  * info_log_data -- print used data from log pool
  */
@@ -51,7 +72,8 @@ info_log_data(struct pmem_info *pip, int v, struct pmemlog *plp)
 	if (!outv_check(v))
 		return 0;
 
-	uint64_t size_used = plp->write_offset - plp->start_offset;
+	uint64_t head = info_log_head(plp);
+	uint64_t size_used = plp->write_offset - head;
 
 	if (size_used == 0)
 		return 0;
@@ -63,6 +85,30 @@ info_log_data(struct pmem_info *pip, int v, struct pmemlog *plp)
 		return -1;
 	}
 
+	/* the data of a ring log may wrap around the end of the pool */
+	uint64_t nbyte = plp->end_offset - plp->start_offset;
+	uint64_t first = (head - plp->start_offset) % nbyte;
+	uint8_t *data = NULL;
+
+	/* only the used part of the log is read */
+	if (first + size_used > nbyte) {
+		pool_set_file_prefetch(pip->pfile, plp->start_offset + first,
+			nbyte - first);
+		pool_set_file_prefetch(pip->pfile, plp->start_offset,
+			size_used - nbyte + first);
+
+		data = malloc(size_used);
+		if (!data)
+			err(1, "Cannot allocate memory for pmemlog data");
+		memcpy(data, addr + first, nbyte - first);
+		memcpy(data + nbyte - first, addr, size_used - nbyte + first);
+		addr = data;
+	} else {
+		pool_set_file_prefetch(pip->pfile, plp->start_offset + first,
+			size_used);
+		addr += first;
+	}
+
 	if (pip->args.log.walk == 0) {
 		outv_title(v, "PMEMLOG data");
 		struct range *curp = NULL;
@@ -71,8 +117,7 @@ info_log_data(struct pmem_info *pip, int v, struct pmemlog *plp)
 			if (curp->last >= size_used)
 				curp->last = size_used - 1;
 			uint64_t count = curp->last - curp->first + 1;
-			outv_hexdump(v, ptr, count, curp->first +
-					plp->start_offset, 1);
+			outv_hexdump(v, ptr, count, curp->first + head, 1);
 			size_used -= count;
 			if (!size_used)
 				break;
@@ -96,13 +141,14 @@ info_log_data(struct pmem_info *pip, int v, struct pmemlog *plp)
 				outv(v, "Chunk %10u:\n", i);
 				outv_hexdump(v, addr + i * pip->args.log.walk,
 					pip->args.log.walk,
-					plp->start_offset +
-					i * pip->args.log.walk,
+					head + i * pip->args.log.walk,
 					1);
 			}
 		}
 	}
 
+	free(data);
+
 	return 0;
 }
 
@@ -113,7 +159,7 @@ static void
 info_log_stats(struct pmem_info *pip, int v, struct pmemlog *plp)
 {
 	uint64_t size_total = plp->end_offset - plp->start_offset;
-	uint64_t size_used = plp->write_offset - plp->start_offset;
+	uint64_t size_used = plp->write_offset - info_log_head(plp);
 	uint64_t size_avail = size_total - size_used;
 
 	if (size_total == 0)
@@ -150,12 +196,25 @@ info_log_descriptor(struct pmem_info *pip, int v, struct pmemlog *plp)
 
 	pmemlog_convert2h(plp);
 
-	int write_offset_valid = plp->write_offset >= plp->start_offset &&
-				plp->write_offset <= plp->end_offset;
+	uint64_t head = info_log_head(plp);
+	int write_offset_valid = head >= plp->start_offset &&
+				plp->write_offset >= head &&
+				plp->write_offset - head <=
+				plp->end_offset - plp->start_offset;
 	outv_field(v, "Start offset", "0x%lx", plp->start_offset);
+	if (info_log_ring(plp))
+		outv_field(v, "Head offset", "0x%lx", head);
 	outv_field(v, "Write offset", "0x%lx [%s]", plp->write_offset,
 			write_offset_valid ? "OK":"ERROR");
 	outv_field(v, "End offset", "0x%lx", plp->end_offset);
+	if (le32toh(plp->hdr.incompat_features) & LOG_FORMAT_INCOMPAT_INDEX) {
+		outv_field(v, "Index interval", "%s",
+			out_get_size_str(plp->index_interval,
+				pip->args.human));
+		outv_field(v, "Index entries", "%lu", plp->index_count);
+	}
+	if (le32toh(plp->hdr.incompat_features) & LOG_FORMAT_INCOMPAT_FRAMED)
+		outv_field(v, "Records", "framed, CRC32C");
 
 	return write_offset_valid;
 }
@@ -40,6 +40,8 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "output.h"
@@ -53,6 +55,9 @@
 
 #define DEFAULT_BUCKET MAX_BUCKETS
 
+/* maximum number of threads collecting heap statistics */
+#define STATS_THREADS_MAX 16
+
 typedef void (*pvector_callback_fn)(struct pmem_info *pip, int v, int vnum,
 		void *ptr, size_t i);
 
@@ -114,7 +119,7 @@ lane_need_recovery_tx(struct pmem_info *pip,
 
 	if (off != 0) {
 		struct tx_range_cache *cache = OFF_TO_PTR(pip->obj.pop, off);
-		struct tx_range *range = (struct tx_range *)&cache->range[0];
+		struct tx_range *range = (struct tx_range *)cache->data;
 
 		set_cache = (range->offset && range->size);
 	}
@@ -180,7 +185,7 @@ heap_class_to_size(int class)
 static uint32_t
 get_bitmap_size(struct chunk_run *run)
 {
-	uint64_t size = RUNSIZE / run->block_size;
+	uint64_t size = RUN_DATA_SIZE(run->block_size) / run->block_size;
 	assert(size <= UINT32_MAX);
 	return (uint32_t)size;
 }
@@ -197,10 +202,11 @@ get_bitmap_reserved(struct chunk_run *run, uint32_t *reserved)
 			&last_val))
 		return -1;
 
+	uint64_t *bitmap = RUN_BITMAP(run);
 	uint32_t ret = 0;
 	for (uint64_t i = 0; i < nvals - 1; i++)
-		ret += util_count_ones(run->bitmap[i]);
-	ret += util_count_ones(run->bitmap[nvals - 1] & ~last_val);
+		ret += util_count_ones(bitmap[i]);
+	ret += util_count_ones(bitmap[nvals - 1] & ~last_val);
 
 	*reserved = ret;
 
@@ -419,17 +425,21 @@ set_entry_cache_cb(struct pmem_info *pip, int v, int vid,
 	info_obj_object_hdr(pip, v, vid, ptr, i);
 
 	int title = 0;
-	for (int i = 0; i < MAX_CACHED_RANGES; ++i) {
-		struct tx_range *range = (struct tx_range *)&cache->range[i];
+	unsigned n = 0;
+	for (uint64_t pos = 0; pos + sizeof(struct tx_range) <=
+			cache->capacity; ++n) {
+		struct tx_range *range = (struct tx_range *)&cache->data[pos];
 		if (range->offset == 0 || range->size == 0)
 			break;
 
+		pos += TX_RANGE_ENTRY_SIZE(range->size);
+
 		if (!title) {
 			outv_title(v, "Tx range cache");
 			outv_indent(v, 1);
 			title = 1;
 		}
-		outv(v, "%010u: Offset: 0x%016lx Size: %s\n", i, range->offset,
+		outv(v, "%010u: Offset: 0x%016lx Size: %s\n", n, range->offset,
 			out_get_size_str(range->size, pip->args.human));
 	}
 	if (title)
@@ -513,6 +523,15 @@ info_obj_lanes(struct pmem_info *pip)
 			pop->lanes_offset);
 	struct range *curp = NULL;
 	FOREACH_RANGE(curp, &pip->args.obj.lane_ranges) {
+		if (curp->first >= pop->nlanes)
+			continue;
+
+		uint64_t last = curp->last < pop->nlanes ?
+			curp->last : pop->nlanes - 1;
+		pool_set_file_prefetch(pip->pfile, pop->lanes_offset +
+			curp->first * sizeof(struct lane_layout),
+			(last - curp->first + 1) * sizeof(struct lane_layout));
+
 		for (uint64_t i = curp->first;
 			i <= curp->last && i < pop->nlanes; i++) {
 
@@ -625,10 +644,11 @@ static void
 info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
 {
 	uint32_t bsize = get_bitmap_size(run);
+	uint64_t *bitmap = RUN_BITMAP(run);
 	uint32_t i = 0;
 	while (i < bsize) {
 		uint32_t nval = i / BITS_PER_VALUE;
-		uint64_t bval = run->bitmap[nval];
+		uint64_t bval = bitmap[nval];
 		uint32_t nbit = i % BITS_PER_VALUE;
 
 		if (!(bval & (1ULL << nbit))) {
@@ -636,8 +656,9 @@ info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
 			continue;
 		}
 
+		uint8_t *data = RUN_DATA(run);
 		struct obj_header *objh =
-			(struct obj_header *)&run->data[run->block_size * i];
+			(struct obj_header *)&data[run->block_size * i];
 
 		/* skip root object */
 		if (!objh->oobh.size) {
@@ -656,24 +677,28 @@ static void
 info_obj_run_bitmap(int v, struct chunk_run *run)
 {
 	uint32_t bsize = get_bitmap_size(run);
+	uint64_t *bitmap = RUN_BITMAP(run);
 
 	if (outv_check(v) && outv_check(VERBOSE_MAX)) {
 		/* print all values from bitmap for higher verbosity */
-		for (int i = 0; i < MAX_BITMAP_VALUES; i++) {
+		uint32_t nvals = (bsize - 1) / BITS_PER_VALUE + 1;
+		if (nvals < MAX_BITMAP_VALUES)
+			nvals = MAX_BITMAP_VALUES;
+		for (uint32_t i = 0; i < nvals; i++) {
 			outv(VERBOSE_MAX, "%s\n",
-					get_bitmap_str(run->bitmap[i],
+					get_bitmap_str(bitmap[i],
 						BITS_PER_VALUE));
 		}
 	} else {
 		/* print only used values for lower verbosity */
 		uint32_t i;
 		for (i = 0; i < bsize / BITS_PER_VALUE; i++)
-			outv(v, "%s\n", get_bitmap_str(run->bitmap[i],
+			outv(v, "%s\n", get_bitmap_str(bitmap[i],
 						BITS_PER_VALUE));
 
 		unsigned mod = bsize % BITS_PER_VALUE;
 		if (mod != 0) {
-			outv(v, "%s\n", get_bitmap_str(run->bitmap[i], mod));
+			outv(v, "%s\n", get_bitmap_str(bitmap[i], mod));
 		}
 	}
 }
@@ -744,8 +769,12 @@ info_obj_chunk(struct pmem_info *pip, uint64_t c,
 			}
 
 			info_obj_run_bitmap(v && pip->args.obj.vbitmap, run);
-			info_obj_run_objects(pip, v && pip->args.obj.vobjects,
-					run);
+
+			/* objects without allocation headers aren't listed */
+			if (!(chunk_hdr->flags & (CHUNK_FLAG_COMPACT_HEADER |
+					CHUNK_FLAG_HEADER_NONE)))
+				info_obj_run_objects(pip,
+					v && pip->args.obj.vobjects, run);
 		} else {
 			outv_field(v, "Block size", "%s [invalid!]",
 					out_get_size_str(run->block_size,
@@ -754,6 +783,19 @@ info_obj_chunk(struct pmem_info *pip, uint64_t c,
 	}
 }
 
+/*
+ * info_obj_zone_prefetch -- (internal) prefetches the headers of the zone
+ *	which is about to be walked and enables the readahead of its chunks
+ */
+static void
+info_obj_zone_prefetch(struct pmem_info *pip, struct zone *zone)
+{
+	uint64_t off = (uint64_t)((char *)zone - (char *)pip->obj.pop);
+	pool_set_file_prefetch(pip->pfile, off, offsetof(struct zone, chunks));
+	pool_set_file_readahead(pip->pfile, off + offsetof(struct zone, chunks),
+		(size_t)zone->header.size_idx * CHUNKSIZE);
+}
+
 /*
  * info_obj_zone_chunks -- print chunk headers from specified zone
  */
@@ -818,6 +860,249 @@ info_obj_root_obj(struct pmem_info *pip)
 	info_obj_object_hdr(pip, v, VERBOSE_SILENT, OBJH_TO_PTR(objh), 0);
 }
 
+/*
+ * info_obj_stats_object -- (internal) add object to statistics
+ */
+static void
+info_obj_stats_object(struct pmem_info *pip, struct obj_header *objh,
+	struct pmem_obj_stats *objs)
+{
+	if (!util_ranges_contain(&pip->args.obj.type_ranges,
+			objh->oobh.type_num))
+		return;
+
+	if (!util_ranges_contain(&pip->args.obj.zone_ranges,
+			objh->ahdr.zone_id))
+		return;
+
+	if (!util_ranges_contain(&pip->args.obj.chunk_ranges,
+			objh->ahdr.chunk_id))
+		return;
+
+	uint64_t real_size = objh->ahdr.size - sizeof(struct obj_header);
+
+	objs->n_total_objects++;
+	objs->n_total_bytes += real_size;
+
+	struct pmem_obj_type_stats *type_stats =
+		pmem_obj_stats_get_type(objs, objh->oobh.type_num);
+
+	type_stats->n_objects++;
+	type_stats->n_bytes += real_size;
+}
+
+/*
+ * info_obj_stats_chunk -- (internal) add chunk to statistics
+ */
+static void
+info_obj_stats_chunk(struct pmem_info *pip, struct chunk_header *chunk_hdr,
+	struct chunk *chunk, struct pmem_obj_zone_stats *stats,
+	struct pmem_obj_stats *objs)
+{
+	if (chunk_hdr->type == CHUNK_TYPE_USED ||
+		chunk_hdr->type == CHUNK_TYPE_FREE) {
+		stats->class_stats[DEFAULT_BUCKET].n_units +=
+			chunk_hdr->size_idx;
+
+		if (chunk_hdr->type == CHUNK_TYPE_USED) {
+			stats->class_stats[DEFAULT_BUCKET].n_used +=
+				chunk_hdr->size_idx;
+
+			struct obj_header *objh =
+				(struct obj_header *)chunk->data;
+
+			/* skip root object */
+			if (!objh->oobh.size)
+				info_obj_stats_object(pip, objh, objs);
+		}
+		return;
+	}
+
+	if (chunk_hdr->type != CHUNK_TYPE_RUN)
+		return;
+
+	struct chunk_run *run = (struct chunk_run *)chunk;
+	int class = heap_size_to_class(run->block_size);
+	if (class < 0 || class >= MAX_CLASS_STATS)
+		return;
+
+	uint32_t used = 0;
+	if (!get_bitmap_reserved(run, &used)) {
+		stats->class_stats[class].n_units += get_bitmap_size(run);
+		stats->class_stats[class].n_used += used;
+	}
+
+	/* objects without allocation headers aren't listed */
+	if (chunk_hdr->flags & (CHUNK_FLAG_COMPACT_HEADER |
+			CHUNK_FLAG_HEADER_NONE))
+		return;
+
+	uint32_t bsize = get_bitmap_size(run);
+	uint64_t *bitmap = RUN_BITMAP(run);
+	uint8_t *data = RUN_DATA(run);
+	uint32_t i = 0;
+	while (i < bsize) {
+		if (!(bitmap[i / BITS_PER_VALUE] &
+				(1ULL << (i % BITS_PER_VALUE)))) {
+			i++;
+			continue;
+		}
+
+		struct obj_header *objh =
+			(struct obj_header *)&data[run->block_size * i];
+
+		/* skip root object */
+		if (!objh->oobh.size)
+			info_obj_stats_object(pip, objh, objs);
+
+		i += (uint32_t)(objh->ahdr.size / run->block_size);
+	}
+}
+
+/*
+ * info_obj_stats_zone -- (internal) collect statistics of a single zone
+ */
+static void
+info_obj_stats_zone(struct pmem_info *pip, struct zone *zone,
+	struct pmem_obj_zone_stats *stats, struct pmem_obj_stats *objs)
+{
+	uint64_t c = 0;
+	while (c < zone->header.size_idx) {
+		enum chunk_type type = zone->chunk_headers[c].type;
+		uint64_t size_idx = zone->chunk_headers[c].size_idx;
+		if (util_ranges_contain(&pip->args.obj.chunk_ranges, c) &&
+			(pip->args.obj.chunk_types & (1ULL << type))) {
+			stats->n_chunks++;
+			stats->n_chunks_type[type]++;
+
+			stats->size_chunks += size_idx;
+			stats->size_chunks_type[type] += size_idx;
+
+			info_obj_stats_chunk(pip, &zone->chunk_headers[c],
+					&zone->chunks[c], stats, objs);
+		}
+
+		c += size_idx;
+	}
+}
+
+/*
+ * info_obj_stats_job -- zones processed by a single thread
+ */
+struct info_obj_stats_job {
+	struct pmem_info *pip;
+	struct heap_layout *layout;
+	size_t nzones;
+	size_t first;		/* first zone of the thread */
+	size_t stride;		/* the number of threads */
+	struct pmem_obj_stats *objs;	/* objects' statistics per zone */
+};
+
+/*
+ * info_obj_stats_worker -- (internal) collect statistics of every
+ * stride-th zone
+ */
+static void *
+info_obj_stats_worker(void *arg)
+{
+	struct info_obj_stats_job *job = arg;
+	struct pmem_info *pip = job->pip;
+
+	for (size_t i = job->first; i < job->nzones; i += job->stride) {
+		if (!util_ranges_contain(&pip->args.obj.zone_ranges, i))
+			continue;
+
+		struct zone *zone = ZID_TO_ZONE(job->layout, i);
+		info_obj_zone_prefetch(pip, zone);
+		info_obj_stats_zone(pip, zone, &pip->obj.stats.zone_stats[i],
+				&job->objs[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * info_obj_zones_stats -- (internal) collect statistics of all zones
+ *
+ * Used when nothing but the statistics is printed, the zones are then
+ * walked by multiple threads and the objects' statistics of each zone
+ * are merged afterwards.
+ */
+static void
+info_obj_zones_stats(struct pmem_info *pip, struct heap_layout *layout,
+	size_t validzone)
+{
+	for (size_t i = 0; i < validzone; i++) {
+		if (util_ranges_contain(&pip->args.obj.zone_ranges, i) &&
+			ZID_TO_ZONE(layout, i)->header.magic ==
+			ZONE_HEADER_MAGIC)
+			pip->obj.stats.n_zones_used++;
+	}
+
+	if (validzone == 0)
+		return;
+
+	struct pmem_obj_stats *objs = calloc(validzone, sizeof(*objs));
+	if (!objs)
+		err(1, "Cannot allocate memory for zone stats");
+
+	for (size_t i = 0; i < validzone; i++)
+		TAILQ_INIT(&objs[i].type_stats);
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = ncpus > 1 ? (size_t)ncpus : 1;
+	if (nthreads > STATS_THREADS_MAX)
+		nthreads = STATS_THREADS_MAX;
+	if (nthreads > validzone)
+		nthreads = validzone;
+
+	struct info_obj_stats_job jobs[STATS_THREADS_MAX];
+	pthread_t threads[STATS_THREADS_MAX];
+	int started[STATS_THREADS_MAX];
+
+	for (size_t t = 0; t < nthreads; t++) {
+		jobs[t].pip = pip;
+		jobs[t].layout = layout;
+		jobs[t].nzones = validzone;
+		jobs[t].first = t;
+		jobs[t].stride = nthreads;
+		jobs[t].objs = objs;
+
+		started[t] = t != 0 && pthread_create(&threads[t], NULL,
+				info_obj_stats_worker, &jobs[t]) == 0;
+	}
+
+	info_obj_stats_worker(&jobs[0]);
+
+	for (size_t t = 1; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		else
+			info_obj_stats_worker(&jobs[t]);
+	}
+
+	/* merge objects' statistics in order of zones */
+	for (size_t i = 0; i < validzone; i++) {
+		pip->obj.stats.n_total_objects += objs[i].n_total_objects;
+		pip->obj.stats.n_total_bytes += objs[i].n_total_bytes;
+
+		while (!TAILQ_EMPTY(&objs[i].type_stats)) {
+			struct pmem_obj_type_stats *zt =
+				TAILQ_FIRST(&objs[i].type_stats);
+			struct pmem_obj_type_stats *t =
+				pmem_obj_stats_get_type(&pip->obj.stats,
+					zt->type_num);
+			t->n_objects += zt->n_objects;
+			t->n_bytes += zt->n_bytes;
+
+			TAILQ_REMOVE(&objs[i].type_stats, zt, next);
+			free(zt);
+		}
+	}
+
+	free(objs);
+}
+
 /*
  * info_obj_zones -- print zones and chunks
  */
@@ -826,18 +1111,35 @@ info_obj_zones_chunks(struct pmem_info *pip)
 {
 	if (!outv_check(pip->args.obj.vheap) &&
 		!outv_check(pip->args.vstats) &&
-		!outv_check(pip->args.obj.vobjects))
+		!outv_check(pip->args.obj.vobjects) &&
+		!pip->args.obj.json)
 		return;
 
 	struct pmemobjpool *pop = pip->obj.pop;
 	struct heap_layout *layout = OFF_TO_PTR(pop, pop->heap_offset);
 	size_t maxzone = util_heap_max_zone(pop->heap_size);
 	pip->obj.stats.n_zones = maxzone;
+
+	/* zones past the high-water mark haven't been initialized yet */
+	size_t validzone = maxzone;
+	uint64_t mark = layout->zone0.header.zones_valid;
+	if (mark != 0 && mark - 1 < maxzone)
+		validzone = mark - 1;
+
 	pip->obj.stats.zone_stats = calloc(maxzone,
 			sizeof(struct pmem_obj_zone_stats));
 	if (!pip->obj.stats.zone_stats)
 		err(1, "Cannot allocate memory for zone stats");
 
+	/* the zones are walked in order only if anything is printed */
+	if (!outv_check(pip->args.obj.vheap) &&
+		!outv_check(pip->args.obj.vchunkhdr) &&
+		!outv_check(pip->args.obj.vobjects) &&
+		!pip->args.use_range) {
+		info_obj_zones_stats(pip, layout, validzone);
+		return;
+	}
+
 	for (size_t i = 0; i < maxzone; i++) {
 		struct zone *zone = ZID_TO_ZONE(layout, i);
 
@@ -848,13 +1150,19 @@ info_obj_zones_chunks(struct pmem_info *pip)
 
 			outv_title(vvv, "Zone", "%lu", i);
 
-			if (zone->header.magic == ZONE_HEADER_MAGIC)
+			if (i < validzone &&
+				zone->header.magic == ZONE_HEADER_MAGIC)
 				pip->obj.stats.n_zones_used++;
 
 			info_obj_zone_hdr(pip, pip->args.obj.vheap &&
 					pip->args.obj.vzonehdr,
 					&zone->header);
 
+			if (i >= validzone)
+				continue;
+
+			info_obj_zone_prefetch(pip, zone);
+
 			outv_indent(vvv, 1);
 			info_obj_zone_chunks(pip, zone,
 					&pip->obj.stats.zone_stats[i]);
@@ -1062,7 +1370,7 @@ info_obj_add_zone_stats(struct pmem_obj_zone_stats *total,
 			stats->size_chunks_type[type];
 	}
 
-	for (int class = 0; class < MAX_BUCKETS; class++) {
+	for (int class = 0; class < MAX_CLASS_STATS; class++) {
 		total->class_stats[class].n_units +=
 			stats->class_stats[class].n_units;
 		total->class_stats[class].n_used +=
@@ -1134,6 +1442,85 @@ info_obj_stats(struct pmem_info *pip)
 
 }
 
+/*
+ * info_obj_stats_json_zone -- print zone's statistics as a JSON object
+ */
+static void
+info_obj_stats_json_zone(struct pmem_obj_zone_stats *stats)
+{
+	printf("{\"chunks\": {\"count\": %lu, \"size\": %lu, \"types\": {",
+		stats->n_chunks, stats->size_chunks);
+
+	const char *sep = "";
+	for (unsigned type = 0; type < MAX_CHUNK_TYPE; type++) {
+		if (!stats->n_chunks_type[type])
+			continue;
+		printf("%s\"%s\": {\"count\": %lu, \"size\": %lu}", sep,
+			out_get_chunk_type_str(type),
+			stats->n_chunks_type[type],
+			stats->size_chunks_type[type]);
+		sep = ", ";
+	}
+
+	printf("}}, \"classes\": [");
+
+	sep = "";
+	for (int class = 0; class < MAX_CLASS_STATS; class++) {
+		if (!stats->class_stats[class].n_units)
+			continue;
+		printf("%s{\"unit_size\": %lu, \"units\": %lu, "
+			"\"used_units\": %lu}", sep,
+			heap_class_to_size(class),
+			stats->class_stats[class].n_units,
+			stats->class_stats[class].n_used);
+		sep = ", ";
+	}
+
+	printf("]}");
+}
+
+/*
+ * info_obj_stats_json -- print statistics in JSON format
+ */
+static void
+info_obj_stats_json(struct pmem_info *pip)
+{
+	struct pmem_obj_stats *stats = &pip->obj.stats;
+	struct pmem_obj_zone_stats total;
+	memset(&total, 0, sizeof(total));
+
+	printf("{\n");
+	printf("  \"objects\": {\"count\": %lu, \"bytes\": %lu, "
+		"\"types\": [", stats->n_total_objects, stats->n_total_bytes);
+
+	const char *sep = "";
+	struct pmem_obj_type_stats *type_stats;
+	TAILQ_FOREACH(type_stats, &stats->type_stats, next) {
+		if (!type_stats->n_objects)
+			continue;
+		printf("%s{\"type_num\": %lu, \"count\": %lu, "
+			"\"bytes\": %lu}", sep, type_stats->type_num,
+			type_stats->n_objects, type_stats->n_bytes);
+		sep = ", ";
+	}
+	printf("]},\n");
+
+	printf("  \"zones\": {\"count\": %lu, \"used\": %lu},\n",
+		stats->n_zones, stats->n_zones_used);
+
+	printf("  \"zone_stats\": [");
+	for (uint64_t i = 0; i < stats->n_zones_used; i++) {
+		printf(i ? ",\n    " : "\n    ");
+		info_obj_stats_json_zone(&stats->zone_stats[i]);
+		info_obj_add_zone_stats(&total, &stats->zone_stats[i]);
+	}
+	printf("\n  ],\n");
+
+	printf("  \"total\": ");
+	info_obj_stats_json_zone(&total);
+	printf("\n}\n");
+}
+
 static struct pmem_info *Pip;
 #ifndef _WIN32
 static void
@@ -1196,7 +1583,11 @@ pmempool_info_obj(struct pmem_info *pip)
 	info_obj_root_obj(pip);
 	info_obj_heap(pip);
 	info_obj_zones_chunks(pip);
-	info_obj_stats(pip);
+
+	if (pip->args.obj.json)
+		info_obj_stats_json(pip);
+	else
+		info_obj_stats(pip);
 
 	return 0;
 }
@@ -48,6 +48,7 @@
 #include "dump.h"
 #include "check.h"
 #include "rm.h"
+#include "sync.h"
 #include "convert.h"
 
 #define APPNAME	"pmempool"
@@ -146,6 +147,12 @@ static struct command commands[] = {
 		.func = pmempool_convert_func,
 		.help = pmempool_convert_help,
 	},
+	{
+		.name = "sync",
+		.brief = "synchronize replicas of a poolset",
+		.func = pmempool_sync_func,
+		.help = pmempool_sync_help,
+	},
 	{
 		.name = "help",
 		.brief = "print help text about a command",
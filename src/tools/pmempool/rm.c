@@ -46,6 +46,8 @@
 #include "rm.h"
 
 #include "set.h"
+#include "file.h"
+#include "libpmem.h"
 
 enum ask_type {
 	ASK_SOMETIMES,	/* ask before removing write-protected files */
@@ -106,6 +108,24 @@ pmempool_rm_help(char *appname)
 	printf(help_str, appname);
 }
 
+/*
+ * rm_device_dax -- clear the pool header of a device DAX
+ *
+ * A device DAX cannot be removed, zeroing its pool header makes it
+ * possible to create a new pool on it.
+ */
+static void
+rm_device_dax(const char *file)
+{
+	size_t len;
+	void *addr = pmem_map_file(file, 0, 0, 0, &len, NULL);
+	if (addr == NULL)
+		err(1, "cannot map device DAX '%s'", file);
+
+	pmem_memset_persist(addr, 0, POOL_HDR_SIZE);
+	pmem_unmap(addr, len);
+}
+
 /*
  * rm_file -- remove single file
  */
@@ -127,6 +147,16 @@ rm_file(const char *file)
 	}
 
 	const char *pre_msg = write_protected ? "write-protected " : "";
+
+	if (util_file_is_device_dax(file)) {
+		if (ask_Yn(cask, "clear pool header of %sdevice DAX '%s' ?",
+				pre_msg, file) == 'y') {
+			rm_device_dax(file);
+			outv(1, "cleared '%s'\n", file);
+		}
+		return;
+	}
+
 	if (ask_Yn(cask, "remove %sfile '%s' ?", pre_msg, file) == 'y') {
 		if (unlink(file))
 			err(1, "cannot remove file '%s'", file);
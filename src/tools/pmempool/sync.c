@@ -0,0 +1,710 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sync.c -- pmempool sync command source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "output.h"
+#include "sync.h"
+
+#include "set.h"
+#include "file.h"
+#include "mtcopy.h"
+#include "libpmem.h"
+
+/* min length of a range copied by multiple threads */
+#define SYNC_MT_THRESHOLD ((size_t)4 << 20)
+
+/*
+ * sync_rep_state -- state of a replica
+ */
+enum sync_rep_state {
+	REP_HEALTHY,	/* all the headers are valid and consistent */
+	REP_DAMAGED,	/* some of the headers are broken */
+	REP_NEW,	/* some of the parts do not exist or are blank */
+};
+
+static const char *sync_rep_state_str[] = {
+	[REP_HEALTHY] = "healthy",
+	[REP_DAMAGED] = "damaged",
+	[REP_NEW] = "new",
+};
+
+/*
+ * sync_ctx -- context of the pool set synchronization
+ */
+struct sync_ctx {
+	struct pool_set *set;
+	enum sync_rep_state *state;	/* state of each replica */
+	struct pool_hdr **hdrs;		/* host order headers of each replica */
+	unsigned src;			/* replica the data is copied from */
+	size_t poolsize;		/* size of the data to synchronize */
+	size_t off;			/* offset of the pending range */
+	size_t len;			/* length of the pending range */
+	size_t copied;			/* total length of the copied ranges */
+};
+
+/* verbosity level */
+static int vlevel;
+/* only print the state of the replicas */
+static int dry_run;
+/* number of threads copying the data, 0 means number of CPUs */
+static unsigned nthreads;
+
+/* help message */
+static const char *help_str =
+"Synchronize the replicas of a pool set\n"
+"\n"
+"Rebuilds the replicas whose parts are missing or have damaged headers from\n"
+"a healthy replica. Replicas added to or removed from the pool set file are\n"
+"created or unlinked from the remaining ones.\n"
+"\n"
+"Available options:\n"
+"  -d, --dry-run      Only print the state of the replicas.\n"
+"  -t, --threads <n>  Number of threads copying the data.\n"
+"  -v, --verbose      Be verbose.\n"
+"  -h, --help         Print this help message.\n"
+"\n"
+"For complete documentation see %s-sync(1) manual page.\n";
+
+/* short options string */
+static const char *optstr = "dt:vh";
+/* long options */
+static const struct option long_options[] = {
+	{"dry-run",	no_argument,		0, 'd'},
+	{"threads",	required_argument,	0, 't'},
+	{"verbose",	no_argument,		0, 'v'},
+	{"help",	no_argument,		0, 'h'},
+	{NULL,		0,			0,  0 },
+};
+
+/*
+ * print_usage -- print usage message
+ */
+static void
+print_usage(const char *appname)
+{
+	printf("Usage: %s sync [<args>] <poolset>\n", appname);
+}
+
+/*
+ * pmempool_sync_help -- print help message
+ */
+void
+pmempool_sync_help(char *appname)
+{
+	print_usage(appname);
+	printf(help_str, appname);
+}
+
+/*
+ * sync_open_parts -- (internal) open the part files and map their headers
+ *
+ * The missing part files are created, unless it is a dry run, with the same
+ * permissions as the pool set file.
+ */
+static int
+sync_open_parts(struct sync_ctx *ctx, const char *path)
+{
+	struct stat stbuf;
+	if (stat(path, &stbuf) != 0) {
+		outv_err("stat '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct pool_set *set = ctx->set;
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+		for (unsigned p = 0; p < rep->nparts; p++) {
+			struct pool_set_part *part = &rep->part[p];
+			if (dry_run && access(part->path, F_OK) != 0) {
+				outv(2, "missing part '%s'\n", part->path);
+				ctx->state[r] = REP_NEW;
+				continue;
+			}
+
+			if (util_poolset_file(part, 0, 1) != 0) {
+				outv_err("cannot open part '%s': %s\n",
+					part->path, strerror(errno));
+				return -1;
+			}
+
+			if (part->created) {
+				outv(1, "created part '%s'\n", part->path);
+				if (fchmod(part->fd, stbuf.st_mode & 0777)) {
+					outv_err("chmod '%s': %s\n",
+						part->path, strerror(errno));
+					return -1;
+				}
+				ctx->state[r] = REP_NEW;
+			}
+
+			if (util_map_hdr(part, MAP_SHARED) != 0) {
+				outv_err("cannot map header of '%s': %s\n",
+					part->path, strerror(errno));
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * sync_check_replica -- (internal) check the headers of a replica
+ *
+ * A replica is healthy if the headers of all its parts are valid, describe
+ * the same pool and link the parts in the order of the pool set file.
+ */
+static enum sync_rep_state
+sync_check_replica(struct sync_ctx *ctx, unsigned r)
+{
+	struct pool_replica *rep = ctx->set->replica[r];
+	struct pool_hdr *hdrs = ctx->hdrs[r];
+	int blank = 1;
+
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		void *hdrp = rep->part[p].hdr;
+		if (hdrp == NULL)
+			return REP_NEW;
+
+		if (!util_is_zeroed(hdrp, sizeof(struct pool_hdr)))
+			blank = 0;
+
+		memcpy(&hdrs[p], hdrp, sizeof(hdrs[p]));
+	}
+
+	if (blank)
+		return REP_NEW;
+
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		if (!util_convert_hdr(&hdrs[p])) {
+			outv(2, "replica %u part %u: invalid header\n", r, p);
+			return REP_DAMAGED;
+		}
+	}
+
+	for (unsigned p = 0; p < rep->nparts; p++) {
+		struct pool_hdr *hdrp = &hdrs[p];
+		struct pool_hdr *prevp = &hdrs[(rep->nparts + p - 1) %
+			rep->nparts];
+		struct pool_hdr *nextp = &hdrs[(p + 1) % rep->nparts];
+
+		if (memcmp(hdrp->signature, hdrs[0].signature,
+				POOL_HDR_SIG_LEN) ||
+		    hdrp->major != hdrs[0].major ||
+		    hdrp->compat_features != hdrs[0].compat_features ||
+		    hdrp->incompat_features != hdrs[0].incompat_features ||
+		    hdrp->ro_compat_features != hdrs[0].ro_compat_features ||
+		    memcmp(hdrp->poolset_uuid, hdrs[0].poolset_uuid,
+				POOL_HDR_UUID_LEN)) {
+			outv(2, "replica %u part %u: header does not match "
+				"the first part\n", r, p);
+			return REP_DAMAGED;
+		}
+
+		if (memcmp(hdrp->prev_part_uuid, prevp->uuid,
+				POOL_HDR_UUID_LEN) ||
+		    memcmp(hdrp->next_part_uuid, nextp->uuid,
+				POOL_HDR_UUID_LEN)) {
+			outv(2, "replica %u part %u: invalid part links\n",
+				r, p);
+			return REP_DAMAGED;
+		}
+
+		if (hdrp->stripe_size != rep->stripe_size) {
+			outv(2, "replica %u part %u: stripe size does not "
+				"match the pool set file\n", r, p);
+			return REP_DAMAGED;
+		}
+	}
+
+	if (util_check_arch_flags(&hdrs[0].arch_flags)) {
+		outv(2, "replica %u: incompatible architecture\n", r);
+		return REP_DAMAGED;
+	}
+
+	return REP_HEALTHY;
+}
+
+/*
+ * sync_check -- (internal) check the state of all the replicas and choose
+ *	the one the data is copied from
+ */
+static int
+sync_check(struct sync_ctx *ctx)
+{
+	struct pool_set *set = ctx->set;
+	int found = 0;
+
+	ctx->poolsize = SIZE_MAX;
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (ctx->state[r] != REP_NEW)
+			ctx->state[r] = sync_check_replica(ctx, r);
+
+		outv(1, "replica %u: %s\n", r,
+			sync_rep_state_str[ctx->state[r]]);
+
+		if (ctx->state[r] != REP_HEALTHY)
+			continue;
+
+		if (!found) {
+			ctx->src = r;
+			found = 1;
+		} else if (memcmp(ctx->hdrs[r][0].poolset_uuid,
+				ctx->hdrs[ctx->src][0].poolset_uuid,
+				POOL_HDR_UUID_LEN) ||
+			memcmp(ctx->hdrs[r][0].signature,
+				ctx->hdrs[ctx->src][0].signature,
+				POOL_HDR_SIG_LEN)) {
+			outv_err("replicas %u and %u belong to different "
+				"pools\n", ctx->src, r);
+			return -1;
+		}
+
+	}
+
+	if (!found) {
+		outv_err("no healthy replica found\n");
+		return -1;
+	}
+
+	/* the pool spans the smallest replica, as when it is opened */
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (set->replica[r]->repsize < ctx->poolsize)
+			ctx->poolsize = set->replica[r]->repsize;
+	}
+
+	return 0;
+}
+
+/*
+ * sync_flush -- (internal) copy the pending range to all the replicas
+ *	being rebuilt
+ */
+static void
+sync_flush(struct sync_ctx *ctx)
+{
+	if (ctx->len == 0)
+		return;
+
+	struct pool_set *set = ctx->set;
+	const char *src = set->replica[ctx->src]->part[0].addr;
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (ctx->state[r] == REP_HEALTHY)
+			continue;
+
+		struct pool_replica *rep = set->replica[r];
+		char *dst = rep->part[0].addr;
+		mtcopy_fn copy = rep->is_pmem ? pmem_memcpy_nodrain : memcpy;
+
+		if (util_mtcopy_enabled(ctx->len))
+			util_memcpy_mt(dst + ctx->off, src + ctx->off,
+				ctx->len, copy);
+		else
+			copy(dst + ctx->off, src + ctx->off, ctx->len);
+	}
+
+	ctx->copied += ctx->len;
+	ctx->len = 0;
+}
+
+/*
+ * sync_range -- (internal) schedule a range of the pool for copying
+ *
+ * Adjacent ranges are merged, so that they are copied at once.
+ */
+static void
+sync_range(struct sync_ctx *ctx, size_t off, size_t len)
+{
+	if (len == 0)
+		return;
+
+	if (ctx->len != 0 && ctx->off + ctx->len == off) {
+		ctx->len += len;
+		return;
+	}
+
+	sync_flush(ctx);
+	ctx->off = off;
+	ctx->len = len;
+}
+
+/*
+ * sync_obj_heap -- (internal) schedule the used part of a pmemobj heap
+ *
+ * The chunks marked as free and the zones past the high-water mark of
+ * the valid zones are never read by the library before they are
+ * initialized again, so they are skipped.
+ */
+static void
+sync_obj_heap(struct sync_ctx *ctx, char *src, size_t heap_offset,
+	size_t heap_size)
+{
+	struct heap_layout *layout = (struct heap_layout *)(src + heap_offset);
+	size_t heap_end = heap_offset + heap_size;
+
+	sync_range(ctx, heap_offset, offsetof(struct heap_layout, zone0));
+
+	unsigned max_zone = util_heap_max_zone(heap_size);
+	uint64_t mark = layout->zone0.header.zones_valid;
+	unsigned nzones = mark == 0 || mark - 1 > max_zone ?
+		max_zone : (unsigned)(mark - 1);
+
+	for (unsigned z = 0; z < nzones; z++) {
+		struct zone *zone = ZID_TO_ZONE(layout, z);
+		size_t zone_off = (size_t)((char *)zone - src);
+
+		/* zone header and all the chunk headers */
+		sync_range(ctx, zone_off, sizeof(struct zone));
+
+		if (zone->header.magic != ZONE_HEADER_MAGIC)
+			continue;
+
+		size_t chunks_off = zone_off + sizeof(struct zone);
+		uint32_t size_idx = zone->header.size_idx;
+		if (size_idx > MAX_CHUNK)
+			size_idx = MAX_CHUNK;
+		if (chunks_off + (size_t)size_idx * CHUNKSIZE > heap_end)
+			size_idx = (uint32_t)((heap_end - chunks_off) /
+				CHUNKSIZE);
+
+		uint32_t c = 0;
+		while (c < size_idx) {
+			struct chunk_header *hdr = &zone->chunk_headers[c];
+			uint32_t n = hdr->size_idx ? hdr->size_idx : 1;
+			if (n > size_idx - c)
+				n = size_idx - c;
+
+			if (hdr->type != CHUNK_TYPE_FREE)
+				sync_range(ctx, chunks_off + c * CHUNKSIZE,
+					n * CHUNKSIZE);
+			c += n;
+		}
+	}
+}
+
+/*
+ * sync_data -- (internal) copy the data of the pool from the source replica
+ *	to all the replicas being rebuilt
+ */
+static int
+sync_data(struct sync_ctx *ctx)
+{
+	struct pool_set *set = ctx->set;
+	char *src = set->replica[ctx->src]->part[0].addr;
+	struct pool_hdr *hdrp = &ctx->hdrs[ctx->src][0];
+
+	size_t off = POOL_HDR_SIZE;
+	if (memcmp(hdrp->signature, OBJ_HDR_SIG, POOL_HDR_SIG_LEN) == 0) {
+		PMEMobjpool *pop = (PMEMobjpool *)src;
+		size_t heap_offset = le64toh(pop->heap_offset);
+		size_t heap_size = le64toh(pop->heap_size);
+
+		if (heap_offset < off || heap_size < HEAP_MIN_SIZE ||
+		    heap_offset + heap_size > ctx->poolsize) {
+			outv_err("heap does not fit in the smallest "
+				"replica\n");
+			return -1;
+		}
+
+		sync_range(ctx, off, heap_offset - off);
+		sync_obj_heap(ctx, src, heap_offset, heap_size);
+		off = heap_offset + heap_size;
+	}
+	sync_range(ctx, off, ctx->poolsize - off);
+	sync_flush(ctx);
+
+	int drain = 0;
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (ctx->state[r] == REP_HEALTHY)
+			continue;
+
+		struct pool_replica *rep = set->replica[r];
+		if (rep->is_pmem)
+			drain = 1;
+		else
+			pmem_msync(rep->part[0].addr, ctx->poolsize);
+	}
+
+	if (drain)
+		pmem_drain();
+
+	return 0;
+}
+
+/*
+ * sync_write_hdr -- (internal) write the header of a part, linking it with
+ *	the neighbouring parts and replicas
+ */
+static void
+sync_write_hdr(struct sync_ctx *ctx, unsigned r, unsigned p)
+{
+	struct pool_set *set = ctx->set;
+	struct pool_replica *rep = set->replica[r];
+	struct pool_hdr *hdrp = &ctx->hdrs[r][p];
+
+	memcpy(hdrp->uuid, PART(rep, p).uuid, POOL_HDR_UUID_LEN);
+	memcpy(hdrp->prev_part_uuid, PART(rep, p - 1).uuid, POOL_HDR_UUID_LEN);
+	memcpy(hdrp->next_part_uuid, PART(rep, p + 1).uuid, POOL_HDR_UUID_LEN);
+	memcpy(hdrp->prev_repl_uuid, PART(REP(set, r - 1), 0).uuid,
+		POOL_HDR_UUID_LEN);
+	memcpy(hdrp->next_repl_uuid, PART(REP(set, r + 1), 0).uuid,
+		POOL_HDR_UUID_LEN);
+
+	struct pool_hdr hdr = *hdrp;
+	util_convert2le_hdr(&hdr);
+	util_checksum(&hdr, sizeof(hdr), &hdr.checksum, 1);
+
+	memcpy(PART(rep, p).hdr, &hdr, sizeof(hdr));
+	pmem_msync(PART(rep, p).hdr, sizeof(hdr));
+}
+
+/*
+ * sync_hdrs -- (internal) write the headers of the rebuilt replicas and
+ *	link all the replicas in the order of the pool set file
+ *
+ * The header of the first part of a rebuilt replica is written last, so
+ * an interrupted synchronization leaves the replica damaged.
+ */
+static int
+sync_hdrs(struct sync_ctx *ctx)
+{
+	struct pool_set *set = ctx->set;
+	struct pool_hdr *tmpl = &ctx->hdrs[ctx->src][0];
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+		for (unsigned p = 0; p < rep->nparts; p++) {
+			if (ctx->state[r] == REP_HEALTHY) {
+				memcpy(rep->part[p].uuid, ctx->hdrs[r][p].uuid,
+					POOL_HDR_UUID_LEN);
+			} else if (util_uuid_generate(rep->part[p].uuid)) {
+				outv_err("cannot generate uuid\n");
+				return -1;
+			}
+		}
+	}
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+		if (ctx->state[r] == REP_HEALTHY)
+			continue;
+
+		for (unsigned p = 0; p < rep->nparts; p++) {
+			struct pool_hdr *hdrp = &ctx->hdrs[r][p];
+			*hdrp = *tmpl;
+			hdrp->stripe_size = rep->stripe_size;
+			if (rep->stripe_size != 0)
+				hdrp->incompat_features |= POOL_FEAT_STRIPED;
+			else
+				hdrp->incompat_features &= ~POOL_FEAT_STRIPED;
+		}
+
+		for (unsigned p = rep->nparts - 1; p > 0; p--)
+			sync_write_hdr(ctx, r, p);
+		sync_write_hdr(ctx, r, 0);
+
+		outv(1, "replica %u: rebuilt\n", r);
+	}
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (ctx->state[r] != REP_HEALTHY)
+			continue;
+
+		struct pool_replica *rep = set->replica[r];
+		const unsigned char *prev = PART(REP(set, r - 1), 0).uuid;
+		const unsigned char *next = PART(REP(set, r + 1), 0).uuid;
+		struct pool_hdr *hdrp = &ctx->hdrs[r][0];
+		if (!memcmp(hdrp->prev_repl_uuid, prev, POOL_HDR_UUID_LEN) &&
+		    !memcmp(hdrp->next_repl_uuid, next, POOL_HDR_UUID_LEN))
+			continue;
+
+		for (unsigned p = 0; p < rep->nparts; p++)
+			sync_write_hdr(ctx, r, p);
+
+		outv(1, "replica %u: relinked\n", r);
+	}
+
+	return 0;
+}
+
+/*
+ * sync_poolset -- (internal) synchronize the replicas of a pool set
+ */
+static int
+sync_poolset(struct sync_ctx *ctx, const char *path)
+{
+	struct pool_set *set = ctx->set;
+
+	if (sync_open_parts(ctx, path))
+		return -1;
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		ctx->hdrs[r] = calloc(set->replica[r]->nparts,
+			sizeof(struct pool_hdr));
+		if (ctx->hdrs[r] == NULL)
+			err(1, "Cannot allocate memory for pool headers");
+	}
+
+	if (sync_check(ctx))
+		return -1;
+
+	if (dry_run)
+		return 0;
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (util_replica_open(set, r, MAP_SHARED)) {
+			outv_err("cannot map replica %u: %s\n", r,
+				strerror(errno));
+			return -1;
+		}
+	}
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		if (ctx->state[r] == REP_HEALTHY)
+			continue;
+
+		if (sync_data(ctx))
+			return -1;
+		outv(1, "copied %zu bytes\n", ctx->copied);
+		break;
+	}
+
+	return sync_hdrs(ctx);
+}
+
+/*
+ * pmempool_sync_func -- main function for sync command
+ */
+int
+pmempool_sync_func(char *appname, int argc, char *argv[])
+{
+	int opt;
+	while ((opt = getopt_long(argc, argv, optstr,
+			long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'd':
+			dry_run = 1;
+			break;
+		case 't': {
+			char *end;
+			errno = 0;
+			unsigned long val = strtoul(optarg, &end, 10);
+			if (errno || *end != '\0' || val == 0 ||
+			    val > MTCOPY_THREADS_MAX) {
+				outv_err("invalid number of threads -- '%s'\n",
+					optarg);
+				return -1;
+			}
+			nthreads = (unsigned)val;
+			break;
+		}
+		case 'v':
+			vlevel++;
+			break;
+		case 'h':
+			pmempool_sync_help(appname);
+			return 0;
+		default:
+			print_usage(appname);
+			return -1;
+		}
+	}
+
+	/* a dry run is pointless without the state of the replicas */
+	if (dry_run && vlevel == 0)
+		vlevel = 1;
+	out_set_vlevel(vlevel);
+
+	if (optind + 1 != argc) {
+		print_usage(appname);
+		return -1;
+	}
+
+	char *path = argv[optind];
+	if (util_is_poolset(path) != 1) {
+		outv_err("'%s' is not a pool set file\n", path);
+		return -1;
+	}
+
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus < 1 ? 1 : ncpus > MTCOPY_THREADS_MAX ?
+			MTCOPY_THREADS_MAX : (unsigned)ncpus;
+	}
+	Mtcopy_nthreads = nthreads;
+	Mtcopy_threshold = SYNC_MT_THRESHOLD;
+
+	struct sync_ctx ctx;
+	memset(&ctx, 0, sizeof(ctx));
+
+	if (util_poolset_read(&ctx.set, path)) {
+		outv_err("cannot parse pool set file '%s'\n", path);
+		return -1;
+	}
+
+	int ret = -1;
+	if (ctx.set->remote) {
+		outv_err("synchronization of remote replicas is not "
+			"supported\n");
+		goto out_set;
+	}
+
+	ctx.state = calloc(ctx.set->nreplicas, sizeof(*ctx.state));
+	ctx.hdrs = calloc(ctx.set->nreplicas, sizeof(*ctx.hdrs));
+	if (ctx.state == NULL || ctx.hdrs == NULL)
+		err(1, "Cannot allocate memory for replicas");
+
+	ret = sync_poolset(&ctx, path);
+
+	for (unsigned r = 0; r < ctx.set->nreplicas; r++)
+		free(ctx.hdrs[r]);
+	free(ctx.hdrs);
+	free(ctx.state);
+out_set:
+	util_poolset_close(ctx.set, 0);
+	return ret;
+}
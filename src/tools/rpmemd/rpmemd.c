@@ -137,6 +137,19 @@ rpmemd_get_pm(struct rpmemd_config *config)
 	return ret;
 }
 
+/*
+ * rpmemd_persist_drain -- (internal) persist function for the platforms with
+ *	the non-allocating writes enabled
+ *
+ * The RDMA writes of the range bypass the CPU caches and have completed by
+ * the time the persist message is received, so there is nothing to flush.
+ */
+static void
+rpmemd_persist_drain(const void *addr, size_t len)
+{
+	pmem_drain();
+}
+
 /*
  * rpmemd_db_get_status -- convert error number to status for db operation
  */
@@ -493,6 +506,8 @@ rpmemd_print_info(struct rpmemd *rpmemd)
 		bool2str(rpmemd->config.persist_apm));
 	RPMEMD_DBG("\tpersist GPSPM: %s",
 		bool2str(rpmemd->config.persist_general));
+	RPMEMD_DBG("\tpersist non-allocating writes: %s",
+		bool2str(rpmemd->config.persist_nonalloc));
 	RPMEMD_DBG("\tuse syslog: %s", bool2str(rpmemd->config.use_syslog));
 	RPMEMD_DBG("\tlog file: %s", _str(rpmemd->config.log_file));
 	RPMEMD_DBG("\tlog level: %s",
@@ -536,7 +551,8 @@ main(int argc, char *argv[])
 	}
 
 	RPMEMD_LOG(INFO, "%s version %s", DAEMON_NAME, SRCVERSION);
-	rpmemd->persist = pmem_persist;
+	rpmemd->persist = rpmemd->config.persist_nonalloc ?
+		rpmemd_persist_drain : pmem_persist;
 	rpmemd->persist_method = rpmemd_get_pm(&rpmemd->config);
 	rpmemd->nthreads = rpmemd_get_nthreads();
 	if (!rpmemd->nthreads) {
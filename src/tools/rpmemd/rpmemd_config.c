@@ -64,6 +64,7 @@ enum rpmemd_option {
 	RPD_OPT_POOLSET_DIR,
 	RPD_OPT_PERSIST_APM,
 	RPD_OPT_PERSIST_GENERAL,
+	RPD_OPT_PERSIST_NONALLOC,
 	RPD_OPT_USE_SYSLOG,
 	RPD_OPT_LOG_LEVEL,
 
@@ -84,6 +85,7 @@ static const struct option options[] = {
 {"poolset-dir",		required_argument,	0, RPD_OPT_POOLSET_DIR},
 {"persist-apm",		no_argument,		0, RPD_OPT_PERSIST_APM},
 {"persist-general",	no_argument,		0, RPD_OPT_PERSIST_GENERAL},
+{"persist-nonalloc",	no_argument,		0, RPD_OPT_PERSIST_NONALLOC},
 {"use-syslog",		no_argument,		0, RPD_OPT_USE_SYSLOG},
 {"log-level",		required_argument,	0, RPD_OPT_LOG_LEVEL},
 {0,			0,			0, 0},
@@ -102,6 +104,7 @@ static const char *help_str =
 "      --poolset-dir <path>      pool set files directory\n"
 "      --persist-apm             enable Appliance Persistency Method\n"
 "      --persist-general         enable General Server Persistency Mechanism\n"
+"      --persist-nonalloc        GPSPM without flushes, non-allocating writes\n"
 "      --use-syslog              use syslog(3) for logging messages\n"
 "      --log-level <level>       set log level value\n"
 VALUE_INDENT "err     error conditions\n"
@@ -199,6 +202,9 @@ set_option(enum rpmemd_option option, const char *value,
 	case RPD_OPT_PERSIST_GENERAL:
 		parse_config_bool(&config->persist_general, value);
 		break;
+	case RPD_OPT_PERSIST_NONALLOC:
+		parse_config_bool(&config->persist_nonalloc, value);
+		break;
 	case RPD_OPT_USE_SYSLOG:
 		parse_config_bool(&config->use_syslog, value);
 		break;
@@ -558,6 +564,7 @@ config_set_default(struct rpmemd_config *config, const char *poolset_dir)
 
 	config->persist_apm	= false;
 	config->persist_general	= true;
+	config->persist_nonalloc	= false;
 	config->use_syslog	= true;
 	config->max_lanes	= RPMEM_DEFAULT_MAX_LANES;
 	config->log_level	= RPD_LOG_ERR;
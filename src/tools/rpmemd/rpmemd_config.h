@@ -59,6 +59,7 @@ struct rpmemd_config {
 	char *poolset_dir;
 	bool persist_apm;
 	bool persist_general;
+	bool persist_nonalloc;
 	bool use_syslog;
 	uint64_t max_lanes;
 	enum rpmemd_log_level log_level;
@@ -55,6 +55,7 @@
 #include "rpmem_fip_msg.h"
 #include "rpmem_fip_common.h"
 #include "rpmem_fip_lane.h"
+#include "rpmem_stats.h"
 #include "rpmemd_fip_worker.h"
 #include "rpmemd_fip.h"
 #include "rpmemd_log.h"
@@ -75,6 +76,12 @@
 	ret;\
 })
 
+/* number of empty completion queue polls before blocking on it */
+#define RPMEMD_FIP_CQ_SPIN	(1 << 10)
+
+/* max persist size processed by the completion queue thread itself */
+#define RPMEMD_FIP_INLINE_MAX	4096
+
 typedef int (*rpmemd_fip_init_fn)(struct rpmemd_fip *fip);
 typedef int (*rpmemd_fip_fini_fn)(struct rpmemd_fip *fip);
 typedef int (*rpmemd_fip_process_fn)(struct rpmemd_fip *fip);
@@ -98,6 +105,7 @@ struct rpmemd_fip_lane {
 	struct rpmem_fip_msg recv;	/* RECV message */
 	struct rpmem_fip_msg send;	/* SEND message */
 	struct rpmemd_fip_worker *worker; /* lane's worker */
+	struct rpmemd_fip_stats *stats;	/* statistics of lane's worker */
 };
 
 /*
@@ -138,6 +146,12 @@ struct rpmemd_fip {
 	pthread_t cq_thread;		/* completion queue thread */
 	struct fi_cq_msg_entry *cq_entries;	/* completion queue entries */
 	struct rpmemd_fip_worker **workers;	/* process workers */
+
+	/*
+	 * Statistics of process workers, the last entry is for persists
+	 * done by the completion queue thread.
+	 */
+	struct rpmemd_fip_stats *stats;
 };
 
 /*
@@ -713,19 +727,20 @@ rpmemd_fip_check_pmsg(struct rpmemd_fip *fip, struct rpmem_msg_persist *pmsg)
 }
 
 /*
- * rpmemd_fip_worker -- worker callback which processes persist
- * operation in GPSPM
+ * rpmemd_fip_persist_lane -- (internal) process persist operation received
+ * on the lane in GPSPM, accounting it in the given statistics
  */
 static int
-rpmemd_fip_worker(void *arg, void *data)
+rpmemd_fip_persist_lane(struct rpmemd_fip *fip, struct rpmemd_fip_lane *lanep,
+	struct rpmemd_fip_stats *stats)
 {
-	struct rpmemd_fip *fip = arg;
-	struct rpmemd_fip_lane *lanep = data;
-
 	int ret = 0;
 
 	/* wait until last SEND message has been processed */
+	uint64_t start = rpmem_stats_now();
 	rpmem_fip_lane_wait(&lanep->lane, FI_SEND);
+	uint64_t end = rpmem_stats_now();
+	stats->wait_ns += end - start;
 
 	/*
 	 * Get persist message and persist message response from appropriate
@@ -753,7 +768,17 @@ rpmemd_fip_worker(void *arg, void *data)
 	 * We could issue flush operation, do some other work like
 	 * posting RECV buffer and then call drain. Need to consider this.
 	 */
+	start = end;
 	fip->persist((void *)pmsg->addr, pmsg->size);
+	end = rpmem_stats_now();
+
+	uint64_t lat = end - start;
+	stats->npersists++;
+	stats->nbytes += pmsg->size;
+	stats->persist_ns += lat;
+	if (lat > stats->max_persist_ns)
+		stats->max_persist_ns = lat;
+	stats->hist[rpmem_stats_bucket(lat, RPMEMD_FIP_STATS_NBUCKETS)]++;
 
 	/* post lane's RECV buffer */
 	ret = rpmemd_fip_gpspm_post_msg(fip, &lanep->recv);
@@ -771,8 +796,42 @@ err:
 	return ret;
 }
 
+/*
+ * rpmemd_fip_worker -- worker callback which processes persist
+ * operation in GPSPM
+ */
+static int
+rpmemd_fip_worker(void *arg, void *data)
+{
+	struct rpmemd_fip *fip = arg;
+	struct rpmemd_fip_lane *lanep = data;
+
+	return rpmemd_fip_persist_lane(fip, lanep, lanep->stats);
+}
+
+/*
+ * rpmemd_fip_process_inline -- returns true if the persist message
+ * received on the lane should be processed by the completion queue thread
+ *
+ * Handing a small persist over to a worker costs more than the persist
+ * itself. The lane must not wait for its previous SEND completion, which
+ * only the completion queue thread can signal.
+ */
+static inline int
+rpmemd_fip_process_inline(struct rpmemd_fip_lane *lanep)
+{
+	struct rpmem_msg_persist *pmsg = rpmem_fip_msg_get_pmsg(&lanep->recv);
+
+	return pmsg->size <= RPMEMD_FIP_INLINE_MAX &&
+		!rpmem_fip_lane_busy(&lanep->lane);
+}
+
 /*
  * rpmemd_fip_cq_thread -- completion queue worker thread
+ *
+ * The completion queue is polled without blocking as long as it keeps
+ * delivering entries. Only after RPMEMD_FIP_CQ_SPIN empty polls in a row
+ * the thread blocks waiting for the next completion.
  */
 static void *
 rpmemd_fip_cq_thread(void *arg)
@@ -782,22 +841,31 @@ rpmemd_fip_cq_thread(void *arg)
 	const char *str_err;
 	ssize_t sret;
 	int ret = 0;
+	unsigned idle = 0;
 
 	while (!fip->closing) {
-		sret = fi_cq_sread(fip->cq, fip->cq_entries,
-				fip->cq_size, NULL,
-				RPMEM_FIP_CQ_WAIT_MS);
+		if (idle < RPMEMD_FIP_CQ_SPIN)
+			sret = fi_cq_read(fip->cq, fip->cq_entries,
+					fip->cq_size);
+		else
+			sret = fi_cq_sread(fip->cq, fip->cq_entries,
+					fip->cq_size, NULL,
+					RPMEM_FIP_CQ_WAIT_MS);
 		if (unlikely(fip->closing))
 			break;
 
-		if (unlikely(sret == -FI_EAGAIN))
+		if (sret == -FI_EAGAIN) {
+			idle++;
 			continue;
+		}
 
 		if (unlikely(sret < 0)) {
 			ret = (int)sret;
 			goto err_cq_read;
 		}
 
+		idle = 0;
+
 		for (ssize_t i = 0; i < sret; i++) {
 			struct fi_cq_msg_entry *entry = &fip->cq_entries[i];
 			RPMEMD_ASSERT(entry->op_context);
@@ -808,10 +876,16 @@ rpmemd_fip_cq_thread(void *arg)
 			if (entry->flags & FI_SEND)
 				rpmem_fip_lane_signal(&lanep->lane, FI_SEND);
 
-			/* add lane to worker's ring buffer */
 			if (entry->flags & FI_RECV) {
-				ret = rpmemd_fip_worker_push(lanep->worker,
-						lanep);
+				if (rpmemd_fip_process_inline(lanep)) {
+					/* persist small range right away */
+					ret = rpmemd_fip_persist_lane(fip,
+						lanep, &fip->stats[fip->nthreads]);
+				} else {
+					/* add lane to worker's ring buffer */
+					ret = rpmemd_fip_worker_push(
+							lanep->worker, lanep);
+				}
 			}
 
 			if (ret)
@@ -857,6 +931,14 @@ rpmemd_fip_process_start_gpspm(struct rpmemd_fip *fip)
 		goto err_alloc_workers;
 	}
 
+	/* one more entry for the completion queue thread */
+	fip->stats = calloc(fip->nthreads + 1, sizeof(*fip->stats));
+	if (!fip->stats) {
+		RPMEMD_LOG(ERR, "!allocating workers' statistics");
+		ret = -1;
+		goto err_alloc_stats;
+	}
+
 	/*
 	 * Initialize workers. Pass the closing flag as a flag for stopping
 	 * the worker threads.
@@ -876,6 +958,7 @@ rpmemd_fip_process_start_gpspm(struct rpmemd_fip *fip)
 	for (unsigned i = 0; i < fip->nlanes; i++) {
 		size_t wi = i % fip->nthreads;
 		fip->lanes[i].worker = fip->workers[wi];
+		fip->lanes[i].stats = &fip->stats[wi];
 	}
 
 	/* allocate buffer for completion queue entries */
@@ -902,10 +985,34 @@ err_cq_entries:
 err_worker:
 	for (size_t i = 0; i < wi; i++)
 		rpmemd_fip_worker_fini(fip->workers[i]);
+	free(fip->stats);
+	fip->stats = NULL;
+err_alloc_stats:
+	free(fip->workers);
 err_alloc_workers:
 	return ret;
 }
 
+/*
+ * rpmemd_fip_stats_log -- (internal) log persist statistics of all workers
+ */
+static void
+rpmemd_fip_stats_log(struct rpmemd_fip *fip)
+{
+	for (size_t i = 0; i <= fip->nthreads; i++) {
+		struct rpmemd_fip_stats *stats = &fip->stats[i];
+		if (!stats->npersists)
+			continue;
+
+		RPMEMD_LOG(INFO, "%s %zu: persists %lu bytes %lu "
+			"avg %lu ns max %lu ns wait %lu ns",
+			i < fip->nthreads ? "worker" : "cq thread", i,
+			stats->npersists, stats->nbytes,
+			stats->persist_ns / stats->npersists,
+			stats->max_persist_ns, stats->wait_ns);
+	}
+}
+
 /*
  * rpmemd_fip_process_stop_gpspm -- stop processing GPSPM messages
  */
@@ -951,6 +1058,8 @@ rpmemd_fip_process_stop_gpspm(struct rpmemd_fip *fip)
 
 	free(fip->workers);
 
+	rpmemd_fip_stats_log(fip);
+
 	return lret;
 }
 
@@ -1077,6 +1186,7 @@ void
 rpmemd_fip_fini(struct rpmemd_fip *fip)
 {
 	fip->ops->fini(fip);
+	free(fip->stats);
 	rpmemd_fip_fini_memory(fip);
 	rpmemd_fip_fini_fabric_res(fip);
 	fi_freeinfo(fip->fi);
@@ -1184,3 +1294,22 @@ rpmemd_fip_process_stop(struct rpmemd_fip *fip)
 {
 	return fip->ops->process_stop(fip);
 }
+
+/*
+ * rpmemd_fip_stats_get -- read GPSPM persist statistics of the worker,
+ * the worker equal to the number of threads selects the completion queue
+ * thread
+ */
+int
+rpmemd_fip_stats_get(struct rpmemd_fip *fip, size_t worker,
+	struct rpmemd_fip_stats *stats)
+{
+	if (!fip->stats || worker > fip->nthreads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*stats = fip->stats[worker];
+
+	return 0;
+}
@@ -35,9 +35,28 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct rpmemd_fip;
 
+/* number of buckets of the persist time histogram */
+#define RPMEMD_FIP_STATS_NBUCKETS	32
+
+/*
+ * rpmemd_fip_stats -- GPSPM persist statistics of a worker
+ *
+ * Bucket i of the histogram counts persists which took [2^i, 2^(i+1))
+ * nanoseconds.
+ */
+struct rpmemd_fip_stats {
+	uint64_t npersists;	/* persist messages processed */
+	uint64_t nbytes;	/* bytes persisted */
+	uint64_t persist_ns;	/* time spent in the persist function */
+	uint64_t max_persist_ns; /* longest persist */
+	uint64_t wait_ns;	/* time spent waiting for previous SEND */
+	uint64_t hist[RPMEMD_FIP_STATS_NBUCKETS]; /* persist time histogram */
+};
+
 struct rpmemd_fip_attr {
 	void *addr;
 	size_t size;
@@ -60,3 +79,5 @@ int rpmemd_fip_process_start(struct rpmemd_fip *fip);
 int rpmemd_fip_process_stop(struct rpmemd_fip *fip);
 int rpmemd_fip_wait_close(struct rpmemd_fip *fip, int timeout);
 int rpmemd_fip_close(struct rpmemd_fip *fip);
+int rpmemd_fip_stats_get(struct rpmemd_fip *fip, size_t worker,
+		struct rpmemd_fip_stats *stats);
@@ -102,6 +102,10 @@ rpmemd_fip_ring_push(struct rpmemd_fip_ring *ring, void *data)
 		return -1;
 
 	ring->data[ring->tail] = data;
+
+	/* publish the data before the slot */
+	__sync_synchronize();
+
 	ring->tail = (ring->tail + 1) % ring->nslots;
 
 	return 0;
@@ -116,6 +120,9 @@ rpmemd_fip_ring_pop(struct rpmemd_fip_ring *ring)
 	if (rpmemd_fip_ring_is_empty(ring))
 		return NULL;
 
+	/* do not read the data before the slot is published */
+	__sync_synchronize();
+
 	void *ret = ring->data[ring->head];
 
 	ring->head = (ring->head + 1) % ring->nslots;
@@ -42,8 +42,19 @@
 #define FATAL RPMEMD_FATAL
 #include "sys_util.h"
 
+/*
+ * Number of times the worker polls an empty ring buffer before it goes to
+ * sleep on the conditional variable.
+ */
+#define RPMEMD_FIP_WORKER_SPIN	(1 << 14)
+
 /*
  * rpmemd_fip_worker -- worker handle
+ *
+ * The ring buffer has a single producer (the completion queue thread) and
+ * a single consumer (the worker thread) so pushing and popping does not
+ * need the lock. The lock and conditional variable are used only to put
+ * an idle worker to sleep and to wake it up.
  */
 struct rpmemd_fip_worker {
 	volatile int *stop;
@@ -52,9 +63,41 @@ struct rpmemd_fip_worker {
 	pthread_t thread;
 	pthread_cond_t cond;
 	pthread_mutex_t lock;
+	volatile int sleeping;	/* worker waits on conditional variable */
 	rpmemd_fip_worker_fn func;
 };
 
+/*
+ * rpmemd_fip_worker_wait -- (internal) wait for incoming entries in ring
+ * buffer, spinning for a while before going to sleep
+ */
+static void
+rpmemd_fip_worker_wait(struct rpmemd_fip_worker *worker)
+{
+	for (unsigned i = 0; i < RPMEMD_FIP_WORKER_SPIN; i++) {
+		if (*worker->stop || !rpmemd_fip_ring_is_empty(worker->ring))
+			return;
+	}
+
+	util_mutex_lock(&worker->lock);
+
+	/*
+	 * The sleeping flag must be visible before checking the ring
+	 * buffer, the producer pushes before checking the flag.
+	 */
+	worker->sleeping = 1;
+	__sync_synchronize();
+
+	while (!(*worker->stop) &&
+		rpmemd_fip_ring_is_empty(worker->ring)) {
+		pthread_cond_wait(&worker->cond, &worker->lock);
+	}
+
+	worker->sleeping = 0;
+
+	util_mutex_unlock(&worker->lock);
+}
+
 /*
  * rpmemd_fip_worker_thread_func -- worker thread function callback
  */
@@ -65,20 +108,11 @@ rpmemd_fip_worker_thread_func(void *arg)
 	int ret = 0;
 
 	while (!(*worker->stop)) {
-		/*
-		 * Wait on conditional variable for incoming entries
-		 * in ring buffer.
-		 */
-		util_mutex_lock(&worker->lock);
-		while (!(*worker->stop) &&
-			rpmemd_fip_ring_is_empty(worker->ring)) {
-			pthread_cond_wait(&worker->cond, &worker->lock);
-		}
+		/* wait for incoming entries in ring buffer */
+		rpmemd_fip_worker_wait(worker);
 
 		void *data = rpmemd_fip_ring_pop(worker->ring);
 
-		util_mutex_unlock(&worker->lock);
-
 		/*
 		 * After setting stop flag the signal can be send to
 		 * stop the worker thread.
@@ -111,6 +145,7 @@ rpmemd_fip_worker_init(void *arg, volatile int *stop,
 	worker->stop = stop;
 	worker->arg = arg;
 	worker->func = func;
+	worker->sleeping = 0;
 
 	/* allocate a ring buffer */
 	worker->ring = rpmemd_fip_ring_alloc(size);
@@ -209,19 +244,22 @@ rpmemd_fip_worker_fini(struct rpmemd_fip_worker *worker)
 int
 rpmemd_fip_worker_push(struct rpmemd_fip_worker *worker, void *data)
 {
-	int ret;
-
-	util_mutex_lock(&worker->lock);
-	ret = rpmemd_fip_ring_push(worker->ring, data);
+	int ret = rpmemd_fip_ring_push(worker->ring, data);
 	if (ret)
-		goto unlock;
+		return ret;
 
+	/* the entry must be visible before checking the sleeping flag */
+	__sync_synchronize();
+
+	/* wake up the worker only if it went to sleep */
+	if (!worker->sleeping)
+		return 0;
+
+	util_mutex_lock(&worker->lock);
 	errno = pthread_cond_signal(&worker->cond);
-	if (errno) {
+	if (errno)
 		ret = -1;
-	}
-
-unlock:
 	util_mutex_unlock(&worker->lock);
+
 	return ret;
 }
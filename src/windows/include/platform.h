@@ -237,6 +237,15 @@ sched_yield(void)
 	return 0;		/* always succeeds */
 }
 
+/*
+ * sched_getcpu -- get the number of the CPU the thread is running on
+ */
+__inline int
+sched_getcpu(void)
+{
+	return (int)GetCurrentProcessorNumber();
+}
+
 /*
  * helper macros for library ctor/dtor function declarations
  */
@@ -54,6 +54,7 @@
 #define MAP_ANON	MAP_ANONYMOUS
 
 #define MAP_NORESERVE	0x04000
+#define MAP_POPULATE	0x08000
 
 #define MS_ASYNC	1
 #define MS_SYNC		4
@@ -96,6 +96,11 @@ pwrite(int fd, const void *buf, size_t count, off_t offset)
 	return ret;
 }
 
+/*
+ * fdatasync - windows port of fdatasync function
+ */
+#define fdatasync(fd) _commit(fd)
+
 #define S_ISBLK(x) 0 /* BLK devices not exist on Windows */
 
 /*
@@ -280,7 +280,7 @@ mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
 		munmap(addr, len);
 	}
 
-	/* XXX - MAP_NORESERVE */
+	/* XXX - MAP_NORESERVE, MAP_POPULATE */
 
 	HANDLE fh;
 	if (flags & MAP_ANON) {
@@ -327,6 +327,13 @@ mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
 			 */
 			void *reserved_addr = VirtualAlloc(addr, len,
 						MEM_RESERVE, PAGE_NOACCESS);
+
+			/* the hint might have been taken in the meantime */
+			if (reserved_addr == NULL && addr != NULL &&
+					(flags & MAP_FIXED) == 0)
+				reserved_addr = VirtualAlloc(NULL, len,
+						MEM_RESERVE, PAGE_NOACCESS);
+
 			if (reserved_addr == NULL) {
 				ERR("cannot find a contiguous region - "
 					"addr: %p, len: %lx, gle: 0x%08x",
@@ -674,6 +681,8 @@ msync(void *addr, size_t len, int flags)
 
 	WaitForSingleObject(FileMappingListMutex, INFINITE);
 
+	HANDLE fh = NULL; /* file whose buffers are yet to be flushed */
+
 	PFILE_MAPPING_TRACKER mt;
 	mt = (PFILE_MAPPING_TRACKER)LIST_FIRST(&FileMappingListHead);
 	while (len > 0 && mt != NULL) {
@@ -695,15 +704,29 @@ msync(void *addr, size_t len, int flags)
 			goto err;
 		}
 
-		if (FlushFileBuffers(mt->FileHandle) == FALSE) {
-			ERR("FlushFileBuffers, gle: 0x%08x", GetLastError());
-			goto err;
+		/*
+		 * A view split by mprotect or munmap ends up in a few trackers
+		 * of the same file, whose buffers need to be flushed only
+		 * once - that's the expensive part of msync.
+		 */
+		if (mt->FileHandle != fh) {
+			if (fh != NULL && FlushFileBuffers(fh) == FALSE) {
+				ERR("FlushFileBuffers, gle: 0x%08x",
+					GetLastError());
+				goto err;
+			}
+			fh = mt->FileHandle;
 		}
 
 		len -= len2;
 		mt = (PFILE_MAPPING_TRACKER)LIST_NEXT(mt, ListEntry);
 	}
 
+	if (fh != NULL && FlushFileBuffers(fh) == FALSE) {
+		ERR("FlushFileBuffers, gle: 0x%08x", GetLastError());
+		goto err;
+	}
+
 	if (len > 0) {
 		ERR("indicated memory (or part of it) was not mapped");
 		errno = ENOMEM;